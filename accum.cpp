@@ -0,0 +1,930 @@
+#include "accum.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "ring.h"
+#include "simd.h"
+
+int accum_init(Accum_t* accum, int width, int height)
+{
+    if (accum == NULL || width <= 0 || height <= 0)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    memset(accum, 0, sizeof(Accum_t));
+    size_t pix_num = (size_t)width * height;
+    accum->width = width;
+    accum->height = height;
+    accum->ref = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    accum->sum = (uint32_t*)malloc(pix_num * sizeof(uint32_t));
+    accum->sq = (uint64_t*)malloc(pix_num * sizeof(uint64_t));
+    accum->consumer_id = -1;
+    if (accum->ref == NULL || accum->sum == NULL || accum->sq == NULL)
+    {
+        free(accum->ref);
+        free(accum->sum);
+        free(accum->sq);
+        accum->ref = NULL;
+        return ACCUM_ERROR_MEM;
+    }
+    pthread_mutex_init(&accum->mutex, NULL);
+    pthread_cond_init(&accum->cond, NULL);
+    return ACCUM_SUCCESS;
+}
+
+void accum_release(Accum_t* accum)
+{
+    if (accum == NULL || accum->ref == NULL)
+    {
+        return;
+    }
+    free(accum->ref);
+    free(accum->sum);
+    free(accum->sq);
+    accum->ref = NULL;
+    accum->sum = NULL;
+    accum->sq = NULL;
+    pthread_mutex_destroy(&accum->mutex);
+    pthread_cond_destroy(&accum->cond);
+}
+
+void accum_reset(Accum_t* accum)
+{
+    if (accum == NULL || accum->ref == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&accum->mutex);
+    accum->frames = 0;
+    pthread_mutex_unlock(&accum->mutex);
+}
+
+//called with the mutex held
+static void accum_add_locked(Accum_t* accum, const uint8_t* src, uint32_t stride)
+{
+    size_t width = (size_t)accum->width;
+    if (accum->frames == 0)
+    {
+        for (int y = 0; y < accum->height; y++)
+        {
+            memcpy(accum->ref + y * width, src + y * stride, width * sizeof(uint16_t));
+        }
+        memset(accum->sum, 0, width * accum->height * sizeof(uint32_t));
+        memset(accum->sq, 0, width * accum->height * sizeof(uint64_t));
+    }
+    for (int y = 0; y < accum->height; y++)
+    {
+        simd_accumulate_sq_u16((const uint16_t*)(src + y * stride), accum->ref + y * width, (int)width, \
+            accum->sum + y * width, accum->sq + y * width);
+    }
+    accum->frames++;
+}
+
+int accum_add(Accum_t* accum, const uint16_t* src, uint32_t stride)
+{
+    if (accum == NULL || accum->ref == NULL || src == NULL)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&accum->mutex);
+    int rst = ACCUM_ERROR_EMPTY;
+    if (accum->frames < ACCUM_MAX_FRAMES)
+    {
+        accum_add_locked(accum, (const uint8_t*)src, (stride > 0) ? stride : accum->width * sizeof(uint16_t));
+        rst = ACCUM_SUCCESS;
+    }
+    pthread_mutex_unlock(&accum->mutex);
+    return rst;
+}
+
+int accum_mean(Accum_t* accum, uint16_t* dst)
+{
+    if (accum == NULL || accum->ref == NULL || dst == NULL)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&accum->mutex);
+    uint32_t frames = accum->frames;
+    if (frames == 0)
+    {
+        pthread_mutex_unlock(&accum->mutex);
+        return ACCUM_ERROR_EMPTY;
+    }
+    int pix_num = accum->width * accum->height;
+    for (int i = 0; i < pix_num; i++)
+    {
+        dst[i] = (uint16_t)((accum->sum[i] + frames / 2) / frames);
+    }
+    pthread_mutex_unlock(&accum->mutex);
+    return ACCUM_SUCCESS;
+}
+
+int accum_noise(Accum_t* accum, float* dst, float* netd_mk)
+{
+    if (accum == NULL || accum->ref == NULL || (dst == NULL && netd_mk == NULL))
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&accum->mutex);
+    uint32_t frames = accum->frames;
+    if (frames < 2)
+    {
+        pthread_mutex_unlock(&accum->mutex);
+        return ACCUM_ERROR_EMPTY;
+    }
+    //var = (sum(d^2) - sum(d)^2 / n) / (n - 1) with d the difference to the reference frame
+    int pix_num = accum->width * accum->height;
+    double total = 0.0;
+    for (int i = 0; i < pix_num; i++)
+    {
+        double d_sum = (double)accum->sum[i] - (double)frames * accum->ref[i];
+        double var = ((double)accum->sq[i] - d_sum * d_sum / frames) / (frames - 1);
+        float std_dev = (var > 0.0) ? (float)sqrt(var) : 0.0f;
+        if (dst != NULL)
+        {
+            dst[i] = std_dev;
+        }
+        total += std_dev;
+    }
+    pthread_mutex_unlock(&accum->mutex);
+    if (netd_mk != NULL)
+    {
+        *netd_mk = (float)(total / pix_num * 1000.0 / 64);
+    }
+    return ACCUM_SUCCESS;
+}
+
+static void accum_task(FrameSlot_t* slot, void* arg)
+{
+    Accum_t* accum = (Accum_t*)arg;
+    const FramePlane_t* plane = (accum->plane == ACCUM_PLANE_TEMP) ? &slot->desc.temp : &slot->desc.image;
+    uint32_t invalid = (accum->plane == ACCUM_PLANE_TEMP) ? FRAME_DESC_TEMP_INVALID : FRAME_DESC_IMAGE_INVALID;
+    pthread_mutex_lock(&accum->mutex);
+    uint32_t target = (accum->target > 0) ? accum->target : ACCUM_MAX_FRAMES;
+    if (accum->running && plane->data != NULL && !(slot->desc.flags & invalid) && \
+        (int)plane->width == accum->width && (int)plane->height == accum->height)
+    {
+        accum_add_locked(accum, plane->data, plane->stride);
+        if (accum->frames >= target)
+        {
+            accum->running = 0;
+            pthread_cond_broadcast(&accum->cond);
+        }
+    }
+    pthread_mutex_unlock(&accum->mutex);
+}
+
+int accum_attach(Accum_t* accum, StreamFrameInfo_t* stream_frame_info, AccumPlane_t plane)
+{
+    if (accum == NULL || accum->ref == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    accum->stream_frame_info = stream_frame_info;
+    accum->plane = plane;
+    accum->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, \
+        POOL_STAGE_TEMPERATURE, accum_task, accum);
+    return (accum->consumer_id >= 0) ? ACCUM_SUCCESS : ACCUM_ERROR_PARAM;
+}
+
+int accum_start(Accum_t* accum, uint32_t frames)
+{
+    if (accum == NULL || accum->ref == NULL || frames > ACCUM_MAX_FRAMES)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&accum->mutex);
+    accum->frames = 0;
+    accum->target = frames;
+    accum->running = 1;
+    pthread_mutex_unlock(&accum->mutex);
+    return ACCUM_SUCCESS;
+}
+
+void accum_stop(Accum_t* accum)
+{
+    if (accum == NULL || accum->ref == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&accum->mutex);
+    accum->running = 0;
+    pthread_cond_broadcast(&accum->cond);
+    pthread_mutex_unlock(&accum->mutex);
+}
+
+int accum_wait(Accum_t* accum, uint32_t timeout_ms)
+{
+    if (accum == NULL || accum->ref == NULL)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    struct timespec deadline;
+#if defined(_WIN32)
+    timespec_get(&deadline, TIME_UTC);
+#else
+    clock_gettime(CLOCK_REALTIME, &deadline);
+#endif
+    deadline.tv_sec += (time_t)(timeout_ms / 1000);
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&accum->mutex);
+    while (accum->running)
+    {
+        if (timeout_ms == 0)
+        {
+            pthread_cond_wait(&accum->cond, &accum->mutex);
+        }
+        else if (pthread_cond_timedwait(&accum->cond, &accum->mutex, &deadline) != 0)
+        {
+            break;
+        }
+    }
+    int frames = (int)accum->frames;
+    pthread_mutex_unlock(&accum->mutex);
+    return frames;
+}
+
+int accum_window_init(AccumWindow_t* accum_window, uint32_t window)
+{
+    if (accum_window == NULL || window == 0 || window > ACCUM_WINDOW_MAX)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    memset(accum_window, 0, sizeof(AccumWindow_t));
+    accum_window->window = window;
+    return ACCUM_SUCCESS;
+}
+
+void accum_window_release(AccumWindow_t* accum_window)
+{
+    if (accum_window == NULL)
+    {
+        return;
+    }
+    free(accum_window->history);
+    free(accum_window->sum);
+    accum_window->history = NULL;
+    accum_window->sum = NULL;
+    accum_window->pix_num = 0;
+    accum_window->count = 0;
+}
+
+void accum_window_reset(AccumWindow_t* accum_window)
+{
+    if (accum_window != NULL)
+    {
+        accum_window->count = 0;
+        accum_window->head = 0;
+    }
+}
+
+int accum_window_process(AccumWindow_t* accum_window, const uint16_t* src, int pix_num, uint16_t* dst)
+{
+    if (accum_window == NULL || accum_window->window == 0 || src == NULL || dst == NULL || pix_num <= 0)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    if (accum_window->pix_num != pix_num)
+    {
+        accum_window_release(accum_window);
+        accum_window->history = (uint16_t*)malloc((size_t)pix_num * accum_window->window * sizeof(uint16_t));
+        accum_window->sum = (uint32_t*)malloc((size_t)pix_num * sizeof(uint32_t));
+        if (accum_window->history == NULL || accum_window->sum == NULL)
+        {
+            accum_window_release(accum_window);
+            return ACCUM_ERROR_MEM;
+        }
+        accum_window->pix_num = pix_num;
+    }
+    uint16_t* slot = accum_window->history + (size_t)accum_window->head * pix_num;
+    if (accum_window->count == 0)
+    {
+        memset(accum_window->sum, 0, (size_t)pix_num * sizeof(uint32_t));
+    }
+    if (accum_window->count == accum_window->window)
+    {
+        //the oldest frame leaves the sum as the new one comes in
+        simd_window_u16(src, slot, pix_num, accum_window->sum);
+    }
+    else
+    {
+        simd_accumulate_u16(src, pix_num, accum_window->sum);
+        accum_window->count++;
+    }
+    memcpy(slot, src, (size_t)pix_num * sizeof(uint16_t));
+    accum_window->head = (accum_window->head + 1) % accum_window->window;
+
+    uint32_t count = accum_window->count;
+    const uint32_t* sum = accum_window->sum;
+    if ((count & (count - 1)) == 0)
+    {
+        int shift = 0;
+        while ((1u << shift) < count)
+        {
+            shift++;
+        }
+        for (int i = 0; i < pix_num; i++)
+        {
+            dst[i] = (uint16_t)((sum[i] + (count >> 1)) >> shift);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < pix_num; i++)
+        {
+            dst[i] = (uint16_t)((sum[i] + count / 2) / count);
+        }
+    }
+    return ACCUM_SUCCESS;
+}
+
+int accum_hold_init(AccumHold_t* hold, int width, int height, uint16_t decay)
+{
+    if (hold == NULL || width <= 0 || height <= 0)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    memset(hold, 0, sizeof(AccumHold_t));
+    size_t pix_num = (size_t)width * height;
+    hold->width = width;
+    hold->height = height;
+    hold->decay = decay;
+    hold->max_val = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    hold->min_val = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    hold->consumer_id = -1;
+    if (hold->max_val == NULL || hold->min_val == NULL)
+    {
+        free(hold->max_val);
+        free(hold->min_val);
+        hold->max_val = NULL;
+        hold->min_val = NULL;
+        return ACCUM_ERROR_MEM;
+    }
+    pthread_mutex_init(&hold->mutex, NULL);
+    return ACCUM_SUCCESS;
+}
+
+void accum_hold_release(AccumHold_t* hold)
+{
+    if (hold == NULL || hold->max_val == NULL)
+    {
+        return;
+    }
+    free(hold->max_val);
+    free(hold->min_val);
+    hold->max_val = NULL;
+    hold->min_val = NULL;
+    pthread_mutex_destroy(&hold->mutex);
+}
+
+void accum_hold_reset(AccumHold_t* hold)
+{
+    if (hold == NULL || hold->max_val == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&hold->mutex);
+    hold->frames = 0;
+    pthread_mutex_unlock(&hold->mutex);
+}
+
+void accum_hold_decay(AccumHold_t* hold, uint16_t decay)
+{
+    if (hold == NULL || hold->max_val == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&hold->mutex);
+    hold->decay = decay;
+    pthread_mutex_unlock(&hold->mutex);
+}
+
+//called with the mutex held, the frame's only pass: read it, read and write both images
+static void accum_hold_add_locked(AccumHold_t* hold, const uint8_t* src, uint32_t stride, uint64_t timestamp_us)
+{
+    size_t width = (size_t)hold->width;
+    for (int y = 0; y < hold->height; y++)
+    {
+        const uint16_t* row = (const uint16_t*)(src + y * stride);
+        if (hold->frames == 0)
+        {
+            memcpy(hold->max_val + y * width, row, width * sizeof(uint16_t));
+            memcpy(hold->min_val + y * width, row, width * sizeof(uint16_t));
+        }
+        else
+        {
+            simd_hold_u16(row, (int)width, hold->decay, hold->max_val + y * width, hold->min_val + y * width);
+        }
+    }
+    if (hold->frames == 0)
+    {
+        hold->first_us = timestamp_us;
+    }
+    hold->last_us = timestamp_us;
+    hold->frames = (hold->frames < UINT32_MAX) ? hold->frames + 1 : hold->frames;
+}
+
+int accum_hold_add(AccumHold_t* hold, const uint16_t* src, uint32_t stride, uint64_t timestamp_us)
+{
+    if (hold == NULL || hold->max_val == NULL || src == NULL)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&hold->mutex);
+    accum_hold_add_locked(hold, (const uint8_t*)src, (stride > 0) ? stride : hold->width * sizeof(uint16_t), \
+        timestamp_us);
+    pthread_mutex_unlock(&hold->mutex);
+    return ACCUM_SUCCESS;
+}
+
+int accum_hold_snapshot(AccumHold_t* hold, AccumHoldImage_t image, uint16_t* dst, uint32_t* frames)
+{
+    if (hold == NULL || hold->max_val == NULL || dst == NULL || (image != ACCUM_HOLD_MAX && image != ACCUM_HOLD_MIN))
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&hold->mutex);
+    if (hold->frames == 0)
+    {
+        pthread_mutex_unlock(&hold->mutex);
+        return ACCUM_ERROR_EMPTY;
+    }
+    memcpy(dst, (image == ACCUM_HOLD_MAX) ? hold->max_val : hold->min_val, \
+        (size_t)hold->width * hold->height * sizeof(uint16_t));
+    if (frames != NULL)
+    {
+        *frames = hold->frames;
+    }
+    pthread_mutex_unlock(&hold->mutex);
+    return ACCUM_SUCCESS;
+}
+
+static void accum_hold_task(FrameSlot_t* slot, void* arg)
+{
+    AccumHold_t* hold = (AccumHold_t*)arg;
+    const FramePlane_t* plane = (hold->plane == ACCUM_PLANE_TEMP) ? &slot->desc.temp : &slot->desc.image;
+    uint32_t invalid = (hold->plane == ACCUM_PLANE_TEMP) ? FRAME_DESC_TEMP_INVALID : FRAME_DESC_IMAGE_INVALID;
+    pthread_mutex_lock(&hold->mutex);
+    //a closed shutter's flat frame would be the min image of every pixel
+    if (hold->running && plane->data != NULL && !(slot->desc.flags & invalid) && \
+        (int)plane->width == hold->width && (int)plane->height == hold->height)
+    {
+        accum_hold_add_locked(hold, plane->data, plane->stride, slot->desc.timestamp_us);
+    }
+    pthread_mutex_unlock(&hold->mutex);
+}
+
+int accum_hold_attach(AccumHold_t* hold, StreamFrameInfo_t* stream_frame_info, AccumPlane_t plane)
+{
+    if (hold == NULL || hold->max_val == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    hold->stream_frame_info = stream_frame_info;
+    hold->plane = plane;
+    hold->running = 1;
+    hold->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, \
+        POOL_STAGE_TEMPERATURE, accum_hold_task, hold);
+    return (hold->consumer_id >= 0) ? ACCUM_SUCCESS : ACCUM_ERROR_PARAM;
+}
+
+void accum_hold_enable(AccumHold_t* hold, int enable)
+{
+    if (hold == NULL || hold->max_val == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&hold->mutex);
+    hold->running = (enable != 0);
+    pthread_mutex_unlock(&hold->mutex);
+}
+
+//snapshot worker: the image as the file's plane
+static int accum_hold_plane(AccumHold_t* hold, AccumHoldImage_t image, uint16_t* dst, uint32_t capacity, \
+    uint32_t* width, uint32_t* height)
+{
+    if ((uint32_t)hold->width * hold->height > capacity || accum_hold_snapshot(hold, image, dst, NULL) != ACCUM_SUCCESS)
+    {
+        return SNAPSHOT_ERROR_FRAME;
+    }
+    *width = (uint32_t)hold->width;
+    *height = (uint32_t)hold->height;
+    return SNAPSHOT_SUCCESS;
+}
+
+static int accum_hold_max_plane(void* arg, uint16_t* dst, uint32_t capacity, uint32_t* width, uint32_t* height)
+{
+    return accum_hold_plane((AccumHold_t*)arg, ACCUM_HOLD_MAX, dst, capacity, width, height);
+}
+
+static int accum_hold_min_plane(void* arg, uint16_t* dst, uint32_t capacity, uint32_t* width, uint32_t* height)
+{
+    return accum_hold_plane((AccumHold_t*)arg, ACCUM_HOLD_MIN, dst, capacity, width, height);
+}
+
+int accum_hold_export(AccumHold_t* hold, AccumHoldImage_t image, Snapshot_t* snapshot, const char* path, \
+    SnapshotFormat_t format)
+{
+    if (hold == NULL || hold->max_val == NULL || (image != ACCUM_HOLD_MAX && image != ACCUM_HOLD_MIN))
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    SnapshotPlane_t plane = (hold->plane == ACCUM_PLANE_TEMP) ? SNAPSHOT_PLANE_TEMP : SNAPSHOT_PLANE_IMAGE;
+    return snapshot_request_plane(snapshot, path, format, plane, \
+        (image == ACCUM_HOLD_MAX) ? accum_hold_max_plane : accum_hold_min_plane, hold);
+}
+
+int accum_rate_init(AccumRate_t* rate, int width, int height, const AccumRateParam_t* param)
+{
+    if (rate == NULL || width <= 0 || height <= 0 || param == NULL || param->level_shift > 16 || \
+        param->slope_shift > 8)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    memset(rate, 0, sizeof(AccumRate_t));
+    size_t pix_num = (size_t)width * height;
+    rate->width = width;
+    rate->height = height;
+    rate->param = *param;
+    rate->param.level_shift = (param->level_shift > 0) ? param->level_shift : ACCUM_RATE_LEVEL_SHIFT;
+    rate->param.slope_shift = (param->slope_shift > 0) ? param->slope_shift : ACCUM_RATE_SLOPE_SHIFT;
+    rate->level = (int32_t*)malloc(pix_num * sizeof(int32_t));
+    rate->slope = (int32_t*)malloc(pix_num * sizeof(int32_t));
+    rate->rate = (uint16_t*)calloc(pix_num, sizeof(uint16_t));
+    rate->consumer_id = -1;
+    TempDataRes_t temp_res = { (uint16_t)width, (uint16_t)height };
+    int rst = (rate->level != NULL && rate->slope != NULL && rate->rate != NULL) ? \
+        alarm_engine_init(&rate->engine, temp_res) : ALARM_ERROR_MEM;
+    if (rst == ALARM_SUCCESS)
+    {
+        rst = alarm_engine_start(&rate->engine, &rate->param.alarm);
+        if (rst != ALARM_SUCCESS)
+        {
+            alarm_engine_release(&rate->engine);
+        }
+    }
+    if (rst != ALARM_SUCCESS)
+    {
+        free(rate->level);
+        free(rate->slope);
+        free(rate->rate);
+        rate->level = NULL;
+        return (rst == ALARM_ERROR_MEM) ? ACCUM_ERROR_MEM : ACCUM_ERROR_PARAM;
+    }
+    pthread_mutex_init(&rate->mutex, NULL);
+    return ACCUM_SUCCESS;
+}
+
+void accum_rate_release(AccumRate_t* rate)
+{
+    if (rate == NULL || rate->level == NULL)
+    {
+        return;
+    }
+    alarm_engine_release(&rate->engine);
+    free(rate->level);
+    free(rate->slope);
+    free(rate->rate);
+    rate->level = NULL;
+    rate->slope = NULL;
+    rate->rate = NULL;
+    pthread_mutex_destroy(&rate->mutex);
+}
+
+void accum_rate_reset(AccumRate_t* rate)
+{
+    if (rate == NULL || rate->level == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&rate->mutex);
+    rate->frames = 0;
+    rate->reseed = 0;
+    alarm_engine_start(&rate->engine, &rate->param.alarm);
+    pthread_mutex_unlock(&rate->mutex);
+}
+
+//called with the mutex held
+static int accum_rate_add_locked(AccumRate_t* rate, const uint8_t* src, uint32_t stride, uint64_t seq, \
+    uint64_t timestamp_us)
+{
+    size_t width = (size_t)rate->width;
+    uint64_t gap_us = (rate->frames > 0 && timestamp_us > rate->last_us) ? timestamp_us - rate->last_us : 0;
+    if (rate->frames > 0 && (gap_us == 0 || gap_us > (uint64_t)ACCUM_RATE_GAP_MS * 1000))
+    {
+        rate->reseed = 1;
+    }
+    rate->last_us = timestamp_us;
+    if (rate->frames == 0 || rate->reseed)
+    {
+        //the first frame starts flat, after a gap the slope carries on from the new level
+        for (int y = 0; y < rate->height; y++)
+        {
+            const uint16_t* row = (const uint16_t*)(src + y * stride);
+            int32_t* level = rate->level + y * width;
+            for (size_t x = 0; x < width; x++)
+            {
+                level[x] = (int32_t)row[x] << 8;
+            }
+        }
+        if (rate->frames == 0)
+        {
+            memset(rate->slope, 0, width * rate->height * sizeof(int32_t));
+            rate->interval_us = 0;
+            rate->frames = 1;
+        }
+        rate->reseed = 0;
+        return 0;
+    }
+    rate->interval_us = (rate->interval_us == 0) ? (uint32_t)gap_us : \
+        (uint32_t)((int64_t)rate->interval_us + ((int64_t)gap_us - (int64_t)rate->interval_us) / 8);
+    //frames per second in Q4
+    uint32_t mul = (uint32_t)((16000000ull + rate->interval_us / 2) / rate->interval_us);
+    mul = (mul > 4095) ? 4095 : mul;
+    for (int y = 0; y < rate->height; y++)
+    {
+        simd_rate_u16((const uint16_t*)(src + y * stride), (int)width, rate->param.level_shift, \
+            rate->param.slope_shift, mul, rate->level + y * width, rate->slope + y * width, rate->rate + y * width);
+    }
+    rate->frames = (rate->frames < UINT32_MAX) ? rate->frames + 1 : rate->frames;
+    //the level and the slope settle before a rate is trusted
+    if (rate->frames <= (1u << rate->param.level_shift) + (1u << rate->param.slope_shift))
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&rate->engine.mutex);
+    int event_num = alarm_engine_process(&rate->engine, rate->rate, seq, timestamp_us);
+    pthread_mutex_unlock(&rate->engine.mutex);
+    return event_num;
+}
+
+int accum_rate_add(AccumRate_t* rate, const uint16_t* src, uint32_t stride, uint64_t seq, uint64_t timestamp_us)
+{
+    if (rate == NULL || rate->level == NULL || src == NULL)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&rate->mutex);
+    int rst = accum_rate_add_locked(rate, (const uint8_t*)src, (stride > 0) ? stride : rate->width * sizeof(uint16_t), \
+        seq, timestamp_us);
+    pthread_mutex_unlock(&rate->mutex);
+    return rst;
+}
+
+int accum_rate_snapshot(AccumRate_t* rate, uint16_t* dst)
+{
+    if (rate == NULL || rate->level == NULL || dst == NULL)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&rate->mutex);
+    memcpy(dst, rate->rate, (size_t)rate->width * rate->height * sizeof(uint16_t));
+    pthread_mutex_unlock(&rate->mutex);
+    return ACCUM_SUCCESS;
+}
+
+static void accum_rate_task(FrameSlot_t* slot, void* arg)
+{
+    AccumRate_t* rate = (AccumRate_t*)arg;
+    const FramePlane_t* plane = &slot->desc.temp;
+    pthread_mutex_lock(&rate->mutex);
+    if (rate->running && plane->data != NULL && (int)plane->width == rate->width && \
+        (int)plane->height == rate->height)
+    {
+        if (slot->desc.flags & FRAME_DESC_TEMP_INVALID)
+        {
+            //the step of a nuc or a gain switch is no rise, the level starts over at the next valid frame
+            rate->reseed = (rate->frames > 0);
+        }
+        else
+        {
+            accum_rate_add_locked(rate, plane->data, plane->stride, slot->seq, slot->desc.timestamp_us);
+        }
+    }
+    pthread_mutex_unlock(&rate->mutex);
+}
+
+int accum_rate_attach(AccumRate_t* rate, StreamFrameInfo_t* stream_frame_info)
+{
+    if (rate == NULL || rate->level == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    rate->stream_frame_info = stream_frame_info;
+    rate->running = 1;
+    //the slope needs every frame in order
+    rate->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, \
+        POOL_STAGE_TEMPERATURE, accum_rate_task, rate);
+    return (rate->consumer_id >= 0) ? ACCUM_SUCCESS : ACCUM_ERROR_PARAM;
+}
+
+int accum_rate_stats(AccumRate_t* rate, AlarmStats_t* stats)
+{
+    if (rate == NULL || rate->level == NULL || stats == NULL)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    return (alarm_engine_stats(&rate->engine, stats) == ALARM_SUCCESS) ? ACCUM_SUCCESS : ACCUM_ERROR_PARAM;
+}
+
+int accum_background_init(AccumBackground_t* background, int width, int height, const AccumBackgroundParam_t* param)
+{
+    if (background == NULL || width <= 0 || height <= 0 || param == NULL || param->learn_shift > 12)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    memset(background, 0, sizeof(AccumBackground_t));
+    size_t pix_num = (size_t)width * height;
+    background->width = width;
+    background->height = height;
+    background->param = *param;
+    background->param.learn_shift = (param->learn_shift > 0) ? param->learn_shift : ACCUM_BACKGROUND_LEARN_SHIFT;
+    background->param.min_sigma = (param->min_sigma > 0) ? param->min_sigma : ACCUM_BACKGROUND_MIN_SIGMA;
+    //the variance is of the deviation in raw << 4, at most 2047 raw units are kept
+    int32_t sigma = (background->param.min_sigma < 2047) ? background->param.min_sigma : 2047;
+    background->var_floor = (sigma << 4) * (sigma << 4);
+    background->mean = (int32_t*)malloc(pix_num * sizeof(int32_t));
+    background->var = (int32_t*)malloc(pix_num * sizeof(int32_t));
+    background->score = (uint16_t*)calloc(pix_num, sizeof(uint16_t));
+    background->consumer_id = -1;
+    TempDataRes_t temp_res = { (uint16_t)width, (uint16_t)height };
+    int rst = (background->mean != NULL && background->var != NULL && background->score != NULL) ? \
+        alarm_engine_init(&background->engine, temp_res) : ALARM_ERROR_MEM;
+    if (rst == ALARM_SUCCESS)
+    {
+        rst = alarm_engine_start(&background->engine, &background->param.alarm);
+        if (rst != ALARM_SUCCESS)
+        {
+            alarm_engine_release(&background->engine);
+        }
+    }
+    if (rst != ALARM_SUCCESS)
+    {
+        free(background->mean);
+        free(background->var);
+        free(background->score);
+        background->mean = NULL;
+        return (rst == ALARM_ERROR_MEM) ? ACCUM_ERROR_MEM : ACCUM_ERROR_PARAM;
+    }
+    pthread_mutex_init(&background->mutex, NULL);
+    return ACCUM_SUCCESS;
+}
+
+void accum_background_release(AccumBackground_t* background)
+{
+    if (background == NULL || background->mean == NULL)
+    {
+        return;
+    }
+    alarm_engine_release(&background->engine);
+    free(background->mean);
+    free(background->var);
+    free(background->score);
+    background->mean = NULL;
+    background->var = NULL;
+    background->score = NULL;
+    pthread_mutex_destroy(&background->mutex);
+}
+
+void accum_background_reset(AccumBackground_t* background)
+{
+    if (background == NULL || background->mean == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&background->mutex);
+    background->frames = 0;
+    alarm_engine_start(&background->engine, &background->param.alarm);
+    pthread_mutex_unlock(&background->mutex);
+}
+
+//called with the mutex held
+static int accum_background_add_locked(AccumBackground_t* background, const uint8_t* src, uint32_t stride, \
+    uint64_t seq, uint64_t timestamp_us)
+{
+    size_t width = (size_t)background->width;
+    int learn_shift = background->param.learn_shift;
+    if (background->frames == 0)
+    {
+        for (int y = 0; y < background->height; y++)
+        {
+            const uint16_t* row = (const uint16_t*)(src + y * stride);
+            int32_t* mean = background->mean + y * width;
+            int32_t* var = background->var + y * width;
+            for (size_t x = 0; x < width; x++)
+            {
+                mean[x] = (int32_t)row[x] << 8;
+                var[x] = background->var_floor;
+            }
+        }
+        memset(background->score, 0, width * background->height * sizeof(uint16_t));
+        background->frames = 1;
+        return 0;
+    }
+    //frame n + 1 is learned at 1/2^ceil(log2(n + 1)) until that reaches the learning rate
+    int shift = 0;
+    while (shift < learn_shift && (1u << shift) <= background->frames)
+    {
+        shift++;
+    }
+    for (int y = 0; y < background->height; y++)
+    {
+        simd_background_u16((const uint16_t*)(src + y * stride), (int)width, shift, background->var_floor, \
+            background->mean + y * width, background->var + y * width, background->score + y * width);
+    }
+    background->frames = (background->frames < UINT32_MAX) ? background->frames + 1 : background->frames;
+    if (background->frames <= (1u << learn_shift))
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&background->engine.mutex);
+    int event_num = alarm_engine_process(&background->engine, background->score, seq, timestamp_us);
+    pthread_mutex_unlock(&background->engine.mutex);
+    return event_num;
+}
+
+int accum_background_add(AccumBackground_t* background, const uint16_t* src, uint32_t stride, uint64_t seq, \
+    uint64_t timestamp_us)
+{
+    if (background == NULL || background->mean == NULL || src == NULL)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&background->mutex);
+    int rst = accum_background_add_locked(background, (const uint8_t*)src, \
+        (stride > 0) ? stride : background->width * sizeof(uint16_t), seq, timestamp_us);
+    pthread_mutex_unlock(&background->mutex);
+    return rst;
+}
+
+int accum_background_snapshot(AccumBackground_t* background, uint16_t* mean, uint16_t* score)
+{
+    if (background == NULL || background->mean == NULL || (mean == NULL && score == NULL))
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&background->mutex);
+    if (background->frames == 0)
+    {
+        pthread_mutex_unlock(&background->mutex);
+        return ACCUM_ERROR_EMPTY;
+    }
+    int pix_num = background->width * background->height;
+    if (mean != NULL)
+    {
+        for (int i = 0; i < pix_num; i++)
+        {
+            int32_t value = (background->mean[i] + 128) >> 8;
+            mean[i] = (uint16_t)((value < 0) ? 0 : ((value > 65535) ? 65535 : value));
+        }
+    }
+    if (score != NULL)
+    {
+        memcpy(score, background->score, (size_t)pix_num * sizeof(uint16_t));
+    }
+    pthread_mutex_unlock(&background->mutex);
+    return ACCUM_SUCCESS;
+}
+
+static void accum_background_task(FrameSlot_t* slot, void* arg)
+{
+    AccumBackground_t* background = (AccumBackground_t*)arg;
+    const FramePlane_t* plane = &slot->desc.temp;
+    pthread_mutex_lock(&background->mutex);
+    //a closed shutter or a gain switch is neither scored nor learned
+    if (background->running && plane->data != NULL && !(slot->desc.flags & FRAME_DESC_TEMP_INVALID) && \
+        (int)plane->width == background->width && (int)plane->height == background->height)
+    {
+        accum_background_add_locked(background, plane->data, plane->stride, slot->seq, slot->desc.timestamp_us);
+    }
+    pthread_mutex_unlock(&background->mutex);
+}
+
+int accum_background_attach(AccumBackground_t* background, StreamFrameInfo_t* stream_frame_info)
+{
+    if (background == NULL || background->mean == NULL || stream_frame_info == NULL || \
+        stream_frame_info->frame_ring == NULL)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    background->stream_frame_info = stream_frame_info;
+    background->running = 1;
+    background->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, \
+        POOL_STAGE_TEMPERATURE, accum_background_task, background);
+    return (background->consumer_id >= 0) ? ACCUM_SUCCESS : ACCUM_ERROR_PARAM;
+}
+
+int accum_background_stats(AccumBackground_t* background, AlarmStats_t* stats)
+{
+    if (background == NULL || background->mean == NULL || stats == NULL)
+    {
+        return ACCUM_ERROR_PARAM;
+    }
+    return (alarm_engine_stats(&background->engine, stats) == ALARM_SUCCESS) ? ACCUM_SUCCESS : ACCUM_ERROR_PARAM;
+}
@@ -0,0 +1,249 @@
+#ifndef _ACCUM_H_
+#define _ACCUM_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+#include "snapshot.h"
+#include "alarm.h"
+
+#define ACCUM_MAX_FRAMES 65535          //the uint32 sums of 16 bit pixels
+#define ACCUM_WINDOW_MAX 64
+#define ACCUM_RATE_LEVEL_SHIFT 2        //the temperature follows 1/4 of its difference per frame
+#define ACCUM_RATE_SLOPE_SHIFT 4        //the slope 1/16 of its, about 0.7 s at 25 fps
+#define ACCUM_RATE_GAP_MS 1000          //a longer gap between two valid frames starts the level over
+#define ACCUM_BACKGROUND_LEARN_SHIFT 8  //the background learns 1/256 of every frame, about 10 s at 25 fps
+#define ACCUM_BACKGROUND_MIN_SIGMA 4    //raw units (1/16 K), the least deviation a calm pixel is measured against
+
+//k sigma as a threshold of the background's score plane, squared and Q4
+#define ACCUM_BACKGROUND_OF_SIGMA(k) ((uint16_t)((k) * (k) * 16 + 0.5))
+
+#define ACCUM_SUCCESS 0
+#define ACCUM_ERROR_PARAM -1
+#define ACCUM_ERROR_MEM -2
+#define ACCUM_ERROR_EMPTY -3            //not enough frames for the result yet
+
+typedef enum
+{
+    ACCUM_PLANE_TEMP = 0,               //the radiometric plane, 1/64 K
+    ACCUM_PLANE_IMAGE,                  //Y14/Y16 image plane
+}AccumPlane_t;
+
+//integration of frames for precise measurement: per pixel sum and sum of squares, the mean and the
+//temporal noise of every pixel on demand. a ring task consumer adds the slot's plane where it is
+typedef struct {
+    int width;
+    int height;
+    uint32_t frames;                    //added since the last reset
+    uint32_t target;                    //the consumer stops adding after this many, 0 until ACCUM_MAX_FRAMES
+    uint16_t* ref;                      //the first frame, the squares are taken of the difference to it
+    uint32_t* sum;
+    uint64_t* sq;
+    AccumPlane_t plane;
+    StreamFrameInfo_t* stream_frame_info;
+    int consumer_id;
+    uint8_t running;
+    pthread_mutex_t mutex;              //the consumer adds on a pool worker, results are read from any thread
+    pthread_cond_t cond;
+}Accum_t;
+
+int accum_init(Accum_t* accum, int width, int height);
+
+void accum_release(Accum_t* accum);
+
+//start over, the next frame becomes the reference
+void accum_reset(Accum_t* accum);
+
+//add one frame, stride in bytes (0 for width * 2)
+int accum_add(Accum_t* accum, const uint16_t* src, uint32_t stride);
+
+//rounded per pixel mean of the frames so far
+int accum_mean(Accum_t* accum, uint16_t* dst);
+
+//per pixel standard deviation over the frames in the plane's units, needs 2 frames.
+//netd_mk != NULL: the spatial mean of it in mK, the temporal NETD estimate of a temp plane facing a uniform target
+int accum_noise(Accum_t* accum, float* dst, float* netd_mk);
+
+//register as a task consumer of the camera's frame ring, before streaming. valid until the ring is closed
+int accum_attach(Accum_t* accum, StreamFrameInfo_t* stream_frame_info, AccumPlane_t plane);
+
+//reset and take the next frames valid frames of the plane (0: until ACCUM_MAX_FRAMES or accum_stop)
+int accum_start(Accum_t* accum, uint32_t frames);
+
+void accum_stop(Accum_t* accum);
+
+//wait until the frames of accum_start are in, 0 waits forever. returns the frames added
+int accum_wait(Accum_t* accum, uint32_t timeout_ms);
+
+//moving average over the last window frames for live display, one sum kept up to date per frame
+typedef struct {
+    int pix_num;
+    uint32_t window;
+    uint32_t count;                     //frames in the window, up to window
+    uint32_t head;                      //the slot of history the next frame replaces
+    uint16_t* history;                  //window frames
+    uint32_t* sum;
+}AccumWindow_t;
+
+int accum_window_init(AccumWindow_t* accum_window, uint32_t window);
+
+void accum_window_release(AccumWindow_t* accum_window);
+
+//the next frame starts a new window, after a scene cut or a gain switch
+void accum_window_reset(AccumWindow_t* accum_window);
+
+//take src into the window and write the mean of the frames in it, dst may be src.
+//the buffers are allocated by the first frame and again when the frame size changes
+int accum_window_process(AccumWindow_t* accum_window, const uint16_t* src, int pix_num, uint16_t* dst);
+
+typedef enum
+{
+    ACCUM_HOLD_MAX = 0,                 //hottest value seen per pixel
+    ACCUM_HOLD_MIN,
+}AccumHoldImage_t;
+
+//max / min hold over an inspection round or a shift: the per pixel extremes since the reset in one simd pass per
+//frame. decay > 0 lets both relax toward the scene by that many units per frame, a hot spot fades out of the max
+//image after (its excess / decay) frames. a ring task consumer adds the valid frames of the plane
+typedef struct {
+    int width;
+    int height;
+    uint32_t frames;                    //added since the reset, the images are the first frame until the next one
+    uint16_t decay;
+    uint16_t* max_val;
+    uint16_t* min_val;
+    uint64_t first_us;                  //timestamp of the first frame since the reset
+    uint64_t last_us;
+    AccumPlane_t plane;
+    StreamFrameInfo_t* stream_frame_info;
+    int consumer_id;
+    uint8_t running;
+    pthread_mutex_t mutex;              //the consumer adds on a pool worker, the images are read from any thread
+}AccumHold_t;
+
+int accum_hold_init(AccumHold_t* hold, int width, int height, uint16_t decay);
+
+void accum_hold_release(AccumHold_t* hold);
+
+//start over, the next frame becomes both images
+void accum_hold_reset(AccumHold_t* hold);
+
+//decay per frame from the next frame on, 0 holds for good
+void accum_hold_decay(AccumHold_t* hold, uint16_t decay);
+
+//take one frame into the images, stride in bytes (0 for width * 2)
+int accum_hold_add(AccumHold_t* hold, const uint16_t* src, uint32_t stride, uint64_t timestamp_us);
+
+//copy one image into dst (width * height values), frames != NULL: the frames in it. ACCUM_ERROR_EMPTY before the first
+int accum_hold_snapshot(AccumHold_t* hold, AccumHoldImage_t image, uint16_t* dst, uint32_t* frames);
+
+//register as a task consumer of the camera's frame ring and start holding, before streaming. valid until the ring
+//is closed
+int accum_hold_attach(AccumHold_t* hold, StreamFrameInfo_t* stream_frame_info, AccumPlane_t plane);
+
+//pause and resume at the frames of the ring, between the rounds of an inspection
+void accum_hold_enable(AccumHold_t* hold, int enable);
+
+//rate of rise alarms (dT/dt): per pixel the temperature smoothed exponentially and the slope of it in two int32
+//planes (simd_rate_u16), one simd pass per frame turns them into the rise per second in raw units (kelvin * 64, falls are 0).
+//the alarm engine labels that plane: alarm.raise_temp and clear_temp are rates, a blob rising at raise_temp over
+//min_area pixels for raise_frames frames raises, it clears below clear_temp after clear_frames (hysteresis in rate
+//and time) and the events' max_temp is the blob's fastest rise. fixed memory, nothing is allocated per frame
+typedef struct {
+    uint8_t level_shift;                //0 selects ACCUM_RATE_LEVEL_SHIFT
+    uint8_t slope_shift;                //0 selects ACCUM_RATE_SLOPE_SHIFT, at most 8
+    AlarmParam_t alarm;
+}AccumRateParam_t;
+
+typedef struct {
+    int width;
+    int height;
+    int32_t* level;                     //smoothed temperature, raw << 8
+    int32_t* slope;                     //smoothed change of level per frame, raw << (8 + slope_shift)
+    uint16_t* rate;                     //rise per second of the last frame, raw units
+    uint32_t frames;                    //since the level was seeded, no rates before the slope settled
+    uint32_t interval_us;               //smoothed frame interval, the rate's time base
+    uint64_t last_us;                   //the last valid frame
+    uint8_t reseed;                     //the next valid frame seeds the level, the slope keeps its value
+    AccumRateParam_t param;
+    AlarmEngine_t engine;
+    StreamFrameInfo_t* stream_frame_info;
+    int consumer_id;
+    uint8_t running;
+    pthread_mutex_t mutex;              //the consumer runs on a pool worker, the rate plane is read from any thread
+}AccumRate_t;
+
+int accum_rate_init(AccumRate_t* rate, int width, int height, const AccumRateParam_t* param);
+
+void accum_rate_release(AccumRate_t* rate);
+
+//start over from the next frame, the tracks of the alarm engine start empty
+void accum_rate_reset(AccumRate_t* rate);
+
+//one temp frame, stride in bytes (0 for width * 2): update the planes and, once settled, label and track.
+//returns the number of alarm events or an error code
+int accum_rate_add(AccumRate_t* rate, const uint16_t* src, uint32_t stride, uint64_t seq, uint64_t timestamp_us);
+
+//copy the rate plane of the last frame into dst (width * height values, raw units per second)
+int accum_rate_snapshot(AccumRate_t* rate, uint16_t* dst);
+
+//register as a task consumer of the camera's frame ring, the temp plane's valid frames in order. before
+//streaming, valid until the ring is closed. a shutter, nuc or gain switch reseeds the level, not a rise
+int accum_rate_attach(AccumRate_t* rate, StreamFrameInfo_t* stream_frame_info);
+
+int accum_rate_stats(AccumRate_t* rate, AlarmStats_t* stats);
+
+//background model for anomaly detection: per pixel an exponentially weighted running mean and variance, both
+//int32 (simd_background_u16), with the learning rate 2^-learn_shift. the first frames are averaged at 1/n as welford's
+//running mean is, the rate then settles at learn_shift. every frame is scored, (T - mean)^2 / sigma^2 in Q4, before
+//it is learned, and the alarm engine labels the scores: alarm.raise_temp and clear_temp are ACCUM_BACKGROUND_OF_SIGMA
+//thresholds, an event's max_temp is the blob's largest score. an object that stays is learned into the background
+//and clears after about 2^learn_shift frames
+typedef struct {
+    uint8_t learn_shift;                //1..12, 0 selects ACCUM_BACKGROUND_LEARN_SHIFT
+    uint16_t min_sigma;                 //raw units, 0 selects ACCUM_BACKGROUND_MIN_SIGMA
+    AlarmParam_t alarm;
+}AccumBackgroundParam_t;
+
+typedef struct {
+    int width;
+    int height;
+    int32_t* mean;                      //raw << 8
+    int32_t* var;                       //raw^2 << 8
+    uint16_t* score;                    //of the last frame
+    uint32_t frames;                    //learned since the reset, no events before 2^learn_shift
+    int32_t var_floor;                  //min_sigma as a variance
+    AccumBackgroundParam_t param;
+    AlarmEngine_t engine;
+    StreamFrameInfo_t* stream_frame_info;
+    int consumer_id;
+    uint8_t running;
+    pthread_mutex_t mutex;              //the consumer runs on a pool worker, the planes are read from any thread
+}AccumBackground_t;
+
+int accum_background_init(AccumBackground_t* background, int width, int height, const AccumBackgroundParam_t* param);
+
+void accum_background_release(AccumBackground_t* background);
+
+//learn again from the next frame, after the camera was moved. the tracks start empty
+void accum_background_reset(AccumBackground_t* background);
+
+//score one temp frame, stride in bytes (0 for width * 2), then learn it. returns the number of alarm events
+int accum_background_add(AccumBackground_t* background, const uint16_t* src, uint32_t stride, uint64_t seq, \
+    uint64_t timestamp_us);
+
+//the rounded mean (raw units) and the last frame's scores, either may be NULL. ACCUM_ERROR_EMPTY before a frame
+int accum_background_snapshot(AccumBackground_t* background, uint16_t* mean, uint16_t* score);
+
+//register as a task consumer in the temperature stage of the camera's frame ring, the valid temp frames in order.
+//before streaming, valid until the ring is closed
+int accum_background_attach(AccumBackground_t* background, StreamFrameInfo_t* stream_frame_info);
+
+int accum_background_stats(AccumBackground_t* background, AlarmStats_t* stats);
+
+//queue one image into the snapshot service as the plane the hold was attached to, the newest frame's metadata
+//with it. returns snapshot_request_plane's result, the hold must outlive the snapshot's worker
+int accum_hold_export(AccumHold_t* hold, AccumHoldImage_t image, Snapshot_t* snapshot, const char* path, \
+    SnapshotFormat_t format);
+
+#endif
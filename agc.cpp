@@ -0,0 +1,199 @@
+#include "agc.h"
+#include <string.h>
+#include <stdio.h>
+
+HistAgc_t display_hist_agc = { 0 };
+static uint8_t display_hist_agc_inited = 0;
+static ImgEnhanceParam_t display_img_enhance_param;
+static uint8_t display_img_enhance_inited = 0;
+
+void hist_agc_default_param(HistAgcParam_t* param)
+{
+	param->high_discard_ratio = 0.01f;
+	param->low_discard_ratio = 0.01f;
+	param->smooth_ratio = 0.2f;
+	param->stretch_param.enable = 0;
+	param->stretch_param.lower_limit = 0;
+	param->stretch_param.upper_limit = HIST_AGC_BINS - 1;
+}
+
+int hist_agc_init(HistAgc_t* agc, HistAgcParam_t* param)
+{
+	if (agc == NULL)
+	{
+		return HIST_AGC_ERROR_PARAM;
+	}
+	memset(agc, 0, sizeof(HistAgc_t));
+	if (param != NULL)
+	{
+		agc->param = *param;
+	}
+	else
+	{
+		hist_agc_default_param(&agc->param);
+	}
+	return HIST_AGC_SUCCESS;
+}
+
+HistAgc_t* get_display_hist_agc(void)
+{
+	if (!display_hist_agc_inited)
+	{
+		hist_agc_init(&display_hist_agc, NULL);
+		display_hist_agc_inited = 1;
+	}
+	return &display_hist_agc;
+}
+
+void img_enhance_default_param(ImgEnhanceParam_t* param)
+{
+	memset(param, 0, sizeof(ImgEnhanceParam_t));
+	param->agc_param.highDiscardRatio = 0.01f;
+	param->agc_param.lowDiscardRatio = 0.01f;
+	param->agc_param.maxStepThdRatio = 0.02f;
+	param->agc_param.minStepThdRatio = 0.0001f;
+	param->agc_param.rangeGain = 1;
+	param->agc_param.alphaRatio = 0.5f;
+	param->agc_param.offsetRatio = 0.0f;
+	param->agc_param.stretch_param.enable = 1;
+	param->agc_param.stretch_param.lower_limit = 0;
+	param->agc_param.stretch_param.upper_limit = HIST_AGC_BINS - 1;
+	param->dde_param.startCoef = 1.0f;
+	param->dde_param.maxCoef = 2.0f;
+	param->dde_param.endCoef = 1.0f;
+	param->dde_param.startMinThd = 4;
+	param->dde_param.startMaxThd = 32;
+	param->dde_param.endMaxThd = 256;
+	param->dde_param.endMinThd = 128;
+}
+
+ImgEnhanceParam_t* get_display_img_enhance_param(void)
+{
+	if (!display_img_enhance_inited)
+	{
+		img_enhance_default_param(&display_img_enhance_param);
+		display_img_enhance_inited = 1;
+	}
+	return &display_img_enhance_param;
+}
+
+//clip points from the accumulated histogram
+static void hist_agc_clip_get(HistAgc_t* agc, int pix_num, uint32_t* low_clip, uint32_t* high_clip)
+{
+	uint32_t low_cnt = (uint32_t)(agc->param.low_discard_ratio * pix_num);
+	uint32_t high_cnt = (uint32_t)(agc->param.high_discard_ratio * pix_num);
+	uint32_t sum = 0;
+	uint32_t low = 0, high = HIST_AGC_BINS - 1;
+
+	for (low = 0; low < HIST_AGC_BINS - 1; low++)
+	{
+		sum += agc->hist[low];
+		if (sum > low_cnt)
+		{
+			break;
+		}
+	}
+	sum = 0;
+	for (high = HIST_AGC_BINS - 1; high > 0; high--)
+	{
+		sum += agc->hist[high];
+		if (sum > high_cnt)
+		{
+			break;
+		}
+	}
+	if (high <= low)
+	{
+		high = low + 1;
+	}
+	*low_clip = low;
+	*high_clip = high;
+}
+
+//output range of the mapping
+static void hist_agc_limits(const HistAgc_t* agc, float* lower, float* upper)
+{
+	*lower = 0;
+	*upper = HIST_AGC_BINS - 1;
+	if (agc->param.stretch_param.enable)
+	{
+		*lower = agc->param.stretch_param.lower_limit;
+		*upper = agc->param.stretch_param.upper_limit;
+		if (*upper > HIST_AGC_BINS - 1) *upper = HIST_AGC_BINS - 1;
+		if (*lower > *upper) *lower = *upper;
+	}
+}
+
+void hist_agc_commit(HistAgc_t* agc, int pix_num)
+{
+	uint32_t low = 0, high = 0;
+	hist_agc_clip_get(agc, pix_num, &low, &high);
+
+	float ratio = agc->param.smooth_ratio;
+	if (!agc->lut_valid || ratio <= 0 || ratio > 1)
+	{
+		ratio = 1;
+	}
+	agc->low_clip += ((float)low - agc->low_clip) * ratio;
+	agc->high_clip += ((float)high - agc->high_clip) * ratio;
+	if (agc->high_clip < agc->low_clip + 1)
+	{
+		agc->high_clip = agc->low_clip + 1;
+	}
+
+	float lower = 0, upper = 0;
+	hist_agc_limits(agc, &lower, &upper);
+	float scale = (upper - lower) / (agc->high_clip - agc->low_clip);
+	for (int v = 0; v < HIST_AGC_BINS; v++)
+	{
+		float out = lower + ((float)v - agc->low_clip) * scale;
+		if (out < lower) out = lower;
+		if (out > upper) out = upper;
+		agc->lut[v] = (uint16_t)(out + 0.5f);
+	}
+	agc->lut_valid = 1;
+	memset(agc->hist, 0, sizeof(agc->hist));
+}
+
+const uint16_t* hist_agc_prepare(HistAgc_t* agc, uint16_t* src, int pix_num, int shift)
+{
+	if (!agc->lut_valid)
+	{
+		//no previous frame, build the mapping from this frame first
+		for (int i = 0; i < pix_num; i++)
+		{
+			uint32_t v = src[i] >> shift;
+			if (v > HIST_AGC_BINS - 1) v = HIST_AGC_BINS - 1;
+			agc->hist[v]++;
+		}
+		hist_agc_commit(agc, pix_num);
+	}
+	return agc->lut;
+}
+
+float hist_agc_slope(const HistAgc_t* agc)
+{
+	float lower = 0, upper = 0;
+	hist_agc_limits(agc, &lower, &upper);
+	return (upper - lower) / (agc->high_clip - agc->low_clip);
+}
+
+int hist_agc_process(HistAgc_t* agc, uint16_t* src, int pix_num, int shift, uint16_t* dst)
+{
+	if (agc == NULL || src == NULL || dst == NULL || pix_num <= 0)
+	{
+		return HIST_AGC_ERROR_PARAM;
+	}
+
+	const uint16_t* lut = hist_agc_prepare(agc, src, pix_num, shift);
+	uint32_t* hist = agc->hist;
+	for (int i = 0; i < pix_num; i++)
+	{
+		uint32_t v = src[i] >> shift;
+		if (v > HIST_AGC_BINS - 1) v = HIST_AGC_BINS - 1;
+		hist[v]++;
+		dst[i] = lut[v];
+	}
+	hist_agc_commit(agc, pix_num);
+	return HIST_AGC_SUCCESS;
+}
@@ -0,0 +1,56 @@
+#ifndef _AGC_H_
+#define _AGC_H_
+
+#include <stdint.h>
+#include "libirprocess.h"
+
+#define HIST_AGC_BINS 16384         //one bin per Y14 value
+
+#define HIST_AGC_SUCCESS 0
+#define HIST_AGC_ERROR_PARAM -1
+
+typedef struct {
+    float high_discard_ratio;       //pixels above the high clip point, like AgcParam_t.highDiscardRatio
+    float low_discard_ratio;        //pixels below the low clip point, like AgcParam_t.lowDiscardRatio
+    float smooth_ratio;             //weight of the new frame's clip points, 1 disables the temporal smoothing
+    AgcStretchParam_t stretch_param;//output range, [0,16383] when not enabled
+}HistAgcParam_t;
+
+typedef struct {
+    HistAgcParam_t param;
+    uint32_t hist[HIST_AGC_BINS];   //histogram of the frame being mapped
+    uint16_t lut[HIST_AGC_BINS];    //Y14 mapping built from the previous frames
+    float low_clip;                 //smoothed clip points, Y14
+    float high_clip;
+    uint8_t lut_valid;
+}HistAgc_t;
+
+//default: discard 1% at each end, smooth the clip points over about 5 frames
+void hist_agc_default_param(HistAgcParam_t* param);
+
+//reset the state, the next frame builds its own mapping before it is applied
+int hist_agc_init(HistAgc_t* agc, HistAgcParam_t* param);
+
+//the agc state used by the display pipeline
+HistAgc_t* get_display_hist_agc(void);
+
+//libirprocess y14_image_enhance parameters: 1% agc clip to [0,16383], dde gain up to 2 on small details
+void img_enhance_default_param(ImgEnhanceParam_t* param);
+
+//the y14_image_enhance parameters used by the display pipeline
+ImgEnhanceParam_t* get_display_img_enhance_param(void);
+
+//return the mapping for this frame, only the first frame after init scans the source first
+//src is shifted right by shift to get Y14
+const uint16_t* hist_agc_prepare(HistAgc_t* agc, uint16_t* src, int pix_num, int shift);
+
+//build the next frame's mapping from agc->hist and clear it
+void hist_agc_commit(HistAgc_t* agc, int pix_num);
+
+//output units per Y14 unit inside the clip points of the current mapping, valid after hist_agc_prepare
+float hist_agc_slope(const HistAgc_t* agc);
+
+//single pass: apply the previous mapping and build this frame's histogram, then commit
+int hist_agc_process(HistAgc_t* agc, uint16_t* src, int pix_num, int shift, uint16_t* dst);
+
+#endif
@@ -0,0 +1,568 @@
+#include "alarm.h"
+#include "simd.h"
+#include "timing.h"
+#include "latency.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define ALARM_NO_LABEL 0xFFFFFFFF
+
+int alarm_engine_init(AlarmEngine_t* engine, TempDataRes_t temp_res)
+{
+    if (engine == NULL || temp_res.width == 0 || temp_res.height == 0)
+    {
+        return ALARM_ERROR_PARAM;
+    }
+    memset(engine, 0, sizeof(AlarmEngine_t));
+    engine->temp_res = temp_res;
+    engine->consumer_id = -1;
+    //runs of one row are separated by a cold pixel, at most width / 2 + 1 of them
+    uint32_t run_cap = temp_res.width / 2 + 1;
+    engine->label_cap = run_cap * temp_res.height;
+    engine->mask = (uint8_t*)malloc(temp_res.width);
+    engine->run_x0 = (uint16_t*)malloc(2 * run_cap * sizeof(uint16_t));
+    engine->run_x1 = (uint16_t*)malloc(2 * run_cap * sizeof(uint16_t));
+    engine->run_label = (uint32_t*)malloc(2 * run_cap * sizeof(uint32_t));
+    engine->parent = (uint32_t*)malloc(engine->label_cap * sizeof(uint32_t));
+    engine->label_blob = (AlarmBlob_t*)malloc(engine->label_cap * sizeof(AlarmBlob_t));
+    if (engine->mask == NULL || engine->run_x0 == NULL || engine->run_x1 == NULL || engine->run_label == NULL || \
+        engine->parent == NULL || engine->label_blob == NULL)
+    {
+        free(engine->mask);
+        free(engine->run_x0);
+        free(engine->run_x1);
+        free(engine->run_label);
+        free(engine->parent);
+        free(engine->label_blob);
+        memset(engine, 0, sizeof(AlarmEngine_t));
+        return ALARM_ERROR_MEM;
+    }
+    pthread_mutex_init(&engine->mutex, NULL);
+    return ALARM_SUCCESS;
+}
+
+void alarm_engine_release(AlarmEngine_t* engine)
+{
+    if (engine == NULL || engine->mask == NULL)
+    {
+        return;
+    }
+    free(engine->mask);
+    free(engine->run_x0);
+    free(engine->run_x1);
+    free(engine->run_label);
+    free(engine->parent);
+    free(engine->label_blob);
+    pthread_mutex_destroy(&engine->mutex);
+    memset(engine, 0, sizeof(AlarmEngine_t));
+}
+
+//path halving, the roots stay the smallest label of their set
+static inline uint32_t alarm_find(uint32_t* parent, uint32_t label)
+{
+    while (parent[label] != label)
+    {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+    return label;
+}
+
+//the peak keeps the first pixel in raster order on ties
+static void alarm_blob_merge(AlarmBlob_t* dst, const AlarmBlob_t* src)
+{
+    dst->area += src->area;
+    dst->hot_area += src->hot_area;
+    if (src->max_temp > dst->max_temp || (src->max_temp == dst->max_temp && \
+        (src->max_y < dst->max_y || (src->max_y == dst->max_y && src->max_x < dst->max_x))))
+    {
+        dst->max_temp = src->max_temp;
+        dst->max_x = src->max_x;
+        dst->max_y = src->max_y;
+    }
+    dst->x0 = (src->x0 < dst->x0) ? src->x0 : dst->x0;
+    dst->y0 = (src->y0 < dst->y0) ? src->y0 : dst->y0;
+    dst->x1 = (src->x1 > dst->x1) ? src->x1 : dst->x1;
+    dst->y1 = (src->y1 > dst->y1) ? src->y1 : dst->y1;
+}
+
+static uint32_t alarm_union(AlarmEngine_t* engine, uint32_t a, uint32_t b)
+{
+    a = alarm_find(engine->parent, a);
+    b = alarm_find(engine->parent, b);
+    if (a == b)
+    {
+        return a;
+    }
+    if (b < a)
+    {
+        uint32_t t = a;
+        a = b;
+        b = t;
+    }
+    engine->parent[b] = a;
+    alarm_blob_merge(&engine->label_blob[a], &engine->label_blob[b]);
+    return a;
+}
+
+//a blob over ALARM_MAX_BLOBS replaces the coldest one kept
+static void alarm_blob_keep(AlarmEngine_t* engine, const AlarmBlob_t* blob)
+{
+    engine->stats.blobs++;
+    if (engine->blob_num < ALARM_MAX_BLOBS)
+    {
+        engine->blobs[engine->blob_num++] = *blob;
+        return;
+    }
+    engine->stats.dropped_blobs++;
+    int coldest = 0;
+    for (int i = 1; i < ALARM_MAX_BLOBS; i++)
+    {
+        if (engine->blobs[i].max_temp < engine->blobs[coldest].max_temp)
+        {
+            coldest = i;
+        }
+    }
+    if (blob->max_temp > engine->blobs[coldest].max_temp)
+    {
+        engine->blobs[coldest] = *blob;
+    }
+}
+
+//one raster pass: each row is thresholded, its runs join the runs of the row above they touch and
+//the blob statistics are merged at the union-find roots, so no label image and no second pass is needed.
+//a pair of rows under a cold row of pyramid level 0 has no runs and is passed over
+static void alarm_label(AlarmEngine_t* engine, const uint16_t* temp_data, const FramePyramidLevel_t* coarse)
+{
+    int width = engine->temp_res.width, height = engine->temp_res.height;
+    int run_cap = width / 2 + 1;
+    uint16_t* prev_x0 = engine->run_x0;
+    uint16_t* prev_x1 = engine->run_x1;
+    uint32_t* prev_label = engine->run_label;
+    uint16_t* cur_x0 = prev_x0 + run_cap;
+    uint16_t* cur_x1 = prev_x1 + run_cap;
+    uint32_t* cur_label = prev_label + run_cap;
+    uint8_t* mask = engine->mask;
+    uint32_t* parent = engine->parent;
+    uint32_t label_num = 0;
+    int prev_num = 0;
+
+    uint8_t coarse_hot = 1;
+    for (int y = 0; y < height; y++)
+    {
+        if (coarse != NULL && (y & 1) == 0)
+        {
+            uint16_t coarse_min = 0, coarse_max = 0;
+            simd_minmax_u16(coarse->max + (y >> 1) * coarse->width, coarse->width, &coarse_min, &coarse_max);
+            coarse_hot = (coarse_max >= engine->param.clear_temp);
+        }
+        if (!coarse_hot)
+        {
+            engine->stats.cold_rows++;
+            prev_num = 0;
+            continue;
+        }
+        const uint16_t* row = temp_data + y * width;
+        simd_threshold2_u16(row, width, engine->param.clear_temp, engine->param.raise_temp, mask);
+        int cur_num = 0, p = 0, x = 0;
+        while (x < width)
+        {
+            //cold pixels are skipped 8 at a time
+            while (x + 8 <= width)
+            {
+                uint64_t word;
+                memcpy(&word, mask + x, 8);
+                if (word != 0)
+                {
+                    break;
+                }
+                x += 8;
+            }
+            while (x < width && mask[x] == 0)
+            {
+                x++;
+            }
+            if (x >= width)
+            {
+                break;
+            }
+            AlarmBlob_t run;
+            run.hot_area = 0;
+            run.max_temp = row[x];
+            run.max_x = (uint16_t)x;
+            run.max_y = (uint16_t)y;
+            run.x0 = (uint16_t)x;
+            run.y0 = run.y1 = (uint16_t)y;
+            for (; x < width && mask[x] != 0; x++)
+            {
+                run.hot_area += mask[x] >> 1;
+                if (row[x] > run.max_temp)
+                {
+                    run.max_temp = row[x];
+                    run.max_x = (uint16_t)x;
+                }
+            }
+            run.x1 = (uint16_t)(x - 1);
+            run.area = run.x1 - run.x0 + 1;
+
+            //8-connected: every run of the row above overlapping [x0 - 1, x1 + 1]
+            while (p < prev_num && prev_x1[p] + 1 < run.x0)
+            {
+                p++;
+            }
+            uint32_t label = ALARM_NO_LABEL;
+            int q = p;
+            for (; q < prev_num && prev_x0[q] <= run.x1 + 1; q++)
+            {
+                label = (label == ALARM_NO_LABEL) ? alarm_find(parent, prev_label[q]) : \
+                    alarm_union(engine, label, prev_label[q]);
+            }
+            //the last one may reach the next run of this row as well
+            if (q > p)
+            {
+                p = q - 1;
+            }
+            if (label == ALARM_NO_LABEL)
+            {
+                label = label_num++;
+                parent[label] = label;
+                engine->label_blob[label] = run;
+            }
+            else
+            {
+                alarm_blob_merge(&engine->label_blob[label], &run);
+            }
+            cur_x0[cur_num] = run.x0;
+            cur_x1[cur_num] = run.x1;
+            cur_label[cur_num] = label;
+            cur_num++;
+        }
+
+        uint16_t* t16 = prev_x0;
+        prev_x0 = cur_x0;
+        cur_x0 = t16;
+        t16 = prev_x1;
+        prev_x1 = cur_x1;
+        cur_x1 = t16;
+        uint32_t* t32 = prev_label;
+        prev_label = cur_label;
+        cur_label = t32;
+        prev_num = cur_num;
+    }
+
+    engine->blob_num = 0;
+    for (uint32_t label = 0; label < label_num; label++)
+    {
+        if (parent[label] == label)
+        {
+            alarm_blob_keep(engine, &engine->label_blob[label]);
+        }
+    }
+}
+
+static void alarm_event_add(AlarmEngine_t* engine, int* event_num, const AlarmTrack_t* track, AlarmEventType_t type, \
+    uint64_t seq, uint64_t timestamp_us)
+{
+    AlarmEvent_t* event = &engine->events[(*event_num)++];
+    const AlarmBlob_t* blob = &track->blob;
+    event->seq = seq;
+    event->timestamp_us = timestamp_us;
+    event->type = (uint16_t)type;
+    event->track_id = track->id;
+    event->max_temp = blob->max_temp;
+    event->max_x = blob->max_x;
+    event->max_y = blob->max_y;
+    event->x0 = blob->x0;
+    event->y0 = blob->y0;
+    event->x1 = blob->x1;
+    event->y1 = blob->y1;
+    event->frames = (uint16_t)((track->frames > 65535) ? 65535 : track->frames);
+    event->area = blob->area;
+    event->hot_area = blob->hot_area;
+    event->latency_us = 0;
+}
+
+static int alarm_blob_near(const AlarmBlob_t* a, const AlarmBlob_t* b, int distance)
+{
+    return a->x0 <= b->x1 + distance && b->x0 <= a->x1 + distance && \
+        a->y0 <= b->y1 + distance && b->y0 <= a->y1 + distance;
+}
+
+//a track takes the nearest blob around its last box. a track that has not raised yet ends as soon as its blob
+//is not hot, a raised one follows its blob down to clear_temp and clears after clear_frames frames without it
+static int alarm_track(AlarmEngine_t* engine, uint64_t seq, uint64_t timestamp_us)
+{
+    const AlarmParam_t* param = &engine->param;
+    uint8_t blob_used[ALARM_MAX_BLOBS] = { 0 };
+    int event_num = 0;
+    for (int t = 0; t < ALARM_MAX_TRACKS; t++)
+    {
+        AlarmTrack_t* track = &engine->tracks[t];
+        if (!track->used)
+        {
+            continue;
+        }
+        int best = -1;
+        uint32_t best_dist = 0xFFFFFFFF;
+        for (int b = 0; b < engine->blob_num; b++)
+        {
+            const AlarmBlob_t* blob = &engine->blobs[b];
+            if (blob_used[b] || !alarm_blob_near(&track->blob, blob, param->match_distance))
+            {
+                continue;
+            }
+            int dx = blob->max_x - track->blob.max_x, dy = blob->max_y - track->blob.max_y;
+            uint32_t dist = (uint32_t)(dx * dx + dy * dy);
+            if (dist < best_dist)
+            {
+                best = b;
+                best_dist = dist;
+            }
+        }
+        track->frames++;
+        if (best < 0)
+        {
+            track->hot_frames = 0;
+            if (!track->raised || ++track->miss_frames >= param->clear_frames)
+            {
+                if (track->raised)
+                {
+                    alarm_event_add(engine, &event_num, track, ALARM_EVENT_CLEAR, seq, timestamp_us);
+                }
+                track->used = 0;
+            }
+            continue;
+        }
+        blob_used[best] = 1;
+        track->blob = engine->blobs[best];
+        track->miss_frames = 0;
+        int hot = (track->blob.hot_area >= param->min_area);
+        track->hot_frames = hot ? track->hot_frames + 1 : 0;
+        if (!track->raised)
+        {
+            if (!hot)
+            {
+                track->used = 0;
+            }
+            else if (track->hot_frames >= param->raise_frames)
+            {
+                track->raised = 1;
+                engine->stats.raised++;
+                alarm_event_add(engine, &event_num, track, ALARM_EVENT_RAISE, seq, timestamp_us);
+            }
+        }
+        else if (param->update_interval > 0 && ++track->update_cnt >= param->update_interval)
+        {
+            track->update_cnt = 0;
+            alarm_event_add(engine, &event_num, track, ALARM_EVENT_UPDATE, seq, timestamp_us);
+        }
+    }
+
+    //hot blobs no track took start one
+    int free_track = 0;
+    for (int b = 0; b < engine->blob_num; b++)
+    {
+        if (blob_used[b] || engine->blobs[b].hot_area < param->min_area)
+        {
+            continue;
+        }
+        while (free_track < ALARM_MAX_TRACKS && engine->tracks[free_track].used)
+        {
+            free_track++;
+        }
+        if (free_track >= ALARM_MAX_TRACKS)
+        {
+            engine->stats.dropped_blobs++;
+            continue;
+        }
+        AlarmTrack_t* track = &engine->tracks[free_track];
+        memset(track, 0, sizeof(AlarmTrack_t));
+        track->used = 1;
+        track->id = engine->track_next++;
+        track->hot_frames = 1;
+        track->frames = 1;
+        track->blob = engine->blobs[b];
+        if (param->raise_frames <= 1)
+        {
+            track->raised = 1;
+            engine->stats.raised++;
+            alarm_event_add(engine, &event_num, track, ALARM_EVENT_RAISE, seq, timestamp_us);
+        }
+    }
+    return event_num;
+}
+
+int alarm_engine_process(AlarmEngine_t* engine, const uint16_t* temp_data, uint64_t seq, uint64_t timestamp_us)
+{
+    return alarm_engine_process_pyramid(engine, temp_data, NULL, seq, timestamp_us);
+}
+
+int alarm_engine_process_pyramid(AlarmEngine_t* engine, const uint16_t* temp_data, const FramePyramid_t* pyramid, \
+    uint64_t seq, uint64_t timestamp_us)
+{
+    if (engine == NULL || engine->mask == NULL || temp_data == NULL)
+    {
+        return ALARM_ERROR_PARAM;
+    }
+    const FramePyramidLevel_t* coarse = NULL;
+    if (pyramid != NULL && pyramid->valid && pyramid->width == engine->temp_res.width && \
+        pyramid->height == engine->temp_res.height)
+    {
+        coarse = &pyramid->level[0];
+    }
+    alarm_label(engine, temp_data, coarse);
+    engine->blob_seq = seq;
+    int event_num = alarm_track(engine, seq, timestamp_us);
+    engine->stats.frames++;
+    if (event_num == 0)
+    {
+        return 0;
+    }
+    engine->stats.events += event_num;
+    uint64_t now_us = get_monotonic_us();
+    uint32_t latency_us = (uint32_t)((now_us > timestamp_us) ? now_us - timestamp_us : 0);
+    for (int i = 0; i < event_num; i++)
+    {
+        engine->events[i].latency_us = latency_us;
+    }
+    timing_record(TIMING_STAGE_ALARM, latency_us);
+    if (engine->param.event_func != NULL)
+    {
+        engine->param.event_func(engine->events, event_num, engine->param.event_arg);
+    }
+    return event_num;
+}
+
+static void alarm_engine_task(FrameSlot_t* slot, void* arg)
+{
+    AlarmEngine_t* engine = (AlarmEngine_t*)arg;
+    pthread_mutex_lock(&engine->mutex);
+    //a gain switch, the closed shutter or the nuc moves every temperature, the events would be spurious.
+    //the zones keep their state until the next good frame
+    if (engine->running && slot->desc.temp.data != NULL && !(slot->desc.flags & FRAME_DESC_TEMP_INVALID))
+    {
+        alarm_engine_process_pyramid(engine, (uint16_t*)slot->desc.temp.data, slot->desc.temp_pyramid, slot->seq, \
+            slot->desc.timestamp_us);
+        latency_probe_sink(engine->stream_frame_info->latency_probe, LATENCY_SINK_ALARM, slot->seq);
+    }
+    pthread_mutex_unlock(&engine->mutex);
+}
+
+int alarm_engine_attach(AlarmEngine_t* engine, StreamFrameInfo_t* stream_frame_info)
+{
+    if (engine == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL || \
+        stream_frame_info->temp_byte_size == 0)
+    {
+        return ALARM_ERROR_PARAM;
+    }
+    TempDataRes_t temp_res = { (uint16_t)stream_frame_info->temp_info.width, (uint16_t)stream_frame_info->temp_info.height };
+    int ret = alarm_engine_init(engine, temp_res);
+    if (ret != ALARM_SUCCESS)
+    {
+        return ret;
+    }
+    engine->stream_frame_info = stream_frame_info;
+    //a blob must be seen on consecutive frames, the engine takes every frame in order
+    engine->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, \
+        POOL_STAGE_TEMPERATURE, alarm_engine_task, engine);
+    if (engine->consumer_id < 0)
+    {
+        alarm_engine_release(engine);
+        return ALARM_ERROR_PARAM;
+    }
+    return ALARM_SUCCESS;
+}
+
+int alarm_engine_start(AlarmEngine_t* engine, const AlarmParam_t* param)
+{
+    if (engine == NULL || engine->mask == NULL || param == NULL || param->clear_temp > param->raise_temp)
+    {
+        return ALARM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&engine->mutex);
+    engine->param = *param;
+    if (engine->param.min_area == 0)
+    {
+        engine->param.min_area = 1;
+    }
+    if (engine->param.raise_frames == 0)
+    {
+        engine->param.raise_frames = 1;
+    }
+    if (engine->param.clear_frames == 0)
+    {
+        engine->param.clear_frames = 1;
+    }
+    memset(engine->tracks, 0, sizeof(engine->tracks));
+    engine->running = 1;
+    pthread_mutex_unlock(&engine->mutex);
+    return ALARM_SUCCESS;
+}
+
+int alarm_engine_stop(AlarmEngine_t* engine)
+{
+    if (engine == NULL)
+    {
+        return ALARM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&engine->mutex);
+    if (engine->running)
+    {
+        engine->running = 0;
+        printf("alarm: %llu frames, %llu blobs, %llu dropped, %llu raised, %llu events, %llu cold rows skipped\n", \
+            (unsigned long long)engine->stats.frames, (unsigned long long)engine->stats.blobs, \
+            (unsigned long long)engine->stats.dropped_blobs, (unsigned long long)engine->stats.raised, \
+            (unsigned long long)engine->stats.events, (unsigned long long)engine->stats.cold_rows);
+    }
+    pthread_mutex_unlock(&engine->mutex);
+    return ALARM_SUCCESS;
+}
+
+int alarm_engine_blob_summary(AlarmEngine_t* engine, AlarmBlobSummary_t* summary)
+{
+    if (engine == NULL || summary == NULL)
+    {
+        return ALARM_ERROR_PARAM;
+    }
+    memset(summary, 0, sizeof(AlarmBlobSummary_t));
+    pthread_mutex_lock(&engine->mutex);
+    summary->seq = engine->blob_seq;
+    summary->count = (uint32_t)engine->blob_num;
+    for (int b = 0; b < engine->blob_num; b++)
+    {
+        const AlarmBlob_t* blob = &engine->blobs[b];
+        summary->area = (blob->area > summary->area) ? blob->area : summary->area;
+        summary->hot_area = (blob->hot_area > summary->hot_area) ? blob->hot_area : summary->hot_area;
+        summary->max_temp = (blob->max_temp > summary->max_temp) ? blob->max_temp : summary->max_temp;
+    }
+    pthread_mutex_unlock(&engine->mutex);
+    return ALARM_SUCCESS;
+}
+
+int alarm_engine_stats(AlarmEngine_t* engine, AlarmStats_t* stats)
+{
+    if (engine == NULL || stats == NULL)
+    {
+        return ALARM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&engine->mutex);
+    *stats = engine->stats;
+    pthread_mutex_unlock(&engine->mutex);
+    return ALARM_SUCCESS;
+}
+
+const char* alarm_event_name(AlarmEventType_t type)
+{
+    switch (type)
+    {
+    case ALARM_EVENT_RAISE:
+        return "raise";
+    case ALARM_EVENT_UPDATE:
+        return "update";
+    case ALARM_EVENT_CLEAR:
+        return "clear";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,157 @@
+#ifndef _ALARM_H_
+#define _ALARM_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+#include "libirtemp.h"
+
+#define ALARM_MAX_BLOBS 64              //blobs kept per frame, the hottest ones
+#define ALARM_MAX_TRACKS 32
+#define ALARM_MAX_EVENTS (2 * ALARM_MAX_TRACKS)  //per frame: every track clears, new ones raise in their place
+
+//celsius -> raw temp value (kelvin * 64), the unit of the thresholds and the events
+#define ALARM_TEMP_OF_CELSIUS(c) ((uint16_t)(((c) + 273.15) * 64 + 0.5))
+
+#define ALARM_SUCCESS 0
+#define ALARM_ERROR_PARAM -1
+#define ALARM_ERROR_MEM -2
+
+typedef enum
+{
+    ALARM_EVENT_RAISE = 1,              //a blob stayed hot for raise_frames frames
+    ALARM_EVENT_UPDATE,                 //a raised blob, every update_interval frames
+    ALARM_EVENT_CLEAR,                  //a raised blob is gone (nothing at clear_temp) for clear_frames frames
+}AlarmEventType_t;
+
+//48 bytes, temperatures are raw temp values, the box is inclusive
+typedef struct {
+    uint64_t seq;                       //ring sequence of the frame the event comes from
+    uint64_t timestamp_us;              //monotonic time the frame was received
+    uint16_t type;                      //AlarmEventType_t
+    uint16_t track_id;
+    uint16_t max_temp;
+    uint16_t max_x;
+    uint16_t max_y;
+    uint16_t x0;
+    uint16_t y0;
+    uint16_t x1;
+    uint16_t y1;
+    uint16_t frames;                    //frames since the track started, saturated
+    uint32_t area;                      //pixels at clear_temp or above
+    uint32_t hot_area;                  //pixels at raise_temp or above
+    uint32_t latency_us;                //frame received -> event out
+}AlarmEvent_t;
+
+//called from the ring task with the events of one frame
+typedef void (*AlarmEventFunc_t)(const AlarmEvent_t* events, int event_num, void* arg);
+
+typedef struct {
+    uint16_t raise_temp;                //pixels at or above it are hot
+    uint16_t clear_temp;                //<= raise_temp, pixels at or above it make up a blob
+    uint32_t min_area;                  //hot pixels a blob needs to count as hot, 0 selects 1
+    uint16_t raise_frames;              //consecutive hot frames before the alarm, 0 selects 1
+    uint16_t clear_frames;              //frames without the blob before the alarm clears, 0 selects 1
+    uint16_t match_distance;            //pixels a blob may move between two frames and keep its track
+    uint32_t update_interval;           //frames between two updates of a raised alarm, 0 sends none
+    AlarmEventFunc_t event_func;
+    void* event_arg;
+}AlarmParam_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t blobs;
+    uint64_t dropped_blobs;             //over ALARM_MAX_BLOBS, or hot with every track in use
+    uint64_t events;
+    uint64_t raised;
+    uint64_t cold_rows;                 //rows the temp pyramid showed below clear_temp, not labelled
+}AlarmStats_t;
+
+typedef struct {
+    uint32_t area;
+    uint32_t hot_area;
+    uint16_t max_temp;
+    uint16_t max_x;
+    uint16_t max_y;
+    uint16_t x0;
+    uint16_t y0;
+    uint16_t x1;
+    uint16_t y1;
+}AlarmBlob_t;
+
+//the blobs of the last processed frame in a few numbers, what alarm rules (rule.h) read
+typedef struct {
+    uint64_t seq;
+    uint32_t count;
+    uint32_t area;                      //the largest blob's
+    uint32_t hot_area;                  //the largest hot area
+    uint16_t max_temp;                  //the hottest blob's, 0 without blobs
+}AlarmBlobSummary_t;
+
+typedef struct {
+    uint8_t used;
+    uint8_t raised;
+    uint16_t id;
+    uint32_t hot_frames;                //consecutive frames the blob was hot
+    uint32_t miss_frames;
+    uint32_t frames;
+    uint32_t update_cnt;
+    AlarmBlob_t blob;                   //the last matched blob
+}AlarmTrack_t;
+
+//full frame alarm engine: the temp frame is thresholded at clear_temp and raise_temp in the raw domain,
+//the pixels at clear_temp are labelled in one raster pass (runs joined by union-find, 8-connected),
+//a hot blob starts a track, which then follows its blob down to clear_temp (hysteresis in space and time)
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    AlarmParam_t param;
+    int consumer_id;
+    uint8_t running;
+    TempDataRes_t temp_res;
+    uint8_t* mask;                      //simd_threshold2_u16 of the row being labelled
+    uint16_t* run_x0;                   //runs of the previous and the current row
+    uint16_t* run_x1;
+    uint32_t* run_label;
+    uint32_t* parent;                   //union-find over the run labels, a root has the smaller label
+    AlarmBlob_t* label_blob;            //accumulated at the root while the frame is scanned
+    uint32_t label_cap;
+    AlarmBlob_t blobs[ALARM_MAX_BLOBS];
+    int blob_num;
+    AlarmTrack_t tracks[ALARM_MAX_TRACKS];
+    uint16_t track_next;
+    AlarmEvent_t events[ALARM_MAX_EVENTS];
+    uint64_t blob_seq;                  //the frame blobs come from
+    AlarmStats_t stats;
+    pthread_mutex_t mutex;
+}AlarmEngine_t;
+
+//buffers for one temp resolution, no frame ring involved
+int alarm_engine_init(AlarmEngine_t* engine, TempDataRes_t temp_res);
+
+void alarm_engine_release(AlarmEngine_t* engine);
+
+//register the engine as a task consumer of the camera's frame ring, before streaming
+int alarm_engine_attach(AlarmEngine_t* engine, StreamFrameInfo_t* stream_frame_info);
+
+//set the thresholds and rules, the tracks start empty
+int alarm_engine_start(AlarmEngine_t* engine, const AlarmParam_t* param);
+
+int alarm_engine_stop(AlarmEngine_t* engine);
+
+//one temp frame: label, track, then the frame's events go to event_func and stay in engine->events
+//returns the number of events or an error code
+int alarm_engine_process(AlarmEngine_t* engine, const uint16_t* temp_data, uint64_t seq, uint64_t timestamp_us);
+
+//the same with the frame's temp pyramid (stats.h): rows whose level 0 cells are all below clear_temp are skipped
+//without thresholding, the result is the same. NULL or a pyramid of another plane size labels every row
+int alarm_engine_process_pyramid(AlarmEngine_t* engine, const uint16_t* temp_data, const FramePyramid_t* pyramid, \
+    uint64_t seq, uint64_t timestamp_us);
+
+int alarm_engine_stats(AlarmEngine_t* engine, AlarmStats_t* stats);
+
+//the blobs of the last frame, any thread. the result is of the frame before when the engine is on this one
+int alarm_engine_blob_summary(AlarmEngine_t* engine, AlarmBlobSummary_t* summary);
+
+const char* alarm_event_name(AlarmEventType_t type);
+
+#endif
@@ -0,0 +1,182 @@
+#include "arena.h"
+#include "memacct.h"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#define ARENA_ROUND(x, a) (((x) + (a) - 1) & ~(size_t)((a) - 1))
+#define ARENA_BLOCK_ROUND 4096          //the block grows in whole pages
+
+void* arena_aligned_alloc(size_t size)
+{
+#if defined(_WIN32)
+	return _aligned_malloc(ARENA_ROUND(size, ARENA_ALIGN), ARENA_ALIGN);
+#else
+	void* ptr = NULL;
+	if (posix_memalign(&ptr, ARENA_ALIGN, ARENA_ROUND(size, ARENA_ALIGN)) != 0)
+	{
+		return NULL;
+	}
+	return ptr;
+#endif
+}
+
+void arena_aligned_free(void* ptr)
+{
+#if defined(_WIN32)
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+int arena_init(Arena_t* arena, size_t size)
+{
+	if (arena == NULL)
+	{
+		return ARENA_ERROR_PARAM;
+	}
+	memset(arena, 0, sizeof(Arena_t));
+	if (size > 0)
+	{
+		size = ARENA_ROUND(size, ARENA_BLOCK_ROUND);
+		arena->base = (uint8_t*)arena_aligned_alloc(size);
+		if (arena->base == NULL)
+		{
+			return ARENA_ERROR_MEM;
+		}
+		arena->size = size;
+		mem_acct_add(MEM_CLASS_ARENA, (int64_t)size);
+	}
+	return ARENA_SUCCESS;
+}
+
+void* arena_alloc(Arena_t* arena, size_t size)
+{
+	if (arena == NULL)
+	{
+		return NULL;
+	}
+	size = ARENA_ROUND((size > 0) ? size : 1, ARENA_ALIGN);
+	arena->frame_need += size;
+	if (arena->base != NULL && arena->size - arena->used >= size)
+	{
+		void* ptr = arena->base + arena->used;
+		arena->used += size;
+		return ptr;
+	}
+
+	//the chunk header takes one ARENA_ALIGN step so the data stays aligned
+	ArenaChunk_t* chunk = (ArenaChunk_t*)arena_aligned_alloc(ARENA_ALIGN + size);
+	if (chunk == NULL)
+	{
+		return NULL;
+	}
+	chunk->next = arena->overflow;
+	arena->overflow = chunk;
+	arena->overflows++;
+	return (uint8_t*)chunk + ARENA_ALIGN;
+}
+
+void arena_reset(Arena_t* arena)
+{
+	if (arena == NULL)
+	{
+		return;
+	}
+	uint8_t overflowed = (arena->overflow != NULL);
+	while (arena->overflow != NULL)
+	{
+		ArenaChunk_t* next = arena->overflow->next;
+		arena_aligned_free(arena->overflow);
+		arena->overflow = next;
+	}
+	if (arena->frame_need > arena->peak)
+	{
+		arena->peak = arena->frame_need;
+	}
+	//nothing points into the block any more, it can move
+	if (overflowed && arena->peak > arena->size)
+	{
+		size_t size = ARENA_ROUND(arena->peak, ARENA_BLOCK_ROUND);
+		uint8_t* base = (uint8_t*)arena_aligned_alloc(size);
+		if (base != NULL)
+		{
+			mem_acct_add(MEM_CLASS_ARENA, (int64_t)size - (int64_t)arena->size);
+			arena_aligned_free(arena->base);
+			arena->base = base;
+			arena->size = size;
+			arena->grows++;
+		}
+	}
+	arena->used = 0;
+	arena->frame_need = 0;
+	arena->frames++;
+}
+
+void arena_release(Arena_t* arena)
+{
+	if (arena == NULL)
+	{
+		return;
+	}
+	arena_reset(arena);
+	mem_acct_release(MEM_CLASS_ARENA, arena->size);
+	arena_aligned_free(arena->base);
+	memset(arena, 0, sizeof(Arena_t));
+}
+
+#ifdef ARENA_HEAP_CHECK
+static std::atomic<uint64_t> arena_heap_cnt(0);
+static thread_local uint64_t arena_heap_thread_cnt = 0;
+
+uint64_t arena_heap_allocs(void)
+{
+	return arena_heap_cnt.load(std::memory_order_relaxed);
+}
+
+uint64_t arena_heap_thread_allocs(void)
+{
+	return arena_heap_thread_cnt;
+}
+
+//glibc lets the executable interpose malloc, other platforms count nothing
+#if defined(__GLIBC__)
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t num, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void* __libc_memalign(size_t alignment, size_t size);
+
+extern "C" void* malloc(size_t size)
+{
+	arena_heap_cnt.fetch_add(1, std::memory_order_relaxed);
+	arena_heap_thread_cnt++;
+	return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t num, size_t size)
+{
+	arena_heap_cnt.fetch_add(1, std::memory_order_relaxed);
+	arena_heap_thread_cnt++;
+	return __libc_calloc(num, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+	arena_heap_cnt.fetch_add(1, std::memory_order_relaxed);
+	arena_heap_thread_cnt++;
+	return __libc_realloc(ptr, size);
+}
+
+extern "C" int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+	arena_heap_cnt.fetch_add(1, std::memory_order_relaxed);
+	arena_heap_thread_cnt++;
+	*ptr = __libc_memalign(alignment, size);
+	return (*ptr != NULL) ? 0 : 12;     //ENOMEM
+}
+#endif
+#endif
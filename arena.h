@@ -0,0 +1,56 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ARENA_SUCCESS 0
+#define ARENA_ERROR_PARAM -1
+#define ARENA_ERROR_MEM -2
+
+#define ARENA_ALIGN 64                  //cache line, and the widest simd load (avx-512) stays aligned
+#define ARENA_WARMUP_FRAMES 4           //heap check: frames after a reconfiguration that may still allocate
+
+//heap allocation that did not fit, freed by the next arena_reset
+typedef struct ArenaChunk_s {
+    struct ArenaChunk_s* next;
+}ArenaChunk_t;
+
+//bump allocator of one pipeline's per-frame scratch. arena_reset at the frame boundary drops every
+//allocation at once; a frame that needed more than the block is served from the heap and the reset
+//grows the block to that frame's need, so a steady state frame never touches the heap
+typedef struct {
+    uint8_t* base;
+    size_t size;
+    size_t used;
+    size_t frame_need;                  //bytes asked for this frame, aligned, including the overflow
+    size_t peak;                        //largest frame_need so far
+    ArenaChunk_t* overflow;
+    uint64_t frames;                    //arena_reset calls
+    uint32_t overflows;                 //allocations served from the heap
+    uint32_t grows;                     //times arena_reset enlarged the block
+}Arena_t;
+
+//size 0 starts empty, the first frame's need sizes the block
+int arena_init(Arena_t* arena, size_t size);
+
+//ARENA_ALIGN aligned, valid until the next arena_reset, NULL only when the heap is exhausted
+void* arena_alloc(Arena_t* arena, size_t size);
+
+//frame boundary: drop every allocation, grow the block when the last frames overflowed it
+void arena_reset(Arena_t* arena);
+
+void arena_release(Arena_t* arena);
+
+//ARENA_ALIGN aligned heap block for buffers that live longer than a frame, freed by arena_aligned_free
+void* arena_aligned_alloc(size_t size);
+void arena_aligned_free(void* ptr);
+
+//ARENA_HEAP_CHECK (cmake -DARENA_HEAP_CHECK=ON / make HEAP_CHECK=1) interposes malloc/calloc/realloc on glibc
+//and counts every heap allocation, the display asserts that a steady state frame made none
+#ifdef ARENA_HEAP_CHECK
+uint64_t arena_heap_allocs(void);           //process wide
+uint64_t arena_heap_thread_allocs(void);    //made by the calling thread
+#endif
+
+#endif
@@ -0,0 +1,452 @@
+#include "badpix.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "simd.h"
+
+#define BADPIX_NOISE_BINS 4096          //median of the std dev in 1/16 steps
+#define BADPIX_NOISE_SCALE 16.0f
+
+static inline int badpix_bit(const BadPix_t* badpix, int x, int y)
+{
+    uint32_t i = (uint32_t)y * badpix->width + x;
+    return (badpix->bitmap[i >> 3] >> (i & 7)) & 1;
+}
+
+static void badpix_table_free(BadPixTable_t* table)
+{
+    free(table->pix);
+    free(table->nbr);
+    free(table->value);
+    memset(table, 0, sizeof(BadPixTable_t));
+}
+
+int badpix_init(BadPix_t* badpix, int width, int height, uint8_t planes)
+{
+    if (badpix == NULL || width <= 0 || height <= 0)
+    {
+        return BADPIX_ERROR_PARAM;
+    }
+    memset(badpix, 0, sizeof(BadPix_t));
+    badpix->bitmap = (uint8_t*)calloc(((size_t)width * height + 7) / 8, 1);
+    if (badpix->bitmap == NULL)
+    {
+        return BADPIX_ERROR_MEM;
+    }
+    badpix->width = width;
+    badpix->height = height;
+    badpix->planes = planes;
+    badpix->generation = 1;
+    pthread_mutex_init(&badpix->mutex, NULL);
+    return BADPIX_SUCCESS;
+}
+
+void badpix_release(BadPix_t* badpix)
+{
+    if (badpix == NULL || badpix->bitmap == NULL)
+    {
+        return;
+    }
+    badpix_table_free(&badpix->table[0]);
+    badpix_table_free(&badpix->table[1]);
+    free(badpix->bitmap);
+    badpix->bitmap = NULL;
+    pthread_mutex_destroy(&badpix->mutex);
+}
+
+//called with the mutex held
+static int badpix_set(BadPix_t* badpix, int x, int y, int bad)
+{
+    if (x < 0 || y < 0 || x >= badpix->width || y >= badpix->height)
+    {
+        return BADPIX_ERROR_PARAM;
+    }
+    uint32_t i = (uint32_t)y * badpix->width + x;
+    uint8_t bit = (uint8_t)(1 << (i & 7));
+    if (((badpix->bitmap[i >> 3] & bit) != 0) != (bad != 0))
+    {
+        badpix->bitmap[i >> 3] ^= bit;
+        badpix->stats.pixels += bad ? 1 : -1;
+        badpix->generation++;
+    }
+    return BADPIX_SUCCESS;
+}
+
+int badpix_add(BadPix_t* badpix, int x, int y)
+{
+    if (badpix == NULL || badpix->bitmap == NULL)
+    {
+        return BADPIX_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&badpix->mutex);
+    int rst = badpix_set(badpix, x, y, 1);
+    pthread_mutex_unlock(&badpix->mutex);
+    return rst;
+}
+
+int badpix_remove(BadPix_t* badpix, int x, int y)
+{
+    if (badpix == NULL || badpix->bitmap == NULL)
+    {
+        return BADPIX_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&badpix->mutex);
+    int rst = badpix_set(badpix, x, y, 0);
+    pthread_mutex_unlock(&badpix->mutex);
+    return rst;
+}
+
+void badpix_clear(BadPix_t* badpix)
+{
+    if (badpix == NULL || badpix->bitmap == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&badpix->mutex);
+    memset(badpix->bitmap, 0, ((size_t)badpix->width * badpix->height + 7) / 8);
+    badpix->stats.pixels = 0;
+    badpix->generation++;
+    pthread_mutex_unlock(&badpix->mutex);
+}
+
+int badpix_is_bad(BadPix_t* badpix, int x, int y)
+{
+    if (badpix == NULL || badpix->bitmap == NULL || x < 0 || y < 0 || x >= badpix->width || y >= badpix->height)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&badpix->mutex);
+    int bad = badpix_bit(badpix, x, y);
+    pthread_mutex_unlock(&badpix->mutex);
+    return bad;
+}
+
+int badpix_load(BadPix_t* badpix, const char* path)
+{
+    if (badpix == NULL || badpix->bitmap == NULL || path == NULL)
+    {
+        return BADPIX_ERROR_PARAM;
+    }
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return BADPIX_ERROR_FILE;
+    }
+    char line[128];
+    int num = 0;
+    pthread_mutex_lock(&badpix->mutex);
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        int x, y;
+        if (line[0] != '#' && sscanf(line, "%d %d", &x, &y) == 2 && badpix_set(badpix, x, y, 1) == BADPIX_SUCCESS)
+        {
+            num++;
+        }
+    }
+    pthread_mutex_unlock(&badpix->mutex);
+    fclose(fp);
+    return num;
+}
+
+int badpix_save(BadPix_t* badpix, const char* path)
+{
+    if (badpix == NULL || badpix->bitmap == NULL || path == NULL)
+    {
+        return BADPIX_ERROR_PARAM;
+    }
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        return BADPIX_ERROR_FILE;
+    }
+    pthread_mutex_lock(&badpix->mutex);
+    fprintf(fp, "# bad pixels of a %dx%d sensor, x y\n", badpix->width, badpix->height);
+    for (int y = 0; y < badpix->height; y++)
+    {
+        for (int x = 0; x < badpix->width; x++)
+        {
+            if (badpix_bit(badpix, x, y))
+            {
+                fprintf(fp, "%d %d\n", x, y);
+            }
+        }
+    }
+    pthread_mutex_unlock(&badpix->mutex);
+    int rst = (fclose(fp) == 0) ? BADPIX_SUCCESS : BADPIX_ERROR_FILE;
+    return rst;
+}
+
+//up to BADPIX_NEIGHBORS good pixels around (x, y): the nearest along the row and the column first,
+//then the nearest ring. returns how many were found
+static int badpix_neighbors(const BadPix_t* badpix, int x, int y, int* nx, int* ny)
+{
+    static const int dir[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+    int found = 0;
+    for (int k = 0; k < 4; k++)
+    {
+        for (int d = 1; d <= BADPIX_SEARCH_RADIUS; d++)
+        {
+            int xx = x + dir[k][0] * d;
+            int yy = y + dir[k][1] * d;
+            if (xx < 0 || yy < 0 || xx >= badpix->width || yy >= badpix->height)
+            {
+                break;
+            }
+            if (!badpix_bit(badpix, xx, yy))
+            {
+                nx[found] = xx;
+                ny[found] = yy;
+                found++;
+                break;
+            }
+        }
+    }
+    for (int r = 1; found == 0 && r <= BADPIX_SEARCH_RADIUS; r++)
+    {
+        for (int dy = -r; dy <= r && found < BADPIX_NEIGHBORS; dy++)
+        {
+            for (int dx = -r; dx <= r && found < BADPIX_NEIGHBORS; dx += ((dy == -r || dy == r) ? 1 : 2 * r))
+            {
+                int xx = x + dx;
+                int yy = y + dy;
+                if (xx >= 0 && yy >= 0 && xx < badpix->width && yy < badpix->height && !badpix_bit(badpix, xx, yy))
+                {
+                    nx[found] = xx;
+                    ny[found] = yy;
+                    found++;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+//called with the mutex held
+static int badpix_table_build(BadPix_t* badpix, BadPixTable_t* table, uint32_t stride)
+{
+    badpix_table_free(table);
+    uint32_t num = badpix->stats.pixels;
+    if (num > 0)
+    {
+        table->pix = (uint32_t*)malloc(num * sizeof(uint32_t));
+        table->nbr = (uint32_t*)malloc((size_t)num * BADPIX_NEIGHBORS * sizeof(uint32_t));
+        table->value = (uint16_t*)malloc(num * sizeof(uint16_t));
+        if (table->pix == NULL || table->nbr == NULL || table->value == NULL)
+        {
+            badpix_table_free(table);
+            return BADPIX_ERROR_MEM;
+        }
+    }
+    int n = 0;
+    uint32_t uncorrectable = 0;
+    for (int y = 0; y < badpix->height && num > 0; y++)
+    {
+        for (int x = 0; x < badpix->width; x++)
+        {
+            int nx[BADPIX_NEIGHBORS], ny[BADPIX_NEIGHBORS];
+            int found;
+            if (!badpix_bit(badpix, x, y))
+            {
+                continue;
+            }
+            found = badpix_neighbors(badpix, x, y, nx, ny);
+            if (found == 0)
+            {
+                uncorrectable++;
+                continue;
+            }
+            table->pix[n] = (uint32_t)y * stride + x;
+            for (int k = 0; k < BADPIX_NEIGHBORS; k++)
+            {
+                //fewer found repeat, the mean stays theirs
+                table->nbr[k * num + n] = (uint32_t)ny[k % found] * stride + nx[k % found];
+            }
+            n++;
+        }
+    }
+    //the uncorrectable ones leave gaps, the gather takes rows of n
+    for (int k = 1; k < BADPIX_NEIGHBORS && (uint32_t)n < num; k++)
+    {
+        memmove(table->nbr + k * n, table->nbr + k * num, n * sizeof(uint32_t));
+    }
+    table->num = n;
+    table->stride = stride;
+    table->generation = badpix->generation;
+    badpix->stats.uncorrectable = uncorrectable;
+    return BADPIX_SUCCESS;
+}
+
+void badpix_apply(BadPix_t* badpix, uint8_t plane, uint16_t* data, int width, int height, uint32_t stride)
+{
+    if (badpix == NULL || badpix->bitmap == NULL || data == NULL || !(badpix->planes & plane) || \
+        width != badpix->width || height != badpix->height)
+    {
+        return;
+    }
+    uint64_t start_us = get_monotonic_us();
+    uint32_t stride_pix = (stride > 0) ? stride / sizeof(uint16_t) : (uint32_t)width;
+    BadPixTable_t* table = &badpix->table[(plane == BADPIX_PLANE_TEMP) ? 1 : 0];
+    pthread_mutex_lock(&badpix->mutex);
+    if ((table->generation != badpix->generation || table->stride != stride_pix) && \
+        badpix_table_build(badpix, table, stride_pix) != BADPIX_SUCCESS)
+    {
+        pthread_mutex_unlock(&badpix->mutex);
+        return;
+    }
+    if (table->num > 0)
+    {
+        uint32_t src_len = (uint32_t)(height - 1) * stride_pix + width;
+        simd_gather_mean4_u16(data, src_len, table->nbr, table->num, table->value);
+        for (int i = 0; i < table->num; i++)
+        {
+            data[table->pix[i]] = table->value[i];
+        }
+    }
+    badpix->stats.frames++;
+    uint64_t elapsed_us = get_monotonic_us() - start_us;
+    if (elapsed_us > badpix->stats.apply_max_us)
+    {
+        badpix->stats.apply_max_us = elapsed_us;
+    }
+    pthread_mutex_unlock(&badpix->mutex);
+}
+
+static uint16_t badpix_median8(uint16_t* v, int n)
+{
+    for (int i = 1; i < n; i++)
+    {
+        uint16_t t = v[i];
+        int j = i - 1;
+        for (; j >= 0 && v[j] > t; j--)
+        {
+            v[j + 1] = v[j];
+        }
+        v[j + 1] = t;
+    }
+    return (n & 1) ? v[n / 2] : (uint16_t)((v[n / 2 - 1] + v[n / 2] + 1) / 2);
+}
+
+//candidates in row major order into found, stops past max_found
+static int badpix_detect_scan(const BadPix_t* badpix, const uint16_t* mean, const float* noise, \
+    const BadPixDetectParam_t* param, uint32_t* hist, uint32_t* found, int max_found)
+{
+    int width = badpix->width;
+    int height = badpix->height;
+    int pix_num = width * height;
+    for (int i = 0; i < pix_num; i++)
+    {
+        int bin = (int)(noise[i] * BADPIX_NOISE_SCALE);
+        hist[(bin < BADPIX_NOISE_BINS) ? bin : BADPIX_NOISE_BINS - 1]++;
+    }
+    uint32_t half = (uint32_t)pix_num / 2;
+    uint32_t cnt = 0;
+    int median_bin = 0;
+    for (; median_bin < BADPIX_NOISE_BINS - 1 && cnt + hist[median_bin] <= half; median_bin++)
+    {
+        cnt += hist[median_bin];
+    }
+    float noise_limit = (median_bin + 0.5f) / BADPIX_NOISE_SCALE * param->noise_ratio;
+
+    int found_num = 0;
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            int i = y * width + x;
+            if (badpix_bit(badpix, x, y))
+            {
+                continue;
+            }
+            int bad = noise[i] <= param->stuck_noise || (param->noise_ratio > 0 && noise[i] > noise_limit);
+            if (!bad && param->offset > 0)
+            {
+                uint16_t v[8];
+                int n = 0;
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        int xx = x + dx;
+                        int yy = y + dy;
+                        if ((dx != 0 || dy != 0) && xx >= 0 && yy >= 0 && xx < width && yy < height)
+                        {
+                            v[n++] = mean[yy * width + xx];
+                        }
+                    }
+                }
+                int diff = (int)mean[i] - (int)badpix_median8(v, n);
+                bad = diff > param->offset || -diff > param->offset;
+            }
+            if (bad)
+            {
+                if (found_num == max_found)
+                {
+                    return found_num + 1;
+                }
+                found[found_num++] = (uint32_t)i;
+            }
+        }
+    }
+    return found_num;
+}
+
+int badpix_detect(BadPix_t* badpix, Accum_t* accum, const BadPixDetectParam_t* param)
+{
+    static const BadPixDetectParam_t detect_default = { BADPIX_STUCK_NOISE, BADPIX_NOISE_RATIO, BADPIX_OFFSET };
+    if (badpix == NULL || badpix->bitmap == NULL || accum == NULL || \
+        accum->width != badpix->width || accum->height != badpix->height)
+    {
+        return BADPIX_ERROR_PARAM;
+    }
+    if (param == NULL)
+    {
+        param = &detect_default;
+    }
+    int pix_num = badpix->width * badpix->height;
+    int max_found = (int)(pix_num * BADPIX_DETECT_MAX_SHARE);
+    uint16_t* mean = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    float* noise = (float*)malloc(pix_num * sizeof(float));
+    uint32_t* hist = (uint32_t*)calloc(BADPIX_NOISE_BINS, sizeof(uint32_t));
+    uint32_t* found = (uint32_t*)malloc((max_found + 1) * sizeof(uint32_t));
+    int rst = BADPIX_ERROR_MEM;
+    if (mean != NULL && noise != NULL && hist != NULL && found != NULL)
+    {
+        //the mean and the noise of the same frames
+        accum_stop(accum);
+        rst = BADPIX_ERROR_PARAM;
+        if (accum_mean(accum, mean) == ACCUM_SUCCESS && accum_noise(accum, noise, NULL) == ACCUM_SUCCESS)
+        {
+            //under the lock with the map it skips, well below a frame interval
+            pthread_mutex_lock(&badpix->mutex);
+            int found_num = badpix_detect_scan(badpix, mean, noise, param, hist, found, max_found);
+            rst = BADPIX_ERROR_SCENE;
+            if (found_num <= max_found)
+            {
+                for (int k = 0; k < found_num; k++)
+                {
+                    badpix_set(badpix, (int)(found[k] % badpix->width), (int)(found[k] / badpix->width), 1);
+                }
+                badpix->stats.detected += found_num;
+                rst = found_num;
+            }
+            pthread_mutex_unlock(&badpix->mutex);
+        }
+    }
+    free(mean);
+    free(noise);
+    free(hist);
+    free(found);
+    return rst;
+}
+
+int badpix_stats(BadPix_t* badpix, BadPixStats_t* stats)
+{
+    if (badpix == NULL || badpix->bitmap == NULL || stats == NULL)
+    {
+        return BADPIX_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&badpix->mutex);
+    *stats = badpix->stats;
+    pthread_mutex_unlock(&badpix->mutex);
+    return BADPIX_SUCCESS;
+}
@@ -0,0 +1,91 @@
+#ifndef _BADPIX_H_
+#define _BADPIX_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "accum.h"
+
+#define BADPIX_NEIGHBORS 4              //good pixels averaged into each bad one
+#define BADPIX_SEARCH_RADIUS 3          //how far along the row, the column and then the rings good ones are looked for
+#define BADPIX_STUCK_NOISE 0.05f        //temporal std dev at or below it: stuck
+#define BADPIX_NOISE_RATIO 6.0f         //std dev above this many times the frame's median: flickering
+#define BADPIX_OFFSET 400               //mean this far from the median of its 8 neighbours: hot or cold (Y14 counts)
+#define BADPIX_DETECT_MAX_SHARE 0.01f   //a detection flagging more of the frame saw no usable scene, nothing is added
+
+#define BADPIX_SUCCESS 0
+#define BADPIX_ERROR_PARAM -1
+#define BADPIX_ERROR_MEM -2
+#define BADPIX_ERROR_FILE -3
+#define BADPIX_ERROR_SCENE -4           //detection: too many pixels flagged
+
+#define BADPIX_PLANE_IMAGE 0x01         //Y14/Y16 image plane
+#define BADPIX_PLANE_TEMP 0x02          //same sensor pixels in the temp plane
+
+typedef struct {
+    float stuck_noise;
+    float noise_ratio;
+    uint16_t offset;                    //0 leaves hot/cold pixels alone
+}BadPixDetectParam_t;
+
+typedef struct {
+    uint64_t frames;                    //planes corrected
+    uint32_t pixels;                    //bits in the map
+    uint32_t uncorrectable;             //no good pixel within the search radius, left as they are
+    uint32_t detected;                  //added by badpix_detect
+    uint64_t apply_max_us;
+}BadPixStats_t;
+
+//the corrections for one plane stride: pixel offsets and the neighbour offsets they are averaged from
+typedef struct {
+    uint32_t stride;                    //pixels per row
+    uint32_t generation;                //of the map it was built from
+    int num;
+    uint32_t* pix;
+    uint32_t* nbr;                      //neighbour k of pixel i at nbr[k * num + i], never a bad pixel
+    uint16_t* value;                    //gather output before it is written back
+}BadPixTable_t;
+
+//host side defective pixel correction: a bitmap of bad pixels of any size (the firmware map is limited and its
+//auto calibration stops the stream), applied in place by one gather pass in the stream thread before the
+//statistics. detection from an image plane accumulator adds pixels that go bad while streaming
+typedef struct BadPix_t {
+    int width;
+    int height;
+    uint8_t planes;                     //BADPIX_PLANE_xxx
+    uint8_t* bitmap;                    //one bit per pixel, row major
+    uint32_t generation;                //bumped by every map change, the tables follow before the next frame
+    BadPixTable_t table[2];             //image, temp
+    BadPixStats_t stats;
+    pthread_mutex_t mutex;              //map changes from any thread against the stream thread
+}BadPix_t;
+
+int badpix_init(BadPix_t* badpix, int width, int height, uint8_t planes);
+
+void badpix_release(BadPix_t* badpix);
+
+//any thread, the stream thread picks the changes up with its next frame
+int badpix_add(BadPix_t* badpix, int x, int y);
+
+int badpix_remove(BadPix_t* badpix, int x, int y);
+
+void badpix_clear(BadPix_t* badpix);
+
+int badpix_is_bad(BadPix_t* badpix, int x, int y);
+
+//text file of "x y" lines, '#' comments. load adds to the map, returns the pixels read or BADPIX_ERROR_xxx
+int badpix_load(BadPix_t* badpix, const char* path);
+
+int badpix_save(BadPix_t* badpix, const char* path);
+
+//correct one plane in place, stride in bytes. plane BADPIX_PLANE_IMAGE or BADPIX_PLANE_TEMP, skipped when the
+//map does not cover it or the sizes differ
+void badpix_apply(BadPix_t* badpix, uint8_t plane, uint16_t* data, int width, int height, uint32_t stride);
+
+//find stuck, flickering and hot/cold pixels in an accumulator of the image plane (a uniform or slowly moving
+//scene, at least 2 frames) and add them. param NULL selects the BADPIX_xxx defaults.
+//returns the pixels added or BADPIX_ERROR_xxx
+int badpix_detect(BadPix_t* badpix, Accum_t* accum, const BadPixDetectParam_t* param);
+
+int badpix_stats(BadPix_t* badpix, BadPixStats_t* stats);
+
+#endif
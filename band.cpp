@@ -0,0 +1,162 @@
+#include "band.h"
+#include <pthread.h>
+#include <atomic>
+
+typedef struct {
+    const BandStage_t* stages;
+    int stage_num;
+    int band_num;
+    PoolStage_t pool_stage;
+    std::atomic<int> next;              //next band ticket, ticket / band_num is its stage
+    std::atomic<int> released;          //tickets below this belong to stages whose input is ready
+    std::atomic<int> done[BAND_MAX_STAGES];
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int helpers;                        //pool tasks that may still touch the job, under mutex
+    int finished;
+}BandJob_t;
+
+static void band_helper(void* arg);
+
+//take the next band of a released stage, -1 when everything released is taken
+static int band_claim(BandJob_t* job)
+{
+    int ticket = job->next.load();
+    while (ticket < job->released.load())
+    {
+        if (job->next.compare_exchange_weak(ticket, ticket + 1))
+        {
+            return ticket;
+        }
+    }
+    return -1;
+}
+
+static void band_helpers_submit(BandJob_t* job)
+{
+    int helper_num = job->band_num - 1;
+    if (helper_num > pool_worker_num())
+    {
+        helper_num = pool_worker_num();
+    }
+    pthread_mutex_lock(&job->mutex);
+    job->helpers += helper_num;
+    pthread_mutex_unlock(&job->mutex);
+    for (int i = 0; i < helper_num; i++)
+    {
+        pool_submit(job->pool_stage, band_helper, job);
+    }
+}
+
+static void band_execute(BandJob_t* job, int ticket)
+{
+    int s = ticket / job->band_num;
+    int band = ticket % job->band_num;
+    const BandStage_t* stage = &job->stages[s];
+    int y0 = (int)((int64_t)stage->rows * band / job->band_num);
+    int y1 = (int)((int64_t)stage->rows * (band + 1) / job->band_num);
+    if (y1 > y0)
+    {
+        stage->func(stage->arg, band, y0, y1);
+    }
+    if (job->done[s].fetch_add(1) + 1 < job->band_num)
+    {
+        return;
+    }
+
+    //last band of the stage: hand the next stage to whoever is free, or the result to the caller
+    if (s + 1 < job->stage_num)
+    {
+        job->released.fetch_add(job->band_num);
+        band_helpers_submit(job);
+        pthread_mutex_lock(&job->mutex);
+        pthread_cond_broadcast(&job->cond);
+        pthread_mutex_unlock(&job->mutex);
+        return;
+    }
+    pthread_mutex_lock(&job->mutex);
+    job->finished = 1;
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->mutex);
+}
+
+static void band_helper(void* arg)
+{
+    BandJob_t* job = (BandJob_t*)arg;
+    int ticket;
+    while ((ticket = band_claim(job)) >= 0)
+    {
+        band_execute(job, ticket);
+    }
+    pthread_mutex_lock(&job->mutex);
+    job->helpers--;
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->mutex);
+}
+
+int band_run(PoolStage_t pool_stage, const BandStage_t* stages, int stage_num, int band_num)
+{
+    if (stages == NULL || stage_num <= 0 || stage_num > BAND_MAX_STAGES || band_num <= 0)
+    {
+        return BAND_ERROR_PARAM;
+    }
+    if (band_num > BAND_MAX_NUM)
+    {
+        band_num = BAND_MAX_NUM;
+    }
+    if (band_num == 1 || pool_worker_num() == 0)
+    {
+        for (int s = 0; s < stage_num; s++)
+        {
+            for (int band = 0; band < band_num; band++)
+            {
+                int y0 = (int)((int64_t)stages[s].rows * band / band_num);
+                int y1 = (int)((int64_t)stages[s].rows * (band + 1) / band_num);
+                if (y1 > y0)
+                {
+                    stages[s].func(stages[s].arg, band, y0, y1);
+                }
+            }
+        }
+        return BAND_SUCCESS;
+    }
+
+    BandJob_t job;
+    job.stages = stages;
+    job.stage_num = stage_num;
+    job.band_num = band_num;
+    job.pool_stage = pool_stage;
+    job.next.store(0);
+    job.released.store(band_num);
+    for (int s = 0; s < BAND_MAX_STAGES; s++)
+    {
+        job.done[s].store(0);
+    }
+    pthread_mutex_init(&job.mutex, NULL);
+    pthread_cond_init(&job.cond, NULL);
+    job.helpers = 0;
+    job.finished = 0;
+
+    band_helpers_submit(&job);
+    pthread_mutex_lock(&job.mutex);
+    while (!job.finished || job.helpers > 0)
+    {
+        if (job.next.load() < job.released.load())
+        {
+            pthread_mutex_unlock(&job.mutex);
+            int ticket;
+            while ((ticket = band_claim(&job)) >= 0)
+            {
+                band_execute(&job, ticket);
+            }
+            pthread_mutex_lock(&job.mutex);
+            continue;
+        }
+        pthread_cond_wait(&job.cond, &job.mutex);
+    }
+    pthread_mutex_unlock(&job.mutex);
+
+    pthread_mutex_destroy(&job.mutex);
+    pthread_cond_destroy(&job.cond);
+    return BAND_SUCCESS;
+}
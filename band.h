@@ -0,0 +1,28 @@
+#ifndef _BAND_H_
+#define _BAND_H_
+
+#include <stdint.h>
+#include "pool.h"
+
+#define BAND_MAX_NUM 16                 //row bands per stage
+#define BAND_MAX_STAGES 4
+
+#define BAND_SUCCESS 0
+#define BAND_ERROR_PARAM -1
+
+//process rows [y0, y1) of the stage's output, band is the band's index in [0, band_num)
+typedef void (*BandFunc_t)(void* arg, int band, int y0, int y1);
+
+typedef struct {
+    BandFunc_t func;
+    void* arg;
+    int rows;                           //rows (or any other unit) the stage splits into bands
+}BandStage_t;
+
+//run the stages in order, each one split into band_num row bands over the task pool
+//there is no barrier between the stages: the band that finishes a stage last releases the next stage's bands,
+//and the one that finishes the last stage wakes the caller. the caller works on bands too while it waits
+//without a pool or with one band everything runs in the caller, band by band
+int band_run(PoolStage_t pool_stage, const BandStage_t* stages, int stage_num, int band_num);
+
+#endif
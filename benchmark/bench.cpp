@@ -0,0 +1,4794 @@
+//headless benchmark of the processing chain, replays recorded raw frames without a camera
+//usage: bench [-f raw_dump | -r recording] [-n frames] [-w width] [-h height] [-g golden]
+//             [-j results.json] [-b baseline.json] [-t threshold_pct] [-c host_class] [-p]
+//raw_dump is camera raw frames written back to back (width*height*2 bytes each, image half then temp half),
+//a recording (record.h) is replayed through the frame source and gives its own size,
+//without -f/-r a synthetic scene is generated.
+//-g runs the golden output check instead of the benchmarks, bench_golden below, and exits with its mismatch count.
+//-j writes the results as json, -b compares them with such a file of the same host class (bench_host_class or -c)
+//and exits with 1 when a result is more than threshold_pct slower or allocates more. it exits with 1 as well when
+//the stress check of a queue or graph run fails. -p reads the hardware counters (perfctr.h) around the cut, stats,
+//enhance, process, transform, segment and temp stages and reports them per pixel after the results
+#include "display.h"
+#include "tau.h"
+#include "record.h"
+#include "source.h"
+#include "alarm.h"
+#include "tracker.h"
+#include "fusion.h"
+#include "mosaic.h"
+#include "tempspan.h"
+#include "queue.h"
+#include "graph.h"
+#include "bus.h"
+#include "framesync.h"
+#include "stream.h"
+#include "profile.h"
+#include "snapshot.h"
+#include "perfctr.h"
+#include "tempquery.h"
+#include "rule.h"
+#include "plugin.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <pthread.h>
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define BENCH_DEFAULT_FRAMES 100
+#define BENCH_DEFAULT_WIDTH 256
+#define BENCH_DEFAULT_HEIGHT 384
+#define BENCH_SYNTH_FRAMES 8
+#define BENCH_REPLAY_MAX_FRAMES 256     //frames of a recording kept in memory
+#define BENCH_MAX_RESULTS 512
+#define BENCH_NR_FRAMES 32              //frames of the noisy y14 sequence for the noise reduction stage
+#define BENCH_NR_SIGMA 16               //y14 noise, about the NETD of the sensor on a 14 bit scale
+#define BENCH_GOLDEN_FRAMES 2           //input frames of the golden check, followed by the fuzzed ones
+#define BENCH_GOLDEN_FUZZ 4
+#define BENCH_REGRESSION_PCT 10        //-t default: slower than the baseline by more than this is a regression
+#define BENCH_ALLOC_SLACK 0.5           //allocations per frame above the baseline that are a regression
+#define BENCH_QUEUE_MESSAGES 1000       //hand-offs per frame of the queue stage
+#define BENCH_QUEUE_CAPACITY 256
+#define BENCH_QUEUE_MAX_THREADS 4       //producers, and as many consumers
+#define BENCH_GRAPH_FRAMES 10           //ring frames per frame of the graph stage
+#define BENCH_GRAPH_SIZE 64             //width and height of its planes
+#define BENCH_PLUGIN_PACE_US 20         //between the ring frames of the plugin stage
+#define BENCH_SYNC_CAMERAS 3            //frame sync check: cameras 2 ms apart with 3/9/15 ms of latency
+#define BENCH_SYNC_PERIOD_US 40000
+#define BENCH_SYNC_JITTER_US 6000       //usb delivery delay on top of the latency
+#define BENCH_RADIOMETRIC_DEADBAND 12   //raw temp units, 3/16 K, of the lossy radiometric config
+#define BENCH_RADIOMETRIC_FPS 25        //the rate its bitrate is given for
+
+//glibc lets the executable interpose malloc, other platforms report no allocation count
+#if defined(__GLIBC__)
+#define BENCH_COUNT_ALLOC
+#endif
+
+#if defined(ARENA_HEAP_CHECK)
+//the arena module interposes malloc already, read its counter
+struct BenchAllocCnt_t {
+    uint64_t load() const { return arena_heap_allocs(); }
+};
+static BenchAllocCnt_t bench_alloc_cnt;
+#else
+static std::atomic<uint64_t> bench_alloc_cnt(0);
+#endif
+
+#if defined(BENCH_COUNT_ALLOC) && !defined(ARENA_HEAP_CHECK)
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t num, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+extern "C" void* malloc(size_t size)
+{
+    bench_alloc_cnt.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t num, size_t size)
+{
+    bench_alloc_cnt.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(num, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    bench_alloc_cnt.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+typedef struct {
+    char stage[20];
+    char config[64];
+    int frames;
+    uint64_t elapsed_us;
+    uint64_t alloc_cnt;
+    int pix_num;
+    uint64_t peak_rss_kb;               //of the process when the stage finished
+    uint32_t perf_valid;                //PerfCounters_t valid bits, 0 when the stage ran without counters
+    PerfCounts_t perf;
+}BenchResult_t;
+
+typedef struct {
+    uint8_t* raw_frames;                //frame_num raw frames back to back
+    int frame_num;
+    int frame_size;
+    int width;                          //image/temp width
+    int height;                         //image/temp height, half of the raw frame height
+    uint8_t* image_frame;
+    uint8_t* temp_frame;
+    uint16_t* y14_frame;                //image half converted to Y14 for the INPUT_FMT_Y14 cases
+}BenchInput_t;
+
+static BenchResult_t bench_results[BENCH_MAX_RESULTS];
+static int bench_result_num = 0;
+
+//-p: the main thread's counter group, a stage reads it at its start and bench_result_add takes the difference
+static PerfCounters_t bench_perf;
+static int bench_perf_on = 0;
+static int bench_perf_pending = 0;
+static PerfCounts_t bench_perf_begin;
+
+static const char* input_format_names[] = { "y14", "y16", "yuv422" };
+static const char* output_format_names[] = { "y14", "yuv422", "yuv444", "rgb888", "bgr888", "bgra32", "rgba32" };
+static const char* enhance_names[] = { "stretch", "off", "hist_agc", "lib", "clahe", "dde" };
+static const char* rotate_names[] = { "none", "left90", "right90", "180" };
+static const char* mirror_flip_names[] = { "none", "mirror", "flip", "mirror_flip" };
+
+//peak resident set of the process so far, 0 where it is not known
+static uint64_t bench_peak_rss_kb(void)
+{
+#if !defined(_WIN32)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        return (uint64_t)usage.ru_maxrss;
+    }
+#endif
+    return 0;
+}
+
+//just after the start_us of a stage with counters
+static void bench_perf_start(void)
+{
+    bench_perf_pending = bench_perf_on && perf_counters_read(&bench_perf, &bench_perf_begin) == PERF_SUCCESS;
+}
+
+static void bench_result_add(const char* stage, const char* config, int frames, uint64_t elapsed_us, \
+    uint64_t alloc_cnt, int pix_num)
+{
+    PerfCounts_t perf_end;
+    int perf_read = bench_perf_pending && perf_counters_read(&bench_perf, &perf_end) == PERF_SUCCESS;
+    bench_perf_pending = 0;
+    if (bench_result_num >= BENCH_MAX_RESULTS)
+    {
+        return;
+    }
+    BenchResult_t* result = &bench_results[bench_result_num++];
+    snprintf(result->stage, sizeof(result->stage), "%s", stage);
+    snprintf(result->config, sizeof(result->config), "%s", config);
+    result->frames = frames;
+    result->elapsed_us = elapsed_us;
+    result->alloc_cnt = alloc_cnt;
+    result->pix_num = pix_num;
+    result->peak_rss_kb = bench_peak_rss_kb();
+    result->perf_valid = perf_read ? bench_perf.valid : 0;
+    if (perf_read)
+    {
+        perf_counts_sub(&perf_end, &bench_perf_begin, &result->perf);
+    }
+}
+
+//background around 22C with a warm 34C blob drifting across the frames, values in 1/64 K
+static void bench_synth_frames(BenchInput_t* input)
+{
+    int pix_num = input->width * input->height;
+    uint32_t seed = 12345;
+    for (int n = 0; n < input->frame_num; n++)
+    {
+        uint16_t* image = (uint16_t*)(input->raw_frames + (size_t)n * input->frame_size);
+        uint16_t* temp = image + pix_num;
+        int cx = input->width / 4 + n * input->width / (2 * input->frame_num);
+        int cy = input->height / 2;
+        int r = input->height / 4;
+        for (int y = 0; y < input->height; y++)
+        {
+            for (int x = 0; x < input->width; x++)
+            {
+                seed = seed * 1103515245 + 12345;
+                int noise = (int)((seed >> 16) % 41) - 20;
+                int inside = (x - cx) * (x - cx) + (y - cy) * (y - cy) < r * r;
+                int value = (int)(((inside ? 34.0 : 22.0) + 273.15) * 64) + y + noise;
+                temp[y * input->width + x] = (uint16_t)value;
+                int image_value = (value - 17000) * 16;
+                image[y * input->width + x] = (uint16_t)((image_value < 0) ? 0 : \
+                    ((image_value > 65535) ? 65535 : image_value));
+            }
+        }
+    }
+}
+
+static int bench_load_frames(BenchInput_t* input, const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        printf("bench: open %s failed\n", path);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long file_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    input->frame_num = (int)(file_size / input->frame_size);
+    if (input->frame_num <= 0)
+    {
+        printf("bench: %s holds no complete %d byte frame\n", path, input->frame_size);
+        fclose(fp);
+        return -1;
+    }
+    input->raw_frames = (uint8_t*)malloc((size_t)input->frame_num * input->frame_size);
+    if (input->raw_frames == NULL || \
+        fread(input->raw_frames, input->frame_size, input->frame_num, fp) != (size_t)input->frame_num)
+    {
+        printf("bench: read %s failed\n", path);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+//the first BENCH_REPLAY_MAX_FRAMES frames of a recording with an image and a temp plane of the same size
+static int bench_replay_frames(BenchInput_t* input, const char* path)
+{
+    FrameSource_t source;
+    FrameSourceParam_t param = { FRAME_SOURCE_REPLAY };
+    snprintf(param.path, sizeof(param.path), "%s", path);
+    if (frame_source_open(&source, &param) != SOURCE_SUCCESS)
+    {
+        return -1;
+    }
+    CameraParam_t camera_param = { 0 };
+    frame_source_camera_param(&source, &camera_param);
+    RecordFileHeader_t* header = &source.reader.header;
+    if (header->image_byte_size == 0 || header->image_byte_size != header->temp_byte_size || \
+        header->image_width != header->temp_width || header->image_byte_size != header->image_width * \
+        header->image_height * 2 || header->frame_num == 0)
+    {
+        printf("bench: %s needs an image and a temp plane of one size\n", path);
+        frame_source_close(&source);
+        return -1;
+    }
+    input->width = (int)camera_param.width;
+    input->height = (int)camera_param.height / 2;
+    input->frame_size = (int)camera_param.frame_size;
+    input->frame_num = (header->frame_num < BENCH_REPLAY_MAX_FRAMES) ? (int)header->frame_num : BENCH_REPLAY_MAX_FRAMES;
+    input->raw_frames = (uint8_t*)malloc((size_t)input->frame_num * input->frame_size);
+    if (input->raw_frames == NULL)
+    {
+        frame_source_close(&source);
+        return -1;
+    }
+    int got = 0;
+    while (got < input->frame_num && \
+        frame_source_get(&source, input->raw_frames + (size_t)got * input->frame_size) == SOURCE_SUCCESS)
+    {
+        got++;
+    }
+    frame_source_close(&source);
+    input->frame_num = got;
+    return (got > 0) ? 0 : -1;
+}
+
+static uint8_t* bench_raw_frame(BenchInput_t* input, int n)
+{
+    return input->raw_frames + (size_t)(n % input->frame_num) * input->frame_size;
+}
+
+static void bench_cut(BenchInput_t* input, int frames)
+{
+    int byte_size = input->width * input->height * 2;
+    uint64_t alloc_start = bench_alloc_cnt.load();
+    uint64_t start_us = get_monotonic_us();
+    bench_perf_start();
+    for (int n = 0; n < frames; n++)
+    {
+        raw_data_cut(bench_raw_frame(input, n), byte_size, byte_size, input->image_frame, input->temp_frame);
+    }
+    bench_result_add("cut", "raw_data_cut", frames, get_monotonic_us() - start_us, \
+        bench_alloc_cnt.load() - alloc_start, input->width * input->height);
+}
+
+//the stream thread's per-plane statistics pass
+static void bench_stats(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    FrameStats_t stats;
+    uint64_t alloc_start = bench_alloc_cnt.load();
+    uint64_t start_us = get_monotonic_us();
+    bench_perf_start();
+    for (int n = 0; n < frames; n++)
+    {
+        uint16_t* temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+        frame_stats_compute(temp, input->width, input->height, &stats);
+    }
+    bench_result_add("stats", "frame_stats_compute", frames, get_monotonic_us() - start_us, \
+        bench_alloc_cnt.load() - alloc_start, pix_num);
+}
+
+//max / min hold of the temp frames with decay, per simd level against scalar. returns the number of mismatches
+static int bench_hold(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    AccumHold_t hold[2];
+    if (accum_hold_init(&hold[0], input->width, input->height, 2) != ACCUM_SUCCESS)
+    {
+        return 0;
+    }
+    if (accum_hold_init(&hold[1], input->width, input->height, 2) != ACCUM_SUCCESS)
+    {
+        accum_hold_release(&hold[0]);
+        return 0;
+    }
+    SimdLevel_t level = simd_level_get();
+    const char* names[] = { "max/min hold", "max/min hold scalar" };
+    for (int config = 0; config < 2; config++)
+    {
+        simd_level_set((config == 1) ? SIMD_LEVEL_SCALAR : level);
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            accum_hold_add(&hold[config], (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2), 0, (uint64_t)n);
+        }
+        bench_result_add("stats", names[config], frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+    simd_level_set(level);
+    int failed = 0;
+    if (memcmp(hold[0].max_val, hold[1].max_val, (size_t)pix_num * sizeof(uint16_t)) != 0 || \
+        memcmp(hold[0].min_val, hold[1].min_val, (size_t)pix_num * sizeof(uint16_t)) != 0)
+    {
+        printf("bench: max/min hold differs from scalar\n");
+        failed++;
+    }
+    accum_hold_release(&hold[0]);
+    accum_hold_release(&hold[1]);
+    return failed;
+}
+
+//rate of rise stage at 25 fps per simd level against scalar, then a plane ramping 2 raw units per frame has to read
+//50 units per second. returns the number of mismatches
+static int bench_rate(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    AccumRateParam_t param;
+    memset(&param, 0, sizeof(param));
+    param.alarm.raise_temp = TEMP_RAW_OF_KELVIN_DELTA(2.0);
+    param.alarm.clear_temp = TEMP_RAW_OF_KELVIN_DELTA(1.0);
+    AccumRate_t rate[2];
+    if (accum_rate_init(&rate[0], input->width, input->height, &param) != ACCUM_SUCCESS)
+    {
+        return 0;
+    }
+    if (accum_rate_init(&rate[1], input->width, input->height, &param) != ACCUM_SUCCESS)
+    {
+        accum_rate_release(&rate[0]);
+        return 0;
+    }
+    SimdLevel_t level = simd_level_get();
+    const char* names[] = { "rate of rise", "rate of rise scalar" };
+    for (int config = 0; config < 2; config++)
+    {
+        simd_level_set((config == 1) ? SIMD_LEVEL_SCALAR : level);
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            accum_rate_add(&rate[config], (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2), 0, (uint64_t)n + 1, \
+                (uint64_t)n * 40000);
+        }
+        bench_result_add("stats", names[config], frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+    simd_level_set(level);
+    int failed = 0;
+    if (memcmp(rate[0].rate, rate[1].rate, (size_t)pix_num * sizeof(uint16_t)) != 0 || \
+        memcmp(rate[0].slope, rate[1].slope, (size_t)pix_num * sizeof(int32_t)) != 0)
+    {
+        printf("bench: rate of rise differs from scalar\n");
+        failed++;
+    }
+    uint16_t* ramp = (uint16_t*)malloc((size_t)pix_num * sizeof(uint16_t));
+    if (ramp != NULL)
+    {
+        accum_rate_reset(&rate[0]);
+        for (int n = 0; n < 128; n++)
+        {
+            for (int i = 0; i < pix_num; i++)
+            {
+                ramp[i] = (uint16_t)(TEMP_RAW_OF_CELSIUS(25) + 2 * n);
+            }
+            accum_rate_add(&rate[0], ramp, 0, (uint64_t)n + 1, (uint64_t)n * 40000);
+        }
+        if (rate[0].rate[0] < 49 || rate[0].rate[0] > 51 || rate[0].rate[pix_num - 1] != rate[0].rate[0])
+        {
+            printf("bench: rate of rise of a 50 units/s ramp is %u\n", rate[0].rate[0]);
+            failed++;
+        }
+        free(ramp);
+    }
+    accum_rate_release(&rate[0]);
+    accum_rate_release(&rate[1]);
+    return failed;
+}
+
+static int bench_background(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    AccumBackgroundParam_t param;
+    memset(&param, 0, sizeof(param));
+    param.alarm.raise_temp = ACCUM_BACKGROUND_OF_SIGMA(4);
+    param.alarm.clear_temp = ACCUM_BACKGROUND_OF_SIGMA(3);
+    AccumBackground_t background[2];
+    if (accum_background_init(&background[0], input->width, input->height, &param) != ACCUM_SUCCESS)
+    {
+        return 0;
+    }
+    if (accum_background_init(&background[1], input->width, input->height, &param) != ACCUM_SUCCESS)
+    {
+        accum_background_release(&background[0]);
+        return 0;
+    }
+    SimdLevel_t level = simd_level_get();
+    const char* names[] = { "background", "background scalar" };
+    for (int config = 0; config < 2; config++)
+    {
+        simd_level_set((config == 1) ? SIMD_LEVEL_SCALAR : level);
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            accum_background_add(&background[config], (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2), 0, \
+                (uint64_t)n + 1, (uint64_t)n * 40000);
+        }
+        bench_result_add("stats", names[config], frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+    simd_level_set(level);
+    int failed = 0;
+    if (memcmp(background[0].score, background[1].score, (size_t)pix_num * sizeof(uint16_t)) != 0 || \
+        memcmp(background[0].mean, background[1].mean, (size_t)pix_num * sizeof(int32_t)) != 0 || \
+        memcmp(background[0].var, background[1].var, (size_t)pix_num * sizeof(int32_t)) != 0)
+    {
+        printf("bench: background differs from scalar\n");
+        failed++;
+    }
+    accum_background_release(&background[1]);
+    accum_background_release(&background[0]);
+    //a 1 K step in a flat scene learned at 1/16 is far over 4 sigma, only where it is
+    param.learn_shift = 4;
+    uint16_t* flat = (uint16_t*)malloc((size_t)pix_num * sizeof(uint16_t));
+    if (flat != NULL && accum_background_init(&background[0], input->width, input->height, &param) == ACCUM_SUCCESS)
+    {
+        for (int i = 0; i < pix_num; i++)
+        {
+            flat[i] = (uint16_t)TEMP_RAW_OF_CELSIUS(25);
+        }
+        int event_num = 0;
+        for (int n = 0; n < 32; n++)
+        {
+            event_num += accum_background_add(&background[0], flat, 0, (uint64_t)n + 1, (uint64_t)n * 40000);
+        }
+        for (int y = 8; y < 24; y++)
+        {
+            for (int x = 8; x < 24; x++)
+            {
+                flat[y * input->width + x] += TEMP_RAW_OF_KELVIN_DELTA(1.0);
+            }
+        }
+        event_num += accum_background_add(&background[0], flat, 0, 33, 32 * 40000);
+        uint16_t score = background[0].score[16 * input->width + 16];
+        if (event_num != 1 || score < ACCUM_BACKGROUND_OF_SIGMA(4) || background[0].score[0] != 0)
+        {
+            printf("bench: background step scored %u with %d events\n", score, event_num);
+            failed++;
+        }
+        accum_background_release(&background[0]);
+    }
+    free(flat);
+    return failed;
+}
+
+static void bench_process_one(BenchInput_t* input, FrameInfo_t* frame_info, int frames)
+{
+    int pix_num = input->width * input->height;
+    uint8_t* src = (frame_info->input_format == INPUT_FMT_Y14) ? (uint8_t*)input->y14_frame : input->image_frame;
+    char config[64];
+    snprintf(config, sizeof(config), "%s->%s color=%s enhance=%s%s", \
+        input_format_names[frame_info->input_format], output_format_names[frame_info->output_format], \
+        (frame_info->pseudo_color_status == PSEUDO_COLOR_ON) ? "on" : "off", \
+        enhance_names[frame_info->img_enhance_status], fused_color_enabled ? "" : " lib");
+
+    //first frame outside the timing builds the luts and the agc mapping
+    FrameInfo_t info = *frame_info;
+    display_image_process(src, pix_num, &info, NULL);
+
+    uint64_t alloc_start = bench_alloc_cnt.load();
+    uint64_t start_us = get_monotonic_us();
+    bench_perf_start();
+    for (int n = 0; n < frames; n++)
+    {
+        info = *frame_info;
+        display_image_process(src, pix_num, &info, NULL);
+    }
+    bench_result_add("process", config, frames, get_monotonic_us() - start_us, \
+        bench_alloc_cnt.load() - alloc_start, pix_num);
+}
+
+//each enhance implementation alone on the Y14 frame, then the whole y14->bgr888 chain with it
+//the library agc+dde is far slower than the rest, so it stays out of the bench_process matrix
+static void bench_enhance(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    uint16_t* dst = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    if (dst == NULL)
+    {
+        return;
+    }
+    FrameInfo_t frame_info = { 0 };
+    frame_info.width = input->width;
+    frame_info.height = input->height;
+    frame_info.input_format = INPUT_FMT_Y14;
+    for (int enhance = IMG_ENHANCE_ON; enhance < IMG_ENHANCE_NUM; enhance++)
+    {
+        frame_info.img_enhance_status = (ImgEnhance_t)enhance;
+        enhance_image_frame(input->y14_frame, &frame_info, NULL, dst);
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        bench_perf_start();
+        for (int n = 0; n < frames; n++)
+        {
+            enhance_image_frame(input->y14_frame, &frame_info, NULL, dst);
+        }
+        char config[64];
+        snprintf(config, sizeof(config), "y14 %s", enhance_name((ImgEnhance_t)enhance));
+        bench_result_add("enhance", config, frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+    free(dst);
+
+    frame_info.output_format = OUTPUT_FMT_BGR888;
+    frame_info.pseudo_color_status = PSEUDO_COLOR_ON;
+    frame_info.img_enhance_status = IMG_ENHANCE_LIB;
+    bench_process_one(input, &frame_info, frames);
+}
+
+//every input/output/pseudocolor/enhance combination that display_image_process accepts
+static void bench_process(BenchInput_t* input, int frames)
+{
+    FrameInfo_t frame_info = { 0 };
+    frame_info.width = input->width;
+    frame_info.height = input->height;
+    for (int in = INPUT_FMT_Y14; in <= INPUT_FMT_YUV422; in++)
+    {
+        for (int out = OUTPUT_FMT_Y14; out <= OUTPUT_FMT_BGR888; out++)
+        {
+            if (in == INPUT_FMT_YUV422)
+            {
+                frame_info.input_format = (InputFormat_t)in;
+                frame_info.output_format = (OutputFormat_t)out;
+                frame_info.pseudo_color_status = PSEUDO_COLOR_OFF;
+                frame_info.img_enhance_status = IMG_ENHANCE_OFF;
+                if (display_pipeline_select(&frame_info) != NULL)
+                {
+                    bench_process_one(input, &frame_info, frames);
+                }
+                continue;
+            }
+            for (int color = PSEUDO_COLOR_ON; color <= PSEUDO_COLOR_OFF; color++)
+            {
+                for (int enhance = IMG_ENHANCE_ON; enhance <= IMG_ENHANCE_HIST_AGC; enhance++)
+                {
+                    frame_info.input_format = (InputFormat_t)in;
+                    frame_info.output_format = (OutputFormat_t)out;
+                    frame_info.pseudo_color_status = (PseudoColor_t)color;
+                    frame_info.img_enhance_status = (ImgEnhance_t)enhance;
+                    bench_process_one(input, &frame_info, frames);
+                    if (color == PSEUDO_COLOR_ON && out == OUTPUT_FMT_BGR888)
+                    {
+                        fused_color_enabled = 0;
+                        bench_process_one(input, &frame_info, frames);
+                        fused_color_enabled = 1;
+                    }
+                }
+            }
+        }
+    }
+}
+
+//mirror/flip/rotate of the processed frame in image_tmp_frame2, as display_one_frame does
+static void bench_transform(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    const OutputFormat_t formats[] = { OUTPUT_FMT_Y14, OUTPUT_FMT_BGR888 };
+    for (int f = 0; f < (int)(sizeof(formats) / sizeof(formats[0])); f++)
+    {
+        FrameInfo_t frame_info = { 0 };
+        frame_info.width = input->width;
+        frame_info.height = input->height;
+        frame_info.output_format = formats[f];
+        frame_info.byte_size = pix_num * ((formats[f] == OUTPUT_FMT_Y14) ? 2 : 3);
+        for (int rotate = NO_ROTATE; rotate <= ROTATE_180D; rotate++)
+        {
+            for (int mirror_flip = STATUS_NO_MIRROR_FLIP; mirror_flip <= STATUS_MIRROR_FLIP; mirror_flip++)
+            {
+                for (int fused = 1; fused >= 0; fused--)
+                {
+                    char config[64];
+                    snprintf(config, sizeof(config), "%s rotate=%s %s%s", output_format_names[formats[f]], \
+                        rotate_names[rotate], mirror_flip_names[mirror_flip], fused ? "" : " lib");
+                    uint64_t alloc_start = bench_alloc_cnt.load();
+                    uint64_t start_us = get_monotonic_us();
+                    bench_perf_start();
+                    for (int n = 0; n < frames; n++)
+                    {
+                        if (fused)
+                        {
+                            transform_demo(&frame_info, (RotateSide_t)rotate, (MirrorFlipStatus_t)mirror_flip);
+                        }
+                        else
+                        {
+                            mirror_flip_demo(&frame_info, image_tmp_frame2, (MirrorFlipStatus_t)mirror_flip);
+                            rotate_demo(&frame_info, image_tmp_frame2, (RotateSide_t)rotate);
+                        }
+                    }
+                    bench_result_add("transform", config, frames, get_monotonic_us() - start_us, \
+                        bench_alloc_cnt.load() - alloc_start, pix_num);
+                }
+            }
+        }
+    }
+}
+
+//fused colorize into the 4 byte formats against bgr888, and bgr888 widened afterwards as a consumer would
+static void bench_packed(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    const ImgEnhance_t enhances[] = { IMG_ENHANCE_OFF, IMG_ENHANCE_ON, IMG_ENHANCE_HIST_AGC };
+    const OutputFormat_t formats[] = { OUTPUT_FMT_BGR888, OUTPUT_FMT_BGRA32, OUTPUT_FMT_RGBA32 };
+    for (int e = 0; e < (int)(sizeof(enhances) / sizeof(enhances[0])); e++)
+    {
+        for (int f = 0; f <= (int)(sizeof(formats) / sizeof(formats[0])); f++)
+        {
+            int widen = (f == (int)(sizeof(formats) / sizeof(formats[0])));
+            FrameInfo_t frame_info = { 0 };
+            frame_info.width = input->width;
+            frame_info.height = input->height;
+            frame_info.input_format = INPUT_FMT_Y16;
+            frame_info.output_format = (widen) ? OUTPUT_FMT_BGR888 : formats[f];
+            frame_info.pseudo_color_status = PSEUDO_COLOR_ON;
+            frame_info.img_enhance_status = enhances[e];
+            char config[64];
+            snprintf(config, sizeof(config), "%s enhance=%s", (widen) ? "bgr888+widen" : \
+                output_format_names[formats[f]], enhance_names[enhances[e]]);
+            uint64_t alloc_start = bench_alloc_cnt.load();
+            uint64_t start_us = get_monotonic_us();
+            bench_perf_start();
+            for (int n = 0; n < frames; n++)
+            {
+                FrameInfo_t info = frame_info;
+                colorize_fused_palette((uint16_t*)input->image_frame, pix_num, &info, palette_active(), NULL, \
+                    image_tmp_frame2);
+                if (widen)
+                {
+                    for (int i = 0; i < pix_num; i++)
+                    {
+                        image_tmp_frame1[i * 4] = image_tmp_frame2[i * 3];
+                        image_tmp_frame1[i * 4 + 1] = image_tmp_frame2[i * 3 + 1];
+                        image_tmp_frame1[i * 4 + 2] = image_tmp_frame2[i * 3 + 2];
+                        image_tmp_frame1[i * 4 + 3] = 255;
+                    }
+                }
+            }
+            bench_result_add("packed", config, frames, get_monotonic_us() - start_us, \
+                bench_alloc_cnt.load() - alloc_start, pix_num);
+        }
+    }
+}
+
+//fused BGR888 colorize + transform in row bands: the caller and threads - 1 pool workers, one band each
+static void bench_bands(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    const ImgEnhance_t enhances[] = { IMG_ENHANCE_ON, IMG_ENHANCE_HIST_AGC };
+    const RotateSide_t rotates[] = { NO_ROTATE, LEFT_90D };
+    for (int threads = 1; threads <= DISPLAY_BAND_MAX; threads *= 2)
+    {
+        if (threads > 1)
+        {
+            pool_init(threads - 1);
+        }
+        for (int e = 0; e < (int)(sizeof(enhances) / sizeof(enhances[0])); e++)
+        {
+            for (int r = 0; r < (int)(sizeof(rotates) / sizeof(rotates[0])); r++)
+            {
+                FrameInfo_t frame_info = { 0 };
+                frame_info.width = input->width;
+                frame_info.height = input->height;
+                frame_info.input_format = INPUT_FMT_Y16;
+                frame_info.output_format = OUTPUT_FMT_BGR888;
+                frame_info.pseudo_color_status = PSEUDO_COLOR_ON;
+                frame_info.img_enhance_status = enhances[e];
+                frame_info.rotate_side = rotates[r];
+                char config[64];
+                snprintf(config, sizeof(config), "bgr888 enhance=%s rotate=%s threads=%d", \
+                    enhance_names[enhances[e]], rotate_names[rotates[r]], threads);
+
+                FrameInfo_t info = frame_info;
+                display_image_process_bands(input->image_frame, pix_num, &info, NULL, threads);
+                uint64_t alloc_start = bench_alloc_cnt.load();
+                uint64_t start_us = get_monotonic_us();
+                for (int n = 0; n < frames; n++)
+                {
+                    info = frame_info;
+                    display_image_process_bands(input->image_frame, pix_num, &info, NULL, threads);
+                }
+                bench_result_add("bands", config, frames, get_monotonic_us() - start_us, \
+                    bench_alloc_cnt.load() - alloc_start, pix_num);
+            }
+        }
+        pool_release();
+    }
+}
+
+static void bench_segment(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    uint64_t alloc_start = bench_alloc_cnt.load();
+    uint64_t start_us = get_monotonic_us();
+    bench_perf_start();
+    for (int n = 0; n < frames; n++)
+    {
+        uint16_t* temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+        segment_human_by_real_temperature(temp, input->width, input->height, image_tmp_frame2);
+    }
+    bench_result_add("segment", "human 28-40C", frames, get_monotonic_us() - start_us, \
+        bench_alloc_cnt.load() - alloc_start, pix_num);
+
+    //the blob list alone: mask, opening, closing and labelling
+    Segment_t segment;
+    TempDataRes_t temp_res = { (uint16_t)input->width, (uint16_t)input->height };
+    if (segment_init(&segment, temp_res) != SEGMENT_SUCCESS)
+    {
+        return;
+    }
+    SegmentParam_t param = { (uint16_t)((HUMAN_TEMP_MIN_CELSIUS + 273.15) * 64), \
+        (uint16_t)((HUMAN_TEMP_MAX_CELSIUS + 273.15) * 64), HUMAN_SEG_OPEN, HUMAN_SEG_CLOSE, HUMAN_SEG_MIN_AREA };
+    alloc_start = bench_alloc_cnt.load();
+    start_us = get_monotonic_us();
+    bench_perf_start();
+    for (int n = 0; n < frames; n++)
+    {
+        segment_process(&segment, (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2), &param);
+    }
+    bench_result_add("segment", "blobs", frames, get_monotonic_us() - start_us, \
+        bench_alloc_cnt.load() - alloc_start, pix_num);
+    segment_release(&segment);
+}
+
+//the same queries as point_temp_demo/line_temp_demo/rect_temp_demo, without the prints
+//then all three per frame, through the library calls and through the temperature analytics with thresholds
+static void bench_temp(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    TempDataRes_t temp_res = { (uint16_t)input->width, (uint16_t)input->height };
+    Dot_t point = { input->width / 2, input->height / 2 };
+    Line_t line = { input->width / 2, input->height - 1, input->width / 2, 0 };
+    Area_t rect = { 50, 50, 20, 20 };
+    const char* names[] = { "point", "line", "rect", "point+line+rect", "analytics" };
+    TempAnalytics_t analytics;
+    TempThreshold_t threshold = { 1000, 0 };
+    temp_analytics_init(&analytics, temp_res, 0);
+    temp_analytics_add_point(&analytics, point, &threshold);
+    temp_analytics_add_rect(&analytics, rect, &threshold);
+    temp_analytics_add_line(&analytics, line, &threshold);
+    for (int query = 0; query < 5; query++)
+    {
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            uint16_t* temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+            uint16_t point_temp = 0;
+            TempInfo_t temp_info = { 0 };
+            switch (query)
+            {
+            case 0:
+                get_point_temp(temp, temp_res, point, &point_temp);
+                break;
+            case 1:
+                get_line_temp(temp, temp_res, line, &temp_info);
+                break;
+            case 2:
+                get_rect_temp(temp, temp_res, rect, &temp_info);
+                break;
+            case 3:
+                get_point_temp(temp, temp_res, point, &point_temp);
+                get_line_temp(temp, temp_res, line, &temp_info);
+                get_rect_temp(temp, temp_res, rect, &temp_info);
+                break;
+            default:
+                temp_analytics_process(&analytics, temp);
+                break;
+            }
+        }
+        bench_result_add("temp", names[query], frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+    temp_analytics_release(&analytics);
+}
+
+//whole frame celsius: temp_value_converter per pixel against the frame converters
+static void bench_convert(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    float* celsius = (float*)malloc(pix_num * sizeof(float));
+    int16_t* centi = (int16_t*)malloc(pix_num * sizeof(int16_t));
+    uint16_t* corrected = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    TempEnvMap_t* env_map = (TempEnvMap_t*)malloc(sizeof(TempEnvMap_t));
+    if (celsius == NULL || centi == NULL || corrected == NULL || env_map == NULL)
+    {
+        free(celsius);
+        free(centi);
+        free(corrected);
+        free(env_map);
+        return;
+    }
+    //the map is built before timing, only the per frame lookup is measured
+    temp_env_map_init(env_map, get_temp_cal_info());
+    temp_env_map_update(env_map);
+    const char* names[] = { "temp_value_converter", "celsius f32", "centi-celsius s16", "env lut f32", "env map u16" };
+    for (int config = 0; config < 5; config++)
+    {
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            uint16_t* temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+            switch (config)
+            {
+            case 0:
+                for (int i = 0; i < pix_num; i++)
+                {
+                    celsius[i] = temp_value_converter(temp[i]);
+                }
+                break;
+            case 1:
+                temp_frame_to_celsius(temp, pix_num, celsius);
+                break;
+            case 2:
+                temp_frame_to_centi_celsius(temp, pix_num, centi);
+                break;
+            case 3:
+                //without calibration data no table is built, this then measures the fallback
+                temp_frame_to_celsius_env(temp, pix_num, celsius);
+                break;
+            default:
+                temp_env_map_apply(env_map, temp, pix_num, corrected);
+                break;
+            }
+        }
+        bench_result_add("convert", names[config], frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+    free(celsius);
+    free(centi);
+    free(corrected);
+    free(env_map);
+}
+
+//nuc reconstruction: reverse_calc_NUC_with_env_correct per pixel against reverse_temp_frame_to_nuc, a synthetic
+//nuc factor so the nuc values spread over the frame's range. returns 1 when a pixel differs
+static int bench_nuc(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    uint16_t* ref = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    uint16_t* nuc = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    if (ref == NULL || nuc == NULL)
+    {
+        free(ref);
+        free(nuc);
+        return 0;
+    }
+    NucFactor_t factor = { 0, 3000000, -100 };
+    int differ = 0;
+    for (int config = 0; config < 2; config++)
+    {
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            uint16_t* temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+            if (config == 0)
+            {
+                for (int i = 0; i < pix_num; i++)
+                {
+                    reverse_calc_NUC_with_env_correct(&factor, temp[i] / 16.0, &ref[i]);
+                }
+            }
+            else
+            {
+                differ += (reverse_temp_frame_to_nuc(temp, &factor, pix_num, nuc) != 0);
+            }
+        }
+        uint64_t elapsed_us = get_monotonic_us() - start_us;
+        if (config == 1)
+        {
+            //the last frame of both loops
+            differ += (memcmp(ref, nuc, pix_num * sizeof(uint16_t)) != 0);
+        }
+        bench_result_add("convert", (config == 0) ? "nuc reverse per pixel" : \
+            (differ ? "nuc reverse lut MISMATCH" : "nuc reverse lut"), frames, elapsed_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+    free(ref);
+    free(nuc);
+    return (differ != 0);
+}
+
+//the environment chain of one bucket center through the library, what temp_env_map_update did before the nuc-t
+//lookups. 0 when it fails
+static uint16_t bench_nuct_ref(uint16_t* nuc_table, const EnvFactor_t* org_factor, const EnvFactor_t* new_factor, \
+    int bucket)
+{
+    double org_temp = ((bucket << TEMP_LUT_SHIFT) + ((1 << TEMP_LUT_SHIFT) - 1) / 2.0) / 64;
+    uint16_t nuc_cal = 0, nuc_org = 0, temp_data = 0;
+    if (reverse_calc_NUC_with_nuc_t(nuc_table, org_temp - 273.15, &nuc_cal) != IRTEMP_SUCCESS || \
+        reverse_calc_NUC_without_env_correct(org_factor, nuc_cal, &nuc_org) != IRTEMP_SUCCESS || \
+        recalc_NUC_with_env_correct(new_factor, nuc_org, &nuc_cal) != IRTEMP_SUCCESS || nuc_cal >= TEMP_NUC_RANGE || \
+        remap_temp(nuc_table, nuc_cal, &temp_data) != IRTEMP_SUCCESS)
+    {
+        return 0;
+    }
+    uint32_t temp_val = (uint32_t)((double)temp_data / 16 * 64 + 0.5);
+    return (uint16_t)((temp_val > 65535) ? 65535 : temp_val);
+}
+
+//corrected table of a synthetic nuc-t table: the library chain per bucket against temp_env_map_update building
+//the nuc-t lookups, then rebuilding for new factors with them. returns 1 when a bucket differs
+static int bench_nuct(void)
+{
+    uint16_t* nuc_table = (uint16_t*)malloc(NUCT_LEN * sizeof(uint16_t));
+    uint16_t* ref = (uint16_t*)malloc(TEMP_LUT_SIZE * sizeof(uint16_t));
+    TempEnvMap_t* env_map = (TempEnvMap_t*)malloc(sizeof(TempEnvMap_t));
+    if (nuc_table == NULL || ref == NULL || env_map == NULL)
+    {
+        free(nuc_table);
+        free(ref);
+        free(env_map);
+        return 0;
+    }
+    //monotonic like the module's tables, -54 .. 690 celsius
+    for (int i = 0; i < NUCT_LEN; i++)
+    {
+        nuc_table[i] = (uint16_t)(3500 + 1.7 * i - 0.00003 * i * (double)i);
+    }
+    EnvParam_t org_param = { 128, 128, 298, 298 }, new_param = { 120, 128, 300, 298 };
+    EnvFactor_t org_factor = { 10000, 100 }, new_factor = { 10200, 50 };
+    NucFactor_t factor = { 0, 0, 0 };
+    TempCalInfo_t cal_info = { &org_param, &new_param, HIGH_GAIN, &factor, &org_factor, &new_factor, nuc_table };
+    temp_env_map_init(env_map, &cal_info);
+    int differ = 0;
+    const char* names[] = { "nuc-t chain per bucket", "nuc-t lookups build", "nuc-t lookups" };
+    for (int config = 0; config < 3; config++)
+    {
+        new_factor.K_E = 10200 + config * 100;
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        if (config == 0)
+        {
+            for (int i = 0; i < TEMP_LUT_SIZE; i++)
+            {
+                ref[i] = bench_nuct_ref(nuc_table, &org_factor, &new_factor, i);
+            }
+        }
+        else
+        {
+            temp_env_map_update(env_map);
+        }
+        uint64_t elapsed_us = get_monotonic_us() - start_us;
+        uint64_t allocs = bench_alloc_cnt.load() - alloc_start;
+        for (int i = 0; config > 0 && i < TEMP_LUT_SIZE; i++)
+        {
+            uint16_t expect = bench_nuct_ref(nuc_table, &org_factor, &new_factor, i);
+            //a failed bucket keeps its center
+            expect = (expect != 0) ? expect : (uint16_t)((i << TEMP_LUT_SHIFT) + (1 << (TEMP_LUT_SHIFT - 1)));
+            differ += (env_map->temp_map[i] != expect);
+        }
+        bench_result_add("convert", (differ != 0) ? "nuc-t lookups MISMATCH" : names[config], 1, elapsed_us, allocs, \
+            TEMP_LUT_SIZE);
+    }
+    if (differ != 0)
+    {
+        printf("nuc-t: %d buckets differ from the library chain\n", differ);
+    }
+    free(nuc_table);
+    free(ref);
+    free(env_map);
+    return (differ != 0);
+}
+
+//command 18's distance correction for the whole frame, two distances split by a rect
+//the correct table is synthetic, tau then only depends on the temperature
+//then two materials times the two distances quantized from per pixel maps, every class checked against the
+//scalar correction of its emissivity. returns 1 when a class differs
+static int bench_tau(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    uint16_t* correct_table = (uint16_t*)malloc(sizeof(correct_table[0]) * 4 * 14 * 64);
+    uint16_t* corrected = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    uint8_t* dist_index = (uint8_t*)calloc(pix_num, 1);
+    TauCorrector_t corrector;
+    if (correct_table == NULL || corrected == NULL || dist_index == NULL || \
+        tau_corrector_init(&corrector, get_temp_cal_info(), correct_table, 0.95f, 25) != TAU_SUCCESS)
+    {
+        free(correct_table);
+        free(corrected);
+        free(dist_index);
+        return 0;
+    }
+    for (int i = 0; i < 4 * 14 * 64; i++)
+    {
+        correct_table[i] = (uint16_t)(12000 + (i % 64) * 40);
+    }
+    tau_corrector_add_dist(&corrector, 5);
+    Area_t rect = { input->width / 4, input->height / 4, input->width / 2, input->height / 2 };
+    tau_dist_map_fill_rect(dist_index, input->width, rect, (uint8_t)tau_corrector_add_dist(&corrector, 20));
+    tau_corrector_update(&corrector);
+
+    uint64_t alloc_start = bench_alloc_cnt.load();
+    uint64_t start_us = get_monotonic_us();
+    for (int n = 0; n < frames; n++)
+    {
+        uint16_t* temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+        tau_corrector_apply(&corrector, temp, dist_index, pix_num, corrected);
+    }
+    bench_result_add("convert", "tau 2 distances", frames, get_monotonic_us() - start_us, \
+        bench_alloc_cnt.load() - alloc_start, pix_num);
+
+    int failed = 0;
+    float* ems_map = (float*)malloc(pix_num * sizeof(float));
+    float* dist_map = (float*)malloc(pix_num * sizeof(float));
+    uint8_t* class_index = (uint8_t*)malloc(pix_num);
+    uint16_t* class_corrected = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    TauCorrector_t classes;
+    if (ems_map != NULL && dist_map != NULL && class_index != NULL && class_corrected != NULL && \
+        tau_corrector_init(&classes, get_temp_cal_info(), correct_table, 0.95f, 25) == TAU_SUCCESS)
+    {
+        for (int i = 0; i < pix_num; i++)
+        {
+            ems_map[i] = (i % input->width < input->width / 2) ? 0.95f : 0.7f;
+            dist_map[i] = dist_index[i] ? 20.0f : 5.0f;
+        }
+        int class_num = tau_dist_map_quantize(&classes, ems_map, dist_map, pix_num, 0.01f, 0.25f, class_index);
+        tau_corrector_update(&classes);
+        alloc_start = bench_alloc_cnt.load();
+        start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            uint16_t* temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+            tau_corrector_apply(&classes, temp, class_index, pix_num, class_corrected);
+        }
+        uint64_t elapsed_us = get_monotonic_us() - start_us;
+
+        uint16_t* temp = (uint16_t*)(bench_raw_frame(input, frames - 1) + pix_num * 2);
+        int differ = (class_num != 4);
+        for (int bucket = 0; bucket < class_num && bucket < TAU_BUCKET_MAX; bucket++)
+        {
+            tau_corrector_set_env(&corrector, classes.dist_ems[bucket], 25);
+            tau_corrector_apply(&corrector, temp, dist_index, pix_num, corrected);
+            for (int i = 0; i < pix_num; i++)
+            {
+                differ += (class_index[i] == bucket && class_corrected[i] != corrected[i]);
+            }
+        }
+        bench_result_add("convert", differ ? "tau 4 classes MISMATCH" : "tau 4 classes", frames, elapsed_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+        failed = (differ != 0);
+        tau_corrector_release(&classes);
+    }
+    tau_corrector_release(&corrector);
+    free(correct_table);
+    free(corrected);
+    free(dist_index);
+    free(ems_map);
+    free(dist_map);
+    free(class_index);
+    free(class_corrected);
+    return failed;
+}
+
+//48 cabinet sized rects, one roi_engine_process against one get_rect_temp per rect
+static void bench_roi(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    TempDataRes_t temp_res = { (uint16_t)input->width, (uint16_t)input->height };
+    RoiEngine_t roi_engine;
+    if (roi_engine_init(&roi_engine, temp_res) != ROI_SUCCESS)
+    {
+        return;
+    }
+    for (int i = 0; i < 48; i++)
+    {
+        Area_t rect = { (i * 13) % (input->width - 40), (i * 7) % (input->height - 40), 20 + i % 20, 10 + i % 30 };
+        roi_engine_add_rect(&roi_engine, rect);
+    }
+
+    TempInfo_t temp_info[ROI_MAX_NUM];
+    const char* names[] = { "roi x48 engine", "roi x48 get_rect_temp" };
+    for (int config = 0; config < 2; config++)
+    {
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        bench_perf_start();
+        for (int n = 0; n < frames; n++)
+        {
+            uint16_t* temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+            if (config == 0)
+            {
+                roi_engine_process(&roi_engine, temp, temp_info);
+                continue;
+            }
+            for (int i = 0; i < roi_engine.roi_num; i++)
+            {
+                get_rect_temp(temp, temp_res, roi_engine.roi[i].rect, &temp_info[i]);
+            }
+        }
+        bench_result_add("temp", names[config], frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+    roi_engine_release(&roi_engine);
+}
+
+//the same filtered temperatures get_point_temp gives, pixel by pixel over the spans
+static void bench_roi_spans_ref(uint16_t* temp, TempDataRes_t temp_res, const Roi_t* roi, TempInfo_t* temp_info)
+{
+    uint16_t max_val = 0, min_val = 65535;
+    uint64_t sum = 0, num = 0;
+    for (int i = 0; i < roi->span_num; i++)
+    {
+        const RoiSpan_t* span = &roi->spans[i];
+        for (int x = span->x0; x <= span->x1; x++)
+        {
+            Dot_t point = { x, span->y };
+            uint16_t value = 0;
+            get_point_temp(temp, temp_res, point, &value);
+            if (value >= max_val)
+            {
+                max_val = value;
+                temp_info->max_cord = point;
+            }
+            if (value <= min_val)
+            {
+                min_val = value;
+                temp_info->min_cord = point;
+            }
+            sum += value;
+            num++;
+        }
+    }
+    temp_info->max_temp = max_val;
+    temp_info->min_temp = min_val;
+    temp_info->avr_temp = (uint16_t)((sum + num / 2) / num);
+}
+
+//48 polygons, ellipses and polylines, one roi_engine_process against get_point_temp over their pixels
+static void bench_roi_shapes(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    TempDataRes_t temp_res = { (uint16_t)input->width, (uint16_t)input->height };
+    RoiEngine_t roi_engine;
+    if (roi_engine_init(&roi_engine, temp_res) != ROI_SUCCESS)
+    {
+        return;
+    }
+    for (int i = 0; i < 48; i++)
+    {
+        int x = 20 + (i * 13) % (input->width - 60), y = 20 + (i * 7) % (input->height - 60);
+        int r = 6 + i % 14;
+        //a concave l shaped outline, a pipe run and a tank end
+        Dot_t outline[6] = { { x - r, y - r }, { x + r, y - r }, { x + r, y }, { x, y + (i % 3) }, \
+            { x, y + r }, { x - r, y + r } };
+        if (i % 3 == 0)
+        {
+            roi_engine_add_polygon(&roi_engine, outline, 6);
+        }
+        else if (i % 3 == 1)
+        {
+            roi_engine_add_polyline(&roi_engine, outline, 6);
+        }
+        else
+        {
+            Dot_t center = { x, y };
+            roi_engine_add_ellipse(&roi_engine, center, r, r / 2 + i % 5);
+        }
+    }
+
+    int mismatch = 0;
+    TempInfo_t temp_info[ROI_MAX_NUM];
+    TempInfo_t ref_info;
+    uint16_t* temp = (uint16_t*)(bench_raw_frame(input, 0) + pix_num * 2);
+    roi_engine_process(&roi_engine, temp, temp_info);
+    for (int i = 0; i < roi_engine.roi_num; i++)
+    {
+        bench_roi_spans_ref(temp, temp_res, &roi_engine.roi[i], &ref_info);
+        mismatch += (memcmp(&ref_info, &temp_info[i], sizeof(TempInfo_t)) != 0);
+    }
+    const char* names[] = { "roi x48 shapes engine", "roi x48 shapes get_point_temp" };
+    for (int config = 0; config < 2; config++)
+    {
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        bench_perf_start();
+        for (int n = 0; n < frames; n++)
+        {
+            temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+            if (config == 0)
+            {
+                roi_engine_process(&roi_engine, temp, temp_info);
+                continue;
+            }
+            for (int i = 0; i < roi_engine.roi_num; i++)
+            {
+                bench_roi_spans_ref(temp, temp_res, &roi_engine.roi[i], &temp_info[i]);
+            }
+        }
+        char config_name[64];
+        snprintf(config_name, sizeof(config_name), "%s%s", names[config], (config == 0 && mismatch != 0) ? " MISMATCH" : "");
+        bench_result_add("temp", config_name, frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+    roi_engine_release(&roi_engine);
+}
+
+//the sliding windows of 48 rois, a frame every 40 ms: one update of the results of a frame. the 640 ms and 60 s
+//windows are checked frame by frame against the frames whose bucket falls in the window, over the first 200 frames
+static int bench_roi_windows(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    TempDataRes_t temp_res = { (uint16_t)input->width, (uint16_t)input->height };
+    RoiEngine_t roi_engine;
+    RoiWindows_t windows;
+    RoiWindowParam_t param = { { 640, 60000 }, 2 };
+    int check_frames = (frames < 200) ? frames : 200;
+    TempInfo_t* history = (TempInfo_t*)malloc((size_t)input->frame_num * ROI_MAX_NUM * sizeof(TempInfo_t));
+    if (history == NULL || roi_engine_init(&roi_engine, temp_res) != ROI_SUCCESS)
+    {
+        free(history);
+        return 0;
+    }
+    if (roi_windows_init(&windows, &param) != ROI_WINDOW_SUCCESS)
+    {
+        roi_engine_release(&roi_engine);
+        free(history);
+        return 0;
+    }
+    for (int i = 0; i < 48; i++)
+    {
+        Area_t rect = { (i * 13) % (input->width - 40), (i * 7) % (input->height - 40), 20 + i % 20, 10 + i % 30 };
+        roi_engine_add_rect(&roi_engine, rect);
+    }
+    //the results of the input frames, computed once
+    for (int n = 0; n < input->frame_num; n++)
+    {
+        roi_engine_process(&roi_engine, (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2), \
+            &history[(size_t)n * ROI_MAX_NUM]);
+    }
+
+    uint64_t alloc_start = bench_alloc_cnt.load();
+    uint64_t start_us = get_monotonic_us();
+    for (int n = 0; n < frames; n++)
+    {
+        roi_windows_update(&windows, &history[(size_t)(n % input->frame_num) * ROI_MAX_NUM], roi_engine.roi_num, \
+            (uint64_t)n * 40000);
+    }
+    bench_result_add("temp", "roi x48 windows 640ms+60s", frames, get_monotonic_us() - start_us, \
+        bench_alloc_cnt.load() - alloc_start, pix_num);
+
+    int mismatch = 0;
+    roi_windows_reset(&windows, -1);
+    for (int n = 0; n < check_frames; n++)
+    {
+        const TempInfo_t* info = &history[(size_t)(n % input->frame_num) * ROI_MAX_NUM];
+        roi_windows_update(&windows, info, roi_engine.roi_num, (uint64_t)n * 40000);
+        for (int h = 0; h < param.num; h++)
+        {
+            uint64_t bucket_us = (uint64_t)param.horizon_ms[h] * 1000 / ROI_WINDOW_BUCKETS;
+            uint64_t seq = (uint64_t)n * 40000 / bucket_us;
+            for (int i = 0; i < roi_engine.roi_num; i++)
+            {
+                uint16_t max_temp = 0, min_temp = 65535;
+                uint64_t sum = 0, num = 0;
+                for (int k = 0; k <= n; k++)
+                {
+                    if (seq - (uint64_t)k * 40000 / bucket_us >= ROI_WINDOW_BUCKETS)
+                    {
+                        continue;
+                    }
+                    const TempInfo_t* sample = &history[(size_t)(k % input->frame_num) * ROI_MAX_NUM + i];
+                    max_temp = (sample->max_temp > max_temp) ? sample->max_temp : max_temp;
+                    min_temp = (sample->min_temp < min_temp) ? sample->min_temp : min_temp;
+                    sum += sample->avr_temp;
+                    num++;
+                }
+                RoiWindowValue_t value;
+                roi_windows_get(&windows, i, h, &value);
+                mismatch += (value.max_temp != max_temp || value.min_temp != min_temp || value.samples != num || \
+                    value.avr_temp != (uint16_t)((sum + num / 2) / num));
+            }
+        }
+    }
+    if (mismatch != 0)
+    {
+        printf("bench: %d roi window values differ\n", mismatch);
+    }
+    roi_windows_release(&windows);
+    roi_engine_release(&roi_engine);
+    free(history);
+    return mismatch != 0;
+}
+
+//the events go nowhere, the check reads the rules' state
+static void bench_rules_event(const RuleEvent_t* events, int event_num, void* arg)
+{
+    (void)events;
+    (void)event_num;
+    (void)arg;
+}
+
+//256 rules over 48 rois, their 60 s/5 min windows and the frame's stats, evaluated per frame with no allocation.
+//the rules of the plain form are checked against the roi results, and a file that fails to compile keeps the set
+static int bench_rules(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    TempDataRes_t temp_res = { (uint16_t)input->width, (uint16_t)input->height };
+    RoiEngine_t roi_engine;
+    RoiWindows_t windows;
+    RoiWindowParam_t window_param = { { 60000, 300000 }, 2 };
+    static RuleEngine_t rules;
+    RuleParam_t rule_param = { { 60000, 300000 }, 2, bench_rules_event, NULL };
+    const int rule_num = 256;
+    TempInfo_t* history = (TempInfo_t*)malloc((size_t)input->frame_num * ROI_MAX_NUM * sizeof(TempInfo_t));
+    FrameStats_t* stats = (FrameStats_t*)malloc((size_t)input->frame_num * sizeof(FrameStats_t));
+    char* text = (char*)malloc((size_t)rule_num * 128);
+    if (history == NULL || stats == NULL || text == NULL || roi_engine_init(&roi_engine, temp_res) != ROI_SUCCESS)
+    {
+        free(history);
+        free(stats);
+        free(text);
+        return 0;
+    }
+    if (roi_windows_init(&windows, &window_param) != ROI_WINDOW_SUCCESS)
+    {
+        roi_engine_release(&roi_engine);
+        free(history);
+        free(stats);
+        free(text);
+        return 0;
+    }
+    for (int i = 0; i < 48; i++)
+    {
+        Area_t rect = { (i * 13) % (input->width - 40), (i * 7) % (input->height - 40), 20 + i % 20, 10 + i % 30 };
+        roi_engine_add_rect(&roi_engine, rect);
+    }
+    for (int n = 0; n < input->frame_num; n++)
+    {
+        uint16_t* temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+        roi_engine_process(&roi_engine, temp, &history[(size_t)n * ROI_MAX_NUM]);
+        frame_stats_compute(temp, input->width, input->height, &stats[n]);
+    }
+    //a quarter of each form, the plain one at thresholds around the scene's temperatures
+    int len = 0;
+    for (int r = 0; r < rule_num; r++)
+    {
+        int roi = r % 48;
+        double celsius = 20.0 + r % 32;
+        int size = rule_num * 128 - len;
+        switch (r % 4)
+        {
+        case 0: len += snprintf(text + len, size, "rule r%d: roi(%d).max > %.1f\n", r, roi, celsius); break;
+        case 1: len += snprintf(text + len, size, "rule r%d: roi(%d).max_60s > %.1f && roi(%d).avr_5m < 200\n", r, \
+            roi, celsius, roi); break;
+        case 2: len += snprintf(text + len, size, "rule r%d: (roi(%d).max - roi(%d).min) * 2 >= %.1f || frame.max > 300\n", \
+            r, roi, roi, celsius); break;
+        default: len += snprintf(text + len, size, "rule r%d: !(roi(%d).avr_60s < %.1f) && frame.avr - roi(%d).min != 0\n", \
+            r, roi, celsius, roi); break;
+        }
+    }
+    int failed = 0;
+    char error[RULE_ERROR_LEN];
+    rule_engine_init(&rules, &rule_param);
+    if (rule_engine_load_text(&rules, text, error, sizeof(error)) != RULE_SUCCESS)
+    {
+        printf("bench: rules: %s\n", error);
+        failed = 1;
+    }
+    else if (rule_engine_load_text(&rules, "rule bad: roi(1).max_7s > 3", error, sizeof(error)) != RULE_ERROR_SYNTAX)
+    {
+        printf("bench: a rule over a horizon the engine has not compiled\n");
+        failed = 1;
+    }
+    uint64_t alloc_start = bench_alloc_cnt.load();
+    uint64_t start_us = get_monotonic_us();
+    for (int n = 0; n < frames && !failed; n++)
+    {
+        int k = n % input->frame_num;
+        const TempInfo_t* info = &history[(size_t)k * ROI_MAX_NUM];
+        roi_windows_update(&windows, info, roi_engine.roi_num, (uint64_t)n * 40000);
+        RuleInput_t rule_input = { (uint64_t)n, (uint64_t)n * 40000, info, roi_engine.roi_num, &windows, NULL, &stats[k] };
+        rule_engine_eval(&rules, &rule_input);
+    }
+    bench_result_add("temp", "rules x256 over roi x48 + windows", frames, get_monotonic_us() - start_us, \
+        bench_alloc_cnt.load() - alloc_start, pix_num);
+
+    RuleStats_t rule_stats;
+    rule_engine_stats(&rules, &rule_stats);
+    const RuleSet_t* set = rules.current;
+    int mismatch = 0;
+    for (int r = 0; r < rule_num && set != NULL && !failed; r += 4)
+    {
+        //the last frame evaluated
+        const TempInfo_t* info = &history[(size_t)((frames - 1) % input->frame_num) * ROI_MAX_NUM + r % 48];
+        float max_celsius = (float)info->max_temp / (1 << TEMP_RAW_SHIFT) - 273.15f;
+        mismatch += (rules.state[r] != (max_celsius > (float)(20.0 + r % 32)));
+    }
+    if (mismatch != 0 || rule_stats.load_errors != 1 || set == NULL || set->rule_num != rule_num)
+    {
+        printf("bench: %d rules differ, %llu load errors\n", mismatch, (unsigned long long)rule_stats.load_errors);
+        failed = 1;
+    }
+    else
+    {
+        printf("bench: rules %d instructions, slowest evaluation %llu us\n", set->code_len, \
+            (unsigned long long)rule_stats.eval_max_us);
+    }
+    rule_engine_release(&rules);
+    roi_windows_release(&windows);
+    roi_engine_release(&roi_engine);
+    free(history);
+    free(stats);
+    free(text);
+    return failed;
+}
+
+//32 user drawn lines, every profile gathered in one pass against one get_line_temp per line. the gathers of both
+//sampling modes are checked against the scalar path, nearest samples against the pixels they name
+static int bench_profile(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    TempDataRes_t temp_res = { (uint16_t)input->width, (uint16_t)input->height };
+    ProfileEngine_t engine;
+    if (profile_engine_init(&engine, temp_res) != PROFILE_SUCCESS)
+    {
+        return 0;
+    }
+    for (int i = 0; i < 32; i++)
+    {
+        Line_t line = { (i * 37) % input->width, (i * 11) % input->height, (input->width - 1) - (i * 23) % input->width, \
+            (input->height - 1) - (i * 5) % input->height };
+        profile_engine_add_line(&engine, line, (i % 2) ? PROFILE_SAMPLE_LINEAR : PROFILE_SAMPLE_NEAREST);
+    }
+
+    TempInfo_t temp_info[PROFILE_MAX_LINES];
+    const char* names[] = { "profile x32 engine", "profile x32 get_line_temp" };
+    for (int config = 0; config < 2; config++)
+    {
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            uint16_t* temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+            if (config == 0)
+            {
+                profile_engine_process(&engine, temp, temp_info);
+                continue;
+            }
+            for (int i = 0; i < engine.line_num; i++)
+            {
+                get_line_temp(temp, temp_res, engine.lines[i].line, &temp_info[i]);
+            }
+        }
+        bench_result_add("temp", names[config], frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+
+    int failed = 0;
+    uint16_t* temp = (uint16_t*)(bench_raw_frame(input, 0) + pix_num * 2);
+    uint16_t* simd_profile = (uint16_t*)malloc(engine.sample_num * sizeof(uint16_t));
+    if (simd_profile != NULL)
+    {
+        SimdLevel_t level = simd_level_get();
+        profile_engine_process(&engine, temp, NULL);
+        memcpy(simd_profile, engine.profile, engine.sample_num * sizeof(uint16_t));
+        simd_level_set(SIMD_LEVEL_SCALAR);
+        profile_engine_process(&engine, temp, NULL);
+        simd_level_set(level);
+        int mismatch = 0;
+        for (int i = 0; i < engine.line_num; i++)
+        {
+            const ProfileLine_t* line = &engine.lines[i];
+            for (int k = line->offset; k < line->offset + line->num; k++)
+            {
+                const Dot_t* point = &engine.points[k];
+                mismatch += (simd_profile[k] != engine.profile[k]);
+                mismatch += (line->sample == PROFILE_SAMPLE_NEAREST && \
+                    engine.profile[k] != temp[point->y * input->width + point->x]);
+            }
+        }
+        if (mismatch != 0)
+        {
+            printf("bench: %d profile samples differ\n", mismatch);
+            failed++;
+        }
+        free(simd_profile);
+    }
+    profile_engine_release(&engine);
+    return failed;
+}
+
+//clahe of the first frame at the current simd level against scalar, and in bands against one band
+static int bench_clahe(BenchInput_t* input)
+{
+    int pix_num = input->width * input->height;
+    Clahe_t clahe;
+    uint16_t* out[3];
+    for (int i = 0; i < 3; i++)
+    {
+        out[i] = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    }
+    int failed = 0;
+    if (clahe_init(&clahe, NULL) == CLAHE_SUCCESS && out[0] != NULL && out[1] != NULL && out[2] != NULL)
+    {
+        uint16_t min_val = 0, max_val = 0;
+        simd_minmax_u16(input->y14_frame, pix_num, &min_val, &max_val);
+        SimdLevel_t level = simd_level_get();
+        clahe_process(&clahe, input->y14_frame, input->width, input->height, min_val, max_val, out[0], 1);
+        clahe_process(&clahe, input->y14_frame, input->width, input->height, min_val, max_val, out[1], 4);
+        simd_level_set(SIMD_LEVEL_SCALAR);
+        clahe_process(&clahe, input->y14_frame, input->width, input->height, min_val, max_val, out[2], 1);
+        simd_level_set(level);
+        int mismatch = 0;
+        for (int i = 0; i < pix_num; i++)
+        {
+            mismatch += (out[0][i] != out[2][i]) + (out[1][i] != out[2][i]) + (out[2][i] > CLAHE_OUT_MAX);
+        }
+        if (mismatch != 0)
+        {
+            printf("bench: %d clahe pixels differ\n", mismatch);
+            failed++;
+        }
+    }
+    clahe_release(&clahe);
+    for (int i = 0; i < 3; i++)
+    {
+        free(out[i]);
+    }
+    return failed;
+}
+
+//dde of the first frame at the current simd level and scalar against the box filter summed out per pixel
+static int bench_dde(BenchInput_t* input)
+{
+    int width = input->width, height = input->height, pix_num = width * height;
+    const uint16_t* src = input->y14_frame;
+    static HistAgc_t agc, agc_ref;
+    uint16_t* out[2] = { (uint16_t*)malloc(pix_num * sizeof(uint16_t)), (uint16_t*)malloc(pix_num * sizeof(uint16_t)) };
+    uint16_t* row_mean = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    int failed = 0;
+    const uint8_t radii[] = { 1, DDE_DEFAULT_RADIUS, DDE_RADIUS_MAX };
+    for (int r = 0; r < 3 && out[0] != NULL && out[1] != NULL && row_mean != NULL; r++)
+    {
+        DdeFilterParam_t param = { radii[r], DDE_DEFAULT_GAIN };
+        DdeFilter_t dde;
+        dde_init(&dde, &param);
+        hist_agc_init(&agc, NULL);
+        hist_agc_prepare(&agc, (uint16_t*)src, pix_num, 0);
+        agc_ref = agc;
+        SimdLevel_t level = simd_level_get();
+        dde_process(&dde, &agc, src, width, height, out[0]);
+        agc = agc_ref;
+        simd_level_set(SIMD_LEVEL_SCALAR);
+        dde_process(&dde, &agc, src, width, height, out[1]);
+        simd_level_set(level);
+        dde_release(&dde);
+
+        int radius = radii[r], n = 2 * radius + 1;
+        int32_t gain = (int32_t)(DDE_DEFAULT_GAIN * hist_agc_slope(&agc_ref) * 256 + 0.5f);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                uint32_t sum = 0;
+                for (int k = -radius; k <= radius; k++)
+                {
+                    int xk = (x + k < 0) ? 0 : ((x + k >= width) ? width - 1 : x + k);
+                    sum += src[y * width + xk];
+                }
+                row_mean[y * width + x] = (uint16_t)((sum * 4 + n / 2) / n);
+            }
+        }
+        int mismatch = 0;
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                uint32_t sum = 0;
+                for (int k = -radius; k <= radius; k++)
+                {
+                    int yk = (y + k < 0) ? 0 : ((y + k >= height) ? height - 1 : y + k);
+                    sum += row_mean[yk * width + x];
+                }
+                int32_t base = (int32_t)(sum / n);
+                int32_t d = ((int32_t)src[y * width + x] << 2) - base;
+                int32_t v = agc_ref.lut[(base + 2) >> 2] + ((d * gain + 512) >> 10);
+                v = (v < 0) ? 0 : ((v > 16383) ? 16383 : v);
+                mismatch += (out[0][y * width + x] != v) + (out[1][y * width + x] != v);
+            }
+        }
+        if (mismatch != 0)
+        {
+            printf("bench: %d dde pixels differ at radius %d\n", mismatch, radius);
+            failed++;
+        }
+    }
+    free(out[0]);
+    free(out[1]);
+    free(row_mean);
+    return failed;
+}
+
+//a nearest x2 view against the source's pixels replicated, and a bilinear x3 view off center against the scalar
+//remap
+static int bench_zoom(BenchInput_t* input)
+{
+    int width = input->width, height = input->height, pix_num = width * height;
+    const uint16_t* src = input->y14_frame;
+    uint16_t* out[2] = { (uint16_t*)malloc(pix_num * sizeof(uint16_t)), (uint16_t*)malloc(pix_num * sizeof(uint16_t)) };
+    int failed = 0;
+    ZoomMap_t map;
+    zoom_map_init(&map);
+    ZoomView_t view;
+    zoom_view_set(&view, 2.0f, 0.5f, 0.5f, ZOOM_SAMPLE_NEAREST);
+    if (out[0] == NULL || out[1] == NULL || zoom_map_update(&map, &view, width, height, width) != ZOOM_SUCCESS)
+    {
+        printf("bench: zoom map failed\n");
+        failed++;
+    }
+    else
+    {
+        int mismatch = 0;
+        for (int y = 0; y < height; y++)
+        {
+            const uint16_t* line = zoom_map_line(&map, src, y);
+            const uint16_t* ref = src + (height / 4 + y / 2) * width + width / 4;
+            for (int x = 0; x < width; x++)
+            {
+                mismatch += (line[x] != ref[x / 2]);
+            }
+        }
+        zoom_view_set(&view, 3.0f, 0.3f, 0.7f, ZOOM_SAMPLE_BILINEAR);
+        zoom_map_update(&map, &view, width, height, width);
+        SimdLevel_t level = simd_level_get();
+        for (int pass = 0; pass < 2; pass++)
+        {
+            simd_level_set(pass == 0 ? level : SIMD_LEVEL_SCALAR);
+            for (int y = 0; y < height; y++)
+            {
+                memcpy(out[pass] + y * width, zoom_map_line(&map, src, y), width * sizeof(uint16_t));
+            }
+        }
+        simd_level_set(level);
+        mismatch += (memcmp(out[0], out[1], pix_num * sizeof(uint16_t)) != 0);
+        if (mismatch != 0)
+        {
+            printf("bench: %d zoom pixels differ\n", mismatch);
+            failed++;
+        }
+    }
+    zoom_map_release(&map);
+    free(out[0]);
+    free(out[1]);
+    return failed;
+}
+
+//1024 scattered point queries, the batch call against get_point_temp per point, and a whole frame compared
+static void bench_points(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    TempDataRes_t temp_res = { (uint16_t)input->width, (uint16_t)input->height };
+    Dot_t points[1024];
+    uint16_t values[1024];
+    for (int i = 0; i < 1024; i++)
+    {
+        points[i].x = (i * 37) % input->width;
+        points[i].y = (i * 11) % input->height;
+    }
+    int mismatch = temp_points_verify((uint16_t*)(bench_raw_frame(input, 0) + pix_num * 2), temp_res);
+    const char* names[] = { "points x1024 get_point_temp", "points x1024 batch" };
+    for (int config = 0; config < 2; config++)
+    {
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            uint16_t* temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+            if (config == 1)
+            {
+                temp_points_get(temp, temp_res, points, 1024, values);
+                continue;
+            }
+            for (int i = 0; i < 1024; i++)
+            {
+                get_point_temp(temp, temp_res, points[i], &values[i]);
+            }
+        }
+        char config_name[64];
+        snprintf(config_name, sizeof(config_name), "%s%s", names[config], (config == 1 && mismatch != 0) ? " MISMATCH" : "");
+        bench_result_add("temp", config_name, frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+}
+
+//full frame alarms 1K under the first frame's peak, against a mask taken after the celsius conversion
+static void bench_alarm(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    TempDataRes_t temp_res = { (uint16_t)input->width, (uint16_t)input->height };
+    AlarmEngine_t alarm_engine;
+    float* celsius = (float*)malloc(pix_num * (sizeof(float) + 1));
+    if (celsius == NULL || alarm_engine_init(&alarm_engine, temp_res) != ALARM_SUCCESS)
+    {
+        free(celsius);
+        return;
+    }
+    uint8_t* mask = (uint8_t*)(celsius + pix_num);
+    uint16_t min_val = 0, max_val = 0;
+    simd_minmax_u16((uint16_t*)(bench_raw_frame(input, 0) + pix_num * 2), pix_num, &min_val, &max_val);
+    AlarmParam_t param = { 0 };
+    param.raise_temp = (max_val > 64) ? max_val - 64 : max_val;
+    param.clear_temp = (param.raise_temp > 3 * 64) ? param.raise_temp - 3 * 64 : 0;
+    param.min_area = 4;
+    param.raise_frames = 2;
+    param.clear_frames = 5;
+    param.match_distance = 4;
+    alarm_engine_start(&alarm_engine, &param);
+
+    SimdLevel_t level = simd_level_get();
+    const char* names[] = { "alarm y14 ccl+track", "alarm y14 ccl+track scalar", "alarm celsius mask only" };
+    for (int config = 0; config < 3; config++)
+    {
+        simd_level_set((config == 1) ? SIMD_LEVEL_SCALAR : level);
+        float raise_celsius = temp_value_converter(param.raise_temp);
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            uint16_t* temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+            if (config < 2)
+            {
+                alarm_engine_process(&alarm_engine, temp, n, get_monotonic_us());
+                continue;
+            }
+            temp_frame_to_celsius(temp, pix_num, celsius);
+            for (int i = 0; i < pix_num; i++)
+            {
+                mask[i] = (uint8_t)(celsius[i] >= raise_celsius);
+            }
+        }
+        bench_result_add("temp", names[config], frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+    simd_level_set(level);
+    alarm_engine_release(&alarm_engine);
+    free(celsius);
+}
+
+//the labelling and tracking results of two engines fed the same frame, latency aside
+static int bench_alarm_same(const AlarmEngine_t* a, const AlarmEngine_t* b, int event_num)
+{
+    if (a->blob_num != b->blob_num)
+    {
+        return 0;
+    }
+    for (int i = 0; i < a->blob_num; i++)
+    {
+        const AlarmBlob_t* p = &a->blobs[i];
+        const AlarmBlob_t* q = &b->blobs[i];
+        if (p->area != q->area || p->hot_area != q->hot_area || p->max_temp != q->max_temp || p->max_x != q->max_x || \
+            p->max_y != q->max_y || p->x0 != q->x0 || p->y0 != q->y0 || p->x1 != q->x1 || p->y1 != q->y1)
+        {
+            return 0;
+        }
+    }
+    for (int i = 0; i < event_num; i++)
+    {
+        const AlarmEvent_t* p = &a->events[i];
+        const AlarmEvent_t* q = &b->events[i];
+        if (p->type != q->type || p->track_id != q->track_id || p->max_temp != q->max_temp || p->area != q->area || \
+            p->x0 != q->x0 || p->y0 != q->y0 || p->x1 != q->x1 || p->y1 != q->y1)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//the temp pyramid: build per simd level, rect max and peaks against a brute force scan, the alarm labelling with
+//and without the pyramid's cold rows. returns the number of mismatches
+static int bench_pyramid(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    TempDataRes_t temp_res = { (uint16_t)input->width, (uint16_t)input->height };
+    FramePyramid_t pyramid, check;
+    AlarmEngine_t alarm_full, alarm_coarse;
+    if (frame_pyramid_init(&pyramid, input->width, input->height) != FRAME_STATS_SUCCESS)
+    {
+        return 0;
+    }
+    if (frame_pyramid_init(&check, input->width, input->height) != FRAME_STATS_SUCCESS)
+    {
+        frame_pyramid_release(&pyramid);
+        return 0;
+    }
+    int failed = 0;
+    SimdLevel_t level = simd_level_get();
+    const char* names[] = { "pyramid build", "pyramid build scalar" };
+    for (int config = 0; config < 2; config++)
+    {
+        simd_level_set((config == 1) ? SIMD_LEVEL_SCALAR : level);
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            frame_pyramid_build((config == 1) ? &check : &pyramid, (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2));
+        }
+        bench_result_add("stats", names[config], frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+    simd_level_set(level);
+    for (int l = 0; l < pyramid.level_num; l++)
+    {
+        size_t size = (size_t)pyramid.level[l].width * pyramid.level[l].height * sizeof(uint16_t);
+        if (memcmp(pyramid.level[l].min, check.level[l].min, size) != 0 || \
+            memcmp(pyramid.level[l].max, check.level[l].max, size) != 0 || \
+            memcmp(pyramid.level[l].mean, check.level[l].mean, size) != 0)
+        {
+            printf("bench: pyramid level %d differs from scalar\n", l);
+            failed++;
+        }
+    }
+
+    //the last frame built: random rects against a scan, timed both ways
+    const uint16_t* temp = (uint16_t*)(bench_raw_frame(input, frames - 1) + pix_num * 2);
+    uint32_t seed = 12345;
+    int rects[256][4];
+    for (int i = 0; i < 256; i++)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            seed = seed * 1103515245 + 12345;
+            rects[i][k] = (int)((seed >> 8) % (uint32_t)((k & 1) ? input->height : input->width));
+        }
+    }
+    uint16_t scan_max[256];
+    uint64_t start_us = get_monotonic_us();
+    for (int n = 0; n < frames; n++)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            int x0 = (rects[i][0] < rects[i][2]) ? rects[i][0] : rects[i][2];
+            int x1 = rects[i][0] + rects[i][2] - x0;
+            int y0 = (rects[i][1] < rects[i][3]) ? rects[i][1] : rects[i][3];
+            int y1 = rects[i][1] + rects[i][3] - y0;
+            uint16_t max_val = 0;
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    max_val = (temp[y * input->width + x] > max_val) ? temp[y * input->width + x] : max_val;
+                }
+            }
+            scan_max[i] = max_val;
+        }
+    }
+    bench_result_add("stats", "rect max x256 scan", frames, get_monotonic_us() - start_us, 0, pix_num);
+    start_us = get_monotonic_us();
+    int mismatch = 0;
+    for (int n = 0; n < frames; n++)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            FramePyramidPeak_t peak = { 0, 0, 0 };
+            int x0 = (rects[i][0] < rects[i][2]) ? rects[i][0] : rects[i][2];
+            int y0 = (rects[i][1] < rects[i][3]) ? rects[i][1] : rects[i][3];
+            frame_pyramid_rect_max(&pyramid, temp, x0, y0, rects[i][0] + rects[i][2] - x0, \
+                rects[i][1] + rects[i][3] - y0, &peak);
+            mismatch += (peak.value != scan_max[i] || temp[peak.y * input->width + peak.x] != peak.value);
+        }
+    }
+    bench_result_add("stats", mismatch ? "rect max x256 pyramid MISMATCH" : "rect max x256 pyramid", frames, \
+        get_monotonic_us() - start_us, 0, pix_num);
+    failed += (mismatch != 0);
+
+    FramePyramidPeak_t peaks[16];
+    int peak_num = frame_pyramid_peaks(&pyramid, temp, 1, 0, peaks, 16);
+    for (int i = 0; i < peak_num; i++)
+    {
+        if (temp[peaks[i].y * input->width + peaks[i].x] != peaks[i].value || \
+            (i > 0 && peaks[i].value > peaks[i - 1].value))
+        {
+            printf("bench: pyramid peak %d at %d,%d is not its plane value\n", i, peaks[i].x, peaks[i].y);
+            failed++;
+            break;
+        }
+    }
+
+    //the alarm thresholds of bench_alarm, both engines must agree on every frame
+    if (alarm_engine_init(&alarm_full, temp_res) == ALARM_SUCCESS)
+    {
+        if (alarm_engine_init(&alarm_coarse, temp_res) == ALARM_SUCCESS)
+        {
+            uint16_t min_val = 0, max_val = 0;
+            simd_minmax_u16((uint16_t*)(bench_raw_frame(input, 0) + pix_num * 2), pix_num, &min_val, &max_val);
+            AlarmParam_t param = { 0 };
+            param.raise_temp = (max_val > 64) ? max_val - 64 : max_val;
+            param.clear_temp = (param.raise_temp > 3 * 64) ? param.raise_temp - 3 * 64 : 0;
+            param.min_area = 4;
+            param.raise_frames = 2;
+            param.clear_frames = 5;
+            param.match_distance = 4;
+            alarm_engine_start(&alarm_full, &param);
+            alarm_engine_start(&alarm_coarse, &param);
+            int differ = 0;
+            uint64_t full_us = 0, coarse_us = 0;
+            for (int n = 0; n < frames; n++)
+            {
+                temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+                frame_pyramid_build(&pyramid, temp);
+                start_us = get_monotonic_us();
+                int full_num = alarm_engine_process(&alarm_full, temp, n, n);
+                full_us += get_monotonic_us() - start_us;
+                start_us = get_monotonic_us();
+                int coarse_num = alarm_engine_process_pyramid(&alarm_coarse, temp, &pyramid, n, n);
+                coarse_us += get_monotonic_us() - start_us;
+                differ += (full_num != coarse_num || !bench_alarm_same(&alarm_full, &alarm_coarse, full_num));
+            }
+            bench_result_add("temp", "alarm y14 full rows", frames, full_us, 0, pix_num);
+            bench_result_add("temp", differ ? "alarm y14 pyramid rows MISMATCH" : "alarm y14 pyramid rows", frames, \
+                coarse_us, 0, pix_num);
+            failed += (differ != 0);
+            alarm_engine_release(&alarm_coarse);
+        }
+        alarm_engine_release(&alarm_full);
+    }
+    frame_pyramid_release(&check);
+    frame_pyramid_release(&pyramid);
+    return failed;
+}
+
+//greedy non maximum suppression by k full scans, each taking the hottest pixel outside the reach of the ones
+//before with frame_topk's tie order: lower tile, then row order in it. the repeated max queries frame_topk replaces
+static int bench_topk_scan(const uint16_t* temp, int width, int height, const FrameTopkParam_t* param, \
+    FramePyramidPeak_t* peaks, int k)
+{
+    int cols = (width + FRAME_TILES_SIZE - 1) / FRAME_TILES_SIZE;
+    int distance = (param->min_distance > 0) ? param->min_distance : 1;
+    int peak_num = 0;
+    for (; peak_num < k; peak_num++)
+    {
+        int found = 0;
+        uint32_t best_key = 0;
+        FramePyramidPeak_t best = { 0, 0, 0 };
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                uint16_t v = temp[y * width + x];
+                if (v < param->threshold || (found && v < best.value))
+                {
+                    continue;
+                }
+                int suppressed = 0;
+                for (int i = 0; i < peak_num && !suppressed; i++)
+                {
+                    int dx = x - peaks[i].x, dy = y - peaks[i].y;
+                    suppressed = (dx * dx + dy * dy < distance * distance);
+                }
+                uint32_t key = (uint32_t)((y / FRAME_TILES_SIZE) * cols + x / FRAME_TILES_SIZE) << 8 | \
+                    (uint32_t)((y % FRAME_TILES_SIZE) << 4 | (x % FRAME_TILES_SIZE));
+                if (suppressed || (found && v == best.value && key > best_key))
+                {
+                    continue;
+                }
+                best.value = v;
+                best.x = (uint16_t)x;
+                best.y = (uint16_t)y;
+                best_key = key;
+                found = 1;
+            }
+        }
+        if (!found)
+        {
+            break;
+        }
+        peaks[peak_num] = best;
+    }
+    return peak_num;
+}
+
+//the 16 hottest points at least 8 pixels apart: frame_topk from the stats pass' tiles, from the pyramid alone and
+//from nothing, against 16 scans of the frame. every frame's three answers must be the scans' answer
+static int bench_topk(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    FramePyramid_t pyramid;
+    if (frame_pyramid_init(&pyramid, input->width, input->height) != FRAME_STATS_SUCCESS)
+    {
+        return 0;
+    }
+    FrameStats_t stats;
+    FrameTiles_t* tiles = (FrameTiles_t*)malloc(sizeof(FrameTiles_t));
+    if (tiles == NULL)
+    {
+        frame_pyramid_release(&pyramid);
+        return 0;
+    }
+    FrameTopkParam_t param = { 0, 8 };
+    FramePyramidPeak_t peaks[4][16];
+    int peak_num[4];
+    int mismatch = 0;
+    uint64_t elapsed_us[4] = { 0, 0, 0, 0 };
+    for (int n = 0; n < frames; n++)
+    {
+        const uint16_t* temp = (uint16_t*)(bench_raw_frame(input, n) + pix_num * 2);
+        frame_stats_compute_tiled(temp, input->width, input->height, &stats, tiles);
+        frame_pyramid_build(&pyramid, temp);
+        //the threshold a few degrees under the frame's max, so the points come from the warm parts
+        param.threshold = (stats.max_val > 4 * 64) ? stats.max_val - 4 * 64 : 0;
+        for (int config = 0; config < 4; config++)
+        {
+            uint64_t start_us = get_monotonic_us();
+            if (config == 3)
+            {
+                peak_num[config] = bench_topk_scan(temp, input->width, input->height, &param, peaks[config], 16);
+            }
+            else
+            {
+                peak_num[config] = frame_topk(temp, input->width, input->height, (config == 0) ? tiles : NULL, \
+                    (config == 1) ? &pyramid : NULL, &param, peaks[config], 16);
+            }
+            elapsed_us[config] += get_monotonic_us() - start_us;
+        }
+        for (int config = 0; config < 3; config++)
+        {
+            mismatch += (peak_num[config] != peak_num[3] || \
+                memcmp(peaks[config], peaks[3], peak_num[3] * sizeof(FramePyramidPeak_t)) != 0);
+        }
+    }
+    const char* names[] = { "topk x16 tiles", "topk x16 pyramid", "topk x16 no tiles", "topk x16 frame scans" };
+    for (int config = 0; config < 4; config++)
+    {
+        char config_name[64];
+        snprintf(config_name, sizeof(config_name), "%s%s", names[config], (config < 3 && mismatch) ? " MISMATCH" : "");
+        bench_result_add("temp", config_name, frames, elapsed_us[config], 0, pix_num);
+    }
+    if (mismatch != 0)
+    {
+        printf("bench: %d topk answers differ from the frame scans\n", mismatch);
+    }
+    free(tiles);
+    frame_pyramid_release(&pyramid);
+    return mismatch != 0;
+}
+
+//synthetic blob lists: num objects bouncing around a 640x480 scene at up to 2 pixels per frame, 1 in 50
+//detections missed. ns/pixel of the report is per blob here
+static void bench_track(int frames)
+{
+    static Tracker_t tracker;
+    const int nums[] = { 32, 128, 256 };
+    const char* names[] = { "track 32 blobs", "track 128 blobs", "track 256 blobs" };
+    SegmentBlob_t* blobs = (SegmentBlob_t*)malloc(TRACKER_MAX_BLOBS * (sizeof(SegmentBlob_t) + 4 * sizeof(float)));
+    if (blobs == NULL)
+    {
+        return;
+    }
+    float* pos = (float*)(blobs + TRACKER_MAX_BLOBS);
+    for (int config = 0; config < 3; config++)
+    {
+        int num = nums[config];
+        TrackerParam_t param = { 0.1f, 12.0f, 3, 5, 0.5f, 1.0f, 0 };
+        tracker_init(&tracker, &param);
+        uint32_t seed = 12345;
+        for (int i = 0; i < num * 4; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            pos[i] = (i % 4 < 2) ? (float)((seed >> 16) % 440 + 20) : (float)((int)((seed >> 16) % 200) - 100) / 50.0f;
+        }
+        uint64_t elapsed_us = 0;
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        for (int n = 0; n < frames; n++)
+        {
+            int blob_num = 0;
+            for (int i = 0; i < num; i++)
+            {
+                float* p = pos + i * 4;
+                p[0] += p[2];
+                p[1] += p[3];
+                p[2] = (p[0] < 10 || p[0] > 630) ? -p[2] : p[2];
+                p[3] = (p[1] < 10 || p[1] > 470) ? -p[3] : p[3];
+                seed = seed * 1103515245 + 12345;
+                if ((seed >> 16) % 50 == 0)
+                {
+                    continue;
+                }
+                SegmentBlob_t* blob = &blobs[blob_num++];
+                memset(blob, 0, sizeof(SegmentBlob_t));
+                blob->cx = (uint16_t)p[0];
+                blob->cy = (uint16_t)p[1];
+                blob->x0 = blob->cx - 4;
+                blob->x1 = blob->cx + 4;
+                blob->y0 = blob->cy - 6;
+                blob->y1 = blob->cy + 6;
+                blob->area = 117;
+            }
+            uint64_t start_us = get_monotonic_us();
+            tracker_update(&tracker, blobs, blob_num, (uint64_t)n * 40000);
+            elapsed_us += get_monotonic_us() - start_us;
+        }
+        bench_result_add("track", names[config], frames, elapsed_us, bench_alloc_cnt.load() - alloc_start, num);
+    }
+    free(blobs);
+}
+
+//the semaphore pair each stage hand-off used to be: the producer waits for done, fills the one slot and posts
+//ready, the consumer waits for ready, takes it and posts done
+typedef struct {
+    sync_mutex_t mutex;
+    sync_cond_t cond;
+    int count;
+}BenchSem_t;
+
+typedef struct {
+    int kind;                           //BENCH_QUEUE_xxx
+    SpscQueue_t* spsc;
+    MpmcQueue_t* mpmc;
+    BenchSem_t* ready;
+    BenchSem_t* done;
+    uint64_t* slot;
+    int id;
+    int producer_num;
+    uint64_t num;                       //messages of this producer, or of all producers for a consumer
+    std::atomic<uint64_t>* consumed;    //shared by the consumers of an mpmc run
+    uint64_t sum;
+    uint64_t received;
+    int errors;                         //messages out of order
+}BenchQueueThread_t;
+
+typedef enum
+{
+    BENCH_QUEUE_SEM = 0,
+    BENCH_QUEUE_SPSC,
+    BENCH_QUEUE_MPMC,
+}BenchQueueKind_t;
+
+static void bench_sem_wait(BenchSem_t* sem)
+{
+    sync_mutex_lock(&sem->mutex);
+    while (sem->count == 0)
+    {
+        sync_cond_wait(&sem->cond, &sem->mutex);
+    }
+    sem->count = 0;
+    sync_mutex_unlock(&sem->mutex);
+}
+
+static void bench_sem_post(BenchSem_t* sem)
+{
+    sync_mutex_lock(&sem->mutex);
+    sem->count = 1;
+    sync_cond_signal(&sem->cond);
+    sync_mutex_unlock(&sem->mutex);
+}
+
+//producer id in the top byte, its sequence below
+static void* bench_queue_producer(void* arg)
+{
+    BenchQueueThread_t* thread = (BenchQueueThread_t*)arg;
+    for (uint64_t i = 0; i < thread->num; i++)
+    {
+        uint64_t message = ((uint64_t)thread->id << 56) | i;
+        if (thread->kind == BENCH_QUEUE_SEM)
+        {
+            bench_sem_wait(thread->done);
+            *thread->slot = message;
+            bench_sem_post(thread->ready);
+        }
+        else if (thread->kind == BENCH_QUEUE_SPSC)
+        {
+            spsc_queue_push_wait(thread->spsc, &message, -1);
+        }
+        else
+        {
+            mpmc_queue_push_wait(thread->mpmc, &message, -1);
+        }
+    }
+    return NULL;
+}
+
+//each producer's messages come in order, the sums tell a lost or doubled one
+static void* bench_queue_consumer(void* arg)
+{
+    BenchQueueThread_t* thread = (BenchQueueThread_t*)arg;
+    uint64_t next[BENCH_QUEUE_MAX_THREADS] = { 0 };
+    while (1)
+    {
+        uint64_t message = 0;
+        if (thread->kind == BENCH_QUEUE_MPMC)
+        {
+            //the last one is claimed before it is popped, so no consumer waits on a queue that stays empty
+            if (thread->consumed->fetch_add(1) >= thread->num)
+            {
+                break;
+            }
+            mpmc_queue_pop_wait(thread->mpmc, &message, -1);
+        }
+        else
+        {
+            if (thread->received >= thread->num)
+            {
+                break;
+            }
+            if (thread->kind == BENCH_QUEUE_SEM)
+            {
+                bench_sem_wait(thread->ready);
+                message = *thread->slot;
+                bench_sem_post(thread->done);
+            }
+            else
+            {
+                spsc_queue_pop_wait(thread->spsc, &message, -1);
+            }
+        }
+        int producer = (int)(message >> 56);
+        uint64_t seq = message & ((1ull << 56) - 1);
+        if (producer >= thread->producer_num || seq < next[producer])
+        {
+            thread->errors++;
+        }
+        else
+        {
+            next[producer] = seq + 1;
+        }
+        thread->sum += message;
+        thread->received++;
+    }
+    return NULL;
+}
+
+typedef struct {
+    uint64_t last_seq;
+    uint64_t runs;
+    int errors;                         //frames out of order
+    int skip_odd;
+}BenchGraphStage_t;
+
+static int bench_graph_stage(const FrameDesc_t* desc, void* arg)
+{
+    BenchGraphStage_t* stage = (BenchGraphStage_t*)arg;
+    if (desc->seq <= stage->last_seq)
+    {
+        stage->errors++;
+    }
+    stage->last_seq = desc->seq;
+    stage->runs++;
+    return (stage->skip_odd && (desc->seq & 1)) ? GRAPH_SKIP : GRAPH_SUCCESS;
+}
+
+static void bench_graph_released(FrameSlot_t* slot, uint64_t held_us, void* arg)
+{
+    ((std::atomic<uint64_t>*)arg)->fetch_add(1, std::memory_order_relaxed);
+}
+
+//graph_attach has to refuse each of these
+static int bench_graph_refused(StreamFrameInfo_t* stream_frame_info, BenchGraphStage_t* stage)
+{
+    const char* names[] = { "pool blocking pool", "missing port", "edge deeper than the ring", "inline with a policy" };
+    int failed = 0;
+    for (int check = 0; check < 4; check++)
+    {
+        static Graph_t graph;
+        graph_init(&graph);
+        GraphStage_t first = { "first", GRAPH_SOURCE, GRAPH_PORT_RAW, 0, GRAPH_EDGE_DROP_OLDEST, 0, GRAPH_THREAD_POOL, \
+            RT_ROLE_ANALYTICS, POOL_STAGE_OTHER, bench_graph_stage, stage };
+        GraphStage_t second = first;
+        second.name = "second";
+        second.parent = 0;
+        if (check == 0)
+        {
+            second.policy = GRAPH_EDGE_BLOCK;
+        }
+        else if (check == 1)
+        {
+            second.inputs = GRAPH_PORT_USER(2);
+        }
+        else if (check == 2)
+        {
+            second.depth = 2 * FRAME_RING_MAX_DEPTH;
+        }
+        else
+        {
+            second.thread = GRAPH_THREAD_INLINE;
+            second.policy = GRAPH_EDGE_LATEST;
+        }
+        graph_add(&graph, &first);
+        graph_add(&graph, &second);
+        char error[GRAPH_ERROR_LEN];
+        if (graph_attach(&graph, stream_frame_info, error, sizeof(error)) != GRAPH_ERROR_INVALID)
+        {
+            printf("graph: %s was not refused\n", names[check]);
+            graph_stop(&graph);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+//ns per ring frame through a graph of every policy and threading, with a stress check: frame order per node,
+//every frame accounted for as run or dropped and every slot free again at the end. returns 1 when it fails
+static int bench_graph(int frames)
+{
+    RingFormat_t format;
+    memset(&format, 0, sizeof(format));
+    uint32_t plane_size = BENCH_GRAPH_SIZE * BENCH_GRAPH_SIZE * 2;
+    format.camera_param.frame_size = 2 * plane_size;
+    format.image_byte_size = plane_size;
+    format.image_width = BENCH_GRAPH_SIZE;
+    format.image_height = BENCH_GRAPH_SIZE;
+    format.temp_byte_size = plane_size;
+    format.temp_width = BENCH_GRAPH_SIZE;
+    format.temp_height = BENCH_GRAPH_SIZE;
+    format.zero_copy = 1;
+    StreamFrameInfo_t stream_frame_info;
+    memset(&stream_frame_info, 0, sizeof(stream_frame_info));
+    stream_frame_info.camera_param.timeout_ms_delay = 100;
+    stream_frame_info.frame_ring = ring_create(&format, 0, NULL);
+    if (stream_frame_info.frame_ring == NULL)
+    {
+        return 0;
+    }
+    FrameRing_t* ring = stream_frame_info.frame_ring;
+    std::atomic<uint64_t> released(0);
+    ring_release_func_set(ring, bench_graph_released, &released);
+    pool_init(2);
+    BenchGraphStage_t stages[5];
+    memset(stages, 0, sizeof(stages));
+    stages[3].skip_odd = 1;
+    int failed = bench_graph_refused(&stream_frame_info, &stages[0]);
+
+    //record -> index inline, encode, alarm -> clip
+    static Graph_t graph;
+    graph_init(&graph);
+    GraphStage_t record = { "record", GRAPH_SOURCE, GRAPH_PORT_RAW, GRAPH_PORT_USER(0), GRAPH_EDGE_BLOCK, 0, \
+        GRAPH_THREAD_OWN, RT_ROLE_ANALYTICS, POOL_STAGE_RECORD, bench_graph_stage, &stages[0] };
+    GraphStage_t index = { "index", 0, GRAPH_PORT_USER(0), 0, GRAPH_EDGE_BLOCK, 0, GRAPH_THREAD_INLINE, \
+        RT_ROLE_ANALYTICS, POOL_STAGE_RECORD, bench_graph_stage, &stages[1] };
+    GraphStage_t encode = { "encode", GRAPH_SOURCE, GRAPH_PORT_IMAGE, 0, GRAPH_EDGE_DROP_OLDEST, 0, GRAPH_THREAD_POOL, \
+        RT_ROLE_ANALYTICS, POOL_STAGE_ENCODE, bench_graph_stage, &stages[2] };
+    GraphStage_t alarm = { "alarm", GRAPH_SOURCE, GRAPH_PORT_TEMP, GRAPH_PORT_USER(1), GRAPH_EDGE_LATEST, 0, \
+        GRAPH_THREAD_OWN, RT_ROLE_ANALYTICS, POOL_STAGE_OTHER, bench_graph_stage, &stages[3] };
+    GraphStage_t clip = { "clip", 3, GRAPH_PORT_USER(1), 0, GRAPH_EDGE_BLOCK, 0, GRAPH_THREAD_POOL, \
+        RT_ROLE_ANALYTICS, POOL_STAGE_OTHER, bench_graph_stage, &stages[4] };
+    graph_add(&graph, &record);
+    graph_add(&graph, &index);
+    graph_add(&graph, &encode);
+    graph_add(&graph, &alarm);
+    graph_add(&graph, &clip);
+    char error[GRAPH_ERROR_LEN];
+    if (graph_attach(&graph, &stream_frame_info, error, sizeof(error)) != GRAPH_SUCCESS || \
+        graph_start(&graph) != GRAPH_SUCCESS)
+    {
+        printf("graph: %s\n", error);
+        pool_release();
+        ring_destroy(ring);
+        return 1;
+    }
+
+    uint64_t num = (uint64_t)frames * BENCH_GRAPH_FRAMES;
+    uint64_t alloc_start = bench_alloc_cnt.load();
+    uint64_t start_us = get_monotonic_us();
+    for (uint64_t i = 0; i < num; i++)
+    {
+        FrameSlot_t* slot = ring_write_begin(ring);
+        if (slot == NULL)
+        {
+            ring_write_drop(ring);
+            std::this_thread::yield();
+            continue;
+        }
+        ring_write_commit(ring, slot, get_monotonic_us());
+    }
+    ring_close(ring);
+    ring_wait_detached(ring, 2000);
+    uint64_t elapsed_us = get_monotonic_us() - start_us;
+    uint64_t allocs = bench_alloc_cnt.load() - alloc_start;
+
+    GraphNodeStats_t stats[5];
+    int errors = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        graph_node_stats(&graph, i, &stats[i]);
+        errors += stages[i].errors + (stages[i].runs != stats[i].processed);
+    }
+    int slots_held = 0;
+    for (uint32_t i = 0; i < ring->depth; i++)
+    {
+        slots_held += (ring->slots[i].state.load() != SLOT_STATE_FREE);
+    }
+    //every hold ends in one release callback
+    TimingStats_t holds;
+    ring_hold_stats(ring, &holds, NULL);
+    if (errors > 0 || slots_held > 0 || released.load() != holds.count || stats[0].frames != graph.frames || stats[0].processed != stats[0].frames || \
+        stats[1].frames != stats[0].processed || stats[2].frames != graph.frames || \
+        stats[2].processed + stats[2].dropped != stats[2].frames || stats[3].frames != graph.frames || \
+        stats[3].processed + stats[3].dropped != stats[3].frames || \
+        stats[4].frames != stats[3].processed - stats[3].skipped || stats[4].processed != stats[4].frames)
+    {
+        printf("graph: stress check failed, %d out of order, %d slots still held, %llu of %llu holds released\n", \
+            errors, slots_held, (unsigned long long)released.load(), (unsigned long long)holds.count);
+        graph_dump(&graph, stdout);
+        failed++;
+    }
+    graph_stop(&graph);
+    pool_release();
+    ring_destroy(ring);
+    //frames of the report are ring frames / BENCH_GRAPH_FRAMES, ns/pixel is ns per ring frame
+    bench_result_add("graph", "5 nodes", frames, elapsed_us, allocs, BENCH_GRAPH_FRAMES);
+    return failed;
+}
+
+typedef struct {
+    std::atomic<int> created;
+    std::atomic<int> destroyed;
+    uint32_t spin_us;                   //wall time each frame burns
+    uint64_t last_seq;
+    int errors;                         //frames out of order, or without their plane
+}BenchPlugin_t;
+
+static BenchPlugin_t bench_plugins[2];
+
+static int bench_plugin_create(const char* config, void** state)
+{
+    BenchPlugin_t* plugin = &bench_plugins[atoi(config)];
+    plugin->created++;
+    plugin->last_seq = 0;
+    *state = plugin;
+    return IRP_SUCCESS;
+}
+
+static void bench_plugin_destroy(void* state)
+{
+    ((BenchPlugin_t*)state)->destroyed++;
+}
+
+static int bench_plugin_frame(void* state, const IrpFrameView_t* view, const IrpFrameStats_t* stats, \
+    IrpOutputs_t* outputs)
+{
+    BenchPlugin_t* plugin = (BenchPlugin_t*)state;
+    if ((plugin->last_seq != 0 && view->seq <= plugin->last_seq) || view->temp.format != IRP_FORMAT_Y14 || \
+        view->temp.data == NULL)
+    {
+        plugin->errors++;
+    }
+    plugin->last_seq = view->seq;
+    uint64_t start_us = get_monotonic_us();
+    while (get_monotonic_us() - start_us < plugin->spin_us)
+    {
+    }
+    outputs->values[0].value = ((const uint16_t*)view->temp.data)[0];
+    outputs->value_num = 1;
+    return IRP_SUCCESS;
+}
+
+static void bench_plugin_output(const char* name, const IrpFrameView_t* view, const IrpOutputs_t* outputs, void* arg)
+{
+    ((std::atomic<uint64_t>*)arg)->fetch_add(outputs->value_num, std::memory_order_relaxed);
+}
+
+//ns per ring frame through the plug-in host with a light plug-in and one that takes three times its budget, with
+//a check: the heavy one is throttled to about a third of its frames, the light one never, a reload mid run swaps
+//the light one's instance and every instance is destroyed at the end. returns 1 when it fails
+static int bench_plugin(int frames)
+{
+    RingFormat_t format;
+    memset(&format, 0, sizeof(format));
+    uint32_t plane_size = BENCH_GRAPH_SIZE * BENCH_GRAPH_SIZE * 2;
+    format.camera_param.frame_size = 2 * plane_size;
+    format.image_byte_size = plane_size;
+    format.image_width = BENCH_GRAPH_SIZE;
+    format.image_height = BENCH_GRAPH_SIZE;
+    format.temp_byte_size = plane_size;
+    format.temp_width = BENCH_GRAPH_SIZE;
+    format.temp_height = BENCH_GRAPH_SIZE;
+    format.zero_copy = 1;
+    StreamFrameInfo_t stream_frame_info;
+    memset(&stream_frame_info, 0, sizeof(stream_frame_info));
+    stream_frame_info.camera_param.timeout_ms_delay = 100;
+    stream_frame_info.frame_ring = ring_create(&format, 0, NULL);
+    if (stream_frame_info.frame_ring == NULL)
+    {
+        return 0;
+    }
+    FrameRing_t* ring = stream_frame_info.frame_ring;
+    pool_init(2);
+    for (int i = 0; i < 2; i++)
+    {
+        bench_plugins[i].created = 0;
+        bench_plugins[i].destroyed = 0;
+        bench_plugins[i].errors = 0;
+    }
+    bench_plugins[1].spin_us = 150;
+    IrpPluginDesc_t light = { sizeof(IrpPluginDesc_t), IRP_ABI_VERSION, IRP_INPUT_TEMP, 1000, "light", \
+        bench_plugin_create, bench_plugin_destroy, bench_plugin_frame };
+    IrpPluginDesc_t heavy = light;
+    heavy.name = "heavy";
+    heavy.budget_us = 50;
+    std::atomic<uint64_t> values(0);
+    PluginParam_t param = { bench_plugin_output, &values };
+    static PluginHost_t host;
+    plugin_host_init(&host, &stream_frame_info, &param);
+    static Graph_t graph;
+    graph_init(&graph);
+    char error[GRAPH_ERROR_LEN] = "";
+    if (plugin_host_add_desc(&host, &light, "0") != 0 || plugin_host_add_desc(&host, &heavy, "1") != 1 || \
+        plugin_host_graph(&host, &graph, GRAPH_SOURCE) != PLUGIN_SUCCESS || \
+        graph_attach(&graph, &stream_frame_info, error, sizeof(error)) != GRAPH_SUCCESS || \
+        graph_start(&graph) != GRAPH_SUCCESS)
+    {
+        printf("plugin: the host did not start %s\n", error);
+        plugin_host_release(&host);
+        pool_release();
+        ring_destroy(ring);
+        return 1;
+    }
+
+    uint64_t num = (uint64_t)frames * BENCH_GRAPH_FRAMES;
+    uint64_t alloc_start = bench_alloc_cnt.load();
+    uint64_t start_us = get_monotonic_us();
+    for (uint64_t i = 0; i < num; i++)
+    {
+        if (i == num / 2)
+        {
+            plugin_host_reload(&host, 0);
+        }
+        FrameSlot_t* slot = ring_write_begin(ring);
+        if (slot == NULL)
+        {
+            ring_write_drop(ring);
+            std::this_thread::yield();
+            continue;
+        }
+        ring_write_commit(ring, slot, get_monotonic_us());
+        //a camera's pace, the latest edges would hand on next to nothing of a burst
+        uint64_t frame_us = get_monotonic_us();
+        while (get_monotonic_us() - frame_us < BENCH_PLUGIN_PACE_US)
+        {
+        }
+    }
+    ring_close(ring);
+    ring_wait_detached(ring, 2000);
+    uint64_t elapsed_us = get_monotonic_us() - start_us;
+    uint64_t allocs = bench_alloc_cnt.load() - alloc_start;
+    graph_stop(&graph);
+
+    PluginStats_t stats[2];
+    plugin_stats(&host, 0, &stats[0]);
+    plugin_stats(&host, 1, &stats[1]);
+    uint64_t runs = stats[0].runs + stats[1].runs;
+    plugin_host_release(&host);
+    int failed = 0;
+    int slots_held = 0;
+    for (uint32_t i = 0; i < ring->depth; i++)
+    {
+        slots_held += (ring->slots[i].state.load() != SLOT_STATE_FREE);
+    }
+    if (bench_plugins[0].errors + bench_plugins[1].errors > 0 || slots_held > 0 || values.load() != runs || \
+        stats[0].throttled > 0 || stats[0].loads != 2 || stats[1].throttled == 0 || stats[1].runs == 0 || \
+        stats[1].runs > stats[1].frames / 2 || bench_plugins[0].created != 2 || bench_plugins[0].destroyed != 2 || \
+        bench_plugins[1].created != 1 || bench_plugins[1].destroyed != 1)
+    {
+        printf("plugin: check failed, %d out of order, %d slots still held, light %llu of %llu runs, %llu loads, " \
+            "heavy %llu of %llu runs, %llu throttled\n", bench_plugins[0].errors + bench_plugins[1].errors, \
+            slots_held, (unsigned long long)stats[0].runs, (unsigned long long)stats[0].frames, \
+            (unsigned long long)stats[0].loads, (unsigned long long)stats[1].runs, \
+            (unsigned long long)stats[1].frames, (unsigned long long)stats[1].throttled);
+        failed = 1;
+    }
+    pool_release();
+    ring_destroy(ring);
+    //as in bench_graph, ns/pixel is ns per ring frame, the pace included: more than it is the host falling behind
+    bench_result_add("plugin", "2 plug-ins, 20 us pace", frames, elapsed_us, allocs, BENCH_GRAPH_FRAMES);
+    return failed;
+}
+
+#if defined(__linux__)
+//bus reader in a child process: every frame's planes hold one value, and sequences only grow. a held frame is
+//checked again after the next acquire, the publisher must not have written it meanwhile
+static int bench_bus_child(const char* name, int hold_and_die)
+{
+    BusReader_t reader;
+    if (bus_reader_open(&reader, name) != BUS_SUCCESS)
+    {
+        return 3;
+    }
+    int errors = 0;
+    uint64_t frames = 0, last_seq = 0;
+    BusFrame_t held;
+    held.slot = -1;
+    uint16_t held_value = 0;
+    int pix_num = reader.header->temp.byte_size / 2;
+    for (;;)
+    {
+        BusFrame_t frame;
+        int rst = bus_reader_acquire(&reader, 1000, &frame);
+        if (rst != BUS_SUCCESS)
+        {
+            break;
+        }
+        if (hold_and_die)
+        {
+            _exit(0);
+        }
+        const uint16_t* image = (const uint16_t*)frame.image;
+        const uint16_t* temp = (const uint16_t*)frame.temp;
+        errors += (frame.seq <= last_seq || image[0] != (uint16_t)frame.seq);
+        for (int i = 0; i < pix_num; i++)
+        {
+            errors += (image[i] != image[0]) + (temp[i] != image[0]);
+        }
+        last_seq = frame.seq;
+        frames++;
+        if (held.slot >= 0)
+        {
+            const uint16_t* held_temp = (const uint16_t*)held.temp;
+            errors += (held_temp[0] != held_value || held_temp[pix_num - 1] != held_value);
+            bus_reader_release(&reader, &held);
+        }
+        if ((frames & 7) == 0)
+        {
+            held = frame;
+            held_value = temp[0];
+            continue;
+        }
+        bus_reader_release(&reader, &frame);
+    }
+    bus_reader_close(&reader);
+    return (errors > 0) ? 1 : ((frames == 0) ? 2 : 0);
+}
+
+static void bench_bus_fill(FrameRing_t* ring, uint32_t plane_size)
+{
+    FrameSlot_t* slot = ring_write_begin(ring);
+    if (slot == NULL)
+    {
+        ring_write_drop(ring);
+        return;
+    }
+    //the sequence the commit will give it
+    uint16_t value = (uint16_t)(ring->write_seq + 1);
+    uint16_t* image = (uint16_t*)slot->desc.image.data;
+    uint16_t* temp = (uint16_t*)slot->desc.temp.data;
+    for (uint32_t i = 0; i < plane_size / 2; i++)
+    {
+        image[i] = value;
+        temp[i] = value;
+    }
+    ring_write_commit(ring, slot, get_monotonic_us());
+}
+
+//ns per ring frame through the shared memory bus with a reader in another process, and a stress check: no torn
+//or rewritten frame on the reader's side and the leases of a reader killed while it held a slot taken back.
+//returns 1 when it fails
+static int bench_bus(int frames)
+{
+    RingFormat_t format;
+    memset(&format, 0, sizeof(format));
+    uint32_t plane_size = BENCH_GRAPH_SIZE * BENCH_GRAPH_SIZE * 2;
+    format.camera_param.frame_size = 2 * plane_size;
+    format.image_byte_size = plane_size;
+    format.image_width = BENCH_GRAPH_SIZE;
+    format.image_height = BENCH_GRAPH_SIZE;
+    format.temp_byte_size = plane_size;
+    format.temp_width = BENCH_GRAPH_SIZE;
+    format.temp_height = BENCH_GRAPH_SIZE;
+    format.zero_copy = 1;
+    StreamConfig_t config;
+    memset(&config, 0, sizeof(config));
+    config.image_info.width = config.temp_info.width = BENCH_GRAPH_SIZE;
+    config.image_info.height = config.temp_info.height = BENCH_GRAPH_SIZE;
+    config.image_info.input_format = INPUT_FMT_Y16;
+    config.image_byte_size = config.temp_byte_size = plane_size;
+    config.camera_param.fps = 25;
+    StreamFrameInfo_t stream_frame_info;
+    memset(&stream_frame_info, 0, sizeof(stream_frame_info));
+    stream_frame_info.camera_param.timeout_ms_delay = 100;
+    stream_frame_info.config = &config;
+    stream_frame_info.frame_ring = ring_create(&format, 0, NULL);
+    if (stream_frame_info.frame_ring == NULL)
+    {
+        return 0;
+    }
+    FrameRing_t* ring = stream_frame_info.frame_ring;
+    pool_init(1);
+    static Bus_t bus;
+    BusParam_t param;
+    memset(&param, 0, sizeof(param));
+    snprintf(param.name, sizeof(param.name), "/ircam-bench-%d", (int)getpid());
+    param.slot_num = 4;
+    param.image = 1;
+    param.temp = 1;
+    if (bus_attach(&bus, &stream_frame_info) != BUS_SUCCESS || bus_start(&bus, &param) != BUS_SUCCESS)
+    {
+        pool_release();
+        ring_destroy(ring);
+        return 0;
+    }
+    fflush(stdout);
+
+    //a reader that dies holding its frame
+    int failed = 0;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        _exit(bench_bus_child(param.name, 1));
+    }
+    int status = 0;
+    for (int i = 0; i < 2000 && waitpid(pid, &status, WNOHANG) == 0; i++)
+    {
+        bench_bus_fill(ring, plane_size);
+        usleep(1000);
+    }
+    for (int i = 0; i < 2 * BUS_RECLAIM_FRAMES; i++)
+    {
+        bench_bus_fill(ring, plane_size);
+        usleep(200);
+    }
+    BusStats_t stats;
+    bus_stats(&bus, &stats);
+    if (stats.reclaimed != 1)
+    {
+        printf("bus: %llu leases of the killed reader reclaimed, expected 1\n", (unsigned long long)stats.reclaimed);
+        failed++;
+    }
+
+    pid = fork();
+    if (pid == 0)
+    {
+        _exit(bench_bus_child(param.name, 0));
+    }
+    uint64_t num = (uint64_t)frames * BENCH_GRAPH_FRAMES;
+    uint64_t published = stats.frames;
+    uint64_t start_us = get_monotonic_us();
+    for (uint64_t i = 0; i < num; i++)
+    {
+        bench_bus_fill(ring, plane_size);
+        //readers need some cpu on a single core host
+        if ((i & 15) == 0)
+        {
+            usleep(100);
+        }
+    }
+    uint64_t elapsed_us = get_monotonic_us() - start_us;
+    usleep(20000);
+    bus_stats(&bus, &stats);
+    printf("bus: %llu of %llu ring frames published with a reader attached, %llu dropped\n", \
+        (unsigned long long)(stats.frames - published), (unsigned long long)num, (unsigned long long)stats.dropped);
+    bus_stop(&bus);
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        printf("bus: reader failed with %d (1 torn or rewritten frames, 2 no frame, 3 open)\n", \
+            WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        failed++;
+    }
+    ring_close(ring);
+    ring_wait_detached(ring, 2000);
+    pool_release();
+    ring_destroy(ring);
+    //as in bench_graph, ns/pixel is ns per ring frame
+    bench_result_add("bus", "64x64 y16+temp publish", frames, elapsed_us, 0, BENCH_GRAPH_FRAMES);
+    return failed;
+}
+#else
+static int bench_bus(int frames)
+{
+    return 0;
+}
+#endif
+
+#define BENCH_QUERY_PER_FRAME 1000      //queries per thread and frame of the temp query stage
+#define BENCH_QUERY_THREADS 2
+
+typedef struct {
+    TempQuery_t* query;
+    int num;
+    int torn;                           //answers whose values are not the frame's
+    int misses;                         //no frame although one was published before the threads started
+}BenchQueryThread_t;
+
+static void bench_query_thread(BenchQueryThread_t* thread)
+{
+    Area_t rect = { 4, 4, 8, 8 };
+    for (int i = 0; i < thread->num; i++)
+    {
+        TempQueryResult_t result;
+        int rst = (i & 1) ? temp_query_rect(thread->query, rect, &result) : \
+            temp_query_point(thread->query, i % BENCH_GRAPH_SIZE, (i / BENCH_GRAPH_SIZE) % BENCH_GRAPH_SIZE, &result);
+        if (rst != TEMP_QUERY_SUCCESS)
+        {
+            thread->misses++;
+            continue;
+        }
+        uint16_t value = (uint16_t)result.seq;
+        thread->torn += (result.info.max_temp != value || result.info.min_temp != value || \
+            result.info.avr_temp != value);
+    }
+}
+
+//ns per query of the latest frame service from two threads while the ring keeps publishing, and a stress check:
+//every frame's temp plane holds its sequence number, an answer mixing frames or from a frame given back to the
+//ring shows up as another value. returns 1 when it fails
+static int bench_temp_query(int frames)
+{
+    RingFormat_t format;
+    memset(&format, 0, sizeof(format));
+    uint32_t plane_size = BENCH_GRAPH_SIZE * BENCH_GRAPH_SIZE * 2;
+    format.camera_param.frame_size = 2 * plane_size;
+    format.image_byte_size = plane_size;
+    format.image_width = BENCH_GRAPH_SIZE;
+    format.image_height = BENCH_GRAPH_SIZE;
+    format.temp_byte_size = plane_size;
+    format.temp_width = BENCH_GRAPH_SIZE;
+    format.temp_height = BENCH_GRAPH_SIZE;
+    format.zero_copy = 1;
+    StreamFrameInfo_t stream_frame_info;
+    memset(&stream_frame_info, 0, sizeof(stream_frame_info));
+    stream_frame_info.camera_param.timeout_ms_delay = 100;
+    stream_frame_info.frame_ring = ring_create(&format, 0, NULL);
+    if (stream_frame_info.frame_ring == NULL)
+    {
+        return 0;
+    }
+    FrameRing_t* ring = stream_frame_info.frame_ring;
+    pool_init(1);
+    static TempQuery_t query;
+    if (temp_query_attach(&query, &stream_frame_info, NULL) != TEMP_QUERY_SUCCESS)
+    {
+        pool_release();
+        ring_destroy(ring);
+        return 0;
+    }
+    std::atomic<int> running(1);
+    std::thread producer([&]() {
+        while (running.load())
+        {
+            FrameSlot_t* slot = ring_write_begin(ring);
+            if (slot == NULL)
+            {
+                ring_write_drop(ring);
+                std::this_thread::yield();
+                continue;
+            }
+            uint16_t value = (uint16_t)(ring->write_seq + 1);
+            uint16_t* temp = (uint16_t*)slot->desc.temp.data;
+            for (uint32_t i = 0; i < plane_size / 2; i++)
+            {
+                temp[i] = value;
+            }
+            ring_write_commit(ring, slot, get_monotonic_us());
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+    TempQueryResult_t first;
+    for (int i = 0; i < 2000 && temp_query_point(&query, 0, 0, &first) != TEMP_QUERY_SUCCESS; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    BenchQueryThread_t threads[BENCH_QUERY_THREADS];
+    std::thread workers[BENCH_QUERY_THREADS];
+    uint64_t start_us = get_monotonic_us();
+    for (int i = 0; i < BENCH_QUERY_THREADS; i++)
+    {
+        threads[i] = { &query, frames * BENCH_QUERY_PER_FRAME, 0, 0 };
+        workers[i] = std::thread(bench_query_thread, &threads[i]);
+    }
+    int torn = 0;
+    int misses = 0;
+    for (int i = 0; i < BENCH_QUERY_THREADS; i++)
+    {
+        workers[i].join();
+        torn += threads[i].torn;
+        misses += threads[i].misses;
+    }
+    uint64_t elapsed_us = get_monotonic_us() - start_us;
+    running.store(0);
+    producer.join();
+    ring_close(ring);
+    ring_wait_detached(ring, 2000);
+    TempQueryStats_t stats;
+    temp_query_stats(&query, &stats);
+    temp_query_stop(&query);
+    int slots_held = 0;
+    for (uint32_t i = 0; i < ring->depth; i++)
+    {
+        slots_held += (ring->slots[i].state.load() != SLOT_STATE_FREE);
+    }
+    printf("temp query: %llu frames switched to, %llu while busy, of %llu ring frames\n", \
+        (unsigned long long)stats.frames, (unsigned long long)stats.busy, (unsigned long long)ring->produced);
+    int failed = 0;
+    if (torn > 0 || misses > 0 || slots_held > 0 || stats.frames == 0)
+    {
+        printf("temp query: stress check failed, %d torn answers, %d without a frame, %d slots still held\n", \
+            torn, misses, slots_held);
+        failed = 1;
+    }
+    pool_release();
+    ring_destroy(ring);
+    //frames of the report are BENCH_QUERY_PER_FRAME queries per thread, ns/pixel is ns per query of one thread
+    bench_result_add("temp_query", "point+rect 2 threads", frames, elapsed_us, 0, BENCH_QUERY_PER_FRAME);
+    return failed;
+}
+
+//stream mode switches on a synthetic ring, image only <-> image and temp, with a frame of the first layout held
+//across all of them: every frame has the planes of its layout, the first of each carries the change, the held one
+//keeps its planes. the allocations are those of the slots' buffers that did not fit
+static int bench_format_change(int frames)
+{
+    uint32_t plane_size = BENCH_GRAPH_SIZE * BENCH_GRAPH_SIZE * 2;
+    RingFormat_t formats[2];
+    memset(formats, 0, sizeof(formats));
+    for (int i = 0; i < 2; i++)
+    {
+        formats[i].image_byte_size = plane_size;
+        formats[i].image_width = BENCH_GRAPH_SIZE;
+        formats[i].image_height = BENCH_GRAPH_SIZE;
+    }
+    //IR_STREAM_IMAGE: the image plane is cut out of a raw frame of its size
+    formats[0].camera_param.frame_size = plane_size;
+    //IR_STREAM_IMAGE_AND_TEMP: both planes are views into the raw frame
+    formats[1].camera_param.frame_size = 2 * plane_size;
+    formats[1].temp_byte_size = plane_size;
+    formats[1].temp_width = BENCH_GRAPH_SIZE;
+    formats[1].temp_height = BENCH_GRAPH_SIZE;
+    formats[1].zero_copy = 1;
+    FrameRing_t* ring = ring_create(&formats[0], 0, NULL);
+    uint8_t* drain_frame = (uint8_t*)malloc(2 * plane_size);
+    if (ring == NULL || drain_frame == NULL)
+    {
+        ring_destroy(ring);
+        free(drain_frame);
+        return 0;
+    }
+    int consumer_id = ring_consumer_attach(ring, RING_POLICY_NEWEST);
+    FrameSlot_t* slot = ring_write_begin(ring);
+    memset(slot->desc.image.data, 0x5a, plane_size);
+    ring_write_commit(ring, slot, get_monotonic_us());
+    FrameSlot_t* held = NULL;
+    ring_read_acquire(ring, consumer_id, 0, &held);
+
+    int bad = 0;
+    int flagged = 0;
+    uint64_t alloc_start = bench_alloc_cnt.load();
+    uint64_t start_us = get_monotonic_us();
+    for (int n = 0; n < frames; n++)
+    {
+        //the first switch grows the raw frames, the ones after reuse them
+        const RingFormat_t* format = &formats[(n + 1) % 2];
+        if (ring_format_change(ring, format, drain_frame) != RING_SUCCESS)
+        {
+            bad++;
+            break;
+        }
+        for (uint32_t k = 0; k < ring->depth; k++)
+        {
+            slot = ring_write_begin(ring);
+            if (slot == NULL)
+            {
+                bad++;
+                continue;
+            }
+            const FrameDesc_t* desc = &slot->desc;
+            if (desc->image.byte_size != format->image_byte_size || desc->temp.byte_size != format->temp_byte_size || \
+                (desc->temp.data != NULL) != (format->temp_byte_size > 0))
+            {
+                bad++;
+            }
+            memset(desc->image.data, (int)k, plane_size);
+            if (desc->temp.data != NULL)
+            {
+                memset(desc->temp.data, (int)k, plane_size);
+            }
+            ring_write_commit(ring, slot, get_monotonic_us());
+            flagged += ((desc->flags & FRAME_DESC_FORMAT_CHANGE) != 0);
+        }
+    }
+    uint64_t elapsed_us = get_monotonic_us() - start_us;
+    uint64_t allocs = bench_alloc_cnt.load() - alloc_start;
+    int held_bad = (held == NULL || held->desc.format_gen != 0 || held->desc.temp.data != NULL);
+    for (uint32_t i = 0; !held_bad && i < plane_size; i++)
+    {
+        held_bad = (held->desc.image.data[i] != 0x5a);
+    }
+    printf("format change: %d switches over %u slots, %llu allocations, %d first frames flagged\n", frames, \
+        ring->depth, (unsigned long long)allocs, flagged);
+    int failed = 0;
+    if (bad > 0 || flagged != frames || held_bad)
+    {
+        printf("format change: check failed, %d frames of the wrong layout, %d flagged of %d, held frame %s\n", bad, \
+            flagged, frames, held_bad ? "changed" : "intact");
+        failed = 1;
+    }
+    if (held != NULL)
+    {
+        ring_read_release(ring, held);
+    }
+    int written = frames * (int)ring->depth;
+    ring_consumer_detach(ring, consumer_id);
+    ring_destroy(ring);
+    free(drain_frame);
+    bench_result_add("format_change", "image <-> image+temp", written, elapsed_us, allocs, \
+        BENCH_GRAPH_SIZE * BENCH_GRAPH_SIZE);
+    return failed;
+}
+
+typedef struct {
+    int mixed;                          //groups of frames with different frame numbers
+    uint64_t clock_error_max_us;        //|capture_us - the true capture time| once the window is full
+}BenchSync_t;
+
+static void bench_sync_group(const FrameSyncGroup_t* group, void* arg)
+{
+    BenchSync_t* bench = (BenchSync_t*)arg;
+    for (int i = 0; i < group->camera_num; i++)
+    {
+        const FrameDesc_t* desc = &group->slots[i]->desc;
+        const uint16_t* image = (const uint16_t*)desc->image.data;
+        uint32_t n = image[0] | ((uint32_t)image[1] << 16);
+        const uint16_t* first = (const uint16_t*)group->slots[0]->desc.image.data;
+        bench->mixed += (image[0] != first[0] || image[1] != first[1]);
+        if (n >= RING_CAPTURE_WINDOW)
+        {
+            uint64_t capture_us = 1000000 + (uint64_t)n * BENCH_SYNC_PERIOD_US + i * 2000;
+            uint64_t error_us = (desc->capture_us > capture_us) ? desc->capture_us - capture_us : \
+                capture_us - desc->capture_us;
+            bench->clock_error_max_us = (error_us > bench->clock_error_max_us) ? error_us : bench->clock_error_max_us;
+        }
+    }
+}
+
+//cameras with different latencies and usb jitter through the capture clock and the synchronizer: every group one
+//frame number, the clock within half the jitter of the truth and every frame grouped or counted as dropped.
+//returns 1 when it fails
+static int bench_framesync(int frames)
+{
+    RingFormat_t format;
+    memset(&format, 0, sizeof(format));
+    uint32_t plane_size = BENCH_GRAPH_SIZE * BENCH_GRAPH_SIZE * 2;
+    format.camera_param.frame_size = 2 * plane_size;
+    format.image_byte_size = plane_size;
+    format.image_width = BENCH_GRAPH_SIZE;
+    format.image_height = BENCH_GRAPH_SIZE;
+    format.temp_byte_size = plane_size;
+    format.temp_width = BENCH_GRAPH_SIZE;
+    format.temp_height = BENCH_GRAPH_SIZE;
+    format.zero_copy = 1;
+    static StreamFrameInfo_t stream_frame_infos[BENCH_SYNC_CAMERAS];
+    static FrameSync_t sync;
+    frame_sync_init(&sync);
+    int cameras = 0;
+    for (; cameras < BENCH_SYNC_CAMERAS; cameras++)
+    {
+        memset(&stream_frame_infos[cameras], 0, sizeof(StreamFrameInfo_t));
+        stream_frame_infos[cameras].frame_ring = ring_create(&format, 8, NULL);
+        if (stream_frame_infos[cameras].frame_ring == NULL || \
+            frame_sync_attach(&sync, &stream_frame_infos[cameras]) != cameras)
+        {
+            break;
+        }
+        ring_capture_clock_set(stream_frame_infos[cameras].frame_ring, BENCH_SYNC_PERIOD_US, 3000 + cameras * 6000);
+    }
+    BenchSync_t bench = { 0 };
+    FrameSyncParam_t param = { 10000, 2, bench_sync_group, &bench };
+    int failed = 0;
+    uint64_t num = (uint64_t)frames * BENCH_GRAPH_FRAMES;
+    uint64_t elapsed_us = 0;
+    if (cameras == BENCH_SYNC_CAMERAS && frame_sync_start(&sync, &param) == FRAME_SYNC_SUCCESS)
+    {
+        uint32_t random = 12345;
+        uint64_t start_us = get_monotonic_us();
+        for (uint64_t n = 0; n < num; n++)
+        {
+            for (int i = 0; i < BENCH_SYNC_CAMERAS; i++)
+            {
+                FrameRing_t* ring = stream_frame_infos[i].frame_ring;
+                FrameSlot_t* slot = ring_write_begin(ring);
+                random = random * 1103515245 + 12345;
+                if (slot == NULL)
+                {
+                    ring_write_drop(ring);
+                    continue;
+                }
+                uint16_t* image = (uint16_t*)slot->desc.image.data;
+                image[0] = (uint16_t)n;
+                image[1] = (uint16_t)(n >> 16);
+                uint64_t arrival_us = 1000000 + n * BENCH_SYNC_PERIOD_US + i * 2000 + 3000 + i * 6000 + \
+                    (random >> 8) % BENCH_SYNC_JITTER_US;
+                ring_write_commit(ring, slot, arrival_us);
+            }
+            //the synchronizer takes each set before the next, as it would at the camera rate
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        elapsed_us = get_monotonic_us() - start_us;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        frame_sync_stop(&sync);
+        FrameSyncStats_t stats;
+        frame_sync_stats(&sync, &stats);
+        uint64_t lost = 0;
+        for (int i = 0; i < BENCH_SYNC_CAMERAS; i++)
+        {
+            //at most a full queue is still held when it stops
+            uint64_t counted = stats.groups + stats.unmatched[i] + stats.overflow[i];
+            lost += (stats.frames[i] > counted + param.queue_depth || stats.frames[i] < counted);
+        }
+        printf("framesync: %llu groups of %llu frames, skew p99 %lluus (%lluus on arrival), clock error %lluus\n", \
+            (unsigned long long)stats.groups, (unsigned long long)num, (unsigned long long)stats.skew.p99_us, \
+            (unsigned long long)stats.arrival_skew.p99_us, (unsigned long long)bench.clock_error_max_us);
+        if (bench.mixed > 0 || lost > 0 || stats.groups == 0 || stats.skew.max_us > param.tolerance_us || \
+            bench.clock_error_max_us > BENCH_SYNC_JITTER_US / 2)
+        {
+            printf("framesync: stress check failed, %d mixed groups, %llu cameras with frames unaccounted\n", \
+                bench.mixed, (unsigned long long)lost);
+            failed++;
+        }
+    }
+    for (int i = 0; i < cameras; i++)
+    {
+        ring_close(stream_frame_infos[i].frame_ring);
+        ring_destroy(stream_frame_infos[i].frame_ring);
+    }
+    if (cameras < BENCH_SYNC_CAMERAS && stream_frame_infos[cameras].frame_ring != NULL)
+    {
+        ring_destroy(stream_frame_infos[cameras].frame_ring);
+    }
+    //ns/pixel is ns per ring frame set
+    bench_result_add("framesync", "3 camera groups", frames, elapsed_us, 0, BENCH_GRAPH_FRAMES);
+    return failed;
+}
+
+//ns per message of the hand-off, with a stress check of every run: order per producer, count and sum.
+//returns the runs that failed it
+static int bench_queue(int frames)
+{
+    const int kinds[] = { BENCH_QUEUE_SEM, BENCH_QUEUE_SPSC, BENCH_QUEUE_MPMC, BENCH_QUEUE_MPMC, BENCH_QUEUE_MPMC };
+    const int thread_nums[] = { 1, 1, 1, 2, 4 };
+    const char* names[] = { "sem pair 1p1c", "spsc 1p1c", "mpmc 1p1c", "mpmc 2p2c", "mpmc 4p4c" };
+    uint64_t num = (uint64_t)frames * BENCH_QUEUE_MESSAGES;
+    int failed = 0;
+    for (int config = 0; config < 5; config++)
+    {
+        static SpscQueue_t spsc;
+        static MpmcQueue_t mpmc;
+        BenchSem_t ready = { SYNC_MUTEX_INITIALIZER, SYNC_COND_INITIALIZER, 0 };
+        BenchSem_t done = { SYNC_MUTEX_INITIALIZER, SYNC_COND_INITIALIZER, 1 };
+        uint64_t slot = 0;
+        std::atomic<uint64_t> consumed(0);
+        int kind = kinds[config];
+        int thread_num = thread_nums[config];
+        if ((kind == BENCH_QUEUE_SPSC && spsc_queue_init(&spsc, BENCH_QUEUE_CAPACITY, sizeof(uint64_t)) != 0) || \
+            (kind == BENCH_QUEUE_MPMC && mpmc_queue_init(&mpmc, BENCH_QUEUE_CAPACITY, sizeof(uint64_t)) != 0))
+        {
+            continue;
+        }
+        BenchQueueThread_t threads[2 * BENCH_QUEUE_MAX_THREADS];
+        pthread_t tids[2 * BENCH_QUEUE_MAX_THREADS];
+        memset(threads, 0, sizeof(threads));
+        uint64_t per_producer = num / thread_num;
+        uint64_t expected_sum = 0;
+        for (int i = 0; i < 2 * thread_num; i++)
+        {
+            BenchQueueThread_t* thread = &threads[i];
+            thread->kind = kind;
+            thread->spsc = &spsc;
+            thread->mpmc = &mpmc;
+            thread->ready = &ready;
+            thread->done = &done;
+            thread->slot = &slot;
+            thread->id = (i < thread_num) ? i : i - thread_num;
+            thread->producer_num = thread_num;
+            thread->num = (i < thread_num) ? per_producer : ((kind == BENCH_QUEUE_MPMC) ? per_producer * thread_num : \
+                per_producer);
+            thread->consumed = &consumed;
+            if (i < thread_num)
+            {
+                expected_sum += ((uint64_t)i << 56) * per_producer + per_producer * (per_producer - 1) / 2;
+            }
+        }
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int i = 0; i < 2 * thread_num; i++)
+        {
+            pthread_create(&tids[i], NULL, (i < thread_num) ? bench_queue_producer : bench_queue_consumer, &threads[i]);
+        }
+        for (int i = 0; i < 2 * thread_num; i++)
+        {
+            pthread_join(tids[i], NULL);
+        }
+        uint64_t elapsed_us = get_monotonic_us() - start_us;
+        uint64_t sum = 0;
+        uint64_t received = 0;
+        int errors = 0;
+        for (int i = thread_num; i < 2 * thread_num; i++)
+        {
+            sum += threads[i].sum;
+            received += threads[i].received;
+            errors += threads[i].errors;
+        }
+        if (errors > 0 || received != per_producer * thread_num || sum != expected_sum)
+        {
+            printf("queue %s: stress check failed, %llu of %llu received, %d out of order, sum %s\n", names[config], \
+                (unsigned long long)received, (unsigned long long)(per_producer * thread_num), errors, \
+                (sum == expected_sum) ? "ok" : "differs");
+            failed++;
+        }
+        //frames of the report are messages / BENCH_QUEUE_MESSAGES, so ns/pixel is ns per message
+        bench_result_add("queue", names[config], frames, elapsed_us, bench_alloc_cnt.load() - alloc_start, \
+            BENCH_QUEUE_MESSAGES);
+        if (kind == BENCH_QUEUE_SPSC)
+        {
+            spsc_queue_release(&spsc);
+        }
+        else if (kind == BENCH_QUEUE_MPMC)
+        {
+            mpmc_queue_release(&mpmc);
+        }
+    }
+    return failed;
+}
+
+//PSNR (peak 16383) of out against the clean frame, over the whole frame and over the pixels the disc moved across
+static void bench_nr_error(const uint16_t* out, const uint16_t* clean, const uint16_t* prev_clean, int pix_num, \
+    double* sse, uint64_t* cnt, double* motion_sse, uint64_t* motion_cnt)
+{
+    for (int i = 0; i < pix_num; i++)
+    {
+        double e = (double)out[i] - clean[i];
+        *sse += e * e;
+        if (clean[i] != prev_clean[i])
+        {
+            *motion_sse += e * e;
+            (*motion_cnt)++;
+        }
+    }
+    *cnt += pix_num;
+}
+
+static double bench_psnr(double sse, uint64_t cnt)
+{
+    if (cnt == 0 || sse <= 0.0)
+    {
+        return 99.0;
+    }
+    return 10.0 * log10(16383.0 * 16383.0 * cnt / sse);
+}
+
+//synthetic y14 sequence: gradient with a hot disc moving 2 pixels a frame, gaussian like noise from a fixed seed
+//none / libirprocess spatial / temporal recursive / moving average, cost and PSNR after an 8 frame warm up
+static void bench_nr(BenchInput_t* input, int frames)
+{
+    int width = input->width;
+    int height = input->height;
+    int pix_num = width * height;
+    uint16_t* clean = (uint16_t*)malloc((size_t)pix_num * BENCH_NR_FRAMES * sizeof(uint16_t));
+    uint16_t* noisy = (uint16_t*)malloc((size_t)pix_num * BENCH_NR_FRAMES * sizeof(uint16_t));
+    uint16_t* out = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    Tnr_t tnr;
+    AccumWindow_t accum_window;
+    accum_window_init(&accum_window, 8);
+    if (clean == NULL || noisy == NULL || out == NULL || tnr_init(&tnr, NULL) != TNR_SUCCESS)
+    {
+        free(clean);
+        free(noisy);
+        free(out);
+        return;
+    }
+    uint32_t seed = 12345;
+    int radius = height / 8;
+    for (int n = 0; n < BENCH_NR_FRAMES; n++)
+    {
+        int cx = radius + (n * 2) % (width - 2 * radius);
+        int cy = height / 2;
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                int i = n * pix_num + y * width + x;
+                int v = 4000 + x * 8 + y * 4;
+                if ((x - cx) * (x - cx) + (y - cy) * (y - cy) <= radius * radius)
+                {
+                    v += 2000;
+                }
+                //sum of 4 uniforms in [-32, 32), sigma about 16
+                int noise = 0;
+                for (int k = 0; k < 4; k++)
+                {
+                    seed = seed * 1103515245 + 12345;
+                    noise += (int)((seed >> 16) & 63) - 32;
+                }
+                clean[i] = (uint16_t)v;
+                v += noise * BENCH_NR_SIGMA / 18;
+                noisy[i] = (uint16_t)((v < 0) ? 0 : ((v > 16383) ? 16383 : v));
+            }
+        }
+    }
+
+    ImageRes_t image_res = { (uint16_t)width, (uint16_t)height };
+    const char* names[] = { "none", "spatial lib", "temporal", "average" };
+    for (int config = 0; config < 4; config++)
+    {
+        //quality pass over the sequence once, then the timed pass
+        double sse = 0.0, motion_sse = 0.0;
+        uint64_t cnt = 0, motion_cnt = 0;
+        for (int pass = 0; pass < 2; pass++)
+        {
+            int num = (pass == 0) ? BENCH_NR_FRAMES : frames;
+            tnr_reset(&tnr);
+            accum_window_reset(&accum_window);
+            uint64_t alloc_start = bench_alloc_cnt.load();
+            uint64_t start_us = get_monotonic_us();
+            for (int n = 0; n < num; n++)
+            {
+                uint16_t* src = noisy + (size_t)(n % BENCH_NR_FRAMES) * pix_num;
+                if (config == 0)
+                {
+                    memcpy(out, src, pix_num * sizeof(uint16_t));
+                }
+                else if (config == 1)
+                {
+                    y14_image_spatial_noise_reduction(src, image_res, out);
+                }
+                else if (config == 2)
+                {
+                    tnr_process(&tnr, src, pix_num, 0, out);
+                }
+                else
+                {
+                    accum_window_process(&accum_window, src, pix_num, out);
+                }
+                if (pass == 0 && n >= 8)
+                {
+                    bench_nr_error(out, clean + (size_t)n * pix_num, clean + (size_t)(n - 1) * pix_num, pix_num, \
+                        &sse, &cnt, &motion_sse, &motion_cnt);
+                }
+            }
+            if (pass == 1)
+            {
+                char config_name[64];
+                snprintf(config_name, sizeof(config_name), "y14 %s psnr=%.1fdB motion=%.1fdB", names[config], \
+                    bench_psnr(sse, cnt), bench_psnr(motion_sse, motion_cnt));
+                bench_result_add("nr", config_name, num, get_monotonic_us() - start_us, \
+                    bench_alloc_cnt.load() - alloc_start, pix_num);
+            }
+        }
+    }
+    tnr_release(&tnr);
+    accum_window_release(&accum_window);
+    free(clean);
+    free(noisy);
+    free(out);
+}
+
+//image and temp plane of every frame through the recorder's plane codec, keyframes as often as it starts chunks
+static void bench_codec(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    uint32_t bound = codec_bound(pix_num);
+    uint8_t* coded = (uint8_t*)malloc((size_t)bound * 2 * frames);
+    uint32_t* coded_size = (uint32_t*)malloc(sizeof(uint32_t) * 2 * frames);
+    uint16_t* decoded = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    CodecContext_t contexts[2];
+    if (coded == NULL || coded_size == NULL || decoded == NULL || \
+        codec_init(&contexts[0], input->width, input->height, RECORD_DEFAULT_CHUNK_FRAMES) != CODEC_SUCCESS || \
+        codec_init(&contexts[1], input->width, input->height, RECORD_DEFAULT_CHUNK_FRAMES) != CODEC_SUCCESS)
+    {
+        free(coded);
+        free(coded_size);
+        free(decoded);
+        return;
+    }
+
+    uint64_t stored = 0;
+    uint64_t alloc_start = bench_alloc_cnt.load();
+    uint64_t start_us = get_monotonic_us();
+    for (int n = 0; n < frames; n++)
+    {
+        uint16_t* image = (uint16_t*)bench_raw_frame(input, n);
+        for (int p = 0; p < 2; p++)
+        {
+            int size = codec_encode(&contexts[p], image + p * pix_num, coded + (size_t)bound * (2 * n + p), bound, 0);
+            coded_size[2 * n + p] = (size > 0) ? (uint32_t)size : 0;
+            stored += coded_size[2 * n + p];
+        }
+    }
+    uint64_t encode_us = get_monotonic_us() - start_us;
+    char config[64];
+    snprintf(config, sizeof(config), "delta image+temp encode ratio=%.2f", \
+        (stored > 0) ? (double)pix_num * 4 * frames / stored : 0.0);
+    bench_result_add("codec", config, frames, encode_us, bench_alloc_cnt.load() - alloc_start, pix_num * 2);
+
+    int mismatch = 0;
+    codec_reset(&contexts[0]);
+    codec_reset(&contexts[1]);
+    alloc_start = bench_alloc_cnt.load();
+    start_us = get_monotonic_us();
+    for (int n = 0; n < frames; n++)
+    {
+        uint16_t* image = (uint16_t*)bench_raw_frame(input, n);
+        for (int p = 0; p < 2; p++)
+        {
+            if (codec_decode(&contexts[p], coded + (size_t)bound * (2 * n + p), coded_size[2 * n + p], decoded) != \
+                CODEC_SUCCESS || memcmp(decoded, image + p * pix_num, pix_num * sizeof(uint16_t)) != 0)
+            {
+                mismatch++;
+            }
+        }
+    }
+    uint64_t decode_us = get_monotonic_us() - start_us;
+    snprintf(config, sizeof(config), "delta image+temp decode%s", (mismatch > 0) ? " MISMATCH" : "");
+    bench_result_add("codec", config, frames, decode_us, bench_alloc_cnt.load() - alloc_start, pix_num * 2);
+
+    codec_release(&contexts[0]);
+    codec_release(&contexts[1]);
+    free(coded);
+    free(coded_size);
+    free(decoded);
+}
+
+//the radiometric track's coding of a static scene: the first temp plane with noise of about the sensor's NETD
+//(40 mK, 2.5 raw units) on every frame, keyframes at the stream's default interval, lossless and with a deadband.
+//the bitrate counts the record headers, every decoded pixel has to be within the deadband of its input and the
+//deadband kernel has to match the scalar one
+static int bench_radiometric(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    uint32_t bound = codec_bound(pix_num);
+    uint16_t* noisy = (uint16_t*)malloc((size_t)pix_num * BENCH_NR_FRAMES * sizeof(uint16_t));
+    uint16_t* decoded = (uint16_t*)malloc((size_t)pix_num * 4 * sizeof(uint16_t));
+    uint8_t* coded = (uint8_t*)malloc(bound);
+    if (noisy == NULL || decoded == NULL || coded == NULL)
+    {
+        free(noisy);
+        free(decoded);
+        free(coded);
+        return 0;
+    }
+    const uint16_t* temp = (const uint16_t*)(bench_raw_frame(input, 0) + pix_num * 2);
+    uint32_t seed = 12345;
+    for (int i = 0; i < pix_num * BENCH_NR_FRAMES; i++)
+    {
+        int noise = 0;
+        for (int k = 0; k < 2; k++)
+        {
+            seed = seed * 1103515245 + 12345;
+            noise += (int)((seed >> 16) % 6) - 3;
+        }
+        int v = temp[i % pix_num] + noise;
+        noisy[i] = (uint16_t)((v < 0) ? 0 : ((v > 65535) ? 65535 : v));
+    }
+
+    int failed = 0;
+    uint16_t* ref = decoded + pix_num;
+    uint16_t* check = decoded + pix_num * 2;
+    uint16_t* check_ref = decoded + pix_num * 3;
+    SimdLevel_t level = simd_level_get();
+    for (int config = 0; config < 2; config++)
+    {
+        simd_level_set((config == 1) ? SIMD_LEVEL_SCALAR : level);
+        memcpy((config == 1) ? check_ref : ref, noisy, pix_num * sizeof(uint16_t));
+        //an odd count, the vector loops leave a tail
+        simd_delta_zigzag_deadband_u16(noisy + pix_num, (config == 1) ? check_ref : ref, pix_num - 3, \
+            BENCH_RADIOMETRIC_DEADBAND, (config == 1) ? check : decoded);
+    }
+    simd_level_set(level);
+    if (memcmp(decoded, check, (pix_num - 3) * sizeof(uint16_t)) != 0 || \
+        memcmp(ref, check_ref, pix_num * sizeof(uint16_t)) != 0)
+    {
+        printf("bench: deadband delta differs from scalar\n");
+        failed++;
+    }
+
+    const uint16_t deadbands[] = { 0, BENCH_RADIOMETRIC_DEADBAND };
+    for (int config = 0; config < 2; config++)
+    {
+        CodecContext_t encoder, decoder;
+        if (codec_init(&encoder, input->width, input->height, STREAM_RADIOMETRIC_DEFAULT_KEY_INTERVAL) != CODEC_SUCCESS)
+        {
+            break;
+        }
+        if (codec_init(&decoder, input->width, input->height, 0) != CODEC_SUCCESS)
+        {
+            codec_release(&encoder);
+            break;
+        }
+        encoder.deadband = deadbands[config];
+        uint64_t stored = 0;
+        int max_error = 0, mismatch = 0;
+        uint64_t coding_us = 0;
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        for (int n = 0; n < frames; n++)
+        {
+            const uint16_t* frame = noisy + (size_t)(n % BENCH_NR_FRAMES) * pix_num;
+            uint64_t start_us = get_monotonic_us();
+            int size = codec_encode(&encoder, frame, coded, bound, 0);
+            coding_us += get_monotonic_us() - start_us;
+            if (size <= 0 || codec_decode(&decoder, coded, (uint32_t)size, decoded) != CODEC_SUCCESS)
+            {
+                mismatch++;
+                continue;
+            }
+            stored += size + sizeof(StreamRadiometricHeader_t);
+            for (int i = 0; i < pix_num; i++)
+            {
+                int error = abs((int)decoded[i] - (int)frame[i]);
+                max_error = (error > max_error) ? error : max_error;
+            }
+        }
+        if (mismatch > 0 || max_error > deadbands[config])
+        {
+            printf("bench: radiometric deadband %u decodes %d frames wrong, error up to %d\n", deadbands[config], \
+                mismatch, max_error);
+            failed++;
+        }
+        char config_name[64];
+        snprintf(config_name, sizeof(config_name), "static deadband=%u %.0fkbit/s@%dfps err=%d", deadbands[config], \
+            (double)stored * 8 * BENCH_RADIOMETRIC_FPS / frames / 1000, BENCH_RADIOMETRIC_FPS, max_error);
+        bench_result_add("radiometric", config_name, frames, coding_us, bench_alloc_cnt.load() - alloc_start, pix_num);
+        codec_release(&encoder);
+        codec_release(&decoder);
+    }
+    free(noisy);
+    free(decoded);
+    free(coded);
+    return failed;
+}
+
+//the web dashboard's jpeg of a Y14 frame: colored into packed 4:4:4 and encoded, against colored straight into the
+//4:2:0 planes and encoded with half the blocks (through libjpeg with JPEG_TURBO)
+static void bench_jpeg(BenchInput_t* input, int frames)
+{
+    uint32_t width = (uint32_t)input->width, height = (uint32_t)input->height;
+    uint32_t bound = jpeg_bound(width, height, 0);
+    uint8_t* ycc = (uint8_t*)malloc((size_t)width * height * 3);
+    uint8_t* yuv_data = (uint8_t*)malloc(jpeg_yuv420_size(width, height));
+    uint8_t* rows = (uint8_t*)malloc((size_t)(width + 15) * 6);
+    uint8_t* file = (uint8_t*)malloc(bound);
+    JpegEncoder_t enc;
+    if (ycc == NULL || yuv_data == NULL || rows == NULL || file == NULL || jpeg_init(&enc, 75) != JPEG_SUCCESS)
+    {
+        free(ycc);
+        free(yuv_data);
+        free(rows);
+        free(file);
+        return;
+    }
+    FrameDesc_t desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.image.data = (uint8_t*)input->y14_frame;
+    desc.image.width = width;
+    desc.image.height = height;
+    desc.image.stride = width * 2;
+#if defined(JPEG_TURBO)
+    const char* names[] = { "4:4:4 q75", "4:2:0 q75 libjpeg" };
+#else
+    const char* names[] = { "4:4:4 q75", "4:2:0 q75" };
+#endif
+    for (int config = 0; config < 2; config++)
+    {
+        uint64_t bytes = 0;
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            int size = -1;
+            if (config == 0)
+            {
+                uint32_t w = 0, h = 0;
+                if (snapshot_color_frame(palette_active(), &desc, INPUT_FMT_Y14, ycc, &w, &h) >= 0)
+                {
+                    size = jpeg_encode(&enc, ycc, w, h, NULL, 0, file, bound);
+                }
+            }
+            else
+            {
+                JpegYuv420_t yuv;
+                if (snapshot_color_frame_yuv420(palette_active(), &desc, INPUT_FMT_Y14, NULL, NULL, yuv_data, rows, \
+                    &yuv) >= 0)
+                {
+                    size = jpeg_encode_yuv420(&enc, &yuv, NULL, 0, file, bound);
+                }
+            }
+            bytes += (size > 0) ? (uint64_t)size : 0;
+        }
+        char config_name[64];
+        snprintf(config_name, sizeof(config_name), "%s %llu bytes", names[config], \
+            (unsigned long long)(bytes / (frames > 0 ? frames : 1)));
+        bench_result_add("jpeg", config_name, frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, (int)(width * height));
+    }
+    free(ycc);
+    free(yuv_data);
+    free(rows);
+    free(file);
+}
+
+//encoder input: the image plane straight into NV12, pseudo color through the lut's yuv, gray through the
+//library and the one pass simd converter (NV12, and YUYV as the display's yuv422 output)
+static void bench_nv12(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    uint8_t* nv12 = (uint8_t*)malloc((size_t)pix_num * 2);
+    static ColorizePlan_t plan;
+    if (nv12 == NULL)
+    {
+        return;
+    }
+    const ImgEnhance_t enhances[] = { IMG_ENHANCE_ON, IMG_ENHANCE_OFF };
+    for (int e = 0; e < (int)(sizeof(enhances) / sizeof(enhances[0])); e++)
+    {
+        FrameInfo_t frame_info = { 0 };
+        frame_info.width = input->width;
+        frame_info.height = input->height;
+        frame_info.input_format = INPUT_FMT_Y16;
+        frame_info.pseudo_color_status = PSEUDO_COLOR_ON;
+        frame_info.img_enhance_status = enhances[e];
+        char config[64];
+        snprintf(config, sizeof(config), "pseudo color enhance=%s", enhance_names[enhances[e]]);
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            uint16_t* image = (uint16_t*)bench_raw_frame(input, n);
+            if (colorize_plan_prepare(&plan, image, pix_num, &frame_info, IRPROC_COLOR_MODE_6, NULL) == \
+                COLORIZE_SUCCESS)
+            {
+                colorize_plan_apply_nv12(&plan, image, input->width, input->width & ~1, input->height & ~1, \
+                    0, input->height & ~1, nv12);
+            }
+        }
+        bench_result_add("nv12", config, frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+
+    uint64_t alloc_start = bench_alloc_cnt.load();
+    uint64_t start_us = get_monotonic_us();
+    for (int n = 0; n < frames; n++)
+    {
+        y16_to_nv12((uint16_t*)bench_raw_frame(input, n), pix_num, nv12);
+    }
+    bench_result_add("nv12", "gray y16_to_nv12", frames, get_monotonic_us() - start_us, \
+        bench_alloc_cnt.load() - alloc_start, pix_num);
+
+    static const SimdYuvLayout_t layouts[] = { SIMD_YUV_NV12, SIMD_YUV_YUYV };
+    static const char* layout_names[] = { "nv12", "yuyv" };
+    for (int l = 0; l < 2; l++)
+    {
+        char config[64];
+        snprintf(config, sizeof(config), "gray simd y16 -> %s", layout_names[l]);
+        alloc_start = bench_alloc_cnt.load();
+        start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            simd_gray_to_yuv((uint16_t*)bench_raw_frame(input, n), pix_num, 16, layouts[l], nv12);
+        }
+        bench_result_add("nv12", config, frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+    free(nv12);
+}
+
+//Y14 upscale alone and with the fused colorize at the output size, ns/pixel is per output pixel
+static void bench_upscale(BenchInput_t* input, int frames)
+{
+    FrameInfo_t frame_info = { 0 };
+    frame_info.width = input->width;
+    frame_info.height = input->height;
+    frame_info.input_format = INPUT_FMT_Y16;
+    frame_info.output_format = OUTPUT_FMT_BGR888;
+    frame_info.pseudo_color_status = PSEUDO_COLOR_ON;
+    frame_info.img_enhance_status = IMG_ENHANCE_ON;
+    int pix_num = input->width * input->height;
+    uint16_t* dst = (uint16_t*)malloc((size_t)pix_num * UPSCALE_FACTOR_MAX * UPSCALE_FACTOR_MAX * sizeof(uint16_t));
+    if (dst == NULL)
+    {
+        return;
+    }
+    for (int mode = 0; mode < UPSCALE_MODE_NUM; mode++)
+    {
+        for (int factor = 2; factor <= UPSCALE_FACTOR_MAX; factor++)
+        {
+            Upscale_t upscale;
+            upscale_init(&upscale, factor, (UpscaleMode_t)mode);
+            char config[64];
+            snprintf(config, sizeof(config), "x%d %s", factor, upscale_mode_name((UpscaleMode_t)mode));
+            uint64_t alloc_start = bench_alloc_cnt.load();
+            uint64_t start_us = get_monotonic_us();
+            for (int n = 0; n < frames; n++)
+            {
+                upscale_process(&upscale, (uint16_t*)bench_raw_frame(input, n), input->width, input->height, 2, dst);
+            }
+            bench_result_add("upscale", config, frames, get_monotonic_us() - start_us, \
+                bench_alloc_cnt.load() - alloc_start, pix_num * factor * factor);
+            upscale_release(&upscale);
+
+            display_upscale_factor = (uint8_t)factor;
+            display_upscale_mode = (uint8_t)mode;
+            uint8_t* frame_out = NULL;
+            arena_reset(get_display_arena());
+            display_image_process_upscale(bench_raw_frame(input, 0), &frame_info, NULL, &frame_out);
+            snprintf(config, sizeof(config), "x%d %s + fused bgr", factor, upscale_mode_name((UpscaleMode_t)mode));
+            alloc_start = bench_alloc_cnt.load();
+            start_us = get_monotonic_us();
+            for (int n = 0; n < frames; n++)
+            {
+                arena_reset(get_display_arena());
+                display_image_process_upscale(bench_raw_frame(input, n), &frame_info, NULL, &frame_out);
+            }
+            bench_result_add("upscale", config, frames, get_monotonic_us() - start_us, \
+                bench_alloc_cnt.load() - alloc_start, pix_num * factor * factor);
+        }
+    }
+    display_upscale_factor = 1;
+    free(dst);
+}
+
+//the thermal frame as gray bgr registered onto a synthetic 640x480 visible frame through a mild keystone,
+//so no row maps to a contiguous run of thermal pixels
+static void bench_fusion(BenchInput_t* input, int frames)
+{
+    const int visible_width = 640, visible_height = 480;
+    int pix_num = input->width * input->height;
+    uint8_t* thermal = (uint8_t*)malloc((size_t)pix_num * 3);
+    uint8_t* visible = (uint8_t*)malloc((size_t)visible_width * visible_height);
+    uint8_t* dst = (uint8_t*)malloc((size_t)visible_width * visible_height * 3);
+    if (thermal == NULL || visible == NULL || dst == NULL)
+    {
+        free(thermal);
+        free(visible);
+        free(dst);
+        return;
+    }
+    for (int i = 0; i < pix_num; i++)
+    {
+        thermal[3 * i] = thermal[3 * i + 1] = thermal[3 * i + 2] = (uint8_t)(input->y14_frame[i] >> 6);
+    }
+    uint32_t seed = 12345;
+    for (int i = 0; i < visible_width * visible_height; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        visible[i] = (uint8_t)(((i % visible_width) >> 2) + ((seed >> 16) & 31));
+    }
+    FusionParam_t param;
+    memset(&param, 0, sizeof(param));
+    param.thermal_width = input->width;
+    param.thermal_height = input->height;
+    param.visible_width = visible_width;
+    param.visible_height = visible_height;
+    const float corners_visible[8] = { 20, 10, 620, 30, 600, 470, 30, 450 };
+    const float corners_thermal[8] = { 0, 0, (float)(input->width - 1), 0, (float)(input->width - 1), \
+        (float)(input->height - 1), 0, (float)(input->height - 1) };
+    fusion_homography(corners_visible, corners_thermal, param.homography);
+    Fusion_t fusion;
+    if (fusion_init(&fusion, &param) != FUSION_SUCCESS)
+    {
+        free(thermal);
+        free(visible);
+        free(dst);
+        return;
+    }
+    SimdLevel_t level = simd_level_get();
+    const char* names[] = { "640x480 remap", "640x480 remap + edges", "640x480 remap + edges scalar" };
+    for (int config = 0; config < 3; config++)
+    {
+        fusion_strength_set(&fusion, (config == 0) ? 0 : 24);
+        simd_level_set((config == 2) ? SIMD_LEVEL_SCALAR : level);
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            fusion_process(&fusion, thermal, visible, visible_width, dst, 1);
+        }
+        bench_result_add("fusion", names[config], frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, visible_width * visible_height);
+    }
+    simd_level_set(level);
+    fusion_release(&fusion);
+    free(thermal);
+    free(visible);
+    free(dst);
+}
+
+//4 cameras of the input size side by side, 16 pixels of overlap between neighbours
+static void bench_mosaic(BenchInput_t* input, int frames)
+{
+    const int camera_num = 4, overlap = 16;
+    if (input->width <= overlap || input->height < 2)
+    {
+        return;
+    }
+    MosaicParam_t param;
+    memset(&param, 0, sizeof(param));
+    param.width = camera_num * (input->width - overlap) + overlap;
+    param.height = input->height;
+    param.camera_num = camera_num;
+    param.feather = 8.0f;
+    FramePlane_t planes[MOSAIC_MAX_CAMERAS];
+    for (int c = 0; c < camera_num; c++)
+    {
+        MosaicCameraParam_t* camera = &param.cameras[c];
+        camera->width = input->width;
+        camera->height = input->height;
+        camera->homography[0] = 1.0;
+        camera->homography[2] = -(double)(c * (input->width - overlap));
+        camera->homography[4] = 1.0;
+        camera->homography[8] = 1.0;
+        planes[c].data = input->temp_frame;
+        planes[c].width = input->width;
+        planes[c].height = input->height;
+        planes[c].stride = input->width * 2;
+        planes[c].byte_size = input->width * input->height * 2;
+    }
+    int pix_num = param.width * param.height;
+    uint16_t* temp = (uint16_t*)malloc((size_t)pix_num * sizeof(uint16_t));
+    uint8_t* bgr = (uint8_t*)malloc((size_t)pix_num * 3);
+    Mosaic_t mosaic;
+    if (temp == NULL || bgr == NULL || mosaic_init(&mosaic, &param) != MOSAIC_SUCCESS)
+    {
+        free(temp);
+        free(bgr);
+        return;
+    }
+    SimdLevel_t level = simd_level_get();
+    const char* names[] = { "4 cameras temp", "4 cameras temp + color", "4 cameras temp + color scalar", \
+        "4 cameras temp + locked span 20-120C" };
+    TempSpanParam_t span_param = { 20.0f, 120.0f, 0, NULL };
+    for (int config = 0; config < 4; config++)
+    {
+        simd_level_set((config == 2) ? SIMD_LEVEL_SCALAR : level);
+        if (config == 3 && temp_span_lock(&span_param) != TEMP_SPAN_SUCCESS)
+        {
+            break;
+        }
+        uint64_t alloc_start = bench_alloc_cnt.load();
+        uint64_t start_us = get_monotonic_us();
+        for (int n = 0; n < frames; n++)
+        {
+            mosaic_compose(&mosaic, planes, temp, (config == 0) ? NULL : bgr, palette_active(), 1);
+        }
+        bench_result_add("mosaic", names[config], frames, get_monotonic_us() - start_us, \
+            bench_alloc_cnt.load() - alloc_start, pix_num);
+    }
+    temp_span_lock(NULL);
+    simd_level_set(level);
+    mosaic_release(&mosaic);
+    free(temp);
+    free(bgr);
+}
+
+//display_one_frame into the null sink: the whole display chain with the overlay and the command channel,
+//nothing waits for a window, so fps is the processing cost alone
+static void bench_display(BenchInput_t* input, int frames)
+{
+    int pix_num = input->width * input->height;
+    StreamFrameInfo_t frame_info = { 0 };
+    frame_info.image_info.width = input->width;
+    frame_info.image_info.height = input->height;
+    frame_info.image_info.input_format = INPUT_FMT_Y16;
+    frame_info.image_info.output_format = OUTPUT_FMT_BGR888;
+    frame_info.image_info.pseudo_color_status = PSEUDO_COLOR_ON;
+    frame_info.temp_info.width = input->width;
+    frame_info.temp_info.height = input->height;
+    frame_info.temp_byte_size = pix_num * 2;
+    uint32_t fw_interval = fw_temp_check_interval;
+    fw_temp_check_interval = 0;
+    static const ImgEnhance_t enhance[] = { IMG_ENHANCE_ON, IMG_ENHANCE_HIST_AGC };
+    for (int factor = 1; factor <= 2; factor++)
+    {
+        for (int e = 0; e < 2; e++)
+        {
+            display_upscale_factor = (uint8_t)factor;
+            StreamFrameInfo_t info = frame_info;
+            info.image_info.img_enhance_status = enhance[e];
+            //the first frames size the scratch and the overlay sprites
+            for (int n = 0; n < ARENA_WARMUP_FRAMES + 1; n++)
+            {
+                info.image_frame = bench_raw_frame(input, n);
+                info.temp_frame = bench_raw_frame(input, n) + pix_num * 2;
+                display_one_frame(&info);
+            }
+            char config[64];
+            snprintf(config, sizeof(config), "null sink x%d %s", factor, enhance_name(enhance[e]));
+            uint64_t alloc_start = bench_alloc_cnt.load();
+            uint64_t start_us = get_monotonic_us();
+            for (int n = 0; n < frames; n++)
+            {
+                info.image_frame = bench_raw_frame(input, n);
+                info.temp_frame = bench_raw_frame(input, n) + pix_num * 2;
+                display_one_frame(&info);
+            }
+            bench_result_add("display", config, frames, get_monotonic_us() - start_us, \
+                bench_alloc_cnt.load() - alloc_start, pix_num);
+        }
+    }
+    display_upscale_factor = 1;
+    fw_temp_check_interval = fw_interval;
+}
+
+//64 bit fnv-1a of an output frame, what the golden file keeps of it
+static uint64_t bench_hash(const uint8_t* data, size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+typedef struct {
+    char key[64];
+    uint32_t size;
+    uint64_t hash;
+}BenchGolden_t;
+
+typedef struct {
+    FILE* fp;                           //new entries are appended, NULL when the file could not be written
+    BenchGolden_t* entries;             //the file's entries, in the order this run produces them
+    int entry_num;
+    int next;                           //where the next key is expected
+    int cases;
+    int added;
+    int mismatch;                       //against the golden file
+    int variant_mismatch;               //a fast path against the reference path of this run
+}BenchGoldenCtx_t;
+
+//the entry of key, found at ctx->next unless the case list changed
+static BenchGolden_t* bench_golden_find(BenchGoldenCtx_t* ctx, const char* key)
+{
+    if (ctx->next < ctx->entry_num && strcmp(ctx->entries[ctx->next].key, key) == 0)
+    {
+        return &ctx->entries[ctx->next++];
+    }
+    for (int i = 0; i < ctx->entry_num; i++)
+    {
+        if (strcmp(ctx->entries[i].key, key) == 0)
+        {
+            ctx->next = i + 1;
+            return &ctx->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void bench_golden_check(BenchGoldenCtx_t* ctx, const char* key, const uint8_t* data, uint32_t size)
+{
+    uint64_t hash = bench_hash(data, size);
+    BenchGolden_t* golden = bench_golden_find(ctx, key);
+    ctx->cases++;
+    if (golden == NULL)
+    {
+        if (ctx->fp != NULL)
+        {
+            fprintf(ctx->fp, "%s %u %016llx\n", key, size, (unsigned long long)hash);
+        }
+        ctx->added++;
+    }
+    else if (golden->size != size || golden->hash != hash)
+    {
+        printf("golden MISMATCH %s\n", key);
+        ctx->mismatch++;
+    }
+}
+
+static void bench_golden_variant(BenchGoldenCtx_t* ctx, const char* key, const char* variant, const uint8_t* ref, \
+    const uint8_t* out, uint32_t size)
+{
+    if (memcmp(ref, out, size) != 0)
+    {
+        int diff = 0;
+        for (uint32_t i = 0; i < size; i++)
+        {
+            diff += (ref[i] != out[i]);
+        }
+        printf("golden MISMATCH %s %s: %d of %u bytes differ from the reference\n", key, variant, diff, size);
+        ctx->variant_mismatch++;
+    }
+}
+
+//the next hist agc frame builds its own mapping, so every case sees the same agc state
+static void bench_golden_agc_reset(void)
+{
+    HistAgc_t* agc = get_display_hist_agc();
+    HistAgcParam_t param = agc->param;
+    hist_agc_init(agc, &param);
+}
+
+static uint32_t bench_golden_rand(uint32_t* seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+//fuzzed raw frames: uniform noise, a flat frame, salt and pepper over mid gray and a range only a few codes wide.
+//the temp half of each has the matching pattern, kind 2 with warm 34C rectangles on 25C for the segmentation
+static void bench_golden_fuzz(uint8_t* raw, int width, int height, int kind)
+{
+    int pix_num = width * height;
+    uint16_t* image = (uint16_t*)raw;
+    uint16_t* temp = image + pix_num;
+    uint32_t seed = 0x9E3779B9u + kind;
+    for (int i = 0; i < pix_num; i++)
+    {
+        uint32_t r = bench_golden_rand(&seed);
+        int x = i % width, y = i / width;
+        switch (kind)
+        {
+        case 0:
+            image[i] = (uint16_t)r;
+            temp[i] = (uint16_t)(r >> 16);
+            break;
+        case 1:
+            image[i] = 0x8000;
+            temp[i] = (uint16_t)((37.0 + 273.15) * 64);
+            break;
+        case 2:
+        {
+            image[i] = ((r & 15) == 0) ? (((r >> 4) & 1) ? 0xFFFF : 0) : 0x8000 + (int)((r >> 8) & 255) - 128;
+            int warm = ((x / 16 + y / 16) % 3 == 0);
+            temp[i] = (uint16_t)(((warm ? 34.0 : 25.0) + 273.15) * 64 + (int)((r >> 16) & 63) - 32);
+            break;
+        }
+        default:
+            image[i] = (uint16_t)(30000 + (r & 3));
+            temp[i] = (uint16_t)(((r >> 8) & 1) ? 0 : 0xFFFF);
+            break;
+        }
+    }
+}
+
+//golden outputs of display_image_process for every combination it accepts, each followed by every mirror/flip and
+//rotation of mirror_flip_demo + rotate_demo, and of segment_human_by_real_temperature, on the first input frames
+//and on fuzzed ones. the reference is the scalar path; every simd level, frame_transform and the row bands
+//must give the same bytes in the same run.
+//a golden file belongs to one input (source names it), entries missing from it are appended.
+//returns the number of mismatches
+static int bench_golden(BenchInput_t* input, const char* source, const char* path)
+{
+    int pix_num = input->width * input->height;
+    BenchGoldenCtx_t ctx = { 0 };
+    int capacity = 0;
+    char header[128];
+    snprintf(header, sizeof(header), "# input %s %dx%d\n", source, input->width, input->height);
+    int has_header = 0;
+    FILE* fp = fopen(path, "r");
+    if (fp != NULL)
+    {
+        char line[128];
+        while (fgets(line, sizeof(line), fp) != NULL)
+        {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (strncmp(line, "# input ", 8) == 0)
+            {
+                if (strncmp(line, header, strlen(header) - 1) != 0)
+                {
+                    printf("bench: %s was recorded from \"%s\", not %s", path, line + 8, header + 8);
+                    fclose(fp);
+                    free(ctx.entries);
+                    return -1;
+                }
+                has_header = 1;
+                continue;
+            }
+            BenchGolden_t entry;
+            unsigned long long hash;
+            if (sscanf(line, "%63s %u %llx", entry.key, &entry.size, &hash) != 3)
+            {
+                continue;
+            }
+            entry.hash = hash;
+            if (ctx.entry_num == capacity)
+            {
+                capacity = (capacity == 0) ? 1024 : capacity * 2;
+                BenchGolden_t* entries = (BenchGolden_t*)realloc(ctx.entries, capacity * sizeof(BenchGolden_t));
+                if (entries == NULL)
+                {
+                    break;
+                }
+                ctx.entries = entries;
+            }
+            ctx.entries[ctx.entry_num++] = entry;
+        }
+        fclose(fp);
+    }
+    ctx.fp = fopen(path, "a");
+    if (ctx.fp == NULL)
+    {
+        printf("bench: %s cannot be written, new cases are only checked against the reference\n", path);
+    }
+    else if (!has_header)
+    {
+        fputs(header, ctx.fp);
+    }
+
+    uint8_t* raw = (uint8_t*)malloc(input->frame_size);
+    uint8_t* image = (uint8_t*)malloc(pix_num * 2);
+    uint8_t* temp = (uint8_t*)malloc(pix_num * 2);
+    uint16_t* y14 = (uint16_t*)malloc(pix_num * 2);
+    uint8_t* ref = (uint8_t*)malloc(pix_num * 3);
+    uint8_t* work = (uint8_t*)malloc(pix_num * 3);
+    if (raw == NULL || image == NULL || temp == NULL || y14 == NULL || ref == NULL || work == NULL)
+    {
+        return -1;
+    }
+    SimdLevel_t simd_level = simd_level_get();
+    SimdLevel_t simd_max = simd_level_detect();
+    uint8_t fused_color = fused_color_enabled;
+    pool_init(1);
+    int frame_num = (input->frame_num < BENCH_GOLDEN_FRAMES) ? input->frame_num : BENCH_GOLDEN_FRAMES;
+    for (int f = 0; f < frame_num + BENCH_GOLDEN_FUZZ; f++)
+    {
+        if (f < frame_num)
+        {
+            memcpy(raw, bench_raw_frame(input, f), input->frame_size);
+        }
+        else
+        {
+            memset(raw, 0, input->frame_size);
+            bench_golden_fuzz(raw, input->width, input->height, f - frame_num);
+        }
+        raw_data_cut(raw, pix_num * 2, pix_num * 2, image, temp);
+        y16_to_y14((uint16_t*)image, pix_num, y14);
+        char key[64];
+
+        for (int in = INPUT_FMT_Y14; in <= INPUT_FMT_YUV422; in++)
+        {
+            for (int out = OUTPUT_FMT_Y14; out <= OUTPUT_FMT_BGR888; out++)
+            {
+                for (int color = PSEUDO_COLOR_ON; color <= PSEUDO_COLOR_OFF; color++)
+                {
+                    for (int enhance = IMG_ENHANCE_ON; enhance < IMG_ENHANCE_NUM; enhance++)
+                    {
+                        FrameInfo_t frame_info = { 0 };
+                        frame_info.width = input->width;
+                        frame_info.height = input->height;
+                        frame_info.input_format = (InputFormat_t)in;
+                        frame_info.output_format = (OutputFormat_t)out;
+                        frame_info.pseudo_color_status = (PseudoColor_t)color;
+                        frame_info.img_enhance_status = (ImgEnhance_t)enhance;
+                        if (display_pipeline_select(&frame_info) == NULL)
+                        {
+                            continue;
+                        }
+                        uint8_t* src = (in == INPUT_FMT_Y14) ? (uint8_t*)y14 : image;
+                        char combo[48];
+                        snprintf(combo, sizeof(combo), "f%d/%s-%s/color=%s/%s", f, input_format_names[in], \
+                            output_format_names[out], (color == PSEUDO_COLOR_ON) ? "on" : "off", \
+                            enhance_names[enhance]);
+
+                        //the fused colorize (the default) is the reference, the library chain it replaces takes
+                        //its own chroma per yuyv pair and only gets its own golden entry. both at every simd level
+                        uint32_t size = 0;
+                        for (int fused = 1; fused >= 0; fused--)
+                        {
+                            if (fused == 0 && color != PSEUDO_COLOR_ON)
+                            {
+                                break;
+                            }
+                            uint8_t* level_ref = fused ? ref : work;
+                            fused_color_enabled = (uint8_t)fused;
+                            for (int level = SIMD_LEVEL_SCALAR; level <= (int)simd_max; level++)
+                            {
+                                if ((level == SIMD_LEVEL_NEON) != (simd_max == SIMD_LEVEL_NEON) && level != SIMD_LEVEL_SCALAR)
+                                {
+                                    continue;
+                                }
+                                simd_level_set((SimdLevel_t)level);
+                                bench_golden_agc_reset();
+                                FrameInfo_t info = frame_info;
+                                display_image_process(src, pix_num, &info, NULL);
+                                if (level == SIMD_LEVEL_SCALAR)
+                                {
+                                    size = info.byte_size;
+                                    memcpy(level_ref, image_tmp_frame2, size);
+                                    if (!fused)
+                                    {
+                                        snprintf(key, sizeof(key), "%s/lib", combo);
+                                        bench_golden_check(&ctx, key, level_ref, size);
+                                    }
+                                    continue;
+                                }
+                                char variant[48];
+                                snprintf(variant, sizeof(variant), "simd=%s%s", simd_level_name((SimdLevel_t)level), \
+                                    fused ? "" : " lib");
+                                bench_golden_variant(&ctx, combo, variant, level_ref, image_tmp_frame2, size);
+                            }
+                        }
+                        simd_level_set(SIMD_LEVEL_SCALAR);
+                        fused_color_enabled = 1;
+
+                        //the library refuses yuv422 and yuv444 in mirror/flip/rotate, those only go through frame_transform
+                        FrameInfo_t info = frame_info;
+                        info.byte_size = size;
+                        for (int rotate = NO_ROTATE; rotate <= ROTATE_180D; rotate++)
+                        {
+                            for (int mirror_flip = STATUS_NO_MIRROR_FLIP; mirror_flip <= STATUS_MIRROR_FLIP; mirror_flip++)
+                            {
+                                snprintf(key, sizeof(key), "%s/%s/%s", combo, rotate_names[rotate], \
+                                    mirror_flip_names[mirror_flip]);
+                                memcpy(work, ref, size);
+                                if (out == OUTPUT_FMT_YUV422 || out == OUTPUT_FMT_YUV444)
+                                {
+                                    if (rotate != NO_ROTATE || mirror_flip != STATUS_NO_MIRROR_FLIP)
+                                    {
+                                        frame_transform(ref, &info, (RotateSide_t)rotate, \
+                                            (MirrorFlipStatus_t)mirror_flip, work);
+                                    }
+                                }
+                                else
+                                {
+                                    mirror_flip_demo(&info, work, (MirrorFlipStatus_t)mirror_flip);
+                                    rotate_demo(&info, work, (RotateSide_t)rotate);
+                                    memcpy(image_tmp_frame2, ref, size);
+                                    transform_demo(&info, (RotateSide_t)rotate, (MirrorFlipStatus_t)mirror_flip);
+                                    bench_golden_variant(&ctx, key, "frame_transform", work, image_tmp_frame2, size);
+                                }
+                                bench_golden_check(&ctx, key, work, size);
+
+                                //the bands run colorize and transform together on the y16 frame
+                                FrameInfo_t band_info = frame_info;
+                                band_info.rotate_side = (RotateSide_t)rotate;
+                                band_info.mirror_flip_status = (MirrorFlipStatus_t)mirror_flip;
+                                if (in == INPUT_FMT_Y16 && out == OUTPUT_FMT_BGR888 && color == PSEUDO_COLOR_ON)
+                                {
+                                    bench_golden_agc_reset();
+                                    if (display_image_process_bands(src, pix_num, &band_info, NULL, 2) == 0)
+                                    {
+                                        bench_golden_variant(&ctx, key, "bands=2", work, image_tmp_frame2, size);
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        //the simd range pass is the only part of the segmentation with variants
+        snprintf(key, sizeof(key), "f%d/segment", f);
+        simd_level_set(SIMD_LEVEL_SCALAR);
+        segment_human_by_real_temperature((uint16_t*)temp, input->width, input->height, ref);
+        bench_golden_check(&ctx, key, ref, pix_num * 3);
+        for (int level = SIMD_LEVEL_SSE41; level <= (int)simd_max; level++)
+        {
+            if ((level == SIMD_LEVEL_NEON) != (simd_max == SIMD_LEVEL_NEON))
+            {
+                continue;
+            }
+            simd_level_set((SimdLevel_t)level);
+            segment_human_by_real_temperature((uint16_t*)temp, input->width, input->height, work);
+            bench_golden_variant(&ctx, key, simd_level_name((SimdLevel_t)level), ref, work, pix_num * 3);
+        }
+    }
+    pool_release();
+    simd_level_set(simd_level);
+    fused_color_enabled = fused_color;
+    bench_golden_agc_reset();
+    printf("golden: %d cases, %d added to %s, %d differ from it, %d fast path results differ from the reference\n", \
+        ctx.cases, ctx.added, path, ctx.mismatch, ctx.variant_mismatch);
+    if (ctx.fp != NULL)
+    {
+        fclose(ctx.fp);
+    }
+    free(ctx.entries);
+    free(raw);
+    free(image);
+    free(temp);
+    free(y14);
+    free(ref);
+    free(work);
+    return ctx.mismatch + ctx.variant_mismatch;
+}
+
+static void bench_report(void)
+{
+    printf("%-10s %-44s %8s %10s %10s %10s\n", "stage", "config", "frames", "fps", "ns/pixel", "alloc/frm");
+    for (int i = 0; i < bench_result_num; i++)
+    {
+        BenchResult_t* result = &bench_results[i];
+        double elapsed_us = (result->elapsed_us > 0) ? (double)result->elapsed_us : 1;
+        double fps = result->frames * 1000000.0 / elapsed_us;
+        double ns_per_pixel = elapsed_us * 1000.0 / ((double)result->frames * result->pix_num);
+#ifdef BENCH_COUNT_ALLOC
+        printf("%-10s %-44s %8d %10.1f %10.3f %10.2f\n", result->stage, result->config, result->frames, \
+            fps, ns_per_pixel, (double)result->alloc_cnt / result->frames);
+#else
+        printf("%-10s %-44s %8d %10.1f %10.3f %10s\n", result->stage, result->config, result->frames, \
+            fps, ns_per_pixel, "-");
+#endif
+    }
+
+    //the counters per pixel of the stages -p measured, llc misses per 1000 pixels. "-" for a counter the host lacks
+    int header = 0;
+    for (int i = 0; i < bench_result_num; i++)
+    {
+        BenchResult_t* result = &bench_results[i];
+        if (result->perf_valid == 0)
+        {
+            continue;
+        }
+        if (!header)
+        {
+            printf("\n%-10s %-44s %10s %10s %6s %10s %10s %10s\n", "stage", "config", "cycles/px", "instr/px", "ipc", \
+                "l1d/px", "llc/kpx", "br_miss/px");
+            header = 1;
+        }
+        double pixels = (double)result->frames * result->pix_num;
+        const double scales[PERF_EVENT_NUM] = { 1, 1, 1, 1000, 1 };
+        char columns[PERF_EVENT_NUM][16];
+        for (int event = 0; event < PERF_EVENT_NUM; event++)
+        {
+            if (result->perf_valid & (1u << event))
+            {
+                snprintf(columns[event], sizeof(columns[event]), "%.3f", result->perf.value[event] * scales[event] / \
+                    pixels);
+            }
+            else
+            {
+                snprintf(columns[event], sizeof(columns[event]), "-");
+            }
+        }
+        char ipc[16] = "-";
+        if ((result->perf_valid & 3) == 3 && result->perf.value[PERF_EVENT_CYCLES] > 0)
+        {
+            snprintf(ipc, sizeof(ipc), "%.2f", (double)result->perf.value[PERF_EVENT_INSTRUCTIONS] / \
+                result->perf.value[PERF_EVENT_CYCLES]);
+        }
+        printf("%-10s %-44s %10s %10s %6s %10s %10s %10s\n", result->stage, result->config, \
+            columns[PERF_EVENT_CYCLES], columns[PERF_EVENT_INSTRUCTIONS], ipc, columns[PERF_EVENT_L1D_MISSES], \
+            columns[PERF_EVENT_LLC_MISSES], columns[PERF_EVENT_BRANCH_MISSES]);
+    }
+}
+
+//baselines only compare on the same kind of machine: architecture, simd level and online cpus
+static void bench_host_class(char* host, int size)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    const char* arch = "x86_64";
+#elif defined(__aarch64__)
+    const char* arch = "aarch64";
+#elif defined(__arm__)
+    const char* arch = "arm";
+#else
+    const char* arch = "other";
+#endif
+    long cpus = 1;
+#if !defined(_WIN32)
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    snprintf(host, size, "%s-%s-%ldcpu", arch, simd_level_name(simd_level_get()), cpus);
+}
+
+static void bench_json_string(FILE* fp, const char* str)
+{
+    fputc('"', fp);
+    for (; *str != '\0'; str++)
+    {
+        if (*str == '"' || *str == '\\')
+        {
+            fputc('\\', fp);
+        }
+        fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+//one result per line, so bench_baseline_compare reads it back without a json parser
+static int bench_json_write(const char* path, const char* host, const char* input_name, int iterations)
+{
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        printf("bench: open %s failed\n", path);
+        return -1;
+    }
+    fprintf(fp, "{\n  \"host\": ");
+    bench_json_string(fp, host);
+    fprintf(fp, ",\n  \"input\": ");
+    bench_json_string(fp, input_name);
+    fprintf(fp, ",\n  \"iterations\": %d,\n  \"peak_rss_kb\": %llu,\n  \"results\": [\n", iterations, \
+        (unsigned long long)bench_peak_rss_kb());
+    for (int i = 0; i < bench_result_num; i++)
+    {
+        BenchResult_t* result = &bench_results[i];
+        double elapsed_us = (result->elapsed_us > 0) ? (double)result->elapsed_us : 1;
+        fprintf(fp, "    {\"stage\": ");
+        bench_json_string(fp, result->stage);
+        fprintf(fp, ", \"config\": ");
+        bench_json_string(fp, result->config);
+        fprintf(fp, ", \"frames\": %d, \"ns_per_frame\": %.1f, \"fps\": %.2f, \"ns_per_pixel\": %.4f, ", \
+            result->frames, elapsed_us * 1000.0 / result->frames, result->frames * 1000000.0 / elapsed_us, \
+            elapsed_us * 1000.0 / ((double)result->frames * result->pix_num));
+#ifdef BENCH_COUNT_ALLOC
+        fprintf(fp, "\"alloc_per_frame\": %.2f, ", (double)result->alloc_cnt / result->frames);
+#else
+        fprintf(fp, "\"alloc_per_frame\": null, ");
+#endif
+        //the hardware counters per pixel, without -p or without the counter null
+        double pixels = (double)result->frames * result->pix_num;
+        for (int event = 0; event < PERF_EVENT_NUM; event++)
+        {
+            if (result->perf_valid & (1u << event))
+            {
+                fprintf(fp, "\"%s_per_pixel\": %.4f, ", perf_event_name((PerfEvent_t)event), \
+                    result->perf.value[event] / pixels);
+            }
+            else
+            {
+                fprintf(fp, "\"%s_per_pixel\": null, ", perf_event_name((PerfEvent_t)event));
+            }
+        }
+        fprintf(fp, "\"peak_rss_kb\": %llu}%s\n", (unsigned long long)result->peak_rss_kb, \
+            (i + 1 < bench_result_num) ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    return 0;
+}
+
+//the value of "name" in a line bench_json_write wrote, strings unescaped. -1 when the line has none (or null)
+static int bench_json_field(const char* line, const char* name, char* value, int size)
+{
+    char pattern[32];
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", name);
+    const char* p = strstr(line, pattern);
+    if (p == NULL)
+    {
+        return -1;
+    }
+    p += strlen(pattern);
+    int n = 0;
+    if (*p == '"')
+    {
+        for (p++; *p != '\0' && *p != '"' && n < size - 1; p++)
+        {
+            if (*p == '\\' && p[1] != '\0')
+            {
+                p++;
+            }
+            value[n++] = *p;
+        }
+    }
+    else
+    {
+        while (*p != '\0' && *p != ',' && *p != '}' && *p != '\r' && *p != '\n' && n < size - 1)
+        {
+            value[n++] = *p++;
+        }
+    }
+    value[n] = '\0';
+    return (strcmp(value, "null") == 0) ? -1 : 0;
+}
+
+//every result of this run against the one of the same stage and config in a json baseline of the same host class:
+//slower by more than threshold_pct, or more allocations per frame, is a regression. returns their number
+static int bench_baseline_compare(const char* path, const char* host, double threshold_pct)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        printf("bench: open %s failed\n", path);
+        return -1;
+    }
+    char line[512];
+    char value[128];
+    int compared = 0, regressions = 0, faster = 0, missing = 0;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (bench_json_field(line, "host", value, sizeof(value)) == 0 && strstr(line, "\"stage\"") == NULL)
+        {
+            if (strcmp(value, host) != 0)
+            {
+                printf("bench: %s is a baseline of %s, this host is %s\n", path, value, host);
+                fclose(fp);
+                return -1;
+            }
+            continue;
+        }
+        char stage[sizeof(bench_results[0].stage)];
+        char config[sizeof(bench_results[0].config)];
+        if (bench_json_field(line, "stage", stage, sizeof(stage)) != 0 || \
+            bench_json_field(line, "config", config, sizeof(config)) != 0 || \
+            bench_json_field(line, "ns_per_frame", value, sizeof(value)) != 0)
+        {
+            continue;
+        }
+        double base_ns = atof(value);
+        BenchResult_t* result = NULL;
+        for (int i = 0; i < bench_result_num; i++)
+        {
+            if (strcmp(bench_results[i].stage, stage) == 0 && strcmp(bench_results[i].config, config) == 0)
+            {
+                result = &bench_results[i];
+                break;
+            }
+        }
+        if (result == NULL)
+        {
+            missing++;
+            continue;
+        }
+        compared++;
+        double ns = ((result->elapsed_us > 0) ? (double)result->elapsed_us : 1) * 1000.0 / result->frames;
+        double change_pct = (base_ns > 0) ? (ns / base_ns - 1) * 100 : 0;
+        if (change_pct > threshold_pct)
+        {
+            printf("REGRESSION %-10s %-44s %12.0f ns/frame, baseline %.0f (%+.1f%%)\n", stage, config, ns, \
+                base_ns, change_pct);
+            regressions++;
+        }
+        else if (change_pct < -threshold_pct)
+        {
+            faster++;
+        }
+#ifdef BENCH_COUNT_ALLOC
+        if (bench_json_field(line, "alloc_per_frame", value, sizeof(value)) == 0)
+        {
+            double alloc = (double)result->alloc_cnt / result->frames;
+            if (alloc > atof(value) + BENCH_ALLOC_SLACK)
+            {
+                printf("REGRESSION %-10s %-44s %12.2f alloc/frm, baseline %s\n", stage, config, alloc, value);
+                regressions++;
+            }
+        }
+#endif
+    }
+    fclose(fp);
+    printf("baseline %s: %d results compared, %d regressions over %.0f%%, %d faster, %d not in this run\n", path, \
+        compared, regressions, threshold_pct, faster, missing);
+    return regressions;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* path = NULL;
+    const char* replay_path = NULL;
+    int frames = BENCH_DEFAULT_FRAMES;
+    int width = BENCH_DEFAULT_WIDTH;
+    int raw_height = BENCH_DEFAULT_HEIGHT;
+    const char* golden_path = NULL;
+    const char* json_path = NULL;
+    const char* baseline_path = NULL;
+    double threshold_pct = BENCH_REGRESSION_PCT;
+    char host[64];
+    bench_host_class(host, sizeof(host));
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            replay_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            frames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+        {
+            width = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-h") == 0 && i + 1 < argc)
+        {
+            raw_height = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+        {
+            golden_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            json_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+        {
+            baseline_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            threshold_pct = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            snprintf(host, sizeof(host), "%s", argv[++i]);
+        }
+        else if (strcmp(argv[i], "-p") == 0)
+        {
+            bench_perf_on = 1;
+        }
+        else
+        {
+            printf("usage: %s [-f raw_dump | -r recording] [-n frames] [-w width] [-h height] [-g golden] " \
+                "[-j results.json] [-b baseline.json] [-t threshold_pct] [-c host_class] [-p]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (frames <= 0 || width <= 0 || raw_height <= 0 || raw_height % 2 != 0)
+    {
+        printf("bench: invalid frames/width/height\n");
+        return -1;
+    }
+    if (bench_perf_on && perf_counters_open(&bench_perf) != PERF_SUCCESS)
+    {
+        printf("bench: no hardware counters on this host (perf_event_open), -p ignored\n");
+        bench_perf_on = 0;
+    }
+    irproc_log_register(IRPROC_LOG_NO_PRINT);
+    irparse_log_register(IRPARSE_LOG_NO_PRINT);
+    irtemp_log_register(IRTEMP_LOG_NO_PRINT);
+
+    BenchInput_t input = { 0 };
+    input.width = width;
+    input.height = raw_height / 2;
+    input.frame_size = width * raw_height * 2;
+    if (replay_path != NULL)
+    {
+        if (bench_replay_frames(&input, replay_path) != 0)
+        {
+            return -1;
+        }
+    }
+    else if (path != NULL)
+    {
+        if (bench_load_frames(&input, path) != 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        input.frame_num = BENCH_SYNTH_FRAMES;
+        input.raw_frames = (uint8_t*)malloc((size_t)input.frame_num * input.frame_size);
+        if (input.raw_frames == NULL)
+        {
+            return -1;
+        }
+        bench_synth_frames(&input);
+    }
+
+    int pix_num = input.width * input.height;
+    input.image_frame = (uint8_t*)malloc(pix_num * 2);
+    input.temp_frame = (uint8_t*)malloc(pix_num * 2);
+    input.y14_frame = (uint16_t*)malloc(pix_num * 2);
+    if (input.image_frame == NULL || input.temp_frame == NULL || input.y14_frame == NULL)
+    {
+        return -1;
+    }
+    raw_data_cut(bench_raw_frame(&input, 0), pix_num * 2, pix_num * 2, input.image_frame, input.temp_frame);
+    y16_to_y14((uint16_t*)input.image_frame, pix_num, input.y14_frame);
+
+    StreamFrameInfo_t stream_frame_info = { 0 };
+    stream_frame_info.image_info.width = input.width;
+    stream_frame_info.image_info.height = input.height;
+    display_sink_param.type = DISPLAY_SINK_NULL;
+    display_init(&stream_frame_info);
+    printf("bench: %d %s frames %dx%d, %d iterations per config, host class %s\n", input.frame_num, \
+        (path != NULL || replay_path != NULL) ? "recorded" : "synthetic", input.width, input.height, frames, host);
+    const char* source = (replay_path != NULL) ? replay_path : ((path != NULL) ? path : "synthetic");
+    if (golden_path != NULL)
+    {
+        int mismatch = bench_golden(&input, source, golden_path);
+        display_release();
+        free(input.image_frame);
+        free(input.temp_frame);
+        free(input.y14_frame);
+        free(input.raw_frames);
+        return (mismatch == 0) ? 0 : 1;
+    }
+
+    bench_cut(&input, frames);
+    bench_stats(&input, frames);
+    bench_process(&input, frames);
+    bench_enhance(&input, frames);
+    bench_transform(&input, frames);
+    bench_packed(&input, frames);
+    bench_bands(&input, frames);
+    bench_segment(&input, frames);
+    bench_temp(&input, frames);
+    bench_roi(&input, frames);
+    bench_roi_shapes(&input, frames);
+    bench_points(&input, frames);
+    bench_alarm(&input, frames);
+    bench_track(frames);
+    int queue_failed = bench_pyramid(&input, frames);
+    queue_failed += bench_topk(&input, frames);
+    queue_failed += bench_hold(&input, frames);
+    queue_failed += bench_rate(&input, frames);
+    queue_failed += bench_background(&input, frames);
+    queue_failed += bench_profile(&input, frames);
+    queue_failed += bench_roi_windows(&input, frames);
+    queue_failed += bench_rules(&input, frames);
+    queue_failed += bench_clahe(&input);
+    queue_failed += bench_dde(&input);
+    queue_failed += bench_zoom(&input);
+    queue_failed += bench_queue(frames);
+    queue_failed += bench_graph(frames);
+    queue_failed += bench_plugin(frames);
+    queue_failed += bench_bus(frames);
+    queue_failed += bench_temp_query(frames);
+    queue_failed += bench_format_change(frames);
+    queue_failed += bench_framesync(frames);
+    bench_nr(&input, frames);
+    bench_convert(&input, frames);
+    queue_failed += bench_nuc(&input, frames);
+    queue_failed += bench_nuct();
+    queue_failed += bench_tau(&input, frames);
+    bench_codec(&input, frames);
+    bench_jpeg(&input, frames);
+    queue_failed += bench_radiometric(&input, frames);
+    bench_nv12(&input, frames);
+    bench_upscale(&input, frames);
+    bench_fusion(&input, frames);
+    bench_mosaic(&input, frames);
+    bench_display(&input, frames);
+    bench_report();
+    int regressions = 0;
+    if (json_path != NULL)
+    {
+        char input_name[320];
+        snprintf(input_name, sizeof(input_name), "%s %dx%d", source, input.width, input.height);
+        bench_json_write(json_path, host, input_name, frames);
+    }
+    if (baseline_path != NULL)
+    {
+        regressions = bench_baseline_compare(baseline_path, host, threshold_pct);
+    }
+
+    display_release();
+    free(input.image_frame);
+    free(input.temp_frame);
+    free(input.y14_frame);
+    free(input.raw_frames);
+    return (regressions == 0 && queue_failed == 0) ? 0 : 1;
+}
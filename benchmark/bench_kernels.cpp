@@ -0,0 +1,426 @@
+//microbenchmarks of the libirparse/libirprocess conversions display.cpp calls, next to the kernels that replace them
+//usage: bench_kernels [-b filter] [-t min_ms]
+//every case runs at 256x192, 256x384 and the x2/x4 upscaled 512x384 and 1024x768, out of place and in place
+//(src == dst, as the BGR branch calls rgb_to_bgr), warm (the frame stays in cache between iterations) and
+//cold (the caches are flushed before each timed call). the check section compares the in place results
+//with the out of place ones and each replacement with its library counterpart. the library's geometric ops
+//refuse yuv422 and are not safe in place, which is why display.cpp goes through image_tmp_frame1
+#include "transform.h"
+#include "palette.h"
+#include "libirparse.h"
+#include "libirprocess.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <chrono>
+
+#define BENCH_MIN_MS 50                 //a case repeats until it ran this long
+#define BENCH_COLD_ITERATIONS 16
+#define BENCH_FLUSH_BYTES (32 << 20)    //written before each cold iteration, larger than the last level cache
+#define BENCH_MAX_WIDTH 1024
+#define BENCH_MAX_HEIGHT 768
+
+typedef enum
+{
+    BENCH_FMT_Y14 = 0,
+    BENCH_FMT_YUV422,
+    BENCH_FMT_BGR888,
+    BENCH_FMT_NUM,
+}BenchFormat_t;
+
+typedef enum
+{
+    BENCH_OP_LEFT_90 = 0,
+    BENCH_OP_RIGHT_90,
+    BENCH_OP_180,
+    BENCH_OP_MIRROR,
+    BENCH_OP_FLIP,
+    BENCH_OP_PSEUDOCOLOR,               //y14_map_to_yuyv_pseudocolor / palette_map_yuyv
+    BENCH_OP_YUYV_RGB,                  //yuv422_to_rgb, no replacement: the display maps y14 to rgb instead
+    BENCH_OP_Y14_RGB,                   //y14_map_to_yuyv_pseudocolor + yuv422_to_rgb / palette_map rgb
+    BENCH_OP_RGB_BGR,                   //rgb_to_bgr / a byte swap loop
+    BENCH_OP_NUM,
+}BenchOp_t;
+
+typedef struct {
+    BenchOp_t op;
+    BenchFormat_t format;               //geometric ops only
+    int width;
+    int height;
+    int replacement;                    //the repo's kernel instead of the library's
+    uint8_t* src;
+    uint8_t* dst;                       //src for in place
+    uint8_t* tmp;                       //the yuyv between the two library calls of BENCH_OP_Y14_RGB
+}BenchCase_t;
+
+static const char* bench_op_names[BENCH_OP_NUM][2] = {
+    { "rotate_left_90", "frame_transform_left90" },
+    { "rotate_right_90", "frame_transform_right90" },
+    { "rotate_180", "frame_transform_180" },
+    { "mirror", "frame_transform_mirror" },
+    { "flip", "frame_transform_flip" },
+    { "y14_map_to_yuyv_pseudocolor", "palette_map_yuyv" },
+    { "yuv422_to_rgb", NULL },
+    { "pseudocolor+yuv422_to_rgb", "palette_map_rgb" },
+    { "rgb_to_bgr", "rgb_swap_loop" } };
+static const char* bench_format_names[BENCH_FMT_NUM] = { "y14", "yuv422", "bgr888" };
+static const int bench_format_bytes[BENCH_FMT_NUM] = { 2, 2, 3 };
+static const irproc_src_fmt_t bench_irproc_formats[BENCH_FMT_NUM] = { IRPROC_SRC_FMT_Y14, IRPROC_SRC_FMT_YUV422, \
+    IRPROC_SRC_FMT_BGR888 };
+static const OutputFormat_t bench_output_formats[BENCH_FMT_NUM] = { OUTPUT_FMT_Y14, OUTPUT_FMT_YUV422, \
+    OUTPUT_FMT_BGR888 };
+static const int bench_sizes[][2] = { { 256, 192 }, { 256, 384 }, { 512, 384 }, { 1024, 768 } };
+
+static uint8_t* bench_flush_buffer = NULL;
+static volatile uint8_t bench_sink = 0;
+
+static uint64_t bench_now_ns(void)
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>( \
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int bench_is_geometric(BenchOp_t op)
+{
+    return op <= BENCH_OP_FLIP;
+}
+
+//bytes a case reads per call
+static int bench_src_bytes(const BenchCase_t* c)
+{
+    int pix_num = c->width * c->height;
+    if (bench_is_geometric(c->op))
+    {
+        return pix_num * bench_format_bytes[c->format];
+    }
+    return pix_num * ((c->op == BENCH_OP_RGB_BGR) ? 3 : 2);
+}
+
+//0, or the error the kernel returned
+static int bench_call(const BenchCase_t* c)
+{
+    int pix_num = c->width * c->height;
+    ImageRes_t res = { (uint16_t)c->width, (uint16_t)c->height };
+    const Palette_t* palette = palette_get(PALETTE_DEFAULT_MODE);
+    if (bench_is_geometric(c->op) && c->replacement)
+    {
+        FrameInfo_t frame_info;
+        memset(&frame_info, 0, sizeof(frame_info));
+        frame_info.width = c->width;
+        frame_info.height = c->height;
+        frame_info.output_format = bench_output_formats[c->format];
+        frame_info.byte_size = pix_num * bench_format_bytes[c->format];
+        static const RotateSide_t rotates[] = { LEFT_90D, RIGHT_90D, ROTATE_180D, NO_ROTATE, NO_ROTATE };
+        static const MirrorFlipStatus_t mirror_flips[] = { STATUS_NO_MIRROR_FLIP, STATUS_NO_MIRROR_FLIP, \
+            STATUS_NO_MIRROR_FLIP, STATUS_ONLY_MIRROR, STATUS_ONLY_FLIP };
+        return frame_transform(c->src, &frame_info, rotates[c->op], mirror_flips[c->op], c->dst);
+    }
+    irproc_src_fmt_t format = bench_irproc_formats[c->format];
+    switch (c->op)
+    {
+    case BENCH_OP_LEFT_90:
+        return rotate_left_90(c->src, res, format, c->dst);
+    case BENCH_OP_RIGHT_90:
+        return rotate_right_90(c->src, res, format, c->dst);
+    case BENCH_OP_180:
+        return rotate_180(c->src, res, format, c->dst);
+    case BENCH_OP_MIRROR:
+        return mirror(c->src, res, format, c->dst);
+    case BENCH_OP_FLIP:
+        return flip(c->src, res, format, c->dst);
+    case BENCH_OP_PSEUDOCOLOR:
+        if (c->replacement)
+        {
+            palette_map_yuyv(palette, (const uint16_t*)c->src, pix_num, c->dst);
+        }
+        else
+        {
+            return y14_map_to_yuyv_pseudocolor((uint16_t*)c->src, pix_num, PALETTE_DEFAULT_MODE, c->dst);
+        }
+        break;
+    case BENCH_OP_YUYV_RGB:
+        return yuv422_to_rgb(c->src, pix_num, c->dst);
+    case BENCH_OP_Y14_RGB:
+        if (c->replacement)
+        {
+            palette_map(palette->rgb, 3, (const uint16_t*)c->src, pix_num, c->dst);
+        }
+        else
+        {
+            int ret = y14_map_to_yuyv_pseudocolor((uint16_t*)c->src, pix_num, PALETTE_DEFAULT_MODE, c->tmp);
+            if (ret != IRPROC_SUCCESS)
+            {
+                return ret;
+            }
+            return yuv422_to_rgb(c->tmp, pix_num, c->dst);
+        }
+        break;
+    case BENCH_OP_RGB_BGR:
+        if (c->replacement)
+        {
+            for (int i = 0; i < pix_num * 3; i += 3)
+            {
+                uint8_t r = c->src[i];
+                c->dst[i + 1] = c->src[i + 1];
+                c->dst[i] = c->src[i + 2];
+                c->dst[i + 2] = r;
+            }
+        }
+        else
+        {
+            return rgb_to_bgr(c->src, pix_num, c->dst);
+        }
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+//evict the frame from every cache level
+static void bench_flush(void)
+{
+    for (int i = 0; i < BENCH_FLUSH_BYTES; i += 64)
+    {
+        bench_flush_buffer[i]++;
+    }
+    bench_sink = bench_flush_buffer[BENCH_FLUSH_BYTES / 2];
+}
+
+static void bench_run(const BenchCase_t* c, int in_place, int cold, uint32_t min_ms)
+{
+    const char* name = bench_op_names[c->op][c->replacement];
+    char full_name[128];
+    if (bench_is_geometric(c->op))
+    {
+        snprintf(full_name, sizeof(full_name), "%s/%s/%dx%d/%s/%s", name, bench_format_names[c->format], c->width, \
+            c->height, in_place ? "in" : "out", cold ? "cold" : "warm");
+    }
+    else
+    {
+        snprintf(full_name, sizeof(full_name), "%s/%dx%d/%s/%s", name, c->width, c->height, in_place ? "in" : "out", \
+            cold ? "cold" : "warm");
+    }
+    //the library refuses some formats (yuv422 for the geometric ops), a refused call would time as free
+    int ret = bench_call(c);
+    if (ret != 0)
+    {
+        printf("%-56s error %d\n", full_name, ret);
+        return;
+    }
+    uint64_t elapsed_ns = 0;
+    uint64_t iterations = 0;
+    if (cold)
+    {
+        for (int i = 0; i < BENCH_COLD_ITERATIONS; i++)
+        {
+            bench_flush();
+            uint64_t start_ns = bench_now_ns();
+            bench_call(c);
+            elapsed_ns += bench_now_ns() - start_ns;
+        }
+        iterations = BENCH_COLD_ITERATIONS;
+    }
+    else
+    {
+        for (uint64_t batch = 1; elapsed_ns < (uint64_t)min_ms * 1000000; batch *= 2)
+        {
+            uint64_t start_ns = bench_now_ns();
+            for (uint64_t i = 0; i < batch; i++)
+            {
+                bench_call(c);
+            }
+            elapsed_ns += bench_now_ns() - start_ns;
+            iterations += batch;
+        }
+    }
+    double ns = (double)elapsed_ns / iterations;
+    printf("%-56s %12.0f ns %9.3f ns/px %9.0f MB/s %10llu\n", full_name, ns, ns / (c->width * c->height), \
+        bench_src_bytes(c) * 1000.0 / ns, (unsigned long long)iterations);
+}
+
+static int bench_filter_match(const BenchCase_t* c, const char* filter)
+{
+    if (filter == NULL)
+    {
+        return 1;
+    }
+    const char* name = bench_op_names[c->op][c->replacement];
+    return strstr(name, filter) != NULL || (bench_is_geometric(c->op) && strstr(bench_format_names[c->format], filter));
+}
+
+static void bench_check_print(const char* what, const uint8_t* a, const uint8_t* b, int size)
+{
+    int diff = 0, max_delta = 0;
+    for (int i = 0; i < size; i++)
+    {
+        int delta = abs(a[i] - b[i]);
+        diff += (delta != 0);
+        max_delta = (delta > max_delta) ? delta : max_delta;
+    }
+    if (diff == 0)
+    {
+        printf("check %-72s match\n", what);
+    }
+    else
+    {
+        printf("check %-72s %d of %d bytes differ, by up to %d\n", what, diff, size, max_delta);
+    }
+}
+
+//in place against out of place, and the replacement against the library, on copies of the input
+static void bench_check(BenchCase_t* c, uint8_t* input, uint8_t* ref, uint8_t* out, int out_size)
+{
+    int in_size = bench_src_bytes(c);
+    char what[128];
+    const char* name = bench_op_names[c->op][0];
+    char format[16] = "";
+    if (bench_is_geometric(c->op))
+    {
+        snprintf(format, sizeof(format), " %s", bench_format_names[c->format]);
+    }
+    c->replacement = 0;
+    c->src = input;
+    c->dst = ref;
+    if (bench_call(c) != 0)
+    {
+        return;
+    }
+    if (in_size == out_size)
+    {
+        memcpy(out, input, in_size);
+        c->src = out;
+        c->dst = out;
+        bench_call(c);
+        snprintf(what, sizeof(what), "%s%s %dx%d in place vs out of place", name, format, c->width, c->height);
+        bench_check_print(what, ref, out, out_size);
+    }
+    if (bench_op_names[c->op][1] != NULL)
+    {
+        c->replacement = 1;
+        c->src = input;
+        c->dst = out;
+        bench_call(c);
+        snprintf(what, sizeof(what), "%s%s %dx%d vs %s", bench_op_names[c->op][1], format, c->width, c->height, name);
+        bench_check_print(what, ref, out, out_size);
+        c->replacement = 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* filter = NULL;
+    uint32_t min_ms = BENCH_MIN_MS;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            min_ms = (uint32_t)atoi(argv[++i]);
+        }
+        else
+        {
+            printf("usage: %s [-b filter] [-t min_ms]\n", argv[0]);
+            return -1;
+        }
+    }
+    irproc_log_register(IRPROC_LOG_NO_PRINT);
+    irparse_log_register(IRPARSE_LOG_NO_PRINT);
+    if (palette_init() != PALETTE_SUCCESS)
+    {
+        printf("bench_kernels: no palettes\n");
+        return -1;
+    }
+
+    //y14 scene, its pseudocolor yuyv and rgb, and a bgr888 copy
+    int max_pix = BENCH_MAX_WIDTH * BENCH_MAX_HEIGHT;
+    uint16_t* y14 = (uint16_t*)malloc(max_pix * 2);
+    uint8_t* yuyv = (uint8_t*)malloc(max_pix * 2);
+    uint8_t* rgb = (uint8_t*)malloc(max_pix * 3);
+    uint8_t* input = (uint8_t*)malloc(max_pix * 3);
+    uint8_t* src = (uint8_t*)malloc(max_pix * 3);
+    uint8_t* dst = (uint8_t*)malloc(max_pix * 3);
+    uint8_t* tmp = (uint8_t*)malloc(max_pix * 3);
+    uint8_t* ref = (uint8_t*)malloc(max_pix * 3);
+    bench_flush_buffer = (uint8_t*)calloc(BENCH_FLUSH_BYTES, 1);
+    if (y14 == NULL || yuyv == NULL || rgb == NULL || input == NULL || src == NULL || dst == NULL || tmp == NULL || \
+        ref == NULL || bench_flush_buffer == NULL)
+    {
+        return -1;
+    }
+    printf("%-56s %15s %15s %14s %10s\n", "benchmark", "time", "per pixel", "read", "iterations");
+    for (size_t s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++)
+    {
+        int width = bench_sizes[s][0], height = bench_sizes[s][1];
+        int pix_num = width * height;
+        for (int i = 0; i < pix_num; i++)
+        {
+            int x = i % width, y = i / width;
+            y14[i] = (uint16_t)(((x * 16383 / width + y * 24) ^ (rand() & 63)) & 0x3FFF);
+        }
+        y14_map_to_yuyv_pseudocolor(y14, pix_num, PALETTE_DEFAULT_MODE, yuyv);
+        yuv422_to_rgb(yuyv, pix_num, rgb);
+        for (int op = 0; op < BENCH_OP_NUM; op++)
+        {
+            for (int f = 0; f < (bench_is_geometric((BenchOp_t)op) ? BENCH_FMT_NUM : 1); f++)
+            {
+                BenchCase_t c = { (BenchOp_t)op, (BenchFormat_t)f, width, height, 0, src, dst, tmp };
+                if (!bench_filter_match(&c, filter))
+                {
+                    c.replacement = 1;
+                    if (bench_op_names[op][1] == NULL || !bench_filter_match(&c, filter))
+                    {
+                        continue;
+                    }
+                    c.replacement = 0;
+                }
+                //the input the op takes
+                const uint8_t* plane = (const uint8_t*)y14;
+                if ((bench_is_geometric(c.op) && f == BENCH_FMT_YUV422) || op == BENCH_OP_YUYV_RGB)
+                {
+                    plane = yuyv;
+                }
+                else if ((bench_is_geometric(c.op) && f == BENCH_FMT_BGR888) || op == BENCH_OP_RGB_BGR)
+                {
+                    plane = rgb;
+                }
+                int in_size = bench_src_bytes(&c);
+                int out_size = (op == BENCH_OP_YUYV_RGB || op == BENCH_OP_Y14_RGB) ? pix_num * 3 : in_size;
+                memcpy(input, plane, in_size);
+                memcpy(src, plane, in_size);
+                bench_run(&c, 0, 0, min_ms);
+                bench_run(&c, 0, 1, min_ms);
+                if (in_size == out_size)
+                {
+                    //the in place call keeps transforming its own output, the cost is the same
+                    c.dst = src;
+                    bench_run(&c, 1, 0, min_ms);
+                    c.dst = dst;
+                }
+                if (bench_op_names[op][1] != NULL)
+                {
+                    c.replacement = 1;
+                    memcpy(src, plane, in_size);
+                    bench_run(&c, 0, 0, min_ms);
+                    bench_run(&c, 0, 1, min_ms);
+                    c.replacement = 0;
+                }
+                bench_check(&c, input, ref, dst, out_size);
+            }
+        }
+    }
+    free(y14);
+    free(yuyv);
+    free(rgb);
+    free(input);
+    free(src);
+    free(dst);
+    free(tmp);
+    free(ref);
+    free(bench_flush_buffer);
+    palette_release();
+    return 0;
+}
@@ -0,0 +1,696 @@
+#include "blackbox.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "flash.h"
+
+#define BLACKBOX_CRC_START offsetof(BlackboxRecordHeader_t, type)
+
+static uint64_t blackbox_align(uint64_t size)
+{
+    return (size + BLACKBOX_ALIGN - 1) / BLACKBOX_ALIGN * BLACKBOX_ALIGN;
+}
+
+static int64_t blackbox_wall_offset(void)
+{
+    struct timespec wall;
+    timespec_get(&wall, TIME_UTC);
+    return (int64_t)wall.tv_sec * 1000000 + wall.tv_nsec / 1000 - (int64_t)get_monotonic_us();
+}
+
+//with mutex held: room for size bytes at write_offset, the ring wraps when they do not fit before the end. the
+//tail keeps its older records, the reader finds them by their crc
+static uint8_t* blackbox_reserve(BlackBox_t* box, uint32_t size)
+{
+    if (box->write_offset + size > box->header->data_size)
+    {
+        box->write_offset = 0;
+        box->laps++;
+        box->dirty_laps++;
+        box->stats.laps++;
+    }
+    return box->data + box->write_offset;
+}
+
+//with mutex held: the header of a filled record, the crc over all of it and the magic last
+static void blackbox_commit(BlackBox_t* box, uint8_t* record, uint16_t type, uint32_t used, uint64_t timestamp_us)
+{
+    uint32_t size = (uint32_t)blackbox_align(used);
+    memset(record + used, 0, size - used);
+    BlackboxRecordHeader_t* record_header = (BlackboxRecordHeader_t*)record;
+    record_header->type = type;
+    record_header->reserved = 0;
+    record_header->size = size;
+    record_header->seq = box->next_seq++;
+    record_header->timestamp_us = timestamp_us;
+    record_header->crc = flash_crc32(0, record + BLACKBOX_CRC_START, size - BLACKBOX_CRC_START);
+    record_header->magic = BLACKBOX_RECORD_MAGIC;
+    box->write_offset += size;
+    box->stats.bytes += size;
+}
+
+//a plane as it came, or coded when the plane has a codec. returns the bytes stored
+static uint32_t blackbox_plane_store(CodecContext_t* codec, const uint8_t* data, uint32_t byte_size, uint8_t* dst, \
+    uint32_t* coded_size)
+{
+    *coded_size = 0;
+    if (codec->pix_num > 0)
+    {
+        int size = codec_encode(codec, (const uint16_t*)data, dst, codec_bound(codec->pix_num), 0);
+        if (size > 0)
+        {
+            *coded_size = (uint32_t)size;
+            return (uint32_t)size;
+        }
+        //the next coded frame has to decode without this one
+        codec_reset(codec);
+    }
+    memcpy(dst, data, byte_size);
+    return byte_size;
+}
+
+//ring task: the frame into the mapping, coded, never waits for the disk
+static void blackbox_task(FrameSlot_t* slot, void* arg)
+{
+    BlackBox_t* box = (BlackBox_t*)arg;
+    uint64_t start_us = get_monotonic_us();
+    sync_mutex_lock(&box->mutex);
+    if (!box->running)
+    {
+        sync_mutex_unlock(&box->mutex);
+        return;
+    }
+    uint32_t interval = (box->param.frame_interval > 1) ? box->param.frame_interval : 1;
+    if (box->frame_cnt++ % interval != 0)
+    {
+        box->stats.skipped++;
+        sync_mutex_unlock(&box->mutex);
+        return;
+    }
+    const BlackboxFileHeader_t* header = box->header;
+    //after a stream mode switch the planes may be other than the box's header describes
+    if (slot->desc.image.byte_size < header->image_byte_size || slot->desc.temp.byte_size < header->temp_byte_size)
+    {
+        sync_mutex_unlock(&box->mutex);
+        return;
+    }
+    uint8_t* record = blackbox_reserve(box, box->record_max);
+    BlackboxFrame_t* frame = (BlackboxFrame_t*)(record + sizeof(BlackboxRecordHeader_t));
+    const FrameDesc_t* desc = &slot->desc;
+    memset(frame, 0, sizeof(BlackboxFrame_t));
+    frame->frame_seq = desc->seq;
+    frame->capture_us = desc->capture_us;
+    frame->frame_index = box->frame_index++;
+    frame->flags = desc->flags;
+    if (desc->flags & FRAME_DESC_META)
+    {
+        frame->counter = desc->meta.counter;
+        frame->vtemp = desc->meta.vtemp;
+    }
+    if (desc->temp_stats != NULL && desc->temp_stats->valid)
+    {
+        frame->temp_min = desc->temp_stats->min_val;
+        frame->temp_max = desc->temp_stats->max_val;
+        frame->temp_avr = (uint16_t)(desc->temp_stats->mean + 0.5f);
+    }
+    uint32_t used = sizeof(BlackboxRecordHeader_t) + sizeof(BlackboxFrame_t);
+    if (header->image_byte_size > 0)
+    {
+        used += blackbox_plane_store(&box->image_codec, desc->image.data, header->image_byte_size, record + used, \
+            &frame->image_coded_size);
+    }
+    if (header->temp_byte_size > 0)
+    {
+        used += blackbox_plane_store(&box->temp_codec, desc->temp.data, header->temp_byte_size, record + used, \
+            &frame->temp_coded_size);
+    }
+    blackbox_commit(box, record, BLACKBOX_RECORD_FRAME, used, desc->timestamp_us);
+    box->stats.frames++;
+    box->stats.plane_bytes += header->image_byte_size + header->temp_byte_size;
+    uint64_t write_us = get_monotonic_us() - start_us;
+    box->stats.write_max_us = (write_us > box->stats.write_max_us) ? write_us : box->stats.write_max_us;
+    sync_mutex_unlock(&box->mutex);
+}
+
+//an event record of size bytes of payload
+static void blackbox_event(BlackBox_t* box, uint16_t type, const void* payload, uint32_t size)
+{
+    if (box == NULL)
+    {
+        return;
+    }
+    uint64_t timestamp_us = get_monotonic_us();
+    sync_mutex_lock(&box->mutex);
+    if (box->running)
+    {
+        uint32_t used = sizeof(BlackboxRecordHeader_t) + size;
+        uint8_t* record = blackbox_reserve(box, (uint32_t)blackbox_align(used));
+        memcpy(record + sizeof(BlackboxRecordHeader_t), payload, size);
+        blackbox_commit(box, record, type, used, timestamp_us);
+        box->stats.events++;
+    }
+    sync_mutex_unlock(&box->mutex);
+}
+
+void blackbox_alarm(BlackBox_t* box, const AlarmEvent_t* event)
+{
+    if (event != NULL)
+    {
+        blackbox_event(box, BLACKBOX_RECORD_ALARM, event, sizeof(AlarmEvent_t));
+    }
+}
+
+void blackbox_note(BlackBox_t* box, const char* text)
+{
+    if (text == NULL)
+    {
+        return;
+    }
+    char line[BLACKBOX_TEXT_LEN];
+    memset(line, 0, sizeof(line));
+    strncpy(line, text, sizeof(line) - 1);
+    blackbox_event(box, BLACKBOX_RECORD_NOTE, line, sizeof(line));
+}
+
+#if !defined(_WIN32)
+//msync a range of the data, page aligned
+static void blackbox_msync(BlackBox_t* box, uint64_t offset, uint64_t end)
+{
+    if (end <= offset)
+    {
+        return;
+    }
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t start = (BLACKBOX_HEADER_SIZE + offset) / page * page;
+    msync(box->map + start, (size_t)(BLACKBOX_HEADER_SIZE + end - start), MS_SYNC);
+}
+
+//what was written since the last call goes to the disk, then the header's hints
+static void blackbox_sync(BlackBox_t* box)
+{
+    sync_mutex_lock(&box->mutex);
+    uint64_t dirty_offset = box->dirty_offset;
+    uint32_t dirty_laps = box->dirty_laps;
+    uint64_t write_offset = box->write_offset;
+    box->dirty_offset = write_offset;
+    box->dirty_laps = 0;
+    sync_mutex_unlock(&box->mutex);
+
+    uint64_t start_us = get_monotonic_us();
+    uint64_t data_size = box->header->data_size;
+    if (dirty_laps == 0)
+    {
+        blackbox_msync(box, dirty_offset, write_offset);
+    }
+    else if (dirty_laps == 1 && dirty_offset > write_offset)
+    {
+        blackbox_msync(box, dirty_offset, data_size);
+        blackbox_msync(box, 0, write_offset);
+    }
+    else
+    {
+        blackbox_msync(box, 0, data_size);
+    }
+    //the hints can trail the records, the reader goes by the crcs
+    sync_mutex_lock(&box->mutex);
+    BlackboxFileHeader_t* header = box->header;
+    header->write_offset = write_offset;
+    header->next_seq = box->next_seq;
+    header->laps = box->laps;
+    header->synced_us = get_monotonic_us();
+    header->wall_offset_us = blackbox_wall_offset();
+    sync_mutex_unlock(&box->mutex);
+    msync(box->map, BLACKBOX_HEADER_SIZE, MS_SYNC);
+    uint64_t sync_us = get_monotonic_us() - start_us;
+    sync_mutex_lock(&box->mutex);
+    box->stats.syncs++;
+    box->stats.sync_max_us = (sync_us > box->stats.sync_max_us) ? sync_us : box->stats.sync_max_us;
+    sync_mutex_unlock(&box->mutex);
+}
+
+static void* blackbox_sync_function(void* arg)
+{
+    BlackBox_t* box = (BlackBox_t*)arg;
+    sync_mutex_lock(&box->mutex);
+    while (box->running)
+    {
+        sync_deadline_t deadline;
+        sync_deadline_set(&deadline, box->param.sync_ms);
+        while (box->running && sync_cond_wait_until(&box->cond, &box->mutex, &deadline) != SYNC_TIMEOUT)
+        {
+        }
+        sync_mutex_unlock(&box->mutex);
+        blackbox_sync(box);
+        sync_mutex_lock(&box->mutex);
+    }
+    sync_mutex_unlock(&box->mutex);
+    return NULL;
+}
+
+//a box of an earlier run is what the crash left, it moves aside instead of being overwritten
+static void blackbox_keep_previous(const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return;
+    }
+    uint32_t magic = 0;
+    size_t got = fread(&magic, sizeof(magic), 1, fp);
+    fclose(fp);
+    if (got == 1 && magic == BLACKBOX_MAGIC)
+    {
+        char prev[BLACKBOX_PATH_LEN + 8];
+        snprintf(prev, sizeof(prev), "%s.prev", path);
+        if (rename(path, prev) == 0)
+        {
+            printf("black box: the last one kept as %s\n", prev);
+        }
+    }
+}
+#endif
+
+int blackbox_attach(BlackBox_t* box, StreamFrameInfo_t* stream_frame_info)
+{
+    if (box == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return BLACKBOX_ERROR_PARAM;
+    }
+    memset(box, 0, sizeof(BlackBox_t));
+    box->stream_frame_info = stream_frame_info;
+    box->fd = -1;
+    sync_mutex_init(&box->mutex);
+    sync_cond_init(&box->cond);
+    //every frame in order, one the task can not keep up with is the consumer's drop, not the stream's
+    box->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, \
+        POOL_STAGE_RECORD, blackbox_task, box);
+    if (box->consumer_id < 0)
+    {
+        sync_mutex_destroy(&box->mutex);
+        sync_cond_destroy(&box->cond);
+        return BLACKBOX_ERROR_PARAM;
+    }
+    return BLACKBOX_SUCCESS;
+}
+
+int blackbox_start(BlackBox_t* box, const BlackboxParam_t* param)
+{
+    if (box == NULL || param == NULL || box->stream_frame_info == NULL || param->path[0] == 0 || box->running)
+    {
+        return BLACKBOX_ERROR_PARAM;
+    }
+#if defined(_WIN32)
+    return BLACKBOX_ERROR_FILE;
+#else
+    box->param = *param;
+    box->param.size_mb = (param->size_mb > 0) ? param->size_mb : BLACKBOX_DEFAULT_SIZE_MB;
+    box->param.sync_ms = (param->sync_ms > 0) ? param->sync_ms : BLACKBOX_DEFAULT_SYNC_MS;
+    box->param.key_interval = (param->key_interval > 0) ? param->key_interval : BLACKBOX_DEFAULT_KEY_INTERVAL;
+    if (box->param.size_mb < BLACKBOX_MIN_SIZE_MB)
+    {
+        return BLACKBOX_ERROR_PARAM;
+    }
+
+    //a coded plane needs a 16 bit sample per pixel, other planes are stored as they came
+    const StreamConfig_t* config = box->stream_frame_info->config;
+    BlackboxFileHeader_t header;
+    memset(&header, 0, sizeof(BlackboxFileHeader_t));
+    header.magic = BLACKBOX_MAGIC;
+    header.version = BLACKBOX_VERSION;
+    header.header_size = BLACKBOX_HEADER_SIZE;
+    header.align = BLACKBOX_ALIGN;
+    header.image_width = config->image_info.width;
+    header.image_height = config->image_info.height;
+    header.image_byte_size = box->param.no_image ? 0 : config->image_byte_size;
+    header.image_format = config->image_info.input_format;
+    header.temp_width = config->temp_info.width;
+    header.temp_height = config->temp_info.height;
+    header.temp_byte_size = config->temp_byte_size;
+    header.fps = config->camera_param.fps;
+    header.wall_offset_us = blackbox_wall_offset();
+    header.next_seq = 1;
+    memset(&box->image_codec, 0, sizeof(CodecContext_t));
+    memset(&box->temp_codec, 0, sizeof(CodecContext_t));
+    uint32_t image_size = header.image_byte_size, temp_size = header.temp_byte_size;
+    if (image_size > 0 && image_size == header.image_width * header.image_height * 2)
+    {
+        image_size = codec_bound(header.image_width * header.image_height);
+        if (codec_init(&box->image_codec, header.image_width, header.image_height, box->param.key_interval) != \
+            CODEC_SUCCESS)
+        {
+            return BLACKBOX_ERROR_MEM;
+        }
+    }
+    if (temp_size > 0 && temp_size == header.temp_width * header.temp_height * 2)
+    {
+        temp_size = codec_bound(header.temp_width * header.temp_height);
+        if (codec_init(&box->temp_codec, header.temp_width, header.temp_height, box->param.key_interval) != \
+            CODEC_SUCCESS)
+        {
+            codec_release(&box->image_codec);
+            return BLACKBOX_ERROR_MEM;
+        }
+    }
+    //the coded planes may come out larger than stored ones, a record has room for the larger of the two
+    image_size = (image_size > header.image_byte_size) ? image_size : header.image_byte_size;
+    temp_size = (temp_size > header.temp_byte_size) ? temp_size : header.temp_byte_size;
+    box->record_max = (uint32_t)blackbox_align(sizeof(BlackboxRecordHeader_t) + sizeof(BlackboxFrame_t) + \
+        image_size + temp_size);
+    box->map_size = (uint64_t)box->param.size_mb << 20;
+    header.data_size = box->map_size - BLACKBOX_HEADER_SIZE;
+    if (header.data_size < 2ull * box->record_max)
+    {
+        codec_release(&box->image_codec);
+        codec_release(&box->temp_codec);
+        return BLACKBOX_ERROR_PARAM;
+    }
+
+    //the blocks are allocated up front: a write into the mapping never finds the disk full, where a sparse file
+    //would take the process down with SIGBUS
+    blackbox_keep_previous(box->param.path);
+    box->fd = open(box->param.path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    int rst = (box->fd >= 0) ? posix_fallocate(box->fd, 0, (off_t)box->map_size) : -1;
+    void* map = (rst == 0) ? mmap(NULL, (size_t)box->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, box->fd, 0) : \
+        MAP_FAILED;
+    if (map == MAP_FAILED)
+    {
+        printf("black box: %s of %u MB can not be created\n", box->param.path, box->param.size_mb);
+        if (box->fd >= 0)
+        {
+            close(box->fd);
+            box->fd = -1;
+        }
+        codec_release(&box->image_codec);
+        codec_release(&box->temp_codec);
+        return BLACKBOX_ERROR_FILE;
+    }
+    box->map = (uint8_t*)map;
+    box->header = (BlackboxFileHeader_t*)box->map;
+    memcpy(box->header, &header, sizeof(BlackboxFileHeader_t));
+    msync(box->map, BLACKBOX_HEADER_SIZE, MS_SYNC);
+    box->data = box->map + BLACKBOX_HEADER_SIZE;
+    box->write_offset = 0;
+    box->next_seq = 1;
+    box->frame_index = 0;
+    box->frame_cnt = 0;
+    box->laps = 0;
+    box->dirty_offset = 0;
+    box->dirty_laps = 0;
+    memset(&box->stats, 0, sizeof(BlackboxStats_t));
+
+    box->running = 1;
+    if (pthread_create(&box->sync_thread, NULL, blackbox_sync_function, box) != 0)
+    {
+        box->running = 0;
+        munmap(box->map, (size_t)box->map_size);
+        box->map = NULL;
+        close(box->fd);
+        box->fd = -1;
+        codec_release(&box->image_codec);
+        codec_release(&box->temp_codec);
+        return BLACKBOX_ERROR_MEM;
+    }
+    blackbox_note(box, "start");
+    printf("black box: %s, %u MB, synced every %u ms, at least %.1f s at %u fps\n", box->param.path, \
+        box->param.size_mb, box->param.sync_ms, (double)header.data_size / box->record_max / \
+        (header.fps ? header.fps : 1) * ((box->param.frame_interval > 1) ? box->param.frame_interval : 1), header.fps);
+    return BLACKBOX_SUCCESS;
+#endif
+}
+
+int blackbox_stop(BlackBox_t* box)
+{
+    if (box == NULL)
+    {
+        return BLACKBOX_ERROR_PARAM;
+    }
+#if defined(_WIN32)
+    return BLACKBOX_SUCCESS;
+#else
+    if (!box->running)
+    {
+        return BLACKBOX_SUCCESS;
+    }
+    blackbox_note(box, "stop");
+    sync_mutex_lock(&box->mutex);
+    box->running = 0;
+    sync_cond_broadcast(&box->cond);
+    sync_mutex_unlock(&box->mutex);
+    //the sync thread leaves with a last sync of everything up to the stop note
+    pthread_join(box->sync_thread, NULL);
+    munmap(box->map, (size_t)box->map_size);
+    box->map = NULL;
+    box->header = NULL;
+    box->data = NULL;
+    close(box->fd);
+    box->fd = -1;
+    codec_release(&box->image_codec);
+    codec_release(&box->temp_codec);
+    return BLACKBOX_SUCCESS;
+#endif
+}
+
+int blackbox_stats(BlackBox_t* box, BlackboxStats_t* stats)
+{
+    if (box == NULL || stats == NULL)
+    {
+        return BLACKBOX_ERROR_PARAM;
+    }
+    sync_mutex_lock(&box->mutex);
+    *stats = box->stats;
+    sync_mutex_unlock(&box->mutex);
+    return BLACKBOX_SUCCESS;
+}
+
+static int blackbox_entry_compare(const void* a, const void* b)
+{
+    uint64_t sa = ((const BlackboxEntry_t*)a)->seq, sb = ((const BlackboxEntry_t*)b)->seq;
+    return (sa < sb) ? -1 : (sa > sb);
+}
+
+int blackbox_reader_open(BlackboxReader_t* reader, const char* path)
+{
+    if (reader == NULL || path == NULL)
+    {
+        return BLACKBOX_ERROR_PARAM;
+    }
+    memset(reader, 0, sizeof(BlackboxReader_t));
+    reader->fd = -1;
+#if defined(_WIN32)
+    return BLACKBOX_ERROR_FILE;
+#else
+    reader->fd = open(path, O_RDONLY);
+    struct stat st;
+    if (reader->fd < 0 || fstat(reader->fd, &st) != 0 || (uint64_t)st.st_size < BLACKBOX_HEADER_SIZE)
+    {
+        blackbox_reader_close(reader);
+        return BLACKBOX_ERROR_FILE;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        blackbox_reader_close(reader);
+        return BLACKBOX_ERROR_FILE;
+    }
+    reader->map = (const uint8_t*)map;
+    reader->map_size = (uint64_t)st.st_size;
+    memcpy(&reader->header, reader->map, sizeof(BlackboxFileHeader_t));
+    const BlackboxFileHeader_t* header = &reader->header;
+    if (header->magic != BLACKBOX_MAGIC || header->version != BLACKBOX_VERSION || \
+        header->header_size != BLACKBOX_HEADER_SIZE || header->align != BLACKBOX_ALIGN || \
+        header->data_size > reader->map_size - BLACKBOX_HEADER_SIZE)
+    {
+        blackbox_reader_close(reader);
+        return BLACKBOX_ERROR_FORMAT;
+    }
+    reader->data = reader->map + BLACKBOX_HEADER_SIZE;
+
+    //every aligned offset may start a record: the ring wrapped at some of them and a newer record may have cut
+    //into an older one anywhere, only the crc tells which survived whole
+    uint32_t capacity = 1024;
+    reader->entries = (BlackboxEntry_t*)malloc(capacity * sizeof(BlackboxEntry_t));
+    if (reader->entries == NULL)
+    {
+        blackbox_reader_close(reader);
+        return BLACKBOX_ERROR_MEM;
+    }
+    BlackboxRecovery_t* recovery = &reader->recovery;
+    uint64_t offset = 0;
+    while (offset + sizeof(BlackboxRecordHeader_t) <= header->data_size)
+    {
+        const BlackboxRecordHeader_t* record = (const BlackboxRecordHeader_t*)(reader->data + offset);
+        if (record->magic != BLACKBOX_RECORD_MAGIC)
+        {
+            offset += BLACKBOX_ALIGN;
+            continue;
+        }
+        if (record->size < sizeof(BlackboxRecordHeader_t) || record->size % BLACKBOX_ALIGN != 0 || \
+            offset + record->size > header->data_size || \
+            flash_crc32(0, (const uint8_t*)record + BLACKBOX_CRC_START, record->size - BLACKBOX_CRC_START) != \
+            record->crc)
+        {
+            recovery->torn++;
+            offset += BLACKBOX_ALIGN;
+            continue;
+        }
+        if (reader->entry_num == capacity)
+        {
+            BlackboxEntry_t* entries = (BlackboxEntry_t*)realloc(reader->entries, \
+                capacity * 2 * sizeof(BlackboxEntry_t));
+            if (entries == NULL)
+            {
+                blackbox_reader_close(reader);
+                return BLACKBOX_ERROR_MEM;
+            }
+            reader->entries = entries;
+            capacity *= 2;
+        }
+        BlackboxEntry_t* entry = &reader->entries[reader->entry_num++];
+        entry->seq = record->seq;
+        entry->timestamp_us = record->timestamp_us;
+        entry->type = record->type;
+        entry->offset = offset;
+        recovery->records++;
+        recovery->frames += (record->type == BLACKBOX_RECORD_FRAME);
+        recovery->events += (record->type != BLACKBOX_RECORD_FRAME);
+        offset += record->size;
+    }
+    qsort(reader->entries, reader->entry_num, sizeof(BlackboxEntry_t), blackbox_entry_compare);
+    for (uint32_t i = 1; i < reader->entry_num; i++)
+    {
+        recovery->gaps += (reader->entries[i].seq != reader->entries[i - 1].seq + 1);
+    }
+
+    if ((header->image_byte_size > 0 && header->image_byte_size == header->image_width * header->image_height * 2 && \
+        codec_init(&reader->image_codec, header->image_width, header->image_height, 0) != CODEC_SUCCESS) || \
+        (header->temp_byte_size > 0 && header->temp_byte_size == header->temp_width * header->temp_height * 2 && \
+        codec_init(&reader->temp_codec, header->temp_width, header->temp_height, 0) != CODEC_SUCCESS))
+    {
+        blackbox_reader_close(reader);
+        return BLACKBOX_ERROR_MEM;
+    }
+    return BLACKBOX_SUCCESS;
+#endif
+}
+
+//one stored plane into data, decoded when coded. the codec keeps the reference either way
+static int blackbox_reader_plane(CodecContext_t* codec, const uint8_t* src, uint32_t byte_size, uint32_t coded_size, \
+    uint8_t* data)
+{
+    if (coded_size == 0)
+    {
+        //stored as it came: the encoder failed and reset, its next frame is a keyframe
+        codec_reset(codec);
+        if (data != NULL)
+        {
+            memcpy(data, src, byte_size);
+        }
+        return CODEC_SUCCESS;
+    }
+    if (codec->pix_num == 0)
+    {
+        return CODEC_ERROR_FORMAT;
+    }
+    return codec_decode(codec, src, coded_size, (uint16_t*)data);
+}
+
+int blackbox_reader_next(BlackboxReader_t* reader, BlackboxItem_t* item, uint8_t* image, uint8_t* temp)
+{
+    if (reader == NULL || item == NULL || reader->map == NULL)
+    {
+        return BLACKBOX_ERROR_PARAM;
+    }
+    if (reader->entry_cur >= reader->entry_num)
+    {
+        return BLACKBOX_END;
+    }
+    const BlackboxEntry_t* entry = &reader->entries[reader->entry_cur++];
+    const uint8_t* record = reader->data + entry->offset;
+    const uint8_t* payload = record + sizeof(BlackboxRecordHeader_t);
+    uint32_t payload_size = ((const BlackboxRecordHeader_t*)record)->size - sizeof(BlackboxRecordHeader_t);
+    memset(item, 0, sizeof(BlackboxItem_t));
+    item->type = entry->type;
+    item->seq = entry->seq;
+    item->timestamp_us = entry->timestamp_us;
+    if (entry->type == BLACKBOX_RECORD_ALARM)
+    {
+        memcpy(&item->alarm, payload, (payload_size < sizeof(AlarmEvent_t)) ? payload_size : sizeof(AlarmEvent_t));
+        return BLACKBOX_SUCCESS;
+    }
+    if (entry->type == BLACKBOX_RECORD_NOTE)
+    {
+        memcpy(item->text, payload, (payload_size < BLACKBOX_TEXT_LEN) ? payload_size : BLACKBOX_TEXT_LEN);
+        item->text[BLACKBOX_TEXT_LEN - 1] = 0;
+        return BLACKBOX_SUCCESS;
+    }
+    if (entry->type != BLACKBOX_RECORD_FRAME || payload_size < sizeof(BlackboxFrame_t))
+    {
+        return BLACKBOX_SUCCESS;
+    }
+    memcpy(&item->frame, payload, sizeof(BlackboxFrame_t));
+    const BlackboxFrame_t* frame = &item->frame;
+    const BlackboxFileHeader_t* header = &reader->header;
+    //a delta frame decodes on the one before it only, after a gap the chain waits for the next keyframe
+    if (!reader->chain || frame->frame_index != reader->last_frame_index + 1)
+    {
+        codec_reset(&reader->image_codec);
+        codec_reset(&reader->temp_codec);
+    }
+    uint32_t image_stored = frame->image_coded_size ? frame->image_coded_size : header->image_byte_size;
+    uint32_t temp_stored = frame->temp_coded_size ? frame->temp_coded_size : header->temp_byte_size;
+    const uint8_t* planes = payload + sizeof(BlackboxFrame_t);
+    int rst = CODEC_SUCCESS;
+    if (sizeof(BlackboxFrame_t) + (uint64_t)image_stored + temp_stored > payload_size)
+    {
+        rst = CODEC_ERROR_FORMAT;
+    }
+    if (rst == CODEC_SUCCESS && header->image_byte_size > 0)
+    {
+        rst = blackbox_reader_plane(&reader->image_codec, planes, header->image_byte_size, frame->image_coded_size, \
+            image);
+    }
+    if (rst == CODEC_SUCCESS && header->temp_byte_size > 0)
+    {
+        rst = blackbox_reader_plane(&reader->temp_codec, planes + image_stored, header->temp_byte_size, \
+            frame->temp_coded_size, temp);
+    }
+    item->decoded = (rst == CODEC_SUCCESS);
+    reader->chain = item->decoded;
+    reader->last_frame_index = frame->frame_index;
+    reader->recovery.undecodable += !item->decoded;
+    return BLACKBOX_SUCCESS;
+}
+
+void blackbox_reader_close(BlackboxReader_t* reader)
+{
+    if (reader == NULL)
+    {
+        return;
+    }
+#if !defined(_WIN32)
+    if (reader->map != NULL)
+    {
+        munmap((void*)reader->map, (size_t)reader->map_size);
+    }
+    if (reader->fd >= 0)
+    {
+        close(reader->fd);
+    }
+#endif
+    free(reader->entries);
+    codec_release(&reader->image_codec);
+    codec_release(&reader->temp_codec);
+    reader->map = NULL;
+    reader->entries = NULL;
+    reader->entry_num = 0;
+    reader->fd = -1;
+}
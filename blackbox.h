@@ -0,0 +1,211 @@
+#ifndef _BLACKBOX_H_
+#define _BLACKBOX_H_
+
+//crash safe black box: the last minutes of frames and events in a fixed size file, mapped shared and written as a
+//ring. records go in one after the other (a ring task copies or codes the frame straight into the mapping, the
+//stream thread never waits for it), each one carries its sequence and a crc32, and a background thread msyncs
+//what was written every sync_ms. after a crash or a power cut the kernel has written what the last sync did not
+//lose: blackbox_reader_open scans the file for records whose crc holds and orders them by sequence, a torn or
+//half overwritten record is skipped and the coded frames decode again from the next keyframe. a box found at
+//blackbox_start is kept as <path>.prev, so a restart does not overwrite the crash it follows
+#include <stdint.h>
+#include <pthread.h>
+#include "sync.h"
+#include "data.h"
+#include "codec.h"
+#include "alarm.h"
+
+#define BLACKBOX_MAGIC 0x58424249           //"IBBX"
+#define BLACKBOX_RECORD_MAGIC 0x43524242    //"BBRC"
+#define BLACKBOX_VERSION 1
+#define BLACKBOX_HEADER_SIZE 4096           //the records start after it
+#define BLACKBOX_ALIGN 64                   //records start at and fill whole units, the reader scans in them
+#define BLACKBOX_DEFAULT_SIZE_MB 256
+#define BLACKBOX_MIN_SIZE_MB 4
+#define BLACKBOX_DEFAULT_SYNC_MS 1000
+#define BLACKBOX_DEFAULT_KEY_INTERVAL 25    //frames between keyframes, what a torn record costs at most
+#define BLACKBOX_PATH_LEN 256
+#define BLACKBOX_TEXT_LEN 96
+
+#define BLACKBOX_SUCCESS 0
+#define BLACKBOX_ERROR_PARAM -1
+#define BLACKBOX_ERROR_FILE -2              //the file can not be created, sized or mapped (windows: no mapping)
+#define BLACKBOX_ERROR_MEM -3
+#define BLACKBOX_ERROR_FORMAT -4            //not a black box, or one of another version
+#define BLACKBOX_END -5
+
+typedef enum
+{
+    BLACKBOX_RECORD_FRAME = 1,
+    BLACKBOX_RECORD_ALARM,                  //an AlarmEvent_t
+    BLACKBOX_RECORD_NOTE,                   //a line of text: start, stop, restarts, what the application adds
+}BlackboxRecordType_t;
+
+//every record, little endian. crc is flash_crc32 of the record from type to size, padding included
+typedef struct {
+    uint32_t magic;
+    uint32_t crc;
+    uint16_t type;                          //BlackboxRecordType_t
+    uint16_t reserved;
+    uint32_t size;                          //header, payload and padding, BLACKBOX_ALIGN aligned
+    uint64_t seq;                           //over all records of the box, from 1
+    uint64_t timestamp_us;                  //monotonic, header wall_offset_us makes it wall time
+}BlackboxRecordHeader_t;
+
+//BLACKBOX_RECORD_FRAME payload, then the image and the temp plane
+typedef struct {
+    uint64_t frame_seq;                     //ring sequence
+    uint64_t capture_us;
+    uint64_t frame_index;                   //frames in the box since start, a gap breaks the delta chain
+    uint32_t flags;                         //FRAME_DESC_xxx
+    uint32_t counter;                       //FRAME_DESC_META: the module's frame counter
+    uint16_t vtemp;
+    uint16_t temp_min;                      //temp plane statistics, 0 without them
+    uint16_t temp_max;
+    uint16_t temp_avr;
+    uint32_t image_coded_size;              //0: the plane is stored as it came, image_byte_size of the header
+    uint32_t temp_coded_size;
+}BlackboxFrame_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;                   //BLACKBOX_HEADER_SIZE
+    uint32_t align;                         //BLACKBOX_ALIGN
+    uint64_t data_size;                     //bytes of records after the header, the ring
+    uint32_t image_width;
+    uint32_t image_height;
+    uint32_t image_byte_size;               //0 without an image plane
+    uint32_t image_format;                  //InputFormat_t
+    uint32_t temp_width;
+    uint32_t temp_height;
+    uint32_t temp_byte_size;
+    uint32_t fps;
+    int64_t wall_offset_us;                 //realtime - monotonic, refreshed on every sync
+    //hints of the last sync, the reader does not depend on them
+    uint64_t write_offset;                  //next record, from the start of the data
+    uint64_t next_seq;
+    uint64_t synced_us;                     //monotonic
+    uint32_t laps;                          //times the ring wrapped
+    uint32_t reserved;
+}BlackboxFileHeader_t;
+
+typedef struct {
+    char path[BLACKBOX_PATH_LEN];
+    uint32_t size_mb;                       //0 selects BLACKBOX_DEFAULT_SIZE_MB
+    uint32_t sync_ms;                       //0 selects BLACKBOX_DEFAULT_SYNC_MS
+    uint32_t key_interval;                  //0 selects BLACKBOX_DEFAULT_KEY_INTERVAL
+    uint32_t frame_interval;                //keep every frame_interval-th frame, 0/1 all of them
+    uint8_t no_image;                       //1 keeps the temp plane only, about half the bytes
+}BlackboxParam_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t events;                        //alarm and note records
+    uint64_t skipped;                       //frames left out by frame_interval
+    uint64_t laps;
+    uint64_t bytes;                         //records written
+    uint64_t plane_bytes;                   //the planes as they came, bytes / plane_bytes is the ratio
+    uint64_t syncs;
+    uint64_t sync_max_us;                   //slowest msync, on the sync thread
+    uint64_t write_max_us;                  //slowest frame record, coding included
+}BlackboxStats_t;
+
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    BlackboxParam_t param;
+    int consumer_id;
+    uint8_t running;
+    int fd;
+    uint8_t* map;                           //the whole file, header first
+    uint64_t map_size;
+    BlackboxFileHeader_t* header;           //in the mapping
+    uint8_t* data;
+    uint32_t record_max;                    //largest frame record, a record that does not fit before the end wraps
+    //under mutex
+    uint64_t write_offset;
+    uint64_t next_seq;
+    uint64_t frame_index;
+    uint64_t frame_cnt;                     //frames seen, frame_interval counts on it
+    uint32_t laps;
+    uint64_t dirty_offset;                  //first byte written since the sync thread's last msync
+    uint32_t dirty_laps;                    //laps since then, the whole ring once it is more than one
+    CodecContext_t image_codec;             //pix_num 0 when the plane is stored as it came
+    CodecContext_t temp_codec;
+    BlackboxStats_t stats;
+    pthread_t sync_thread;
+    sync_mutex_t mutex;
+    sync_cond_t cond;                       //wakes the sync thread to stop
+}BlackBox_t;
+
+//register the black box as a task consumer of the camera's frame ring, before streaming
+int blackbox_attach(BlackBox_t* box, StreamFrameInfo_t* stream_frame_info);
+
+//create and map param->path at its full size, start taking frames and the sync thread
+int blackbox_start(BlackBox_t* box, const BlackboxParam_t* param);
+
+//a last sync, then unmap and close. the file stays a readable box
+int blackbox_stop(BlackBox_t* box);
+
+//an alarm engine event into the box, from any thread
+void blackbox_alarm(BlackBox_t* box, const AlarmEvent_t* event);
+
+//a line of text into the box, from any thread
+void blackbox_note(BlackBox_t* box, const char* text);
+
+int blackbox_stats(BlackBox_t* box, BlackboxStats_t* stats);
+
+//one record of the recovered timeline
+typedef struct {
+    uint64_t seq;
+    uint64_t timestamp_us;
+    uint16_t type;
+    uint64_t offset;                        //record, from the start of the data
+}BlackboxEntry_t;
+
+typedef struct {
+    uint64_t records;                       //found with a good crc
+    uint64_t frames;
+    uint64_t events;
+    uint64_t torn;                          //a record header whose crc fails, the one write that was cut
+    uint64_t gaps;                          //breaks in the sequence, overwritten by the ring or torn
+    uint64_t undecodable;                   //delta frames before the next keyframe after a gap
+}BlackboxRecovery_t;
+
+//the recovered timeline of a box, oldest first. an item is a frame or an event
+typedef struct {
+    uint16_t type;                          //BlackboxRecordType_t
+    uint64_t seq;
+    uint64_t timestamp_us;
+    BlackboxFrame_t frame;                  //BLACKBOX_RECORD_FRAME
+    uint8_t decoded;                        //the planes were filled, 0 for a delta frame without its reference
+    AlarmEvent_t alarm;                     //BLACKBOX_RECORD_ALARM
+    char text[BLACKBOX_TEXT_LEN];           //BLACKBOX_RECORD_NOTE
+}BlackboxItem_t;
+
+typedef struct {
+    int fd;
+    const uint8_t* map;
+    uint64_t map_size;
+    BlackboxFileHeader_t header;
+    const uint8_t* data;
+    BlackboxEntry_t* entries;
+    uint32_t entry_num;
+    uint32_t entry_cur;
+    uint64_t last_frame_index;              //of the last frame decoded, the delta chain
+    uint8_t chain;                          //the codecs hold the reference of last_frame_index
+    CodecContext_t image_codec;
+    CodecContext_t temp_codec;
+    BlackboxRecovery_t recovery;
+}BlackboxReader_t;
+
+//map a box read only and rebuild its timeline, whether or not it was stopped cleanly
+int blackbox_reader_open(BlackboxReader_t* reader, const char* path);
+
+//the next item in sequence order, image/temp (header image_byte_size/temp_byte_size) NULL leave the planes.
+//returns BLACKBOX_END after the last one
+int blackbox_reader_next(BlackboxReader_t* reader, BlackboxItem_t* item, uint8_t* image, uint8_t* temp);
+
+void blackbox_reader_close(BlackboxReader_t* reader);
+
+#endif
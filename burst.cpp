@@ -0,0 +1,233 @@
+#include "burst.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pool.h"
+
+int burst_init(Burst_t* burst, StreamFrameInfo_t* stream_frame_info, uint32_t frames, BurstDoneFunc_t done, \
+    void* done_arg)
+{
+    if (burst == NULL || stream_frame_info == NULL || frames == 0 || frames > BURST_MAX_FRAMES || \
+        stream_frame_info->camera_param.frame_size == 0)
+    {
+        return BURST_ERROR_PARAM;
+    }
+    memset(&burst->block, 0, sizeof(BurstBlock_t));
+    memset(&burst->stats, 0, sizeof(BurstStats_t));
+    burst->stream_frame_info = stream_frame_info;
+    burst->done = done;
+    burst->done_arg = done_arg;
+    burst->state = BURST_STATE_ARMED;
+    burst->triggered.store(0, std::memory_order_relaxed);
+
+    BurstBlock_t* block = &burst->block;
+    block->frame_size = stream_frame_info->camera_param.frame_size;
+    block->frame_stride = (uint32_t)FRAME_POOL_ROUND(block->frame_size);
+    block->image_byte_size = stream_frame_info->image_byte_size;
+    block->temp_byte_size = stream_frame_info->temp_byte_size;
+    block->info_byte_size = stream_frame_info->info_byte_size;
+    //one region, touched and locked before the first trigger: a burst never waits for a page fault
+    FramePoolParam_t pool_param;
+    frame_pool_default_param(&pool_param);
+    pool_param.lock = 1;
+    size_t size = (size_t)frames * block->frame_stride;
+    if (frame_pool_create(&burst->pool, &pool_param, size) != FRAME_POOL_SUCCESS)
+    {
+        return BURST_ERROR_MEM;
+    }
+    block->data = (uint8_t*)frame_pool_alloc(&burst->pool, size);
+    block->timestamps_us = (uint64_t*)calloc(frames, sizeof(uint64_t));
+    if (block->data == NULL || block->timestamps_us == NULL)
+    {
+        free(block->timestamps_us);
+        frame_pool_destroy(&burst->pool);
+        return BURST_ERROR_MEM;
+    }
+    burst->capacity = frames;
+    sync_mutex_init(&burst->mutex);
+    sync_cond_init(&burst->cond);
+    stream_frame_info->burst = burst;
+    printf("burst: %u frames of %u bytes, %s pages%s\n", frames, block->frame_size, \
+        frame_pool_page_name(burst->pool.page), burst->pool.locked ? ", locked" : "");
+    return BURST_SUCCESS;
+}
+
+void burst_destroy(Burst_t* burst)
+{
+    if (burst == NULL || burst->block.data == NULL)
+    {
+        return;
+    }
+    if (burst->stream_frame_info != NULL && burst->stream_frame_info->burst == burst)
+    {
+        burst->stream_frame_info->burst = NULL;
+    }
+    //a done task still holds the block
+    sync_mutex_lock(&burst->mutex);
+    while (burst->state == BURST_STATE_DONE && burst->done != NULL)
+    {
+        sync_cond_wait(&burst->cond, &burst->mutex);
+    }
+    sync_mutex_unlock(&burst->mutex);
+    free(burst->block.timestamps_us);
+    frame_pool_destroy(&burst->pool);
+    memset(&burst->block, 0, sizeof(BurstBlock_t));
+    sync_mutex_destroy(&burst->mutex);
+    sync_cond_destroy(&burst->cond);
+}
+
+int burst_trigger(Burst_t* burst)
+{
+    if (burst == NULL || burst->block.data == NULL)
+    {
+        return BURST_ERROR_PARAM;
+    }
+    sync_mutex_lock(&burst->mutex);
+    if (burst->state != BURST_STATE_ARMED)
+    {
+        burst->stats.busy++;
+        sync_mutex_unlock(&burst->mutex);
+        return BURST_ERROR_BUSY;
+    }
+    burst->state = BURST_STATE_TRIGGERED;
+    burst->block.trigger_us = get_monotonic_us();
+    burst->stats.triggers++;
+    burst->triggered.store(1, std::memory_order_release);
+    sync_mutex_unlock(&burst->mutex);
+    return BURST_SUCCESS;
+}
+
+int burst_wait(Burst_t* burst, uint32_t timeout_ms, const BurstBlock_t** block)
+{
+    if (burst == NULL || block == NULL || burst->done != NULL)
+    {
+        return BURST_ERROR_PARAM;
+    }
+    sync_deadline_t deadline;
+    sync_deadline_set(&deadline, timeout_ms);
+    sync_mutex_lock(&burst->mutex);
+    while (burst->state != BURST_STATE_DONE)
+    {
+        if (timeout_ms == 0)
+        {
+            sync_cond_wait(&burst->cond, &burst->mutex);
+        }
+        else if (sync_cond_wait_until(&burst->cond, &burst->mutex, &deadline) == SYNC_TIMEOUT)
+        {
+            break;
+        }
+    }
+    int rst = (burst->state == BURST_STATE_DONE) ? BURST_SUCCESS : BURST_ERROR_TIMEOUT;
+    sync_mutex_unlock(&burst->mutex);
+    *block = (rst == BURST_SUCCESS) ? &burst->block : NULL;
+    return rst;
+}
+
+int burst_release(Burst_t* burst)
+{
+    if (burst == NULL)
+    {
+        return BURST_ERROR_PARAM;
+    }
+    sync_mutex_lock(&burst->mutex);
+    if (burst->state != BURST_STATE_DONE)
+    {
+        sync_mutex_unlock(&burst->mutex);
+        return BURST_ERROR_PARAM;
+    }
+    burst->state = BURST_STATE_ARMED;
+    sync_cond_broadcast(&burst->cond);
+    sync_mutex_unlock(&burst->mutex);
+    return BURST_SUCCESS;
+}
+
+void burst_capture_begin(Burst_t* burst, uint64_t first_seq)
+{
+    uint64_t now_us = get_monotonic_us();
+    sync_mutex_lock(&burst->mutex);
+    burst->state = BURST_STATE_CAPTURING;
+    burst->block.frames = 0;
+    burst->block.timeouts = 0;
+    burst->block.first_seq = first_seq;
+    uint64_t start_us = (now_us > burst->block.trigger_us) ? now_us - burst->block.trigger_us : 0;
+    if (start_us > burst->stats.start_max_us)
+    {
+        burst->stats.start_max_us = start_us;
+    }
+    sync_mutex_unlock(&burst->mutex);
+}
+
+//capture only, the stream thread alone touches the block until burst_capture_end
+uint8_t* burst_frame_next(Burst_t* burst)
+{
+    BurstBlock_t* block = &burst->block;
+    if (block->frames >= burst->capacity)
+    {
+        return NULL;
+    }
+    return block->data + (size_t)block->frames * block->frame_stride;
+}
+
+void burst_frame_done(Burst_t* burst, uint64_t timestamp_us)
+{
+    BurstBlock_t* block = &burst->block;
+    block->timestamps_us[block->frames++] = timestamp_us;
+}
+
+void burst_frame_timeout(Burst_t* burst)
+{
+    burst->block.timeouts++;
+}
+
+static void burst_done_task(void* arg)
+{
+    Burst_t* burst = (Burst_t*)arg;
+    burst->done(&burst->block, burst->done_arg);
+    burst_release(burst);
+}
+
+uint32_t burst_capture_end(Burst_t* burst)
+{
+    sync_mutex_lock(&burst->mutex);
+    uint32_t frames = burst->block.frames;
+    burst->state = BURST_STATE_DONE;
+    burst->triggered.store(0, std::memory_order_release);
+    burst->stats.bursts++;
+    burst->stats.frames += frames;
+    burst->stats.timeouts += burst->block.timeouts;
+    sync_cond_broadcast(&burst->cond);
+    sync_mutex_unlock(&burst->mutex);
+    if (burst->done != NULL)
+    {
+        //off the stream thread, it goes back to the ring right away
+        pool_submit(POOL_STAGE_OTHER, burst_done_task, burst);
+    }
+    return frames;
+}
+
+void burst_frame_planes(const BurstBlock_t* block, uint32_t index, const uint16_t** image, const uint16_t** temp)
+{
+    const uint8_t* frame = (block != NULL && index < block->frames) ? \
+        block->data + (size_t)index * block->frame_stride : NULL;
+    if (image != NULL)
+    {
+        *image = (frame != NULL && block->image_byte_size > 0) ? (const uint16_t*)frame : NULL;
+    }
+    if (temp != NULL)
+    {
+        *temp = (frame != NULL && block->temp_byte_size > 0) ? \
+            (const uint16_t*)(frame + block->image_byte_size + block->info_byte_size) : NULL;
+    }
+}
+
+int burst_stats(Burst_t* burst, BurstStats_t* stats)
+{
+    if (burst == NULL || stats == NULL || burst->block.data == NULL)
+    {
+        return BURST_ERROR_PARAM;
+    }
+    sync_mutex_lock(&burst->mutex);
+    *stats = burst->stats;
+    sync_mutex_unlock(&burst->mutex);
+    return BURST_SUCCESS;
+}
@@ -0,0 +1,112 @@
+#ifndef _BURST_H_
+#define _BURST_H_
+
+//burst capture for transients: burst_init preallocates frames whole raw frames in one pinned block, burst_trigger
+//(an alarm, a command, any thread) switches the stream thread into capture only. from its next frame it reads
+//uvc_frame_get straight into the block, nothing is cut, committed or computed, so no other stage runs and no
+//busy consumer or full ring can lose one of those frames. once the block is full the stream thread goes back to
+//the ring, whose consumers see the burst as a gap in the sequence numbers, and the block is handed over whole:
+//to done on a pool task, or to burst_wait. the block stays the holder's until done returned or burst_release
+#include <stdint.h>
+#include <atomic>
+#include "data.h"
+#include "framepool.h"
+#include "sync.h"
+
+#define BURST_MAX_FRAMES 4096
+#define BURST_TIMEOUT_FRAMES 3          //failed reads in a row end a burst short, the stream thread reconnects
+
+#define BURST_SUCCESS 0
+#define BURST_ERROR_PARAM -1
+#define BURST_ERROR_MEM -2
+#define BURST_ERROR_BUSY -3             //a burst is running or its block was not released yet
+#define BURST_ERROR_TIMEOUT -4
+
+typedef enum
+{
+    BURST_STATE_ARMED = 0,              //waits for a trigger
+    BURST_STATE_TRIGGERED,              //the stream thread takes it with its next frame
+    BURST_STATE_CAPTURING,
+    BURST_STATE_DONE,                   //the block is handed over
+}BurstState_t;
+
+//the captured frames as uvc_frame_get wrote them: frame n at data + n * frame_stride, the image plane first,
+//then the info line (info_byte_size) and the temp plane, the layout zero_copy views use
+typedef struct {
+    uint8_t* data;
+    uint32_t frame_size;
+    uint32_t frame_stride;              //FRAME_POOL_ALIGN rounded
+    uint32_t frames;                    //short of the burst's when the stream ended or kept failing
+    uint32_t image_byte_size;
+    uint32_t temp_byte_size;
+    uint32_t info_byte_size;
+    uint64_t* timestamps_us;            //monotonic time each uvc_frame_get returned
+    uint64_t first_seq;                 //ring sequence the first frame would have had, the burst takes frames more
+    uint64_t trigger_us;                //burst_trigger
+    uint32_t timeouts;                  //failed reads during the burst
+}BurstBlock_t;
+
+//runs on a pool task with the full block, which is armed again once it returns
+typedef void (*BurstDoneFunc_t)(const BurstBlock_t* block, void* arg);
+
+typedef struct {
+    uint64_t triggers;                  //triggers taken, the ones while busy are not
+    uint64_t busy;                      //triggers refused because a burst was running or held
+    uint64_t bursts;
+    uint64_t frames;
+    uint64_t timeouts;
+    uint64_t start_max_us;              //trigger -> first frame of the burst
+}BurstStats_t;
+
+typedef struct Burst_t {
+    StreamFrameInfo_t* stream_frame_info;
+    BurstBlock_t block;
+    uint32_t capacity;                  //frames of the block
+    FramePool_t pool;
+    BurstDoneFunc_t done;
+    void* done_arg;
+    BurstState_t state;
+    std::atomic<uint8_t> triggered;     //what the stream thread looks at every frame
+    BurstStats_t stats;
+    sync_mutex_t mutex;
+    sync_cond_t cond;
+}Burst_t;
+
+//allocate and touch frames raw frames of the camera, mlocked where allowed, and hook the burst into its stream
+//thread. done NULL hands the block to burst_wait
+int burst_init(Burst_t* burst, StreamFrameInfo_t* stream_frame_info, uint32_t frames, BurstDoneFunc_t done, \
+    void* done_arg);
+
+//unhook it and free the block, after the stream thread left or with no burst running
+void burst_destroy(Burst_t* burst);
+
+//start a burst with the stream thread's next frame. BURST_ERROR_BUSY while one runs or is held
+int burst_trigger(Burst_t* burst);
+
+//wait for the block of a burst without done, timeout_ms 0 waits forever, then burst_release it
+int burst_wait(Burst_t* burst, uint32_t timeout_ms, const BurstBlock_t** block);
+
+//give the block back and arm the burst again
+int burst_release(Burst_t* burst);
+
+//stream thread: a burst was triggered
+static inline int burst_pending(Burst_t* burst)
+{
+    return burst != NULL && burst->triggered.load(std::memory_order_acquire);
+}
+
+//stream thread, capture only: burst_capture_begin, then burst_frame_next for the buffer of every read and
+//burst_frame_done after a good one until burst_frame_next returns NULL, then burst_capture_end
+void burst_capture_begin(Burst_t* burst, uint64_t first_seq);
+uint8_t* burst_frame_next(Burst_t* burst);
+void burst_frame_done(Burst_t* burst, uint64_t timestamp_us);
+void burst_frame_timeout(Burst_t* burst);
+//returns the frames captured
+uint32_t burst_capture_end(Burst_t* burst);
+
+//the planes of frame index of a block, NULL for a plane it has not
+void burst_frame_planes(const BurstBlock_t* block, uint32_t index, const uint16_t** image, const uint16_t** temp);
+
+int burst_stats(Burst_t* burst, BurstStats_t* stats);
+
+#endif
@@ -0,0 +1,580 @@
+#include "bus.h"
+#include "ring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+static uint32_t bus_align(uint32_t size, uint32_t align)
+{
+    return (size + align - 1) / align * align;
+}
+
+static const char* bus_name(const char* name)
+{
+    return (name != NULL && name[0] != '\0') ? name : BUS_DEFAULT_NAME;
+}
+
+static uint8_t* bus_slot_data(BusHeader_t* header, int slot)
+{
+    return (uint8_t*)header + header->header_size + (size_t)slot * header->slot_size;
+}
+
+#if defined(__linux__)
+//the mapping is shared between processes, so no FUTEX_PRIVATE_FLAG
+static void bus_futex_wait(std::atomic<uint32_t>* word, uint32_t value, uint32_t timeout_ms)
+{
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, value, &ts, NULL, 0);
+}
+
+static void bus_futex_wake(std::atomic<uint32_t>* word)
+{
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static int bus_pid_alive(int pid)
+{
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+//the leases of readers that died with them go back, their table entries are free again
+static void bus_reclaim(Bus_t* bus)
+{
+    BusHeader_t* header = bus->header;
+    uint32_t readers = 0;
+    for (int i = 0; i < BUS_MAX_READERS; i++)
+    {
+        BusReaderEntry_t* entry = &header->readers[i];
+        int pid = entry->pid.load();
+        if (pid == 0)
+        {
+            continue;
+        }
+        if (bus_pid_alive(pid))
+        {
+            readers++;
+            continue;
+        }
+        for (uint32_t s = 0; s < header->slot_num; s++)
+        {
+            bus->stats.reclaimed += entry->held[s].exchange(0);
+        }
+        entry->pid.store(0);
+    }
+    bus->stats.readers = readers;
+}
+
+//a slot no reader holds, marked WRITING. the state goes out before the leases are looked at and a reader counts
+//itself in before it looks at the state, so one of the two always sees the other
+static int bus_slot_claim(Bus_t* bus)
+{
+    BusHeader_t* header = bus->header;
+    int newest = header->newest.load();
+    for (uint32_t i = 0; i < header->slot_num; i++)
+    {
+        int slot = (int)((bus->next + i) % header->slot_num);
+        if (slot == newest)
+        {
+            continue;
+        }
+        BusSlot_t* bus_slot = &header->slots[slot];
+        int prev = bus_slot->state.load();
+        bus_slot->state.store(BUS_SLOT_WRITING);
+        uint32_t held = 0;
+        for (int r = 0; r < BUS_MAX_READERS && held == 0; r++)
+        {
+            held = header->readers[r].held[slot].load();
+        }
+        if (held == 0)
+        {
+            bus->next = (uint32_t)(slot + 1) % header->slot_num;
+            return slot;
+        }
+        bus_slot->state.store(prev);
+    }
+    return -1;
+}
+
+static void bus_plane_copy(uint8_t* dst, const BusPlane_t* layout, const FramePlane_t* plane)
+{
+    if (layout->byte_size == 0 || plane->data == NULL)
+    {
+        return;
+    }
+    memcpy(dst + layout->offset, plane->data, (plane->byte_size < layout->byte_size) ? plane->byte_size : \
+        layout->byte_size);
+}
+
+//ring task: one copy of the frame into a free slot, then wake the readers. never waits for a reader
+static void bus_task(FrameSlot_t* slot, void* arg)
+{
+    Bus_t* bus = (Bus_t*)arg;
+    pthread_mutex_lock(&bus->mutex);
+    if (!bus->running)
+    {
+        pthread_mutex_unlock(&bus->mutex);
+        return;
+    }
+    BusHeader_t* header = bus->header;
+    if (bus->stats.frames % BUS_RECLAIM_FRAMES == 0)
+    {
+        bus_reclaim(bus);
+    }
+    int index = bus_slot_claim(bus);
+    if (index < 0)
+    {
+        bus_reclaim(bus);
+        index = bus_slot_claim(bus);
+    }
+    if (index < 0)
+    {
+        bus->stats.dropped++;
+        header->dropped.store(bus->stats.dropped, std::memory_order_relaxed);
+        pthread_mutex_unlock(&bus->mutex);
+        return;
+    }
+    BusSlot_t* bus_slot = &header->slots[index];
+    uint8_t* data = bus_slot_data(header, index);
+    bus_plane_copy(data, &header->image, &slot->desc.image);
+    bus_plane_copy(data, &header->temp, &slot->desc.temp);
+    bus_slot->seq = slot->desc.seq;
+    bus_slot->timestamp_us = slot->desc.timestamp_us;
+    bus_slot->flags = slot->desc.flags;
+    bus_slot->temp_stats_valid = (header->temp.byte_size > 0 && slot->desc.temp_stats != NULL);
+    if (bus_slot->temp_stats_valid)
+    {
+        bus_slot->temp_stats = *slot->desc.temp_stats;
+    }
+    bus_slot->state.store(BUS_SLOT_READY, std::memory_order_release);
+    header->newest.store(index, std::memory_order_release);
+    bus->stats.frames++;
+    header->frames.store(bus->stats.frames, std::memory_order_relaxed);
+    header->publish.fetch_add(1, std::memory_order_release);
+    bus_futex_wake(&header->publish);
+    pthread_mutex_unlock(&bus->mutex);
+}
+
+//a bus left behind by a publisher that is gone is unlinked, a live one keeps its name
+static int bus_shm_create(Bus_t* bus, const char* name, size_t map_size)
+{
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        bus->fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (bus->fd >= 0 || errno != EEXIST)
+        {
+            break;
+        }
+        int fd = shm_open(name, O_RDONLY, 0);
+        BusHeader_t* old = NULL;
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(BusHeader_t))
+        {
+            void* map = mmap(NULL, sizeof(BusHeader_t), PROT_READ, MAP_SHARED, fd, 0);
+            old = (map != MAP_FAILED) ? (BusHeader_t*)map : NULL;
+        }
+        int busy = (old != NULL && old->magic == BUS_MAGIC && !old->closed.load() && \
+            bus_pid_alive(old->publisher_pid) && old->publisher_pid != getpid());
+        if (old != NULL)
+        {
+            munmap(old, sizeof(BusHeader_t));
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        if (busy)
+        {
+            return BUS_ERROR_BUSY;
+        }
+        shm_unlink(name);
+    }
+    if (bus->fd < 0)
+    {
+        return BUS_ERROR_OPEN;
+    }
+    if (ftruncate(bus->fd, (off_t)map_size) < 0)
+    {
+        close(bus->fd);
+        bus->fd = -1;
+        shm_unlink(name);
+        return BUS_ERROR_OPEN;
+    }
+    void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, bus->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        close(bus->fd);
+        bus->fd = -1;
+        shm_unlink(name);
+        return BUS_ERROR_MEM;
+    }
+    bus->header = (BusHeader_t*)map;
+    bus->map_size = map_size;
+    return BUS_SUCCESS;
+}
+
+static void bus_shm_close(Bus_t* bus)
+{
+    if (bus->header != NULL)
+    {
+        munmap(bus->header, bus->map_size);
+        bus->header = NULL;
+    }
+    if (bus->fd >= 0)
+    {
+        close(bus->fd);
+        bus->fd = -1;
+    }
+}
+#else
+static void bus_task(FrameSlot_t* slot, void* arg)
+{
+}
+
+static int bus_shm_create(Bus_t* bus, const char* name, size_t map_size)
+{
+    return BUS_ERROR_UNAVAILABLE;
+}
+
+static void bus_shm_close(Bus_t* bus)
+{
+}
+#endif
+
+//register the bus as a task consumer of the frame ring
+int bus_attach(Bus_t* bus, StreamFrameInfo_t* stream_frame_info)
+{
+    if (bus == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return BUS_ERROR_PARAM;
+    }
+    memset(bus, 0, sizeof(Bus_t));
+    bus->stream_frame_info = stream_frame_info;
+    bus->fd = -1;
+    pthread_mutex_init(&bus->mutex, NULL);
+    //readers want the newest frame, a slow one drops frames on its own side
+    bus->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEWEST, \
+        POOL_STAGE_ENCODE, bus_task, bus);
+    if (bus->consumer_id < 0)
+    {
+        pthread_mutex_destroy(&bus->mutex);
+        return BUS_ERROR_PARAM;
+    }
+    return BUS_SUCCESS;
+}
+
+//lay out the slots from the stream's planes and create the object
+int bus_start(Bus_t* bus, const BusParam_t* param)
+{
+    if (bus == NULL || param == NULL || bus->stream_frame_info == NULL || param->slot_num > BUS_MAX_SLOTS || \
+        (param->slot_num > 0 && param->slot_num < 2))
+    {
+        return BUS_ERROR_PARAM;
+    }
+    const StreamConfig_t* config = bus->stream_frame_info->config;
+    uint32_t image_size = (param->image) ? config->image_byte_size : 0;
+    uint32_t temp_size = (param->temp) ? config->temp_byte_size : 0;
+    if (image_size == 0 && temp_size == 0)
+    {
+        return BUS_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&bus->mutex);
+    if (bus->running)
+    {
+        pthread_mutex_unlock(&bus->mutex);
+        return BUS_ERROR_PARAM;
+    }
+    bus->param = *param;
+    bus->param.name[BUS_NAME_LEN - 1] = '\0';
+    if (bus->param.slot_num == 0)
+    {
+        bus->param.slot_num = BUS_DEFAULT_SLOTS;
+    }
+    uint32_t header_size = bus_align(sizeof(BusHeader_t), 4096);
+    uint32_t image_offset = 0;
+    uint32_t temp_offset = bus_align(image_size, BUS_ALIGN);
+    uint32_t slot_size = bus_align(temp_offset + temp_size, BUS_ALIGN);
+    size_t map_size = header_size + (size_t)bus->param.slot_num * slot_size;
+    const char* name = bus_name(bus->param.name);
+    int rst = bus_shm_create(bus, name, map_size);
+    if (rst != BUS_SUCCESS)
+    {
+        pthread_mutex_unlock(&bus->mutex);
+        return rst;
+    }
+
+    //the object is new and zero filled, the magic goes out last so a reader sees a complete header or none
+    BusHeader_t* header = bus->header;
+    header->version = BUS_VERSION;
+    header->header_size = header_size;
+    header->slot_num = bus->param.slot_num;
+    header->slot_size = slot_size;
+    header->fps = config->camera_param.fps;
+    const FrameInfo_t* infos[2] = { &config->image_info, &config->temp_info };
+    BusPlane_t* planes[2] = { &header->image, &header->temp };
+    uint32_t offsets[2] = { image_offset, temp_offset };
+    uint32_t sizes[2] = { image_size, temp_size };
+    for (int i = 0; i < 2; i++)
+    {
+        if (sizes[i] == 0)
+        {
+            continue;
+        }
+        planes[i]->offset = offsets[i];
+        planes[i]->width = infos[i]->width;
+        planes[i]->height = infos[i]->height;
+        planes[i]->stride = (infos[i]->height > 0) ? sizes[i] / infos[i]->height : 0;
+        planes[i]->byte_size = sizes[i];
+        planes[i]->input_format = (uint32_t)infos[i]->input_format;
+    }
+#if defined(__linux__)
+    header->publisher_pid = getpid();
+#endif
+    header->newest.store(-1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = BUS_MAGIC;
+    bus->next = 0;
+    memset(&bus->stats, 0, sizeof(BusStats_t));
+    bus->running = 1;
+    pthread_mutex_unlock(&bus->mutex);
+    printf("bus: %s, %u slots of %u bytes, image %ux%u, temp %ux%u\n", name, bus->param.slot_num, slot_size, \
+        header->image.width, header->image.height, header->temp.width, header->temp.height);
+    return BUS_SUCCESS;
+}
+
+int bus_stop(Bus_t* bus)
+{
+    if (bus == NULL)
+    {
+        return BUS_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&bus->mutex);
+    if (!bus->running)
+    {
+        pthread_mutex_unlock(&bus->mutex);
+        return BUS_SUCCESS;
+    }
+    bus->running = 0;
+#if defined(__linux__)
+    bus->header->closed.store(1);
+    bus->header->publish.fetch_add(1);
+    bus_futex_wake(&bus->header->publish);
+    shm_unlink(bus_name(bus->param.name));
+#endif
+    bus_shm_close(bus);
+    printf("bus: %llu frames, %llu dropped, %llu leases reclaimed\n", (unsigned long long)bus->stats.frames, \
+        (unsigned long long)bus->stats.dropped, (unsigned long long)bus->stats.reclaimed);
+    pthread_mutex_unlock(&bus->mutex);
+    return BUS_SUCCESS;
+}
+
+int bus_stats(Bus_t* bus, BusStats_t* stats)
+{
+    if (bus == NULL || stats == NULL)
+    {
+        return BUS_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&bus->mutex);
+    *stats = bus->stats;
+    pthread_mutex_unlock(&bus->mutex);
+    return BUS_SUCCESS;
+}
+
+/*************************************** reader ***************************************/
+#if defined(__linux__)
+int bus_reader_open(BusReader_t* reader, const char* name)
+{
+    if (reader == NULL)
+    {
+        return BUS_ERROR_PARAM;
+    }
+    memset(reader, 0, sizeof(BusReader_t));
+    reader->entry = -1;
+    reader->fd = shm_open(bus_name(name), O_RDWR, 0);
+    if (reader->fd < 0)
+    {
+        return BUS_ERROR_OPEN;
+    }
+    struct stat st;
+    BusHeader_t header;
+    if (fstat(reader->fd, &st) != 0 || (size_t)st.st_size < sizeof(BusHeader_t) || \
+        pread(reader->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || header.magic != BUS_MAGIC || \
+        header.version != BUS_VERSION || header.slot_num > BUS_MAX_SLOTS || \
+        (size_t)st.st_size < header.header_size + (size_t)header.slot_num * header.slot_size)
+    {
+        close(reader->fd);
+        reader->fd = -1;
+        return BUS_ERROR_OPEN;
+    }
+    reader->map_size = (size_t)st.st_size;
+    void* map = mmap(NULL, reader->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, reader->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        close(reader->fd);
+        reader->fd = -1;
+        return BUS_ERROR_MEM;
+    }
+    reader->header = (BusHeader_t*)map;
+    int pid = getpid();
+    for (int i = 0; i < BUS_MAX_READERS && reader->entry < 0; i++)
+    {
+        int expected = 0;
+        if (reader->header->readers[i].pid.compare_exchange_strong(expected, pid))
+        {
+            reader->entry = i;
+        }
+    }
+    if (reader->entry < 0)
+    {
+        bus_reader_close(reader);
+        return BUS_ERROR_BUSY;
+    }
+    return BUS_SUCCESS;
+}
+
+void bus_reader_close(BusReader_t* reader)
+{
+    if (reader == NULL)
+    {
+        return;
+    }
+    if (reader->header != NULL)
+    {
+        if (reader->entry >= 0)
+        {
+            BusReaderEntry_t* entry = &reader->header->readers[reader->entry];
+            for (int s = 0; s < BUS_MAX_SLOTS; s++)
+            {
+                entry->held[s].store(0);
+            }
+            entry->pid.store(0);
+        }
+        munmap(reader->header, reader->map_size);
+        reader->header = NULL;
+    }
+    if (reader->fd >= 0)
+    {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+    reader->entry = -1;
+}
+
+//count this reader into the slot, then check the publisher is not writing it
+static int bus_reader_lease(BusReader_t* reader, int slot)
+{
+    std::atomic<uint32_t>* held = &reader->header->readers[reader->entry].held[slot];
+    held->fetch_add(1);
+    if (reader->header->slots[slot].state.load() == BUS_SLOT_READY)
+    {
+        return 1;
+    }
+    held->fetch_sub(1);
+    return 0;
+}
+
+int bus_reader_acquire(BusReader_t* reader, uint32_t timeout_ms, BusFrame_t* frame)
+{
+    if (reader == NULL || reader->header == NULL || frame == NULL)
+    {
+        return BUS_ERROR_PARAM;
+    }
+    frame->slot = -1;
+    BusHeader_t* header = reader->header;
+    uint64_t deadline_us = get_monotonic_us() + (uint64_t)timeout_ms * 1000;
+    for (;;)
+    {
+        uint32_t publish = header->publish.load(std::memory_order_acquire);
+        if (header->closed.load())
+        {
+            return BUS_ERROR_CLOSED;
+        }
+        int slot = header->newest.load(std::memory_order_acquire);
+        if (slot >= 0 && slot < (int)header->slot_num && bus_reader_lease(reader, slot))
+        {
+            BusSlot_t* bus_slot = &header->slots[slot];
+            if (bus_slot->seq > reader->last_seq)
+            {
+                if (reader->last_seq > 0 && bus_slot->seq > reader->last_seq + 1)
+                {
+                    reader->skipped += bus_slot->seq - reader->last_seq - 1;
+                }
+                reader->last_seq = bus_slot->seq;
+                reader->frames++;
+                uint8_t* data = bus_slot_data(header, slot);
+                frame->slot = slot;
+                frame->seq = bus_slot->seq;
+                frame->timestamp_us = bus_slot->timestamp_us;
+                frame->flags = bus_slot->flags;
+                frame->image = (header->image.byte_size > 0) ? data + header->image.offset : NULL;
+                frame->temp = (header->temp.byte_size > 0) ? data + header->temp.offset : NULL;
+                frame->temp_stats = (bus_slot->temp_stats_valid) ? &bus_slot->temp_stats : NULL;
+                return BUS_SUCCESS;
+            }
+            reader->header->readers[reader->entry].held[slot].fetch_sub(1);
+        }
+        uint64_t now_us = get_monotonic_us();
+        if (now_us >= deadline_us)
+        {
+            //a publisher that was killed never closes the bus
+            return bus_pid_alive(header->publisher_pid) ? BUS_ERROR_TIMEOUT : BUS_ERROR_CLOSED;
+        }
+        //a frame between the load of publish and here changed it, the wait then returns at once
+        if (header->publish.load(std::memory_order_acquire) == publish)
+        {
+            bus_futex_wait(&header->publish, publish, (uint32_t)((deadline_us - now_us + 999) / 1000));
+        }
+    }
+}
+
+int bus_reader_release(BusReader_t* reader, BusFrame_t* frame)
+{
+    if (reader == NULL || reader->header == NULL || frame == NULL || frame->slot < 0 || \
+        frame->slot >= (int)reader->header->slot_num)
+    {
+        return BUS_ERROR_PARAM;
+    }
+    std::atomic<uint32_t>* held = &reader->header->readers[reader->entry].held[frame->slot];
+    if (held->load() > 0)
+    {
+        held->fetch_sub(1);
+    }
+    frame->slot = -1;
+    frame->image = NULL;
+    frame->temp = NULL;
+    frame->temp_stats = NULL;
+    return BUS_SUCCESS;
+}
+#else
+int bus_reader_open(BusReader_t* reader, const char* name)
+{
+    return BUS_ERROR_UNAVAILABLE;
+}
+
+void bus_reader_close(BusReader_t* reader)
+{
+}
+
+int bus_reader_acquire(BusReader_t* reader, uint32_t timeout_ms, BusFrame_t* frame)
+{
+    return BUS_ERROR_UNAVAILABLE;
+}
+
+int bus_reader_release(BusReader_t* reader, BusFrame_t* frame)
+{
+    return BUS_ERROR_UNAVAILABLE;
+}
+#endif
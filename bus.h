@@ -0,0 +1,153 @@
+#ifndef _BUS_H_
+#define _BUS_H_
+
+//frames of one camera for other processes: the publisher is a ring task consumer that copies each frame's planes
+//once into a slot of a posix shared memory object, any number of readers map the object and lease slots without
+//copying. a slot is owned through atomics in the mapping: a reader counts itself into the slot, the publisher only
+//writes a slot nobody holds and drops the frame when every slot is held. the reader table lets the publisher take
+//back the slots of a reader that died with them. readers wait on a futex of the mapping, linux only
+#include <stdint.h>
+#include <atomic>
+#include <pthread.h>
+#include "data.h"
+#include "stats.h"
+
+#define BUS_MAGIC 0x53554249            //"IBUS"
+#define BUS_VERSION 1                   //of the layout below, a reader refuses any other
+#define BUS_NAME_LEN 64
+#define BUS_DEFAULT_NAME "/ircam-bus"
+#define BUS_MAX_SLOTS 16
+#define BUS_DEFAULT_SLOTS 8             //the newest one, the one being written and what readers may hold
+#define BUS_MAX_READERS 16
+#define BUS_ALIGN 64
+#define BUS_RECLAIM_FRAMES 64          //frames between two looks at the reader table, and whenever no slot is free
+
+#define BUS_SUCCESS 0
+#define BUS_ERROR_PARAM -1
+#define BUS_ERROR_MEM -2
+#define BUS_ERROR_OPEN -3               //shm_open/mmap failed, or the object is not a bus of this version
+#define BUS_ERROR_BUSY -4               //a live publisher owns the name, or the reader table / leases are full
+#define BUS_ERROR_TIMEOUT -5
+#define BUS_ERROR_CLOSED -6             //the publisher stopped, open the name again for its next run
+#define BUS_ERROR_UNAVAILABLE -7        //posix shared memory and futexes are linux only
+
+#define BUS_SLOT_FREE 0
+#define BUS_SLOT_WRITING 1
+#define BUS_SLOT_READY 2
+
+//the layout of one plane in every slot, rows as the ring cuts them
+typedef struct {
+    uint32_t offset;                    //from the slot's start, 0 size when the stream has no such plane
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;                    //bytes per row
+    uint32_t byte_size;
+    uint32_t input_format;              //InputFormat_t of the image plane
+}BusPlane_t;
+
+typedef struct {
+    std::atomic<int> state;             //BUS_SLOT_xxx
+    std::atomic<uint32_t> readers;      //leases held by every reader together
+    uint64_t seq;                       //ring sequence, stable while the slot is held
+    uint64_t timestamp_us;              //monotonic capture time, the clock is shared by the processes of a host
+    uint32_t flags;                     //FRAME_DESC_xxx, FRAME_DESC_TEMP_SKIPPED leaves the temp plane stale
+    uint8_t temp_stats_valid;
+    FrameStats_t temp_stats;
+}BusSlot_t;
+
+typedef struct {
+    std::atomic<int> pid;               //0 for a free entry
+    std::atomic<uint32_t> held[BUS_MAX_SLOTS];  //leases of this reader per slot
+}BusReaderEntry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;               //slot data starts here, page aligned
+    uint32_t slot_num;
+    uint32_t slot_size;
+    uint32_t fps;
+    BusPlane_t image;
+    BusPlane_t temp;
+    int publisher_pid;
+    std::atomic<int> closed;
+    std::atomic<uint32_t> publish;      //bumped with every frame, the futex readers wait on
+    std::atomic<int> newest;            //slot of the newest frame, -1 before the first
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> dropped;      //every slot was held or being read
+    BusReaderEntry_t readers[BUS_MAX_READERS];
+    alignas(BUS_ALIGN) BusSlot_t slots[BUS_MAX_SLOTS];
+}BusHeader_t;
+
+typedef struct {
+    char name[BUS_NAME_LEN];            //"/name" of the shared memory object, empty selects BUS_DEFAULT_NAME
+    uint32_t slot_num;                  //0 selects BUS_DEFAULT_SLOTS, at most BUS_MAX_SLOTS
+    uint8_t image;                      //publish the image plane
+    uint8_t temp;                       //publish the temp plane
+}BusParam_t;
+
+typedef struct {
+    uint64_t frames;                    //published
+    uint64_t dropped;                   //no free slot
+    uint64_t reclaimed;                 //leases taken back from readers that died
+    uint32_t readers;                   //registered at the last publish
+}BusStats_t;
+
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    BusParam_t param;
+    int consumer_id;
+    uint8_t running;
+    int fd;
+    BusHeader_t* header;
+    size_t map_size;
+    uint32_t next;                      //where the slot search starts
+    BusStats_t stats;
+    pthread_mutex_t mutex;
+}Bus_t;
+
+//one leased frame, the planes point into the mapping until bus_reader_release
+typedef struct {
+    int slot;                           //-1 when nothing is leased
+    uint64_t seq;
+    uint64_t timestamp_us;
+    uint32_t flags;
+    const uint8_t* image;               //NULL without the plane
+    const uint8_t* temp;
+    const FrameStats_t* temp_stats;     //NULL when the stream thread computed none
+}BusFrame_t;
+
+typedef struct {
+    int fd;
+    BusHeader_t* header;
+    size_t map_size;
+    int entry;                          //this reader's entry in the reader table
+    uint64_t last_seq;                  //newest sequence handed out, bus_reader_acquire waits for a later one
+    uint64_t frames;
+    uint64_t skipped;                   //sequences between two acquires this reader never saw
+}BusReader_t;
+
+//register the bus as a task consumer of the camera's frame ring, before streaming
+//the bus must stay valid until the ring is closed, frames are ignored while it is not running
+int bus_attach(Bus_t* bus, StreamFrameInfo_t* stream_frame_info);
+
+//create the shared memory object and publish from the next frame, can be called while streaming
+int bus_start(Bus_t* bus, const BusParam_t* param);
+
+//mark the bus closed, wake the readers and unlink the name, a reader's mapping stays valid until it closes
+int bus_stop(Bus_t* bus);
+
+int bus_stats(Bus_t* bus, BusStats_t* stats);
+
+//map a running publisher's bus and take an entry of the reader table
+int bus_reader_open(BusReader_t* reader, const char* name);
+
+//every lease of the reader goes back
+void bus_reader_close(BusReader_t* reader);
+
+//lease the newest frame after the last one acquired, waiting up to timeout_ms for it
+int bus_reader_acquire(BusReader_t* reader, uint32_t timeout_ms, BusFrame_t* frame);
+
+int bus_reader_release(BusReader_t* reader, BusFrame_t* frame);
+
+#endif
@@ -0,0 +1,548 @@
+#include "calib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "libiruvc.h"
+#include "flash.h"
+#include "prop.h"
+
+#define CALIB_NUC_T_BYTES (NUC_T_SIZE * 2)
+#define CALIB_KT_BYTES (KT_SIZE * 2)
+#define CALIB_BT_BYTES (BT_SIZE * 2)
+
+//correct tables come from these files, the device tables have none
+static const char* calib_source_file[CALIB_SECTION_NUM] = { NULL, NULL, NULL, "tau_H.bin", "new_tau_H.bin", "tau_L.bin" };
+
+static char calib_cache_dir[CALIB_PATH_LEN] = { 0 };
+static char calib_cache_path[CALIB_PATH_LEN + CALIB_SN_LEN + 32] = { 0 };
+static uint8_t* calib_cache_data = NULL;    //mapped file (malloc on windows)
+static uint32_t calib_cache_size = 0;
+static uint8_t calib_cache_sn[CALIB_SN_LEN] = { 0 };     //of the last calib_cache_load
+static uint32_t calib_cache_gain = HIGH_GAIN;
+
+static uint32_t calib_fnv1a(const void* data, uint32_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void calib_source_stat(const char* path, int64_t* mtime, int64_t* size)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        *mtime = 0;
+        *size = -1;
+        return;
+    }
+    *mtime = (int64_t)st.st_mtime;
+    *size = (int64_t)st.st_size;
+}
+
+static void calib_file_unmap(void)
+{
+    if (calib_cache_data == NULL)
+    {
+        return;
+    }
+#if defined(_WIN32)
+    free(calib_cache_data);
+#else
+    munmap(calib_cache_data, calib_cache_size);
+#endif
+    calib_cache_data = NULL;
+    calib_cache_size = 0;
+}
+
+static int calib_file_map(const char* path)
+{
+#if defined(_WIN32)
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return CALIB_ERROR_FILE;
+    }
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t* data = (len > 0) ? (uint8_t*)malloc(len) : NULL;
+    if (data == NULL || fread(data, 1, len, fp) != (size_t)len)
+    {
+        free(data);
+        fclose(fp);
+        return CALIB_ERROR_FILE;
+    }
+    fclose(fp);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return CALIB_ERROR_FILE;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return CALIB_ERROR_FILE;
+    }
+    long len = (long)st.st_size;
+    void* map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return CALIB_ERROR_FILE;
+    }
+    uint8_t* data = (uint8_t*)map;
+#endif
+    calib_file_unmap();
+    calib_cache_data = data;
+    calib_cache_size = (uint32_t)len;
+    return CALIB_SUCCESS;
+}
+
+//header belongs to this sn/gain/version and every section lies inside the file
+static int calib_header_check(const uint8_t* data, uint32_t size, const uint8_t* sn, uint32_t gain)
+{
+    if (data == NULL || size < sizeof(CalibCacheHeader_t))
+    {
+        return 0;
+    }
+    const CalibCacheHeader_t* header = (const CalibCacheHeader_t*)data;
+    if (header->magic != CALIB_CACHE_MAGIC || header->version != CALIB_CACHE_VERSION || \
+        memcmp(header->sn, sn, CALIB_SN_LEN) != 0 || header->gain != gain || header->file_size != size || \
+        header->header_checksum != calib_fnv1a(header, offsetof(CalibCacheHeader_t, header_checksum)))
+    {
+        return 0;
+    }
+    for (int i = 0; i < CALIB_SECTION_NUM; i++)
+    {
+        const CalibSection_t* section = &header->section[i];
+        if (section->size > 0 && ((uint64_t)section->offset + section->size > size || \
+            calib_fnv1a(data + section->offset, section->size) != section->checksum))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//a correct table section whose file was edited, added or removed since the cache was written
+static int calib_section_stale(const CalibSection_t* section, int type)
+{
+    if (calib_source_file[type] == NULL)
+    {
+        return 0;
+    }
+    int64_t mtime, size;
+    calib_source_stat(calib_source_file[type], &mtime, &size);
+    return (mtime != section->source_mtime || size != section->source_size);
+}
+
+static int calib_device_read(int type, uint32_t gain, uint8_t* dst, uint32_t* size)
+{
+    *size = 0;
+    switch (type)
+    {
+    case CALIB_SECTION_NUC_T:
+        if (flash_read((gain == HIGH_GAIN) ? 0xda000 : 0xd3000, CALIB_NUC_T_BYTES, dst) != FLASH_SUCCESS)
+        {
+            return CALIB_ERROR_DEVICE;
+        }
+        for (int i = 0; i < CALIB_NUC_T_BYTES; i += 2)
+        {
+            uint8_t temp = dst[i];
+            dst[i] = dst[i + 1];
+            dst[i + 1] = temp;
+        }
+        *size = CALIB_NUC_T_BYTES;
+        return CALIB_SUCCESS;
+    case CALIB_SECTION_KT:
+        if (get_tpd_kt_array(dst) != IRUVC_SUCCESS)
+        {
+            return CALIB_ERROR_DEVICE;
+        }
+        *size = CALIB_KT_BYTES;
+        return CALIB_SUCCESS;
+    case CALIB_SECTION_BT:
+        if (get_tpd_bt_array(dst) != IRUVC_SUCCESS)
+        {
+            return CALIB_ERROR_DEVICE;
+        }
+        *size = CALIB_BT_BYTES;
+        return CALIB_SUCCESS;
+    default:
+        return CALIB_ERROR_PARAM;
+    }
+}
+
+static uint8_t* calib_file_read(const char* path, uint32_t* size)
+{
+    *size = 0;
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t* data = (len > 0) ? (uint8_t*)malloc(len) : NULL;
+    if (data != NULL && fread(data, 1, len, fp) == (size_t)len)
+    {
+        *size = (uint32_t)len;
+    }
+    else
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    return data;
+}
+
+//write the cache next to the old one and rename it into place, the old mapping stays valid until we remap
+static int calib_cache_rebuild(const uint8_t* sn, uint32_t gain, int old_valid)
+{
+    const CalibCacheHeader_t* old_header = old_valid ? (const CalibCacheHeader_t*)calib_cache_data : NULL;
+    uint8_t* section_data[CALIB_SECTION_NUM] = { NULL };
+    int section_owned[CALIB_SECTION_NUM] = { 0 };
+    CalibCacheHeader_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CALIB_CACHE_MAGIC;
+    header.version = CALIB_CACHE_VERSION;
+    memcpy(header.sn, sn, CALIB_SN_LEN);
+    header.gain = gain;
+
+    int ret = CALIB_SUCCESS;
+    int reused = 0;
+    uint32_t offset = (sizeof(CalibCacheHeader_t) + CALIB_ALIGN - 1) & ~(CALIB_ALIGN - 1);
+    for (int i = 0; i < CALIB_SECTION_NUM && ret == CALIB_SUCCESS; i++)
+    {
+        CalibSection_t* section = &header.section[i];
+        if (calib_source_file[i] != NULL)
+        {
+            calib_source_stat(calib_source_file[i], &section->source_mtime, &section->source_size);
+        }
+        if (old_header != NULL && old_header->section[i].size > 0 && !calib_section_stale(&old_header->section[i], i))
+        {
+            section_data[i] = calib_cache_data + old_header->section[i].offset;
+            section->size = old_header->section[i].size;
+            reused++;
+        }
+        else if (calib_source_file[i] != NULL)
+        {
+            section_data[i] = calib_file_read(calib_source_file[i], &section->size);
+            section_owned[i] = 1;
+        }
+        else
+        {
+            section_data[i] = (uint8_t*)malloc(CALIB_NUC_T_BYTES);
+            section_owned[i] = 1;
+            if (section_data[i] == NULL)
+            {
+                ret = CALIB_ERROR_MEM;
+            }
+            else if (calib_device_read(i, gain, section_data[i], &section->size) != CALIB_SUCCESS)
+            {
+                printf("calib cache: read device table %d failed\n", i);
+                ret = (i == CALIB_SECTION_NUC_T) ? CALIB_ERROR_DEVICE : CALIB_SUCCESS;
+            }
+        }
+        if (section->size > 0)
+        {
+            section->offset = offset;
+            section->checksum = calib_fnv1a(section_data[i], section->size);
+            offset = (offset + section->size + CALIB_ALIGN - 1) & ~(CALIB_ALIGN - 1);
+        }
+    }
+    header.file_size = offset;
+    header.header_checksum = calib_fnv1a(&header, offsetof(CalibCacheHeader_t, header_checksum));
+
+    char tmp_path[sizeof(calib_cache_path) + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", calib_cache_path);
+    FILE* fp = (ret == CALIB_SUCCESS) ? fopen(tmp_path, "wb") : NULL;
+    if (ret == CALIB_SUCCESS && fp == NULL)
+    {
+        ret = CALIB_ERROR_FILE;
+    }
+    if (fp != NULL)
+    {
+        static const uint8_t zero[CALIB_ALIGN] = { 0 };
+        uint32_t pos = sizeof(header);
+        int ok = (fwrite(&header, 1, sizeof(header), fp) == sizeof(header));
+        for (int i = 0; i < CALIB_SECTION_NUM && ok; i++)
+        {
+            if (header.section[i].size == 0)
+            {
+                continue;
+            }
+            ok = (fwrite(zero, 1, header.section[i].offset - pos, fp) == header.section[i].offset - pos) && \
+                (fwrite(section_data[i], 1, header.section[i].size, fp) == header.section[i].size);
+            pos = header.section[i].offset + header.section[i].size;
+        }
+        ok = ok && (fwrite(zero, 1, header.file_size - pos, fp) == header.file_size - pos);
+        ok = (fclose(fp) == 0) && ok;
+#if defined(_WIN32)
+        remove(calib_cache_path);
+#endif
+        if (!ok || rename(tmp_path, calib_cache_path) != 0)
+        {
+            remove(tmp_path);
+            ret = CALIB_ERROR_FILE;
+        }
+    }
+    for (int i = 0; i < CALIB_SECTION_NUM; i++)
+    {
+        if (section_owned[i])
+        {
+            free(section_data[i]);
+        }
+    }
+    if (ret == CALIB_SUCCESS)
+    {
+        printf("calib cache: %s rebuilt, %d of %d tables reused\n", calib_cache_path, reused, CALIB_SECTION_NUM);
+        ret = calib_file_map(calib_cache_path);
+    }
+    return ret;
+}
+
+void calib_cache_dir_set(const char* dir)
+{
+    snprintf(calib_cache_dir, sizeof(calib_cache_dir), "%s", (dir != NULL) ? dir : "");
+}
+
+int calib_cache_load(TempCalInfo_t* temp_cal_info)
+{
+    if (temp_cal_info == NULL || temp_cal_info->nuc_table == NULL)
+    {
+        return CALIB_ERROR_PARAM;
+    }
+    uint8_t sn_content[64] = { 0 };
+    uint16_t gain = HIGH_GAIN;
+    if (get_sn(sn_content) != IRUVC_SUCCESS || sn_content[0] == 0)
+    {
+        //tc modules have no sn, nothing identifies the tables so they are read from the device as before
+        calib_cache_release();
+        return CALIB_ERROR_NO_SN;
+    }
+    if (prop_tpd_get(TPD_PROP_GAIN_SEL, &gain) != IRUVC_SUCCESS)
+    {
+        return CALIB_ERROR_DEVICE;
+    }
+
+    //the sn becomes part of the file name, keep it to characters every file system accepts
+    uint8_t sn[CALIB_SN_LEN] = { 0 };
+    for (int i = 0; i < CALIB_SN_LEN - 1 && sn_content[i] != 0; i++)
+    {
+        uint8_t c = sn_content[i];
+        int valid = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-';
+        sn[i] = valid ? c : '_';
+    }
+    calib_file_unmap();
+    memcpy(calib_cache_sn, sn, CALIB_SN_LEN);
+    calib_cache_gain = gain;
+    snprintf(calib_cache_path, sizeof(calib_cache_path), "%s%scalib_%s_%u.bin", calib_cache_dir, \
+        calib_cache_dir[0] ? "/" : "", (const char*)sn, (unsigned)gain);
+
+    int ret = CALIB_SUCCESS;
+    int valid = (calib_file_map(calib_cache_path) == CALIB_SUCCESS) && \
+        calib_header_check(calib_cache_data, calib_cache_size, sn, gain);
+    int stale = !valid;
+    if (valid)
+    {
+        const CalibCacheHeader_t* header = (const CalibCacheHeader_t*)calib_cache_data;
+        for (int i = 0; i < CALIB_SECTION_NUM; i++)
+        {
+            stale |= (calib_source_file[i] == NULL) ? (header->section[i].size == 0) : \
+                calib_section_stale(&header->section[i], i);
+        }
+    }
+    if (stale)
+    {
+        ret = calib_cache_rebuild(sn, gain, valid);
+        if (ret != CALIB_SUCCESS)
+        {
+            calib_cache_release();
+            return ret;
+        }
+    }
+
+    uint32_t size = 0;
+    const void* nuc_t = calib_cache_section(CALIB_SECTION_NUC_T, &size);
+    if (nuc_t == NULL || size != CALIB_NUC_T_BYTES)
+    {
+        calib_cache_release();
+        return CALIB_ERROR_FILE;
+    }
+    memcpy(temp_cal_info->nuc_table, nuc_t, CALIB_NUC_T_BYTES);
+    temp_nuc_tables_update(temp_cal_info->nuc_table);
+    return CALIB_SUCCESS;
+}
+
+//the nuc-t table of the gain the device is not in: its own cache file when it is valid, else the flash
+static int calib_other_nuc_t(uint32_t gain, uint16_t* dst)
+{
+    char path[sizeof(calib_cache_path)];
+    snprintf(path, sizeof(path), "%s%scalib_%s_%u.bin", calib_cache_dir, calib_cache_dir[0] ? "/" : "", \
+        (const char*)calib_cache_sn, (unsigned)gain);
+    uint32_t size = 0;
+    uint8_t* data = calib_file_read(path, &size);
+    int ret = CALIB_ERROR_FILE;
+    if (calib_header_check(data, size, calib_cache_sn, gain))
+    {
+        const CalibSection_t* section = &((const CalibCacheHeader_t*)data)->section[CALIB_SECTION_NUC_T];
+        if (section->size == CALIB_NUC_T_BYTES)
+        {
+            memcpy(dst, data + section->offset, CALIB_NUC_T_BYTES);
+            ret = CALIB_SUCCESS;
+        }
+    }
+    free(data);
+    if (ret != CALIB_SUCCESS)
+    {
+        ret = calib_device_read(CALIB_SECTION_NUC_T, gain, (uint8_t*)dst, &size);
+    }
+    return ret;
+}
+
+int calib_file_table(const char* path, CalibSectionType_t type, void* dst, uint32_t dst_size, uint32_t* gain)
+{
+    if (path == NULL || dst == NULL || type < 0 || type >= CALIB_SECTION_NUM)
+    {
+        return CALIB_ERROR_PARAM;
+    }
+    uint32_t size = 0;
+    uint8_t* data = calib_file_read(path, &size);
+    int ret = CALIB_ERROR_FILE;
+    const CalibCacheHeader_t* header = (const CalibCacheHeader_t*)data;
+    if (data != NULL && size >= sizeof(CalibCacheHeader_t) && calib_header_check(data, size, header->sn, header->gain) && \
+        header->section[type].size > 0)
+    {
+        uint32_t copy = (header->section[type].size < dst_size) ? header->section[type].size : dst_size;
+        memcpy(dst, data + header->section[type].offset, copy);
+        if (gain != NULL)
+        {
+            *gain = header->gain;
+        }
+        ret = (int)copy;
+    }
+    free(data);
+    return ret;
+}
+
+int calib_cache_load_gains(void)
+{
+    static uint16_t nuc[NUC_T_SIZE];
+    static uint16_t correct[TEMP_CORRECT_TABLE_LEN];
+    if (calib_cache_data == NULL)
+    {
+        return CALIB_ERROR_FILE;
+    }
+    int loaded = 0;
+    for (uint32_t gain = LOW_GAIN; gain <= HIGH_GAIN; gain++)
+    {
+        uint32_t size = 0;
+        const void* nuc_t = calib_cache_section(CALIB_SECTION_NUC_T, &size);
+        int ret = CALIB_ERROR_FILE;
+        if (gain == calib_cache_gain && nuc_t != NULL && size == CALIB_NUC_T_BYTES)
+        {
+            memcpy(nuc, nuc_t, CALIB_NUC_T_BYTES);
+            ret = CALIB_SUCCESS;
+        }
+        else if (gain != calib_cache_gain)
+        {
+            ret = calib_other_nuc_t(gain, nuc);
+        }
+        if (ret != CALIB_SUCCESS)
+        {
+            printf("calib cache: no nuc-t table of gain %u\n", (unsigned)gain);
+            continue;
+        }
+        memset(correct, 0, sizeof(correct));
+        int len = calib_cache_read_table((gain == HIGH_GAIN) ? CALIB_SECTION_TAU_H : CALIB_SECTION_TAU_L, correct, \
+            sizeof(correct));
+        if (temp_gain_tables_set((int)gain, nuc, (len > 0) ? correct : NULL) == 0)
+        {
+            loaded++;
+        }
+    }
+    temp_gain_select((int)calib_cache_gain);
+    return loaded;
+}
+
+const void* calib_cache_section(CalibSectionType_t type, uint32_t* size)
+{
+    if (size != NULL)
+    {
+        *size = 0;
+    }
+    if (calib_cache_data == NULL || type < 0 || type >= CALIB_SECTION_NUM)
+    {
+        return NULL;
+    }
+    const CalibSection_t* section = &((const CalibCacheHeader_t*)calib_cache_data)->section[type];
+    if (section->size == 0)
+    {
+        return NULL;
+    }
+    if (size != NULL)
+    {
+        *size = section->size;
+    }
+    return calib_cache_data + section->offset;
+}
+
+int calib_cache_read_table(CalibSectionType_t type, void* dst, uint32_t dst_size)
+{
+    if (dst == NULL || type < 0 || type >= CALIB_SECTION_NUM)
+    {
+        return CALIB_ERROR_PARAM;
+    }
+    uint32_t size = 0;
+    const void* data = calib_cache_section(type, &size);
+    if (data != NULL && !calib_section_stale(&((const CalibCacheHeader_t*)calib_cache_data)->section[type], type))
+    {
+        size = (size < dst_size) ? size : dst_size;
+        memcpy(dst, data, size);
+        return (int)size;
+    }
+    if (calib_source_file[type] == NULL)
+    {
+        return CALIB_ERROR_FILE;
+    }
+    FILE* fp = fopen(calib_source_file[type], "rb");
+    if (fp == NULL)
+    {
+        return CALIB_ERROR_FILE;
+    }
+    size = (uint32_t)fread(dst, 1, dst_size, fp);
+    fclose(fp);
+    return (int)size;
+}
+
+void calib_cache_invalidate(void)
+{
+    //dropping the file is enough: its device tables are the ones we just overwrote
+    calib_file_unmap();
+    if (calib_cache_path[0] != 0)
+    {
+        remove(calib_cache_path);
+    }
+}
+
+void calib_cache_release(void)
+{
+    calib_file_unmap();
+    calib_cache_path[0] = 0;
+}
@@ -0,0 +1,80 @@
+#ifndef _CALIB_H_
+#define _CALIB_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "temperature.h"
+
+#define CALIB_CACHE_MAGIC 0x43435249    //"IRCC"
+#define CALIB_CACHE_VERSION 1
+#define CALIB_SN_LEN 32
+#define CALIB_PATH_LEN 256
+#define CALIB_ALIGN 64                  //section offsets, so the mapped tables are aligned
+
+#define CALIB_SUCCESS 0
+#define CALIB_ERROR_PARAM -1
+#define CALIB_ERROR_DEVICE -2
+#define CALIB_ERROR_FILE -3
+#define CALIB_ERROR_MEM -4
+#define CALIB_ERROR_NO_SN -5
+
+typedef enum {
+    CALIB_SECTION_NUC_T = 0,            //NUC_T_SIZE uint16, byte order already swapped
+    CALIB_SECTION_KT,                   //KT_SIZE uint16
+    CALIB_SECTION_BT,                   //BT_SIZE int16
+    CALIB_SECTION_TAU_H,                //tau_H.bin
+    CALIB_SECTION_NEW_TAU_H,            //new_tau_H.bin
+    CALIB_SECTION_TAU_L,                //tau_L.bin
+    CALIB_SECTION_NUM,
+}CalibSectionType_t;
+
+typedef struct {
+    uint32_t offset;                    //from the start of the file
+    uint32_t size;                      //bytes, 0 when the table was not available
+    uint32_t checksum;                  //fnv-1a of the section
+    uint32_t reserved;
+    int64_t source_mtime;               //correct table files: mtime and size of the file it was read from
+    int64_t source_size;
+}CalibSection_t;
+
+//file layout: this header, then the sections at CALIB_ALIGN offsets, all little endian
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint8_t sn[CALIB_SN_LEN];
+    uint32_t gain;                      //HIGH_GAIN / LOW_GAIN
+    uint32_t file_size;
+    CalibSection_t section[CALIB_SECTION_NUM];
+    uint32_t header_checksum;           //fnv-1a of everything above
+    uint32_t reserved;
+}CalibCacheHeader_t;
+
+//directory of the cache files, default is the working directory
+void calib_cache_dir_set(const char* dir);
+
+//called once after the camera is opened and command_init: reads the SN and the gain, maps calib_<sn>_<gain>.bin
+//and copies the NUC-T table into temp_cal_info. device tables are read over SPI only when the file is missing,
+//belongs to another SN/gain/version or was invalidated. changed correct table files are re-read on their own
+int calib_cache_load(TempCalInfo_t* temp_cal_info);
+
+//after calib_cache_load: the nuc-t and tau correct tables of both gains made resident with temp_gain_tables_set,
+//the other gain's nuc-t from its own cache file or the flash. returns the gains loaded or a negative error code
+int calib_cache_load_gains(void);
+
+//one table of a cache file by path, without a camera: offline tools correcting recordings of that camera.
+//gain (may be NULL) is the file's. returns the bytes copied, at most dst_size, or a negative error code
+int calib_file_table(const char* path, CalibSectionType_t type, void* dst, uint32_t dst_size, uint32_t* gain);
+
+//the mapped section, NULL when no cache is loaded or the table was not available
+const void* calib_cache_section(CalibSectionType_t type, uint32_t* size);
+
+//copy a correct table section into dst, reading its source file when it is not cached
+//returns the bytes copied, at most dst_size, or a negative error code
+int calib_cache_read_table(CalibSectionType_t type, void* dst, uint32_t dst_size);
+
+//the device tables were rewritten (set_tpd_nuc_t_array etc), the next load reads them again
+void calib_cache_invalidate(void);
+
+void calib_cache_release(void);
+
+#endif
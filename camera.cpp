@@ -1,12 +1,101 @@
 #include "camera.h"
+#include "trace.h"
+#include "log.h"
+#include "sync.h"
+#include "rtsched.h"
+#include "band.h"
+#include "tempunit.h"
+#include "prop.h"
+#include "burst.h"
+#include "duty.h"
+#include "integrity.h"
+#include "usbplan.h"
+#include "stab.h"
+#include "usbxfer.h"
+#include <thread>
 
 uint8_t is_streaming = 0;
 int stream_time = 1000;  //unit:s
 int fps;
 
+//stream_state_cond: the waits for a stream to stop wake up on the change instead of polling the flag
+static sync_mutex_t stream_state_mutex = SYNC_MUTEX_INITIALIZER;
+static sync_cond_t stream_state_cond = SYNC_COND_INITIALIZER;
+static int stream_cnt = 0;
+
 int auto_gain_switch_frame_cnt = 0;
 int overexposure_frame_cnt = 0;
 
+//one module as the last full open found it, the pointers of camera_param point at name/format
+typedef struct {
+    uint8_t valid;
+    CameraParam_t camera_param;
+    char name[IR_CAMERA_NAME_LEN];
+    char format[IR_CAMERA_FORMAT_LEN];
+}IrCameraCache_t;
+
+static uint8_t fast_reopen = 0;
+static uint8_t uvc_context_ready = 0;
+static IrCameraCache_t camera_cache[IR_CAMERA_MAX_NUM];
+
+//startup metrics: dynamic initialization runs before main, close enough to the process start
+static uint64_t process_start_us = get_monotonic_us();
+static std::atomic<bool> startup_recorded(false);
+static uint64_t camera_open_us[IR_CAMERA_MAX_NUM];
+
+static IrReconnectParam_t reconnect_param = { 0 };
+static int camera_num_opened = 1;
+//the factors come from the usb plan once it is enabled, usb_plan_mutex: the reconnect threads open and start too
+static uint8_t usb_plan_enable = 0;
+static UsbPlan_t usb_plan;
+static uint8_t usb_plan_valid = 0;
+static sync_mutex_t usb_plan_mutex = SYNC_MUTEX_INITIALIZER;
+static uint32_t camera_reconnects[IR_CAMERA_MAX_NUM];
+#if defined(IMAGE_AND_TEMP_OUTPUT)
+static IrStreamMode_t camera_stream_mode = IR_STREAM_IMAGE_AND_TEMP;
+#elif defined(IMAGE_OUTPUT)
+static IrStreamMode_t camera_stream_mode = IR_STREAM_IMAGE;
+#else
+static IrStreamMode_t camera_stream_mode = IR_STREAM_TEMP;
+#endif
+//ir_camera_stream_mode_switch: every mode's stream of the last full open, the mode + 1 each camera switched to
+//(0 streams camera_stream_mode) and the mode + 1 its stream thread is to switch to
+static IrCameraCache_t camera_modes[IR_CAMERA_MAX_NUM][IR_STREAM_MODE_NUM];
+static uint8_t camera_mode_now[IR_CAMERA_MAX_NUM];
+static std::atomic<int> camera_mode_pending[IR_CAMERA_MAX_NUM];
+
+//per camera streaming flag, is_streaming stays set until the last camera stops
+static void stream_state_set(StreamFrameInfo_t* stream_frame_info, uint8_t streaming)
+{
+    sync_mutex_lock(&stream_state_mutex);
+    if (stream_frame_info->is_streaming != streaming)
+    {
+        stream_frame_info->is_streaming = streaming;
+        stream_cnt += streaming ? 1 : -1;
+        sync_cond_broadcast(&stream_state_cond);
+    }
+    is_streaming = (stream_cnt > 0);
+    sync_mutex_unlock(&stream_state_mutex);
+}
+
+//wait up to wait_ms for the stream to stop, returns 0 when it was stopped
+static int stream_state_wait_off(StreamFrameInfo_t* stream_frame_info, uint32_t wait_ms)
+{
+    sync_deadline_t deadline;
+    sync_deadline_set(&deadline, wait_ms);
+    sync_mutex_lock(&stream_state_mutex);
+    while (stream_frame_info->is_streaming)
+    {
+        if (sync_cond_wait_until(&stream_state_cond, &stream_state_mutex, &deadline) != SYNC_SUCCESS)
+        {
+            break;
+        }
+    }
+    int streaming = stream_frame_info->is_streaming;
+    sync_mutex_unlock(&stream_state_mutex);
+    return streaming;
+}
+
 //get specific device via pid&vid from all devices
 int get_dev_index_with_pid_vid(int vid, int pid, DevCfg_t devs_cfg[])
 {
@@ -38,17 +127,334 @@ CameraParam_t camera_para_set(DevCfg_t dev_cfg, int stream_index, CameraStreamIn
     return camera_param;
 }
 
+//the stream of camera_stream_info the mode asks for. image_and_temp stacks the two halves, its frame is taller
+//than wide (256x384, 384x576, 640x1024), the single plane modes stream the sensor's own shape. the first
+//entry, as before, when no entry has the shape
+static int camera_stream_index(const CameraStreamInfo_t camera_stream_info[], IrStreamMode_t mode)
+{
+    for (int i = 0; camera_stream_info[i].width != 0 && camera_stream_info[i].height != 0; i++)
+    {
+        int stacked = (camera_stream_info[i].height > camera_stream_info[i].width);
+        if (stacked == (mode == IR_STREAM_IMAGE_AND_TEMP))
+        {
+            return i;
+        }
+    }
+    return 0;
+}
+
+void ir_camera_fast_reopen_set(uint8_t enable)
+{
+    fast_reopen = enable;
+}
+
+void ir_camera_usb_plan_set(uint8_t enable)
+{
+    usb_plan_enable = enable;
+}
+
+void ir_camera_cache_clear(void)
+{
+    memset(camera_cache, 0, sizeof(camera_cache));
+}
+
+void ir_camera_stream_mode_set(IrStreamMode_t mode)
+{
+    if (mode >= 0 && mode < IR_STREAM_MODE_NUM && mode != camera_stream_mode)
+    {
+        //the cached stream parameters are of the other resolution
+        camera_stream_mode = mode;
+        ir_camera_cache_clear();
+        memset(camera_mode_now, 0, sizeof(camera_mode_now));
+    }
+}
+
+IrStreamMode_t ir_camera_stream_mode(void)
+{
+    return camera_stream_mode;
+}
+
+static IrStreamMode_t camera_mode_of(int index)
+{
+    if (index < 0 || index >= IR_CAMERA_MAX_NUM || camera_mode_now[index] == 0)
+    {
+        return camera_stream_mode;
+    }
+    return (IrStreamMode_t)(camera_mode_now[index] - 1);
+}
+
+IrStreamMode_t ir_camera_stream_mode_of(int index)
+{
+    return camera_mode_of(index);
+}
+
+void ir_camera_release(void)
+{
+    if (uvc_context_ready)
+    {
+        uvc_camera_release();
+        uvc_context_ready = 0;
+    }
+}
+
+int ir_camera_count(void)
+{
+    DevCfg_t devs_cfg[64] = { 0 };
+    if (!uvc_context_ready)
+    {
+        int rst = uvc_camera_init();
+        if (rst < 0)
+        {
+            printf("uvc_camera_init:%d\n", rst);
+            return rst;
+        }
+        uvc_context_ready = 1;
+    }
+    int rst = uvc_camera_list(devs_cfg);
+    int count = 0;
+    for (int i = 0; rst >= 0 && i < 64; i++)
+    {
+        if (devs_cfg[i].vid == IR_CAMERA_VID && devs_cfg[i].pid == IR_CAMERA_PID)
+        {
+            count++;
+        }
+    }
+    if (!fast_reopen)
+    {
+        ir_camera_release();
+    }
+    return (rst < 0) ? rst : count;
+}
+
+//the libiruvc strings may not outlive its context, the cache keeps copies
+static void camera_param_keep(IrCameraCache_t* cache, const CameraParam_t* camera_param)
+{
+    cache->camera_param = *camera_param;
+    snprintf(cache->name, sizeof(cache->name), "%s", camera_param->dev_cfg.name ? camera_param->dev_cfg.name : "");
+    snprintf(cache->format, sizeof(cache->format), "%s", camera_param->format ? camera_param->format : "");
+    cache->camera_param.dev_cfg.name = cache->name;
+    cache->camera_param.format = cache->format;
+    cache->valid = 1;
+}
+
+static void camera_cache_store(int same_dev_index, const CameraParam_t* camera_param)
+{
+    if (same_dev_index >= 0 && same_dev_index < IR_CAMERA_MAX_NUM)
+    {
+        camera_param_keep(&camera_cache[same_dev_index], camera_param);
+    }
+}
+
+//the stream of every mode the module lists, the first entry camera_stream_index falls back to is no such stream
+static void camera_modes_store(int same_dev_index, DevCfg_t dev_cfg, CameraStreamInfo_t camera_stream_info[])
+{
+    if (same_dev_index < 0 || same_dev_index >= IR_CAMERA_MAX_NUM)
+    {
+        return;
+    }
+    for (int mode = 0; mode < IR_STREAM_MODE_NUM; mode++)
+    {
+        int index = camera_stream_index(camera_stream_info, (IrStreamMode_t)mode);
+        CameraParam_t camera_param = camera_para_set(dev_cfg, index, camera_stream_info);
+        IrCameraCache_t* entry = &camera_modes[same_dev_index][mode];
+        camera_param_keep(entry, &camera_param);
+        entry->valid = ((camera_param.height > camera_param.width) == (mode == IR_STREAM_IMAGE_AND_TEMP));
+    }
+}
+
+static int camera_bandwidth_set(int camera_num)
+{
+    if (camera_num <= 1)
+    {
+        return 0;
+    }
+    //every module gets an equal share, the factor applies to the streams opened afterwards
+    float factor = 1.0f / camera_num;
+    int rst = uvc_camera_set_bandwidth_factor(factor);
+    if (rst < 0)
+    {
+        printf("uvc_camera_set_bandwidth_factor:%d\n", rst);
+        return rst;
+    }
+    uvc_camera_get_bandwidth_factor(&factor);
+    printf("bandwidth factor=%.3f\n", factor);
+    return 0;
+}
+
+//the topology as it is now, a reconnect may have found a module on another port
+static void camera_usb_plan_build(const CameraParam_t* camera_param)
+{
+    if (!usb_plan_enable)
+    {
+        return;
+    }
+    UsbPlan_t plan;
+    int rst = usb_plan_build(&plan, IR_CAMERA_VID, IR_CAMERA_PID, camera_param->frame_size, camera_param->fps);
+    sync_mutex_lock(&usb_plan_mutex);
+    int changed = (rst == USB_PLAN_SUCCESS) && (!usb_plan_valid || memcmp(&plan, &usb_plan, sizeof(UsbPlan_t)) != 0);
+    if (rst == USB_PLAN_SUCCESS)
+    {
+        usb_plan = plan;
+    }
+    usb_plan_valid = (rst == USB_PLAN_SUCCESS);
+    sync_mutex_unlock(&usb_plan_mutex);
+    if (rst != USB_PLAN_SUCCESS)
+    {
+        printf("usb_plan_build:%d, equal bandwidth shares\n", rst);
+    }
+    else if (changed)
+    {
+        usb_plan_print(&plan);
+    }
+}
+
+//the planned factor of the module, -1 without a plan
+static float camera_usb_plan_factor(int same_dev_index, float factor)
+{
+    sync_mutex_lock(&usb_plan_mutex);
+    float planned = !usb_plan_valid ? -1 : \
+        (factor < 0) ? usb_plan_factor(&usb_plan, same_dev_index) : usb_plan_backoff(&usb_plan, same_dev_index, factor);
+    sync_mutex_unlock(&usb_plan_mutex);
+    return planned;
+}
+
+//uvc_camera_stream_start at the planned factor, a start the controller refuses for its bandwidth is retried lower
+//down to the demand of the module. without a plan the factor of the open stays
+static int camera_stream_start(CameraParam_t camera_param, int same_dev_index, UserCallback_t* callback)
+{
+    float factor = camera_usb_plan_factor(same_dev_index, -1);
+    if (factor < 0)
+    {
+        usb_xfer_stream_begin(same_dev_index);
+        int rst = uvc_camera_stream_start(camera_param, callback);
+        usb_xfer_stream_end();
+        return rst;
+    }
+    int rst = -1;
+    for (int retry = 0; ; retry++)
+    {
+        uvc_camera_set_bandwidth_factor(factor);
+        usb_xfer_stream_begin(same_dev_index);
+        rst = uvc_camera_stream_start(camera_param, callback);
+        usb_xfer_stream_end();
+        float next = camera_usb_plan_factor(same_dev_index, factor);
+        if (rst >= 0 || retry >= USB_PLAN_RETRIES || next < 0)
+        {
+            break;
+        }
+        printf("camera %d stream start at bandwidth factor %.3f:%d, retrying at %.3f\n", same_dev_index, factor, \
+            rst, next);
+        uvc_camera_stream_close(KEEP_CAM_SIDE_PREVIEW);
+        std::this_thread::sleep_for(std::chrono::milliseconds(USB_PLAN_RETRY_MS));
+        factor = next;
+    }
+    if (rst >= 0)
+    {
+        printf("camera %d bandwidth factor=%.3f\n", same_dev_index, factor);
+    }
+    return rst;
+}
+
+static int camera_device_open(DevCfg_t dev_cfg, int same_dev_index)
+{
+    int rst = (same_dev_index == 0) ? uvc_camera_open(dev_cfg) : uvc_camera_open_same(dev_cfg, same_dev_index);
+    if (rst < 0)
+    {
+        printf("uvc_camera_open(%d):%d\n", same_dev_index, rst);
+    }
+    else
+    {
+        //a module opened anew, or back after a reconnect, may hold other properties than the last one
+        prop_cache_invalidate();
+    }
+    return rst;
+}
+
+//the cached module straight away, nothing is listed or queried
+static int camera_open_cached(CameraParam_t* camera_param, int same_dev_index, int camera_num)
+{
+    IrCameraCache_t* cache = &camera_cache[same_dev_index];
+    if (!uvc_context_ready)
+    {
+        int rst = uvc_camera_init();
+        if (rst < 0)
+        {
+            printf("uvc_camera_init:%d\n", rst);
+            return rst;
+        }
+        uvc_context_ready = 1;
+    }
+    int rst = camera_bandwidth_set(camera_num);
+    if (rst < 0)
+    {
+        return rst;
+    }
+    rst = camera_device_open(cache->camera_param.dev_cfg, same_dev_index);
+    if (rst < 0)
+    {
+        return rst;
+    }
+    *camera_param = cache->camera_param;
+    camera_usb_plan_build(camera_param);
+    return 0;
+}
+
+//the first frame of a stream: open -> first frame every time, process start -> first frame once
+static void camera_first_frame(int camera_index, uint64_t timestamp_us)
+{
+    if (camera_index >= 0 && camera_index < IR_CAMERA_MAX_NUM && camera_open_us[camera_index] != 0)
+    {
+        timing_record(TIMING_STAGE_OPEN_TO_FRAME, timestamp_us - camera_open_us[camera_index]);
+        camera_open_us[camera_index] = 0;
+    }
+    if (!startup_recorded.exchange(true))
+    {
+        timing_record(TIMING_STAGE_STARTUP, timestamp_us - process_start_us);
+        printf("first frame %.1fms after process start\n", (timestamp_us - process_start_us) / 1000.0);
+    }
+}
+
 //open camera device by camera_param
 int ir_camera_open(CameraParam_t* camera_param)
+{
+    return ir_camera_open_same(camera_param, 0, 1);
+}
+
+//open the same_dev_index-th of several identical modules, camera_num modules share the usb bandwidth
+int ir_camera_open_same(CameraParam_t* camera_param, int same_dev_index, int camera_num)
 {
     DevCfg_t devs_cfg[64] = { 0 };
     CameraStreamInfo_t camera_stream_info[32] = { 0 };
+    uint64_t open_start_us = get_monotonic_us();
+    if (same_dev_index >= 0 && same_dev_index < IR_CAMERA_MAX_NUM)
+    {
+        camera_open_us[same_dev_index] = open_start_us;
+    }
+    camera_num_opened = camera_num;
 
-    int rst = uvc_camera_init();
-    if (rst < 0)
+    if (fast_reopen && same_dev_index >= 0 && same_dev_index < IR_CAMERA_MAX_NUM && camera_cache[same_dev_index].valid)
     {
-        printf("uvc_camera_init:%d\n", rst);
-        return rst;
+        int rst = camera_open_cached(camera_param, same_dev_index, camera_num);
+        if (rst == 0)
+        {
+            timing_record_since(TIMING_STAGE_OPEN, open_start_us);
+            return 0;
+        }
+        //replugged or gone, look for it again
+        printf("cached open of camera %d failed:%d, enumerating\n", same_dev_index, rst);
+        camera_cache[same_dev_index].valid = 0;
+    }
+
+    int rst = 0;
+    if (!fast_reopen || !uvc_context_ready)
+    {
+        rst = uvc_camera_init();
+        if (rst < 0)
+        {
+            printf("uvc_camera_init:%d\n", rst);
+            return rst;
+        }
+        uvc_context_ready = 1;
     }
 
     memset(devs_cfg, 0, sizeof(DevCfg_t) * 64); //clear the device list before get list
@@ -62,13 +468,8 @@ int ir_camera_open(CameraParam_t* camera_param)
     int dev_index = 0;
     int pid, vid, resolution_idx = 0;
 
-    pid = 0x5840;
-    vid = 0x0BDA;
-#if defined(IMAGE_AND_TEMP_OUTPUT)
-    resolution_idx = 1;
-#elif defined(IMAGE_OUTPUT) || defined(TEMP_OUTPUT)
-    resolution_idx = 0;
-#endif
+    pid = IR_CAMERA_PID;
+    vid = IR_CAMERA_VID;
     dev_index = get_dev_index_with_pid_vid(vid, pid, devs_cfg);
     if (dev_index < 0)
     {
@@ -84,10 +485,14 @@ int ir_camera_open(CameraParam_t* camera_param)
         return rst;
     }
 
-    rst = uvc_camera_open(devs_cfg[dev_index]);
+    rst = camera_bandwidth_set(camera_num);
+    if (rst < 0)
+    {
+        return rst;
+    }
+    rst = camera_device_open(devs_cfg[dev_index], same_dev_index);
     if (rst < 0)
     {
-        printf("uvc_camera_open:%d\n", rst);
         return rst;
     }
 
@@ -97,106 +502,378 @@ int ir_camera_open(CameraParam_t* camera_param)
         printf("width: %d,height: %d\n", camera_stream_info[i].width, camera_stream_info[i].height);
         i++;
     }
+    resolution_idx = camera_stream_index(camera_stream_info, camera_mode_of(same_dev_index));
     *camera_param = camera_para_set(devs_cfg[dev_index], resolution_idx, camera_stream_info);
+    camera_modes_store(same_dev_index, devs_cfg[dev_index], camera_stream_info);
+    if (fast_reopen)
+    {
+        camera_cache_store(same_dev_index, camera_param);
+    }
+    camera_usb_plan_build(camera_param);
+    timing_record_since(TIMING_STAGE_OPEN, open_start_us);
 
     return 0;
 }
 
-//close the device
-int ir_camera_close(void)
+//open one camera into its context
+int ir_camera_context_open(IrCamera_t* camera, int index, int camera_num)
 {
-    int rst = 0;
-    if (is_streaming)
+    if (camera == NULL || index < 0 || camera_num < 1 || camera_num > IR_CAMERA_MAX_NUM || index >= camera_num)
     {
-        rst = uvc_camera_stream_close(KEEP_CAM_SIDE_PREVIEW);
-        if (rst < 0)
-            return rst;
-        else
-            is_streaming = 0;
+        return -1;
     }
-    uvc_camera_close();
-    uvc_camera_release();
-    return rst;
+    memset(camera, 0, sizeof(IrCamera_t));
+    camera->index = index;
+    camera->camera_num = camera_num;
+    camera->stream_frame_info.camera_index = index;
+    return ir_camera_open_same(&camera->stream_frame_info.camera_param, index, camera_num);
 }
 
-//stream start by stream_frame_info
-int ir_camera_stream_on(StreamFrameInfo_t* stream_frame_info)
+//stream on and start the camera's own stream thread
+int ir_camera_context_start(IrCamera_t* camera)
 {
-    int rst;
-
-    init_pthread_sem();
-
-    rst = uvc_camera_stream_start(stream_frame_info->camera_param, NULL);
-    if (rst < 0)
+    if (camera == NULL || camera->thread_started || camera->stream_frame_info.frame_ring == NULL)
     {
-        printf("uvc_camera_stream_start:%d\n", rst);
-        return rst;
+        return -1;
     }
-#if defined(TEMP_OUTPUT)
-    rst = y16_preview_start(PREVIEW_PATH0, Y16_MODE_TEMPERATURE);
+    int rst = ir_camera_stream_on(&camera->stream_frame_info);
     if (rst < 0)
     {
-        printf("y16_preview_start:%d\n", rst);
         return rst;
     }
-#endif
-
-    is_streaming = 1;
-    return rst;
+    if (pthread_create(&camera->tid_stream, NULL, stream_function, &camera->stream_frame_info) != 0)
+    {
+        ir_camera_stream_off(&camera->stream_frame_info);
+        return -1;
+    }
+    camera->thread_started = 1;
+    return 0;
 }
 
-//stream stop
-int ir_camera_stream_off(StreamFrameInfo_t* stream_frame_info)
+//stop the camera's stream thread
+void ir_camera_context_stop(IrCamera_t* camera)
 {
-    int rst = 0;
-
-    rst = uvc_camera_stream_close(KEEP_CAM_SIDE_PREVIEW);
-    if (rst < 0)
+    if (camera == NULL || !camera->thread_started)
     {
-        return rst;
+        return;
     }
+    ir_camera_stream_stop(&camera->stream_frame_info);
+    pthread_join(camera->tid_stream, NULL);
+    camera->thread_started = 0;
+}
 
-    destroy_data_demo(stream_frame_info);
-    destroy_pthread_sem();
-    is_streaming = 0;
-
-    return rst;
+//the stream thread checks its own camera's flag
+void ir_camera_stream_stop(StreamFrameInfo_t* stream_frame_info)
+{
+    stream_state_set(stream_frame_info, 0);
 }
 
-void auto_gain_switch(uint16_t* temp_frame, FrameInfo_t* temp_info, \
-    AutoGainSwitchInfo_t* auto_gain_switch_info)
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    uint32_t fps;                       //the newest rate asked for
+    uint32_t sent;                      //the rate the running command sets
+    uint8_t pending;
+}IrFpsSwitch_t;
+
+static IrFpsSwitch_t camera_fps_switch[IR_CAMERA_MAX_NUM];
+static pthread_mutex_t camera_fps_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+//runs on the cmdq worker
+static int camera_fps_command(void* arg)
 {
-    int rst = 0;
-    uint16_t cur_gain = 0;
-    uint8_t detect_flag = 0;
-    ImageRes_t image_res = { temp_info->width, temp_info->height };
-    GainSwitchParam_t gain_switch_param = { 0.1, (int)((130 + 273.15) * 16 * 4), \
-                                            0.95, (int)((110 + 273.15) * 16 * 4) };
+    IrFpsSwitch_t* fps_switch = (IrFpsSwitch_t*)arg;
+    pthread_mutex_lock(&camera_fps_mutex);
+    fps_switch->sent = fps_switch->fps;
+    uint8_t full_rate = (fps_switch->sent >= fps_switch->stream_frame_info->camera_param.fps);
+    pthread_mutex_unlock(&camera_fps_mutex);
+    return switch_fps(full_rate);
+}
 
-    //just switched, waiting for sensor loading
-    if (auto_gain_switch_info->switched_flag)
+static void camera_fps_done(int job_id, int result, void* user_data)
+{
+    IrFpsSwitch_t* fps_switch = (IrFpsSwitch_t*)user_data;
+    pthread_mutex_lock(&camera_fps_mutex);
+    if (result == IRUVC_SUCCESS)
     {
-        //printf("just switched\n");
-        auto_gain_switch_info->cur_switched_cnt++;
-        if (auto_gain_switch_info->cur_switched_cnt > auto_gain_switch_info->waiting_frame_cnt)
-        {
-            auto_gain_switch_info->switched_flag = 0;
-            auto_gain_switch_info->cur_switched_cnt = 0;
-        }
-        return;
+        fps_switch->stream_frame_info->fps = fps_switch->sent;
     }
-
-    rst = gain_switch_detect(temp_frame, image_res, gain_switch_param, &detect_flag);
-    if (rst < IRPROC_SUCCESS)
+    else
     {
-        printf("error\n");
-        return;
+        printf("switch fps to %u failed:%d\n", fps_switch->sent, result);
     }
-
-    if (detect_flag == 1)    //this frame needs switch to low
+    //asked again while the command ran, the queue is not held here
+    uint8_t again = (result != CMDQ_CLOSED && fps_switch->fps != fps_switch->sent);
+    fps_switch->pending = again;
+    pthread_mutex_unlock(&camera_fps_mutex);
+    if (again && cmdq_submit(camera_fps_command, fps_switch, CMDQ_PRIORITY_NORMAL, 0, camera_fps_done, fps_switch, \
+        NULL) != CMDQ_SUCCESS)
     {
-        auto_gain_switch_info->cur_detected_low_cnt++;
-        auto_gain_switch_info->cur_detected_high_cnt = 0;
+        pthread_mutex_lock(&camera_fps_mutex);
+        fps_switch->pending = 0;
+        pthread_mutex_unlock(&camera_fps_mutex);
+    }
+}
+
+int ir_camera_fps_set(StreamFrameInfo_t* stream_frame_info, uint32_t fps)
+{
+    if (stream_frame_info == NULL || stream_frame_info->camera_index < 0 || \
+        stream_frame_info->camera_index >= IR_CAMERA_MAX_NUM || \
+        (fps != stream_frame_info->camera_param.fps && fps != IR_CAMERA_FPS_LOW) || \
+        (stream_frame_info->frame_source != NULL && stream_frame_info->frame_source->param.type != FRAME_SOURCE_UVC && \
+        stream_frame_info->frame_source->param.type != FRAME_SOURCE_VOSPI))
+    {
+        return -1;
+    }
+    IrFpsSwitch_t* fps_switch = &camera_fps_switch[stream_frame_info->camera_index];
+    pthread_mutex_lock(&camera_fps_mutex);
+    fps_switch->stream_frame_info = stream_frame_info;
+    fps_switch->fps = fps;
+    if (fps_switch->pending)
+    {
+        //the queued command takes the newest rate, the running one is followed by another
+        pthread_mutex_unlock(&camera_fps_mutex);
+        return 0;
+    }
+    fps_switch->pending = 1;
+    pthread_mutex_unlock(&camera_fps_mutex);
+    int rst = cmdq_submit(camera_fps_command, fps_switch, CMDQ_PRIORITY_NORMAL, 0, camera_fps_done, fps_switch, NULL);
+    if (rst != CMDQ_SUCCESS)
+    {
+        pthread_mutex_lock(&camera_fps_mutex);
+        fps_switch->pending = 0;
+        pthread_mutex_unlock(&camera_fps_mutex);
+    }
+    return rst;
+}
+
+//on the stream thread, the first frame after a rate switch
+static void camera_fps_apply(StreamFrameInfo_t* stream_frame_info, FrameRing_t* ring, uint32_t fps)
+{
+    printf("camera %d fps=%u\n", stream_frame_info->camera_index, fps);
+    if (stream_frame_info->gain_ctrl != NULL)
+    {
+        gain_ctrl_fps_set(stream_frame_info->gain_ctrl, fps);
+    }
+    if (stream_frame_info->exposure_guard != NULL)
+    {
+        exposure_guard_fps_set(stream_frame_info->exposure_guard, fps);
+    }
+    //the pacer and the consumer timeouts follow the measured interval, start it at the new rate
+    ring->interval_us.store(1000000 / fps, std::memory_order_relaxed);
+    ring_capture_clock_set(ring, 1000000 / fps, stream_frame_info->capture_latency_us);
+}
+
+//the planes of a mode as load_stream_frame_info lays them out, the image plane is the same in every mode
+static void camera_mode_layout(StreamFrameInfo_t* stream_frame_info, const CameraParam_t* camera_param, \
+    IrStreamMode_t mode)
+{
+    uint8_t both = (mode == IR_STREAM_IMAGE_AND_TEMP);
+    stream_frame_info->camera_param = *camera_param;
+    stream_frame_info->temp_info.width = both ? camera_param->width : 0;
+    stream_frame_info->temp_info.height = both ? camera_param->height / 2 : 0;
+    stream_frame_info->temp_byte_size = stream_frame_info->temp_info.width * stream_frame_info->temp_info.height * 2;
+    stream_frame_info->zero_copy = both;
+}
+
+int ir_camera_stream_mode_switch(StreamFrameInfo_t* stream_frame_info, IrStreamMode_t mode)
+{
+    int index = (stream_frame_info != NULL) ? stream_frame_info->camera_index : -1;
+    if (index < 0 || index >= IR_CAMERA_MAX_NUM || mode < 0 || mode >= IR_STREAM_MODE_NUM || \
+        (stream_frame_info->frame_source != NULL && stream_frame_info->frame_source->param.type != FRAME_SOURCE_UVC) || \
+        stream_frame_info->info_byte_size > 0 || stream_frame_info->temp_interval > 1 || \
+        stream_frame_info->image_info.input_format == INPUT_FMT_Y8 || stream_frame_info->frame_pool != NULL || \
+        !camera_modes[index][mode].valid)
+    {
+        return -1;
+    }
+    const CameraParam_t* camera_param = &camera_modes[index][mode].camera_param;
+    uint32_t image_height = (mode == IR_STREAM_IMAGE_AND_TEMP) ? camera_param->height / 2 : camera_param->height;
+    if (camera_param->width != stream_frame_info->image_info.width || \
+        image_height != stream_frame_info->image_info.height)
+    {
+        //the display and every image consumer were sized for the image plane
+        printf("camera %d: the image plane of stream mode %d is %ux%u, streaming %ux%u\n", index, mode, \
+            camera_param->width, image_height, stream_frame_info->image_info.width, stream_frame_info->image_info.height);
+        return -1;
+    }
+    camera_mode_pending[index].store(mode + 1);
+    return 0;
+}
+
+//the mode the stream thread is to switch to, taken once
+static int camera_mode_take(int index, IrStreamMode_t* mode)
+{
+    if (index < 0 || index >= IR_CAMERA_MAX_NUM || camera_mode_pending[index].load(std::memory_order_relaxed) == 0)
+    {
+        return 0;
+    }
+    int pending = camera_mode_pending[index].exchange(0);
+    *mode = (IrStreamMode_t)(pending - 1);
+    return (pending != 0);
+}
+
+//the camera's frame counters
+int ir_camera_context_stats(IrCamera_t* camera, IrCameraStats_t* stats)
+{
+    if (camera == NULL || stats == NULL || camera->stream_frame_info.frame_ring == NULL)
+    {
+        return -1;
+    }
+    FrameRing_t* ring = camera->stream_frame_info.frame_ring;
+    stats->produced = ring->produced;
+    stats->dropped = ring->producer_dropped;
+    stats->lost = ring->producer_lost;
+    stats->hw_lost = ring->hw_lost;
+    stats->timeouts = ring->capture_timeouts;
+    stats->reconnects = camera_reconnects[camera->index];
+    return 0;
+}
+
+uint32_t ir_camera_reconnect_count(int index)
+{
+    if (index < 0 || index >= IR_CAMERA_MAX_NUM)
+    {
+        return 0;
+    }
+    return camera_reconnects[index];
+}
+
+void ir_camera_reconnect_set(const IrReconnectParam_t* param)
+{
+    if (param == NULL)
+    {
+        memset(&reconnect_param, 0, sizeof(reconnect_param));
+        return;
+    }
+    reconnect_param = *param;
+    if (reconnect_param.backoff_min_ms == 0)
+    {
+        reconnect_param.backoff_min_ms = IR_RECONNECT_BACKOFF_MIN_MS;
+    }
+    if (reconnect_param.backoff_max_ms < reconnect_param.backoff_min_ms)
+    {
+        reconnect_param.backoff_max_ms = (reconnect_param.backoff_min_ms > IR_RECONNECT_BACKOFF_MAX_MS) ? \
+            reconnect_param.backoff_min_ms : IR_RECONNECT_BACKOFF_MAX_MS;
+    }
+}
+
+//close the device
+int ir_camera_close(void)
+{
+    int rst = 0;
+    if (is_streaming)
+    {
+        rst = uvc_camera_stream_close(KEEP_CAM_SIDE_PREVIEW);
+        if (rst < 0)
+            return rst;
+        else
+            is_streaming = 0;
+    }
+    uvc_camera_close();
+    if (!fast_reopen)
+    {
+        uvc_camera_release();
+        uvc_context_ready = 0;
+    }
+    return rst;
+}
+
+//stream start by stream_frame_info
+int ir_camera_stream_on(StreamFrameInfo_t* stream_frame_info)
+{
+    int rst;
+
+    FrameSource_t* source = stream_frame_info->frame_source;
+    if (source != NULL && source->param.type != FRAME_SOURCE_UVC)
+    {
+        //the source writes the image plane then the temp plane, as the camera does
+        if (source->image_byte_size != stream_frame_info->image_byte_size || \
+            source->temp_byte_size != stream_frame_info->temp_byte_size)
+        {
+            printf("frame source planes %u/%u bytes, the stream expects %u/%u\n", source->image_byte_size, \
+                source->temp_byte_size, stream_frame_info->image_byte_size, stream_frame_info->temp_byte_size);
+            return SOURCE_ERROR_FORMAT;
+        }
+        printf("frame source: %s%s\n", frame_source_name(source->param.type), \
+            source->param.paced ? ", paced" : ", as fast as possible");
+        stream_state_set(stream_frame_info, 1);
+        return 0;
+    }
+
+    rst = camera_stream_start(stream_frame_info->camera_param, stream_frame_info->camera_index, NULL);
+    if (rst < 0)
+    {
+        printf("uvc_camera_stream_start:%d\n", rst);
+        return rst;
+    }
+    if (camera_mode_of(stream_frame_info->camera_index) == IR_STREAM_TEMP)
+    {
+        rst = y16_preview_start(PREVIEW_PATH0, Y16_MODE_TEMPERATURE);
+        if (rst < 0)
+        {
+            printf("y16_preview_start:%d\n", rst);
+            return rst;
+        }
+    }
+
+    stream_state_set(stream_frame_info, 1);
+    return rst;
+}
+
+//stream stop
+int ir_camera_stream_off(StreamFrameInfo_t* stream_frame_info)
+{
+    int rst = 0;
+
+    FrameSource_t* source = stream_frame_info->frame_source;
+    if (source == NULL || source->param.type == FRAME_SOURCE_UVC)
+    {
+        rst = uvc_camera_stream_close(KEEP_CAM_SIDE_PREVIEW);
+        if (rst < 0)
+        {
+            return rst;
+        }
+    }
+
+    destroy_data_demo(stream_frame_info);
+    stream_state_set(stream_frame_info, 0);
+
+    return rst;
+}
+
+void auto_gain_switch(uint16_t* temp_frame, FrameInfo_t* temp_info, \
+    AutoGainSwitchInfo_t* auto_gain_switch_info)
+{
+    int rst = 0;
+    uint16_t cur_gain = 0;
+    uint8_t detect_flag = 0;
+    ImageRes_t image_res = { temp_info->width, temp_info->height };
+    GainSwitchParam_t gain_switch_param = { 0.1, TEMP_RAW_OF_CELSIUS(130), 0.95, TEMP_RAW_OF_CELSIUS(110) };
+
+    //just switched, waiting for sensor loading
+    if (auto_gain_switch_info->switched_flag)
+    {
+        //printf("just switched\n");
+        auto_gain_switch_info->cur_switched_cnt++;
+        if (auto_gain_switch_info->cur_switched_cnt > auto_gain_switch_info->waiting_frame_cnt)
+        {
+            auto_gain_switch_info->switched_flag = 0;
+            auto_gain_switch_info->cur_switched_cnt = 0;
+        }
+        return;
+    }
+
+    rst = gain_switch_detect(temp_frame, image_res, gain_switch_param, &detect_flag);
+    if (rst < IRPROC_SUCCESS)
+    {
+        printf("error\n");
+        return;
+    }
+
+    if (detect_flag == 1)    //this frame needs switch to low
+    {
+        auto_gain_switch_info->cur_detected_low_cnt++;
+        auto_gain_switch_info->cur_detected_high_cnt = 0;
     }
     else if (detect_flag == 2)    //this frame needs switch to high
     {
@@ -218,7 +895,7 @@ void auto_gain_switch(uint16_t* temp_frame, FrameInfo_t* temp_info, \
         auto_gain_switch_info->switched_flag = 1;
         auto_gain_switch_info->cur_switched_cnt = 0;
 
-        rst = get_prop_tpd_params(TPD_PROP_GAIN_SEL, &cur_gain);
+        rst = prop_tpd_get(TPD_PROP_GAIN_SEL, &cur_gain);
         if (rst < IRPROC_SUCCESS)
         {
             printf("error\n");
@@ -229,12 +906,18 @@ void auto_gain_switch(uint16_t* temp_frame, FrameInfo_t* temp_info, \
         if ((detect_flag == 1) && (cur_gain != 0))
         {
             printf("switch to low gain!\n");
-            set_prop_tpd_params(TPD_PROP_GAIN_SEL, 0);//high->low
+            if (prop_tpd_set(TPD_PROP_GAIN_SEL, 0) == IRUVC_SUCCESS)//high->low
+            {
+                temp_gain_select(LOW_GAIN);
+            }
         }
         else if ((detect_flag == 2) && (cur_gain != 1))
         {
             printf("switch to high gain!\n");
-            set_prop_tpd_params(TPD_PROP_GAIN_SEL, 1);//low->high
+            if (prop_tpd_set(TPD_PROP_GAIN_SEL, 1) == IRUVC_SUCCESS)//low->high
+            {
+                temp_gain_select(HIGH_GAIN);
+            }
         }
 
 
@@ -259,7 +942,7 @@ void avoid_overexposure(uint16_t* temp_frame, FrameInfo_t* temp_info, int close_
         return;
     }
 
-    rst = get_prop_tpd_params(TPD_PROP_GAIN_SEL, &cur_gain);
+    rst = prop_tpd_get(TPD_PROP_GAIN_SEL, &cur_gain);
     if (rst < IRPROC_SUCCESS)
     {
         printf("error\n");
@@ -308,6 +991,360 @@ void avoid_overexposure(uint16_t* temp_frame, FrameInfo_t* temp_info, int close_
     }
 }
 
+//a stop request ends the wait at once, returns 0 when the stream was stopped
+static int camera_reconnect_wait(StreamFrameInfo_t* stream_frame_info, uint32_t wait_ms)
+{
+    return stream_state_wait_off(stream_frame_info, wait_ms);
+}
+
+//close what is left of the device and open it again with backoff, then restart the stream with the old parameters.
+//no libusb hotplug here: libiruvc owns the libusb context, each retry enumerates and that finds the replugged module
+static int camera_reconnect(StreamFrameInfo_t* stream_frame_info)
+{
+    int index = stream_frame_info->camera_index;
+    CameraParam_t old_param = stream_frame_info->camera_param;
+    uint32_t backoff_ms = reconnect_param.backoff_min_ms;
+
+    printf("camera %d lost, reconnecting\n", index);
+    uvc_camera_stream_close(KEEP_CAM_SIDE_PREVIEW);
+    uvc_camera_close();
+    if (!fast_reopen)
+    {
+        uvc_camera_release();
+        uvc_context_ready = 0;
+    }
+
+    for (uint32_t retry = 0; reconnect_param.max_retries == 0 || retry < reconnect_param.max_retries; retry++)
+    {
+        if (!camera_reconnect_wait(stream_frame_info, backoff_ms))
+        {
+            return -1;
+        }
+        backoff_ms = (backoff_ms * 2 > reconnect_param.backoff_max_ms) ? reconnect_param.backoff_max_ms : backoff_ms * 2;
+
+        CameraParam_t camera_param = { 0 };
+        if (ir_camera_open_same(&camera_param, index, camera_num_opened) < 0)
+        {
+            continue;
+        }
+        if (camera_param.width != old_param.width || camera_param.height != old_param.height || \
+            camera_param.fps != old_param.fps)
+        {
+            //the ring and every consumer were sized for the old module
+            printf("camera %d came back as %ux%u@%u, was %ux%u@%u\n", index, camera_param.width, camera_param.height, \
+                camera_param.fps, old_param.width, old_param.height, old_param.fps);
+            uvc_camera_close();
+            return -1;
+        }
+        int rst = camera_stream_start(camera_param, index, NULL);
+        if (rst >= 0 && camera_mode_of(index) == IR_STREAM_TEMP)
+        {
+            rst = y16_preview_start(PREVIEW_PATH0, Y16_MODE_TEMPERATURE);
+        }
+        if (rst < 0)
+        {
+            printf("camera %d stream restart:%d\n", index, rst);
+            uvc_camera_stream_close(KEEP_CAM_SIDE_PREVIEW);
+            uvc_camera_close();
+            continue;
+        }
+        stream_frame_info->camera_param = camera_param;
+        if (index >= 0 && index < IR_CAMERA_MAX_NUM)
+        {
+            camera_reconnects[index]++;
+        }
+        if (reconnect_param.on_reconnect != NULL)
+        {
+            reconnect_param.on_reconnect(stream_frame_info, reconnect_param.arg);
+        }
+        if (stream_frame_info->fps != camera_param.fps)
+        {
+            //the reopened module starts at its full rate
+            uint32_t fps = stream_frame_info->fps;
+            stream_frame_info->fps = camera_param.fps;
+            ir_camera_fps_set(stream_frame_info, fps);
+        }
+        printf("camera %d reconnected after %u retries\n", index, retry + 1);
+        return 0;
+    }
+    return -1;
+}
+
+#define STREAM_PLANE_IMAGE 0
+#define STREAM_PLANE_TEMP 1
+#define STREAM_PLANE_NUM 2
+
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    FrameSlot_t* slot;
+    uint8_t image_on;                   //a Y14/Y16 image plane
+    uint8_t temp_on;
+    uint32_t tag_flags;                 //of the temp band, merged after the join
+}StreamPlaneJob_t;
+
+//one plane of the slot in place: bad pixels, hdr fusion of the temp plane, then its statistics blocks and the
+//temp plane's pyramid
+static void stream_plane_band(void* arg, int band, int y0, int y1)
+{
+    (void)band;
+    StreamPlaneJob_t* job = (StreamPlaneJob_t*)arg;
+    StreamFrameInfo_t* stream_frame_info = job->stream_frame_info;
+    FrameSlot_t* slot = job->slot;
+    for (int plane = y0; plane < y1; plane++)
+    {
+        if (plane == STREAM_PLANE_IMAGE)
+        {
+            if (!job->image_on)
+            {
+                frame_stats_clear(&slot->image_stats);
+                continue;
+            }
+            badpix_apply(stream_frame_info->badpix, BADPIX_PLANE_IMAGE, (uint16_t*)slot->desc.image.data, \
+                slot->desc.image.width, slot->desc.image.height, slot->desc.image.stride);
+            frame_stats_compute_profiled((uint16_t*)slot->desc.image.data, slot->desc.image.width, \
+                slot->desc.image.height, &slot->image_stats, &slot->image_tiles, \
+                (stream_frame_info->stab != NULL) ? &slot->profiles : NULL);
+            continue;
+        }
+        if (!job->temp_on)
+        {
+            frame_stats_clear(&slot->temp_stats);
+            continue;
+        }
+        badpix_apply(stream_frame_info->badpix, BADPIX_PLANE_TEMP, (uint16_t*)slot->desc.temp.data, \
+            slot->desc.temp.width, slot->desc.temp.height, slot->desc.temp.stride);
+        if (stream_frame_info->hdr != NULL)
+        {
+            //before the statistics, they describe the fused frame
+            job->tag_flags |= hdr_frame(stream_frame_info->hdr, (uint16_t*)slot->desc.temp.data);
+        }
+        frame_stats_compute_profiled((uint16_t*)slot->desc.temp.data, slot->desc.temp.width, \
+            slot->desc.temp.height, &slot->temp_stats, &slot->temp_tiles, \
+            (stream_frame_info->stab != NULL && !job->image_on) ? &slot->profiles : NULL);
+        frame_pyramid_build(&slot->temp_pyramid, (const uint16_t*)slot->desc.temp.data);
+    }
+}
+
+//cut the written slot and compute its statistics blocks, before it is published
+static void stream_slot_prepare(StreamFrameInfo_t* stream_frame_info, FrameRing_t* ring, FrameSlot_t* slot, \
+    uint64_t timestamp_us)
+{
+    camera_first_frame(stream_frame_info->camera_index, timestamp_us);
+    if (ring->last_commit_us != 0 && timestamp_us > ring->last_commit_us)
+    {
+        uint64_t delta_us = timestamp_us - ring->last_commit_us;
+        uint64_t interval_us = ring->interval_us.load(std::memory_order_relaxed);
+        timing_record(TIMING_STAGE_FRAME_INTERVAL, delta_us);
+        if (interval_us != 0)
+        {
+            uint64_t jitter_us = (delta_us > interval_us) ? delta_us - interval_us : interval_us - delta_us;
+            timing_record(TIMING_STAGE_ARRIVAL_JITTER, jitter_us);
+        }
+    }
+    ring_slot_cut(ring, slot);
+    uint64_t stats_start_us = timing_record_since(TIMING_STAGE_CUT, timestamp_us);
+
+    //the image and the temp plane are independent branches up to here: their corrections and statistics run
+    //as two bands, the stream thread takes one and a pool worker the other, and join before the consumers
+    //of the temp statistics below. the slot is published with both, so no consumer waits on the other plane
+    StreamPlaneJob_t job;
+    job.stream_frame_info = stream_frame_info;
+    job.slot = slot;
+    job.tag_flags = 0;
+    uint8_t temp_cut = !(slot->tag_flags & FRAME_DESC_TEMP_SKIPPED);
+    const StreamConfig_t* config = stream_frame_info->config;
+    InputFormat_t image_format = config->image_info.input_format;
+    job.image_on = (config->image_byte_size > 0 && (image_format == INPUT_FMT_Y14 || image_format == INPUT_FMT_Y16));
+    job.temp_on = (config->temp_byte_size > 0 && temp_cut);
+    slot->profiles.valid = 0;
+    BandStage_t stage = { stream_plane_band, &job, STREAM_PLANE_NUM };
+    band_run(POOL_STAGE_STATS, &stage, 1, (job.image_on && job.temp_on) ? STREAM_PLANE_NUM : 1);
+    slot->tag_flags |= job.tag_flags;
+    timing_record_since(TIMING_STAGE_STATS, stats_start_us);
+    if (stream_frame_info->gain_ctrl != NULL)
+    {
+        slot->tag_flags |= gain_ctrl_frame(stream_frame_info->gain_ctrl, &slot->temp_stats);
+    }
+    if (stream_frame_info->exposure_guard != NULL)
+    {
+        slot->tag_flags |= exposure_guard_frame(stream_frame_info->exposure_guard, &slot->temp_stats);
+    }
+    if (stream_frame_info->shutter_mon != NULL)
+    {
+        const FrameStats_t* stats = slot->temp_stats.valid ? &slot->temp_stats : &slot->image_stats;
+        slot->tag_flags |= shutter_mon_frame(stream_frame_info->shutter_mon, stats, timestamp_us);
+    }
+    if (stream_frame_info->latency_probe != NULL)
+    {
+        //the seq ring_write_commit gives the slot
+        const FrameStats_t* stats = slot->temp_stats.valid ? &slot->temp_stats : &slot->image_stats;
+        latency_probe_frame(stream_frame_info->latency_probe, stats, ring->write_seq + 1, timestamp_us);
+    }
+    if (stream_frame_info->housekeep != NULL)
+    {
+        housekeep_frame(stream_frame_info->housekeep, \
+            (slot->tag_flags & FRAME_DESC_META) ? &slot->desc.meta : NULL, timestamp_us);
+    }
+}
+
+//capture only: the burst's frames go from the camera straight into its block, no slot is written or committed
+//so nothing else runs until it is full. returns the frames captured, the ring's gap
+static uint32_t stream_burst_capture(StreamFrameInfo_t* stream_frame_info, FrameRing_t* ring, Burst_t* burst)
+{
+    TRACE_BEGIN("burst");
+    burst_capture_begin(burst, ring->write_seq + 1);
+    int timeouts = 0;
+    uint8_t* raw_frame = NULL;
+    while (stream_frame_info->is_streaming && (raw_frame = burst_frame_next(burst)) != NULL)
+    {
+        uint64_t get_start_us = timing_start();
+        int r = (stream_frame_info->frame_source != NULL) ? \
+            frame_source_get(stream_frame_info->frame_source, raw_frame) : uvc_frame_get(raw_frame);
+        uint64_t timestamp_us = timing_record_since(TIMING_STAGE_CAPTURE, get_start_us);
+        if (r < 0)
+        {
+            //the stream loop sees the end or the failures again and handles them
+            ring->capture_timeouts++;
+            burst_frame_timeout(burst);
+            if (r == SOURCE_END || ++timeouts >= BURST_TIMEOUT_FRAMES)
+            {
+                break;
+            }
+            continue;
+        }
+        timeouts = 0;
+        cmdq_frame_mark(timestamp_us);
+        burst_frame_done(burst, timestamp_us);
+    }
+    uint32_t frames = burst_capture_end(burst);
+    TRACE_END("burst");
+    return frames;
+}
+
+//duty cycle: the result is in, close the host side of the stream and sleep out the period, then start it again.
+//returns the frames the camera would have sent meanwhile, -1 when the stream was stopped or did not come back
+//start the host side of the uvc stream again with its parameters, a start that fails goes on to a reconnect
+static int stream_uvc_restart(StreamFrameInfo_t* stream_frame_info, const char* reason)
+{
+    int rst = camera_stream_start(stream_frame_info->camera_param, stream_frame_info->camera_index, NULL);
+    if (rst >= 0 && camera_mode_of(stream_frame_info->camera_index) == IR_STREAM_TEMP)
+    {
+        rst = y16_preview_start(PREVIEW_PATH0, Y16_MODE_TEMPERATURE);
+    }
+    if (rst < 0)
+    {
+        printf("camera %d %s stream restart:%d\n", stream_frame_info->camera_index, reason, rst);
+        if (!reconnect_param.enable || camera_reconnect(stream_frame_info) < 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//between two frames: the host side of the stream restarts in the other mode, the device stays open, and the ring
+//takes the new layout so only its slots' buffers that no longer fit are allocated again. a mode that does not
+//start goes back to the old one, -1 when neither streams
+static int camera_mode_apply(StreamFrameInfo_t* stream_frame_info, FrameRing_t* ring, IrStreamMode_t mode)
+{
+    int index = stream_frame_info->camera_index;
+    IrStreamMode_t old_mode = camera_mode_of(index);
+    if (mode == old_mode)
+    {
+        return 0;
+    }
+    uint64_t start_us = get_monotonic_us();
+    CameraParam_t old_param = stream_frame_info->camera_param;
+    if (old_mode == IR_STREAM_TEMP)
+    {
+        y16_preview_stop(PREVIEW_PATH0);
+    }
+    uvc_camera_stream_close(KEEP_CAM_SIDE_PREVIEW);
+    camera_mode_layout(stream_frame_info, &camera_modes[index][mode].camera_param, mode);
+    int rst = data_format_change(stream_frame_info);
+    if (rst == 0)
+    {
+        rst = camera_stream_start(stream_frame_info->camera_param, index, NULL);
+        if (rst >= 0 && mode == IR_STREAM_TEMP)
+        {
+            rst = y16_preview_start(PREVIEW_PATH0, Y16_MODE_TEMPERATURE);
+        }
+        if (rst < 0)
+        {
+            uvc_camera_stream_close(KEEP_CAM_SIDE_PREVIEW);
+            camera_mode_layout(stream_frame_info, &old_param, old_mode);
+            if (data_format_change(stream_frame_info) != 0)
+            {
+                printf("camera %d: the ring did not take stream mode %d back\n", index, old_mode);
+                return -1;
+            }
+        }
+    }
+    else
+    {
+        camera_mode_layout(stream_frame_info, &old_param, old_mode);
+    }
+    if (rst < 0)
+    {
+        printf("camera %d stream mode %d -> %d:%d, staying\n", index, old_mode, mode, rst);
+        return stream_uvc_restart(stream_frame_info, "stream mode");
+    }
+    camera_mode_now[index] = (uint8_t)(mode + 1);
+    if (fast_reopen && camera_cache[index].valid)
+    {
+        camera_cache_store(index, &stream_frame_info->camera_param);
+    }
+    //the module's counter and the measured interval start over with the new stream
+    ring->hw_counter_valid = 0;
+    ring->interval_us.store(0, std::memory_order_relaxed);
+    printf("camera %d stream mode %d -> %d, %ux%u, in %.1fms\n", index, old_mode, mode, \
+        stream_frame_info->camera_param.width, stream_frame_info->camera_param.height, \
+        (get_monotonic_us() - start_us) / 1000.0);
+    if (stream_frame_info->fps != stream_frame_info->camera_param.fps)
+    {
+        //the restarted stream runs at the mode's full rate
+        uint32_t fps = stream_frame_info->fps;
+        stream_frame_info->fps = stream_frame_info->camera_param.fps;
+        ir_camera_fps_set(stream_frame_info, fps);
+    }
+    return 0;
+}
+
+static int64_t stream_duty_sleep(StreamFrameInfo_t* stream_frame_info, FrameRing_t* ring, DutyCycle_t* duty, \
+    uint32_t fps)
+{
+    TRACE_BEGIN("duty_sleep");
+    duty_result_wait(duty);
+    FrameSource_t* source = stream_frame_info->frame_source;
+    uint8_t uvc = (source == NULL || source->param.type == FRAME_SOURCE_UVC);
+    if (uvc)
+    {
+        uvc_camera_stream_close(KEEP_CAM_SIDE_PREVIEW);
+    }
+    uint64_t sleep_start_us = get_monotonic_us();
+    uint32_t wait_ms = duty_sleep_begin(duty, sleep_start_us);
+    int streaming = stream_frame_info->is_streaming;
+    while (streaming && wait_ms > 0)
+    {
+        streaming = stream_state_wait_off(stream_frame_info, wait_ms);
+        wait_ms = duty_sleep_next(duty, get_monotonic_us());
+    }
+    TRACE_END("duty_sleep");
+    if (!streaming)
+    {
+        return -1;
+    }
+    uint64_t wake_us = get_monotonic_us();
+    duty_wake(duty, wake_us);
+    if (uvc && stream_uvc_restart(stream_frame_info, "duty cycle") < 0)
+    {
+        return -1;
+    }
+    //the module's counter went on while the host side was closed, that is no loss
+    ring->hw_counter_valid = 0;
+    return (int64_t)((wake_us - sleep_start_us) * fps / 1000000);
+}
+
 //stream thread.this function can get the raw frame and cut it to image frame and temperature frame
 //and send semaphore to image/temperature thread
 void* stream_function(void* threadarg)
@@ -319,85 +1356,222 @@ void* stream_function(void* threadarg)
         return NULL;
     }
 
-    fps = stream_frame_info->camera_param.fps;
+    uint32_t fps = stream_frame_info->camera_param.fps;
 
-    printf("fps=%d\n", fps);
-    int i = 0;
+    printf("camera %d fps=%u\n", stream_frame_info->camera_index, fps);
+    uint64_t i = 0;
+    uint64_t frame_limit = (uint64_t)stream_time * fps;
     int r = 0;
     int overtime_cnt = 0;
     int overtime_threshold = 3;
-    AutoGainSwitchInfo_t auto_gain_switch_info = { 0 };
-    auto_gain_switch_info.switch_frame_cnt = 5 * fps;
-    auto_gain_switch_info.waiting_frame_cnt = 7 * fps;
-
-    while (is_streaming && (i <= stream_time * fps))//display stream_time seconds
-    {
-#if defined(_WIN32)
-        WaitForSingleObject(image_done_sem, INFINITE);
-        WaitForSingleObject(temp_done_sem, INFINITE);
-#elif defined(linux) || defined(unix)
-        sem_wait(&image_done_sem);
-        sem_wait(&temp_done_sem);
-#endif
-        r = uvc_frame_get(stream_frame_info->raw_frame);
+
+    FrameRing_t* ring = stream_frame_info->frame_ring;
+    if (ring == NULL)
+    {
+        printf("frame ring is not created\n");
+        return NULL;
+    }
+    TRACE_THREAD_NAME("stream");
+    char rt_name[RT_NAME_LEN];
+    snprintf(rt_name, sizeof(rt_name), "stream%d", stream_frame_info->camera_index);
+    rt_thread_enter(RT_ROLE_ACQUISITION, stream_frame_info->camera_index, rt_name);
+    ring_capture_clock_set(ring, (fps > 0) ? 1000000 / fps : 0, stream_frame_info->capture_latency_us);
+    DutyCycle_t* duty = stream_frame_info->duty;
+    if (duty != NULL)
+    {
+        duty_wake(duty, get_monotonic_us());
+    }
+    FrameIntegrity_t* integrity = stream_frame_info->integrity;
+    uint8_t uvc = (stream_frame_info->frame_source == NULL || \
+        stream_frame_info->frame_source->param.type == FRAME_SOURCE_UVC);
+
+    //acquisition never waits for the display/temperature threads, they read from the frame ring
+    while (stream_frame_info->is_streaming && (i <= frame_limit))//display stream_time seconds
+    {
+        uint32_t fps_now = stream_frame_info->fps;
+        if (fps_now != 0 && fps_now != fps)
+        {
+            //the seconds left of stream_time stay the same
+            frame_limit = i + (frame_limit - i) * fps_now / fps;
+            fps = fps_now;
+            camera_fps_apply(stream_frame_info, ring, fps);
+        }
+        IrStreamMode_t mode;
+        if (uvc && camera_mode_take(stream_frame_info->camera_index, &mode))
+        {
+            uint64_t switch_start_us = get_monotonic_us();
+            TRACE_BEGIN("mode_switch");
+            int switched = camera_mode_apply(stream_frame_info, ring, mode);
+            TRACE_END("mode_switch");
+            if (switched < 0)
+            {
+                break;
+            }
+            //the frames of the restart are a gap, as a reconnect's
+            ring_write_skip(ring, (get_monotonic_us() - switch_start_us) * fps / 1000000);
+            continue;
+        }
+        if (burst_pending(stream_frame_info->burst))
+        {
+            //the consumers see the burst as frames they missed
+            uint32_t captured = stream_burst_capture(stream_frame_info, ring, stream_frame_info->burst);
+            ring_write_skip(ring, captured);
+            i += captured;
+            if (i >= frame_limit)
+            {
+                break;
+            }
+            continue;
+        }
+        FrameSlot_t* slot = ring_write_begin(ring);
+        uint8_t* raw_frame = (slot != NULL) ? slot->raw_frame : ring->drain_frame;
+
+        uint64_t get_start_us = timing_start();
+        TRACE_BEGIN("frame_get");
+        r = (stream_frame_info->frame_source != NULL) ? frame_source_get(stream_frame_info->frame_source, raw_frame) : \
+            uvc_frame_get(raw_frame);
+        TRACE_END("frame_get");
+        uint64_t timestamp_us = timing_record_since(TIMING_STAGE_CAPTURE, get_start_us);
+        if (r == SOURCE_END && stream_frame_info->frame_source != NULL && \
+            stream_frame_info->frame_source->param.type != FRAME_SOURCE_UVC)
+        {
+            if (slot != NULL)
+            {
+                ring_write_abort(ring, slot);
+            }
+            printf("frame source ended\n");
+            break;
+        }
         if (r < 0)
         {
             overtime_cnt++;
+            ring->capture_timeouts++;
+            TRACE_INSTANT("frame_timeout", overtime_cnt);
         }
         else
         {
             overtime_cnt = 0;
+            cmdq_frame_mark(timestamp_us);
         }
-        while (r < 0 && overtime_cnt >= overtime_threshold)
+        if (r < 0 || slot == NULL)
         {
-#if defined(_WIN32)
-            ReleaseSemaphore(image_sem, 1, NULL);
-            ReleaseSemaphore(temp_sem, 1, NULL);
-#elif defined(linux) || defined(unix)
-            sem_post(&image_sem);
-            sem_post(&temp_sem);
-#endif
-            ir_camera_stream_off(stream_frame_info);
-            printf("uvc_frame_get failed\n ");
-            return NULL;
+            if (slot != NULL)
+            {
+                ring_write_abort(ring, slot);
+            }
+            else if (r >= 0)
+            {
+                ring_write_drop(ring);
+                TRACE_INSTANT("ring_full", ring->producer_dropped);
+            }
+            if (r < 0 && overtime_cnt >= overtime_threshold)
+            {
+                LOG_RATE(LOG_LEVEL_WARN, 1000, "uvc_frame_get failed\n");
+                if (!reconnect_param.enable || stream_frame_info->frame_source != NULL)
+                {
+                    break;
+                }
+                uint64_t lost_start_us = get_monotonic_us();
+                TRACE_BEGIN("reconnect");
+                int reconnected = camera_reconnect(stream_frame_info);
+                TRACE_END("reconnect");
+                if (reconnected < 0)
+                {
+                    break;
+                }
+                //consumers see the frames the camera would have sent as a gap in the sequence numbers
+                ring_write_skip(ring, (get_monotonic_us() - lost_start_us) * fps / 1000000);
+                overtime_cnt = 0;
+            }
+            continue;
         }
 
-        if (stream_frame_info->raw_frame != NULL)
+        TRACE_BEGIN("frame_prepare");
+        stream_slot_prepare(stream_frame_info, ring, slot, timestamp_us);
+        if (stream_frame_info->temp_byte_size > 0)
         {
-            raw_data_cut((uint8_t*)stream_frame_info->raw_frame, stream_frame_info->image_byte_size, \
-                stream_frame_info->temp_byte_size, (uint8_t*)stream_frame_info->image_frame, \
-                (uint8_t*)stream_frame_info->temp_frame);
-            if (stream_frame_info->temp_byte_size > 0)
+            //auto gain switch and overexposure protection: stream_frame_info->gain_ctrl/exposure_guard,
+            //from the statistics of stream_slot_prepare
+        }
+        uint8_t commit = 1;
+        if (integrity != NULL && integrity_frame(integrity, slot, timestamp_us) != 0)
+        {
+            slot->tag_flags |= FRAME_DESC_CORRUPT;
+            commit = !integrity->param.drop;
+            TRACE_INSTANT("frame_corrupt", integrity->stats.bad);
+        }
+        if (stream_frame_info->stab != NULL && commit)
+        {
+            //after the integrity check, a torn frame would read as a jump of the view
+            slot->tag_flags |= stab_frame(stream_frame_info->stab, slot);
+        }
+        if (commit && (duty == NULL || duty_frame(duty, slot->tag_flags, ring->write_seq + 1, timestamp_us)))
+        {
+            ring_write_commit(ring, slot, timestamp_us);
+            TRACE_INSTANT("frame_commit", ring->write_seq);
+        }
+        else
+        {
+            //settling after a wake or a bad transfer, the consumers only get stable frames
+            ring_write_abort(ring, slot);
+        }
+        TRACE_END("frame_prepare");
+        if (integrity != NULL && integrity_restart_due(integrity, timestamp_us) && uvc)
+        {
+            //frames keep coming and none of them is any good, the timeouts above never see it
+            LOG_RATE(LOG_LEVEL_WARN, 1000, "camera %d: %u bad frames in a row, restarting the stream\n", \
+                stream_frame_info->camera_index, integrity->stats.bad_run);
+            TRACE_BEGIN("integrity_restart");
+            uvc_camera_stream_close(KEEP_CAM_SIDE_PREVIEW);
+            int restarted = stream_uvc_restart(stream_frame_info, "integrity");
+            TRACE_END("integrity_restart");
+            if (restarted < 0)
             {
-                //avoid_overexposure((uint16_t*)stream_frame_info->temp_frame, &stream_frame_info->temp_info, 10 * fps);
-                //auto_gain_switch((uint16_t*)stream_frame_info->temp_frame, &stream_frame_info->temp_info, &auto_gain_switch_info);
+                break;
             }
+            integrity_restarted(integrity);
+            ring->hw_counter_valid = 0;
         }
-#if defined(_WIN32)
-        ReleaseSemaphore(image_sem, 1, NULL);
-        ReleaseSemaphore(temp_sem, 1, NULL);
-#elif defined(linux) || defined(unix)
-        sem_post(&image_sem);
-        sem_post(&temp_sem);
-#endif
+        timing_dump_check();
         //printf("raw data\n");
         i++;
-        if (i == stream_time * fps)
+        if (i == frame_limit)
         {
-            is_streaming = 0;
             break;
         }
+        if (duty != NULL && duty_sleep_due(duty, timestamp_us))
+        {
+            int64_t slept = stream_duty_sleep(stream_frame_info, ring, duty, fps);
+            if (slept < 0)
+            {
+                break;
+            }
+            i += slept;
+            if (i >= frame_limit)
+            {
+                break;
+            }
+        }
     }
+    stream_state_set(stream_frame_info, 0);
 
-#if defined(_WIN32)
-    WaitForSingleObject(image_done_sem, INFINITE);
-    WaitForSingleObject(temp_done_sem, INFINITE);
-#elif defined(linux) || defined(unix)
-    sem_wait(&image_done_sem);
-    sem_wait(&temp_done_sem);
-#endif
+    //let the consumers finish their current frame before the buffers are released
+    ring_close(ring);
+    if (ring_wait_detached(ring, 2000) != RING_SUCCESS)
+    {
+        printf("frame ring consumers still attached\n");
+    }
+    printf("camera %d frames produced:%llu, dropped without free slot:%llu\n", stream_frame_info->camera_index, \
+        (unsigned long long)ring->produced, (unsigned long long)ring->producer_dropped);
+    TimingStats_t holds;
+    uint64_t long_holds = 0;
+    ring_hold_stats(ring, &holds, &long_holds);
+    printf("camera %d slot holds p50:%lluus p99:%lluus max:%lluus, %llu longer than %ums\n", \
+        stream_frame_info->camera_index, (unsigned long long)holds.p50_us, (unsigned long long)holds.p99_us, \
+        (unsigned long long)holds.max_us, (unsigned long long)long_holds, ring->hold_warn_us / 1000);
 
     ir_camera_stream_off(stream_frame_info);
+    rt_thread_leave();
 
     printf("stream thread exit!!\n");
     return NULL;
@@ -409,28 +1583,24 @@ int ir_camera_stream_on_with_callback(StreamFrameInfo_t* stream_frame_info, void
     int rst;
 
     static UserCallback_t user_callback = { test_func, (void*)stream_frame_info };
-    rst = uvc_camera_stream_start(stream_frame_info->camera_param, &user_callback);
+    rst = camera_stream_start(stream_frame_info->camera_param, stream_frame_info->camera_index, &user_callback);
     printf("uvc_camera_stream_start:%d\n", rst);
     if (rst < 0)
     {
         return rst;
     }
-    is_streaming = 1;
-#if defined(TEMP_OUTPUT)
-    rst = y16_preview_start(PREVIEW_PATH0, Y16_MODE_TEMPERATURE);
-    if (rst < 0)
+    stream_state_set(stream_frame_info, 1);
+    if (camera_mode_of(stream_frame_info->camera_index) == IR_STREAM_TEMP)
     {
-        printf("y16_preview_start:%d\n", rst);
-        return rst;
+        rst = y16_preview_start(PREVIEW_PATH0, Y16_MODE_TEMPERATURE);
+        if (rst < 0)
+        {
+            printf("y16_preview_start:%d\n", rst);
+            return rst;
+        }
     }
-#endif
-    //display 100s
-#if defined(_WIN32)
-    //while (1);
-    //Sleep(100000);
-#elif defined(linux) || defined(unix)
-    sleep(100);
-#endif
+    //display 100s, or until the stream is stopped
+    stream_state_wait_off(stream_frame_info, 100000);
 
 #ifdef OPENCV_ENABLE
     //cv::destroyAllWindows();
@@ -448,7 +1618,213 @@ int ir_camera_stream_off_with_callback(StreamFrameInfo_t* stream_frame_info)
     {
         return rst;
     }
-    is_streaming = 0;
+    stream_state_set(stream_frame_info, 0);
+
+    destroy_data_demo(stream_frame_info);
+    return rst;
+}
+
+//callback mode hand-off: slots the libiruvc callback filled, waiting for the pipeline thread
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    FrameSlot_t* slots[FRAME_RING_MAX_DEPTH];   //at most one entry per ring slot
+    uint64_t timestamps_us[FRAME_RING_MAX_DEPTH];
+    uint32_t head;
+    uint32_t count;
+    uint8_t running;
+    uint64_t signal_us;                         //the last signal of cond, for the pipeline thread's wakeup latency
+    pthread_t tid;
+    sync_mutex_t mutex;
+    sync_cond_t cond;
+}StreamHandoff_t;
+
+static StreamHandoff_t stream_handoff = { 0 };
+
+//runs in the libiruvc transfer thread: one copy into a free ring slot, everything else is left to the pipeline
+static void stream_handoff_callback(void* frame, void* usr_param)
+{
+    uint64_t entry_us = get_monotonic_us();
+    StreamHandoff_t* handoff = (StreamHandoff_t*)usr_param;
+    FrameRing_t* ring = handoff->stream_frame_info->frame_ring;
+    if (frame == NULL || ring == NULL || !handoff->running)
+    {
+        timing_record_since(TIMING_STAGE_CALLBACK, entry_us);
+        return;
+    }
+    cmdq_frame_mark(entry_us);
+
+    FrameSlot_t* slot = ring_write_begin(ring);
+    if (slot == NULL)
+    {
+        ring_write_drop(ring);
+        timing_record_since(TIMING_STAGE_CALLBACK, entry_us);
+        return;
+    }
+    //the library reuses its buffer once the callback returns, so this is the frame's only copy
+    memcpy(slot->raw_frame, frame, ring->format.camera_param.frame_size);
+
+    sync_mutex_lock(&handoff->mutex);
+    uint32_t tail = (handoff->head + handoff->count) % FRAME_RING_MAX_DEPTH;
+    handoff->slots[tail] = slot;
+    handoff->timestamps_us[tail] = entry_us;
+    handoff->count++;
+    handoff->signal_us = get_monotonic_us();
+    sync_cond_signal(&handoff->cond);
+    sync_mutex_unlock(&handoff->mutex);
+    timing_record_since(TIMING_STAGE_CALLBACK, entry_us);
+}
+
+//pipeline thread of the callback mode: what stream_function does after uvc_frame_get
+static void* stream_handoff_function(void* threadarg)
+{
+    StreamHandoff_t* handoff = (StreamHandoff_t*)threadarg;
+    StreamFrameInfo_t* stream_frame_info = handoff->stream_frame_info;
+    FrameRing_t* ring = stream_frame_info->frame_ring;
+    uint32_t fps = stream_frame_info->camera_param.fps;
+    char rt_name[RT_NAME_LEN];
+    snprintf(rt_name, sizeof(rt_name), "handoff%d", stream_frame_info->camera_index);
+    rt_thread_enter(RT_ROLE_ACQUISITION, stream_frame_info->camera_index, rt_name);
+    ring_capture_clock_set(ring, (fps > 0) ? 1000000 / fps : 0, stream_frame_info->capture_latency_us);
+
+    sync_mutex_lock(&handoff->mutex);
+    while (1)
+    {
+        uint8_t waited = 0;
+        while (handoff->count == 0 && handoff->running)
+        {
+            sync_cond_wait(&handoff->cond, &handoff->mutex);
+            waited = 1;
+        }
+        if (handoff->count == 0)
+        {
+            break;
+        }
+        if (waited)
+        {
+            rt_wakeup_record_since(handoff->signal_us);
+        }
+        FrameSlot_t* slot = handoff->slots[handoff->head];
+        uint64_t timestamp_us = handoff->timestamps_us[handoff->head];
+        handoff->head = (handoff->head + 1) % FRAME_RING_MAX_DEPTH;
+        handoff->count--;
+        sync_mutex_unlock(&handoff->mutex);
+
+        if (stream_frame_info->fps != 0 && stream_frame_info->fps != fps)
+        {
+            fps = stream_frame_info->fps;
+            camera_fps_apply(stream_frame_info, ring, fps);
+        }
+        stream_slot_prepare(stream_frame_info, ring, slot, timestamp_us);
+        ring_write_commit(ring, slot, timestamp_us);
+        timing_dump_check();
+
+        sync_mutex_lock(&handoff->mutex);
+    }
+    sync_mutex_unlock(&handoff->mutex);
+    rt_thread_leave();
+    return NULL;
+}
+
+//no callback is running any more: publish what was handed off and stop the pipeline thread
+static void stream_handoff_stop(StreamHandoff_t* handoff)
+{
+    if (!handoff->running)
+    {
+        return;
+    }
+    sync_mutex_lock(&handoff->mutex);
+    handoff->running = 0;
+    sync_cond_signal(&handoff->cond);
+    sync_mutex_unlock(&handoff->mutex);
+    pthread_join(handoff->tid, NULL);
+    sync_mutex_destroy(&handoff->mutex);
+    sync_cond_destroy(&handoff->cond);
+}
+
+//stream start in callback mode, the frames go to the frame ring's consumers
+int ir_camera_stream_on_with_handoff(StreamFrameInfo_t* stream_frame_info)
+{
+    if (stream_frame_info == NULL || stream_frame_info->frame_ring == NULL || stream_handoff.running)
+    {
+        return -1;
+    }
+    StreamHandoff_t* handoff = &stream_handoff;
+    handoff->stream_frame_info = stream_frame_info;
+    handoff->head = 0;
+    handoff->count = 0;
+    handoff->running = 1;
+    sync_mutex_init(&handoff->mutex);
+    sync_cond_init(&handoff->cond);
+    if (pthread_create(&handoff->tid, NULL, stream_handoff_function, handoff) != 0)
+    {
+        handoff->running = 0;
+        sync_mutex_destroy(&handoff->mutex);
+        sync_cond_destroy(&handoff->cond);
+        return -1;
+    }
+
+    static UserCallback_t user_callback = { (void*)stream_handoff_callback, (void*)&stream_handoff };
+    int rst = camera_stream_start(stream_frame_info->camera_param, stream_frame_info->camera_index, &user_callback);
+    printf("uvc_camera_stream_start:%d\n", rst);
+    if (rst < 0)
+    {
+        stream_handoff_stop(handoff);
+        handoff->stream_frame_info = NULL;
+        return rst;
+    }
+    stream_state_set(stream_frame_info, 1);
+    if (camera_mode_of(stream_frame_info->camera_index) == IR_STREAM_TEMP)
+    {
+        rst = y16_preview_start(PREVIEW_PATH0, Y16_MODE_TEMPERATURE);
+        if (rst < 0)
+        {
+            printf("y16_preview_start:%d\n", rst);
+            return rst;
+        }
+    }
+    return rst;
+}
+
+//stop stream, publish the frames already handed off, then close the ring and release the buffers
+int ir_camera_stream_off_with_handoff(StreamFrameInfo_t* stream_frame_info)
+{
+    StreamHandoff_t* handoff = &stream_handoff;
+    if (stream_frame_info == NULL || handoff->stream_frame_info != stream_frame_info)
+    {
+        return -1;
+    }
+    int rst = 0;
+    if (stream_frame_info->is_streaming)
+    {
+        rst = uvc_camera_stream_close(KEEP_CAM_SIDE_PREVIEW);
+        stream_state_set(stream_frame_info, 0);
+    }
+    stream_handoff_stop(handoff);
+    handoff->stream_frame_info = NULL;
+
+    FrameRing_t* ring = stream_frame_info->frame_ring;
+    if (ring != NULL)
+    {
+        ring_close(ring);
+        if (ring_wait_detached(ring, 2000) != RING_SUCCESS)
+        {
+            printf("frame ring consumers still attached\n");
+        }
+        printf("camera %d frames produced:%llu, dropped without free slot:%llu\n", stream_frame_info->camera_index, \
+            (unsigned long long)ring->produced, (unsigned long long)ring->producer_dropped);
+        TimingStats_t holds;
+        uint64_t long_holds = 0;
+        ring_hold_stats(ring, &holds, &long_holds);
+        printf("camera %d slot holds p50:%lluus p99:%lluus max:%lluus, %llu longer than %ums\n", \
+            stream_frame_info->camera_index, (unsigned long long)holds.p50_us, (unsigned long long)holds.p99_us, \
+            (unsigned long long)holds.max_us, (unsigned long long)long_holds, ring->hold_warn_us / 1000);
+    }
+    TimingStats_t residency;
+    if (timing_stats_get(TIMING_STAGE_CALLBACK, &residency) == 0 && residency.count > 0)
+    {
+        printf("callback residency: mean %lluus, p99 %lluus, max %lluus\n", (unsigned long long)residency.mean_us, \
+            (unsigned long long)residency.p99_us, (unsigned long long)residency.max_us);
+    }
 
     destroy_data_demo(stream_frame_info);
     return rst;
@@ -3,21 +3,144 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 #include "data.h"
 #include "libiruvc.h"
 #include "libirparse.h"
 
 #include "display.h"
 #include "cmd.h"
+#include "source.h"
+#include "gain.h"
+#include "exposure.h"
+#include "shutter.h"
+#include "latency.h"
+#include "hdr.h"
+#include "housekeep.h"
+#include "badpix.h"
 
 #define IMAGE_AND_TEMP_OUTPUT	//normal mode:get 1 image frame and temp frame at the same time 
 //#define IMAGE_OUTPUT	//only image frame
 //#define TEMP_OUTPUT		//only temp frame
 
+#define IR_CAMERA_VID 0x0BDA
+#define IR_CAMERA_PID 0x5840
+#define IR_CAMERA_MAX_NUM 16
+#define IR_CAMERA_NAME_LEN 64           //fast reopen keeps its own copy of the device name and format
+#define IR_CAMERA_FORMAT_LEN 16
+#define IR_CAMERA_FPS_LOW 9             //the sensor rate with its 25 fps mode off, switch_fps(0)
+#define IR_RECONNECT_BACKOFF_MIN_MS 100
+#define IR_RECONNECT_BACKOFF_MAX_MS 5000
+
+//what the camera streams, the defines above select the default
+typedef enum
+{
+    IR_STREAM_IMAGE_AND_TEMP = 0,   //the image half and the temp half in one frame
+    IR_STREAM_IMAGE,                //only the image frame
+    IR_STREAM_TEMP,                 //only the temp frame, y16 temperature preview
+    IR_STREAM_MODE_NUM
+}IrStreamMode_t;
+
+//one module of several identical ones: its stream parameters, buffers, frame ring and acquisition thread
+typedef struct {
+    int index;                      //same_dev_index for uvc_camera_open_same
+    int camera_num;                 //modules sharing the usb bandwidth
+    StreamFrameInfo_t stream_frame_info;
+    pthread_t tid_stream;
+    uint8_t thread_started;
+}IrCamera_t;
+
+typedef struct {
+    uint64_t produced;              //frames published to the camera's ring
+    uint64_t dropped;               //frames received while every ring slot was held
+    uint64_t lost;                  //frames missed while the camera was reconnecting, a gap in the sequence numbers
+    uint64_t hw_lost;               //ac020 info lines: frames the module counted but the host never got
+    uint64_t timeouts;              //uvc_frame_get calls that failed (usb timeouts), 3 in a row reconnect
+    uint32_t reconnects;
+}IrCameraStats_t;
+
+//called on the stream thread after a reconnect restarted the stream, to apply device side settings again
+//(gain, shutter, env correction). image_info/temp_info and the loaded calibration tables are host side and kept
+typedef void (*IrReconnectFunc_t)(StreamFrameInfo_t* stream_frame_info, void* arg);
+
+typedef struct {
+    uint8_t enable;
+    uint32_t backoff_min_ms;        //first retry, doubled up to backoff_max_ms. 0 selects the defaults
+    uint32_t backoff_max_ms;
+    uint32_t max_retries;           //0 retries until the stream is stopped
+    IrReconnectFunc_t on_reconnect;
+    void* arg;
+}IrReconnectParam_t;
+
 
 //open the ir camera,and get its parameter(width,height,fps,and so on)
 int ir_camera_open(CameraParam_t* camera_param);
 
+//open the same_dev_index-th module with IR_CAMERA_VID/PID, the bandwidth factor is set to 1/camera_num (or planned)
+int ir_camera_open_same(CameraParam_t* camera_param, int same_dev_index, int camera_num);
+
+//fast reopen: the first full open of each module caches its DevCfg_t and chosen stream parameters, later opens
+//skip uvc_camera_list/uvc_camera_info_get and open straight away, and ir_camera_close keeps the libusb context.
+//a cached open that fails enumerates again. modules are told apart by same_dev_index, the device list has no serial
+void ir_camera_fast_reopen_set(uint8_t enable);
+
+//usb bandwidth plan (usbplan.h): each open reads where the modules sit on the controllers, each stream start sets
+//the module's planned factor instead of 1/camera_num and retries lower when the controller refuses the start
+void ir_camera_usb_plan_set(uint8_t enable);
+
+//forget the cached modules, after they were replugged or swapped
+void ir_camera_cache_clear(void);
+
+//the stream mode of the next open, a change also forgets the cached stream parameters
+void ir_camera_stream_mode_set(IrStreamMode_t mode);
+
+IrStreamMode_t ir_camera_stream_mode(void);
+
+//switch a running uvc stream to another mode with a restart of its host side only: the stream thread closes the
+//stream, starts it with the mode's parameters of the last full open and gives the frame ring the new layout
+//(data_format_change), consumers find FRAME_DESC_FORMAT_CHANGE on its first frame and the restart as a gap.
+//-1 for a mode the module does not list, another image plane, the info lines, the y8 preview or a frame pool.
+//taken up by stream_function before its next frame, the callback and handoff threads do not switch
+int ir_camera_stream_mode_switch(StreamFrameInfo_t* stream_frame_info, IrStreamMode_t mode);
+
+//the mode the camera streams, ir_camera_stream_mode until it switched
+IrStreamMode_t ir_camera_stream_mode_of(int index);
+
+//release the libusb context ir_camera_close kept in fast reopen mode, at exit
+void ir_camera_release(void);
+
+//modules with IR_CAMERA_VID/PID attached, the same_dev_index range of ir_camera_open_same. the libusb context is
+//released again unless fast reopen keeps it
+int ir_camera_count(void);
+
+//when uvc_frame_get keeps failing the stream thread closes the device and reopens it in the background instead of
+//exiting, the frame ring and its consumers stay as they are. a module with other stream parameters ends the stream
+void ir_camera_reconnect_set(const IrReconnectParam_t* param);
+
+//open one camera into its context, fill stream_frame_info (load_stream_frame_info) before starting it
+int ir_camera_context_open(IrCamera_t* camera, int index, int camera_num);
+
+//stream on and start the camera's own stream thread
+int ir_camera_context_start(IrCamera_t* camera);
+
+//stop the camera's stream thread, it turns the stream off and releases the buffers
+void ir_camera_context_stop(IrCamera_t* camera);
+
+//switch the sensor rate while streaming, to the full camera_param.fps or IR_CAMERA_FPS_LOW. the command goes through
+//the command queue, returns once it is queued. on the first frame after it ran the stream thread rescales what
+//counts in frames (gain switch and overexposure windows, reconnect gaps, the stream_time limit) and the frame ring's
+//interval, the encoder and the temperature reports follow stream_frame_info->fps on their own
+int ir_camera_fps_set(StreamFrameInfo_t* stream_frame_info, uint32_t fps);
+
+//ask the stream thread of stream_frame_info to leave, it turns the stream off and releases the buffers on its way out
+void ir_camera_stream_stop(StreamFrameInfo_t* stream_frame_info);
+
+//the camera's frame counters, only valid while it streams
+int ir_camera_context_stats(IrCamera_t* camera, IrCameraStats_t* stats);
+
+//reconnects of the index-th module since the process started, 0 for an index out of range
+uint32_t ir_camera_reconnect_count(int index);
+
 //close the ir camera 
 int ir_camera_close(void);
 
@@ -36,4 +159,12 @@ int ir_camera_stream_on_with_callback(StreamFrameInfo_t* stream_frame_info, void
 //stop stream
 int ir_camera_stream_off_with_callback(StreamFrameInfo_t* stream_frame_info);
 
+//callback mode that never holds the libiruvc transfer thread: the callback copies the frame into a free
+//frame ring slot and returns, a pipeline thread cuts it, computes its statistics and publishes it to the
+//ring's consumers (display/temperature threads or tasks). time inside the callback is the timing "callback" stage
+int ir_camera_stream_on_with_handoff(StreamFrameInfo_t* stream_frame_info);
+
+//stop the stream, publish the frames already handed off, close the frame ring and release the buffers
+int ir_camera_stream_off_with_handoff(StreamFrameInfo_t* stream_frame_info);
+
 #endif
@@ -0,0 +1,245 @@
+#include "clahe.h"
+#include <stdlib.h>
+#include <string.h>
+#include "band.h"
+#include "simd.h"
+
+static Clahe_t display_clahe;
+static uint8_t display_clahe_inited = 0;
+
+void clahe_default_param(ClaheParam_t* param)
+{
+    param->tiles_x = CLAHE_DEFAULT_TILES_X;
+    param->tiles_y = CLAHE_DEFAULT_TILES_Y;
+    param->clip_limit = CLAHE_DEFAULT_CLIP;
+}
+
+int clahe_init(Clahe_t* clahe, const ClaheParam_t* param)
+{
+    if (clahe == NULL || (param != NULL && (param->tiles_x == 0 || param->tiles_y == 0 || \
+        param->tiles_x * param->tiles_y > CLAHE_TILES_MAX || param->clip_limit < 0)))
+    {
+        return CLAHE_ERROR_PARAM;
+    }
+    memset(clahe, 0, sizeof(Clahe_t));
+    if (param != NULL)
+    {
+        clahe->param = *param;
+    }
+    else
+    {
+        clahe_default_param(&clahe->param);
+    }
+    return CLAHE_SUCCESS;
+}
+
+void clahe_release(Clahe_t* clahe)
+{
+    if (clahe == NULL)
+    {
+        return;
+    }
+    free(clahe->col_tile);
+    free(clahe->col_weight);
+    clahe->col_tile = NULL;
+    clahe->col_weight = NULL;
+    clahe->width = 0;
+    clahe->height = 0;
+}
+
+Clahe_t* get_display_clahe(void)
+{
+    if (!display_clahe_inited)
+    {
+        clahe_init(&display_clahe, NULL);
+        display_clahe_inited = 1;
+    }
+    return &display_clahe;
+}
+
+//tile t covers [t * len / num, (t + 1) * len / num), its center in Q8 pixels
+static int clahe_tile_center(int t, int len, int num)
+{
+    return (t * len / num + (t + 1) * len / num - 1) * 128;
+}
+
+//the last tile center at or before pixel pos and the Q8 weight of the next one, before the first and after the
+//last center the nearest lut alone
+static void clahe_tile_weight(int pos, int len, int num, int* tile, int* weight)
+{
+    int p = pos * 256;
+    int t = 0;
+    while (t + 1 < num && clahe_tile_center(t + 1, len, num) <= p)
+    {
+        t++;
+    }
+    int c0 = clahe_tile_center(t, len, num);
+    *tile = t;
+    if (p <= c0 || t + 1 >= num)
+    {
+        *weight = 0;
+        return;
+    }
+    *weight = (p - c0) * 256 / (clahe_tile_center(t + 1, len, num) - c0);
+}
+
+static int clahe_geometry(Clahe_t* clahe, int width, int height)
+{
+    if (clahe->width == width && clahe->height == height)
+    {
+        return CLAHE_SUCCESS;
+    }
+    uint8_t* col_tile = (uint8_t*)realloc(clahe->col_tile, width);
+    if (col_tile == NULL)
+    {
+        return CLAHE_ERROR_MEM;
+    }
+    clahe->col_tile = col_tile;
+    uint16_t* col_weight = (uint16_t*)realloc(clahe->col_weight, width * sizeof(uint16_t));
+    if (col_weight == NULL)
+    {
+        return CLAHE_ERROR_MEM;
+    }
+    clahe->col_weight = col_weight;
+    for (int x = 0; x < width; x++)
+    {
+        int tile = 0, weight = 0;
+        clahe_tile_weight(x, width, clahe->param.tiles_x, &tile, &weight);
+        clahe->col_tile[x] = (uint8_t)tile;
+        clahe->col_weight[x] = (uint16_t)weight;
+    }
+    clahe->width = width;
+    clahe->height = height;
+    return CLAHE_SUCCESS;
+}
+
+//histogram, clip and lut of tiles [t0, t1)
+static void clahe_band_tiles(void* arg, int band, int t0, int t1)
+{
+    Clahe_t* clahe = (Clahe_t*)arg;
+    int width = clahe->width, height = clahe->height;
+    int tiles_x = clahe->param.tiles_x, tiles_y = clahe->param.tiles_y;
+    uint16_t low = clahe->low, high = clahe->high;
+    uint32_t scale = clahe->scale;
+    for (int t = t0; t < t1; t++)
+    {
+        int tx = t % tiles_x, ty = t / tiles_x;
+        int x0 = tx * width / tiles_x, x1 = (tx + 1) * width / tiles_x;
+        int y0 = ty * height / tiles_y, y1 = (ty + 1) * height / tiles_y;
+        uint32_t* hist = clahe->hist[t];
+        memset(hist, 0, CLAHE_BINS * sizeof(uint32_t));
+        for (int y = y0; y < y1; y++)
+        {
+            const uint16_t* row = clahe->src + y * width;
+            for (int x = x0; x < x1; x++)
+            {
+                uint32_t v = row[x];
+                v = (v < low) ? low : ((v > high) ? high : v);
+                hist[((v - low) * scale) >> 16]++;
+            }
+        }
+
+        //the counts over the limit are dealt out to every bin, the remainder one per stride
+        uint32_t total = (uint32_t)(x1 - x0) * (y1 - y0);
+        if (clahe->param.clip_limit > 0)
+        {
+            uint32_t limit = (uint32_t)(clahe->param.clip_limit * total / CLAHE_BINS);
+            limit = (limit > 0) ? limit : 1;
+            uint32_t excess = 0;
+            for (int b = 0; b < CLAHE_BINS; b++)
+            {
+                if (hist[b] > limit)
+                {
+                    excess += hist[b] - limit;
+                    hist[b] = limit;
+                }
+            }
+            uint32_t add = excess / CLAHE_BINS, rest = excess % CLAHE_BINS;
+            for (int b = 0; b < CLAHE_BINS; b++)
+            {
+                hist[b] += add;
+            }
+            if (rest > 0)
+            {
+                uint32_t stride = CLAHE_BINS / rest;
+                for (uint32_t b = 0; b < CLAHE_BINS && rest > 0; b += stride, rest--)
+                {
+                    hist[b]++;
+                }
+            }
+        }
+
+        uint16_t* lut = clahe->lut[t];
+        uint64_t cdf = 0;
+        for (int b = 0; b < CLAHE_BINS; b++)
+        {
+            cdf += hist[b];
+            lut[b] = (uint16_t)((cdf * CLAHE_OUT_MAX + total / 2) / total);
+        }
+        lut[CLAHE_BINS] = lut[CLAHE_BINS - 1];
+        lut[CLAHE_BINS + 1] = lut[CLAHE_BINS - 1];
+    }
+}
+
+//rows [y0, y1) through the luts of the 4 tile centers around each pixel
+static void clahe_band_rows(void* arg, int band, int y0, int y1)
+{
+    Clahe_t* clahe = (Clahe_t*)arg;
+    int width = clahe->width;
+    int tiles_x = clahe->param.tiles_x;
+    for (int y = y0; y < y1; y++)
+    {
+        int ty = 0, wy = 0;
+        clahe_tile_weight(y, clahe->height, clahe->param.tiles_y, &ty, &wy);
+        int ty1 = (ty + 1 < clahe->param.tiles_y) ? ty + 1 : ty;
+        const uint16_t* src = clahe->src + y * width;
+        uint16_t* dst = clahe->dst + y * width;
+        //each run of columns between two tile centers has the same 4 luts
+        for (int x = 0; x < width;)
+        {
+            int tx = clahe->col_tile[x];
+            int end = x + 1;
+            while (end < width && clahe->col_tile[end] == tx)
+            {
+                end++;
+            }
+            int tx1 = (tx + 1 < tiles_x) ? tx + 1 : tx;
+            const uint16_t* luts[4] = { clahe->lut[ty * tiles_x + tx], clahe->lut[ty * tiles_x + tx1], \
+                clahe->lut[ty1 * tiles_x + tx], clahe->lut[ty1 * tiles_x + tx1] };
+            simd_lut4_lerp_u16(src + x, end - x, clahe->low, clahe->high, clahe->scale, luts, \
+                clahe->col_weight + x, (uint16_t)wy, dst + x);
+            x = end;
+        }
+    }
+}
+
+int clahe_process(Clahe_t* clahe, const uint16_t* src, int width, int height, uint16_t low, uint16_t high, \
+    uint16_t* dst, int band_num)
+{
+    if (clahe == NULL || src == NULL || dst == NULL || src == dst || width < 2 * clahe->param.tiles_x || \
+        height < 2 * clahe->param.tiles_y || high < low)
+    {
+        return CLAHE_ERROR_PARAM;
+    }
+    int rst = clahe_geometry(clahe, width, height);
+    if (rst != CLAHE_SUCCESS)
+    {
+        return rst;
+    }
+    clahe->src = src;
+    clahe->dst = dst;
+    clahe->low = low;
+    clahe->high = high;
+    //(high - low) * scale >> 16 stays below CLAHE_BINS
+    clahe->scale = (uint32_t)(((uint64_t)CLAHE_BINS << 16) / ((uint32_t)(high - low) + 1));
+
+    BandStage_t stages[2];
+    stages[0].func = clahe_band_tiles;
+    stages[0].arg = clahe;
+    stages[0].rows = clahe->param.tiles_x * clahe->param.tiles_y;
+    stages[1].func = clahe_band_rows;
+    stages[1].arg = clahe;
+    stages[1].rows = height;
+    band_run(POOL_STAGE_DISPLAY, stages, 2, (band_num > 0) ? band_num : 1);
+    return CLAHE_SUCCESS;
+}
@@ -0,0 +1,59 @@
+#ifndef _CLAHE_H_
+#define _CLAHE_H_
+
+//contrast limited adaptive histogram equalization of Y14 frames: the frame is cut into tiles_x x tiles_y tiles,
+//each tile's histogram over the frame's [low, high] is clipped at clip_limit times a flat histogram's height, the
+//clipped counts spread over every bin, and its cdf becomes the tile's lut. every pixel is then mapped through the
+//4 luts of the tile centers around it, bilinear in the pixel's position. the tiles run in parallel as one band
+//stage and the rows as the next (band.h), the mapping is simd_lut4_lerp_u16
+#include <stdint.h>
+
+#define CLAHE_BINS 256
+#define CLAHE_TILES_MAX 64
+#define CLAHE_DEFAULT_TILES_X 8         //32x32 pixel tiles on 256x192
+#define CLAHE_DEFAULT_TILES_Y 6
+#define CLAHE_DEFAULT_CLIP 3.0f
+#define CLAHE_OUT_MAX 16383
+
+#define CLAHE_SUCCESS 0
+#define CLAHE_ERROR_PARAM -1
+#define CLAHE_ERROR_MEM -2
+
+typedef struct {
+    uint8_t tiles_x;                    //tiles_x * tiles_y <= CLAHE_TILES_MAX, each at least 2 pixels
+    uint8_t tiles_y;
+    float clip_limit;                   //1 gives the plain linear stretch, 0 no limit (ahe)
+}ClaheParam_t;
+
+typedef struct {
+    ClaheParam_t param;
+    int width;                          //the frame the column weights are for
+    int height;
+    uint16_t low;                       //the bins cover [low, high] of the frame being mapped
+    uint16_t high;
+    uint32_t scale;                     //bin = ((v - low) * scale) >> 16
+    const uint16_t* src;
+    uint16_t* dst;
+    uint32_t hist[CLAHE_TILES_MAX][CLAHE_BINS];
+    uint16_t lut[CLAHE_TILES_MAX][CLAHE_BINS + 2];  //the padding keeps the 32 bit gathers inside
+    uint8_t* col_tile;                  //per column, the tile center at or left of it
+    uint16_t* col_weight;               //per column, Q8 weight of the tile center right of it
+}Clahe_t;
+
+//CLAHE_DEFAULT_TILES_X x CLAHE_DEFAULT_TILES_Y, clip CLAHE_DEFAULT_CLIP
+void clahe_default_param(ClaheParam_t* param);
+
+//param NULL selects the defaults
+int clahe_init(Clahe_t* clahe, const ClaheParam_t* param);
+
+void clahe_release(Clahe_t* clahe);
+
+//the clahe state used by the display pipeline
+Clahe_t* get_display_clahe(void);
+
+//map the Y14 frame to [0, CLAHE_OUT_MAX], the bins cover [low, high] (the frame's min and max, values outside
+//are clamped). band_num bands on the display pool stage, 1 runs on the calling thread. src and dst must differ
+int clahe_process(Clahe_t* clahe, const uint16_t* src, int width, int height, uint16_t low, uint16_t high, \
+    uint16_t* dst, int band_num);
+
+#endif
@@ -0,0 +1,704 @@
+#include "clip.h"
+#include "memacct.h"
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t clip_align(uint32_t size, uint32_t align)
+{
+    return (size + align - 1) / align * align;
+}
+
+static uint64_t clip_frame_us(const Clip_t* clip)
+{
+    uint32_t fps = clip->header.fps;
+    return 1000000ull / ((fps > 0) ? fps : 25);
+}
+
+//the lock is held by the caller. one past the oldest keyframe interval
+static uint64_t clip_gop_end(const Clip_t* clip)
+{
+    uint64_t n = clip->frame_head + 1;
+    while (n < clip->frame_tail && !clip->frames[n % clip->frame_capacity].key)
+    {
+        n++;
+    }
+    return n;
+}
+
+//the lock is held by the caller. the oldest keyframe interval can go unless a clip still has to write it
+static int clip_evictable(const Clip_t* clip)
+{
+    return clip->frame_head < clip->frame_tail && (!clip->active || clip_gop_end(clip) <= clip->write_next);
+}
+
+//the lock is held by the caller. drops the oldest keyframe interval, the history keeps starting on a keyframe
+static void clip_evict(Clip_t* clip)
+{
+    clip->frame_head = clip_gop_end(clip);
+    if (clip->frame_head >= clip->frame_tail)
+    {
+        //nothing to code the next frame against
+        clip->frame_head = clip->frame_tail;
+        clip->history_end = 0;
+        clip->gop_cnt = 0;
+    }
+}
+
+//the lock is held by the caller. offset of size free contiguous bytes behind the newest frame, evicting the
+//oldest frames for them, -1 when the frames in the way are frozen
+static int64_t clip_room(Clip_t* clip, uint32_t size)
+{
+    while (1)
+    {
+        if (clip->frame_head == clip->frame_tail)
+        {
+            return 0;
+        }
+        if (clip->frame_tail - clip->frame_head < clip->frame_capacity)
+        {
+            uint32_t oldest = clip->frames[clip->frame_head % clip->frame_capacity].offset;
+            if (clip->history_end > oldest)
+            {
+                //free behind the newest up to the end, or from the start up to the oldest
+                if (clip->history_bytes - clip->history_end >= size)
+                {
+                    return clip->history_end;
+                }
+                if (oldest >= size)
+                {
+                    return 0;
+                }
+            }
+            else if (oldest - clip->history_end >= size)
+            {
+                return clip->history_end;
+            }
+        }
+        if (!clip_evictable(clip))
+        {
+            return -1;
+        }
+        clip_evict(clip);
+    }
+}
+
+//a plane coded, or as it came when the coder gives up. returns the bytes stored
+static uint32_t clip_plane_store(CodecContext_t* codec, const uint8_t* data, uint32_t byte_size, int key, \
+    uint8_t* dst, uint32_t* coded_size)
+{
+    *coded_size = 0;
+    if (codec->pix_num > 0)
+    {
+        int size = codec_encode(codec, (const uint16_t*)data, dst, codec_bound(codec->pix_num), key);
+        if (size > 0)
+        {
+            *coded_size = (uint32_t)size;
+            return (uint32_t)size;
+        }
+        codec_reset(codec);
+    }
+    memcpy(dst, data, byte_size);
+    return byte_size;
+}
+
+//ring task: code the frame into the history, never waits for the writer
+static void clip_task(FrameSlot_t* slot, void* arg)
+{
+    Clip_t* clip = (Clip_t*)arg;
+    pthread_mutex_lock(&clip->mutex);
+    if (!clip->running || (clip->image_size > 0 && slot->desc.image.data == NULL) || \
+        (clip->temp_size > 0 && slot->desc.temp.data == NULL))
+    {
+        pthread_mutex_unlock(&clip->mutex);
+        return;
+    }
+    uint64_t timestamp_us = slot->desc.timestamp_us;
+    //the clip is complete once a frame past its end comes in
+    if (clip->active && !clip->end_set && timestamp_us > clip->end_us)
+    {
+        clip->end_set = 1;
+        clip->write_end = clip->frame_tail;
+        pthread_cond_broadcast(&clip->cond);
+    }
+    int64_t offset = clip_room(clip, clip->record_max);
+    if (offset < 0)
+    {
+        clip->stats.dropped++;
+        pthread_mutex_unlock(&clip->mutex);
+        return;
+    }
+    //both planes key together every key_interval frames and after a restart, a chunk of the clip starts on each
+    int key = (clip->gop_cnt == 0 || clip->gop_cnt >= clip->param.key_interval);
+    uint8_t* record = clip->history + offset;
+    RecordFrameMeta_t* meta = (RecordFrameMeta_t*)record;
+    memset(meta, 0, sizeof(RecordFrameMeta_t));
+    meta->seq = slot->seq;
+    meta->timestamp_us = timestamp_us;
+    if (slot->desc.flags & FRAME_DESC_TEMP_INVALID)
+    {
+        meta->flags |= RECORD_META_TEMP_INVALID;
+    }
+    uint32_t used = sizeof(RecordFrameMeta_t);
+    if (clip->image_size > 0)
+    {
+        used += clip_plane_store(&clip->image_codec, slot->desc.image.data, clip->image_size, key, record + used, \
+            &meta->image_coded_size);
+    }
+    if (clip->temp_size > 0)
+    {
+        used += clip_plane_store(&clip->temp_codec, slot->desc.temp.data, clip->temp_size, key, record + used, \
+            &meta->temp_coded_size);
+    }
+    //a plane stored as it came restarts its coder, the other one restarts with it on the next frame
+    int restart = (clip->image_codec.pix_num > 0 && !clip->image_codec.has_ref) || \
+        (clip->temp_codec.pix_num > 0 && !clip->temp_codec.has_ref);
+    if (restart)
+    {
+        codec_reset(&clip->image_codec);
+        codec_reset(&clip->temp_codec);
+    }
+    clip->gop_cnt = restart ? 0 : (key ? 1 : clip->gop_cnt + 1);
+    uint32_t record_size = clip_align(used, RECORD_FRAME_ALIGN);
+    memset(record + used, 0, record_size - used);
+    ClipFrame_t* frame = &clip->frames[clip->frame_tail % clip->frame_capacity];
+    frame->offset = (uint32_t)offset;
+    frame->size = record_size;
+    frame->timestamp_us = timestamp_us;
+    frame->key = (uint8_t)key;
+    clip->frame_tail++;
+    clip->history_end = (uint32_t)offset + record_size;
+    clip->stats.frames++;
+    clip->stats.plane_bytes += clip->image_size + clip->temp_size;
+    clip->stats.stored_bytes += used - sizeof(RecordFrameMeta_t);
+
+    //no more than the pre-roll: a keyframe interval goes once the keyframe after it is old enough to start a clip
+    uint64_t preroll_us = (uint64_t)clip->param.preroll_ms * 1000;
+    while (clip_evictable(clip))
+    {
+        uint64_t next = clip_gop_end(clip);
+        if (next >= clip->frame_tail || clip->frames[next % clip->frame_capacity].timestamp_us + preroll_us > timestamp_us)
+        {
+            break;
+        }
+        clip_evict(clip);
+    }
+    if (clip->active)
+    {
+        pthread_cond_broadcast(&clip->cond);
+    }
+    pthread_mutex_unlock(&clip->mutex);
+}
+
+//writer: complete the chunk being written with its header and index
+static int clip_chunk_close(Clip_t* clip)
+{
+    if (clip->chunk.frame_num == 0)
+    {
+        return CLIP_SUCCESS;
+    }
+    static const uint8_t zero[RECORD_ALIGN] = { 0 };
+    uint32_t used = (uint32_t)(clip->file_offset - clip->chunk_offset);
+    uint32_t chunk_size = clip_align(used, RECORD_ALIGN);
+    int rst = (chunk_size == used || fwrite(zero, 1, chunk_size - used, clip->fp) == chunk_size - used) ? \
+        CLIP_SUCCESS : CLIP_ERROR_FILE;
+    clip->chunk.magic = RECORD_CHUNK_MAGIC;
+    clip->chunk.chunk_size = chunk_size;
+    if (rst == CLIP_SUCCESS && (fseek(clip->fp, (long)clip->chunk_offset, SEEK_SET) != 0 || \
+        fwrite(&clip->chunk, sizeof(RecordChunkHeader_t), 1, clip->fp) != 1 || \
+        fwrite(clip->chunk_index, sizeof(RecordIndexEntry_t), clip->chunk.frame_num, clip->fp) != clip->chunk.frame_num || \
+        fseek(clip->fp, 0, SEEK_END) != 0))
+    {
+        rst = CLIP_ERROR_FILE;
+    }
+    if (rst == CLIP_SUCCESS && clip->chunk_num == clip->index_capacity)
+    {
+        uint32_t capacity = (clip->index_capacity > 0) ? clip->index_capacity * 2 : 64;
+        RecordChunkEntry_t* index = (RecordChunkEntry_t*)realloc(clip->index, capacity * sizeof(RecordChunkEntry_t));
+        if (index == NULL)
+        {
+            rst = CLIP_ERROR_MEM;
+        }
+        else
+        {
+            clip->index = index;
+            clip->index_capacity = capacity;
+        }
+    }
+    if (rst == CLIP_SUCCESS)
+    {
+        RecordChunkEntry_t* entry = &clip->index[clip->chunk_num++];
+        entry->offset = clip->chunk_offset;
+        entry->first_timestamp_us = clip->chunk.first_timestamp_us;
+        entry->last_timestamp_us = clip->chunk.last_timestamp_us;
+        entry->frame_num = clip->chunk.frame_num;
+        entry->chunk_size = chunk_size;
+        clip->file_offset = clip->chunk_offset + chunk_size;
+    }
+    memset(&clip->chunk, 0, sizeof(RecordChunkHeader_t));
+    return rst;
+}
+
+//writer: one frame record, a keyframe starts a chunk
+static int clip_file_frame(Clip_t* clip, const ClipFrame_t* frame, const uint8_t* record)
+{
+    int rst = CLIP_SUCCESS;
+    if (clip->chunk.frame_num > 0 && (frame->key || clip->chunk.frame_num == clip->header.chunk_frames))
+    {
+        rst = clip_chunk_close(clip);
+    }
+    if (rst == CLIP_SUCCESS && clip->chunk.frame_num == 0)
+    {
+        //the header block is filled in by clip_chunk_close
+        static const uint8_t zero[RECORD_ALIGN] = { 0 };
+        clip->chunk_offset = clip->file_offset;
+        for (uint32_t left = clip->chunk_header_size; left > 0 && rst == CLIP_SUCCESS; left -= RECORD_ALIGN)
+        {
+            rst = (fwrite(zero, 1, RECORD_ALIGN, clip->fp) == RECORD_ALIGN) ? CLIP_SUCCESS : CLIP_ERROR_FILE;
+        }
+        clip->file_offset += clip->chunk_header_size;
+        clip->chunk.first_seq = ((const RecordFrameMeta_t*)record)->seq;
+        clip->chunk.first_timestamp_us = frame->timestamp_us;
+    }
+    if (rst == CLIP_SUCCESS && fwrite(record, 1, frame->size, clip->fp) != frame->size)
+    {
+        rst = CLIP_ERROR_FILE;
+    }
+    if (rst != CLIP_SUCCESS)
+    {
+        return rst;
+    }
+    RecordIndexEntry_t* index = &clip->chunk_index[clip->chunk.frame_num++];
+    index->timestamp_us = frame->timestamp_us;
+    index->offset = (uint32_t)(clip->file_offset - clip->chunk_offset);
+    index->flags = 0;
+    clip->chunk.last_timestamp_us = frame->timestamp_us;
+    clip->file_offset += frame->size;
+    if (clip->header.frame_num == 0)
+    {
+        clip->header.first_timestamp_us = frame->timestamp_us;
+    }
+    clip->header.last_timestamp_us = frame->timestamp_us;
+    clip->header.frame_num++;
+    return CLIP_SUCCESS;
+}
+
+//writer: the last chunk, the index and the final header
+static int clip_file_finish(Clip_t* clip)
+{
+    int rst = clip_chunk_close(clip);
+    RecordFileHeader_t* header = &clip->header;
+    if (rst == CLIP_SUCCESS)
+    {
+        RecordIndexHeader_t index_header = { RECORD_INDEX_MAGIC, clip->chunk_num };
+        uint32_t index_size = sizeof(RecordIndexHeader_t) + clip->chunk_num * sizeof(RecordChunkEntry_t);
+        uint32_t padded = clip_align(index_size, RECORD_ALIGN);
+        static const uint8_t zero[RECORD_ALIGN] = { 0 };
+        if (fwrite(&index_header, sizeof(index_header), 1, clip->fp) != 1 || (clip->chunk_num > 0 && \
+            fwrite(clip->index, sizeof(RecordChunkEntry_t), clip->chunk_num, clip->fp) != clip->chunk_num) || \
+            (padded > index_size && fwrite(zero, 1, padded - index_size, clip->fp) != padded - index_size))
+        {
+            rst = CLIP_ERROR_FILE;
+        }
+        header->chunk_num = clip->chunk_num;
+        header->index_offset = clip->file_offset;
+        if (rst == CLIP_SUCCESS && (fseek(clip->fp, 0, SEEK_SET) != 0 || \
+            fwrite(header, sizeof(RecordFileHeader_t), 1, clip->fp) != 1))
+        {
+            rst = CLIP_ERROR_FILE;
+        }
+    }
+    if (fclose(clip->fp) != 0)
+    {
+        rst = CLIP_ERROR_FILE;
+    }
+    clip->fp = NULL;
+    return rst;
+}
+
+static int clip_file_open(Clip_t* clip)
+{
+    clip->fp = fopen(clip->path, "wb");
+    if (clip->fp == NULL)
+    {
+        return CLIP_ERROR_FILE;
+    }
+    RecordFileHeader_t* header = &clip->header;
+    header->chunk_num = 0;
+    header->index_offset = 0;
+    header->frame_num = 0;
+    header->first_timestamp_us = 0;
+    header->last_timestamp_us = 0;
+    //the header block is rewritten by clip_file_finish, a clip cut short is read by scanning the chunks
+    static const uint8_t zero[RECORD_ALIGN] = { 0 };
+    if (fwrite(header, sizeof(RecordFileHeader_t), 1, clip->fp) != 1 || \
+        fwrite(zero, 1, RECORD_ALIGN - sizeof(RecordFileHeader_t), clip->fp) != RECORD_ALIGN - sizeof(RecordFileHeader_t))
+    {
+        fclose(clip->fp);
+        clip->fp = NULL;
+        return CLIP_ERROR_FILE;
+    }
+    clip->file_offset = RECORD_ALIGN;
+    clip->chunk_num = 0;
+    memset(&clip->chunk, 0, sizeof(RecordChunkHeader_t));
+    return CLIP_SUCCESS;
+}
+
+//writer thread: the frozen history and the live frames of a clip go out in order straight from the history,
+//the task keeps coding frames behind them
+static void* clip_writer(void* threadarg)
+{
+    Clip_t* clip = (Clip_t*)threadarg;
+    pthread_mutex_lock(&clip->mutex);
+    while (1)
+    {
+        while (clip->writer_running && !(clip->active && (clip->write_next < clip->frame_tail || clip->end_set)))
+        {
+            pthread_cond_wait(&clip->cond, &clip->mutex);
+        }
+        if (!clip->active)
+        {
+            break;
+        }
+        if (!clip->writer_running && !clip->end_set)
+        {
+            clip->end_set = 1;
+            clip->write_end = clip->frame_tail;
+        }
+        if (!clip->end_set || clip->write_next < clip->write_end)
+        {
+            ClipFrame_t frame = clip->frames[clip->write_next % clip->frame_capacity];
+            const uint8_t* record = clip->history + frame.offset;
+            int open = (clip->fp == NULL && !clip->write_error);
+            pthread_mutex_unlock(&clip->mutex);
+
+            //the frame stays in the history until write_next passes it
+            int rst = CLIP_SUCCESS;
+            if (open)
+            {
+                rst = clip_file_open(clip);
+                if (rst != CLIP_SUCCESS)
+                {
+                    printf("clip: can not create %s\n", clip->path);
+                }
+            }
+            if (rst == CLIP_SUCCESS && clip->fp != NULL)
+            {
+                rst = clip_file_frame(clip, &frame, record);
+            }
+
+            pthread_mutex_lock(&clip->mutex);
+            if (rst != CLIP_SUCCESS && !clip->write_error)
+            {
+                clip->write_error = 1;
+                clip->stats.write_errors++;
+            }
+            clip->stats.clip_frames += (rst == CLIP_SUCCESS && clip->fp != NULL);
+            clip->write_next++;
+            continue;
+        }
+        pthread_mutex_unlock(&clip->mutex);
+        int rst = CLIP_SUCCESS;
+        if (clip->fp != NULL)
+        {
+            rst = clip_file_finish(clip);
+        }
+        pthread_mutex_lock(&clip->mutex);
+        if (rst != CLIP_SUCCESS || clip->write_error)
+        {
+            clip->stats.write_errors += (rst != CLIP_SUCCESS);
+            printf("clip: %s is incomplete\n", clip->path);
+        }
+        else
+        {
+            clip->stats.clips++;
+            printf("clip: %s, %u frames\n", clip->path, (unsigned)clip->header.frame_num);
+        }
+        clip->active = 0;
+        clip->end_set = 0;
+        pthread_cond_broadcast(&clip->cond);
+        if (!clip->writer_running)
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&clip->mutex);
+    return NULL;
+}
+
+int clip_attach(Clip_t* clip, StreamFrameInfo_t* stream_frame_info)
+{
+    if (clip == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return CLIP_ERROR_PARAM;
+    }
+    memset(clip, 0, sizeof(Clip_t));
+    clip->stream_frame_info = stream_frame_info;
+    pthread_mutex_init(&clip->mutex, NULL);
+    pthread_cond_init(&clip->cond, NULL);
+    //every frame in order, the history is a continuous delta chain
+    clip->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, \
+        POOL_STAGE_RECORD, clip_task, clip);
+    if (clip->consumer_id < 0)
+    {
+        pthread_mutex_destroy(&clip->mutex);
+        pthread_cond_destroy(&clip->cond);
+        return CLIP_ERROR_PARAM;
+    }
+    return CLIP_SUCCESS;
+}
+
+static void clip_buffers_free(Clip_t* clip)
+{
+    free(clip->history);
+    free(clip->frames);
+    free(clip->chunk_index);
+    free(clip->index);
+    clip->history = NULL;
+    clip->frames = NULL;
+    clip->chunk_index = NULL;
+    clip->index = NULL;
+    clip->index_capacity = 0;
+    mem_acct_release(MEM_CLASS_PREROLL, clip->mem_bytes);
+    clip->mem_bytes = 0;
+    codec_release(&clip->image_codec);
+    codec_release(&clip->temp_codec);
+}
+
+int clip_start(Clip_t* clip, const ClipParam_t* param)
+{
+    if (clip == NULL || param == NULL || clip->stream_frame_info == NULL || clip->stream_frame_info->config == NULL)
+    {
+        return CLIP_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&clip->mutex);
+    int busy = clip->running || clip->writer_running;
+    pthread_mutex_unlock(&clip->mutex);
+    if (busy)
+    {
+        return CLIP_ERROR_PARAM;
+    }
+    clip->param = *param;
+    if (clip->param.key_interval == 0)
+    {
+        clip->param.key_interval = CLIP_DEFAULT_KEY_INTERVAL;
+    }
+    if (clip->param.planes == 0)
+    {
+        clip->param.planes = CLIP_PLANE_IMAGE | CLIP_PLANE_TEMP;
+    }
+    if (clip->param.key_interval > RECORD_MAX_CHUNK_FRAMES)
+    {
+        return CLIP_ERROR_PARAM;
+    }
+
+    const StreamConfig_t* config = clip->stream_frame_info->config;
+    RecordFileHeader_t* header = &clip->header;
+    memset(header, 0, sizeof(RecordFileHeader_t));
+    header->magic = RECORD_MAGIC;
+    header->version = RECORD_VERSION;
+    header->header_size = RECORD_ALIGN;
+    header->chunk_frames = clip->param.key_interval;
+    header->image_width = config->image_info.width;
+    header->image_height = config->image_info.height;
+    header->image_byte_size = (clip->param.planes & CLIP_PLANE_IMAGE) ? config->image_byte_size : 0;
+    header->image_format = config->image_info.input_format;
+    header->temp_width = config->temp_info.width;
+    header->temp_height = config->temp_info.height;
+    header->temp_byte_size = (clip->param.planes & CLIP_PLANE_TEMP) ? config->temp_byte_size : 0;
+    header->fps = config->camera_param.fps;
+    header->codec = RECORD_CODEC_DELTA;
+    clip->image_size = header->image_byte_size;
+    clip->temp_size = header->temp_byte_size;
+    if (clip->image_size == 0 && clip->temp_size == 0)
+    {
+        return CLIP_ERROR_PARAM;
+    }
+    //16 bit planes are coded, the others kept as they came
+    memset(&clip->image_codec, 0, sizeof(CodecContext_t));
+    memset(&clip->temp_codec, 0, sizeof(CodecContext_t));
+    uint32_t image_bound = clip->image_size, temp_bound = clip->temp_size;
+    int rst = CLIP_SUCCESS;
+    if (clip->image_size > 0 && clip->image_size == header->image_width * header->image_height * 2)
+    {
+        image_bound = codec_bound(header->image_width * header->image_height);
+        rst = (codec_init(&clip->image_codec, header->image_width, header->image_height, 0) == CODEC_SUCCESS) ? \
+            rst : CLIP_ERROR_MEM;
+    }
+    if (clip->temp_size > 0 && clip->temp_size == header->temp_width * header->temp_height * 2)
+    {
+        temp_bound = codec_bound(header->temp_width * header->temp_height);
+        rst = (codec_init(&clip->temp_codec, header->temp_width, header->temp_height, 0) == CODEC_SUCCESS) ? \
+            rst : CLIP_ERROR_MEM;
+    }
+    image_bound = (image_bound > clip->image_size) ? image_bound : clip->image_size;
+    temp_bound = (temp_bound > clip->temp_size) ? temp_bound : clip->temp_size;
+    clip->record_max = clip_align(sizeof(RecordFrameMeta_t) + image_bound + temp_bound, RECORD_FRAME_ALIGN);
+    header->frame_size = clip->record_max;
+    clip->chunk_header_size = clip_align(sizeof(RecordChunkHeader_t) + \
+        header->chunk_frames * sizeof(RecordIndexEntry_t), RECORD_ALIGN);
+
+    uint64_t frame_us = clip_frame_us(clip);
+    uint64_t preroll_frames = (uint64_t)clip->param.preroll_ms * 1000 / frame_us + 1;
+    uint64_t history_bytes = clip->param.history_bytes;
+    if (history_bytes == 0)
+    {
+        history_bytes = preroll_frames * (clip->image_size + clip->temp_size) / 2 + 4ull * clip->record_max;
+    }
+    //a frame at the end and one at the start never overlap
+    history_bytes = (history_bytes < 2ull * clip->record_max) ? 2ull * clip->record_max : history_bytes;
+    uint64_t frame_capacity = preroll_frames + (uint64_t)clip->param.postroll_ms * 1000 / frame_us + \
+        4ull * clip->param.key_interval + 64;
+    if (history_bytes > 0x7FFFFFFF || frame_capacity > 0x7FFFFFFF)
+    {
+        rst = CLIP_ERROR_PARAM;
+    }
+    if (rst == CLIP_SUCCESS)
+    {
+        //a tight memory budget shortens the pre-roll, down to the two records the history works with
+        history_bytes = mem_acct_reserve(MEM_CLASS_PREROLL, history_bytes, 2ull * clip->record_max, 0);
+        if (history_bytes == 0)
+        {
+            printf("clip: no room for the history in the memory budget\n");
+            rst = CLIP_ERROR_MEM;
+        }
+        clip->mem_bytes = history_bytes;
+    }
+    clip->history_bytes = (uint32_t)history_bytes;
+    clip->frame_capacity = (uint32_t)frame_capacity;
+    if (rst == CLIP_SUCCESS)
+    {
+        clip->mem_bytes += frame_capacity * sizeof(ClipFrame_t);
+        mem_acct_add(MEM_CLASS_PREROLL, (int64_t)(frame_capacity * sizeof(ClipFrame_t)));
+        clip->history = (uint8_t*)malloc(clip->history_bytes);
+        clip->frames = (ClipFrame_t*)malloc(clip->frame_capacity * sizeof(ClipFrame_t));
+        clip->chunk_index = (RecordIndexEntry_t*)malloc(header->chunk_frames * sizeof(RecordIndexEntry_t));
+        rst = (clip->history != NULL && clip->frames != NULL && clip->chunk_index != NULL) ? rst : CLIP_ERROR_MEM;
+    }
+    if (rst != CLIP_SUCCESS)
+    {
+        clip_buffers_free(clip);
+        return rst;
+    }
+
+    clip->history_end = 0;
+    clip->frame_head = 0;
+    clip->frame_tail = 0;
+    clip->gop_cnt = 0;
+    clip->active = 0;
+    clip->end_set = 0;
+    clip->fp = NULL;
+    memset(&clip->stats, 0, sizeof(ClipStats_t));
+    clip->writer_running = 1;
+    if (pthread_create(&clip->writer, NULL, clip_writer, clip) != 0)
+    {
+        clip->writer_running = 0;
+        clip_buffers_free(clip);
+        return CLIP_ERROR_MEM;
+    }
+    pthread_mutex_lock(&clip->mutex);
+    clip->running = 1;
+    pthread_mutex_unlock(&clip->mutex);
+    printf("clip: %u ms pre-roll in %u bytes, keyframe every %u frames\n", clip->param.preroll_ms, \
+        clip->history_bytes, clip->param.key_interval);
+    return CLIP_SUCCESS;
+}
+
+int clip_stop(Clip_t* clip)
+{
+    if (clip == NULL)
+    {
+        return CLIP_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&clip->mutex);
+    if (!clip->writer_running)
+    {
+        pthread_mutex_unlock(&clip->mutex);
+        return CLIP_ERROR_PARAM;
+    }
+    clip->running = 0;
+    clip->writer_running = 0;
+    pthread_cond_broadcast(&clip->cond);
+    pthread_mutex_unlock(&clip->mutex);
+    pthread_join(clip->writer, NULL);
+
+    clip_buffers_free(clip);
+    printf("clip: %llu frames, %llu clips, %llu dropped, %llu write errors\n", \
+        (unsigned long long)clip->stats.frames, (unsigned long long)clip->stats.clips, \
+        (unsigned long long)clip->stats.dropped, (unsigned long long)clip->stats.write_errors);
+    if (clip->stats.stored_bytes > 0)
+    {
+        printf("clip: planes coded %.2f:1\n", (double)clip->stats.plane_bytes / clip->stats.stored_bytes);
+    }
+    return CLIP_SUCCESS;
+}
+
+int clip_trigger(Clip_t* clip, const char* path)
+{
+    if (clip == NULL || path == NULL || strlen(path) >= CLIP_PATH_LEN)
+    {
+        return CLIP_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&clip->mutex);
+    if (!clip->running)
+    {
+        pthread_mutex_unlock(&clip->mutex);
+        return CLIP_ERROR_PARAM;
+    }
+    uint64_t now_us = get_monotonic_us();
+    if (clip->active)
+    {
+        //while the end is not reached, a later trigger moves it
+        if (!clip->end_set)
+        {
+            clip->end_us = now_us + (uint64_t)clip->param.postroll_ms * 1000;
+            clip->stats.retriggers++;
+        }
+        pthread_mutex_unlock(&clip->mutex);
+        return CLIP_SUCCESS;
+    }
+    //the newest keyframe preroll_ms back, or the oldest frame held
+    uint64_t preroll_us = (uint64_t)clip->param.preroll_ms * 1000;
+    uint64_t start = clip->frame_head;
+    for (uint64_t n = clip->frame_head; n < clip->frame_tail; n++)
+    {
+        const ClipFrame_t* frame = &clip->frames[n % clip->frame_capacity];
+        if (frame->timestamp_us + preroll_us > now_us)
+        {
+            break;
+        }
+        start = frame->key ? n : start;
+    }
+    strcpy(clip->path, path);
+    clip->write_next = start;
+    clip->end_us = now_us + (uint64_t)clip->param.postroll_ms * 1000;
+    clip->end_set = 0;
+    clip->write_error = 0;
+    clip->active = 1;
+    clip->stats.preroll_us = (start < clip->frame_tail && now_us > clip->frames[start % clip->frame_capacity].timestamp_us) ? \
+        now_us - clip->frames[start % clip->frame_capacity].timestamp_us : 0;
+    pthread_cond_broadcast(&clip->cond);
+    pthread_mutex_unlock(&clip->mutex);
+    return CLIP_SUCCESS;
+}
+
+int clip_stats(Clip_t* clip, ClipStats_t* stats)
+{
+    if (clip == NULL || stats == NULL)
+    {
+        return CLIP_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&clip->mutex);
+    *stats = clip->stats;
+    uint32_t used = 0;
+    if (clip->frame_tail > clip->frame_head)
+    {
+        const ClipFrame_t* oldest = &clip->frames[clip->frame_head % clip->frame_capacity];
+        const ClipFrame_t* newest = &clip->frames[(clip->frame_tail - 1) % clip->frame_capacity];
+        stats->history_us = newest->timestamp_us - oldest->timestamp_us;
+        used = (clip->history_end > oldest->offset) ? clip->history_end - oldest->offset : \
+            clip->history_bytes - oldest->offset + clip->history_end;
+    }
+    stats->history_used = used;
+    pthread_mutex_unlock(&clip->mutex);
+    return CLIP_SUCCESS;
+}
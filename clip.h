@@ -0,0 +1,114 @@
+#ifndef _CLIP_H_
+#define _CLIP_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "data.h"
+#include "codec.h"
+#include "record.h"
+
+#define CLIP_DEFAULT_KEY_INTERVAL 16    //frames between keyframes, the history is evicted and clips start on them
+#define CLIP_PATH_LEN RECORD_PATH_LEN
+
+#define CLIP_PLANE_IMAGE 0x1
+#define CLIP_PLANE_TEMP 0x2
+
+#define CLIP_SUCCESS 0
+#define CLIP_ERROR_PARAM -1
+#define CLIP_ERROR_MEM -2
+#define CLIP_ERROR_FILE -3
+
+typedef struct {
+    uint32_t preroll_ms;                //history kept for a trigger
+    uint32_t postroll_ms;               //frames taken after the last trigger of a clip
+    uint32_t history_bytes;             //coded history, 0 sizes it for the pre-roll coded 2:1
+    uint32_t key_interval;              //0 selects CLIP_DEFAULT_KEY_INTERVAL, at most RECORD_MAX_CHUNK_FRAMES
+    uint8_t planes;                     //CLIP_PLANE_xxx, 0 takes both
+}ClipParam_t;
+
+typedef struct {
+    uint64_t frames;                    //frames coded into the history
+    uint64_t dropped;                   //frames lost because the history was full of frames a clip still has to write
+    uint64_t clips;                     //clip files finished
+    uint64_t clip_frames;               //frames written into them
+    uint64_t retriggers;                //triggers that extended the running clip
+    uint64_t write_errors;
+    uint64_t history_us;                //span of the frames held now
+    uint32_t history_used;              //bytes of the frames held now
+    uint64_t preroll_us;                //pre-roll the last clip got, short of preroll_ms when the memory was not enough
+    uint64_t plane_bytes;               //planes as they came
+    uint64_t stored_bytes;              //the same planes coded
+}ClipStats_t;
+
+//one frame of the history: a record frame (RecordFrameMeta_t and its planes) ready for a chunk
+typedef struct {
+    uint32_t offset;                    //in the history buffer
+    uint32_t size;                      //RECORD_FRAME_ALIGN padded
+    uint64_t timestamp_us;
+    uint8_t key;                        //every plane is a keyframe or stored as it came, decodes alone
+}ClipFrame_t;
+
+//a ring task consumer keeping the last preroll_ms of one camera delta coded in memory. clip_trigger freezes it
+//from the last keyframe preroll_ms back, a writer thread writes that history and the live frames up to
+//postroll_ms after the trigger into a recording (record.h, RECORD_CODEC_DELTA, one chunk per keyframe interval)
+//while new frames keep coming in behind it. record_reader_open reads the clips
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    ClipParam_t param;
+    int consumer_id;
+    uint8_t running;
+    uint8_t writer_running;
+    RecordFileHeader_t header;          //every clip's, the counts and timestamps filled when it is finished
+    uint32_t image_size;                //plane bytes as they came, 0 when not kept
+    uint32_t temp_size;
+    uint32_t record_max;                //largest frame record
+    CodecContext_t image_codec;         //pix_num 0 when the plane is stored as it came
+    CodecContext_t temp_codec;
+    uint8_t* history;                   //history_bytes
+    uint32_t history_bytes;             //granted by the memory budget, may be short of the param's
+    uint64_t mem_bytes;                 //history and frame table registered with memacct.h
+    uint32_t history_end;               //byte after the newest frame
+    ClipFrame_t* frames;                //frame_capacity, frame n at n % frame_capacity
+    uint32_t frame_capacity;
+    uint64_t frame_head;                //oldest frame held
+    uint64_t frame_tail;                //next frame
+    uint32_t gop_cnt;                   //frames since the last keyframe, 0 codes the next one as a keyframe
+    uint8_t active;                     //a clip is being written
+    uint8_t end_set;
+    uint64_t write_next;                //next frame of the clip, frames from here on are not evicted
+    uint64_t write_end;                 //with end_set: one past the clip's last frame
+    uint64_t end_us;                    //the clip takes frames received up to here
+    char path[CLIP_PATH_LEN];           //of the clip being written
+    FILE* fp;                           //writer
+    uint64_t file_offset;
+    uint32_t chunk_header_size;
+    uint64_t chunk_offset;              //of the chunk being written
+    RecordChunkHeader_t chunk;
+    RecordIndexEntry_t* chunk_index;    //key_interval entries
+    RecordChunkEntry_t* index;          //one entry per written chunk
+    uint32_t index_capacity;
+    uint32_t chunk_num;
+    int write_error;
+    ClipStats_t stats;
+    pthread_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+}Clip_t;
+
+//register the history as a task consumer of the camera's frame ring, before streaming
+int clip_attach(Clip_t* clip, StreamFrameInfo_t* stream_frame_info);
+
+//allocate the history and start coding every frame into it, can be called while streaming
+int clip_start(Clip_t* clip, const ClipParam_t* param);
+
+//finish the running clip with the frames taken so far and free the history
+int clip_stop(Clip_t* clip);
+
+//write preroll_ms before and postroll_ms after now into path, returns at once. a trigger while a clip is
+//being written extends that clip to postroll_ms after this one (path is ignored)
+int clip_trigger(Clip_t* clip, const char* path);
+
+int clip_stats(Clip_t* clip, ClipStats_t* stats);
+
+#endif
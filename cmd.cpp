@@ -1,4 +1,28 @@
 #include "cmd.h"
+#include "calib.h"
+#include "flash.h"
+#include "cmdq.h"
+#include "display.h"
+#include "trace.h"
+#include "rtsched.h"
+#include "prop.h"
+#include "cmdbatch.h"
+#include "burst.h"
+#include "tempquery.h"
+#include <ctype.h>
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <poll.h>
+#endif
+
+#define CMD_INPUT_LEN 256
+#define CMD_KEY_POLL_MS 20              //a console with keys but no enter yet, or a pipe, is looked at this often
+#define CMD_INPUT_RECORDS 128
+
+static Burst_t* command_burst = NULL;   //command 36 triggers it
+static TempCalibCtx_t* command_calib = NULL;   //the calibration the temperature commands work on, NULL the default
+static TempQuery_t* command_query = NULL;      //commands 17/18 read the point from its frame instead of the device
 
 //command init.it need to be called before sending command.
 void command_init(void)
@@ -6,6 +30,34 @@ void command_init(void)
     vdcmd_init();
 }
 
+void command_burst_set(struct Burst_t* burst)
+{
+    command_burst = burst;
+}
+
+void command_calib_set(struct TempCalibCtx_t* calib)
+{
+    command_calib = calib;
+}
+
+void command_query_set(struct TempQuery_t* query)
+{
+    command_query = query;
+}
+
+//the point temperature in the device's 1/16 K: the newest frame's temp_val (1/64 K) when a query service is set,
+//tpd_get_point_temp_info otherwise or before its first frame
+static int command_point_temp(IruvcPoint_t point_pos, uint16_t* temp)
+{
+    TempQueryResult_t result;
+    if (command_query != NULL && temp_query_point(command_query, point_pos.x, point_pos.y, &result) == TEMP_QUERY_SUCCESS)
+    {
+        *temp = (uint16_t)((result.info.max_temp + 2) >> 2);
+        return IRUVC_SUCCESS;
+    }
+    return tpd_get_point_temp_info(point_pos, temp);
+}
+
 //获取某个文件的长度
 int get_file_len(const char* p_path)
 {
@@ -33,9 +85,14 @@ int read_nuc_parameter(TempCalInfo_t* temp_cal_info)
     int i = 0;
     uint8_t temp = 0;
 
-
+    //calib_cache_load already mapped this camera's table
+    if (calib_cache_read_table(CALIB_SECTION_NUC_T, temp_cal_info->nuc_table, NUC_T_SIZE * 2) == NUC_T_SIZE * 2)
+    {
+        temp_nuc_tables_update(temp_cal_info->nuc_table);
+        return SUCCESS;
+    }
     uint8_t data[0x4000] = { 0 };
-    if (spi_read(0xda000, 0x4000, data) != IRUVC_SUCCESS)//high gain is 0xda000 / low gain is 0xd3000
+    if (flash_read(0xda000, 0x4000, data) != FLASH_SUCCESS)//high gain is 0xda000 / low gain is 0xd3000
     {
         printf("get nuc-t table failed\n");
         return FAIL;
@@ -48,7 +105,8 @@ int read_nuc_parameter(TempCalInfo_t* temp_cal_info)
         i = i + 2;
     }
     memcpy(temp_cal_info->nuc_table, data, 0x4000);
-    return FAIL;
+    temp_nuc_tables_update(temp_cal_info->nuc_table);
+    return SUCCESS;
 }
 
 //该函数的功能是计算固件中环境变量校正的参数
@@ -56,23 +114,23 @@ int calculate_org_env_cali_parameter()
 {
     uint8_t gain_flag = HIGH_GAIN;
     uint8_t data[4] = { 0 };
-    TempCalInfo_t* temp_cal_info = get_temp_cal_info();
-    if (get_prop_tpd_params(TPD_PROP_EMS, (uint16_t*)&temp_cal_info->org_env_param->EMS) != IRUVC_SUCCESS)
+    TempCalInfo_t* temp_cal_info = temp_calib_info(command_calib);
+    if (prop_tpd_get(TPD_PROP_EMS, (uint16_t*)&temp_cal_info->org_env_param->EMS) != IRUVC_SUCCESS)
     {
         printf("get EMS failed\n");
         return FAIL;
     }
-    if (get_prop_tpd_params(TPD_PROP_TAU, (uint16_t*)&temp_cal_info->org_env_param->TAU) != IRUVC_SUCCESS)
+    if (prop_tpd_get(TPD_PROP_TAU, (uint16_t*)&temp_cal_info->org_env_param->TAU) != IRUVC_SUCCESS)
     {
         printf("get TAU failed\n");
         return FAIL;
     }
-    if (get_prop_tpd_params(TPD_PROP_TA, (uint16_t*)&temp_cal_info->org_env_param->Ta) != IRUVC_SUCCESS)
+    if (prop_tpd_get(TPD_PROP_TA, (uint16_t*)&temp_cal_info->org_env_param->Ta) != IRUVC_SUCCESS)
     {
         printf("get TA failed\n");
         return FAIL;
     }
-    if (get_prop_tpd_params(TPD_PROP_TU, (uint16_t*)&temp_cal_info->org_env_param->Tu) != IRUVC_SUCCESS)
+    if (prop_tpd_get(TPD_PROP_TU, (uint16_t*)&temp_cal_info->org_env_param->Tu) != IRUVC_SUCCESS)
     {
         printf("get TU failed\n");
         return FAIL;
@@ -104,15 +162,43 @@ int get_compitible_correct_table(uint16_t* correct_table, uint16_t** valid_corre
     return 0;
 }
 
-uint16_t new_nuc_table[NUC_T_SIZE] = { 0 };
-uint16_t new_kt[KT_SIZE] = { 0 };
-int16_t new_bt[BT_SIZE] = { 0 };
+//how much of the table moved, printing all NUC_T_SIZE entries takes longer than the calculation
+static void nuc_table_diff_print(const uint16_t* org_table, const uint16_t* new_table)
+{
+    int changed = 0, max_delta = 0, max_index = 0;
+    for (int i = 0; i < NUC_T_SIZE; i++)
+    {
+        int delta = abs((int)new_table[i] - (int)org_table[i]);
+        changed += (delta != 0);
+        if (delta > max_delta)
+        {
+            max_delta = delta;
+            max_index = i;
+        }
+    }
+    printf("new_nuc_table: %d of %d entries changed, max %d at [%d] %d -> %d\n", changed, NUC_T_SIZE, max_delta, \
+        max_index, org_table[max_index], new_table[max_index]);
+}
+
+//the device measures with new_nuc_table once it took it, the host's table and its lookups follow
+static void nuc_table_follow(iruvc_error_t rst)
+{
+    if (rst != IRUVC_SUCCESS)
+    {
+        printf("set nuc-t table failed\n");
+        return;
+    }
+    TempCalInfo_t* temp_cal_info = temp_calib_info(command_calib);
+    memcpy(temp_cal_info->nuc_table, temp_calib_stage(command_calib)->new_nuc_table, NUC_T_SIZE * 2);
+    temp_nuc_tables_update(temp_cal_info->nuc_table);
+}
 
 void multi_point_calibration(uint16_t* correct_table, uint16_t* nuc_table, \
     uint16_t* org_kt, int16_t* org_bt, TempCalibParam_t* temp_calib_param)
 {
     int i = 0;
-    second_calibration_result_t second_cal_result = { new_kt,new_bt };
+    TempCalibStage_t* stage = temp_calib_stage(command_calib);
+    second_calibration_result_t second_cal_result = { stage->new_kt,stage->new_bt };
 
     second_calibration_param_t second_cal_param = { temp_calib_param->Ktemp, \
         temp_calib_param->Btemp, temp_calib_param->AddressCA,\
@@ -141,7 +227,7 @@ void multi_point_calibration(uint16_t* correct_table, uint16_t* nuc_table, \
     MultiPointCalibParam_t multi_point_calib_param = { env_cor_param[0],
        second_cal_param,8400 };
     MultiPointCalibArray_t multi_point_calib_array = { org_kt, org_bt, nuc_table, correct_table };
-    TwoPointCalibResult_t two_point_calib_result = { new_kt, new_bt };
+    TwoPointCalibResult_t two_point_calib_result = { stage->new_kt, stage->new_bt };
     new_ktbt_recal_double_point_calculate(&multi_point_calib_param, P2, &multi_point_calib_array, &two_point_calib_result);
     printf("new_kt[0]= %d,new_bt[0]= %d\n", two_point_calib_result.new_kt_array[0], two_point_calib_result.new_bt_array[0]);
     for (i = 0; i < sizeof(multi_point_temp) / sizeof(multi_point_temp[0]); i++)
@@ -156,15 +242,11 @@ void multi_point_calibration(uint16_t* correct_table, uint16_t* nuc_table, \
     }
 
     multi_point_calc_new_nuc_table(nuc_table, multi_point_nuc,
-        sizeof(multi_point_temp) / sizeof(multi_point_temp[0]), new_nuc_table);
+        sizeof(multi_point_temp) / sizeof(multi_point_temp[0]), stage->new_nuc_table);
 
 
 
-    for (i = 0; i < NUC_T_SIZE; i++)
-    {
-        printf("new_nuc_table[%d]= %d %d\n", i, nuc_table[i], new_nuc_table[i]);
-    }
-    printf("new_nuc_table[%d]= %d\n", 0, new_nuc_table[0]);
+    nuc_table_diff_print(nuc_table, stage->new_nuc_table);
 }
 
 
@@ -176,6 +258,7 @@ void multi_point_calibration_one_point_correct(uint16_t* correct_table, uint16_t
     uint16_t* kt_array, int16_t* bt_array, TempCalibParam_t* temp_calib_param)
 {
     int i = 0;
+    TempCalibStage_t* stage = temp_calib_stage(command_calib);
 
 
     float ems = 0.95;
@@ -206,11 +289,8 @@ void multi_point_calibration_one_point_correct(uint16_t* correct_table, uint16_t
         printf("setting_nuc=%d output_nuc=%d\n", multi_point_nuc[i].setting_nuc / 2, multi_point_nuc[i].output_nuc / 2);
     }
     memcpy(org_nuc_table, nuc_table, NUC_T_SIZE * 2);
-    multi_point_calc_one_point_correct(nuc_table, multi_point_nuc, 3, new_nuc_table);
-    for (i = 0; i < NUC_T_SIZE; i++)
-    {
-        printf("new_nuc_table[%d]= %d %d\n", i, org_nuc_table[i], new_nuc_table[i]);
-    }
+    multi_point_calc_one_point_correct(nuc_table, multi_point_nuc, 3, stage->new_nuc_table);
+    nuc_table_diff_print(org_nuc_table, stage->new_nuc_table);
 
     //uint8_t data[NUC_T_SIZE * 2] = { 0 };
     //FILE* fp = NULL;
@@ -245,6 +325,36 @@ void multi_point_calibration_one_point_correct(uint16_t* correct_table, uint16_t
     //EXPECT_TRUE(true);
 }
 
+//low gain, ems 128 (and the tpd defaults with restore), then kt/bt/nuc-t and the calib parameters for the
+//multi point calibration, one command batch. runs inside command_sel, on the command worker already
+static void calib_array_read(uint16_t* kt_array, int16_t* bt_array, uint16_t* nuct_array, \
+    TempCalibParam_t* temp_calib_param, int restore)
+{
+    CmdBatch_t batch;
+    cmd_batch_init(&batch, CMD_BATCH_STOP_ON_ERROR, 0);
+    cmd_batch_tpd_set(&batch, TPD_PROP_GAIN_SEL, 0);
+    cmd_batch_tpd_set(&batch, TPD_PROP_EMS, 128);
+    if (restore)
+    {
+        cmd_batch_restore(&batch, DEF_CFG_TPD);
+    }
+    cmd_batch_transfer(&batch, CMD_BATCH_KT_READ, kt_array);
+    cmd_batch_transfer(&batch, CMD_BATCH_BT_READ, bt_array);
+    cmd_batch_transfer(&batch, CMD_BATCH_NUC_T_READ, nuct_array);
+    cmd_batch_transfer(&batch, CMD_BATCH_CALIB_PARAM_READ, temp_calib_param);
+    int rst = cmd_batch_exec(&batch);
+    for (int i = 0; i < batch.num; i++)
+    {
+        printf("batch op %d type %d: %d in %u us\n", i, batch.ops[i].type, batch.ops[i].result, batch.ops[i].us);
+    }
+    printf("calibration arrays read:%d in %llu ms\n", rst, (unsigned long long)(batch.elapsed_us / 1000));
+    printf("kt_array[0]=%d kt_array[1200]=%d\n", kt_array[0], kt_array[1200]);
+    printf("bt_array[0]=%d bt_array[1200]=%d\n", bt_array[0], bt_array[1200]);
+    printf("nuct_array[0]=%d nuct_array[8191]=%d\n", nuct_array[0], nuct_array[8191]);
+    printf("Ktemp=%d Btemp=%d AddressCA=%d\n", temp_calib_param->Ktemp, temp_calib_param->Btemp, \
+        temp_calib_param->AddressCA);
+}
+
 //command selection
 void command_sel(int cmd_type)
 {
@@ -266,8 +376,10 @@ void command_sel(int cmd_type)
     uint32_t file_len = 0;
     double org_temp, dev_temp, new_temp;
     uint16_t temp;
-    TempCalInfo_t* temp_cal_info = get_temp_cal_info();
-    FILE* fp;
+    TempCalInfo_t* temp_cal_info = temp_calib_info(command_calib);
+    uint16_t* correct_table = temp_calib_correct_table(command_calib);
+    size_t correct_size = TEMP_CORRECT_TABLE_LEN * sizeof(uint16_t);
+    TempCalibStage_t* stage = temp_calib_stage(command_calib);
     float ems = 1;
     float ta = 25;
     float new_temp1 = 0;
@@ -360,26 +472,21 @@ void command_sel(int cmd_type)
         printf("Tu=%d\n", temp_cal_info->org_env_param->Tu);
         break;
     case 17: //temperature correction with origin method  for tc1c/wn256/tcbe
-        fp = fopen("tau_H.bin", "rb");
-        fread(correct_table, 1, sizeof(correct_table), fp);
-        fclose(fp);
-        calculate_new_env_cali_parameter(correct_table, 1, 27, 27, 0.25, 1);
-        tpd_get_point_temp_info(point_pos, &temp);
+        calib_cache_read_table(CALIB_SECTION_TAU_H, correct_table, correct_size);
+        calculate_new_env_cali_parameter_ctx(command_calib, correct_table, 1, 27, 27, 0.25, 1);
+        command_point_temp(point_pos, &temp);
         org_temp = (double)temp / 16;
         temp_calc_with_new_env_calibration(temp_cal_info, org_temp, &new_temp);
         printf("org_temp=%f\n", org_temp - 273.15);
         printf("new_temp=%f\n", new_temp - 273.15);
         break;
     case 18:  //temperature correction with new method for P2 module
-        file_len = get_file_len("new_tau_H.bin");
+        file_len = calib_cache_read_table(CALIB_SECTION_NEW_TAU_H, correct_table, correct_size);
         printf("file_len=%d\n", file_len);
-        fp = fopen("new_tau_H.bin", "rb");
-        fread(correct_table, 1, file_len, fp);
-        fclose(fp);
 
         get_compitible_correct_table(correct_table, &cur_correct_table);//新旧版本的修正表兼容
         d = 5;
-        tpd_get_point_temp_info(point_pos, &temp);  //获取固件中的点温度
+        command_point_temp(point_pos, &temp);  //获取固件中的点温度
         dev_temp = (double)temp / 16;  //
         temp_calc_without_any_correct(temp_cal_info, dev_temp, &org_temp);  //计算出未经任何修正的温度数据
         org_temp = org_temp - 273.15;
@@ -392,11 +499,17 @@ void command_sel(int cmd_type)
         printf("new_temp=%f\n", new_temp2);
         break;
     case 19:
-        set_prop_tpd_params(TPD_PROP_GAIN_SEL, 0);
+        if (prop_tpd_set(TPD_PROP_GAIN_SEL, 0) == IRUVC_SUCCESS)
+        {
+            temp_gain_select_ctx(command_calib, LOW_GAIN);
+        }
         printf("set_prop_tpd_params to low\n");
         break;
     case 20:
-        set_prop_tpd_params(TPD_PROP_GAIN_SEL, 1);
+        if (prop_tpd_set(TPD_PROP_GAIN_SEL, 1) == IRUVC_SUCCESS)
+        {
+            temp_gain_select_ctx(command_calib, HIGH_GAIN);
+        }
         printf("set_prop_tpd_params to high\n");
         break;
     case 23:
@@ -404,7 +517,7 @@ void command_sel(int cmd_type)
         printf("dpc_auto_detect completed\n");
         break;
     case 24:
-        restore_default_cfg(DEF_CFG_TPD);
+        prop_restore_default(DEF_CFG_TPD);
         printf("dpc_auto_detect completed\n");
         break;
     case 25:
@@ -416,83 +529,55 @@ void command_sel(int cmd_type)
         printf("zoom_center_down completed\n");
         break;
     case 27:
-        set_prop_image_params(IMAGE_PROP_SEL_MIRROR_FLIP, 3);
+        prop_image_set(IMAGE_PROP_SEL_MIRROR_FLIP, 3);
         printf("IMAGE_PROP_SEL_MIRROR_FLIP completed\n");
         break;
     case 28:
-        set_prop_image_params(IMAGE_PROP_SEL_MIRROR_FLIP, 2);
+        prop_image_set(IMAGE_PROP_SEL_MIRROR_FLIP, 2);
         printf("IMAGE_PROP_SEL_MIRROR_FLIP completed\n");
         break;
     case 29:
-        set_prop_tpd_params(TPD_PROP_GAIN_SEL, 0);
-        set_prop_tpd_params(TPD_PROP_EMS, 128);
-        printf("set_prop_tpd_params to low gain\n");
-        restore_default_cfg(DEF_CFG_TPD);
-        get_tpd_kt_array((uint8_t*)kt_array);
-        printf("get_tpd_kt_array completed\n");
-        printf("kt_array[0]=%d kt_array[1200]=%d\n", kt_array[0], kt_array[1200]);
-        get_tpd_bt_array((uint8_t*)bt_array);
-        printf("get_tpd_bt_array completed\n");
-        printf("bt_array[0]=%d bt_array[1200]=%d\n", bt_array[0], bt_array[1200]);
-        get_tpd_nuc_t_array((uint8_t*)nuct_array);
-        printf("get_tpd_nuc_t_array completed\n");
-        printf("nuct_array[0]=%d nuct_array[8191]=%d\n", nuct_array[0], nuct_array[8191]);
-        get_tpd_calib_param(&temp_calib_param);
-        printf("get_tpd_calib_param completed\n");
-        printf("Ktemp=%d Btemp=%d AddressCA=%d\n", temp_calib_param.Ktemp, temp_calib_param.Btemp, temp_calib_param.AddressCA);
+        calib_array_read(kt_array, bt_array, nuct_array, &temp_calib_param, 1);
         break;
     case 30:
-        file_len = get_file_len("tau_L.bin");
-        fp = fopen("tau_L.bin", "rb");
-        fread(correct_table, 1, file_len, fp);
-        fclose(fp);
+        calib_cache_read_table(CALIB_SECTION_TAU_L, correct_table, correct_size);
         multi_point_calibration(correct_table, nuct_array, kt_array, bt_array, &temp_calib_param);
         break;
     case 31:
-        printf("new_kt[0]=%d\n", new_kt[0]);
-        set_tpd_kt_array((uint8_t*)new_kt);
-        printf("set_tpd_kt_array completed new_kt[0]=%d\n", new_kt[0]);
-        printf("new_bt[0]=%d\n", new_bt[0]);
-        set_tpd_bt_array((uint8_t*)new_bt);
-        printf("set_tpd_bt_array completed new_bt[0]=%d\n", new_bt[0]);
-        printf("new_nuc_table[0]=%d\n", new_nuc_table[0]);
-        set_tpd_nuc_t_array((uint8_t*)new_nuc_table);
-        printf("set_tpd_bt_array completed new_nuc_table[0]=%d\n", new_nuc_table[0]);
+        printf("new_kt[0]=%d\n", stage->new_kt[0]);
+        set_tpd_kt_array((uint8_t*)stage->new_kt);
+        printf("set_tpd_kt_array completed new_kt[0]=%d\n", stage->new_kt[0]);
+        printf("new_bt[0]=%d\n", stage->new_bt[0]);
+        set_tpd_bt_array((uint8_t*)stage->new_bt);
+        printf("set_tpd_bt_array completed new_bt[0]=%d\n", stage->new_bt[0]);
+        printf("new_nuc_table[0]=%d\n", stage->new_nuc_table[0]);
+        nuc_table_follow(set_tpd_nuc_t_array((uint8_t*)stage->new_nuc_table));
+        printf("set_tpd_bt_array completed new_nuc_table[0]=%d\n", stage->new_nuc_table[0]);
+        calib_cache_invalidate();
         break;
     case 32:
-        set_prop_tpd_params(TPD_PROP_GAIN_SEL, 0);
-        set_prop_tpd_params(TPD_PROP_EMS, 128);
-        printf("set_prop_tpd_params to low gain\n");
-        get_tpd_kt_array((uint8_t*)kt_array);
-        printf("get_tpd_kt_array completed\n");
-        printf("kt_array[0]=%d kt_array[1200]=%d\n", kt_array[0], kt_array[1200]);
-        get_tpd_bt_array((uint8_t*)bt_array);
-        printf("get_tpd_bt_array completed\n");
-        printf("bt_array[0]=%d bt_array[1200]=%d\n", bt_array[0], bt_array[1200]);
-        get_tpd_nuc_t_array((uint8_t*)nuct_array);
-        printf("get_tpd_nuc_t_array completed\n");
-        printf("nuct_array[0]=%d nuct_array[8191]=%d\n", nuct_array[0], nuct_array[8191]);
-        get_tpd_calib_param(&temp_calib_param);
-        printf("get_tpd_calib_param completed\n");
-        printf("Ktemp=%d Btemp=%d AddressCA=%d\n", temp_calib_param.Ktemp, temp_calib_param.Btemp, temp_calib_param.AddressCA);
+        calib_array_read(kt_array, bt_array, nuct_array, &temp_calib_param, 0);
         break;
     case 33:
-        file_len = get_file_len("tau_L.bin");
-        fp = fopen("tau_L.bin", "rb");
-        fread(correct_table, 1, file_len, fp);
-        fclose(fp);
+        calib_cache_read_table(CALIB_SECTION_TAU_L, correct_table, correct_size);
         irtemp_log_register(IRTEMP_LOG_ERROR);
         multi_point_calibration_one_point_correct(correct_table, nuct_array, kt_array, bt_array, &temp_calib_param);
         break;
     case 34:
-        printf("new_nuc_table[0]=%d\n", new_nuc_table[0]);
-        set_tpd_nuc_t_array_to_ddr((uint8_t*)new_nuc_table);
-        printf("set_tpd_bt_array completed new_nuc_table[0]=%d\n", new_nuc_table[0]);
+        printf("new_nuc_table[0]=%d\n", stage->new_nuc_table[0]);
+        nuc_table_follow(set_tpd_nuc_t_array_to_ddr((uint8_t*)stage->new_nuc_table));
+        printf("set_tpd_bt_array completed new_nuc_table[0]=%d\n", stage->new_nuc_table[0]);
+        calib_cache_invalidate();
         break;
     case 35:
-        printf("new_nuc_table[0]=%d\n", new_nuc_table[0]);
-        set_tpd_nuc_t_array((uint8_t*)new_nuc_table);
-        printf("set_tpd_bt_array completed new_nuc_table[0]=%d\n", new_nuc_table[0]);
+        printf("new_nuc_table[0]=%d\n", stage->new_nuc_table[0]);
+        nuc_table_follow(set_tpd_nuc_t_array((uint8_t*)stage->new_nuc_table));
+        printf("set_tpd_bt_array completed new_nuc_table[0]=%d\n", stage->new_nuc_table[0]);
+        calib_cache_invalidate();
+        break;
+    case 36:
+        rst = burst_trigger(command_burst);
+        printf("burst_trigger:%d\n", rst);
         break;
     default:
         break;
@@ -502,17 +587,240 @@ void command_sel(int cmd_type)
 }
 
 //command thread function
+//queue class of each command of command_sel
+CmdqPriority_t command_priority(int cmd_type)
+{
+    switch (cmd_type)
+    {
+    case 0:
+    case 5:
+    case 10:
+    case 11:
+    case 13:
+        return CMDQ_PRIORITY_READ;
+    case 16:
+    case 17:
+    case 18:
+    case 23:
+    case 24:
+    case 29:
+    case 30:
+    case 31:
+    case 32:
+    case 33:
+    case 34:
+    case 35:
+        return CMDQ_PRIORITY_LONG;
+    default:
+        return CMDQ_PRIORITY_NORMAL;
+    }
+}
+
+static int command_job(void* arg)
+{
+    TRACE_BEGIN_VALUE("command", (intptr_t)arg);
+    command_sel((int)(intptr_t)arg);
+    TRACE_END("command");
+    return SUCCESS;
+}
+
+int command_submit(int cmd_type, CmdqDone_t done, void* user_data)
+{
+    return cmdq_submit(command_job, (void*)(intptr_t)cmd_type, command_priority(cmd_type), 0, \
+        done, user_data, NULL);
+}
+
+int cmd_stdin_wait(StopToken_t* stop, int timeout_ms)
+{
+#if defined(_WIN32)
+    HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+    HANDLE event = (HANDLE)stop_token_event(stop);
+    DWORD mode = 0;
+    if (GetConsoleMode(input, &mode))
+    {
+        HANDLE handles[2] = { input, event };
+        DWORD rst = WaitForMultipleObjects((event != NULL) ? 2 : 1, handles, FALSE, (DWORD)timeout_ms);
+        if (stop_requested(stop))
+        {
+            return -1;
+        }
+        if (rst != WAIT_OBJECT_0)
+        {
+            return 0;
+        }
+        //any console event signals the handle, a line is ready once enter is down: focus and mouse events are
+        //dropped, keys stay for the read
+        INPUT_RECORD records[CMD_INPUT_RECORDS];
+        DWORD num = 0;
+        if (!PeekConsoleInputA(input, records, CMD_INPUT_RECORDS, &num) || num == CMD_INPUT_RECORDS)
+        {
+            return 1;
+        }
+        int keys = 0;
+        for (DWORD i = 0; i < num; i++)
+        {
+            if (records[i].EventType != KEY_EVENT)
+            {
+                continue;
+            }
+            keys++;
+            if (records[i].Event.KeyEvent.bKeyDown && records[i].Event.KeyEvent.wVirtualKeyCode == VK_RETURN)
+            {
+                return 1;
+            }
+        }
+        if (keys == 0)
+        {
+            ReadConsoleInputA(input, records, num, &num);
+            return 0;
+        }
+    }
+    else if (GetFileType(input) == FILE_TYPE_PIPE)
+    {
+        //a closed pipe fails the peek and reads as the end
+        DWORD avail = 0;
+        if (!PeekNamedPipe(input, NULL, 0, NULL, &avail, NULL) || avail > 0)
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        //a file or nul reads without blocking
+        return stop_requested(stop) ? -1 : 1;
+    }
+    int step_ms = (timeout_ms < CMD_KEY_POLL_MS) ? timeout_ms : CMD_KEY_POLL_MS;
+    if (stop != NULL)
+    {
+        stop_token_wait(stop, (uint32_t)step_ms);
+    }
+    else
+    {
+        Sleep((DWORD)step_ms);
+    }
+    return stop_requested(stop) ? -1 : 0;
+#else
+    struct pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { stop_token_fd(stop), POLLIN, 0 } };
+    int rst = poll(fds, (fds[1].fd >= 0) ? 2 : 1, timeout_ms);
+    if (stop_requested(stop))
+    {
+        return -1;
+    }
+    //a hang up or a closed stdin is ready too, the read then sees the end
+    return (rst > 0 && fds[0].revents != 0) ? 1 : 0;
+#endif
+}
+
+static char cmd_input[CMD_INPUT_LEN];
+static int cmd_input_len = 0;
+
+//the next token of stdin. read past stdio, so no input waits in a buffer the stdin wait cannot see: 0 at the end
+//of the input or once stopped
+static int cmd_token_read(StopToken_t* stop, char* token, int token_len)
+{
+    int ended = 0;
+    while (1)
+    {
+        int start = 0;
+        while (start < cmd_input_len && isspace((unsigned char)cmd_input[start]))
+        {
+            start++;
+        }
+        int end = start;
+        while (end < cmd_input_len && !isspace((unsigned char)cmd_input[end]))
+        {
+            end++;
+        }
+        if (end > start && (end < cmd_input_len || ended))
+        {
+            int len = (end - start < token_len - 1) ? end - start : token_len - 1;
+            memcpy(token, cmd_input + start, len);
+            token[len] = '\0';
+            cmd_input_len -= end;
+            memmove(cmd_input, cmd_input + end, cmd_input_len);
+            return 1;
+        }
+        cmd_input_len -= start;
+        memmove(cmd_input, cmd_input + start, cmd_input_len);
+        if (cmd_input_len == CMD_INPUT_LEN)
+        {
+            cmd_input_len = 0;          //no token is this long
+        }
+        if (ended || (stop == NULL && !is_streaming))
+        {
+            return 0;
+        }
+        int ready = cmd_stdin_wait(stop, CMD_POLL_MS);
+        if (ready < 0)
+        {
+            return 0;
+        }
+        if (ready == 0)
+        {
+            continue;
+        }
+#if defined(_WIN32)
+        int num = _read(0, cmd_input + cmd_input_len, CMD_INPUT_LEN - cmd_input_len);
+#else
+        int num = (int)read(STDIN_FILENO, cmd_input + cmd_input_len, CMD_INPUT_LEN - cmd_input_len);
+#endif
+        if (num <= 0)
+        {
+            ended = 1;
+        }
+        else
+        {
+            cmd_input_len += num;
+        }
+    }
+}
+
 void* cmd_function(void* threadarg)
 {
     int cmd = 1;
-    while (is_streaming)
+    char token[16];
+    StopToken_t* stop = (StopToken_t*)threadarg;
+    TRACE_THREAD_NAME("cmd");
+    rt_thread_enter(RT_ROLE_CONTROL, -1, "cmd");
+    while (cmd_token_read(stop, token, sizeof(token)))
     {
-        scanf("%d", &cmd);
+        //a letter is a display key ('s', 'a', 'p', ...), the same toggles as in the window
+        if (!isdigit((unsigned char)token[0]) && token[0] != '-')
+        {
+            int display_cmd = display_cmd_of_key(token[0]);
+            if (display_cmd >= 0)
+            {
+                display_cmd_post((DisplayCmd_t)display_cmd);
+            }
+            continue;
+        }
+        cmd = atoi(token);
         if (is_streaming)
         {
-            command_sel(cmd);
+            //the worker runs it between frames, without cmdq_init it runs here as before
+            TRACE_INSTANT("command_submit", cmd);
+            if (command_submit(cmd, NULL, NULL) != CMDQ_SUCCESS)
+            {
+                command_job((void*)(intptr_t)cmd);
+            }
         }
     }
     printf("cmd thread exit!!\n");
+    rt_thread_leave();
     return NULL;
-}
\ No newline at end of file
+}
+
+void update_fw_cmd(const char* file_path)
+{
+    flash_stats_reset();
+    int rst = flash_update_fw_file(file_path);
+    if (rst != FLASH_SUCCESS)
+    {
+        printf("update firmware from %s failed:%d\n", file_path, rst);
+        return;
+    }
+    FlashStats_t stats;
+    flash_stats_get(&stats);
+    flash_stats_print(&stats);
+    puts("firmware updated");
+}
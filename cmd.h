@@ -18,6 +18,8 @@
 #include "libirtemp.h"
 #include "data.h"
 #include "temperature.h"
+#include "cmdq.h"
+#include "stop.h"
 
 #define DEV_STATUS_NULL 0
 #define DEV_STATUS_ROM 1
@@ -30,16 +32,36 @@
 
 
 #define KT_LEN 1201
+#define CMD_POLL_MS 200                 //a stdin wait without a stop token looks at is_streaming this often
 #define SUCCESS 0
 #define FAIL   -1
 
 //init the command
 void command_init(void);
 
+//the burst command 36 triggers, NULL for none
+void command_burst_set(struct Burst_t* burst);
+
+//the calibration context the temperature and calibration commands work on, NULL the default one
+void command_calib_set(struct TempCalibCtx_t* calib);
+
+//the latest frame service commands 17/18 read their point temperature from, NULL asks the device over usb
+void command_query_set(struct TempQuery_t* query);
+
 //select the command
 void command_sel(int cmd_type);
 
-//command thread, get the input and select the command
+//queue class of a command_sel command: reads first, calibration and table writes last
+CmdqPriority_t command_priority(int cmd_type);
+
+//run command_sel(cmd_type) on the command worker, done is called there once it finished
+int command_submit(int cmd_type, CmdqDone_t done, void* user_data);
+
+//wait up to timeout_ms for input on stdin: 1 ready, 0 not yet, -1 once stop (may be NULL) is requested
+int cmd_stdin_wait(StopToken_t* stop, int timeout_ms);
+
+//command thread, get the input and queue the command. threadarg is the run's StopToken_t, the thread leaves
+//with its stop instead of being cancelled out of a blocking read. NULL reads while is_streaming as before
 void* cmd_function(void* threadarg);
 
 //download firmware
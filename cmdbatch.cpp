@@ -0,0 +1,185 @@
+#include "cmdbatch.h"
+#include <string.h>
+#include "data.h"
+#include "trace.h"
+
+static uint32_t cmd_batch_poll_ms = CMD_BATCH_POLL_MS;
+
+void cmd_batch_init(CmdBatch_t* batch, uint32_t flags, uint32_t poll_ms)
+{
+    if (batch == NULL)
+    {
+        return;
+    }
+    memset(batch, 0, sizeof(CmdBatch_t));
+    batch->flags = flags;
+    batch->poll_ms = poll_ms;
+}
+
+static int cmd_batch_add(CmdBatch_t* batch, CmdBatchOpType_t type, int prop, uint16_t value, void* data)
+{
+    if (batch == NULL)
+    {
+        return CMD_BATCH_ERROR_PARAM;
+    }
+    if (type <= CMD_BATCH_SHUTTER_SET)
+    {
+        //a set of a property already set in the run of sets at the tail takes its place
+        for (int i = batch->num - 1; i >= 0 && batch->ops[i].type <= CMD_BATCH_SHUTTER_SET; i--)
+        {
+            if (batch->ops[i].type == type && batch->ops[i].prop == prop)
+            {
+                batch->ops[i].value = value;
+                return CMD_BATCH_SUCCESS;
+            }
+        }
+    }
+    if (batch->num >= CMD_BATCH_MAX_OPS)
+    {
+        return CMD_BATCH_ERROR_FULL;
+    }
+    CmdBatchOp_t* op = &batch->ops[batch->num++];
+    memset(op, 0, sizeof(CmdBatchOp_t));
+    op->type = type;
+    op->prop = prop;
+    op->value = value;
+    op->data = data;
+    return CMD_BATCH_SUCCESS;
+}
+
+int cmd_batch_tpd_set(CmdBatch_t* batch, enum prop_tpd_params prop, uint16_t value)
+{
+    return cmd_batch_add(batch, CMD_BATCH_TPD_SET, (int)prop, value, NULL);
+}
+
+int cmd_batch_image_set(CmdBatch_t* batch, enum prop_image_params prop, uint16_t value)
+{
+    return cmd_batch_add(batch, CMD_BATCH_IMAGE_SET, (int)prop, value, NULL);
+}
+
+int cmd_batch_shutter_set(CmdBatch_t* batch, enum prop_auto_shutter_params prop, uint16_t value)
+{
+    return cmd_batch_add(batch, CMD_BATCH_SHUTTER_SET, (int)prop, value, NULL);
+}
+
+int cmd_batch_restore(CmdBatch_t* batch, enum prop_default_cfg cfg)
+{
+    return cmd_batch_add(batch, CMD_BATCH_RESTORE, (int)cfg, 0, NULL);
+}
+
+int cmd_batch_transfer(CmdBatch_t* batch, CmdBatchOpType_t type, void* data)
+{
+    if (type < CMD_BATCH_KT_READ || type > CMD_BATCH_BT_WRITE || data == NULL)
+    {
+        return CMD_BATCH_ERROR_PARAM;
+    }
+    return cmd_batch_add(batch, type, 0, 0, data);
+}
+
+static int cmd_batch_op_run(const CmdBatchOp_t* op)
+{
+    switch (op->type)
+    {
+    case CMD_BATCH_TPD_SET:
+        return prop_tpd_set((enum prop_tpd_params)op->prop, op->value);
+    case CMD_BATCH_IMAGE_SET:
+        return prop_image_set((enum prop_image_params)op->prop, op->value);
+    case CMD_BATCH_SHUTTER_SET:
+        return prop_shutter_set((enum prop_auto_shutter_params)op->prop, op->value);
+    case CMD_BATCH_RESTORE:
+        return prop_restore_default((enum prop_default_cfg)op->prop);
+    case CMD_BATCH_KT_READ:
+        return get_tpd_kt_array((uint8_t*)op->data);
+    case CMD_BATCH_BT_READ:
+        return get_tpd_bt_array((uint8_t*)op->data);
+    case CMD_BATCH_NUC_T_READ:
+        return get_tpd_nuc_t_array((uint8_t*)op->data);
+    case CMD_BATCH_CALIB_PARAM_READ:
+        return get_tpd_calib_param((TempCalibParam_t*)op->data);
+    case CMD_BATCH_KT_WRITE:
+        return set_tpd_kt_array((uint8_t*)op->data);
+    case CMD_BATCH_BT_WRITE:
+        return set_tpd_bt_array((uint8_t*)op->data);
+    default:
+        return IRUVC_ERROR_PARAM;
+    }
+}
+
+int cmd_batch_exec(CmdBatch_t* batch)
+{
+    if (batch == NULL)
+    {
+        return CMD_BATCH_ERROR_PARAM;
+    }
+    TRACE_BEGIN_VALUE("cmd_batch", batch->num);
+    uint64_t start_us = get_monotonic_us();
+    uint32_t poll_ms = (batch->poll_ms != 0) ? batch->poll_ms : CMD_BATCH_POLL_MS;
+    if (poll_ms != cmd_batch_poll_ms)
+    {
+        vdcmd_set_polling_wait_time(poll_ms);
+    }
+    batch->failed = 0;
+    for (int i = 0; i < batch->num; i++)
+    {
+        CmdBatchOp_t* op = &batch->ops[i];
+        if (batch->failed > 0 && (batch->flags & CMD_BATCH_STOP_ON_ERROR))
+        {
+            op->result = CMD_BATCH_SKIPPED;
+            op->us = 0;
+            continue;
+        }
+        uint64_t op_start_us = get_monotonic_us();
+        op->result = cmd_batch_op_run(op);
+        op->us = (uint32_t)(get_monotonic_us() - op_start_us);
+        if (op->result != IRUVC_SUCCESS)
+        {
+            batch->failed++;
+        }
+    }
+    if (poll_ms != cmd_batch_poll_ms)
+    {
+        vdcmd_set_polling_wait_time(cmd_batch_poll_ms);
+    }
+    batch->elapsed_us = get_monotonic_us() - start_us;
+    TRACE_END("cmd_batch");
+    return (batch->failed > 0) ? CMD_BATCH_ERROR_DEVICE : CMD_BATCH_SUCCESS;
+}
+
+static int cmd_batch_job(void* arg)
+{
+    return cmd_batch_exec((CmdBatch_t*)arg);
+}
+
+int cmd_batch_run(CmdBatch_t* batch)
+{
+    if (batch == NULL)
+    {
+        return CMD_BATCH_ERROR_PARAM;
+    }
+    int result = CMD_BATCH_SUCCESS;
+    int rst = cmdq_call(cmd_batch_job, batch, CMDQ_PRIORITY_LONG, 0, &result);
+    if (rst == CMDQ_CLOSED)
+    {
+        result = cmd_batch_exec(batch);
+    }
+    else if (rst != CMDQ_SUCCESS)
+    {
+        return rst;
+    }
+    return result;
+}
+
+int cmd_batch_submit(CmdBatch_t* batch, CmdqDone_t done, void* user_data, int* job_id)
+{
+    if (batch == NULL)
+    {
+        return CMD_BATCH_ERROR_PARAM;
+    }
+    return cmdq_submit(cmd_batch_job, batch, CMDQ_PRIORITY_LONG, 0, done, user_data, job_id);
+}
+
+void cmd_batch_poll_default(uint32_t poll_ms)
+{
+    cmd_batch_poll_ms = (poll_ms != 0) ? poll_ms : CMD_BATCH_POLL_MS;
+    vdcmd_set_polling_wait_time(cmd_batch_poll_ms);
+}
@@ -0,0 +1,78 @@
+#ifndef _CMDBATCH_H_
+#define _CMDBATCH_H_
+
+//several property sets, restores and calibration array transfers run back to back as one command worker job:
+//the stream gives the device one long gap instead of one per command, the vendor's polling wait is set once for
+//the batch and a property set again among the sets queued in a row is written once, with the last value.
+//results are per operation
+#include <stdint.h>
+#include "cmdq.h"
+#include "prop.h"
+
+#define CMD_BATCH_MAX_OPS 16
+#define CMD_BATCH_POLL_MS 10000         //vdcmd_set_polling_wait_time outside a batch, what sample.cpp has always set
+#define CMD_BATCH_STOP_ON_ERROR 0x01    //the operations after a failed one are not run
+
+#define CMD_BATCH_SUCCESS 0
+#define CMD_BATCH_ERROR_PARAM -1
+#define CMD_BATCH_ERROR_FULL -2
+#define CMD_BATCH_ERROR_DEVICE -3       //an operation failed, see its result
+#define CMD_BATCH_SKIPPED -4            //result of an operation not run after CMD_BATCH_STOP_ON_ERROR
+
+typedef enum
+{
+    CMD_BATCH_TPD_SET = 0,
+    CMD_BATCH_IMAGE_SET,
+    CMD_BATCH_SHUTTER_SET,
+    CMD_BATCH_RESTORE,                  //prop_restore_default(prop)
+    CMD_BATCH_KT_READ,                  //get_tpd_kt_array into data, KT_LEN uint16
+    CMD_BATCH_BT_READ,                  //get_tpd_bt_array, KT_LEN int16
+    CMD_BATCH_NUC_T_READ,               //get_tpd_nuc_t_array, NUCT_LEN uint16
+    CMD_BATCH_CALIB_PARAM_READ,         //get_tpd_calib_param, a TempCalibParam_t
+    CMD_BATCH_KT_WRITE,                 //set_tpd_kt_array from data
+    CMD_BATCH_BT_WRITE,
+}CmdBatchOpType_t;
+
+typedef struct {
+    CmdBatchOpType_t type;
+    int prop;                           //property or prop_default_cfg
+    uint16_t value;
+    void* data;                         //array of the transfers, the caller's until the batch completed
+    int result;                         //iruvc_error_t of the vendor call, or CMD_BATCH_SKIPPED
+    uint32_t us;                        //time the operation took
+}CmdBatchOp_t;
+
+typedef struct {
+    CmdBatchOp_t ops[CMD_BATCH_MAX_OPS];
+    int num;
+    uint32_t flags;                     //CMD_BATCH_xxx
+    uint32_t poll_ms;                   //vendor polling wait while the batch runs, 0 CMD_BATCH_POLL_MS
+    int failed;                         //operations failed in the last run
+    uint64_t elapsed_us;
+}CmdBatch_t;
+
+void cmd_batch_init(CmdBatch_t* batch, uint32_t flags, uint32_t poll_ms);
+
+//queue one operation, CMD_BATCH_ERROR_FULL after CMD_BATCH_MAX_OPS
+int cmd_batch_tpd_set(CmdBatch_t* batch, enum prop_tpd_params prop, uint16_t value);
+int cmd_batch_image_set(CmdBatch_t* batch, enum prop_image_params prop, uint16_t value);
+int cmd_batch_shutter_set(CmdBatch_t* batch, enum prop_auto_shutter_params prop, uint16_t value);
+int cmd_batch_restore(CmdBatch_t* batch, enum prop_default_cfg cfg);
+int cmd_batch_transfer(CmdBatch_t* batch, CmdBatchOpType_t type, void* data);
+
+//run the batch on the calling thread, for code that already runs on the command worker (command_sel).
+//CMD_BATCH_ERROR_DEVICE when any operation failed
+int cmd_batch_exec(CmdBatch_t* batch);
+
+//run the batch as one CMDQ_PRIORITY_LONG job and wait for it, on the calling thread without cmdq_init.
+//a full queue returns CMDQ_ERROR_FULL and nothing ran
+int cmd_batch_run(CmdBatch_t* batch);
+
+//queue the batch as one job and return cmdq_submit's result, done gets cmd_batch_exec's. batch stays the
+//caller's until then
+int cmd_batch_submit(CmdBatch_t* batch, CmdqDone_t done, void* user_data, int* job_id);
+
+//polling wait of the vendor commands outside a batch, what a batch returns to when it is done
+void cmd_batch_poll_default(uint32_t poll_ms);
+
+#endif
@@ -0,0 +1,598 @@
+#include "cmdbroker.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "cmd.h"
+#include "gain.h"
+#include "prop.h"
+#include "temperature.h"
+#include "trace.h"
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+
+#if !defined(_WIN32)
+//<path>.<camera_index>, a path that does not fit is refused: cut short, two modules would share a socket
+static int cmd_broker_path(char* dst, const char* path, int camera_index)
+{
+    int len = snprintf(dst, CMD_BROKER_PATH_LEN, "%s.%d", (path != NULL && path[0] != '\0') ? path : \
+        CMD_BROKER_DEFAULT_PATH, camera_index);
+    return (len > 0 && len < CMD_BROKER_PATH_LEN) ? CMD_BROKER_SUCCESS : CMD_BROKER_ERROR_PARAM;
+}
+
+static void cmd_broker_reply_init(CmdBrokerReply_t* reply, const CmdBrokerRequest_t* request, int result)
+{
+    memset(reply, 0, sizeof(CmdBrokerReply_t));
+    reply->magic = CMD_BROKER_MAGIC;
+    reply->version = CMD_BROKER_VERSION;
+    reply->op = request->op;
+    reply->seq = request->seq;
+    reply->result = result;
+}
+
+//the op's own class, and whether a request may ask for another: any op may go lower, only the short property
+//ops may go up to critical, a long command asking for it would hold the slot critical jobs are bounded by
+static int cmd_broker_priority(const CmdBrokerRequest_t* request, CmdqPriority_t* priority)
+{
+    CmdqPriority_t own = CMDQ_PRIORITY_NORMAL;
+    switch (request->op)
+    {
+    case CMD_BROKER_OP_COMMAND: own = command_priority(request->arg[0]); break;
+    case CMD_BROKER_OP_PROP_GET: own = CMDQ_PRIORITY_READ; break;
+    case CMD_BROKER_OP_PROP_SET: own = CMDQ_PRIORITY_NORMAL; break;
+    case CMD_BROKER_OP_GAIN: own = CMDQ_PRIORITY_CRITICAL; break;
+    default: return CMD_BROKER_ERROR_PARAM;
+    }
+    *priority = own;
+    if (request->priority == CMD_BROKER_PRIORITY_DEFAULT)
+    {
+        return CMD_BROKER_SUCCESS;
+    }
+    if (request->priority >= CMDQ_PRIORITY_NUM || (request->priority < own && request->op == CMD_BROKER_OP_COMMAND))
+    {
+        return CMD_BROKER_ERROR_PARAM;
+    }
+    *priority = (CmdqPriority_t)request->priority;
+    return CMD_BROKER_SUCCESS;
+}
+
+static int cmd_broker_prop_get(int page, int prop, uint16_t* value)
+{
+    switch (page)
+    {
+    case CMD_BROKER_PAGE_TPD: return prop_tpd_get((enum prop_tpd_params)prop, value);
+    case CMD_BROKER_PAGE_IMAGE: return prop_image_get((enum prop_image_params)prop, value);
+    default: return prop_shutter_get((enum prop_auto_shutter_params)prop, value);
+    }
+}
+
+static int cmd_broker_prop_set(int page, int prop, uint16_t value)
+{
+    switch (page)
+    {
+    case CMD_BROKER_PAGE_TPD: return prop_tpd_set((enum prop_tpd_params)prop, value);
+    case CMD_BROKER_PAGE_IMAGE: return prop_image_set((enum prop_image_params)prop, value);
+    default: return prop_shutter_set((enum prop_auto_shutter_params)prop, value);
+    }
+}
+
+static int cmd_broker_args_valid(const CmdBrokerRequest_t* request)
+{
+    static const int page_size[CMD_BROKER_PAGE_NUM] = { PROP_TPD_NUM, PROP_IMAGE_NUM, PROP_SHUTTER_NUM };
+    switch (request->op)
+    {
+    case CMD_BROKER_OP_COMMAND:
+        return request->arg[0] >= 0;
+    case CMD_BROKER_OP_PROP_SET:
+        if (request->arg[2] < 0 || request->arg[2] > 0xFFFF)
+        {
+            return 0;
+        }
+        //fall through
+    case CMD_BROKER_OP_PROP_GET:
+        return request->arg[0] >= 0 && request->arg[0] < CMD_BROKER_PAGE_NUM && request->arg[1] >= 0 && \
+            request->arg[1] < page_size[request->arg[0]];
+    case CMD_BROKER_OP_GAIN:
+        return request->arg[0] == GAIN_CTRL_HIGH || request->arg[0] == GAIN_CTRL_LOW;
+    default:
+        return 0;
+    }
+}
+
+//runs on the cmdq worker
+static int cmd_broker_job(void* arg)
+{
+    CmdBrokerJob_t* job = (CmdBrokerJob_t*)arg;
+    const CmdBrokerRequest_t* request = &job->request;
+    job->start_us = get_monotonic_us();
+    TRACE_BEGIN_VALUE("broker", request->op);
+    int rst = IRUVC_SUCCESS;
+    uint16_t value = 0;
+    switch (request->op)
+    {
+    case CMD_BROKER_OP_COMMAND:
+        command_sel(request->arg[0]);
+        break;
+    case CMD_BROKER_OP_PROP_GET:
+        rst = cmd_broker_prop_get(request->arg[0], request->arg[1], &value);
+        job->value = value;
+        break;
+    case CMD_BROKER_OP_PROP_SET:
+        rst = cmd_broker_prop_set(request->arg[0], request->arg[1], (uint16_t)request->arg[2]);
+        break;
+    case CMD_BROKER_OP_GAIN:
+        //the gain's calibration tables go with it, like the gain controller's switch
+        rst = prop_tpd_set(TPD_PROP_GAIN_SEL, (uint16_t)request->arg[0]);
+        if (rst == IRUVC_SUCCESS)
+        {
+            temp_gain_select_ctx(job->broker->param.calib, request->arg[0]);
+        }
+        break;
+    default:
+        break;
+    }
+    TRACE_END("broker");
+    return rst;
+}
+
+//called with the mutex held, the client may have gone and its slot be taken by another one since
+static void cmd_broker_send(CmdBroker_t* broker, int client, uint32_t gen, const CmdBrokerReply_t* reply)
+{
+    CmdBrokerClient_t* slot = &broker->clients[client];
+    if (slot->fd < 0 || slot->gen != gen || \
+        send(slot->fd, reply, sizeof(CmdBrokerReply_t), MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)sizeof(CmdBrokerReply_t))
+    {
+        broker->stats.lost++;
+        return;
+    }
+    broker->stats.replies++;
+}
+
+//on the cmdq worker once the job ran, with CMDQ_CLOSED when the queue stopped first
+static void cmd_broker_done(int job_id, int result, void* user_data)
+{
+    CmdBrokerJob_t* job = (CmdBrokerJob_t*)user_data;
+    CmdBroker_t* broker = job->broker;
+    uint64_t now_us = get_monotonic_us();
+    CmdBrokerReply_t reply;
+    cmd_broker_reply_init(&reply, &job->request, result);
+    reply.value = job->value;
+    if (job->start_us > 0)
+    {
+        reply.wait_us = (uint32_t)(job->start_us - job->submit_us);
+        reply.exec_us = (uint32_t)(now_us - job->start_us);
+    }
+    pthread_mutex_lock(&broker->mutex);
+    cmd_broker_send(broker, job->client, job->client_gen, &reply);
+    if (broker->clients[job->client].gen == job->client_gen)
+    {
+        broker->clients[job->client].inflight--;
+    }
+    job->used = 0;
+    broker->jobs_used--;
+    pthread_cond_broadcast(&broker->cond);
+    pthread_mutex_unlock(&broker->mutex);
+}
+
+//one datagram of a client, answered right away when it does not go to the queue
+static void cmd_broker_request(CmdBroker_t* broker, int client, const CmdBrokerRequest_t* request)
+{
+    CmdBrokerReply_t reply;
+    CmdqPriority_t priority = CMDQ_PRIORITY_NORMAL;
+    pthread_mutex_lock(&broker->mutex);
+    broker->stats.requests++;
+    if (request->version != CMD_BROKER_VERSION)
+    {
+        cmd_broker_reply_init(&reply, request, CMD_BROKER_ERROR_VERSION);
+    }
+    else if (request->op == CMD_BROKER_OP_STATS)
+    {
+        cmd_broker_reply_init(&reply, request, CMD_BROKER_SUCCESS);
+        pthread_mutex_unlock(&broker->mutex);
+        cmdq_pending(reply.pending);
+        cmdq_stats(&reply.stats);
+        pthread_mutex_lock(&broker->mutex);
+        cmd_broker_send(broker, client, broker->clients[client].gen, &reply);
+        pthread_mutex_unlock(&broker->mutex);
+        return;
+    }
+    else if (!cmd_broker_args_valid(request) || cmd_broker_priority(request, &priority) != CMD_BROKER_SUCCESS)
+    {
+        cmd_broker_reply_init(&reply, request, CMD_BROKER_ERROR_PARAM);
+    }
+    else if (broker->clients[client].inflight >= CMD_BROKER_MAX_INFLIGHT || broker->jobs_used >= CMD_BROKER_MAX_JOBS)
+    {
+        cmd_broker_reply_init(&reply, request, CMD_BROKER_ERROR_BUSY);
+    }
+    else
+    {
+        int index = 0;
+        while (broker->jobs[index].used)
+        {
+            index++;
+        }
+        CmdBrokerJob_t* job = &broker->jobs[index];
+        memset(job, 0, sizeof(CmdBrokerJob_t));
+        job->broker = broker;
+        job->client = client;
+        job->client_gen = broker->clients[client].gen;
+        job->submit_us = get_monotonic_us();
+        job->request = *request;
+        job->used = 1;
+        broker->jobs_used++;
+        broker->clients[client].inflight++;
+        pthread_mutex_unlock(&broker->mutex);
+        //the done callback may run before cmdq_submit returns, it takes the mutex itself
+        int rst = cmdq_submit(cmd_broker_job, job, priority, 0, cmd_broker_done, job, NULL);
+        if (rst == CMDQ_SUCCESS)
+        {
+            return;
+        }
+        pthread_mutex_lock(&broker->mutex);
+        job->used = 0;
+        broker->jobs_used--;
+        broker->clients[client].inflight--;
+        cmd_broker_reply_init(&reply, request, CMD_BROKER_ERROR_QUEUE);
+        reply.value = rst;
+    }
+    broker->stats.rejected++;
+    cmd_broker_send(broker, client, broker->clients[client].gen, &reply);
+    pthread_mutex_unlock(&broker->mutex);
+}
+
+//called with the mutex held, the replies still queued for it are dropped by the generation
+static void cmd_broker_close_client(CmdBroker_t* broker, int client)
+{
+    CmdBrokerClient_t* slot = &broker->clients[client];
+    close(slot->fd);
+    slot->fd = -1;
+    slot->gen++;
+    slot->inflight = 0;
+    broker->stats.clients--;
+}
+
+static void* cmd_broker_function(void* arg)
+{
+    CmdBroker_t* broker = (CmdBroker_t*)arg;
+    TRACE_THREAD_NAME("broker");
+    struct pollfd fds[CMD_BROKER_MAX_CLIENTS + 2];
+    int fd_client[CMD_BROKER_MAX_CLIENTS + 2];
+    while (broker->running)
+    {
+        int fd_num = 0;
+        fds[fd_num].fd = broker->listen_fd;
+        fds[fd_num].events = POLLIN;
+        fd_client[fd_num++] = -1;
+        fds[fd_num].fd = broker->wake_fd[0];
+        fds[fd_num].events = POLLIN;
+        fd_client[fd_num++] = -1;
+        pthread_mutex_lock(&broker->mutex);
+        for (int i = 0; i < CMD_BROKER_MAX_CLIENTS; i++)
+        {
+            if (broker->clients[i].fd >= 0)
+            {
+                fds[fd_num].fd = broker->clients[i].fd;
+                fds[fd_num].events = POLLIN;
+                fd_client[fd_num++] = i;
+            }
+        }
+        pthread_mutex_unlock(&broker->mutex);
+        if (poll(fds, fd_num, CMD_BROKER_POLL_MS) <= 0)
+        {
+            continue;
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            uint8_t wake[16];
+            while (read(broker->wake_fd[0], wake, sizeof(wake)) > 0)
+            {
+            }
+        }
+        for (int i = 2; i < fd_num; i++)
+        {
+            if (fds[i].revents == 0)
+            {
+                continue;
+            }
+            int client = fd_client[i];
+            CmdBrokerRequest_t request;
+            memset(&request, 0, sizeof(request));
+            ssize_t len = recv(fds[i].fd, &request, sizeof(request), MSG_DONTWAIT);
+            if (len < 0 && (errno == EAGAIN || errno == EINTR))
+            {
+                continue;
+            }
+            if (len <= 0)
+            {
+                pthread_mutex_lock(&broker->mutex);
+                cmd_broker_close_client(broker, client);
+                pthread_mutex_unlock(&broker->mutex);
+                continue;
+            }
+            //a broker's datagram of another size is answered with the version, anything else as a bad request
+            if (len != (ssize_t)sizeof(request) || request.magic != CMD_BROKER_MAGIC)
+            {
+                request.version = (request.magic == CMD_BROKER_MAGIC && request.version != CMD_BROKER_VERSION) ? \
+                    request.version : CMD_BROKER_VERSION;
+                request.op = CMD_BROKER_OP_NUM;
+            }
+            cmd_broker_request(broker, client, &request);
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            int fd = accept(broker->listen_fd, NULL, NULL);
+            if (fd < 0)
+            {
+                continue;
+            }
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            pthread_mutex_lock(&broker->mutex);
+            int client = 0;
+            while (client < CMD_BROKER_MAX_CLIENTS && broker->clients[client].fd >= 0)
+            {
+                client++;
+            }
+            if (client == CMD_BROKER_MAX_CLIENTS)
+            {
+                close(fd);
+            }
+            else
+            {
+                broker->clients[client].fd = fd;
+                broker->clients[client].inflight = 0;
+                broker->stats.clients++;
+            }
+            pthread_mutex_unlock(&broker->mutex);
+        }
+    }
+    return NULL;
+}
+
+int cmd_broker_start(CmdBroker_t* broker, const CmdBrokerParam_t* param)
+{
+    if (broker == NULL || param == NULL || param->camera_index < 0)
+    {
+        return CMD_BROKER_ERROR_PARAM;
+    }
+    memset(broker, 0, sizeof(CmdBroker_t));
+    broker->param = *param;
+    broker->listen_fd = -1;
+    broker->wake_fd[0] = -1;
+    broker->wake_fd[1] = -1;
+    for (int i = 0; i < CMD_BROKER_MAX_CLIENTS; i++)
+    {
+        broker->clients[i].fd = -1;
+    }
+    pthread_mutex_init(&broker->mutex, NULL);
+    pthread_cond_init(&broker->cond, NULL);
+    if (cmd_broker_path(broker->path, param->path, param->camera_index) != CMD_BROKER_SUCCESS)
+    {
+        return CMD_BROKER_ERROR_PARAM;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", broker->path);
+    broker->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (broker->listen_fd < 0)
+    {
+        return CMD_BROKER_ERROR_SOCKET;
+    }
+    //a socket nobody accepts on is left over from a process that died
+    if (connect(broker->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+    {
+        printf("broker: %s is served by another process\n", broker->path);
+        close(broker->listen_fd);
+        broker->listen_fd = -1;
+        return CMD_BROKER_ERROR_BUSY;
+    }
+    close(broker->listen_fd);
+    unlink(broker->path);
+    broker->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (broker->listen_fd < 0 || bind(broker->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || \
+        listen(broker->listen_fd, 4) < 0 || pipe(broker->wake_fd) < 0)
+    {
+        printf("broker: listen on %s failed\n", broker->path);
+        cmd_broker_stop(broker);
+        return CMD_BROKER_ERROR_SOCKET;
+    }
+    fcntl(broker->listen_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(broker->listen_fd, F_SETFL, fcntl(broker->listen_fd, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(broker->wake_fd[0], F_SETFL, fcntl(broker->wake_fd[0], F_GETFL, 0) | O_NONBLOCK);
+
+    broker->running = 1;
+    if (pthread_create(&broker->thread, NULL, cmd_broker_function, broker) != 0)
+    {
+        broker->running = 0;
+        cmd_broker_stop(broker);
+        return CMD_BROKER_ERROR_SOCKET;
+    }
+    printf("broker: vendor commands of camera %d at %s\n", param->camera_index, broker->path);
+    return CMD_BROKER_SUCCESS;
+}
+
+void cmd_broker_stop(CmdBroker_t* broker)
+{
+    if (broker == NULL)
+    {
+        return;
+    }
+    int running = broker->running;
+    broker->running = 0;
+    if (running)
+    {
+        uint8_t wake = 1;
+        if (write(broker->wake_fd[1], &wake, 1) < 0)
+        {
+        }
+        pthread_join(broker->thread, NULL);
+    }
+    if (broker->listen_fd >= 0)
+    {
+        close(broker->listen_fd);
+        broker->listen_fd = -1;
+        unlink(broker->path);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (broker->wake_fd[i] >= 0)
+        {
+            close(broker->wake_fd[i]);
+            broker->wake_fd[i] = -1;
+        }
+    }
+    //the queued requests point at the jobs, their replies still go out
+    pthread_mutex_lock(&broker->mutex);
+    uint64_t deadline_us = get_monotonic_us() + CMD_BROKER_STOP_WAIT_MS * 1000ull;
+    while (broker->jobs_used > 0 && get_monotonic_us() < deadline_us)
+    {
+        struct timespec wait;
+        timespec_get(&wait, TIME_UTC);
+        wait.tv_nsec += CMD_BROKER_POLL_MS * 1000000L;
+        wait.tv_sec += wait.tv_nsec / 1000000000L;
+        wait.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&broker->cond, &broker->mutex, &wait);
+    }
+    for (int i = 0; i < CMD_BROKER_MAX_CLIENTS; i++)
+    {
+        if (broker->clients[i].fd >= 0)
+        {
+            cmd_broker_close_client(broker, i);
+        }
+    }
+    pthread_mutex_unlock(&broker->mutex);
+    if (running)
+    {
+        printf("broker: %llu requests, %llu replies, %llu rejected, %llu lost\n", \
+            (unsigned long long)broker->stats.requests, (unsigned long long)broker->stats.replies, \
+            (unsigned long long)broker->stats.rejected, (unsigned long long)broker->stats.lost);
+    }
+}
+
+int cmd_broker_connect(CmdBrokerConn_t* conn, const char* path, int camera_index)
+{
+    if (conn == NULL || camera_index < 0)
+    {
+        return CMD_BROKER_ERROR_PARAM;
+    }
+    memset(conn, 0, sizeof(CmdBrokerConn_t));
+    conn->fd = -1;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (cmd_broker_path(addr.sun_path, path, camera_index) != CMD_BROKER_SUCCESS)
+    {
+        return CMD_BROKER_ERROR_PARAM;
+    }
+    conn->fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (conn->fd < 0 || connect(conn->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        cmd_broker_disconnect(conn);
+        return CMD_BROKER_ERROR_SOCKET;
+    }
+    return CMD_BROKER_SUCCESS;
+}
+
+int cmd_broker_call(CmdBrokerConn_t* conn, CmdBrokerOp_t op, int priority, int32_t arg0, int32_t arg1, \
+    int32_t arg2, int timeout_ms, CmdBrokerReply_t* reply)
+{
+    if (conn == NULL || conn->fd < 0 || reply == NULL)
+    {
+        return CMD_BROKER_ERROR_PARAM;
+    }
+    CmdBrokerRequest_t request;
+    memset(&request, 0, sizeof(request));
+    request.magic = CMD_BROKER_MAGIC;
+    request.version = CMD_BROKER_VERSION;
+    request.op = (uint16_t)op;
+    request.seq = ++conn->seq;
+    request.priority = (uint8_t)priority;
+    request.arg[0] = arg0;
+    request.arg[1] = arg1;
+    request.arg[2] = arg2;
+    if (send(conn->fd, &request, sizeof(request), MSG_NOSIGNAL) != (ssize_t)sizeof(request))
+    {
+        return CMD_BROKER_ERROR_SOCKET;
+    }
+    uint64_t deadline_us = get_monotonic_us() + (uint64_t)timeout_ms * 1000;
+    while (1)
+    {
+        uint64_t now_us = get_monotonic_us();
+        if (now_us >= deadline_us)
+        {
+            return CMD_BROKER_ERROR_TIMEOUT;
+        }
+        struct pollfd fd = { conn->fd, POLLIN, 0 };
+        int rst = poll(&fd, 1, (int)((deadline_us - now_us + 999) / 1000));
+        if (rst < 0 && errno != EINTR)
+        {
+            return CMD_BROKER_ERROR_SOCKET;
+        }
+        if (rst <= 0)
+        {
+            continue;
+        }
+        ssize_t len = recv(conn->fd, reply, sizeof(CmdBrokerReply_t), 0);
+        if (len <= 0)
+        {
+            return CMD_BROKER_ERROR_SOCKET;
+        }
+        //replies of calls that timed out before come late, they are skipped
+        if (len == (ssize_t)sizeof(CmdBrokerReply_t) && reply->magic == CMD_BROKER_MAGIC && reply->seq == request.seq)
+        {
+            return CMD_BROKER_SUCCESS;
+        }
+    }
+}
+
+void cmd_broker_disconnect(CmdBrokerConn_t* conn)
+{
+    if (conn != NULL && conn->fd >= 0)
+    {
+        close(conn->fd);
+        conn->fd = -1;
+    }
+}
+#else
+int cmd_broker_start(CmdBroker_t* broker, const CmdBrokerParam_t* param)
+{
+    //the broker is written against unix sockets and poll
+    return CMD_BROKER_ERROR_UNAVAILABLE;
+}
+
+void cmd_broker_stop(CmdBroker_t* broker)
+{
+}
+
+int cmd_broker_connect(CmdBrokerConn_t* conn, const char* path, int camera_index)
+{
+    return CMD_BROKER_ERROR_UNAVAILABLE;
+}
+
+int cmd_broker_call(CmdBrokerConn_t* conn, CmdBrokerOp_t op, int priority, int32_t arg0, int32_t arg1, \
+    int32_t arg2, int timeout_ms, CmdBrokerReply_t* reply)
+{
+    return CMD_BROKER_ERROR_UNAVAILABLE;
+}
+
+void cmd_broker_disconnect(CmdBrokerConn_t* conn)
+{
+}
+#endif
+
+void cmd_broker_stats(CmdBroker_t* broker, CmdBrokerStats_t* stats)
+{
+    pthread_mutex_lock(&broker->mutex);
+    *stats = broker->stats;
+    pthread_mutex_unlock(&broker->mutex);
+}
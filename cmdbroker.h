@@ -0,0 +1,155 @@
+#ifndef _CMDBROKER_H_
+#define _CMDBROKER_H_
+
+//the vendor command access of one module for other processes. libiruvc and vdcmd keep their state in globals
+//with no device handle, so the process that streams a module is the only one that may command it, one process
+//per module (sample -i). the broker is that process' front door: a unix seqpacket socket per module that takes
+//requests from the cli (tools/ircmd.cpp), scripts and other services and puts them on the module's command queue
+//(cmdq.h) next to the pipeline's own commands and the network control's, so every command of the module runs
+//one at a time between frames in priority order and nothing of another module waits for it. gain switches go
+//critical: past the aging, the per frame limit and the gap after long commands, so their latency is bounded by
+//the command running when they were queued plus one frame interval. linux only
+#include <stdint.h>
+#include <pthread.h>
+#include "cmdq.h"
+
+#define CMD_BROKER_MAGIC 0x4b524249     //"IBRK"
+#define CMD_BROKER_VERSION 1            //of the messages below, the broker answers another with CMD_BROKER_ERROR_VERSION
+#define CMD_BROKER_DEFAULT_PATH "/tmp/ircam-cmd"        //module i listens at <path>.<i>
+#define CMD_BROKER_PATH_LEN 108         //sun_path
+#define CMD_BROKER_MAX_CLIENTS 16
+#define CMD_BROKER_MAX_INFLIGHT 8       //queued requests of one client, more are answered CMD_BROKER_ERROR_BUSY
+#define CMD_BROKER_MAX_JOBS (CMDQ_MAX_JOBS / 2)         //the rest of the queue stays for the pipeline
+#define CMD_BROKER_POLL_MS 200
+#define CMD_BROKER_STOP_WAIT_MS 2000    //cmd_broker_stop waits this long for the queued requests
+
+#define CMD_BROKER_SUCCESS 0            //the errors are apart from the vendor's and cmdq's, a reply's result may be either
+#define CMD_BROKER_ERROR_PARAM -1001
+#define CMD_BROKER_ERROR_SOCKET -1002
+#define CMD_BROKER_ERROR_BUSY -1003     //the client's inflight limit or the broker's jobs are used up
+#define CMD_BROKER_ERROR_VERSION -1004
+#define CMD_BROKER_ERROR_QUEUE -1005    //cmdq_submit failed, the reply's value has its CMDQ_xxx
+#define CMD_BROKER_ERROR_TIMEOUT -1006
+#define CMD_BROKER_ERROR_UNAVAILABLE -1007 //unix sockets, linux only
+
+#define CMD_BROKER_PRIORITY_DEFAULT 0xFF   //the op's own class
+
+typedef enum
+{
+    CMD_BROKER_OP_COMMAND = 1,          //command_sel(arg[0]), in command_priority's class
+    CMD_BROKER_OP_PROP_GET,             //page arg[0] (CmdBrokerPage_t), property arg[1], the reply's value
+    CMD_BROKER_OP_PROP_SET,             //page arg[0], property arg[1], value arg[2]
+    CMD_BROKER_OP_GAIN,                 //TPD_PROP_GAIN_SEL = arg[0] (GAIN_CTRL_HIGH/LOW), critical
+    CMD_BROKER_OP_STATS,                //answered by the broker thread, the reply's pending and stats
+    CMD_BROKER_OP_NUM
+}CmdBrokerOp_t;
+
+typedef enum
+{
+    CMD_BROKER_PAGE_TPD = 0,            //prop_tpd_get/set
+    CMD_BROKER_PAGE_IMAGE,
+    CMD_BROKER_PAGE_SHUTTER,
+    CMD_BROKER_PAGE_NUM
+}CmdBrokerPage_t;
+
+//one datagram each way
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t op;                        //CmdBrokerOp_t
+    uint32_t seq;                       //the client's, echoed in the reply
+    uint8_t priority;                   //CmdqPriority_t, CMD_BROKER_PRIORITY_DEFAULT for the op's own
+    uint8_t reserved[3];
+    int32_t arg[3];
+}CmdBrokerRequest_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t op;
+    uint32_t seq;
+    int32_t result;                     //CMD_BROKER_xxx, or the vendor call's iruvc_error_t
+    int32_t value;                      //PROP_GET's value
+    uint32_t wait_us;                   //queued until it started
+    uint32_t exec_us;
+    uint32_t pending[CMDQ_PRIORITY_NUM];    //STATS
+    CmdqStats_t stats;
+}CmdBrokerReply_t;
+
+typedef struct {
+    uint64_t requests;
+    uint64_t replies;
+    uint64_t rejected;                  //bad requests, busy, version
+    uint64_t lost;                      //replies whose client had gone
+    uint32_t clients;
+}CmdBrokerStats_t;
+
+struct TempCalibCtx_t;
+
+typedef struct {
+    char path[CMD_BROKER_PATH_LEN];     //"" for CMD_BROKER_DEFAULT_PATH
+    int camera_index;                   //the <i> of the socket
+    struct TempCalibCtx_t* calib;       //a gain op selects the gain's tables in it, NULL the default
+}CmdBrokerParam_t;
+
+struct CmdBroker_t;
+
+//a request on the command queue, from the broker's pool
+typedef struct {
+    struct CmdBroker_t* broker;
+    int client;                         //slot and generation of the client it answers
+    uint32_t client_gen;
+    uint64_t submit_us;
+    uint64_t start_us;
+    CmdBrokerRequest_t request;
+    int32_t value;
+    uint8_t used;
+}CmdBrokerJob_t;
+
+typedef struct {
+    int fd;                             //-1 for a free slot
+    uint32_t gen;
+    int inflight;
+}CmdBrokerClient_t;
+
+typedef struct CmdBroker_t {
+    CmdBrokerParam_t param;
+    char path[CMD_BROKER_PATH_LEN];
+    uint8_t running;
+    int listen_fd;
+    int wake_fd[2];                     //cmd_broker_stop wakes the thread
+    CmdBrokerClient_t clients[CMD_BROKER_MAX_CLIENTS];
+    CmdBrokerJob_t jobs[CMD_BROKER_MAX_JOBS];
+    int jobs_used;
+    CmdBrokerStats_t stats;
+    pthread_t thread;
+    pthread_mutex_t mutex;              //clients, jobs and stats, the cmdq worker answers
+    pthread_cond_t cond;
+}CmdBroker_t;
+
+//listen at <path>.<camera_index>, a stale socket of a process that died is replaced, a live one is not. a path
+//that does not fit CMD_BROKER_PATH_LEN with the index is CMD_BROKER_ERROR_PARAM, on either side
+int cmd_broker_start(CmdBroker_t* broker, const CmdBrokerParam_t* param);
+
+//close the socket and the clients, wait for the requests still queued
+void cmd_broker_stop(CmdBroker_t* broker);
+
+void cmd_broker_stats(CmdBroker_t* broker, CmdBrokerStats_t* stats);
+
+//client side, any process
+typedef struct {
+    int fd;
+    uint32_t seq;
+}CmdBrokerConn_t;
+
+//path NULL for CMD_BROKER_DEFAULT_PATH
+int cmd_broker_connect(CmdBrokerConn_t* conn, const char* path, int camera_index);
+
+//send one request and wait up to timeout_ms for its reply. the return value is the transport's, reply->result
+//the request's
+int cmd_broker_call(CmdBrokerConn_t* conn, CmdBrokerOp_t op, int priority, int32_t arg0, int32_t arg1, \
+    int32_t arg2, int timeout_ms, CmdBrokerReply_t* reply);
+
+void cmd_broker_disconnect(CmdBrokerConn_t* conn);
+
+#endif
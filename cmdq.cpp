@@ -0,0 +1,421 @@
+#include "cmdq.h"
+#include "data.h"
+#include "timing.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define CMDQ_JOB_FREE 0
+#define CMDQ_JOB_QUEUED 1
+#define CMDQ_JOB_RUNNING 2
+#define CMDQ_JOB_DONE 3
+
+#define CMDQ_INDEX_MASK 0xff            //job_id = (generation << 8) | slot index
+
+typedef struct {
+    int state;
+    int id;
+    int next;                           //next queued job of the same priority, -1 ends the list
+    int detached;                       //no future, the worker frees the slot
+    int result;
+    CmdqFunc_t func;
+    void* arg;
+    CmdqDone_t done;
+    void* user_data;
+    CmdqPriority_t priority;
+    uint32_t cost_us;
+    uint64_t submit_us;
+}CmdqJob_t;
+
+static CmdqJob_t cmdq_jobs[CMDQ_MAX_JOBS];
+static int cmdq_head[CMDQ_PRIORITY_NUM] = { -1, -1, -1, -1 };
+static int cmdq_tail[CMDQ_PRIORITY_NUM] = { -1, -1, -1, -1 };
+static uint32_t cmdq_pending_cnt[CMDQ_PRIORITY_NUM] = { 0 };
+static uint64_t cmdq_cost_avg_us[CMDQ_PRIORITY_NUM] = { 0 };
+static uint32_t cmdq_generation = 0;
+static CmdqStats_t cmdq_stats_all;
+
+static pthread_mutex_t cmdq_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cmdq_cond = PTHREAD_COND_INITIALIZER;        //worker: new job or new frame
+static pthread_cond_t cmdq_done_cond = PTHREAD_COND_INITIALIZER;   //cmdq_wait callers
+static pthread_t cmdq_thread;
+static int cmdq_running = 0;
+
+//frame timing seen by the stream thread
+static uint64_t cmdq_last_frame_us = 0;
+static uint64_t cmdq_frame_period_us = 0;
+static uint64_t cmdq_frame_cnt = 0;
+static uint32_t cmdq_frame_started = 0;    //jobs started since the last frame
+static uint64_t cmdq_long_ready_frame = 0;
+
+//absolute CLOCK_REALTIME deadline for pthread_cond_timedwait
+static void cmdq_deadline(struct timespec* ts, uint64_t timeout_us)
+{
+#if defined(_WIN32)
+    timespec_get(ts, TIME_UTC);
+#elif defined(linux) || defined(unix)
+    clock_gettime(CLOCK_REALTIME, ts);
+#endif
+    ts->tv_sec += (time_t)(timeout_us / 1000000);
+    ts->tv_nsec += (long)(timeout_us % 1000000) * 1000L;
+    if (ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+//oldest job of the best priority, a job moves up one priority for every CMDQ_AGING_US it has waited. aging
+//never passes a critical job
+static int cmdq_pick(uint64_t now_us)
+{
+    if (cmdq_head[CMDQ_PRIORITY_CRITICAL] >= 0)
+    {
+        return cmdq_head[CMDQ_PRIORITY_CRITICAL];
+    }
+    int best = -1;
+    int64_t best_level = 0;
+    for (int priority = CMDQ_PRIORITY_READ; priority < CMDQ_PRIORITY_NUM; priority++)
+    {
+        int index = cmdq_head[priority];
+        if (index < 0)
+        {
+            continue;
+        }
+        int64_t level = priority - (int64_t)((now_us - cmdq_jobs[index].submit_us) / CMDQ_AGING_US);
+        if (best < 0 || level < best_level)
+        {
+            best = index;
+            best_level = level;
+        }
+    }
+    return best;
+}
+
+//how long the job has to wait before it may start, 0 starts it now
+static uint64_t cmdq_delay_us(const CmdqJob_t* job, uint64_t now_us)
+{
+    uint64_t period = cmdq_frame_period_us;
+    //not streaming, or the stream stalled: nothing to protect
+    if (period == 0 || now_us - cmdq_last_frame_us > 4 * period)
+    {
+        return 0;
+    }
+    uint64_t elapsed = now_us - cmdq_last_frame_us;
+    //wait for the next frame, cmdq_frame_mark wakes the worker earlier when it arrives
+    uint64_t next_frame = ((elapsed < period) ? period - elapsed : 0) + period / 4;
+    if (cmdq_frame_started >= CMDQ_MAX_PER_FRAME && job->priority != CMDQ_PRIORITY_CRITICAL)
+    {
+        return next_frame;
+    }
+    uint64_t cost = (job->cost_us > 0) ? job->cost_us : cmdq_cost_avg_us[job->priority];
+    if (job->priority == CMDQ_PRIORITY_LONG && cmdq_frame_cnt < cmdq_long_ready_frame)
+    {
+        return next_frame;
+    }
+    if (elapsed + cost + CMDQ_GUARD_US <= period)
+    {
+        return 0;
+    }
+    //longer than one interval: start right after a frame so only the frames it covers are late
+    if ((cost + CMDQ_GUARD_US > period || job->priority == CMDQ_PRIORITY_LONG) && elapsed <= period / 4)
+    {
+        return 0;
+    }
+    return next_frame;
+}
+
+static void cmdq_unlink(int index)
+{
+    CmdqPriority_t priority = cmdq_jobs[index].priority;
+    //cmdq_pick only returns list heads
+    cmdq_head[priority] = cmdq_jobs[index].next;
+    if (cmdq_head[priority] < 0)
+    {
+        cmdq_tail[priority] = -1;
+    }
+    cmdq_jobs[index].next = -1;
+    cmdq_pending_cnt[priority]--;
+}
+
+//called with the mutex held, the done callback runs without it
+static void cmdq_complete(int index, int result)
+{
+    CmdqJob_t* job = &cmdq_jobs[index];
+    job->result = result;
+    if (job->done != NULL)
+    {
+        CmdqDone_t done = job->done;
+        int id = job->id;
+        void* user_data = job->user_data;
+        pthread_mutex_unlock(&cmdq_mutex);
+        done(id, result, user_data);
+        pthread_mutex_lock(&cmdq_mutex);
+    }
+    if (job->detached)
+    {
+        job->state = CMDQ_JOB_FREE;
+    }
+    else
+    {
+        job->state = CMDQ_JOB_DONE;
+        pthread_cond_broadcast(&cmdq_done_cond);
+    }
+}
+
+static void* cmdq_worker(void* threadarg)
+{
+    TRACE_THREAD_NAME("cmdq");
+    pthread_mutex_lock(&cmdq_mutex);
+    while (cmdq_running)
+    {
+        uint64_t now_us = get_monotonic_us();
+        int index = cmdq_pick(now_us);
+        if (index < 0)
+        {
+            pthread_cond_wait(&cmdq_cond, &cmdq_mutex);
+            continue;
+        }
+        uint64_t delay_us = cmdq_delay_us(&cmdq_jobs[index], now_us);
+        if (delay_us > 0)
+        {
+            //pick again afterwards, a read may have been queued in the meantime
+            struct timespec deadline;
+            cmdq_deadline(&deadline, delay_us);
+            pthread_cond_timedwait(&cmdq_cond, &cmdq_mutex, &deadline);
+            continue;
+        }
+
+        CmdqJob_t* job = &cmdq_jobs[index];
+        cmdq_unlink(index);
+        job->state = CMDQ_JOB_RUNNING;
+        cmdq_frame_started++;
+        pthread_mutex_unlock(&cmdq_mutex);
+
+        uint64_t wait_us = now_us - job->submit_us;
+        timing_record(TIMING_STAGE_CMD_WAIT, wait_us);
+        TRACE_BEGIN_VALUE("cmdq_job", job->priority);
+        int result = job->func(job->arg);
+        TRACE_END("cmdq_job");
+        uint64_t exec_us = get_monotonic_us() - now_us;
+        timing_record(TIMING_STAGE_CMD_EXEC, exec_us);
+
+        pthread_mutex_lock(&cmdq_mutex);
+        uint64_t* avg = &cmdq_cost_avg_us[job->priority];
+        *avg = (*avg == 0) ? exec_us : (*avg * 7 + exec_us) / 8;
+        cmdq_stats_all.jobs[job->priority]++;
+        if (wait_us > cmdq_stats_all.wait_max_us[job->priority])
+        {
+            cmdq_stats_all.wait_max_us[job->priority] = wait_us;
+        }
+        if (exec_us > cmdq_stats_all.exec_max_us[job->priority])
+        {
+            cmdq_stats_all.exec_max_us[job->priority] = exec_us;
+        }
+        if (job->priority == CMDQ_PRIORITY_LONG)
+        {
+            cmdq_long_ready_frame = cmdq_frame_cnt + CMDQ_LONG_GAP_FRAMES;
+        }
+        cmdq_complete(index, result);
+    }
+    pthread_mutex_unlock(&cmdq_mutex);
+    return NULL;
+}
+
+int cmdq_init(void)
+{
+    pthread_mutex_lock(&cmdq_mutex);
+    if (cmdq_running)
+    {
+        pthread_mutex_unlock(&cmdq_mutex);
+        return CMDQ_SUCCESS;
+    }
+    memset(cmdq_jobs, 0, sizeof(cmdq_jobs));
+    memset(&cmdq_stats_all, 0, sizeof(cmdq_stats_all));
+    for (int priority = 0; priority < CMDQ_PRIORITY_NUM; priority++)
+    {
+        cmdq_head[priority] = -1;
+        cmdq_tail[priority] = -1;
+        cmdq_pending_cnt[priority] = 0;
+    }
+    cmdq_last_frame_us = 0;
+    cmdq_frame_period_us = 0;
+    cmdq_frame_started = 0;
+    cmdq_running = 1;
+    if (pthread_create(&cmdq_thread, NULL, cmdq_worker, NULL) != 0)
+    {
+        cmdq_running = 0;
+        pthread_mutex_unlock(&cmdq_mutex);
+        return CMDQ_ERROR_PARAM;
+    }
+    pthread_mutex_unlock(&cmdq_mutex);
+    return CMDQ_SUCCESS;
+}
+
+void cmdq_release(void)
+{
+    pthread_mutex_lock(&cmdq_mutex);
+    if (!cmdq_running)
+    {
+        pthread_mutex_unlock(&cmdq_mutex);
+        return;
+    }
+    cmdq_running = 0;
+    pthread_cond_broadcast(&cmdq_cond);
+    pthread_mutex_unlock(&cmdq_mutex);
+    pthread_join(cmdq_thread, NULL);
+
+    pthread_mutex_lock(&cmdq_mutex);
+    for (int priority = 0; priority < CMDQ_PRIORITY_NUM; priority++)
+    {
+        while (cmdq_head[priority] >= 0)
+        {
+            int index = cmdq_head[priority];
+            cmdq_unlink(index);
+            cmdq_complete(index, CMDQ_CLOSED);
+        }
+    }
+    pthread_mutex_unlock(&cmdq_mutex);
+}
+
+int cmdq_submit(CmdqFunc_t func, void* arg, CmdqPriority_t priority, uint32_t cost_us, \
+    CmdqDone_t done, void* user_data, int* job_id)
+{
+    if (func == NULL || priority < 0 || priority >= CMDQ_PRIORITY_NUM)
+    {
+        return CMDQ_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&cmdq_mutex);
+    if (!cmdq_running)
+    {
+        pthread_mutex_unlock(&cmdq_mutex);
+        return CMDQ_CLOSED;
+    }
+    int index = 0;
+    while (index < CMDQ_MAX_JOBS && cmdq_jobs[index].state != CMDQ_JOB_FREE)
+    {
+        index++;
+    }
+    if (index == CMDQ_MAX_JOBS)
+    {
+        pthread_mutex_unlock(&cmdq_mutex);
+        return CMDQ_ERROR_FULL;
+    }
+
+    CmdqJob_t* job = &cmdq_jobs[index];
+    cmdq_generation = (cmdq_generation + 1) & 0x7fffff;
+    job->state = CMDQ_JOB_QUEUED;
+    job->id = (int)((cmdq_generation << 8) | index);
+    job->next = -1;
+    job->detached = (job_id == NULL);
+    job->result = 0;
+    job->func = func;
+    job->arg = arg;
+    job->done = done;
+    job->user_data = user_data;
+    job->priority = priority;
+    job->cost_us = cost_us;
+    job->submit_us = get_monotonic_us();
+    if (cmdq_tail[priority] >= 0)
+    {
+        cmdq_jobs[cmdq_tail[priority]].next = index;
+    }
+    else
+    {
+        cmdq_head[priority] = index;
+    }
+    cmdq_tail[priority] = index;
+    cmdq_pending_cnt[priority]++;
+    if (job_id != NULL)
+    {
+        *job_id = job->id;
+    }
+    pthread_cond_signal(&cmdq_cond);
+    pthread_mutex_unlock(&cmdq_mutex);
+    return CMDQ_SUCCESS;
+}
+
+int cmdq_wait(int job_id, uint32_t timeout_ms, int* result)
+{
+    int index = job_id & CMDQ_INDEX_MASK;
+    if (job_id < 0 || index >= CMDQ_MAX_JOBS)
+    {
+        return CMDQ_ERROR_PARAM;
+    }
+    CmdqJob_t* job = &cmdq_jobs[index];
+    struct timespec deadline;
+    cmdq_deadline(&deadline, (uint64_t)timeout_ms * 1000);
+
+    pthread_mutex_lock(&cmdq_mutex);
+    if (job->state == CMDQ_JOB_FREE || job->id != job_id || job->detached)
+    {
+        pthread_mutex_unlock(&cmdq_mutex);
+        return CMDQ_ERROR_PARAM;
+    }
+    while (job->state != CMDQ_JOB_DONE)
+    {
+        if (pthread_cond_timedwait(&cmdq_done_cond, &cmdq_mutex, &deadline) != 0 && job->state != CMDQ_JOB_DONE)
+        {
+            pthread_mutex_unlock(&cmdq_mutex);
+            return CMDQ_TIMEOUT;
+        }
+    }
+    if (result != NULL)
+    {
+        *result = job->result;
+    }
+    job->state = CMDQ_JOB_FREE;
+    pthread_mutex_unlock(&cmdq_mutex);
+    return CMDQ_SUCCESS;
+}
+
+int cmdq_call(CmdqFunc_t func, void* arg, CmdqPriority_t priority, uint32_t cost_us, int* result)
+{
+    int job_id = 0;
+    int rst = cmdq_submit(func, arg, priority, cost_us, NULL, NULL, &job_id);
+    if (rst != CMDQ_SUCCESS)
+    {
+        return rst;
+    }
+    //a command may block the device for many seconds (dpc calibration), wait as long as it takes
+    while ((rst = cmdq_wait(job_id, 1000, result)) == CMDQ_TIMEOUT)
+    {
+    }
+    return rst;
+}
+
+void cmdq_frame_mark(uint64_t timestamp_us)
+{
+    pthread_mutex_lock(&cmdq_mutex);
+    if (cmdq_last_frame_us > 0 && timestamp_us > cmdq_last_frame_us)
+    {
+        uint64_t interval = timestamp_us - cmdq_last_frame_us;
+        //gaps of a second and more are stream restarts, not the frame rate
+        if (interval < 1000000)
+        {
+            cmdq_frame_period_us = (cmdq_frame_period_us == 0) ? interval : \
+                (cmdq_frame_period_us * 7 + interval) / 8;
+        }
+    }
+    cmdq_last_frame_us = timestamp_us;
+    cmdq_frame_cnt++;
+    cmdq_frame_started = 0;
+    pthread_cond_signal(&cmdq_cond);
+    pthread_mutex_unlock(&cmdq_mutex);
+}
+
+void cmdq_pending(uint32_t pending[CMDQ_PRIORITY_NUM])
+{
+    pthread_mutex_lock(&cmdq_mutex);
+    memcpy(pending, cmdq_pending_cnt, sizeof(cmdq_pending_cnt));
+    pthread_mutex_unlock(&cmdq_mutex);
+}
+
+void cmdq_stats(CmdqStats_t* stats)
+{
+    pthread_mutex_lock(&cmdq_mutex);
+    *stats = cmdq_stats_all;
+    pthread_mutex_unlock(&cmdq_mutex);
+}
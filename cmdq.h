@@ -0,0 +1,65 @@
+#ifndef _CMDQ_H_
+#define _CMDQ_H_
+
+#include <stdint.h>
+
+#define CMDQ_MAX_JOBS 64
+#define CMDQ_MAX_PER_FRAME 2            //commands started per frame interval while streaming
+#define CMDQ_GUARD_US 2000              //a command has to end this long before the next frame is due
+#define CMDQ_LONG_GAP_FRAMES 10         //frames the stream gets to recover after a long command
+#define CMDQ_AGING_US 500000            //queued this long, a job moves up one priority
+
+#define CMDQ_SUCCESS 0
+#define CMDQ_ERROR_PARAM -1
+#define CMDQ_ERROR_FULL -2
+#define CMDQ_TIMEOUT -3
+#define CMDQ_CLOSED -4
+
+typedef enum
+{
+    CMDQ_PRIORITY_CRITICAL = 0,         //gain switches: never aged past, not held by the per frame limit or the long gap
+    CMDQ_PRIORITY_READ,             //short reads: device info, point/rect temperature, vtemp, small spi reads
+    CMDQ_PRIORITY_NORMAL,               //property sets, shutter, zoom
+    CMDQ_PRIORITY_LONG,                 //calibration, table writes, restore default: hold the device for many frames
+    CMDQ_PRIORITY_NUM,
+}CmdqPriority_t;
+
+//runs on the worker thread, its return value is the job's result
+typedef int (*CmdqFunc_t)(void* arg);
+
+typedef struct {
+    uint64_t jobs[CMDQ_PRIORITY_NUM];           //run per priority
+    uint64_t wait_max_us[CMDQ_PRIORITY_NUM];    //submit to start, the latency a priority had at worst
+    uint64_t exec_max_us[CMDQ_PRIORITY_NUM];
+}CmdqStats_t;
+
+//called on the worker thread once the job has run (result is CMDQ_CLOSED if it never ran)
+typedef void (*CmdqDone_t)(int job_id, int result, void* user_data);
+
+//start the worker, every vendor command submitted afterwards is serialized on it
+int cmdq_init(void);
+
+//stop the worker. queued jobs complete with CMDQ_CLOSED, the running one is waited for
+void cmdq_release(void);
+
+//queue func(arg). cost_us is the expected run time, 0 uses the average of the priority's past jobs
+//job_id != NULL returns a future that must be passed to cmdq_wait, NULL lets the job free itself when done
+int cmdq_submit(CmdqFunc_t func, void* arg, CmdqPriority_t priority, uint32_t cost_us, \
+    CmdqDone_t done, void* user_data, int* job_id);
+
+//wait for a job submitted with a job_id, then release it. returns CMDQ_TIMEOUT and keeps the job if it is not done
+int cmdq_wait(int job_id, uint32_t timeout_ms, int* result);
+
+//submit and wait, for callers that need the answer
+int cmdq_call(CmdqFunc_t func, void* arg, CmdqPriority_t priority, uint32_t cost_us, int* result);
+
+//called by the stream thread after every uvc_frame_get, the worker schedules commands between frames
+void cmdq_frame_mark(uint64_t timestamp_us);
+
+//jobs queued per priority
+void cmdq_pending(uint32_t pending[CMDQ_PRIORITY_NUM]);
+
+//since cmdq_init. a critical job waits at most for the job running when it was queued and one frame interval
+void cmdq_stats(CmdqStats_t* stats);
+
+#endif
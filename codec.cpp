@@ -0,0 +1,190 @@
+#include "codec.h"
+#include <stdlib.h>
+#include <string.h>
+#include "simd.h"
+
+static inline uint16_t codec_zigzag(uint16_t cur, uint16_t ref)
+{
+    int16_t d = (int16_t)(cur - ref);
+    return (uint16_t)((d << 1) ^ (d >> 15));
+}
+
+static inline uint16_t codec_unzigzag(uint16_t z, uint16_t ref)
+{
+    return (uint16_t)(ref + ((z >> 1) ^ (uint16_t)(0 - (z & 1))));
+}
+
+int codec_init(CodecContext_t* ctx, uint32_t width, uint32_t height, uint32_t key_interval)
+{
+    if (ctx == NULL || width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF)
+    {
+        return CODEC_ERROR_PARAM;
+    }
+    memset(ctx, 0, sizeof(CodecContext_t));
+    ctx->width = width;
+    ctx->height = height;
+    ctx->pix_num = width * height;
+    ctx->block_num = (ctx->pix_num + CODEC_BLOCK - 1) / CODEC_BLOCK;
+    ctx->key_interval = key_interval;
+    ctx->ref = (uint16_t*)malloc(ctx->pix_num * sizeof(uint16_t));
+    ctx->residual = (uint16_t*)calloc(ctx->block_num * CODEC_BLOCK, sizeof(uint16_t));
+    if (ctx->ref == NULL || ctx->residual == NULL)
+    {
+        codec_release(ctx);
+        return CODEC_ERROR_MEM;
+    }
+    return CODEC_SUCCESS;
+}
+
+void codec_release(CodecContext_t* ctx)
+{
+    if (ctx == NULL)
+    {
+        return;
+    }
+    free(ctx->ref);
+    ctx->ref = NULL;
+    free(ctx->residual);
+    ctx->residual = NULL;
+    ctx->has_ref = 0;
+}
+
+void codec_reset(CodecContext_t* ctx)
+{
+    if (ctx != NULL)
+    {
+        ctx->has_ref = 0;
+        ctx->frame_cnt = 0;
+    }
+}
+
+uint32_t codec_bound(uint32_t pix_num)
+{
+    uint32_t block_num = (pix_num + CODEC_BLOCK - 1) / CODEC_BLOCK;
+    return sizeof(CodecFrameHeader_t) + block_num * (1 + CODEC_MAX_PLANE_BITS * CODEC_BLOCK / 8);
+}
+
+int codec_encode(CodecContext_t* ctx, const uint16_t* frame, uint8_t* dst, uint32_t dst_size, int key)
+{
+    if (ctx == NULL || ctx->ref == NULL || frame == NULL || dst == NULL)
+    {
+        return CODEC_ERROR_PARAM;
+    }
+    if (dst_size < codec_bound(ctx->pix_num))
+    {
+        return CODEC_ERROR_SIZE;
+    }
+    key = key || !ctx->has_ref || (ctx->key_interval > 0 && ctx->frame_cnt >= ctx->key_interval);
+    uint16_t* residual = ctx->residual;
+    if (key)
+    {
+        //the first row from its left neighbour, every other row from the one above
+        residual[0] = codec_zigzag(frame[0], 0);
+        simd_delta_zigzag_u16(frame + 1, frame, ctx->width - 1, residual + 1);
+        simd_delta_zigzag_u16(frame + ctx->width, frame, ctx->pix_num - ctx->width, residual + ctx->width);
+    }
+    else if (ctx->deadband > 0)
+    {
+        simd_delta_zigzag_deadband_u16(frame, ctx->ref, ctx->pix_num, ctx->deadband, residual);
+    }
+    else
+    {
+        simd_delta_zigzag_u16(frame, ctx->ref, ctx->pix_num, residual);
+    }
+
+    CodecFrameHeader_t* header = (CodecFrameHeader_t*)dst;
+    uint8_t* widths = dst + sizeof(CodecFrameHeader_t);
+    int plane_bytes = simd_bitplane_pack(residual, ctx->block_num, widths, widths + ctx->block_num);
+    header->magic = CODEC_MAGIC;
+    header->type = key ? CODEC_FRAME_KEY : CODEC_FRAME_DELTA;
+    header->reserved = 0;
+    header->width = (uint16_t)ctx->width;
+    header->height = (uint16_t)ctx->height;
+    header->size = sizeof(CodecFrameHeader_t) + ctx->block_num + plane_bytes;
+    header->frame_cnt = key ? 0 : ctx->frame_cnt;
+
+    if (key || ctx->deadband == 0)
+    {
+        memcpy(ctx->ref, frame, ctx->pix_num * sizeof(uint16_t));
+    }
+    ctx->has_ref = 1;
+    ctx->frame_cnt = key ? 1 : ctx->frame_cnt + 1;
+    return (int)header->size;
+}
+
+int codec_frame_type(const uint8_t* src, uint32_t size)
+{
+    if (src == NULL || size < sizeof(CodecFrameHeader_t))
+    {
+        return CODEC_ERROR_FORMAT;
+    }
+    const CodecFrameHeader_t* header = (const CodecFrameHeader_t*)src;
+    if (header->magic != CODEC_MAGIC || header->type > CODEC_FRAME_DELTA || header->size > size)
+    {
+        return CODEC_ERROR_FORMAT;
+    }
+    return header->type;
+}
+
+int codec_decode(CodecContext_t* ctx, const uint8_t* src, uint32_t size, uint16_t* frame)
+{
+    if (ctx == NULL || ctx->ref == NULL || src == NULL)
+    {
+        return CODEC_ERROR_PARAM;
+    }
+    int type = codec_frame_type(src, size);
+    const CodecFrameHeader_t* header = (const CodecFrameHeader_t*)src;
+    if (type < 0 || header->width != ctx->width || header->height != ctx->height || \
+        header->size < sizeof(CodecFrameHeader_t) + ctx->block_num)
+    {
+        return CODEC_ERROR_FORMAT;
+    }
+    //the widths give the planes' size, check it before touching them
+    const uint8_t* widths = src + sizeof(CodecFrameHeader_t);
+    uint32_t plane_bytes = 0;
+    for (uint32_t b = 0; b < ctx->block_num; b++)
+    {
+        if (widths[b] > CODEC_MAX_PLANE_BITS)
+        {
+            return CODEC_ERROR_FORMAT;
+        }
+        plane_bytes += widths[b] * (CODEC_BLOCK / 8);
+    }
+    if (header->size != sizeof(CodecFrameHeader_t) + ctx->block_num + plane_bytes)
+    {
+        return CODEC_ERROR_FORMAT;
+    }
+    if (type == CODEC_FRAME_DELTA && (!ctx->has_ref || header->frame_cnt != ctx->frame_cnt))
+    {
+        return CODEC_ERROR_NO_KEY;
+    }
+
+    uint16_t* residual = ctx->residual;
+    simd_bitplane_unpack(widths, widths + ctx->block_num, ctx->block_num, residual);
+    uint16_t* out = (frame != NULL) ? frame : ctx->ref;
+    if (type == CODEC_FRAME_KEY)
+    {
+        //the rows depend on each other, each one is a vector pass over the row above
+        out[0] = codec_unzigzag(residual[0], 0);
+        for (uint32_t x = 1; x < ctx->width; x++)
+        {
+            out[x] = codec_unzigzag(residual[x], out[x - 1]);
+        }
+        for (uint32_t y = 1; y < ctx->height; y++)
+        {
+            simd_undelta_zigzag_u16(residual + y * ctx->width, out + (y - 1) * ctx->width, ctx->width, \
+                out + y * ctx->width);
+        }
+    }
+    else
+    {
+        simd_undelta_zigzag_u16(residual, ctx->ref, ctx->pix_num, out);
+    }
+    if (frame != NULL)
+    {
+        memcpy(ctx->ref, frame, ctx->pix_num * sizeof(uint16_t));
+    }
+    ctx->has_ref = 1;
+    ctx->frame_cnt = (type == CODEC_FRAME_KEY) ? 1 : ctx->frame_cnt + 1;
+    return CODEC_SUCCESS;
+}
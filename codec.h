@@ -0,0 +1,70 @@
+#ifndef _CODEC_H_
+#define _CODEC_H_
+
+#include <stdint.h>
+
+#define CODEC_MAGIC 0x4346              //"FC"
+#define CODEC_BLOCK 32                  //values sharing one bit width, SIMD_BITPLANE_BLOCK
+#define CODEC_MAX_PLANE_BITS 16
+
+#define CODEC_SUCCESS 0
+#define CODEC_ERROR_PARAM -1
+#define CODEC_ERROR_MEM -2
+#define CODEC_ERROR_SIZE -3             //the destination is smaller than codec_bound
+#define CODEC_ERROR_FORMAT -4
+#define CODEC_ERROR_NO_KEY -5           //a delta frame whose reference was not decoded
+
+typedef enum
+{
+    CODEC_FRAME_KEY = 0,                //predicted from the row above (the first row from the left), decodes alone
+    CODEC_FRAME_DELTA,                  //predicted from the previous frame
+}CodecFrameType_t;
+
+//coded frame, little endian: this header, one width byte per block, then the blocks' bit planes
+//residuals are zigzag coded 16 bit differences, so every 16 bit frame round trips exactly
+typedef struct {
+    uint16_t magic;
+    uint8_t type;                       //CodecFrameType_t
+    uint8_t reserved;
+    uint16_t width;
+    uint16_t height;
+    uint32_t size;                      //the whole coded frame
+    uint32_t frame_cnt;                 //frames since the keyframe, 0 for the keyframe
+}CodecFrameHeader_t;
+
+//one plane of one stream, the same context type encodes or decodes
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t pix_num;
+    uint32_t block_num;
+    uint32_t key_interval;              //encoder: frames between keyframes, 0 only when asked for or after codec_reset
+    uint32_t frame_cnt;                 //frames since the keyframe, the next delta frame's count
+    uint16_t deadband;                  //encoder: a delta frame leaves pixels that moved at most this far, the reference
+                                        //keeps what the decoder has so the error stays within it. 0 lossless, < 32768
+    uint8_t has_ref;
+    uint16_t* ref;                      //the previous frame, the decoder's view of it with a deadband
+    uint16_t* residual;                 //block_num * CODEC_BLOCK, the padding after pix_num stays 0
+}CodecContext_t;
+
+int codec_init(CodecContext_t* ctx, uint32_t width, uint32_t height, uint32_t key_interval);
+
+void codec_release(CodecContext_t* ctx);
+
+//forget the reference: the encoder's next frame is a keyframe, the decoder waits for one
+void codec_reset(CodecContext_t* ctx);
+
+//largest coded frame for pix_num values
+uint32_t codec_bound(uint32_t pix_num);
+
+//returns the coded size. key forces a keyframe, the first frame and every key_interval-th one are keyframes anyway
+int codec_encode(CodecContext_t* ctx, const uint16_t* frame, uint8_t* dst, uint32_t dst_size, int key);
+
+//decode one coded frame, frames have to come in coding order from a keyframe on
+//frame NULL only advances the reference, as a seek past the frame needs
+int codec_decode(CodecContext_t* ctx, const uint8_t* src, uint32_t size, uint16_t* frame);
+
+//CodecFrameType_t of a coded frame, CODEC_ERROR_FORMAT when it is not one
+int codec_frame_type(const uint8_t* src, uint32_t size);
+
+#endif
@@ -0,0 +1,329 @@
+#include "colorize.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "simd.h"
+#include "agc.h"
+#include "palette.h"
+
+//the luts are the palette manager's, built at startup
+const uint8_t* colorize_lut_get(irproc_color_mode_t color_mode)
+{
+	const Palette_t* palette = palette_get(color_mode);
+	return (palette != NULL) ? palette->bgr : NULL;
+}
+
+const uint8_t* colorize_lut_yuv_get(irproc_color_mode_t color_mode)
+{
+	const Palette_t* palette = palette_get(color_mode);
+	return (palette != NULL) ? palette->yuv : NULL;
+}
+
+void colorize_lut_release(void)
+{
+	palette_release();
+}
+
+int colorize_plan_prepare(ColorizePlan_t* plan, uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, \
+	irproc_color_mode_t color_mode, const FrameStats_t* src_stats)
+{
+	return colorize_plan_prepare_palette(plan, src_frame, pix_num, frameinfo, palette_get(color_mode), src_stats);
+}
+
+int colorize_plan_prepare_palette(ColorizePlan_t* plan, uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const Palette_t* palette, const FrameStats_t* src_stats)
+{
+	if (plan == NULL || src_frame == NULL || frameinfo == NULL || pix_num <= 0)
+	{
+		return COLORIZE_ERROR_PARAM;
+	}
+	if (frameinfo->img_enhance_status == IMG_ENHANCE_LIB || frameinfo->img_enhance_status == IMG_ENHANCE_CLAHE || \
+		frameinfo->img_enhance_status == IMG_ENHANCE_DDE)
+	{
+		//dde filters neighbourhoods and clahe blends per position, no per value mapping
+		return COLORIZE_ERROR_ENHANCE;
+	}
+	if (palette == NULL)
+	{
+		return COLORIZE_ERROR_MEMORY;
+	}
+	plan->palette = palette;
+	plan->lut = palette->bgr;
+	plan->bpp = 3;
+	plan->yuv_lut = palette->yuv;
+
+	//y16_to_y14 drops the two low bits
+	plan->shift = (frameinfo->input_format == INPUT_FMT_Y16) ? 2 : 0;
+	plan->map = COLORIZE_MAP_DIRECT;
+	plan->agc_lut = NULL;
+
+	if (frameinfo->img_enhance_status == IMG_ENHANCE_HIST_AGC)
+	{
+		//previous frames' mapping is applied while this frame's histogram is built
+		plan->agc_lut = hist_agc_prepare(get_display_hist_agc(), src_frame, pix_num, plan->shift);
+		plan->map = COLORIZE_MAP_HIST_AGC;
+	}
+	else if (frameinfo->img_enhance_status == IMG_ENHANCE_ON)
+	{
+		//the shift keeps the order, so the Y14 range comes from the source range
+		uint16_t min_val = 65535, max_val = 0;
+		if (src_stats != NULL && src_stats->valid)
+		{
+			min_val = src_stats->min_val;
+			max_val = src_stats->max_val;
+		}
+		else
+		{
+			simd_minmax_u16(src_frame, pix_num, &min_val, &max_val);
+		}
+		uint32_t lo = min_val >> plan->shift;
+		uint32_t hi = max_val >> plan->shift;
+		if (lo > COLOR_LUT_SIZE - 1) lo = COLOR_LUT_SIZE - 1;
+		if (hi > COLOR_LUT_SIZE - 1) hi = COLOR_LUT_SIZE - 1;
+
+		if (hi > lo)
+		{
+			//the linear stretch only needs one division per value in range, not per pixel
+			uint32_t range = hi - lo;
+			for (uint32_t v = 0; v <= range; v++)
+			{
+				plan->stretch_offset[v] = (uint16_t)((v * 16383) / range);
+			}
+			plan->stretch_offset[range + 1] = plan->stretch_offset[range];
+			plan->lo = lo;
+			plan->hi = hi;
+			plan->map = COLORIZE_MAP_STRETCH;
+		}
+	}
+	frameinfo->byte_size = pix_num * 3;
+	return COLORIZE_SUCCESS;
+}
+
+int colorize_plan_output(ColorizePlan_t* plan, OutputFormat_t format, int pix_num, FrameInfo_t* frameinfo)
+{
+	if (plan == NULL || plan->palette == NULL || frameinfo == NULL)
+	{
+		return COLORIZE_ERROR_PARAM;
+	}
+	switch (format)
+	{
+	case OUTPUT_FMT_BGR888: plan->lut = plan->palette->bgr; plan->bpp = 3; break;
+	case OUTPUT_FMT_RGB888: plan->lut = plan->palette->rgb; plan->bpp = 3; break;
+	case OUTPUT_FMT_BGRA32: plan->lut = plan->palette->bgra; plan->bpp = 4; break;
+	case OUTPUT_FMT_RGBA32: plan->lut = plan->palette->rgba; plan->bpp = 4; break;
+	default: return COLORIZE_ERROR_PARAM;
+	}
+	frameinfo->byte_size = pix_num * plan->bpp;
+	return COLORIZE_SUCCESS;
+}
+
+//whole 4 byte pixels, the agc's histogram is counted in a pass of its own ahead of the gathers
+static void colorize_plan_apply32(const ColorizePlan_t* plan, const uint16_t* src_frame, int begin, int end, \
+	uint8_t* dst_frame, uint32_t* hist)
+{
+	const uint16_t* src = src_frame + begin;
+	uint32_t* dst = (uint32_t*)dst_frame + begin;
+	const uint32_t* lut = (const uint32_t*)plan->lut;
+	int num = end - begin;
+	if (plan->map == COLORIZE_MAP_HIST_AGC)
+	{
+		if (hist == NULL)
+		{
+			hist = get_display_hist_agc()->hist;
+		}
+		for (int i = 0; i < num; i++)
+		{
+			uint32_t v = src[i] >> plan->shift;
+			hist[(v > COLOR_LUT_SIZE - 1) ? COLOR_LUT_SIZE - 1 : v]++;
+		}
+		simd_lut32_u16(src, num, plan->shift, 0, COLOR_LUT_SIZE - 1, plan->agc_lut, lut, dst);
+	}
+	else if (plan->map == COLORIZE_MAP_STRETCH)
+	{
+		simd_lut32_u16(src, num, plan->shift, plan->lo, plan->hi, plan->stretch_offset, lut, dst);
+	}
+	else
+	{
+		simd_lut32_u16(src, num, plan->shift, 0, COLOR_LUT_SIZE - 1, NULL, lut, dst);
+	}
+}
+
+void colorize_plan_apply(const ColorizePlan_t* plan, const uint16_t* src_frame, int begin, int end, \
+	uint8_t* dst_frame, uint32_t* hist)
+{
+	if (plan->bpp == 4)
+	{
+		colorize_plan_apply32(plan, src_frame, begin, end, dst_frame, hist);
+		return;
+	}
+	const uint8_t* lut = plan->lut;
+	int shift = plan->shift;
+	uint8_t* dst = dst_frame + (long)begin * 3;
+
+	if (plan->map == COLORIZE_MAP_HIST_AGC)
+	{
+		const uint16_t* agc_lut = plan->agc_lut;
+		if (hist == NULL)
+		{
+			hist = get_display_hist_agc()->hist;
+		}
+		for (int i = begin; i < end; i++)
+		{
+			uint32_t v = src_frame[i] >> shift;
+			if (v > COLOR_LUT_SIZE - 1) v = COLOR_LUT_SIZE - 1;
+			hist[v]++;
+			const uint8_t* color = lut + agc_lut[v] * 3;
+			dst[0] = color[0];
+			dst[1] = color[1];
+			dst[2] = color[2];
+			dst += 3;
+		}
+		return;
+	}
+
+	if (plan->map == COLORIZE_MAP_STRETCH)
+	{
+		uint32_t lo = plan->lo, hi = plan->hi;
+		const uint16_t* stretch_offset = plan->stretch_offset;
+		for (int i = begin; i < end; i++)
+		{
+			uint32_t v = src_frame[i] >> shift;
+			if (v > hi) v = hi;
+			if (v < lo) v = lo;
+			const uint8_t* color = lut + stretch_offset[v - lo] * 3;
+			dst[0] = color[0];
+			dst[1] = color[1];
+			dst[2] = color[2];
+			dst += 3;
+		}
+		return;
+	}
+
+	for (int i = begin; i < end; i++)
+	{
+		uint32_t v = src_frame[i] >> shift;
+		if (v > COLOR_LUT_SIZE - 1) v = COLOR_LUT_SIZE - 1;
+		const uint8_t* color = lut + v * 3;
+		dst[0] = color[0];
+		dst[1] = color[1];
+		dst[2] = color[2];
+		dst += 3;
+	}
+}
+
+//byte offset of a source value's entry in a 3 byte per entry lut
+static inline uint32_t colorize_plan_offset(const ColorizePlan_t* plan, uint32_t v)
+{
+	v >>= plan->shift;
+	if (plan->map == COLORIZE_MAP_STRETCH)
+	{
+		if (v > plan->hi) v = plan->hi;
+		if (v < plan->lo) v = plan->lo;
+		return plan->stretch_offset[v - plan->lo] * 3u;
+	}
+	if (v > COLOR_LUT_SIZE - 1) v = COLOR_LUT_SIZE - 1;
+	return (plan->map == COLORIZE_MAP_HIST_AGC) ? plan->agc_lut[v] * 3u : v * 3u;
+}
+
+void colorize_plan_apply_nv12(const ColorizePlan_t* plan, const uint16_t* src_frame, int src_width, \
+	int width, int height, int y0, int y1, uint8_t* dst_frame)
+{
+	const uint8_t* lut = plan->yuv_lut;
+	uint8_t* dst_uv = dst_frame + (long)width * height;
+	for (int y = y0; y < y1; y += 2)
+	{
+		const uint16_t* src0 = src_frame + (long)y * src_width;
+		const uint16_t* src1 = src0 + src_width;
+		uint8_t* luma0 = dst_frame + (long)y * width;
+		uint8_t* luma1 = luma0 + width;
+		uint8_t* chroma = dst_uv + (long)(y / 2) * width;
+		for (int x = 0; x < width; x += 2)
+		{
+			const uint8_t* c00 = lut + colorize_plan_offset(plan, src0[x]);
+			const uint8_t* c01 = lut + colorize_plan_offset(plan, src0[x + 1]);
+			const uint8_t* c10 = lut + colorize_plan_offset(plan, src1[x]);
+			const uint8_t* c11 = lut + colorize_plan_offset(plan, src1[x + 1]);
+			luma0[x] = c00[0];
+			luma0[x + 1] = c01[0];
+			luma1[x] = c10[0];
+			luma1[x + 1] = c11[0];
+			chroma[x] = (uint8_t)((c00[1] + c01[1] + c10[1] + c11[1] + 2) >> 2);
+			chroma[x + 1] = (uint8_t)((c00[2] + c01[2] + c10[2] + c11[2] + 2) >> 2);
+		}
+	}
+}
+
+void colorize_plan_apply_yuyv(const ColorizePlan_t* plan, const uint16_t* src_frame, int src_width, \
+	int width, int y0, int y1, uint8_t* dst_frame)
+{
+	const uint8_t* lut = plan->yuv_lut;
+	for (int y = y0; y < y1; y++)
+	{
+		const uint16_t* src = src_frame + (long)y * src_width;
+		uint8_t* dst = dst_frame + (long)y * width * 2;
+		for (int x = 0; x < width; x += 2)
+		{
+			const uint8_t* c0 = lut + colorize_plan_offset(plan, src[x]);
+			const uint8_t* c1 = lut + colorize_plan_offset(plan, src[x + 1]);
+			dst[0] = c0[0];
+			dst[1] = (uint8_t)((c0[1] + c1[1] + 1) >> 1);
+			dst[2] = c1[0];
+			dst[3] = (uint8_t)((c0[2] + c1[2] + 1) >> 1);
+			dst += 4;
+		}
+	}
+}
+
+void colorize_plan_commit(const ColorizePlan_t* plan, int pix_num)
+{
+	if (plan->map == COLORIZE_MAP_HIST_AGC)
+	{
+		hist_agc_commit(get_display_hist_agc(), pix_num);
+	}
+}
+
+int colorize_fused_bgr(uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, \
+	irproc_color_mode_t color_mode, const FrameStats_t* src_stats, uint8_t* dst_frame)
+{
+	return colorize_fused_bgr_palette(src_frame, pix_num, frameinfo, palette_get(color_mode), src_stats, dst_frame);
+}
+
+int colorize_fused_bgr_palette(uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const Palette_t* palette, const FrameStats_t* src_stats, uint8_t* dst_frame)
+{
+	if (dst_frame == NULL)
+	{
+		return COLORIZE_ERROR_PARAM;
+	}
+	ColorizePlan_t plan;
+	int ret = colorize_plan_prepare_palette(&plan, src_frame, pix_num, frameinfo, palette, src_stats);
+	if (ret != COLORIZE_SUCCESS)
+	{
+		return ret;
+	}
+	colorize_plan_apply(&plan, src_frame, 0, pix_num, dst_frame, NULL);
+	colorize_plan_commit(&plan, pix_num);
+	return COLORIZE_SUCCESS;
+}
+
+int colorize_fused_palette(uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const Palette_t* palette, const FrameStats_t* src_stats, uint8_t* dst_frame)
+{
+	if (dst_frame == NULL || frameinfo == NULL)
+	{
+		return COLORIZE_ERROR_PARAM;
+	}
+	ColorizePlan_t plan;
+	int ret = colorize_plan_prepare_palette(&plan, src_frame, pix_num, frameinfo, palette, src_stats);
+	if (ret == COLORIZE_SUCCESS && frameinfo->output_format != OUTPUT_FMT_BGR888)
+	{
+		ret = colorize_plan_output(&plan, frameinfo->output_format, pix_num, frameinfo);
+	}
+	if (ret != COLORIZE_SUCCESS)
+	{
+		return ret;
+	}
+	colorize_plan_apply(&plan, src_frame, 0, pix_num, dst_frame, NULL);
+	colorize_plan_commit(&plan, pix_num);
+	return COLORIZE_SUCCESS;
+}
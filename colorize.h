@@ -0,0 +1,92 @@
+#ifndef _COLORIZE_H_
+#define _COLORIZE_H_
+
+#include <stdint.h>
+#include "data.h"
+#include "libirprocess.h"
+#include "palette.h"
+
+#define COLOR_LUT_SIZE 16384        //one entry per Y14 value
+
+#define COLORIZE_SUCCESS 0
+#define COLORIZE_ERROR_PARAM -1
+#define COLORIZE_ERROR_MEMORY -2
+#define COLORIZE_ERROR_ENHANCE -3       //the enhance mode does not fold into a lut, take the Y14 chain
+
+typedef enum
+{
+    COLORIZE_MAP_DIRECT = 0,        //Y14 straight into the color lut
+    COLORIZE_MAP_STRETCH,           //linear stretch of the frame's range
+    COLORIZE_MAP_HIST_AGC,          //previous frames' agc mapping, this frame's histogram is built on the way
+}ColorizeMap_t;
+
+//everything colorize_fused_bgr works out once per frame, the pixels can then be mapped in any order from any thread
+typedef struct {
+    const Palette_t* palette;
+    const uint8_t* lut;             //bgr, or the format of colorize_plan_output
+    int bpp;                        //bytes per entry of lut and per pixel of colorize_plan_apply
+    const uint8_t* yuv_lut;         //the same colors as Y, U, V
+    int shift;
+    ColorizeMap_t map;
+    uint32_t lo;
+    uint32_t hi;
+    const uint16_t* agc_lut;
+    uint16_t stretch_offset[COLOR_LUT_SIZE + 1];    //lut entry of v - lo, one past for the 32 bit gathers
+}ColorizePlan_t;
+
+//get the Y14->BGR888 lut of color_mode, the bgr lut of palette_get(color_mode)
+//3 bytes per entry, returns NULL when the mode has no palette
+const uint8_t* colorize_lut_get(irproc_color_mode_t color_mode);
+
+//the Y14->YUV lut of color_mode, the palette's yuv, 3 bytes per entry
+const uint8_t* colorize_lut_yuv_get(irproc_color_mode_t color_mode);
+
+//release all palettes
+void colorize_lut_release(void);
+
+//one pass Y16/Y14 -> Y14 -> enhance -> pseudocolor -> BGR888, no intermediate frames
+//same result as y16_to_y14 + enhance_image_frame + color_image_frame except that every pixel
+//keeps its own chroma instead of the yuyv pair average
+//src_stats is the source frame's statistics block, the stretch range is taken from it when valid
+int colorize_fused_bgr(uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, \
+    irproc_color_mode_t color_mode, const FrameStats_t* src_stats, uint8_t* dst_frame);
+
+//colorize_fused_bgr with the luts of a palette, a composed one that is no color mode's
+int colorize_fused_bgr_palette(uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, \
+    const Palette_t* palette, const FrameStats_t* src_stats, uint8_t* dst_frame);
+
+//colorize_fused_bgr_palette into frameinfo->output_format, OUTPUT_FMT_BGR888, OUTPUT_FMT_BGRA32 or
+//OUTPUT_FMT_RGBA32. the 4 byte formats store whole pixels, dst_frame 4 byte aligned
+int colorize_fused_palette(uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, \
+    const Palette_t* palette, const FrameStats_t* src_stats, uint8_t* dst_frame);
+
+//per frame part of colorize_fused_bgr: color lut, stretch table or agc mapping, sets frameinfo->byte_size
+int colorize_plan_prepare(ColorizePlan_t* plan, uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, \
+    irproc_color_mode_t color_mode, const FrameStats_t* src_stats);
+
+int colorize_plan_prepare_palette(ColorizePlan_t* plan, uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, \
+    const Palette_t* palette, const FrameStats_t* src_stats);
+
+//switch a prepared plan's lut to another packed format of its palette: OUTPUT_FMT_BGR888, OUTPUT_FMT_RGB888,
+//OUTPUT_FMT_BGRA32 or OUTPUT_FMT_RGBA32, sets frameinfo->byte_size. the yuv mappings stay
+int colorize_plan_output(ColorizePlan_t* plan, OutputFormat_t format, int pix_num, FrameInfo_t* frameinfo);
+
+//map pixels [begin, end) into dst_frame at the same offsets, plan->bpp bytes each
+//with the agc mapping their histogram is added to hist (HIST_AGC_BINS entries), NULL adds to the agc's own
+void colorize_plan_apply(const ColorizePlan_t* plan, const uint16_t* src_frame, int begin, int end, \
+    uint8_t* dst_frame, uint32_t* hist);
+
+//map rows [y0, y1) of the top left width x height (all even) pixels into the NV12 frame dst_frame
+//each 2x2 block shares its averaged chroma. the agc mapping is only read, no histogram is built
+void colorize_plan_apply_nv12(const ColorizePlan_t* plan, const uint16_t* src_frame, int src_width, \
+    int width, int height, int y0, int y1, uint8_t* dst_frame);
+
+//map rows [y0, y1) of the top left width (even) x height pixels into the packed YUYV frame dst_frame
+//each horizontal pair shares its averaged chroma, the agc mapping is only read
+void colorize_plan_apply_yuyv(const ColorizePlan_t* plan, const uint16_t* src_frame, int src_width, \
+    int width, int y0, int y1, uint8_t* dst_frame);
+
+//after every pixel was mapped: the agc builds the next frame's mapping from its histogram
+void colorize_plan_commit(const ColorizePlan_t* plan, int pix_num);
+
+#endif
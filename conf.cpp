@@ -0,0 +1,588 @@
+#include "conf.h"
+#include "stop.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <atomic>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define CONF_PATH_LEN 256
+
+typedef enum
+{
+    CONF_TYPE_INT = 0,
+    CONF_TYPE_ENUM,                     //one of names, stored as its index
+    CONF_TYPE_STRING,
+    CONF_TYPE_WINDOWS,                  //"x,y,w,h x,y,w,h ..."
+    CONF_TYPE_ISOTHERMS,                //"low,high,r,g,b ..."
+}ConfType_t;
+
+typedef struct {
+    const char* name;
+    ConfType_t type;
+    uint8_t restart;
+    int min;
+    int max;
+    const char* const* names;
+    size_t offset;
+    size_t size;
+    const char* help;
+}ConfKey_t;
+
+static const char* const conf_stream_names[] = { "image_and_temp", "image", "temp", NULL };
+static const char* const conf_run_names[] = { "threads", "callback", "handoff", NULL };
+static const char* const conf_sink_names[] = { "null", "window", "fb", "shm", "d3d11", "gl", "kms", NULL };
+static const char* const conf_output_names[] = { "y14", "yuv422", "yuv444", "rgb888", "bgr888", "bgra32", \
+    "rgba32", NULL };
+static const char* const conf_pseudo_names[] = { "on", "off", NULL };
+static const char* const conf_enhance_names[] = { "on", "off", "hist_agc", "lib", "clahe", "dde", NULL };
+static const char* const conf_rotate_names[] = { "none", "left_90", "right_90", "180", NULL };
+static const char* const conf_mirror_names[] = { "none", "mirror", "flip", "mirror_flip", NULL };
+static const char* const conf_upscale_names[] = { "bilinear", "bicubic", NULL };
+static const char* const conf_nr_names[] = { "off", "spatial", "temporal", "average", NULL };
+static const char* const conf_policy_names[] = { "normal", "fifo", "rr", NULL };
+
+#define CONF_MEMBER(member) offsetof(Conf_t, member), sizeof(((Conf_t*)0)->member)
+
+//the schema, conf_schema_write prints it
+static const ConfKey_t conf_keys[] = {
+    { "stream_mode", CONF_TYPE_ENUM, 1, 0, 0, conf_stream_names, CONF_MEMBER(stream_mode), \
+        "planes the camera streams" },
+    { "run_mode", CONF_TYPE_ENUM, 1, 0, 0, conf_run_names, CONF_MEMBER(run_mode), \
+        "stream threads, the user callback, or the callback handing off to the frame ring" },
+    { "display_sink", CONF_TYPE_ENUM, 1, 0, 0, conf_sink_names, CONF_MEMBER(display_sink), \
+        "output of the display, window needs an opencv build with highgui, gl one with DISPLAY_GL, kms one with DISPLAY_KMS" },
+    { "display_sink_path", CONF_TYPE_STRING, 1, 0, 0, NULL, CONF_MEMBER(display_sink_path), \
+        "window title, fb or drm device or shm name, empty selects the default" },
+    { "ring_depth", CONF_TYPE_INT, 1, 0, FRAME_RING_MAX_DEPTH, NULL, CONF_MEMBER(ring_depth), \
+        "frame ring slots, 0 selects the default" },
+    { "output_format", CONF_TYPE_ENUM, 1, 0, 0, conf_output_names, CONF_MEMBER(output_format), \
+        "pixel format of the displayed image" },
+    { "info_lines", CONF_TYPE_INT, 1, 0, 1, NULL, CONF_MEMBER(info_lines), \
+        "ac020: one info line after each half, image_and_temp only" },
+    { "y8_preview", CONF_TYPE_INT, 1, 0, 255, NULL, CONF_MEMBER(y8_preview), \
+        "image_and_temp: a y8 image plane and the temp plane of every n-th frame, 0 off" },
+    { "acq_policy", CONF_TYPE_ENUM, 1, 0, 0, conf_policy_names, CONF_MEMBER(rt.role[RT_ROLE_ACQUISITION].policy), \
+        "scheduling of the stream and handoff threads, fifo/rr need CAP_SYS_NICE" },
+    { "acq_priority", CONF_TYPE_INT, 1, -20, 99, NULL, CONF_MEMBER(rt.role[RT_ROLE_ACQUISITION].priority), \
+        "1..99 for fifo/rr, the nice value for normal" },
+    { "acq_cpus", CONF_TYPE_STRING, 1, 0, 0, NULL, CONF_MEMBER(rt.role[RT_ROLE_ACQUISITION].cpus), \
+        "cpu list of the stream and handoff threads, \"0-1,3\", one list per camera split by ';', empty for any" },
+    { "display_policy", CONF_TYPE_ENUM, 1, 0, 0, conf_policy_names, CONF_MEMBER(rt.role[RT_ROLE_DISPLAY].policy), \
+        "scheduling of the display and sink threads, fifo/rr need CAP_SYS_NICE" },
+    { "display_priority", CONF_TYPE_INT, 1, -20, 99, NULL, CONF_MEMBER(rt.role[RT_ROLE_DISPLAY].priority), \
+        "1..99 for fifo/rr, the nice value for normal" },
+    { "display_cpus", CONF_TYPE_STRING, 1, 0, 0, NULL, CONF_MEMBER(rt.role[RT_ROLE_DISPLAY].cpus), \
+        "cpu list of the display and sink threads, \"2,4-7\", empty for any" },
+    { "analytics_policy", CONF_TYPE_ENUM, 1, 0, 0, conf_policy_names, CONF_MEMBER(rt.role[RT_ROLE_ANALYTICS].policy), \
+        "scheduling of the temperature and pool threads, fifo/rr need CAP_SYS_NICE" },
+    { "analytics_priority", CONF_TYPE_INT, 1, -20, 99, NULL, CONF_MEMBER(rt.role[RT_ROLE_ANALYTICS].priority), \
+        "1..99 for fifo/rr, the nice value for normal" },
+    { "analytics_cpus", CONF_TYPE_STRING, 1, 0, 0, NULL, CONF_MEMBER(rt.role[RT_ROLE_ANALYTICS].cpus), \
+        "cpu list of the temperature and pool threads, \"2,4-7\", empty for any" },
+    { "control_policy", CONF_TYPE_ENUM, 1, 0, 0, conf_policy_names, CONF_MEMBER(rt.role[RT_ROLE_CONTROL].policy), \
+        "scheduling of the command, log and config threads, fifo/rr need CAP_SYS_NICE" },
+    { "control_priority", CONF_TYPE_INT, 1, -20, 99, NULL, CONF_MEMBER(rt.role[RT_ROLE_CONTROL].priority), \
+        "1..99 for fifo/rr, the nice value for normal" },
+    { "control_cpus", CONF_TYPE_STRING, 1, 0, 0, NULL, CONF_MEMBER(rt.role[RT_ROLE_CONTROL].cpus), \
+        "cpu list of the command, log and config threads, \"2,4-7\", empty for any" },
+    { "cpu_isolate", CONF_TYPE_INT, 1, 0, 1, NULL, CONF_MEMBER(rt.isolate), \
+        "threads of the other roles without a cpu list stay off the acquisition cpus" },
+    { "lock_memory", CONF_TYPE_INT, 1, 0, 1, NULL, CONF_MEMBER(rt.lock_memory), \
+        "mlockall, no page faults on the frame path" },
+    { "palette", CONF_TYPE_INT, 0, 0, PALETTE_MODE_NUM - 1, NULL, CONF_MEMBER(display.palette), \
+        "pseudocolor mode, user palettes from 16" },
+    { "pseudo_color", CONF_TYPE_ENUM, 0, 0, 0, conf_pseudo_names, CONF_MEMBER(display.pseudo_color), \
+        "pseudocolor or gray" },
+    { "enhance", CONF_TYPE_ENUM, 0, 0, 0, conf_enhance_names, CONF_MEMBER(display.enhance), \
+        "contrast stretch of the image" },
+    { "rotate", CONF_TYPE_ENUM, 0, 0, 0, conf_rotate_names, CONF_MEMBER(display.rotate), \
+        "rotation of the displayed image" },
+    { "mirror_flip", CONF_TYPE_ENUM, 0, 0, 0, conf_mirror_names, CONF_MEMBER(display.mirror_flip), \
+        "mirror and flip after the rotation" },
+    { "upscale_factor", CONF_TYPE_INT, 0, 1, UPSCALE_FACTOR_MAX, NULL, CONF_MEMBER(display.upscale_factor), \
+        "display upscale" },
+    { "upscale_mode", CONF_TYPE_ENUM, 0, 0, 0, conf_upscale_names, CONF_MEMBER(display.upscale_mode), \
+        "upscale interpolation" },
+    { "nr_mode", CONF_TYPE_ENUM, 0, 0, 0, conf_nr_names, CONF_MEMBER(display.nr_mode), \
+        "display noise reduction" },
+    { "segmentation", CONF_TYPE_INT, 0, 0, 1, NULL, CONF_MEMBER(display.segmentation), \
+        "human segmentation by temperature" },
+    { "windows", CONF_TYPE_WINDOWS, 0, 0, DISPLAY_WINDOW_MAX, NULL, CONF_MEMBER(windows), \
+        "x,y,w,h regions processed between full refreshes, empty for the full frame" },
+    { "window_refresh", CONF_TYPE_INT, 0, 0, 1000000, NULL, CONF_MEMBER(window_refresh), \
+        "frames per full refresh with windows set, 0 refreshes after commands only" },
+    { "isotherms", CONF_TYPE_ISOTHERMS, 0, 0, DISPLAY_ISOTHERM_MAX, NULL, CONF_MEMBER(isotherms), \
+        "low,high,r,g,b bands (celsius) painted over the palette, empty for none" },
+};
+
+#define CONF_KEY_NUM (int)(sizeof(conf_keys) / sizeof(conf_keys[0]))
+
+static pthread_mutex_t conf_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Conf_t conf_current;             //the watcher's, under the mutex
+static char conf_path[CONF_PATH_LEN];
+static ConfRestartFunc_t conf_restart_func = NULL;
+static void* conf_restart_arg = NULL;
+static ConfModeFunc_t conf_mode_func = NULL;
+static void* conf_mode_arg = NULL;
+static pthread_t conf_thread;
+static std::atomic<int> conf_running(0);
+static StopToken_t conf_stop;            //conf_watch_stop wakes the watcher out of its poll wait
+static std::atomic<int> conf_restart(0);
+
+void conf_default(Conf_t* conf)
+{
+    if (conf == NULL)
+    {
+        return;
+    }
+    memset(conf, 0, sizeof(Conf_t));
+    conf->stream_mode = ir_camera_stream_mode();
+    conf->run_mode = CONF_RUN_THREADS;
+    conf->display_sink = display_sink_param.type;
+    snprintf(conf->display_sink_path, sizeof(conf->display_sink_path), "%s", display_sink_param.path);
+    conf->output_format = OUTPUT_FMT_BGR888;
+    conf->display.palette = PALETTE_DEFAULT_MODE;
+    conf->display.pseudo_color = PSEUDO_COLOR_ON;
+    conf->display.enhance = IMG_ENHANCE_ON;
+    conf->display.rotate = NO_ROTATE;
+    conf->display.mirror_flip = STATUS_NO_MIRROR_FLIP;
+    conf->display.upscale_factor = display_upscale_factor;
+    conf->display.upscale_mode = display_upscale_mode;
+    conf->display.nr_mode = display_nr_mode;
+    conf->display.segmentation = human_segmentation_enabled;
+    rt_param_default(&conf->rt);
+}
+
+static char* conf_trim(char* text)
+{
+    while (isspace((unsigned char)*text))
+    {
+        text++;
+    }
+    size_t len = strlen(text);
+    while (len > 0 && isspace((unsigned char)text[len - 1]))
+    {
+        text[--len] = '\0';
+    }
+    return text;
+}
+
+static const ConfKey_t* conf_key_find(const char* name)
+{
+    for (int i = 0; i < CONF_KEY_NUM; i++)
+    {
+        if (strcmp(conf_keys[i].name, name) == 0)
+        {
+            return &conf_keys[i];
+        }
+    }
+    return NULL;
+}
+
+//value into the key's member of conf, 0 or -1 when it does not fit the schema
+static int conf_value_parse(const ConfKey_t* key, char* value, Conf_t* conf)
+{
+    uint8_t* member = (uint8_t*)conf + key->offset;
+    switch (key->type)
+    {
+    case CONF_TYPE_INT:
+    {
+        char* end = NULL;
+        long number = strtol(value, &end, 0);
+        if (end == value || *end != '\0' || number < key->min || number > key->max)
+        {
+            return -1;
+        }
+        if (key->size == sizeof(int))
+        {
+            *(int*)member = (int)number;
+        }
+        else
+        {
+            *(uint32_t*)member = (uint32_t)number;
+        }
+        return 0;
+    }
+    case CONF_TYPE_ENUM:
+        for (int i = 0; key->names[i] != NULL; i++)
+        {
+            if (strcmp(key->names[i], value) == 0)
+            {
+                *(int*)member = i;
+                return 0;
+            }
+        }
+        return -1;
+    case CONF_TYPE_STRING:
+        if (strlen(value) >= key->size)
+        {
+            return -1;
+        }
+        memset(member, 0, key->size);
+        memcpy(member, value, strlen(value));
+        return 0;
+    case CONF_TYPE_WINDOWS:
+    {
+        ConfWindows_t windows;
+        memset(&windows, 0, sizeof(windows));
+        for (char* item = strtok(value, " \t"); item != NULL; item = strtok(NULL, " \t"))
+        {
+            Area_t* rect = &windows.rects[windows.num];
+            if (windows.num >= key->max || sscanf(item, "%d,%d,%d,%d", &rect->start_x, &rect->start_y, \
+                &rect->width, &rect->height) != 4 || rect->start_x < 0 || rect->start_y < 0 || \
+                rect->width <= 0 || rect->height <= 0)
+            {
+                return -1;
+            }
+            windows.num++;
+        }
+        memcpy(member, &windows, sizeof(windows));
+        return 0;
+    }
+    case CONF_TYPE_ISOTHERMS:
+    {
+        ConfIsotherms_t isotherms;
+        memset(&isotherms, 0, sizeof(isotherms));
+        for (char* item = strtok(value, " \t"); item != NULL; item = strtok(NULL, " \t"))
+        {
+            DisplayIsotherm_t* band = &isotherms.bands[isotherms.num];
+            int rgb[3];
+            if (isotherms.num >= key->max || sscanf(item, "%f,%f,%d,%d,%d", &band->low_celsius, \
+                &band->high_celsius, &rgb[0], &rgb[1], &rgb[2]) != 5 || !(band->high_celsius >= band->low_celsius))
+            {
+                return -1;
+            }
+            for (int c = 0; c < 3; c++)
+            {
+                if (rgb[c] < 0 || rgb[c] > 255)
+                {
+                    return -1;
+                }
+                band->rgb[c] = (uint8_t)rgb[c];
+            }
+            isotherms.num++;
+        }
+        memcpy(member, &isotherms, sizeof(isotherms));
+        return 0;
+    }
+    default:
+        return -1;
+    }
+}
+
+int conf_load(const char* path, Conf_t* conf, char* error, int error_len)
+{
+    if (path == NULL || conf == NULL)
+    {
+        return CONF_ERROR_PARAM;
+    }
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        if (error != NULL)
+        {
+            snprintf(error, error_len, "%s: can not open", path);
+        }
+        return CONF_ERROR_FILE;
+    }
+    Conf_t loaded = *conf;
+    char line[CONF_LINE_LEN];
+    int line_num = 0;
+    int rst = CONF_SUCCESS;
+    while (rst == CONF_SUCCESS && fgets(line, sizeof(line), fp) != NULL)
+    {
+        line_num++;
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+        {
+            *comment = '\0';
+        }
+        char* text = conf_trim(line);
+        if (text[0] == '\0')
+        {
+            continue;
+        }
+        char* equal = strchr(text, '=');
+        if (equal == NULL)
+        {
+            rst = CONF_ERROR_SYNTAX;
+            if (error != NULL)
+            {
+                snprintf(error, error_len, "%s:%d: no '=' in \"%s\"", path, line_num, text);
+            }
+            break;
+        }
+        *equal = '\0';
+        char* name = conf_trim(text);
+        char* value = conf_trim(equal + 1);
+        const ConfKey_t* key = conf_key_find(name);
+        if (key == NULL)
+        {
+            rst = CONF_ERROR_SYNTAX;
+            if (error != NULL)
+            {
+                snprintf(error, error_len, "%s:%d: unknown key %s", path, line_num, name);
+            }
+        }
+        else if (conf_value_parse(key, value, &loaded) != 0)
+        {
+            rst = CONF_ERROR_SYNTAX;
+            if (error != NULL)
+            {
+                snprintf(error, error_len, "%s:%d: %s does not take \"%s\", see the schema", path, line_num, \
+                    name, value);
+            }
+        }
+    }
+    fclose(fp);
+    if (rst == CONF_SUCCESS)
+    {
+        *conf = loaded;
+    }
+    return rst;
+}
+
+//the key's member of conf as the parser takes it
+static void conf_value_write(FILE* fp, const ConfKey_t* key, const Conf_t* conf)
+{
+    const uint8_t* member = (const uint8_t*)conf + key->offset;
+    switch (key->type)
+    {
+    case CONF_TYPE_INT:
+        fprintf(fp, "%d", (key->size == sizeof(int)) ? *(const int*)member : (int)*(const uint32_t*)member);
+        break;
+    case CONF_TYPE_ENUM:
+    {
+        int index = *(const int*)member;
+        int num = 0;
+        while (key->names[num] != NULL)
+        {
+            num++;
+        }
+        fprintf(fp, "%s", (index >= 0 && index < num) ? key->names[index] : "");
+        break;
+    }
+    case CONF_TYPE_STRING:
+        fprintf(fp, "%s", (const char*)member);
+        break;
+    case CONF_TYPE_WINDOWS:
+    {
+        const ConfWindows_t* windows = (const ConfWindows_t*)member;
+        for (int i = 0; i < windows->num; i++)
+        {
+            const Area_t* rect = &windows->rects[i];
+            fprintf(fp, "%s%d,%d,%d,%d", (i > 0) ? " " : "", rect->start_x, rect->start_y, rect->width, rect->height);
+        }
+        break;
+    }
+    case CONF_TYPE_ISOTHERMS:
+    {
+        const ConfIsotherms_t* isotherms = (const ConfIsotherms_t*)member;
+        for (int i = 0; i < isotherms->num; i++)
+        {
+            const DisplayIsotherm_t* band = &isotherms->bands[i];
+            fprintf(fp, "%s%g,%g,%d,%d,%d", (i > 0) ? " " : "", band->low_celsius, band->high_celsius, \
+                band->rgb[0], band->rgb[1], band->rgb[2]);
+        }
+        break;
+    }
+    }
+}
+
+int conf_schema_write(FILE* fp, const Conf_t* conf)
+{
+    if (fp == NULL || conf == NULL)
+    {
+        return CONF_ERROR_PARAM;
+    }
+    fprintf(fp, "# key = value, '#' comments. live keys apply to the running stream, restart keys reopen it\n");
+    for (int i = 0; i < CONF_KEY_NUM; i++)
+    {
+        const ConfKey_t* key = &conf_keys[i];
+        fprintf(fp, "\n# %s, %s: ", key->help, key->restart ? "restart" : "live");
+        switch (key->type)
+        {
+        case CONF_TYPE_INT:
+            fprintf(fp, "%d..%d", key->min, key->max);
+            break;
+        case CONF_TYPE_ENUM:
+            for (int n = 0; key->names[n] != NULL; n++)
+            {
+                fprintf(fp, "%s%s", (n > 0) ? "|" : "", key->names[n]);
+            }
+            break;
+        case CONF_TYPE_STRING:
+            fprintf(fp, "text, up to %d characters", (int)key->size - 1);
+            break;
+        default:
+            fprintf(fp, "up to %d, space separated", key->max);
+            break;
+        }
+        fprintf(fp, "\n%s = ", key->name);
+        conf_value_write(fp, key, conf);
+        fprintf(fp, "\n");
+    }
+    return ferror(fp) ? CONF_ERROR_FILE : CONF_SUCCESS;
+}
+
+int conf_diff(const Conf_t* a, const Conf_t* b)
+{
+    int changes = 0;
+    for (int i = 0; i < CONF_KEY_NUM; i++)
+    {
+        const ConfKey_t* key = &conf_keys[i];
+        if (memcmp((const uint8_t*)a + key->offset, (const uint8_t*)b + key->offset, key->size) != 0)
+        {
+            changes |= key->restart ? CONF_CHANGE_RESTART : CONF_CHANGE_LIVE;
+        }
+    }
+    return changes;
+}
+
+int conf_apply_live(const Conf_t* conf)
+{
+    if (conf == NULL)
+    {
+        return CONF_ERROR_PARAM;
+    }
+    int rst = display_settings_set(&conf->display);
+    rst |= display_window_set(conf->windows.rects, conf->windows.num, conf->window_refresh);
+    rst |= display_isotherm_set(conf->isotherms.bands, conf->isotherms.num);
+    return (rst == 0) ? CONF_SUCCESS : CONF_ERROR_PARAM;
+}
+
+//changes are told by the mtime and the size, an editor saving twice within a second is seen by the size or not at all
+static int conf_file_stamp(const char* path, uint64_t* stamp)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        return -1;
+    }
+    *stamp = ((uint64_t)st.st_mtime << 24) ^ (uint64_t)st.st_size;
+    return 0;
+}
+
+static void conf_reload(void)
+{
+    pthread_mutex_lock(&conf_mutex);
+    Conf_t conf = conf_current;
+    pthread_mutex_unlock(&conf_mutex);
+    char error[CONF_ERROR_LEN];
+    if (conf_load(conf_path, &conf, error, sizeof(error)) != CONF_SUCCESS)
+    {
+        printf("conf: %s, the settings stay as they are\n", error);
+        return;
+    }
+    pthread_mutex_lock(&conf_mutex);
+    int changes = conf_diff(&conf_current, &conf);
+    //a stream mode change and nothing else of the restart keys is switched with the stream running
+    Conf_t others = conf;
+    others.stream_mode = conf_current.stream_mode;
+    uint8_t mode_only = (others.stream_mode != conf.stream_mode && !(conf_diff(&conf_current, &others) & \
+        CONF_CHANGE_RESTART));
+    conf_current = conf;
+    pthread_mutex_unlock(&conf_mutex);
+    if ((changes & CONF_CHANGE_RESTART) && mode_only && conf_mode_func != NULL && \
+        conf_mode_func(conf.stream_mode, conf_mode_arg) == 0)
+    {
+        printf("conf: %s changed the stream mode, switching the running stream\n", conf_path);
+        changes &= ~CONF_CHANGE_RESTART;
+    }
+    if (changes & CONF_CHANGE_LIVE)
+    {
+        printf("conf: %s changed, applied to the running stream\n", conf_path);
+        conf_apply_live(&conf);
+    }
+    if (changes & CONF_CHANGE_RESTART)
+    {
+        printf("conf: %s changed the stream format, restarting the stream\n", conf_path);
+        conf_restart.store(1, std::memory_order_release);
+        if (conf_restart_func != NULL)
+        {
+            conf_restart_func(&conf, conf_restart_arg);
+        }
+    }
+}
+
+static void* conf_function(void* threadarg)
+{
+    uint64_t stamp = 0;
+    uint8_t stamped = (conf_file_stamp(conf_path, &stamp) == 0);
+    rt_thread_enter(RT_ROLE_CONTROL, -1, "conf");
+    while (!stop_token_wait(&conf_stop, CONF_POLL_MS))
+    {
+        uint64_t now_stamp = 0;
+        if (conf_file_stamp(conf_path, &now_stamp) != 0 || (stamped && now_stamp == stamp))
+        {
+            continue;
+        }
+        stamp = now_stamp;
+        stamped = 1;
+        conf_reload();
+    }
+    rt_thread_leave();
+    return NULL;
+}
+
+void conf_mode_switch_set(ConfModeFunc_t mode_func, void* arg)
+{
+    conf_mode_arg = arg;
+    conf_mode_func = mode_func;
+}
+
+int conf_watch_start(const char* path, const Conf_t* conf, ConfRestartFunc_t restart_func, void* arg)
+{
+    if (path == NULL || conf == NULL || strlen(path) >= CONF_PATH_LEN || conf_running.load(std::memory_order_relaxed))
+    {
+        return CONF_ERROR_PARAM;
+    }
+    snprintf(conf_path, sizeof(conf_path), "%s", path);
+    pthread_mutex_lock(&conf_mutex);
+    conf_current = *conf;
+    pthread_mutex_unlock(&conf_mutex);
+    conf_restart_func = restart_func;
+    conf_restart_arg = arg;
+    if (stop_token_init(&conf_stop) != STOP_SUCCESS)
+    {
+        return CONF_ERROR_THREAD;
+    }
+    conf_running.store(1, std::memory_order_release);
+    if (pthread_create(&conf_thread, NULL, conf_function, NULL) != 0)
+    {
+        conf_running.store(0, std::memory_order_release);
+        stop_token_release(&conf_stop);
+        return CONF_ERROR_THREAD;
+    }
+    return CONF_SUCCESS;
+}
+
+void conf_watch_stop(void)
+{
+    if (!conf_running.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    stop_request(&conf_stop);
+    pthread_join(conf_thread, NULL);
+    stop_token_release(&conf_stop);
+    conf_running.store(0, std::memory_order_release);
+}
+
+int conf_restart_pending(void)
+{
+    return conf_restart.load(std::memory_order_acquire);
+}
+
+int conf_restart_take(void)
+{
+    return conf_restart.exchange(0, std::memory_order_acq_rel);
+}
@@ -0,0 +1,98 @@
+#ifndef _CONF_H_
+#define _CONF_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "camera.h"
+#include "display.h"
+#include "rtsched.h"
+
+#define CONF_ERROR_LEN 160
+#define CONF_LINE_LEN 512
+#define CONF_POLL_MS 1000               //the watcher looks at the file's mtime and size this often
+
+#define CONF_SUCCESS 0
+#define CONF_ERROR_PARAM -1
+#define CONF_ERROR_FILE -2
+#define CONF_ERROR_SYNTAX -3            //unknown key or a value outside the schema, the error text has the line
+#define CONF_ERROR_THREAD -4
+
+#define CONF_CHANGE_LIVE 0x1            //display settings, windows, isotherms: applied to the running stream
+#define CONF_CHANGE_RESTART 0x2         //the stream format or the threads around it: the stream is reopened
+
+typedef enum
+{
+    CONF_RUN_THREADS = 0,               //stream, display and temperature threads (or the task pool)
+    CONF_RUN_CALLBACK,                  //usr_test_func on the stream's callback, USER_FUNCTION_CALLBACK
+    CONF_RUN_HANDOFF,                   //the callback fills the frame ring, CALLBACK_HANDOFF
+    CONF_RUN_MODE_NUM
+}ConfRunMode_t;
+
+typedef struct {
+    int num;
+    Area_t rects[DISPLAY_WINDOW_MAX];
+}ConfWindows_t;
+
+typedef struct {
+    int num;
+    DisplayIsotherm_t bands[DISPLAY_ISOTHERM_MAX];
+}ConfIsotherms_t;
+
+//what used to be compile time in sample.h/camera.h/load_stream_frame_info. one "key = value" per line,
+//'#' starts a comment, keys left out keep the value they had
+typedef struct {
+    //restart
+    int stream_mode;                    //IrStreamMode_t
+    int run_mode;                       //ConfRunMode_t
+    int display_sink;                   //DisplaySinkType_t, window needs an opencv build with highgui
+    char display_sink_path[SINK_PATH_LEN];
+    int ring_depth;                     //0 selects FRAME_RING_DEFAULT_DEPTH
+    int output_format;                  //OutputFormat_t of the image plane
+    int info_lines;                     //ac020 info line after each half, image_and_temp only
+    int y8_preview;                     //0, or a y8 image plane and the temp plane of every y8_preview-th frame
+    RtParam_t rt;                       //scheduling, cpus and memory locking of the threads
+    //live
+    DisplaySettings_t display;
+    ConfWindows_t windows;
+    uint32_t window_refresh;            //frames per full refresh with windows set
+    ConfIsotherms_t isotherms;
+}Conf_t;
+
+//the built in defaults: the compiled stream mode and the display's current settings
+void conf_default(Conf_t* conf);
+
+//read path over conf, nothing is changed when a line fails. error gets the line and the reason
+int conf_load(const char* path, Conf_t* conf, char* error, int error_len);
+
+//every key with its type, range, when it applies and conf's value, a valid config file itself
+int conf_schema_write(FILE* fp, const Conf_t* conf);
+
+//CONF_CHANGE_xxx bits of the keys that differ
+int conf_diff(const Conf_t* a, const Conf_t* b);
+
+//hand the live part to the display, any thread
+int conf_apply_live(const Conf_t* conf);
+
+//the stream format changed, called on the watcher thread
+typedef void (*ConfRestartFunc_t)(const Conf_t* conf, void* arg);
+
+//watch path from conf on: live changes are applied as the file changes, a restart change sets the restart
+//flag and calls restart_func (NULL for none). a file that fails to parse is reported and ignored
+int conf_watch_start(const char* path, const Conf_t* conf, ConfRestartFunc_t restart_func, void* arg);
+
+void conf_watch_stop(void);
+
+//a stream mode change without another restart key, on the watcher thread: 0 switched the running stream and no
+//restart follows
+typedef int (*ConfModeFunc_t)(int stream_mode, void* arg);
+
+//set before conf_watch_start, NULL restarts for every stream mode change
+void conf_mode_switch_set(ConfModeFunc_t mode_func, void* arg);
+
+//the watcher saw a restart change since the last conf_restart_take
+int conf_restart_pending(void);
+
+//1 once for each restart change, clears the flag
+int conf_restart_take(void);
+
+#endif
@@ -0,0 +1,744 @@
+#include "control.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "libiruvc.h"
+#include "cmdq.h"
+#include "palette.h"
+#include "prop.h"
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/time.h>
+#endif
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+
+#define CONTROL_POLL_MS 100
+#define CONTROL_HEADER_LEN 256
+#define CONTROL_ZOOM_CENTER 0xFFFF
+#define CONTROL_STOP_WAIT_MS 2000       //control_stop waits this long for the queued commands
+
+static const char* control_key_names[CONTROL_KEY_NUM] = { "ems", "tau", "ta", "tu", "distance", "palette", \
+    "mirror", "zoom" };
+
+//the host colors Y14/Y16/Y8 image planes with palette.h, a yuv stream comes colored by the module
+static int control_host_palette(Control_t* control)
+{
+    return control->stream_frame_info->config->image_info.input_format != INPUT_FMT_YUV422;
+}
+
+//api value -> device units, -1 when it is out of range
+static int control_device_value(Control_t* control, int key, double value, int32_t* device)
+{
+    double integer = floor(value);
+    switch (key)
+    {
+    case CONTROL_EMS:
+    case CONTROL_TAU:
+        *device = (int32_t)lround(value * 128);
+        return (value >= 0.01 && value <= 1.0) ? 0 : -1;
+    case CONTROL_TA:
+    case CONTROL_TU:
+        *device = (int32_t)lround(value + 273.15);
+        return (*device >= 230 && *device <= 900) ? 0 : -1;
+    case CONTROL_DISTANCE:
+        *device = (int32_t)lround(value * 128);
+        return (value >= 0 && value <= 200) ? 0 : -1;
+    case CONTROL_PALETTE:
+        *device = (int32_t)integer;
+        if (integer != value)
+        {
+            return -1;
+        }
+        if (control_host_palette(control))
+        {
+            return (value >= 0 && value < 256 && palette_get((irproc_color_mode_t)*device) != NULL) ? 0 : -1;
+        }
+        return (*device >= PSEUDO_COLOR_MODE_1 && *device <= PSEUDO_COLOR_MODE_12) ? 0 : -1;
+    case CONTROL_MIRROR:
+        *device = (int32_t)integer;
+        return (integer == value && *device >= 0 && *device <= 3) ? 0 : -1;
+    case CONTROL_ZOOM:
+        *device = (int32_t)integer;
+        return (integer == value && *device != 0 && abs(*device) <= CONTROL_ZOOM_MAX_STEPS) ? 0 : -1;
+    default:
+        return -1;
+    }
+}
+
+//device units -> the api's, for the state
+static double control_api_value(int key, int32_t device)
+{
+    switch (key)
+    {
+    case CONTROL_EMS:
+    case CONTROL_TAU:
+    case CONTROL_DISTANCE:
+        return device / 128.0;
+    case CONTROL_TA:
+    case CONTROL_TU:
+        return device - 273.15;
+    default:
+        return device;
+    }
+}
+
+//one vendor command on the command worker
+static int control_command(int key, int32_t value, uint16_t x, uint16_t y)
+{
+    switch (key)
+    {
+    case CONTROL_EMS:
+        return prop_tpd_set(TPD_PROP_EMS, (uint16_t)value);
+    case CONTROL_TAU:
+        return prop_tpd_set(TPD_PROP_TAU, (uint16_t)value);
+    case CONTROL_TA:
+        return prop_tpd_set(TPD_PROP_TA, (uint16_t)value);
+    case CONTROL_TU:
+        return prop_tpd_set(TPD_PROP_TU, (uint16_t)value);
+    case CONTROL_DISTANCE:
+        return prop_tpd_set(TPD_PROP_DISTANCE, (uint16_t)value);
+    case CONTROL_PALETTE:
+        return pseudo_color_set(PREVIEW_PATH0, (enum pseudo_color_types)value);
+    case CONTROL_MIRROR:
+        return prop_image_set(IMAGE_PROP_SEL_MIRROR_FLIP, (uint16_t)value);
+    case CONTROL_ZOOM:
+    {
+        enum zoom_scale_step step = (enum zoom_scale_step)abs(value);
+        IruvcPoint_t point = { x, y };
+        if (x == CONTROL_ZOOM_CENTER)
+        {
+            return (value > 0) ? zoom_center_up(PREVIEW_PATH0, step) : zoom_center_down(PREVIEW_PATH0, step);
+        }
+        return (value > 0) ? zoom_position_up(PREVIEW_PATH0, step, point) : \
+            zoom_position_down(PREVIEW_PATH0, step, point);
+    }
+    default:
+        return -1;
+    }
+}
+
+static void control_submit(Control_t* control, ControlEntry_t* entry);
+
+//the command of one parameter: it takes the newest value when it runs, not the one it was queued for.
+//a zoom takes at most ZOOM_STEP4 and queues itself again for the rest
+static int control_job(void* arg)
+{
+    ControlEntry_t* entry = (ControlEntry_t*)arg;
+    Control_t* control = (Control_t*)entry->owner;
+    pthread_mutex_lock(&control->mutex);
+    int32_t value = entry->value;
+    if (entry->key == CONTROL_ZOOM)
+    {
+        value = (value > ZOOM_STEP4) ? ZOOM_STEP4 : ((value < -ZOOM_STEP4) ? -ZOOM_STEP4 : value);
+        entry->value -= value;
+    }
+    entry->pending = (entry->key == CONTROL_ZOOM && entry->value != 0);
+    entry->queued = 0;
+    uint16_t x = control->zoom_x, y = control->zoom_y;
+    pthread_mutex_unlock(&control->mutex);
+
+    //zooms in and out that cancelled each other leave nothing to send
+    int run = (value != 0 || entry->key != CONTROL_ZOOM);
+    int rst = run ? control_command(entry->key, value, x, y) : 0;
+
+    pthread_mutex_lock(&control->mutex);
+    control->stats.commands += run;
+    if (rst == 0)
+    {
+        entry->applied = (entry->key == CONTROL_ZOOM) ? entry->applied + value : value;
+        entry->known = 1;
+    }
+    else
+    {
+        control->stats.errors++;
+        printf("control: %s %d failed:%d\n", control_key_names[entry->key], value, rst);
+    }
+    if (entry->pending && !entry->queued)
+    {
+        control_submit(control, entry);
+    }
+    pthread_mutex_unlock(&control->mutex);
+    return (rst == 0) ? CONTROL_SUCCESS : CONTROL_ERROR_PARAM;
+}
+
+//on the worker: a job that never ran (CMDQ_CLOSED) leaves its value pending
+static void control_job_done(int job_id, int result, void* user_data)
+{
+    ControlEntry_t* entry = (ControlEntry_t*)user_data;
+    Control_t* control = (Control_t*)entry->owner;
+    pthread_mutex_lock(&control->mutex);
+    if (result == CMDQ_CLOSED)
+    {
+        entry->queued = 0;
+    }
+    control->jobs--;
+    pthread_cond_broadcast(&control->cond);
+    pthread_mutex_unlock(&control->mutex);
+}
+
+//the lock is held. without a command worker the command runs here, as the stdin commands do
+static void control_submit(Control_t* control, ControlEntry_t* entry)
+{
+    entry->queued = 1;
+    control->jobs++;
+    int rst = cmdq_submit(control_job, entry, CMDQ_PRIORITY_NORMAL, 0, control_job_done, entry, NULL);
+    if (rst == CMDQ_SUCCESS)
+    {
+        return;
+    }
+    if (rst == CMDQ_CLOSED)
+    {
+        pthread_mutex_unlock(&control->mutex);
+        control_job(entry);
+        pthread_mutex_lock(&control->mutex);
+    }
+    else
+    {
+        //the queue is full, the value stays pending for the next change
+        entry->queued = 0;
+        control->stats.errors++;
+    }
+    control->jobs--;
+    pthread_cond_broadcast(&control->cond);
+}
+
+//the lock is held, device is in device units
+static void control_change(Control_t* control, int key, int32_t device, uint16_t x, uint16_t y)
+{
+    ControlEntry_t* entry = &control->entries[key];
+    control->stats.changes++;
+    if (entry->pending && entry->queued)
+    {
+        control->stats.coalesced++;
+    }
+    if (key == CONTROL_ZOOM)
+    {
+        //steps add up, the position is the newest one
+        int32_t steps = entry->value + device;
+        int32_t limit = 4 * CONTROL_ZOOM_MAX_STEPS;
+        entry->value = (steps > limit) ? limit : ((steps < -limit) ? -limit : steps);
+        control->zoom_x = x;
+        control->zoom_y = y;
+        entry->pending = (entry->value != 0);
+    }
+    else
+    {
+        if (!entry->pending && entry->known && entry->applied == device)
+        {
+            control->stats.unchanged++;
+            return;
+        }
+        entry->value = device;
+        entry->pending = 1;
+    }
+    if (key == CONTROL_PALETTE && control_host_palette(control))
+    {
+        //a host palette is a pointer swap, the display takes it with its next frame
+        entry->pending = 0;
+        if (palette_select((irproc_color_mode_t)device) == PALETTE_SUCCESS)
+        {
+            entry->applied = device;
+            entry->known = 1;
+        }
+        return;
+    }
+    if (entry->pending && !entry->queued)
+    {
+        control_submit(control, entry);
+    }
+}
+
+int control_set(Control_t* control, ControlKey_t key, double value)
+{
+    if (control == NULL || control->stream_frame_info == NULL || key < 0 || key >= CONTROL_KEY_NUM)
+    {
+        return CONTROL_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&control->mutex);
+    int32_t device = 0;
+    int rst = control_device_value(control, key, value, &device);
+    if (rst == 0)
+    {
+        control_change(control, key, device, CONTROL_ZOOM_CENTER, CONTROL_ZOOM_CENTER);
+    }
+    pthread_mutex_unlock(&control->mutex);
+    return (rst == 0) ? CONTROL_SUCCESS : CONTROL_ERROR_PARAM;
+}
+
+static int control_render_locked(Control_t* control, char* dst, uint32_t size)
+{
+    int len = snprintf(dst, size, "{");
+    for (int key = 0; key < CONTROL_KEY_NUM && len < (int)size; key++)
+    {
+        const ControlEntry_t* entry = &control->entries[key];
+        if (!entry->known)
+        {
+            len += snprintf(dst + len, size - len, "\"%s\":null,", control_key_names[key]);
+        }
+        else if (key == CONTROL_PALETTE || key == CONTROL_MIRROR || key == CONTROL_ZOOM)
+        {
+            len += snprintf(dst + len, size - len, "\"%s\":%d,", control_key_names[key], entry->applied);
+        }
+        else
+        {
+            len += snprintf(dst + len, size - len, "\"%s\":%.2f,", control_key_names[key], \
+                control_api_value(key, entry->applied));
+        }
+    }
+    if (len >= (int)size)
+    {
+        return CONTROL_ERROR_PARAM;
+    }
+    len += snprintf(dst + len, size - len, "\"pending\":[");
+    int first = 1;
+    for (int key = 0; key < CONTROL_KEY_NUM && len < (int)size; key++)
+    {
+        if (control->entries[key].pending)
+        {
+            len += snprintf(dst + len, size - len, "%s\"%s\"", first ? "" : ",", control_key_names[key]);
+            first = 0;
+        }
+    }
+    if (len >= (int)size)
+    {
+        return CONTROL_ERROR_PARAM;
+    }
+    len += snprintf(dst + len, size - len, "],\"changes\":%llu,\"coalesced\":%llu,\"commands\":%llu,\"errors\":%llu}\n", \
+        (unsigned long long)control->stats.changes, (unsigned long long)control->stats.coalesced, \
+        (unsigned long long)control->stats.commands, (unsigned long long)control->stats.errors);
+    return (len < (int)size) ? len : CONTROL_ERROR_PARAM;
+}
+
+int control_render(Control_t* control, char* dst, uint32_t size)
+{
+    if (control == NULL || dst == NULL || size == 0)
+    {
+        return CONTROL_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&control->mutex);
+    int len = control_render_locked(control, dst, size);
+    pthread_mutex_unlock(&control->mutex);
+    return len;
+}
+
+//the values the module starts with, a parameter changed meanwhile keeps its own
+static int control_read_job(void* arg)
+{
+    Control_t* control = (Control_t*)arg;
+    static const int tpd_props[] = { TPD_PROP_EMS, TPD_PROP_TAU, TPD_PROP_TA, TPD_PROP_TU, TPD_PROP_DISTANCE };
+    uint16_t values[CONTROL_MIRROR + 1];
+    int valid[CONTROL_MIRROR + 1] = { 0 };
+    for (int key = CONTROL_EMS; key <= CONTROL_DISTANCE; key++)
+    {
+        valid[key] = (prop_tpd_get((enum prop_tpd_params)tpd_props[key], &values[key]) == 0);
+    }
+    valid[CONTROL_MIRROR] = (prop_image_get(IMAGE_PROP_SEL_MIRROR_FLIP, &values[CONTROL_MIRROR]) == 0);
+    pthread_mutex_lock(&control->mutex);
+    for (int key = CONTROL_EMS; key <= CONTROL_MIRROR; key++)
+    {
+        ControlEntry_t* entry = &control->entries[key];
+        if (valid[key] && !entry->known && !entry->pending)
+        {
+            entry->applied = values[key];
+            entry->known = 1;
+        }
+    }
+    pthread_mutex_unlock(&control->mutex);
+    return CONTROL_SUCCESS;
+}
+
+static void control_read_done(int job_id, int result, void* user_data)
+{
+    Control_t* control = (Control_t*)user_data;
+    pthread_mutex_lock(&control->mutex);
+    control->jobs--;
+    pthread_cond_broadcast(&control->cond);
+    pthread_mutex_unlock(&control->mutex);
+}
+
+int control_attach(Control_t* control, StreamFrameInfo_t* stream_frame_info)
+{
+    if (control == NULL || stream_frame_info == NULL || stream_frame_info->config == NULL)
+    {
+        return CONTROL_ERROR_PARAM;
+    }
+    memset(control, 0, sizeof(Control_t));
+    control->stream_frame_info = stream_frame_info;
+    control->listen_fd = -1;
+    control->wake_fd[0] = -1;
+    control->wake_fd[1] = -1;
+    control->zoom_x = CONTROL_ZOOM_CENTER;
+    control->zoom_y = CONTROL_ZOOM_CENTER;
+    for (int key = 0; key < CONTROL_KEY_NUM; key++)
+    {
+        control->entries[key].owner = control;
+        control->entries[key].key = key;
+    }
+    //the zoom is relative, counted from where the module is
+    control->entries[CONTROL_ZOOM].known = 1;
+    pthread_mutex_init(&control->mutex, NULL);
+    pthread_cond_init(&control->cond, NULL);
+    return CONTROL_SUCCESS;
+}
+
+//one key=value pair of the query, 0 when the name is not a parameter
+static int control_query_key(const char* name, size_t name_len)
+{
+    for (int key = 0; key < CONTROL_KEY_NUM; key++)
+    {
+        if (strlen(control_key_names[key]) == name_len && strncmp(name, control_key_names[key], name_len) == 0)
+        {
+            return key;
+        }
+    }
+    return -1;
+}
+
+//parse and check every pair before anything changes, a request is taken whole or not at all. returns the http
+//status, error gets the reason of a 400
+static int control_query(Control_t* control, const char* query, char* error, int error_len)
+{
+    int32_t devices[CONTROL_KEY_NUM];
+    int given[CONTROL_KEY_NUM] = { 0 };
+    long x = CONTROL_ZOOM_CENTER, y = CONTROL_ZOOM_CENTER;
+    const char* p = query;
+    while (*p != 0 && *p != ' ' && *p != '\r' && *p != '\n')
+    {
+        size_t pair_len = strcspn(p, "& \r\n");
+        const char* eq = (const char*)memchr(p, '=', pair_len);
+        if (eq == NULL)
+        {
+            snprintf(error, error_len, "%.*s: no value", (int)pair_len, p);
+            return 400;
+        }
+        size_t name_len = eq - p;
+        char* end = NULL;
+        double value = strtod(eq + 1, &end);
+        if (end == eq + 1 || end != p + pair_len)
+        {
+            snprintf(error, error_len, "%.*s: not a number", (int)name_len, p);
+            return 400;
+        }
+        int key = control_query_key(p, name_len);
+        if ((name_len == 6 && strncmp(p, "zoom_x", 6) == 0) || (name_len == 6 && strncmp(p, "zoom_y", 6) == 0))
+        {
+            long* pos = (p[5] == 'x') ? &x : &y;
+            *pos = (long)value;
+            if (value < 0 || value >= CONTROL_ZOOM_CENTER)
+            {
+                snprintf(error, error_len, "%.*s: out of range", (int)name_len, p);
+                return 400;
+            }
+        }
+        else if (key < 0)
+        {
+            snprintf(error, error_len, "%.*s: unknown parameter", (int)name_len, p);
+            return 400;
+        }
+        else if (control_device_value(control, key, value, &devices[key]) < 0)
+        {
+            snprintf(error, error_len, "%s: out of range", control_key_names[key]);
+            return 400;
+        }
+        else
+        {
+            given[key] = 1;
+        }
+        p += pair_len;
+        p += (*p == '&');
+    }
+    if ((x == CONTROL_ZOOM_CENTER) != (y == CONTROL_ZOOM_CENTER))
+    {
+        snprintf(error, error_len, "zoom_x and zoom_y go together");
+        return 400;
+    }
+    for (int key = 0; key < CONTROL_KEY_NUM; key++)
+    {
+        if (given[key])
+        {
+            control_change(control, key, devices[key], (uint16_t)x, (uint16_t)y);
+        }
+    }
+    return 200;
+}
+
+#if !defined(_WIN32)
+static int control_send(int fd, const char* data, uint32_t size)
+{
+    uint32_t sent = 0;
+    while (sent < size)
+    {
+        ssize_t n = send(fd, data + sent, size - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        sent += n;
+    }
+    return 0;
+}
+
+//read the request line and headers, up to the empty line. returns -1 on a timeout, a close or control_stop
+static int control_request_read(Control_t* control, int fd, char* request, uint32_t size)
+{
+    uint32_t len = 0;
+    uint64_t deadline_us = get_monotonic_us() + CONTROL_REQUEST_TIMEOUT_MS * 1000ull;
+    while (len < size - 1)
+    {
+        uint64_t now_us = get_monotonic_us();
+        if (now_us >= deadline_us || !control->running)
+        {
+            return -1;
+        }
+        struct pollfd pfds[2];
+        pfds[0].fd = fd;
+        pfds[0].events = POLLIN;
+        pfds[1].fd = control->wake_fd[0];
+        pfds[1].events = POLLIN;
+        uint64_t wait_ms = (deadline_us - now_us + 999) / 1000;
+        if (poll(pfds, 2, wait_ms < CONTROL_POLL_MS ? (int)wait_ms : CONTROL_POLL_MS) <= 0 || \
+            !(pfds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            continue;
+        }
+        ssize_t n = recv(fd, request + len, size - 1 - len, 0);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        len += n;
+        request[len] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL)
+        {
+            return 0;
+        }
+    }
+    //headers longer than the buffer, the request line is all that is looked at
+    return 0;
+}
+
+//one request per connection, then close. GET and POST both take the query, a form posted in the body is not read
+static void control_client(Control_t* control, int fd)
+{
+    char request[CONTROL_REQUEST_LEN];
+    if (control_request_read(control, fd, request, sizeof(request)) < 0)
+    {
+        pthread_mutex_lock(&control->mutex);
+        control->stats.bad_requests++;
+        pthread_mutex_unlock(&control->mutex);
+        return;
+    }
+    int post = (strncmp(request, "POST ", 5) == 0);
+    const char* path = post ? request + 5 : request + 4;
+    size_t path_len = strcspn(path, " ?\r\n");
+    int found = (post || strncmp(request, "GET ", 4) == 0) && path_len == 8 && strncmp(path, "/control", 8) == 0;
+
+    char body[CONTROL_REPLY_LEN];
+    char error[128];
+    int status = found ? 200 : 404;
+    pthread_mutex_lock(&control->mutex);
+    control->stats.requests++;
+    if (found && path[path_len] == '?')
+    {
+        status = control_query(control, path + path_len + 1, error, sizeof(error));
+    }
+    int len = 0;
+    if (status == 200)
+    {
+        len = control_render_locked(control, body, sizeof(body));
+        len = (len < 0) ? 0 : len;
+    }
+    else
+    {
+        control->stats.bad_requests++;
+        len = snprintf(body, sizeof(body), "{\"error\":\"%s\"}\n", (status == 404) ? "not found" : error);
+    }
+    pthread_mutex_unlock(&control->mutex);
+
+    char header[CONTROL_HEADER_LEN];
+    //a browser page on another port (the web dashboard) may call it
+    int header_len = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Type: application/json\r\n" \
+        "Access-Control-Allow-Origin: *\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", \
+        (status == 200) ? "200 OK" : ((status == 404) ? "404 Not Found" : "400 Bad Request"), len);
+    if (control_send(fd, header, header_len) < 0 || control_send(fd, body, len) < 0)
+    {
+        pthread_mutex_lock(&control->mutex);
+        control->stats.bad_requests++;
+        pthread_mutex_unlock(&control->mutex);
+    }
+}
+
+//server thread: requests are small, they are answered one at a time. the commands never run here
+static void* control_server_function(void* threadarg)
+{
+    Control_t* control = (Control_t*)threadarg;
+    while (control->running)
+    {
+        struct pollfd pfds[2];
+        pfds[0].fd = control->listen_fd;
+        pfds[0].events = POLLIN;
+        pfds[1].fd = control->wake_fd[0];
+        pfds[1].events = POLLIN;
+        if (poll(pfds, 2, CONTROL_POLL_MS) <= 0 || !(pfds[0].revents & POLLIN))
+        {
+            continue;
+        }
+        int fd = accept(control->listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            continue;
+        }
+        //a client that stops reading must not hold the thread
+        struct timeval timeout;
+        timeout.tv_sec = CONTROL_REQUEST_TIMEOUT_MS / 1000;
+        timeout.tv_usec = (CONTROL_REQUEST_TIMEOUT_MS % 1000) * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        control_client(control, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+int control_start(Control_t* control, const ControlParam_t* param)
+{
+    if (control == NULL || param == NULL || control->stream_frame_info == NULL || control->running)
+    {
+        return CONTROL_ERROR_PARAM;
+    }
+    control->param = *param;
+    if (control->param.port == 0)
+    {
+        control->param.port = CONTROL_DEFAULT_PORT;
+    }
+    pthread_mutex_lock(&control->mutex);
+    if (control_host_palette(control) && palette_active() != NULL)
+    {
+        control->entries[CONTROL_PALETTE].applied = palette_active()->color_mode;
+        control->entries[CONTROL_PALETTE].known = 1;
+    }
+    control->jobs++;
+    if (cmdq_submit(control_read_job, control, CMDQ_PRIORITY_READ, 0, control_read_done, control, NULL) != CMDQ_SUCCESS)
+    {
+        control->jobs--;
+    }
+    pthread_mutex_unlock(&control->mutex);
+
+    control->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(control->param.port);
+    if (control->listen_fd < 0 || \
+        setsockopt(control->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 || \
+        bind(control->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(control->listen_fd, 4) < 0 || \
+        pipe(control->wake_fd) < 0)
+    {
+        printf("control: listen on port %u failed\n", control->param.port);
+        control_stop(control);
+        return CONTROL_ERROR_SOCKET;
+    }
+    fcntl(control->listen_fd, F_SETFL, fcntl(control->listen_fd, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(control->wake_fd[0], F_SETFL, fcntl(control->wake_fd[0], F_GETFL, 0) | O_NONBLOCK);
+
+    control->running = 1;
+    if (pthread_create(&control->thread, NULL, control_server_function, control) != 0)
+    {
+        control->running = 0;
+        control_stop(control);
+        return CONTROL_ERROR_SOCKET;
+    }
+    printf("control: http://<host>:%u/control\n", control->param.port);
+    return CONTROL_SUCCESS;
+}
+
+int control_stop(Control_t* control)
+{
+    if (control == NULL)
+    {
+        return CONTROL_ERROR_PARAM;
+    }
+    int running = control->running;
+    control->running = 0;
+    if (running)
+    {
+        uint8_t wake = 1;
+        if (write(control->wake_fd[1], &wake, 1) < 0)
+        {
+        }
+        pthread_join(control->thread, NULL);
+    }
+    if (control->listen_fd >= 0)
+    {
+        close(control->listen_fd);
+        control->listen_fd = -1;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (control->wake_fd[i] >= 0)
+        {
+            close(control->wake_fd[i]);
+            control->wake_fd[i] = -1;
+        }
+    }
+    //the queued commands point at the entries
+    pthread_mutex_lock(&control->mutex);
+    uint64_t deadline_us = get_monotonic_us() + CONTROL_STOP_WAIT_MS * 1000ull;
+    while (control->jobs > 0 && get_monotonic_us() < deadline_us)
+    {
+        struct timespec wait;
+        timespec_get(&wait, TIME_UTC);
+        wait.tv_nsec += CONTROL_POLL_MS * 1000000L;
+        wait.tv_sec += wait.tv_nsec / 1000000000L;
+        wait.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&control->cond, &control->mutex, &wait);
+    }
+    pthread_mutex_unlock(&control->mutex);
+    if (running)
+    {
+        printf("control: %llu requests, %llu bad, %llu changes, %llu coalesced, %llu unchanged, %llu commands, " \
+            "%llu failed\n", (unsigned long long)control->stats.requests, \
+            (unsigned long long)control->stats.bad_requests, (unsigned long long)control->stats.changes, \
+            (unsigned long long)control->stats.coalesced, (unsigned long long)control->stats.unchanged, \
+            (unsigned long long)control->stats.commands, (unsigned long long)control->stats.errors);
+    }
+    return CONTROL_SUCCESS;
+}
+#else
+int control_start(Control_t* control, const ControlParam_t* param)
+{
+    //the server is written against posix sockets and poll
+    return CONTROL_ERROR_SOCKET;
+}
+
+int control_stop(Control_t* control)
+{
+    return CONTROL_SUCCESS;
+}
+#endif
+
+int control_stats(Control_t* control, ControlStats_t* stats)
+{
+    if (control == NULL || stats == NULL)
+    {
+        return CONTROL_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&control->mutex);
+    *stats = control->stats;
+    pthread_mutex_unlock(&control->mutex);
+    return CONTROL_SUCCESS;
+}
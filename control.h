@@ -0,0 +1,95 @@
+#ifndef _CONTROL_H_
+#define _CONTROL_H_
+
+//network control of the module's measurement and image parameters: http://<host>:port/control answers the
+//current values as json, /control?ems=0.95&distance=2.5 changes them. every change becomes a command on the
+//command queue, so it runs between frames like the stdin commands. a parameter holds its newest value and at most
+//one queued command, a slider dragged across many values while the command waits sends only the last one
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+
+#define CONTROL_DEFAULT_PORT 8081
+#define CONTROL_REQUEST_LEN 2048
+#define CONTROL_REPLY_LEN 1024
+#define CONTROL_REQUEST_TIMEOUT_MS 1000 //a client sending its request slower than this is closed
+#define CONTROL_ZOOM_MAX_STEPS 16       //zoom steps one request may ask for, either way
+
+#define CONTROL_SUCCESS 0
+#define CONTROL_ERROR_PARAM -1
+#define CONTROL_ERROR_SOCKET -2
+
+typedef enum
+{
+    CONTROL_EMS = 0,                    //emissivity 0.01..1, TPD_PROP_EMS
+    CONTROL_TAU,                        //atmospheric transmittance 0.01..1, TPD_PROP_TAU
+    CONTROL_TA,                         //atmospheric temperature, celsius, TPD_PROP_TA
+    CONTROL_TU,                         //reflected temperature, celsius, TPD_PROP_TU
+    CONTROL_DISTANCE,                   //target distance 0..200 m, TPD_PROP_DISTANCE
+    CONTROL_PALETTE,                    //irproc_color_mode_t of the host palette, pseudo_color_types for yuv output
+    CONTROL_MIRROR,                     //0 none, 1 mirror, 2 flip, 3 both, IMAGE_PROP_SEL_MIRROR_FLIP
+    CONTROL_ZOOM,                       //relative zoom steps, + in, - out, at zoom_x/zoom_y or the center
+    CONTROL_KEY_NUM,
+}ControlKey_t;
+
+typedef struct {
+    uint16_t port;                      //0 selects CONTROL_DEFAULT_PORT
+}ControlParam_t;
+
+typedef struct {
+    uint64_t requests;                  //http requests answered
+    uint64_t bad_requests;              //unknown keys, values out of range, other paths
+    uint64_t changes;                   //values received
+    uint64_t coalesced;                 //values that replaced one still waiting for its command
+    uint64_t unchanged;                 //values equal to the applied one, no command
+    uint64_t commands;                  //vendor commands run
+    uint64_t errors;                    //vendor commands that failed
+}ControlStats_t;
+
+//one parameter. values are in the device's units: 1/128 for ems and tau, kelvin for ta and tu,
+//1/128 m for the distance, zoom steps for the zoom
+typedef struct {
+    void* owner;                        //the Control_t, for the command
+    int key;                            //ControlKey_t
+    uint8_t known;                      //applied holds the device's value
+    uint8_t pending;                    //value waits for the command
+    uint8_t queued;                     //a command is queued and has not taken value yet
+    int32_t value;
+    int32_t applied;
+}ControlEntry_t;
+
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    ControlParam_t param;
+    uint8_t running;
+    int listen_fd;
+    int wake_fd[2];                     //control_stop wakes the server thread
+    ControlEntry_t entries[CONTROL_KEY_NUM];
+    uint16_t zoom_x;                    //the position of the pending zoom, 0xFFFF for the center
+    uint16_t zoom_y;
+    int jobs;                           //commands queued or running, control_stop waits for them
+    ControlStats_t stats;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+}Control_t;
+
+//the camera whose parameters are controlled, its command queue takes the changes
+int control_attach(Control_t* control, StreamFrameInfo_t* stream_frame_info);
+
+//read the current values once and listen on param->port from a server thread
+int control_start(Control_t* control, const ControlParam_t* param);
+
+//close the listening socket and wait for the queued commands
+int control_stop(Control_t* control);
+
+//the change a request of the key would make, from any thread. value is in the api's units (ems 0.95,
+//ta in celsius, distance in m, zoom in steps), the same ranges and coalescing as the http api
+int control_set(Control_t* control, ControlKey_t key, double value);
+
+//the state /control answers, returns its length or CONTROL_ERROR_PARAM when size is too small
+int control_render(Control_t* control, char* dst, uint32_t size);
+
+int control_stats(Control_t* control, ControlStats_t* stats);
+
+#endif
@@ -1,43 +1,118 @@
 #include "data.h"
+#include "memacct.h"
 
+//monotonic clock, unit:us
+uint64_t get_monotonic_us(void)
+{
 #if defined(_WIN32)
-	HANDLE image_sem, temp_sem, image_done_sem, temp_done_sem;
+	static LARGE_INTEGER freq = { 0 };
+	LARGE_INTEGER counter;
+	if (freq.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)(counter.QuadPart / freq.QuadPart) * 1000000 + \
+		(uint64_t)(counter.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
 #elif defined(linux) || defined(unix)
-	sem_t image_sem, temp_sem, image_done_sem, temp_done_sem;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 #endif
+}
+
 
-//init the semaphore
-int init_pthread_sem()
+//the bytes of a ring slot: the raw frame and the cut planes
+static uint64_t data_slot_bytes(const StreamFrameInfo_t* stream_frame_info)
 {
-#if defined(_WIN32)
-	image_sem = CreateSemaphore(NULL, 1, 1, NULL);
-	temp_sem = CreateSemaphore(NULL, 1, 1, NULL);
-	image_done_sem = CreateSemaphore(NULL, 0, 1, NULL);
-	temp_done_sem = CreateSemaphore(NULL, 0, 1, NULL);
-#elif defined(linux) || defined(unix)
-	sem_init(&image_sem, 0, 1);
-	sem_init(&temp_sem, 0, 1);
-	sem_init(&image_done_sem, 0, 0);
-	sem_init(&temp_done_sem, 0, 0);
-#endif 
-	return 0;
+	uint64_t frame_size = stream_frame_info->camera_param.frame_size;
+	if (!stream_frame_info->zero_copy)
+	{
+		frame_size += stream_frame_info->image_byte_size + stream_frame_info->temp_byte_size + \
+			2ull * stream_frame_info->info_byte_size;
+	}
+	return frame_size;
 }
 
-//recycle the semaphore
-int destroy_pthread_sem()
+//register the ring slots and the drain frame with the memory budget, a tight budget gets fewer slots
+static void data_ring_budget(StreamFrameInfo_t* stream_frame_info)
 {
-#if defined(_WIN32)
-	CloseHandle(image_sem);
-	CloseHandle(temp_sem);
-	CloseHandle(image_done_sem);
-	CloseHandle(temp_done_sem);
-#elif defined(linux) || defined(unix)
-	sem_destroy(&image_sem);
-	sem_destroy(&temp_sem);
-	sem_destroy(&image_done_sem);
-	sem_destroy(&temp_done_sem);
-#endif 
-	return 0;
+	uint32_t depth = (stream_frame_info->ring_depth > 0) ? stream_frame_info->ring_depth : FRAME_RING_DEFAULT_DEPTH;
+	uint64_t frame_size = data_slot_bytes(stream_frame_info);
+	uint64_t want = (depth + 1) * frame_size;
+	uint64_t grant = mem_acct_reserve(MEM_CLASS_RING, want, 3 * frame_size, frame_size);
+	if (grant == 0)
+	{
+		//two slots are the least the ring works with, taken past the budget
+		grant = (depth > 2) ? 3 * frame_size : want;
+		mem_acct_add(MEM_CLASS_RING, (int64_t)grant);
+	}
+	if (grant < want)
+	{
+		stream_frame_info->ring_depth = (uint32_t)(grant / frame_size) - 1;
+		printf("ring depth %u -> %u to fit the memory budget\n", depth, stream_frame_info->ring_depth);
+	}
+	stream_frame_info->ring_mem_bytes = grant;
+}
+
+//the settings as the threads read them from now on
+static StreamConfig_t* data_config_create(const StreamFrameInfo_t* stream_frame_info)
+{
+	StreamConfig_t* config = new StreamConfig_t();
+	config->camera_param = stream_frame_info->camera_param;
+	config->image_info = stream_frame_info->image_info;
+	config->temp_info = stream_frame_info->temp_info;
+	config->image_byte_size = stream_frame_info->image_byte_size;
+	config->temp_byte_size = stream_frame_info->temp_byte_size;
+	config->ring_depth = stream_frame_info->ring_depth;
+	config->zero_copy = stream_frame_info->zero_copy;
+	config->temp_interval = stream_frame_info->temp_interval;
+	config->info_byte_size = stream_frame_info->info_byte_size;
+	config->camera_index = stream_frame_info->camera_index;
+	config->prev = NULL;
+	return config;
+}
+
+static void data_ring_format(const StreamFrameInfo_t* stream_frame_info, FramePool_t* pool, RingFormat_t* ring_format)
+{
+	memset(ring_format, 0, sizeof(RingFormat_t));
+	ring_format->camera_param = stream_frame_info->camera_param;
+	ring_format->image_byte_size = stream_frame_info->image_byte_size;
+	ring_format->image_width = stream_frame_info->image_info.width;
+	ring_format->image_height = stream_frame_info->image_info.height;
+	ring_format->temp_byte_size = stream_frame_info->temp_byte_size;
+	ring_format->temp_width = stream_frame_info->temp_info.width;
+	ring_format->temp_height = stream_frame_info->temp_info.height;
+	ring_format->zero_copy = stream_frame_info->zero_copy;
+	//the wire still carries 16 bit pixels, the cut stretches them, a smaller raw frame (a y8 replay) is cut as is
+	ring_format->image_y8 = (stream_frame_info->image_info.input_format == INPUT_FMT_Y8 && \
+		stream_frame_info->camera_param.frame_size >= \
+		stream_frame_info->image_byte_size * 2 + stream_frame_info->temp_byte_size + \
+		stream_frame_info->info_byte_size * 2);
+	ring_format->temp_interval = stream_frame_info->temp_interval;
+	ring_format->info_byte_size = stream_frame_info->info_byte_size;
+	ring_format->frame_pool = pool;
+}
+
+//the stream's own image/temp frame next to the raw frame, views into it with zero_copy
+static void data_planes_create(StreamFrameInfo_t* stream_frame_info, FramePool_t* pool)
+{
+	if (stream_frame_info->zero_copy)
+	{
+		//image and temp halves are contiguous in the raw frame
+		stream_frame_info->image_frame = stream_frame_info->raw_frame;
+		stream_frame_info->temp_frame = stream_frame_info->raw_frame + stream_frame_info->image_byte_size;
+	}
+	else if (pool != NULL)
+	{
+		stream_frame_info->image_frame = (uint8_t*)frame_pool_alloc(pool, stream_frame_info->image_byte_size);
+		stream_frame_info->temp_frame = (uint8_t*)frame_pool_alloc(pool, stream_frame_info->temp_byte_size);
+	}
+	else
+	{
+		stream_frame_info->image_frame = (uint8_t*)malloc(stream_frame_info->image_byte_size);
+		stream_frame_info->temp_frame = (uint8_t*)malloc(stream_frame_info->temp_byte_size);
+	}
 }
 
 //create the raw frame/image frame/temperature frame's buffer
@@ -45,12 +120,72 @@ int create_data_demo(StreamFrameInfo_t* stream_frame_info)
 {
 	if (stream_frame_info != NULL)
 	{
+		if (stream_frame_info->frame_ring == NULL && stream_frame_info->ring_mem_bytes == 0)
+		{
+			data_ring_budget(stream_frame_info);
+		}
+		if (stream_frame_info->image_info.input_format == INPUT_FMT_Y8)
+		{
+			//the y8 plane is its own buffer, never a view into the 16 bit raw frame
+			stream_frame_info->zero_copy = 0;
+		}
+		if (stream_frame_info->config == NULL)
+		{
+			//from here on the threads read the settings from the frozen copy
+			stream_frame_info->config = data_config_create(stream_frame_info);
+			stream_frame_info->fps = stream_frame_info->config->camera_param.fps;
+		}
+		FramePool_t* pool = stream_frame_info->frame_pool;
+		if (stream_frame_info->frame_pool_param != NULL && pool == NULL && \
+			stream_frame_info->raw_frame == NULL && stream_frame_info->frame_ring == NULL)
+		{
+			//every ring slot plus the drain frame, each a raw frame and its cut planes
+			uint32_t depth = (stream_frame_info->ring_depth > 0) ? stream_frame_info->ring_depth : FRAME_RING_DEFAULT_DEPTH;
+			size_t frame_size = FRAME_POOL_ROUND(stream_frame_info->camera_param.frame_size);
+			if (!stream_frame_info->zero_copy)
+			{
+				frame_size += FRAME_POOL_ROUND(stream_frame_info->image_byte_size) + \
+					FRAME_POOL_ROUND(stream_frame_info->temp_byte_size);
+			}
+			pool = new FramePool_t();
+			if (frame_pool_create(pool, stream_frame_info->frame_pool_param, (depth + 1) * frame_size) == \
+				FRAME_POOL_SUCCESS)
+			{
+				printf("frame pool: %zu bytes, %s pages, %s, numa node %d\n", pool->size, \
+					frame_pool_page_name(pool->page), pool->locked ? "locked" : "unlocked", pool->numa_node);
+				stream_frame_info->frame_pool = pool;
+			}
+			else
+			{
+				printf("frame pool of %zu bytes failed, frames stay on the heap\n", (depth + 1) * frame_size);
+				delete pool;
+				pool = NULL;
+			}
+		}
 		if (stream_frame_info->raw_frame == NULL && stream_frame_info->image_frame == NULL && \
 			stream_frame_info->temp_frame == NULL)
 		{
-			stream_frame_info->raw_frame = (uint8_t*)uvc_frame_buf_create(stream_frame_info->camera_param);
-			stream_frame_info->image_frame = (uint8_t*)malloc(stream_frame_info->image_byte_size);
-			stream_frame_info->temp_frame = (uint8_t*)malloc(stream_frame_info->temp_byte_size);
+			if (pool != NULL)
+			{
+				stream_frame_info->raw_frame = (uint8_t*)frame_pool_alloc(pool, stream_frame_info->camera_param.frame_size);
+			}
+			else
+			{
+				stream_frame_info->raw_frame = (uint8_t*)uvc_frame_buf_create(stream_frame_info->camera_param);
+			}
+			data_planes_create(stream_frame_info, pool);
+		}
+		if (stream_frame_info->frame_ring == NULL)
+		{
+			RingFormat_t ring_format;
+			data_ring_format(stream_frame_info, pool, &ring_format);
+			//raw_frame stays as the drain target when every ring slot is held
+			stream_frame_info->frame_ring = ring_create(&ring_format, stream_frame_info->ring_depth, \
+				stream_frame_info->raw_frame);
+			if (stream_frame_info->frame_ring == NULL)
+			{
+				return -1;
+			}
 		}
 	}
 	return 0;
@@ -61,9 +196,31 @@ int destroy_data_demo(StreamFrameInfo_t* stream_frame_info)
 {
 	if (stream_frame_info != NULL)
 	{
+		if (stream_frame_info->frame_ring != NULL)
+		{
+			ring_destroy(stream_frame_info->frame_ring);
+			stream_frame_info->frame_ring = NULL;
+		}
+
+		if (stream_frame_info->zero_copy || stream_frame_info->frame_pool != NULL)
+		{
+			stream_frame_info->image_frame = NULL;
+			stream_frame_info->temp_frame = NULL;
+		}
+
+		if (stream_frame_info->frame_pool != NULL)
+		{
+			//the frames are slices of the pool, it goes as a whole
+			stream_frame_info->raw_frame = NULL;
+			frame_pool_destroy(stream_frame_info->frame_pool);
+			delete stream_frame_info->frame_pool;
+			stream_frame_info->frame_pool = NULL;
+		}
+
 		if (stream_frame_info->raw_frame != NULL)
 		{
 			uvc_frame_buf_release(stream_frame_info->raw_frame);
+			stream_frame_info->raw_frame = NULL;
 		}
 
 		if (stream_frame_info->image_frame != NULL)
@@ -77,6 +234,69 @@ int destroy_data_demo(StreamFrameInfo_t* stream_frame_info)
 			free(stream_frame_info->temp_frame);
 			stream_frame_info->temp_frame = NULL;
 		}
+
+		while (stream_frame_info->config != NULL)
+		{
+			const StreamConfig_t* prev = stream_frame_info->config->prev;
+			delete stream_frame_info->config;
+			stream_frame_info->config = prev;
+		}
+		mem_acct_release(MEM_CLASS_RING, stream_frame_info->ring_mem_bytes);
+		stream_frame_info->ring_mem_bytes = 0;
 	}
 	return 0;
-}
\ No newline at end of file
+}
+int data_format_change(StreamFrameInfo_t* stream_frame_info)
+{
+	const StreamConfig_t* old_config = (stream_frame_info != NULL) ? stream_frame_info->config : NULL;
+	if (old_config == NULL || stream_frame_info->frame_ring == NULL || stream_frame_info->frame_pool != NULL)
+	{
+		return -1;
+	}
+	uint8_t* raw_frame = stream_frame_info->raw_frame;
+	if (stream_frame_info->camera_param.frame_size > old_config->camera_param.frame_size)
+	{
+		raw_frame = (uint8_t*)uvc_frame_buf_create(stream_frame_info->camera_param);
+		if (raw_frame == NULL)
+		{
+			return -1;
+		}
+	}
+	RingFormat_t ring_format;
+	data_ring_format(stream_frame_info, NULL, &ring_format);
+	if (ring_format_change(stream_frame_info->frame_ring, &ring_format, raw_frame) != RING_SUCCESS)
+	{
+		if (raw_frame != stream_frame_info->raw_frame)
+		{
+			uvc_frame_buf_release(raw_frame);
+		}
+		return -1;
+	}
+	//the stream's own planes only when they no longer fit the layout
+	uint8_t planes_changed = (raw_frame != stream_frame_info->raw_frame || \
+		stream_frame_info->zero_copy != old_config->zero_copy || \
+		stream_frame_info->image_byte_size > old_config->image_byte_size || \
+		stream_frame_info->temp_byte_size > old_config->temp_byte_size);
+	if (planes_changed)
+	{
+		if (!old_config->zero_copy)
+		{
+			free(stream_frame_info->image_frame);
+			free(stream_frame_info->temp_frame);
+		}
+		if (raw_frame != stream_frame_info->raw_frame)
+		{
+			uvc_frame_buf_release(stream_frame_info->raw_frame);
+			stream_frame_info->raw_frame = raw_frame;
+		}
+		data_planes_create(stream_frame_info, NULL);
+	}
+	uint32_t depth = (stream_frame_info->ring_depth > 0) ? stream_frame_info->ring_depth : FRAME_RING_DEFAULT_DEPTH;
+	uint64_t ring_bytes = (depth + 1) * data_slot_bytes(stream_frame_info);
+	mem_acct_add(MEM_CLASS_RING, (int64_t)ring_bytes - (int64_t)stream_frame_info->ring_mem_bytes);
+	stream_frame_info->ring_mem_bytes = ring_bytes;
+	StreamConfig_t* config = data_config_create(stream_frame_info);
+	config->prev = old_config;
+	stream_frame_info->config = config;
+	return 0;
+}
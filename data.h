@@ -7,23 +7,16 @@
 #include <pthread.h>
 #include "libiruvc.h"
 #include "libirtemp.h"
+#include "ring.h"
+#include "timing.h"
 
 #if defined(_WIN32)
     #include <Windows.h>
 #elif defined(linux) || defined(unix)
     #include <unistd.h>
-    #include <semaphore.h>
     #include <sys/time.h>
 #endif
-//thread's semaphore
-#if defined(_WIN32)
-    extern HANDLE image_sem, temp_sem, image_done_sem, temp_done_sem;
-#elif defined(linux) || defined(unix)
-    extern sem_t image_sem, temp_sem, image_done_sem, temp_done_sem;
-#endif
-//thread's semaphore
-
-extern uint8_t is_streaming;
+extern uint8_t is_streaming;    //set while any camera streams
 extern int stream_time;  //unit:s
 extern int fps;
 typedef enum
@@ -48,7 +41,9 @@ typedef enum
     INPUT_FMT_Y16,
     INPUT_FMT_YUV422,
     INPUT_FMT_YUV444,
-    INPUT_FMT_RGB888
+    INPUT_FMT_RGB888,
+    INPUT_FMT_Y8,                   //one byte per pixel, the low bandwidth preview plane
+    INPUT_FMT_NUM,
 }InputFormat_t;
 
 typedef enum
@@ -58,18 +53,27 @@ typedef enum
     OUTPUT_FMT_YUV444,
     OUTPUT_FMT_RGB888,
     OUTPUT_FMT_BGR888,
+    OUTPUT_FMT_BGRA32,              //4 bytes per pixel, alpha 255, for gpu uploads and compositors
+    OUTPUT_FMT_RGBA32,
+    OUTPUT_FMT_NUM,
 }OutputFormat_t;
 
 typedef enum
 {
     PSEUDO_COLOR_ON=0,
     PSEUDO_COLOR_OFF,
+    PSEUDO_COLOR_NUM,
 }PseudoColor_t;
 
 typedef enum
 {
     IMG_ENHANCE_ON = 0,
     IMG_ENHANCE_OFF,
+    IMG_ENHANCE_HIST_AGC,       //percentile clipped stretch from the previous frames' histogram
+    IMG_ENHANCE_LIB,            //y14_image_enhance of libirprocess, agc + dde, Y14 chain only
+    IMG_ENHANCE_CLAHE,          //tile adaptive histogram equalization (clahe.h), Y14 chain only
+    IMG_ENHANCE_DDE,            //histogram agc of a box base layer plus the detail with gain (dde.h), Y14 chain only
+    IMG_ENHANCE_NUM,
 }ImgEnhance_t;
 
 typedef struct {
@@ -103,6 +107,24 @@ typedef struct {
     ImgEnhance_t   img_enhance_status;
 }FrameInfo_t;
 
+//the stream's settings, copied once by create_data_demo and never written afterwards, so every thread
+//reads them without a lock. what changes per frame travels in the ring slot's FrameDesc_t, what the
+//display changes (key commands, output byte_size) stays in the display's own copy of image_info.
+//data_format_change publishes a new copy, the ones before stay until destroy_data_demo
+typedef struct StreamConfig_t {
+    CameraParam_t camera_param;
+    FrameInfo_t image_info;
+    FrameInfo_t temp_info;
+    uint32_t image_byte_size;
+    uint32_t temp_byte_size;
+    uint32_t ring_depth;
+    uint8_t zero_copy;
+    uint32_t temp_interval;
+    uint32_t info_byte_size;
+    int camera_index;
+    const struct StreamConfig_t* prev;  //the copy this one replaced, NULL for the first
+}StreamConfig_t;
+
 typedef struct {
     uint8_t* raw_frame;
     uint8_t* image_frame;
@@ -112,16 +134,48 @@ typedef struct {
     FrameInfo_t image_info;
     FrameInfo_t temp_info;
     CameraParam_t camera_param;
+    uint32_t ring_depth;        //frame ring slots, 0 selects FRAME_RING_DEFAULT_DEPTH
+    uint8_t zero_copy;          //image_frame/temp_frame are views into raw_frame, raw_data_cut is skipped
+    uint32_t temp_interval;     //the temp plane is cut every temp_interval frames, the others are FRAME_DESC_TEMP_SKIPPED
+                                //0/1 cuts every frame. not with zero_copy, the plane is in the raw frame anyway
+    uint32_t info_byte_size;    //ac020: bytes of the info line following the image and the temp plane, 0 without
+    FrameRing_t* frame_ring;    //frames between the stream thread and the display/temperature threads
+    const FrameStats_t* image_stats;    //current frame's statistics from its ring slot, NULL when not computed
+    const FrameStats_t* temp_stats;
+    const FrameTiles_t* image_tiles;    //tile signatures of the image plane, NULL when not computed
+    int camera_index;           //same_dev_index of the module among identical ones
+    volatile uint8_t is_streaming;  //this camera's stream, clearing it stops its stream thread
+    volatile uint32_t fps;          //the sensor's current rate, camera_param.fps until ir_camera_fps_set switched it
+    uint32_t capture_latency_us;    //exposure -> uvc_frame_get returning of this module, taken off desc.capture_us
+    struct FrameSource_t* frame_source; //source.h, NULL reads the open camera with uvc_frame_get
+    struct GainCtrl_t* gain_ctrl;       //gain.h, auto gain switch from the temp statistics, NULL leaves the gain alone
+    struct ExposureGuard_t* exposure_guard; //exposure.h, closes the shutter on overexposure, NULL disables it
+    struct ShutterMon_t* shutter_mon;   //shutter.h, tags the frames of shutter closes and nuc, NULL tags none
+    struct LatencyProbe_t* latency_probe;   //latency.h, glass to glass latency of the sinks, NULL measures none
+    struct Hdr_t* hdr;                  //hdr.h, dual gain fusion into the temp plane, NULL streams one gain
+    struct Housekeep_t* housekeep;      //housekeep.h, cached vtemp/shutter/lens temperatures, NULL polls none
+    struct BadPix_t* badpix;            //badpix.h, host side dead pixel correction before the statistics, NULL corrects none
+    struct Burst_t* burst;              //burst.h, capture only bursts of raw frames on a trigger, NULL takes none
+    struct DutyCycle_t* duty;           //duty.h, wake, get a result and close the stream every period, NULL streams on
+    struct FrameIntegrity_t* integrity; //integrity.h, drops frozen and torn frames and restarts the stream, NULL checks none
+    struct TempCalibCtx_t* calib;       //temperature.h, this camera's calibration context, NULL the default one
+    struct Stab_t* stab;                //stab.h, the view's jitter from the projection profiles, NULL measures none
+    FramePoolParam_t* frame_pool_param; //non-NULL: create_data_demo carves every frame out of one pinned region
+    FramePool_t* frame_pool;    //owned by create_data_demo/destroy_data_demo, NULL when the frames are on the heap
+    const StreamConfig_t* config;   //frozen by create_data_demo, NULL before
+    uint64_t ring_mem_bytes;    //ring slots registered with memacct.h by create_data_demo, may lower ring_depth
 }StreamFrameInfo_t;
 
-//initial the pthread's cond and mutex
-int init_pthread_sem();
-
-//release the pthread's cond and mutex
-int destroy_pthread_sem();
+//monotonic clock, unit:us
+uint64_t get_monotonic_us(void);
 
 //create space for getting frames
 int create_data_demo(StreamFrameInfo_t* stream_frame_info);
 
 //destroy the space
-int destroy_data_demo(StreamFrameInfo_t* stream_frame_info);
\ No newline at end of file
+int destroy_data_demo(StreamFrameInfo_t* stream_frame_info);
+
+//producer side, between two frames: the new camera_param, plane sizes and zero_copy of stream_frame_info as the
+//stream's layout. publishes a new config, reallocates the drain frame when the frame grew and hands the layout to
+//the ring, ring_format_change. -1 leaves everything as it was
+int data_format_change(StreamFrameInfo_t* stream_frame_info);
\ No newline at end of file
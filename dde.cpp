@@ -0,0 +1,148 @@
+#include "dde.h"
+#include <stdlib.h>
+#include <string.h>
+#include "simd.h"
+
+static DdeFilter_t display_dde;
+static uint8_t display_dde_inited = 0;
+
+void dde_default_param(DdeFilterParam_t* param)
+{
+    param->radius = DDE_DEFAULT_RADIUS;
+    param->gain = DDE_DEFAULT_GAIN;
+}
+
+int dde_init(DdeFilter_t* dde, const DdeFilterParam_t* param)
+{
+    if (dde == NULL || (param != NULL && (param->radius < 1 || param->radius > DDE_RADIUS_MAX || \
+        param->gain < 0)))
+    {
+        return DDE_ERROR_PARAM;
+    }
+    memset(dde, 0, sizeof(DdeFilter_t));
+    if (param != NULL)
+    {
+        dde->param = *param;
+    }
+    else
+    {
+        dde_default_param(&dde->param);
+    }
+    return DDE_SUCCESS;
+}
+
+void dde_release(DdeFilter_t* dde)
+{
+    if (dde == NULL)
+    {
+        return;
+    }
+    free(dde->row_mean);
+    free(dde->col_sum);
+    dde->row_mean = NULL;
+    dde->col_sum = NULL;
+    dde->width = 0;
+    dde->height = 0;
+}
+
+DdeFilter_t* get_display_dde(void)
+{
+    if (!display_dde_inited)
+    {
+        dde_init(&display_dde, NULL);
+        display_dde_inited = 1;
+    }
+    return &display_dde;
+}
+
+static int dde_buffers(DdeFilter_t* dde, int width, int height)
+{
+    if (dde->width == width && dde->height == height)
+    {
+        return DDE_SUCCESS;
+    }
+    uint16_t* row_mean = (uint16_t*)realloc(dde->row_mean, (size_t)width * height * sizeof(uint16_t));
+    if (row_mean == NULL)
+    {
+        return DDE_ERROR_MEM;
+    }
+    dde->row_mean = row_mean;
+    uint32_t* col_sum = (uint32_t*)realloc(dde->col_sum, width * sizeof(uint32_t));
+    if (col_sum == NULL)
+    {
+        return DDE_ERROR_MEM;
+    }
+    dde->col_sum = col_sum;
+    dde->width = width;
+    dde->height = height;
+    return DDE_SUCCESS;
+}
+
+//ceil(2^32 / n): (s * inv) >> 32 is s / n rounded down for every s the box sums reach
+static uint32_t dde_inverse(uint32_t n)
+{
+    return (uint32_t)((((uint64_t)1 << 32) + n - 1) / n);
+}
+
+int dde_process(DdeFilter_t* dde, HistAgc_t* agc, const uint16_t* src, int width, int height, uint16_t* dst)
+{
+    if (dde == NULL || agc == NULL || src == NULL || dst == NULL || src == dst || width < 1 || height < 1)
+    {
+        return DDE_ERROR_PARAM;
+    }
+    int rst = dde_buffers(dde, width, height);
+    if (rst != DDE_SUCCESS)
+    {
+        return rst;
+    }
+    int pix_num = width * height;
+    int radius = dde->param.radius;
+    uint32_t n = 2 * radius + 1;
+    uint32_t inv = dde_inverse(n);
+    const uint16_t* lut = hist_agc_prepare(agc, (uint16_t*)src, pix_num, 0);
+    float gain = dde->param.gain * hist_agc_slope(agc);
+    gain = (gain < DDE_GAIN_MAX) ? gain : DDE_GAIN_MAX;
+    int32_t gain_q8 = (int32_t)(gain * 256 + 0.5f);
+
+    //row pass with the edge pixels repeated, Q2 means rounded. the agc's histogram of this frame on the way
+    uint32_t* hist = agc->hist;
+    for (int y = 0; y < height; y++)
+    {
+        const uint16_t* row = src + y * width;
+        uint16_t* mean = dde->row_mean + y * width;
+        uint32_t sum = (radius + 1) * row[0];
+        for (int k = 1; k <= radius; k++)
+        {
+            sum += row[(k < width) ? k : width - 1];
+        }
+        for (int x = 0; x < width; x++)
+        {
+            uint32_t v = row[x];
+            hist[(v > HIST_AGC_BINS - 1) ? HIST_AGC_BINS - 1 : v]++;
+            mean[x] = (uint16_t)(((uint64_t)(sum * 4 + n / 2) * inv) >> 32);
+            int in = x + radius + 1, out = x - radius;
+            sum += row[(in < width) ? in : width - 1];
+            sum -= row[(out > 0) ? out : 0];
+        }
+    }
+
+    //column pass, the running sum slides down a row per output row
+    uint32_t* col_sum = dde->col_sum;
+    memset(col_sum, 0, width * sizeof(uint32_t));
+    for (int k = -radius; k <= radius; k++)
+    {
+        simd_accumulate_u16(dde->row_mean + ((k < 0) ? 0 : ((k < height) ? k : height - 1)) * width, width, col_sum);
+    }
+    for (int y = 0; y < height; y++)
+    {
+        simd_dde_u16(src + y * width, col_sum, width, inv, lut, HIST_AGC_BINS, gain_q8, dst + y * width);
+        if (y + 1 < height)
+        {
+            int in = y + radius + 1, out = y - radius;
+            simd_window_u16(dde->row_mean + ((in < height) ? in : height - 1) * width, \
+                dde->row_mean + ((out > 0) ? out : 0) * width, width, col_sum);
+        }
+    }
+    hist_agc_commit(agc, pix_num);
+    return DDE_SUCCESS;
+}
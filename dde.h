@@ -0,0 +1,49 @@
+#ifndef _DDE_H_
+#define _DDE_H_
+
+//digital detail enhancement on the host: a (2 * radius + 1)^2 box mean of the Y14 frame is the base layer, the
+//frame minus it the detail layer. the base goes through the histogram agc's lut (agc.h) and the detail is added
+//back with gain, scaled by the lut's slope so small details keep gain times their share of the output range.
+//the box is two running sums (a row pass and a column pass of simd_window_u16), its cost does not depend on the
+//radius, and the column pass's sums feed simd_dde_u16 straight, the base is never stored
+#include <stdint.h>
+#include "agc.h"
+
+#define DDE_RADIUS_MAX 8
+#define DDE_DEFAULT_RADIUS 2            //5x5 base, what the vendor's dde thresholds are tuned around
+#define DDE_DEFAULT_GAIN 2.0f           //like DdeParam_t.maxCoef of img_enhance_default_param
+#define DDE_GAIN_MAX 127.0f             //gain * slope, keeps the Q8 product of simd_dde_u16 in 32 bits
+
+#define DDE_SUCCESS 0
+#define DDE_ERROR_PARAM -1
+#define DDE_ERROR_MEM -2
+
+typedef struct {
+    uint8_t radius;                     //1..DDE_RADIUS_MAX
+    float gain;                         //detail gain in output units per agc-mapped unit, 1 keeps the detail
+}DdeFilterParam_t;
+
+typedef struct {
+    DdeFilterParam_t param;
+    int width;                          //the frame the buffers are for
+    int height;
+    uint16_t* row_mean;                 //row pass, Q2 horizontal box means of the whole frame
+    uint32_t* col_sum;                  //column pass, running sum of row_mean over the vertical box
+}DdeFilter_t;
+
+//DDE_DEFAULT_RADIUS, DDE_DEFAULT_GAIN
+void dde_default_param(DdeFilterParam_t* param);
+
+//param NULL selects the defaults
+int dde_init(DdeFilter_t* dde, const DdeFilterParam_t* param);
+
+void dde_release(DdeFilter_t* dde);
+
+//the dde state used by the display pipeline
+DdeFilter_t* get_display_dde(void);
+
+//one pass like hist_agc_process: the base is mapped through the previous frames' lut while the row pass
+//builds this frame's histogram, then the agc commits. src Y14, src and dst must differ
+int dde_process(DdeFilter_t* dde, HistAgc_t* agc, const uint16_t* src, int width, int height, uint16_t* dst);
+
+#endif
@@ -1,8 +1,14 @@
 #include "display.h"
+#include "trace.h"
+#include "log.h"
+#include "rtsched.h"
+#include "latency.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
+#include <math.h>
+#include <assert.h>
 #include "libiruvc.h"
 #ifdef THERMAL_CAM_CMD
 #include "thermal_cam_cmd.h"
@@ -15,6 +21,93 @@ uint8_t* image_tmp_frame2 = NULL;
 // 人体分割模式开关
 uint8_t human_segmentation_enabled = 0;
 
+uint8_t fused_color_enabled = 1;
+uint8_t fused_transform_enabled = 1;
+uint8_t display_band_num = 1;
+ZoomView_t display_zoom_view = { 1.0f, 0.5f, 0.5f, ZOOM_SAMPLE_BILINEAR };
+uint8_t display_nr_mode = DISPLAY_NR_OFF;
+uint8_t display_tile_reuse = 0;
+uint32_t display_tile_tolerance = FRAME_TILES_DEFAULT_TOLERANCE;
+const char* display_palette_dir = NULL;
+uint8_t display_upscale_factor = 1;
+uint8_t display_upscale_mode = UPSCALE_BICUBIC;
+uint8_t display_gpu_enabled = 0;
+uint32_t display_gpu_verify_interval = 300;
+uint8_t display_pacing_depth = 0;
+#ifdef DISPLAY_WINDOW
+DisplaySinkParam_t display_sink_param = { DISPLAY_SINK_WINDOW };
+#elif defined(_WIN32)
+DisplaySinkParam_t display_sink_param = { DISPLAY_SINK_D3D11 };
+#else
+DisplaySinkParam_t display_sink_param = { DISPLAY_SINK_NULL };
+#endif
+static DisplaySink_t display_sink;
+static uint16_t* display_nr_frame = NULL;    //the noise reduced frame, same format as the ring slot
+static uint8_t display_nr_last_mode = DISPLAY_NR_OFF;
+static AccumWindow_t display_nr_window;     //DISPLAY_NR_AVERAGE history, allocated by its first frame
+static uint32_t* display_band_hist = NULL;   //DISPLAY_BAND_MAX partial histograms for the hist agc bands
+static Overlay_t display_overlay;            //fps/temperature/status text of the window, blended every frame
+static Overlay_t display_label_overlay;      //color bar labels, blended when the temperature range changes
+static uint8_t display_overlay_inited = 0;
+static Upscale_t display_upscale;
+static ZoomMap_t display_zoom_map;
+static FrameInfo_t display_image_info;       //ring frames: the config's image_info as the commands changed it
+static uint8_t display_image_info_set = 0;
+static Arena_t display_arena;                //per-frame scratch, reset by display_one_frame
+typedef struct {
+	int begin;                               //pixel index of the span's first pixel
+	int end;
+}DisplaySpan_t;
+static pthread_mutex_t display_window_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Area_t display_window_pending[DISPLAY_WINDOW_MAX];   //display_window_set's copy, under the mutex
+static int display_window_pending_num = 0;
+static uint32_t display_window_pending_interval = 0;
+static std::atomic<uint32_t> display_window_gen(0);
+static uint32_t display_window_applied_gen = 0;
+static int display_window_num = 0;          //the display thread's copy from here on
+static uint32_t display_window_interval = 0;
+static DisplaySpan_t* display_window_spans = NULL;   //merged row spans of the windows, height * DISPLAY_WINDOW_MAX
+static int display_window_span_num = 0;
+static int display_window_pix_num = 0;
+static uint8_t* display_window_frame = NULL;  //the shown BGR888 frame before transform, windows update it in place
+static uint8_t display_window_valid = 0;     //display_window_frame holds a full refresh of the current settings
+static uint32_t display_window_frames = 0;   //frames since the last full refresh
+static DisplaySpan_t* display_tile_spans = NULL;     //changed tile pieces, height * (DISPLAY_WINDOW_MAX + tile columns)
+static pthread_mutex_t display_isotherm_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DisplayIsotherm_t display_isotherm_pending[DISPLAY_ISOTHERM_MAX];   //display_isotherm_set's copy, under the mutex
+static int display_isotherm_pending_num = 0;
+static std::atomic<uint32_t> display_isotherm_gen(0);
+static uint32_t display_isotherm_applied_gen = 0;
+static DisplayIsotherm_t display_isotherm_bands[DISPLAY_ISOTHERM_MAX];     //the display thread's copy from here on
+static int display_isotherm_num = 0;
+static Palette_t* display_isotherm_palette = NULL;   //base palette with the bands painted, allocated by the first band
+static const Palette_t* display_isotherm_base = NULL;
+static uint16_t display_isotherm_low[DISPLAY_ISOTHERM_MAX];    //lut ranges painted into display_isotherm_palette
+static uint16_t display_isotherm_high[DISPLAY_ISOTHERM_MAX];
+static int display_isotherm_painted = 0;
+static const Palette_t* display_palette_cur = NULL;  //the frame's palette, the active one or display_isotherm_palette
+static uint32_t display_palette_version = 0;         //bumped when display_isotherm_palette is repainted
+static Segment_t display_segment;            //human segmentation blobs, sized by its first frame
+static pthread_mutex_t display_segment_mutex = PTHREAD_MUTEX_INITIALIZER;
+static SegmentBlob_t display_segment_blobs[SEGMENT_MAX_BLOBS];   //the last frame's blobs for display_human_blobs_get
+static int display_segment_blob_num = 0;
+static uint64_t display_segment_frames = 0;
+static const Palette_t* display_palette_get(void)
+{
+	return (display_palette_cur != NULL) ? display_palette_cur : palette_active();
+}
+Arena_t* get_display_arena(void)
+{
+	return &display_arena;
+}
+#ifdef ARENA_HEAP_CHECK
+static uint32_t display_heap_steady = 0;     //frames since the last reconfiguration or arena growth
+#endif
+uint8_t host_temp_range_enabled = 1;
+uint32_t fw_temp_check_interval = 250;
+
+#define FW_TEMP_CHECK_TOLERANCE 1.0f	// 主机端与固件最高/最低温度相差超过该值(°C)时打印
+
 // 颜色条参数
 #define COLOR_BAR_WIDTH 40        // 颜色条宽度
 #define COLOR_BAR_HEIGHT 256      // 颜色条高度
@@ -53,12 +146,44 @@ void display_init(StreamFrameInfo_t* stream_frame_info)
 	// start timers (use global variables, not local)
 	timer0 = time(NULL);
 	timer1 = timer0;
+	printf("display simd level: %s\n", simd_level_name(simd_level_get()));
+	// 启动时生成全部调色板，之后切换调色板不做逐帧的调色板计算
+	palette_init();
+	if (display_palette_dir != NULL)
+	{
+		printf("display: %d user palettes from %s\n", palette_load_user_dir(display_palette_dir), display_palette_dir);
+	}
+
+	// 字形在启动时栅格化一次，之后每帧只混合变化过的字符串
+	if (!display_overlay_inited && overlay_init(&display_overlay) == OVERLAY_SUCCESS && \
+		overlay_init(&display_label_overlay) == OVERLAY_SUCCESS)
+	{
+		display_overlay_inited = 1;
+	}
+	if (display_gpu_enabled && gpu_init() != GPU_SUCCESS)
+	{
+		printf("display: gpu unavailable, colorize stays on the cpu\n");
+	}
+	// 输出端打不开时退回空输出端，处理流程照常运行
+	if (!display_sink.opened)
+	{
+		int sink_rst = display_sink_open(&display_sink, &display_sink_param);
+		if (sink_rst != SINK_SUCCESS)
+		{
+			printf("display: %s sink unavailable (%d), frames are dropped\n", \
+				display_sink_name(display_sink_param.type), sink_rst);
+			DisplaySinkParam_t null_param = { DISPLAY_SINK_NULL };
+			display_sink_open(&display_sink, &null_param);
+		}
+		printf("display sink: %s\n", display_sink_name(display_sink.param.type));
+	}
 
 	int pixel_size = stream_frame_info->image_info.width * stream_frame_info->image_info.height;
-	// allocate temporary buffers: worst-case 3 bytes per pixel for RGB/BGR or 2 for Y14
+	// allocate temporary buffers: worst-case 4 bytes per pixel for BGRA/RGBA, 3 for RGB/BGR or 2 for Y14
+	// cache line aligned for the simd kernels; per-frame scratch of other sizes comes from display_arena
 	if (image_tmp_frame1 == NULL)
 	{
-		image_tmp_frame1 = (uint8_t*)malloc((size_t)pixel_size * 3);
+		image_tmp_frame1 = (uint8_t*)arena_aligned_alloc((size_t)pixel_size * 4);
 		if (image_tmp_frame1 == NULL) {
 			fprintf(stderr, "display_init: failed to allocate image_tmp_frame1\n");
 			return;
@@ -67,15 +192,49 @@ void display_init(StreamFrameInfo_t* stream_frame_info)
 
 	if (image_tmp_frame2 == NULL)
 	{
-		image_tmp_frame2 = (uint8_t*)malloc((size_t)pixel_size * 3);
+		image_tmp_frame2 = (uint8_t*)arena_aligned_alloc((size_t)pixel_size * 4);
 		if (image_tmp_frame2 == NULL) {
 			fprintf(stderr, "display_init: failed to allocate image_tmp_frame2\n");
 			// free previous to avoid leak
-			free(image_tmp_frame1);
+			arena_aligned_free(image_tmp_frame1);
 			image_tmp_frame1 = NULL;
 			return;
 		}
 	}
+
+	if (display_nr_frame == NULL)
+	{
+		display_nr_frame = (uint16_t*)arena_aligned_alloc((size_t)pixel_size * sizeof(uint16_t));
+		if (display_nr_frame == NULL) {
+			fprintf(stderr, "display_init: failed to allocate display_nr_frame\n");
+		}
+	}
+
+	// 关注区域：窗口外的画面保留上一次整帧刷新的结果，缓冲区在启动时一次分配
+	if (display_window_frame == NULL)
+	{
+		display_window_frame = (uint8_t*)arena_aligned_alloc((size_t)pixel_size * 3);
+		display_window_spans = (DisplaySpan_t*)malloc((size_t)stream_frame_info->image_info.height * \
+			DISPLAY_WINDOW_MAX * sizeof(DisplaySpan_t));
+		int tile_cols = (stream_frame_info->image_info.width + FRAME_TILES_SIZE - 1) / FRAME_TILES_SIZE;
+		display_tile_spans = (DisplaySpan_t*)malloc((size_t)stream_frame_info->image_info.height * \
+			(DISPLAY_WINDOW_MAX + tile_cols) * sizeof(DisplaySpan_t));
+		if (display_window_frame == NULL || display_window_spans == NULL || display_tile_spans == NULL) {
+			fprintf(stderr, "display_init: failed to allocate the window buffers, windows are ignored\n");
+			arena_aligned_free(display_window_frame);
+			display_window_frame = NULL;
+			free(display_window_spans);
+			display_window_spans = NULL;
+			free(display_tile_spans);
+			display_tile_spans = NULL;
+		}
+	}
+	display_window_valid = 0;
+}
+
+void display_sink_stats_get(DisplaySinkStats_t* stats)
+{
+	display_sink_stats(&display_sink, stats);
 }
 
 //recyle the display parameters
@@ -85,193 +244,523 @@ void display_release(void)
 
 	if (image_tmp_frame1 != NULL)
 	{
-		free(image_tmp_frame1);
+		arena_aligned_free(image_tmp_frame1);
 		image_tmp_frame1 = NULL;
 	}
 
 	if (image_tmp_frame2 != NULL)
 	{
-		free(image_tmp_frame2);
+		arena_aligned_free(image_tmp_frame2);
 		image_tmp_frame2 = NULL;
 	}
+
+	free(display_band_hist);
+	display_band_hist = NULL;
+	arena_aligned_free(display_nr_frame);
+	display_nr_frame = NULL;
+	accum_window_release(&display_nr_window);
+	arena_aligned_free(display_window_frame);
+	display_window_frame = NULL;
+	free(display_window_spans);
+	display_window_spans = NULL;
+	free(display_tile_spans);
+	display_tile_spans = NULL;
+	display_window_span_num = 0;
+	display_window_valid = 0;
+	display_window_applied_gen = 0;
+	free(display_isotherm_palette);
+	display_isotherm_palette = NULL;
+	display_isotherm_base = NULL;
+	display_isotherm_painted = 0;
+	display_isotherm_applied_gen = 0;
+	display_palette_cur = NULL;
+	segment_release(&display_segment);
+	pthread_mutex_lock(&display_segment_mutex);
+	display_segment_blob_num = 0;
+	pthread_mutex_unlock(&display_segment_mutex);
+	tnr_release(get_display_tnr());
+	gpu_release();
+	display_sink_close(&display_sink);
+	overlay_release(&display_overlay);
+	overlay_release(&display_label_overlay);
+	overlay_atlas_release();
+	display_overlay_inited = 0;
+	display_image_info_set = 0;
+	upscale_release(&display_upscale);
+	memset(&display_upscale, 0, sizeof(Upscale_t));
+	zoom_map_release(&display_zoom_map);
+	arena_release(&display_arena);
+	temp_span_release();
+	colorize_lut_release();
 }
 
-//enhance the image frame by the frameinfo
-int enhance_image_frame(uint16_t* src_frame, FrameInfo_t* frameinfo, uint16_t* dst_frame)
+//min/max linear stretch to the full Y14 range
+static int enhance_stretch(uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, const FrameStats_t* src_stats, \
+	uint16_t* dst_frame)
 {
-	int pix_num = frameinfo->width * frameinfo->height;
-	
-	// 未标定时，直接复制原始数据，不做温度增强
-	if (frameinfo->img_enhance_status == IMG_ENHANCE_ON)
+	// 找到实际数据范围
+	uint16_t min_val = 65535, max_val = 0;
+	if (src_stats != NULL && src_stats->valid)
 	{
-		// 找到实际数据范围
-		uint16_t min_val = 65535, max_val = 0;
-		for (int i = 0; i < pix_num; i++)
-		{
-			if (src_frame[i] < min_val) min_val = src_frame[i];
-			if (src_frame[i] > max_val) max_val = src_frame[i];
-		}
-		
-		// 简单的线性拉伸到全范围
-		for (int i = 0; i < pix_num; i++)
-		{
-			if (max_val > min_val)
-			{
-				dst_frame[i] = ((src_frame[i] - min_val) * 16383) / (max_val - min_val);
-			}
-			else
-			{
-				dst_frame[i] = src_frame[i];
-			}
-		}
+		// stream线程已统计过，y16_to_y14只去掉低两位，顺序不变
+		int shift = (frameinfo->input_format == INPUT_FMT_Y16) ? 2 : 0;
+		min_val = src_stats->min_val >> shift;
+		max_val = src_stats->max_val >> shift;
 	}
 	else
+	{
+		simd_minmax_u16(src_frame, pix_num, &min_val, &max_val);
+	}
+	
+	// 简单的线性拉伸到全范围
+	if (max_val > min_val)
+	{
+		simd_stretch_u16(src_frame, pix_num, min_val, max_val - min_val, dst_frame);
+	}
+	else if (dst_frame != src_frame)
+	{
+		memcpy(dst_frame, src_frame, pix_num * 2);
+	}
+	return 0;
+}
+
+// 未标定时，直接复制原始数据，不做温度增强
+static int enhance_off(uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, const FrameStats_t* src_stats, \
+	uint16_t* dst_frame)
+{
+	if (dst_frame != src_frame)
 	{
 		memcpy(dst_frame, src_frame, pix_num * 2);
 	}
 	return 0;
 }
 
+// 直方图AGC：用前几帧的映射拉伸本帧，同一遍统计本帧直方图供下一帧使用
+static int enhance_hist_agc(uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, const FrameStats_t* src_stats, \
+	uint16_t* dst_frame)
+{
+	return hist_agc_process(get_display_hist_agc(), src_frame, pix_num, 0, dst_frame);
+}
+
+// 库函数增强：AGC加DDE细节增强，src不被修改
+static int enhance_lib(uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, const FrameStats_t* src_stats, \
+	uint16_t* dst_frame)
+{
+	ImageRes_t image_res = { frameinfo->width,frameinfo->height };
+	if (y14_image_enhance(src_frame, image_res, *get_display_img_enhance_param(), dst_frame) != IRPROC_SUCCESS)
+	{
+		return enhance_stretch(src_frame, pix_num, frameinfo, src_stats, dst_frame);
+	}
+	return 0;
+}
+
+// CLAHE：分块直方图均衡，块内直方图限幅后生成映射，按像素位置在相邻四块映射间双线性插值
+static int enhance_clahe(uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, const FrameStats_t* src_stats, \
+	uint16_t* dst_frame)
+{
+	uint16_t min_val = 65535, max_val = 0;
+	if (src_stats != NULL && src_stats->valid)
+	{
+		int shift = (frameinfo->input_format == INPUT_FMT_Y16) ? 2 : 0;
+		min_val = src_stats->min_val >> shift;
+		max_val = src_stats->max_val >> shift;
+	}
+	else
+	{
+		simd_minmax_u16(src_frame, pix_num, &min_val, &max_val);
+	}
+	int band_num = pool_worker_num();
+	band_num = (band_num > BAND_MAX_NUM) ? BAND_MAX_NUM : ((band_num > 0) ? band_num : 1);
+	if (max_val <= min_val || clahe_process(get_display_clahe(), src_frame, frameinfo->width, frameinfo->height, \
+		min_val, max_val, dst_frame, band_num) != CLAHE_SUCCESS)
+	{
+		return enhance_stretch(src_frame, pix_num, frameinfo, src_stats, dst_frame);
+	}
+	return 0;
+}
+
+// DDE：盒式均值为基础层，经直方图AGC映射后加回增益放大的细节层，与AGC查表在同一遍完成
+static int enhance_dde(uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, const FrameStats_t* src_stats, \
+	uint16_t* dst_frame)
+{
+	if (dde_process(get_display_dde(), get_display_hist_agc(), src_frame, frameinfo->width, frameinfo->height, \
+		dst_frame) != DDE_SUCCESS)
+	{
+		return enhance_hist_agc(src_frame, pix_num, frameinfo, src_stats, dst_frame);
+	}
+	return 0;
+}
+
+typedef int (*EnhanceFunc_t)(uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, const FrameStats_t* src_stats, \
+	uint16_t* dst_frame);
+
+typedef struct {
+	const char* name;
+	EnhanceFunc_t func;
+	TimingStage_t stage;	// TIMING_STAGE_NUM: not timed
+}EnhanceStage_t;
+
+//indexed by ImgEnhance_t
+static const EnhanceStage_t enhance_stages[IMG_ENHANCE_NUM] = {
+	{ "min/max stretch", enhance_stretch, TIMING_STAGE_ENHANCE_STRETCH },
+	{ "off", enhance_off, TIMING_STAGE_NUM },
+	{ "histogram agc", enhance_hist_agc, TIMING_STAGE_ENHANCE_HIST_AGC },
+	{ "library agc+dde", enhance_lib, TIMING_STAGE_ENHANCE_LIB },
+	{ "clahe", enhance_clahe, TIMING_STAGE_ENHANCE_CLAHE },
+	{ "histogram agc+dde", enhance_dde, TIMING_STAGE_ENHANCE_DDE },
+};
+
+const char* enhance_name(ImgEnhance_t enhance)
+{
+	if ((int)enhance < 0 || enhance >= IMG_ENHANCE_NUM)
+	{
+		return "unknown";
+	}
+	return enhance_stages[enhance].name;
+}
+
+//enhance the image frame by the frameinfo, src_stats belongs to the frame before y16_to_y14
+int enhance_image_frame(uint16_t* src_frame, FrameInfo_t* frameinfo, const FrameStats_t* src_stats, \
+	uint16_t* dst_frame)
+{
+	int pix_num = frameinfo->width * frameinfo->height;
+	ImgEnhance_t enhance = frameinfo->img_enhance_status;
+	if ((int)enhance < 0 || enhance >= IMG_ENHANCE_NUM)
+	{
+		enhance = IMG_ENHANCE_OFF;
+	}
+	const EnhanceStage_t* stage = &enhance_stages[enhance];
+	if (stage->stage == TIMING_STAGE_NUM)
+	{
+		return stage->func(src_frame, pix_num, frameinfo, src_stats, dst_frame);
+	}
+	uint64_t start_us = timing_start();
+	int ret = stage->func(src_frame, pix_num, frameinfo, src_stats, dst_frame);
+	timing_record_since(stage->stage, start_us);
+	return ret;
+}
+
+//bytes per pixel of the processed frame
+static inline int display_output_bpp(OutputFormat_t output_format)
+{
+	if (output_format == OUTPUT_FMT_BGRA32 || output_format == OUTPUT_FMT_RGBA32)
+	{
+		return 4;
+	}
+	return (output_format == OUTPUT_FMT_Y14 || output_format == OUTPUT_FMT_YUV422) ? 2 : 3;
+}
+
+//the formats the fused colorize paths write, the plan's lut switched to the 4 byte ones
+static inline int display_output_fused(OutputFormat_t output_format)
+{
+	return output_format == OUTPUT_FMT_BGR888 || output_format == OUTPUT_FMT_BGRA32 || \
+		output_format == OUTPUT_FMT_RGBA32;
+}
+
+//the palette's lut of a packed output format
+static inline const uint8_t* display_palette_lut(const Palette_t* palette, OutputFormat_t output_format)
+{
+	switch (output_format)
+	{
+	case OUTPUT_FMT_RGB888: return palette->rgb;
+	case OUTPUT_FMT_BGRA32: return palette->bgra;
+	case OUTPUT_FMT_RGBA32: return palette->rgba;
+	default: return palette->bgr;
+	}
+}
+
+//rgb888 widened to 4 byte pixels with alpha 255, swap exchanges r and b for bgra. the last pixel goes first,
+//so dst may be rgb itself
+static void display_rgb_to_rgba32(const uint8_t* rgb, int pix_num, int swap, uint8_t* dst)
+{
+	for (int i = pix_num - 1; i >= 0; i--)
+	{
+		uint8_t r = rgb[i * 3], g = rgb[i * 3 + 1], b = rgb[i * 3 + 2];
+		dst[i * 4] = (swap) ? b : r;
+		dst[i * 4 + 1] = g;
+		dst[i * 4 + 2] = (swap) ? r : b;
+		dst[i * 4 + 3] = 255;
+	}
+}
+
+//4 byte pixels back to bgr888 for the window and the sinks, swap for rgba
+static void display_rgba32_to_bgr(const uint8_t* src, int pix_num, int swap, uint8_t* dst)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		dst[i * 3] = src[i * 4 + ((swap) ? 2 : 0)];
+		dst[i * 3 + 1] = src[i * 4 + 1];
+		dst[i * 3 + 2] = src[i * 4 + ((swap) ? 0 : 2)];
+	}
+}
+
+//enhance stage fixed at compile time, the table entry folds into a direct call
+template <ImgEnhance_t ENHANCE>
+static inline void enhance_image_frame_fixed(uint16_t* src_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const FrameStats_t* src_stats, uint16_t* dst_frame)
+{
+	const EnhanceStage_t* stage = &enhance_stages[ENHANCE];
+	if (stage->stage == TIMING_STAGE_NUM)
+	{
+		stage->func(src_frame, pix_num, frameinfo, src_stats, dst_frame);
+		return;
+	}
+	uint64_t start_us = timing_start();
+	stage->func(src_frame, pix_num, frameinfo, src_stats, dst_frame);
+	timing_record_since(stage->stage, start_us);
+}
+
 //color the image frame
 // src_frame: input Y14 buffer (uint8_t* but interpreted as uint16_t* when Y14)
-// dst_frame: output buffer (size depends on frameinfo->output_format)
-void color_image_frame(uint8_t* src_frame, FrameInfo_t* frameinfo, uint8_t* dst_frame)
+// dst_frame: output buffer, OUT is YUV422, RGB888, BGR888, BGRA32 or RGBA32
+template <OutputFormat_t OUT>
+static inline void color_image_frame(uint8_t* src_frame, int pix_num, uint8_t* dst_frame)
 {
-	int pix_num = frameinfo->width * frameinfo->height;
+	const Palette_t* palette = display_palette_get();
+	if (palette == NULL)
+	{
+		return;
+	}
 
-	// we expect src_frame to be Y14 (2 bytes per pixel)
-	// we will first map Y14 -> YUYV pseudocolor (YUV422, 2 bytes per pixel),
-	// then convert to RGB/BGR if needed
-	switch (frameinfo->output_format)
+	// 调色板的查找表在启动时已生成，这里只查表；关闭融合时库函数流程作为对照（用户调色板和等温色带库函数无法生成）
+	if (fused_color_enabled || palette->user || palette == display_isotherm_palette)
 	{
-	case OUTPUT_FMT_YUV422:
-		// YUV422 destination: map directly to YUYV pseudocolor
-		// byte_size = pix_num * 2
-		y14_map_to_yuyv_pseudocolor((uint16_t*)src_frame, pix_num, IRPROC_COLOR_MODE_3, dst_frame);
-		frameinfo->byte_size = pix_num * 2;
-		break;
+		if (OUT == OUTPUT_FMT_YUV422)
+		{
+			palette_map_yuyv(palette, (uint16_t*)src_frame, pix_num, dst_frame);
+		}
+		else
+		{
+			palette_map(display_palette_lut(palette, OUT), display_output_bpp(OUT), (uint16_t*)src_frame, \
+				pix_num, dst_frame);
+		}
+		return;
+	}
 
-	case OUTPUT_FMT_RGB888:
-		// map to YUYV pseudocolor first, then convert to RGB
-		// image_tmp_frame2 will hold YUV422 (pix_num * 2)
-		y14_map_to_yuyv_pseudocolor((uint16_t*)src_frame, pix_num, IRPROC_COLOR_MODE_3, image_tmp_frame2);
-		// convert YUV422 -> RGB888
+	// map Y14 -> YUYV pseudocolor (YUV422, 2 bytes per pixel), then convert to RGB/BGR if needed
+	if (OUT == OUTPUT_FMT_YUV422)
+	{
+		y14_map_to_yuyv_pseudocolor((uint16_t*)src_frame, pix_num, palette->color_mode, dst_frame);
+	}
+	else if (OUT == OUTPUT_FMT_RGB888)
+	{
+		// image_tmp_frame2 holds YUV422 (pix_num * 2)
+		y14_map_to_yuyv_pseudocolor((uint16_t*)src_frame, pix_num, palette->color_mode, image_tmp_frame2);
 		yuv422_to_rgb((uint8_t*)image_tmp_frame2, pix_num, dst_frame);
-		frameinfo->byte_size = pix_num * 3;
-		break;
-
-	case OUTPUT_FMT_BGR888:
-	default:
-		// map to YUYV pseudocolor first, convert to RGB then swap channels to BGR
-		y14_map_to_yuyv_pseudocolor((uint16_t*)src_frame, pix_num, IRPROC_COLOR_MODE_6, image_tmp_frame2);
+	}
+	else if (OUT == OUTPUT_FMT_BGRA32 || OUT == OUTPUT_FMT_RGBA32)
+	{
+		y14_map_to_yuyv_pseudocolor((uint16_t*)src_frame, pix_num, palette->color_mode, image_tmp_frame2);
+		yuv422_to_rgb((uint8_t*)image_tmp_frame2, pix_num, image_tmp_frame1);
+		display_rgb_to_rgba32(image_tmp_frame1, pix_num, OUT == OUTPUT_FMT_BGRA32, dst_frame);
+	}
+	else
+	{
+		// convert to RGB then swap channels to BGR
+		y14_map_to_yuyv_pseudocolor((uint16_t*)src_frame, pix_num, palette->color_mode, image_tmp_frame2);
 		yuv422_to_rgb((uint8_t*)image_tmp_frame2, pix_num, image_tmp_frame1); // temp rgb in image_tmp_frame1
 		rgb_to_bgr(image_tmp_frame1, pix_num, dst_frame);
-		frameinfo->byte_size = pix_num * 3;
-		break;
 	}
 }
 
-//convert the image process  image_tmp_frame2 is the default output frame
-void display_image_process(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo)
+//one (input, output, pseudocolor, enhance) combination of the display chain, every format test is a
+//template constant so each instance compiles to the straight line of kernels for its combination.
+//the fused toggle and the active palette stay runtime switches, the commands flip them while streaming
+template <InputFormat_t IN, OutputFormat_t OUT, PseudoColor_t COLOR, ImgEnhance_t ENHANCE>
+static void display_pipeline(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const FrameStats_t* image_stats)
 {
-	ImageRes_t image_res = { frameinfo->width,frameinfo->height };
-	if (frameinfo->input_format == INPUT_FMT_Y14 || frameinfo->input_format == INPUT_FMT_Y16)
+	frameinfo->byte_size = pix_num * display_output_bpp(OUT);
+	if (IN == INPUT_FMT_YUV422)
 	{
-		if (frameinfo->input_format == INPUT_FMT_Y16)
+		// yuv422 input is passed through or converted, pseudocolor and enhance do not apply
+		if (OUT == OUTPUT_FMT_YUV422)
 		{
-			// convert in-place Y16 -> Y14
-			y16_to_y14((uint16_t*)image_frame, pix_num, (uint16_t*)image_frame);
+			memcpy(image_tmp_frame2, image_frame, pix_num * 2);
 		}
-
-		// enhance (src -> image_tmp_frame1 as Y14)
-		enhance_image_frame((uint16_t*)image_frame, frameinfo, (uint16_t*)image_tmp_frame1);
-
-		// If pseudo color is enabled, handle via color_image_frame()
-		if (frameinfo->pseudo_color_status == PSEUDO_COLOR_ON)
+		else if (OUT == OUTPUT_FMT_RGB888)
 		{
-			// color_image_frame will write final bytes into image_tmp_frame2 (or dst)
-			color_image_frame(image_tmp_frame1, frameinfo, image_tmp_frame2);
-			return;
+			yuv422_to_rgb((uint8_t*)image_frame, pix_num, image_tmp_frame2);
+		}
+		else if (OUT == OUTPUT_FMT_BGRA32 || OUT == OUTPUT_FMT_RGBA32)
+		{
+			yuv422_to_rgb((uint8_t*)image_frame, pix_num, image_tmp_frame2);
+			display_rgb_to_rgba32(image_tmp_frame2, pix_num, OUT == OUTPUT_FMT_BGRA32, image_tmp_frame2);
 		}
+		else
+		{
+			yuv422_to_rgb((uint8_t*)image_frame, pix_num, image_tmp_frame1);
+			rgb_to_bgr(image_tmp_frame1, pix_num, image_tmp_frame2);
+		}
+		return;
+	}
 
-		// non-pseudocolor paths
-		switch (frameinfo->output_format)
+	if (IN == INPUT_FMT_Y8)
+	{
+		// y8 was stretched at the cut, enhance does not apply. the palette luts are indexed per byte,
+		// everything else widens the byte back to Y14 and shares the chain below
+		const Palette_t* palette = display_palette_get();
+		if (COLOR == PSEUDO_COLOR_ON && palette != NULL && \
+			(fused_color_enabled || palette->user || palette == display_isotherm_palette) && \
+			OUT != OUTPUT_FMT_Y14 && OUT != OUTPUT_FMT_YUV444)
 		{
-			case OUTPUT_FMT_Y14:
-			{
-				frameinfo->byte_size = pix_num * 2;
-				memcpy(image_tmp_frame2, image_tmp_frame1, frameinfo->byte_size);
-				break;
-			}
-			case OUTPUT_FMT_YUV444:
-			{
-				frameinfo->byte_size = pix_num * 3;
-				y14_to_yuv444((uint16_t *)image_tmp_frame1, pix_num, (uint8_t*)image_tmp_frame2);
-				break;
-			}
-			case OUTPUT_FMT_YUV422:
-			{
-				frameinfo->byte_size = pix_num * 2;
-				// no pseudo color: convert y14 -> yuv444 -> yuv422 (reuse tmp buffers)
-				y14_to_yuv444((uint16_t*)image_tmp_frame1, pix_num, (uint8_t*)image_tmp_frame2);
-				memcpy(image_tmp_frame1, image_tmp_frame2, frameinfo->byte_size); // NOTE: here byte_size is pix_num*2 (not exact for yuv444), but keep logic similar to original
-				yuv444_to_yuv422((uint8_t*)image_tmp_frame1, pix_num, (uint8_t*)image_tmp_frame2);
-				break;
-			}
-			case OUTPUT_FMT_RGB888:
+			if (OUT == OUTPUT_FMT_YUV422)
 			{
-				frameinfo->byte_size = pix_num * 3;
-				y14_to_rgb((uint16_t*)image_tmp_frame1, pix_num, image_tmp_frame2);
-				break;
+				palette_map8_yuyv(palette, image_frame, pix_num, image_tmp_frame2);
 			}
-			case OUTPUT_FMT_BGR888:
-			default:
+			else
 			{
-				frameinfo->byte_size = pix_num * 3;
-				y14_to_rgb((uint16_t*)image_tmp_frame1, pix_num, image_tmp_frame2);
-				rgb_to_bgr(image_tmp_frame2, pix_num, image_tmp_frame2); // in-place if supported
-				break;
+				palette_map8(display_palette_lut(palette, OUT), display_output_bpp(OUT), image_frame, \
+					pix_num, image_tmp_frame2);
 			}
+			return;
+		}
+		uint16_t* y14 = (uint16_t*)image_tmp_frame1;
+		for (int i = 0; i < pix_num; i++)
+		{
+			y14[i] = (uint16_t)((image_frame[i] * 16383u + 127) / 255);
 		}
 	}
-	else if (frameinfo->input_format == INPUT_FMT_YUV422)
+	// fused path: Y16/Y14 straight to BGR888 (or whole BGRA32/RGBA32 pixels) in one pass, no Y14/YUYV/RGB intermediates
+	else if (COLOR == PSEUDO_COLOR_ON && (OUT == OUTPUT_FMT_BGR888 || OUT == OUTPUT_FMT_BGRA32 || \
+		OUT == OUTPUT_FMT_RGBA32) && fused_color_enabled)
 	{
-		switch (frameinfo->output_format)
+		if (colorize_fused_palette((uint16_t*)image_frame, pix_num, frameinfo, display_palette_get(), \
+			image_stats, image_tmp_frame2) == COLORIZE_SUCCESS)
 		{
-			case OUTPUT_FMT_Y14:
-			{
-				frameinfo->byte_size = 0;
-				printf("convert error!\n");
-				break;
-			}
-			case OUTPUT_FMT_YUV444:
-			{
-				frameinfo->byte_size = 0;
-				printf("convert error!\n");
-				break;
-			}
-			case OUTPUT_FMT_YUV422:
-			{
-				frameinfo->byte_size = pix_num * 2;
-				memcpy(image_tmp_frame2, image_frame, pix_num * 2);
-				break;
-			}
-			case OUTPUT_FMT_RGB888:
-			{
-				frameinfo->byte_size = pix_num * 3;
-				yuv422_to_rgb((uint8_t*)image_frame, pix_num, image_tmp_frame2);
-				break;
-			}
-			case OUTPUT_FMT_BGR888:
-			default:
-			{
-				frameinfo->byte_size = pix_num * 3;
-				yuv422_to_rgb((uint8_t*)image_frame, pix_num, image_tmp_frame1);
-				rgb_to_bgr(image_tmp_frame1, pix_num, image_tmp_frame2);
-				break;
-			}
+			return;
+		}
+	}
+
+	if (IN != INPUT_FMT_Y8)
+	{
+		uint16_t* y14_frame = (uint16_t*)image_frame;
+		if (IN == INPUT_FMT_Y16)
+		{
+			// convert Y16 -> Y14 into scratch, the ring slot is shared and stays untouched
+			y16_to_y14((uint16_t*)image_frame, pix_num, (uint16_t*)image_tmp_frame2);
+			y14_frame = (uint16_t*)image_tmp_frame2;
 		}
+
+		// enhance (src -> image_tmp_frame1 as Y14)
+		enhance_image_frame_fixed<ENHANCE>(y14_frame, pix_num, frameinfo, image_stats, (uint16_t*)image_tmp_frame1);
+	}
+
+	if (COLOR == PSEUDO_COLOR_ON)
+	{
+		color_image_frame<OUT>(image_tmp_frame1, pix_num, image_tmp_frame2);
+	}
+	else if (OUT == OUTPUT_FMT_Y14)
+	{
+		memcpy(image_tmp_frame2, image_tmp_frame1, pix_num * 2);
+	}
+	else if (OUT == OUTPUT_FMT_YUV444)
+	{
+		y14_to_yuv444((uint16_t *)image_tmp_frame1, pix_num, (uint8_t*)image_tmp_frame2);
+	}
+	else if (OUT == OUTPUT_FMT_YUV422)
+	{
+		// no pseudo color: gray yuyv straight from y14, one pass
+		simd_gray_to_yuv((uint16_t*)image_tmp_frame1, pix_num, 14, SIMD_YUV_YUYV, image_tmp_frame2);
+	}
+	else if (OUT == OUTPUT_FMT_RGB888)
+	{
+		y14_to_rgb((uint16_t*)image_tmp_frame1, pix_num, image_tmp_frame2);
+	}
+	else if (OUT == OUTPUT_FMT_BGRA32 || OUT == OUTPUT_FMT_RGBA32)
+	{
+		y14_to_rgb((uint16_t*)image_tmp_frame1, pix_num, image_tmp_frame2);
+		display_rgb_to_rgba32(image_tmp_frame2, pix_num, OUT == OUTPUT_FMT_BGRA32, image_tmp_frame2);
+	}
+	else
+	{
+		y14_to_rgb((uint16_t*)image_tmp_frame1, pix_num, image_tmp_frame2);
+		rgb_to_bgr(image_tmp_frame2, pix_num, image_tmp_frame2); // in-place if supported
+	}
+}
+
+#define DISPLAY_PIPELINE_ENHANCE(IN, OUT, COLOR) { \
+	display_pipeline<IN, OUT, COLOR, IMG_ENHANCE_ON>, display_pipeline<IN, OUT, COLOR, IMG_ENHANCE_OFF>, \
+	display_pipeline<IN, OUT, COLOR, IMG_ENHANCE_HIST_AGC>, display_pipeline<IN, OUT, COLOR, IMG_ENHANCE_LIB>, \
+	display_pipeline<IN, OUT, COLOR, IMG_ENHANCE_CLAHE>, display_pipeline<IN, OUT, COLOR, IMG_ENHANCE_DDE> }
+#define DISPLAY_PIPELINE_COLOR(IN, OUT) { \
+	DISPLAY_PIPELINE_ENHANCE(IN, OUT, PSEUDO_COLOR_ON), DISPLAY_PIPELINE_ENHANCE(IN, OUT, PSEUDO_COLOR_OFF) }
+#define DISPLAY_PIPELINE_Y(IN) { \
+	DISPLAY_PIPELINE_COLOR(IN, OUTPUT_FMT_Y14), DISPLAY_PIPELINE_COLOR(IN, OUTPUT_FMT_YUV422), \
+	DISPLAY_PIPELINE_COLOR(IN, OUTPUT_FMT_YUV444), DISPLAY_PIPELINE_COLOR(IN, OUTPUT_FMT_RGB888), \
+	DISPLAY_PIPELINE_COLOR(IN, OUTPUT_FMT_BGR888), DISPLAY_PIPELINE_COLOR(IN, OUTPUT_FMT_BGRA32), \
+	DISPLAY_PIPELINE_COLOR(IN, OUTPUT_FMT_RGBA32) }
+//yuv422 ignores pseudocolor and enhance, one instance per output fills the whole row
+#define DISPLAY_PIPELINE_PASS(OUT) { \
+	{ display_pipeline<INPUT_FMT_YUV422, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_YUV422, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_YUV422, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_YUV422, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_YUV422, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_YUV422, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF> }, \
+	{ display_pipeline<INPUT_FMT_YUV422, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_YUV422, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_YUV422, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_YUV422, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_YUV422, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_YUV422, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF> } }
+//y8 ignores enhance, the plane was stretched at the cut
+#define DISPLAY_PIPELINE_Y8_COLOR(OUT) { \
+	{ display_pipeline<INPUT_FMT_Y8, OUT, PSEUDO_COLOR_ON, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_Y8, OUT, PSEUDO_COLOR_ON, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_Y8, OUT, PSEUDO_COLOR_ON, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_Y8, OUT, PSEUDO_COLOR_ON, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_Y8, OUT, PSEUDO_COLOR_ON, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_Y8, OUT, PSEUDO_COLOR_ON, IMG_ENHANCE_OFF> }, \
+	{ display_pipeline<INPUT_FMT_Y8, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_Y8, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_Y8, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_Y8, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_Y8, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF>, \
+	display_pipeline<INPUT_FMT_Y8, OUT, PSEUDO_COLOR_OFF, IMG_ENHANCE_OFF> } }
+
+//indexed by [input][output][pseudocolor][enhance], NULL: the combination has no conversion
+//yuv444/rgb888 inputs are not produced by any module and have no row
+static DisplayPipeline_t const display_pipelines[INPUT_FMT_NUM][OUTPUT_FMT_NUM][PSEUDO_COLOR_NUM][IMG_ENHANCE_NUM] = {
+	DISPLAY_PIPELINE_Y(INPUT_FMT_Y14),
+	DISPLAY_PIPELINE_Y(INPUT_FMT_Y16),
+	{ { { NULL } }, DISPLAY_PIPELINE_PASS(OUTPUT_FMT_YUV422), { { NULL } },
+	  DISPLAY_PIPELINE_PASS(OUTPUT_FMT_RGB888), DISPLAY_PIPELINE_PASS(OUTPUT_FMT_BGR888), \
+	  DISPLAY_PIPELINE_PASS(OUTPUT_FMT_BGRA32), DISPLAY_PIPELINE_PASS(OUTPUT_FMT_RGBA32) },
+	{ { { NULL } } },
+	{ { { NULL } } },
+	{ DISPLAY_PIPELINE_Y8_COLOR(OUTPUT_FMT_Y14), DISPLAY_PIPELINE_Y8_COLOR(OUTPUT_FMT_YUV422), \
+	  DISPLAY_PIPELINE_Y8_COLOR(OUTPUT_FMT_YUV444), DISPLAY_PIPELINE_Y8_COLOR(OUTPUT_FMT_RGB888), \
+	  DISPLAY_PIPELINE_Y8_COLOR(OUTPUT_FMT_BGR888), DISPLAY_PIPELINE_Y8_COLOR(OUTPUT_FMT_BGRA32), \
+	  DISPLAY_PIPELINE_Y8_COLOR(OUTPUT_FMT_RGBA32) },
+};
+
+DisplayPipeline_t display_pipeline_select(const FrameInfo_t* frameinfo)
+{
+	if (frameinfo == NULL || (unsigned)frameinfo->input_format >= INPUT_FMT_NUM || \
+		(unsigned)frameinfo->output_format >= OUTPUT_FMT_NUM || \
+		(unsigned)frameinfo->pseudo_color_status >= PSEUDO_COLOR_NUM || \
+		(unsigned)frameinfo->img_enhance_status >= IMG_ENHANCE_NUM)
+	{
+		return NULL;
+	}
+	return display_pipelines[frameinfo->input_format][frameinfo->output_format]\
+		[frameinfo->pseudo_color_status][frameinfo->img_enhance_status];
+}
+
+//convert the image process  image_tmp_frame2 is the default output frame
+void display_image_process(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const FrameStats_t* image_stats)
+{
+	// the commands toggle pseudocolor/enhance while streaming, so the variant is looked up per frame;
+	// combinations without a conversion were already refused by display_pipeline_select at configuration
+	DisplayPipeline_t pipeline = display_pipeline_select(frameinfo);
+	if (pipeline == NULL)
+	{
+		frameinfo->byte_size = 0;
+		return;
 	}
+	pipeline(image_frame, pix_num, frameinfo, image_stats);
 }
 
 irproc_src_fmt_t format_converter(OutputFormat_t output_format)
@@ -355,60 +844,367 @@ void mirror_flip_demo(FrameInfo_t* frame_info, uint8_t* frame, MirrorFlipStatus_
 	}
 }
 
-// 创建动态颜色对比条
-// 参数:
-//   height: 颜色条的高度
-//   width: 颜色条的宽度
-//   color_mode: 伪彩色模式
-//   max_temp: 当前实际最高温度（摄氏度）
-//   min_temp: 当前实际最低温度（摄氏度）
-// 返回值: OpenCV Mat对象（BGR格式）
-#ifdef OPENCV_ENABLE
-cv::Mat create_color_bar(int height, int width, irproc_color_mode_t color_mode, 
-                         float max_temp, float min_temp)
+//mirror/flip and rotate image_tmp_frame2 in one pass, the result becomes image_tmp_frame2
+void transform_demo(FrameInfo_t* frame_info, RotateSide_t rotate_side, MirrorFlipStatus_t mirror_flip_status)
 {
-	// 创建一个临时的Y14数组，从高到低线性分布
-	int bar_pixels = height * width;
-	uint16_t* y14_gradient = (uint16_t*)malloc(bar_pixels * sizeof(uint16_t));
-	uint8_t* yuv_buffer = (uint8_t*)malloc(bar_pixels * 2);  // YUV422格式
-	uint8_t* rgb_buffer = (uint8_t*)malloc(bar_pixels * 3);  // RGB格式
-	uint8_t* bgr_buffer = (uint8_t*)malloc(bar_pixels * 3);  // BGR格式
-	
-	if (!y14_gradient || !yuv_buffer || !rgb_buffer || !bgr_buffer) {
-		if (y14_gradient) free(y14_gradient);
-		if (yuv_buffer) free(yuv_buffer);
-		if (rgb_buffer) free(rgb_buffer);
-		if (bgr_buffer) free(bgr_buffer);
-		return cv::Mat(height, width, CV_8UC3, cv::Scalar(0, 0, 0));
+	if (rotate_side == NO_ROTATE && mirror_flip_status == STATUS_NO_MIRROR_FLIP)
+	{
+		return;
 	}
-	
-	// 生成Y14梯度：从上到下，从高温到低温（16383到0）
-	for (int y = 0; y < height; y++) {
-		// 计算当前行的Y14值（线性插值）
-		uint16_t y14_value = (uint16_t)(16383 - (y * 16383 / (height - 1)));
-		for (int x = 0; x < width; x++) {
-			y14_gradient[y * width + x] = y14_value;
-		}
+	if (frame_transform(image_tmp_frame2, frame_info, rotate_side, mirror_flip_status, \
+		image_tmp_frame1) == TRANSFORM_SUCCESS)
+	{
+		//both buffers have the same size, swap instead of copying back
+		uint8_t* tmp_frame = image_tmp_frame2;
+		image_tmp_frame2 = image_tmp_frame1;
+		image_tmp_frame1 = tmp_frame;
 	}
-	
-	// 使用与主图像相同的伪彩色映射函数
-	y14_map_to_yuyv_pseudocolor(y14_gradient, bar_pixels, color_mode, yuv_buffer);
-	
-	// 转换为RGB
-	yuv422_to_rgb(yuv_buffer, bar_pixels, rgb_buffer);
-	
-	// 转换为BGR（OpenCV使用BGR格式）
-	rgb_to_bgr(rgb_buffer, bar_pixels, bgr_buffer);
-	
-	// 创建OpenCV Mat
+}
+
+//one frame of display_image_process_bands, the stages only read it
+typedef struct {
+	uint16_t* src;
+	FrameInfo_t* frameinfo;
+	ColorizePlan_t plan;
+	int band_num;
+	int transform;
+}DisplayBands_t;
+
+static void display_band_colorize(void* arg, int band, int y0, int y1)
+{
+	DisplayBands_t* bands = (DisplayBands_t*)arg;
+	int width = bands->frameinfo->width;
+	uint32_t* hist = NULL;
+	if (bands->plan.map == COLORIZE_MAP_HIST_AGC)
+	{
+		hist = display_band_hist + (size_t)band * HIST_AGC_BINS;
+	}
+	colorize_plan_apply(&bands->plan, bands->src, y0 * width, y1 * width, image_tmp_frame2, hist);
+}
+
+//bins [v0, v1) of every band's histogram into the agc's, the bands' are cleared for the next frame
+static void display_band_hist_merge(void* arg, int band, int v0, int v1)
+{
+	DisplayBands_t* bands = (DisplayBands_t*)arg;
+	uint32_t* hist = get_display_hist_agc()->hist;
+	for (int b = 0; b < bands->band_num; b++)
+	{
+		uint32_t* band_hist = display_band_hist + (size_t)b * HIST_AGC_BINS;
+		for (int v = v0; v < v1; v++)
+		{
+			hist[v] += band_hist[v];
+			band_hist[v] = 0;
+		}
+	}
+}
+
+static void display_band_transform(void* arg, int band, int y0, int y1)
+{
+	DisplayBands_t* bands = (DisplayBands_t*)arg;
+	FrameInfo_t* frameinfo = bands->frameinfo;
+	frame_transform_rows(image_tmp_frame2, frameinfo, frameinfo->rotate_side, frameinfo->mirror_flip_status, \
+		y0, y1, image_tmp_frame1);
+}
+
+int display_image_process_bands(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const FrameStats_t* image_stats, int band_num)
+{
+	if ((frameinfo->input_format != INPUT_FMT_Y14 && frameinfo->input_format != INPUT_FMT_Y16) || \
+		frameinfo->pseudo_color_status != PSEUDO_COLOR_ON || !display_output_fused(frameinfo->output_format) || \
+		!fused_color_enabled || !fused_transform_enabled)
+	{
+		return -1;
+	}
+	if (band_num > DISPLAY_BAND_MAX)
+	{
+		band_num = DISPLAY_BAND_MAX;
+	}
+
+	//the plan's stretch table is too big for a worker's stack, one frame is in flight at a time
+	static DisplayBands_t bands;
+	bands.src = (uint16_t*)image_frame;
+	bands.frameinfo = frameinfo;
+	bands.band_num = band_num;
+	bands.transform = (frameinfo->rotate_side != NO_ROTATE || frameinfo->mirror_flip_status != STATUS_NO_MIRROR_FLIP);
+	if (colorize_plan_prepare_palette(&bands.plan, bands.src, pix_num, frameinfo, display_palette_get(), \
+		image_stats) != COLORIZE_SUCCESS || \
+		colorize_plan_output(&bands.plan, frameinfo->output_format, pix_num, frameinfo) != COLORIZE_SUCCESS)
+	{
+		return -1;
+	}
+	if (bands.plan.map == COLORIZE_MAP_HIST_AGC && display_band_hist == NULL)
+	{
+		display_band_hist = (uint32_t*)calloc((size_t)DISPLAY_BAND_MAX * HIST_AGC_BINS, sizeof(uint32_t));
+		if (display_band_hist == NULL)
+		{
+			return -1;
+		}
+	}
+
+	BandStage_t stages[3];
+	int stage_num = 0;
+	stages[stage_num].func = display_band_colorize;
+	stages[stage_num].arg = &bands;
+	stages[stage_num++].rows = frameinfo->height;
+	if (bands.plan.map == COLORIZE_MAP_HIST_AGC)
+	{
+		stages[stage_num].func = display_band_hist_merge;
+		stages[stage_num].arg = &bands;
+		stages[stage_num++].rows = HIST_AGC_BINS;
+	}
+	if (bands.transform)
+	{
+		int out_height = (frameinfo->rotate_side == LEFT_90D || frameinfo->rotate_side == RIGHT_90D) ? \
+			frameinfo->width : frameinfo->height;
+		stages[stage_num].func = display_band_transform;
+		stages[stage_num].arg = &bands;
+		stages[stage_num++].rows = out_height;
+	}
+	band_run(POOL_STAGE_DISPLAY, stages, stage_num, band_num);
+
+	colorize_plan_commit(&bands.plan, pix_num);
+	if (bands.transform)
+	{
+		uint8_t* tmp_frame = image_tmp_frame2;
+		image_tmp_frame2 = image_tmp_frame1;
+		image_tmp_frame1 = tmp_frame;
+	}
+	return 0;
+}
+
+int display_image_process_zoom(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const FrameStats_t* image_stats)
+{
+	if ((frameinfo->input_format != INPUT_FMT_Y14 && frameinfo->input_format != INPUT_FMT_Y16) || \
+		frameinfo->pseudo_color_status != PSEUDO_COLOR_ON || !display_output_fused(frameinfo->output_format) || \
+		!fused_color_enabled || !fused_transform_enabled || !zoom_view_active(&display_zoom_view))
+	{
+		return -1;
+	}
+	int width = frameinfo->width, height = frameinfo->height;
+	if (zoom_map_update(&display_zoom_map, &display_zoom_view, width, height, width) != ZOOM_SUCCESS)
+	{
+		return -1;
+	}
+	//the range of the whole frame, the agc's histogram is the view's
+	static ColorizePlan_t plan;
+	if (colorize_plan_prepare_palette(&plan, (uint16_t*)image_frame, pix_num, frameinfo, display_palette_get(), \
+		image_stats) != COLORIZE_SUCCESS || \
+		colorize_plan_output(&plan, frameinfo->output_format, pix_num, frameinfo) != COLORIZE_SUCCESS)
+	{
+		return -1;
+	}
+	for (int y = 0; y < height; y++)
+	{
+		const uint16_t* line = zoom_map_line(&display_zoom_map, (const uint16_t*)image_frame, y);
+		colorize_plan_apply(&plan, line, 0, width, image_tmp_frame2 + (long)y * width * plan.bpp, NULL);
+	}
+	colorize_plan_commit(&plan, pix_num);
+	if (frameinfo->rotate_side != NO_ROTATE || frameinfo->mirror_flip_status != STATUS_NO_MIRROR_FLIP)
+	{
+		int out_height = (frameinfo->rotate_side == LEFT_90D || frameinfo->rotate_side == RIGHT_90D) ? width : height;
+		frame_transform_rows(image_tmp_frame2, frameinfo, frameinfo->rotate_side, frameinfo->mirror_flip_status, \
+			0, out_height, image_tmp_frame1);
+		uint8_t* tmp_frame = image_tmp_frame2;
+		image_tmp_frame2 = image_tmp_frame1;
+		image_tmp_frame1 = tmp_frame;
+	}
+	return 0;
+}
+
+int display_image_process_upscale(uint8_t* image_frame, FrameInfo_t* frameinfo, const FrameStats_t* image_stats, \
+	uint8_t** frame_out)
+{
+	int factor = display_upscale_factor;
+	if ((frameinfo->input_format != INPUT_FMT_Y14 && frameinfo->input_format != INPUT_FMT_Y16) || \
+		frameinfo->pseudo_color_status != PSEUDO_COLOR_ON || frameinfo->output_format != OUTPUT_FMT_BGR888 || \
+		frameinfo->img_enhance_status == IMG_ENHANCE_LIB || frameinfo->img_enhance_status == IMG_ENHANCE_CLAHE || \
+		frameinfo->img_enhance_status == IMG_ENHANCE_DDE || factor < 2 || factor > UPSCALE_FACTOR_MAX)
+	{
+		return -1;
+	}
+	if (display_upscale.factor != factor || display_upscale.mode != display_upscale_mode)
+	{
+		upscale_release(&display_upscale);
+		if (upscale_init(&display_upscale, factor, (UpscaleMode_t)display_upscale_mode) != UPSCALE_SUCCESS)
+		{
+			return -1;
+		}
+	}
+	//the upscaled frames only live until the frame is presented, they come from the frame arena
+	int pix_num = frameinfo->width * frameinfo->height * factor * factor;
+	uint16_t* upscale_frame = (uint16_t*)arena_alloc(&display_arena, (size_t)pix_num * sizeof(uint16_t));
+	uint8_t* upscale_bgr = (uint8_t*)arena_alloc(&display_arena, (size_t)pix_num * 3);
+	if (upscale_frame == NULL || upscale_bgr == NULL)
+	{
+		return -1;
+	}
+
+	uint64_t upscale_start_us = timing_start();
+	int shift = (frameinfo->input_format == INPUT_FMT_Y16) ? 2 : 0;
+	if (upscale_process(&display_upscale, (uint16_t*)image_frame, frameinfo->width, frameinfo->height, shift, \
+		upscale_frame) != UPSCALE_SUCCESS)
+	{
+		return -1;
+	}
+	timing_record_since(TIMING_STAGE_DISPLAY_UPSCALE, upscale_start_us);
+
+	//the stretch keeps the source range, the bicubic overshoot at edges is clipped by it
+	FrameInfo_t info = *frameinfo;
+	info.width *= factor;
+	info.height *= factor;
+	info.input_format = INPUT_FMT_Y14;
+	static FrameStats_t stats;
+	const FrameStats_t* stats_ptr = NULL;
+	if (image_stats != NULL && image_stats->valid)
+	{
+		stats.valid = 1;
+		stats.min_val = image_stats->min_val >> shift;
+		stats.max_val = image_stats->max_val >> shift;
+		stats_ptr = &stats;
+	}
+	if (colorize_fused_bgr_palette(upscale_frame, pix_num, &info, display_palette_get(), stats_ptr, \
+		upscale_bgr) != COLORIZE_SUCCESS)
+	{
+		return -1;
+	}
+	*frame_out = upscale_bgr;
+	if (frameinfo->rotate_side != NO_ROTATE || frameinfo->mirror_flip_status != STATUS_NO_MIRROR_FLIP)
+	{
+		uint8_t* transform_bgr = (uint8_t*)arena_alloc(&display_arena, (size_t)pix_num * 3);
+		if (transform_bgr == NULL)
+		{
+			return -1;
+		}
+		frame_transform(upscale_bgr, &info, frameinfo->rotate_side, frameinfo->mirror_flip_status, transform_bgr);
+		*frame_out = transform_bgr;
+	}
+	return 0;
+}
+
+int display_image_process_gpu(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const FrameStats_t* image_stats)
+{
+	if ((frameinfo->input_format != INPUT_FMT_Y14 && frameinfo->input_format != INPUT_FMT_Y16) || \
+		frameinfo->pseudo_color_status != PSEUDO_COLOR_ON || frameinfo->output_format != OUTPUT_FMT_BGR888 || \
+		!gpu_available() || display_palette_get() == display_isotherm_palette)
+	{
+		return -1;
+	}
+	irproc_color_mode_t color_mode = palette_active()->color_mode;
+	static uint32_t frames_since_verify = 0;
+	if (display_gpu_verify_interval > 0 && ++frames_since_verify >= display_gpu_verify_interval)
+	{
+		frames_since_verify = 0;
+		int ret = gpu_verify_bgr((uint16_t*)image_frame, frameinfo, color_mode, image_stats, \
+			image_tmp_frame1, image_tmp_frame2);
+		if (ret == GPU_ERROR_KERNEL)
+		{
+			//a device that does not match the cpu is not used again, this frame shows the cpu result
+			GpuStats_t stats;
+			gpu_stats(&stats);
+			printf("display: gpu output differs from the cpu (%llu of %llu frames), back to the cpu\n", \
+				(unsigned long long)stats.mismatches, (unsigned long long)stats.verified);
+			display_gpu_enabled = 0;
+			uint8_t* tmp_frame = image_tmp_frame2;
+			image_tmp_frame2 = image_tmp_frame1;
+			image_tmp_frame1 = tmp_frame;
+			return 0;
+		}
+		return (ret == GPU_SUCCESS) ? 0 : -1;
+	}
+	return (gpu_colorize_bgr((uint16_t*)image_frame, frameinfo, color_mode, image_stats, image_tmp_frame2) == GPU_SUCCESS) ? 0 : -1;
+}
+
+int display_image_present_raw(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const FrameStats_t* image_stats, const char* caption)
+{
+	if (!display_sink_takes_raw(&display_sink) || \
+		(frameinfo->input_format != INPUT_FMT_Y14 && frameinfo->input_format != INPUT_FMT_Y16) || \
+		frameinfo->pseudo_color_status != PSEUDO_COLOR_ON || frameinfo->output_format != OUTPUT_FMT_BGR888 || \
+		!fused_color_enabled || human_segmentation_enabled)
+	{
+		return -1;
+	}
+	static ColorizePlan_t plan;
+	if (colorize_plan_prepare_palette(&plan, (uint16_t*)image_frame, pix_num, frameinfo, display_palette_get(), \
+		image_stats) != COLORIZE_SUCCESS)
+	{
+		return -1;
+	}
+	if (plan.map == COLORIZE_MAP_HIST_AGC)
+	{
+		//what colorize_plan_apply counts on the way, the next frame's mapping
+		const uint16_t* src = (const uint16_t*)image_frame;
+		uint32_t* hist = get_display_hist_agc()->hist;
+		for (int i = 0; i < pix_num; i++)
+		{
+			uint32_t v = src[i] >> plan.shift;
+			hist[(v > COLOR_LUT_SIZE - 1) ? COLOR_LUT_SIZE - 1 : v]++;
+		}
+	}
+	DisplaySinkRaw_t raw;
+	memset(&raw, 0, sizeof(raw));
+	raw.lut = plan.lut;
+	raw.agc_lut = plan.agc_lut;
+	raw.shift = plan.shift;
+	raw.map = plan.map;
+	raw.lo = plan.lo;
+	raw.hi = plan.hi;
+	frame_transform_map_get(frameinfo->width, frameinfo->height, frameinfo->rotate_side, \
+		frameinfo->mirror_flip_status, &raw.transform);
+	raw.zoom = display_zoom_view;
+	raw.color_bar = 1;
+	snprintf(raw.caption, sizeof(raw.caption), "%s", caption);
+	//a frame the sink could not take is counted in its drops, the agc moves on either way
+	display_sink_present_raw(&display_sink, (const uint16_t*)image_frame, frameinfo->width, frameinfo->height, \
+		frameinfo->width, &raw);
+	colorize_plan_commit(&plan, pix_num);
+	return 0;
+}
+
+// 创建动态颜色对比条
+// 参数:
+//   height: 颜色条的高度
+//   width: 颜色条的宽度
+//   color_mode: 伪彩色模式
+//   max_temp: 当前实际最高温度（摄氏度）
+//   min_temp: 当前实际最低温度（摄氏度）
+// 返回值: OpenCV Mat对象（BGR格式）
+// 渐变只与(color_mode, width, height)有关，结果缓存复用，参数不变时不再重新生成
+#ifdef OPENCV_ENABLE
+static cv::Mat color_bar_cache;
+static const uint8_t* color_bar_cache_lut = NULL;	// 用户调色板重新加载后同一模式的查找表也会变
+static uint32_t color_bar_cache_version = 0;		// 等温色带重画后同一个查找表的内容也会变
+
+cv::Mat create_color_bar(int height, int width, irproc_color_mode_t color_mode, 
+                         float max_temp, float min_temp)
+{
+	// 使用与主图像相同的伪彩色查找表
+	const Palette_t* palette = display_palette_get();
+	const uint8_t* lut = (palette != NULL && palette->color_mode == color_mode) ? palette->bgr : colorize_lut_get(color_mode);
+	if (!color_bar_cache.empty() && color_bar_cache.rows == height && color_bar_cache.cols == width && \
+		color_bar_cache_lut == lut && color_bar_cache_version == display_palette_version) {
+		return color_bar_cache;
+	}
+
+	if (lut == NULL) {
+		return cv::Mat(height, width, CV_8UC3, cv::Scalar(0, 0, 0));
+	}
+
 	cv::Mat color_bar(height, width, CV_8UC3);
-	memcpy(color_bar.data, bgr_buffer, bar_pixels * 3);
-	
-	// 释放临时缓冲区
-	free(y14_gradient);
-	free(yuv_buffer);
-	free(rgb_buffer);
-	free(bgr_buffer);
+	// 生成Y14梯度：从上到下，从高温到低温（16383到0）
+	for (int y = 0; y < height; y++) {
+		// 计算当前行的Y14值（线性插值）
+		uint16_t y14_value = (uint16_t)(16383 - (y * 16383 / (height - 1)));
+		const uint8_t* color = lut + y14_value * 3;
+		uint8_t* row = color_bar.ptr<uint8_t>(y);
+		for (int x = 0; x < width; x++) {
+			row[x * 3 + 0] = color[0];
+			row[x * 3 + 1] = color[1];
+			row[x * 3 + 2] = color[2];
+		}
+	}
 	
 	// 添加温度刻度线
 	for (int i = 0; i < TEMP_LABEL_COUNT; i++) {
@@ -420,171 +1216,926 @@ cv::Mat create_color_bar(int height, int width, irproc_color_mode_t color_mode,
 		cv::line(color_bar, cv::Point(width-5, y_pos), cv::Point(width-1, y_pos), 
 		         cv::Scalar(255, 255, 255), 1);
 	}
-	
-	return color_bar;
+
+	color_bar_cache = color_bar;
+	color_bar_cache_lut = lut;
+	color_bar_cache_version = display_palette_version;
+	return color_bar_cache;
+}
+
+enum {
+	DISPLAY_OVERLAY_FPS = 0,
+	DISPLAY_OVERLAY_MAX,
+	DISPLAY_OVERLAY_MIN,
+	DISPLAY_OVERLAY_STATUS,
+};
+
+// 在颜色条右侧添加动态温度标签
+void add_temperature_labels(cv::Mat& combined_image, int bar_x, int bar_y, 
+                            int bar_height, float max_temp, float min_temp)
+{
+	char temp_text[32];
+	if (!display_overlay_inited) {
+		return;
+	}
+	for (int i = 0; i < TEMP_LABEL_COUNT; i++) {
+		// 根据实际温度范围计算温度值（动态）
+		float temp = max_temp - (max_temp - min_temp) * i / (TEMP_LABEL_COUNT - 1);
+		int y_pos = bar_y + (int)(i * (bar_height - 1) / (TEMP_LABEL_COUNT - 1));
+		
+		sprintf(temp_text, "%.1f", temp);
+		
+		// 文字位置：颜色条右侧
+		int text_x = bar_x + COLOR_BAR_WIDTH + 5;
+		int text_y = y_pos + 4;  // 文字垂直居中对齐
+		
+		// 黑色阴影 + 白色文字
+		overlay_text(&display_label_overlay, i, OVERLAY_FONT_SMALL, text_x, text_y, OVERLAY_RGB(255, 255, 255), 1, temp_text);
+	}
+	overlay_blend(&display_label_overlay, combined_image.data, combined_image.cols, combined_image.rows, \
+		(int)combined_image.step);
+}
+
+// 帧率、最高/最低温度与人体分割状态，位置与原来的putText相同
+static void display_overlay_update(const char* frame_text, uint8_t temp_range_valid, float max_temp, float min_temp)
+{
+	char text[OVERLAY_TEXT_LEN];
+	overlay_text(&display_overlay, DISPLAY_OVERLAY_FPS, OVERLAY_FONT_PLAIN, 10, 10, OVERLAY_RGB(255, 255, 255), 1, frame_text);
+	if (temp_range_valid) {
+		snprintf(text, sizeof(text), "Max: %.2f C", max_temp);
+		overlay_text(&display_overlay, DISPLAY_OVERLAY_MAX, OVERLAY_FONT_PLAIN, 10, 30, OVERLAY_RGB(255, 255, 255), 1, text);
+		snprintf(text, sizeof(text), "Min: %.2f C", min_temp);
+		overlay_text(&display_overlay, DISPLAY_OVERLAY_MIN, OVERLAY_FONT_PLAIN, 10, 50, OVERLAY_RGB(255, 255, 255), 1, text);
+	} else {
+		overlay_hide(&display_overlay, DISPLAY_OVERLAY_MAX);
+		overlay_hide(&display_overlay, DISPLAY_OVERLAY_MIN);
+	}
+	if (human_segmentation_enabled) {
+		snprintf(text, sizeof(text), "[S] Human Seg: ON (%.0f-%.0f C)", HUMAN_TEMP_MIN_CELSIUS, HUMAN_TEMP_MAX_CELSIUS);
+		overlay_text(&display_overlay, DISPLAY_OVERLAY_STATUS, OVERLAY_FONT_PLAIN, 10, 70, OVERLAY_RGB(0, 255, 0), 1, text);
+	} else {
+		overlay_hide(&display_overlay, DISPLAY_OVERLAY_STATUS);
+	}
+}
+
+// 人体温度窗口对应的温度数据范围（单位1/64 K），阈值变化时才重新计算
+static float human_range_min_celsius = 0.0f;
+static float human_range_max_celsius = 0.0f;
+static uint32_t human_range_lo = 1;
+static uint32_t human_range_hi = 0;
+static uint8_t human_range_valid = 0;
+// 窗口内每个温度值对应的颜色表偏移，常驻内存，不再每帧申请
+static uint16_t human_color_offset[65536];
+static int human_seg_frame_cnt = 0;
+
+// 温度随温度数据单调递增，摄氏度窗口可以换算成一次性的数据范围
+static void human_temp_range_update(float min_celsius, float max_celsius)
+{
+	if (human_range_valid && min_celsius == human_range_min_celsius && max_celsius == human_range_max_celsius) {
+		return;
+	}
+
+	// 先按换算公式估计，再用temp_value_converter校正边界，保证与逐点判断一致
+	int lo = (int)((min_celsius + 273.15) * 64);
+	int hi = (int)((max_celsius + 273.15) * 64);
+	if (lo < 0) lo = 0;
+	if (lo > 65535) lo = 65535;
+	if (hi < 0) hi = 0;
+	if (hi > 65535) hi = 65535;
+	while (lo > 0 && temp_value_converter((uint16_t)(lo - 1)) >= min_celsius) lo--;
+	while (lo <= 65535 && temp_value_converter((uint16_t)lo) < min_celsius) lo++;
+	while (hi < 65535 && temp_value_converter((uint16_t)(hi + 1)) <= max_celsius) hi++;
+	while (hi >= 0 && temp_value_converter((uint16_t)hi) > max_celsius) hi--;
+
+	human_range_lo = (uint32_t)lo;
+	human_range_hi = (uint32_t)((hi < 0) ? 0 : hi);
+	if (hi < lo) {
+		// 空窗口
+		human_range_lo = 1;
+		human_range_hi = 0;
+	}
+	human_range_min_celsius = min_celsius;
+	human_range_max_celsius = max_celsius;
+	human_range_valid = 1;
+}
+
+// 基于真实温度的人体分割函数
+// y14_data: 温度数据（单位1/64 K）
+// width, height: 图像尺寸
+// dst_frame: 输出BGR图像
+// 阈值判断按像素的温度数据进行；get_point_temp自带3x3邻域滤波，所以分割边缘可能与逐点调用相差一个像素
+// 范围掩码经开/闭运算去掉噪点、填补空洞后按连通域输出人体区域，display_human_blobs_get读取
+void segment_human_by_real_temperature(uint16_t* y14_data, int width, int height, uint8_t* dst_frame)
+{
+	if (y14_data == NULL || dst_frame == NULL) {
+		return;
+	}
+	if (display_segment.temp_res.width != width || display_segment.temp_res.height != height) {
+		TempDataRes_t temp_res = { (uint16_t)width, (uint16_t)height };
+		segment_release(&display_segment);
+		if (segment_init(&display_segment, temp_res) != SEGMENT_SUCCESS) {
+			memset(dst_frame, 0, (size_t)width * height * 3);
+			return;
+		}
+	}
+
+	int pix_num = width * height;
+	const uint8_t* lut = colorize_lut_get(IRPROC_COLOR_MODE_6);
+	if (lut == NULL) {
+		memset(dst_frame, 0, (size_t)pix_num * 3);
+		return;
+	}
+
+	human_temp_range_update(HUMAN_TEMP_MIN_CELSIUS, HUMAN_TEMP_MAX_CELSIUS);
+
+	// 第一遍（SIMD）：统计温度数据范围；第二遍：掩码、形态学与连通域
+	uint16_t min_y14 = 65535;
+	uint16_t max_y14 = 0;
+	int human_pixel_count = 0;
+	int blob_num = 0;
+	if (human_range_hi >= human_range_lo && simd_range_minmax_u16(y14_data, pix_num, (uint16_t)human_range_lo, \
+		(uint16_t)human_range_hi, &min_y14, &max_y14) > 0) {
+		SegmentParam_t param = { (uint16_t)human_range_lo, (uint16_t)human_range_hi, HUMAN_SEG_OPEN, HUMAN_SEG_CLOSE, \
+			HUMAN_SEG_MIN_AREA };
+		blob_num = segment_process(&display_segment, y14_data, &param);
+		human_pixel_count = (blob_num >= 0) ? (int)display_segment.pix_num : 0;
+	}
+	pthread_mutex_lock(&display_segment_mutex);
+	display_segment_blob_num = (blob_num > 0) ? blob_num : 0;
+	memcpy(display_segment_blobs, display_segment.blobs, display_segment_blob_num * sizeof(SegmentBlob_t));
+	display_segment_frames++;
+	pthread_mutex_unlock(&display_segment_mutex);
+	if (human_pixel_count == 0) {
+		memset(dst_frame, 0, (size_t)pix_num * 3);
+	} else {
+		// 人体范围内的值线性拉伸到全范围(0-16383)，每个值只算一次
+		for (uint32_t v = min_y14; v <= max_y14; v++) {
+			uint16_t stretched = 8191;	// 如果所有人体像素值相同，设为中间值
+			if (max_y14 > min_y14) {
+				float normalized = (float)(v - min_y14) / (float)(max_y14 - min_y14);
+				stretched = (uint16_t)(normalized * 16383.0f);
+			}
+			human_color_offset[v - min_y14] = stretched * 3;
+		}
+
+		// 第三遍：掩码外为纯黑背景，掩码内直接查表得到伪彩色，闭运算补进的像素钳位到人体范围
+		// 掩码按64像素一个字处理：全为背景的字整段清零，大画面中大部分字都是这种情况
+		uint8_t* dst = dst_frame;
+		for (int y = 0; y < height; y++) {
+			const uint64_t* mask = display_segment.mask + y * display_segment.words;
+			const uint16_t* row = y14_data + y * width;
+			for (int x0 = 0; x0 < width; x0 += 64) {
+				int n = (width - x0 < 64) ? width - x0 : 64;
+				uint64_t word = mask[x0 >> 6];
+				if (word == 0) {
+					memset(dst, 0, (size_t)n * 3);
+					dst += n * 3;
+					continue;
+				}
+				for (int x = x0; x < x0 + n; x++) {
+					if ((word >> (x & 63)) & 1) {
+						uint32_t v = row[x];
+						v = (v < min_y14) ? min_y14 : ((v > max_y14) ? max_y14 : v);
+						const uint8_t* color = lut + human_color_offset[v - min_y14];
+						dst[0] = color[0];
+						dst[1] = color[1];
+						dst[2] = color[2];
+					} else {
+						dst[0] = 0;
+						dst[1] = 0;
+						dst[2] = 0;
+					}
+					dst += 3;
+				}
+			}
+		}
+	}
+
+	// 每25帧打印一次分割统计信息，由日志线程格式化输出
+	if (human_seg_frame_cnt % 25 == 0) {
+		LOG(LOG_LEVEL_INFO, "[Human Segmentation] 温度阈值: %.1f-%.1f°C\n",
+		       HUMAN_TEMP_MIN_CELSIUS, HUMAN_TEMP_MAX_CELSIUS);
+		LOG(LOG_LEVEL_INFO, "[Human Segmentation] 人体像素: %d/%d (%.1f%%), 人体区域: %d\n",
+		       human_pixel_count, pix_num, 100.0f * human_pixel_count / pix_num, blob_num);
+		if (human_pixel_count > 0) {
+			LOG(LOG_LEVEL_INFO, "[Human Segmentation] 人体温度范围: %.2f-%.2f°C\n",
+			       temp_value_converter(min_y14), temp_value_converter(max_y14));
+			LOG(LOG_LEVEL_INFO, "[Human Segmentation] Y14拉伸: %d-%d → 0-16383 (线性映射到全伪彩色范围)\n",
+			       min_y14, max_y14);
+		}
+		human_seg_frame_cnt = 0;
+	}
+	human_seg_frame_cnt++;
+}
+#endif
+
+//max/min temperature of the current temp frame, from the stream thread's statistics when attached, else scanned
+//here unless scan is 0
+static int display_temp_range_get(StreamFrameInfo_t* stream_frame_info, uint8_t scan, float* max_celsius, \
+	float* min_celsius)
+{
+	uint16_t min_val = 65535, max_val = 0;
+	if (stream_frame_info->temp_stats != NULL && stream_frame_info->temp_stats->valid)
+	{
+		min_val = stream_frame_info->temp_stats->min_val;
+		max_val = stream_frame_info->temp_stats->max_val;
+	}
+	else if (scan && stream_frame_info->temp_frame != NULL && stream_frame_info->temp_byte_size > 0)
+	{
+		int temp_pix_num = stream_frame_info->temp_info.width * stream_frame_info->temp_info.height;
+		simd_minmax_u16((uint16_t*)stream_frame_info->temp_frame, temp_pix_num, &min_val, &max_val);
+	}
+	else
+	{
+		return -1;
+	}
+	*max_celsius = temp_value_converter(max_val);
+	*min_celsius = temp_value_converter(min_val);
+	return 0;
+}
+
+//noise reduce the Y14/Y16 image frame into display_nr_frame, returns the frame the display goes on with
+static Tnr_t* display_nr_tnr(void)
+{
+	Tnr_t* tnr = get_display_tnr();
+	if (display_nr_mode != display_nr_last_mode)
+	{
+		// a new temporal run starts from the current frame, not from an old history
+		tnr_reset(tnr);
+		if (display_nr_window.window != DISPLAY_NR_AVERAGE_WINDOW)
+		{
+			accum_window_init(&display_nr_window, DISPLAY_NR_AVERAGE_WINDOW);
+		}
+		accum_window_reset(&display_nr_window);
+		display_nr_last_mode = display_nr_mode;
+	}
+	return tnr;
+}
+
+static uint8_t* display_noise_reduction(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo)
+{
+	int shift = (frameinfo->input_format == INPUT_FMT_Y16) ? 2 : 0;
+	Tnr_t* tnr = display_nr_tnr();
+	if (display_nr_mode == DISPLAY_NR_OFF || display_nr_frame == NULL || \
+		(frameinfo->input_format != INPUT_FMT_Y14 && frameinfo->input_format != INPUT_FMT_Y16))
+	{
+		return image_frame;
+	}
+
+	if (display_nr_mode == DISPLAY_NR_TEMPORAL)
+	{
+		if (tnr_process(tnr, (uint16_t*)image_frame, pix_num, shift, display_nr_frame) != TNR_SUCCESS)
+		{
+			return image_frame;
+		}
+		return (uint8_t*)display_nr_frame;
+	}
+	if (display_nr_mode == DISPLAY_NR_AVERAGE)
+	{
+		// y16 keeps its low bits in the sum, no shift needed
+		if (accum_window_process(&display_nr_window, (uint16_t*)image_frame, pix_num, display_nr_frame) != ACCUM_SUCCESS)
+		{
+			return image_frame;
+		}
+		return (uint8_t*)display_nr_frame;
+	}
+
+	ImageRes_t image_res = { frameinfo->width,frameinfo->height };
+	uint16_t* y14_frame = (uint16_t*)image_frame;
+	if (shift)
+	{
+		// image_tmp_frame1 is free until enhance
+		y16_to_y14((uint16_t*)image_frame, pix_num, (uint16_t*)image_tmp_frame1);
+		y14_frame = (uint16_t*)image_tmp_frame1;
+	}
+	if (y14_image_spatial_noise_reduction(y14_frame, image_res, display_nr_frame) != IRPROC_SUCCESS)
+	{
+		return image_frame;
+	}
+	for (int i = 0; shift && i < pix_num; i++)
+	{
+		display_nr_frame[i] <<= shift;
+	}
+	return (uint8_t*)display_nr_frame;
+}
+
+int display_window_set(const Area_t* rects, int num, uint32_t refresh_interval)
+{
+	if (num < 0 || num > DISPLAY_WINDOW_MAX || (num > 0 && rects == NULL))
+	{
+		return -1;
+	}
+	for (int i = 0; i < num; i++)
+	{
+		if (rects[i].width <= 0 || rects[i].height <= 0)
+		{
+			return -1;
+		}
+	}
+	pthread_mutex_lock(&display_window_mutex);
+	if (num > 0)
+	{
+		memcpy(display_window_pending, rects, num * sizeof(Area_t));
+	}
+	display_window_pending_num = num;
+	display_window_pending_interval = refresh_interval;
+	display_window_gen.fetch_add(1, std::memory_order_release);
+	pthread_mutex_unlock(&display_window_mutex);
+	return 0;
+}
+
+int display_isotherm_set(const DisplayIsotherm_t* bands, int num)
+{
+	if (num < 0 || num > DISPLAY_ISOTHERM_MAX || (num > 0 && bands == NULL))
+	{
+		return -1;
+	}
+	for (int i = 0; i < num; i++)
+	{
+		if (!(bands[i].high_celsius >= bands[i].low_celsius))
+		{
+			return -1;
+		}
+	}
+	pthread_mutex_lock(&display_isotherm_mutex);
+	if (num > 0)
+	{
+		memcpy(display_isotherm_pending, bands, num * sizeof(DisplayIsotherm_t));
+	}
+	display_isotherm_pending_num = num;
+	display_isotherm_gen.fetch_add(1, std::memory_order_release);
+	pthread_mutex_unlock(&display_isotherm_mutex);
+	return 0;
+}
+
+int display_human_blobs_get(SegmentBlob_t* blobs, int max_num, uint64_t* frame)
+{
+	if (blobs == NULL && max_num > 0)
+	{
+		return -1;
+	}
+	pthread_mutex_lock(&display_segment_mutex);
+	int num = (display_segment_blob_num < max_num) ? display_segment_blob_num : max_num;
+	if (num > 0)
+	{
+		memcpy(blobs, display_segment_blobs, num * sizeof(SegmentBlob_t));
+	}
+	if (frame != NULL)
+	{
+		*frame = display_segment_frames;
+	}
+	pthread_mutex_unlock(&display_segment_mutex);
+	return num;
+}
+
+//the palette of this frame: the active one, or a copy with the isotherm bands painted at the lut values of
+//their temperatures on the color bar scale. only the changed ranges are restored and repainted, returns 1 when
+//the bands themselves changed
+static int display_palette_update(uint8_t temp_range_valid, float max_celsius, float min_celsius)
+{
+	int changed = 0;
+	uint32_t gen = display_isotherm_gen.load(std::memory_order_acquire);
+	if (gen != display_isotherm_applied_gen)
+	{
+		pthread_mutex_lock(&display_isotherm_mutex);
+		display_isotherm_num = display_isotherm_pending_num;
+		memcpy(display_isotherm_bands, display_isotherm_pending, sizeof(display_isotherm_bands));
+		display_isotherm_applied_gen = display_isotherm_gen.load(std::memory_order_relaxed);
+		pthread_mutex_unlock(&display_isotherm_mutex);
+		changed = 1;
+	}
+
+	const Palette_t* base = palette_active();
+	float span = max_celsius - min_celsius;
+	if (display_isotherm_num == 0 || !temp_range_valid || !(span > 0.0f))
+	{
+		display_palette_cur = base;
+		return changed;
+	}
+	if (display_isotherm_palette == NULL)
+	{
+		display_isotherm_palette = (Palette_t*)malloc(sizeof(Palette_t));
+		if (display_isotherm_palette == NULL)
+		{
+			display_palette_cur = base;
+			return changed;
+		}
+		display_isotherm_base = NULL;
+	}
+
+	uint16_t low[DISPLAY_ISOTHERM_MAX];
+	uint16_t high[DISPLAY_ISOTHERM_MAX];
+	const uint8_t* rgb[DISPLAY_ISOTHERM_MAX];
+	int num = 0;
+	for (int i = 0; i < display_isotherm_num; i++)
+	{
+		float lo = (display_isotherm_bands[i].low_celsius - min_celsius) / span * (PALETTE_LUT_SIZE - 1);
+		float hi = (display_isotherm_bands[i].high_celsius - min_celsius) / span * (PALETTE_LUT_SIZE - 1);
+		if (hi < 0.0f || lo > (float)(PALETTE_LUT_SIZE - 1))
+		{
+			continue;
+		}
+		low[num] = (lo < 0.0f) ? 0 : (uint16_t)(lo + 0.5f);
+		high[num] = (hi > (float)(PALETTE_LUT_SIZE - 1)) ? (PALETTE_LUT_SIZE - 1) : (uint16_t)(hi + 0.5f);
+		rgb[num] = display_isotherm_bands[i].rgb;
+		num++;
+	}
+
+	int same = (base == display_isotherm_base && num == display_isotherm_painted && !changed);
+	for (int i = 0; same && i < num; i++)
+	{
+		same = (low[i] == display_isotherm_low[i] && high[i] == display_isotherm_high[i]);
+	}
+	if (!same)
+	{
+		if (base != display_isotherm_base)
+		{
+			memcpy(display_isotherm_palette, base, sizeof(Palette_t));
+			display_isotherm_base = base;
+		}
+		else
+		{
+			for (int i = 0; i < display_isotherm_painted; i++)
+			{
+				palette_copy_range(display_isotherm_palette, base, display_isotherm_low[i], display_isotherm_high[i]);
+			}
+		}
+		for (int i = 0; i < num; i++)
+		{
+			palette_fill_range(display_isotherm_palette, low[i], high[i], rgb[i]);
+			display_isotherm_low[i] = low[i];
+			display_isotherm_high[i] = high[i];
+		}
+		display_isotherm_painted = num;
+		display_palette_version++;
+	}
+	display_palette_cur = display_isotherm_palette;
+	return changed;
+}
+
+//take the windows display_window_set published, clipped to the frame and merged into one span list per row
+//so overlapping windows are filtered and colorized once, returns 1 when they changed
+static int display_window_update(const FrameInfo_t* frameinfo)
+{
+	uint32_t gen = display_window_gen.load(std::memory_order_acquire);
+	if (gen == display_window_applied_gen || display_window_spans == NULL)
+	{
+		return 0;
+	}
+	Area_t rects[DISPLAY_WINDOW_MAX];
+	pthread_mutex_lock(&display_window_mutex);
+	int num = display_window_pending_num;
+	memcpy(rects, display_window_pending, sizeof(rects));
+	display_window_interval = display_window_pending_interval;
+	display_window_applied_gen = display_window_gen.load(std::memory_order_relaxed);
+	pthread_mutex_unlock(&display_window_mutex);
+
+	int width = frameinfo->width;
+	int height = frameinfo->height;
+	display_window_span_num = 0;
+	display_window_pix_num = 0;
+	for (int y = 0; y < height; y++)
+	{
+		int x0[DISPLAY_WINDOW_MAX];
+		int x1[DISPLAY_WINDOW_MAX];
+		int row_num = 0;
+		for (int i = 0; i < num; i++)
+		{
+			int start = (rects[i].start_x < 0) ? 0 : rects[i].start_x;
+			int stop = rects[i].start_x + rects[i].width;
+			stop = (stop > width) ? width : stop;
+			if (y < rects[i].start_y || y >= rects[i].start_y + rects[i].height || start >= stop)
+			{
+				continue;
+			}
+			// insertion by start, at most DISPLAY_WINDOW_MAX per row
+			int k = row_num++;
+			while (k > 0 && x0[k - 1] > start)
+			{
+				x0[k] = x0[k - 1];
+				x1[k] = x1[k - 1];
+				k--;
+			}
+			x0[k] = start;
+			x1[k] = stop;
+		}
+		for (int k = 0; k < row_num; k++)
+		{
+			DisplaySpan_t* last = (display_window_span_num > 0) ? \
+				&display_window_spans[display_window_span_num - 1] : NULL;
+			int begin = y * width + x0[k];
+			int end = y * width + x1[k];
+			if (last != NULL && begin <= last->end)
+			{
+				if (end > last->end)
+				{
+					display_window_pix_num += end - last->end;
+					last->end = end;
+				}
+				continue;
+			}
+			display_window_spans[display_window_span_num].begin = begin;
+			display_window_spans[display_window_span_num].end = end;
+			display_window_span_num++;
+			display_window_pix_num += end - begin;
+		}
+	}
+	display_window_num = num;
+	display_window_valid = 0;
+	return 1;
+}
+
+//the windows or the tile reuse take this frame: a chain they cover and no mode that needs the whole frame
+static uint8_t display_window_eligible(const FrameInfo_t* frameinfo)
+{
+	return display_window_frame != NULL && \
+		(frameinfo->input_format == INPUT_FMT_Y14 || frameinfo->input_format == INPUT_FMT_Y16) && \
+		frameinfo->pseudo_color_status == PSEUDO_COLOR_ON && frameinfo->output_format == OUTPUT_FMT_BGR888 && \
+		fused_color_enabled && display_nr_mode != DISPLAY_NR_SPATIAL && display_nr_mode != DISPLAY_NR_AVERAGE && \
+		!human_segmentation_enabled && display_upscale_factor <= 1 && !display_gpu_enabled && \
+		!zoom_view_active(&display_zoom_view) && !display_sink_takes_raw(&display_sink);
+}
+
+//the changed tiles' pieces of the window spans (of every row without windows), merged per row
+static int display_tile_spans_build(const uint8_t* changed, int cols, int width, int height, int* covered)
+{
+	int src_num = (display_window_num > 0) ? display_window_span_num : height;
+	int span_num = 0;
+	*covered = 0;
+	for (int i = 0; i < src_num; i++)
+	{
+		int begin = (display_window_num > 0) ? display_window_spans[i].begin : i * width;
+		int end = (display_window_num > 0) ? display_window_spans[i].end : (i + 1) * width;
+		int y = begin / width;
+		int row = y * width;
+		const uint8_t* tile_row = changed + (y / FRAME_TILES_SIZE) * cols;
+		for (int x = begin - row; x < end - row; )
+		{
+			int piece_end = (x / FRAME_TILES_SIZE + 1) * FRAME_TILES_SIZE;
+			piece_end = (piece_end < end - row) ? piece_end : end - row;
+			if (tile_row[x / FRAME_TILES_SIZE])
+			{
+				DisplaySpan_t* last = (span_num > 0) ? &display_tile_spans[span_num - 1] : NULL;
+				if (last != NULL && last->end == row + x)
+				{
+					last->end = row + piece_end;
+				}
+				else
+				{
+					display_tile_spans[span_num].begin = row + x;
+					display_tile_spans[span_num].end = row + piece_end;
+					span_num++;
+				}
+				*covered += piece_end - x;
+			}
+			x = piece_end;
+		}
+	}
+	return span_num;
+}
+
+//temporal nr and the fused colorize of the window spans into display_window_frame, the whole frame on refresh
+//the stretch range stays the stream thread's one of the whole unfiltered frame, a pass over the filtered
+//frame would cost what the windows save. with image_tiles only the tiles changed since they were last drawn
+//are redone, with the plan of the last refresh as long as the frame's range stays within the tolerance.
+//*frame_out is the frame to show
+static int display_image_process_windows(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const FrameStats_t* image_stats, const FrameTiles_t* image_tiles, uint8_t refresh, uint8_t** frame_out)
+{
+	static DisplaySpan_t full_span;
+	static ColorizePlan_t plan;
+	static FrameTiles_t tiles_ref;
+	static uint8_t tile_changed[FRAME_TILES_MAX];
+	static uint16_t plan_min = 0;
+	static uint16_t plan_max = 0;
+	uint32_t tolerance = display_tile_tolerance;
+	if (image_tiles != NULL && !refresh && (!tiles_ref.valid || \
+		abs((int)image_stats->min_val - (int)plan_min) > (int)tolerance || \
+		abs((int)image_stats->max_val - (int)plan_max) > (int)tolerance))
+	{
+		// the colors of every pixel move with the range, the whole frame is redrawn
+		refresh = 1;
+	}
+
+	full_span.begin = 0;
+	full_span.end = pix_num;
+	const DisplaySpan_t* spans = &full_span;
+	int span_num = 1;
+	int covered = pix_num;
+	if (refresh)
+	{
+		tiles_ref.valid = 0;
+		if (image_tiles != NULL)
+		{
+			tiles_ref = *image_tiles;
+			plan_min = image_stats->min_val;
+			plan_max = image_stats->max_val;
+		}
+	}
+	else if (image_tiles != NULL)
+	{
+		int cols = image_tiles->cols;
+		frame_tiles_changed(&tiles_ref, image_tiles, frameinfo->width, frameinfo->height, tolerance, tile_changed);
+		for (int i = 0; i < cols * image_tiles->rows; i++)
+		{
+			if (tile_changed[i])
+			{
+				tiles_ref.sum[i] = image_tiles->sum[i];
+				tiles_ref.max[i] = image_tiles->max[i];
+			}
+		}
+		spans = display_tile_spans;
+		span_num = display_tile_spans_build(tile_changed, cols, frameinfo->width, frameinfo->height, &covered);
+	}
+	else
+	{
+		spans = display_window_spans;
+		span_num = display_window_span_num;
+		covered = display_window_pix_num;
+	}
+
+	uint16_t* src = (uint16_t*)image_frame;
+	if (display_nr_mode == DISPLAY_NR_TEMPORAL && display_nr_frame != NULL && span_num > 0)
+	{
+		uint64_t nr_start_us = timing_start();
+		int shift = (frameinfo->input_format == INPUT_FMT_Y16) ? 2 : 0;
+		Tnr_t* tnr = display_nr_tnr();
+		int rst = TNR_SUCCESS;
+		for (int i = 0; i < span_num && rst == TNR_SUCCESS; i++)
+		{
+			rst = tnr_process_span(tnr, src, pix_num, spans[i].begin, spans[i].end, shift, display_nr_frame);
+		}
+		if (rst == TNR_SUCCESS)
+		{
+			src = display_nr_frame;
+		}
+		timing_record_since(TIMING_STAGE_DISPLAY_NR, nr_start_us);
+	}
+
+	// tile reuse keeps the refresh's plan, the windows alone take a new one every frame
+	uint8_t prepare = refresh || image_tiles == NULL;
+	if (prepare && colorize_plan_prepare_palette(&plan, src, pix_num, frameinfo, display_palette_get(), \
+		image_stats) != COLORIZE_SUCCESS)
+	{
+		tiles_ref.valid = 0;
+		return -1;
+	}
+	frameinfo->byte_size = pix_num * 3;
+	for (int i = 0; i < span_num; i++)
+	{
+		colorize_plan_apply(&plan, src, spans[i].begin, spans[i].end, display_window_frame, NULL);
+	}
+	if (prepare)
+	{
+		colorize_plan_commit(&plan, covered);
+	}
+
+	*frame_out = display_window_frame;
+	if (frameinfo->rotate_side != NO_ROTATE || frameinfo->mirror_flip_status != STATUS_NO_MIRROR_FLIP)
+	{
+		frame_transform(display_window_frame, frameinfo, frameinfo->rotate_side, frameinfo->mirror_flip_status, \
+			image_tmp_frame2);
+		*frame_out = image_tmp_frame2;
+	}
+	return 0;
 }
 
-// 在颜色条右侧添加动态温度标签
-void add_temperature_labels(cv::Mat& combined_image, int bar_x, int bar_y, 
-                            int bar_height, float max_temp, float min_temp)
+static std::atomic<uint32_t> display_cmd_pending[DISPLAY_CMD_NUM];
+static pthread_mutex_t display_settings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DisplaySettings_t display_settings_pending;   //display_settings_set's copy, under the mutex
+static std::atomic<uint32_t> display_settings_gen(0);
+static uint32_t display_settings_applied_gen = 0;
+
+void display_cmd_post(DisplayCmd_t cmd)
 {
-	char temp_text[32];
-	for (int i = 0; i < TEMP_LABEL_COUNT; i++) {
-		// 根据实际温度范围计算温度值（动态）
-		float temp = max_temp - (max_temp - min_temp) * i / (TEMP_LABEL_COUNT - 1);
-		int y_pos = bar_y + (int)(i * (bar_height - 1) / (TEMP_LABEL_COUNT - 1));
-		
-		sprintf(temp_text, "%.1f", temp);
-		
-		// 文字位置：颜色条右侧
-		int text_x = bar_x + COLOR_BAR_WIDTH + 5;
-		int text_y = y_pos + 4;  // 文字垂直居中对齐
-		
-		// 绘制文字（黑色阴影 + 白色文字）
-		putText(combined_image, temp_text, cv::Point(text_x + 1, text_y + 1), 
-		        cv::FONT_HERSHEY_SIMPLEX, 0.4, cv::Scalar(0, 0, 0), 1, 8);
-		putText(combined_image, temp_text, cv::Point(text_x, text_y), 
-		        cv::FONT_HERSHEY_SIMPLEX, 0.4, cv::Scalar(255, 255, 255), 1, 8);
+	if (cmd >= 0 && cmd < DISPLAY_CMD_NUM)
+	{
+		display_cmd_pending[cmd].fetch_add(1, std::memory_order_relaxed);
 	}
 }
 
-// 基于真实温度的人体分割函数
-// y14_data: Y14格式的图像数据
-// width, height: 图像尺寸
-// dst_frame: 输出BGR图像
-void segment_human_by_real_temperature(uint16_t* y14_data, int width, int height, uint8_t* dst_frame)
+int display_cmd_of_key(int key)
 {
-	if (y14_data == NULL || dst_frame == NULL) {
-		return;
+	static const char cmd_key[DISPLAY_CMD_NUM] = { 's', 'a', 'f', 'g', 'u', 'i', 'n', 'p', 't', 'z', 'h', 'j', 'k', 'l' };
+	for (int cmd = 0; cmd < DISPLAY_CMD_NUM; cmd++)
+	{
+		if (key == cmd_key[cmd] || key == cmd_key[cmd] - 'a' + 'A')
+		{
+			return cmd;
+		}
 	}
-	
-	int pix_num = width * height;
-	TempDataRes_t temp_res = { (uint16_t)width, (uint16_t)height };
-	
-	// 创建掩码后的Y14数据
-	uint16_t* masked_y14 = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
-	if (masked_y14 == NULL) {
-		fprintf(stderr, "segment_human_by_real_temperature: failed to allocate masked_y14\n");
-		return;
+	return -1;
+}
+
+static void display_cmd_run(DisplayCmd_t cmd, StreamFrameInfo_t* stream_frame_info)
+{
+	switch (cmd) {
+	// 's' 切换人体分割模式
+	case DISPLAY_CMD_SEGMENTATION:
+		human_segmentation_enabled = !human_segmentation_enabled;
+		printf("\n========================================\n");
+		printf("[Human Segmentation] 模式: %s\n", 
+		       human_segmentation_enabled ? "已开启 ✓" : "已关闭 ✗");
+		printf("[Human Segmentation] 温度阈值: %.1f-%.1f°C\n",
+		       HUMAN_TEMP_MIN_CELSIUS, HUMAN_TEMP_MAX_CELSIUS);
+		printf("[Human Segmentation] 按 's' 键切换模式\n");
+		printf("========================================\n\n");
+		break;
+	// 'a' 在最大最小值拉伸、直方图AGC、库函数AGC+DDE、CLAHE与直方图AGC+DDE之间切换
+	case DISPLAY_CMD_ENHANCE: {
+		ImgEnhance_t* enhance_status = &stream_frame_info->image_info.img_enhance_status;
+		if (*enhance_status == IMG_ENHANCE_ON) {
+			*enhance_status = IMG_ENHANCE_HIST_AGC;
+		} else if (*enhance_status == IMG_ENHANCE_HIST_AGC) {
+			*enhance_status = IMG_ENHANCE_LIB;
+		} else if (*enhance_status == IMG_ENHANCE_LIB) {
+			*enhance_status = IMG_ENHANCE_CLAHE;
+		} else if (*enhance_status == IMG_ENHANCE_CLAHE) {
+			*enhance_status = IMG_ENHANCE_DDE;
+		} else {
+			*enhance_status = IMG_ENHANCE_ON;
+		}
+		printf("[Enhance] %s\n", enhance_name(*enhance_status));
+		break;
 	}
-	
-	// 统计人体像素数量和温度范围
-	int human_pixel_count = 0;
-	float min_human_temp = 999.0f;
-	float max_human_temp = -999.0f;
-	uint16_t min_y14 = 65535;
-	uint16_t max_y14 = 0;
-	
-	// 第一遍扫描：统计人体区域的温度和Y14范围
-	for (int y = 0; y < height; y++) {
-		for (int x = 0; x < width; x++) {
-			int pixel_index = y * width + x;
-			Dot_t point = { (uint16_t)x, (uint16_t)y };
-			uint16_t temp_raw = 0;  // 单位：1/64 K
-			
-			// 使用SDK函数获取该点的真实温度
-			if (get_point_temp(y14_data, temp_res, point, &temp_raw) == IRTEMP_SUCCESS) {
-				float temp_celsius = temp_value_converter(temp_raw);
-				
-				// 判断是否在人体温度范围内
-				if (temp_celsius >= HUMAN_TEMP_MIN_CELSIUS && temp_celsius <= HUMAN_TEMP_MAX_CELSIUS) {
-					human_pixel_count++;
-					
-					// 统计温度范围
-					if (temp_celsius < min_human_temp) min_human_temp = temp_celsius;
-					if (temp_celsius > max_human_temp) max_human_temp = temp_celsius;
-					
-					// 统计Y14范围
-					if (y14_data[pixel_index] < min_y14) min_y14 = y14_data[pixel_index];
-					if (y14_data[pixel_index] > max_y14) max_y14 = y14_data[pixel_index];
-				}
-			}
+	// 'f' 在融合伪彩色与库参考流程之间切换，便于对比输出
+	case DISPLAY_CMD_FUSED_COLOR:
+		fused_color_enabled = !fused_color_enabled;
+		printf("[Pseudo Color] %s\n", fused_color_enabled ? "fused lut kernel" : "library reference chain");
+		break;
+	// 'g' 在gpu与cpu伪彩色之间切换，首次开启时初始化设备
+	case DISPLAY_CMD_GPU:
+		display_gpu_enabled = !display_gpu_enabled;
+		if (display_gpu_enabled && gpu_init() != GPU_SUCCESS) {
+			display_gpu_enabled = 0;
 		}
+		printf("[GPU] %s%s\n", display_gpu_enabled ? "on " : "off", gpu_device_name());
+		break;
+	// 'u' 在1-4倍放大之间切换，'i' 在双线性与双三次插值之间切换
+	case DISPLAY_CMD_UPSCALE_FACTOR:
+		display_upscale_factor = (display_upscale_factor % UPSCALE_FACTOR_MAX) + 1;
+		printf("[Upscale] x%d %s\n", display_upscale_factor, upscale_mode_name((UpscaleMode_t)display_upscale_mode));
+		break;
+	case DISPLAY_CMD_UPSCALE_MODE:
+		display_upscale_mode = (display_upscale_mode + 1) % UPSCALE_MODE_NUM;
+		printf("[Upscale] x%d %s\n", display_upscale_factor, upscale_mode_name((UpscaleMode_t)display_upscale_mode));
+		break;
+	// 'n' 在关闭、空域降噪与时域降噪之间切换
+	case DISPLAY_CMD_NR: {
+		static const char* nr_mode_name[DISPLAY_NR_MODE_NUM] = { "off", "spatial (library)", "temporal (recursive)", "average (moving window)" };
+		display_nr_mode = (display_nr_mode + 1) % DISPLAY_NR_MODE_NUM;
+		printf("[Noise Reduction] %s\n", nr_mode_name[display_nr_mode]);
+		break;
 	}
-	
-	// 第二遍扫描：生成掩码并进行线性拉伸
-	for (int y = 0; y < height; y++) {
-		for (int x = 0; x < width; x++) {
-			int pixel_index = y * width + x;
-			Dot_t point = { (uint16_t)x, (uint16_t)y };
-			uint16_t temp_raw = 0;  // 单位：1/64 K
-			
-			// 使用SDK函数获取该点的真实温度
-			if (get_point_temp(y14_data, temp_res, point, &temp_raw) == IRTEMP_SUCCESS) {
-				float temp_celsius = temp_value_converter(temp_raw);
-				
-				// 判断是否在人体温度范围内
-				if (temp_celsius >= HUMAN_TEMP_MIN_CELSIUS && temp_celsius <= HUMAN_TEMP_MAX_CELSIUS) {
-					// 在范围内，将Y14值线性拉伸到全范围(0-16383)以获得更好的伪彩色显示
-					if (max_y14 > min_y14) {
-						float normalized = (float)(y14_data[pixel_index] - min_y14) / (float)(max_y14 - min_y14);
-						masked_y14[pixel_index] = (uint16_t)(normalized * 16383.0f);
-					} else {
-						// 如果所有人体像素Y14值相同，设为中间值
-						masked_y14[pixel_index] = 8191;
-					}
-				} else {
-					// 不在范围内，设为0（背景）
-					masked_y14[pixel_index] = 0;
-				}
-			} else {
-				// 解算失败，设为背景
-				masked_y14[pixel_index] = 0;
-			}
+	// 'p' 切换到下一个调色板，只交换一个指针
+	case DISPLAY_CMD_PALETTE: {
+		irproc_color_mode_t next_mode = palette_next(palette_active()->color_mode);
+		palette_select(next_mode);
+		printf("[Palette] color mode %d%s\n", next_mode, palette_get(next_mode)->user ? " (user)" : "");
+		break;
+	}
+	// 't' 打印各阶段耗时统计
+	case DISPLAY_CMD_TIMING: {
+		timing_dump();
+		rt_dump(stdout);
+		DisplaySinkStats_t sink_stats;
+		display_sink_stats(&display_sink, &sink_stats);
+		printf("display sink: %llu presented, %llu shown, %llu replaced before shown, %llu failed\n", \
+			(unsigned long long)sink_stats.presented, (unsigned long long)sink_stats.shown, \
+			(unsigned long long)sink_stats.replaced, (unsigned long long)sink_stats.failed);
+		break;
+	}
+	// 'z' 在1/2/4/8倍数字变焦之间切换，'h'/'j'/'k'/'l' 平移变焦窗口，只影响显示
+	case DISPLAY_CMD_ZOOM:
+		zoom_view_step(&display_zoom_view);
+		printf("[Zoom] x%.0f\n", display_zoom_view.factor);
+		break;
+	case DISPLAY_CMD_PAN_LEFT:
+	case DISPLAY_CMD_PAN_DOWN:
+	case DISPLAY_CMD_PAN_UP:
+	case DISPLAY_CMD_PAN_RIGHT: {
+		static const int pan_x[4] = { -1, 0, 0, 1 };
+		static const int pan_y[4] = { 0, 1, -1, 0 };
+		zoom_view_pan(&display_zoom_view, pan_x[cmd - DISPLAY_CMD_PAN_LEFT], pan_y[cmd - DISPLAY_CMD_PAN_LEFT]);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+int display_settings_set(const DisplaySettings_t* settings)
+{
+	if (settings == NULL || settings->pseudo_color >= PSEUDO_COLOR_NUM || settings->enhance >= IMG_ENHANCE_NUM || \
+		settings->rotate > ROTATE_180D || settings->mirror_flip > STATUS_MIRROR_FLIP || \
+		settings->palette >= PALETTE_MODE_NUM || settings->upscale_factor == 0 || \
+		settings->upscale_factor > UPSCALE_FACTOR_MAX || settings->upscale_mode >= UPSCALE_MODE_NUM || \
+		settings->nr_mode >= DISPLAY_NR_MODE_NUM)
+	{
+		return -1;
+	}
+	pthread_mutex_lock(&display_settings_mutex);
+	display_settings_pending = *settings;
+	display_settings_gen.fetch_add(1, std::memory_order_release);
+	pthread_mutex_unlock(&display_settings_mutex);
+	return 0;
+}
+
+//on the display thread, the settings in the display's copy of image_info and the display globals
+static void display_settings_apply(StreamFrameInfo_t* stream_frame_info)
+{
+	pthread_mutex_lock(&display_settings_mutex);
+	DisplaySettings_t settings = display_settings_pending;
+	display_settings_applied_gen = display_settings_gen.load(std::memory_order_relaxed);
+	pthread_mutex_unlock(&display_settings_mutex);
+	FrameInfo_t* info = &stream_frame_info->image_info;
+	if (settings.pseudo_color >= 0) {
+		info->pseudo_color_status = (PseudoColor_t)settings.pseudo_color;
+	}
+	if (settings.enhance >= 0) {
+		info->img_enhance_status = (ImgEnhance_t)settings.enhance;
+	}
+	if (settings.rotate >= 0) {
+		info->rotate_side = (RotateSide_t)settings.rotate;
+	}
+	if (settings.mirror_flip >= 0) {
+		info->mirror_flip_status = (MirrorFlipStatus_t)settings.mirror_flip;
+	}
+	if (settings.palette >= 0 && palette_select((irproc_color_mode_t)settings.palette) != PALETTE_SUCCESS) {
+		printf("[Palette] color mode %d has no palette, kept %d\n", settings.palette, palette_active()->color_mode);
+	}
+	if (settings.upscale_factor > 0) {
+		display_upscale_factor = (uint8_t)settings.upscale_factor;
+	}
+	if (settings.upscale_mode >= 0) {
+		display_upscale_mode = (uint8_t)settings.upscale_mode;
+	}
+	if (settings.nr_mode >= 0) {
+		display_nr_mode = (uint8_t)settings.nr_mode;
+	}
+	if (settings.segmentation >= 0) {
+		human_segmentation_enabled = (settings.segmentation != 0);
+	}
+}
+
+//the window's keys become commands, then every pending command runs once per post, returns the commands run
+static int display_cmd_apply(StreamFrameInfo_t* stream_frame_info)
+{
+	int key;
+	int cmd_num = 0;
+	while ((key = display_sink_poll_key(&display_sink)) != SINK_KEY_NONE) {
+		int cmd = display_cmd_of_key(key);
+		if (cmd >= 0) {
+			display_cmd_post((DisplayCmd_t)cmd);
 		}
 	}
-	
-	// 打印分割统计信息
-	printf("[Human Segmentation] 温度阈值: %.1f-%.1f°C\n", 
-	       HUMAN_TEMP_MIN_CELSIUS, HUMAN_TEMP_MAX_CELSIUS);
-	printf("[Human Segmentation] 人体像素: %d/%d (%.1f%%)\n",
-	       human_pixel_count, pix_num, 100.0f * human_pixel_count / pix_num);
-	if (human_pixel_count > 0) {
-		printf("[Human Segmentation] 人体温度范围: %.2f-%.2f°C\n",
-		       min_human_temp, max_human_temp);
-		printf("[Human Segmentation] Y14拉伸: %d-%d → 0-16383 (线性映射到全伪彩色范围)\n",
-		       min_y14, max_y14);
+	//settings first, the toggles posted with them step from the new values
+	if (display_settings_gen.load(std::memory_order_acquire) != display_settings_applied_gen) {
+		display_settings_apply(stream_frame_info);
+		cmd_num++;
 	}
-	
-	// 分配YUYV伪彩色缓冲区
-	uint8_t* yuyv_buffer = (uint8_t*)malloc(pix_num * 2);
-	if (yuyv_buffer == NULL) {
-		fprintf(stderr, "segment_human_by_real_temperature: failed to allocate yuyv_buffer\n");
-		free(masked_y14);
+	for (int cmd = 0; cmd < DISPLAY_CMD_NUM; cmd++) {
+		uint32_t count = display_cmd_pending[cmd].exchange(0, std::memory_order_relaxed);
+		while (count-- > 0) {
+			display_cmd_run((DisplayCmd_t)cmd, stream_frame_info);
+			cmd_num++;
+		}
+	}
+	return cmd_num;
+}
+
+#ifdef ARENA_HEAP_CHECK
+//everything that sizes the display's buffers, a change restarts the heap check warmup
+static uint64_t display_config_key(const StreamFrameInfo_t* stream_frame_info)
+{
+	const FrameInfo_t* info = &stream_frame_info->image_info;
+	uint64_t key = (uint64_t)info->width << 48 | (uint64_t)info->height << 32;
+	key ^= (uint64_t)info->input_format << 24 | (uint64_t)info->output_format << 20 | \
+		(uint64_t)info->pseudo_color_status << 16 | (uint64_t)info->img_enhance_status << 12 | \
+		(uint64_t)info->rotate_side << 8 | (uint64_t)info->mirror_flip_status << 4;
+	key ^= (uint64_t)display_upscale_factor << 40 | (uint64_t)display_upscale_mode << 36 | \
+		(uint64_t)display_nr_mode << 28 | (uint64_t)display_band_num << 44 | (uint64_t)display_gpu_enabled << 3 | \
+		(uint64_t)fused_color_enabled << 2 | (uint64_t)fused_transform_enabled << 1 | human_segmentation_enabled;
+	key ^= (uint64_t)display_window_applied_gen << 52 | (uint64_t)display_tile_reuse << 51;
+	return key;
+}
+
+//ARENA_WARMUP_FRAMES after a reconfiguration or an arena overflow the display thread must not touch the heap,
+//band tasks on other pool threads are not counted
+static void display_heap_check(uint64_t allocs, uint8_t reconfigured)
+{
+	if (reconfigured) {
+		display_heap_steady = 0;
 		return;
 	}
-	
-	// 将掩码后的Y14转换为YUYV伪彩色
-	y14_map_to_yuyv_pseudocolor(masked_y14, pix_num, IRPROC_COLOR_MODE_6, yuyv_buffer);
-	
-	// 分配RGB缓冲区
-	uint8_t* rgb_buffer = (uint8_t*)malloc(pix_num * 3);
-	if (rgb_buffer == NULL) {
-		fprintf(stderr, "segment_human_by_real_temperature: failed to allocate rgb_buffer\n");
-		free(masked_y14);
-		free(yuyv_buffer);
+	if (display_heap_steady < ARENA_WARMUP_FRAMES) {
+		display_heap_steady++;
 		return;
 	}
-	
-	// 将YUYV转换为RGB
-	yuv422_to_rgb(yuyv_buffer, pix_num, rgb_buffer);
-	
-	// 将RGB转换为BGR (OpenCV使用BGR格式)
-	rgb_to_bgr(rgb_buffer, pix_num, dst_frame);
-	
-	// 强制将背景像素设置为纯黑色 (0, 0, 0)
-	for (int i = 0; i < pix_num; i++) {
-		if (masked_y14[i] == 0) {
-			dst_frame[i * 3 + 0] = 0;  // B
-			dst_frame[i * 3 + 1] = 0;  // G
-			dst_frame[i * 3 + 2] = 0;  // R
-		}
+	if (allocs > 0) {
+		fprintf(stderr, "[Heap Check] %llu heap allocations in a steady state display frame\n", (unsigned long long)allocs);
 	}
-	
-	// 释放临时缓冲区
-	free(masked_y14);
-	free(yuyv_buffer);
-	free(rgb_buffer);
+	assert(allocs == 0);
 }
 #endif
 
@@ -596,8 +2147,23 @@ void display_one_frame(StreamFrameInfo_t* stream_frame_info)
 		return;
 	}
 
-	char key_press = 0;
 	int rst = 0;
+	uint64_t frame_start_us = timing_start();
+#ifdef ARENA_HEAP_CHECK
+	uint64_t heap_start = arena_heap_thread_allocs();
+	uint32_t arena_overflows = display_arena.overflows;
+#endif
+	// 上一帧的临时内存在帧开始时整体释放
+	arena_reset(&display_arena);
+	// 按键和命令在帧开始时处理，处理流程不等待输入
+	int cmd_num = display_cmd_apply(stream_frame_info);
+#ifdef ARENA_HEAP_CHECK
+	static uint64_t config_key = 0;
+	uint64_t frame_config_key = display_config_key(stream_frame_info);
+	uint8_t reconfigured = (cmd_num > 0 || frame_config_key != config_key);
+	config_key = frame_config_key;
+#endif
+	uint64_t stage_start_us = frame_start_us;
 	static struct timeval now_time,last_time;
 	gettimeofday(&now_time, NULL);
 	float frame = 1000000 / (double)((now_time.tv_sec - last_time.tv_sec)*1000000+\
@@ -607,29 +2173,124 @@ void display_one_frame(StreamFrameInfo_t* stream_frame_info)
 	char frameText[10] = { " " };
 	sprintf(frameText, "%.2f", frame);
 
-	// 获取最高温度和最低温度
-	uint16_t max_temp_raw = 0;
-	uint16_t min_temp_raw = 0;
+	// 获取最高温度和最低温度：默认从内存中的温度帧计算，不占用USB控制传输
 	float max_temp_celsius = 0.0f;
 	float min_temp_celsius = 0.0f;
+	uint8_t temp_range_valid = 0;
+	// 锁定色标范围：颜色条固定为锁定的范围，最高/最低温度只取stream线程已有的统计值，不再逐帧扫描
+	float bar_max_celsius = 0.0f;
+	float bar_min_celsius = 0.0f;
+	uint8_t span_locked = (temp_span_range(&bar_min_celsius, &bar_max_celsius) == 0);
+	if (host_temp_range_enabled) {
+		temp_range_valid = (display_temp_range_get(stream_frame_info, !span_locked, &max_temp_celsius, \
+			&min_temp_celsius) == 0);
+	}
 	
 #ifdef THERMAL_CAM_CMD
-	// 调用温度解算函数
-	if (tpd_get_max_temp(&max_temp_raw) == 0) {
-		// 温度单位是 1/16 K，转换为摄氏度: °C = K - 273.15
-		max_temp_celsius = (max_temp_raw / 16.0f) - 273.15f;
+	// 固件查询：没有主机端结果时每帧查询，否则每fw_temp_check_interval帧校验一次
+	static uint32_t fw_temp_check_cnt = 0;
+	uint8_t fw_query = !temp_range_valid && !span_locked;
+	if (temp_range_valid && fw_temp_check_interval > 0 && ++fw_temp_check_cnt >= fw_temp_check_interval) {
+		fw_temp_check_cnt = 0;
+		fw_query = 1;
 	}
-	if (tpd_get_min_temp(&min_temp_raw) == 0) {
-		min_temp_celsius = (min_temp_raw / 16.0f) - 273.15f;
+	if (fw_query) {
+		uint16_t max_temp_raw = 0;
+		uint16_t min_temp_raw = 0;
+		// 温度单位是 1/16 K，先换成温度平面的 1/64 K，再转换为摄氏度显示
+		if (tpd_get_max_temp(&max_temp_raw) == 0 && tpd_get_min_temp(&min_temp_raw) == 0) {
+			float fw_max_celsius = temp_celsius_of_raw(temp_raw_of_fw(max_temp_raw));
+			float fw_min_celsius = temp_celsius_of_raw(temp_raw_of_fw(min_temp_raw));
+			if (!temp_range_valid) {
+				max_temp_celsius = fw_max_celsius;
+				min_temp_celsius = fw_min_celsius;
+				temp_range_valid = 1;
+			} else if (fabsf(fw_max_celsius - max_temp_celsius) > FW_TEMP_CHECK_TOLERANCE || \
+				fabsf(fw_min_celsius - min_temp_celsius) > FW_TEMP_CHECK_TOLERANCE) {
+				printf("[Temp Check] host max/min %.2f/%.2f C, firmware %.2f/%.2f C\n", \
+					max_temp_celsius, min_temp_celsius, fw_max_celsius, fw_min_celsius);
+			}
+		}
 	}
 #endif
 
+	if (!span_locked) {
+		bar_max_celsius = max_temp_celsius;
+		bar_min_celsius = min_temp_celsius;
+	}
+
 	int pix_num = stream_frame_info->image_info.width * stream_frame_info->image_info.height;
 	int width = stream_frame_info->image_info.width;
 	int height = stream_frame_info->image_info.height;
-#ifndef OPENCV_ENABLE
-	printf("raw data=%d\n", ((uint16_t*)stream_frame_info->image_frame)[1000]);
+
+	// 降噪后的帧不再对应stream线程的统计值，交给后续流程重新统计
+	uint8_t* image_frame = stream_frame_info->image_frame;
+	uint8_t* display_frame = NULL;
+	const FrameStats_t* image_stats = stream_frame_info->image_stats;
+	// 关注区域：只处理窗口内的像素，整帧每display_window_interval帧或命令之后刷新一次
+	uint8_t windowed = 0;
+	uint8_t window_refresh = 0;
+	uint8_t window_shown = 0;
+	// 等温色带画进调色板的副本，色带变化后窗口外的部分也要整帧刷新
+	if (display_palette_update(temp_range_valid || span_locked, bar_max_celsius, bar_min_celsius)) {
+		display_window_valid = 0;
+	}
+	// 锁定色标范围时温度平面经共享的温度查找表直接伪彩色，帧有温度平面且与图像同尺寸才行
+	const TempSpan_t* span = NULL;
+	if (span_locked && !human_segmentation_enabled && stream_frame_info->temp_frame != NULL && \
+		stream_frame_info->temp_info.width == stream_frame_info->image_info.width && \
+		stream_frame_info->temp_info.height == stream_frame_info->image_info.height && \
+		stream_frame_info->image_info.pseudo_color_status == PSEUDO_COLOR_ON && \
+		stream_frame_info->image_info.output_format == OUTPUT_FMT_BGR888) {
+		span = temp_span_get(display_palette_get(), display_palette_version);
+	}
+	if (display_window_update(&stream_frame_info->image_info) || cmd_num > 0) {
+		display_window_valid = 0;
+	}
+	// 静止画面：只重画与上次绘制相比变化了的块，直方图AGC每帧都要整帧的直方图，CLAHE的映射随整帧变化，DDE同样用整帧直方图，都不参与
+	const FrameTiles_t* image_tiles = NULL;
+	if (display_tile_reuse && stream_frame_info->image_tiles != NULL && image_stats != NULL && \
+		stream_frame_info->image_info.img_enhance_status != IMG_ENHANCE_HIST_AGC && \
+		stream_frame_info->image_info.img_enhance_status != IMG_ENHANCE_CLAHE && \
+		stream_frame_info->image_info.img_enhance_status != IMG_ENHANCE_DDE) {
+		image_tiles = stream_frame_info->image_tiles;
+	}
+	if (span == NULL && display_window_eligible(&stream_frame_info->image_info) && \
+		(image_tiles != NULL || (display_window_num > 0 && display_window_span_num > 0))) {
+		windowed = 1;
+		window_refresh = !display_window_valid || \
+			(display_window_interval > 0 && ++display_window_frames >= display_window_interval);
+	}
+	if (display_nr_mode != DISPLAY_NR_OFF && !human_segmentation_enabled && !windowed && span == NULL) {
+		uint64_t nr_start_us = timing_start();
+		image_frame = display_noise_reduction(image_frame, pix_num, &stream_frame_info->image_info);
+		if (image_frame != stream_frame_info->image_frame) {
+			image_stats = NULL;
+		}
+		stage_start_us = timing_record_since(TIMING_STAGE_DISPLAY_NR, nr_start_us);
+	}
+
+	// gl显示端：Y14直接交给显示端，伪彩色、颜色条、等温色带与变焦都在片段着色器中完成，叠加文字改为窗口标题
+	if (span == NULL && display_sink_takes_raw(&display_sink)) {
+		char caption[SINK_PATH_LEN];
+		if (temp_range_valid) {
+			snprintf(caption, sizeof(caption), "%s fps  Max: %.2f C  Min: %.2f C", frameText, max_temp_celsius, \
+				min_temp_celsius);
+		} else {
+			snprintf(caption, sizeof(caption), "%s fps", frameText);
+		}
+		if (display_image_present_raw(image_frame, pix_num, &stream_frame_info->image_info, image_stats, \
+			caption) == 0) {
+			display_window_valid = 0;
+			timing_record_since(TIMING_STAGE_DISPLAY_RENDER, stage_start_us);
+			timing_record_since(TIMING_STAGE_DISPLAY_TOTAL, frame_start_us);
+#ifdef ARENA_HEAP_CHECK
+			display_heap_check(arena_heap_thread_allocs() - heap_start, \
+				reconfigured || display_arena.overflows != arena_overflows);
 #endif
+			return;
+		}
+	}
 
 	// 如果启用了人体分割模式，使用温度数据进行分割
 	if (human_segmentation_enabled && stream_frame_info->temp_frame != NULL) {
@@ -638,13 +2299,85 @@ void display_one_frame(StreamFrameInfo_t* stream_frame_info)
 		                                   stream_frame_info->temp_info.width,
 		                                   stream_frame_info->temp_info.height,
 		                                   image_tmp_frame2);
+		stage_start_us = timing_record_since(TIMING_STAGE_DISPLAY_PROCESS, stage_start_us);
 		
 		// 更新宽高（人体分割输出使用temp_info的尺寸）
 		width = stream_frame_info->temp_info.width;
 		height = stream_frame_info->temp_info.height;
+	} else if (span != NULL) {
+		// 锁定色标范围：每个温度值一次查表，不统计最高/最低温度也不拉伸，再镜像/旋转，计入display_process
+		temp_span_map(span->bgr, (uint16_t*)stream_frame_info->temp_frame, pix_num, image_tmp_frame2);
+		stage_start_us = timing_record_since(TIMING_STAGE_DISPLAY_PROCESS, stage_start_us);
+		if ((stream_frame_info->image_info.rotate_side == LEFT_90D) || \
+			(stream_frame_info->image_info.rotate_side == RIGHT_90D))
+		{
+			width = stream_frame_info->image_info.height;
+			height = stream_frame_info->image_info.width;
+		}
+		transform_demo(&stream_frame_info->image_info, stream_frame_info->image_info.rotate_side, \
+			stream_frame_info->image_info.mirror_flip_status);
+		stage_start_us = timing_record_since(TIMING_STAGE_DISPLAY_TRANSFORM, stage_start_us);
+	} else if (windowed && display_image_process_windows(image_frame, pix_num, &stream_frame_info->image_info, \
+		image_stats, image_tiles, window_refresh, &display_frame) == 0) {
+		// 窗口：降噪与伪彩色只覆盖窗口，镜像/旋转一起完成，计入display_process
+		stage_start_us = timing_record_since(TIMING_STAGE_DISPLAY_PROCESS, stage_start_us);
+		window_shown = 1;
+		if (window_refresh) {
+			display_window_valid = 1;
+			display_window_frames = 0;
+		}
+		if ((stream_frame_info->image_info.rotate_side == LEFT_90D) || \
+			(stream_frame_info->image_info.rotate_side == RIGHT_90D))
+		{
+			width = stream_frame_info->image_info.height;
+			height = stream_frame_info->image_info.width;
+		}
+	} else if (zoom_view_active(&display_zoom_view) && display_image_process_zoom(image_frame, pix_num, \
+		&stream_frame_info->image_info, image_stats) == 0) {
+		// 数字变焦：按变焦窗口的映射表逐行重采样后直接伪彩色，再镜像/旋转，计入display_process
+		stage_start_us = timing_record_since(TIMING_STAGE_DISPLAY_PROCESS, stage_start_us);
+		if ((stream_frame_info->image_info.rotate_side == LEFT_90D) || \
+			(stream_frame_info->image_info.rotate_side == RIGHT_90D))
+		{
+			width = stream_frame_info->image_info.height;
+			height = stream_frame_info->image_info.width;
+		}
+	} else if (display_upscale_factor > 1 && display_image_process_upscale(image_frame, \
+		&stream_frame_info->image_info, image_stats, &display_frame) == 0) {
+		// 放大：Y14先放大，再在输出分辨率上伪彩色与镜像/旋转，计入display_process
+		stage_start_us = timing_record_since(TIMING_STAGE_DISPLAY_PROCESS, stage_start_us);
+		width = stream_frame_info->image_info.width * display_upscale_factor;
+		height = stream_frame_info->image_info.height * display_upscale_factor;
+		if ((stream_frame_info->image_info.rotate_side == LEFT_90D) || \
+			(stream_frame_info->image_info.rotate_side == RIGHT_90D))
+		{
+			width = stream_frame_info->image_info.height * display_upscale_factor;
+			height = stream_frame_info->image_info.width * display_upscale_factor;
+		}
+	} else if (display_gpu_enabled && display_image_process_gpu(image_frame, pix_num, \
+		&stream_frame_info->image_info, image_stats) == 0) {
+		// gpu：伪彩色与镜像/旋转在一个kernel中完成，计入display_process
+		stage_start_us = timing_record_since(TIMING_STAGE_DISPLAY_PROCESS, stage_start_us);
+		if ((stream_frame_info->image_info.rotate_side == LEFT_90D) || \
+			(stream_frame_info->image_info.rotate_side == RIGHT_90D))
+		{
+			width = stream_frame_info->image_info.height;
+			height = stream_frame_info->image_info.width;
+		}
+	} else if (display_band_num > 1 && display_image_process_bands(image_frame, pix_num, \
+		&stream_frame_info->image_info, image_stats, display_band_num) == 0) {
+		// 行带并行：伪彩色与镜像/旋转一起完成，计入display_process
+		stage_start_us = timing_record_since(TIMING_STAGE_DISPLAY_PROCESS, stage_start_us);
+		if ((stream_frame_info->image_info.rotate_side == LEFT_90D) || \
+			(stream_frame_info->image_info.rotate_side == RIGHT_90D))
+		{
+			width = stream_frame_info->image_info.height;
+			height = stream_frame_info->image_info.width;
+		}
 	} else {
 		// 常规图像处理流程
-		display_image_process(stream_frame_info->image_frame, pix_num, &stream_frame_info->image_info);
+		display_image_process(image_frame, pix_num, &stream_frame_info->image_info, image_stats);
+		stage_start_us = timing_record_since(TIMING_STAGE_DISPLAY_PROCESS, stage_start_us);
 		if ((stream_frame_info->image_info.rotate_side == LEFT_90D)|| \
 			(stream_frame_info->image_info.rotate_side == RIGHT_90D))
 		{
@@ -652,129 +2385,170 @@ void display_one_frame(StreamFrameInfo_t* stream_frame_info)
 			height = stream_frame_info->image_info.width;
 		}
 
-		mirror_flip_demo(&stream_frame_info->image_info, image_tmp_frame2, \
+		// the library's mirror/rotate have no 4 byte format
+		if (fused_transform_enabled || display_output_bpp(stream_frame_info->image_info.output_format) == 4)
+		{
+			transform_demo(&stream_frame_info->image_info, stream_frame_info->image_info.rotate_side, \
 						stream_frame_info->image_info.mirror_flip_status);
-		rotate_demo(&stream_frame_info->image_info, image_tmp_frame2, \
-					stream_frame_info->image_info.rotate_side);
+		}
+		else
+		{
+			mirror_flip_demo(&stream_frame_info->image_info, image_tmp_frame2, \
+							stream_frame_info->image_info.mirror_flip_status);
+			rotate_demo(&stream_frame_info->image_info, image_tmp_frame2, \
+						stream_frame_info->image_info.rotate_side);
+		}
+		stage_start_us = timing_record_since(TIMING_STAGE_DISPLAY_TRANSFORM, stage_start_us);
 	}
 
+	if (display_frame == NULL) {
+		display_frame = image_tmp_frame2;
+	}
+	// 窗口与各显示后端只接受BGR888，4字节输出在显示前转换一次
+	int frame_bpp = (human_segmentation_enabled && stream_frame_info->temp_frame != NULL) ? 3 : \
+		display_output_bpp(stream_frame_info->image_info.output_format);
+	if (frame_bpp == 4) {
+		display_rgba32_to_bgr(display_frame, width * height, \
+			stream_frame_info->image_info.output_format == OUTPUT_FMT_RGBA32, image_tmp_frame1);
+		display_frame = image_tmp_frame1;
+	}
+	if (!window_shown) {
+		// 其他流程画出的帧不在窗口画布里，重新用窗口时先整帧刷新
+		display_window_valid = 0;
+	}
 #ifdef OPENCV_ENABLE
-	cv::Mat image = cv::Mat(height, width, CV_8UC3, image_tmp_frame2);
+	cv::Mat image = cv::Mat(height, width, CV_8UC3, display_frame);
 	
 	// 获取当前使用的颜色模式
-	irproc_color_mode_t current_color_mode = IRPROC_COLOR_MODE_3;
-	if (stream_frame_info->image_info.output_format == OUTPUT_FMT_BGR888) {
-		current_color_mode = IRPROC_COLOR_MODE_6;
-	}
+	irproc_color_mode_t current_color_mode = palette_active()->color_mode;
+	display_overlay_update(frameText, temp_range_valid, max_temp_celsius, min_temp_celsius);
 	
 	// 创建颜色对比条（只在伪彩色模式下显示）
-	cv::Mat combined_image;
+	// 组合图像预先分配并跨帧复用，只有尺寸、颜色条或温度范围变化时才重绘对应区域
+	static cv::Mat combined_image;
+	static cv::Mat combined_bar;
+	static float combined_max_temp = 0.0f;
+	static float combined_min_temp = 0.0f;
+	static uint8_t combined_labels_valid = 0;
 	if (stream_frame_info->image_info.pseudo_color_status == PSEUDO_COLOR_ON) {
 		// 创建动态颜色条（根据实际温度范围）
 		cv::Mat color_bar = create_color_bar(COLOR_BAR_HEIGHT, COLOR_BAR_WIDTH, 
-		                                      current_color_mode, max_temp_celsius, min_temp_celsius);
+		                                      current_color_mode, bar_max_celsius, bar_min_celsius);
 		
 		// 计算组合图像的尺寸（图像 + 间距 + 颜色条 + 温度标签空间）
 		int label_width = 60;  // 温度标签预留空间
 		int combined_width = width + COLOR_BAR_MARGIN + COLOR_BAR_WIDTH + label_width;
 		int combined_height = (height > COLOR_BAR_HEIGHT) ? height : COLOR_BAR_HEIGHT;
 		
-		// 创建组合图像（黑色背景）
-		combined_image = cv::Mat(combined_height, combined_width, CV_8UC3, cv::Scalar(0, 0, 0));
+		// 创建组合图像（黑色背景），尺寸变化时才重新分配
+		if (combined_image.rows != combined_height || combined_image.cols != combined_width) {
+			combined_image.create(combined_height, combined_width, CV_8UC3);
+			combined_image.setTo(cv::Scalar(0, 0, 0));
+			combined_bar.release();
+			combined_labels_valid = 0;
+		}
 		
 		// 将原始图像复制到左侧
 		cv::Rect image_roi(0, 0, width, height);
 		image.copyTo(combined_image(image_roi));
 		
-		// 将颜色条复制到右侧（垂直居中）
+		// 将颜色条复制到右侧（垂直居中），颜色条缓存换了才重新复制
 		int bar_y = (combined_height - COLOR_BAR_HEIGHT) / 2;
 		int bar_x = width + COLOR_BAR_MARGIN;
-		cv::Rect bar_roi(bar_x, bar_y, COLOR_BAR_WIDTH, COLOR_BAR_HEIGHT);
-		color_bar.copyTo(combined_image(bar_roi));
+		if (combined_bar.data != color_bar.data) {
+			cv::Rect bar_roi(bar_x, bar_y, COLOR_BAR_WIDTH, COLOR_BAR_HEIGHT);
+			color_bar.copyTo(combined_image(bar_roi));
+			combined_bar = color_bar;
+		}
 		
-		// 添加动态温度标签（根据实际温度）
-		add_temperature_labels(combined_image, bar_x, bar_y, COLOR_BAR_HEIGHT, 
-		                       max_temp_celsius, min_temp_celsius);
+		// 添加动态温度标签（根据实际温度），温度范围变化时清掉标签区域重绘
+		if (!combined_labels_valid || bar_max_celsius != combined_max_temp || bar_min_celsius != combined_min_temp) {
+			int label_x = bar_x + COLOR_BAR_WIDTH;
+			cv::Rect label_roi(label_x, 0, combined_width - label_x, combined_height);
+			combined_image(label_roi).setTo(cv::Scalar(0, 0, 0));
+			add_temperature_labels(combined_image, bar_x, bar_y, COLOR_BAR_HEIGHT, 
+			                       bar_max_celsius, bar_min_celsius);
+			combined_max_temp = bar_max_celsius;
+			combined_min_temp = bar_min_celsius;
+			combined_labels_valid = 1;
+		}
 		
 		// 在组合图像上添加帧率和温度信息
-		putText(combined_image, frameText, cv::Point(11, 11), cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar::all(0), 1, 8);
-		putText(combined_image, frameText, cv::Point(10, 10), cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar::all(255), 1, 8);
-		
-#ifdef THERMAL_CAM_CMD
-		// 显示最高温度
-		char maxTempText[64];
-		sprintf(maxTempText, "Max: %.2f C", max_temp_celsius);
-		putText(combined_image, maxTempText, cv::Point(11, 31), cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar::all(0), 1, 8);
-		putText(combined_image, maxTempText, cv::Point(10, 30), cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar::all(255), 1, 8);
-		
-		// 显示最低温度
-		char minTempText[64];
-		sprintf(minTempText, "Min: %.2f C", min_temp_celsius);
-		putText(combined_image, minTempText, cv::Point(11, 51), cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar::all(0), 1, 8);
-		putText(combined_image, minTempText, cv::Point(10, 50), cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar::all(255), 1, 8);
-#endif
-		
-		cv::imshow("Test", combined_image);
+		overlay_blend(&display_overlay, combined_image.data, combined_image.cols, combined_image.rows, \
+			(int)combined_image.step);
+		display_sink_present(&display_sink, combined_image.data, combined_image.cols, combined_image.rows, \
+			(int)combined_image.step);
 	} else {
 		// 非伪彩色模式，只显示原始图像
-		// 显示帧率
-		putText(image, frameText, cv::Point(11, 11), cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar::all(0), 1, 8);
-		putText(image, frameText, cv::Point(10, 10), cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar::all(255), 1, 8);
-		
-#ifdef THERMAL_CAM_CMD
-		// 显示最高温度
-		char maxTempText[64];
-		sprintf(maxTempText, "Max: %.2f C", max_temp_celsius);
-		putText(image, maxTempText, cv::Point(11, 31), cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar::all(0), 1, 8);
-		putText(image, maxTempText, cv::Point(10, 30), cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar::all(255), 1, 8);
-		
-		// 显示最低温度
-		char minTempText[64];
-		sprintf(minTempText, "Min: %.2f C", min_temp_celsius);
-		putText(image, minTempText, cv::Point(11, 51), cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar::all(0), 1, 8);
-		putText(image, minTempText, cv::Point(10, 50), cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar::all(255), 1, 8);
-#endif
-		
-		cv::imshow("Test", image);
-	}
-	
-	// 键盘控制：按 's' 键切换人体分割模式
-	key_press = cvWaitKey(5);
-	if (key_press == 's' || key_press == 'S') {
-		human_segmentation_enabled = !human_segmentation_enabled;
-		printf("\n========================================\n");
-		printf("[Human Segmentation] 模式: %s\n", 
-		       human_segmentation_enabled ? "已开启 ✓" : "已关闭 ✗");
-		printf("[Human Segmentation] 温度阈值: %.1f-%.1f°C\n",
-		       HUMAN_TEMP_MIN_CELSIUS, HUMAN_TEMP_MAX_CELSIUS);
-		printf("[Human Segmentation] 按 's' 键切换模式\n");
-		printf("========================================\n\n");
+		overlay_blend(&display_overlay, image.data, image.cols, image.rows, (int)image.step);
+		display_sink_present(&display_sink, image.data, image.cols, image.rows, (int)image.step);
 	}
+#else
+	display_sink_present(&display_sink, display_frame, width, height, width * 3);
+#endif
 	
-	// 在屏幕上显示人体分割状态
-	if (human_segmentation_enabled) {
-		char status_text[128];
-		sprintf(status_text, "[S] Human Seg: ON (%.0f-%.0f C)", 
-		        HUMAN_TEMP_MIN_CELSIUS, HUMAN_TEMP_MAX_CELSIUS);
-		
-		if (stream_frame_info->image_info.pseudo_color_status == PSEUDO_COLOR_ON) {
-			// 在组合图像上显示
-			putText(combined_image, status_text, cv::Point(11, 71), 
-			        cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar::all(0), 1, 8);
-			putText(combined_image, status_text, cv::Point(10, 70), 
-			        cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar(0, 255, 0), 1, 8);
-		} else {
-			// 在普通图像上显示
-			putText(image, status_text, cv::Point(11, 71), 
-			        cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar::all(0), 1, 8);
-			putText(image, status_text, cv::Point(10, 70), 
-			        cv::FONT_HERSHEY_PLAIN, 1, cv::Scalar(0, 255, 0), 1, 8);
-		}
-	}
+	timing_record_since(TIMING_STAGE_DISPLAY_RENDER, stage_start_us);
+	timing_record_since(TIMING_STAGE_DISPLAY_TOTAL, frame_start_us);
+#ifdef ARENA_HEAP_CHECK
+	display_heap_check(arena_heap_thread_allocs() - heap_start, reconfigured || display_arena.overflows != arena_overflows);
 #endif
 }
 
 //display thread function
+//display the frame held in slot
+static void display_slot(StreamFrameInfo_t* stream_frame_info, FrameSlot_t* slot)
+{
+	//per-frame view: the frozen config plus the slot's descriptor, nothing of the shared stream info is written
+	const StreamConfig_t* config = stream_frame_info->config;
+	const FrameDesc_t* desc = &slot->desc;
+	if (!display_image_info_set)
+	{
+		display_image_info = config->image_info;
+		display_image_info_set = 1;
+	}
+	StreamFrameInfo_t frame_view = { 0 };
+	frame_view.camera_param = config->camera_param;
+	frame_view.image_info = display_image_info;
+	//the planes as this frame has them, a stream mode switch publishes the config before the frames of its layout
+	frame_view.temp_info = config->temp_info;
+	frame_view.temp_info.width = desc->temp.width;
+	frame_view.temp_info.height = desc->temp.height;
+	frame_view.image_byte_size = desc->image.byte_size;
+	frame_view.temp_byte_size = desc->temp.byte_size;
+	frame_view.zero_copy = config->zero_copy;
+	frame_view.camera_index = config->camera_index;
+	frame_view.config = config;
+	frame_view.raw_frame = slot->raw_frame;
+	frame_view.image_frame = desc->image.data;
+	frame_view.temp_frame = desc->temp.data;
+	frame_view.image_stats = desc->image_stats;
+	frame_view.temp_stats = desc->temp_stats;
+	frame_view.image_tiles = desc->image_tiles;
+	timing_record_since(TIMING_STAGE_DISPLAY_QUEUE, desc->timestamp_us);
+	TRACE_BEGIN_VALUE("display_frame", desc->seq);
+	display_one_frame(&frame_view);
+	TRACE_END("display_frame");
+	timing_record_since(TIMING_STAGE_DISPLAY_LATENCY, desc->timestamp_us);
+	latency_probe_sink(stream_frame_info->latency_probe, LATENCY_SINK_DISPLAY, desc->seq);
+	//the format/enhance changes made by the commands (and byte_size) stay with the display
+	display_image_info = frame_view.image_info;
+}
+
+static void display_task(FrameSlot_t* slot, void* arg)
+{
+	display_slot((StreamFrameInfo_t*)arg, slot);
+}
+
+int display_task_attach(StreamFrameInfo_t* stream_frame_info)
+{
+	if (stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+	{
+		return -1;
+	}
+	return ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEWEST, POOL_STAGE_DISPLAY, \
+		display_task, stream_frame_info);
+}
+
 void* display_function(void* threadarg)
 {
 	StreamFrameInfo_t* stream_frame_info;
@@ -784,29 +2558,71 @@ void* display_function(void* threadarg)
 		return NULL;
 	}
 
+	FrameRing_t* ring = stream_frame_info->frame_ring;
+	//display always shows the newest frame, older ones are skipped, unless the pacer evens out the cadence
+	FramePacer_t pacer;
+	int consumer_id = -1;
+	if (display_pacing_depth > 0)
+	{
+		if (pacer_attach(&pacer, ring, display_pacing_depth) == RING_SUCCESS)
+		{
+			consumer_id = pacer.consumer_id;
+		}
+	}
+	else
+	{
+		consumer_id = ring_consumer_attach(ring, RING_POLICY_NEWEST);
+	}
+	if (consumer_id < 0)
+	{
+		printf("display thread attach frame ring failed\n");
+		return NULL;
+	}
+
 	display_init(stream_frame_info);
+	TRACE_THREAD_NAME("display");
+	char rt_name[RT_NAME_LEN];
+	snprintf(rt_name, sizeof(rt_name), "display%d", stream_frame_info->camera_index);
+	rt_thread_enter(RT_ROLE_DISPLAY, stream_frame_info->camera_index, rt_name);
 
-	int i = 0;
-	int timer = 0;
-	while (is_streaming || (i <= stream_time * fps))
+	while (1)
 	{
-#if defined(_WIN32)
-		WaitForSingleObject(image_sem, INFINITE);	//waitting for image singnal 
-#elif defined(linux) || defined(unix)
-		sem_wait(&image_sem);
-#endif
-		display_one_frame(stream_frame_info);
-#if defined(_WIN32)
-		ReleaseSemaphore(image_done_sem, 1, NULL);
-#elif defined(linux) || defined(unix)
-		sem_post(&image_done_sem);
-#endif
-		i++;
+		FrameSlot_t* slot = NULL;
+		uint32_t timeout_ms = ring_frame_timeout_ms(ring, stream_frame_info->camera_param.timeout_ms_delay);
+		TRACE_BEGIN("ring_wait");
+		int rst = (display_pacing_depth > 0) ? pacer_acquire(&pacer, timeout_ms, &slot) : \
+			ring_read_acquire(ring, consumer_id, timeout_ms, &slot);
+		TRACE_END("ring_wait");
+		if (rst == RING_CLOSED)
+		{
+			break;
+		}
+		if (rst != RING_SUCCESS)
+		{
+			continue;
+		}
+		display_slot(stream_frame_info, slot);
+		ring_read_release(ring, slot);
+	}
+	uint64_t frames = 0, dropped = 0;
+	ring_consumer_stats(ring, consumer_id, &frames, &dropped);
+	if (display_pacing_depth > 0)
+	{
+		FramePacerStats_t pacer_stats_out;
+		pacer_stats(&pacer, &pacer_stats_out);
+		printf("display pacer underflows:%llu\n", (unsigned long long)pacer_stats_out.underflows);
+		pacer_detach(&pacer);
+	}
+	else
+	{
+		ring_consumer_detach(ring, consumer_id);
 	}
+
 	display_release();
-#ifdef OPENCV_ENABLE
+#ifdef DISPLAY_WINDOW
 	cv::destroyAllWindows();
 #endif
-	printf("display thread exit!!\n");
+	printf("display thread exit!! frames:%llu dropped:%llu\n", (unsigned long long)frames, (unsigned long long)dropped);
+	rt_thread_leave();
 	return NULL;
 }
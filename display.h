@@ -7,13 +7,39 @@
 #include "libirprocess.h"
 #include "cmd.h"
 #include "temperature.h"
+#include "colorize.h"
+#include "simd.h"
+#include "agc.h"
+#include "clahe.h"
+#include "dde.h"
+#include "zoom.h"
+#include "transform.h"
+#include "band.h"
+#include "tnr.h"
+#include "accum.h"
+#include "palette.h"
+#include "gpu.h"
+#include "overlay.h"
+#include "upscale.h"
+#include "sink.h"
+#include "arena.h"
+#include "pacer.h"
+#include "segment.h"
+#include "tempspan.h"
 
 #define OPENCV_ENABLE
 #ifdef OPENCV_ENABLE
 #include <opencv2/imgproc.hpp>
+//using namespace cv;
+#endif
+//DISPLAY_HEADLESS (cmake -DDISPLAY_HEADLESS=ON / make HEADLESS=1) compiles the highgui window out,
+//frames still go through the opencv composition into the fb, shm or null sink
+#if defined(OPENCV_ENABLE) && !defined(DISPLAY_HEADLESS)
+#define DISPLAY_WINDOW
+#endif
+#ifdef DISPLAY_WINDOW
 #include <opencv2/highgui.hpp> 
 #include <opencv2/highgui/highgui_c.h> 
-//using namespace cv;
 #endif
 
 //initial the parameters for displaying
@@ -25,16 +51,227 @@ void display_release(void);
 //display one frame
 void display_one_frame(StreamFrameInfo_t* stream_frame_info);
 
+//frames of the display's sink: shown, and dropped for display apart from the acquisition drops of the ring
+void display_sink_stats_get(DisplaySinkStats_t* stats);
+
 //display thread
 void* display_function(void* threadarg);
 
+//display as a task consumer of the frame ring, call display_init first. the window sink owns highgui
+//on its own ui thread, so the display task may run on any pool thread
+int display_task_attach(StreamFrameInfo_t* stream_frame_info);
+
+//scratch frames of the display chain, image_tmp_frame2 holds the processed frame
+extern uint8_t* image_tmp_frame1;
+extern uint8_t* image_tmp_frame2;
+
+//convert the image frame by frameinfo into image_tmp_frame2
+//image_stats is the frame's statistics block from the stream thread, NULL computes the range here
+void display_image_process(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const FrameStats_t* image_stats);
+
+//one compiled variant of display_image_process for a fixed input/output/pseudocolor/enhance combination
+typedef void (*DisplayPipeline_t)(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const FrameStats_t* image_stats);
+
+//the variant for frameinfo's combination, NULL when there is no conversion for it (yuv422 to y14/yuv444,
+//yuv444/rgb888 input, out of range values). load_stream_frame_info refuses such a configuration
+DisplayPipeline_t display_pipeline_select(const FrameInfo_t* frameinfo);
+
+//Y14 enhance stage selected by frameinfo->img_enhance_status (stretch, off, hist agc, library agc+dde),
+//each implementation is timed in its own timing stage
+int enhance_image_frame(uint16_t* src_frame, FrameInfo_t* frameinfo, const FrameStats_t* src_stats, \
+	uint16_t* dst_frame);
+
+const char* enhance_name(ImgEnhance_t enhance);
+
+//mirror/flip the frame in place through libirprocess
+void mirror_flip_demo(FrameInfo_t* frame_info, uint8_t* frame, MirrorFlipStatus_t mirror_flip_status);
+
+//rotate the frame in place through libirprocess
+void rotate_demo(FrameInfo_t* frame_info, uint8_t* frame, RotateSide_t rotate_side);
+
+//mirror/flip and rotate image_tmp_frame2 in one pass
+void transform_demo(FrameInfo_t* frame_info, RotateSide_t rotate_side, MirrorFlipStatus_t mirror_flip_status);
+
+#define DISPLAY_BAND_MAX 8
+
+//display_image_process + transform_demo of the fused BGR888/BGRA32/RGBA32 path, split into band_num row bands over the task pool
+//the agc mapping and stretch table are built once, then colorize -> histogram merge -> transform run band by band
+//result in image_tmp_frame2, returns -1 and leaves the frame to the single threaded chain for any other format
+int display_image_process_bands(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const FrameStats_t* image_stats, int band_num);
+
+//the fused BGR888/BGRA32/RGBA32 path of the display's zoomed view: every output row is resampled from the frame by
+//the view's remap table and colored right away, then transformed. result in image_tmp_frame2, returns -1 and
+//leaves the frame to the other paths (unzoomed) for any other format or an enhance without a lut
+int display_image_process_zoom(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const FrameStats_t* image_stats);
+
+//Y14 upscale by display_upscale_factor, then the fused BGR888 path and transform at the output size, so
+//every output pixel is looked up in the palette once. *frame_out is set to the result in get_display_arena()
+//returns -1 and leaves the frame to the other paths for any other format or the library enhance
+int display_image_process_upscale(uint8_t* image_frame, FrameInfo_t* frameinfo, const FrameStats_t* image_stats, \
+	uint8_t** frame_out);
+
+//per-frame scratch of the display chain, display_one_frame resets it at the start of every frame
+Arena_t* get_display_arena(void);
+
+//display_image_process + transform_demo of the fused BGR888 path as one opencl kernel, result in image_tmp_frame2
+//every display_gpu_verify_interval frames the cpu path runs as well and the bytes are compared
+//returns -1 and leaves the frame to the cpu chain without a device or for any other format
+int display_image_process_gpu(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const FrameStats_t* image_stats);
+
+//the fused BGR888 path handed to a sink that colors Y14 itself (gl): the frame goes out as it is with its plan's
+//luts, transform and the zoom view, the cpu only builds the agc's histogram. caption is the window title
+//returns -1 and leaves the frame to the other paths for other sinks, formats or an enhance without a lut
+int display_image_present_raw(uint8_t* image_frame, int pix_num, FrameInfo_t* frameinfo, \
+	const FrameStats_t* image_stats, const char* caption);
+
 // 人体温度分割参数
 #define HUMAN_TEMP_MIN_CELSIUS 28.0f
 #define HUMAN_TEMP_MAX_CELSIUS 40.0f
+#define HUMAN_SEG_OPEN 1                //opening radius of the range mask
+#define HUMAN_SEG_CLOSE 1               //closing radius after the opening
+#define HUMAN_SEG_MIN_AREA 20           //smaller blobs are not people
 
 // 人体分割模式开关
 extern uint8_t human_segmentation_enabled;
 
+//pseudocolor BGR888 through the fused lut kernel, 0 runs the libirparse/libirprocess reference chain
+extern uint8_t fused_color_enabled;
+
+//mirror/flip/rotate through the one pass frame_transform, 0 runs the libirprocess mirror/flip/rotate calls
+extern uint8_t fused_transform_enabled;
+
+//row bands per frame for display_image_process_bands, 1 keeps colorize/transform single threaded
+extern uint8_t display_band_num;
+
+//the display's own zoom and pan (zoom.h), the ring keeps the full frame for every other consumer. the 'z' key
+//steps the factor, 'h'/'j'/'k'/'l' pan
+extern ZoomView_t display_zoom_view;
+
+//noise reduction of the Y14/Y16 frame before enhance, the ring slot stays untouched
+typedef enum {
+    DISPLAY_NR_OFF = 0,
+    DISPLAY_NR_SPATIAL,             //y14_image_spatial_noise_reduction of libirprocess
+    DISPLAY_NR_TEMPORAL,            //motion adaptive recursive filter of get_display_tnr()
+    DISPLAY_NR_AVERAGE,             //moving average of the last DISPLAY_NR_AVERAGE_WINDOW frames, static scenes
+    DISPLAY_NR_MODE_NUM
+}DisplayNr_t;
+
+#define DISPLAY_NR_AVERAGE_WINDOW 8
+extern uint8_t display_nr_mode;
+
+#define DISPLAY_WINDOW_MAX 8
+
+//regions of interest of a fixed installation (image coordinates). between two full refreshes only the
+//windows are noise reduced and colorized, the rest of the shown frame keeps the last refresh, so the per
+//frame cost follows the windows' area. refresh_interval frames per full refresh, 0 refreshes only after a
+//command. applies to the fused BGR888 pseudocolor chain with the temporal or no noise reduction, the other
+//paths (segmentation, upscale, gpu, spatial or average nr) keep processing the whole frame. num 0 clears the windows
+//any thread, the display picks the windows up before its next frame
+int display_window_set(const Area_t* rects, int num, uint32_t refresh_interval);
+
+#define DISPLAY_ISOTHERM_MAX 4
+
+//one isotherm band: the pixels between low and high (celsius) take a flat color
+typedef struct {
+    float low_celsius;
+    float high_celsius;
+    uint8_t rgb[3];
+}DisplayIsotherm_t;
+
+//isotherm/threshold bands painted into the display's copy of the palette lut, on the color bar's temperature
+//scale, so they cost nothing per pixel. the lut is rebuilt only when the bands, the palette or the frame's
+//range move. later bands paint over earlier ones, num 0 clears. the gpu path falls back to the cpu while
+//bands are set. any thread, the display picks the bands up before its next frame
+int display_isotherm_set(const DisplayIsotherm_t* bands, int num);
+
+//static scenes: on the same chain as the windows, only the image tiles whose stats pass signature moved since
+//they were last drawn are noise reduced and colorized again (inside the windows when set), the colors stay
+//those of the last full refresh until the frame's range moves by more than display_tile_tolerance.
+//not with the hist agc, its mapping follows the whole frame's histogram
+extern uint8_t display_tile_reuse;
+
+//mean/range shift in image plane values still taken as noise, the tile max allows 4x
+extern uint32_t display_tile_tolerance;
+
+//user palettes 16..20 loaded by display_init from display_palette_dir/palette_<mode>.rgb, NULL loads none
+extern const char* display_palette_dir;
+
+//upscale of the displayed frame, 1..UPSCALE_FACTOR_MAX, 1 shows the sensor resolution
+extern uint8_t display_upscale_factor;
+
+//UpscaleMode_t of the display upscale
+extern uint8_t display_upscale_mode;
+
+//colorize and transform on the gpu, display_init opens the device when set
+extern uint8_t display_gpu_enabled;
+
+//frames between two gpu/cpu comparisons, 0 never compares
+extern uint32_t display_gpu_verify_interval;
+
+//display thread: frames of the jitter buffer in front of the display (pacer.h), 0 shows the newest frame on arrival.
+//the queued frames hold ring slots, raise ring_depth by as many
+extern uint8_t display_pacing_depth;
+
+//max/min temperature from the temp frame on the host, 0 queries tpd_get_max_temp/tpd_get_min_temp every frame
+extern uint8_t host_temp_range_enabled;
+
+//with the host range, query the firmware every fw_temp_check_interval frames as a cross-check, 0 never queries
+extern uint32_t fw_temp_check_interval;
+
+//where display_init sends the composed frames, the highgui window by default, the null sink when headless
+extern DisplaySinkParam_t display_sink_param;
+
+//display toggles. any thread posts them (window keys, the cmd thread's stdin), display_one_frame
+//applies the pending ones before its next frame
+typedef enum {
+    DISPLAY_CMD_SEGMENTATION = 0,       //'s' human segmentation on/off
+    DISPLAY_CMD_ENHANCE,                //'a' stretch -> hist agc -> library agc+dde -> clahe -> hist agc+dde
+    DISPLAY_CMD_FUSED_COLOR,            //'f' fused lut kernel or the library reference chain
+    DISPLAY_CMD_GPU,                    //'g' opencl colorize on/off
+    DISPLAY_CMD_UPSCALE_FACTOR,         //'u' upscale x1..x4
+    DISPLAY_CMD_UPSCALE_MODE,           //'i' bilinear or bicubic
+    DISPLAY_CMD_NR,                     //'n' off -> spatial -> temporal -> average
+    DISPLAY_CMD_PALETTE,                //'p' next palette
+    DISPLAY_CMD_TIMING,                 //'t' print the timing stages
+    DISPLAY_CMD_ZOOM,                   //'z' zoom x1 -> x2 -> x4 -> x8
+    DISPLAY_CMD_PAN_LEFT,               //'h'
+    DISPLAY_CMD_PAN_DOWN,               //'j'
+    DISPLAY_CMD_PAN_UP,                 //'k'
+    DISPLAY_CMD_PAN_RIGHT,              //'l'
+    DISPLAY_CMD_NUM
+}DisplayCmd_t;
+
+//lock free, never blocks the caller. a toggle posted twice before the next frame cancels out
+void display_cmd_post(DisplayCmd_t cmd);
+
+//the DisplayCmd_t of a key, -1 for keys without one
+int display_cmd_of_key(int key);
+
+//the display settings a runtime configuration sets as absolute values rather than toggles, -1 leaves one as it is
+typedef struct {
+    int pseudo_color;                   //PseudoColor_t
+    int enhance;                        //ImgEnhance_t
+    int rotate;                         //RotateSide_t
+    int mirror_flip;                    //MirrorFlipStatus_t
+    int palette;                        //irproc_color_mode_t, a mode without a palette is skipped
+    int upscale_factor;                 //1..UPSCALE_FACTOR_MAX
+    int upscale_mode;                   //UpscaleMode_t
+    int nr_mode;                        //DISPLAY_NR_xxx
+    int segmentation;                   //human_segmentation_enabled
+}DisplaySettings_t;
+
+//any thread, the display picks the last settings up before its next frame, together with the posted commands
+int display_settings_set(const DisplaySettings_t* settings);
+
+//the person blobs of the last segmented frame (raw temps), any thread. copies up to max_num, returns how many,
+//frame gets the number of frames segmented so far to tell a new list from the last one
+int display_human_blobs_get(SegmentBlob_t* blobs, int max_num, uint64_t* frame);
+
 // 基于真实温度的人体分割函数
 void segment_human_by_real_temperature(uint16_t* y14_data, int width, int height, uint8_t* dst_frame);
 
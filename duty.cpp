@@ -0,0 +1,325 @@
+#include "duty.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(linux) || defined(unix)
+#include <glob.h>
+#endif
+
+//battery discharge first, then a power monitor (ina2xx and the like) on hwmon
+static const char* duty_power_patterns[] = {
+    "/sys/class/power_supply/*/power_now",
+    "/sys/class/hwmon/hwmon*/power1_input",
+};
+
+//one reading in mW, -1 when the file can not be read
+static double duty_power_read(const char* path)
+{
+    if (path[0] == '\0')
+    {
+        return -1;
+    }
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    long long uw = 0;
+    int n = fscanf(fp, "%lld", &uw);
+    fclose(fp);
+    if (n != 1)
+    {
+        return -1;
+    }
+    //some fuel gauges report the discharge negative
+    return (uw < 0 ? -uw : uw) / 1000.0;
+}
+
+static void duty_power_probe(DutyCycle_t* duty)
+{
+    duty->power_path[0] = '\0';
+    if (duty->param.power_path[0] != '\0')
+    {
+        if (duty_power_read(duty->param.power_path) >= 0)
+        {
+            strcpy(duty->power_path, duty->param.power_path);
+        }
+        return;
+    }
+#if defined(linux) || defined(unix)
+    for (size_t i = 0; i < sizeof(duty_power_patterns) / sizeof(duty_power_patterns[0]) && \
+        duty->power_path[0] == '\0'; i++)
+    {
+        glob_t found;
+        if (glob(duty_power_patterns[i], 0, NULL, &found) != 0)
+        {
+            continue;
+        }
+        for (size_t j = 0; j < found.gl_pathc; j++)
+        {
+            if (strlen(found.gl_pathv[j]) < DUTY_PATH_LEN && duty_power_read(found.gl_pathv[j]) >= 0)
+            {
+                strcpy(duty->power_path, found.gl_pathv[j]);
+                break;
+            }
+        }
+        globfree(&found);
+    }
+#endif
+}
+
+//integrate the draw since the last reading, trapezoids between readings
+static void duty_power_sample(DutyCycle_t* duty, uint64_t now_us)
+{
+    double mw = duty_power_read(duty->power_path);
+    if (mw < 0)
+    {
+        return;
+    }
+    if (duty->power_us != 0 && now_us > duty->power_us)
+    {
+        duty->energy_mj += (duty->power_mw + mw) * 0.5 * (now_us - duty->power_us) / 1e6;
+    }
+    duty->power_mw = mw;
+    duty->power_us = now_us;
+}
+
+static void duty_released(FrameSlot_t* slot, uint64_t held_us, void* arg)
+{
+    DutyCycle_t* duty = (DutyCycle_t*)arg;
+    uint64_t seq = duty->result_seq.load(std::memory_order_acquire);
+    if (seq == 0 || slot->desc.seq != seq)
+    {
+        return;
+    }
+    sync_mutex_lock(&duty->mutex);
+    if (duty->result_us == 0 && duty->result_seq.load(std::memory_order_relaxed) == seq)
+    {
+        duty->result_us = get_monotonic_us();
+        sync_cond_broadcast(&duty->cond);
+    }
+    sync_mutex_unlock(&duty->mutex);
+}
+
+void duty_default_param(DutyParam_t* param)
+{
+    if (param == NULL)
+    {
+        return;
+    }
+    memset(param, 0, sizeof(DutyParam_t));
+    param->period_ms = DUTY_DEFAULT_PERIOD_MS;
+    param->settle_frames = DUTY_DEFAULT_SETTLE_FRAMES;
+    param->result_frames = DUTY_DEFAULT_RESULT_FRAMES;
+    param->max_wake_ms = DUTY_DEFAULT_MAX_WAKE_MS;
+    param->result_timeout_ms = DUTY_DEFAULT_RESULT_TIMEOUT_MS;
+}
+
+int duty_init(DutyCycle_t* duty, const DutyParam_t* param, StreamFrameInfo_t* stream_frame_info)
+{
+    if (duty == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return DUTY_ERROR_PARAM;
+    }
+    DutyParam_t default_param;
+    if (param == NULL)
+    {
+        duty_default_param(&default_param);
+        param = &default_param;
+    }
+    if (param->period_ms == 0 || param->result_frames == 0 || param->max_wake_ms >= param->period_ms)
+    {
+        return DUTY_ERROR_PARAM;
+    }
+    duty->param = *param;
+    duty->param.power_path[DUTY_PATH_LEN - 1] = '\0';
+    duty->stream_frame_info = stream_frame_info;
+    duty->ring = stream_frame_info->frame_ring;
+    duty->wake_us = 0;
+    duty->sleep_us = 0;
+    duty->wake_frames = 0;
+    duty->published = 0;
+    duty->power_mw = 0;
+    duty->power_us = 0;
+    duty->energy_mj = 0;
+    duty->wake_start_mj = 0;
+    duty->sleep_start_mj = 0;
+    duty->result_seq.store(0, std::memory_order_relaxed);
+    duty->result_us = 0;
+    timing_hist_reset(&duty->result_hist);
+    timing_hist_reset(&duty->wake_hist);
+    memset(&duty->stats, 0, sizeof(DutyStats_t));
+    duty_power_probe(duty);
+    duty->stats.power_valid = (duty->power_path[0] != '\0');
+    sync_mutex_init(&duty->mutex);
+    sync_cond_init(&duty->cond);
+    ring_release_func_set(duty->ring, duty_released, duty);
+    stream_frame_info->duty = duty;
+    printf("duty cycle: wake every %u ms for %u stable frames, power %s\n", duty->param.period_ms, \
+        duty->param.result_frames, duty->stats.power_valid ? duty->power_path : "not measured");
+    return DUTY_SUCCESS;
+}
+
+void duty_release(DutyCycle_t* duty)
+{
+    if (duty == NULL || duty->ring == NULL)
+    {
+        return;
+    }
+    ring_release_func_set(duty->ring, NULL, NULL);
+    if (duty->stream_frame_info->duty == duty)
+    {
+        duty->stream_frame_info->duty = NULL;
+    }
+    duty->ring = NULL;
+    sync_mutex_destroy(&duty->mutex);
+    sync_cond_destroy(&duty->cond);
+}
+
+void duty_wake(DutyCycle_t* duty, uint64_t now_us)
+{
+    duty_power_sample(duty, now_us);
+    if (duty->sleep_us != 0)
+    {
+        //the cycle that started with the previous wake is over
+        double cycle_mj = duty->energy_mj - duty->wake_start_mj;
+        double awake_mj = duty->sleep_start_mj - duty->wake_start_mj;
+        uint64_t cycle_us = now_us - duty->wake_us;
+        sync_mutex_lock(&duty->mutex);
+        duty->stats.asleep_us += now_us - duty->sleep_us;
+        duty->stats.energy_mj += cycle_mj;
+        duty->stats.wake_energy_mj += awake_mj;
+        duty->stats.last_cycle_mj = cycle_mj;
+        sync_mutex_unlock(&duty->mutex);
+        if (duty->stats.power_valid)
+        {
+            printf("duty cycle %llu: %.1f mJ, %.1f mJ awake, %.1f mW average\n", \
+                (unsigned long long)duty->stats.cycles, cycle_mj, awake_mj, cycle_mj * 1000.0 / cycle_us);
+        }
+    }
+    sync_mutex_lock(&duty->mutex);
+    duty->stats.cycles++;
+    duty->result_seq.store(0, std::memory_order_relaxed);
+    duty->result_us = 0;
+    sync_mutex_unlock(&duty->mutex);
+    duty->wake_us = now_us;
+    duty->sleep_us = 0;
+    duty->wake_frames = 0;
+    duty->published = 0;
+    duty->wake_start_mj = duty->energy_mj;
+}
+
+int duty_frame(DutyCycle_t* duty, uint32_t tag_flags, uint64_t seq, uint64_t timestamp_us)
+{
+    if (timestamp_us - duty->power_us >= DUTY_POWER_AWAKE_MS * 1000ull)
+    {
+        duty_power_sample(duty, timestamp_us);
+    }
+    duty->stats.frames++;
+    duty->wake_frames++;
+    if (duty->published >= duty->param.result_frames || duty->wake_frames <= duty->param.settle_frames || \
+        (tag_flags & FRAME_DESC_TEMP_INVALID))
+    {
+        duty->stats.settle_frames++;
+        return 0;
+    }
+    duty->published++;
+    if (duty->published == duty->param.result_frames)
+    {
+        //before the commit, a reader may be done with it before ring_write_commit returns
+        duty->result_seq.store(seq, std::memory_order_release);
+    }
+    return 1;
+}
+
+int duty_sleep_due(DutyCycle_t* duty, uint64_t now_us)
+{
+    return duty->published >= duty->param.result_frames || \
+        now_us - duty->wake_us >= duty->param.max_wake_ms * 1000ull;
+}
+
+void duty_result_wait(DutyCycle_t* duty)
+{
+    if (duty->published < duty->param.result_frames)
+    {
+        printf("duty cycle %llu: no stable frame within %u ms\n", (unsigned long long)duty->stats.cycles, \
+            duty->param.max_wake_ms);
+        sync_mutex_lock(&duty->mutex);
+        duty->stats.no_result++;
+        sync_mutex_unlock(&duty->mutex);
+        return;
+    }
+    sync_deadline_t deadline;
+    sync_deadline_set(&deadline, duty->param.result_timeout_ms);
+    sync_mutex_lock(&duty->mutex);
+    while (duty->result_us == 0)
+    {
+        if (sync_cond_wait_until(&duty->cond, &duty->mutex, &deadline) != SYNC_SUCCESS)
+        {
+            break;
+        }
+    }
+    uint64_t result_us = duty->result_us;
+    if (result_us != 0)
+    {
+        duty->stats.results++;
+    }
+    else
+    {
+        duty->stats.result_timeouts++;
+    }
+    sync_mutex_unlock(&duty->mutex);
+    if (result_us != 0)
+    {
+        timing_hist_record(&duty->result_hist, result_us - duty->wake_us);
+    }
+}
+
+uint32_t duty_sleep_begin(DutyCycle_t* duty, uint64_t now_us)
+{
+    duty_power_sample(duty, now_us);
+    duty->sleep_us = now_us;
+    duty->sleep_start_mj = duty->energy_mj;
+    timing_hist_record(&duty->wake_hist, now_us - duty->wake_us);
+    sync_mutex_lock(&duty->mutex);
+    duty->stats.awake_us += now_us - duty->wake_us;
+    uint64_t result_us = duty->result_us;
+    sync_mutex_unlock(&duty->mutex);
+    printf("duty cycle %llu: awake %llu ms, result after %lld ms, %u frames read\n", \
+        (unsigned long long)duty->stats.cycles, (unsigned long long)(now_us - duty->wake_us) / 1000, \
+        (result_us != 0) ? (long long)(result_us - duty->wake_us) / 1000 : -1LL, duty->wake_frames);
+    return duty_sleep_next(duty, now_us);
+}
+
+uint32_t duty_sleep_next(DutyCycle_t* duty, uint64_t now_us)
+{
+    if (now_us != duty->sleep_us)
+    {
+        duty_power_sample(duty, now_us);
+    }
+    uint64_t wake_at_us = duty->wake_us + duty->param.period_ms * 1000ull;
+    if (now_us >= wake_at_us)
+    {
+        return 0;
+    }
+    uint64_t left_ms = (wake_at_us - now_us + 999) / 1000;
+    if (duty->stats.power_valid && left_ms > DUTY_POWER_ASLEEP_MS)
+    {
+        left_ms = DUTY_POWER_ASLEEP_MS;
+    }
+    return (uint32_t)left_ms;
+}
+
+int duty_stats(DutyCycle_t* duty, DutyStats_t* stats)
+{
+    if (duty == NULL || stats == NULL)
+    {
+        return DUTY_ERROR_PARAM;
+    }
+    sync_mutex_lock(&duty->mutex);
+    *stats = duty->stats;
+    sync_mutex_unlock(&duty->mutex);
+    timing_hist_stats(&duty->result_hist, &stats->wake_to_result);
+    timing_hist_stats(&duty->wake_hist, &stats->wake);
+    return DUTY_SUCCESS;
+}
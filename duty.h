@@ -0,0 +1,108 @@
+#ifndef _DUTY_H_
+#define _DUTY_H_
+
+//duty cycled capture for nodes on solar and batteries: the stream thread keeps the stream only until result_frames
+//stable frames went through the ring and their readers let go of the last one (the roi checks and alarms ran on
+//it), then closes the host side of the stream (KEEP_CAM_SIDE_PREVIEW, the module keeps its nuc and gain state)
+//and sleeps out the period while every consumer blocks on the empty ring. after a wake the frames are read and
+//dropped until settle_frames passed and the shutter monitor (SHUTTER_MONITOR) tags none as shutter/nuc.
+//each cycle is timed wake -> result and, with a power reading in sysfs, integrated into its energy
+#include <stdint.h>
+#include <atomic>
+#include "sync.h"
+#include "timing.h"
+#include "data.h"
+
+#define DUTY_DEFAULT_PERIOD_MS 60000
+#define DUTY_DEFAULT_SETTLE_FRAMES 10       //the first frames after a stream start, the sensor settles
+#define DUTY_DEFAULT_RESULT_FRAMES 1        //more for alarms that raise over several frames
+#define DUTY_DEFAULT_MAX_WAKE_MS 5000       //a wake without a stable frame by then sleeps without a result
+#define DUTY_DEFAULT_RESULT_TIMEOUT_MS 1000 //the last result frame's readers, after its commit
+#define DUTY_POWER_AWAKE_MS 100             //power readings while streaming
+#define DUTY_POWER_ASLEEP_MS 1000           //and while asleep
+#define DUTY_PATH_LEN 256
+
+#define DUTY_SUCCESS 0
+#define DUTY_ERROR_PARAM -1
+
+typedef struct {
+    uint32_t period_ms;                 //wake to wake
+    uint32_t settle_frames;
+    uint32_t result_frames;
+    uint32_t max_wake_ms;
+    uint32_t result_timeout_ms;
+    char power_path[DUTY_PATH_LEN];     //sysfs file of the node's draw in microwatts, empty probes power_supply/hwmon
+}DutyParam_t;
+
+typedef struct {
+    uint64_t cycles;                    //wakes, the first is the stream start
+    uint64_t results;                   //wakes whose last result frame was read
+    uint64_t no_result;                 //wakes that gave up after max_wake_ms
+    uint64_t result_timeouts;           //result frames nobody let go of within result_timeout_ms
+    uint64_t frames;                    //read from the camera
+    uint64_t settle_frames;             //read and dropped
+    uint64_t awake_us;
+    uint64_t asleep_us;
+    uint8_t power_valid;                //the energies below are 0 without a power reading
+    double energy_mj;                   //every finished cycle, awake and asleep
+    double wake_energy_mj;              //their awake parts
+    double last_cycle_mj;
+    TimingStats_t wake_to_result;       //wake -> the last result frame released
+    TimingStats_t wake;                 //wake -> stream closed
+}DutyStats_t;
+
+typedef struct DutyCycle_t {
+    DutyParam_t param;
+    StreamFrameInfo_t* stream_frame_info;
+    FrameRing_t* ring;
+    char power_path[DUTY_PATH_LEN];     //the file read, empty without
+    //stream thread only
+    uint64_t wake_us;
+    uint64_t sleep_us;                  //host side stream closed, 0 while awake
+    uint32_t wake_frames;
+    uint32_t published;
+    double power_mw;                    //last reading
+    uint64_t power_us;
+    double energy_mj;                   //since duty_init
+    double wake_start_mj;
+    double sleep_start_mj;
+    //the readers of the last result frame report to the stream thread
+    std::atomic<uint64_t> result_seq;   //0 before it was committed
+    uint64_t result_us;
+    TimingHist_t result_hist;
+    TimingHist_t wake_hist;
+    DutyStats_t stats;
+    sync_mutex_t mutex;
+    sync_cond_t cond;
+}DutyCycle_t;
+
+void duty_default_param(DutyParam_t* param);
+
+//hook the duty cycle into the stream thread of stream_frame_info, after create_data_demo and before it starts.
+//it takes the ring's release callback (ring_release_func_set). param NULL selects the defaults
+int duty_init(DutyCycle_t* duty, const DutyParam_t* param, StreamFrameInfo_t* stream_frame_info);
+
+//unhook it, after the stream thread left
+void duty_release(DutyCycle_t* duty);
+
+//stream thread: the stream (re)started
+void duty_wake(DutyCycle_t* duty, uint64_t now_us);
+
+//stream thread: a frame prepared as seq, its FRAME_DESC_xxx flags. returns 1 to commit it, 0 drops it while settling
+int duty_frame(DutyCycle_t* duty, uint32_t tag_flags, uint64_t seq, uint64_t timestamp_us);
+
+//stream thread: the result frames are committed or the wake gave up, time to sleep
+int duty_sleep_due(DutyCycle_t* duty, uint64_t now_us);
+
+//stream thread: wait for the readers of the last result frame, at most result_timeout_ms
+void duty_result_wait(DutyCycle_t* duty);
+
+//stream thread: the stream is closed, returns the first wait before the next wake
+uint32_t duty_sleep_begin(DutyCycle_t* duty, uint64_t now_us);
+
+//stream thread, asleep: a power reading and the next wait, 0 once the period is over
+uint32_t duty_sleep_next(DutyCycle_t* duty, uint64_t now_us);
+
+int duty_stats(DutyCycle_t* duty, DutyStats_t* stats);
+
+#endif
@@ -0,0 +1,822 @@
+#include "encode.h"
+#include "gpu.h"
+#include "simd.h"
+#include "memacct.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+#endif
+#if defined(ENCODE_X264)
+#include <x264.h>
+#endif
+#include "libirparse.h"
+
+static const char* encode_backend_names[] = { "auto", "v4l2", "x264" };
+
+const char* encode_backend_name(EncodeBackend_t backend)
+{
+    if (backend < ENCODE_BACKEND_AUTO || backend > ENCODE_BACKEND_X264)
+    {
+        return "unknown";
+    }
+    return encode_backend_names[backend];
+}
+
+static void encode_packet(Encoder_t* encoder, const uint8_t* data, uint32_t size, uint64_t timestamp_us, int key)
+{
+    encoder->stats.packets++;
+    encoder->stats.bytes += size;
+    if (key)
+    {
+        encoder->stats.keyframes++;
+    }
+    if (encoder->param.packet_func != NULL)
+    {
+        encoder->param.packet_func(data, size, timestamp_us, key, encoder->param.packet_arg);
+    }
+}
+
+#if defined(__linux__)
+static int encode_v4l2_ioctl(int fd, unsigned long request, void* arg)
+{
+    int rst;
+    do
+    {
+        rst = ioctl(fd, request, arg);
+    } while (rst < 0 && errno == EINTR);
+    return rst;
+}
+
+static int encode_v4l2_has_format(int fd, uint32_t type, uint32_t pixelformat)
+{
+    struct v4l2_fmtdesc desc;
+    for (uint32_t i = 0; ; i++)
+    {
+        memset(&desc, 0, sizeof(desc));
+        desc.index = i;
+        desc.type = type;
+        if (encode_v4l2_ioctl(fd, VIDIOC_ENUM_FMT, &desc) < 0)
+        {
+            return 0;
+        }
+        if (desc.pixelformat == pixelformat)
+        {
+            return 1;
+        }
+    }
+}
+
+//a multi planar m2m node that takes NV12 and gives the codec
+static int encode_v4l2_probe(const char* path, uint32_t pixelformat)
+{
+    int fd = open(path, O_RDWR | O_NONBLOCK);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (encode_v4l2_ioctl(fd, VIDIOC_QUERYCAP, &cap) == 0)
+    {
+        uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+        if ((caps & V4L2_CAP_VIDEO_M2M_MPLANE) && (caps & V4L2_CAP_STREAMING) && \
+            encode_v4l2_has_format(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, pixelformat) && \
+            encode_v4l2_has_format(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, V4L2_PIX_FMT_NV12))
+        {
+            return fd;
+        }
+    }
+    close(fd);
+    return -1;
+}
+
+static void encode_v4l2_control(int fd, uint32_t id, int32_t value, const char* name)
+{
+    struct v4l2_control control;
+    control.id = id;
+    control.value = value;
+    if (encode_v4l2_ioctl(fd, VIDIOC_S_CTRL, &control) < 0)
+    {
+        //not every driver has every control, the encoder's default is used
+        printf("encode: v4l2 control %s not set\n", name);
+    }
+}
+
+static int encode_v4l2_buffers(Encoder_t* encoder, uint32_t type, EncodeBuffer_t* bufs)
+{
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = ENCODE_V4L2_BUFFERS;
+    req.type = type;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (encode_v4l2_ioctl(encoder->fd, VIDIOC_REQBUFS, &req) < 0 || req.count < ENCODE_V4L2_BUFFERS)
+    {
+        return ENCODE_ERROR_BACKEND;
+    }
+    for (int i = 0; i < ENCODE_V4L2_BUFFERS; i++)
+    {
+        struct v4l2_buffer buf;
+        struct v4l2_plane plane;
+        memset(&buf, 0, sizeof(buf));
+        memset(&plane, 0, sizeof(plane));
+        buf.index = i;
+        buf.type = type;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.m.planes = &plane;
+        buf.length = 1;
+        if (encode_v4l2_ioctl(encoder->fd, VIDIOC_QUERYBUF, &buf) < 0)
+        {
+            return ENCODE_ERROR_BACKEND;
+        }
+        void* data = mmap(NULL, plane.length, PROT_READ | PROT_WRITE, MAP_SHARED, encoder->fd, plane.m.mem_offset);
+        if (data == MAP_FAILED)
+        {
+            return ENCODE_ERROR_MEM;
+        }
+        bufs[i].data = data;
+        bufs[i].length = plane.length;
+    }
+    return ENCODE_SUCCESS;
+}
+
+static int encode_v4l2_queue_capture(Encoder_t* encoder, int index)
+{
+    struct v4l2_buffer buf;
+    struct v4l2_plane plane;
+    memset(&buf, 0, sizeof(buf));
+    memset(&plane, 0, sizeof(plane));
+    buf.index = index;
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.m.planes = &plane;
+    buf.length = 1;
+    plane.length = encoder->cap_bufs[index].length;
+    return encode_v4l2_ioctl(encoder->fd, VIDIOC_QBUF, &buf);
+}
+
+static void encode_v4l2_close(Encoder_t* encoder)
+{
+    if (encoder->fd < 0)
+    {
+        return;
+    }
+    int type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    encode_v4l2_ioctl(encoder->fd, VIDIOC_STREAMOFF, &type);
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    encode_v4l2_ioctl(encoder->fd, VIDIOC_STREAMOFF, &type);
+    for (int i = 0; i < ENCODE_V4L2_BUFFERS; i++)
+    {
+        if (encoder->out_bufs[i].data != NULL)
+        {
+            munmap(encoder->out_bufs[i].data, encoder->out_bufs[i].length);
+        }
+        if (encoder->cap_bufs[i].data != NULL)
+        {
+            munmap(encoder->cap_bufs[i].data, encoder->cap_bufs[i].length);
+        }
+    }
+    memset(encoder->out_bufs, 0, sizeof(encoder->out_bufs));
+    memset(encoder->cap_bufs, 0, sizeof(encoder->cap_bufs));
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.memory = V4L2_MEMORY_MMAP;
+    req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    encode_v4l2_ioctl(encoder->fd, VIDIOC_REQBUFS, &req);
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    encode_v4l2_ioctl(encoder->fd, VIDIOC_REQBUFS, &req);
+    close(encoder->fd);
+    encoder->fd = -1;
+}
+
+//the rate the driver's rate control assumes, also set again when the sensor rate is switched
+static void encode_v4l2_rate(Encoder_t* encoder)
+{
+    struct v4l2_streamparm parm;
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    parm.parm.output.timeperframe.numerator = 1;
+    parm.parm.output.timeperframe.denominator = encoder->fps;
+    encode_v4l2_ioctl(encoder->fd, VIDIOC_S_PARM, &parm);
+}
+
+//capture format first, the output (NV12) side follows the coded size on most drivers
+static int encode_v4l2_open(Encoder_t* encoder)
+{
+    uint32_t pixelformat = (encoder->param.codec == ENCODE_CODEC_HEVC) ? V4L2_PIX_FMT_HEVC : V4L2_PIX_FMT_H264;
+    if (encoder->param.device[0] != 0)
+    {
+        encoder->fd = encode_v4l2_probe(encoder->param.device, pixelformat);
+    }
+    else
+    {
+        char path[ENCODE_DEVICE_LEN];
+        for (int i = 0; i < ENCODE_V4L2_MAX_DEVICES && encoder->fd < 0; i++)
+        {
+            snprintf(path, sizeof(path), "/dev/video%d", i);
+            encoder->fd = encode_v4l2_probe(path, pixelformat);
+        }
+    }
+    if (encoder->fd < 0)
+    {
+        return ENCODE_ERROR_BACKEND;
+    }
+
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    fmt.fmt.pix_mp.width = encoder->width;
+    fmt.fmt.pix_mp.height = encoder->height;
+    fmt.fmt.pix_mp.pixelformat = pixelformat;
+    fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+    fmt.fmt.pix_mp.num_planes = 1;
+    //a keyframe at a low bitrate still fits the raw frame size
+    fmt.fmt.pix_mp.plane_fmt[0].sizeimage = encoder->width * encoder->height * 3 / 2 + 16384;
+    if (encode_v4l2_ioctl(encoder->fd, VIDIOC_S_FMT, &fmt) < 0)
+    {
+        encode_v4l2_close(encoder);
+        return ENCODE_ERROR_BACKEND;
+    }
+
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    fmt.fmt.pix_mp.width = encoder->width;
+    fmt.fmt.pix_mp.height = encoder->height;
+    fmt.fmt.pix_mp.pixelformat = V4L2_PIX_FMT_NV12;
+    fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+    fmt.fmt.pix_mp.num_planes = 1;
+    fmt.fmt.pix_mp.plane_fmt[0].bytesperline = encoder->width;
+    if (encode_v4l2_ioctl(encoder->fd, VIDIOC_S_FMT, &fmt) < 0 || \
+        fmt.fmt.pix_mp.pixelformat != V4L2_PIX_FMT_NV12 || fmt.fmt.pix_mp.num_planes != 1 || \
+        fmt.fmt.pix_mp.width < encoder->width || fmt.fmt.pix_mp.height < encoder->height)
+    {
+        encode_v4l2_close(encoder);
+        return ENCODE_ERROR_BACKEND;
+    }
+    //the driver may align the lines and the luma height, the frame is copied into its layout
+    encoder->out_stride = fmt.fmt.pix_mp.plane_fmt[0].bytesperline;
+    if (encoder->out_stride < encoder->width)
+    {
+        encoder->out_stride = fmt.fmt.pix_mp.width;
+    }
+    encoder->out_lines = fmt.fmt.pix_mp.height;
+
+    encode_v4l2_rate(encoder);
+    encode_v4l2_control(encoder->fd, V4L2_CID_MPEG_VIDEO_BITRATE, (int32_t)encoder->param.bitrate, "bitrate");
+    encode_v4l2_control(encoder->fd, V4L2_CID_MPEG_VIDEO_GOP_SIZE, (int32_t)encoder->param.gop, "gop");
+    if (encoder->param.codec == ENCODE_CODEC_H264)
+    {
+        encode_v4l2_control(encoder->fd, V4L2_CID_MPEG_VIDEO_H264_I_PERIOD, (int32_t)encoder->param.gop, "i period");
+    }
+    //a client joining the stream late needs the parameter sets at every keyframe
+    encode_v4l2_control(encoder->fd, V4L2_CID_MPEG_VIDEO_REPEAT_SEQ_HEADER, 1, "repeat seq header");
+
+    if (encode_v4l2_buffers(encoder, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, encoder->out_bufs) != ENCODE_SUCCESS || \
+        encode_v4l2_buffers(encoder, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, encoder->cap_bufs) != ENCODE_SUCCESS)
+    {
+        encode_v4l2_close(encoder);
+        return ENCODE_ERROR_BACKEND;
+    }
+    if ((uint64_t)encoder->out_stride * encoder->out_lines * 3 / 2 > encoder->out_bufs[0].length)
+    {
+        encode_v4l2_close(encoder);
+        return ENCODE_ERROR_BACKEND;
+    }
+    for (int i = 0; i < ENCODE_V4L2_BUFFERS; i++)
+    {
+        encoder->out_queued[i] = 0;
+        if (encode_v4l2_queue_capture(encoder, i) < 0)
+        {
+            encode_v4l2_close(encoder);
+            return ENCODE_ERROR_BACKEND;
+        }
+    }
+    int type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    int rst = encode_v4l2_ioctl(encoder->fd, VIDIOC_STREAMON, &type);
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    if (rst < 0 || encode_v4l2_ioctl(encoder->fd, VIDIOC_STREAMON, &type) < 0)
+    {
+        encode_v4l2_close(encoder);
+        return ENCODE_ERROR_BACKEND;
+    }
+    return ENCODE_SUCCESS;
+}
+
+//give back the input buffers the encoder is done with, hand every finished packet on
+//returns 1 when the packet flagged as the last one was seen
+static int encode_v4l2_dequeue(Encoder_t* encoder)
+{
+    struct v4l2_buffer buf;
+    struct v4l2_plane plane;
+    for (;;)
+    {
+        memset(&buf, 0, sizeof(buf));
+        memset(&plane, 0, sizeof(plane));
+        buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.m.planes = &plane;
+        buf.length = 1;
+        if (encode_v4l2_ioctl(encoder->fd, VIDIOC_DQBUF, &buf) < 0)
+        {
+            break;
+        }
+        encoder->out_queued[buf.index] = 0;
+    }
+    int last = 0;
+    for (;;)
+    {
+        memset(&buf, 0, sizeof(buf));
+        memset(&plane, 0, sizeof(plane));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.m.planes = &plane;
+        buf.length = 1;
+        if (encode_v4l2_ioctl(encoder->fd, VIDIOC_DQBUF, &buf) < 0)
+        {
+            //EPIPE once the drain is over
+            last |= (errno == EPIPE);
+            break;
+        }
+        uint32_t size = plane.bytesused - plane.data_offset;
+        if (plane.bytesused > plane.data_offset && size > 0)
+        {
+            uint64_t timestamp_us = (uint64_t)buf.timestamp.tv_sec * 1000000 + buf.timestamp.tv_usec;
+            encode_packet(encoder, (const uint8_t*)encoder->cap_bufs[buf.index].data + plane.data_offset, size, \
+                timestamp_us, (buf.flags & V4L2_BUF_FLAG_KEYFRAME) != 0);
+        }
+        last |= ((buf.flags & V4L2_BUF_FLAG_LAST) != 0);
+        encode_v4l2_queue_capture(encoder, buf.index);
+    }
+    return last;
+}
+
+static int encode_v4l2_frame(Encoder_t* encoder, uint64_t timestamp_us)
+{
+    encode_v4l2_dequeue(encoder);
+    int index = -1;
+    for (int i = 0; i < ENCODE_V4L2_BUFFERS; i++)
+    {
+        if (!encoder->out_queued[i])
+        {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0)
+    {
+        return ENCODE_ERROR_FULL;
+    }
+
+    uint8_t* dst = (uint8_t*)encoder->out_bufs[index].data;
+    uint32_t width = encoder->width, height = encoder->height, stride = encoder->out_stride;
+    if (stride == width && encoder->out_lines == height)
+    {
+        memcpy(dst, encoder->nv12, (size_t)width * height * 3 / 2);
+    }
+    else
+    {
+        const uint8_t* src_uv = encoder->nv12 + (size_t)width * height;
+        uint8_t* dst_uv = dst + (size_t)stride * encoder->out_lines;
+        for (uint32_t y = 0; y < height; y++)
+        {
+            memcpy(dst + (size_t)y * stride, encoder->nv12 + (size_t)y * width, width);
+        }
+        for (uint32_t y = 0; y < height / 2; y++)
+        {
+            memcpy(dst_uv + (size_t)y * stride, src_uv + (size_t)y * width, width);
+        }
+    }
+
+    struct v4l2_buffer buf;
+    struct v4l2_plane plane;
+    memset(&buf, 0, sizeof(buf));
+    memset(&plane, 0, sizeof(plane));
+    buf.index = index;
+    buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.m.planes = &plane;
+    buf.length = 1;
+    //the capture buffer carries the timestamp back with the packet
+    buf.timestamp.tv_sec = (time_t)(timestamp_us / 1000000);
+    buf.timestamp.tv_usec = (suseconds_t)(timestamp_us % 1000000);
+    plane.length = encoder->out_bufs[index].length;
+    plane.bytesused = stride * encoder->out_lines * 3 / 2;
+    if (encode_v4l2_ioctl(encoder->fd, VIDIOC_QBUF, &buf) < 0)
+    {
+        return ENCODE_ERROR_BACKEND;
+    }
+    encoder->out_queued[index] = 1;
+
+    struct pollfd pfd;
+    pfd.fd = encoder->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, ENCODE_V4L2_POLL_MS) > 0)
+    {
+        encode_v4l2_dequeue(encoder);
+    }
+    return ENCODE_SUCCESS;
+}
+
+//the stop command makes the encoder emit everything queued, the last packet is flagged
+static void encode_v4l2_drain(Encoder_t* encoder)
+{
+    struct v4l2_encoder_cmd cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cmd = V4L2_ENC_CMD_STOP;
+    if (encode_v4l2_ioctl(encoder->fd, VIDIOC_ENCODER_CMD, &cmd) < 0)
+    {
+        encode_v4l2_dequeue(encoder);
+        return;
+    }
+    uint64_t end_us = get_monotonic_us() + ENCODE_DRAIN_MS * 1000;
+    while (get_monotonic_us() < end_us)
+    {
+        struct pollfd pfd;
+        pfd.fd = encoder->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        poll(&pfd, 1, ENCODE_V4L2_POLL_MS);
+        if (encode_v4l2_dequeue(encoder))
+        {
+            break;
+        }
+    }
+}
+#else
+static void encode_v4l2_rate(Encoder_t* encoder)
+{
+}
+
+static int encode_v4l2_open(Encoder_t* encoder)
+{
+    return ENCODE_ERROR_BACKEND;
+}
+
+static int encode_v4l2_frame(Encoder_t* encoder, uint64_t timestamp_us)
+{
+    return ENCODE_ERROR_BACKEND;
+}
+
+static void encode_v4l2_drain(Encoder_t* encoder)
+{
+}
+
+static void encode_v4l2_close(Encoder_t* encoder)
+{
+}
+#endif
+
+#if defined(ENCODE_X264)
+static int encode_x264_open(Encoder_t* encoder)
+{
+    if (encoder->param.codec != ENCODE_CODEC_H264)
+    {
+        return ENCODE_ERROR_BACKEND;
+    }
+    x264_param_t param;
+    if (x264_param_default_preset(&param, "ultrafast", "zerolatency") < 0)
+    {
+        return ENCODE_ERROR_BACKEND;
+    }
+    param.i_csp = X264_CSP_NV12;
+    param.i_width = encoder->width;
+    param.i_height = encoder->height;
+    param.i_fps_num = encoder->fps;
+    param.i_fps_den = 1;
+    //the pts are the frames' microsecond timestamps, rate control follows them across sensor rate switches
+    param.i_timebase_num = 1;
+    param.i_timebase_den = 1000000;
+    param.b_vfr_input = 1;
+    param.i_keyint_max = encoder->param.gop;
+    //one frame per call on a pool worker, the other workers run the other stages
+    param.i_threads = 1;
+    param.b_repeat_headers = 1;
+    param.b_annexb = 1;
+    param.rc.i_rc_method = X264_RC_ABR;
+    param.rc.i_bitrate = encoder->param.bitrate / 1000;
+    x264_param_apply_profile(&param, "baseline");
+    encoder->x264 = x264_encoder_open(&param);
+    return (encoder->x264 != NULL) ? ENCODE_SUCCESS : ENCODE_ERROR_BACKEND;
+}
+
+static void encode_x264_output(Encoder_t* encoder, x264_nal_t* nal, int nal_num, int size, x264_picture_t* pic_out)
+{
+    if (size <= 0 || nal_num <= 0)
+    {
+        return;
+    }
+    //the nal payloads of one call follow each other in memory
+    encode_packet(encoder, nal[0].p_payload, (uint32_t)size, (uint64_t)pic_out->i_pts, pic_out->b_keyframe);
+}
+
+static int encode_x264_frame(Encoder_t* encoder, uint64_t timestamp_us)
+{
+    x264_picture_t pic_in, pic_out;
+    x264_picture_init(&pic_in);
+    pic_in.img.i_csp = X264_CSP_NV12;
+    pic_in.img.i_plane = 2;
+    pic_in.img.plane[0] = encoder->nv12;
+    pic_in.img.i_stride[0] = encoder->width;
+    pic_in.img.plane[1] = encoder->nv12 + (size_t)encoder->width * encoder->height;
+    pic_in.img.i_stride[1] = encoder->width;
+    pic_in.i_pts = (int64_t)timestamp_us;
+    x264_nal_t* nal = NULL;
+    int nal_num = 0;
+    int size = x264_encoder_encode((x264_t*)encoder->x264, &nal, &nal_num, &pic_in, &pic_out);
+    if (size < 0)
+    {
+        return ENCODE_ERROR_BACKEND;
+    }
+    encode_x264_output(encoder, nal, nal_num, size, &pic_out);
+    return ENCODE_SUCCESS;
+}
+
+static void encode_x264_drain(Encoder_t* encoder)
+{
+    x264_t* x264 = (x264_t*)encoder->x264;
+    while (x264_encoder_delayed_frames(x264) > 0)
+    {
+        x264_picture_t pic_out;
+        x264_nal_t* nal = NULL;
+        int nal_num = 0;
+        int size = x264_encoder_encode(x264, &nal, &nal_num, NULL, &pic_out);
+        if (size < 0)
+        {
+            break;
+        }
+        encode_x264_output(encoder, nal, nal_num, size, &pic_out);
+    }
+}
+
+static void encode_x264_close(Encoder_t* encoder)
+{
+    if (encoder->x264 != NULL)
+    {
+        x264_encoder_close((x264_t*)encoder->x264);
+        encoder->x264 = NULL;
+    }
+}
+#else
+static int encode_x264_open(Encoder_t* encoder)
+{
+    return ENCODE_ERROR_BACKEND;
+}
+
+static int encode_x264_frame(Encoder_t* encoder, uint64_t timestamp_us)
+{
+    return ENCODE_ERROR_BACKEND;
+}
+
+static void encode_x264_drain(Encoder_t* encoder)
+{
+}
+
+static void encode_x264_close(Encoder_t* encoder)
+{
+}
+#endif
+
+//the image plane straight into NV12: the pseudo color lut's own yuv, or the library's gray conversion
+static int encode_colorize(Encoder_t* encoder, FrameSlot_t* slot)
+{
+    uint16_t* src = (uint16_t*)slot->desc.image.data;
+    FrameInfo_t* frameinfo = &encoder->frameinfo;
+    int pix_num = encoder->width * encoder->height;
+    if (frameinfo->pseudo_color_status == PSEUDO_COLOR_ON)
+    {
+        if (encoder->param.gpu && gpu_available() && gpu_colorize_nv12(src, frameinfo, encoder->param.color_mode, \
+            &slot->image_stats, encoder->width, encoder->height, encoder->nv12) == GPU_SUCCESS)
+        {
+            return ENCODE_SUCCESS;
+        }
+        if (colorize_plan_prepare(&encoder->plan, src, pix_num, frameinfo, encoder->param.color_mode, \
+            &slot->image_stats) != COLORIZE_SUCCESS)
+        {
+            return ENCODE_ERROR_MEM;
+        }
+        colorize_plan_apply_nv12(&encoder->plan, src, slot->desc.image.width, encoder->width, encoder->height, \
+            0, encoder->height, encoder->nv12);
+    }
+    else
+    {
+        simd_gray_to_yuv(src, pix_num, (frameinfo->input_format == INPUT_FMT_Y16) ? 16 : 14, SIMD_YUV_NV12, \
+            encoder->nv12);
+    }
+    return ENCODE_SUCCESS;
+}
+
+//ring task: colorize and queue the newest frame, never waits for the encoder longer than ENCODE_V4L2_POLL_MS
+static void encode_task(FrameSlot_t* slot, void* arg)
+{
+    Encoder_t* encoder = (Encoder_t*)arg;
+    pthread_mutex_lock(&encoder->mutex);
+    if (!encoder->encoding || slot->desc.image.data == NULL)
+    {
+        pthread_mutex_unlock(&encoder->mutex);
+        return;
+    }
+    uint64_t start_us = get_monotonic_us();
+    uint32_t fps = encoder->stream_frame_info->fps;
+    if (fps > 0 && fps != encoder->fps)
+    {
+        encoder->fps = fps;
+        if (encoder->backend == ENCODE_BACKEND_V4L2)
+        {
+            encode_v4l2_rate(encoder);
+        }
+    }
+    int rst = ENCODE_SUCCESS;
+    if ((slot->desc.flags & FRAME_DESC_IMAGE_INVALID) && encoder->nv12_valid)
+    {
+        //the shutter would be encoded, nv12 still holds the last good picture
+        encoder->stats.repeated++;
+    }
+    else
+    {
+        rst = encode_colorize(encoder, slot);
+        encoder->nv12_valid = (rst == ENCODE_SUCCESS);
+    }
+    if (rst == ENCODE_SUCCESS)
+    {
+        if (encoder->backend == ENCODE_BACKEND_V4L2)
+        {
+            rst = encode_v4l2_frame(encoder, slot->desc.timestamp_us);
+        }
+        else
+        {
+            rst = encode_x264_frame(encoder, slot->desc.timestamp_us);
+        }
+    }
+    if (rst == ENCODE_SUCCESS)
+    {
+        encoder->stats.frames++;
+        uint64_t encode_us = get_monotonic_us() - start_us;
+        if (encode_us > encoder->stats.encode_max_us)
+        {
+            encoder->stats.encode_max_us = encode_us;
+        }
+    }
+    else
+    {
+        encoder->stats.dropped++;
+    }
+    pthread_mutex_unlock(&encoder->mutex);
+}
+
+//register the encoder as a task consumer of the frame ring
+int encode_attach(Encoder_t* encoder, StreamFrameInfo_t* stream_frame_info)
+{
+    if (encoder == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return ENCODE_ERROR_PARAM;
+    }
+    memset(encoder, 0, sizeof(Encoder_t));
+    encoder->stream_frame_info = stream_frame_info;
+    encoder->fd = -1;
+    pthread_mutex_init(&encoder->mutex, NULL);
+    //a live stream wants the newest frame, frames the encoder can not take are skipped
+    encoder->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEWEST, \
+        POOL_STAGE_ENCODE, encode_task, encoder);
+    if (encoder->consumer_id < 0)
+    {
+        pthread_mutex_destroy(&encoder->mutex);
+        return ENCODE_ERROR_PARAM;
+    }
+    return ENCODE_SUCCESS;
+}
+
+//pick the image settings and open the backend
+int encode_start(Encoder_t* encoder, const EncodeParam_t* param)
+{
+    if (encoder == NULL || param == NULL || encoder->stream_frame_info == NULL)
+    {
+        return ENCODE_ERROR_PARAM;
+    }
+    StreamFrameInfo_t* stream_frame_info = encoder->stream_frame_info;
+    const FrameInfo_t* image_info = &stream_frame_info->config->image_info;
+    if ((image_info->input_format != INPUT_FMT_Y14 && image_info->input_format != INPUT_FMT_Y16) || \
+        image_info->width == 0 || image_info->height == 0 || (image_info->width & 1) || (image_info->height & 1))
+    {
+        return ENCODE_ERROR_FORMAT;
+    }
+    pthread_mutex_lock(&encoder->mutex);
+    if (encoder->encoding)
+    {
+        pthread_mutex_unlock(&encoder->mutex);
+        return ENCODE_ERROR_PARAM;
+    }
+    encoder->param = *param;
+    if (encoder->param.bitrate == 0)
+    {
+        encoder->param.bitrate = ENCODE_DEFAULT_BITRATE;
+    }
+    if (encoder->param.gop == 0)
+    {
+        encoder->param.gop = ENCODE_DEFAULT_GOP;
+    }
+    if (encoder->param.color_mode < IRPROC_COLOR_MODE_1)
+    {
+        encoder->param.color_mode = IRPROC_COLOR_MODE_6;
+    }
+    encoder->width = image_info->width;
+    encoder->height = image_info->height;
+    encoder->fps = (stream_frame_info->config->camera_param.fps > 0) ? stream_frame_info->config->camera_param.fps : 25;
+    encoder->frameinfo = *image_info;
+    //the hist agc state belongs to the display and the library enhance has no lut form,
+    //the stream stretches each frame over its own range instead
+    if (encoder->frameinfo.img_enhance_status == IMG_ENHANCE_HIST_AGC || \
+        encoder->frameinfo.img_enhance_status == IMG_ENHANCE_LIB || \
+        encoder->frameinfo.img_enhance_status == IMG_ENHANCE_CLAHE || \
+        encoder->frameinfo.img_enhance_status == IMG_ENHANCE_DDE)
+    {
+        encoder->frameinfo.img_enhance_status = IMG_ENHANCE_ON;
+    }
+    encoder->nv12 = (uint8_t*)malloc((size_t)encoder->width * encoder->height * 3 / 2);
+    if (encoder->nv12 == NULL)
+    {
+        pthread_mutex_unlock(&encoder->mutex);
+        return ENCODE_ERROR_MEM;
+    }
+    mem_acct_add(MEM_CLASS_ENCODER, (int64_t)encoder->width * encoder->height * 3 / 2);
+
+    int rst = ENCODE_ERROR_BACKEND;
+    if (param->backend == ENCODE_BACKEND_AUTO || param->backend == ENCODE_BACKEND_V4L2)
+    {
+        rst = encode_v4l2_open(encoder);
+        encoder->backend = ENCODE_BACKEND_V4L2;
+    }
+    if (rst != ENCODE_SUCCESS && (param->backend == ENCODE_BACKEND_AUTO || param->backend == ENCODE_BACKEND_X264))
+    {
+        rst = encode_x264_open(encoder);
+        encoder->backend = ENCODE_BACKEND_X264;
+    }
+    if (rst != ENCODE_SUCCESS)
+    {
+        mem_acct_release(MEM_CLASS_ENCODER, (uint64_t)encoder->width * encoder->height * 3 / 2);
+        free(encoder->nv12);
+        encoder->nv12 = NULL;
+        pthread_mutex_unlock(&encoder->mutex);
+        return rst;
+    }
+    memset(&encoder->stats, 0, sizeof(EncodeStats_t));
+    encoder->nv12_valid = 0;
+    encoder->encoding = 1;
+    pthread_mutex_unlock(&encoder->mutex);
+    printf("encode: %s %dx%d %s backend, %u bit/s\n", (param->codec == ENCODE_CODEC_HEVC) ? "hevc" : "h264", \
+        encoder->width, encoder->height, encode_backend_name(encoder->backend), encoder->param.bitrate);
+    return ENCODE_SUCCESS;
+}
+
+int encode_stop(Encoder_t* encoder)
+{
+    if (encoder == NULL)
+    {
+        return ENCODE_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&encoder->mutex);
+    if (!encoder->encoding)
+    {
+        pthread_mutex_unlock(&encoder->mutex);
+        return ENCODE_SUCCESS;
+    }
+    encoder->encoding = 0;
+    if (encoder->backend == ENCODE_BACKEND_V4L2)
+    {
+        encode_v4l2_drain(encoder);
+        encode_v4l2_close(encoder);
+    }
+    else
+    {
+        encode_x264_drain(encoder);
+        encode_x264_close(encoder);
+    }
+    mem_acct_release(MEM_CLASS_ENCODER, (uint64_t)encoder->width * encoder->height * 3 / 2);
+    free(encoder->nv12);
+    encoder->nv12 = NULL;
+    printf("encode: %llu frames, %llu dropped, %llu packets (%llu key), %llu bytes, slowest %llu us\n", \
+        (unsigned long long)encoder->stats.frames, (unsigned long long)encoder->stats.dropped, \
+        (unsigned long long)encoder->stats.packets, (unsigned long long)encoder->stats.keyframes, \
+        (unsigned long long)encoder->stats.bytes, (unsigned long long)encoder->stats.encode_max_us);
+    pthread_mutex_unlock(&encoder->mutex);
+    return ENCODE_SUCCESS;
+}
+
+int encode_stats(Encoder_t* encoder, EncodeStats_t* stats)
+{
+    if (encoder == NULL || stats == NULL)
+    {
+        return ENCODE_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&encoder->mutex);
+    *stats = encoder->stats;
+    pthread_mutex_unlock(&encoder->mutex);
+    return ENCODE_SUCCESS;
+}
@@ -0,0 +1,106 @@
+#ifndef _ENCODE_H_
+#define _ENCODE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+#include "colorize.h"
+
+#define ENCODE_DEVICE_LEN 64
+#define ENCODE_V4L2_BUFFERS 4           //mmap buffers on each side of the m2m device
+#define ENCODE_V4L2_MAX_DEVICES 64      //video nodes scanned for an encoder
+#define ENCODE_V4L2_POLL_MS 10          //wait for a packet after queueing a frame
+#define ENCODE_DRAIN_MS 200             //wait for the last packets when stopping
+#define ENCODE_DEFAULT_BITRATE 1000000  //bit/s
+#define ENCODE_DEFAULT_GOP 25           //frames between keyframes
+
+#define ENCODE_SUCCESS 0
+#define ENCODE_ERROR_PARAM -1
+#define ENCODE_ERROR_MEM -2
+#define ENCODE_ERROR_FORMAT -3          //the image plane is not Y14/Y16 or has odd sizes
+#define ENCODE_ERROR_BACKEND -4         //no encoder device or library, or it refused the settings
+#define ENCODE_ERROR_FULL -5            //every input buffer is still with the encoder
+
+typedef enum
+{
+    ENCODE_CODEC_H264 = 0,
+    ENCODE_CODEC_HEVC,
+}EncodeCodec_t;
+
+typedef enum
+{
+    ENCODE_BACKEND_AUTO = 0,            //the v4l2 encoder if there is one, else x264
+    ENCODE_BACKEND_V4L2,                //linux memory to memory encoder (rockchip, raspberry pi, ...)
+    ENCODE_BACKEND_X264,                //software, ultrafast, only when built with ENCODE_X264
+}EncodeBackend_t;
+
+//one packet of annex-b nal units, called from the encode task
+typedef void (*EncodePacketFunc_t)(const uint8_t* data, uint32_t size, uint64_t timestamp_us, int key, void* arg);
+
+typedef struct {
+    EncodeCodec_t codec;
+    EncodeBackend_t backend;
+    uint32_t bitrate;                   //bit/s, 0 selects ENCODE_DEFAULT_BITRATE
+    uint32_t gop;                       //0 selects ENCODE_DEFAULT_GOP
+    char device[ENCODE_DEVICE_LEN];     //v4l2 node, empty scans /dev/video*
+    irproc_color_mode_t color_mode;     //pseudo color, the image info's pseudo_color_status switches it on
+    uint8_t gpu;                        //pseudo color NV12 through gpu_colorize_nv12 once gpu_init found a device
+    EncodePacketFunc_t packet_func;
+    void* packet_arg;
+}EncodeParam_t;
+
+typedef struct {
+    uint64_t frames;                    //frames given to the encoder
+    uint64_t dropped;                   //frames skipped because every input buffer was still queued
+    uint64_t packets;
+    uint64_t keyframes;
+    uint64_t bytes;
+    uint64_t encode_max_us;             //slowest frame, colorize to queued
+    uint64_t repeated;                  //shutter/nuc frames encoded as the last good picture again
+}EncodeStats_t;
+
+typedef struct {
+    void* data;
+    uint32_t length;
+}EncodeBuffer_t;
+
+//a ring task consumer that colorizes the newest frame straight into NV12 and encodes it
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    EncodeParam_t param;
+    EncodeBackend_t backend;            //the one in use
+    int consumer_id;
+    uint8_t encoding;
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;
+    uint8_t* nv12;                      //width x height NV12
+    uint8_t nv12_valid;                 //nv12 holds a good frame to repeat over FRAME_DESC_IMAGE_INVALID ones
+    FrameInfo_t frameinfo;              //the image info as the colorize plan sees it
+    ColorizePlan_t plan;
+    int fd;                             //v4l2
+    uint32_t out_stride;                //bytes per line of the driver's NV12 buffers
+    uint32_t out_lines;                 //luma lines before the chroma plane
+    EncodeBuffer_t out_bufs[ENCODE_V4L2_BUFFERS];
+    EncodeBuffer_t cap_bufs[ENCODE_V4L2_BUFFERS];
+    uint8_t out_queued[ENCODE_V4L2_BUFFERS];
+    void* x264;                         //x264_t
+    EncodeStats_t stats;
+    pthread_mutex_t mutex;
+}Encoder_t;
+
+//register the encoder as a task consumer of the camera's frame ring, before streaming
+//the encoder must stay valid until the ring is closed, frames are ignored while it is not encoding
+int encode_attach(Encoder_t* encoder, StreamFrameInfo_t* stream_frame_info);
+
+//open the backend and start encoding the newest frames, can be called while streaming
+int encode_start(Encoder_t* encoder, const EncodeParam_t* param);
+
+//drain the last packets and close the backend
+int encode_stop(Encoder_t* encoder);
+
+int encode_stats(Encoder_t* encoder, EncodeStats_t* stats);
+
+const char* encode_backend_name(EncodeBackend_t backend);
+
+#endif
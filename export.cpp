@@ -0,0 +1,629 @@
+#include "export.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#if defined(EXPORT_ZLIB)
+#include <zlib.h>
+#endif
+#include "pool.h"
+
+//the 1-D metadata arrays, one RecordFrameMeta_t field each
+typedef struct {
+    const char* name;
+    const char* dtype;
+    uint32_t size;
+    uint32_t offset;
+}ExportColumn_t;
+
+static const ExportColumn_t export_columns[] = {
+    { "seq", "<u8", 8, offsetof(RecordFrameMeta_t, seq) },
+    { "timestamp_us", "<u8", 8, offsetof(RecordFrameMeta_t, timestamp_us) },
+    { "flags", "<u4", 4, offsetof(RecordFrameMeta_t, flags) },
+    { "gain", "<u2", 2, offsetof(RecordFrameMeta_t, gain) },
+    { "ems", "<u2", 2, offsetof(RecordFrameMeta_t, ems) },
+    { "tau", "<u2", 2, offsetof(RecordFrameMeta_t, tau) },
+    { "ta", "<u2", 2, offsetof(RecordFrameMeta_t, ta) },
+    { "tu", "<u2", 2, offsetof(RecordFrameMeta_t, tu) },
+};
+#define EXPORT_COLUMN_NUM (int)(sizeof(export_columns) / sizeof(export_columns[0]))
+#define EXPORT_COLUMN_MAX_SIZE 8
+
+static const char* export_plane_names[EXPORT_PLANE_NUM] = { "image", "temp" };
+
+static const char* export_plane_attrs[EXPORT_PLANE_NUM] = {
+    "\"_ARRAY_DIMENSIONS\": [\"time\", \"image_y\", \"image_x\"], \"long_name\": \"raw sensor counts\"",
+    "\"_ARRAY_DIMENSIONS\": [\"time\", \"y\", \"x\"], \"long_name\": \"temperature\", \"units\": \"degC\", " \
+    "\"scale_factor\": 0.015625, \"add_offset\": -273.15",
+};
+
+static int export_mkdir(const char* path)
+{
+#if defined(_WIN32)
+    int rst = _mkdir(path);
+#else
+    int rst = mkdir(path, 0755);
+#endif
+    return (rst == 0 || errno == EEXIST) ? EXPORT_SUCCESS : EXPORT_ERROR_FILE;
+}
+
+static int export_file_write(const char* path, const void* data, uint32_t size)
+{
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        return EXPORT_ERROR_FILE;
+    }
+    size_t written = (size > 0) ? fwrite(data, 1, size, fp) : 0;
+    int rst = (fclose(fp) == 0 && written == size) ? EXPORT_SUCCESS : EXPORT_ERROR_FILE;
+    return rst;
+}
+
+//name under the group directory, "" the group itself
+static int export_json_write(Exporter_t* exporter, const char* name, const char* file, const char* text)
+{
+    char path[EXPORT_PATH_LEN + 64];
+    snprintf(path, sizeof(path), "%s/%s%s%s", exporter->param.path, name, (name[0] != 0) ? "/" : "", file);
+    return export_file_write(path, text, (uint32_t)strlen(text));
+}
+
+//.zarray of a T x height x width array, height 0 makes it 1-D
+static int export_array_write(Exporter_t* exporter, const char* name, const char* dtype, uint32_t width, \
+    uint32_t height, uint64_t frames)
+{
+    char compressor[64] = "null";
+    if (exporter->param.level > 0)
+    {
+        snprintf(compressor, sizeof(compressor), "{\"id\": \"zlib\", \"level\": %d}", exporter->param.level);
+    }
+    char dims[64] = "";
+    if (height > 0)
+    {
+        snprintf(dims, sizeof(dims), ", %u, %u", height, width);
+    }
+    char text[512];
+    snprintf(text, sizeof(text), "{\n    \"zarr_format\": 2,\n    \"shape\": [%llu%s],\n    \"chunks\": [%u%s],\n" \
+        "    \"dtype\": \"%s\",\n    \"compressor\": %s,\n    \"fill_value\": 0,\n    \"order\": \"C\",\n" \
+        "    \"filters\": null\n}\n", (unsigned long long)frames, dims, exporter->param.chunk_frames, dims, dtype, \
+        compressor);
+    return export_json_write(exporter, name, ".zarray", text);
+}
+
+static int export_arrays_write(Exporter_t* exporter, uint64_t frames)
+{
+    int rst = EXPORT_SUCCESS;
+    for (int plane = 0; plane < EXPORT_PLANE_NUM && rst == EXPORT_SUCCESS; plane++)
+    {
+        if (exporter->shape.width[plane] > 0)
+        {
+            rst = export_array_write(exporter, export_plane_names[plane], "<u2", exporter->shape.width[plane], \
+                exporter->shape.height[plane], frames);
+        }
+    }
+    for (int column = 0; column < EXPORT_COLUMN_NUM && rst == EXPORT_SUCCESS; column++)
+    {
+        rst = export_array_write(exporter, export_columns[column].name, export_columns[column].dtype, 0, 0, frames);
+    }
+    return rst;
+}
+
+//the group, every array's directory and attributes, the arrays empty until export_close
+static int export_group_create(Exporter_t* exporter)
+{
+    const char* path = exporter->param.path;
+    if (export_mkdir(path) != EXPORT_SUCCESS || export_json_write(exporter, "", ".zgroup", \
+        "{\n    \"zarr_format\": 2\n}\n") != EXPORT_SUCCESS)
+    {
+        return EXPORT_ERROR_FILE;
+    }
+    char env[256] = "";
+    const ExportEnv_t* scene = &exporter->param.env;
+    if (scene->valid)
+    {
+        snprintf(env, sizeof(env), ",\n    \"env\": {\"ems\": %g, \"ta\": %g, \"tu\": %g, \"dist\": %g, \"hum\": %g}", \
+            scene->ems, scene->ta, scene->tu, scene->dist, scene->hum);
+    }
+    char text[1024];
+    snprintf(text, sizeof(text), "{\n    \"fps\": %u,\n    \"chunk_frames\": %u,\n    \"temp_unit\": \"kelvin * 64\",\n" \
+        "    \"device_values\": \"gain/ems/tau/ta/tu as prop_tpd_get returns them, where flags has %d\",\n" \
+        "    \"temp_invalid_flag\": %d,\n    \"roi_tiles_flag\": %d%s\n}\n", exporter->shape.fps, \
+        exporter->param.chunk_frames, RECORD_META_DEVICE, RECORD_META_TEMP_INVALID, RECORD_META_TILES, env);
+    if (export_json_write(exporter, "", ".zattrs", text) != EXPORT_SUCCESS)
+    {
+        return EXPORT_ERROR_FILE;
+    }
+
+    char dir[EXPORT_PATH_LEN + 64];
+    for (int plane = 0; plane < EXPORT_PLANE_NUM; plane++)
+    {
+        if (exporter->shape.width[plane] == 0)
+        {
+            continue;
+        }
+        snprintf(dir, sizeof(dir), "%s/%s", path, export_plane_names[plane]);
+        snprintf(text, sizeof(text), "{%s}\n", export_plane_attrs[plane]);
+        if (export_mkdir(dir) != EXPORT_SUCCESS || \
+            export_json_write(exporter, export_plane_names[plane], ".zattrs", text) != EXPORT_SUCCESS)
+        {
+            return EXPORT_ERROR_FILE;
+        }
+    }
+    for (int column = 0; column < EXPORT_COLUMN_NUM; column++)
+    {
+        snprintf(dir, sizeof(dir), "%s/%s", path, export_columns[column].name);
+        if (export_mkdir(dir) != EXPORT_SUCCESS || export_json_write(exporter, export_columns[column].name, \
+            ".zattrs", "{\"_ARRAY_DIMENSIONS\": [\"time\"]}\n") != EXPORT_SUCCESS)
+        {
+            return EXPORT_ERROR_FILE;
+        }
+    }
+    return export_arrays_write(exporter, 0);
+}
+
+static void export_buffers_free(Exporter_t* exporter)
+{
+    for (int i = 0; i < EXPORT_MAX_CHUNK_BUFFERS; i++)
+    {
+        ExportChunk_t* chunk = &exporter->chunks[i];
+        for (int plane = 0; plane < EXPORT_PLANE_NUM; plane++)
+        {
+            free(chunk->planes[plane]);
+        }
+        free(chunk->meta);
+        free(chunk->column);
+        free(chunk->out);
+        memset(chunk, 0, sizeof(ExportChunk_t));
+    }
+}
+
+//one chunk file: compressed into chunk->out, or as it is without a compressor. returns the bytes written, < 0 error
+static int64_t export_chunk_file(ExportChunk_t* chunk, const char* name, const char* key_suffix, \
+    const uint8_t* data, uint32_t size)
+{
+    Exporter_t* exporter = chunk->exporter;
+#if defined(EXPORT_ZLIB)
+    if (exporter->param.level > 0)
+    {
+        uLongf out_size = chunk->out_size;
+        if (compress2(chunk->out, &out_size, data, size, exporter->param.level) != Z_OK)
+        {
+            return EXPORT_ERROR_MEM;
+        }
+        data = chunk->out;
+        size = (uint32_t)out_size;
+    }
+#endif
+    char path[EXPORT_PATH_LEN + 64];
+    snprintf(path, sizeof(path), "%s/%s/%u%s", exporter->param.path, name, chunk->chunk_id, key_suffix);
+    int rst = export_file_write(path, data, size);
+    return (rst == EXPORT_SUCCESS) ? (int64_t)size : rst;
+}
+
+//pool job: compress and write the chunk of every array, then give the buffer back
+static void export_chunk_task(void* arg)
+{
+    ExportChunk_t* chunk = (ExportChunk_t*)arg;
+    Exporter_t* exporter = chunk->exporter;
+    uint32_t chunk_frames = exporter->param.chunk_frames;
+    uint64_t start_us = get_monotonic_us();
+    uint64_t stored = 0;
+    int rst = EXPORT_SUCCESS;
+    for (int plane = 0; plane < EXPORT_PLANE_NUM && rst == EXPORT_SUCCESS; plane++)
+    {
+        size_t pix_num = (size_t)exporter->shape.width[plane] * exporter->shape.height[plane];
+        if (pix_num == 0)
+        {
+            continue;
+        }
+        //zarr chunks are whole, the last one is padded with the fill value
+        memset(chunk->planes[plane] + chunk->frame_num * pix_num, 0, (chunk_frames - chunk->frame_num) * pix_num * 2);
+        int64_t size = export_chunk_file(chunk, export_plane_names[plane], ".0.0", (const uint8_t*)chunk->planes[plane], \
+            (uint32_t)(chunk_frames * pix_num * 2));
+        if (size < 0)
+        {
+            rst = (int)size;
+        }
+        else
+        {
+            stored += (uint64_t)size;
+        }
+    }
+    for (int column = 0; column < EXPORT_COLUMN_NUM && rst == EXPORT_SUCCESS; column++)
+    {
+        const ExportColumn_t* desc = &export_columns[column];
+        memset(chunk->column, 0, chunk_frames * desc->size);
+        for (uint32_t i = 0; i < chunk->frame_num; i++)
+        {
+            memcpy(chunk->column + i * desc->size, (const uint8_t*)&chunk->meta[i] + desc->offset, desc->size);
+        }
+        int64_t size = export_chunk_file(chunk, desc->name, "", chunk->column, chunk_frames * desc->size);
+        if (size < 0)
+        {
+            rst = (int)size;
+        }
+    }
+    uint64_t chunk_us = get_monotonic_us() - start_us;
+
+    pthread_mutex_lock(&exporter->mutex);
+    if (rst == EXPORT_SUCCESS)
+    {
+        exporter->stats.chunks++;
+        exporter->stats.stored_bytes += stored;
+        if (chunk_us > exporter->stats.chunk_max_us)
+        {
+            exporter->stats.chunk_max_us = chunk_us;
+        }
+    }
+    else if (!exporter->write_error)
+    {
+        //disk full or gone: the missing chunks read as the fill value
+        printf("export: chunk %u write failed, export stopped\n", chunk->chunk_id);
+        exporter->write_error = 1;
+        exporter->exporting = 0;
+    }
+    exporter->free_list[exporter->free_num++] = (int)(chunk - exporter->chunks);
+    exporter->busy--;
+    pthread_cond_broadcast(&exporter->cond);
+    pthread_mutex_unlock(&exporter->mutex);
+}
+
+//under the mutex: the filling chunk goes to a pool job, submitted by the caller once the mutex is released
+static ExportChunk_t* export_chunk_queue(Exporter_t* exporter)
+{
+    ExportChunk_t* chunk = &exporter->chunks[exporter->filling];
+    chunk->chunk_id = exporter->chunk_next++;
+    exporter->busy++;
+    exporter->filling = -1;
+    return chunk;
+}
+
+void export_init(Exporter_t* exporter)
+{
+    memset(exporter, 0, sizeof(Exporter_t));
+    exporter->consumer_id = -1;
+    exporter->filling = -1;
+    pthread_mutex_init(&exporter->mutex, NULL);
+    pthread_cond_init(&exporter->cond, NULL);
+}
+
+int export_open(Exporter_t* exporter, const ExportParam_t* param, const ExportShape_t* shape)
+{
+    if (exporter == NULL || param == NULL || shape == NULL || param->path[0] == 0)
+    {
+        return EXPORT_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&exporter->mutex);
+    int busy = exporter->open;
+    pthread_mutex_unlock(&exporter->mutex);
+    if (busy)
+    {
+        return EXPORT_ERROR_PARAM;
+    }
+
+    exporter->param = *param;
+    ExportParam_t* cur = &exporter->param;
+    if (cur->chunk_frames == 0)
+    {
+        cur->chunk_frames = EXPORT_DEFAULT_CHUNK_FRAMES;
+    }
+    if (cur->chunk_buffers == 0)
+    {
+        cur->chunk_buffers = EXPORT_DEFAULT_CHUNK_BUFFERS;
+    }
+#if !defined(EXPORT_ZLIB)
+    cur->level = 0;
+#endif
+    if (cur->chunk_frames > EXPORT_MAX_CHUNK_FRAMES || cur->chunk_buffers > EXPORT_MAX_CHUNK_BUFFERS || \
+        cur->level < 0 || cur->level > 9)
+    {
+        return EXPORT_ERROR_PARAM;
+    }
+    exporter->shape = *shape;
+    uint64_t chunk_bytes = (uint64_t)cur->chunk_frames * EXPORT_COLUMN_MAX_SIZE;
+    for (int plane = 0; plane < EXPORT_PLANE_NUM; plane++)
+    {
+        uint64_t plane_bytes = (uint64_t)shape->width[plane] * shape->height[plane] * 2 * cur->chunk_frames;
+        if (plane_bytes > chunk_bytes)
+        {
+            chunk_bytes = plane_bytes;
+        }
+    }
+    if (chunk_bytes > 0x7FFFFFFF)
+    {
+        return EXPORT_ERROR_PARAM;
+    }
+
+    uint32_t out_size = (uint32_t)chunk_bytes;
+#if defined(EXPORT_ZLIB)
+    out_size = (uint32_t)compressBound((uLong)chunk_bytes);
+#endif
+    exporter->free_num = 0;
+    for (uint32_t i = 0; i < cur->chunk_buffers; i++)
+    {
+        ExportChunk_t* chunk = &exporter->chunks[i];
+        int failed = 0;
+        for (int plane = 0; plane < EXPORT_PLANE_NUM; plane++)
+        {
+            size_t plane_bytes = (size_t)shape->width[plane] * shape->height[plane] * 2 * cur->chunk_frames;
+            if (plane_bytes > 0)
+            {
+                chunk->planes[plane] = (uint16_t*)malloc(plane_bytes);
+                failed |= (chunk->planes[plane] == NULL);
+            }
+        }
+        chunk->meta = (RecordFrameMeta_t*)malloc(cur->chunk_frames * sizeof(RecordFrameMeta_t));
+        chunk->column = (uint8_t*)malloc(cur->chunk_frames * EXPORT_COLUMN_MAX_SIZE);
+        chunk->out = (uint8_t*)malloc(out_size);
+        chunk->out_size = out_size;
+        chunk->exporter = exporter;
+        if (failed || chunk->meta == NULL || chunk->column == NULL || chunk->out == NULL)
+        {
+            export_buffers_free(exporter);
+            return EXPORT_ERROR_MEM;
+        }
+        exporter->free_list[exporter->free_num++] = (int)i;
+    }
+    if (export_group_create(exporter) != EXPORT_SUCCESS)
+    {
+        printf("export: can not create %s\n", cur->path);
+        export_buffers_free(exporter);
+        return EXPORT_ERROR_FILE;
+    }
+
+    pthread_mutex_lock(&exporter->mutex);
+    memset(&exporter->stats, 0, sizeof(ExportStats_t));
+    exporter->filling = -1;
+    exporter->busy = 0;
+    exporter->chunk_next = 0;
+    exporter->write_error = 0;
+    exporter->open = 1;
+    pthread_mutex_unlock(&exporter->mutex);
+    printf("export: %s, %u frame chunks, %s\n", cur->path, cur->chunk_frames, \
+        (cur->level > 0) ? "zlib" : "uncompressed");
+    return EXPORT_SUCCESS;
+}
+
+int export_frame(Exporter_t* exporter, const RecordFrameMeta_t* meta, const uint16_t* image, const uint16_t* temp, \
+    int block)
+{
+    if (exporter == NULL || meta == NULL)
+    {
+        return EXPORT_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&exporter->mutex);
+    if (exporter->filling < 0)
+    {
+        while (block && exporter->open && !exporter->write_error && exporter->free_num == 0)
+        {
+            pthread_cond_wait(&exporter->cond, &exporter->mutex);
+        }
+        if (!exporter->open || exporter->write_error)
+        {
+            pthread_mutex_unlock(&exporter->mutex);
+            return exporter->open ? EXPORT_ERROR_FILE : EXPORT_ERROR_PARAM;
+        }
+        if (exporter->free_num == 0)
+        {
+            exporter->stats.dropped++;
+            pthread_mutex_unlock(&exporter->mutex);
+            return EXPORT_ERROR_FULL;
+        }
+        exporter->filling = exporter->free_list[--exporter->free_num];
+        exporter->chunks[exporter->filling].frame_num = 0;
+    }
+
+    ExportChunk_t* chunk = &exporter->chunks[exporter->filling];
+    const uint16_t* planes[EXPORT_PLANE_NUM] = { image, temp };
+    for (int plane = 0; plane < EXPORT_PLANE_NUM; plane++)
+    {
+        size_t pix_num = (size_t)exporter->shape.width[plane] * exporter->shape.height[plane];
+        if (pix_num == 0)
+        {
+            continue;
+        }
+        uint16_t* dst = chunk->planes[plane] + chunk->frame_num * pix_num;
+        if (planes[plane] != NULL)
+        {
+            memcpy(dst, planes[plane], pix_num * 2);
+        }
+        else
+        {
+            memset(dst, 0, pix_num * 2);
+        }
+        exporter->stats.plane_bytes += pix_num * 2;
+    }
+    chunk->meta[chunk->frame_num] = *meta;
+    chunk->frame_num++;
+    exporter->stats.frames++;
+    ExportChunk_t* full = NULL;
+    if (chunk->frame_num == exporter->param.chunk_frames)
+    {
+        full = export_chunk_queue(exporter);
+    }
+    pthread_mutex_unlock(&exporter->mutex);
+    if (full != NULL)
+    {
+        pool_submit(POOL_STAGE_RECORD, export_chunk_task, full);
+    }
+    return EXPORT_SUCCESS;
+}
+
+int export_close(Exporter_t* exporter)
+{
+    if (exporter == NULL)
+    {
+        return EXPORT_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&exporter->mutex);
+    if (!exporter->open)
+    {
+        pthread_mutex_unlock(&exporter->mutex);
+        return EXPORT_ERROR_PARAM;
+    }
+    exporter->exporting = 0;
+    ExportChunk_t* full = NULL;
+    if (exporter->filling >= 0)
+    {
+        if (exporter->chunks[exporter->filling].frame_num > 0)
+        {
+            full = export_chunk_queue(exporter);
+        }
+        else
+        {
+            exporter->free_list[exporter->free_num++] = exporter->filling;
+            exporter->filling = -1;
+        }
+    }
+    pthread_mutex_unlock(&exporter->mutex);
+    if (full != NULL)
+    {
+        pool_submit(POOL_STAGE_RECORD, export_chunk_task, full);
+    }
+    pthread_mutex_lock(&exporter->mutex);
+    while (exporter->busy > 0)
+    {
+        pthread_cond_wait(&exporter->cond, &exporter->mutex);
+    }
+    exporter->open = 0;
+    pthread_cond_broadcast(&exporter->cond);
+    ExportStats_t stats = exporter->stats;
+    int rst = exporter->write_error ? EXPORT_ERROR_FILE : EXPORT_SUCCESS;
+    pthread_mutex_unlock(&exporter->mutex);
+
+    //the shape covers every frame taken, a chunk that failed reads as the fill value
+    if (export_arrays_write(exporter, stats.frames) != EXPORT_SUCCESS)
+    {
+        rst = EXPORT_ERROR_FILE;
+    }
+    export_buffers_free(exporter);
+    printf("export: %llu frames in %llu chunks, %llu dropped, slowest chunk %lluus\n", \
+        (unsigned long long)stats.frames, (unsigned long long)stats.chunks, (unsigned long long)stats.dropped, \
+        (unsigned long long)stats.chunk_max_us);
+    if (exporter->param.level > 0 && stats.stored_bytes > 0)
+    {
+        printf("export: planes compressed %.2f:1\n", (double)stats.plane_bytes / stats.stored_bytes);
+    }
+    return rst;
+}
+
+//ring task: the frame goes into the filling chunk, never waits for a chunk job
+static void export_task(FrameSlot_t* slot, void* arg)
+{
+    Exporter_t* exporter = (Exporter_t*)arg;
+    pthread_mutex_lock(&exporter->mutex);
+    if (!exporter->exporting)
+    {
+        pthread_mutex_unlock(&exporter->mutex);
+        return;
+    }
+    RecordFrameMeta_t meta = exporter->meta;
+    pthread_mutex_unlock(&exporter->mutex);
+    meta.seq = slot->seq;
+    meta.timestamp_us = slot->desc.timestamp_us;
+    if (slot->desc.flags & FRAME_DESC_TEMP_INVALID)
+    {
+        meta.flags |= RECORD_META_TEMP_INVALID;
+    }
+    export_frame(exporter, &meta, (const uint16_t*)slot->desc.image.data, (const uint16_t*)slot->desc.temp.data, 0);
+}
+
+int export_attach(Exporter_t* exporter, StreamFrameInfo_t* stream_frame_info)
+{
+    if (exporter == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return EXPORT_ERROR_PARAM;
+    }
+    export_init(exporter);
+    exporter->stream_frame_info = stream_frame_info;
+    //every frame in order, a frame that can not be queued counts as the consumer's drop
+    exporter->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, \
+        POOL_STAGE_RECORD, export_task, exporter);
+    if (exporter->consumer_id < 0)
+    {
+        pthread_mutex_destroy(&exporter->mutex);
+        pthread_cond_destroy(&exporter->cond);
+        return EXPORT_ERROR_PARAM;
+    }
+    return EXPORT_SUCCESS;
+}
+
+int export_start(Exporter_t* exporter, const ExportParam_t* param)
+{
+    if (exporter == NULL || exporter->stream_frame_info == NULL)
+    {
+        return EXPORT_ERROR_PARAM;
+    }
+    //the 16 bit planes only, a yuv or rgb image plane is left out
+    const StreamConfig_t* config = exporter->stream_frame_info->config;
+    ExportShape_t shape = { { 0 } };
+    const FrameInfo_t* image_info = &config->image_info;
+    if ((image_info->input_format == INPUT_FMT_Y14 || image_info->input_format == INPUT_FMT_Y16) && \
+        config->image_byte_size == image_info->width * image_info->height * 2)
+    {
+        shape.width[EXPORT_PLANE_IMAGE] = image_info->width;
+        shape.height[EXPORT_PLANE_IMAGE] = image_info->height;
+    }
+    if (config->temp_byte_size > 0 && config->temp_byte_size == config->temp_info.width * config->temp_info.height * 2)
+    {
+        shape.width[EXPORT_PLANE_TEMP] = config->temp_info.width;
+        shape.height[EXPORT_PLANE_TEMP] = config->temp_info.height;
+    }
+    shape.fps = config->camera_param.fps;
+    int rst = export_open(exporter, param, &shape);
+    if (rst != EXPORT_SUCCESS)
+    {
+        return rst;
+    }
+    pthread_mutex_lock(&exporter->mutex);
+    exporter->exporting = 1;
+    pthread_mutex_unlock(&exporter->mutex);
+    return EXPORT_SUCCESS;
+}
+
+int export_stop(Exporter_t* exporter)
+{
+    if (exporter == NULL)
+    {
+        return EXPORT_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&exporter->mutex);
+    exporter->exporting = 0;
+    pthread_mutex_unlock(&exporter->mutex);
+    return export_close(exporter);
+}
+
+void export_meta_set(Exporter_t* exporter, const RecordFrameMeta_t* meta)
+{
+    if (exporter == NULL || meta == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&exporter->mutex);
+    exporter->meta.gain = meta->gain;
+    exporter->meta.ems = meta->ems;
+    exporter->meta.tau = meta->tau;
+    exporter->meta.ta = meta->ta;
+    exporter->meta.tu = meta->tu;
+    exporter->meta.shutter_en = meta->shutter_en;
+    exporter->meta.shutter_state = meta->shutter_state;
+    exporter->meta.flags = (meta->flags & RECORD_META_DEVICE) | RECORD_META_USER;
+    pthread_mutex_unlock(&exporter->mutex);
+}
+
+int export_stats(Exporter_t* exporter, ExportStats_t* stats)
+{
+    if (exporter == NULL || stats == NULL)
+    {
+        return EXPORT_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&exporter->mutex);
+    *stats = exporter->stats;
+    pthread_mutex_unlock(&exporter->mutex);
+    return EXPORT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+#ifndef _EXPORT_H_
+#define _EXPORT_H_
+
+//chunked array export for data science tools: a zarr v2 group directory (zarr.open / xarray.open_zarr read it)
+//with the 16 bit planes as T x H x W uint16 arrays chunked by time, the frames' metadata as 1-D arrays of the same
+//chunking and the camera and scene as attributes. "temp" carries scale_factor/add_offset, xarray decodes it to
+//celsius. a full chunk is compressed and written to its own files by a task pool job, the chunks don't depend on
+//each other so they compress on every worker at once. live the exporter is a ring task consumer, offline
+//export_frame takes the frames of a recording (tools/irexport.cpp)
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+#include "record.h"
+
+#define EXPORT_DEFAULT_CHUNK_FRAMES 32
+#define EXPORT_MAX_CHUNK_FRAMES 1024
+#define EXPORT_DEFAULT_CHUNK_BUFFERS 4  //live: chunks being filled or compressed, a frame finding none is dropped
+#define EXPORT_MAX_CHUNK_BUFFERS 16
+#define EXPORT_DEFAULT_LEVEL 1          //zlib, keeps up with the stream on one core
+#define EXPORT_PATH_LEN 256
+
+#define EXPORT_SUCCESS 0
+#define EXPORT_ERROR_PARAM -1
+#define EXPORT_ERROR_FILE -2
+#define EXPORT_ERROR_MEM -3
+#define EXPORT_ERROR_FULL -4            //not blocking and every chunk buffer is compressing, the frame was dropped
+
+typedef enum
+{
+    EXPORT_PLANE_IMAGE = 0,             //the image plane when it is Y14/Y16
+    EXPORT_PLANE_TEMP,                  //kelvin * 64
+    EXPORT_PLANE_NUM,
+}ExportPlane_t;
+
+//what the user knows of the scene, written as group attributes
+typedef struct {
+    uint8_t valid;
+    float ems;
+    float ta;                           //celsius
+    float tu;                           //celsius
+    float dist;                         //m
+    float hum;                          //0..1
+}ExportEnv_t;
+
+typedef struct {
+    char path[EXPORT_PATH_LEN];         //group directory, created
+    uint32_t chunk_frames;              //0 selects EXPORT_DEFAULT_CHUNK_FRAMES
+    uint32_t chunk_buffers;             //0 selects EXPORT_DEFAULT_CHUNK_BUFFERS
+    int level;                          //zlib level 1..9, 0 stores the chunks as they are. without EXPORT_ZLIB always 0
+    ExportEnv_t env;
+}ExportParam_t;
+
+//plane sizes of the exported frames, 0 leaves a plane out
+typedef struct {
+    uint32_t width[EXPORT_PLANE_NUM];
+    uint32_t height[EXPORT_PLANE_NUM];
+    uint32_t fps;
+}ExportShape_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t dropped;                   //live frames finding every chunk buffer compressing
+    uint64_t chunks;
+    uint64_t plane_bytes;               //the planes of the exported frames as they came
+    uint64_t stored_bytes;              //plane chunk files as written
+    uint64_t chunk_max_us;              //slowest chunk job, compression and writes
+}ExportStats_t;
+
+struct Exporter_t;
+
+typedef struct {
+    uint16_t* planes[EXPORT_PLANE_NUM]; //chunk_frames frames each
+    RecordFrameMeta_t* meta;            //chunk_frames
+    uint8_t* column;                    //one metadata column gathered for its file
+    uint8_t* out;                       //compressed plane or column
+    uint32_t out_size;
+    uint32_t frame_num;
+    uint32_t chunk_id;                  //chunk index along time
+    struct Exporter_t* exporter;
+}ExportChunk_t;
+
+typedef struct Exporter_t {
+    StreamFrameInfo_t* stream_frame_info;
+    ExportParam_t param;
+    ExportShape_t shape;
+    int consumer_id;
+    uint8_t open;
+    uint8_t exporting;                  //the ring task takes frames
+    ExportChunk_t chunks[EXPORT_MAX_CHUNK_BUFFERS];
+    int filling;                        //-1 none
+    int free_list[EXPORT_MAX_CHUNK_BUFFERS];
+    int free_num;
+    uint32_t busy;                      //chunk jobs queued or running
+    uint32_t chunk_next;
+    int write_error;
+    RecordFrameMeta_t meta;             //latest known metadata of the live frames
+    ExportStats_t stats;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+}Exporter_t;
+
+//an exporter without a ring, for export_open
+void export_init(Exporter_t* exporter);
+
+//create the group and the arrays of shape and allocate the chunk buffers, for export_frame
+int export_open(Exporter_t* exporter, const ExportParam_t* param, const ExportShape_t* shape);
+
+//add one frame, NULL for a plane the shape has not. block 1 waits for a chunk buffer, 0 counts the frame dropped.
+//planes as the shape gives them, width * height uint16
+int export_frame(Exporter_t* exporter, const RecordFrameMeta_t* meta, const uint16_t* image, const uint16_t* temp, \
+    int block);
+
+//flush the partial chunk, wait for the chunk jobs and write the arrays' final shape
+int export_close(Exporter_t* exporter);
+
+//register the exporter as a task consumer of the frame ring
+int export_attach(Exporter_t* exporter, StreamFrameInfo_t* stream_frame_info);
+
+//export_open with the stream's planes, then take the ring's frames
+int export_start(Exporter_t* exporter, const ExportParam_t* param);
+
+//stop taking frames and export_close
+int export_stop(Exporter_t* exporter);
+
+//device values every following live frame carries, as record_meta_set
+void export_meta_set(Exporter_t* exporter, const RecordFrameMeta_t* meta);
+
+int export_stats(Exporter_t* exporter, ExportStats_t* stats);
+
+#endif
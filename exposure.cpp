@@ -0,0 +1,229 @@
+#include "exposure.h"
+#include <stdio.h>
+#include <string.h>
+#include "ring.h"
+#include "tempunit.h"
+#include "cmdq.h"
+#include "thermal_cam_cmd.h"
+#include "prop.h"
+
+#define EXPOSURE_HIGH_GAIN_OVER_TEMP TEMP_RAW_OF_CELSIUS(105)
+#define EXPOSURE_LOW_GAIN_OVER_TEMP TEMP_RAW_OF_CELSIUS(550)
+
+//runs on the cmdq worker
+static int exposure_gain_query(void* arg)
+{
+    ExposureGuard_t* guard = (ExposureGuard_t*)arg;
+    uint16_t gain = 0;
+    int rst = prop_tpd_get(TPD_PROP_GAIN_SEL, &gain);
+    if (rst == IRUVC_SUCCESS)
+    {
+        pthread_mutex_lock(&guard->mutex);
+        guard->gain = gain;
+        pthread_mutex_unlock(&guard->mutex);
+    }
+    return rst;
+}
+
+static void exposure_gain_query_done(int job_id, int result, void* user_data)
+{
+    ExposureGuard_t* guard = (ExposureGuard_t*)user_data;
+    pthread_mutex_lock(&guard->mutex);
+    guard->query_pending = 0;
+    pthread_cond_broadcast(&guard->cond);
+    pthread_mutex_unlock(&guard->mutex);
+}
+
+static int exposure_shutter_close(void* arg)
+{
+    printf("OVEREXPOSURE, close shutter!!!\n");
+    int rst = shutter_manual_switch(SHUTTER_CLOSE);
+    if (rst != IRUVC_SUCCESS)
+    {
+        return rst;
+    }
+    //the automatic shutter would open it again
+    return shutter_sta_set(SHUTTER_CTL_DIS);
+}
+
+static int exposure_shutter_open(void* arg)
+{
+    printf("open shutter!!!\n");
+    int rst = shutter_sta_set(SHUTTER_CTL_EN);
+    if (rst != IRUVC_SUCCESS)
+    {
+        return rst;
+    }
+    return shutter_manual_switch(SHUTTER_OPEN);
+}
+
+static void exposure_shutter_done(int job_id, int result, void* user_data)
+{
+    ExposureGuard_t* guard = (ExposureGuard_t*)user_data;
+    pthread_mutex_lock(&guard->mutex);
+    if (result != IRUVC_SUCCESS)
+    {
+        guard->stats.failures++;
+    }
+    if (guard->state == EXPOSURE_CLOSING)
+    {
+        guard->state = (result == IRUVC_SUCCESS) ? EXPOSURE_CLOSED : EXPOSURE_OPEN;
+    }
+    else
+    {
+        //a failed open is tried again after another close_frame_cnt frames
+        guard->state = (result == IRUVC_SUCCESS) ? EXPOSURE_OPEN : EXPOSURE_CLOSED;
+    }
+    guard->closed_cnt = 0;
+    pthread_cond_broadcast(&guard->cond);
+    pthread_mutex_unlock(&guard->mutex);
+}
+
+int exposure_guard_init(ExposureGuard_t* guard, const ExposureGuardParam_t* param, uint32_t fps, \
+    GainCtrl_t* gain_ctrl)
+{
+    if (guard == NULL)
+    {
+        return EXPOSURE_ERROR_PARAM;
+    }
+    memset(guard, 0, sizeof(ExposureGuard_t));
+    if (param != NULL)
+    {
+        guard->param = *param;
+    }
+    else
+    {
+        guard->param.high_gain_over_temp = EXPOSURE_HIGH_GAIN_OVER_TEMP;
+        guard->param.low_gain_over_temp = EXPOSURE_LOW_GAIN_OVER_TEMP;
+        guard->param.pixel_above_prop = 0.02f;
+        guard->param.close_frame_cnt = 10 * fps;
+    }
+    guard->fps = fps;
+    guard->gain_ctrl = gain_ctrl;
+    guard->gain = GAIN_CTRL_UNKNOWN;
+    guard->state = EXPOSURE_OPEN;
+    pthread_mutex_init(&guard->mutex, NULL);
+    pthread_cond_init(&guard->cond, NULL);
+
+    if (gain_ctrl == NULL)
+    {
+        guard->query_pending = 1;
+        if (cmdq_submit(exposure_gain_query, guard, CMDQ_PRIORITY_READ, 0, exposure_gain_query_done, guard, NULL) \
+            != CMDQ_SUCCESS)
+        {
+            guard->query_pending = 0;
+        }
+    }
+    return EXPOSURE_SUCCESS;
+}
+
+void exposure_guard_fps_set(ExposureGuard_t* guard, uint32_t fps)
+{
+    if (guard == NULL || fps == 0)
+    {
+        return;
+    }
+    pthread_mutex_lock(&guard->mutex);
+    if (guard->fps != 0 && guard->fps != fps)
+    {
+        guard->param.close_frame_cnt = (uint32_t)(((uint64_t)guard->param.close_frame_cnt * fps + guard->fps / 2) / \
+            guard->fps);
+        guard->closed_cnt = (uint32_t)((uint64_t)guard->closed_cnt * fps / guard->fps);
+    }
+    guard->fps = fps;
+    pthread_mutex_unlock(&guard->mutex);
+}
+
+void exposure_guard_release(ExposureGuard_t* guard)
+{
+    if (guard == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&guard->mutex);
+    while (guard->query_pending || guard->state == EXPOSURE_CLOSING || guard->state == EXPOSURE_OPENING)
+    {
+        pthread_cond_wait(&guard->cond, &guard->mutex);
+    }
+    ExposureState_t state = guard->state;
+    pthread_mutex_unlock(&guard->mutex);
+    if (state == EXPOSURE_CLOSED)
+    {
+        //not left closed for the next user of the camera
+        int result = 0;
+        cmdq_call(exposure_shutter_open, guard, CMDQ_PRIORITY_NORMAL, 0, &result);
+    }
+    pthread_mutex_destroy(&guard->mutex);
+    pthread_cond_destroy(&guard->cond);
+}
+
+uint32_t exposure_guard_frame(ExposureGuard_t* guard, const FrameStats_t* temp_stats)
+{
+    if (guard == NULL)
+    {
+        return 0;
+    }
+    int gain = (guard->gain_ctrl != NULL) ? gain_ctrl_gain(guard->gain_ctrl) : GAIN_CTRL_UNKNOWN;
+    pthread_mutex_lock(&guard->mutex);
+    if (guard->state == EXPOSURE_CLOSED && ++guard->closed_cnt > guard->param.close_frame_cnt)
+    {
+        guard->state = EXPOSURE_OPENING;
+        if (cmdq_submit(exposure_shutter_open, guard, CMDQ_PRIORITY_NORMAL, 0, exposure_shutter_done, guard, NULL) \
+            != CMDQ_SUCCESS)
+        {
+            guard->state = EXPOSURE_CLOSED;
+            guard->closed_cnt = 0;
+            guard->stats.failures++;
+        }
+    }
+    if (guard->state != EXPOSURE_OPEN)
+    {
+        //the frames show the shutter, not the scene
+        guard->stats.closed_frames++;
+        pthread_mutex_unlock(&guard->mutex);
+        return FRAME_DESC_SHUTTER_CLOSED;
+    }
+    if (temp_stats == NULL || !temp_stats->valid)
+    {
+        pthread_mutex_unlock(&guard->mutex);
+        return 0;
+    }
+
+    if (guard->gain_ctrl == NULL)
+    {
+        gain = guard->gain;
+    }
+    uint32_t over_temp = (gain == GAIN_CTRL_LOW) ? guard->param.low_gain_over_temp : guard->param.high_gain_over_temp;
+    if (frame_stats_share_above(temp_stats, over_temp) <= guard->param.pixel_above_prop)
+    {
+        pthread_mutex_unlock(&guard->mutex);
+        return 0;
+    }
+    guard->state = EXPOSURE_CLOSING;
+    guard->stats.closes++;
+    guard->stats.closed_frames++;
+    if (cmdq_submit(exposure_shutter_close, guard, CMDQ_PRIORITY_NORMAL, 0, exposure_shutter_done, guard, NULL) \
+        != CMDQ_SUCCESS)
+    {
+        guard->state = EXPOSURE_OPEN;
+        guard->stats.closes--;
+        guard->stats.closed_frames--;
+        guard->stats.failures++;
+        pthread_mutex_unlock(&guard->mutex);
+        return 0;
+    }
+    pthread_mutex_unlock(&guard->mutex);
+    return FRAME_DESC_SHUTTER_CLOSED;
+}
+
+int exposure_guard_stats(ExposureGuard_t* guard, ExposureGuardStats_t* stats)
+{
+    if (guard == NULL || stats == NULL)
+    {
+        return EXPOSURE_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&guard->mutex);
+    *stats = guard->stats;
+    pthread_mutex_unlock(&guard->mutex);
+    return EXPOSURE_SUCCESS;
+}
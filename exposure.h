@@ -0,0 +1,64 @@
+#ifndef _EXPOSURE_H_
+#define _EXPOSURE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "stats.h"
+#include "gain.h"
+
+#define EXPOSURE_SUCCESS 0
+#define EXPOSURE_ERROR_PARAM -1
+
+//temperatures in the temp plane's 1/64 K units
+typedef struct {
+    uint16_t high_gain_over_temp;       //overexposed in high gain above this
+    uint16_t low_gain_over_temp;
+    float pixel_above_prop;             //share of the pixels above the gain's over temp that closes the shutter
+    uint32_t close_frame_cnt;           //frames the shutter stays closed before it is opened again
+}ExposureGuardParam_t;
+
+typedef enum {
+    EXPOSURE_OPEN = 0,
+    EXPOSURE_CLOSING,                   //close command queued or running
+    EXPOSURE_CLOSED,
+    EXPOSURE_OPENING,
+}ExposureState_t;
+
+typedef struct {
+    uint64_t closes;                    //shutter closed for overexposure
+    uint64_t failures;                  //shutter commands that failed
+    uint64_t closed_frames;             //frames tagged FRAME_DESC_SHUTTER_CLOSED
+}ExposureGuardStats_t;
+
+//overexposure protection of one camera: the share of hot pixels comes from the temp histogram the stream thread
+//computes anyway, the shutter commands go through the command queue. all state is in the guard
+typedef struct ExposureGuard_t {
+    ExposureGuardParam_t param;
+    uint32_t fps;                       //close_frame_cnt is at this rate
+    GainCtrl_t* gain_ctrl;              //the gain to pick the threshold, NULL queries it once at init
+    int gain;                           //GAIN_CTRL_xxx without gain_ctrl
+    ExposureState_t state;
+    uint32_t closed_cnt;                //frames since the shutter closed
+    uint8_t query_pending;
+    ExposureGuardStats_t stats;
+    pthread_mutex_t mutex;              //the cmdq worker completes the commands
+    pthread_cond_t cond;
+}ExposureGuard_t;
+
+//param NULL takes the defaults of avoid_overexposure: 2% of the pixels above 105C in high gain or 550C in low gain
+//close the shutter for 10 s of frames. an unknown gain uses the high gain threshold
+int exposure_guard_init(ExposureGuard_t* guard, const ExposureGuardParam_t* param, uint32_t fps, \
+    GainCtrl_t* gain_ctrl);
+
+//the stream's rate changed, close_frame_cnt is rescaled to keep its time
+void exposure_guard_fps_set(ExposureGuard_t* guard, uint32_t fps);
+
+//wait for the queued commands, open the shutter if the guard closed it, release the guard
+void exposure_guard_release(ExposureGuard_t* guard);
+
+//one frame from the stream thread, returns the FRAME_DESC_xxx flags for the frame
+uint32_t exposure_guard_frame(ExposureGuard_t* guard, const FrameStats_t* temp_stats);
+
+int exposure_guard_stats(ExposureGuard_t* guard, ExposureGuardStats_t* stats);
+
+#endif
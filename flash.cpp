@@ -0,0 +1,360 @@
+#include "flash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "data.h"
+#include "thermal_cam_cmd.h"
+#include "prop.h"
+
+static pthread_mutex_t flash_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FlashParam_t flash_param = { FLASH_READ_CHUNK, FLASH_WRITE_CHUNK };
+static FlashStats_t flash_stats;
+static uint32_t flash_crc_table[256];
+static pthread_once_t flash_crc_once = PTHREAD_ONCE_INIT;
+
+static void flash_crc_table_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+        flash_crc_table[i] = crc;
+    }
+}
+
+uint32_t flash_crc32(uint32_t crc, const uint8_t* data, uint32_t size)
+{
+    pthread_once(&flash_crc_once, flash_crc_table_init);
+    crc = ~crc;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        crc = flash_crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+//largest power of two up to FLASH_CHUNK_MAX, 0 leaves the default
+static uint32_t flash_chunk_fit(uint32_t chunk, uint32_t def)
+{
+    if (chunk == 0)
+    {
+        return def;
+    }
+    uint32_t fit = FLASH_CHUNK_MAX;
+    while (fit > chunk && fit > 256)
+    {
+        fit >>= 1;
+    }
+    return fit;
+}
+
+void flash_param_set(const FlashParam_t* param)
+{
+    pthread_mutex_lock(&flash_mutex);
+    flash_param.read_chunk = flash_chunk_fit((param != NULL) ? param->read_chunk : 0, FLASH_READ_CHUNK);
+    flash_param.write_chunk = flash_chunk_fit((param != NULL) ? param->write_chunk : 0, FLASH_WRITE_CHUNK);
+    pthread_mutex_unlock(&flash_mutex);
+}
+
+void flash_stats_get(FlashStats_t* stats)
+{
+    pthread_mutex_lock(&flash_mutex);
+    *stats = flash_stats;
+    pthread_mutex_unlock(&flash_mutex);
+}
+
+void flash_stats_reset(void)
+{
+    pthread_mutex_lock(&flash_mutex);
+    memset(&flash_stats, 0, sizeof(FlashStats_t));
+    pthread_mutex_unlock(&flash_mutex);
+}
+
+static double flash_kbps(uint64_t bytes, uint64_t us)
+{
+    return (us > 0) ? bytes * 1000000.0 / 1024 / us : 0.0;
+}
+
+void flash_stats_print(const FlashStats_t* stats)
+{
+    printf("flash read:%llu bytes %.1f KB/s, write:%llu bytes %.1f KB/s, erase:%llu sectors %.1f ms, " \
+        "skipped:%llu sectors, commands:%llu\n", \
+        (unsigned long long)stats->read_bytes, flash_kbps(stats->read_bytes, stats->read_us), \
+        (unsigned long long)stats->write_bytes, flash_kbps(stats->write_bytes, stats->write_us), \
+        (unsigned long long)stats->erase_sectors, stats->erase_us / 1000.0, \
+        (unsigned long long)stats->skipped_sectors, (unsigned long long)stats->commands);
+}
+
+static void flash_chunks(uint32_t* read_chunk, uint32_t* write_chunk)
+{
+    pthread_mutex_lock(&flash_mutex);
+    *read_chunk = flash_param.read_chunk;
+    *write_chunk = flash_param.write_chunk;
+    pthread_mutex_unlock(&flash_mutex);
+}
+
+static void flash_account(uint64_t* bytes, uint64_t count, uint64_t* us, uint64_t start_us)
+{
+    uint64_t elapsed_us = get_monotonic_us() - start_us;
+    pthread_mutex_lock(&flash_mutex);
+    *bytes += count;
+    *us += elapsed_us;
+    flash_stats.commands++;
+    pthread_mutex_unlock(&flash_mutex);
+}
+
+static int flash_read_chunk(uint32_t addr, uint32_t size, uint8_t* dst)
+{
+    uint64_t start_us = get_monotonic_us();
+    if (spi_read(addr, (uint16_t)size, dst) != IRUVC_SUCCESS)
+    {
+        return FLASH_ERROR_DEVICE;
+    }
+    flash_account(&flash_stats.read_bytes, size, &flash_stats.read_us, start_us);
+    return FLASH_SUCCESS;
+}
+
+int flash_read(uint32_t addr, uint32_t size, uint8_t* dst)
+{
+    if (dst == NULL && size > 0)
+    {
+        return FLASH_ERROR_PARAM;
+    }
+    uint32_t read_chunk, write_chunk;
+    flash_chunks(&read_chunk, &write_chunk);
+    for (uint32_t done = 0; done < size;)
+    {
+        uint32_t len = (size - done < read_chunk) ? size - done : read_chunk;
+        if (flash_read_chunk(addr + done, len, dst + done) != FLASH_SUCCESS)
+        {
+            return FLASH_ERROR_DEVICE;
+        }
+        done += len;
+    }
+    return FLASH_SUCCESS;
+}
+
+int flash_range_crc32(uint32_t addr, uint32_t size, uint32_t* crc)
+{
+    if (crc == NULL)
+    {
+        return FLASH_ERROR_PARAM;
+    }
+    uint32_t read_chunk, write_chunk;
+    flash_chunks(&read_chunk, &write_chunk);
+    uint8_t* chunk = (uint8_t*)malloc(read_chunk);
+    if (chunk == NULL)
+    {
+        return FLASH_ERROR_MEM;
+    }
+    int rst = FLASH_SUCCESS;
+    *crc = 0;
+    for (uint32_t done = 0; done < size && rst == FLASH_SUCCESS;)
+    {
+        uint32_t len = (size - done < read_chunk) ? size - done : read_chunk;
+        rst = flash_read_chunk(addr + done, len, chunk);
+        *crc = flash_crc32(*crc, chunk, len);
+        done += len;
+    }
+    free(chunk);
+    return rst;
+}
+
+static int flash_erase(uint32_t addr, uint32_t sector_cnt)
+{
+    uint64_t start_us = get_monotonic_us();
+    if (spi_erase_sector(addr, (uint16_t)sector_cnt) != IRUVC_SUCCESS)
+    {
+        return FLASH_ERROR_DEVICE;
+    }
+    flash_account(&flash_stats.erase_sectors, sector_cnt, &flash_stats.erase_us, start_us);
+    return FLASH_SUCCESS;
+}
+
+//the sectors first..first+count: one erase, then their chunks. the source is copied into a chunk buffer,
+//spi_write takes a non-const pointer and the last sector may be partial
+static int flash_write_run(uint32_t addr, uint32_t size, const uint8_t* src, uint32_t first, uint32_t count, \
+    uint32_t write_chunk, uint8_t* chunk)
+{
+    uint32_t begin = first * FLASH_SECTOR_SIZE;
+    if (flash_erase(addr + begin, count) != FLASH_SUCCESS)
+    {
+        return FLASH_ERROR_DEVICE;
+    }
+    uint32_t end = (first + count) * FLASH_SECTOR_SIZE;
+    end = (end < size) ? end : size;
+    for (uint32_t done = begin; done < end;)
+    {
+        uint32_t len = (end - done < write_chunk) ? end - done : write_chunk;
+        memcpy(chunk, src + done, len);
+        uint64_t start_us = get_monotonic_us();
+        if (spi_write(addr + done, (uint16_t)len, chunk) != IRUVC_SUCCESS)
+        {
+            return FLASH_ERROR_DEVICE;
+        }
+        flash_account(&flash_stats.write_bytes, len, &flash_stats.write_us, start_us);
+        done += len;
+    }
+    return FLASH_SUCCESS;
+}
+
+int flash_write(uint32_t addr, uint32_t size, const uint8_t* src, uint32_t flags)
+{
+    if ((src == NULL && size > 0) || addr % FLASH_SECTOR_SIZE != 0)
+    {
+        return FLASH_ERROR_PARAM;
+    }
+    uint32_t read_chunk, write_chunk;
+    flash_chunks(&read_chunk, &write_chunk);
+    uint32_t buf_size = (write_chunk > FLASH_SECTOR_SIZE) ? write_chunk : FLASH_SECTOR_SIZE;
+    uint8_t* chunk = (uint8_t*)malloc(buf_size);
+    if (chunk == NULL)
+    {
+        return FLASH_ERROR_MEM;
+    }
+    uint32_t sectors = (size + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE;
+    uint32_t run_first = 0, run_count = 0;
+    int rst = FLASH_SUCCESS;
+    for (uint32_t sector = 0; sector < sectors && rst == FLASH_SUCCESS; sector++)
+    {
+        uint32_t offset = sector * FLASH_SECTOR_SIZE;
+        uint32_t len = (size - offset < FLASH_SECTOR_SIZE) ? size - offset : FLASH_SECTOR_SIZE;
+        if ((flags & FLASH_WRITE_SKIP_SAME) && len == FLASH_SECTOR_SIZE)
+        {
+            rst = flash_read_chunk(addr + offset, len, chunk);
+            if (rst == FLASH_SUCCESS && memcmp(chunk, src + offset, len) == 0)
+            {
+                //up to date, it ends the run to rewrite
+                if (run_count > 0)
+                {
+                    rst = flash_write_run(addr, size, src, run_first, run_count, write_chunk, chunk);
+                    run_count = 0;
+                }
+                pthread_mutex_lock(&flash_mutex);
+                flash_stats.skipped_sectors++;
+                pthread_mutex_unlock(&flash_mutex);
+                continue;
+            }
+        }
+        if (run_count == 0)
+        {
+            run_first = sector;
+        }
+        run_count++;
+    }
+    if (rst == FLASH_SUCCESS && run_count > 0)
+    {
+        rst = flash_write_run(addr, size, src, run_first, run_count, write_chunk, chunk);
+    }
+    free(chunk);
+    if (rst == FLASH_SUCCESS && (flags & FLASH_WRITE_VERIFY))
+    {
+        uint32_t crc = 0;
+        rst = flash_range_crc32(addr, size, &crc);
+        if (rst == FLASH_SUCCESS && crc != flash_crc32(0, src, size))
+        {
+            rst = FLASH_ERROR_VERIFY;
+        }
+    }
+    return rst;
+}
+
+//min_size > file size: the rest is zeros
+static uint8_t* flash_file_read(const char* path, uint32_t min_size, uint32_t* size)
+{
+    *size = 0;
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint32_t alloc = ((uint32_t)len > min_size) ? (uint32_t)len : min_size;
+    uint8_t* data = (len > 0) ? (uint8_t*)calloc(alloc, 1) : NULL;
+    if (data != NULL && fread(data, 1, len, fp) == (size_t)len)
+    {
+        *size = alloc;
+    }
+    else
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    return data;
+}
+
+int flash_backup(uint32_t addr, uint32_t size, const char* path)
+{
+    if (path == NULL || size == 0)
+    {
+        return FLASH_ERROR_PARAM;
+    }
+    uint8_t* data = (uint8_t*)malloc(size);
+    if (data == NULL)
+    {
+        return FLASH_ERROR_MEM;
+    }
+    int rst = flash_read(addr, size, data);
+    if (rst == FLASH_SUCCESS)
+    {
+        FILE* fp = fopen(path, "wb");
+        if (fp == NULL || fwrite(data, 1, size, fp) != size)
+        {
+            rst = FLASH_ERROR_FILE;
+        }
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+    }
+    free(data);
+    return rst;
+}
+
+int flash_restore(uint32_t addr, const char* path, uint32_t flags)
+{
+    if (path == NULL)
+    {
+        return FLASH_ERROR_PARAM;
+    }
+    uint32_t size = 0;
+    uint8_t* data = flash_file_read(path, 0, &size);
+    if (data == NULL)
+    {
+        return FLASH_ERROR_FILE;
+    }
+    int rst = flash_write(addr, size, data, flags);
+    free(data);
+    return rst;
+}
+
+int flash_update_fw_file(const char* path)
+{
+    if (path == NULL)
+    {
+        return FLASH_ERROR_PARAM;
+    }
+    uint32_t size = 0;
+    uint8_t* data = flash_file_read(path, FLASH_FW_SIZE, &size);
+    if (data == NULL)
+    {
+        return FLASH_ERROR_FILE;
+    }
+    uint64_t start_us = get_monotonic_us();
+    int rst = (update_fw(data, (int)size) == IRUVC_SUCCESS) ? FLASH_SUCCESS : FLASH_ERROR_DEVICE;
+    if (rst == FLASH_SUCCESS)
+    {
+        //the new firmware comes up with its own defaults
+        prop_cache_invalidate();
+        flash_account(&flash_stats.write_bytes, size, &flash_stats.write_us, start_us);
+    }
+    free(data);
+    return rst;
+}
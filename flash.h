@@ -0,0 +1,66 @@
+#ifndef _FLASH_H_
+#define _FLASH_H_
+
+#include <stdint.h>
+
+#define FLASH_SECTOR_SIZE 4096          //spi_erase_sector unit, SECTOR_LEN of cmd.h
+#define FLASH_READ_CHUNK 0x4000         //bytes per spi_read, what the nuc-t table read has always used
+#define FLASH_WRITE_CHUNK 0x1000        //bytes per spi_write, one sector
+#define FLASH_CHUNK_MAX 0x8000          //spi_read/spi_write lengths are 16 bit, kept a power of two
+#define FLASH_FW_SIZE (256 * 1024)      //update_fw image, shorter files are zero padded as before
+
+#define FLASH_SUCCESS 0
+#define FLASH_ERROR_PARAM -1
+#define FLASH_ERROR_DEVICE -2           //a spi command failed
+#define FLASH_ERROR_VERIFY -3           //the crc read back differs from the data written
+#define FLASH_ERROR_FILE -4
+#define FLASH_ERROR_MEM -5
+
+#define FLASH_WRITE_VERIFY 0x01         //read the range back and compare its crc32
+#define FLASH_WRITE_SKIP_SAME 0x02      //read each sector first, leave sectors that already hold the data
+
+typedef struct {
+    uint32_t read_chunk;                //0 selects FLASH_READ_CHUNK
+    uint32_t write_chunk;               //0 selects FLASH_WRITE_CHUNK
+}FlashParam_t;
+
+typedef struct {
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint64_t erase_sectors;
+    uint64_t skipped_sectors;           //FLASH_WRITE_SKIP_SAME sectors already up to date
+    uint64_t commands;                  //spi transfers issued
+    uint64_t read_us;                   //time inside the spi commands of each kind
+    uint64_t write_us;
+    uint64_t erase_us;
+}FlashStats_t;
+
+//chunk sizes of the following transfers, NULL restores the defaults
+void flash_param_set(const FlashParam_t* param);
+
+//the counters of every transfer since the last reset
+void flash_stats_get(FlashStats_t* stats);
+void flash_stats_reset(void);
+void flash_stats_print(const FlashStats_t* stats);
+
+//crc32 (ieee, as zlib), crc 0 starts a new one
+uint32_t flash_crc32(uint32_t crc, const uint8_t* data, uint32_t size);
+
+//these hold the device for a long time: with the stream running call them through cmdq_call at CMDQ_PRIORITY_LONG
+int flash_read(uint32_t addr, uint32_t size, uint8_t* dst);
+
+//crc32 of a flash range, read chunk by chunk without a buffer of the range's size
+int flash_range_crc32(uint32_t addr, uint32_t size, uint32_t* crc);
+
+//erase and program addr..addr+size, addr sector aligned. runs of sectors to rewrite are erased with one command
+//right before they are written, a sector's bytes past size are erased
+int flash_write(uint32_t addr, uint32_t size, const uint8_t* src, uint32_t flags);
+
+//save a flash range to a file and write it back, e.g. the calibration tables before a firmware update
+int flash_backup(uint32_t addr, uint32_t size, const char* path);
+int flash_restore(uint32_t addr, const char* path, uint32_t flags);
+
+//update_fw with the file read into a heap buffer, at least FLASH_FW_SIZE
+int flash_update_fw_file(const char* path);
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef _FRAME_AWAIT_H_
+#define _FRAME_AWAIT_H_
+
+//c++20 coroutine access to frame rings: co_await frame_next(&loop, ring, consumer_id) suspends until the
+//consumer has a frame, one thread running frame_loop_run resumes the waiters of any number of rings.
+//one waiter per consumer at a time.
+//header only, the rest of the tree builds without c++20 and without this file.
+//use -std=gnu++20, the vendor headers test the gnu `linux` macro
+#if defined(__cpp_impl_coroutine) && defined(__linux__)
+
+#include <coroutine>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "ring.h"
+
+#define FRAME_LOOP_EVENTS 16        //ready fds taken per epoll_wait
+
+typedef struct {
+    int epoll_fd;
+    int waiting;                    //suspended awaiters
+}FrameLoop_t;
+
+typedef struct {
+    int rst;                        //RING_SUCCESS with slot held, RING_CLOSED, or the ring_consumer_fd error
+    FrameSlot_t* slot;              //ring_read_release it when done, like ring_read_acquire's
+}FrameNext_t;
+
+//one pending co_await, lives in the waiting coroutine's frame
+struct FrameAwaiter_t {
+    FrameLoop_t* loop;
+    FrameRing_t* ring;
+    int consumer_id;
+    int fd;
+    FrameNext_t next;
+    std::coroutine_handle<> handle;
+
+    bool await_ready()
+    {
+        next.slot = NULL;
+        fd = ring_consumer_fd(ring, consumer_id);
+        if (fd < 0)
+        {
+            next.rst = fd;
+            return true;
+        }
+        next.rst = ring_read_acquire(ring, consumer_id, 0, &next.slot);
+        return next.rst != RING_TIMEOUT;
+    }
+
+    bool await_suspend(std::coroutine_handle<> waiting)
+    {
+        handle = waiting;
+        struct epoll_event event = {};
+        event.events = EPOLLIN | EPOLLONESHOT;
+        event.data.ptr = this;
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0 && \
+            (errno != EEXIST || epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, fd, &event) != 0))
+        {
+            //not resumable from the loop, carry on with the error
+            next.rst = RING_ERROR_PARAM;
+            return false;
+        }
+        loop->waiting++;
+        return true;
+    }
+
+    FrameNext_t await_resume()
+    {
+        return next;
+    }
+};
+
+static inline FrameAwaiter_t frame_next(FrameLoop_t* loop, FrameRing_t* ring, int consumer_id)
+{
+    FrameAwaiter_t awaiter = {};
+    awaiter.loop = loop;
+    awaiter.ring = ring;
+    awaiter.consumer_id = consumer_id;
+    awaiter.fd = -1;
+    return awaiter;
+}
+
+static inline int frame_loop_init(FrameLoop_t* loop)
+{
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop->waiting = 0;
+    return (loop->epoll_fd >= 0) ? RING_SUCCESS : RING_ERROR_UNAVAILABLE;
+}
+
+//the waiters still suspended are never resumed, destroy their coroutines first
+static inline void frame_loop_release(FrameLoop_t* loop)
+{
+    if (loop->epoll_fd >= 0)
+    {
+        close(loop->epoll_fd);
+    }
+    loop->epoll_fd = -1;
+    loop->waiting = 0;
+}
+
+//wait up to timeout_ms (-1 forever) and resume every waiter that got its frame or saw the ring close,
+//returns the number resumed
+static inline int frame_loop_run_once(FrameLoop_t* loop, int timeout_ms)
+{
+    struct epoll_event events[FRAME_LOOP_EVENTS];
+    int num = epoll_wait(loop->epoll_fd, events, FRAME_LOOP_EVENTS, timeout_ms);
+    int resumed = 0;
+    for (int i = 0; i < num; i++)
+    {
+        FrameAwaiter_t* awaiter = (FrameAwaiter_t*)events[i].data.ptr;
+        FrameNext_t next = { 0, NULL };
+        next.rst = ring_read_acquire(awaiter->ring, awaiter->consumer_id, 0, &next.slot);
+        if (next.rst == RING_TIMEOUT)
+        {
+            //spurious, the newest frame went to a slot it already read
+            struct epoll_event event = {};
+            event.events = EPOLLIN | EPOLLONESHOT;
+            event.data.ptr = awaiter;
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, awaiter->fd, &event);
+            continue;
+        }
+        //removed before the resume, the coroutine may await the same consumer again
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, awaiter->fd, NULL);
+        loop->waiting--;
+        awaiter->next = next;
+        awaiter->handle.resume();
+        resumed++;
+    }
+    return resumed;
+}
+
+//run until no coroutine waits any more
+static inline void frame_loop_run(FrameLoop_t* loop)
+{
+    while (loop->waiting > 0)
+    {
+        frame_loop_run_once(loop, -1);
+    }
+}
+
+#endif
+#endif
@@ -0,0 +1,196 @@
+#include "framepool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <malloc.h>
+#include <Windows.h>
+#elif defined(linux) || defined(unix)
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#define FRAME_POOL_MPOL_BIND 2          //linux/mempolicy.h, without pulling in libnuma
+
+void frame_pool_default_param(FramePoolParam_t* param)
+{
+    if (param == NULL)
+    {
+        return;
+    }
+    param->numa_node = -1;
+    param->huge_page = 1;
+    param->lock = 1;
+}
+
+const char* frame_pool_page_name(FramePoolPage_t page)
+{
+    switch (page)
+    {
+    case FRAME_POOL_PAGE_HUGETLB:
+        return "hugetlb";
+    case FRAME_POOL_PAGE_TRANSPARENT:
+        return "thp";
+    default:
+        return "normal";
+    }
+}
+
+#if defined(linux) || defined(unix)
+static uint8_t* frame_pool_map(FramePool_t* pool, const FramePoolParam_t* param)
+{
+    void* base = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+    if (param->huge_page)
+    {
+        base = mmap(NULL, pool->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED)
+        {
+            pool->page = FRAME_POOL_PAGE_HUGETLB;
+        }
+    }
+#endif
+    if (base == MAP_FAILED)
+    {
+        //FRAME_POOL_HUGE_PAGE aligned start so transparent huge pages can back the whole region
+        size_t map_size = pool->size + FRAME_POOL_HUGE_PAGE;
+        uint8_t* map = (uint8_t*)mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == (uint8_t*)MAP_FAILED)
+        {
+            return NULL;
+        }
+        size_t head = (FRAME_POOL_HUGE_PAGE - ((uintptr_t)map & (FRAME_POOL_HUGE_PAGE - 1))) & (FRAME_POOL_HUGE_PAGE - 1);
+        if (head > 0)
+        {
+            munmap(map, head);
+        }
+        if (map_size - head > pool->size)
+        {
+            munmap(map + head + pool->size, map_size - head - pool->size);
+        }
+        base = map + head;
+#if defined(MADV_HUGEPAGE)
+        if (param->huge_page && madvise(base, pool->size, MADV_HUGEPAGE) == 0)
+        {
+            pool->page = FRAME_POOL_PAGE_TRANSPARENT;
+        }
+#endif
+    }
+
+#if defined(__linux__) && defined(SYS_mbind)
+    //bind before the first touch, pages already faulted in would stay where they are
+    if (param->numa_node >= 0 && param->numa_node < (int)(sizeof(unsigned long) * 8))
+    {
+        unsigned long node_mask = 1UL << param->numa_node;
+        if (syscall(SYS_mbind, base, pool->size, FRAME_POOL_MPOL_BIND, &node_mask, \
+            sizeof(node_mask) * 8, 0) == 0)
+        {
+            pool->numa_node = param->numa_node;
+        }
+        else
+        {
+            printf("frame pool: bind to numa node %d failed(%d)\n", param->numa_node, errno);
+        }
+    }
+#endif
+
+    if (param->lock)
+    {
+        //mlock faults every page in, on the bound node
+        if (mlock(base, pool->size) == 0)
+        {
+            pool->locked = 1;
+        }
+        else
+        {
+            printf("frame pool: mlock of %zu bytes failed(%d), raise RLIMIT_MEMLOCK\n", pool->size, errno);
+        }
+    }
+    if (!pool->locked)
+    {
+        memset(base, 0, pool->size);
+    }
+    pool->mapped = 1;
+    return (uint8_t*)base;
+}
+#endif
+
+int frame_pool_create(FramePool_t* pool, const FramePoolParam_t* param, size_t size)
+{
+    if (pool == NULL || size == 0)
+    {
+        return FRAME_POOL_ERROR_PARAM;
+    }
+    FramePoolParam_t default_param;
+    if (param == NULL)
+    {
+        frame_pool_default_param(&default_param);
+        param = &default_param;
+    }
+    memset(pool, 0, sizeof(FramePool_t));
+    pool->numa_node = -1;
+    pool->size = (size + FRAME_POOL_HUGE_PAGE - 1) & ~(size_t)(FRAME_POOL_HUGE_PAGE - 1);
+
+#if defined(linux) || defined(unix)
+    pool->base = frame_pool_map(pool, param);
+#elif defined(_WIN32)
+    pool->base = (uint8_t*)_aligned_malloc(pool->size, FRAME_POOL_ALIGN);
+    if (pool->base != NULL)
+    {
+        memset(pool->base, 0, pool->size);
+        if (param->lock && VirtualLock(pool->base, pool->size))
+        {
+            pool->locked = 1;
+        }
+    }
+#endif
+    if (pool->base == NULL)
+    {
+        memset(pool, 0, sizeof(FramePool_t));
+        return FRAME_POOL_ERROR_MEM;
+    }
+    return FRAME_POOL_SUCCESS;
+}
+
+void* frame_pool_alloc(FramePool_t* pool, size_t size)
+{
+    if (pool == NULL || pool->base == NULL)
+    {
+        return NULL;
+    }
+    size = FRAME_POOL_ROUND((size > 0) ? size : 1);
+    if (pool->size - pool->used < size)
+    {
+        return NULL;
+    }
+    void* ptr = pool->base + pool->used;
+    pool->used += size;
+    return ptr;
+}
+
+void frame_pool_destroy(FramePool_t* pool)
+{
+    if (pool == NULL || pool->base == NULL)
+    {
+        return;
+    }
+#if defined(linux) || defined(unix)
+    if (pool->locked)
+    {
+        munlock(pool->base, pool->size);
+    }
+    if (pool->mapped)
+    {
+        munmap(pool->base, pool->size);
+    }
+#elif defined(_WIN32)
+    if (pool->locked)
+    {
+        VirtualUnlock(pool->base, pool->size);
+    }
+    _aligned_free(pool->base);
+#endif
+    memset(pool, 0, sizeof(FramePool_t));
+}
@@ -0,0 +1,52 @@
+#ifndef _FRAMEPOOL_H_
+#define _FRAMEPOOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FRAME_POOL_SUCCESS 0
+#define FRAME_POOL_ERROR_PARAM -1
+#define FRAME_POOL_ERROR_MEM -2
+
+#define FRAME_POOL_ALIGN 64                     //every plane starts on a cache line, simd loads stay aligned
+#define FRAME_POOL_HUGE_PAGE (2 * 1024 * 1024)  //the region is rounded to whole 2MB pages
+#define FRAME_POOL_ROUND(x) (((size_t)(x) + FRAME_POOL_ALIGN - 1) & ~(size_t)(FRAME_POOL_ALIGN - 1))
+
+typedef enum
+{
+    FRAME_POOL_PAGE_NORMAL = 0,         //no huge pages available, plain pages
+    FRAME_POOL_PAGE_HUGETLB,            //reserved huge pages (vm.nr_hugepages)
+    FRAME_POOL_PAGE_TRANSPARENT,        //transparent huge pages asked for with madvise
+}FramePoolPage_t;
+
+typedef struct {
+    int numa_node;                      //-1 leaves the placement to the first touch
+    uint8_t huge_page;                  //try reserved, then transparent huge pages
+    uint8_t lock;                       //mlock the region so a frame never pages out, failure only warns
+}FramePoolParam_t;
+
+//one camera's frame buffers in a single region: every ring slot's raw/image/temp plane is a
+//FRAME_POOL_ALIGN aligned slice of it, carved once at create_data_demo and never freed on its own
+typedef struct {
+    uint8_t* base;
+    size_t size;
+    size_t used;
+    FramePoolPage_t page;
+    uint8_t locked;
+    uint8_t mapped;                     //base came from mmap, otherwise from the aligned heap
+    int numa_node;                      //node the region is bound to, -1 when unbound
+}FramePool_t;
+
+void frame_pool_default_param(FramePoolParam_t* param);
+
+//size is the sum of FRAME_POOL_ROUND of every slice that will be carved
+int frame_pool_create(FramePool_t* pool, const FramePoolParam_t* param, size_t size);
+
+//next FRAME_POOL_ALIGN aligned slice, NULL when the region is used up
+void* frame_pool_alloc(FramePool_t* pool, size_t size);
+
+void frame_pool_destroy(FramePool_t* pool);
+
+const char* frame_pool_page_name(FramePoolPage_t page);
+
+#endif
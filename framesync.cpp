@@ -0,0 +1,315 @@
+#include "framesync.h"
+#include <stdio.h>
+#include <string.h>
+#if defined(__linux__)
+#include <poll.h>
+#endif
+#include "rtsched.h"
+#include "trace.h"
+
+static FrameSlot_t* frame_sync_head(FrameSyncCamera_t* camera)
+{
+    return camera->queue[camera->head];
+}
+
+static void frame_sync_pop(FrameSyncCamera_t* camera)
+{
+    ring_read_release(camera->ring, camera->queue[camera->head]);
+    camera->queue[camera->head] = NULL;
+    camera->head = (camera->head + 1) % FRAME_SYNC_MAX_QUEUE;
+    camera->count--;
+}
+
+static void frame_sync_push(FrameSync_t* sync, int index, FrameSlot_t* slot)
+{
+    FrameSyncCamera_t* camera = &sync->cameras[index];
+    sync_mutex_lock(&sync->mutex);
+    sync->stats.frames[index]++;
+    if (camera->count >= sync->param.queue_depth)
+    {
+        sync->stats.overflow[index]++;
+    }
+    sync_mutex_unlock(&sync->mutex);
+    if (camera->count >= sync->param.queue_depth)
+    {
+        frame_sync_pop(camera);
+    }
+    camera->queue[(camera->head + camera->count) % FRAME_SYNC_MAX_QUEUE] = slot;
+    camera->count++;
+}
+
+static void frame_sync_close(FrameSyncCamera_t* camera)
+{
+    while (camera->count > 0)
+    {
+        frame_sync_pop(camera);
+    }
+    if (!camera->closed)
+    {
+        ring_consumer_detach(camera->ring, camera->consumer_id);
+        camera->closed = 1;
+    }
+}
+
+//groups out of the queue heads until a camera has none left
+static void frame_sync_match(FrameSync_t* sync)
+{
+    int camera_num = sync->camera_num;
+    while (1)
+    {
+        int oldest = -1;
+        uint64_t oldest_us = UINT64_MAX, newest_us = 0;
+        uint64_t arrival_min_us = UINT64_MAX, arrival_max_us = 0;
+        for (int i = 0; i < camera_num; i++)
+        {
+            if (sync->cameras[i].count == 0)
+            {
+                return;
+            }
+            const FrameDesc_t* desc = &frame_sync_head(&sync->cameras[i])->desc;
+            if (desc->capture_us < oldest_us)
+            {
+                oldest_us = desc->capture_us;
+                oldest = i;
+            }
+            newest_us = (desc->capture_us > newest_us) ? desc->capture_us : newest_us;
+            arrival_min_us = (desc->timestamp_us < arrival_min_us) ? desc->timestamp_us : arrival_min_us;
+            arrival_max_us = (desc->timestamp_us > arrival_max_us) ? desc->timestamp_us : arrival_max_us;
+        }
+        if (newest_us - oldest_us > sync->param.tolerance_us)
+        {
+            //the other cameras' frames only get later, nothing can match it any more
+            sync_mutex_lock(&sync->mutex);
+            sync->stats.unmatched[oldest]++;
+            sync_mutex_unlock(&sync->mutex);
+            frame_sync_pop(&sync->cameras[oldest]);
+            continue;
+        }
+        FrameSyncGroup_t group;
+        group.seq = sync->stats.groups;
+        group.camera_num = camera_num;
+        for (int i = 0; i < camera_num; i++)
+        {
+            group.slots[i] = frame_sync_head(&sync->cameras[i]);
+        }
+        group.capture_us = oldest_us;
+        group.skew_us = newest_us - oldest_us;
+        group.arrival_skew_us = arrival_max_us - arrival_min_us;
+        TRACE_BEGIN("frame_group");
+        if (sync->param.func != NULL)
+        {
+            sync->param.func(&group, sync->param.arg);
+        }
+        TRACE_END("frame_group");
+        timing_hist_record(&sync->skew_hist, group.skew_us);
+        timing_hist_record(&sync->arrival_skew_hist, group.arrival_skew_us);
+        sync_mutex_lock(&sync->mutex);
+        sync->stats.groups++;
+        sync_mutex_unlock(&sync->mutex);
+        for (int i = 0; i < camera_num; i++)
+        {
+            frame_sync_pop(&sync->cameras[i]);
+        }
+    }
+}
+
+//take what every ring has published, returns the frames taken
+static int frame_sync_drain(FrameSync_t* sync)
+{
+    int taken = 0;
+    for (int i = 0; i < sync->camera_num; i++)
+    {
+        FrameSyncCamera_t* camera = &sync->cameras[i];
+        while (!camera->closed)
+        {
+            FrameSlot_t* slot = NULL;
+            int rst = ring_read_acquire(camera->ring, camera->consumer_id, 0, &slot);
+            if (rst == RING_SUCCESS)
+            {
+                frame_sync_push(sync, i, slot);
+                taken++;
+            }
+            else
+            {
+                if (rst == RING_CLOSED)
+                {
+                    frame_sync_close(camera);
+                }
+                break;
+            }
+        }
+    }
+    return taken;
+}
+
+static int frame_sync_open_num(FrameSync_t* sync)
+{
+    int open_num = 0;
+    for (int i = 0; i < sync->camera_num; i++)
+    {
+        open_num += !sync->cameras[i].closed;
+    }
+    return open_num;
+}
+
+//until every frame it waits for is in: the readiness fds of all rings, one ring at a time elsewhere
+static void frame_sync_wait(FrameSync_t* sync)
+{
+#if defined(__linux__)
+    struct pollfd fds[FRAME_SYNC_MAX_CAMERAS];
+    int fd_num = 0;
+    for (int i = 0; i < sync->camera_num; i++)
+    {
+        FrameSyncCamera_t* camera = &sync->cameras[i];
+        int fd = camera->closed ? -1 : ring_consumer_fd(camera->ring, camera->consumer_id);
+        if (fd >= 0)
+        {
+            fds[fd_num].fd = fd;
+            fds[fd_num].events = POLLIN;
+            fds[fd_num].revents = 0;
+            fd_num++;
+        }
+    }
+    if (fd_num > 0)
+    {
+        poll(fds, fd_num, FRAME_SYNC_POLL_MS);
+        return;
+    }
+#endif
+    for (int i = 0; i < sync->camera_num; i++)
+    {
+        FrameSyncCamera_t* camera = &sync->cameras[i];
+        if (camera->closed || camera->count > 0)
+        {
+            continue;
+        }
+        FrameSlot_t* slot = NULL;
+        int rst = ring_read_acquire(camera->ring, camera->consumer_id, FRAME_SYNC_POLL_MS, &slot);
+        if (rst == RING_SUCCESS)
+        {
+            frame_sync_push(sync, i, slot);
+        }
+        else if (rst == RING_CLOSED)
+        {
+            frame_sync_close(camera);
+        }
+        return;
+    }
+}
+
+static void* frame_sync_function(void* arg)
+{
+    FrameSync_t* sync = (FrameSync_t*)arg;
+    TRACE_THREAD_NAME("framesync");
+    rt_thread_enter(RT_ROLE_ANALYTICS, -1, "framesync");
+    while (!sync->stop && frame_sync_open_num(sync) > 0)
+    {
+        if (frame_sync_drain(sync) > 0)
+        {
+            frame_sync_match(sync);
+            continue;
+        }
+        frame_sync_wait(sync);
+    }
+    for (int i = 0; i < sync->camera_num; i++)
+    {
+        frame_sync_close(&sync->cameras[i]);
+    }
+    rt_thread_leave();
+    return NULL;
+}
+
+void frame_sync_init(FrameSync_t* sync)
+{
+    if (sync == NULL)
+    {
+        return;
+    }
+    memset(&sync->param, 0, sizeof(FrameSyncParam_t));
+    memset(sync->cameras, 0, sizeof(sync->cameras));
+    memset(&sync->stats, 0, sizeof(FrameSyncStats_t));
+    sync->camera_num = 0;
+    sync->running = 0;
+    sync->stop = 0;
+    timing_hist_reset(&sync->skew_hist);
+    timing_hist_reset(&sync->arrival_skew_hist);
+    sync_mutex_init(&sync->mutex);
+}
+
+int frame_sync_attach(FrameSync_t* sync, StreamFrameInfo_t* stream_frame_info)
+{
+    if (sync == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL || \
+        sync->camera_num >= FRAME_SYNC_MAX_CAMERAS)
+    {
+        return FRAME_SYNC_ERROR_PARAM;
+    }
+    if (sync->running)
+    {
+        return FRAME_SYNC_ERROR_BUSY;
+    }
+    int consumer_id = ring_consumer_attach(stream_frame_info->frame_ring, RING_POLICY_NEXT);
+    if (consumer_id < 0)
+    {
+        return FRAME_SYNC_ERROR_PARAM;
+    }
+    FrameSyncCamera_t* camera = &sync->cameras[sync->camera_num];
+    memset(camera, 0, sizeof(FrameSyncCamera_t));
+    camera->ring = stream_frame_info->frame_ring;
+    camera->consumer_id = consumer_id;
+    return sync->camera_num++;
+}
+
+int frame_sync_start(FrameSync_t* sync, const FrameSyncParam_t* param)
+{
+    if (sync == NULL || param == NULL || sync->camera_num == 0 || param->queue_depth > FRAME_SYNC_MAX_QUEUE)
+    {
+        return FRAME_SYNC_ERROR_PARAM;
+    }
+    if (sync->running)
+    {
+        return FRAME_SYNC_ERROR_BUSY;
+    }
+    sync->param = *param;
+    sync->param.tolerance_us = (param->tolerance_us > 0) ? param->tolerance_us : FRAME_SYNC_DEFAULT_TOLERANCE_US;
+    sync->param.queue_depth = (param->queue_depth > 0) ? param->queue_depth : FRAME_SYNC_DEFAULT_QUEUE;
+    sync->stop = 0;
+    if (pthread_create(&sync->thread, NULL, frame_sync_function, sync) != 0)
+    {
+        return FRAME_SYNC_ERROR_PARAM;
+    }
+    sync->running = 1;
+    printf("frame sync: %d cameras within %u us, %u frames queued each\n", sync->camera_num, \
+        sync->param.tolerance_us, sync->param.queue_depth);
+    return FRAME_SYNC_SUCCESS;
+}
+
+void frame_sync_stop(FrameSync_t* sync)
+{
+    if (sync == NULL || !sync->running)
+    {
+        return;
+    }
+    sync->stop = 1;
+    pthread_join(sync->thread, NULL);
+    sync->running = 0;
+    FrameSyncStats_t stats;
+    frame_sync_stats(sync, &stats);
+    printf("frame sync: %llu groups, skew p50:%lluus p99:%lluus max:%lluus, %lluus max on arrival\n", \
+        (unsigned long long)stats.groups, (unsigned long long)stats.skew.p50_us, \
+        (unsigned long long)stats.skew.p99_us, (unsigned long long)stats.skew.max_us, \
+        (unsigned long long)stats.arrival_skew.max_us);
+}
+
+int frame_sync_stats(FrameSync_t* sync, FrameSyncStats_t* stats)
+{
+    if (sync == NULL || stats == NULL)
+    {
+        return FRAME_SYNC_ERROR_PARAM;
+    }
+    sync_mutex_lock(&sync->mutex);
+    *stats = sync->stats;
+    sync_mutex_unlock(&sync->mutex);
+    timing_hist_stats(&sync->skew_hist, &stats->skew);
+    timing_hist_stats(&sync->arrival_skew_hist, &stats->arrival_skew);
+    return FRAME_SYNC_SUCCESS;
+}
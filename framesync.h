@@ -0,0 +1,89 @@
+#ifndef _FRAMESYNC_H_
+#define _FRAMESYNC_H_
+
+//frame groups across cameras for mosaics, fusion and multi view alarms: one thread takes every frame of each
+//attached ring into a short per camera queue, the slots stay held, and whenever every camera has one it compares
+//the oldest ones by desc.capture_us (ring_capture_clock_set, the usb jitter and each device's latency taken out).
+//within tolerance_us they leave as one group through func, otherwise the oldest frame can not match any more and
+//is dropped. a camera that falls behind by more than its queue loses its oldest frames
+#include <stdint.h>
+#include <pthread.h>
+#include "sync.h"
+#include "timing.h"
+#include "data.h"
+
+#define FRAME_SYNC_MAX_CAMERAS 8
+#define FRAME_SYNC_MAX_QUEUE 8
+#define FRAME_SYNC_DEFAULT_QUEUE 2          //held slots per camera, keep the ring depth above it and the other readers
+#define FRAME_SYNC_DEFAULT_TOLERANCE_US 10000   //a quarter period at 25 fps
+#define FRAME_SYNC_POLL_MS 100              //a wait for frames, stops are seen within it
+
+#define FRAME_SYNC_SUCCESS 0
+#define FRAME_SYNC_ERROR_PARAM -1
+#define FRAME_SYNC_ERROR_BUSY -2            //running, attach every camera before frame_sync_start
+
+//the frames of one group, camera i's slot held for the call. ring_slot_copy keeps planes beyond it
+typedef struct {
+    uint64_t seq;                       //groups before this one
+    int camera_num;
+    FrameSlot_t* slots[FRAME_SYNC_MAX_CAMERAS];
+    uint64_t capture_us;                //the oldest of the group's capture times
+    uint64_t skew_us;                   //newest - oldest capture_us
+    uint64_t arrival_skew_us;           //the same spread of timestamp_us, what the group would be without the clock
+}FrameSyncGroup_t;
+
+//on the synchronizer's thread, the next group waits until it returns
+typedef void (*FrameSyncFunc_t)(const FrameSyncGroup_t* group, void* arg);
+
+typedef struct {
+    uint32_t tolerance_us;              //0 selects FRAME_SYNC_DEFAULT_TOLERANCE_US
+    uint32_t queue_depth;               //0 selects FRAME_SYNC_DEFAULT_QUEUE, at most FRAME_SYNC_MAX_QUEUE
+    FrameSyncFunc_t func;
+    void* arg;
+}FrameSyncParam_t;
+
+typedef struct {
+    uint64_t groups;
+    uint64_t frames[FRAME_SYNC_MAX_CAMERAS];    //taken from each ring
+    uint64_t unmatched[FRAME_SYNC_MAX_CAMERAS]; //dropped, no frame of every other camera within tolerance
+    uint64_t overflow[FRAME_SYNC_MAX_CAMERAS];  //dropped from a full queue while another camera was behind
+    TimingStats_t skew;                 //of the groups' capture_us
+    TimingStats_t arrival_skew;         //and of their timestamp_us
+}FrameSyncStats_t;
+
+typedef struct {
+    FrameRing_t* ring;
+    int consumer_id;
+    uint8_t closed;
+    FrameSlot_t* queue[FRAME_SYNC_MAX_QUEUE];
+    uint32_t head;
+    uint32_t count;
+}FrameSyncCamera_t;
+
+typedef struct FrameSync_t {
+    FrameSyncParam_t param;
+    int camera_num;
+    FrameSyncCamera_t cameras[FRAME_SYNC_MAX_CAMERAS];
+    pthread_t thread;
+    uint8_t running;
+    volatile uint8_t stop;
+    TimingHist_t skew_hist;
+    TimingHist_t arrival_skew_hist;
+    FrameSyncStats_t stats;
+    sync_mutex_t mutex;                 //stats against frame_sync_stats
+}FrameSync_t;
+
+void frame_sync_init(FrameSync_t* sync);
+
+//camera index of the stream in the groups, a NEXT consumer of its ring. before frame_sync_start
+int frame_sync_attach(FrameSync_t* sync, StreamFrameInfo_t* stream_frame_info);
+
+int frame_sync_start(FrameSync_t* sync, const FrameSyncParam_t* param);
+
+//stop the thread, release the queued frames and detach what is still attached. the thread also leaves once
+//every ring closed, the streams may stop first
+void frame_sync_stop(FrameSync_t* sync);
+
+int frame_sync_stats(FrameSync_t* sync, FrameSyncStats_t* stats);
+
+#endif
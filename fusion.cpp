@@ -0,0 +1,208 @@
+#include "fusion.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "band.h"
+#include "simd.h"
+
+#define FUSION_FRAC_BITS 6
+
+//the 8 unknowns of h (h8 = 1) from x = (h0 u + h1 v + h2) / (h6 u + h7 v + 1) and the same for y,
+//gaussian elimination with partial pivoting
+int fusion_homography(const float* visible, const float* thermal, double* homography)
+{
+    if (visible == NULL || thermal == NULL || homography == NULL)
+    {
+        return FUSION_ERROR_PARAM;
+    }
+    double a[8][9];
+    for (int i = 0; i < 4; i++)
+    {
+        double u = visible[2 * i], v = visible[2 * i + 1];
+        double x = thermal[2 * i], y = thermal[2 * i + 1];
+        double row_x[9] = { u, v, 1, 0, 0, 0, -u * x, -v * x, x };
+        double row_y[9] = { 0, 0, 0, u, v, 1, -u * y, -v * y, y };
+        memcpy(a[2 * i], row_x, sizeof(row_x));
+        memcpy(a[2 * i + 1], row_y, sizeof(row_y));
+    }
+    for (int c = 0; c < 8; c++)
+    {
+        int pivot = c;
+        for (int r = c + 1; r < 8; r++)
+        {
+            pivot = (fabs(a[r][c]) > fabs(a[pivot][c])) ? r : pivot;
+        }
+        if (fabs(a[pivot][c]) < 1e-12)
+        {
+            //three of the points on a line
+            return FUSION_ERROR_PARAM;
+        }
+        for (int k = 0; k < 9; k++)
+        {
+            double t = a[c][k];
+            a[c][k] = a[pivot][k];
+            a[pivot][k] = t;
+        }
+        for (int r = 0; r < 8; r++)
+        {
+            if (r != c)
+            {
+                double f = a[r][c] / a[c][c];
+                for (int k = c; k < 9; k++)
+                {
+                    a[r][k] -= f * a[c][k];
+                }
+            }
+        }
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        homography[i] = a[i][8] / a[i][i];
+    }
+    homography[8] = 1.0;
+    return FUSION_SUCCESS;
+}
+
+//one coordinate in Q6, the 2 taps kept inside [0, size - 1]
+static void fusion_tap(double pos, uint32_t size, uint32_t* first, uint32_t* frac)
+{
+    double max_pos = (double)(size - 1);
+    pos = (pos < 0.0) ? 0.0 : ((pos > max_pos) ? max_pos : pos);
+    uint32_t fixed = (uint32_t)(pos * (1 << FUSION_FRAC_BITS) + 0.5);
+    *first = fixed >> FUSION_FRAC_BITS;
+    *frac = fixed & ((1 << FUSION_FRAC_BITS) - 1);
+    if (*first >= size - 1)
+    {
+        *first = size - 2;
+        *frac = 1 << FUSION_FRAC_BITS;
+    }
+}
+
+static void fusion_map_build(Fusion_t* fusion)
+{
+    const FusionParam_t* param = &fusion->param;
+    const double* h = param->homography;
+    for (uint32_t v = 0; v < param->visible_height; v++)
+    {
+        uint32_t first = param->visible_width, last = 0;
+        uint32_t* base = fusion->base + v * param->visible_width;
+        uint16_t* frac = fusion->frac + v * param->visible_width;
+        for (uint32_t u = 0; u < param->visible_width; u++)
+        {
+            double w = h[6] * u + h[7] * v + h[8];
+            double x = (w > 1e-9) ? (h[0] * u + h[1] * v + h[2]) / w : -1.0;
+            double y = (w > 1e-9) ? (h[3] * u + h[4] * v + h[5]) / w : -1.0;
+            //the thermal frame covers half a pixel around its outer centers
+            if (x >= -0.5 && x <= param->thermal_width - 0.5 && y >= -0.5 && y <= param->thermal_height - 0.5)
+            {
+                first = (u < first) ? u : first;
+                last = u + 1;
+            }
+            uint32_t x0, fx, y0, fy;
+            fusion_tap(x, param->thermal_width, &x0, &fx);
+            fusion_tap(y, param->thermal_height, &y0, &fy);
+            base[u] = (y0 * param->thermal_width + x0) * 3;
+            frac[u] = (uint16_t)(fx | (fy << 8));
+        }
+        //a line maps to a line, its part inside the frame is one span
+        fusion->span[2 * v] = (uint16_t)((first < last) ? first : 0);
+        fusion->span[2 * v + 1] = (uint16_t)((first < last) ? last : 0);
+    }
+}
+
+int fusion_init(Fusion_t* fusion, const FusionParam_t* param)
+{
+    if (fusion == NULL || param == NULL || param->thermal_width < 2 || param->thermal_height < 2 || \
+        param->visible_width == 0 || param->visible_height == 0 || param->visible_width > 65535 || \
+        (uint64_t)param->thermal_width * param->thermal_height * 3 >= (1u << 31) || \
+        param->edge_strength > FUSION_STRENGTH_MAX)
+    {
+        return FUSION_ERROR_PARAM;
+    }
+    memset(fusion, 0, sizeof(Fusion_t));
+    fusion->param = *param;
+    fusion->thermal_len = param->thermal_width * param->thermal_height * 3;
+    size_t pix_num = (size_t)param->visible_width * param->visible_height;
+    fusion->base = (uint32_t*)malloc(pix_num * sizeof(uint32_t));
+    fusion->frac = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    fusion->span = (uint16_t*)malloc(param->visible_height * 2 * sizeof(uint16_t));
+    if (fusion->base == NULL || fusion->frac == NULL || fusion->span == NULL)
+    {
+        fusion_release(fusion);
+        return FUSION_ERROR_MEM;
+    }
+    fusion_map_build(fusion);
+    return FUSION_SUCCESS;
+}
+
+void fusion_release(Fusion_t* fusion)
+{
+    if (fusion == NULL)
+    {
+        return;
+    }
+    free(fusion->base);
+    free(fusion->frac);
+    free(fusion->span);
+    memset(fusion, 0, sizeof(Fusion_t));
+}
+
+int fusion_strength_set(Fusion_t* fusion, uint8_t edge_strength)
+{
+    if (fusion == NULL || edge_strength > FUSION_STRENGTH_MAX)
+    {
+        return FUSION_ERROR_PARAM;
+    }
+    fusion->param.edge_strength = edge_strength;
+    return FUSION_SUCCESS;
+}
+
+typedef struct {
+    const Fusion_t* fusion;
+    const uint8_t* thermal_bgr;
+    const uint8_t* visible_y;
+    int visible_stride;
+    uint8_t* dst;
+}FusionJob_t;
+
+static void fusion_band(void* arg, int band, int y0, int y1)
+{
+    const FusionJob_t* job = (const FusionJob_t*)arg;
+    const Fusion_t* fusion = job->fusion;
+    const FusionParam_t* param = &fusion->param;
+    uint32_t width = param->visible_width;
+    for (int y = y0; y < y1; y++)
+    {
+        uint8_t* out = job->dst + (size_t)y * width * 3;
+        uint32_t first = fusion->span[2 * y], last = fusion->span[2 * y + 1];
+        memset(out, 0, first * 3);
+        if (last > first)
+        {
+            size_t offset = (size_t)y * width + first;
+            simd_remap_bgr(job->thermal_bgr, fusion->thermal_len, param->thermal_width * 3, fusion->base + offset, \
+                fusion->frac + offset, last - first, out + first * 3);
+        }
+        memset(out + last * 3, 0, (width - last) * 3);
+        //the outermost rows and columns have no 3x3 neighbourhood and get no detail
+        if (param->edge_strength > 0 && y > 0 && y + 1 < (int)param->visible_height && width > 2)
+        {
+            const uint8_t* cur = job->visible_y + (size_t)y * job->visible_stride + 1;
+            simd_edge_add_bgr(cur - job->visible_stride, cur, cur + job->visible_stride, width - 2, \
+                param->edge_strength, out + 3);
+        }
+    }
+}
+
+int fusion_process(Fusion_t* fusion, const uint8_t* thermal_bgr, const uint8_t* visible_y, int visible_stride, \
+    uint8_t* dst, int band_num)
+{
+    if (fusion == NULL || fusion->base == NULL || thermal_bgr == NULL || dst == NULL || \
+        (fusion->param.edge_strength > 0 && (visible_y == NULL || visible_stride < (int)fusion->param.visible_width)))
+    {
+        return FUSION_ERROR_PARAM;
+    }
+    FusionJob_t job = { fusion, thermal_bgr, visible_y, visible_stride, dst };
+    BandStage_t stage = { fusion_band, &job, (int)fusion->param.visible_height };
+    band_run(POOL_STAGE_DISPLAY, &stage, 1, (band_num > 0) ? band_num : 1);
+    return FUSION_SUCCESS;
+}
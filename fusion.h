@@ -0,0 +1,49 @@
+#ifndef _FUSION_H_
+#define _FUSION_H_
+
+#include <stdint.h>
+
+#define FUSION_STRENGTH_MAX 127         //Q4 edge gain, 16 adds the visible detail once
+
+#define FUSION_SUCCESS 0
+#define FUSION_ERROR_PARAM -1
+#define FUSION_ERROR_MEM -2
+
+typedef struct {
+    uint32_t thermal_width;
+    uint32_t thermal_height;
+    uint32_t visible_width;             //the output resolution
+    uint32_t visible_height;
+    double homography[9];               //row major, visible pixel (u, v, 1) -> thermal pixel, centers at integers
+    uint8_t edge_strength;              //Q4, 0 blends no edges
+}FusionParam_t;
+
+//thermal/visible fusion at the visible resolution. the static registration is precomputed once into a remap
+//table: per visible pixel the byte offset of its 2x2 thermal taps and Q6 weights, per row the span that
+//falls inside the thermal frame. each frame is then a gather remap of the colorized thermal frame and an
+//msx style high pass of the visible luma added on top
+typedef struct {
+    FusionParam_t param;
+    uint32_t* base;                     //visible_width * visible_height, offsets into the thermal bgr
+    uint16_t* frac;                     //fx | fy << 8
+    uint16_t* span;                     //2 per visible row: first pixel inside, one past the last
+    uint32_t thermal_len;               //bytes of the thermal bgr frame
+}Fusion_t;
+
+//the homography of 4 point pairs, visible[2 * i], visible[2 * i + 1] -> thermal[2 * i], thermal[2 * i + 1]
+int fusion_homography(const float* visible, const float* thermal, double* homography);
+
+//builds the remap table
+int fusion_init(Fusion_t* fusion, const FusionParam_t* param);
+
+void fusion_release(Fusion_t* fusion);
+
+int fusion_strength_set(Fusion_t* fusion, uint8_t edge_strength);
+
+//thermal_bgr: the colorized thermal frame, bgr888 without padding. visible_y: the visible camera's luma plane.
+//dst: bgr888 of visible_width x visible_height, outside the thermal frame only the edges show.
+//band_num row bands on the display stage of the task pool, 1 runs in the caller
+int fusion_process(Fusion_t* fusion, const uint8_t* thermal_bgr, const uint8_t* visible_y, int visible_stride, \
+    uint8_t* dst, int band_num);
+
+#endif
@@ -0,0 +1,250 @@
+#include "gain.h"
+#include <stdio.h>
+#include <string.h>
+#include "ring.h"
+#include "tempunit.h"
+#include "cmdq.h"
+#include "temperature.h"
+#include "prop.h"
+
+#define GAIN_CTRL_ABOVE_TEMP TEMP_RAW_OF_CELSIUS(130)
+#define GAIN_CTRL_BELOW_TEMP TEMP_RAW_OF_CELSIUS(110)
+
+//runs on the cmdq worker
+static int gain_ctrl_query(void* arg)
+{
+    GainCtrl_t* ctrl = (GainCtrl_t*)arg;
+    uint16_t gain = 0;
+    int rst = prop_tpd_get(TPD_PROP_GAIN_SEL, &gain);
+    if (rst == IRUVC_SUCCESS)
+    {
+        pthread_mutex_lock(&ctrl->mutex);
+        if (!ctrl->pending)
+        {
+            ctrl->gain = gain;
+        }
+        pthread_mutex_unlock(&ctrl->mutex);
+    }
+    return rst;
+}
+
+static void gain_ctrl_query_done(int job_id, int result, void* user_data)
+{
+    GainCtrl_t* ctrl = (GainCtrl_t*)user_data;
+    pthread_mutex_lock(&ctrl->mutex);
+    ctrl->query_pending = 0;
+    pthread_cond_broadcast(&ctrl->cond);
+    pthread_mutex_unlock(&ctrl->mutex);
+}
+
+static int gain_ctrl_set(void* arg)
+{
+    GainCtrl_t* ctrl = (GainCtrl_t*)arg;
+    pthread_mutex_lock(&ctrl->mutex);
+    int target = ctrl->target;
+    pthread_mutex_unlock(&ctrl->mutex);
+    printf("switch to %s gain!\n", (target == GAIN_CTRL_LOW) ? "low" : "high");
+    return prop_tpd_set(TPD_PROP_GAIN_SEL, (uint16_t)target);
+}
+
+static void gain_ctrl_set_done(int job_id, int result, void* user_data)
+{
+    GainCtrl_t* ctrl = (GainCtrl_t*)user_data;
+    pthread_mutex_lock(&ctrl->mutex);
+    ctrl->pending = 0;
+    if (result == IRUVC_SUCCESS)
+    {
+        ctrl->gain = ctrl->target;
+        temp_gain_select_ctx(ctrl->calib, ctrl->target);    //the resident tables of the gain, from the next frame
+        ctrl->settle_left = ctrl->param.settle_frame_cnt;
+        ctrl->stats.switches++;
+    }
+    else
+    {
+        //the device keeps its gain, try again after another switch_frame_cnt frames
+        ctrl->stats.failures++;
+    }
+    pthread_cond_broadcast(&ctrl->cond);
+    pthread_mutex_unlock(&ctrl->mutex);
+}
+
+int gain_ctrl_init(GainCtrl_t* ctrl, const GainCtrlParam_t* param, uint32_t fps)
+{
+    if (ctrl == NULL)
+    {
+        return GAIN_CTRL_ERROR_PARAM;
+    }
+    memset(ctrl, 0, sizeof(GainCtrl_t));
+    if (param != NULL)
+    {
+        ctrl->param = *param;
+    }
+    else
+    {
+        ctrl->param.above_pixel_prop = 0.1f;
+        ctrl->param.above_temp = (uint16_t)GAIN_CTRL_ABOVE_TEMP;
+        ctrl->param.below_pixel_prop = 0.95f;
+        ctrl->param.below_temp = (uint16_t)GAIN_CTRL_BELOW_TEMP;
+        ctrl->param.switch_frame_cnt = 5 * fps;
+        ctrl->param.settle_frame_cnt = 7 * fps;
+    }
+    ctrl->fps = fps;
+    ctrl->gain = GAIN_CTRL_UNKNOWN;
+    ctrl->target = GAIN_CTRL_UNKNOWN;
+    pthread_mutex_init(&ctrl->mutex, NULL);
+    pthread_cond_init(&ctrl->cond, NULL);
+
+    ctrl->query_pending = 1;
+    if (cmdq_submit(gain_ctrl_query, ctrl, CMDQ_PRIORITY_READ, 0, gain_ctrl_query_done, ctrl, NULL) != CMDQ_SUCCESS)
+    {
+        //switches are sent anyway while the gain is unknown
+        ctrl->query_pending = 0;
+    }
+    return GAIN_CTRL_SUCCESS;
+}
+
+static uint32_t gain_ctrl_rescale(uint32_t frames, uint32_t from, uint32_t to)
+{
+    return (uint32_t)(((uint64_t)frames * to + from / 2) / from);
+}
+
+void gain_ctrl_fps_set(GainCtrl_t* ctrl, uint32_t fps)
+{
+    if (ctrl == NULL || fps == 0)
+    {
+        return;
+    }
+    pthread_mutex_lock(&ctrl->mutex);
+    if (ctrl->fps != 0 && ctrl->fps != fps)
+    {
+        ctrl->param.switch_frame_cnt = gain_ctrl_rescale(ctrl->param.switch_frame_cnt, ctrl->fps, fps);
+        ctrl->param.settle_frame_cnt = gain_ctrl_rescale(ctrl->param.settle_frame_cnt, ctrl->fps, fps);
+        ctrl->settle_left = gain_ctrl_rescale(ctrl->settle_left, ctrl->fps, fps);
+        ctrl->low_cnt = gain_ctrl_rescale(ctrl->low_cnt, ctrl->fps, fps);
+        ctrl->high_cnt = gain_ctrl_rescale(ctrl->high_cnt, ctrl->fps, fps);
+    }
+    ctrl->fps = fps;
+    pthread_mutex_unlock(&ctrl->mutex);
+}
+
+void gain_ctrl_release(GainCtrl_t* ctrl)
+{
+    if (ctrl == NULL)
+    {
+        return;
+    }
+    //cmdq_release completes what never ran, the done callbacks always come
+    pthread_mutex_lock(&ctrl->mutex);
+    while (ctrl->pending || ctrl->query_pending)
+    {
+        pthread_cond_wait(&ctrl->cond, &ctrl->mutex);
+    }
+    pthread_mutex_unlock(&ctrl->mutex);
+    pthread_mutex_destroy(&ctrl->mutex);
+    pthread_cond_destroy(&ctrl->cond);
+}
+
+uint32_t gain_ctrl_frame(GainCtrl_t* ctrl, const FrameStats_t* temp_stats)
+{
+    if (ctrl == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&ctrl->mutex);
+    if (ctrl->pending || ctrl->settle_left > 0)
+    {
+        //the sensor reloads, the temperatures of these frames are not valid for either gain
+        if (!ctrl->pending)
+        {
+            ctrl->settle_left--;
+        }
+        ctrl->stats.transition_frames++;
+        pthread_mutex_unlock(&ctrl->mutex);
+        return FRAME_DESC_GAIN_TRANSITION;
+    }
+    if (temp_stats == NULL || !temp_stats->valid)
+    {
+        pthread_mutex_unlock(&ctrl->mutex);
+        return 0;
+    }
+
+    float above = frame_stats_share_above(temp_stats, ctrl->param.above_temp);
+    float below = 1.0f - frame_stats_share_above(temp_stats, ctrl->param.below_temp);
+    if (above > ctrl->param.above_pixel_prop)
+    {
+        ctrl->low_cnt++;
+        ctrl->high_cnt = 0;
+    }
+    else if (below > ctrl->param.below_pixel_prop)
+    {
+        ctrl->high_cnt++;
+        ctrl->low_cnt = 0;
+    }
+    else
+    {
+        ctrl->low_cnt = 0;
+        ctrl->high_cnt = 0;
+    }
+
+    int target = GAIN_CTRL_UNKNOWN;
+    if (ctrl->low_cnt > ctrl->param.switch_frame_cnt)
+    {
+        target = GAIN_CTRL_LOW;
+    }
+    else if (ctrl->high_cnt > ctrl->param.switch_frame_cnt)
+    {
+        target = GAIN_CTRL_HIGH;
+    }
+    if (target == GAIN_CTRL_UNKNOWN)
+    {
+        pthread_mutex_unlock(&ctrl->mutex);
+        return 0;
+    }
+    ctrl->low_cnt = 0;
+    ctrl->high_cnt = 0;
+    if (target == ctrl->gain)
+    {
+        pthread_mutex_unlock(&ctrl->mutex);
+        return 0;
+    }
+
+    ctrl->target = target;
+    ctrl->pending = 1;
+    ctrl->stats.transition_frames++;
+    pthread_mutex_unlock(&ctrl->mutex);
+    //the done callback may run before cmdq_submit returns, it takes the mutex itself
+    if (cmdq_submit(gain_ctrl_set, ctrl, CMDQ_PRIORITY_CRITICAL, 0, gain_ctrl_set_done, ctrl, NULL) != CMDQ_SUCCESS)
+    {
+        pthread_mutex_lock(&ctrl->mutex);
+        ctrl->pending = 0;
+        ctrl->stats.failures++;
+        ctrl->stats.transition_frames--;
+        pthread_mutex_unlock(&ctrl->mutex);
+        return 0;
+    }
+    return FRAME_DESC_GAIN_TRANSITION;
+}
+
+int gain_ctrl_gain(GainCtrl_t* ctrl)
+{
+    if (ctrl == NULL)
+    {
+        return GAIN_CTRL_UNKNOWN;
+    }
+    pthread_mutex_lock(&ctrl->mutex);
+    int gain = ctrl->gain;
+    pthread_mutex_unlock(&ctrl->mutex);
+    return gain;
+}
+
+int gain_ctrl_stats(GainCtrl_t* ctrl, GainCtrlStats_t* stats)
+{
+    if (ctrl == NULL || stats == NULL)
+    {
+        return GAIN_CTRL_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&ctrl->mutex);
+    *stats = ctrl->stats;
+    pthread_mutex_unlock(&ctrl->mutex);
+    return GAIN_CTRL_SUCCESS;
+}
@@ -0,0 +1,68 @@
+#ifndef _GAIN_H_
+#define _GAIN_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "stats.h"
+
+#define GAIN_CTRL_HIGH 1                //TPD_PROP_GAIN_SEL values
+#define GAIN_CTRL_LOW 0
+#define GAIN_CTRL_UNKNOWN -1
+
+#define GAIN_CTRL_SUCCESS 0
+#define GAIN_CTRL_ERROR_PARAM -1
+
+//switch thresholds on the temp plane, temperatures in the temp plane's 1/64 K units
+typedef struct {
+    float above_pixel_prop;             //high -> low: more than this share of the pixels above above_temp
+    uint16_t above_temp;
+    float below_pixel_prop;             //low -> high: more than this share of the pixels below below_temp
+    uint16_t below_temp;
+    uint32_t switch_frame_cnt;          //frames in a row that have to ask for the same switch
+    uint32_t settle_frame_cnt;          //frames after the command for the sensor to reload
+}GainCtrlParam_t;
+
+typedef struct {
+    uint64_t switches;                  //gain commands that succeeded
+    uint64_t failures;
+    uint64_t transition_frames;         //frames tagged FRAME_DESC_GAIN_TRANSITION
+}GainCtrlStats_t;
+
+//auto gain switch of one stream: decides from the temp histogram the stream thread computes anyway and sends
+//TPD_PROP_GAIN_SEL through the command queue, so the stream thread never waits for the device. from the
+//submit until settle_frame_cnt frames after the command ran the frames are tagged as gain transition
+typedef struct GainCtrl_t {
+    GainCtrlParam_t param;
+    uint32_t fps;                       //the frame counts of param are at this rate
+    int gain;                           //GAIN_CTRL_xxx, what the device runs at as far as known
+    int target;                         //the gain the queued command sets
+    uint32_t low_cnt;                   //frames in a row asking for low gain
+    uint32_t high_cnt;
+    uint8_t pending;                    //command queued or running
+    uint8_t query_pending;
+    uint32_t settle_left;               //transition frames still to tag once the command ran
+    GainCtrlStats_t stats;
+    struct TempCalibCtx_t* calib;       //temperature.h, the context the switch selects the gain's tables in, NULL the default
+    pthread_mutex_t mutex;              //the cmdq worker completes the command
+    pthread_cond_t cond;
+}GainCtrl_t;
+
+//param NULL takes the defaults of auto_gain_switch: 10% above 130C switches to low, 95% below 110C back to high,
+//5 s of frames to decide and 7 s to settle. the current gain is queried through the command queue
+int gain_ctrl_init(GainCtrl_t* ctrl, const GainCtrlParam_t* param, uint32_t fps);
+
+//the stream's rate changed, the frame counts are rescaled to keep their time
+void gain_ctrl_fps_set(GainCtrl_t* ctrl, uint32_t fps);
+
+//wait for a queued command and release the controller
+void gain_ctrl_release(GainCtrl_t* ctrl);
+
+//one frame from the stream thread, returns the FRAME_DESC_xxx flags for the frame
+uint32_t gain_ctrl_frame(GainCtrl_t* ctrl, const FrameStats_t* temp_stats);
+
+//GAIN_CTRL_xxx the device runs at as far as the controller knows
+int gain_ctrl_gain(GainCtrl_t* ctrl);
+
+int gain_ctrl_stats(GainCtrl_t* ctrl, GainCtrlStats_t* stats);
+
+#endif
@@ -0,0 +1,505 @@
+#include "gpu.h"
+#include "display.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+
+static GpuStats_t gpu_stat = { 0 };
+
+#ifdef OPENCV_ENABLE
+#include <opencv2/core/ocl.hpp>
+
+//one work item per output pixel: gather through the transform mapping, enhance, palette lookup
+//MAP_* and LUT_MAX come from the build options, the offsets are the colorize plan's
+static const char* gpu_program_source =
+	"inline uint gpu_offset(uint s, int shift, int map, uint lo, uint hi, __global const ushort* agc_lut,\n"
+	"	__global int* hist, int build_hist)\n"
+	"{\n"
+	"	uint v = s >> shift;\n"
+	"	if (map == MAP_STRETCH)\n"
+	"	{\n"
+	"		v = clamp(v, lo, hi);\n"
+	"		return ((v - lo) * (uint)LUT_MAX / (hi - lo)) * 3u;\n"
+	"	}\n"
+	"	v = min(v, (uint)LUT_MAX);\n"
+	"	if (map == MAP_HIST_AGC)\n"
+	"	{\n"
+	"		if (build_hist) atomic_inc(hist + v);\n"
+	"		return agc_lut[v] * 3u;\n"
+	"	}\n"
+	"	return v * 3u;\n"
+	"}\n"
+	"__kernel void gpu_colorize_bgr(__global const ushort* src, int shift, int map, uint lo, uint hi,\n"
+	"	__global const uchar* lut, __global const ushort* agc_lut, __global int* hist, int build_hist,\n"
+	"	int base, int step_x, int step_y, __global uchar* dst, int out_width, int out_height)\n"
+	"{\n"
+	"	int x = get_global_id(0);\n"
+	"	int y = get_global_id(1);\n"
+	"	if (x >= out_width || y >= out_height) return;\n"
+	"	uint off = gpu_offset(src[base + x * step_x + y * step_y], shift, map, lo, hi, agc_lut, hist, build_hist);\n"
+	"	__global uchar* d = dst + (y * out_width + x) * 3;\n"
+	"	d[0] = lut[off];\n"
+	"	d[1] = lut[off + 1];\n"
+	"	d[2] = lut[off + 2];\n"
+	"}\n"
+	"__kernel void gpu_colorize_nv12(__global const ushort* src, int src_width, int shift, int map, uint lo, uint hi,\n"
+	"	__global const uchar* lut, __global const ushort* agc_lut, __global uchar* dst, int width, int height)\n"
+	"{\n"
+	"	int x = get_global_id(0) * 2;\n"
+	"	int y = get_global_id(1) * 2;\n"
+	"	if (x >= width || y >= height) return;\n"
+	"	__global const ushort* s0 = src + y * src_width + x;\n"
+	"	__global const ushort* s1 = s0 + src_width;\n"
+	"	__global const uchar* c00 = lut + gpu_offset(s0[0], shift, map, lo, hi, agc_lut, 0, 0);\n"
+	"	__global const uchar* c01 = lut + gpu_offset(s0[1], shift, map, lo, hi, agc_lut, 0, 0);\n"
+	"	__global const uchar* c10 = lut + gpu_offset(s1[0], shift, map, lo, hi, agc_lut, 0, 0);\n"
+	"	__global const uchar* c11 = lut + gpu_offset(s1[1], shift, map, lo, hi, agc_lut, 0, 0);\n"
+	"	__global uchar* luma = dst + y * width + x;\n"
+	"	luma[0] = c00[0];\n"
+	"	luma[1] = c01[0];\n"
+	"	luma[width] = c10[0];\n"
+	"	luma[width + 1] = c11[0];\n"
+	"	__global uchar* chroma = dst + width * height + (y / 2) * width + x;\n"
+	"	chroma[0] = (uchar)((c00[1] + c01[1] + c10[1] + c11[1] + 2) >> 2);\n"
+	"	chroma[1] = (uchar)((c00[2] + c01[2] + c10[2] + c11[2] + 2) >> 2);\n"
+	"}\n";
+
+typedef struct {
+	uint8_t inited;
+	uint8_t available;
+	char device_name[128];
+	cv::ocl::Kernel bgr_kernel;
+	cv::ocl::Kernel nv12_kernel;
+	uint16_t* staging;                  //page aligned copy of the source frame, opencl can use it in place
+	size_t staging_size;
+	const uint8_t* lut_src;             //palette lut in gpu_lut, uploaded again when the palette changes
+	const uint8_t* yuv_lut_src;
+	cv::UMat lut;
+	cv::UMat yuv_lut;
+	cv::UMat agc_lut;
+	cv::UMat hist;
+	cv::UMat dst;
+	cv::Mat hist_host;
+	uint8_t* cpu_scratch;               //cpu reference of gpu_verify_bgr before its transform
+	int cpu_scratch_pix;
+}Gpu_t;
+
+static Gpu_t gpu;
+static pthread_mutex_t gpu_mutex = PTHREAD_MUTEX_INITIALIZER;   //display and encoder share the device buffers
+
+static int gpu_init_locked(void)
+{
+	if (gpu.inited)
+	{
+		return gpu.available ? GPU_SUCCESS : GPU_ERROR_UNAVAILABLE;
+	}
+	gpu.inited = 1;
+	gpu.available = 0;
+	if (!cv::ocl::haveOpenCL())
+	{
+		printf("gpu: no opencl runtime\n");
+		return GPU_ERROR_UNAVAILABLE;
+	}
+	cv::ocl::setUseOpenCL(true);
+	const cv::ocl::Device& device = cv::ocl::Device::getDefault();
+	if (!device.available())
+	{
+		printf("gpu: no opencl device\n");
+		return GPU_ERROR_UNAVAILABLE;
+	}
+	snprintf(gpu.device_name, sizeof(gpu.device_name), "%s", device.name().c_str());
+
+	char options[128];
+	snprintf(options, sizeof(options), "-D MAP_STRETCH=%d -D MAP_HIST_AGC=%d -D LUT_MAX=%d", \
+		COLORIZE_MAP_STRETCH, COLORIZE_MAP_HIST_AGC, COLOR_LUT_SIZE - 1);
+	cv::ocl::ProgramSource source(gpu_program_source);
+	cv::String errmsg;
+	if (!gpu.bgr_kernel.create("gpu_colorize_bgr", source, options, &errmsg) || \
+		!gpu.nv12_kernel.create("gpu_colorize_nv12", source, options, &errmsg))
+	{
+		printf("gpu: program build failed: %s\n", errmsg.c_str());
+		return GPU_ERROR_KERNEL;
+	}
+	gpu.hist.create(1, COLOR_LUT_SIZE, CV_32SC1);
+	gpu.available = 1;
+	printf("gpu: opencl device %s\n", gpu.device_name);
+	return GPU_SUCCESS;
+}
+
+int gpu_available(void)
+{
+	return gpu.available;
+}
+
+const char* gpu_device_name(void)
+{
+	return gpu.available ? gpu.device_name : "";
+}
+
+//copy the frame into the aligned staging buffer, the only host to device copy of the frame
+static int gpu_stage(const uint16_t* src_frame, int pix_num)
+{
+	size_t size = ((size_t)pix_num * sizeof(uint16_t) + 4095) & ~(size_t)4095;
+	if (size > gpu.staging_size)
+	{
+#if defined(_WIN32)
+		_aligned_free(gpu.staging);
+		gpu.staging = (uint16_t*)_aligned_malloc(size, 4096);
+#else
+		free(gpu.staging);
+		gpu.staging = NULL;
+		void* ptr = NULL;
+		if (posix_memalign(&ptr, 4096, size) == 0)
+		{
+			gpu.staging = (uint16_t*)ptr;
+		}
+#endif
+		gpu.staging_size = (gpu.staging != NULL) ? size : 0;
+		if (gpu.staging == NULL)
+		{
+			return GPU_ERROR_PARAM;
+		}
+	}
+	memcpy(gpu.staging, src_frame, (size_t)pix_num * sizeof(uint16_t));
+	return GPU_SUCCESS;
+}
+
+//palette luts change only with the palette, the agc mapping every frame
+static void gpu_upload_tables(const ColorizePlan_t* plan, int yuv)
+{
+	const uint8_t* lut = yuv ? plan->yuv_lut : plan->lut;
+	const uint8_t** cached = yuv ? &gpu.yuv_lut_src : &gpu.lut_src;
+	cv::UMat* dst = yuv ? &gpu.yuv_lut : &gpu.lut;
+	if (*cached != lut)
+	{
+		cv::Mat(1, COLOR_LUT_SIZE * 3, CV_8UC1, (void*)lut).copyTo(*dst);
+		*cached = lut;
+	}
+	if (plan->map == COLORIZE_MAP_HIST_AGC)
+	{
+		cv::Mat(1, COLOR_LUT_SIZE, CV_16UC1, (void*)plan->agc_lut).copyTo(gpu.agc_lut);
+	}
+	else if (gpu.agc_lut.empty())
+	{
+		gpu.agc_lut.create(1, COLOR_LUT_SIZE, CV_16UC1);
+	}
+}
+
+//the plan is prepared by the caller, build_hist adds this frame's histogram to the display agc
+static int gpu_run_bgr(const ColorizePlan_t* plan, FrameInfo_t* frameinfo, int build_hist, uint8_t* dst_frame)
+{
+	int pix_num = frameinfo->width * frameinfo->height;
+	TransformMap_t map;
+	frame_transform_map_get(frameinfo->width, frameinfo->height, frameinfo->rotate_side, \
+		frameinfo->mirror_flip_status, &map);
+	gpu_upload_tables(plan, 0);
+	build_hist = build_hist && (plan->map == COLORIZE_MAP_HIST_AGC);
+	if (build_hist)
+	{
+		gpu.hist.setTo(cv::Scalar(0));
+	}
+	gpu.dst.create(map.out_height, map.out_width * 3, CV_8UC1, cv::USAGE_ALLOCATE_HOST_MEMORY);
+
+	cv::Mat src_mat(frameinfo->height, frameinfo->width, CV_16UC1, gpu.staging);
+	cv::UMat src = src_mat.getUMat(cv::ACCESS_READ);
+	int i = 0;
+	i = gpu.bgr_kernel.set(i, cv::ocl::KernelArg::PtrReadOnly(src));
+	i = gpu.bgr_kernel.set(i, plan->shift);
+	i = gpu.bgr_kernel.set(i, (int)plan->map);
+	i = gpu.bgr_kernel.set(i, (uint32_t)plan->lo);
+	i = gpu.bgr_kernel.set(i, (uint32_t)plan->hi);
+	i = gpu.bgr_kernel.set(i, cv::ocl::KernelArg::PtrReadOnly(gpu.lut));
+	i = gpu.bgr_kernel.set(i, cv::ocl::KernelArg::PtrReadOnly(gpu.agc_lut));
+	i = gpu.bgr_kernel.set(i, cv::ocl::KernelArg::PtrReadWrite(gpu.hist));
+	i = gpu.bgr_kernel.set(i, build_hist);
+	i = gpu.bgr_kernel.set(i, (int)map.base);
+	i = gpu.bgr_kernel.set(i, (int)map.step_x);
+	i = gpu.bgr_kernel.set(i, (int)map.step_y);
+	i = gpu.bgr_kernel.set(i, cv::ocl::KernelArg::PtrWriteOnly(gpu.dst));
+	i = gpu.bgr_kernel.set(i, map.out_width);
+	i = gpu.bgr_kernel.set(i, map.out_height);
+	size_t global_size[2] = { (size_t)map.out_width, (size_t)map.out_height };
+	if (i < 0 || !gpu.bgr_kernel.run(2, global_size, NULL, true))
+	{
+		return GPU_ERROR_KERNEL;
+	}
+
+	gpu.dst.copyTo(cv::Mat(map.out_height, map.out_width * 3, CV_8UC1, dst_frame));
+	if (build_hist)
+	{
+		gpu.hist.copyTo(gpu.hist_host);
+		uint32_t* hist = get_display_hist_agc()->hist;
+		const int32_t* counts = gpu.hist_host.ptr<int32_t>();
+		for (int v = 0; v < COLOR_LUT_SIZE; v++)
+		{
+			hist[v] += (uint32_t)counts[v];
+		}
+	}
+	frameinfo->byte_size = pix_num * 3;
+	return GPU_SUCCESS;
+}
+
+static int gpu_prepare(const uint16_t* src_frame, FrameInfo_t* frameinfo, irproc_color_mode_t color_mode, \
+	const FrameStats_t* src_stats, ColorizePlan_t* plan)
+{
+	if (src_frame == NULL || frameinfo == NULL || (frameinfo->input_format != INPUT_FMT_Y14 && \
+		frameinfo->input_format != INPUT_FMT_Y16))
+	{
+		return GPU_ERROR_PARAM;
+	}
+	if (!gpu.available)
+	{
+		return GPU_ERROR_UNAVAILABLE;
+	}
+	int pix_num = frameinfo->width * frameinfo->height;
+	if (gpu_stage(src_frame, pix_num) != GPU_SUCCESS)
+	{
+		return GPU_ERROR_PARAM;
+	}
+	//the agc prepare may scan the source, the staged copy serves it
+	if (colorize_plan_prepare(plan, gpu.staging, pix_num, frameinfo, color_mode, src_stats) != COLORIZE_SUCCESS)
+	{
+		return GPU_ERROR_FORMAT;
+	}
+	return GPU_SUCCESS;
+}
+
+static int gpu_colorize_bgr_locked(const uint16_t* src_frame, FrameInfo_t* frameinfo, irproc_color_mode_t color_mode, \
+	const FrameStats_t* src_stats, uint8_t* dst_frame)
+{
+	if (dst_frame == NULL)
+	{
+		return GPU_ERROR_PARAM;
+	}
+	//the plan holds a 32KB stretch table, kept off the stack
+	static ColorizePlan_t plan;
+	int ret = gpu_prepare(src_frame, frameinfo, color_mode, src_stats, &plan);
+	if (ret == GPU_SUCCESS)
+	{
+		ret = gpu_run_bgr(&plan, frameinfo, 1, dst_frame);
+		if (ret == GPU_SUCCESS)
+		{
+			colorize_plan_commit(&plan, frameinfo->width * frameinfo->height);
+		}
+	}
+	if (ret == GPU_SUCCESS)
+	{
+		gpu_stat.frames++;
+	}
+	else
+	{
+		gpu_stat.fallbacks++;
+	}
+	return ret;
+}
+
+static int gpu_colorize_nv12_locked(const uint16_t* src_frame, FrameInfo_t* frameinfo, irproc_color_mode_t color_mode, \
+	const FrameStats_t* src_stats, int width, int height, uint8_t* dst_frame)
+{
+	if (dst_frame == NULL || frameinfo == NULL || width <= 0 || height <= 0 || (width | height) & 1 || \
+		width > frameinfo->width || height > frameinfo->height)
+	{
+		return GPU_ERROR_PARAM;
+	}
+	static ColorizePlan_t plan;
+	int ret = gpu_prepare(src_frame, frameinfo, color_mode, src_stats, &plan);
+	if (ret != GPU_SUCCESS)
+	{
+		gpu_stat.fallbacks++;
+		return ret;
+	}
+	gpu_upload_tables(&plan, 1);
+	gpu.dst.create(height * 3 / 2, width, CV_8UC1, cv::USAGE_ALLOCATE_HOST_MEMORY);
+
+	cv::Mat src_mat(frameinfo->height, frameinfo->width, CV_16UC1, gpu.staging);
+	cv::UMat src = src_mat.getUMat(cv::ACCESS_READ);
+	int i = 0;
+	i = gpu.nv12_kernel.set(i, cv::ocl::KernelArg::PtrReadOnly(src));
+	i = gpu.nv12_kernel.set(i, (int)frameinfo->width);
+	i = gpu.nv12_kernel.set(i, plan.shift);
+	i = gpu.nv12_kernel.set(i, (int)plan.map);
+	i = gpu.nv12_kernel.set(i, (uint32_t)plan.lo);
+	i = gpu.nv12_kernel.set(i, (uint32_t)plan.hi);
+	i = gpu.nv12_kernel.set(i, cv::ocl::KernelArg::PtrReadOnly(gpu.yuv_lut));
+	i = gpu.nv12_kernel.set(i, cv::ocl::KernelArg::PtrReadOnly(gpu.agc_lut));
+	i = gpu.nv12_kernel.set(i, cv::ocl::KernelArg::PtrWriteOnly(gpu.dst));
+	i = gpu.nv12_kernel.set(i, width);
+	i = gpu.nv12_kernel.set(i, height);
+	size_t global_size[2] = { (size_t)width / 2, (size_t)height / 2 };
+	if (i < 0 || !gpu.nv12_kernel.run(2, global_size, NULL, true))
+	{
+		gpu_stat.fallbacks++;
+		return GPU_ERROR_KERNEL;
+	}
+	gpu.dst.copyTo(cv::Mat(height * 3 / 2, width, CV_8UC1, dst_frame));
+	gpu_stat.frames++;
+	return GPU_SUCCESS;
+}
+
+static int gpu_verify_bgr_locked(const uint16_t* src_frame, FrameInfo_t* frameinfo, irproc_color_mode_t color_mode, \
+	const FrameStats_t* src_stats, uint8_t* cpu_frame, uint8_t* gpu_frame)
+{
+	if (cpu_frame == NULL || gpu_frame == NULL)
+	{
+		return GPU_ERROR_PARAM;
+	}
+	static ColorizePlan_t plan;
+	int ret = gpu_prepare(src_frame, frameinfo, color_mode, src_stats, &plan);
+	if (ret != GPU_SUCCESS)
+	{
+		return ret;
+	}
+	int pix_num = frameinfo->width * frameinfo->height;
+	if (gpu.cpu_scratch_pix < pix_num)
+	{
+		free(gpu.cpu_scratch);
+		gpu.cpu_scratch = (uint8_t*)malloc((size_t)pix_num * 3);
+		gpu.cpu_scratch_pix = (gpu.cpu_scratch != NULL) ? pix_num : 0;
+		if (gpu.cpu_scratch == NULL)
+		{
+			return GPU_ERROR_PARAM;
+		}
+	}
+
+	//one plan for both, only the cpu pass builds the agc histogram
+	ret = gpu_run_bgr(&plan, frameinfo, 0, gpu_frame);
+	colorize_plan_apply(&plan, gpu.staging, 0, pix_num, gpu.cpu_scratch, NULL);
+	colorize_plan_commit(&plan, pix_num);
+	FrameInfo_t info = *frameinfo;
+	info.output_format = OUTPUT_FMT_BGR888;
+	frame_transform(gpu.cpu_scratch, &info, frameinfo->rotate_side, frameinfo->mirror_flip_status, cpu_frame);
+	if (ret != GPU_SUCCESS)
+	{
+		return ret;
+	}
+	gpu_stat.verified++;
+	if (memcmp(cpu_frame, gpu_frame, (size_t)pix_num * 3) != 0)
+	{
+		gpu_stat.mismatches++;
+		return GPU_ERROR_KERNEL;
+	}
+	return GPU_SUCCESS;
+}
+
+static void gpu_release_locked(void)
+{
+	gpu.bgr_kernel = cv::ocl::Kernel();
+	gpu.nv12_kernel = cv::ocl::Kernel();
+	gpu.lut.release();
+	gpu.yuv_lut.release();
+	gpu.agc_lut.release();
+	gpu.hist.release();
+	gpu.dst.release();
+	gpu.hist_host.release();
+	gpu.lut_src = NULL;
+	gpu.yuv_lut_src = NULL;
+#if defined(_WIN32)
+	_aligned_free(gpu.staging);
+#else
+	free(gpu.staging);
+#endif
+	gpu.staging = NULL;
+	gpu.staging_size = 0;
+	free(gpu.cpu_scratch);
+	gpu.cpu_scratch = NULL;
+	gpu.cpu_scratch_pix = 0;
+	gpu.inited = 0;
+	gpu.available = 0;
+}
+
+int gpu_init(void)
+{
+	pthread_mutex_lock(&gpu_mutex);
+	int ret = gpu_init_locked();
+	pthread_mutex_unlock(&gpu_mutex);
+	return ret;
+}
+
+int gpu_colorize_bgr(const uint16_t* src_frame, FrameInfo_t* frameinfo, irproc_color_mode_t color_mode, \
+	const FrameStats_t* src_stats, uint8_t* dst_frame)
+{
+	pthread_mutex_lock(&gpu_mutex);
+	int ret = gpu_colorize_bgr_locked(src_frame, frameinfo, color_mode, src_stats, dst_frame);
+	pthread_mutex_unlock(&gpu_mutex);
+	return ret;
+}
+
+int gpu_colorize_nv12(const uint16_t* src_frame, FrameInfo_t* frameinfo, irproc_color_mode_t color_mode, \
+	const FrameStats_t* src_stats, int width, int height, uint8_t* dst_frame)
+{
+	pthread_mutex_lock(&gpu_mutex);
+	int ret = gpu_colorize_nv12_locked(src_frame, frameinfo, color_mode, src_stats, width, height, dst_frame);
+	pthread_mutex_unlock(&gpu_mutex);
+	return ret;
+}
+
+int gpu_verify_bgr(const uint16_t* src_frame, FrameInfo_t* frameinfo, irproc_color_mode_t color_mode, \
+	const FrameStats_t* src_stats, uint8_t* cpu_frame, uint8_t* gpu_frame)
+{
+	pthread_mutex_lock(&gpu_mutex);
+	int ret = gpu_verify_bgr_locked(src_frame, frameinfo, color_mode, src_stats, cpu_frame, gpu_frame);
+	pthread_mutex_unlock(&gpu_mutex);
+	return ret;
+}
+
+void gpu_release(void)
+{
+	pthread_mutex_lock(&gpu_mutex);
+	gpu_release_locked();
+	pthread_mutex_unlock(&gpu_mutex);
+}
+
+#else
+
+//headless builds have no opencv, every call hands the frame back to the cpu path
+int gpu_init(void)
+{
+	return GPU_ERROR_UNAVAILABLE;
+}
+
+int gpu_available(void)
+{
+	return 0;
+}
+
+const char* gpu_device_name(void)
+{
+	return "";
+}
+
+int gpu_colorize_bgr(const uint16_t* src_frame, FrameInfo_t* frameinfo, irproc_color_mode_t color_mode, \
+	const FrameStats_t* src_stats, uint8_t* dst_frame)
+{
+	gpu_stat.fallbacks++;
+	return GPU_ERROR_UNAVAILABLE;
+}
+
+int gpu_colorize_nv12(const uint16_t* src_frame, FrameInfo_t* frameinfo, irproc_color_mode_t color_mode, \
+	const FrameStats_t* src_stats, int width, int height, uint8_t* dst_frame)
+{
+	gpu_stat.fallbacks++;
+	return GPU_ERROR_UNAVAILABLE;
+}
+
+int gpu_verify_bgr(const uint16_t* src_frame, FrameInfo_t* frameinfo, irproc_color_mode_t color_mode, \
+	const FrameStats_t* src_stats, uint8_t* cpu_frame, uint8_t* gpu_frame)
+{
+	return GPU_ERROR_UNAVAILABLE;
+}
+
+void gpu_release(void)
+{
+}
+
+#endif
+
+int gpu_stats(GpuStats_t* stats)
+{
+	if (stats == NULL)
+	{
+		return GPU_ERROR_PARAM;
+	}
+	*stats = gpu_stat;
+	return GPU_SUCCESS;
+}
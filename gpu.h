@@ -0,0 +1,49 @@
+#ifndef _GPU_H_
+#define _GPU_H_
+
+#include <stdint.h>
+#include "data.h"
+#include "libirprocess.h"
+
+#define GPU_SUCCESS 0
+#define GPU_ERROR_PARAM -1
+#define GPU_ERROR_UNAVAILABLE -2        //built without OPENCV_ENABLE, or no OpenCL device
+#define GPU_ERROR_KERNEL -3             //program build or kernel launch failed
+#define GPU_ERROR_FORMAT -4             //a format or enhance mode the gpu path does not take, use the cpu path
+
+typedef struct {
+    uint64_t frames;
+    uint64_t fallbacks;                 //frames handed back to the cpu path
+    uint64_t verified;
+    uint64_t mismatches;                //verified frames that differ from the cpu path
+}GpuStats_t;
+
+//OpenCL through the opencv T-API (cv::ocl), the program is built once, returns GPU_ERROR_UNAVAILABLE without a device
+int gpu_init(void);
+
+int gpu_available(void);
+
+//device name for the logs, "" without a device
+const char* gpu_device_name(void);
+
+//Y14/Y16 -> stretch/hist agc -> palette -> mirror/flip/rotate -> BGR888 in one kernel, the same bytes as
+//colorize_fused_bgr + frame_transform. the frame is uploaded once through a page aligned staging buffer
+//(zero copy on integrated gpus), dst gets the transformed frame and frameinfo->byte_size is set
+int gpu_colorize_bgr(const uint16_t* src_frame, FrameInfo_t* frameinfo, irproc_color_mode_t color_mode, \
+    const FrameStats_t* src_stats, uint8_t* dst_frame);
+
+//Y14/Y16 -> NV12 for the encoder, the same bytes as colorize_plan_apply_nv12 over the even width x height
+//hist agc is only read, not updated, like the cpu encoder path
+int gpu_colorize_nv12(const uint16_t* src_frame, FrameInfo_t* frameinfo, irproc_color_mode_t color_mode, \
+    const FrameStats_t* src_stats, int width, int height, uint8_t* dst_frame);
+
+//run gpu_colorize_bgr and the cpu path on the same frame, GPU_SUCCESS when the bytes match
+//the hist agc state is left as the cpu path leaves it
+int gpu_verify_bgr(const uint16_t* src_frame, FrameInfo_t* frameinfo, irproc_color_mode_t color_mode, \
+    const FrameStats_t* src_stats, uint8_t* cpu_frame, uint8_t* gpu_frame);
+
+int gpu_stats(GpuStats_t* stats);
+
+void gpu_release(void);
+
+#endif
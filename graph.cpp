@@ -0,0 +1,598 @@
+#include "graph.h"
+#include "trace.h"
+#include <string.h>
+#include <stdarg.h>
+
+static const char* graph_thread_names[] = { "pool", "thread", "inline" };
+static const char* graph_policy_names[] = { "block", "drop_oldest", "latest" };
+
+static void graph_deliver(Graph_t* graph, GraphNode_t* node, FrameSlot_t* slot);
+static void graph_node_end(Graph_t* graph, GraphNode_t* node);
+
+const char* graph_port_name(uint32_t port)
+{
+    static const char* names[] = { "raw", "image", "temp", "meta" };
+    static char user[16];
+    for (int i = 0; i < 4; i++)
+    {
+        if (port & (1u << i))
+        {
+            return names[i];
+        }
+    }
+    for (int i = 0; i < 24; i++)
+    {
+        if (port & GRAPH_PORT_USER(i))
+        {
+            snprintf(user, sizeof(user), "user%d", i);
+            return user;
+        }
+    }
+    return "none";
+}
+
+void graph_init(Graph_t* graph)
+{
+    graph->node_num = 0;
+    graph->child_num = 0;
+    graph->stream_frame_info = NULL;
+    graph->ring = NULL;
+    graph->consumer_id = -1;
+    graph->frames = 0;
+    graph->dropped = 0;
+    graph->attached = 0;
+    graph->started = 0;
+    graph->running.store(0);
+    graph->ended_num = 0;
+}
+
+int graph_add(Graph_t* graph, const GraphStage_t* stage)
+{
+    if (graph == NULL || stage == NULL || graph->node_num >= GRAPH_MAX_NODES || graph->attached || \
+        stage->name == NULL || stage->name[0] == '\0' || strlen(stage->name) >= GRAPH_NAME_LEN)
+    {
+        return GRAPH_ERROR_PARAM;
+    }
+    int id = graph->node_num++;
+    GraphNode_t* node = &graph->nodes[id];
+    node->stage = *stage;
+    snprintf(node->name, sizeof(node->name), "%s", stage->name);
+    node->stage.name = node->name;
+    node->id = id;
+    node->ports = 0;
+    node->capacity = 0;
+    node->child_num = 0;
+    node->graph = graph;
+    node->thread_started = 0;
+    node->scheduled.store(0);
+    node->upstream_ended.store(0);
+    node->ended.store(0);
+    node->frames.store(0);
+    node->processed.store(0);
+    node->skipped.store(0);
+    node->dropped.store(0);
+    node->blocked_us.store(0);
+    node->queued_max.store(0);
+    timing_hist_reset(&node->busy);
+    return id;
+}
+
+int graph_find(const Graph_t* graph, const char* name)
+{
+    if (graph == NULL || name == NULL)
+    {
+        return GRAPH_ERROR_PARAM;
+    }
+    for (int i = 0; i < graph->node_num; i++)
+    {
+        if (strcmp(graph->nodes[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return GRAPH_ERROR_PARAM;
+}
+
+static int graph_invalid(char* error, int error_len, const char* format, ...)
+{
+    if (error != NULL && error_len > 0)
+    {
+        va_list args;
+        va_start(args, format);
+        vsnprintf(error, error_len, format, args);
+        va_end(args);
+    }
+    return GRAPH_ERROR_INVALID;
+}
+
+//where a node really runs: an inline node runs wherever its parent does, the ring's frames come on the graph's thread
+static GraphThread_t graph_node_runs_on(const Graph_t* graph, int id)
+{
+    while (id != GRAPH_SOURCE && graph->nodes[id].stage.thread == GRAPH_THREAD_INLINE)
+    {
+        id = graph->nodes[id].stage.parent;
+    }
+    return (id == GRAPH_SOURCE) ? GRAPH_THREAD_OWN : graph->nodes[id].stage.thread;
+}
+
+//the edge's queue: a power of two of at least 2, latest keeps room for the end mark behind its one frame
+static uint32_t graph_edge_capacity(const GraphStage_t* stage)
+{
+    uint32_t depth = (stage->policy == GRAPH_EDGE_LATEST) ? 2 : ((stage->depth > 0) ? stage->depth : \
+        GRAPH_DEFAULT_DEPTH);
+    uint32_t capacity = 2;
+    while (capacity < depth && capacity < QUEUE_MAX_CAPACITY)
+    {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+static void graph_queues_release(Graph_t* graph, int node_num)
+{
+    for (int i = 0; i < node_num; i++)
+    {
+        if (graph->nodes[i].capacity > 0)
+        {
+            mpmc_queue_release(&graph->nodes[i].queue);
+            graph->nodes[i].capacity = 0;
+        }
+    }
+}
+
+int graph_attach(Graph_t* graph, StreamFrameInfo_t* stream_frame_info, char* error, int error_len)
+{
+    if (graph == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL || graph->attached)
+    {
+        return GRAPH_ERROR_PARAM;
+    }
+    FrameRing_t* ring = stream_frame_info->frame_ring;
+    if (graph->node_num == 0)
+    {
+        return graph_invalid(error, error_len, "the graph has no nodes");
+    }
+    uint32_t source_ports = GRAPH_PORT_RAW;
+    source_ports |= (ring->format.image_byte_size > 0) ? GRAPH_PORT_IMAGE : 0;
+    source_ports |= (ring->format.temp_byte_size > 0) ? GRAPH_PORT_TEMP : 0;
+    source_ports |= (ring->format.info_byte_size > 0) ? GRAPH_PORT_META : 0;
+
+    for (int i = 0; i < graph->node_num; i++)
+    {
+        GraphNode_t* node = &graph->nodes[i];
+        const GraphStage_t* stage = &node->stage;
+        for (int j = 0; j < i; j++)
+        {
+            if (strcmp(graph->nodes[j].name, node->name) == 0)
+            {
+                return graph_invalid(error, error_len, "two nodes are called %s", node->name);
+            }
+        }
+        //parents come first, so the graph has no cycle
+        if (stage->parent != GRAPH_SOURCE && (stage->parent < 0 || stage->parent >= i))
+        {
+            return graph_invalid(error, error_len, "%s: parent %d is not an earlier node", node->name, stage->parent);
+        }
+        if (stage->func == NULL)
+        {
+            return graph_invalid(error, error_len, "%s has no stage function", node->name);
+        }
+        if ((unsigned)stage->thread > GRAPH_THREAD_INLINE || (unsigned)stage->policy > GRAPH_EDGE_LATEST || \
+            (stage->thread == GRAPH_THREAD_OWN && (unsigned)stage->role >= RT_ROLE_NUM) || \
+            (stage->thread == GRAPH_THREAD_POOL && (unsigned)stage->stage >= POOL_STAGE_NUM))
+        {
+            return graph_invalid(error, error_len, "%s: unknown thread, policy, role or stage", node->name);
+        }
+        const char* parent_name = (stage->parent == GRAPH_SOURCE) ? "the ring" : graph->nodes[stage->parent].name;
+        uint32_t available = (stage->parent == GRAPH_SOURCE) ? source_ports : graph->nodes[stage->parent].ports;
+        uint32_t missing = stage->inputs & ~available;
+        if (missing != 0)
+        {
+            return graph_invalid(error, error_len, "%s reads %s, %s does not carry it", node->name, \
+                graph_port_name(missing), parent_name);
+        }
+        node->ports = available | stage->outputs;
+        if (stage->thread == GRAPH_THREAD_INLINE)
+        {
+            if (stage->policy != GRAPH_EDGE_BLOCK || stage->depth != 0)
+            {
+                return graph_invalid(error, error_len, "%s runs inline, its edge has no queue for a policy or a depth", \
+                    node->name);
+            }
+            continue;
+        }
+        uint32_t depth = (stage->policy == GRAPH_EDGE_LATEST) ? 1 : graph_edge_capacity(stage);
+        //one edge holding every slot would stop the producer for all the others
+        if (depth > ring->depth - 1)
+        {
+            return graph_invalid(error, error_len, "%s queues %u frames, the ring has %u slots", node->name, depth, \
+                ring->depth);
+        }
+        //a pool task waiting for another pool task can wait for a worker that never comes
+        if (stage->policy == GRAPH_EDGE_BLOCK && stage->thread == GRAPH_THREAD_POOL && \
+            graph_node_runs_on(graph, stage->parent) == GRAPH_THREAD_POOL)
+        {
+            return graph_invalid(error, error_len, "%s blocks a pool worker of %s, give one of them a thread or " \
+                "another policy", node->name, parent_name);
+        }
+    }
+
+    graph->child_num = 0;
+    for (int i = 0; i < graph->node_num; i++)
+    {
+        GraphNode_t* node = &graph->nodes[i];
+        node->child_num = 0;
+        if (node->stage.parent == GRAPH_SOURCE)
+        {
+            graph->children[graph->child_num++] = i;
+        }
+        else
+        {
+            GraphNode_t* parent = &graph->nodes[node->stage.parent];
+            parent->children[parent->child_num++] = i;
+        }
+    }
+    for (int i = 0; i < graph->node_num; i++)
+    {
+        GraphNode_t* node = &graph->nodes[i];
+        if (node->stage.thread == GRAPH_THREAD_INLINE)
+        {
+            continue;
+        }
+        uint32_t capacity = graph_edge_capacity(&node->stage);
+        if (mpmc_queue_init(&node->queue, capacity, sizeof(FrameSlot_t*)) != QUEUE_SUCCESS)
+        {
+            graph_queues_release(graph, i);
+            return GRAPH_ERROR_MEM;
+        }
+        node->capacity = capacity;
+    }
+    graph->consumer_id = ring_consumer_attach(ring, RING_POLICY_NEXT);
+    if (graph->consumer_id < 0)
+    {
+        graph_queues_release(graph, graph->node_num);
+        return graph_invalid(error, error_len, "the ring has no consumer left for the graph");
+    }
+    graph->stream_frame_info = stream_frame_info;
+    graph->ring = ring;
+    graph->frames = 0;
+    graph->dropped = 0;
+    graph->ended_num = 0;
+    sync_mutex_init(&graph->mutex);
+    sync_cond_init(&graph->cond);
+    graph->attached = 1;
+    return GRAPH_SUCCESS;
+}
+
+static void graph_node_run(Graph_t* graph, GraphNode_t* node, FrameSlot_t* slot)
+{
+    uint64_t start_us = get_monotonic_us();
+    int rst = node->stage.func(&slot->desc, node->stage.arg);
+    timing_hist_record(&node->busy, get_monotonic_us() - start_us);
+    node->processed.fetch_add(1, std::memory_order_relaxed);
+    if (rst == GRAPH_SKIP)
+    {
+        node->skipped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    for (int i = 0; i < node->child_num; i++)
+    {
+        graph_deliver(graph, &graph->nodes[node->children[i]], slot);
+    }
+}
+
+//pool node: drain the queue, a node is scheduled at most once so its frames run in order
+static void graph_node_task(void* arg)
+{
+    GraphNode_t* node = (GraphNode_t*)arg;
+    Graph_t* graph = (Graph_t*)node->graph;
+    while (1)
+    {
+        //looked at before the queue: every frame the parent sent before its end is seen by the pops below
+        int ended = node->upstream_ended.load(std::memory_order_acquire);
+        FrameSlot_t* slot = NULL;
+        while (mpmc_queue_pop(&node->queue, &slot) == QUEUE_SUCCESS)
+        {
+            graph_node_run(graph, node, slot);
+            ring_read_release(graph->ring, slot);
+        }
+        if (ended)
+        {
+            graph_node_end(graph, node);
+            return;
+        }
+        node->scheduled.store(0, std::memory_order_seq_cst);
+        if ((mpmc_queue_count(&node->queue) == 0 && !node->upstream_ended.load(std::memory_order_seq_cst)) || \
+            node->scheduled.exchange(1, std::memory_order_acq_rel) != 0)
+        {
+            return;
+        }
+    }
+}
+
+static void graph_node_schedule(GraphNode_t* node)
+{
+    if (node->scheduled.exchange(1, std::memory_order_acq_rel) == 0)
+    {
+        pool_submit(node->stage.stage, graph_node_task, node);
+    }
+}
+
+//hand a frame the caller holds to one child, by the child's edge policy
+static void graph_deliver(Graph_t* graph, GraphNode_t* node, FrameSlot_t* slot)
+{
+    node->frames.fetch_add(1, std::memory_order_relaxed);
+    if (node->stage.thread == GRAPH_THREAD_INLINE)
+    {
+        graph_node_run(graph, node, slot);
+        return;
+    }
+    ring_slot_ref(slot);
+    if (node->stage.policy == GRAPH_EDGE_BLOCK)
+    {
+        if (mpmc_queue_push(&node->queue, &slot) != QUEUE_SUCCESS)
+        {
+            uint64_t start_us = get_monotonic_us();
+            mpmc_queue_push_wait(&node->queue, &slot, -1);
+            node->blocked_us.fetch_add(get_monotonic_us() - start_us, std::memory_order_relaxed);
+        }
+    }
+    else
+    {
+        FrameSlot_t* oldest = NULL;
+        if (node->stage.policy == GRAPH_EDGE_LATEST)
+        {
+            while (mpmc_queue_pop(&node->queue, &oldest) == QUEUE_SUCCESS)
+            {
+                ring_read_release(graph->ring, oldest);
+                node->dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        while (mpmc_queue_push(&node->queue, &slot) != QUEUE_SUCCESS)
+        {
+            if (mpmc_queue_pop(&node->queue, &oldest) == QUEUE_SUCCESS)
+            {
+                ring_read_release(graph->ring, oldest);
+                node->dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    //one producer per edge, the parent
+    uint32_t queued = mpmc_queue_count(&node->queue);
+    if (queued > node->queued_max.load(std::memory_order_relaxed))
+    {
+        node->queued_max.store(queued, std::memory_order_relaxed);
+    }
+    if (node->stage.thread == GRAPH_THREAD_POOL)
+    {
+        graph_node_schedule(node);
+    }
+}
+
+//the parent sent its last frame: a thread gets a NULL mark behind the frames, a pool node a flag
+static void graph_end_child(Graph_t* graph, GraphNode_t* node)
+{
+    if (node->stage.thread == GRAPH_THREAD_INLINE || (node->stage.thread == GRAPH_THREAD_OWN && !node->thread_started))
+    {
+        graph_node_end(graph, node);
+    }
+    else if (node->stage.thread == GRAPH_THREAD_OWN)
+    {
+        FrameSlot_t* end = NULL;
+        mpmc_queue_push_wait(&node->queue, &end, -1);
+    }
+    else
+    {
+        node->upstream_ended.store(1, std::memory_order_release);
+        graph_node_schedule(node);
+    }
+}
+
+static void graph_node_end(Graph_t* graph, GraphNode_t* node)
+{
+    for (int i = 0; i < node->child_num; i++)
+    {
+        graph_end_child(graph, &graph->nodes[node->children[i]]);
+    }
+    node->ended.store(1, std::memory_order_release);
+    sync_mutex_lock(&graph->mutex);
+    graph->ended_num++;
+    sync_cond_broadcast(&graph->cond);
+    sync_mutex_unlock(&graph->mutex);
+}
+
+//the end runs down the graph behind the last frames, every slot reference is gone once all nodes ended
+static void graph_drain(Graph_t* graph)
+{
+    for (int i = 0; i < graph->child_num; i++)
+    {
+        graph_end_child(graph, &graph->nodes[graph->children[i]]);
+    }
+    sync_mutex_lock(&graph->mutex);
+    while (graph->ended_num < graph->node_num)
+    {
+        sync_cond_wait(&graph->cond, &graph->mutex);
+    }
+    sync_mutex_unlock(&graph->mutex);
+}
+
+static void* graph_node_function(void* threadarg)
+{
+    GraphNode_t* node = (GraphNode_t*)threadarg;
+    Graph_t* graph = (Graph_t*)node->graph;
+    TRACE_THREAD_NAME(node->name);
+    rt_thread_enter(node->stage.role, graph->stream_frame_info->camera_index, node->name);
+    while (1)
+    {
+        FrameSlot_t* slot = NULL;
+        if (mpmc_queue_pop_wait(&node->queue, &slot, -1) != QUEUE_SUCCESS)
+        {
+            continue;
+        }
+        if (slot == NULL)
+        {
+            break;
+        }
+        graph_node_run(graph, node, slot);
+        ring_read_release(graph->ring, slot);
+    }
+    graph_node_end(graph, node);
+    rt_thread_leave();
+    return NULL;
+}
+
+//takes every frame of the ring and feeds the root edges, on RING_CLOSED or graph_stop it drains the graph
+static void* graph_function(void* threadarg)
+{
+    Graph_t* graph = (Graph_t*)threadarg;
+    FrameRing_t* ring = graph->ring;
+    int camera_index = graph->stream_frame_info->camera_index;
+    char rt_name[RT_NAME_LEN];
+    snprintf(rt_name, sizeof(rt_name), "graph%d", camera_index);
+    TRACE_THREAD_NAME(rt_name);
+    rt_thread_enter(RT_ROLE_ANALYTICS, camera_index, rt_name);
+    while (graph->running.load(std::memory_order_acquire))
+    {
+        FrameSlot_t* slot = NULL;
+        int rst = ring_read_acquire(ring, graph->consumer_id, ring_frame_timeout_ms(ring, \
+            graph->stream_frame_info->camera_param.timeout_ms_delay), &slot);
+        if (rst == RING_CLOSED)
+        {
+            break;
+        }
+        if (rst != RING_SUCCESS)
+        {
+            continue;
+        }
+        for (int i = 0; i < graph->child_num; i++)
+        {
+            graph_deliver(graph, &graph->nodes[graph->children[i]], slot);
+        }
+        ring_read_release(ring, slot);
+    }
+    graph_drain(graph);
+    ring_consumer_stats(ring, graph->consumer_id, &graph->frames, &graph->dropped);
+    ring_consumer_detach(ring, graph->consumer_id);
+    rt_thread_leave();
+    return NULL;
+}
+
+int graph_start(Graph_t* graph)
+{
+    if (graph == NULL || !graph->attached || graph->started)
+    {
+        return GRAPH_ERROR_PARAM;
+    }
+    graph->running.store(1, std::memory_order_release);
+    int rst = GRAPH_SUCCESS;
+    for (int i = 0; i < graph->node_num && rst == GRAPH_SUCCESS; i++)
+    {
+        GraphNode_t* node = &graph->nodes[i];
+        if (node->stage.thread != GRAPH_THREAD_OWN)
+        {
+            continue;
+        }
+        if (pthread_create(&node->thread, NULL, graph_node_function, node) != 0)
+        {
+            rst = GRAPH_ERROR_THREAD;
+            break;
+        }
+        node->thread_started = 1;
+    }
+    if (rst == GRAPH_SUCCESS && pthread_create(&graph->thread, NULL, graph_function, graph) != 0)
+    {
+        rst = GRAPH_ERROR_THREAD;
+    }
+    if (rst != GRAPH_SUCCESS)
+    {
+        //the nodes that have a thread end it, the others end in place
+        printf("graph: a thread could not be started\n");
+        graph->running.store(0, std::memory_order_release);
+        graph_drain(graph);
+        for (int i = 0; i < graph->node_num; i++)
+        {
+            if (graph->nodes[i].thread_started)
+            {
+                pthread_join(graph->nodes[i].thread, NULL);
+                graph->nodes[i].thread_started = 0;
+            }
+        }
+        return rst;
+    }
+    graph->started = 1;
+    return GRAPH_SUCCESS;
+}
+
+void graph_stop(Graph_t* graph)
+{
+    if (graph == NULL || !graph->attached)
+    {
+        return;
+    }
+    if (graph->started)
+    {
+        graph->running.store(0, std::memory_order_release);
+        pthread_join(graph->thread, NULL);
+        for (int i = 0; i < graph->node_num; i++)
+        {
+            if (graph->nodes[i].thread_started)
+            {
+                pthread_join(graph->nodes[i].thread, NULL);
+                graph->nodes[i].thread_started = 0;
+            }
+        }
+        graph->started = 0;
+    }
+    else
+    {
+        ring_consumer_detach(graph->ring, graph->consumer_id);
+    }
+    graph_queues_release(graph, graph->node_num);
+    sync_cond_destroy(&graph->cond);
+    sync_mutex_destroy(&graph->mutex);
+    graph->attached = 0;
+}
+
+int graph_node_stats(Graph_t* graph, int node_id, GraphNodeStats_t* stats)
+{
+    if (graph == NULL || stats == NULL || node_id < 0 || node_id >= graph->node_num)
+    {
+        return GRAPH_ERROR_PARAM;
+    }
+    GraphNode_t* node = &graph->nodes[node_id];
+    stats->frames = node->frames.load(std::memory_order_relaxed);
+    stats->processed = node->processed.load(std::memory_order_relaxed);
+    stats->skipped = node->skipped.load(std::memory_order_relaxed);
+    stats->dropped = node->dropped.load(std::memory_order_relaxed);
+    stats->blocked_us = node->blocked_us.load(std::memory_order_relaxed);
+    stats->queued_max = node->queued_max.load(std::memory_order_relaxed);
+    timing_hist_stats(&node->busy, &stats->busy);
+    return GRAPH_SUCCESS;
+}
+
+void graph_dump(Graph_t* graph, FILE* fp)
+{
+    if (graph == NULL || fp == NULL)
+    {
+        return;
+    }
+    fprintf(fp, "graph: %d nodes, %llu frames from the ring, %llu overwritten there\n", graph->node_num, \
+        (unsigned long long)graph->frames, (unsigned long long)graph->dropped);
+    for (int i = 0; i < graph->node_num; i++)
+    {
+        GraphNode_t* node = &graph->nodes[i];
+        int level = 1;
+        for (int parent = node->stage.parent; parent != GRAPH_SOURCE; parent = graph->nodes[parent].stage.parent)
+        {
+            level++;
+        }
+        GraphNodeStats_t stats;
+        graph_node_stats(graph, i, &stats);
+        fprintf(fp, "%*s%-*s %-6s %-11s frames:%llu run:%llu skip:%llu drop:%llu blocked:%.1fms queued max:%u " \
+            "p50:%lluus p99:%lluus\n", 2 * level, "", GRAPH_NAME_LEN, node->name, \
+            graph_thread_names[node->stage.thread], (node->stage.thread == GRAPH_THREAD_INLINE) ? "-" : \
+            graph_policy_names[node->stage.policy], (unsigned long long)stats.frames, \
+            (unsigned long long)stats.processed, (unsigned long long)stats.skipped, (unsigned long long)stats.dropped, \
+            stats.blocked_us / 1000.0, stats.queued_max, (unsigned long long)stats.busy.p50_us, \
+            (unsigned long long)stats.busy.p99_us);
+    }
+}
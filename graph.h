@@ -0,0 +1,151 @@
+#ifndef _GRAPH_H_
+#define _GRAPH_H_
+
+//a camera's frame consumers declared as one dataflow graph instead of a thread and a hand-off each: every node is
+//a stage fed by the camera's ring or by another node, its frames come over a queued edge with its own policy and it
+//runs on its own thread, on the task pool or inline in its parent. a frame fans out to every child as one more
+//reference to the same ring slot, so nothing is copied and the slot is free once the last branch let go of it.
+//graph_attach checks the whole graph first, ports included, and every node counts what happened to its frames
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <pthread.h>
+#include "data.h"
+#include "ring.h"
+#include "queue.h"
+#include "pool.h"
+#include "rtsched.h"
+#include "timing.h"
+#include "sync.h"
+
+#define GRAPH_MAX_NODES 16
+#define GRAPH_NAME_LEN 16
+#define GRAPH_ERROR_LEN 128
+#define GRAPH_DEFAULT_DEPTH 2           //frames an edge queues, at most the ring depth - 1
+#define GRAPH_SOURCE -1                 //the parent of a node fed by the camera's ring
+
+#define GRAPH_SUCCESS 0
+#define GRAPH_ERROR_PARAM -1
+#define GRAPH_ERROR_INVALID -2          //graph_attach refused the graph, the error text says why
+#define GRAPH_ERROR_MEM -3
+#define GRAPH_ERROR_THREAD -4
+#define GRAPH_SKIP 1                    //a stage's return: the frame is done here, the children do not get it
+
+//port types: what a frame carries along an edge. the ring gives the planes its format has, a node adds its outputs
+//for its children, the GRAPH_PORT_USER bits are results of the stages themselves (blobs, detections, ...)
+#define GRAPH_PORT_RAW 0x01
+#define GRAPH_PORT_IMAGE 0x02
+#define GRAPH_PORT_TEMP 0x04
+#define GRAPH_PORT_META 0x08            //desc.meta, ac020 info lines
+#define GRAPH_PORT_USER(n) (0x100u << (n))
+
+typedef enum
+{
+    GRAPH_EDGE_BLOCK = 0,               //every frame, the parent waits while the queue is full
+    GRAPH_EDGE_DROP_OLDEST,             //a full queue drops its oldest frame for the new one
+    GRAPH_EDGE_LATEST,                  //only the newest frame waits, an older one is replaced
+}GraphEdgePolicy_t;
+
+typedef enum
+{
+    GRAPH_THREAD_POOL = 0,              //a pool task drains the queue, one at a time per node
+    GRAPH_THREAD_OWN,                   //a thread of its own with the role's scheduling, rtsched.h
+    GRAPH_THREAD_INLINE,                //in the parent's thread right after the parent, no queue
+}GraphThread_t;
+
+//the frame is shared with the other branches and must only be read. GRAPH_SUCCESS passes it on to the children
+typedef int (*GraphStageFunc_t)(const FrameDesc_t* desc, void* arg);
+
+typedef struct {
+    const char* name;
+    int parent;                         //an earlier node's id, or GRAPH_SOURCE
+    uint32_t inputs;                    //GRAPH_PORT_xxx the stage reads, each must reach it
+    uint32_t outputs;                   //GRAPH_PORT_xxx it adds for its children
+    GraphEdgePolicy_t policy;           //of the edge from the parent
+    uint32_t depth;                     //of the edge's queue, 0 GRAPH_DEFAULT_DEPTH, a power of two of at least 2
+    GraphThread_t thread;
+    RtRole_t role;                      //GRAPH_THREAD_OWN
+    PoolStage_t stage;                  //GRAPH_THREAD_POOL, the stage the tasks are accounted to
+    GraphStageFunc_t func;
+    void* arg;
+}GraphStage_t;
+
+typedef struct {
+    uint64_t frames;                    //came over the edge
+    uint64_t processed;                 //the stage ran on them
+    uint64_t skipped;                   //the stage returned GRAPH_SKIP
+    uint64_t dropped;                   //the edge's policy dropped or replaced them
+    uint64_t blocked_us;                //the parent waited on the full queue
+    uint32_t queued_max;
+    TimingStats_t busy;                 //duration of the stage function
+}GraphNodeStats_t;
+
+typedef struct {
+    GraphStage_t stage;
+    char name[GRAPH_NAME_LEN];
+    int id;
+    uint32_t ports;                     //what its children get
+    uint32_t capacity;                  //of the queue, 0 inline
+    int children[GRAPH_MAX_NODES];
+    int child_num;
+    MpmcQueue_t queue;                  //FrameSlot_t*, NULL is the parent's last frame for own threads
+    void* graph;
+    pthread_t thread;
+    uint8_t thread_started;
+    std::atomic<int> scheduled;         //pool: a drain task is queued or running
+    std::atomic<int> upstream_ended;    //pool: the parent sent its last frame
+    std::atomic<int> ended;             //the node drained and passed the end on to its children
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> processed;
+    std::atomic<uint64_t> skipped;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> blocked_us;
+    std::atomic<uint32_t> queued_max;
+    TimingHist_t busy;
+}GraphNode_t;
+
+typedef struct {
+    GraphNode_t nodes[GRAPH_MAX_NODES];
+    int node_num;
+    int children[GRAPH_MAX_NODES];      //the nodes fed by the ring
+    int child_num;
+    StreamFrameInfo_t* stream_frame_info;
+    FrameRing_t* ring;
+    int consumer_id;                    //RING_POLICY_NEXT, the edges drop by their own policy
+    pthread_t thread;                   //takes the ring's frames and feeds the root edges
+    uint64_t frames;                    //taken from the ring
+    uint64_t dropped;                   //overwritten in the ring before the graph took them
+    uint8_t attached;
+    uint8_t started;
+    std::atomic<int> running;
+    sync_mutex_t mutex;
+    sync_cond_t cond;                   //a node ended
+    int ended_num;
+}Graph_t;
+
+void graph_init(Graph_t* graph);
+
+//declare a node, returns its id. GRAPH_ERROR_PARAM when the graph is full or the name is missing or longer than
+//GRAPH_NAME_LEN - 1, the rest is checked by graph_attach
+int graph_add(Graph_t* graph, const GraphStage_t* stage);
+
+//the id of the node called name, GRAPH_ERROR_PARAM without
+int graph_find(const Graph_t* graph, const char* name);
+
+//check the graph against the camera's ring and build its queues: names, parents, ports, depths and threading.
+//GRAPH_ERROR_INVALID with the first problem in error
+int graph_attach(Graph_t* graph, StreamFrameInfo_t* stream_frame_info, char* error, int error_len);
+
+int graph_start(Graph_t* graph);
+
+//the queued frames still run, nodes finish in the order of the graph. a closed ring ends the graph the same way
+void graph_stop(Graph_t* graph);
+
+int graph_node_stats(Graph_t* graph, int node_id, GraphNodeStats_t* stats);
+
+//one line per node, the tree as indentation
+void graph_dump(Graph_t* graph, FILE* fp);
+
+const char* graph_port_name(uint32_t port);
+
+#endif
@@ -0,0 +1,651 @@
+//thermalsrc: gstreamer live source on the camera/data modules, built as libgstthermal.so when the gstreamer
+//development files are found. GRAY16_LE buffers wrap the frame ring slots, the pseudo color formats are
+//rendered into buffers of the negotiated pool
+//  GST_PLUGIN_PATH=. gst-launch-1.0 thermalsrc ! videoconvert ! autovideosink
+//  GST_PLUGIN_PATH=. gst-launch-1.0 thermalsrc source=synth ! video/x-raw,format=NV12 ! x264enc ! ...
+#include <gst/gst.h>
+#include <gst/base/gstpushsrc.h>
+#include <gst/video/video.h>
+#include <stdlib.h>
+#include <string.h>
+#include "camera.h"
+#include "colorize.h"
+
+#define THERMALSRC_FORMATS "{ GRAY16_LE, NV12, YUY2, BGR, BGRA, RGBA }"
+#define THERMALSRC_RING_DEPTH 8             //slots downstream may keep on top of the stream thread's
+#define THERMALSRC_WAIT_MS 100              //frame wait between flushing checks
+#define THERMALSRC_RELEASE_TIMEOUT_MS 1000  //detach: wait for downstream to give the wrapped slots back,
+                                            //under the stream thread's 2000 ms wait for its consumers
+
+GST_DEBUG_CATEGORY_STATIC(thermalsrc_debug);
+#define GST_CAT_DEFAULT thermalsrc_debug
+
+typedef struct ThermalSrc_s ThermalSrc;
+
+//one ring slot wrapped in a GstMemory, its destroy notify gives the slot back
+typedef struct {
+    ThermalSrc* src;
+    FrameSlot_t* slot;
+}ThermalSrcLease_t;
+
+struct ThermalSrc_s {
+    GstPushSrc parent;
+    //properties
+    FrameSourceType_t source_type;
+    gchar* location;
+    gboolean loop;
+    gboolean radiometric;               //GRAY16_LE: the temp plane, else the Y16 image plane
+    gint color_mode;
+    //stream
+    IrCamera_t camera;
+    FrameSource_t frame_source;
+    gboolean opened;
+    int consumer_id;
+    FrameRing_t* ring;                  //NULL once detached, late lease releases skip the ring
+    GstVideoInfo info;
+    GstVideoFormat format;
+    FrameInfo_t frameinfo;              //the image info as the colorize plan sees it
+    ColorizePlan_t plan;
+    uint8_t* scratch;                   //NV12 frame when the pool's planes are not packed
+    ThermalSrcLease_t leases[FRAME_RING_MAX_DEPTH];
+    GMutex mutex;
+    GCond cond;
+    int outstanding;                    //wrapped slots downstream still holds
+    gint flushing;
+    guint64 copies;                     //GRAY16 frames copied because downstream held too many slots
+};
+
+typedef struct {
+    GstPushSrcClass parent_class;
+}ThermalSrcClass;
+
+enum
+{
+    PROP_0,
+    PROP_SOURCE,
+    PROP_LOCATION,
+    PROP_LOOP,
+    PROP_RADIOMETRIC,
+    PROP_COLOR_MODE,
+};
+
+G_DEFINE_TYPE(ThermalSrc, thermal_src, GST_TYPE_PUSH_SRC);
+#define THERMAL_SRC(obj) ((ThermalSrc*)(obj))
+
+static GstStaticPadTemplate thermal_src_template = GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS, \
+    GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(THERMALSRC_FORMATS)));
+
+static GType thermal_src_source_get_type(void)
+{
+    static gsize type = 0;
+    static const GEnumValue values[] = {
+        { FRAME_SOURCE_UVC, "the ir camera", "uvc" },
+        { FRAME_SOURCE_REPLAY, "a recording of record.h, see location", "replay" },
+        { FRAME_SOURCE_SYNTH, "a generated scene", "synth" },
+        { 0, NULL, NULL },
+    };
+    if (g_once_init_enter(&type))
+    {
+        g_once_init_leave(&type, g_enum_register_static("ThermalSrcSource", values));
+    }
+    return (GType)type;
+}
+
+//the raw frame is the image half then the temp half, as load_stream_frame_info sets it up
+static void thermal_src_stream_info(StreamFrameInfo_t* stream_frame_info)
+{
+    FrameInfo_t* image_info = &stream_frame_info->image_info;
+    FrameInfo_t* temp_info = &stream_frame_info->temp_info;
+    image_info->width = stream_frame_info->camera_param.width;
+    image_info->height = stream_frame_info->camera_param.height / 2;
+    image_info->rotate_side = NO_ROTATE;
+    image_info->mirror_flip_status = STATUS_NO_MIRROR_FLIP;
+    image_info->pseudo_color_status = PSEUDO_COLOR_ON;
+    //the hist agc state belongs to the display, each frame is stretched over its own range
+    image_info->img_enhance_status = IMG_ENHANCE_ON;
+    image_info->input_format = INPUT_FMT_Y16;
+    image_info->output_format = OUTPUT_FMT_BGR888;
+    temp_info->width = image_info->width;
+    temp_info->height = image_info->height;
+    temp_info->rotate_side = NO_ROTATE;
+    temp_info->mirror_flip_status = STATUS_NO_MIRROR_FLIP;
+    stream_frame_info->image_byte_size = image_info->width * image_info->height * 2;
+    stream_frame_info->temp_byte_size = temp_info->width * temp_info->height * 2;
+    stream_frame_info->zero_copy = 1;
+    stream_frame_info->ring_depth = THERMALSRC_RING_DEPTH;
+}
+
+static void thermal_src_lease_release(gpointer data)
+{
+    ThermalSrcLease_t* lease = (ThermalSrcLease_t*)data;
+    ThermalSrc* src = lease->src;
+    g_mutex_lock(&src->mutex);
+    if (src->ring != NULL && lease->slot != NULL)
+    {
+        ring_read_release(src->ring, lease->slot);
+    }
+    lease->slot = NULL;
+    src->outstanding--;
+    g_cond_broadcast(&src->cond);
+    g_mutex_unlock(&src->mutex);
+    gst_object_unref(src);
+}
+
+//wait for the wrapped slots and leave the ring, the stream thread releases it once every consumer is gone
+static void thermal_src_detach(ThermalSrc* src)
+{
+    g_mutex_lock(&src->mutex);
+    if (src->ring == NULL)
+    {
+        g_mutex_unlock(&src->mutex);
+        return;
+    }
+    gint64 end_time = g_get_monotonic_time() + (gint64)THERMALSRC_RELEASE_TIMEOUT_MS * 1000;
+    while (src->outstanding > 0)
+    {
+        if (!g_cond_wait_until(&src->cond, &src->mutex, end_time))
+        {
+            GST_ELEMENT_WARNING(src, RESOURCE, CLOSE, ("downstream still holds %d frames", src->outstanding), \
+                ("their memory is released with the frame ring"));
+            break;
+        }
+    }
+    ring_consumer_detach(src->ring, src->consumer_id);
+    src->consumer_id = -1;
+    src->ring = NULL;
+    g_mutex_unlock(&src->mutex);
+}
+
+static void thermal_src_close(ThermalSrc* src)
+{
+    if (src->source_type == FRAME_SOURCE_UVC)
+    {
+        ir_camera_close();
+    }
+    else
+    {
+        frame_source_close(&src->frame_source);
+    }
+    src->opened = FALSE;
+}
+
+static gboolean thermal_src_start(GstBaseSrc* base)
+{
+    ThermalSrc* src = THERMAL_SRC(base);
+    memset(&src->camera, 0, sizeof(IrCamera_t));
+    src->camera.camera_num = 1;
+    StreamFrameInfo_t* stream_frame_info = &src->camera.stream_frame_info;
+    if (src->source_type == FRAME_SOURCE_UVC)
+    {
+        if (ir_camera_open(&stream_frame_info->camera_param) < 0)
+        {
+            GST_ELEMENT_ERROR(src, RESOURCE, OPEN_READ, ("no ir camera"), (NULL));
+            return FALSE;
+        }
+    }
+    else
+    {
+        FrameSourceParam_t param;
+        memset(&param, 0, sizeof(param));
+        param.type = src->source_type;
+        if (src->location != NULL)
+        {
+            g_strlcpy(param.path, src->location, sizeof(param.path));
+        }
+        param.paced = 1;
+        param.loop = (uint8_t)src->loop;
+        if (frame_source_open(&src->frame_source, &param) != SOURCE_SUCCESS)
+        {
+            GST_ELEMENT_ERROR(src, RESOURCE, OPEN_READ, ("can not open the %s frame source", \
+                frame_source_name(src->source_type)), ("location %s", (src->location != NULL) ? src->location : ""));
+            return FALSE;
+        }
+        frame_source_camera_param(&src->frame_source, &stream_frame_info->camera_param);
+        stream_frame_info->frame_source = &src->frame_source;
+    }
+    src->opened = TRUE;
+
+    thermal_src_stream_info(stream_frame_info);
+    if (create_data_demo(stream_frame_info) != 0)
+    {
+        GST_ELEMENT_ERROR(src, RESOURCE, NO_SPACE_LEFT, ("no memory for the frame ring"), (NULL));
+        thermal_src_close(src);
+        return FALSE;
+    }
+    src->frameinfo = stream_frame_info->config->image_info;
+    //attached before the stream thread writes its first frame, only the newest frame is taken
+    src->consumer_id = ring_consumer_attach(stream_frame_info->frame_ring, RING_POLICY_NEWEST);
+    src->ring = stream_frame_info->frame_ring;
+    if (src->consumer_id < 0 || ir_camera_context_start(&src->camera) != 0)
+    {
+        GST_ELEMENT_ERROR(src, RESOURCE, OPEN_READ, ("ir camera stream on failed"), (NULL));
+        if (src->consumer_id >= 0)
+        {
+            ring_consumer_detach(src->ring, src->consumer_id);
+        }
+        src->consumer_id = -1;
+        src->ring = NULL;
+        destroy_data_demo(stream_frame_info);
+        thermal_src_close(src);
+        return FALSE;
+    }
+    GST_INFO_OBJECT(src, "%s %ux%u at %u fps", frame_source_name(src->source_type), \
+        stream_frame_info->image_info.width, stream_frame_info->image_info.height, \
+        stream_frame_info->camera_param.fps);
+    return TRUE;
+}
+
+static gboolean thermal_src_stop(GstBaseSrc* base)
+{
+    ThermalSrc* src = THERMAL_SRC(base);
+    if (!src->opened)
+    {
+        return TRUE;
+    }
+    thermal_src_detach(src);
+    //the stream thread closes the ring and releases the buffers when it leaves
+    ir_camera_context_stop(&src->camera);
+    thermal_src_close(src);
+    free(src->scratch);
+    src->scratch = NULL;
+    GST_INFO_OBJECT(src, "%" G_GUINT64_FORMAT " gray16 frames copied", src->copies);
+    return TRUE;
+}
+
+//the formats at the stream's size, GRAY16_LE first so it is the one fixated by default
+static GstCaps* thermal_src_get_caps(GstBaseSrc* base, GstCaps* filter)
+{
+    ThermalSrc* src = THERMAL_SRC(base);
+    if (!src->opened)
+    {
+        return gst_pad_get_pad_template_caps(GST_BASE_SRC_PAD(base));
+    }
+    const StreamConfig_t* config = src->camera.stream_frame_info.config;
+    const FrameInfo_t* gray_info = (src->radiometric) ? &config->temp_info : &config->image_info;
+    const FrameInfo_t* image_info = &config->image_info;
+    int fps = (config->camera_param.fps > 0) ? (int)config->camera_param.fps : 25;
+    static const char* formats[] = { "GRAY16_LE", "NV12", "YUY2", "BGR", "BGRA", "RGBA" };
+    GstCaps* caps = gst_caps_new_empty();
+    for (int i = 0; i < (int)G_N_ELEMENTS(formats); i++)
+    {
+        const FrameInfo_t* info = (i == 0) ? gray_info : image_info;
+        if (i > 0 && i < 3 && ((info->width & 1) || (i == 1 && (info->height & 1))))
+        {
+            continue;
+        }
+        gst_caps_append(caps, gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING, formats[i], \
+            "width", G_TYPE_INT, (int)info->width, "height", G_TYPE_INT, (int)info->height, \
+            "framerate", GST_TYPE_FRACTION, fps, 1, "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1, NULL));
+    }
+    if (filter != NULL)
+    {
+        GstCaps* intersection = gst_caps_intersect_full(filter, caps, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref(caps);
+        caps = intersection;
+    }
+    return caps;
+}
+
+static gboolean thermal_src_set_caps(GstBaseSrc* base, GstCaps* caps)
+{
+    ThermalSrc* src = THERMAL_SRC(base);
+    if (!gst_video_info_from_caps(&src->info, caps))
+    {
+        return FALSE;
+    }
+    src->format = GST_VIDEO_INFO_FORMAT(&src->info);
+    free(src->scratch);
+    src->scratch = NULL;
+    if (src->format == GST_VIDEO_FORMAT_NV12)
+    {
+        src->scratch = (uint8_t*)malloc((size_t)GST_VIDEO_INFO_WIDTH(&src->info) * GST_VIDEO_INFO_HEIGHT(&src->info) * 3 / 2);
+        if (src->scratch == NULL)
+        {
+            return FALSE;
+        }
+    }
+    GST_INFO_OBJECT(src, "%s %dx%d", gst_video_format_to_string(src->format), GST_VIDEO_INFO_WIDTH(&src->info), \
+        GST_VIDEO_INFO_HEIGHT(&src->info));
+    return TRUE;
+}
+
+static gboolean thermal_src_query(GstBaseSrc* base, GstQuery* query)
+{
+    ThermalSrc* src = THERMAL_SRC(base);
+    if (GST_QUERY_TYPE(query) == GST_QUERY_LATENCY && src->opened)
+    {
+        //a frame is handed out as soon as it is published, at most the ring's depth behind
+        uint32_t fps = src->camera.stream_frame_info.config->camera_param.fps;
+        GstClockTime frame_time = gst_util_uint64_scale_int(GST_SECOND, 1, (fps > 0) ? fps : 25);
+        gst_query_set_latency(query, TRUE, frame_time, frame_time * THERMALSRC_RING_DEPTH);
+        return TRUE;
+    }
+    return GST_BASE_SRC_CLASS(thermal_src_parent_class)->query(base, query);
+}
+
+static gboolean thermal_src_unlock(GstBaseSrc* base)
+{
+    g_atomic_int_set(&THERMAL_SRC(base)->flushing, 1);
+    return TRUE;
+}
+
+static gboolean thermal_src_unlock_stop(GstBaseSrc* base)
+{
+    g_atomic_int_set(&THERMAL_SRC(base)->flushing, 0);
+    return TRUE;
+}
+
+//capture time on the monotonic clock moved to the pipeline clock, as a running time
+static GstClockTime thermal_src_pts(ThermalSrc* src, uint64_t timestamp_us)
+{
+    GstClock* clock = gst_element_get_clock(GST_ELEMENT(src));
+    if (clock == NULL)
+    {
+        return GST_CLOCK_TIME_NONE;
+    }
+    GstClockTime now = gst_clock_get_time(clock);
+    gst_object_unref(clock);
+    uint64_t now_us = get_monotonic_us();
+    GstClockTime age = (now_us > timestamp_us) ? (now_us - timestamp_us) * GST_USECOND : 0;
+    GstClockTime capture = (now > age) ? now - age : 0;
+    GstClockTime base_time = gst_element_get_base_time(GST_ELEMENT(src));
+    return (capture > base_time) ? capture - base_time : 0;
+}
+
+//the plane's memory is the slot's, it goes back to the ring when downstream drops the buffer
+static GstBuffer* thermal_src_wrap(ThermalSrc* src, FrameSlot_t* slot)
+{
+    const FramePlane_t* plane = (src->radiometric) ? &slot->desc.temp : &slot->desc.image;
+    GstBuffer* buf = NULL;
+    g_mutex_lock(&src->mutex);
+    //the stream thread needs a free slot and one for the next frame
+    if (src->outstanding + 2 >= (int)src->ring->depth)
+    {
+        g_mutex_unlock(&src->mutex);
+        buf = gst_buffer_new_allocate(NULL, plane->byte_size, NULL);
+        if (buf != NULL)
+        {
+            gst_buffer_fill(buf, 0, plane->data, plane->byte_size);
+        }
+        ring_read_release(src->ring, slot);
+        src->copies++;
+    }
+    else
+    {
+        ThermalSrcLease_t* lease = &src->leases[slot - src->ring->slots];
+        lease->src = (ThermalSrc*)gst_object_ref(src);
+        lease->slot = slot;
+        src->outstanding++;
+        g_mutex_unlock(&src->mutex);
+        buf = gst_buffer_new();
+        gst_buffer_append_memory(buf, gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY, plane->data, \
+            plane->byte_size, 0, plane->byte_size, lease, thermal_src_lease_release));
+    }
+    if (buf != NULL)
+    {
+        gsize offset[GST_VIDEO_MAX_PLANES] = { 0 };
+        gint stride[GST_VIDEO_MAX_PLANES] = { (gint)plane->stride };
+        gst_buffer_add_video_meta_full(buf, GST_VIDEO_FRAME_FLAG_NONE, GST_VIDEO_FORMAT_GRAY16_LE, plane->width, \
+            plane->height, 1, offset, stride);
+    }
+    return buf;
+}
+
+//the pseudo color lut's own bgr or yuv straight into the pool's buffer
+static GstBuffer* thermal_src_colorize(ThermalSrc* src, FrameSlot_t* slot)
+{
+    uint16_t* image = (uint16_t*)slot->desc.image.data;
+    int width = (int)slot->desc.image.width;
+    int height = (int)slot->desc.image.height;
+    if (colorize_plan_prepare(&src->plan, image, width * height, &src->frameinfo, \
+        (irproc_color_mode_t)src->color_mode, &slot->image_stats) != COLORIZE_SUCCESS)
+    {
+        ring_read_release(src->ring, slot);
+        return NULL;
+    }
+    GstBuffer* buf = NULL;
+    GstBufferPool* pool = gst_base_src_get_buffer_pool(GST_BASE_SRC(src));
+    if (pool != NULL)
+    {
+        gst_buffer_pool_acquire_buffer(pool, &buf, NULL);
+        gst_object_unref(pool);
+    }
+    else
+    {
+        buf = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(&src->info), NULL);
+    }
+    GstVideoFrame frame;
+    if (buf == NULL || !gst_video_frame_map(&frame, &src->info, buf, GST_MAP_WRITE))
+    {
+        ring_read_release(src->ring, slot);
+        if (buf != NULL)
+        {
+            gst_buffer_unref(buf);
+        }
+        return NULL;
+    }
+    uint8_t* dst = (uint8_t*)GST_VIDEO_FRAME_PLANE_DATA(&frame, 0);
+    int stride = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0);
+    if (src->format == GST_VIDEO_FORMAT_BGRA || src->format == GST_VIDEO_FORMAT_RGBA)
+    {
+        //whole pixels from the palette's 4 byte lut, nothing for videoconvert to repack
+        colorize_plan_output(&src->plan, (src->format == GST_VIDEO_FORMAT_BGRA) ? OUTPUT_FMT_BGRA32 : \
+            OUTPUT_FMT_RGBA32, width * height, &src->frameinfo);
+        for (int y = 0; y < height; y++)
+        {
+            colorize_plan_apply(&src->plan, image + (long)y * width, 0, width, dst + (long)y * stride, NULL);
+        }
+    }
+    else if (src->format == GST_VIDEO_FORMAT_BGR)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            colorize_plan_apply(&src->plan, image + (long)y * width, 0, width, dst + (long)y * stride, NULL);
+        }
+    }
+    else if (src->format == GST_VIDEO_FORMAT_YUY2)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            colorize_plan_apply_yuyv(&src->plan, image + (long)y * width, width, width, 0, 1, dst + (long)y * stride);
+        }
+    }
+    else
+    {
+        uint8_t* dst_uv = (uint8_t*)GST_VIDEO_FRAME_PLANE_DATA(&frame, 1);
+        int stride_uv = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 1);
+        if (stride == width && stride_uv == width && dst_uv == dst + (long)width * height)
+        {
+            colorize_plan_apply_nv12(&src->plan, image, width, width, height, 0, height, dst);
+        }
+        else
+        {
+            colorize_plan_apply_nv12(&src->plan, image, width, width, height, 0, height, src->scratch);
+            for (int y = 0; y < height; y++)
+            {
+                memcpy(dst + (long)y * stride, src->scratch + (long)y * width, width);
+            }
+            for (int y = 0; y < height / 2; y++)
+            {
+                memcpy(dst_uv + (long)y * stride_uv, src->scratch + (long)(height + y) * width, width);
+            }
+        }
+    }
+    gst_video_frame_unmap(&frame);
+    ring_read_release(src->ring, slot);
+    return buf;
+}
+
+static GstFlowReturn thermal_src_create(GstPushSrc* push, GstBuffer** outbuf)
+{
+    ThermalSrc* src = THERMAL_SRC(push);
+    if (src->ring == NULL)
+    {
+        return GST_FLOW_EOS;
+    }
+    FrameSlot_t* slot = NULL;
+    for (;;)
+    {
+        if (g_atomic_int_get(&src->flushing))
+        {
+            return GST_FLOW_FLUSHING;
+        }
+        int rst = ring_read_acquire(src->ring, src->consumer_id, THERMALSRC_WAIT_MS, &slot);
+        if (rst == RING_SUCCESS)
+        {
+            break;
+        }
+        if (rst == RING_CLOSED)
+        {
+            //the stream ended (replay without loop, camera lost), let the stream thread release the ring
+            thermal_src_detach(src);
+            return GST_FLOW_EOS;
+        }
+        if (rst != RING_TIMEOUT)
+        {
+            GST_ELEMENT_ERROR(src, RESOURCE, READ, ("frame ring read failed: %d", rst), (NULL));
+            return GST_FLOW_ERROR;
+        }
+    }
+    uint64_t seq = slot->desc.seq;
+    uint64_t timestamp_us = slot->desc.timestamp_us;
+    GstBuffer* buf = (src->format == GST_VIDEO_FORMAT_GRAY16_LE) ? thermal_src_wrap(src, slot) : \
+        thermal_src_colorize(src, slot);
+    if (buf == NULL)
+    {
+        GST_ELEMENT_ERROR(src, RESOURCE, NO_SPACE_LEFT, ("no buffer for the frame"), (NULL));
+        return GST_FLOW_ERROR;
+    }
+    uint32_t fps = src->camera.stream_frame_info.config->camera_param.fps;
+    GST_BUFFER_PTS(buf) = thermal_src_pts(src, timestamp_us);
+    GST_BUFFER_DURATION(buf) = gst_util_uint64_scale_int(GST_SECOND, 1, (fps > 0) ? fps : 25);
+    GST_BUFFER_OFFSET(buf) = seq;
+    GST_BUFFER_OFFSET_END(buf) = seq + 1;
+    *outbuf = buf;
+    return GST_FLOW_OK;
+}
+
+static void thermal_src_set_property(GObject* object, guint prop_id, const GValue* value, GParamSpec* pspec)
+{
+    ThermalSrc* src = THERMAL_SRC(object);
+    switch (prop_id)
+    {
+    case PROP_SOURCE:
+        src->source_type = (FrameSourceType_t)g_value_get_enum(value);
+        break;
+    case PROP_LOCATION:
+        g_free(src->location);
+        src->location = g_value_dup_string(value);
+        break;
+    case PROP_LOOP:
+        src->loop = g_value_get_boolean(value);
+        break;
+    case PROP_RADIOMETRIC:
+        src->radiometric = g_value_get_boolean(value);
+        break;
+    case PROP_COLOR_MODE:
+        src->color_mode = g_value_get_int(value);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+static void thermal_src_get_property(GObject* object, guint prop_id, GValue* value, GParamSpec* pspec)
+{
+    ThermalSrc* src = THERMAL_SRC(object);
+    switch (prop_id)
+    {
+    case PROP_SOURCE:
+        g_value_set_enum(value, src->source_type);
+        break;
+    case PROP_LOCATION:
+        g_value_set_string(value, src->location);
+        break;
+    case PROP_LOOP:
+        g_value_set_boolean(value, src->loop);
+        break;
+    case PROP_RADIOMETRIC:
+        g_value_set_boolean(value, src->radiometric);
+        break;
+    case PROP_COLOR_MODE:
+        g_value_set_int(value, src->color_mode);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+static void thermal_src_finalize(GObject* object)
+{
+    ThermalSrc* src = THERMAL_SRC(object);
+    g_free(src->location);
+    g_mutex_clear(&src->mutex);
+    g_cond_clear(&src->cond);
+    G_OBJECT_CLASS(thermal_src_parent_class)->finalize(object);
+}
+
+static void thermal_src_init(ThermalSrc* src)
+{
+    src->source_type = FRAME_SOURCE_UVC;
+    src->radiometric = TRUE;
+    src->color_mode = IRPROC_COLOR_MODE_6;
+    src->consumer_id = -1;
+    g_mutex_init(&src->mutex);
+    g_cond_init(&src->cond);
+    gst_base_src_set_live(GST_BASE_SRC(src), TRUE);
+    gst_base_src_set_format(GST_BASE_SRC(src), GST_FORMAT_TIME);
+    gst_base_src_set_do_timestamp(GST_BASE_SRC(src), FALSE);
+}
+
+static void thermal_src_class_init(ThermalSrcClass* klass)
+{
+    GObjectClass* gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass* element_class = GST_ELEMENT_CLASS(klass);
+    GstBaseSrcClass* basesrc_class = GST_BASE_SRC_CLASS(klass);
+    GstPushSrcClass* pushsrc_class = GST_PUSH_SRC_CLASS(klass);
+    GParamFlags flags = (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+    gobject_class->set_property = thermal_src_set_property;
+    gobject_class->get_property = thermal_src_get_property;
+    gobject_class->finalize = thermal_src_finalize;
+    g_object_class_install_property(gobject_class, PROP_SOURCE, g_param_spec_enum("source", "Source", \
+        "where the raw frames come from", thermal_src_source_get_type(), FRAME_SOURCE_UVC, flags));
+    g_object_class_install_property(gobject_class, PROP_LOCATION, g_param_spec_string("location", "Location", \
+        "recording played by source=replay", NULL, flags));
+    g_object_class_install_property(gobject_class, PROP_LOOP, g_param_spec_boolean("loop", "Loop", \
+        "start the recording over after its last frame", FALSE, flags));
+    g_object_class_install_property(gobject_class, PROP_RADIOMETRIC, g_param_spec_boolean("radiometric", \
+        "Radiometric", "GRAY16_LE carries the temp plane (1/64 K), else the Y16 image", TRUE, flags));
+    g_object_class_install_property(gobject_class, PROP_COLOR_MODE, g_param_spec_int("color-mode", "Color mode", \
+        "pseudo color of NV12/YUY2/BGR, irproc_color_mode_t", IRPROC_COLOR_MODE_1, IRPROC_COLOR_MODE_20, \
+        IRPROC_COLOR_MODE_6, flags));
+
+    gst_element_class_set_static_metadata(element_class, "Thermal camera source", "Source/Video", \
+        "Radiometric GRAY16_LE or pseudo color frames of the ir camera's frame ring", "irsample");
+    gst_element_class_add_static_pad_template(element_class, &thermal_src_template);
+
+    basesrc_class->start = thermal_src_start;
+    basesrc_class->stop = thermal_src_stop;
+    basesrc_class->get_caps = thermal_src_get_caps;
+    basesrc_class->set_caps = thermal_src_set_caps;
+    basesrc_class->query = thermal_src_query;
+    basesrc_class->unlock = thermal_src_unlock;
+    basesrc_class->unlock_stop = thermal_src_unlock_stop;
+    pushsrc_class->create = thermal_src_create;
+}
+
+static gboolean plugin_init(GstPlugin* plugin)
+{
+    GST_DEBUG_CATEGORY_INIT(thermalsrc_debug, "thermalsrc", 0, "thermal camera source");
+    return gst_element_register(plugin, "thermalsrc", GST_RANK_NONE, thermal_src_get_type());
+}
+
+#ifndef PACKAGE
+#define PACKAGE "irsample"
+#endif
+
+GST_PLUGIN_DEFINE(GST_VERSION_MAJOR, GST_VERSION_MINOR, thermal, "thermal camera source", plugin_init, "1.0", \
+    "Proprietary", PACKAGE, "irsample")
@@ -0,0 +1,190 @@
+#include "hdr.h"
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+#include "tempunit.h"
+#include "cmdq.h"
+#include "temperature.h"
+#include "gain.h"
+#include "simd.h"
+#include "prop.h"
+
+#define HDR_KNEE_TEMP TEMP_RAW_OF_CELSIUS(130)
+#define HDR_MOTION_TEMP TEMP_RAW_OF_KELVIN_DELTA(3)
+#define HDR_MAX_KNEE_SHIFT 14
+
+//runs on the cmdq worker
+static int hdr_gain_set(void* arg)
+{
+    Hdr_t* hdr = (Hdr_t*)arg;
+    pthread_mutex_lock(&hdr->mutex);
+    int target = hdr->target;
+    pthread_mutex_unlock(&hdr->mutex);
+    return prop_tpd_set(TPD_PROP_GAIN_SEL, (uint16_t)target);
+}
+
+static void hdr_gain_set_done(int job_id, int result, void* user_data)
+{
+    Hdr_t* hdr = (Hdr_t*)user_data;
+    pthread_mutex_lock(&hdr->mutex);
+    hdr->pending = 0;
+    hdr->good_cnt = 0;
+    if (result == IRUVC_SUCCESS)
+    {
+        hdr->gain = hdr->target;
+        temp_gain_select_ctx(hdr->calib, hdr->target);
+        hdr->settle_left = hdr->param.settle_frames;
+        hdr->stats.switches++;
+    }
+    else
+    {
+        //stay at the gain, the next switch comes after another cadence
+        hdr->stats.failures++;
+    }
+    pthread_cond_broadcast(&hdr->cond);
+    pthread_mutex_unlock(&hdr->mutex);
+}
+
+//called with the mutex held, the done callback may run before cmdq_submit returns
+static void hdr_switch(Hdr_t* hdr, int target)
+{
+    hdr->target = target;
+    hdr->pending = 1;
+    pthread_mutex_unlock(&hdr->mutex);
+    int rst = cmdq_submit(hdr_gain_set, hdr, CMDQ_PRIORITY_CRITICAL, 0, hdr_gain_set_done, hdr, NULL);
+    pthread_mutex_lock(&hdr->mutex);
+    if (rst != CMDQ_SUCCESS)
+    {
+        hdr->pending = 0;
+        hdr->good_cnt = 0;
+        hdr->stats.failures++;
+    }
+}
+
+int hdr_init(Hdr_t* hdr, const HdrParam_t* param, uint32_t width, uint32_t height)
+{
+    if (hdr == NULL || width == 0 || height == 0 || \
+        (param != NULL && (param->cadence == 0 || param->knee_shift > HDR_MAX_KNEE_SHIFT)))
+    {
+        return HDR_ERROR_PARAM;
+    }
+    memset(hdr, 0, sizeof(Hdr_t));
+    if (param != NULL)
+    {
+        hdr->param = *param;
+    }
+    else
+    {
+        hdr->param.cadence = 4;
+        hdr->param.settle_frames = 3;
+        hdr->param.knee = (uint16_t)HDR_KNEE_TEMP;
+        hdr->param.knee_shift = 10;
+        hdr->param.motion = HDR_MOTION_TEMP;
+    }
+    hdr->pix_num = width * height;
+    for (int i = 0; i < 2; i++)
+    {
+        hdr->keep[i] = (uint16_t*)malloc(hdr->pix_num * sizeof(uint16_t));
+        if (hdr->keep[i] == NULL)
+        {
+            free(hdr->keep[0]);
+            hdr->keep[0] = NULL;
+            return HDR_ERROR_MEM;
+        }
+    }
+    hdr->gain = GAIN_CTRL_UNKNOWN;
+    hdr->target = GAIN_CTRL_UNKNOWN;
+    pthread_mutex_init(&hdr->mutex, NULL);
+    pthread_cond_init(&hdr->cond, NULL);
+
+    //the frames are not attributed to a gain until this ran
+    pthread_mutex_lock(&hdr->mutex);
+    hdr_switch(hdr, GAIN_CTRL_HIGH);
+    pthread_mutex_unlock(&hdr->mutex);
+    return HDR_SUCCESS;
+}
+
+void hdr_release(Hdr_t* hdr)
+{
+    if (hdr == NULL || hdr->keep[0] == NULL)
+    {
+        return;
+    }
+    //cmdq_release completes what never ran, the done callback always comes
+    pthread_mutex_lock(&hdr->mutex);
+    while (hdr->pending)
+    {
+        pthread_cond_wait(&hdr->cond, &hdr->mutex);
+    }
+    pthread_mutex_unlock(&hdr->mutex);
+    pthread_mutex_destroy(&hdr->mutex);
+    pthread_cond_destroy(&hdr->cond);
+    free(hdr->keep[0]);
+    free(hdr->keep[1]);
+    hdr->keep[0] = NULL;
+    hdr->keep[1] = NULL;
+}
+
+uint32_t hdr_frame(Hdr_t* hdr, uint16_t* temp)
+{
+    if (hdr == NULL || temp == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&hdr->mutex);
+    if (hdr->pending || hdr->settle_left > 0 || hdr->gain == GAIN_CTRL_UNKNOWN)
+    {
+        //the sensor reloads, show the last fusion again rather than a frame of neither gain
+        if (!hdr->pending && hdr->settle_left > 0)
+        {
+            hdr->settle_left--;
+        }
+        if (!hdr->have[GAIN_CTRL_LOW] || !hdr->have[GAIN_CTRL_HIGH])
+        {
+            if (hdr->gain == GAIN_CTRL_UNKNOWN && !hdr->pending && ++hdr->good_cnt >= hdr->param.cadence)
+            {
+                //the first command failed, try again every cadence frames
+                hdr_switch(hdr, GAIN_CTRL_HIGH);
+            }
+            hdr->stats.transition_frames++;
+            pthread_mutex_unlock(&hdr->mutex);
+            return FRAME_DESC_GAIN_TRANSITION;
+        }
+    }
+    else
+    {
+        memcpy(hdr->keep[hdr->gain], temp, hdr->pix_num * sizeof(uint16_t));
+        hdr->have[hdr->gain] = 1;
+        hdr->newer = hdr->gain;
+        hdr->good_cnt++;
+        if (hdr->good_cnt >= hdr->param.cadence)
+        {
+            hdr_switch(hdr, (hdr->gain == GAIN_CTRL_HIGH) ? GAIN_CTRL_LOW : GAIN_CTRL_HIGH);
+        }
+        if (!hdr->have[GAIN_CTRL_LOW] || !hdr->have[GAIN_CTRL_HIGH])
+        {
+            //a plain frame of one gain until the other one was seen
+            pthread_mutex_unlock(&hdr->mutex);
+            return 0;
+        }
+    }
+
+    //where the scene moved between the two frames the newer one wins
+    simd_hdr_fuse_u16(hdr->keep[GAIN_CTRL_HIGH], hdr->keep[GAIN_CTRL_LOW], (int)hdr->pix_num, hdr->param.knee, \
+        hdr->param.knee_shift, hdr->param.motion, hdr->newer == GAIN_CTRL_LOW, temp);
+    hdr->stats.fused++;
+    pthread_mutex_unlock(&hdr->mutex);
+    return FRAME_DESC_HDR_FUSED;
+}
+
+int hdr_stats(Hdr_t* hdr, HdrStats_t* stats)
+{
+    if (hdr == NULL || stats == NULL)
+    {
+        return HDR_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&hdr->mutex);
+    *stats = hdr->stats;
+    pthread_mutex_unlock(&hdr->mutex);
+    return HDR_SUCCESS;
+}
@@ -0,0 +1,60 @@
+#ifndef _HDR_H_
+#define _HDR_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define HDR_SUCCESS 0
+#define HDR_ERROR_PARAM -1
+#define HDR_ERROR_MEM -2
+
+//temperatures in the temp plane's 1/64 K units
+typedef struct {
+    uint32_t cadence;                   //good frames taken at one gain before switching to the other
+    uint32_t settle_frames;             //frames after the gain command for the sensor to reload
+    uint16_t knee;                      //high gain temperature where the low gain frame starts to fade in
+    uint8_t knee_shift;                 //the fade spans 1 << knee_shift, <= 14
+    uint16_t motion;                    //high/low difference below the knee's end that counts as scene motion
+}HdrParam_t;
+
+typedef struct {
+    uint64_t fused;                     //frames tagged FRAME_DESC_HDR_FUSED
+    uint64_t switches;
+    uint64_t failures;
+    uint64_t transition_frames;         //frames tagged FRAME_DESC_GAIN_TRANSITION, one gain not seen yet
+}HdrStats_t;
+
+//dual gain fusion of one stream: alternates TPD_PROP_GAIN_SEL through the command queue every cadence good
+//frames, keeps the newest temp frame of each gain and writes their fusion into the slot's temp plane, so every
+//consumer sees one extended range frame. not to be combined with the auto gain switch
+typedef struct Hdr_t {
+    HdrParam_t param;
+    uint32_t pix_num;
+    uint16_t* keep[2];                  //newest good frame per gain, indexed by GAIN_CTRL_LOW/HIGH
+    uint8_t have[2];
+    int newer;                          //gain of the keep frame taken last
+    int gain;                           //GAIN_CTRL_xxx the frames are taken at, unknown until the first command ran
+    int target;
+    uint32_t good_cnt;                  //good frames at the current gain
+    uint8_t pending;                    //command queued or running
+    uint32_t settle_left;
+    HdrStats_t stats;
+    struct TempCalibCtx_t* calib;       //temperature.h, the context the switch selects the gain's tables in, NULL the default
+    pthread_mutex_t mutex;              //the cmdq worker completes the command
+    pthread_cond_t cond;
+}Hdr_t;
+
+//width/height of the temp plane, param NULL takes 4 frames per gain, 3 to settle, the knee at 130C over 16 K
+//and 3 K of motion. queues the switch to high gain
+int hdr_init(Hdr_t* hdr, const HdrParam_t* param, uint32_t width, uint32_t height);
+
+//wait for a queued command and free the frames, the device stays at the gain it has
+void hdr_release(Hdr_t* hdr);
+
+//one temp frame from the stream thread, before its statistics: fuses in place when both gains were seen,
+//returns the FRAME_DESC_xxx flags for the frame
+uint32_t hdr_frame(Hdr_t* hdr, uint16_t* temp);
+
+int hdr_stats(Hdr_t* hdr, HdrStats_t* stats);
+
+#endif
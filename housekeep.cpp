@@ -0,0 +1,195 @@
+#include "housekeep.h"
+#include <string.h>
+#include "cmdq.h"
+#include "thermal_cam_cmd.h"
+
+//called with the mutex held, the only writers are the cmdq worker and the stream thread
+static void housekeep_store(Housekeep_t* housekeep, const HousekeepSnapshot_t* snapshot)
+{
+    uint64_t values = (uint64_t)snapshot->vtemp | (uint64_t)snapshot->shutter_vtemp << 16 | \
+        (uint64_t)snapshot->lens_vtemp << 32 | (uint64_t)snapshot->valid << 48;
+    housekeep->seq.fetch_add(1);
+    housekeep->values.store(values);
+    housekeep->timestamp_us.store(snapshot->timestamp_us);
+    housekeep->seq.fetch_add(1);
+}
+
+static void housekeep_load(Housekeep_t* housekeep, HousekeepSnapshot_t* snapshot)
+{
+    uint32_t seq;
+    uint64_t values, timestamp_us;
+    do
+    {
+        seq = housekeep->seq.load();
+        values = housekeep->values.load();
+        timestamp_us = housekeep->timestamp_us.load();
+    } while ((seq & 1) || seq != housekeep->seq.load());
+    snapshot->vtemp = (uint16_t)values;
+    snapshot->shutter_vtemp = (uint16_t)(values >> 16);
+    snapshot->lens_vtemp = (uint16_t)(values >> 32);
+    snapshot->valid = (uint8_t)(values >> 48);
+    snapshot->timestamp_us = timestamp_us;
+}
+
+//runs on the cmdq worker, one job for the whole batch
+static int housekeep_poll(void* arg)
+{
+    Housekeep_t* housekeep = (Housekeep_t*)arg;
+    pthread_mutex_lock(&housekeep->mutex);
+    uint8_t items = housekeep->param.items;
+    if (housekeep->meta_vtemp)
+    {
+        items &= ~HOUSEKEEP_VTEMP;
+    }
+    pthread_mutex_unlock(&housekeep->mutex);
+
+    uint16_t value[3] = { 0, 0, 0 };
+    int rst[3] = { IRUVC_SUCCESS, IRUVC_SUCCESS, IRUVC_SUCCESS };
+    if (items & HOUSEKEEP_VTEMP)
+    {
+        rst[0] = cur_vtemp_get(&value[0]);
+    }
+    if (items & HOUSEKEEP_SHUTTER_VTEMP)
+    {
+        rst[1] = shutter_vtemp_get(&value[1]);
+    }
+    if (items & HOUSEKEEP_LENS_VTEMP)
+    {
+        rst[2] = lens_vtemp_get(&value[2]);
+    }
+
+    pthread_mutex_lock(&housekeep->mutex);
+    HousekeepSnapshot_t snapshot;
+    housekeep_load(housekeep, &snapshot);
+    uint16_t* field[3] = { &snapshot.vtemp, &snapshot.shutter_vtemp, &snapshot.lens_vtemp };
+    int result = IRUVC_SUCCESS;
+    for (int i = 0; i < 3; i++)
+    {
+        if (!(items & (1 << i)))
+        {
+            continue;
+        }
+        if (rst[i] != IRUVC_SUCCESS)
+        {
+            housekeep->stats.failures++;
+            result = rst[i];
+            continue;
+        }
+        *field[i] = value[i];
+        snapshot.valid |= (uint8_t)(1 << i);
+    }
+    snapshot.timestamp_us = housekeep->poll_us;
+    housekeep_store(housekeep, &snapshot);
+    housekeep->stats.polls++;
+    pthread_mutex_unlock(&housekeep->mutex);
+    return result;
+}
+
+static void housekeep_poll_done(int job_id, int result, void* user_data)
+{
+    Housekeep_t* housekeep = (Housekeep_t*)user_data;
+    pthread_mutex_lock(&housekeep->mutex);
+    housekeep->poll_pending = 0;
+    pthread_cond_broadcast(&housekeep->cond);
+    pthread_mutex_unlock(&housekeep->mutex);
+}
+
+int housekeep_init(Housekeep_t* housekeep, const HousekeepParam_t* param)
+{
+    if (housekeep == NULL)
+    {
+        return HOUSEKEEP_ERROR_PARAM;
+    }
+    housekeep->seq.store(0);
+    housekeep->values.store(0);
+    housekeep->timestamp_us.store(0);
+    housekeep->poll_pending = 0;
+    housekeep->meta_vtemp = 0;
+    housekeep->last_poll_us = 0;
+    housekeep->poll_us = 0;
+    memset(&housekeep->stats, 0, sizeof(HousekeepStats_t));
+    if (param != NULL)
+    {
+        housekeep->param = *param;
+    }
+    else
+    {
+        housekeep->param.poll_interval_ms = HOUSEKEEP_POLL_MS;
+        housekeep->param.items = HOUSEKEEP_ALL;
+    }
+    pthread_mutex_init(&housekeep->mutex, NULL);
+    pthread_cond_init(&housekeep->cond, NULL);
+    return HOUSEKEEP_SUCCESS;
+}
+
+void housekeep_release(Housekeep_t* housekeep)
+{
+    if (housekeep == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&housekeep->mutex);
+    while (housekeep->poll_pending)
+    {
+        pthread_cond_wait(&housekeep->cond, &housekeep->mutex);
+    }
+    pthread_mutex_unlock(&housekeep->mutex);
+    pthread_mutex_destroy(&housekeep->mutex);
+    pthread_cond_destroy(&housekeep->cond);
+}
+
+void housekeep_frame(Housekeep_t* housekeep, const FrameMeta_t* meta, uint64_t timestamp_us)
+{
+    if (housekeep == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&housekeep->mutex);
+    if (meta != NULL && (housekeep->param.items & HOUSEKEEP_VTEMP))
+    {
+        HousekeepSnapshot_t snapshot;
+        housekeep_load(housekeep, &snapshot);
+        snapshot.vtemp = meta->vtemp;
+        snapshot.valid |= HOUSEKEEP_VTEMP;
+        snapshot.timestamp_us = timestamp_us;
+        housekeep_store(housekeep, &snapshot);
+        housekeep->meta_vtemp = 1;
+        housekeep->stats.meta_frames++;
+    }
+    uint8_t items = housekeep->param.items & (housekeep->meta_vtemp ? ~HOUSEKEEP_VTEMP : HOUSEKEEP_ALL);
+    if (items != 0 && housekeep->param.poll_interval_ms > 0 && !housekeep->poll_pending && \
+        timestamp_us - housekeep->last_poll_us >= (uint64_t)housekeep->param.poll_interval_ms * 1000)
+    {
+        housekeep->last_poll_us = timestamp_us;
+        housekeep->poll_us = timestamp_us;
+        housekeep->poll_pending = 1;
+        if (cmdq_submit(housekeep_poll, housekeep, CMDQ_PRIORITY_READ, 0, housekeep_poll_done, housekeep, NULL) \
+            != CMDQ_SUCCESS)
+        {
+            housekeep->poll_pending = 0;
+        }
+    }
+    pthread_mutex_unlock(&housekeep->mutex);
+}
+
+int housekeep_get(Housekeep_t* housekeep, HousekeepSnapshot_t* snapshot)
+{
+    if (housekeep == NULL || snapshot == NULL)
+    {
+        return HOUSEKEEP_ERROR_PARAM;
+    }
+    housekeep_load(housekeep, snapshot);
+    return snapshot->valid;
+}
+
+int housekeep_stats(Housekeep_t* housekeep, HousekeepStats_t* stats)
+{
+    if (housekeep == NULL || stats == NULL)
+    {
+        return HOUSEKEEP_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&housekeep->mutex);
+    *stats = housekeep->stats;
+    pthread_mutex_unlock(&housekeep->mutex);
+    return HOUSEKEEP_SUCCESS;
+}
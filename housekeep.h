@@ -0,0 +1,68 @@
+#ifndef _HOUSEKEEP_H_
+#define _HOUSEKEEP_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+#include "ring.h"
+
+#define HOUSEKEEP_POLL_MS 2000          //one batch of reads between two frames through the command queue
+
+#define HOUSEKEEP_VTEMP 0x01            //cur_vtemp_get, taken from the frame's info line instead when it has one
+#define HOUSEKEEP_SHUTTER_VTEMP 0x02    //shutter_vtemp_get
+#define HOUSEKEEP_LENS_VTEMP 0x04       //lens_vtemp_get
+#define HOUSEKEEP_ALL (HOUSEKEEP_VTEMP | HOUSEKEEP_SHUTTER_VTEMP | HOUSEKEEP_LENS_VTEMP)
+
+#define HOUSEKEEP_SUCCESS 0
+#define HOUSEKEEP_ERROR_PARAM -1
+
+typedef struct {
+    uint32_t poll_interval_ms;          //0 polls nothing, only the info line vtemp is taken
+    uint8_t items;                      //HOUSEKEEP_xxx to read
+}HousekeepParam_t;
+
+typedef struct {
+    uint16_t vtemp;                     //the units the vendor commands return
+    uint16_t shutter_vtemp;
+    uint16_t lens_vtemp;
+    uint8_t valid;                      //HOUSEKEEP_xxx read at least once, a failed read keeps the last value
+    uint64_t timestamp_us;              //monotonic time of the last update, 0 before the first
+}HousekeepSnapshot_t;
+
+typedef struct {
+    uint64_t polls;                     //batches run
+    uint64_t failures;                  //single reads that failed
+    uint64_t meta_frames;               //frames whose info line gave the vtemp
+}HousekeepStats_t;
+
+//caches the sensor housekeeping temperatures of one camera: the stream thread schedules the reads at a low rate,
+//the cmdq worker runs them between frames, any thread reads the cache without touching the device
+typedef struct Housekeep_t {
+    HousekeepParam_t param;
+    std::atomic<uint32_t> seq;          //odd while the snapshot is written
+    std::atomic<uint64_t> values;       //vtemp | shutter_vtemp << 16 | lens_vtemp << 32 | valid << 48
+    std::atomic<uint64_t> timestamp_us;
+    uint8_t poll_pending;
+    uint8_t meta_vtemp;                 //the frames carry the vtemp, the batch leaves cur_vtemp_get out
+    uint64_t last_poll_us;
+    uint64_t poll_us;                   //timestamp of the frame that scheduled the running batch
+    HousekeepStats_t stats;
+    pthread_mutex_t mutex;              //serializes the writers and guards the rest
+    pthread_cond_t cond;
+}Housekeep_t;
+
+//param NULL reads HOUSEKEEP_ALL every HOUSEKEEP_POLL_MS
+int housekeep_init(Housekeep_t* housekeep, const HousekeepParam_t* param);
+
+//wait for a queued batch and release
+void housekeep_release(Housekeep_t* housekeep);
+
+//one frame from the stream thread, meta is the frame's parsed info line or NULL without one
+void housekeep_frame(Housekeep_t* housekeep, const FrameMeta_t* meta, uint64_t timestamp_us);
+
+//lock free, no i/o, from any thread. returns HOUSEKEEP_ERROR_PARAM or the valid mask
+int housekeep_get(Housekeep_t* housekeep, HousekeepSnapshot_t* snapshot);
+
+int housekeep_stats(Housekeep_t* housekeep, HousekeepStats_t* stats);
+
+#endif
@@ -0,0 +1,750 @@
+#include "infer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include "ring.h"
+#include "simd.h"
+#include "timing.h"
+#if defined(INFER_ONNXRUNTIME)
+#include <onnxruntime_c_api.h>
+#endif
+
+int infer_init(Infer_t* infer)
+{
+    if (infer == NULL)
+    {
+        return INFER_ERROR_PARAM;
+    }
+    memset(infer, 0, sizeof(Infer_t));
+    pthread_mutex_init(&infer->mutex, NULL);
+    pthread_cond_init(&infer->cond, NULL);
+    return INFER_SUCCESS;
+}
+
+void infer_release(Infer_t* infer)
+{
+    if (infer == NULL)
+    {
+        return;
+    }
+    infer_stop(infer);
+    pthread_cond_destroy(&infer->cond);
+    pthread_mutex_destroy(&infer->mutex);
+    memset(infer, 0, sizeof(Infer_t));
+}
+
+static int infer_elem_size(InferTensorType_t type)
+{
+    return (type == INFER_TENSOR_S8) ? 1 : 4;
+}
+
+//dst = src * a + b in int8 steps as simd_u16_to_s8_fixed's mul/shift/offset, the largest shift that keeps
+//src * mul in 31 bits. b is rounded on its own, the result may be one step off the exact rounding
+static void infer_s8_fixed(double a, double b, uint32_t* mul, int* shift, int32_t* offset)
+{
+    int s = 0;
+    while (s < 30 && a * (double)(1u << (s + 1)) * 65535.0 < 2147483648.0)
+    {
+        s++;
+    }
+    *mul = (uint32_t)(a * (double)(1u << s) + 0.5);
+    *shift = s;
+    double o = floor(b + 0.5);
+    *offset = (int32_t)((o > 32767.0) ? 32767.0 : ((o < -32768.0) ? -32768.0 : o));
+}
+
+//the image plane into one image of the input tensor in a single pass per row, the pad in the same loop
+static void infer_convert(const InferParam_t* param, const FrameSlot_t* slot, uint8_t* dst)
+{
+    const FramePlane_t* plane = &slot->desc.image;
+    double scale = 0.0, offset = 0.0;
+    if (param->norm == INFER_NORM_FIXED)
+    {
+        scale = 1.0 / param->std;
+        offset = -param->mean / param->std;
+    }
+    else
+    {
+        uint16_t min_val = 65535, max_val = 0;
+        if (slot->desc.image_stats != NULL && slot->desc.image_stats->valid)
+        {
+            min_val = slot->desc.image_stats->min_val;
+            max_val = slot->desc.image_stats->max_val;
+        }
+        else
+        {
+            for (uint32_t y = 0; y < plane->height; y++)
+            {
+                uint16_t row_min, row_max;
+                simd_minmax_u16((const uint16_t*)(plane->data + y * plane->stride), plane->width, &row_min, &row_max);
+                min_val = (row_min < min_val) ? row_min : min_val;
+                max_val = (row_max > max_val) ? row_max : max_val;
+            }
+        }
+        double range = (max_val > min_val) ? (double)(max_val - min_val) : 1.0;
+        scale = 1.0 / range;
+        offset = -(double)min_val / range;
+    }
+    int elem_size = infer_elem_size(param->type);
+    uint32_t pad = param->width - plane->width;
+    uint32_t mul = 0;
+    int shift = 0;
+    int32_t s8_offset = 0;
+    if (param->type == INFER_TENSOR_S8)
+    {
+        infer_s8_fixed(scale / param->s8_scale, offset / param->s8_scale + param->s8_zero, &mul, &shift, &s8_offset);
+    }
+    int8_t s8_pad = (int8_t)((param->s8_zero > 127) ? 127 : ((param->s8_zero < -128) ? -128 : param->s8_zero));
+    for (uint32_t y = 0; y < param->height; y++)
+    {
+        uint8_t* row = dst + (size_t)y * param->width * elem_size;
+        uint32_t done = 0;
+        if (y < plane->height)
+        {
+            const uint16_t* src = (const uint16_t*)(plane->data + y * plane->stride);
+            if (param->type == INFER_TENSOR_S8)
+            {
+                simd_u16_to_s8_fixed(src, plane->width, mul, shift, s8_offset, (int8_t*)row);
+            }
+            else
+            {
+                simd_u16_to_f32(src, plane->width, scale, offset, (float*)row);
+            }
+            done = plane->width;
+        }
+        //the pad is rewritten every frame, the cameras of different sizes share the images
+        if (param->type == INFER_TENSOR_S8)
+        {
+            memset(row + done, (uint8_t)s8_pad, (y < plane->height) ? pad : param->width);
+        }
+        else
+        {
+            memset(row + done * 4, 0, ((y < plane->height) ? pad : param->width) * 4);
+        }
+    }
+}
+
+static int infer_plane_fits(const InferParam_t* param, const FramePlane_t* plane)
+{
+    //Y14/Y16 only, the Y8 plane of image_y8 rings has lost the raw values
+    return plane->data != NULL && plane->width > 0 && plane->width <= param->width && \
+        plane->height > 0 && plane->height <= param->height && plane->stride >= plane->width * 2 && \
+        plane->byte_size >= plane->stride * (plane->height - 1) + plane->width * 2;
+}
+
+static void infer_task(FrameSlot_t* slot, void* arg)
+{
+    InferCamera_t* camera = (InferCamera_t*)arg;
+    Infer_t* infer = camera->infer;
+    pthread_mutex_lock(&infer->mutex);
+    if (!infer->running)
+    {
+        pthread_mutex_unlock(&infer->mutex);
+        return;
+    }
+    if ((slot->desc.flags & FRAME_DESC_IMAGE_INVALID) || !infer_plane_fits(&infer->param, &slot->desc.image))
+    {
+        infer->stats.skipped++;
+        pthread_mutex_unlock(&infer->mutex);
+        return;
+    }
+    int camera_index = (int)(camera - infer->cameras);
+    uint64_t now_us = get_monotonic_us();
+    camera->last_us = now_us;
+    InferBatch_t* batch = &infer->batches[infer->fill];
+    if (batch->reserved >= infer->param.batch)
+    {
+        //the backend still has the other batch
+        infer->stats.dropped++;
+        camera->stats.dropped++;
+        pthread_mutex_unlock(&infer->mutex);
+        return;
+    }
+    //an even share per active camera, rounded up so the batch can fill. with NEWEST the camera's next
+    //frame tries the next batch
+    uint32_t active = 0;
+    for (int i = 0; i < infer->camera_num; i++)
+    {
+        active += (now_us - infer->cameras[i].last_us < INFER_ACTIVE_US);
+    }
+    uint32_t share = (infer->param.batch + active - 1) / active;
+    if (batch->shares[camera_index] >= share)
+    {
+        infer->stats.throttled++;
+        camera->stats.throttled++;
+        pthread_mutex_unlock(&infer->mutex);
+        return;
+    }
+    batch->shares[camera_index]++;
+    uint32_t index = batch->reserved++;
+    if (index == 0 || slot->desc.timestamp_us < batch->oldest_us)
+    {
+        batch->oldest_us = slot->desc.timestamp_us;
+    }
+    InferItem_t* item = &batch->items[index];
+    item->camera = camera_index;
+    item->seq = slot->desc.seq;
+    item->timestamp_us = slot->desc.timestamp_us;
+    pthread_mutex_unlock(&infer->mutex);
+
+    //the batch cannot be swapped while one of its images is reserved and not filled
+    infer_convert(&infer->param, slot, batch->tensor + (size_t)index * infer->image_size);
+
+    pthread_mutex_lock(&infer->mutex);
+    batch->filled++;
+    infer->stats.frames++;
+    camera->stats.frames++;
+    pthread_cond_broadcast(&infer->cond);
+    pthread_mutex_unlock(&infer->mutex);
+}
+
+int infer_attach(Infer_t* infer, StreamFrameInfo_t* stream_frame_info)
+{
+    if (infer == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return INFER_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&infer->mutex);
+    if (infer->camera_num >= INFER_MAX_CAMERAS)
+    {
+        pthread_mutex_unlock(&infer->mutex);
+        return INFER_ERROR_PARAM;
+    }
+    int index = infer->camera_num;
+    InferCamera_t* camera = &infer->cameras[index];
+    memset(camera, 0, sizeof(InferCamera_t));
+    camera->infer = infer;
+    camera->stream_frame_info = stream_frame_info;
+    pthread_mutex_unlock(&infer->mutex);
+    //a detector wants the latest frame, the ones behind a busy batch are dropped anyway
+    camera->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEWEST, \
+        POOL_STAGE_OTHER, infer_task, camera);
+    if (camera->consumer_id < 0)
+    {
+        return INFER_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&infer->mutex);
+    infer->camera_num++;
+    pthread_mutex_unlock(&infer->mutex);
+    return index;
+}
+
+//the filled images of the run's output, rows of x0, y0, x1, y1, score, class
+static int infer_decode(Infer_t* infer, const InferBatch_t* batch, const float* output, int rows)
+{
+    uint64_t now_us = get_monotonic_us();
+    for (uint32_t b = 0; b < batch->filled; b++)
+    {
+        const InferItem_t* item = &batch->items[b];
+        InferResult_t* result = &infer->results[b];
+        result->camera = item->camera;
+        result->seq = item->seq;
+        result->timestamp_us = item->timestamp_us;
+        result->latency_us = (uint32_t)((now_us > item->timestamp_us) ? now_us - item->timestamp_us : 0);
+        result->detection_num = 0;
+        const float* row = output + (size_t)b * rows * INFER_DETECTION_FIELDS;
+        for (int r = 0; r < rows && result->detection_num < INFER_MAX_DETECTIONS; r++, row += INFER_DETECTION_FIELDS)
+        {
+            if (!(row[4] >= infer->param.score_threshold))
+            {
+                continue;
+            }
+            InferDetection_t* detection = &result->detections[result->detection_num++];
+            detection->x0 = row[0];
+            detection->y0 = row[1];
+            detection->x1 = row[2];
+            detection->y1 = row[3];
+            detection->score = row[4];
+            detection->class_id = (int32_t)row[5];
+        }
+        timing_record(TIMING_STAGE_INFER, result->latency_us);
+    }
+    return (int)batch->filled;
+}
+
+static void* infer_thread(void* arg)
+{
+    Infer_t* infer = (Infer_t*)arg;
+    pthread_mutex_lock(&infer->mutex);
+    while (1)
+    {
+        InferBatch_t* batch = &infer->batches[infer->fill];
+        uint8_t settled = (batch->filled == batch->reserved);
+        if (infer->quit)
+        {
+            //no converter may still write a tensor that stop frees
+            if (settled)
+            {
+                break;
+            }
+            pthread_cond_wait(&infer->cond, &infer->mutex);
+            continue;
+        }
+        uint64_t deadline_us = batch->oldest_us + infer->param.batch_timeout_us;
+        uint8_t full = (batch->filled == infer->param.batch);
+        uint8_t expired = (infer->param.batch_timeout_us > 0 && batch->filled > 0 && get_monotonic_us() >= deadline_us);
+        if (!settled || !(full || expired))
+        {
+            if (infer->param.batch_timeout_us > 0 && batch->reserved > 0 && settled)
+            {
+                uint64_t now_us = get_monotonic_us();
+                uint64_t wait_us = (deadline_us > now_us) ? deadline_us - now_us : 0;
+                struct timespec deadline;
+#if defined(_WIN32)
+                timespec_get(&deadline, TIME_UTC);
+#else
+                clock_gettime(CLOCK_REALTIME, &deadline);
+#endif
+                deadline.tv_sec += (time_t)(wait_us / 1000000);
+                deadline.tv_nsec += (long)(wait_us % 1000000) * 1000L;
+                if (deadline.tv_nsec >= 1000000000L)
+                {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000000000L;
+                }
+                pthread_cond_timedwait(&infer->cond, &infer->mutex, &deadline);
+            }
+            else
+            {
+                pthread_cond_wait(&infer->cond, &infer->mutex);
+            }
+            continue;
+        }
+        //the cameras go on with the other batch, emptied after its run
+        infer->fill ^= 1;
+        uint64_t start_us = get_monotonic_us();
+        infer->stats.images += batch->filled;
+        for (uint32_t i = 0; i < batch->filled; i++)
+        {
+            const InferItem_t* item = &batch->items[i];
+            InferCameraStats_t* camera_stats = &infer->cameras[item->camera].stats;
+            uint64_t queue_us = (start_us > item->timestamp_us) ? start_us - item->timestamp_us : 0;
+            camera_stats->queue_sum_us += queue_us;
+            camera_stats->queue_max_us = (queue_us > camera_stats->queue_max_us) ? queue_us : camera_stats->queue_max_us;
+            infer->stats.queue_sum_us += queue_us;
+            infer->stats.queue_max_us = (queue_us > infer->stats.queue_max_us) ? queue_us : infer->stats.queue_max_us;
+            timing_record(TIMING_STAGE_INFER_QUEUE, queue_us);
+        }
+        int image_num = infer->param.dynamic_batch ? (int)batch->filled : (int)infer->param.batch;
+        pthread_mutex_unlock(&infer->mutex);
+
+        const float* output = NULL;
+        int rows = 0;
+        int ret = infer->backend->run(infer->backend_ctx, batch->tensor, image_num, &output, &rows);
+        uint64_t run_us = get_monotonic_us() - start_us;
+        int result_num = (ret == INFER_SUCCESS && output != NULL) ? infer_decode(infer, batch, output, rows) : 0;
+
+        pthread_mutex_lock(&infer->mutex);
+        infer->stats.runs++;
+        infer->stats.run_max_us = (run_us > infer->stats.run_max_us) ? run_us : infer->stats.run_max_us;
+        for (int i = 0; i < result_num; i++)
+        {
+            const InferResult_t* result = &infer->results[i];
+            InferCamera_t* camera = &infer->cameras[result->camera];
+            camera->results[camera->result_next] = *result;
+            camera->result_next = (camera->result_next + 1) % INFER_RESULT_HISTORY;
+            infer->stats.detections += result->detection_num;
+            infer->stats.latency_max_us = (result->latency_us > infer->stats.latency_max_us) ? \
+                result->latency_us : infer->stats.latency_max_us;
+        }
+        batch->reserved = 0;
+        batch->filled = 0;
+        memset(batch->shares, 0, sizeof(batch->shares));
+        InferResultFunc_t func = infer->func;
+        void* func_arg = infer->arg;
+        pthread_mutex_unlock(&infer->mutex);
+        //unlocked, the callback may look up other results
+        if (func != NULL && result_num > 0)
+        {
+            func(infer->results, result_num, func_arg);
+        }
+        pthread_mutex_lock(&infer->mutex);
+    }
+    pthread_mutex_unlock(&infer->mutex);
+    return NULL;
+}
+
+int infer_start(Infer_t* infer, const InferParam_t* param, const InferBackend_t* backend, const char* model_path, \
+    InferResultFunc_t func, void* arg)
+{
+    if (infer == NULL || param == NULL || backend == NULL || backend->open == NULL || backend->run == NULL || backend->close == NULL || \
+        param->width == 0 || param->height == 0 || param->batch > INFER_MAX_BATCH || \
+        (param->norm == INFER_NORM_FIXED && !(param->std > 0.0f)) || \
+        (param->type == INFER_TENSOR_S8 && !(param->s8_scale > 0.0f)))
+    {
+        return INFER_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&infer->mutex);
+    if (infer->running || infer->thread_started)
+    {
+        pthread_mutex_unlock(&infer->mutex);
+        return INFER_ERROR_PARAM;
+    }
+    for (int i = 0; i < infer->camera_num; i++)
+    {
+        const FrameInfo_t* image_info = &infer->cameras[i].stream_frame_info->image_info;
+        if (image_info->width > param->width || image_info->height > param->height)
+        {
+            pthread_mutex_unlock(&infer->mutex);
+            return INFER_ERROR_PARAM;
+        }
+    }
+    infer->param = *param;
+    if (infer->param.batch == 0)
+    {
+        infer->param.batch = 1;
+    }
+    infer->image_size = param->width * param->height * infer_elem_size(param->type);
+    int ret = INFER_SUCCESS;
+    for (int i = 0; i < 2 && ret == INFER_SUCCESS; i++)
+    {
+        //zeroed: a partial batch runs with the images behind it, stale but never uninitialized
+        infer->batches[i].tensor = (uint8_t*)calloc(infer->param.batch, infer->image_size);
+        infer->batches[i].reserved = 0;
+        infer->batches[i].filled = 0;
+        memset(infer->batches[i].shares, 0, sizeof(infer->batches[i].shares));
+        ret = (infer->batches[i].tensor != NULL) ? INFER_SUCCESS : INFER_ERROR_MEM;
+    }
+    if (ret == INFER_SUCCESS)
+    {
+        ret = backend->open(&infer->backend_ctx, model_path, &infer->param);
+    }
+    if (ret == INFER_SUCCESS)
+    {
+        infer->backend = backend;
+        infer->func = func;
+        infer->arg = arg;
+        infer->fill = 0;
+        infer->quit = 0;
+        if (pthread_create(&infer->thread, NULL, infer_thread, infer) == 0)
+        {
+            infer->thread_started = 1;
+            infer->running = 1;
+        }
+        else
+        {
+            backend->close(infer->backend_ctx);
+            infer->backend_ctx = NULL;
+            infer->backend = NULL;
+            ret = INFER_ERROR_MEM;
+        }
+    }
+    if (ret != INFER_SUCCESS)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            free(infer->batches[i].tensor);
+            infer->batches[i].tensor = NULL;
+        }
+    }
+    pthread_mutex_unlock(&infer->mutex);
+    return ret;
+}
+
+int infer_stop(Infer_t* infer)
+{
+    if (infer == NULL)
+    {
+        return INFER_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&infer->mutex);
+    if (!infer->thread_started)
+    {
+        pthread_mutex_unlock(&infer->mutex);
+        return INFER_SUCCESS;
+    }
+    infer->running = 0;
+    infer->quit = 1;
+    pthread_cond_broadcast(&infer->cond);
+    pthread_mutex_unlock(&infer->mutex);
+    pthread_join(infer->thread, NULL);
+
+    pthread_mutex_lock(&infer->mutex);
+    infer->thread_started = 0;
+    infer->backend->close(infer->backend_ctx);
+    infer->backend_ctx = NULL;
+    infer->backend = NULL;
+    for (int i = 0; i < 2; i++)
+    {
+        free(infer->batches[i].tensor);
+        infer->batches[i].tensor = NULL;
+        infer->batches[i].reserved = 0;
+        infer->batches[i].filled = 0;
+    }
+    const InferStats_t* stats = &infer->stats;
+    printf("infer: %llu frames, %llu runs, %llu detections, %llu dropped, %llu throttled, %llu skipped, run max %llu us, " \
+        "utilisation %.2f, queue mean %llu us\n", (unsigned long long)stats->frames, (unsigned long long)stats->runs, \
+        (unsigned long long)stats->detections, (unsigned long long)stats->dropped, (unsigned long long)stats->throttled, \
+        (unsigned long long)stats->skipped, (unsigned long long)stats->run_max_us, \
+        stats->runs ? (double)stats->images / (double)(stats->runs * infer->param.batch) : 0.0, \
+        (unsigned long long)(stats->images ? stats->queue_sum_us / stats->images : 0));
+    pthread_mutex_unlock(&infer->mutex);
+    return INFER_SUCCESS;
+}
+
+int infer_result_get(Infer_t* infer, int camera, uint64_t seq, InferResult_t* result)
+{
+    if (infer == NULL || result == NULL || camera < 0 || camera >= infer->camera_num)
+    {
+        return INFER_ERROR_PARAM;
+    }
+    int ret = INFER_ERROR_NOT_FOUND;
+    pthread_mutex_lock(&infer->mutex);
+    const InferCamera_t* cam = &infer->cameras[camera];
+    for (int i = 0; i < INFER_RESULT_HISTORY; i++)
+    {
+        //seq 0 is never published, an unused entry never matches
+        if (cam->results[i].seq == seq && seq != 0)
+        {
+            *result = cam->results[i];
+            ret = INFER_SUCCESS;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&infer->mutex);
+    return ret;
+}
+
+int infer_stats(Infer_t* infer, InferStats_t* stats)
+{
+    if (infer == NULL || stats == NULL)
+    {
+        return INFER_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&infer->mutex);
+    *stats = infer->stats;
+    uint32_t batch = infer->param.batch ? infer->param.batch : 1;
+    stats->utilisation = stats->runs ? (float)((double)stats->images / (double)(stats->runs * batch)) : 0.0f;
+    //(sum x)^2 / (n sum x^2) over the cameras that offered frames
+    double sum = 0.0, sum_sq = 0.0;
+    int n = 0;
+    for (int i = 0; i < infer->camera_num; i++)
+    {
+        const InferCameraStats_t* camera_stats = &infer->cameras[i].stats;
+        if (camera_stats->frames + camera_stats->dropped + camera_stats->throttled > 0)
+        {
+            double x = (double)camera_stats->frames;
+            sum += x;
+            sum_sq += x * x;
+            n++;
+        }
+    }
+    stats->fairness = (sum_sq > 0.0) ? (float)(sum * sum / (n * sum_sq)) : 1.0f;
+    pthread_mutex_unlock(&infer->mutex);
+    return INFER_SUCCESS;
+}
+
+int infer_camera_stats(Infer_t* infer, int camera, InferCameraStats_t* stats)
+{
+    if (infer == NULL || stats == NULL || camera < 0 || camera >= infer->camera_num)
+    {
+        return INFER_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&infer->mutex);
+    *stats = infer->cameras[camera].stats;
+    pthread_mutex_unlock(&infer->mutex);
+    return INFER_SUCCESS;
+}
+
+#if defined(INFER_ONNXRUNTIME)
+typedef struct {
+    const OrtApi* api;
+    OrtEnv* env;
+    OrtSession* session;
+    OrtMemoryInfo* memory_info;
+    OrtValue* output;
+    char* input_name;
+    char* output_name;
+    int64_t shape[4];
+    ONNXTensorElementDataType type;
+    size_t image_size;
+}InferOrt_t;
+
+static int infer_ort_check(const OrtApi* api, OrtStatus* status, const char* what)
+{
+    if (status == NULL)
+    {
+        return INFER_SUCCESS;
+    }
+    printf("infer: onnxruntime %s: %s\n", what, api->GetErrorMessage(status));
+    api->ReleaseStatus(status);
+    return INFER_ERROR_BACKEND;
+}
+
+static void infer_ort_close(void* ctx)
+{
+    InferOrt_t* ort = (InferOrt_t*)ctx;
+    if (ort == NULL)
+    {
+        return;
+    }
+    const OrtApi* api = ort->api;
+    if (ort->output != NULL)
+    {
+        api->ReleaseValue(ort->output);
+    }
+    free(ort->input_name);
+    free(ort->output_name);
+    if (ort->memory_info != NULL)
+    {
+        api->ReleaseMemoryInfo(ort->memory_info);
+    }
+    if (ort->session != NULL)
+    {
+        api->ReleaseSession(ort->session);
+    }
+    if (ort->env != NULL)
+    {
+        api->ReleaseEnv(ort->env);
+    }
+    free(ort);
+}
+
+//the session's name of input or output 0, copied out of the runtime's allocator
+static char* infer_ort_name(InferOrt_t* ort, int output)
+{
+    const OrtApi* api = ort->api;
+    OrtAllocator* allocator = NULL;
+    char* name = NULL;
+    if (infer_ort_check(api, api->GetAllocatorWithDefaultOptions(&allocator), "allocator") != INFER_SUCCESS || \
+        infer_ort_check(api, output ? api->SessionGetOutputName(ort->session, 0, allocator, &name) : \
+        api->SessionGetInputName(ort->session, 0, allocator, &name), "name") != INFER_SUCCESS)
+    {
+        return NULL;
+    }
+    char* copy = strdup(name);
+    api->AllocatorFree(allocator, name);
+    return copy;
+}
+
+static int infer_ort_open(void** ctx, const char* model_path, const InferParam_t* param)
+{
+    if (model_path == NULL)
+    {
+        return INFER_ERROR_PARAM;
+    }
+    InferOrt_t* ort = (InferOrt_t*)calloc(1, sizeof(InferOrt_t));
+    if (ort == NULL)
+    {
+        return INFER_ERROR_MEM;
+    }
+    const OrtApi* api = OrtGetApiBase()->GetApi(ORT_API_VERSION);
+    ort->api = api;
+    int ret = infer_ort_check(api, api->CreateEnv(ORT_LOGGING_LEVEL_WARNING, "infer", &ort->env), "env");
+    OrtSessionOptions* options = NULL;
+    if (ret == INFER_SUCCESS)
+    {
+        ret = infer_ort_check(api, api->CreateSessionOptions(&options), "session options");
+    }
+    if (ret == INFER_SUCCESS)
+    {
+        api->SetSessionGraphOptimizationLevel(options, ORT_ENABLE_ALL);
+        if (param->tensorrt)
+        {
+            //the runtime's defaults, engines are built on the first run. without the provider the cpu runs it
+            OrtTensorRTProviderOptionsV2* trt = NULL;
+            if (infer_ort_check(api, api->CreateTensorRTProviderOptions(&trt), "tensorrt options") == INFER_SUCCESS)
+            {
+                infer_ort_check(api, api->SessionOptionsAppendExecutionProvider_TensorRT_V2(options, trt), "tensorrt");
+                api->ReleaseTensorRTProviderOptions(trt);
+            }
+        }
+        ret = infer_ort_check(api, api->CreateSession(ort->env, model_path, options, &ort->session), "session");
+        api->ReleaseSessionOptions(options);
+    }
+    if (ret == INFER_SUCCESS)
+    {
+        ret = infer_ort_check(api, api->CreateCpuMemoryInfo(OrtArenaAllocator, OrtMemTypeDefault, \
+            &ort->memory_info), "memory info");
+    }
+    if (ret == INFER_SUCCESS)
+    {
+        ort->input_name = infer_ort_name(ort, 0);
+        ort->output_name = infer_ort_name(ort, 1);
+        ret = (ort->input_name != NULL && ort->output_name != NULL) ? INFER_SUCCESS : INFER_ERROR_BACKEND;
+    }
+    if (ret != INFER_SUCCESS)
+    {
+        infer_ort_close(ort);
+        return ret;
+    }
+    ort->shape[0] = param->batch;
+    ort->shape[1] = 1;
+    ort->shape[2] = param->height;
+    ort->shape[3] = param->width;
+    ort->type = (param->type == INFER_TENSOR_S8) ? ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8 : ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+    ort->image_size = (size_t)param->width * param->height * ((param->type == INFER_TENSOR_S8) ? 1 : 4);
+    *ctx = ort;
+    return INFER_SUCCESS;
+}
+
+static int infer_ort_run(void* ctx, const void* input, int image_num, const float** output, int* rows)
+{
+    InferOrt_t* ort = (InferOrt_t*)ctx;
+    const OrtApi* api = ort->api;
+    ort->shape[0] = image_num;
+    if (ort->output != NULL)
+    {
+        api->ReleaseValue(ort->output);
+        ort->output = NULL;
+    }
+    //the batch tensor as it is, no copy into the runtime
+    OrtValue* value = NULL;
+    int ret = infer_ort_check(api, api->CreateTensorWithDataAsOrtValue(ort->memory_info, (void*)input, ort->image_size * image_num, \
+        ort->shape, 4, ort->type, &value), "input");
+    if (ret == INFER_SUCCESS)
+    {
+        const char* input_names[1] = { ort->input_name };
+        const char* output_names[1] = { ort->output_name };
+        ret = infer_ort_check(api, api->Run(ort->session, NULL, input_names, (const OrtValue* const*)&value, 1, \
+            output_names, 1, &ort->output), "run");
+        api->ReleaseValue(value);
+    }
+    OrtTensorTypeAndShapeInfo* info = NULL;
+    if (ret == INFER_SUCCESS)
+    {
+        ret = infer_ort_check(api, api->GetTensorTypeAndShape(ort->output, &info), "output shape");
+    }
+    if (ret == INFER_SUCCESS)
+    {
+        ONNXTensorElementDataType type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+        size_t dim_num = 0;
+        int64_t dims[3] = { 0, 0, 0 };
+        api->GetTensorElementType(info, &type);
+        api->GetDimensionsCount(info, &dim_num);
+        if (dim_num == 3)
+        {
+            api->GetDimensions(info, dims, 3);
+        }
+        api->ReleaseTensorTypeAndShapeInfo(info);
+        if (type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT || dim_num != 3 || dims[0] != ort->shape[0] || \
+            dims[2] != INFER_DETECTION_FIELDS)
+        {
+            printf("infer: the model's output is not float [batch, rows, %d]\n", INFER_DETECTION_FIELDS);
+            ret = INFER_ERROR_BACKEND;
+        }
+        else
+        {
+            void* data = NULL;
+            ret = infer_ort_check(api, api->GetTensorMutableData(ort->output, &data), "output");
+            *output = (const float*)data;
+            *rows = (int)dims[1];
+        }
+    }
+    return ret;
+}
+
+static const InferBackend_t infer_ort_backend = { "onnxruntime", infer_ort_open, infer_ort_run, infer_ort_close };
+
+const InferBackend_t* infer_backend_onnxruntime(void)
+{
+    return &infer_ort_backend;
+}
+#else
+const InferBackend_t* infer_backend_onnxruntime(void)
+{
+    return NULL;
+}
+#endif
@@ -0,0 +1,186 @@
+#ifndef _INFER_H_
+#define _INFER_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+
+#define INFER_MAX_BATCH 8
+#define INFER_MAX_CAMERAS 8
+#define INFER_MAX_DETECTIONS 64         //per frame, the first ones of the model's output above the threshold
+#define INFER_RESULT_HISTORY 4          //results kept per camera for infer_result_get
+#define INFER_DETECTION_FIELDS 6        //model output rows: x0, y0, x1, y1, score, class
+#define INFER_ACTIVE_US 1000000         //a camera without a frame for this long gives its batch share to the others
+
+#define INFER_SUCCESS 0
+#define INFER_ERROR_PARAM -1
+#define INFER_ERROR_MEM -2
+#define INFER_ERROR_BACKEND -3          //the runtime could not load the model or run it
+#define INFER_ERROR_UNAVAILABLE -4      //built without onnxruntime
+#define INFER_ERROR_NOT_FOUND -5        //no result for the frame (yet, or any more)
+
+typedef enum
+{
+    INFER_TENSOR_F32 = 0,
+    INFER_TENSOR_S8,                    //quantized: round(value / s8_scale) + s8_zero
+}InferTensorType_t;
+
+typedef enum
+{
+    INFER_NORM_MINMAX = 0,              //the frame's min..max to 0..1, from the stream thread's image statistics
+    INFER_NORM_FIXED,                   //(raw - mean) / std, the same for every frame
+}InferNorm_t;
+
+typedef struct {
+    InferTensorType_t type;
+    InferNorm_t norm;
+    float mean;                         //INFER_NORM_FIXED, raw image values
+    float std;
+    float s8_scale;                     //INFER_TENSOR_S8, the input's quantization
+    int32_t s8_zero;
+    uint32_t width;                     //model input, NCHW with one channel. the image plane sits top left,
+    uint32_t height;                    //the rest holds the value of 0
+    uint32_t batch;                     //images per run, 0 selects 1, at most INFER_MAX_BATCH
+    uint32_t batch_timeout_us;          //latency deadline: a partial batch runs this long after its oldest frame was
+                                        //received, 0 waits for a full one
+    uint8_t dynamic_batch;              //the model takes any batch size: a partial batch runs only its images
+    float score_threshold;
+    uint8_t tensorrt;                   //onnxruntime: the tensorrt execution provider, cpu when it does not load
+}InferParam_t;
+
+//boxes in input pixels, which are the image plane's pixels
+typedef struct {
+    float x0;
+    float y0;
+    float x1;
+    float y1;
+    float score;
+    int32_t class_id;
+}InferDetection_t;
+
+//the detections of one frame: the slot is read only and released long before they exist,
+//so they carry the frame's seq instead of being written into its FrameDesc_t
+typedef struct {
+    int camera;                         //infer_attach's index
+    uint64_t seq;                       //desc.seq of the frame
+    uint64_t timestamp_us;              //desc.timestamp_us
+    uint32_t latency_us;                //frame received -> detections out
+    int detection_num;
+    InferDetection_t detections[INFER_MAX_DETECTIONS];
+}InferResult_t;
+
+//called from the inference thread with every result of a run
+typedef void (*InferResultFunc_t)(const InferResult_t* results, int result_num, void* arg);
+
+//a model runtime. run takes image_num images of the input tensor (param->batch without dynamic_batch)
+//and returns float [image_num, rows, INFER_DETECTION_FIELDS] detections, valid until the next run or close
+typedef struct {
+    const char* name;
+    int (*open)(void** ctx, const char* model_path, const InferParam_t* param);
+    int (*run)(void* ctx, const void* input, int image_num, const float** output, int* rows);
+    void (*close)(void* ctx);
+}InferBackend_t;
+
+typedef struct {
+    uint64_t frames;                    //converted into a batch
+    uint64_t dropped;                   //both batches busy
+    uint64_t throttled;                 //the camera already had its share of the batch
+    uint64_t skipped;                   //bad image, no 16 bit plane, or larger than the input
+    uint64_t runs;
+    uint64_t images;                    //run images that held a frame
+    uint64_t detections;
+    uint64_t run_max_us;
+    uint64_t queue_sum_us;              //frame received -> its batch dispatched
+    uint64_t queue_max_us;
+    uint64_t latency_max_us;
+    float utilisation;                  //images / (runs * batch), by infer_stats
+    float fairness;                     //jain's index of the frames of the active cameras, 1 is even, by infer_stats
+}InferStats_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t dropped;
+    uint64_t throttled;
+    uint64_t queue_sum_us;
+    uint64_t queue_max_us;
+}InferCameraStats_t;
+
+typedef struct {
+    int camera;
+    uint64_t seq;
+    uint64_t timestamp_us;
+}InferItem_t;
+
+//the converters reserve an image, fill it unlocked and count it filled
+typedef struct {
+    uint8_t* tensor;                    //param.batch images
+    InferItem_t items[INFER_MAX_BATCH];
+    uint8_t shares[INFER_MAX_CAMERAS];  //images of each camera
+    uint32_t reserved;
+    uint32_t filled;
+    uint64_t oldest_us;                 //receive time of the oldest frame, the deadline counts from it
+}InferBatch_t;
+
+struct Infer_t;
+
+typedef struct {
+    struct Infer_t* infer;
+    StreamFrameInfo_t* stream_frame_info;
+    int consumer_id;
+    uint64_t last_us;                   //the last frame offered, for INFER_ACTIVE_US
+    InferCameraStats_t stats;
+    uint32_t result_next;
+    InferResult_t results[INFER_RESULT_HISTORY];
+}InferCamera_t;
+
+//inference over the image planes of up to INFER_MAX_CAMERAS frame rings. each ring task normalizes its
+//Y14 plane straight into the batch tensor in one simd pass, one thread runs the batches through the backend
+//while the cameras fill the other one. a batch runs when full or at its deadline, each active camera gets
+//an even share of it so one fast camera cannot starve the rest
+typedef struct Infer_t {
+    InferParam_t param;
+    const InferBackend_t* backend;
+    void* backend_ctx;
+    InferResultFunc_t func;
+    void* arg;
+    uint8_t running;
+    uint8_t quit;
+    uint32_t image_size;                //bytes of one input image
+    InferBatch_t batches[2];
+    int fill;                           //the batch the cameras write, the other one is with the backend
+    InferCamera_t cameras[INFER_MAX_CAMERAS];
+    int camera_num;
+    InferResult_t results[INFER_MAX_BATCH];
+    pthread_t thread;
+    uint8_t thread_started;
+    InferStats_t stats;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+}Infer_t;
+
+int infer_init(Infer_t* infer);
+
+//stops first
+void infer_release(Infer_t* infer);
+
+//register the camera's frame ring as a source, before streaming, returns the camera index
+//frames are ignored while the inference is not running
+int infer_attach(Infer_t* infer, StreamFrameInfo_t* stream_frame_info);
+
+//open the model and start the inference thread, every attached image plane has to fit the input
+int infer_start(Infer_t* infer, const InferParam_t* param, const InferBackend_t* backend, const char* model_path, \
+    InferResultFunc_t func, void* arg);
+
+int infer_stop(Infer_t* infer);
+
+//the detections of the camera's frame seq, while they are among its last INFER_RESULT_HISTORY
+int infer_result_get(Infer_t* infer, int camera, uint64_t seq, InferResult_t* result);
+
+int infer_stats(Infer_t* infer, InferStats_t* stats);
+
+int infer_camera_stats(Infer_t* infer, int camera, InferCameraStats_t* stats);
+
+//onnxruntime c api, NULL when built without it
+const InferBackend_t* infer_backend_onnxruntime(void);
+
+#endif
@@ -0,0 +1,232 @@
+#include "integrity.h"
+#include <stdio.h>
+#include <string.h>
+
+#define INTEGRITY_HASH_MUL 0x9E3779B97F4A7C15ull
+
+static inline uint64_t integrity_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    return h;
+}
+
+//the sampled raw lines, 8 bytes per multiply
+static uint64_t integrity_hash(const FrameIntegrity_t* integrity, const uint8_t* raw_frame)
+{
+    uint64_t h = 0;
+    uint32_t words = integrity->raw_stride / 8;
+    for (uint32_t i = 0; i < integrity->param.sample_rows; i++)
+    {
+        const uint8_t* line = raw_frame + (size_t)integrity->rows[i] * integrity->raw_stride;
+        for (uint32_t w = 0; w < words; w++)
+        {
+            uint64_t v;
+            memcpy(&v, line + w * 8, 8);
+            h = (h ^ v) * INTEGRITY_HASH_MUL;
+            h = (h << 29) | (h >> 35);
+        }
+    }
+    return integrity_mix(h);
+}
+
+//range and line structure of the temp plane, on its own sampled rows
+static uint32_t integrity_temp_check(const FrameIntegrity_t* integrity, const FramePlane_t* temp)
+{
+    const IntegrityParam_t* param = &integrity->param;
+    uint32_t rows = (param->sample_rows < temp->height) ? param->sample_rows : temp->height;
+    uint32_t sampled = 0, out = 0, flat = 0, steps = 0;
+    for (uint32_t i = 0; i < rows; i++)
+    {
+        uint32_t y = (uint32_t)(((uint64_t)i * 2 + 1) * temp->height / (rows * 2));
+        const uint16_t* line = (const uint16_t*)(temp->data + (size_t)y * temp->stride);
+        uint8_t same = 1;
+        for (uint32_t x = 0; x < temp->width; x++)
+        {
+            same &= (line[x] == line[0]);
+        }
+        flat += same;
+        for (uint32_t x = 0; x < temp->width; x += INTEGRITY_PIXEL_STEP)
+        {
+            out += (line[x] < param->temp_min || line[x] > param->temp_max);
+            sampled++;
+        }
+    }
+    if (param->row_step > 0)
+    {
+        //a transfer that stopped part way leaves the rest of the frame from another one or blank: a step between
+        //two neighbouring rows over the whole width, the means of every row on a quarter of its pixels
+        uint64_t last_sum = 0;
+        uint64_t limit = (uint64_t)param->row_step * ((temp->width + INTEGRITY_PIXEL_STEP - 1) / INTEGRITY_PIXEL_STEP);
+        for (uint32_t y = 0; y < temp->height; y++)
+        {
+            const uint16_t* line = (const uint16_t*)(temp->data + (size_t)y * temp->stride);
+            uint64_t sum = 0;
+            for (uint32_t x = 0; x < temp->width; x += INTEGRITY_PIXEL_STEP)
+            {
+                sum += line[x];
+            }
+            steps += (y > 0 && ((sum > last_sum) ? sum - last_sum : last_sum - sum) > limit);
+            last_sum = sum;
+        }
+    }
+    uint32_t found = 0;
+    if (sampled > 0 && out > sampled * param->range_share)
+    {
+        found |= INTEGRITY_RANGE;
+    }
+    if (flat > 0 || steps > 0)
+    {
+        found |= INTEGRITY_STRUCTURE;
+    }
+    return found;
+}
+
+void integrity_default_param(IntegrityParam_t* param)
+{
+    if (param == NULL)
+    {
+        return;
+    }
+    memset(param, 0, sizeof(IntegrityParam_t));
+    param->sample_rows = INTEGRITY_DEFAULT_SAMPLE_ROWS;
+    param->temp_min = INTEGRITY_DEFAULT_TEMP_MIN;
+    param->temp_max = INTEGRITY_DEFAULT_TEMP_MAX;
+    param->range_share = INTEGRITY_DEFAULT_RANGE_SHARE;
+    param->row_step = INTEGRITY_DEFAULT_ROW_STEP;
+    param->drop = 1;
+    param->restart_ms = INTEGRITY_DEFAULT_RESTART_MS;
+}
+
+int integrity_init(FrameIntegrity_t* integrity, const IntegrityParam_t* param, StreamFrameInfo_t* stream_frame_info)
+{
+    if (integrity == NULL || stream_frame_info == NULL || stream_frame_info->camera_param.width == 0 || \
+        stream_frame_info->camera_param.frame_size == 0)
+    {
+        return INTEGRITY_ERROR_PARAM;
+    }
+    IntegrityParam_t default_param;
+    if (param == NULL)
+    {
+        integrity_default_param(&default_param);
+        param = &default_param;
+    }
+    if (param->sample_rows > INTEGRITY_MAX_SAMPLE_ROWS || param->temp_min >= param->temp_max)
+    {
+        return INTEGRITY_ERROR_PARAM;
+    }
+    integrity->param = *param;
+    if (integrity->param.sample_rows == 0)
+    {
+        integrity->param.sample_rows = INTEGRITY_DEFAULT_SAMPLE_ROWS;
+    }
+    integrity->stream_frame_info = stream_frame_info;
+    integrity->raw_stride = stream_frame_info->camera_param.width * 2;
+    integrity->raw_rows = stream_frame_info->camera_param.frame_size / integrity->raw_stride;
+    if (integrity->param.sample_rows > integrity->raw_rows)
+    {
+        integrity->param.sample_rows = integrity->raw_rows;
+    }
+    for (uint32_t i = 0; i < integrity->param.sample_rows; i++)
+    {
+        //both halves of a stacked frame, and each line once
+        integrity->rows[i] = (uint32_t)(((uint64_t)i * 2 + 1) * integrity->raw_rows / (integrity->param.sample_rows * 2));
+    }
+    integrity->last_hash = 0;
+    integrity->hash_valid = 0;
+    integrity->bad_since_us = 0;
+    memset(&integrity->stats, 0, sizeof(IntegrityStats_t));
+    sync_mutex_init(&integrity->mutex);
+    stream_frame_info->integrity = integrity;
+    printf("frame integrity: %u of %u lines hashed, temp %.0f..%.0fC, bad frames %s\n", integrity->param.sample_rows, \
+        integrity->raw_rows, temp_celsius_of_raw(integrity->param.temp_min), \
+        temp_celsius_of_raw(integrity->param.temp_max), integrity->param.drop ? "dropped" : "tagged");
+    return INTEGRITY_SUCCESS;
+}
+
+void integrity_release(FrameIntegrity_t* integrity)
+{
+    if (integrity == NULL || integrity->stream_frame_info == NULL)
+    {
+        return;
+    }
+    if (integrity->stream_frame_info->integrity == integrity)
+    {
+        integrity->stream_frame_info->integrity = NULL;
+    }
+    integrity->stream_frame_info = NULL;
+    sync_mutex_destroy(&integrity->mutex);
+}
+
+uint32_t integrity_frame(FrameIntegrity_t* integrity, const FrameSlot_t* slot, uint64_t timestamp_us)
+{
+    uint32_t found = 0;
+    uint64_t hash = integrity_hash(integrity, slot->raw_frame);
+    //a module holds its output during the nuc, and the temperatures are off while the gain switches
+    if (integrity->hash_valid && hash == integrity->last_hash && !(slot->tag_flags & FRAME_DESC_IMAGE_INVALID))
+    {
+        found |= INTEGRITY_FROZEN;
+    }
+    integrity->last_hash = hash;
+    integrity->hash_valid = 1;
+    if (slot->desc.temp.data != NULL && slot->desc.temp.width > 0 && !(slot->tag_flags & FRAME_DESC_TEMP_INVALID))
+    {
+        found |= integrity_temp_check(integrity, &slot->desc.temp);
+    }
+
+    sync_mutex_lock(&integrity->mutex);
+    IntegrityStats_t* stats = &integrity->stats;
+    stats->frames++;
+    stats->frozen += (found & INTEGRITY_FROZEN) != 0;
+    stats->range += (found & INTEGRITY_RANGE) != 0;
+    stats->structure += (found & INTEGRITY_STRUCTURE) != 0;
+    if (found != 0)
+    {
+        stats->bad++;
+        stats->bad_run++;
+        stats->bad_run_max = (stats->bad_run > stats->bad_run_max) ? stats->bad_run : stats->bad_run_max;
+    }
+    else
+    {
+        stats->bad_run = 0;
+    }
+    sync_mutex_unlock(&integrity->mutex);
+    if (found == 0)
+    {
+        integrity->bad_since_us = 0;
+    }
+    else if (integrity->bad_since_us == 0)
+    {
+        integrity->bad_since_us = timestamp_us;
+    }
+    return found;
+}
+
+int integrity_restart_due(FrameIntegrity_t* integrity, uint64_t now_us)
+{
+    return integrity->param.restart_ms > 0 && integrity->bad_since_us != 0 && \
+        now_us - integrity->bad_since_us >= integrity->param.restart_ms * 1000ull;
+}
+
+void integrity_restarted(FrameIntegrity_t* integrity)
+{
+    integrity->hash_valid = 0;
+    integrity->bad_since_us = 0;
+    sync_mutex_lock(&integrity->mutex);
+    integrity->stats.restarts++;
+    integrity->stats.bad_run = 0;
+    sync_mutex_unlock(&integrity->mutex);
+}
+
+int integrity_stats(FrameIntegrity_t* integrity, IntegrityStats_t* stats)
+{
+    if (integrity == NULL || stats == NULL)
+    {
+        return INTEGRITY_ERROR_PARAM;
+    }
+    sync_mutex_lock(&integrity->mutex);
+    *stats = integrity->stats;
+    sync_mutex_unlock(&integrity->mutex);
+    return INTEGRITY_SUCCESS;
+}
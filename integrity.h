@@ -0,0 +1,85 @@
+#ifndef _INTEGRITY_H_
+#define _INTEGRITY_H_
+
+//frame integrity on the stream thread, for the frames uvc_frame_get returns without an error that are still bad:
+//a stale buffer handed out again (the 64 bit hash of sample_rows rows spread over the raw frame equals the last
+//one, real sensors never repeat a frame to the bit) and a partly written transfer (temp plane pixels out of
+//temp_min..temp_max, rows of one value, a row step no scene has). bad frames are dropped, or tagged
+//FRAME_DESC_CORRUPT for the consumers to skip, and restart_ms of nothing but bad frames restarts the stream.
+//frames the shutter monitor tagged as nuc may repeat, they are left alone
+#include <stdint.h>
+#include "sync.h"
+#include "data.h"
+#include "tempunit.h"
+
+#define INTEGRITY_DEFAULT_SAMPLE_ROWS 16
+#define INTEGRITY_MAX_SAMPLE_ROWS 64
+#define INTEGRITY_DEFAULT_TEMP_MIN TEMP_RAW_OF_CELSIUS(-45)
+#define INTEGRITY_DEFAULT_TEMP_MAX TEMP_RAW_OF_CELSIUS(650)
+#define INTEGRITY_DEFAULT_RANGE_SHARE 0.05f     //of the sampled pixels out of range
+#define INTEGRITY_DEFAULT_ROW_STEP TEMP_RAW_OF_KELVIN_DELTA(40)  //mean difference of two neighbouring rows
+#define INTEGRITY_DEFAULT_RESTART_MS 2000
+#define INTEGRITY_PIXEL_STEP 4                  //every 4th pixel of a sampled row for the range
+
+//what integrity_frame found, 0 for a good frame
+#define INTEGRITY_FROZEN 0x01
+#define INTEGRITY_RANGE 0x02
+#define INTEGRITY_STRUCTURE 0x04
+
+#define INTEGRITY_SUCCESS 0
+#define INTEGRITY_ERROR_PARAM -1
+
+typedef struct {
+    uint32_t sample_rows;               //0 selects INTEGRITY_DEFAULT_SAMPLE_ROWS
+    uint16_t temp_min;                  //raw temp unit
+    uint16_t temp_max;
+    float range_share;
+    uint32_t row_step;                  //raw temp unit, 0 checks no steps
+    uint8_t drop;                       //1 drops bad frames, 0 commits them tagged FRAME_DESC_CORRUPT
+    uint32_t restart_ms;                //0 never restarts
+}IntegrityParam_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t frozen;
+    uint64_t range;
+    uint64_t structure;
+    uint64_t bad;                       //frames with any of them
+    uint64_t restarts;                  //stream restarts of the watchdog
+    uint32_t bad_run;                   //the current run of bad frames
+    uint32_t bad_run_max;
+}IntegrityStats_t;
+
+typedef struct FrameIntegrity_t {
+    IntegrityParam_t param;
+    StreamFrameInfo_t* stream_frame_info;
+    uint32_t raw_stride;                //bytes per raw line
+    uint32_t raw_rows;
+    uint32_t rows[INTEGRITY_MAX_SAMPLE_ROWS];   //sampled raw lines
+    //stream thread only
+    uint64_t last_hash;
+    uint8_t hash_valid;
+    uint64_t bad_since_us;              //first frame of the current bad run, 0 without one
+    IntegrityStats_t stats;
+    sync_mutex_t mutex;                 //stats against integrity_stats
+}FrameIntegrity_t;
+
+void integrity_default_param(IntegrityParam_t* param);
+
+//hook the checks into the stream thread of stream_frame_info, after the camera is open. param NULL: the defaults
+int integrity_init(FrameIntegrity_t* integrity, const IntegrityParam_t* param, StreamFrameInfo_t* stream_frame_info);
+
+void integrity_release(FrameIntegrity_t* integrity);
+
+//stream thread: the prepared slot, returns the INTEGRITY_xxx it found
+uint32_t integrity_frame(FrameIntegrity_t* integrity, const FrameSlot_t* slot, uint64_t timestamp_us);
+
+//stream thread: the frames were bad for restart_ms
+int integrity_restart_due(FrameIntegrity_t* integrity, uint64_t now_us);
+
+//stream thread: the stream restarted, the next frame starts over
+void integrity_restarted(FrameIntegrity_t* integrity);
+
+int integrity_stats(FrameIntegrity_t* integrity, IntegrityStats_t* stats);
+
+#endif
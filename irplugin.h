@@ -0,0 +1,136 @@
+#ifndef _IRPLUGIN_H_
+#define _IRPLUGIN_H_
+
+//versioned c abi of the analytics plug-ins, shared objects the host (plugin.h) loads at run time and runs once per
+//frame as a node of the camera's graph: on the task pool, on the frame's ring slot itself, within a cpu budget the
+//plug-in declares. a plug-in includes only this header and exports one function, irp_plugin_describe, that returns
+//its IrpPluginDesc_t. the same layout rules as thermal_pipeline.h: fixed width fields, 64 bit fields 8 byte
+//aligned with explicit padding, pointers last, structs that grow start with struct_size
+//    extern "C" IRP_EXPORT const IrpPluginDesc_t* irp_plugin_describe(void) { return &my_desc; }
+//everything the host passes is valid during the call only and must only be read, a plug-in that keeps a result
+//copies it into its state. the calls on one state never overlap, create and destroy may run on other threads
+//than on_frame, and a reload creates the new state while the old one may still be in on_frame
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+#define IRP_EXPORT __declspec(dllexport)
+#else
+#define IRP_EXPORT __attribute__((visibility("default")))
+#endif
+
+//the host refuses a plug-in of another major version, the minor version grows when something is added at the end
+#define IRP_ABI_VERSION_MAJOR 1
+#define IRP_ABI_VERSION_MINOR 0
+#define IRP_ABI_VERSION ((IRP_ABI_VERSION_MAJOR << 16) | IRP_ABI_VERSION_MINOR)
+
+#define IRP_DESCRIBE_SYMBOL "irp_plugin_describe"
+
+#define IRP_SUCCESS 0                  //on_frame and create return it or a negative error of their own
+#define IRP_NAME_LEN 32
+#define IRP_TEXT_LEN 48
+#define IRP_MAX_VALUES 16
+#define IRP_MAX_EVENTS 8
+#define IRP_HIST_BINS 256
+
+//IrpPluginDesc_t inputs, the planes on_frame reads. a plane it does not ask for may still be there
+#define IRP_INPUT_TEMP 0x01
+#define IRP_INPUT_IMAGE 0x02
+
+//IrpPlane_t format
+#define IRP_FORMAT_NONE 0              //the frame has no such plane, data is NULL
+#define IRP_FORMAT_Y14 1               //uint16 temperatures in 1/64 K
+#define IRP_FORMAT_Y16 2               //uint16
+#define IRP_FORMAT_YUYV 3              //yuv 4:2:2, two bytes a pixel
+#define IRP_FORMAT_Y8 4
+
+//IrpFrameView_t flags, what the host knew about the frame
+#define IRP_FRAME_TEMP_INVALID 0x01    //shutter, nuc, gain switch or a skipped temp cut: the temperatures are off
+#define IRP_FRAME_IMAGE_INVALID 0x02   //shutter or a corrupt transfer
+#define IRP_FRAME_HDR 0x04             //the temp plane is the dual gain fusion, extended range
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;                    //bytes per row
+    uint32_t format;                    //IRP_FORMAT_xxx
+    const void* data;
+}IrpPlane_t;
+
+typedef struct {
+    uint32_t struct_size;               //sizeof(IrpFrameView_t) of the host, more than a plug-in knows is fine
+    uint32_t flags;                     //IRP_FRAME_xxx
+    uint64_t seq;                       //grows, a gap is a frame the plug-in did not get
+    uint64_t timestamp_us;              //capture time, monotonic clock
+    uint64_t deadline_us;               //the same clock: the call should return by then, what is left of the budget
+    IrpPlane_t temp;
+    IrpPlane_t image;
+}IrpFrameView_t;
+
+//statistics of one plane, computed once by the stream thread, shared by every consumer
+typedef struct {
+    uint8_t valid;
+    uint8_t reserved0;
+    uint16_t min_val;
+    uint16_t max_val;
+    uint16_t min_x;                     //first pixel of min_val in row order
+    uint16_t min_y;
+    uint16_t max_x;
+    uint16_t max_y;
+    uint16_t reserved1;
+    uint32_t pix_num;
+    float mean;
+    uint32_t hist_low;                  //bin i counts [hist_low + i * hist_bin_width, hist_low + (i + 1) * hist_bin_width)
+    uint32_t hist_bin_width;
+    uint32_t hist[IRP_HIST_BINS];
+}IrpPlaneStats_t;
+
+typedef struct {
+    const IrpPlaneStats_t* temp;        //NULL when the stream computed none for the frame
+    const IrpPlaneStats_t* image;
+}IrpFrameStats_t;
+
+typedef struct {
+    char name[IRP_NAME_LEN];
+    double value;
+}IrpValue_t;
+
+typedef struct {
+    int32_t code;                       //the plug-in's own
+    int32_t x;                          //where in the frame, -1 for none
+    int32_t y;
+    float value;
+    char text[IRP_TEXT_LEN];
+}IrpEvent_t;
+
+//what on_frame found, the host clears the counts before each call and hands the rest to its output callback
+typedef struct {
+    uint32_t value_num;                 //at most IRP_MAX_VALUES
+    uint32_t event_num;                 //at most IRP_MAX_EVENTS
+    IrpValue_t values[IRP_MAX_VALUES];  //measurements of the frame
+    IrpEvent_t events[IRP_MAX_EVENTS];  //findings worth a notice
+}IrpOutputs_t;
+
+typedef struct {
+    uint32_t struct_size;               //sizeof(IrpPluginDesc_t)
+    uint32_t abi_version;               //IRP_ABI_VERSION
+    uint32_t inputs;                    //IRP_INPUT_xxx
+    uint32_t budget_us;                 //cpu time on_frame may take per frame on average, 0 the host's default
+    const char* name;
+    //config is the host's text for the plug-in (NULL without), *state what the other calls get
+    int (*create)(const char* config, void** state);
+    void (*destroy)(void* state);
+    int (*on_frame)(void* state, const IrpFrameView_t* view, const IrpFrameStats_t* stats, IrpOutputs_t* outputs);
+}IrpPluginDesc_t;
+
+typedef const IrpPluginDesc_t* (*IrpDescribeFunc_t)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
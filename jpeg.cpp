@@ -0,0 +1,602 @@
+#include "jpeg.h"
+#include <string.h>
+#if defined(JPEG_TURBO)
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <jpeglib.h>
+#endif
+
+#define JPEG_BLOCK_BOUND 420            //one coded 8x8 block at worst, every byte stuffed
+#define JPEG_HEADER_BOUND 1024          //SOI to SOS and EOI
+
+static const uint8_t jpeg_zigzag[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+
+//Annex K, natural order
+static const uint8_t jpeg_std_quant[2][64] = {
+    { 16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99 },
+    { 17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99 } };
+
+static const uint8_t jpeg_dc_bits[2][16] = {
+    { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 } };
+
+static const uint8_t jpeg_dc_vals[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t jpeg_ac_bits[2][16] = {
+    { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d },
+    { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 } };
+
+static const uint8_t jpeg_ac_vals[2][162] = {
+    { 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa },
+    { 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa } };
+
+static const float jpeg_aan_scale[8] = { 1.0f, 1.387039845f, 1.306562965f, 1.175875602f, \
+    1.0f, 0.785694958f, 0.541196100f, 0.275899379f };
+
+//canonical codes of one table (Annex C)
+static void jpeg_huffman_build(const uint8_t* bits, const uint8_t* vals, uint16_t* code, uint8_t* code_len)
+{
+    uint16_t next = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; len++)
+    {
+        for (int i = 0; i < bits[len - 1]; i++, k++)
+        {
+            code[vals[k]] = next++;
+            code_len[vals[k]] = (uint8_t)len;
+        }
+        next <<= 1;
+    }
+}
+
+int jpeg_init(JpegEncoder_t* enc, int quality)
+{
+    if (enc == NULL || quality < 1 || quality > 100)
+    {
+        return JPEG_ERROR_PARAM;
+    }
+    memset(enc, 0, sizeof(JpegEncoder_t));
+    enc->quality = quality;
+    int percent = (quality < 50) ? 5000 / quality : 200 - quality * 2;
+    for (int t = 0; t < 2; t++)
+    {
+        for (int k = 0; k < 64; k++)
+        {
+            int n = jpeg_zigzag[k];
+            int q = (jpeg_std_quant[t][n] * percent + 50) / 100;
+            q = (q < 1) ? 1 : ((q > 255) ? 255 : q);
+            enc->quant[t][k] = (uint8_t)q;
+            enc->scale[t][n] = 1.0f / (q * jpeg_aan_scale[n >> 3] * jpeg_aan_scale[n & 7] * 8.0f);
+        }
+        jpeg_huffman_build(jpeg_dc_bits[t], jpeg_dc_vals, enc->code[t * 2], enc->code_len[t * 2]);
+        jpeg_huffman_build(jpeg_ac_bits[t], jpeg_ac_vals[t], enc->code[t * 2 + 1], enc->code_len[t * 2 + 1]);
+    }
+    return JPEG_SUCCESS;
+}
+
+uint32_t jpeg_bound(uint32_t width, uint32_t height, uint32_t app_size)
+{
+    //16x16 macroblocks of 4:4:4 blocks, which covers the padded 4:2:0 ones
+    uint32_t blocks = ((width + 15) / 16) * ((height + 15) / 16) * 12;
+    return JPEG_HEADER_BOUND + app_size + blocks * JPEG_BLOCK_BOUND;
+}
+
+typedef struct {
+    uint8_t* dst;
+    uint32_t acc;
+    int bits;
+}JpegBits_t;
+
+static inline void jpeg_bits_put(JpegBits_t* bw, uint32_t code, int len)
+{
+    bw->acc = (bw->acc << len) | code;
+    bw->bits += len;
+    while (bw->bits >= 8)
+    {
+        uint8_t byte = (uint8_t)(bw->acc >> (bw->bits - 8));
+        *bw->dst++ = byte;
+        if (byte == 0xFF)
+        {
+            *bw->dst++ = 0;
+        }
+        bw->bits -= 8;
+    }
+    bw->acc &= (1u << bw->bits) - 1;
+}
+
+//AAN float forward dct of one row or column, stride apart
+static inline void jpeg_fdct8(float* d, int stride)
+{
+    float tmp0 = d[0] + d[7 * stride], tmp7 = d[0] - d[7 * stride];
+    float tmp1 = d[stride] + d[6 * stride], tmp6 = d[stride] - d[6 * stride];
+    float tmp2 = d[2 * stride] + d[5 * stride], tmp5 = d[2 * stride] - d[5 * stride];
+    float tmp3 = d[3 * stride] + d[4 * stride], tmp4 = d[3 * stride] - d[4 * stride];
+
+    float tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+    float tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+    d[0] = tmp10 + tmp11;
+    d[4 * stride] = tmp10 - tmp11;
+    float z1 = (tmp12 + tmp13) * 0.707106781f;
+    d[2 * stride] = tmp13 + z1;
+    d[6 * stride] = tmp13 - z1;
+
+    tmp10 = tmp4 + tmp5;
+    tmp11 = tmp5 + tmp6;
+    tmp12 = tmp6 + tmp7;
+    float z5 = (tmp10 - tmp12) * 0.382683433f;
+    float z2 = 0.541196100f * tmp10 + z5;
+    float z4 = 1.306562965f * tmp12 + z5;
+    float z3 = tmp11 * 0.707106781f;
+    float z11 = tmp7 + z3, z13 = tmp7 - z3;
+    d[5 * stride] = z13 + z2;
+    d[3 * stride] = z13 - z2;
+    d[stride] = z11 + z4;
+    d[7 * stride] = z11 - z4;
+}
+
+//bits of |v|, the huffman category
+static inline int jpeg_category(int v)
+{
+    v = (v < 0) ? -v : v;
+    int n = 0;
+    while (v > 0)
+    {
+        n++;
+        v >>= 1;
+    }
+    return n;
+}
+
+static void jpeg_block_encode(const JpegEncoder_t* enc, JpegBits_t* bw, float* block, int t, int* dc_pred)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        jpeg_fdct8(block + i * 8, 1);
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        jpeg_fdct8(block + i, 8);
+    }
+    int coef[64];
+    for (int k = 0; k < 64; k++)
+    {
+        int n = jpeg_zigzag[k];
+        float v = block[n] * enc->scale[t][n];
+        coef[k] = (int)((v < 0) ? v - 0.5f : v + 0.5f);
+    }
+
+    const uint16_t* dc_code = enc->code[t * 2];
+    const uint8_t* dc_len = enc->code_len[t * 2];
+    const uint16_t* ac_code = enc->code[t * 2 + 1];
+    const uint8_t* ac_len = enc->code_len[t * 2 + 1];
+    int diff = coef[0] - *dc_pred;
+    *dc_pred = coef[0];
+    int cat = jpeg_category(diff);
+    jpeg_bits_put(bw, dc_code[cat], dc_len[cat]);
+    if (cat > 0)
+    {
+        jpeg_bits_put(bw, (uint32_t)((diff < 0) ? diff - 1 : diff) & ((1u << cat) - 1), cat);
+    }
+    int run = 0;
+    for (int k = 1; k < 64; k++)
+    {
+        if (coef[k] == 0)
+        {
+            run++;
+            continue;
+        }
+        while (run >= 16)
+        {
+            jpeg_bits_put(bw, ac_code[0xF0], ac_len[0xF0]);
+            run -= 16;
+        }
+        cat = jpeg_category(coef[k]);
+        int symbol = (run << 4) | cat;
+        jpeg_bits_put(bw, ac_code[symbol], ac_len[symbol]);
+        jpeg_bits_put(bw, (uint32_t)((coef[k] < 0) ? coef[k] - 1 : coef[k]) & ((1u << cat) - 1), cat);
+        run = 0;
+    }
+    if (run > 0)
+    {
+        jpeg_bits_put(bw, ac_code[0x00], ac_len[0x00]);
+    }
+}
+
+static uint8_t* jpeg_put16(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+    return p + 2;
+}
+
+static uint8_t* jpeg_dht(uint8_t* p, int table_class, int id, const uint8_t* bits, const uint8_t* vals)
+{
+    int num = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        num += bits[i];
+    }
+    *p++ = 0xFF;
+    *p++ = 0xC4;
+    p = jpeg_put16(p, 2 + 1 + 16 + num);
+    *p++ = (uint8_t)((table_class << 4) | id);
+    memcpy(p, bits, 16);
+    memcpy(p + 16, vals, num);
+    return p + 16 + num;
+}
+
+//SOI to SOS of a baseline file, luma sampling 0x11 (4:4:4) or 0x22 (4:2:0). returns the entropy coded start
+static uint8_t* jpeg_headers(const JpegEncoder_t* enc, uint32_t width, uint32_t height, int luma_sampling, \
+    const uint8_t* app, uint32_t app_size, uint8_t* dst)
+{
+    static const uint8_t jfif[18] = { 0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+    uint8_t* p = dst;
+    *p++ = 0xFF;
+    *p++ = 0xD8;
+    memcpy(p, jfif, sizeof(jfif));
+    p += sizeof(jfif);
+    if (app_size > 0)
+    {
+        memcpy(p, app, app_size);
+        p += app_size;
+    }
+    *p++ = 0xFF;
+    *p++ = 0xDB;
+    p = jpeg_put16(p, 2 + 2 * 65);
+    for (int t = 0; t < 2; t++)
+    {
+        *p++ = (uint8_t)t;
+        memcpy(p, enc->quant[t], 64);
+        p += 64;
+    }
+    //components 2 and 3 one sample per block on the chroma tables
+    *p++ = 0xFF;
+    *p++ = 0xC0;
+    p = jpeg_put16(p, 8 + 3 * 3);
+    *p++ = 8;
+    p = jpeg_put16(p, height);
+    p = jpeg_put16(p, width);
+    *p++ = 3;
+    for (int c = 0; c < 3; c++)
+    {
+        *p++ = (uint8_t)(c + 1);
+        *p++ = (uint8_t)((c > 0) ? 0x11 : luma_sampling);
+        *p++ = (uint8_t)(c > 0);
+    }
+    for (int t = 0; t < 2; t++)
+    {
+        p = jpeg_dht(p, 0, t, jpeg_dc_bits[t], jpeg_dc_vals);
+        p = jpeg_dht(p, 1, t, jpeg_ac_bits[t], jpeg_ac_vals[t]);
+    }
+    *p++ = 0xFF;
+    *p++ = 0xDA;
+    p = jpeg_put16(p, 6 + 2 * 3);
+    *p++ = 3;
+    for (int c = 0; c < 3; c++)
+    {
+        *p++ = (uint8_t)(c + 1);
+        *p++ = (c > 0) ? 0x11 : 0x00;
+    }
+    *p++ = 0;
+    *p++ = 63;
+    *p++ = 0;
+    return p;
+}
+
+//the last byte padded with 1 bits and EOI, returns the file size
+static int jpeg_finish(JpegBits_t* bw, uint8_t* dst)
+{
+    if (bw->bits > 0)
+    {
+        jpeg_bits_put(bw, (1u << (8 - bw->bits)) - 1, 8 - bw->bits);
+    }
+    uint8_t* p = bw->dst;
+    *p++ = 0xFF;
+    *p++ = 0xD9;
+    return (int)(p - dst);
+}
+
+int jpeg_encode(const JpegEncoder_t* enc, const uint8_t* ycc, uint32_t width, uint32_t height, \
+    const uint8_t* app, uint32_t app_size, uint8_t* dst, uint32_t dst_size)
+{
+    if (enc == NULL || ycc == NULL || dst == NULL || width == 0 || height == 0 || width > 0xFFFF || \
+        height > 0xFFFF || (app == NULL && app_size > 0))
+    {
+        return JPEG_ERROR_PARAM;
+    }
+    if (dst_size < jpeg_bound(width, height, app_size))
+    {
+        return JPEG_ERROR_SIZE;
+    }
+    uint8_t* p = jpeg_headers(enc, width, height, 0x11, app, app_size, dst);
+
+    //interleaved blocks, the right and bottom edges repeat the last pixel
+    JpegBits_t bw = { p, 0, 0 };
+    int dc_pred[3] = { 0, 0, 0 };
+    float block[64];
+    for (uint32_t by = 0; by < height; by += 8)
+    {
+        for (uint32_t bx = 0; bx < width; bx += 8)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                for (int y = 0; y < 8; y++)
+                {
+                    uint32_t sy = (by + y < height) ? by + y : height - 1;
+                    const uint8_t* row = ycc + (size_t)sy * width * 3;
+                    for (int x = 0; x < 8; x++)
+                    {
+                        uint32_t sx = (bx + x < width) ? bx + x : width - 1;
+                        block[y * 8 + x] = (float)row[sx * 3 + c] - 128.0f;
+                    }
+                }
+                jpeg_block_encode(enc, &bw, block, (c > 0), &dc_pred[c]);
+            }
+        }
+    }
+    return jpeg_finish(&bw, dst);
+}
+
+uint32_t jpeg_yuv420_size(uint32_t width, uint32_t height)
+{
+    uint32_t padded_width = (width + 15) & ~15u;
+    uint32_t padded_height = (height + 15) & ~15u;
+    return padded_width * padded_height / 2 * 3;
+}
+
+void jpeg_yuv420_planes(JpegYuv420_t* yuv, uint8_t* data, uint32_t width, uint32_t height)
+{
+    uint32_t padded_width = (width + 15) & ~15u;
+    uint32_t padded_height = (height + 15) & ~15u;
+    yuv->width = width;
+    yuv->height = height;
+    yuv->stride[0] = padded_width;
+    yuv->stride[1] = padded_width / 2;
+    yuv->stride[2] = padded_width / 2;
+    yuv->plane[0] = data;
+    yuv->plane[1] = data + padded_width * padded_height;
+    yuv->plane[2] = yuv->plane[1] + padded_width * padded_height / 4;
+}
+
+static void jpeg_block_load(float* block, const uint8_t* src, uint32_t stride)
+{
+    for (int y = 0; y < 8; y++)
+    {
+        for (int x = 0; x < 8; x++)
+        {
+            block[y * 8 + x] = (float)src[x] - 128.0f;
+        }
+        src += stride;
+    }
+}
+
+static int jpeg_yuv420_builtin(const JpegEncoder_t* enc, const JpegYuv420_t* yuv, const uint8_t* app, \
+    uint32_t app_size, uint8_t* dst)
+{
+    uint8_t* p = jpeg_headers(enc, yuv->width, yuv->height, 0x22, app, app_size, dst);
+    //macroblocks of four luma blocks, then the Cb and the Cr block
+    JpegBits_t bw = { p, 0, 0 };
+    int dc_pred[3] = { 0, 0, 0 };
+    float block[64];
+    for (uint32_t by = 0; by < yuv->height; by += 16)
+    {
+        for (uint32_t bx = 0; bx < yuv->width; bx += 16)
+        {
+            for (int b = 0; b < 4; b++)
+            {
+                jpeg_block_load(block, yuv->plane[0] + (size_t)(by + (b >> 1) * 8) * yuv->stride[0] + bx + (b & 1) * 8, \
+                    yuv->stride[0]);
+                jpeg_block_encode(enc, &bw, block, 0, &dc_pred[0]);
+            }
+            for (int c = 1; c < 3; c++)
+            {
+                jpeg_block_load(block, yuv->plane[c] + (size_t)(by / 2) * yuv->stride[c] + bx / 2, yuv->stride[c]);
+                jpeg_block_encode(enc, &bw, block, 1, &dc_pred[c]);
+            }
+        }
+    }
+    return jpeg_finish(&bw, dst);
+}
+
+#if defined(JPEG_TURBO)
+//one compressor per thread that encodes, made by its first frame and destroyed when the thread exits
+typedef struct {
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr err;
+    struct jpeg_destination_mgr dest;
+    jmp_buf jump;
+}JpegTurbo_t;
+
+static pthread_key_t jpeg_turbo_key;
+static pthread_once_t jpeg_turbo_once = PTHREAD_ONCE_INIT;
+
+static void jpeg_turbo_free(void* arg)
+{
+    JpegTurbo_t* turbo = (JpegTurbo_t*)arg;
+    jpeg_destroy_compress(&turbo->cinfo);
+    free(turbo);
+}
+
+static void jpeg_turbo_key_create(void)
+{
+    pthread_key_create(&jpeg_turbo_key, jpeg_turbo_free);
+}
+
+static void jpeg_turbo_error(j_common_ptr cinfo)
+{
+    longjmp(((JpegTurbo_t*)cinfo->client_data)->jump, 1);
+}
+
+static void jpeg_turbo_message(j_common_ptr cinfo)
+{
+}
+
+static void jpeg_turbo_dest_init(j_compress_ptr cinfo)
+{
+}
+
+//the destination is jpeg_bound sized, running out of it is an error
+static boolean jpeg_turbo_dest_empty(j_compress_ptr cinfo)
+{
+    cinfo->err->error_exit((j_common_ptr)cinfo);
+    return FALSE;
+}
+
+static void jpeg_turbo_dest_term(j_compress_ptr cinfo)
+{
+}
+
+static JpegTurbo_t* jpeg_turbo_get(void)
+{
+    pthread_once(&jpeg_turbo_once, jpeg_turbo_key_create);
+    JpegTurbo_t* turbo = (JpegTurbo_t*)pthread_getspecific(jpeg_turbo_key);
+    if (turbo != NULL)
+    {
+        return turbo;
+    }
+    turbo = (JpegTurbo_t*)calloc(1, sizeof(JpegTurbo_t));
+    if (turbo == NULL)
+    {
+        return NULL;
+    }
+    turbo->cinfo.err = jpeg_std_error(&turbo->err);
+    turbo->err.error_exit = jpeg_turbo_error;
+    turbo->err.output_message = jpeg_turbo_message;
+    turbo->cinfo.client_data = turbo;
+    if (setjmp(turbo->jump))
+    {
+        free(turbo);
+        return NULL;
+    }
+    jpeg_create_compress(&turbo->cinfo);
+    turbo->dest.init_destination = jpeg_turbo_dest_init;
+    turbo->dest.empty_output_buffer = jpeg_turbo_dest_empty;
+    turbo->dest.term_destination = jpeg_turbo_dest_term;
+    turbo->cinfo.dest = &turbo->dest;
+    if (pthread_setspecific(jpeg_turbo_key, turbo) != 0)
+    {
+        jpeg_turbo_free(turbo);
+        return NULL;
+    }
+    return turbo;
+}
+
+//raw data input: the planes go to the library's dct as they are, no color conversion or downsampling. < 0 failed
+static int jpeg_yuv420_turbo(const JpegEncoder_t* enc, const JpegYuv420_t* yuv, const uint8_t* app, \
+    uint32_t app_size, uint8_t* dst, uint32_t dst_size)
+{
+    JpegTurbo_t* turbo = jpeg_turbo_get();
+    if (turbo == NULL)
+    {
+        return -1;
+    }
+    j_compress_ptr cinfo = &turbo->cinfo;
+    if (setjmp(turbo->jump))
+    {
+        jpeg_abort_compress(cinfo);
+        return -1;
+    }
+    turbo->dest.next_output_byte = dst;
+    turbo->dest.free_in_buffer = dst_size;
+    cinfo->image_width = yuv->width;
+    cinfo->image_height = yuv->height;
+    cinfo->input_components = 3;
+    cinfo->in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, enc->quality, TRUE);
+    cinfo->raw_data_in = TRUE;
+    cinfo->comp_info[0].h_samp_factor = 2;
+    cinfo->comp_info[0].v_samp_factor = 2;
+    for (int c = 1; c < 3; c++)
+    {
+        cinfo->comp_info[c].h_samp_factor = 1;
+        cinfo->comp_info[c].v_samp_factor = 1;
+    }
+    jpeg_start_compress(cinfo, TRUE);
+    //the caller's complete segments after the library's APP0
+    for (uint32_t pos = 0; pos + 4 <= app_size && app[pos] == 0xFF;)
+    {
+        uint32_t len = ((uint32_t)app[pos + 2] << 8) | app[pos + 3];
+        if (len < 2 || pos + 2 + len > app_size)
+        {
+            break;
+        }
+        jpeg_write_marker(cinfo, app[pos + 1], app + pos + 4, len - 2);
+        pos += 2 + len;
+    }
+    JSAMPROW rows[3][16];
+    JSAMPARRAY planes[3] = { rows[0], rows[1], rows[2] };
+    for (uint32_t y = 0; y < yuv->height; y += 16)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            rows[0][i] = yuv->plane[0] + (size_t)(y + i) * yuv->stride[0];
+        }
+        for (int c = 1; c < 3; c++)
+        {
+            for (int i = 0; i < 8; i++)
+            {
+                rows[c][i] = yuv->plane[c] + (size_t)(y / 2 + i) * yuv->stride[c];
+            }
+        }
+        jpeg_write_raw_data(cinfo, planes, 16);
+    }
+    jpeg_finish_compress(cinfo);
+    return (int)(dst_size - turbo->dest.free_in_buffer);
+}
+#endif
+
+int jpeg_encode_yuv420(const JpegEncoder_t* enc, const JpegYuv420_t* yuv, const uint8_t* app, uint32_t app_size, \
+    uint8_t* dst, uint32_t dst_size)
+{
+    if (enc == NULL || yuv == NULL || yuv->plane[0] == NULL || yuv->plane[1] == NULL || yuv->plane[2] == NULL || \
+        dst == NULL || yuv->width == 0 || yuv->height == 0 || yuv->width > 0xFFFF || yuv->height > 0xFFFF || \
+        (app == NULL && app_size > 0))
+    {
+        return JPEG_ERROR_PARAM;
+    }
+    if (dst_size < jpeg_bound(yuv->width, yuv->height, app_size))
+    {
+        return JPEG_ERROR_SIZE;
+    }
+#if defined(JPEG_TURBO)
+    int size = jpeg_yuv420_turbo(enc, yuv, app, app_size, dst, dst_size);
+    if (size > 0)
+    {
+        return size;
+    }
+#endif
+    return jpeg_yuv420_builtin(enc, yuv, app, app_size, dst);
+}
@@ -0,0 +1,51 @@
+#ifndef _JPEG_H_
+#define _JPEG_H_
+
+#include <stdint.h>
+
+#define JPEG_DEFAULT_QUALITY 90
+#define JPEG_APP_MAX 65533              //payload bytes of one APPn segment, after the marker and the length
+
+#define JPEG_SUCCESS 0
+#define JPEG_ERROR_PARAM -1
+#define JPEG_ERROR_SIZE -2              //the destination is smaller than jpeg_bound
+
+//4:2:0 planes as jpeg_encode_yuv420 takes them: Y, Cb, Cr with their rows padded to whole 16x16 macroblocks
+//(chroma 8x8), the padding repeats the last column and row, what the encoder codes without a bounds check
+typedef struct {
+    uint8_t* plane[3];
+    uint32_t stride[3];
+    uint32_t width;
+    uint32_t height;
+}JpegYuv420_t;
+
+//quantization and huffman tables of one quality, read only once built
+typedef struct {
+    int quality;
+    uint8_t quant[2][64];               //luma, chroma, zigzag order as written into the DQT segment
+    float scale[2][64];                 //natural order: 1 / (quant * the AAN factors * 8)
+    uint16_t code[4][256];              //dc luma, ac luma, dc chroma, ac chroma
+    uint8_t code_len[4][256];
+}JpegEncoder_t;
+
+//the tables of quality 1..100 (the IJG scaling of the Annex K tables)
+int jpeg_init(JpegEncoder_t* enc, int quality);
+
+//largest file of a width x height frame with app_size bytes of extra segments, 4:4:4 or 4:2:0
+uint32_t jpeg_bound(uint32_t width, uint32_t height, uint32_t app_size);
+
+//a baseline JFIF file, 4:4:4, from packed Y, Cb, Cr bytes (full range bt.601, the palette yuv lut).
+//app: complete marker segments written as they are after APP0, NULL without. returns the file size
+int jpeg_encode(const JpegEncoder_t* enc, const uint8_t* ycc, uint32_t width, uint32_t height, \
+    const uint8_t* app, uint32_t app_size, uint8_t* dst, uint32_t dst_size);
+
+//bytes of the padded 4:2:0 planes of a width x height frame, and the planes laid out in data
+uint32_t jpeg_yuv420_size(uint32_t width, uint32_t height);
+void jpeg_yuv420_planes(JpegYuv420_t* yuv, uint8_t* data, uint32_t width, uint32_t height);
+
+//jpeg_encode of 4:2:0 planes, half the blocks of 4:4:4. with JPEG_TURBO the planes go to libjpeg(-turbo)'s raw
+//data input through a compressor each calling thread keeps, its failure falls back to the tables of enc
+int jpeg_encode_yuv420(const JpegEncoder_t* enc, const JpegYuv420_t* yuv, const uint8_t* app, uint32_t app_size, \
+    uint8_t* dst, uint32_t dst_size);
+
+#endif
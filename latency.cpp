@@ -0,0 +1,303 @@
+#include "latency.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+#include "data.h"
+#include "cmdq.h"
+#include "thermal_cam_cmd.h"
+
+static const char* latency_sink_names[LATENCY_SINK_NUM] = { "arrival", "stats", "display", "network", "alarm" };
+
+static int latency_shutter_trigger(int start, void* arg)
+{
+    return shutter_manual_switch(start ? SHUTTER_CLOSE : SHUTTER_OPEN);
+}
+
+static int latency_trigger(LatencyProbe_t* probe, int start)
+{
+    LatencyTriggerFunc_t trigger = (probe->param.trigger != NULL) ? probe->param.trigger : latency_shutter_trigger;
+    return trigger(start, probe->param.trigger_arg);
+}
+
+//runs on the cmdq worker: the time taken right before the command is what the frames are measured against
+static int latency_start_job(void* arg)
+{
+    LatencyProbe_t* probe = (LatencyProbe_t*)arg;
+    uint64_t command_us = get_monotonic_us();
+    int rst = latency_trigger(probe, 1);
+    pthread_mutex_lock(&probe->mutex);
+    if (rst == IRUVC_SUCCESS)
+    {
+        probe->command_us = command_us;
+        probe->event_seq = 0;
+        probe->reported = 0;
+        probe->stats.events++;
+        probe->state = LATENCY_STATE_ARMED;
+    }
+    else
+    {
+        probe->stats.trigger_errors++;
+        probe->idle_since_us = get_monotonic_us();
+        probe->state = LATENCY_STATE_IDLE;
+    }
+    pthread_mutex_unlock(&probe->mutex);
+    return rst;
+}
+
+static int latency_end_job(void* arg)
+{
+    LatencyProbe_t* probe = (LatencyProbe_t*)arg;
+    int rst = latency_trigger(probe, 0);
+    pthread_mutex_lock(&probe->mutex);
+    if (rst != IRUVC_SUCCESS)
+    {
+        probe->stats.trigger_errors++;
+    }
+    probe->idle_since_us = get_monotonic_us();
+    probe->state = LATENCY_STATE_IDLE;
+    pthread_mutex_unlock(&probe->mutex);
+    return rst;
+}
+
+static void latency_job_done(int job_id, int result, void* user_data)
+{
+    LatencyProbe_t* probe = (LatencyProbe_t*)user_data;
+    pthread_mutex_lock(&probe->mutex);
+    if (result == CMDQ_CLOSED)
+    {
+        //never ran, the next interval tries again
+        probe->idle_since_us = get_monotonic_us();
+        probe->state = LATENCY_STATE_IDLE;
+    }
+    probe->pending = 0;
+    pthread_cond_broadcast(&probe->cond);
+    pthread_mutex_unlock(&probe->mutex);
+}
+
+//with the mutex held
+static void latency_submit(LatencyProbe_t* probe, CmdqFunc_t func, LatencyState_t state)
+{
+    probe->state = state;
+    probe->pending = 1;
+    if (cmdq_submit(func, probe, CMDQ_PRIORITY_NORMAL, 0, latency_job_done, probe, NULL) != CMDQ_SUCCESS)
+    {
+        probe->pending = 0;
+        probe->idle_since_us = get_monotonic_us();
+        probe->state = LATENCY_STATE_IDLE;
+    }
+}
+
+//with the mutex held, the first report of the event by each sink
+static void latency_report(LatencyProbe_t* probe, LatencySink_t sink, uint64_t now_us)
+{
+    if (probe->reported & (1u << sink))
+    {
+        return;
+    }
+    probe->reported |= 1u << sink;
+    timing_hist_record(&probe->hist[sink], (now_us > probe->command_us) ? now_us - probe->command_us : 0);
+}
+
+//with the mutex held: the sinks that never reported a detected event
+static void latency_event_end(LatencyProbe_t* probe)
+{
+    if (probe->state == LATENCY_STATE_DETECTED)
+    {
+        for (int sink = 0; sink < LATENCY_SINK_NUM; sink++)
+        {
+            if ((probe->sinks & (1u << sink)) && !(probe->reported & (1u << sink)))
+            {
+                probe->stats.missed[sink]++;
+            }
+        }
+    }
+    probe->event_seq = 0;
+}
+
+int latency_probe_init(LatencyProbe_t* probe, const LatencyProbeParam_t* param)
+{
+    if (probe == NULL)
+    {
+        return LATENCY_ERROR_PARAM;
+    }
+    //value-initialized: zero, the atomics included
+    new (probe) LatencyProbe_t();
+    if (param != NULL)
+    {
+        probe->param = *param;
+    }
+    else
+    {
+        probe->param.interval_ms = LATENCY_PROBE_INTERVAL_MS;
+        probe->param.closed_ms = LATENCY_PROBE_CLOSED_MS;
+        probe->param.timeout_ms = LATENCY_PROBE_TIMEOUT_MS;
+        probe->param.range_drop = LATENCY_PROBE_RANGE_DROP;
+        probe->param.mean_step = LATENCY_PROBE_MEAN_STEP;
+    }
+    for (int sink = 0; sink < LATENCY_SINK_NUM; sink++)
+    {
+        timing_hist_reset(&probe->hist[sink]);
+    }
+    pthread_mutex_init(&probe->mutex, NULL);
+    pthread_cond_init(&probe->cond, NULL);
+    return LATENCY_SUCCESS;
+}
+
+void latency_probe_release(LatencyProbe_t* probe)
+{
+    if (probe == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&probe->mutex);
+    while (probe->pending)
+    {
+        pthread_cond_wait(&probe->cond, &probe->mutex);
+    }
+    int running = (probe->state == LATENCY_STATE_ARMED || probe->state == LATENCY_STATE_DETECTED);
+    if (running)
+    {
+        latency_event_end(probe);
+        probe->state = LATENCY_STATE_END;
+    }
+    pthread_mutex_unlock(&probe->mutex);
+    if (running)
+    {
+        //the shutter is not left closed, on the calling thread once the command queue is gone
+        int result = 0;
+        if (cmdq_call(latency_end_job, probe, CMDQ_PRIORITY_NORMAL, 0, &result) == CMDQ_CLOSED)
+        {
+            latency_end_job(probe);
+        }
+    }
+    pthread_mutex_destroy(&probe->mutex);
+    pthread_cond_destroy(&probe->cond);
+}
+
+void latency_probe_frame(LatencyProbe_t* probe, const FrameStats_t* stats, uint64_t seq, uint64_t timestamp_us)
+{
+    if (probe == NULL || stats == NULL || !stats->valid)
+    {
+        return;
+    }
+    float range = (float)(stats->max_val - stats->min_val);
+    pthread_mutex_lock(&probe->mutex);
+    switch (probe->state)
+    {
+    case LATENCY_STATE_IDLE:
+        if (timestamp_us < probe->idle_since_us + (uint64_t)LATENCY_PROBE_SETTLE_MS * 1000)
+        {
+            break;
+        }
+        if (probe->baseline_frames == 0)
+        {
+            probe->range_avg = range;
+            probe->mean_avg = stats->mean;
+        }
+        else
+        {
+            probe->range_avg += (range - probe->range_avg) / 16;
+            probe->mean_avg += (stats->mean - probe->mean_avg) / 16;
+        }
+        probe->baseline_frames++;
+        if (!probe->pending && probe->baseline_frames >= LATENCY_PROBE_BASELINE_FRAMES && \
+            timestamp_us - probe->idle_since_us >= (uint64_t)probe->param.interval_ms * 1000)
+        {
+            latency_submit(probe, latency_start_job, LATENCY_STATE_TRIGGER);
+        }
+        break;
+    case LATENCY_STATE_ARMED:
+        //a frame that left the sensor before the command can't show it
+        if (timestamp_us > probe->command_us && (range < probe->range_avg * probe->param.range_drop || \
+            fabsf(stats->mean - probe->mean_avg) > probe->param.mean_step))
+        {
+            probe->event_seq = seq;
+            probe->state = LATENCY_STATE_DETECTED;
+            probe->stats.detected++;
+            probe->sinks |= (1u << LATENCY_SINK_ARRIVAL) | (1u << LATENCY_SINK_STATS);
+            latency_report(probe, LATENCY_SINK_ARRIVAL, timestamp_us);
+            latency_report(probe, LATENCY_SINK_STATS, get_monotonic_us());
+        }
+        else if (timestamp_us - probe->command_us > (uint64_t)probe->param.timeout_ms * 1000)
+        {
+            probe->stats.lost++;
+            latency_event_end(probe);
+            latency_submit(probe, latency_end_job, LATENCY_STATE_END);
+        }
+        break;
+    case LATENCY_STATE_DETECTED:
+        if (timestamp_us - probe->command_us >= (uint64_t)probe->param.closed_ms * 1000)
+        {
+            latency_event_end(probe);
+            latency_submit(probe, latency_end_job, LATENCY_STATE_END);
+        }
+        break;
+    default:
+        break;
+    }
+    pthread_mutex_unlock(&probe->mutex);
+}
+
+void latency_probe_sink(LatencyProbe_t* probe, LatencySink_t sink, uint64_t seq)
+{
+    if (probe == NULL || sink < 0 || sink >= LATENCY_SINK_NUM)
+    {
+        return;
+    }
+    uint64_t now_us = get_monotonic_us();
+    pthread_mutex_lock(&probe->mutex);
+    probe->sinks |= 1u << sink;
+    //a sink that skipped the changed frame reports with the next one it puts out
+    if (probe->state == LATENCY_STATE_DETECTED && probe->event_seq != 0 && seq >= probe->event_seq)
+    {
+        latency_report(probe, sink, now_us);
+    }
+    pthread_mutex_unlock(&probe->mutex);
+}
+
+int latency_probe_stats(LatencyProbe_t* probe, LatencyProbeStats_t* stats)
+{
+    if (probe == NULL || stats == NULL)
+    {
+        return LATENCY_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&probe->mutex);
+    *stats = probe->stats;
+    pthread_mutex_unlock(&probe->mutex);
+    for (int sink = 0; sink < LATENCY_SINK_NUM; sink++)
+    {
+        timing_hist_stats(&probe->hist[sink], &stats->sink[sink]);
+    }
+    return LATENCY_SUCCESS;
+}
+
+const char* latency_sink_name(LatencySink_t sink)
+{
+    return (sink >= 0 && sink < LATENCY_SINK_NUM) ? latency_sink_names[sink] : "unknown";
+}
+
+void latency_probe_dump(LatencyProbe_t* probe)
+{
+    LatencyProbeStats_t stats;
+    if (latency_probe_stats(probe, &stats) != LATENCY_SUCCESS)
+    {
+        return;
+    }
+    printf("latency probe: %llu events, %llu detected, %llu lost, %llu trigger errors\n", \
+        (unsigned long long)stats.events, (unsigned long long)stats.detected, (unsigned long long)stats.lost, \
+        (unsigned long long)stats.trigger_errors);
+    printf("%-18s %10s %10s %10s %10s %10s %10s\n", "sink(us)", "count", "mean", "p50", "p99", "max", "missed");
+    for (int sink = 0; sink < LATENCY_SINK_NUM; sink++)
+    {
+        const TimingStats_t* sink_stats = &stats.sink[sink];
+        if (sink_stats->count == 0 && stats.missed[sink] == 0)
+        {
+            continue;
+        }
+        printf("%-18s %10llu %10llu %10llu %10llu %10llu %10llu\n", latency_sink_name((LatencySink_t)sink), \
+            (unsigned long long)sink_stats->count, (unsigned long long)sink_stats->mean_us, \
+            (unsigned long long)sink_stats->p50_us, (unsigned long long)sink_stats->p99_us, \
+            (unsigned long long)sink_stats->max_us, (unsigned long long)stats.missed[sink]);
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+//glass to glass latency probe: every interval_ms a known event is triggered on the command queue, by default
+//shutter_manual_switch(SHUTTER_CLOSE), and the time the command went to the device is taken. the stream thread's
+//statistics pass finds the first frame after it that changed frame wide (its min..max range collapsed or its
+//mean jumped), and each sink reports when it put out that frame or a later one. every sink gets a latency
+//distribution from the command, the sensor, the shutter and usb included. SHUTTER_MONITOR makes the consumers
+//hold their last output over the event, measure without it
+#include <stdint.h>
+#include <pthread.h>
+#include "stats.h"
+#include "timing.h"
+
+#define LATENCY_PROBE_INTERVAL_MS 3000  //from one event's end to the next trigger
+#define LATENCY_PROBE_CLOSED_MS 500     //the event is ended (shutter opened) this long after its command
+#define LATENCY_PROBE_TIMEOUT_MS 2000   //no changed frame by then: the event counts as lost
+#define LATENCY_PROBE_SETTLE_MS 500     //frames after the end are not taken into the baseline, the nuc settles
+#define LATENCY_PROBE_RANGE_DROP 0.25f  //a frame whose min..max range falls below this share of the baseline's
+#define LATENCY_PROBE_MEAN_STEP 128     //or whose mean moves this far from it, raw units (2 K)
+#define LATENCY_PROBE_BASELINE_FRAMES 16    //frames in the baseline before the first trigger
+
+#define LATENCY_SUCCESS 0
+#define LATENCY_ERROR_PARAM -1
+
+typedef enum
+{
+    LATENCY_SINK_ARRIVAL = 0,           //uvc_frame_get returned the changed frame
+    LATENCY_SINK_STATS,                 //the statistics pass found the change
+    LATENCY_SINK_DISPLAY,               //display_one_frame done with it
+    LATENCY_SINK_NETWORK,               //the web dashboard queued it to its clients
+    LATENCY_SINK_ALARM,                 //the alarm engine evaluated it
+    LATENCY_SINK_NUM,
+}LatencySink_t;
+
+//start 1 triggers the event, 0 ends it. runs on the command queue worker, returns the vendor's result
+typedef int (*LatencyTriggerFunc_t)(int start, void* arg);
+
+typedef struct {
+    uint32_t interval_ms;
+    uint32_t closed_ms;
+    uint32_t timeout_ms;
+    float range_drop;
+    uint16_t mean_step;
+    LatencyTriggerFunc_t trigger;       //NULL closes and opens the shutter
+    void* trigger_arg;
+}LatencyProbeParam_t;
+
+typedef struct {
+    uint64_t events;                    //triggers the device accepted
+    uint64_t detected;
+    uint64_t lost;                      //no changed frame within timeout_ms
+    uint64_t trigger_errors;
+    uint64_t missed[LATENCY_SINK_NUM];  //detected events an attached sink put out no frame of before the end
+    TimingStats_t sink[LATENCY_SINK_NUM];
+}LatencyProbeStats_t;
+
+typedef enum
+{
+    LATENCY_STATE_IDLE = 0,
+    LATENCY_STATE_TRIGGER,              //the start is queued
+    LATENCY_STATE_ARMED,                //the command went out, looking for the change
+    LATENCY_STATE_DETECTED,             //the sinks report the event's frame
+    LATENCY_STATE_END,                  //the end is queued
+}LatencyState_t;
+
+typedef struct LatencyProbe_t {
+    LatencyProbeParam_t param;
+    LatencyState_t state;
+    uint64_t command_us;                //the start's command went to the device, what every latency counts from
+    uint64_t event_seq;                 //ring seq of the changed frame
+    uint32_t reported;                  //sinks that reported the event, 1 << LatencySink_t
+    uint32_t sinks;                     //sinks that reported any frame, the others are not attached
+    uint64_t idle_since_us;             //the last event's end
+    float range_avg;                    //baseline of the frames between events
+    float mean_avg;
+    uint32_t baseline_frames;
+    uint8_t pending;                    //a trigger job is queued
+    LatencyProbeStats_t stats;
+    TimingHist_t hist[LATENCY_SINK_NUM];
+    pthread_mutex_t mutex;              //the cmdq worker, the stream thread and the sinks
+    pthread_cond_t cond;
+}LatencyProbe_t;
+
+//param NULL selects the LATENCY_PROBE_xxx defaults
+int latency_probe_init(LatencyProbe_t* probe, const LatencyProbeParam_t* param);
+
+//wait for a queued trigger, end a running event and release the probe
+void latency_probe_release(LatencyProbe_t* probe);
+
+//one frame from the stream thread with the statistics of its temp plane (or image plane without one), seq is
+//the ring sequence the frame is committed with
+void latency_probe_frame(LatencyProbe_t* probe, const FrameStats_t* stats, uint64_t seq, uint64_t timestamp_us);
+
+//a sink put out frame seq, probe NULL does nothing
+void latency_probe_sink(LatencyProbe_t* probe, LatencySink_t sink, uint64_t seq);
+
+int latency_probe_stats(LatencyProbe_t* probe, LatencyProbeStats_t* stats);
+
+const char* latency_sink_name(LatencySink_t sink);
+
+//print the events and the distribution of every sink that reported one
+void latency_probe_dump(LatencyProbe_t* probe);
+
+#endif
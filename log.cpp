@@ -0,0 +1,348 @@
+#include "log.h"
+#include "data.h"
+#include "rtsched.h"
+#include <string.h>
+#include <pthread.h>
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "libiruvc.h"
+#include "libirtemp.h"
+#include "libirprocess.h"
+#include "libirparse.h"
+
+#define LOG_RING_MASK (LOG_RING_RECORDS - 1)
+#define LOG_CACHE_LINE 64
+
+//bounded multi producer queue, each cell's seq says whose turn it is: cell i is free for the producer of
+//position pos when seq == pos and holds that record for the log thread when seq == pos + 1
+typedef struct {
+    std::atomic<uint64_t> seq;
+    LogEntry_t entry;
+}LogCell_t;
+
+std::atomic<int> log_level_min(LOG_LEVEL_INFO);
+
+static LogCell_t log_cells[LOG_RING_RECORDS];
+alignas(LOG_CACHE_LINE) static std::atomic<uint64_t> log_enqueue_pos(0);
+alignas(LOG_CACHE_LINE) static uint64_t log_dequeue_pos = 0;     //log thread only
+static std::atomic<uint64_t> log_dropped(0);
+static std::atomic<uint64_t> log_suppressed(0);
+static std::atomic<uint64_t> log_written(0);
+static std::atomic<int> log_running(0);
+static uint64_t log_dropped_reported = 0;
+static FILE* log_fp = NULL;
+static pthread_t log_thread;
+static pthread_once_t log_cells_once = PTHREAD_ONCE_INIT;
+
+static void log_cells_init(void)
+{
+    for (uint64_t i = 0; i < LOG_RING_RECORDS; i++)
+    {
+        log_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+int log_site_allow(LogSite_t* site)
+{
+    uint64_t now_us = get_monotonic_us();
+    uint64_t next_us = site->next_us.load(std::memory_order_relaxed);
+    //of racing threads one wins the interval, the others count as suppressed
+    if (now_us < next_us || !site->next_us.compare_exchange_strong(next_us, now_us + site->interval_ms * 1000ull, \
+        std::memory_order_relaxed))
+    {
+        site->suppressed.fetch_add(1, std::memory_order_relaxed);
+        log_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+    return 1;
+}
+
+//one conversion of the format with one argument, spec is "%[flags][width][.precision]"
+static int log_format_arg(char* dst, int size, char* spec, int spec_len, char conv, const LogEntry_t* entry, int index)
+{
+    if (index >= entry->arg_num)
+    {
+        //more conversions than arguments, printed as they are
+        return snprintf(dst, size, "%.*s%c", spec_len, spec, conv);
+    }
+    const LogArg_t* arg = &entry->args[index];
+    int type = entry->types[index] & ~LOG_ARG_WIDE;
+    int wide = (entry->types[index] & LOG_ARG_WIDE) != 0;
+    switch (conv)
+    {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+    {
+        long long value = (type == LOG_ARG_DOUBLE) ? (long long)arg->d : arg->i;
+        int is_signed = (conv == 'd' || conv == 'i');
+        if (!is_signed && !wide)
+        {
+            value = (uint32_t)value;
+        }
+        spec[spec_len] = 'l';
+        spec[spec_len + 1] = 'l';
+        spec[spec_len + 2] = conv;
+        spec[spec_len + 3] = '\0';
+        return is_signed ? snprintf(dst, size, spec, value) : snprintf(dst, size, spec, (unsigned long long)value);
+    }
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+    {
+        double value = (type == LOG_ARG_DOUBLE) ? arg->d : ((type == LOG_ARG_UINT) ? (double)arg->u : (double)arg->i);
+        spec[spec_len] = conv;
+        spec[spec_len + 1] = '\0';
+        return snprintf(dst, size, spec, value);
+    }
+    case 'c':
+        spec[spec_len] = 'c';
+        spec[spec_len + 1] = '\0';
+        return snprintf(dst, size, spec, (int)arg->i);
+    case 's':
+        spec[spec_len] = 's';
+        spec[spec_len + 1] = '\0';
+        if (type != LOG_ARG_STRING || arg->u == UINT64_MAX)
+        {
+            return snprintf(dst, size, spec, "(null)");
+        }
+        else
+        {
+            char text[LOG_TEXT_LEN + 1];
+            uint32_t offset = (uint32_t)(arg->u >> 16), len = (uint32_t)(arg->u & 0xffff);
+            memcpy(text, entry->text + offset, len);
+            text[len] = '\0';
+            return snprintf(dst, size, spec, text);
+        }
+    case 'p':
+        spec[spec_len] = 'p';
+        spec[spec_len + 1] = '\0';
+        return snprintf(dst, size, spec, arg->p);
+    default:
+        return snprintf(dst, size, "%.*s%c", spec_len, spec, conv);
+    }
+}
+
+//the printf of the entry's format with its stored arguments
+static int log_format(const LogEntry_t* entry, char* line, int size)
+{
+    int len = 0;
+    int index = 0;
+    const char* f = entry->format;
+    while (*f != '\0' && len < size - 1)
+    {
+        if (*f != '%')
+        {
+            line[len++] = *f++;
+            continue;
+        }
+        if (f[1] == '%')
+        {
+            line[len++] = '%';
+            f += 2;
+            continue;
+        }
+        char spec[32];
+        int spec_len = 0;
+        spec[spec_len++] = *f++;
+        while (*f != '\0' && strchr("-+ #0123456789.", *f) != NULL && spec_len < (int)sizeof(spec) - 4)
+        {
+            spec[spec_len++] = *f++;
+        }
+        while (*f != '\0' && strchr("hlLqjzt", *f) != NULL)
+        {
+            f++;
+        }
+        if (*f == '\0')
+        {
+            break;
+        }
+        int n = log_format_arg(line + len, size - len, spec, spec_len, *f++, entry, index++);
+        if (n > 0)
+        {
+            len += (n < size - len) ? n : size - len - 1;
+        }
+    }
+    line[len] = '\0';
+    if (entry->suppressed > 0)
+    {
+        //before the line's own newline
+        int newline = (len > 0 && line[len - 1] == '\n');
+        len -= newline;
+        int n = snprintf(line + len, size - len, " (%u more suppressed)%s", entry->suppressed, newline ? "\n" : "");
+        len += (n < size - len) ? n : size - len - 1;
+    }
+    return len;
+}
+
+static void log_print(const LogEntry_t* entry, FILE* fp)
+{
+    char line[LOG_LINE_LEN];
+    int len = log_format(entry, line, sizeof(line));
+    fwrite(line, 1, len, fp);
+    log_written.fetch_add(1, std::memory_order_relaxed);
+}
+
+void log_submit(LogEntry_t* entry, LogSite_t* site)
+{
+    entry->timestamp_us = get_monotonic_us();
+    entry->suppressed = (site != NULL) ? site->suppressed.exchange(0, std::memory_order_relaxed) : 0;
+    if (!log_running.load(std::memory_order_acquire))
+    {
+        log_print(entry, (log_fp != NULL) ? log_fp : stdout);
+        return;
+    }
+    uint64_t pos = log_enqueue_pos.load(std::memory_order_relaxed);
+    LogCell_t* cell;
+    while (1)
+    {
+        cell = &log_cells[pos & LOG_RING_MASK];
+        uint64_t seq = cell->seq.load(std::memory_order_acquire);
+        int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0)
+        {
+            if (log_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            //the log thread is a whole ring behind
+            log_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = log_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    memcpy(&cell->entry, entry, sizeof(LogEntry_t));
+    cell->seq.store(pos + 1, std::memory_order_release);
+}
+
+//print every complete record in order, returns how many
+static int log_drain(void)
+{
+    int printed = 0;
+    while (1)
+    {
+        LogCell_t* cell = &log_cells[log_dequeue_pos & LOG_RING_MASK];
+        if (cell->seq.load(std::memory_order_acquire) != log_dequeue_pos + 1)
+        {
+            break;
+        }
+        log_print(&cell->entry, log_fp);
+        cell->seq.store(log_dequeue_pos + LOG_RING_RECORDS, std::memory_order_release);
+        log_dequeue_pos++;
+        printed++;
+    }
+    uint64_t dropped = log_dropped.load(std::memory_order_relaxed);
+    if (dropped != log_dropped_reported)
+    {
+        fprintf(log_fp, "log: %llu records dropped, the ring was full\n", \
+            (unsigned long long)(dropped - log_dropped_reported));
+        log_dropped_reported = dropped;
+    }
+    if (printed > 0)
+    {
+        fflush(log_fp);
+    }
+    return printed;
+}
+
+static void* log_function(void* threadarg)
+{
+    rt_thread_enter(RT_ROLE_CONTROL, -1, "log");
+    while (log_running.load(std::memory_order_acquire))
+    {
+        if (log_drain() == 0)
+        {
+#if defined(_WIN32)
+            Sleep(LOG_POLL_MS);
+#else
+            usleep(LOG_POLL_MS * 1000);
+#endif
+        }
+    }
+    rt_thread_leave();
+    return NULL;
+}
+
+void log_level_set(LogLevel_t level)
+{
+    log_level_min.store(level, std::memory_order_relaxed);
+    if (level == LOG_LEVEL_DEBUG)
+    {
+        iruvc_log_register(IRUVC_LOG_DEBUG);
+        irtemp_log_register(IRTEMP_LOG_DEBUG);
+        irproc_log_register(IRPROC_LOG_DEBUG);
+        irparse_log_register(IRPARSE_LOG_DEBUG);
+    }
+    else if (level == LOG_LEVEL_OFF)
+    {
+        iruvc_log_register(IRUVC_LOG_NO_PRINT);
+        irtemp_log_register(IRTEMP_LOG_NO_PRINT);
+        irproc_log_register(IRPROC_LOG_NO_PRINT);
+        irparse_log_register(IRPARSE_LOG_NO_PRINT);
+    }
+    else
+    {
+        iruvc_log_register(IRUVC_LOG_ERROR);
+        irtemp_log_register(IRTEMP_LOG_ERROR);
+        irproc_log_register(IRPROC_LOG_ERROR);
+        irparse_log_register(IRPARSE_LOG_ERROR);
+    }
+}
+
+int log_start(FILE* fp)
+{
+    if (log_running.load(std::memory_order_relaxed))
+    {
+        return LOG_ERROR_PARAM;
+    }
+    pthread_once(&log_cells_once, log_cells_init);
+    log_fp = (fp != NULL) ? fp : stdout;
+    log_running.store(1, std::memory_order_release);
+    if (pthread_create(&log_thread, NULL, log_function, NULL) != 0)
+    {
+        log_running.store(0, std::memory_order_release);
+        return LOG_ERROR_THREAD;
+    }
+    return LOG_SUCCESS;
+}
+
+void log_stop(void)
+{
+    if (!log_running.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    log_running.store(0, std::memory_order_release);
+    pthread_join(log_thread, NULL);
+    //records of producers that saw the logger running a moment ago
+    log_drain();
+    fflush(log_fp);
+}
+
+void log_stats(LogStats_t* stats)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+    stats->written = log_written.load(std::memory_order_relaxed);
+    stats->dropped = log_dropped.load(std::memory_order_relaxed);
+    stats->suppressed = log_suppressed.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,158 @@
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+
+#define LOG_RING_RECORDS 2048           //a power of two, a full ring drops records and counts them
+#define LOG_MAX_ARGS 8
+#define LOG_TEXT_LEN 64                 //string arguments of one record are copied here, longer ones are cut
+#define LOG_LINE_LEN 512
+#define LOG_POLL_MS 10
+
+#define LOG_SUCCESS 0
+#define LOG_ERROR_PARAM -1
+#define LOG_ERROR_THREAD -2
+
+typedef enum
+{
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_OFF,
+}LogLevel_t;
+
+typedef enum
+{
+    LOG_ARG_INT = 0,
+    LOG_ARG_UINT,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING,                     //offset << 16 | length into text
+    LOG_ARG_POINTER,
+}LogArgType_t;
+
+#define LOG_ARG_WIDE 0x10               //type flag: the argument was 64 bit
+
+//one call site of LOG_RATE, at most one record per interval_ms, the calls in between are counted
+typedef struct {
+    const char* file;
+    int line;
+    uint32_t interval_ms;
+    std::atomic<uint64_t> next_us;
+    std::atomic<uint32_t> suppressed;
+}LogSite_t;
+
+typedef union {
+    int64_t i;
+    uint64_t u;
+    double d;
+    const void* p;
+}LogArg_t;
+
+//what a producer hands over: the format string and the raw arguments, formatted on the log thread
+typedef struct {
+    uint64_t timestamp_us;
+    const char* format;                 //a string literal, kept as a pointer
+    uint32_t suppressed;                //calls of the site dropped by its rate limit before this one
+    uint8_t level;
+    uint8_t arg_num;
+    uint8_t text_len;
+    uint8_t types[LOG_MAX_ARGS];        //LogArgType_t | LOG_ARG_WIDE
+    LogArg_t args[LOG_MAX_ARGS];
+    char text[LOG_TEXT_LEN];
+}LogEntry_t;
+
+typedef struct {
+    uint64_t written;                   //records printed
+    uint64_t dropped;                   //lost to a full ring
+    uint64_t suppressed;                //calls dropped by the call site rate limits
+}LogStats_t;
+
+//records below it are skipped before their arguments are evaluated
+extern std::atomic<int> log_level_min;
+
+//printf style, the arguments are copied into a lock-free ring and formatted by the log thread.
+//integers, floating point, chars, pointers and strings (copied, LOG_TEXT_LEN per record) are taken,
+//lengths in the format (l, ll, z, h) are ignored: every argument is printed with its own size.
+//without log_start the record is formatted and printed by the caller
+#define LOG(level, ...) do { \
+        if ((int)(level) >= log_level_min.load(std::memory_order_relaxed)) log_write(level, NULL, __VA_ARGS__); \
+    } while (0)
+
+//LOG at most once per interval_ms for this call site, the next record that goes out tells how many were skipped
+#define LOG_RATE(level, interval_ms, ...) do { \
+        static LogSite_t log_site_ = { __FILE__, __LINE__, interval_ms }; \
+        if ((int)(level) >= log_level_min.load(std::memory_order_relaxed) && log_site_allow(&log_site_)) \
+            log_write(level, &log_site_, __VA_ARGS__); \
+    } while (0)
+
+//set the level of LOG and the matching level of the vendor libraries: debug prints their debug output,
+//info/warn/error their errors only, off silences them
+void log_level_set(LogLevel_t level);
+
+//start the log thread writing to fp (NULL for stdout)
+int log_start(FILE* fp);
+
+//print what is left in the ring and stop the thread, later records are printed by their callers
+void log_stop(void);
+
+void log_stats(LogStats_t* stats);
+
+//below: used by the macros
+int log_site_allow(LogSite_t* site);
+
+void log_submit(LogEntry_t* entry, LogSite_t* site);
+
+static inline void log_arg_set(LogEntry_t* entry, int v) { entry->types[entry->arg_num] = LOG_ARG_INT; entry->args[entry->arg_num].i = v; }
+static inline void log_arg_set(LogEntry_t* entry, long v) { entry->types[entry->arg_num] = LOG_ARG_INT | (sizeof(long) > 4 ? LOG_ARG_WIDE : 0); entry->args[entry->arg_num].i = v; }
+static inline void log_arg_set(LogEntry_t* entry, long long v) { entry->types[entry->arg_num] = LOG_ARG_INT | LOG_ARG_WIDE; entry->args[entry->arg_num].i = v; }
+static inline void log_arg_set(LogEntry_t* entry, unsigned int v) { entry->types[entry->arg_num] = LOG_ARG_UINT; entry->args[entry->arg_num].u = v; }
+static inline void log_arg_set(LogEntry_t* entry, unsigned long v) { entry->types[entry->arg_num] = LOG_ARG_UINT | (sizeof(long) > 4 ? LOG_ARG_WIDE : 0); entry->args[entry->arg_num].u = v; }
+static inline void log_arg_set(LogEntry_t* entry, unsigned long long v) { entry->types[entry->arg_num] = LOG_ARG_UINT | LOG_ARG_WIDE; entry->args[entry->arg_num].u = v; }
+static inline void log_arg_set(LogEntry_t* entry, double v) { entry->types[entry->arg_num] = LOG_ARG_DOUBLE; entry->args[entry->arg_num].d = v; }
+static inline void log_arg_set(LogEntry_t* entry, const void* v) { entry->types[entry->arg_num] = LOG_ARG_POINTER; entry->args[entry->arg_num].p = v; }
+static inline void log_arg_set(LogEntry_t* entry, const char* v)
+{
+    //copied, the caller's buffer may be gone when the log thread formats the record
+    uint32_t len = 0;
+    while (v != NULL && v[len] != '\0' && entry->text_len + len < LOG_TEXT_LEN)
+    {
+        entry->text[entry->text_len + len] = v[len];
+        len++;
+    }
+    entry->types[entry->arg_num] = LOG_ARG_STRING;
+    entry->args[entry->arg_num].u = (v == NULL) ? UINT64_MAX : ((uint64_t)entry->text_len << 16) | len;
+    entry->text_len += len;
+}
+static inline void log_arg_set(LogEntry_t* entry, char* v) { log_arg_set(entry, (const char*)v); }
+
+static inline void log_pack(LogEntry_t* entry)
+{
+}
+
+template <typename T, typename... Rest>
+static inline void log_pack(LogEntry_t* entry, T value, Rest... rest)
+{
+    if (entry->arg_num < LOG_MAX_ARGS)
+    {
+        log_arg_set(entry, value);
+        entry->arg_num++;
+    }
+    log_pack(entry, rest...);
+}
+
+template <typename... Args>
+static inline void log_write(int level, LogSite_t* site, const char* format, Args... args)
+{
+    LogEntry_t entry;
+    entry.format = format;
+    entry.level = (uint8_t)level;
+    entry.arg_num = 0;
+    entry.text_len = 0;
+    log_pack(&entry, args...);
+    log_submit(&entry, site);
+}
+
+#endif
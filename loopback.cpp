@@ -0,0 +1,463 @@
+#include "loopback.h"
+#include "simd.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+#endif
+
+static const char* loopback_format_names[] = { "nv12", "yuyv", "grey16" };
+
+const char* loopback_format_name(LoopbackFormat_t format)
+{
+    if (format < LOOPBACK_FMT_NV12 || format >= LOOPBACK_FMT_NUM)
+    {
+        return "unknown";
+    }
+    return loopback_format_names[format];
+}
+
+//the newest plane packed into dst: pseudo color or gray yuv of the image, or the 16 bit values as they are
+static int loopback_convert(Loopback_t* loopback, FrameSlot_t* slot, uint8_t* dst)
+{
+    int pix_num = loopback->width * loopback->height;
+    if (loopback->param.format == LOOPBACK_FMT_GREY16)
+    {
+        const FramePlane_t* plane = (loopback->param.radiometric) ? &slot->desc.temp : &slot->desc.image;
+        if (plane->data == NULL)
+        {
+            return LOOPBACK_ERROR_FORMAT;
+        }
+        const uint16_t* src = (const uint16_t*)plane->data;
+        if (loopback->param.radiometric || loopback->frameinfo.input_format == INPUT_FMT_Y16)
+        {
+            memcpy(dst, src, loopback->frame_size);
+        }
+        else
+        {
+            //Y14 over the whole 16 bit range, gray readers expect it
+            uint16_t* dst16 = (uint16_t*)dst;
+            for (int i = 0; i < pix_num; i++)
+            {
+                dst16[i] = (uint16_t)(src[i] << 2);
+            }
+        }
+        return LOOPBACK_SUCCESS;
+    }
+
+    uint16_t* src = (uint16_t*)slot->desc.image.data;
+    FrameInfo_t* frameinfo = &loopback->frameinfo;
+    if (frameinfo->pseudo_color_status == PSEUDO_COLOR_ON)
+    {
+        if (colorize_plan_prepare(&loopback->plan, src, pix_num, frameinfo, loopback->param.color_mode, \
+            &slot->image_stats) != COLORIZE_SUCCESS)
+        {
+            return LOOPBACK_ERROR_MEM;
+        }
+        if (loopback->param.format == LOOPBACK_FMT_NV12)
+        {
+            colorize_plan_apply_nv12(&loopback->plan, src, slot->desc.image.width, loopback->width, \
+                loopback->height, 0, loopback->height, dst);
+        }
+        else
+        {
+            colorize_plan_apply_yuyv(&loopback->plan, src, slot->desc.image.width, loopback->width, \
+                0, loopback->height, dst);
+        }
+    }
+    else
+    {
+        simd_gray_to_yuv(src, pix_num, (frameinfo->input_format == INPUT_FMT_Y16) ? 16 : 14, \
+            (loopback->param.format == LOOPBACK_FMT_NV12) ? SIMD_YUV_NV12 : SIMD_YUV_YUYV, dst);
+    }
+    return LOOPBACK_SUCCESS;
+}
+
+#if defined(__linux__)
+static int loopback_v4l2_ioctl(int fd, unsigned long request, void* arg)
+{
+    int rst;
+    do
+    {
+        rst = ioctl(fd, request, arg);
+    } while (rst < 0 && errno == EINTR);
+    return rst;
+}
+
+static int loopback_v4l2_buffers(Loopback_t* loopback)
+{
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = LOOPBACK_V4L2_BUFFERS;
+    req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (loopback_v4l2_ioctl(loopback->fd, VIDIOC_REQBUFS, &req) < 0 || req.count == 0)
+    {
+        return LOOPBACK_ERROR_OPEN;
+    }
+    loopback->buf_num = (req.count < LOOPBACK_V4L2_BUFFERS) ? (int)req.count : LOOPBACK_V4L2_BUFFERS;
+    for (int i = 0; i < loopback->buf_num; i++)
+    {
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.index = i;
+        buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (loopback_v4l2_ioctl(loopback->fd, VIDIOC_QUERYBUF, &buf) < 0 || buf.length < loopback->frame_size)
+        {
+            return LOOPBACK_ERROR_OPEN;
+        }
+        void* data = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, loopback->fd, buf.m.offset);
+        if (data == MAP_FAILED)
+        {
+            return LOOPBACK_ERROR_MEM;
+        }
+        loopback->bufs[i].data = data;
+        loopback->bufs[i].length = buf.length;
+    }
+    return LOOPBACK_SUCCESS;
+}
+
+static void loopback_v4l2_release_buffers(Loopback_t* loopback)
+{
+    for (int i = 0; i < LOOPBACK_V4L2_BUFFERS; i++)
+    {
+        if (loopback->bufs[i].data != NULL)
+        {
+            munmap(loopback->bufs[i].data, loopback->bufs[i].length);
+        }
+    }
+    memset(loopback->bufs, 0, sizeof(loopback->bufs));
+    memset(loopback->queued, 0, sizeof(loopback->queued));
+    loopback->buf_num = 0;
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    req.memory = V4L2_MEMORY_MMAP;
+    loopback_v4l2_ioctl(loopback->fd, VIDIOC_REQBUFS, &req);
+}
+
+static void loopback_v4l2_close(Loopback_t* loopback)
+{
+    if (loopback->fd < 0)
+    {
+        return;
+    }
+    if (loopback->streaming)
+    {
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        loopback_v4l2_ioctl(loopback->fd, VIDIOC_STREAMOFF, &type);
+        loopback->streaming = 0;
+    }
+    loopback_v4l2_release_buffers(loopback);
+    free(loopback->frame);
+    loopback->frame = NULL;
+    close(loopback->fd);
+    loopback->fd = -1;
+}
+
+//the output format first, v4l2loopback hands it to every reader; packed rows only
+static int loopback_v4l2_open(Loopback_t* loopback)
+{
+    const char* device = (loopback->param.device[0] != '\0') ? loopback->param.device : LOOPBACK_DEFAULT_DEVICE;
+    //non blocking: a buffer the device has not given back is a dropped frame, not a stalled task
+    loopback->fd = open(device, O_RDWR | O_NONBLOCK);
+    if (loopback->fd < 0)
+    {
+        printf("loopback: can not open %s\n", device);
+        return LOOPBACK_ERROR_OPEN;
+    }
+    struct v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (loopback_v4l2_ioctl(loopback->fd, VIDIOC_QUERYCAP, &cap) < 0)
+    {
+        loopback_v4l2_close(loopback);
+        return LOOPBACK_ERROR_OPEN;
+    }
+    uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_OUTPUT))
+    {
+        printf("loopback: %s is not a video output\n", device);
+        loopback_v4l2_close(loopback);
+        return LOOPBACK_ERROR_OPEN;
+    }
+
+    static const uint32_t pixelformats[] = { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_Y16 };
+    uint32_t stride = (loopback->param.format == LOOPBACK_FMT_NV12) ? loopback->width : loopback->width * 2;
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    fmt.fmt.pix.width = loopback->width;
+    fmt.fmt.pix.height = loopback->height;
+    fmt.fmt.pix.pixelformat = pixelformats[loopback->param.format];
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    fmt.fmt.pix.bytesperline = stride;
+    fmt.fmt.pix.sizeimage = loopback->frame_size;
+    //the libirparse yuv is bt.601
+    fmt.fmt.pix.colorspace = (loopback->param.format == LOOPBACK_FMT_GREY16) ? V4L2_COLORSPACE_RAW : \
+        V4L2_COLORSPACE_SMPTE170M;
+    if (loopback_v4l2_ioctl(loopback->fd, VIDIOC_S_FMT, &fmt) < 0 || \
+        fmt.fmt.pix.pixelformat != pixelformats[loopback->param.format] || fmt.fmt.pix.width != loopback->width || \
+        fmt.fmt.pix.height != loopback->height || (fmt.fmt.pix.bytesperline != 0 && fmt.fmt.pix.bytesperline != stride))
+    {
+        printf("loopback: %s refused %ux%u %s\n", device, loopback->width, loopback->height, \
+            loopback_format_name(loopback->param.format));
+        loopback_v4l2_close(loopback);
+        return LOOPBACK_ERROR_FORMAT;
+    }
+
+    int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    if ((caps & V4L2_CAP_STREAMING) && loopback_v4l2_buffers(loopback) == LOOPBACK_SUCCESS && \
+        loopback_v4l2_ioctl(loopback->fd, VIDIOC_STREAMON, &type) == 0)
+    {
+        loopback->streaming = 1;
+        return LOOPBACK_SUCCESS;
+    }
+    //no mmap streaming, every frame goes through write()
+    loopback_v4l2_release_buffers(loopback);
+    if (!(caps & V4L2_CAP_READWRITE))
+    {
+        loopback_v4l2_close(loopback);
+        return LOOPBACK_ERROR_OPEN;
+    }
+    loopback->frame = (uint8_t*)malloc(loopback->frame_size);
+    if (loopback->frame == NULL)
+    {
+        loopback_v4l2_close(loopback);
+        return LOOPBACK_ERROR_MEM;
+    }
+    return LOOPBACK_SUCCESS;
+}
+
+//take back every buffer the device is done with
+static void loopback_v4l2_dequeue(Loopback_t* loopback)
+{
+    struct v4l2_buffer buf;
+    for (;;)
+    {
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (loopback_v4l2_ioctl(loopback->fd, VIDIOC_DQBUF, &buf) < 0)
+        {
+            break;
+        }
+        if (buf.index < (uint32_t)loopback->buf_num)
+        {
+            loopback->queued[buf.index] = 0;
+        }
+    }
+}
+
+static int loopback_v4l2_frame(Loopback_t* loopback, FrameSlot_t* slot)
+{
+    if (!loopback->streaming)
+    {
+        int rst = loopback_convert(loopback, slot, loopback->frame);
+        if (rst != LOOPBACK_SUCCESS)
+        {
+            return rst;
+        }
+        return (write(loopback->fd, loopback->frame, loopback->frame_size) == (ssize_t)loopback->frame_size) ? \
+            LOOPBACK_SUCCESS : LOOPBACK_ERROR_FULL;
+    }
+
+    loopback_v4l2_dequeue(loopback);
+    int index = -1;
+    for (int i = 0; i < loopback->buf_num; i++)
+    {
+        if (!loopback->queued[i])
+        {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0)
+    {
+        return LOOPBACK_ERROR_FULL;
+    }
+    //straight into the mapped buffer, the device's copy to its readers is the only one
+    int rst = loopback_convert(loopback, slot, (uint8_t*)loopback->bufs[index].data);
+    if (rst != LOOPBACK_SUCCESS)
+    {
+        return rst;
+    }
+
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.index = index;
+    buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.bytesused = loopback->frame_size;
+    buf.field = V4L2_FIELD_NONE;
+    //readers get the capture time instead of the queue time
+    buf.flags = V4L2_BUF_FLAG_TIMESTAMP_COPY;
+    buf.timestamp.tv_sec = (time_t)(slot->desc.timestamp_us / 1000000);
+    buf.timestamp.tv_usec = (suseconds_t)(slot->desc.timestamp_us % 1000000);
+    if (loopback_v4l2_ioctl(loopback->fd, VIDIOC_QBUF, &buf) < 0)
+    {
+        return LOOPBACK_ERROR_FULL;
+    }
+    loopback->queued[index] = 1;
+    return LOOPBACK_SUCCESS;
+}
+#else
+static int loopback_v4l2_open(Loopback_t* loopback)
+{
+    return LOOPBACK_ERROR_UNAVAILABLE;
+}
+
+static int loopback_v4l2_frame(Loopback_t* loopback, FrameSlot_t* slot)
+{
+    return LOOPBACK_ERROR_UNAVAILABLE;
+}
+
+static void loopback_v4l2_close(Loopback_t* loopback)
+{
+}
+#endif
+
+//ring task: convert and queue the newest frame, never waits for the device
+static void loopback_task(FrameSlot_t* slot, void* arg)
+{
+    Loopback_t* loopback = (Loopback_t*)arg;
+    pthread_mutex_lock(&loopback->mutex);
+    if (!loopback->running || slot->desc.image.data == NULL)
+    {
+        pthread_mutex_unlock(&loopback->mutex);
+        return;
+    }
+    uint64_t start_us = get_monotonic_us();
+    if (loopback_v4l2_frame(loopback, slot) == LOOPBACK_SUCCESS)
+    {
+        loopback->stats.frames++;
+        uint64_t convert_us = get_monotonic_us() - start_us;
+        if (convert_us > loopback->stats.convert_max_us)
+        {
+            loopback->stats.convert_max_us = convert_us;
+        }
+    }
+    else
+    {
+        loopback->stats.dropped++;
+    }
+    pthread_mutex_unlock(&loopback->mutex);
+}
+
+//register the loopback as a task consumer of the frame ring
+int loopback_attach(Loopback_t* loopback, StreamFrameInfo_t* stream_frame_info)
+{
+    if (loopback == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return LOOPBACK_ERROR_PARAM;
+    }
+    memset(loopback, 0, sizeof(Loopback_t));
+    loopback->stream_frame_info = stream_frame_info;
+    loopback->fd = -1;
+    pthread_mutex_init(&loopback->mutex, NULL);
+    //readers want live video, frames the device can not take are skipped
+    loopback->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEWEST, \
+        POOL_STAGE_ENCODE, loopback_task, loopback);
+    if (loopback->consumer_id < 0)
+    {
+        pthread_mutex_destroy(&loopback->mutex);
+        return LOOPBACK_ERROR_PARAM;
+    }
+    return LOOPBACK_SUCCESS;
+}
+
+//pick the plane and open the device
+int loopback_start(Loopback_t* loopback, const LoopbackParam_t* param)
+{
+    if (loopback == NULL || param == NULL || loopback->stream_frame_info == NULL || \
+        param->format < LOOPBACK_FMT_NV12 || param->format >= LOOPBACK_FMT_NUM)
+    {
+        return LOOPBACK_ERROR_PARAM;
+    }
+    const StreamConfig_t* config = loopback->stream_frame_info->config;
+    const FrameInfo_t* image_info = &config->image_info;
+    uint8_t radiometric = (param->format == LOOPBACK_FMT_GREY16 && param->radiometric);
+    const FrameInfo_t* plane_info = (radiometric) ? &config->temp_info : image_info;
+    if ((image_info->input_format != INPUT_FMT_Y14 && image_info->input_format != INPUT_FMT_Y16) || \
+        plane_info->width == 0 || plane_info->height == 0 || (plane_info->width & 1) || (plane_info->height & 1))
+    {
+        return LOOPBACK_ERROR_FORMAT;
+    }
+    pthread_mutex_lock(&loopback->mutex);
+    if (loopback->running)
+    {
+        pthread_mutex_unlock(&loopback->mutex);
+        return LOOPBACK_ERROR_PARAM;
+    }
+    loopback->param = *param;
+    loopback->param.radiometric = radiometric;
+    if (loopback->param.color_mode < IRPROC_COLOR_MODE_1)
+    {
+        loopback->param.color_mode = IRPROC_COLOR_MODE_6;
+    }
+    loopback->width = plane_info->width;
+    loopback->height = plane_info->height;
+    loopback->frame_size = (param->format == LOOPBACK_FMT_NV12) ? loopback->width * loopback->height * 3 / 2 : \
+        loopback->width * loopback->height * 2;
+    loopback->frameinfo = *image_info;
+    //the hist agc state belongs to the display and the library enhance has no lut form,
+    //the loopback stretches each frame over its own range instead
+    if (loopback->frameinfo.img_enhance_status == IMG_ENHANCE_HIST_AGC || \
+        loopback->frameinfo.img_enhance_status == IMG_ENHANCE_LIB || \
+        loopback->frameinfo.img_enhance_status == IMG_ENHANCE_CLAHE || \
+        loopback->frameinfo.img_enhance_status == IMG_ENHANCE_DDE)
+    {
+        loopback->frameinfo.img_enhance_status = IMG_ENHANCE_ON;
+    }
+    int rst = loopback_v4l2_open(loopback);
+    if (rst != LOOPBACK_SUCCESS)
+    {
+        pthread_mutex_unlock(&loopback->mutex);
+        return rst;
+    }
+    memset(&loopback->stats, 0, sizeof(LoopbackStats_t));
+    loopback->running = 1;
+    pthread_mutex_unlock(&loopback->mutex);
+    printf("loopback: %s %ux%u %s through %s\n", (loopback->param.device[0] != '\0') ? loopback->param.device : \
+        LOOPBACK_DEFAULT_DEVICE, loopback->width, loopback->height, loopback_format_name(loopback->param.format), \
+        (loopback->streaming) ? "mmap buffers" : "write");
+    return LOOPBACK_SUCCESS;
+}
+
+int loopback_stop(Loopback_t* loopback)
+{
+    if (loopback == NULL)
+    {
+        return LOOPBACK_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&loopback->mutex);
+    if (!loopback->running)
+    {
+        pthread_mutex_unlock(&loopback->mutex);
+        return LOOPBACK_SUCCESS;
+    }
+    loopback->running = 0;
+    loopback_v4l2_close(loopback);
+    printf("loopback: %llu frames, %llu dropped, slowest %llu us\n", (unsigned long long)loopback->stats.frames, \
+        (unsigned long long)loopback->stats.dropped, (unsigned long long)loopback->stats.convert_max_us);
+    pthread_mutex_unlock(&loopback->mutex);
+    return LOOPBACK_SUCCESS;
+}
+
+int loopback_stats(Loopback_t* loopback, LoopbackStats_t* stats)
+{
+    if (loopback == NULL || stats == NULL)
+    {
+        return LOOPBACK_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&loopback->mutex);
+    *stats = loopback->stats;
+    pthread_mutex_unlock(&loopback->mutex);
+    return LOOPBACK_SUCCESS;
+}
@@ -0,0 +1,82 @@
+#ifndef _LOOPBACK_H_
+#define _LOOPBACK_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+#include "colorize.h"
+
+#define LOOPBACK_DEVICE_LEN 64
+#define LOOPBACK_V4L2_BUFFERS 4         //mmap output buffers, v4l2loopback copies each one out when queued
+#define LOOPBACK_DEFAULT_DEVICE "/dev/video10"
+
+#define LOOPBACK_SUCCESS 0
+#define LOOPBACK_ERROR_PARAM -1
+#define LOOPBACK_ERROR_MEM -2
+#define LOOPBACK_ERROR_FORMAT -3        //the plane is not Y14/Y16, has odd sizes, or the device keeps another layout
+#define LOOPBACK_ERROR_OPEN -4          //no such device, or it is not a video output
+#define LOOPBACK_ERROR_FULL -5          //every buffer is still queued
+#define LOOPBACK_ERROR_UNAVAILABLE -6   //v4l2 is linux only
+
+typedef enum
+{
+    LOOPBACK_FMT_NV12 = 0,              //pseudo color or gray, what ffmpeg/gstreamer/ml pipelines take as a camera
+    LOOPBACK_FMT_YUYV,
+    LOOPBACK_FMT_GREY16,                //V4L2_PIX_FMT_Y16, the image plane, or the temp plane when radiometric
+    LOOPBACK_FMT_NUM
+}LoopbackFormat_t;
+
+typedef struct {
+    char device[LOOPBACK_DEVICE_LEN];   //v4l2loopback node, empty selects LOOPBACK_DEFAULT_DEVICE
+    LoopbackFormat_t format;
+    irproc_color_mode_t color_mode;     //pseudo color, the image info's pseudo_color_status switches it on
+    uint8_t radiometric;                //GREY16: the temp plane's raw values instead of the image
+}LoopbackParam_t;
+
+typedef struct {
+    uint64_t frames;                    //frames handed to the device
+    uint64_t dropped;                   //frames skipped because no buffer was free or the write failed
+    uint64_t convert_max_us;            //slowest frame, plane to queued
+}LoopbackStats_t;
+
+typedef struct {
+    void* data;
+    uint32_t length;
+}LoopbackBuffer_t;
+
+//a ring task consumer that converts the newest frame straight into the loopback device's buffers,
+//one process owns the camera and any number of local readers open the loopback node
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    LoopbackParam_t param;
+    int consumer_id;
+    uint8_t running;
+    uint32_t width;
+    uint32_t height;
+    uint32_t frame_size;                //bytes of one packed frame
+    FrameInfo_t frameinfo;              //the image info as the colorize plan sees it
+    ColorizePlan_t plan;
+    int fd;
+    uint8_t streaming;                  //mmap buffers, else write() from frame
+    uint8_t* frame;                     //write() fallback: one packed frame
+    int buf_num;                        //the driver may grant fewer (v4l2loopback max_buffers)
+    LoopbackBuffer_t bufs[LOOPBACK_V4L2_BUFFERS];
+    uint8_t queued[LOOPBACK_V4L2_BUFFERS];
+    LoopbackStats_t stats;
+    pthread_mutex_t mutex;
+}Loopback_t;
+
+//register the loopback as a task consumer of the camera's frame ring, before streaming
+//the loopback must stay valid until the ring is closed, frames are ignored while it is not running
+int loopback_attach(Loopback_t* loopback, StreamFrameInfo_t* stream_frame_info);
+
+//open the device, set its format and start writing the newest frames, can be called while streaming
+int loopback_start(Loopback_t* loopback, const LoopbackParam_t* param);
+
+int loopback_stop(Loopback_t* loopback);
+
+int loopback_stats(Loopback_t* loopback, LoopbackStats_t* stats);
+
+const char* loopback_format_name(LoopbackFormat_t format);
+
+#endif
@@ -0,0 +1,128 @@
+#include "memacct.h"
+#include <atomic>
+
+static std::atomic<uint64_t> mem_acct_budget(0);
+static std::atomic<uint64_t> mem_acct_used(0);
+static std::atomic<uint64_t> mem_acct_peak(0);
+static std::atomic<uint64_t> mem_acct_bytes[MEM_CLASS_NUM];
+static std::atomic<uint64_t> mem_acct_shrunk(0);
+static std::atomic<uint64_t> mem_acct_over(0);
+
+static const char* mem_acct_names[MEM_CLASS_NUM] = { "ring", "arena", "lut", "preroll", "encoder", "other" };
+
+static void mem_acct_peak_update(uint64_t total)
+{
+    uint64_t peak = mem_acct_peak.load(std::memory_order_relaxed);
+    while (total > peak && !mem_acct_peak.compare_exchange_weak(peak, total, std::memory_order_relaxed))
+    {
+    }
+}
+
+void mem_acct_budget_set(uint64_t bytes)
+{
+    mem_acct_budget.store(bytes, std::memory_order_relaxed);
+}
+
+void mem_acct_add(MemClass_t cls, int64_t bytes)
+{
+    if (cls < 0 || cls >= MEM_CLASS_NUM || bytes == 0)
+    {
+        return;
+    }
+    mem_acct_bytes[cls].fetch_add((uint64_t)bytes, std::memory_order_relaxed);
+    uint64_t total = mem_acct_used.fetch_add((uint64_t)bytes, std::memory_order_relaxed) + (uint64_t)bytes;
+    if (bytes > 0)
+    {
+        mem_acct_peak_update(total);
+        uint64_t budget = mem_acct_budget.load(std::memory_order_relaxed);
+        if (budget > 0 && total > budget)
+        {
+            mem_acct_over.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+uint64_t mem_acct_reserve(MemClass_t cls, uint64_t want, uint64_t min_bytes, uint64_t step)
+{
+    if (cls < 0 || cls >= MEM_CLASS_NUM || want == 0)
+    {
+        return 0;
+    }
+    min_bytes = (min_bytes < want) ? min_bytes : want;
+    uint64_t used = mem_acct_used.load(std::memory_order_relaxed);
+    uint64_t grant;
+    do
+    {
+        uint64_t budget = mem_acct_budget.load(std::memory_order_relaxed);
+        uint64_t room = (budget == 0) ? want : ((used < budget) ? budget - used : 0);
+        grant = want;
+        if (room < want)
+        {
+            grant = (step > 0) ? room - room % step : room;
+        }
+        if (grant < min_bytes || grant == 0)
+        {
+            return 0;
+        }
+    } while (!mem_acct_used.compare_exchange_weak(used, used + grant, std::memory_order_relaxed));
+    mem_acct_bytes[cls].fetch_add(grant, std::memory_order_relaxed);
+    mem_acct_peak_update(used + grant);
+    if (grant < want)
+    {
+        mem_acct_shrunk.fetch_add(1, std::memory_order_relaxed);
+    }
+    return grant;
+}
+
+void mem_acct_release(MemClass_t cls, uint64_t bytes)
+{
+    mem_acct_add(cls, -(int64_t)bytes);
+}
+
+uint64_t mem_acct_total(void)
+{
+    return mem_acct_used.load(std::memory_order_relaxed);
+}
+
+void mem_acct_stats(MemAcctStats_t* stats)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+    stats->budget = mem_acct_budget.load(std::memory_order_relaxed);
+    stats->total = mem_acct_used.load(std::memory_order_relaxed);
+    stats->peak = mem_acct_peak.load(std::memory_order_relaxed);
+    for (int i = 0; i < MEM_CLASS_NUM; i++)
+    {
+        stats->bytes[i] = mem_acct_bytes[i].load(std::memory_order_relaxed);
+    }
+    stats->shrunk = mem_acct_shrunk.load(std::memory_order_relaxed);
+    stats->over_budget = mem_acct_over.load(std::memory_order_relaxed);
+}
+
+const char* mem_acct_class_name(MemClass_t cls)
+{
+    return (cls >= 0 && cls < MEM_CLASS_NUM) ? mem_acct_names[cls] : "unknown";
+}
+
+void mem_acct_dump(FILE* fp)
+{
+    MemAcctStats_t stats;
+    mem_acct_stats(&stats);
+    fp = (fp != NULL) ? fp : stdout;
+    fprintf(fp, "memory: %.1f MiB in use, peak %.1f MiB", stats.total / 1048576.0, stats.peak / 1048576.0);
+    if (stats.budget > 0)
+    {
+        fprintf(fp, " of a %.1f MiB budget, %llu shrunk, %llu over", stats.budget / 1048576.0, \
+            (unsigned long long)stats.shrunk, (unsigned long long)stats.over_budget);
+    }
+    fprintf(fp, "\n");
+    for (int i = 0; i < MEM_CLASS_NUM; i++)
+    {
+        if (stats.bytes[i] > 0)
+        {
+            fprintf(fp, "memory:   %-8s %.1f KiB\n", mem_acct_names[i], stats.bytes[i] / 1024.0);
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef _MEMACCT_H_
+#define _MEMACCT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define MEM_ACCT_SUCCESS 0
+#define MEM_ACCT_ERROR_PARAM -1
+#define MEM_ACCT_ERROR_BUDGET -2
+
+typedef enum
+{
+    MEM_CLASS_RING = 0,                 //frame pool and ring slots
+    MEM_CLASS_ARENA,                    //per frame scratch arenas
+    MEM_CLASS_LUT,                      //palettes and other lookup tables
+    MEM_CLASS_PREROLL,                  //clip history
+    MEM_CLASS_ENCODER,                  //encoder input and output buffers
+    MEM_CLASS_OTHER,
+    MEM_CLASS_NUM,
+}MemClass_t;
+
+typedef struct {
+    uint64_t budget;                    //0: unlimited
+    uint64_t total;
+    uint64_t peak;
+    uint64_t bytes[MEM_CLASS_NUM];
+    uint64_t shrunk;                    //reservations granted less than they asked for
+    uint64_t over_budget;               //mandatory allocations that went past the budget
+}MemAcctStats_t;
+
+//set the budget of everything registered, 0 for none. what is already registered is kept even when the new
+//budget is smaller, only later reservations see it
+void mem_acct_budget_set(uint64_t bytes);
+
+//register (bytes > 0) or release (bytes < 0) a buffer the subsystem needs to work. never refused, a buffer
+//that takes the total past the budget is counted in over_budget
+void mem_acct_add(MemClass_t cls, int64_t bytes);
+
+//reserve a buffer that works smaller: grants want bytes when they fit the budget, else as many as fit down
+//to min_bytes, else 0. step rounds the shrunk grant down (a frame size, 0 for none). release the grant with
+//mem_acct_release
+uint64_t mem_acct_reserve(MemClass_t cls, uint64_t want, uint64_t min_bytes, uint64_t step);
+
+void mem_acct_release(MemClass_t cls, uint64_t bytes);
+
+uint64_t mem_acct_total(void);
+
+void mem_acct_stats(MemAcctStats_t* stats);
+
+const char* mem_acct_class_name(MemClass_t cls);
+
+//one line per class with bytes registered
+void mem_acct_dump(FILE* fp);
+
+#endif
@@ -0,0 +1,703 @@
+#include "metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include "ring.h"
+#include "camera.h"
+#include "timing.h"
+#include "pool.h"
+#include "display.h"
+#include "cmdq.h"
+#include "memacct.h"
+#include "usbxfer.h"
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/time.h>
+#endif
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+
+#define METRICS_POLL_MS 100
+#define METRICS_HEADER_LEN 256
+
+static const char* metrics_priority_names[CMDQ_PRIORITY_NUM] = { "critical", "read", "normal", "long" };
+
+//what a scrape reads of one camera, taken before any family is written so each camera is read once
+typedef struct {
+    int index;
+    uint32_t fps_expected;
+    double fps_measured;
+    uint64_t produced;
+    uint64_t ring_full;
+    uint64_t reconnect_lost;
+    uint64_t hw_lost;
+    uint64_t timeouts;
+    uint64_t reconnects;
+    UsbXferStats_t usb;
+    uint64_t depth;
+    uint64_t published;
+    uint64_t long_holds;
+    TimingStats_t holds;
+    FrameRing_t* ring;
+}MetricsCamera_t;
+
+typedef struct {
+    char* dst;
+    uint32_t size;
+    uint32_t len;
+    uint8_t overflow;
+}MetricsWriter_t;
+
+static void metrics_printf(MetricsWriter_t* w, const char* format, ...)
+{
+    if (w->overflow)
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(w->dst + w->len, w->size - w->len, format, args);
+    va_end(args);
+    if (n < 0 || (uint32_t)n >= w->size - w->len)
+    {
+        w->overflow = 1;
+        return;
+    }
+    w->len += n;
+}
+
+static void metrics_family(MetricsWriter_t* w, const char* name, const char* type, const char* help)
+{
+    metrics_printf(w, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+//one sample per camera of a uint64_t field of MetricsCamera_t
+static void metrics_camera_family(MetricsWriter_t* w, const MetricsCamera_t* cameras, int camera_num, \
+    const char* name, const char* type, const char* help, size_t offset)
+{
+    metrics_family(w, name, type, help);
+    for (int i = 0; i < camera_num; i++)
+    {
+        uint64_t value = *(const uint64_t*)((const uint8_t*)&cameras[i] + offset);
+        metrics_printf(w, "%s{camera=\"%d\"} %llu\n", name, cameras[i].index, (unsigned long long)value);
+    }
+}
+
+static void metrics_camera_read(StreamFrameInfo_t* stream_frame_info, MetricsCamera_t* camera)
+{
+    FrameRing_t* ring = stream_frame_info->frame_ring;
+    memset(camera, 0, sizeof(MetricsCamera_t));
+    camera->index = stream_frame_info->camera_index;
+    camera->fps_expected = stream_frame_info->fps;
+    if (camera->fps_expected == 0)
+    {
+        camera->fps_expected = stream_frame_info->camera_param.fps;
+    }
+    camera->reconnects = ir_camera_reconnect_count(camera->index);
+    usb_xfer_stats(camera->index, &camera->usb);
+    camera->ring = ring;
+    if (ring == NULL)
+    {
+        return;
+    }
+    //producer counters are plain 64 bit fields, a scrape may read one an increment behind
+    uint32_t interval_us = ring->interval_us.load(std::memory_order_relaxed);
+    camera->fps_measured = (interval_us > 0) ? 1000000.0 / interval_us : 0;
+    camera->produced = ring->produced;
+    camera->ring_full = ring->producer_dropped;
+    camera->reconnect_lost = ring->producer_lost;
+    camera->hw_lost = ring->hw_lost;
+    camera->timeouts = ring->capture_timeouts;
+    camera->depth = ring->depth;
+    camera->published = ring->published_seq.load(std::memory_order_acquire);
+    ring_hold_stats(ring, &camera->holds, &camera->long_holds);
+}
+
+//the lock is held by the caller
+static int metrics_render_locked(Metrics_t* metrics, char* dst, uint32_t size)
+{
+    MetricsWriter_t w = { dst, size, 0, 0 };
+    MetricsCamera_t cameras[METRICS_MAX_CAMERAS];
+    for (int i = 0; i < metrics->camera_num; i++)
+    {
+        metrics_camera_read(metrics->cameras[i], &cameras[i]);
+    }
+    int camera_num = metrics->camera_num;
+
+    metrics_family(&w, "ir_camera_fps_expected", "gauge", "sensor rate the camera was set to");
+    for (int i = 0; i < camera_num; i++)
+    {
+        metrics_printf(&w, "ir_camera_fps_expected{camera=\"%d\"} %u\n", cameras[i].index, cameras[i].fps_expected);
+    }
+    metrics_family(&w, "ir_camera_fps_measured", "gauge", "moving average of the frame arrival rate");
+    for (int i = 0; i < camera_num; i++)
+    {
+        metrics_printf(&w, "ir_camera_fps_measured{camera=\"%d\"} %.3f\n", cameras[i].index, cameras[i].fps_measured);
+    }
+    metrics_camera_family(&w, cameras, camera_num, "ir_camera_frames_total", "counter", \
+        "frames published to the camera's ring", offsetof(MetricsCamera_t, produced));
+    metrics_family(&w, "ir_camera_dropped_frames_total", "counter", \
+        "frames never published: ring_full while every slot was held, reconnect while the camera was gone, "
+        "hardware as the module's frame counter skipped");
+    for (int i = 0; i < camera_num; i++)
+    {
+        metrics_printf(&w, "ir_camera_dropped_frames_total{camera=\"%d\",reason=\"ring_full\"} %llu\n", \
+            cameras[i].index, (unsigned long long)cameras[i].ring_full);
+        metrics_printf(&w, "ir_camera_dropped_frames_total{camera=\"%d\",reason=\"reconnect\"} %llu\n", \
+            cameras[i].index, (unsigned long long)cameras[i].reconnect_lost);
+        metrics_printf(&w, "ir_camera_dropped_frames_total{camera=\"%d\",reason=\"hardware\"} %llu\n", \
+            cameras[i].index, (unsigned long long)cameras[i].hw_lost);
+    }
+    metrics_camera_family(&w, cameras, camera_num, "ir_camera_capture_timeouts_total", "counter", \
+        "failed uvc_frame_get calls, usb timeouts mostly", offsetof(MetricsCamera_t, timeouts));
+    metrics_camera_family(&w, cameras, camera_num, "ir_camera_reconnects_total", "counter", \
+        "stream restarts after uvc_frame_get kept failing", offsetof(MetricsCamera_t, reconnects));
+    metrics_family(&w, "ir_usb_transfers_total", "counter", \
+        "libusb stream transfers back from the camera: completed, short of them, error, cancelled");
+    for (int i = 0; i < camera_num; i++)
+    {
+        const UsbXferStats_t* usb = &cameras[i].usb;
+        metrics_printf(&w, "ir_usb_transfers_total{camera=\"%d\",result=\"completed\"} %llu\n", cameras[i].index, \
+            (unsigned long long)usb->completed);
+        metrics_printf(&w, "ir_usb_transfers_total{camera=\"%d\",result=\"short\"} %llu\n", cameras[i].index, \
+            (unsigned long long)usb->short_transfers);
+        metrics_printf(&w, "ir_usb_transfers_total{camera=\"%d\",result=\"error\"} %llu\n", cameras[i].index, \
+            (unsigned long long)usb->errors);
+        metrics_printf(&w, "ir_usb_transfers_total{camera=\"%d\",result=\"cancelled\"} %llu\n", cameras[i].index, \
+            (unsigned long long)usb->cancelled);
+    }
+    metrics_family(&w, "ir_usb_transfer_errors_total", "counter", "error completions by libusb status");
+    for (int i = 0; i < camera_num; i++)
+    {
+        const UsbXferStats_t* usb = &cameras[i].usb;
+        metrics_printf(&w, "ir_usb_transfer_errors_total{camera=\"%d\",status=\"timeout\"} %llu\n", \
+            cameras[i].index, (unsigned long long)usb->timeouts);
+        metrics_printf(&w, "ir_usb_transfer_errors_total{camera=\"%d\",status=\"stall\"} %llu\n", \
+            cameras[i].index, (unsigned long long)usb->stalls);
+        metrics_printf(&w, "ir_usb_transfer_errors_total{camera=\"%d\",status=\"overflow\"} %llu\n", \
+            cameras[i].index, (unsigned long long)usb->overflows);
+        metrics_printf(&w, "ir_usb_transfer_errors_total{camera=\"%d\",status=\"other\"} %llu\n", \
+            cameras[i].index, (unsigned long long)(usb->errors - usb->timeouts - usb->stalls - usb->overflows));
+    }
+    metrics_camera_family(&w, cameras, camera_num, "ir_usb_transfer_submits_total", "counter", \
+        "stream transfers passed on to libusb", offsetof(MetricsCamera_t, usb.submitted));
+    metrics_camera_family(&w, cameras, camera_num, "ir_usb_transfer_resubmits_total", "counter", \
+        "submits of transfers that had come back before", offsetof(MetricsCamera_t, usb.resubmitted));
+    metrics_camera_family(&w, cameras, camera_num, "ir_usb_transfer_submit_errors_total", "counter", \
+        "stream transfers libusb refused to submit", offsetof(MetricsCamera_t, usb.submit_errors));
+    metrics_camera_family(&w, cameras, camera_num, "ir_usb_transfer_held_total", "counter", \
+        "submits held back by the configured queue depth", offsetof(MetricsCamera_t, usb.held));
+    metrics_camera_family(&w, cameras, camera_num, "ir_usb_iso_packet_errors_total", "counter", \
+        "packets of completed isochronous transfers with an error status", \
+        offsetof(MetricsCamera_t, usb.iso_packet_errors));
+    metrics_camera_family(&w, cameras, camera_num, "ir_usb_transfer_bytes_total", "counter", \
+        "bytes the completed stream transfers carried", offsetof(MetricsCamera_t, usb.bytes));
+    //the queue as libiruvc and the usb_xfer_param_set of the camera sized it
+    metrics_family(&w, "ir_usb_transfers_in_flight", "gauge", "stream transfers submitted and not back yet");
+    for (int i = 0; i < camera_num; i++)
+    {
+        metrics_printf(&w, "ir_usb_transfers_in_flight{camera=\"%d\"} %u\n", cameras[i].index, \
+            cameras[i].usb.in_flight);
+    }
+    metrics_family(&w, "ir_usb_transfers_in_flight_max", "gauge", "most stream transfers in flight at once");
+    for (int i = 0; i < camera_num; i++)
+    {
+        metrics_printf(&w, "ir_usb_transfers_in_flight_max{camera=\"%d\"} %u\n", cameras[i].index, \
+            cameras[i].usb.in_flight_max);
+    }
+    metrics_family(&w, "ir_usb_transfers_allocated", "gauge", "stream transfers libiruvc allocated for the stream");
+    for (int i = 0; i < camera_num; i++)
+    {
+        metrics_printf(&w, "ir_usb_transfers_allocated{camera=\"%d\"} %u\n", cameras[i].index, \
+            cameras[i].usb.transfers);
+    }
+    metrics_family(&w, "ir_usb_transfer_size_bytes", "gauge", "bytes per stream transfer as submitted");
+    for (int i = 0; i < camera_num; i++)
+    {
+        metrics_printf(&w, "ir_usb_transfer_size_bytes{camera=\"%d\"} %u\n", cameras[i].index, \
+            cameras[i].usb.transfer_length);
+    }
+    metrics_family(&w, "ir_usb_transfer_iso_packets", "gauge", "packets per isochronous transfer, 0 for bulk");
+    for (int i = 0; i < camera_num; i++)
+    {
+        metrics_printf(&w, "ir_usb_transfer_iso_packets{camera=\"%d\"} %u\n", cameras[i].index, \
+            cameras[i].usb.iso_packets);
+    }
+    metrics_camera_family(&w, cameras, camera_num, "ir_ring_depth", "gauge", \
+        "slots of the camera's frame ring", offsetof(MetricsCamera_t, depth));
+    metrics_family(&w, "ir_ring_slot_hold_seconds", "summary", \
+        "first reference to last release of a ring slot, how long its readers kept a frame");
+    for (int i = 0; i < camera_num; i++)
+    {
+        metrics_printf(&w, "ir_ring_slot_hold_seconds{camera=\"%d\",quantile=\"0.5\"} %.6f\n", cameras[i].index, \
+            cameras[i].holds.p50_us / 1e6);
+        metrics_printf(&w, "ir_ring_slot_hold_seconds{camera=\"%d\",quantile=\"0.99\"} %.6f\n", cameras[i].index, \
+            cameras[i].holds.p99_us / 1e6);
+        metrics_printf(&w, "ir_ring_slot_hold_seconds_sum{camera=\"%d\"} %.6f\n", cameras[i].index, \
+            cameras[i].holds.sum_us / 1e6);
+        metrics_printf(&w, "ir_ring_slot_hold_seconds_count{camera=\"%d\"} %llu\n", cameras[i].index, \
+            (unsigned long long)cameras[i].holds.count);
+    }
+    metrics_camera_family(&w, cameras, camera_num, "ir_ring_slot_long_holds_total", "counter", \
+        "ring slots held longer than the ring's hold warning", offsetof(MetricsCamera_t, long_holds));
+
+    //consumers are attached and detached by their own threads, a scrape may see one half set up
+    metrics_family(&w, "ir_ring_consumer_frames_total", "counter", "frames a ring consumer took");
+    for (int i = 0; i < camera_num; i++)
+    {
+        for (int c = 0; cameras[i].ring != NULL && c < FRAME_RING_MAX_CONSUMERS; c++)
+        {
+            const RingConsumer_t* consumer = &cameras[i].ring->consumers[c];
+            if (consumer->attached)
+            {
+                metrics_printf(&w, "ir_ring_consumer_frames_total{camera=\"%d\",consumer=\"%d\"} %llu\n", \
+                    cameras[i].index, c, (unsigned long long)consumer->frames);
+            }
+        }
+    }
+    metrics_family(&w, "ir_ring_consumer_dropped_total", "counter", \
+        "frames a ring consumer skipped or lost to the producer");
+    for (int i = 0; i < camera_num; i++)
+    {
+        for (int c = 0; cameras[i].ring != NULL && c < FRAME_RING_MAX_CONSUMERS; c++)
+        {
+            const RingConsumer_t* consumer = &cameras[i].ring->consumers[c];
+            if (consumer->attached)
+            {
+                metrics_printf(&w, "ir_ring_consumer_dropped_total{camera=\"%d\",consumer=\"%d\"} %llu\n", \
+                    cameras[i].index, c, (unsigned long long)consumer->dropped);
+            }
+        }
+    }
+    metrics_family(&w, "ir_ring_consumer_lag_frames", "gauge", \
+        "published frames a ring consumer has not taken yet, its queue depth");
+    for (int i = 0; i < camera_num; i++)
+    {
+        for (int c = 0; cameras[i].ring != NULL && c < FRAME_RING_MAX_CONSUMERS; c++)
+        {
+            const RingConsumer_t* consumer = &cameras[i].ring->consumers[c];
+            if (consumer->attached)
+            {
+                uint64_t last_seq = consumer->last_seq;
+                uint64_t lag = (cameras[i].published > last_seq) ? cameras[i].published - last_seq : 0;
+                metrics_printf(&w, "ir_ring_consumer_lag_frames{camera=\"%d\",consumer=\"%d\"} %llu\n", \
+                    cameras[i].index, c, (unsigned long long)lag);
+            }
+        }
+    }
+
+    uint32_t pending[CMDQ_PRIORITY_NUM];
+    cmdq_pending(pending);
+    metrics_family(&w, "ir_cmdq_pending", "gauge", "vendor commands waiting for the command worker");
+    for (int p = 0; p < CMDQ_PRIORITY_NUM; p++)
+    {
+        metrics_printf(&w, "ir_cmdq_pending{priority=\"%s\"} %u\n", metrics_priority_names[p], pending[p]);
+    }
+    CmdqStats_t cmdq;
+    cmdq_stats(&cmdq);
+    metrics_family(&w, "ir_cmdq_wait_max_seconds", "gauge", "longest submit to start of a vendor command since start");
+    for (int p = 0; p < CMDQ_PRIORITY_NUM; p++)
+    {
+        metrics_printf(&w, "ir_cmdq_wait_max_seconds{priority=\"%s\"} %.6f\n", metrics_priority_names[p], \
+            cmdq.wait_max_us[p] / 1e6);
+    }
+
+    //the timing.h histograms, cmd_wait and cmd_exec are the command latency
+    metrics_family(&w, "ir_stage_latency_seconds", "summary", \
+        "per stage durations since start, quantiles are histogram bucket upper bounds within 12.5%");
+    for (int stage = 0; stage < TIMING_STAGE_NUM; stage++)
+    {
+        TimingStats_t stats;
+        if (timing_stats_get((TimingStage_t)stage, &stats) < 0 || stats.count == 0)
+        {
+            continue;
+        }
+        const char* name = timing_stage_name((TimingStage_t)stage);
+        metrics_printf(&w, "ir_stage_latency_seconds{stage=\"%s\",quantile=\"0.5\"} %.6f\n", name, stats.p50_us / 1e6);
+        metrics_printf(&w, "ir_stage_latency_seconds{stage=\"%s\",quantile=\"0.99\"} %.6f\n", name, stats.p99_us / 1e6);
+        metrics_printf(&w, "ir_stage_latency_seconds_sum{stage=\"%s\"} %.6f\n", name, stats.sum_us / 1e6);
+        metrics_printf(&w, "ir_stage_latency_seconds_count{stage=\"%s\"} %llu\n", name, (unsigned long long)stats.count);
+    }
+    metrics_family(&w, "ir_stage_latency_max_seconds", "gauge", "longest duration of the stage since start");
+    for (int stage = 0; stage < TIMING_STAGE_NUM; stage++)
+    {
+        TimingStats_t stats;
+        if (timing_stats_get((TimingStage_t)stage, &stats) < 0 || stats.count == 0)
+        {
+            continue;
+        }
+        metrics_printf(&w, "ir_stage_latency_max_seconds{stage=\"%s\"} %.6f\n", \
+            timing_stage_name((TimingStage_t)stage), stats.max_us / 1e6);
+    }
+
+    metrics_family(&w, "ir_pool_stage_tasks_total", "counter", "tasks the worker pool ran per stage");
+    for (int stage = 0; stage < POOL_STAGE_NUM; stage++)
+    {
+        PoolStageStats_t stats;
+        if (pool_stage_stats((PoolStage_t)stage, &stats) == 0)
+        {
+            metrics_printf(&w, "ir_pool_stage_tasks_total{stage=\"%s\"} %llu\n", pool_stage_name((PoolStage_t)stage), \
+                (unsigned long long)stats.tasks);
+        }
+    }
+    metrics_family(&w, "ir_pool_stage_cpu_seconds_total", "counter", "thread cpu time of the worker pool per stage");
+    for (int stage = 0; stage < POOL_STAGE_NUM; stage++)
+    {
+        PoolStageStats_t stats;
+        if (pool_stage_stats((PoolStage_t)stage, &stats) == 0)
+        {
+            metrics_printf(&w, "ir_pool_stage_cpu_seconds_total{stage=\"%s\"} %.6f\n", \
+                pool_stage_name((PoolStage_t)stage), stats.cpu_us / 1e6);
+        }
+    }
+
+    MemAcctStats_t mem;
+    mem_acct_stats(&mem);
+    metrics_family(&w, "ir_memory_bytes", "gauge", "buffers registered with the memory accountant per class");
+    for (int cls = 0; cls < MEM_CLASS_NUM; cls++)
+    {
+        metrics_printf(&w, "ir_memory_bytes{class=\"%s\"} %llu\n", mem_acct_class_name((MemClass_t)cls), \
+            (unsigned long long)mem.bytes[cls]);
+    }
+    metrics_family(&w, "ir_memory_peak_bytes", "gauge", "highest total of the registered buffers");
+    metrics_printf(&w, "ir_memory_peak_bytes %llu\n", (unsigned long long)mem.peak);
+    metrics_family(&w, "ir_memory_budget_bytes", "gauge", "memory budget, 0 when unlimited");
+    metrics_printf(&w, "ir_memory_budget_bytes %llu\n", (unsigned long long)mem.budget);
+    metrics_family(&w, "ir_memory_shrunk_total", "counter", "optional buffers granted smaller to fit the budget");
+    metrics_printf(&w, "ir_memory_shrunk_total %llu\n", (unsigned long long)mem.shrunk);
+
+    DisplaySinkStats_t sink;
+    display_sink_stats_get(&sink);
+    metrics_family(&w, "ir_display_frames_total", "counter", "frames the display sink showed");
+    metrics_printf(&w, "ir_display_frames_total %llu\n", (unsigned long long)sink.shown);
+    metrics_family(&w, "ir_display_dropped_frames_total", "counter", \
+        "frames dropped for display only: replaced by a newer one before the sink thread took it, or refused "
+        "by the sink. the acquisition drops are ir_camera_dropped_frames_total");
+    metrics_printf(&w, "ir_display_dropped_frames_total{reason=\"replaced\"} %llu\n", \
+        (unsigned long long)sink.replaced);
+    metrics_printf(&w, "ir_display_dropped_frames_total{reason=\"sink\"} %llu\n", (unsigned long long)sink.failed);
+
+    metrics_family(&w, "ir_metrics_scrapes_total", "counter", "scrapes answered, this one included");
+    metrics_printf(&w, "ir_metrics_scrapes_total %llu\n", (unsigned long long)metrics->stats.scrapes);
+    if (w.overflow)
+    {
+        return METRICS_ERROR_MEM;
+    }
+    return (int)w.len;
+}
+
+int metrics_attach(Metrics_t* metrics, StreamFrameInfo_t* stream_frame_info)
+{
+    if (metrics == NULL || stream_frame_info == NULL)
+    {
+        return METRICS_ERROR_PARAM;
+    }
+    memset(metrics, 0, sizeof(Metrics_t));
+    metrics->cameras[0] = stream_frame_info;
+    metrics->camera_num = 1;
+    metrics->listen_fd = -1;
+    metrics->wake_fd[0] = -1;
+    metrics->wake_fd[1] = -1;
+    pthread_mutex_init(&metrics->mutex, NULL);
+    return METRICS_SUCCESS;
+}
+
+int metrics_add_camera(Metrics_t* metrics, StreamFrameInfo_t* stream_frame_info)
+{
+    if (metrics == NULL || stream_frame_info == NULL || metrics->camera_num == 0)
+    {
+        return METRICS_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&metrics->mutex);
+    if (metrics->camera_num >= METRICS_MAX_CAMERAS)
+    {
+        pthread_mutex_unlock(&metrics->mutex);
+        return METRICS_ERROR_PARAM;
+    }
+    metrics->cameras[metrics->camera_num++] = stream_frame_info;
+    pthread_mutex_unlock(&metrics->mutex);
+    return METRICS_SUCCESS;
+}
+
+int metrics_render(Metrics_t* metrics, char* dst, uint32_t size)
+{
+    if (metrics == NULL || dst == NULL || size == 0)
+    {
+        return METRICS_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&metrics->mutex);
+    int len = metrics_render_locked(metrics, dst, size);
+    pthread_mutex_unlock(&metrics->mutex);
+    return len;
+}
+
+#if !defined(_WIN32)
+static int metrics_send(int fd, const char* data, uint32_t size)
+{
+    uint32_t sent = 0;
+    while (sent < size)
+    {
+        ssize_t n = send(fd, data + sent, size - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        sent += n;
+    }
+    return 0;
+}
+
+//read the request line and headers, up to the empty line. returns -1 on a timeout, a close or metrics_stop
+static int metrics_request_read(Metrics_t* metrics, int fd, char* request, uint32_t size)
+{
+    uint32_t len = 0;
+    uint64_t deadline_us = get_monotonic_us() + METRICS_REQUEST_TIMEOUT_MS * 1000ull;
+    while (len < size - 1)
+    {
+        uint64_t now_us = get_monotonic_us();
+        if (now_us >= deadline_us || !metrics->running)
+        {
+            return -1;
+        }
+        struct pollfd pfds[2];
+        pfds[0].fd = fd;
+        pfds[0].events = POLLIN;
+        pfds[1].fd = metrics->wake_fd[0];
+        pfds[1].events = POLLIN;
+        uint64_t wait_ms = (deadline_us - now_us + 999) / 1000;
+        if (poll(pfds, 2, wait_ms < METRICS_POLL_MS ? (int)wait_ms : METRICS_POLL_MS) <= 0 || \
+            !(pfds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            continue;
+        }
+        ssize_t n = recv(fd, request + len, size - 1 - len, 0);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        len += n;
+        request[len] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL)
+        {
+            return 0;
+        }
+    }
+    //headers longer than the buffer, the request line is all that is looked at
+    return 0;
+}
+
+//one request per connection, then close
+static void metrics_client(Metrics_t* metrics, int fd)
+{
+    char request[METRICS_REQUEST_LEN];
+    if (metrics_request_read(metrics, fd, request, sizeof(request)) < 0)
+    {
+        pthread_mutex_lock(&metrics->mutex);
+        metrics->stats.errors++;
+        pthread_mutex_unlock(&metrics->mutex);
+        return;
+    }
+    int head = (strncmp(request, "HEAD ", 5) == 0);
+    const char* path = head ? request + 5 : request + 4;
+    size_t path_len = strcspn(path, " ?\r\n");
+    int found = (head || strncmp(request, "GET ", 4) == 0) && path_len == 8 && strncmp(path, "/metrics", 8) == 0;
+
+    char header[METRICS_HEADER_LEN];
+    pthread_mutex_lock(&metrics->mutex);
+    if (!found)
+    {
+        metrics->stats.errors++;
+        pthread_mutex_unlock(&metrics->mutex);
+        static const char* not_found = "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 10\r\n"
+            "Connection: close\r\n\r\nnot found\n";
+        metrics_send(fd, not_found, strlen(not_found));
+        return;
+    }
+    metrics->stats.scrapes++;
+    int len;
+    while ((len = metrics_render_locked(metrics, metrics->body, metrics->body_capacity)) == METRICS_ERROR_MEM)
+    {
+        char* body = (char*)realloc(metrics->body, metrics->body_capacity * 2);
+        if (body == NULL)
+        {
+            break;
+        }
+        metrics->body = body;
+        metrics->body_capacity *= 2;
+    }
+    if (len < 0)
+    {
+        metrics->stats.errors++;
+        pthread_mutex_unlock(&metrics->mutex);
+        static const char* error = "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        metrics_send(fd, error, strlen(error));
+        return;
+    }
+    pthread_mutex_unlock(&metrics->mutex);
+    //only this thread touches the body once it is rendered
+    int header_len = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", len);
+    if (metrics_send(fd, header, header_len) < 0 || (!head && metrics_send(fd, metrics->body, len) < 0))
+    {
+        pthread_mutex_lock(&metrics->mutex);
+        metrics->stats.errors++;
+        pthread_mutex_unlock(&metrics->mutex);
+    }
+}
+
+//server thread: scrapes are rare and small, they are answered one at a time
+static void* metrics_server_function(void* threadarg)
+{
+    Metrics_t* metrics = (Metrics_t*)threadarg;
+    while (metrics->running)
+    {
+        struct pollfd pfds[2];
+        pfds[0].fd = metrics->listen_fd;
+        pfds[0].events = POLLIN;
+        pfds[1].fd = metrics->wake_fd[0];
+        pfds[1].events = POLLIN;
+        if (poll(pfds, 2, METRICS_POLL_MS) <= 0 || !(pfds[0].revents & POLLIN))
+        {
+            continue;
+        }
+        int fd = accept(metrics->listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            continue;
+        }
+        //a scraper that stops reading must not hold the thread
+        struct timeval timeout;
+        timeout.tv_sec = METRICS_REQUEST_TIMEOUT_MS / 1000;
+        timeout.tv_usec = (METRICS_REQUEST_TIMEOUT_MS % 1000) * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        metrics_client(metrics, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+int metrics_start(Metrics_t* metrics, const MetricsParam_t* param)
+{
+    if (metrics == NULL || param == NULL || metrics->camera_num == 0 || metrics->running)
+    {
+        return METRICS_ERROR_PARAM;
+    }
+    metrics->param = *param;
+    if (metrics->param.port == 0)
+    {
+        metrics->param.port = METRICS_DEFAULT_PORT;
+    }
+    metrics->body = (char*)malloc(METRICS_BODY_LEN);
+    if (metrics->body == NULL)
+    {
+        return METRICS_ERROR_MEM;
+    }
+    metrics->body_capacity = METRICS_BODY_LEN;
+
+    metrics->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(metrics->param.port);
+    if (metrics->listen_fd < 0 || \
+        setsockopt(metrics->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 || \
+        bind(metrics->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(metrics->listen_fd, 4) < 0 || \
+        pipe(metrics->wake_fd) < 0)
+    {
+        printf("metrics: listen on port %u failed\n", metrics->param.port);
+        metrics_stop(metrics);
+        return METRICS_ERROR_SOCKET;
+    }
+    fcntl(metrics->listen_fd, F_SETFL, fcntl(metrics->listen_fd, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(metrics->wake_fd[0], F_SETFL, fcntl(metrics->wake_fd[0], F_GETFL, 0) | O_NONBLOCK);
+
+    memset(&metrics->stats, 0, sizeof(MetricsStats_t));
+    metrics->running = 1;
+    if (pthread_create(&metrics->thread, NULL, metrics_server_function, metrics) != 0)
+    {
+        metrics->running = 0;
+        metrics_stop(metrics);
+        return METRICS_ERROR_SOCKET;
+    }
+    printf("metrics: http://<host>:%u/metrics\n", metrics->param.port);
+    return METRICS_SUCCESS;
+}
+
+int metrics_stop(Metrics_t* metrics)
+{
+    if (metrics == NULL)
+    {
+        return METRICS_ERROR_PARAM;
+    }
+    int running = metrics->running;
+    metrics->running = 0;
+    if (running)
+    {
+        uint8_t wake = 1;
+        if (write(metrics->wake_fd[1], &wake, 1) < 0)
+        {
+        }
+        pthread_join(metrics->thread, NULL);
+    }
+    if (metrics->listen_fd >= 0)
+    {
+        close(metrics->listen_fd);
+        metrics->listen_fd = -1;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (metrics->wake_fd[i] >= 0)
+        {
+            close(metrics->wake_fd[i]);
+            metrics->wake_fd[i] = -1;
+        }
+    }
+    free(metrics->body);
+    metrics->body = NULL;
+    metrics->body_capacity = 0;
+    if (running)
+    {
+        printf("metrics: %llu scrapes, %llu errors\n", (unsigned long long)metrics->stats.scrapes, \
+            (unsigned long long)metrics->stats.errors);
+    }
+    return METRICS_SUCCESS;
+}
+#else
+int metrics_start(Metrics_t* metrics, const MetricsParam_t* param)
+{
+    //the server is written against posix sockets and poll
+    return METRICS_ERROR_SOCKET;
+}
+
+int metrics_stop(Metrics_t* metrics)
+{
+    return METRICS_SUCCESS;
+}
+#endif
+
+int metrics_stats(Metrics_t* metrics, MetricsStats_t* stats)
+{
+    if (metrics == NULL || stats == NULL)
+    {
+        return METRICS_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&metrics->mutex);
+    *stats = metrics->stats;
+    pthread_mutex_unlock(&metrics->mutex);
+    return METRICS_SUCCESS;
+}
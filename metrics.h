@@ -0,0 +1,60 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+
+#define METRICS_DEFAULT_PORT 9464
+#define METRICS_MAX_CAMERAS 4
+#define METRICS_BODY_LEN 16384          //first size of the exposition buffer, doubled when a scrape does not fit
+#define METRICS_REQUEST_LEN 1024
+#define METRICS_REQUEST_TIMEOUT_MS 1000 //a scraper sending its request slower than this is closed
+
+#define METRICS_SUCCESS 0
+#define METRICS_ERROR_PARAM -1
+#define METRICS_ERROR_MEM -2            //metrics_render: dst is too small
+#define METRICS_ERROR_SOCKET -3
+
+typedef struct {
+    uint16_t port;                      //0 selects METRICS_DEFAULT_PORT
+}MetricsParam_t;
+
+typedef struct {
+    uint64_t scrapes;                   //GET /metrics answered
+    uint64_t errors;                    //other requests, timeouts and failed sends
+}MetricsStats_t;
+
+//prometheus text exposition on http://<host>:port/metrics. nothing is counted for it: the frame path keeps
+//its plain per thread counters (ring, camera) and lock-free histograms (timing.h), a scrape reads them as they are
+typedef struct {
+    StreamFrameInfo_t* cameras[METRICS_MAX_CAMERAS];
+    int camera_num;
+    MetricsParam_t param;
+    uint8_t running;
+    int listen_fd;
+    int wake_fd[2];                     //metrics_stop wakes the server thread
+    char* body;
+    uint32_t body_capacity;
+    MetricsStats_t stats;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+}Metrics_t;
+
+//export the camera's frame ring and counters, it must stay open until metrics_stop
+int metrics_attach(Metrics_t* metrics, StreamFrameInfo_t* stream_frame_info);
+
+//one more camera of a multi camera process, after metrics_attach
+int metrics_add_camera(Metrics_t* metrics, StreamFrameInfo_t* stream_frame_info);
+
+//listen on param->port and answer scrapes from a server thread
+int metrics_start(Metrics_t* metrics, const MetricsParam_t* param);
+
+int metrics_stop(Metrics_t* metrics);
+
+//the exposition as a scrape returns it, returns its length or METRICS_ERROR_MEM when size is too small
+int metrics_render(Metrics_t* metrics, char* dst, uint32_t size);
+
+int metrics_stats(Metrics_t* metrics, MetricsStats_t* stats);
+
+#endif
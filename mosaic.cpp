@@ -0,0 +1,467 @@
+#include "mosaic.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ring.h"
+#include "simd.h"
+#include "tempspan.h"
+
+#define MOSAIC_FRAC_BITS 6
+
+//mosaic pixel (u, v) in camera pixels, 0 when the camera does not see it
+static int mosaic_map(const MosaicCameraParam_t* camera, uint32_t u, uint32_t v, double* x, double* y)
+{
+    const double* h = camera->homography;
+    double w = h[6] * u + h[7] * v + h[8];
+    if (w <= 1e-9)
+    {
+        return 0;
+    }
+    *x = (h[0] * u + h[1] * v + h[2]) / w;
+    *y = (h[3] * u + h[4] * v + h[5]) / w;
+    //the plane covers half a pixel around its outer centers
+    return *x >= -0.5 && *x <= camera->width - 0.5 && *y >= -0.5 && *y <= camera->height - 0.5;
+}
+
+//one coordinate in Q6, the 2 taps kept inside [0, size - 1]
+static void mosaic_tap(double pos, uint32_t size, uint32_t* first, uint32_t* frac)
+{
+    double max_pos = (double)(size - 1);
+    pos = (pos < 0.0) ? 0.0 : ((pos > max_pos) ? max_pos : pos);
+    uint32_t fixed = (uint32_t)(pos * (1 << MOSAIC_FRAC_BITS) + 0.5);
+    *first = fixed >> MOSAIC_FRAC_BITS;
+    *frac = fixed & ((1 << MOSAIC_FRAC_BITS) - 1);
+    if (*first >= size - 1)
+    {
+        *first = size - 2;
+        *frac = 1 << MOSAIC_FRAC_BITS;
+    }
+}
+
+//camera pixels to the nearest border of the plane
+static double mosaic_depth(const MosaicCameraParam_t* camera, double x, double y)
+{
+    double dx = fmin(x + 0.5, camera->width - 0.5 - x);
+    double dy = fmin(y + 0.5, camera->height - 0.5 - y);
+    return fmax(fmin(dx, dy), 0.0);
+}
+
+static void mosaic_segs_build(Mosaic_t* mosaic, uint32_t v)
+{
+    uint16_t* segs = mosaic->segs + (size_t)v * MOSAIC_MAX_CAMERAS * 2;
+    int num = 0;
+    for (int c = 0; c < mosaic->param.camera_num; c++)
+    {
+        const uint16_t* span = mosaic->warps[c].span + 2 * v;
+        if (span[1] <= span[0])
+        {
+            continue;
+        }
+        //insert by first pixel, then merge the overlapping and touching ones
+        int k = num++;
+        while (k > 0 && segs[2 * (k - 1)] > span[0])
+        {
+            segs[2 * k] = segs[2 * (k - 1)];
+            segs[2 * k + 1] = segs[2 * (k - 1) + 1];
+            k--;
+        }
+        segs[2 * k] = span[0];
+        segs[2 * k + 1] = span[1];
+    }
+    int merged = 0;
+    for (int k = 0; k < num; k++)
+    {
+        if (merged > 0 && segs[2 * k] <= segs[2 * (merged - 1) + 1])
+        {
+            uint16_t end = segs[2 * k + 1];
+            segs[2 * (merged - 1) + 1] = (end > segs[2 * (merged - 1) + 1]) ? end : segs[2 * (merged - 1) + 1];
+            continue;
+        }
+        segs[2 * merged] = segs[2 * k];
+        segs[2 * merged + 1] = segs[2 * k + 1];
+        merged++;
+    }
+    mosaic->seg_num[v] = (uint8_t)merged;
+}
+
+//the cameras' raw weights of one row side by side, normalized so every covered pixel adds up to MOSAIC_WEIGHT_ONE
+static void mosaic_row_build(Mosaic_t* mosaic, uint32_t v, double* depth)
+{
+    const MosaicParam_t* param = &mosaic->param;
+    for (int c = 0; c < param->camera_num; c++)
+    {
+        const MosaicCameraParam_t* camera = &param->cameras[c];
+        MosaicWarp_t* warp = &mosaic->warps[c];
+        const uint16_t* span = warp->span + 2 * v;
+        uint32_t entry = warp->row_start[v];
+        for (uint32_t u = 0; u < param->width; u++)
+        {
+            double x = -1.0, y = -1.0;
+            int covered = (u >= span[0] && u < span[1]);
+            if (covered)
+            {
+                mosaic_map(camera, u, v, &x, &y);
+                uint32_t x0, fx, y0, fy;
+                mosaic_tap(x, camera->width, &x0, &fx);
+                mosaic_tap(y, camera->height, &y0, &fy);
+                warp->base[entry] = y0 * camera->width + x0;
+                warp->frac[entry] = (uint16_t)(fx | (fy << 8));
+                entry++;
+            }
+            depth[(size_t)c * param->width + u] = covered ? mosaic_depth(camera, x, y) : -1.0;
+        }
+    }
+    for (uint32_t u = 0; u < param->width; u++)
+    {
+        double sum = 0.0, best = -1.0;
+        int best_c = -1;
+        double raw[MOSAIC_MAX_CAMERAS];
+        for (int c = 0; c < param->camera_num; c++)
+        {
+            double d = depth[(size_t)c * param->width + u];
+            raw[c] = (d < 0.0) ? 0.0 : ((param->feather > 0.0f) ? fmin(d / param->feather, 1.0) : 0.0);
+            sum += raw[c];
+            if (d > best)
+            {
+                best = d;
+                best_c = c;
+            }
+        }
+        if (best_c < 0)
+        {
+            continue;
+        }
+        if (sum <= 0.0)
+        {
+            //no feather, or every camera at its very border: the deepest one takes the pixel
+            raw[best_c] = 1.0;
+            sum = 1.0;
+        }
+        uint32_t total = 0;
+        uint16_t weight[MOSAIC_MAX_CAMERAS];
+        for (int c = 0; c < param->camera_num; c++)
+        {
+            weight[c] = (uint16_t)(raw[c] * MOSAIC_WEIGHT_ONE / sum);
+            total += weight[c];
+        }
+        weight[best_c] += (uint16_t)(MOSAIC_WEIGHT_ONE - total);
+        for (int c = 0; c < param->camera_num; c++)
+        {
+            MosaicWarp_t* warp = &mosaic->warps[c];
+            const uint16_t* span = warp->span + 2 * v;
+            if (u >= span[0] && u < span[1])
+            {
+                warp->weight[warp->row_start[v] + u - span[0]] = weight[c];
+            }
+        }
+    }
+}
+
+int mosaic_init(Mosaic_t* mosaic, const MosaicParam_t* param)
+{
+    if (mosaic == NULL || param == NULL || param->width == 0 || param->width > 65535 || param->height == 0 || \
+        param->camera_num <= 0 || param->camera_num > MOSAIC_MAX_CAMERAS || param->feather < 0.0f)
+    {
+        return MOSAIC_ERROR_PARAM;
+    }
+    for (int c = 0; c < param->camera_num; c++)
+    {
+        const MosaicCameraParam_t* camera = &param->cameras[c];
+        if (camera->width < 2 || camera->height < 2 || (uint64_t)camera->width * camera->height >= (1u << 31))
+        {
+            return MOSAIC_ERROR_PARAM;
+        }
+    }
+    memset(mosaic, 0, sizeof(Mosaic_t));
+    mosaic->param = *param;
+    for (int c = 0; c < MOSAIC_MAX_CAMERAS; c++)
+    {
+        mosaic->consumer_ids[c] = -1;
+    }
+    mosaic->segs = (uint16_t*)malloc((size_t)param->height * MOSAIC_MAX_CAMERAS * 2 * sizeof(uint16_t));
+    mosaic->seg_num = (uint8_t*)calloc(param->height, 1);
+    mosaic->rows = (uint16_t*)malloc((size_t)BAND_MAX_NUM * param->width * sizeof(uint16_t));
+    double* depth = (double*)malloc((size_t)param->camera_num * param->width * sizeof(double));
+    int ret = (mosaic->segs != NULL && mosaic->seg_num != NULL && mosaic->rows != NULL && depth != NULL) ? \
+        MOSAIC_SUCCESS : MOSAIC_ERROR_MEM;
+    //spans first, they size the tables
+    for (int c = 0; c < param->camera_num && ret == MOSAIC_SUCCESS; c++)
+    {
+        const MosaicCameraParam_t* camera = &param->cameras[c];
+        MosaicWarp_t* warp = &mosaic->warps[c];
+        warp->plane_len = camera->width * camera->height;
+        warp->span = (uint16_t*)malloc((size_t)param->height * 2 * sizeof(uint16_t));
+        warp->row_start = (uint32_t*)malloc(((size_t)param->height + 1) * sizeof(uint32_t));
+        if (warp->span == NULL || warp->row_start == NULL)
+        {
+            ret = MOSAIC_ERROR_MEM;
+            break;
+        }
+        uint32_t entries = 0;
+        for (uint32_t v = 0; v < param->height; v++)
+        {
+            uint32_t first = param->width, last = 0;
+            for (uint32_t u = 0; u < param->width; u++)
+            {
+                double x, y;
+                if (mosaic_map(camera, u, v, &x, &y))
+                {
+                    first = (u < first) ? u : first;
+                    last = u + 1;
+                }
+            }
+            //a line maps to a line, its part inside the plane is one span
+            warp->span[2 * v] = (uint16_t)((first < last) ? first : 0);
+            warp->span[2 * v + 1] = (uint16_t)((first < last) ? last : 0);
+            warp->row_start[v] = entries;
+            entries += warp->span[2 * v + 1] - warp->span[2 * v];
+        }
+        warp->row_start[param->height] = entries;
+        size_t entry_num = (entries > 0) ? entries : 1;
+        warp->base = (uint32_t*)malloc(entry_num * sizeof(uint32_t));
+        warp->frac = (uint16_t*)malloc(entry_num * sizeof(uint16_t));
+        warp->weight = (uint16_t*)malloc(entry_num * sizeof(uint16_t));
+        if (warp->base == NULL || warp->frac == NULL || warp->weight == NULL)
+        {
+            ret = MOSAIC_ERROR_MEM;
+        }
+    }
+    for (uint32_t v = 0; v < param->height && ret == MOSAIC_SUCCESS; v++)
+    {
+        mosaic_row_build(mosaic, v, depth);
+        mosaic_segs_build(mosaic, v);
+    }
+    free(depth);
+    if (ret != MOSAIC_SUCCESS)
+    {
+        mosaic_release(mosaic);
+    }
+    return ret;
+}
+
+void mosaic_release(Mosaic_t* mosaic)
+{
+    if (mosaic == NULL)
+    {
+        return;
+    }
+    for (int c = 0; c < MOSAIC_MAX_CAMERAS; c++)
+    {
+        if (mosaic->rings[c] != NULL && mosaic->consumer_ids[c] >= 0)
+        {
+            ring_consumer_detach(mosaic->rings[c], mosaic->consumer_ids[c]);
+        }
+        MosaicWarp_t* warp = &mosaic->warps[c];
+        free(warp->base);
+        free(warp->frac);
+        free(warp->weight);
+        free(warp->row_start);
+        free(warp->span);
+    }
+    free(mosaic->segs);
+    free(mosaic->seg_num);
+    free(mosaic->rows);
+    memset(mosaic, 0, sizeof(Mosaic_t));
+}
+
+typedef struct {
+    Mosaic_t* mosaic;
+    const FramePlane_t* planes;
+    uint16_t* temp;
+    uint8_t* bgr;
+    const uint8_t* lut;
+    const TempSpan_t* span;             //the locked span's lut, the temp values map straight
+    int band_num;
+}MosaicJob_t;
+
+//every camera accumulates its share into the zeroed rows, then the band's min/max over the covered runs (none
+//through a locked span)
+static void mosaic_compose_band(void* arg, int band, int y0, int y1)
+{
+    MosaicJob_t* job = (MosaicJob_t*)arg;
+    Mosaic_t* mosaic = job->mosaic;
+    uint32_t width = mosaic->param.width;
+    uint16_t band_min = 65535, band_max = 0;
+    for (int y = y0; y < y1; y++)
+    {
+        uint16_t* row = job->temp + (size_t)y * width;
+        memset(row, 0, width * sizeof(uint16_t));
+        for (int c = 0; c < mosaic->param.camera_num; c++)
+        {
+            const MosaicWarp_t* warp = &mosaic->warps[c];
+            uint32_t first = warp->span[2 * y], last = warp->span[2 * y + 1];
+            if (last > first)
+            {
+                uint32_t entry = warp->row_start[y];
+                simd_remap_add_u16((const uint16_t*)job->planes[c].data, warp->plane_len, mosaic->param.cameras[c].width, \
+                    warp->base + entry, warp->frac + entry, warp->weight + entry, last - first, row + first);
+            }
+        }
+        const uint16_t* segs = mosaic->segs + (size_t)y * MOSAIC_MAX_CAMERAS * 2;
+        for (int s = 0; job->span == NULL && s < mosaic->seg_num[y]; s++)
+        {
+            uint16_t seg_min, seg_max;
+            simd_minmax_u16(row + segs[2 * s], segs[2 * s + 1] - segs[2 * s], &seg_min, &seg_max);
+            band_min = (seg_min < band_min) ? seg_min : band_min;
+            band_max = (seg_max > band_max) ? seg_max : band_max;
+        }
+    }
+    mosaic->band_min[band] = band_min;
+    mosaic->band_max[band] = band_max;
+}
+
+//after every compose band: one stretch of the whole mosaic, the same lut entry for the same temperature
+static void mosaic_colorize_band(void* arg, int band, int y0, int y1)
+{
+    MosaicJob_t* job = (MosaicJob_t*)arg;
+    Mosaic_t* mosaic = job->mosaic;
+    uint32_t width = mosaic->param.width;
+    uint16_t min_val = 65535, max_val = 0;
+    for (int b = 0; b < job->band_num; b++)
+    {
+        min_val = (mosaic->band_min[b] < min_val) ? mosaic->band_min[b] : min_val;
+        max_val = (mosaic->band_max[b] > max_val) ? mosaic->band_max[b] : max_val;
+    }
+    uint32_t range = (max_val > min_val) ? (uint32_t)(max_val - min_val) : 1;
+    uint16_t* stretched = mosaic->rows + (size_t)band * width;
+    for (int y = y0; y < y1; y++)
+    {
+        const uint16_t* row = job->temp + (size_t)y * width;
+        uint8_t* out = job->bgr + (size_t)y * width * 3;
+        memset(out, 0, width * 3);
+        const uint16_t* segs = mosaic->segs + (size_t)y * MOSAIC_MAX_CAMERAS * 2;
+        for (int s = 0; s < mosaic->seg_num[y]; s++)
+        {
+            int first = segs[2 * s], num = segs[2 * s + 1] - segs[2 * s];
+            if (job->span != NULL)
+            {
+                temp_span_map(job->span->bgr, row + first, num, out + first * 3);
+                continue;
+            }
+            simd_stretch_u16(row + first, num, min_val, range, stretched);
+            palette_map(job->lut, 3, stretched, num, out + first * 3);
+        }
+    }
+}
+
+int mosaic_compose(Mosaic_t* mosaic, const FramePlane_t* planes, uint16_t* temp, uint8_t* bgr, \
+    const Palette_t* palette, int band_num)
+{
+    if (mosaic == NULL || mosaic->segs == NULL || planes == NULL || temp == NULL || (bgr != NULL && palette == NULL))
+    {
+        return MOSAIC_ERROR_PARAM;
+    }
+    for (int c = 0; c < mosaic->param.camera_num; c++)
+    {
+        //the warps index packed planes
+        const MosaicCameraParam_t* camera = &mosaic->param.cameras[c];
+        if (planes[c].data == NULL || planes[c].width != camera->width || planes[c].height != camera->height || \
+            planes[c].stride != camera->width * 2)
+        {
+            return MOSAIC_ERROR_PARAM;
+        }
+    }
+    band_num = (band_num < 1) ? 1 : ((band_num > BAND_MAX_NUM) ? BAND_MAX_NUM : band_num);
+    band_num = (band_num > (int)mosaic->param.height) ? (int)mosaic->param.height : band_num;
+    //the span is taken once, every band maps through the same lut
+    const TempSpan_t* span = (bgr != NULL) ? temp_span_get(palette, 0) : NULL;
+    MosaicJob_t job = { mosaic, planes, temp, bgr, (palette != NULL) ? palette->bgr : NULL, span, band_num };
+    BandStage_t stages[2] = {
+        { mosaic_compose_band, &job, (int)mosaic->param.height },
+        { mosaic_colorize_band, &job, (int)mosaic->param.height },
+    };
+    band_run(POOL_STAGE_DISPLAY, stages, (bgr != NULL) ? 2 : 1, band_num);
+    uint16_t min_val = 65535, max_val = 0;
+    for (int b = 0; b < band_num; b++)
+    {
+        min_val = (mosaic->band_min[b] < min_val) ? mosaic->band_min[b] : min_val;
+        max_val = (mosaic->band_max[b] > max_val) ? mosaic->band_max[b] : max_val;
+    }
+    mosaic->agc_min = (span == NULL) ? min_val : 0;
+    mosaic->agc_max = (span == NULL) ? max_val : 0;
+    return MOSAIC_SUCCESS;
+}
+
+int mosaic_attach(Mosaic_t* mosaic, int camera, StreamFrameInfo_t* stream_frame_info)
+{
+    if (mosaic == NULL || mosaic->segs == NULL || camera < 0 || camera >= mosaic->param.camera_num || \
+        mosaic->rings[camera] != NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL || \
+        stream_frame_info->temp_info.width != mosaic->param.cameras[camera].width || \
+        stream_frame_info->temp_info.height != mosaic->param.cameras[camera].height)
+    {
+        return MOSAIC_ERROR_PARAM;
+    }
+    int consumer_id = ring_consumer_attach(stream_frame_info->frame_ring, RING_POLICY_NEWEST);
+    if (consumer_id < 0)
+    {
+        return MOSAIC_ERROR_PARAM;
+    }
+    mosaic->rings[camera] = stream_frame_info->frame_ring;
+    mosaic->consumer_ids[camera] = consumer_id;
+    return MOSAIC_SUCCESS;
+}
+
+int mosaic_frame(Mosaic_t* mosaic, uint32_t timeout_ms, uint16_t* temp, uint8_t* bgr, const Palette_t* palette, \
+    int band_num)
+{
+    if (mosaic == NULL || mosaic->segs == NULL)
+    {
+        return MOSAIC_ERROR_PARAM;
+    }
+    int camera_num = mosaic->param.camera_num;
+    FrameSlot_t* slots[MOSAIC_MAX_CAMERAS];
+    FramePlane_t planes[MOSAIC_MAX_CAMERAS];
+    int held = 0;
+    int ret = MOSAIC_SUCCESS;
+    uint64_t oldest_us = UINT64_MAX, newest_us = 0;
+    for (; held < camera_num; held++)
+    {
+        if (mosaic->rings[held] == NULL)
+        {
+            ret = MOSAIC_ERROR_PARAM;
+            break;
+        }
+        int rst = ring_read_acquire(mosaic->rings[held], mosaic->consumer_ids[held], timeout_ms, &slots[held]);
+        if (rst != RING_SUCCESS)
+        {
+            ret = (rst == RING_TIMEOUT) ? MOSAIC_ERROR_TIMEOUT : ((rst == RING_CLOSED) ? MOSAIC_ERROR_CLOSED : \
+                MOSAIC_ERROR_PARAM);
+            break;
+        }
+        //the planes straight from the held slots
+        planes[held] = slots[held]->desc.temp;
+        uint64_t timestamp_us = slots[held]->desc.timestamp_us;
+        oldest_us = (timestamp_us < oldest_us) ? timestamp_us : oldest_us;
+        newest_us = (timestamp_us > newest_us) ? timestamp_us : newest_us;
+    }
+    if (ret == MOSAIC_SUCCESS)
+    {
+        uint64_t start_us = get_monotonic_us();
+        ret = mosaic_compose(mosaic, planes, temp, bgr, palette, band_num);
+        uint64_t compose_us = get_monotonic_us() - start_us;
+        mosaic->stats.frames += (ret == MOSAIC_SUCCESS);
+        mosaic->stats.compose_max_us = (compose_us > mosaic->stats.compose_max_us) ? compose_us : \
+            mosaic->stats.compose_max_us;
+        uint64_t skew_us = newest_us - oldest_us;
+        mosaic->stats.skew_max_us = (skew_us > mosaic->stats.skew_max_us) ? skew_us : mosaic->stats.skew_max_us;
+    }
+    else if (ret == MOSAIC_ERROR_TIMEOUT)
+    {
+        mosaic->stats.timeouts++;
+    }
+    for (int i = 0; i < held; i++)
+    {
+        ring_read_release(mosaic->rings[i], slots[i]);
+    }
+    return ret;
+}
+
+int mosaic_stats(Mosaic_t* mosaic, MosaicStats_t* stats)
+{
+    if (mosaic == NULL || stats == NULL)
+    {
+        return MOSAIC_ERROR_PARAM;
+    }
+    *stats = mosaic->stats;
+    return MOSAIC_SUCCESS;
+}
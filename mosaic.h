@@ -0,0 +1,92 @@
+#ifndef _MOSAIC_H_
+#define _MOSAIC_H_
+
+#include <stdint.h>
+#include "data.h"
+#include "band.h"
+#include "palette.h"
+
+#define MOSAIC_MAX_CAMERAS 8
+#define MOSAIC_WEIGHT_ONE 256           //Q8 blend weight of a pixel only one camera covers
+
+#define MOSAIC_SUCCESS 0
+#define MOSAIC_ERROR_PARAM -1
+#define MOSAIC_ERROR_MEM -2
+#define MOSAIC_ERROR_TIMEOUT -3         //a camera had no frame in time
+#define MOSAIC_ERROR_CLOSED -4          //a camera's ring is closed
+
+typedef struct {
+    uint32_t width;                     //the camera's temp plane
+    uint32_t height;
+    double homography[9];               //row major, mosaic pixel (u, v, 1) -> camera pixel, centers at integers,
+                                        //fusion_homography of 4 point pairs
+}MosaicCameraParam_t;
+
+typedef struct {
+    uint32_t width;                     //the wide frame
+    uint32_t height;
+    int camera_num;
+    MosaicCameraParam_t cameras[MOSAIC_MAX_CAMERAS];
+    float feather;                      //camera pixels from a camera's border over which its weight ramps up,
+                                        //0 gives each overlap pixel to the camera it lies deepest in
+}MosaicParam_t;
+
+//one camera's warp table over the mosaic rows it covers, entries only for its spans
+typedef struct {
+    uint32_t* base;                     //element offset of the 2x2 taps in the camera plane
+    uint16_t* frac;                     //Q6 fx | fy << 8
+    uint16_t* weight;                   //Q8, the weights of the cameras covering a pixel add up to MOSAIC_WEIGHT_ONE
+    uint32_t* row_start;                //height + 1 prefix sums into the entries
+    uint16_t* span;                     //2 per mosaic row: first covered pixel, one past the last
+    uint32_t plane_len;                 //values in the camera plane
+}MosaicWarp_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t timeouts;
+    uint64_t skew_max_us;               //spread of the receive times of the frames of one mosaic
+    uint64_t compose_max_us;
+}MosaicStats_t;
+
+//n cameras side by side stitched into one wide temp frame and one wide colorized frame. the warps are built
+//once, each frame the cameras' temp planes are remapped and blended straight into the wide temp frame (no
+//per camera copies), then the wide frame is colorized through one min/max stretch over everything covered,
+//so one temperature has one color in every camera. while a span is locked (tempspan.h) the wide frame maps
+//through the span's lut instead, the colors of every display and mosaic, and no min/max is taken
+typedef struct {
+    MosaicParam_t param;
+    MosaicWarp_t warps[MOSAIC_MAX_CAMERAS];
+    uint16_t* segs;                     //per row MOSAIC_MAX_CAMERAS covered runs (first, end), the cameras' spans merged
+    uint8_t* seg_num;
+    uint16_t* rows;                     //BAND_MAX_NUM stretch rows
+    uint16_t band_min[BAND_MAX_NUM];
+    uint16_t band_max[BAND_MAX_NUM];
+    uint16_t agc_min;                   //the last frame's shared stretch, both 0 through a locked span
+    uint16_t agc_max;
+    FrameRing_t* rings[MOSAIC_MAX_CAMERAS];  //mosaic_attach
+    int consumer_ids[MOSAIC_MAX_CAMERAS];
+    MosaicStats_t stats;
+}Mosaic_t;
+
+//builds the warps and the blend weights
+int mosaic_init(Mosaic_t* mosaic, const MosaicParam_t* param);
+
+//detaches the rings' consumers
+void mosaic_release(Mosaic_t* mosaic);
+
+//planes[i]: camera i's temp plane (16 bit). temp: width x height raw temp values, 0 where no camera looks.
+//bgr: bgr888 through palette (the locked span's lut of it while one is locked), black where no camera looks,
+//NULL skips it. band_num row bands on the display stage of the task pool
+int mosaic_compose(Mosaic_t* mosaic, const FramePlane_t* planes, uint16_t* temp, uint8_t* bgr, \
+    const Palette_t* palette, int band_num);
+
+//read camera i from its stream's ring with a NEWEST consumer
+int mosaic_attach(Mosaic_t* mosaic, int camera, StreamFrameInfo_t* stream_frame_info);
+
+//the newest frame of every attached ring, composed while the slots are held, then released
+int mosaic_frame(Mosaic_t* mosaic, uint32_t timeout_ms, uint16_t* temp, uint8_t* bgr, const Palette_t* palette, \
+    int band_num);
+
+int mosaic_stats(Mosaic_t* mosaic, MosaicStats_t* stats);
+
+#endif
@@ -0,0 +1,483 @@
+#include "mpcal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(linux) || defined(unix)
+#include <unistd.h>
+#endif
+#include "ring.h"
+#include "pool.h"
+#include "cmdq.h"
+#include "simd.h"
+#include "calib.h"
+#include "housekeep.h"
+#include "prop.h"
+
+//absolute CLOCK_REALTIME deadline for pthread_cond_timedwait
+static void mpcal_deadline(struct timespec* ts, uint32_t timeout_ms)
+{
+#if defined(_WIN32)
+    timespec_get(ts, TIME_UTC);
+#elif defined(linux) || defined(unix)
+    clock_gettime(CLOCK_REALTIME, ts);
+#endif
+    ts->tv_sec += (time_t)(timeout_ms / 1000);
+    ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+//wait on the session's cond while state is busy, timeout_ms 0 waits forever. called with the mutex held
+static int mpcal_wait_state(MpCal_t* cal, MpcalState_t busy, uint32_t timeout_ms)
+{
+    struct timespec deadline;
+    mpcal_deadline(&deadline, timeout_ms);
+    while (cal->state == busy)
+    {
+        if (timeout_ms == 0)
+        {
+            pthread_cond_wait(&cal->cond, &cal->mutex);
+        }
+        else if (pthread_cond_timedwait(&cal->cond, &cal->mutex, &deadline) != 0 && cal->state == busy)
+        {
+            return MPCAL_TIMEOUT;
+        }
+    }
+    return MPCAL_SUCCESS;
+}
+
+//the device calls run on the cmdq worker between frames, without cmdq_init in the caller
+static int mpcal_device(CmdqFunc_t func, MpCal_t* cal)
+{
+    int result = MPCAL_SUCCESS;
+    int rst = cmdq_call(func, cal, CMDQ_PRIORITY_LONG, 0, &result);
+    if (rst == CMDQ_CLOSED)
+    {
+        result = func(cal);
+    }
+    else if (rst != CMDQ_SUCCESS)
+    {
+        result = MPCAL_ERROR_DEVICE;
+    }
+    return result;
+}
+
+static int mpcal_load_job(void* arg)
+{
+    MpCal_t* cal = (MpCal_t*)arg;
+    if (prop_tpd_set(TPD_PROP_GAIN_SEL, cal->param.gain) != IRUVC_SUCCESS || \
+        get_tpd_calib_param(&cal->calib_param) != IRUVC_SUCCESS || \
+        get_tpd_kt_array((uint8_t*)cal->kt) != IRUVC_SUCCESS || \
+        get_tpd_bt_array((uint8_t*)cal->bt) != IRUVC_SUCCESS || \
+        get_tpd_nuc_t_array((uint8_t*)cal->nuc_table) != IRUVC_SUCCESS)
+    {
+        return MPCAL_ERROR_DEVICE;
+    }
+    return MPCAL_SUCCESS;
+}
+
+static int mpcal_write_job(void* arg)
+{
+    MpCal_t* cal = (MpCal_t*)arg;
+    if (cal->param.mode == MPCAL_MODE_KTBT_NUC && \
+        (set_tpd_kt_array((uint8_t*)cal->new_kt) != IRUVC_SUCCESS || \
+        set_tpd_bt_array((uint8_t*)cal->new_bt) != IRUVC_SUCCESS))
+    {
+        return MPCAL_ERROR_DEVICE;
+    }
+    if (set_tpd_nuc_t_array((uint8_t*)cal->new_nuc_table) != IRUVC_SUCCESS)
+    {
+        return MPCAL_ERROR_DEVICE;
+    }
+    calib_cache_invalidate();
+    return MPCAL_SUCCESS;
+}
+
+static int mpcal_vtemp_job(void* arg)
+{
+    MpCal_t* cal = (MpCal_t*)arg;
+    return (cur_vtemp_get(&cal->vtemp_start) == IRUVC_SUCCESS) ? MPCAL_SUCCESS : MPCAL_ERROR_DEVICE;
+}
+
+//the setpoint's frames are all in: mean of the blackbody area, called with the mutex held
+static void mpcal_capture_done(MpCal_t* cal)
+{
+    const StreamConfig_t* config = cal->stream_frame_info->config;
+    uint32_t width = config->temp_info.width;
+    const Area_t* area = &cal->param.area;
+    uint64_t total = 0;
+    for (int y = area->start_y; y < area->start_y + area->height; y++)
+    {
+        const uint32_t* row = cal->sum + (size_t)y * width;
+        for (int x = area->start_x; x < area->start_x + area->width; x++)
+        {
+            total += row[x];
+        }
+    }
+    MpcalCapture_t* capture = &cal->capture[cal->point];
+    double mean = (double)total / ((double)cal->frames * area->width * area->height);
+    capture->output_temp = (float)(mean / 64 - 273.15);
+    capture->vtemp = (cal->vtemp_num > 0) ? (uint16_t)((cal->vtemp_sum + cal->vtemp_num / 2) / cal->vtemp_num) : \
+        cal->vtemp_start;
+    capture->frames = cal->frames;
+    cal->captured[cal->point] = 1;
+    cal->state = MPCAL_STATE_IDLE;
+    pthread_cond_broadcast(&cal->cond);
+}
+
+static void mpcal_task(FrameSlot_t* slot, void* arg)
+{
+    MpCal_t* cal = (MpCal_t*)arg;
+    pthread_mutex_lock(&cal->mutex);
+    //a gain switch, the shutter or a skipped temp plane would bias the average
+    if (cal->state == MPCAL_STATE_CAPTURING && slot->desc.temp.data != NULL && \
+        !(slot->desc.flags & FRAME_DESC_TEMP_INVALID))
+    {
+        const FramePlane_t* temp = &slot->desc.temp;
+        for (uint32_t y = 0; y < temp->height; y++)
+        {
+            simd_accumulate_u16((const uint16_t*)(temp->data + (size_t)y * temp->stride), (int)temp->width, \
+                cal->sum + (size_t)y * temp->width);
+        }
+        if (slot->desc.flags & FRAME_DESC_META)
+        {
+            cal->vtemp_sum += slot->desc.meta.vtemp;
+            cal->vtemp_num++;
+        }
+        if (++cal->frames >= cal->param.frames)
+        {
+            mpcal_capture_done(cal);
+        }
+    }
+    pthread_mutex_unlock(&cal->mutex);
+}
+
+int mpcal_init(MpCal_t* cal, const MpcalParam_t* param, StreamFrameInfo_t* stream_frame_info)
+{
+    if (cal == NULL || param == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL || \
+        stream_frame_info->config == NULL || stream_frame_info->config->temp_byte_size == 0 || \
+        param->mode < 0 || param->mode >= MPCAL_MODE_NUM || param->point_num > MPCAL_MAX_POINTS || \
+        param->point_num < ((param->mode == MPCAL_MODE_KTBT_NUC) ? 3u : 1u))
+    {
+        return MPCAL_ERROR_PARAM;
+    }
+    memset(cal, 0, sizeof(MpCal_t));
+    cal->param = *param;
+    cal->stream_frame_info = stream_frame_info;
+    const StreamConfig_t* config = stream_frame_info->config;
+    int width = (int)config->temp_info.width, height = (int)config->temp_info.height;
+    Area_t* area = &cal->param.area;
+    if (area->width <= 0 || area->height <= 0)
+    {
+        area->start_x = width / 4;
+        area->start_y = height / 4;
+        area->width = width / 2;
+        area->height = height / 2;
+    }
+    if (area->start_x < 0 || area->start_y < 0 || area->start_x + area->width > width || \
+        area->start_y + area->height > height)
+    {
+        return MPCAL_ERROR_PARAM;
+    }
+    if (cal->param.frames == 0)
+    {
+        cal->param.frames = MPCAL_FRAMES;
+    }
+    cal->sum = (uint32_t*)malloc((size_t)width * height * sizeof(uint32_t));
+    if (cal->sum == NULL)
+    {
+        return MPCAL_ERROR_MEM;
+    }
+    pthread_mutex_init(&cal->mutex, NULL);
+    pthread_cond_init(&cal->cond, NULL);
+    int rst = mpcal_device(mpcal_load_job, cal);
+    if (rst == MPCAL_SUCCESS)
+    {
+        calib_cache_read_table((cal->param.gain == HIGH_GAIN) ? CALIB_SECTION_TAU_H : CALIB_SECTION_TAU_L, \
+            cal->correct_table, sizeof(cal->correct_table));
+        cal->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, \
+            POOL_STAGE_TEMPERATURE, mpcal_task, cal);
+        rst = (cal->consumer_id >= 0) ? MPCAL_SUCCESS : MPCAL_ERROR_PARAM;
+    }
+    if (rst != MPCAL_SUCCESS)
+    {
+        free(cal->sum);
+        cal->sum = NULL;
+        pthread_mutex_destroy(&cal->mutex);
+        pthread_cond_destroy(&cal->cond);
+    }
+    return rst;
+}
+
+//the session stays a consumer of the ring, release it after the ring was closed
+void mpcal_release(MpCal_t* cal)
+{
+    if (cal == NULL || cal->sum == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&cal->mutex);
+    mpcal_wait_state(cal, MPCAL_STATE_COMPUTING, 0);
+    cal->state = MPCAL_STATE_IDLE;
+    pthread_mutex_unlock(&cal->mutex);
+    free(cal->sum);
+    cal->sum = NULL;
+    pthread_mutex_destroy(&cal->mutex);
+    pthread_cond_destroy(&cal->cond);
+}
+
+int mpcal_capture(MpCal_t* cal, int point, uint32_t timeout_ms)
+{
+    if (cal == NULL || cal->sum == NULL || point < 0 || point >= (int)cal->param.point_num)
+    {
+        return MPCAL_ERROR_PARAM;
+    }
+    //frames without an info line get the vtemp of the start, the temperature of the sensor barely moves in a second
+    HousekeepSnapshot_t snapshot;
+    if (housekeep_get(cal->stream_frame_info->housekeep, &snapshot) > 0 && (snapshot.valid & HOUSEKEEP_VTEMP))
+    {
+        cal->vtemp_start = snapshot.vtemp;
+    }
+    else if (mpcal_device(mpcal_vtemp_job, cal) != MPCAL_SUCCESS)
+    {
+        return MPCAL_ERROR_DEVICE;
+    }
+    const StreamConfig_t* config = cal->stream_frame_info->config;
+    pthread_mutex_lock(&cal->mutex);
+    if (cal->state == MPCAL_STATE_CAPTURING || cal->state == MPCAL_STATE_COMPUTING)
+    {
+        pthread_mutex_unlock(&cal->mutex);
+        return MPCAL_ERROR_STATE;
+    }
+    memset(cal->sum, 0, (size_t)config->temp_info.width * config->temp_info.height * sizeof(uint32_t));
+    cal->point = point;
+    cal->frames = 0;
+    cal->vtemp_sum = 0;
+    cal->vtemp_num = 0;
+    cal->captured[point] = 0;
+    cal->state = MPCAL_STATE_CAPTURING;
+    int rst = mpcal_wait_state(cal, MPCAL_STATE_CAPTURING, timeout_ms);
+    if (rst != MPCAL_SUCCESS)
+    {
+        cal->state = MPCAL_STATE_IDLE;
+    }
+    pthread_mutex_unlock(&cal->mutex);
+    return rst;
+}
+
+//the libirtemp calls of multi_point_calibration/multi_point_calibration_one_point_correct with the captured points
+static int mpcal_calculate(MpCal_t* cal)
+{
+    uint32_t num = cal->param.point_num;
+    MultiPointCalibTemp_t temp[MPCAL_MAX_POINTS];
+    for (uint32_t i = 0; i < num; i++)
+    {
+        temp[i].output_temp = cal->capture[i].output_temp;
+        temp[i].setting_temp = cal->param.points[i].setting_temp;
+        cal->nuc[i].output_nuc = 0;
+        cal->nuc[i].setting_nuc = 0;
+    }
+    second_calibration_param_t second_cal_param = { (int16_t)cal->calib_param.Ktemp, cal->calib_param.Btemp, \
+        cal->calib_param.AddressCA, KT_SIZE, BT_SIZE, NUC_T_SIZE };
+    MultiPointCalibArray_t calib_array = { cal->kt, cal->bt, cal->nuc_table, cal->correct_table };
+    TwoPointCalibResult_t two_point_result = { cal->kt, cal->bt };
+    int nuc_product_type = cal->param.product_type;
+    if (cal->param.mode == MPCAL_MODE_KTBT_NUC)
+    {
+        uint32_t low = 0, high = 0;
+        for (uint32_t i = 1; i < num; i++)
+        {
+            low = (temp[i].setting_temp < temp[low].setting_temp) ? i : low;
+            high = (temp[i].setting_temp > temp[high].setting_temp) ? i : high;
+        }
+        second_cal_param.setting_temp_high = temp[high].setting_temp;
+        second_cal_param.setting_temp_low = temp[low].setting_temp;
+        second_cal_param.object_temp_high = temp[high].output_temp;
+        second_cal_param.object_temp_low = temp[low].output_temp;
+        second_cal_param.high_vtemp = cal->capture[high].vtemp;
+        second_cal_param.low_vtemp = cal->capture[low].vtemp;
+        MultiPointCalibParam_t calib_param = { cal->param.points[low].env, second_cal_param, cal->capture[low].vtemp };
+        two_point_result.new_kt_array = cal->new_kt;
+        two_point_result.new_bt_array = cal->new_bt;
+        if (new_ktbt_recal_double_point_calculate(&calib_param, cal->param.product_type, &calib_array, \
+            &two_point_result) != IRTEMP_SUCCESS)
+        {
+            return MPCAL_ERROR_CALC;
+        }
+        //the nuc values through the new kt/bt, the product correction is already in them
+        nuc_product_type = 0;
+    }
+    for (uint32_t i = 0; i < num; i++)
+    {
+        MultiPointCalibParam_t calib_param = { cal->param.points[i].env, second_cal_param, cal->capture[i].vtemp };
+        if (multi_point_calc_user_defined_nuc(&calib_param, nuc_product_type, &calib_array, &two_point_result, \
+            &temp[i], &cal->nuc[i]) != IRTEMP_SUCCESS)
+        {
+            return MPCAL_ERROR_CALC;
+        }
+    }
+    irtemp_error_t rst = (cal->param.mode == MPCAL_MODE_KTBT_NUC) ? \
+        multi_point_calc_new_nuc_table(cal->nuc_table, cal->nuc, (uint16_t)num, cal->new_nuc_table) : \
+        multi_point_calc_one_point_correct(cal->nuc_table, cal->nuc, (uint16_t)num, cal->new_nuc_table);
+    if (rst != IRTEMP_SUCCESS)
+    {
+        return MPCAL_ERROR_CALC;
+    }
+    if (cal->param.mode != MPCAL_MODE_KTBT_NUC)
+    {
+        memcpy(cal->new_kt, cal->kt, sizeof(cal->new_kt));
+        memcpy(cal->new_bt, cal->bt, sizeof(cal->new_bt));
+    }
+    return MPCAL_SUCCESS;
+}
+
+static void mpcal_compute_task(void* arg)
+{
+    MpCal_t* cal = (MpCal_t*)arg;
+    uint64_t start_us = get_monotonic_us();
+    int rst = mpcal_calculate(cal);
+    pthread_mutex_lock(&cal->mutex);
+    cal->result = rst;
+    cal->compute_us = get_monotonic_us() - start_us;
+    cal->state = (rst == MPCAL_SUCCESS) ? MPCAL_STATE_DONE : MPCAL_STATE_FAILED;
+    pthread_cond_broadcast(&cal->cond);
+    pthread_mutex_unlock(&cal->mutex);
+}
+
+int mpcal_compute(MpCal_t* cal)
+{
+    if (cal == NULL || cal->sum == NULL)
+    {
+        return MPCAL_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&cal->mutex);
+    int ready = (cal->state != MPCAL_STATE_CAPTURING && cal->state != MPCAL_STATE_COMPUTING);
+    for (uint32_t i = 0; i < cal->param.point_num; i++)
+    {
+        ready &= cal->captured[i];
+    }
+    if (!ready)
+    {
+        pthread_mutex_unlock(&cal->mutex);
+        return MPCAL_ERROR_STATE;
+    }
+    cal->state = MPCAL_STATE_COMPUTING;
+    pthread_mutex_unlock(&cal->mutex);
+    pool_submit(POOL_STAGE_OTHER, mpcal_compute_task, cal);
+    return MPCAL_SUCCESS;
+}
+
+int mpcal_finish(MpCal_t* cal, uint32_t timeout_ms)
+{
+    if (cal == NULL || cal->sum == NULL)
+    {
+        return MPCAL_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&cal->mutex);
+    int rst = mpcal_wait_state(cal, MPCAL_STATE_COMPUTING, timeout_ms);
+    if (rst == MPCAL_SUCCESS)
+    {
+        rst = (cal->state == MPCAL_STATE_DONE) ? MPCAL_SUCCESS : \
+            (cal->state == MPCAL_STATE_FAILED) ? cal->result : MPCAL_ERROR_STATE;
+    }
+    pthread_mutex_unlock(&cal->mutex);
+    if (rst == MPCAL_SUCCESS && cal->param.write_back)
+    {
+        rst = mpcal_device(mpcal_write_job, cal);
+    }
+    return rst;
+}
+
+int mpcal_compute_all(MpCal_t** cals, int num, uint32_t timeout_ms)
+{
+    if (cals == NULL || num <= 0)
+    {
+        return 0;
+    }
+    int* started = (int*)calloc(num, sizeof(int));
+    if (started == NULL)
+    {
+        return 0;
+    }
+    for (int i = 0; i < num; i++)
+    {
+        started[i] = (mpcal_compute(cals[i]) == MPCAL_SUCCESS);
+    }
+    //the write backs go one after another through the command queue, the calculations overlap
+    int done = 0;
+    for (int i = 0; i < num; i++)
+    {
+        done += (started[i] && mpcal_finish(cals[i], timeout_ms) == MPCAL_SUCCESS);
+    }
+    free(started);
+    return done;
+}
+
+void mpcal_print(const MpCal_t* cal)
+{
+    if (cal == NULL)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < cal->param.point_num; i++)
+    {
+        printf("point %u: setting %.2f output %.2f vtemp %u frames %u setting_nuc=%d output_nuc=%d\n", i, \
+            cal->param.points[i].setting_temp, cal->capture[i].output_temp, cal->capture[i].vtemp, \
+            cal->capture[i].frames, cal->nuc[i].setting_nuc / 2, cal->nuc[i].output_nuc / 2);
+    }
+    int changed = 0, max_delta = 0, max_index = 0;
+    for (int i = 0; i < NUC_T_SIZE; i++)
+    {
+        int delta = abs((int)cal->new_nuc_table[i] - (int)cal->nuc_table[i]);
+        changed += (delta != 0);
+        if (delta > max_delta)
+        {
+            max_delta = delta;
+            max_index = i;
+        }
+    }
+    printf("new_nuc_table: %d of %d entries changed, max %d at [%d] %d -> %d, new_kt[0]=%d new_bt[0]=%d, %llu us\n", \
+        changed, NUC_T_SIZE, max_delta, max_index, cal->nuc_table[max_index], cal->new_nuc_table[max_index], \
+        cal->new_kt[0], cal->new_bt[0], (unsigned long long)cal->compute_us);
+}
+
+int mpcal_step_wait(const char* path, int point, uint32_t timeout_ms)
+{
+    if (path == NULL)
+    {
+        return MPCAL_ERROR_PARAM;
+    }
+    uint64_t start_us = get_monotonic_us();
+    while (1)
+    {
+        FILE* fp = fopen(path, "r");
+        int step = -1;
+        if (fp != NULL)
+        {
+            if (fscanf(fp, "%d", &step) != 1)
+            {
+                step = -1;
+            }
+            fclose(fp);
+        }
+        if (step >= point)
+        {
+            return MPCAL_SUCCESS;
+        }
+        if (timeout_ms > 0 && get_monotonic_us() - start_us >= (uint64_t)timeout_ms * 1000)
+        {
+            return MPCAL_TIMEOUT;
+        }
+#if defined(_WIN32)
+        Sleep(MPCAL_STEP_POLL_MS);
+#else
+        usleep(MPCAL_STEP_POLL_MS * 1000);
+#endif
+    }
+}
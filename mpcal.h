@@ -0,0 +1,118 @@
+#ifndef _MPCAL_H_
+#define _MPCAL_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+#include "libirtemp.h"
+#include "thermal_cam_cmd.h"
+
+#define MPCAL_MAX_POINTS 8
+#define MPCAL_FRAMES 32                 //frames averaged per setpoint
+#define MPCAL_CORRECT_TABLE_SIZE (4 * 14 * 64 + 128)
+#define MPCAL_STEP_POLL_MS 200
+
+#define MPCAL_SUCCESS 0
+#define MPCAL_ERROR_PARAM -1
+#define MPCAL_ERROR_MEM -2
+#define MPCAL_ERROR_DEVICE -3           //reading or writing the device tables failed
+#define MPCAL_ERROR_STATE -4            //a capture or calculation is still running, or a setpoint is missing
+#define MPCAL_ERROR_CALC -5             //libirtemp rejected the points
+#define MPCAL_TIMEOUT -6
+
+typedef enum
+{
+    MPCAL_MODE_KTBT_NUC = 0,            //new kt/bt from the lowest and highest setpoint, then the nuc-t table through all
+    MPCAL_MODE_NUC_ONE_POINT,           //kt/bt kept, the nuc-t table corrected through the setpoints
+    MPCAL_MODE_NUM
+}MpcalMode_t;
+
+typedef struct {
+    float setting_temp;                 //blackbody, celsius
+    EnvCorrectParam env;                //distance, emissivity and ambient of the fixture at this setpoint
+}MpcalPoint_t;
+
+typedef struct {
+    MpcalMode_t mode;
+    int product_type;                   //ProductType_t of the module, P2 for the ac010 units the demo calibrated
+    uint8_t gain;                       //HIGH_GAIN / LOW_GAIN, selects the nuc-t table and the tau correct table
+    uint32_t point_num;                 //3 or more for MPCAL_MODE_KTBT_NUC, 1 or more otherwise
+    MpcalPoint_t points[MPCAL_MAX_POINTS];
+    uint32_t frames;                    //0 selects MPCAL_FRAMES
+    Area_t area;                        //blackbody in temp plane pixels, width or height 0 takes the center quarter
+    uint8_t write_back;                 //mpcal_finish writes the new tables to the module
+}MpcalParam_t;
+
+typedef struct {
+    float output_temp;                  //celsius, the area's mean over the averaged frames
+    uint16_t vtemp;                     //mean sensor temperature while the frames were taken
+    uint32_t frames;
+}MpcalCapture_t;
+
+typedef enum
+{
+    MPCAL_STATE_IDLE = 0,               //waiting for the next capture
+    MPCAL_STATE_CAPTURING,
+    MPCAL_STATE_COMPUTING,
+    MPCAL_STATE_DONE,                   //new tables in new_kt/new_bt/new_nuc_table
+    MPCAL_STATE_FAILED
+}MpcalState_t;
+
+//one module's multi point calibration: averaged temp frames at each blackbody setpoint, then the libirtemp
+//recalculation on the task pool and the new tables written back through the command queue.
+//every table lives in the session, sessions of several cameras run side by side
+typedef struct MpCal_t {
+    MpcalParam_t param;
+    StreamFrameInfo_t* stream_frame_info;
+    int consumer_id;
+    MpcalState_t state;
+    int point;                          //capturing this setpoint
+    uint32_t frames;                    //taken of it so far
+    uint32_t* sum;                      //per pixel sum of the taken frames
+    uint64_t vtemp_sum;
+    uint32_t vtemp_num;
+    uint16_t vtemp_start;               //read when the capture started, for frames without an info line
+    MpcalCapture_t capture[MPCAL_MAX_POINTS];
+    uint8_t captured[MPCAL_MAX_POINTS];
+    TempCalibParam_t calib_param;
+    uint16_t nuc_table[NUC_T_SIZE];     //the module's tables when the session was loaded
+    uint16_t kt[KT_SIZE];
+    int16_t bt[BT_SIZE];
+    uint16_t correct_table[MPCAL_CORRECT_TABLE_SIZE];
+    uint16_t new_nuc_table[NUC_T_SIZE];
+    uint16_t new_kt[KT_SIZE];
+    int16_t new_bt[BT_SIZE];
+    MultiPointCalibNuc_t nuc[MPCAL_MAX_POINTS];
+    int result;                         //MPCAL_xxx of the calculation
+    uint64_t compute_us;
+    pthread_mutex_t mutex;              //frames come from a pool task, the calculation runs on another
+    pthread_cond_t cond;
+}MpCal_t;
+
+//read the module's tables and register the session as a task consumer of the camera's frame ring, before streaming.
+//device reads go through cmdq_call when the command queue runs
+int mpcal_init(MpCal_t* cal, const MpcalParam_t* param, StreamFrameInfo_t* stream_frame_info);
+
+void mpcal_release(MpCal_t* cal);
+
+//average the next param.frames valid temp frames for setpoint point, returns once they are taken
+int mpcal_capture(MpCal_t* cal, int point, uint32_t timeout_ms);
+
+//calculate the new tables on the task pool, without one in the caller
+int mpcal_compute(MpCal_t* cal);
+
+//wait for the calculation, then with param.write_back write the tables to the module. returns the result
+int mpcal_finish(MpCal_t* cal, uint32_t timeout_ms);
+
+//compute every session at once and finish them, the pool runs the calculations in parallel.
+//returns the number that succeeded
+int mpcal_compute_all(MpCal_t** cals, int num, uint32_t timeout_ms);
+
+//entries of the new nuc-t table that changed and the largest change, instead of printing the table
+void mpcal_print(const MpCal_t* cal);
+
+//fleet stepping: each camera's process waits until the fixture wrote a setpoint index >= point into path.
+//returns MPCAL_TIMEOUT if it did not within timeout_ms, 0 waits forever
+int mpcal_step_wait(const char* path, int point, uint32_t timeout_ms);
+
+#endif
@@ -0,0 +1,862 @@
+#include "mqtt.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "tempunit.h"
+#include "timing.h"
+#include "stab.h"
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+
+#define MQTT_POLL_MS 100
+#define MQTT_PUBLISH_RESERVE (1 + 4 + 2 + MQTT_TOPIC_LEN + 8 + 2)  //fixed header, topic and packet id at most
+#define MQTT_PAYLOAD_LEN (MQTT_MESSAGE_LEN - MQTT_PUBLISH_RESERVE)
+#define MQTT_EVENT_LEN 192              //json of one alarm event at most
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 2
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBLISH_DUP 0x08
+#define MQTT_PUBACK 4
+#define MQTT_PINGRESP 13
+
+typedef enum
+{
+    MQTT_STATE_IDLE = 0,                //no connection, the next attempt after MQTT_RETRY_MS
+    MQTT_STATE_TCP,                     //tcp connect in progress
+    MQTT_STATE_CONNECT,                 //CONNECT sent, waiting for the CONNACK
+    MQTT_STATE_READY,
+}MqttState_t;
+
+//the lock is held by the caller for every function below that takes the publisher
+static void mqtt_message_free(Mqtt_t* mqtt, int index)
+{
+    mqtt->free_list[mqtt->free_num++] = (uint16_t)index;
+}
+
+static void mqtt_queue_remove(Mqtt_t* mqtt, int n)
+{
+    for (int i = n; i + 1 < mqtt->queue_num; i++)
+    {
+        mqtt->queue[(mqtt->queue_head + i) % MQTT_QUEUE] = mqtt->queue[(mqtt->queue_head + i + 1) % MQTT_QUEUE];
+    }
+    mqtt->queue_num--;
+}
+
+//a free slot, or the oldest waiting summary (the oldest waiting alarm when there is none) is given up for it
+static int mqtt_message_alloc(Mqtt_t* mqtt)
+{
+    if (mqtt->messages == NULL)
+    {
+        return -1;
+    }
+    if (mqtt->free_num == 0)
+    {
+        if (mqtt->queue_num == 0)
+        {
+            mqtt->stats.dropped++;
+            return -1;
+        }
+        int victim = 0;
+        for (int i = 0; i < mqtt->queue_num; i++)
+        {
+            if (mqtt->messages[mqtt->queue[(mqtt->queue_head + i) % MQTT_QUEUE]].qos == 0)
+            {
+                victim = i;
+                break;
+            }
+        }
+        mqtt_message_free(mqtt, mqtt->queue[(mqtt->queue_head + victim) % MQTT_QUEUE]);
+        mqtt_queue_remove(mqtt, victim);
+        mqtt->stats.dropped++;
+    }
+    return mqtt->free_list[--mqtt->free_num];
+}
+
+//the payload is written here, mqtt_message_queue puts the header in front of it
+static char* mqtt_payload(Mqtt_t* mqtt, int index)
+{
+    return (char*)mqtt->messages[index].data + MQTT_PUBLISH_RESERVE;
+}
+
+static uint32_t mqtt_varint(uint8_t* p, uint32_t value)
+{
+    uint32_t len = 0;
+    do
+    {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        p[len++] = byte | ((value > 0) ? 0x80 : 0);
+    } while (value > 0);
+    return len;
+}
+
+static void mqtt_message_queue(Mqtt_t* mqtt, int index, const char* subtopic, int qos, uint32_t payload_len)
+{
+    MqttMessage_t* message = &mqtt->messages[index];
+    char topic[MQTT_TOPIC_LEN + 8];
+    int topic_len = snprintf(topic, sizeof(topic), "%s/%s", mqtt->param.topic, subtopic);
+    uint8_t header[MQTT_PUBLISH_RESERVE];
+    uint32_t len = 0;
+    header[len++] = (uint8_t)(MQTT_PUBLISH | (qos << 1));
+    len += mqtt_varint(header + len, 2 + topic_len + (qos ? 2 : 0) + payload_len);
+    header[len++] = (uint8_t)(topic_len >> 8);
+    header[len++] = (uint8_t)topic_len;
+    memcpy(header + len, topic, topic_len);
+    len += topic_len;
+    message->qos = (uint8_t)qos;
+    message->packet_id = 0;
+    if (qos)
+    {
+        mqtt->packet_id = (mqtt->packet_id == 0xFFFF) ? 1 : mqtt->packet_id + 1;
+        message->packet_id = mqtt->packet_id;
+        header[len++] = (uint8_t)(message->packet_id >> 8);
+        header[len++] = (uint8_t)message->packet_id;
+    }
+    memmove(message->data + len, message->data + MQTT_PUBLISH_RESERVE, payload_len);
+    memcpy(message->data, header, len);
+    message->size = len + payload_len;
+    message->created_us = get_monotonic_us();
+    mqtt->queue[(mqtt->queue_head + mqtt->queue_num) % MQTT_QUEUE] = (uint16_t)index;
+    mqtt->queue_num++;
+#if !defined(_WIN32)
+    uint8_t wake = 1;
+    if (write(mqtt->wake_fd[1], &wake, 1) < 0)
+    {
+        //the pipe is full, the client thread is already woken
+    }
+#endif
+}
+
+//one message of the window's rois, celsius
+static void mqtt_summary_publish(Mqtt_t* mqtt)
+{
+    if (mqtt->window_frames == 0)
+    {
+        return;
+    }
+    int index = mqtt_message_alloc(mqtt);
+    if (index >= 0)
+    {
+        char* p = mqtt_payload(mqtt, index);
+        int len = snprintf(p, MQTT_PAYLOAD_LEN, "{\"timestamp_us\":%llu,\"seq\":%llu,\"frames\":%u,\"rois\":[", \
+            (unsigned long long)((int64_t)mqtt->window_start_us + mqtt->wall_offset_us), \
+            (unsigned long long)mqtt->window_seq, mqtt->window_frames);
+        for (int i = 0; i < mqtt->roi_engine.roi_num; i++)
+        {
+            const MqttRollup_t* rollup = &mqtt->rollups[i];
+            len += snprintf(p + len, MQTT_PAYLOAD_LEN - len, "%s{\"roi\":%d,\"type\":\"%s\",\"min\":%.2f," \
+                "\"max\":%.2f,\"avr\":%.2f}", (i > 0) ? "," : "", i, \
+                roi_type_name(mqtt->roi_engine.roi[i].type), \
+                temp_celsius_of_raw(rollup->min_temp), temp_celsius_of_raw(rollup->max_temp), \
+                temp_celsius_of_raw((TempRaw_t)((rollup->avr_sum + mqtt->window_frames / 2) / mqtt->window_frames)));
+        }
+        len += snprintf(p + len, MQTT_PAYLOAD_LEN - len, "]}");
+        mqtt_message_queue(mqtt, index, "roi", mqtt->param.summary_qos, (uint32_t)len);
+        mqtt->stats.summaries++;
+    }
+    mqtt->window_frames = 0;
+}
+
+//ring task: the rois of the frame into the window, the window out once summary_ms have passed
+static void mqtt_task(FrameSlot_t* slot, void* arg)
+{
+    Mqtt_t* mqtt = (Mqtt_t*)arg;
+    pthread_mutex_lock(&mqtt->mutex);
+    //temperatures of a frame with the shutter closed or a gain switch are off, they stay out of the window
+    if (!mqtt->running || slot->desc.temp.data == NULL || (slot->desc.flags & FRAME_DESC_TEMP_INVALID) || \
+        (mqtt->frame_cnt++ % mqtt->param.interval) != 0)
+    {
+        pthread_mutex_unlock(&mqtt->mutex);
+        return;
+    }
+    RoiEngine_t* engine = &mqtt->roi_engine;
+    stab_roi_follow(engine, &slot->desc);
+    if (engine->roi_num > 0 && roi_engine_process_tiles(engine, (uint16_t*)slot->desc.temp.data, \
+        slot->desc.temp_tiles, mqtt->roi_info) == ROI_SUCCESS)
+    {
+        if (mqtt->window_frames > 0 && \
+            slot->desc.timestamp_us >= mqtt->window_start_us + (uint64_t)mqtt->param.summary_ms * 1000)
+        {
+            mqtt_summary_publish(mqtt);
+        }
+        if (mqtt->window_frames == 0)
+        {
+            mqtt->window_start_us = slot->desc.timestamp_us;
+            for (int i = 0; i < engine->roi_num; i++)
+            {
+                mqtt->rollups[i].min_temp = 0xFFFF;
+                mqtt->rollups[i].max_temp = 0;
+                mqtt->rollups[i].avr_sum = 0;
+            }
+        }
+        for (int i = 0; i < engine->roi_num; i++)
+        {
+            MqttRollup_t* rollup = &mqtt->rollups[i];
+            const TempInfo_t* info = &mqtt->roi_info[i];
+            rollup->min_temp = (info->min_temp < rollup->min_temp) ? info->min_temp : rollup->min_temp;
+            rollup->max_temp = (info->max_temp > rollup->max_temp) ? info->max_temp : rollup->max_temp;
+            rollup->avr_sum += info->avr_temp;
+        }
+        mqtt->window_frames++;
+        mqtt->window_seq = slot->desc.seq;
+        mqtt->stats.frames++;
+    }
+    pthread_mutex_unlock(&mqtt->mutex);
+}
+
+void mqtt_alarm_events(const AlarmEvent_t* events, int event_num, void* arg)
+{
+    Mqtt_t* mqtt = (Mqtt_t*)arg;
+    if (mqtt == NULL || events == NULL || event_num <= 0)
+    {
+        return;
+    }
+    pthread_mutex_lock(&mqtt->mutex);
+    int index = mqtt->running ? mqtt_message_alloc(mqtt) : -1;
+    if (index >= 0)
+    {
+        char* p = mqtt_payload(mqtt, index);
+        int len = snprintf(p, MQTT_PAYLOAD_LEN, "{\"timestamp_us\":%llu,\"events\":[", \
+            (unsigned long long)((int64_t)events[0].timestamp_us + mqtt->wall_offset_us));
+        for (int i = 0; i < event_num && len < MQTT_PAYLOAD_LEN - MQTT_EVENT_LEN; i++)
+        {
+            const AlarmEvent_t* event = &events[i];
+            len += snprintf(p + len, MQTT_PAYLOAD_LEN - len, "%s{\"event\":\"%s\",\"seq\":%llu,\"track\":%u," \
+                "\"max\":%.2f,\"x\":%u,\"y\":%u,\"box\":[%u,%u,%u,%u],\"area\":%u,\"hot_area\":%u," \
+                "\"latency_us\":%u}", (i > 0) ? "," : "", alarm_event_name((AlarmEventType_t)event->type), \
+                (unsigned long long)event->seq, event->track_id, temp_celsius_of_raw(event->max_temp), \
+                event->max_x, event->max_y, event->x0, event->y0, event->x1, event->y1, event->area, \
+                event->hot_area, event->latency_us);
+        }
+        len += snprintf(p + len, MQTT_PAYLOAD_LEN - len, "]}");
+        mqtt_message_queue(mqtt, index, "alarm", 1, (uint32_t)len);
+        mqtt->stats.alarms++;
+    }
+    pthread_mutex_unlock(&mqtt->mutex);
+}
+
+int mqtt_attach(Mqtt_t* mqtt, StreamFrameInfo_t* stream_frame_info)
+{
+    if (mqtt == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL || \
+        stream_frame_info->temp_byte_size == 0)
+    {
+        return MQTT_ERROR_PARAM;
+    }
+    memset(mqtt, 0, sizeof(Mqtt_t));
+    mqtt->stream_frame_info = stream_frame_info;
+    mqtt->fd = -1;
+    mqtt->out_msg = -1;
+    mqtt->wake_fd[0] = -1;
+    mqtt->wake_fd[1] = -1;
+    TempDataRes_t temp_res = { (uint16_t)stream_frame_info->temp_info.width, (uint16_t)stream_frame_info->temp_info.height };
+    if (roi_engine_init(&mqtt->roi_engine, temp_res) != ROI_SUCCESS)
+    {
+        return MQTT_ERROR_PARAM;
+    }
+    pthread_mutex_init(&mqtt->mutex, NULL);
+    //a window summarizes the frames it saw, one the stage could not take is left out
+    mqtt->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, \
+        POOL_STAGE_TEMPERATURE, mqtt_task, mqtt);
+    if (mqtt->consumer_id < 0)
+    {
+        roi_engine_release(&mqtt->roi_engine);
+        pthread_mutex_destroy(&mqtt->mutex);
+        return MQTT_ERROR_PARAM;
+    }
+    return MQTT_SUCCESS;
+}
+
+//a new roi starts a new window, the open one has no rollup for it
+static int mqtt_roi_added(Mqtt_t* mqtt, int roi_id)
+{
+    if (roi_id < 0)
+    {
+        return (roi_id == ROI_ERROR_FULL) ? MQTT_ERROR_FULL : MQTT_ERROR_PARAM;
+    }
+    mqtt->window_frames = 0;
+    return roi_id;
+}
+
+int mqtt_add_line(Mqtt_t* mqtt, Line_t line)
+{
+    if (mqtt == NULL || mqtt->stream_frame_info == NULL)
+    {
+        return MQTT_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&mqtt->mutex);
+    int rst = mqtt_roi_added(mqtt, roi_engine_add_line(&mqtt->roi_engine, line));
+    pthread_mutex_unlock(&mqtt->mutex);
+    return rst;
+}
+
+int mqtt_add_rect(Mqtt_t* mqtt, Area_t rect)
+{
+    if (mqtt == NULL || mqtt->stream_frame_info == NULL)
+    {
+        return MQTT_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&mqtt->mutex);
+    int rst = mqtt_roi_added(mqtt, roi_engine_add_rect(&mqtt->roi_engine, rect));
+    pthread_mutex_unlock(&mqtt->mutex);
+    return rst;
+}
+
+#if !defined(_WIN32)
+//resolve and start a non-blocking connect, without the lock: the name lookup may take a while
+static int mqtt_socket_open(const char* host, uint16_t port)
+{
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = NULL;
+    if (getaddrinfo(host, service, &hints, &result) != 0)
+    {
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo* ai = result; ai != NULL && fd < 0; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+        {
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) < 0 && errno != EINPROGRESS)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+static uint32_t mqtt_string_put(uint8_t* p, const char* s)
+{
+    uint32_t len = (uint32_t)strlen(s);
+    p[0] = (uint8_t)(len >> 8);
+    p[1] = (uint8_t)len;
+    memcpy(p + 2, s, len);
+    return 2 + len;
+}
+
+static void mqtt_control_send(Mqtt_t* mqtt, uint32_t len)
+{
+    mqtt->out_msg = -1;
+    mqtt->out_data = mqtt->control;
+    mqtt->out_len = len;
+    mqtt->out_sent = 0;
+}
+
+//clean session off: the broker keeps the qos 1 state of the client id across reconnects
+static void mqtt_connect_send(Mqtt_t* mqtt)
+{
+    uint8_t body[MQTT_CONTROL_LEN];
+    uint32_t len = 0;
+    static const uint8_t protocol[] = { 0, 4, 'M', 'Q', 'T', 'T', 4 };
+    memcpy(body, protocol, sizeof(protocol));
+    len += sizeof(protocol);
+    int login = (mqtt->param.username[0] != 0);
+    body[len++] = login ? 0xC0 : 0x00;
+    body[len++] = (uint8_t)(mqtt->param.keepalive_s >> 8);
+    body[len++] = (uint8_t)mqtt->param.keepalive_s;
+    len += mqtt_string_put(body + len, mqtt->param.client_id);
+    if (login)
+    {
+        len += mqtt_string_put(body + len, mqtt->param.username);
+        len += mqtt_string_put(body + len, mqtt->param.password);
+    }
+    uint32_t header = 0;
+    mqtt->control[header++] = MQTT_CONNECT;
+    header += mqtt_varint(mqtt->control + header, len);
+    memcpy(mqtt->control + header, body, len);
+    mqtt_control_send(mqtt, header + len);
+}
+
+static void mqtt_queue_push_front(Mqtt_t* mqtt, int index)
+{
+    mqtt->queue_head = (mqtt->queue_head + MQTT_QUEUE - 1) % MQTT_QUEUE;
+    mqtt->queue[mqtt->queue_head] = (uint16_t)index;
+    mqtt->queue_num++;
+}
+
+//the connection is gone: what was not acknowledged goes out again in its order on the next one, qos 1 with DUP
+static void mqtt_close(Mqtt_t* mqtt, uint64_t now_us)
+{
+    if (mqtt->state == MQTT_STATE_READY)
+    {
+        printf("mqtt: connection to %s:%u lost\n", mqtt->param.host, mqtt->param.port);
+    }
+    if (mqtt->state >= MQTT_STATE_CONNECT)
+    {
+        mqtt->stats.disconnects++;
+    }
+    close(mqtt->fd);
+    mqtt->fd = -1;
+    if (mqtt->out_msg >= 0 && mqtt->messages[mqtt->out_msg].qos == 0)
+    {
+        mqtt_queue_push_front(mqtt, mqtt->out_msg);
+    }
+    for (int i = mqtt->inflight_num - 1; i >= 0; i--)
+    {
+        mqtt->messages[mqtt->inflight[i]].data[0] |= MQTT_PUBLISH_DUP;
+        mqtt_queue_push_front(mqtt, mqtt->inflight[i]);
+    }
+    mqtt->inflight_num = 0;
+    mqtt->out_msg = -1;
+    mqtt->out_len = 0;
+    mqtt->out_sent = 0;
+    mqtt->input_len = 0;
+    mqtt->skip = 0;
+    mqtt->ping_pending = 0;
+    mqtt->state = MQTT_STATE_IDLE;
+    mqtt->state_us = now_us;
+}
+
+//write the packet in progress, then the waiting messages while the inflight window has room
+//returns -1 when the connection failed
+static int mqtt_flush(Mqtt_t* mqtt, uint64_t now_us)
+{
+    for (;;)
+    {
+        while (mqtt->out_sent < mqtt->out_len)
+        {
+            int len = (int)send(mqtt->fd, mqtt->out_data + mqtt->out_sent, mqtt->out_len - mqtt->out_sent, \
+                MSG_NOSIGNAL);
+            if (len < 0)
+            {
+                return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+            }
+            mqtt->out_sent += len;
+            mqtt->stats.bytes += len;
+            mqtt->send_us = now_us;
+        }
+        if (mqtt->out_msg >= 0)
+        {
+            MqttMessage_t* message = &mqtt->messages[mqtt->out_msg];
+            mqtt->stats.sent++;
+            if (message->qos == 0)
+            {
+                timing_record(TIMING_STAGE_MQTT_PUBLISH, now_us - message->created_us);
+                mqtt_message_free(mqtt, mqtt->out_msg);
+            }
+        }
+        mqtt->out_msg = -1;
+        mqtt->out_len = 0;
+        mqtt->out_sent = 0;
+        if (mqtt->state != MQTT_STATE_READY || mqtt->queue_num == 0)
+        {
+            return 0;
+        }
+        int index = mqtt->queue[mqtt->queue_head];
+        MqttMessage_t* message = &mqtt->messages[index];
+        if (message->qos && mqtt->inflight_num == MQTT_INFLIGHT)
+        {
+            return 0;
+        }
+        mqtt->queue_head = (mqtt->queue_head + 1) % MQTT_QUEUE;
+        mqtt->queue_num--;
+        if (message->qos)
+        {
+            mqtt->inflight[mqtt->inflight_num++] = (uint16_t)index;
+        }
+        mqtt->out_msg = index;
+        mqtt->out_data = message->data;
+        mqtt->out_len = message->size;
+    }
+}
+
+static void mqtt_puback(Mqtt_t* mqtt, uint16_t packet_id, uint64_t now_us)
+{
+    for (int i = 0; i < mqtt->inflight_num; i++)
+    {
+        int index = mqtt->inflight[i];
+        if (mqtt->messages[index].packet_id != packet_id || index == mqtt->out_msg)
+        {
+            continue;
+        }
+        timing_record(TIMING_STAGE_MQTT_PUBLISH, now_us - mqtt->messages[index].created_us);
+        mqtt_message_free(mqtt, index);
+        memmove(&mqtt->inflight[i], &mqtt->inflight[i + 1], (mqtt->inflight_num - i - 1) * sizeof(uint16_t));
+        mqtt->inflight_num--;
+        mqtt->stats.acked++;
+        return;
+    }
+}
+
+//the broker's packets in input. returns -1 when it refused the connection
+static int mqtt_input(Mqtt_t* mqtt, uint64_t now_us)
+{
+    while (mqtt->input_len > 0)
+    {
+        uint32_t used = 0;
+        if (mqtt->skip > 0)
+        {
+            used = (mqtt->skip < mqtt->input_len) ? mqtt->skip : mqtt->input_len;
+            mqtt->skip -= used;
+        }
+        else
+        {
+            uint32_t remaining = 0, header = 1;
+            for (int shift = 0; ; shift += 7)
+            {
+                if (header >= mqtt->input_len)
+                {
+                    return 0;
+                }
+                uint8_t byte = mqtt->input[header++];
+                remaining |= (uint32_t)(byte & 0x7F) << shift;
+                if (!(byte & 0x80) || shift == 21)
+                {
+                    break;
+                }
+            }
+            if (header + remaining > MQTT_INPUT_LEN)
+            {
+                //nothing subscribed, a large packet is not ours
+                mqtt->skip = header + remaining;
+                continue;
+            }
+            if (header + remaining > mqtt->input_len)
+            {
+                return 0;
+            }
+            const uint8_t* body = mqtt->input + header;
+            int type = mqtt->input[0] >> 4;
+            if (type == MQTT_CONNACK && remaining >= 2 && mqtt->state == MQTT_STATE_CONNECT)
+            {
+                if (body[1] != 0)
+                {
+                    printf("mqtt: %s:%u refused the connection, code %d\n", mqtt->param.host, mqtt->param.port, \
+                        body[1]);
+                    return -1;
+                }
+                printf("mqtt: connected to %s:%u\n", mqtt->param.host, mqtt->param.port);
+                mqtt->state = MQTT_STATE_READY;
+                mqtt->state_us = now_us;
+                mqtt->send_us = now_us;
+                mqtt->stats.connects++;
+            }
+            else if (type == MQTT_PUBACK && remaining >= 2)
+            {
+                mqtt_puback(mqtt, (uint16_t)((body[0] << 8) | body[1]), now_us);
+            }
+            else if (type == MQTT_PINGRESP)
+            {
+                mqtt->ping_pending = 0;
+            }
+            used = header + remaining;
+        }
+        memmove(mqtt->input, mqtt->input + used, mqtt->input_len - used);
+        mqtt->input_len -= used;
+    }
+    return 0;
+}
+
+//client thread: connect (again), keep the connection alive and send what the task and the alarm callback queue
+static void* mqtt_client_function(void* threadarg)
+{
+    Mqtt_t* mqtt = (Mqtt_t*)threadarg;
+    uint64_t stop_us = 0;
+    pthread_mutex_lock(&mqtt->mutex);
+    for (;;)
+    {
+        uint64_t now_us = get_monotonic_us();
+        if (!mqtt->client_running)
+        {
+            //mqtt_stop gives what is queued a moment on a working connection
+            stop_us = (stop_us == 0) ? now_us + MQTT_STOP_FLUSH_MS * 1000ull : stop_us;
+            if (mqtt->state != MQTT_STATE_READY || now_us >= stop_us || \
+                (mqtt->queue_num == 0 && mqtt->inflight_num == 0 && mqtt->out_sent == mqtt->out_len))
+            {
+                break;
+            }
+        }
+        if (mqtt->fd < 0 && (mqtt->state_us == 0 || now_us >= mqtt->state_us + MQTT_RETRY_MS * 1000ull))
+        {
+            pthread_mutex_unlock(&mqtt->mutex);
+            int fd = mqtt_socket_open(mqtt->param.host, mqtt->param.port);
+            pthread_mutex_lock(&mqtt->mutex);
+            now_us = get_monotonic_us();
+            mqtt->fd = fd;
+            mqtt->state = (fd >= 0) ? MQTT_STATE_TCP : MQTT_STATE_IDLE;
+            mqtt->state_us = now_us;
+        }
+        if (mqtt->fd >= 0 && mqtt->state != MQTT_STATE_READY && \
+            now_us >= mqtt->state_us + MQTT_CONNECT_TIMEOUT_MS * 1000ull)
+        {
+            mqtt_close(mqtt, now_us);
+        }
+        uint64_t keepalive_us = (uint64_t)mqtt->param.keepalive_s * 1000000;
+        if (mqtt->fd >= 0 && mqtt->state == MQTT_STATE_READY)
+        {
+            if (mqtt->ping_pending && now_us >= mqtt->ping_us + keepalive_us)
+            {
+                mqtt_close(mqtt, now_us);
+            }
+            else if (!mqtt->ping_pending && mqtt->out_len == 0 && now_us >= mqtt->send_us + keepalive_us)
+            {
+                mqtt->control[0] = 0xC0;
+                mqtt->control[1] = 0;
+                mqtt_control_send(mqtt, 2);
+                mqtt->ping_pending = 1;
+                mqtt->ping_us = now_us;
+            }
+        }
+        if (mqtt->fd >= 0 && mqtt->state >= MQTT_STATE_CONNECT && mqtt_flush(mqtt, now_us) < 0)
+        {
+            mqtt_close(mqtt, now_us);
+        }
+
+        struct pollfd pfds[2];
+        int pfd_num = 0;
+        pfds[pfd_num].fd = mqtt->wake_fd[0];
+        pfds[pfd_num++].events = POLLIN;
+        if (mqtt->fd >= 0)
+        {
+            pfds[pfd_num].fd = mqtt->fd;
+            pfds[pfd_num++].events = (mqtt->state == MQTT_STATE_TCP) ? POLLOUT : \
+                (POLLIN | ((mqtt->out_sent < mqtt->out_len) ? POLLOUT : 0));
+        }
+        pthread_mutex_unlock(&mqtt->mutex);
+        poll(pfds, pfd_num, MQTT_POLL_MS);
+        pthread_mutex_lock(&mqtt->mutex);
+        now_us = get_monotonic_us();
+
+        if (pfds[0].revents & POLLIN)
+        {
+            uint8_t wake[64];
+            while (read(mqtt->wake_fd[0], wake, sizeof(wake)) > 0)
+            {
+            }
+        }
+        if (pfd_num < 2 || mqtt->fd != pfds[1].fd || pfds[1].revents == 0)
+        {
+            continue;
+        }
+        if (mqtt->state == MQTT_STATE_TCP)
+        {
+            int err = 0;
+            socklen_t err_len = sizeof(err);
+            if (getsockopt(mqtt->fd, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0 || err != 0)
+            {
+                mqtt_close(mqtt, now_us);
+                continue;
+            }
+            int one = 1;
+            setsockopt(mqtt->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            mqtt->state = MQTT_STATE_CONNECT;
+            mqtt_connect_send(mqtt);
+            continue;
+        }
+        if (pfds[1].revents & POLLIN)
+        {
+            int len = (int)recv(mqtt->fd, mqtt->input + mqtt->input_len, MQTT_INPUT_LEN - mqtt->input_len, 0);
+            if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            {
+                mqtt_close(mqtt, now_us);
+                continue;
+            }
+            mqtt->input_len += (len > 0) ? len : 0;
+            if (mqtt_input(mqtt, now_us) < 0)
+            {
+                mqtt_close(mqtt, now_us);
+            }
+        }
+        else if (pfds[1].revents & (POLLERR | POLLHUP | POLLNVAL))
+        {
+            mqtt_close(mqtt, now_us);
+        }
+    }
+    if (mqtt->fd >= 0)
+    {
+        if (mqtt->state == MQTT_STATE_READY && mqtt->out_sent == mqtt->out_len)
+        {
+            static const uint8_t disconnect[] = { 0xE0, 0 };
+            if (send(mqtt->fd, disconnect, sizeof(disconnect), MSG_NOSIGNAL) < 0)
+            {
+            }
+        }
+        close(mqtt->fd);
+        mqtt->fd = -1;
+    }
+    mqtt->state = MQTT_STATE_IDLE;
+    pthread_mutex_unlock(&mqtt->mutex);
+    return NULL;
+}
+
+static void mqtt_buffers_free(Mqtt_t* mqtt)
+{
+    free(mqtt->messages);
+    mqtt->messages = NULL;
+    for (int i = 0; i < 2; i++)
+    {
+        if (mqtt->wake_fd[i] >= 0)
+        {
+            close(mqtt->wake_fd[i]);
+            mqtt->wake_fd[i] = -1;
+        }
+    }
+}
+
+int mqtt_start(Mqtt_t* mqtt, const MqttParam_t* param)
+{
+    if (mqtt == NULL || param == NULL || mqtt->stream_frame_info == NULL || param->host[0] == 0 || \
+        param->summary_qos > 1)
+    {
+        return MQTT_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&mqtt->mutex);
+    if (mqtt->running || mqtt->client_running)
+    {
+        pthread_mutex_unlock(&mqtt->mutex);
+        return MQTT_ERROR_PARAM;
+    }
+    mqtt->param = *param;
+    mqtt->param.host[MQTT_HOST_LEN - 1] = 0;
+    mqtt->param.client_id[MQTT_ID_LEN - 1] = 0;
+    mqtt->param.username[MQTT_HOST_LEN - 1] = 0;
+    mqtt->param.password[MQTT_HOST_LEN - 1] = 0;
+    mqtt->param.topic[MQTT_TOPIC_LEN - 1] = 0;
+    if (mqtt->param.port == 0)
+    {
+        mqtt->param.port = MQTT_DEFAULT_PORT;
+    }
+    if (mqtt->param.client_id[0] == 0)
+    {
+        strcpy(mqtt->param.client_id, MQTT_DEFAULT_TOPIC);
+    }
+    if (mqtt->param.topic[0] == 0)
+    {
+        strcpy(mqtt->param.topic, MQTT_DEFAULT_TOPIC);
+    }
+    if (mqtt->param.summary_ms == 0)
+    {
+        mqtt->param.summary_ms = MQTT_DEFAULT_SUMMARY_MS;
+    }
+    if (mqtt->param.keepalive_s == 0)
+    {
+        mqtt->param.keepalive_s = MQTT_DEFAULT_KEEPALIVE_S;
+    }
+    if (mqtt->param.interval == 0)
+    {
+        mqtt->param.interval = 1;
+    }
+    mqtt->messages = (MqttMessage_t*)malloc((size_t)MQTT_QUEUE * sizeof(MqttMessage_t));
+    if (mqtt->messages == NULL || pipe(mqtt->wake_fd) < 0)
+    {
+        mqtt_buffers_free(mqtt);
+        pthread_mutex_unlock(&mqtt->mutex);
+        return MQTT_ERROR_MEM;
+    }
+    fcntl(mqtt->wake_fd[0], F_SETFL, fcntl(mqtt->wake_fd[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(mqtt->wake_fd[1], F_SETFL, fcntl(mqtt->wake_fd[1], F_GETFL, 0) | O_NONBLOCK);
+    for (int i = 0; i < MQTT_QUEUE; i++)
+    {
+        mqtt->free_list[i] = (uint16_t)(MQTT_QUEUE - 1 - i);
+    }
+    mqtt->free_num = MQTT_QUEUE;
+    mqtt->queue_head = 0;
+    mqtt->queue_num = 0;
+    mqtt->inflight_num = 0;
+    mqtt->window_frames = 0;
+    mqtt->frame_cnt = 0;
+    mqtt->state = MQTT_STATE_IDLE;
+    mqtt->state_us = 0;
+    memset(&mqtt->stats, 0, sizeof(MqttStats_t));
+    //frames carry monotonic receive times, the messages unix time
+    struct timespec wall;
+    timespec_get(&wall, TIME_UTC);
+    mqtt->wall_offset_us = (int64_t)wall.tv_sec * 1000000 + wall.tv_nsec / 1000 - (int64_t)get_monotonic_us();
+    mqtt->client_running = 1;
+    if (pthread_create(&mqtt->thread, NULL, mqtt_client_function, mqtt) != 0)
+    {
+        mqtt->client_running = 0;
+        mqtt_buffers_free(mqtt);
+        pthread_mutex_unlock(&mqtt->mutex);
+        return MQTT_ERROR_MEM;
+    }
+    mqtt->running = 1;
+    pthread_mutex_unlock(&mqtt->mutex);
+    return MQTT_SUCCESS;
+}
+
+int mqtt_stop(Mqtt_t* mqtt)
+{
+    if (mqtt == NULL)
+    {
+        return MQTT_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&mqtt->mutex);
+    if (!mqtt->client_running)
+    {
+        pthread_mutex_unlock(&mqtt->mutex);
+        return MQTT_SUCCESS;
+    }
+    mqtt_summary_publish(mqtt);
+    mqtt->running = 0;
+    mqtt->client_running = 0;
+    uint8_t wake = 1;
+    if (write(mqtt->wake_fd[1], &wake, 1) < 0)
+    {
+    }
+    pthread_mutex_unlock(&mqtt->mutex);
+    pthread_join(mqtt->thread, NULL);
+
+    pthread_mutex_lock(&mqtt->mutex);
+    mqtt_buffers_free(mqtt);
+    TimingStats_t latency;
+    timing_stats_get(TIMING_STAGE_MQTT_PUBLISH, &latency);
+    printf("mqtt: %llu frames, %llu summaries, %llu alarm messages, %llu sent, %llu acked, %llu dropped, " \
+        "%llu connects, %llu disconnects, %llu bytes, publish latency p50 %llu us p99 %llu us\n", \
+        (unsigned long long)mqtt->stats.frames, (unsigned long long)mqtt->stats.summaries, \
+        (unsigned long long)mqtt->stats.alarms, (unsigned long long)mqtt->stats.sent, \
+        (unsigned long long)mqtt->stats.acked, (unsigned long long)mqtt->stats.dropped, \
+        (unsigned long long)mqtt->stats.connects, (unsigned long long)mqtt->stats.disconnects, \
+        (unsigned long long)mqtt->stats.bytes, (unsigned long long)latency.p50_us, \
+        (unsigned long long)latency.p99_us);
+    pthread_mutex_unlock(&mqtt->mutex);
+    return MQTT_SUCCESS;
+}
+#else
+int mqtt_start(Mqtt_t* mqtt, const MqttParam_t* param)
+{
+    //the client is written against posix sockets and poll
+    return MQTT_ERROR_SOCKET;
+}
+
+int mqtt_stop(Mqtt_t* mqtt)
+{
+    return MQTT_SUCCESS;
+}
+#endif
+
+int mqtt_stats(Mqtt_t* mqtt, MqttStats_t* stats)
+{
+    if (mqtt == NULL || stats == NULL)
+    {
+        return MQTT_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&mqtt->mutex);
+    *stats = mqtt->stats;
+    pthread_mutex_unlock(&mqtt->mutex);
+    return MQTT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+#ifndef _MQTT_H_
+#define _MQTT_H_
+
+//mqtt 3.1.1 publisher: the registered lines' and rects' min/max/avr batched into one message per summary
+//window on <topic>/roi, and the alarm events of each frame right away on <topic>/alarm with qos 1. the ring
+//task and the alarm callback only fill a message slot, a client thread of its own connects, sends and waits
+//for the broker, so a slow or lost broker fills the slots and then drops summaries, never the frame pipeline
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+#include "libirtemp.h"
+#include "roi.h"
+#include "alarm.h"
+
+#define MQTT_DEFAULT_PORT 1883
+#define MQTT_DEFAULT_TOPIC "ircam"
+#define MQTT_DEFAULT_SUMMARY_MS 1000
+#define MQTT_DEFAULT_KEEPALIVE_S 30
+#define MQTT_HOST_LEN 64
+#define MQTT_ID_LEN 24                  //23 characters, the client id every broker accepts
+#define MQTT_TOPIC_LEN 64
+#define MQTT_MESSAGE_LEN 16384          //one PUBLISH packet, ROI_MAX_NUM rois or ALARM_MAX_EVENTS events fit
+#define MQTT_QUEUE 32                   //message slots: waiting, being sent and waiting for their PUBACK
+#define MQTT_INFLIGHT 8                 //qos 1 messages sent and not acknowledged yet
+#define MQTT_CONTROL_LEN 320            //CONNECT with user name and password, PINGREQ, DISCONNECT
+#define MQTT_INPUT_LEN 64               //the broker's CONNACK, PUBACK and PINGRESP
+#define MQTT_RETRY_MS 2000              //wait before connecting again
+#define MQTT_CONNECT_TIMEOUT_MS 5000    //tcp connect + CONNACK
+#define MQTT_STOP_FLUSH_MS 1000         //mqtt_stop waits this long for the queued messages
+
+#define MQTT_SUCCESS 0
+#define MQTT_ERROR_PARAM -1
+#define MQTT_ERROR_FULL -2
+#define MQTT_ERROR_MEM -3
+#define MQTT_ERROR_SOCKET -4
+
+typedef struct {
+    char host[MQTT_HOST_LEN];           //broker name or address
+    uint16_t port;                      //0 selects MQTT_DEFAULT_PORT
+    char client_id[MQTT_ID_LEN];        //empty selects MQTT_DEFAULT_TOPIC, it keeps the broker session
+    char username[MQTT_HOST_LEN];       //empty: no user name and password
+    char password[MQTT_HOST_LEN];
+    char topic[MQTT_TOPIC_LEN];         //prefix of the roi and alarm topics, empty selects MQTT_DEFAULT_TOPIC
+    uint32_t summary_ms;                //roi summary window, 0 selects MQTT_DEFAULT_SUMMARY_MS
+    uint8_t summary_qos;                //0 or 1, alarms are always qos 1
+    uint16_t keepalive_s;               //0 selects MQTT_DEFAULT_KEEPALIVE_S
+    uint32_t interval;                  //frames between two evaluations, 0 or 1 evaluates every frame
+}MqttParam_t;
+
+//the publish latency (message made -> written to the socket for qos 0, -> PUBACK for qos 1) is the
+//TIMING_STAGE_MQTT_PUBLISH histogram of timing.h
+typedef struct {
+    uint64_t frames;                    //frames evaluated
+    uint64_t summaries;
+    uint64_t alarms;                    //alarm messages, one per frame with events
+    uint64_t sent;                      //PUBLISH packets written, retransmissions included
+    uint64_t acked;
+    uint64_t dropped;                   //messages lost to full slots, summaries go first
+    uint64_t connects;                  //CONNACKs accepted
+    uint64_t disconnects;               //connections lost or refused
+    uint64_t bytes;
+}MqttStats_t;
+
+typedef struct {
+    uint64_t created_us;
+    uint32_t size;                      //the complete PUBLISH packet
+    uint16_t packet_id;                 //qos 1
+    uint8_t qos;
+    uint8_t data[MQTT_MESSAGE_LEN];
+}MqttMessage_t;
+
+//the window a roi is accumulating
+typedef struct {
+    uint16_t min_temp;
+    uint16_t max_temp;
+    uint64_t avr_sum;
+}MqttRollup_t;
+
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    MqttParam_t param;
+    int consumer_id;
+    uint8_t running;                    //messages are made
+    uint8_t client_running;             //the client thread runs, mqtt_stop lets it send what is queued
+    RoiEngine_t roi_engine;
+    TempInfo_t roi_info[ROI_MAX_NUM];
+    MqttRollup_t rollups[ROI_MAX_NUM];
+    uint32_t window_frames;
+    uint64_t window_start_us;           //monotonic receive time of the window's first frame
+    uint64_t window_seq;                //its last frame
+    int64_t wall_offset_us;             //unix time - monotonic time, taken at start
+    uint32_t frame_cnt;
+    MqttMessage_t* messages;            //MQTT_QUEUE, allocated at start
+    uint16_t free_list[MQTT_QUEUE];
+    int free_num;
+    uint16_t queue[MQTT_QUEUE];         //made, not sent yet, in order
+    int queue_head;
+    int queue_num;
+    uint16_t inflight[MQTT_INFLIGHT];   //qos 1 sent, in order
+    int inflight_num;
+    uint16_t packet_id;                 //last one given out
+    //client thread
+    int fd;
+    int state;                          //MqttState_t of mqtt.cpp
+    uint64_t state_us;                  //when the state was entered
+    int out_msg;                        //message being sent, -1 for a control packet or nothing
+    const uint8_t* out_data;
+    uint32_t out_len;
+    uint32_t out_sent;
+    uint8_t control[MQTT_CONTROL_LEN];
+    uint8_t input[MQTT_INPUT_LEN];
+    uint32_t input_len;
+    uint32_t skip;                      //bytes of a broker packet too large for input still to discard
+    uint64_t send_us;                   //the last packet written, for the keepalive
+    uint8_t ping_pending;
+    uint64_t ping_us;
+    int wake_fd[2];                     //a queued message wakes the client thread
+    MqttStats_t stats;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+}Mqtt_t;
+
+//register the roi summaries as a task consumer of the camera's frame ring, before streaming
+int mqtt_attach(Mqtt_t* mqtt, StreamFrameInfo_t* stream_frame_info);
+
+//returns the roi index of the summaries or an error code
+int mqtt_add_line(Mqtt_t* mqtt, Line_t line);
+int mqtt_add_rect(Mqtt_t* mqtt, Area_t rect);
+
+//start the client thread and the summaries, the broker may come up later
+int mqtt_start(Mqtt_t* mqtt, const MqttParam_t* param);
+
+//publish the partial window, give the queued messages MQTT_STOP_FLUSH_MS and disconnect
+int mqtt_stop(Mqtt_t* mqtt);
+
+//AlarmEventFunc_t publishing the events of one frame as one qos 1 message, arg is the publisher
+void mqtt_alarm_events(const AlarmEvent_t* events, int event_num, void* arg);
+
+int mqtt_stats(Mqtt_t* mqtt, MqttStats_t* stats);
+
+#endif
@@ -0,0 +1,342 @@
+#include "overlay.h"
+#include "display.h"
+#include <stdlib.h>
+#include <string.h>
+
+static OverlayAtlas_t overlay_atlas[OVERLAY_FONT_NUM];
+static uint8_t overlay_atlas_inited = 0;
+
+static const OverlayGlyph_t* overlay_glyph(const OverlayAtlas_t* atlas, char c)
+{
+	unsigned char ch = (unsigned char)c;
+	if (ch < OVERLAY_GLYPH_FIRST || ch > OVERLAY_GLYPH_LAST)
+	{
+		ch = '?';
+	}
+	return &atlas->glyph[ch - OVERLAY_GLYPH_FIRST];
+}
+
+#ifdef OPENCV_ENABLE
+static const struct {
+	int face;
+	double scale;
+} overlay_font_face[OVERLAY_FONT_NUM] = {
+	{ cv::FONT_HERSHEY_PLAIN, 1.0 },
+	{ cv::FONT_HERSHEY_SIMPLEX, 0.4 },
+};
+
+//every glyph is drawn once by putText into a cell with a margin (hershey strokes may leave the
+//advance box) and cropped to its coverage
+static int overlay_atlas_build(OverlayAtlas_t* atlas, int face, double scale)
+{
+	const int margin = 3;
+	int baseline = 0;
+	cv::Size full = cv::getTextSize("Ag|", face, scale, 1, &baseline);
+	atlas->ascent = full.height;
+	atlas->descent = baseline;
+	int cell_height = atlas->ascent + atlas->descent + 2 * margin;
+
+	size_t atlas_size = 0;
+	for (int i = 0; i < OVERLAY_GLYPH_NUM; i++)
+	{
+		char s[2] = { (char)(OVERLAY_GLYPH_FIRST + i), 0 };
+		atlas_size += (size_t)(cv::getTextSize(s, face, scale, 1, &baseline).width + 2 * margin) * cell_height;
+	}
+	atlas->atlas = (uint8_t*)malloc(atlas_size);
+	if (atlas->atlas == NULL)
+	{
+		return OVERLAY_ERROR_MEM;
+	}
+
+	uint32_t offset = 0;
+	for (int i = 0; i < OVERLAY_GLYPH_NUM; i++)
+	{
+		char s[2] = { (char)(OVERLAY_GLYPH_FIRST + i), 0 };
+		OverlayGlyph_t* glyph = &atlas->glyph[i];
+		memset(glyph, 0, sizeof(OverlayGlyph_t));
+
+		//the advance of 16 copies keeps the fractional part of a scaled hershey advance
+		char repeat[17];
+		memset(repeat, s[0], 16);
+		repeat[16] = 0;
+		glyph->advance_q8 = (cv::getTextSize(repeat, face, scale, 1, &baseline).width * 256 + 8) / 16;
+
+		int cell_width = cv::getTextSize(s, face, scale, 1, &baseline).width + 2 * margin;
+		cv::Mat cell = cv::Mat::zeros(cell_height, cell_width, CV_8UC1);
+		cv::putText(cell, s, cv::Point(margin, margin + atlas->ascent), face, scale, cv::Scalar::all(255), 1, 8);
+
+		int x0 = cell_width, y0 = cell_height, x1 = -1, y1 = -1;
+		for (int y = 0; y < cell_height; y++)
+		{
+			const uint8_t* row = cell.ptr<uint8_t>(y);
+			for (int x = 0; x < cell_width; x++)
+			{
+				if (row[x] != 0)
+				{
+					x0 = (x < x0) ? x : x0;
+					x1 = (x > x1) ? x : x1;
+					y0 = (y < y0) ? y : y0;
+					y1 = (y > y1) ? y : y1;
+				}
+			}
+		}
+		if (x1 < 0)
+		{
+			continue;
+		}
+		glyph->left = (int16_t)(x0 - margin);
+		glyph->top = (int16_t)(y0 - margin - atlas->ascent);
+		glyph->width = (int16_t)(x1 - x0 + 1);
+		glyph->height = (int16_t)(y1 - y0 + 1);
+		glyph->offset = offset;
+		for (int y = y0; y <= y1; y++)
+		{
+			memcpy(atlas->atlas + offset, cell.ptr<uint8_t>(y) + x0, glyph->width);
+			offset += glyph->width;
+		}
+	}
+	return OVERLAY_SUCCESS;
+}
+
+static int overlay_atlas_init(void)
+{
+	if (overlay_atlas_inited)
+	{
+		return OVERLAY_SUCCESS;
+	}
+	for (int font = 0; font < OVERLAY_FONT_NUM; font++)
+	{
+		if (overlay_atlas_build(&overlay_atlas[font], overlay_font_face[font].face, \
+			overlay_font_face[font].scale) != OVERLAY_SUCCESS)
+		{
+			overlay_atlas_release();
+			return OVERLAY_ERROR_MEM;
+		}
+	}
+	overlay_atlas_inited = 1;
+	return OVERLAY_SUCCESS;
+}
+#else
+static int overlay_atlas_init(void)
+{
+	return OVERLAY_ERROR_UNAVAILABLE;
+}
+#endif
+
+void overlay_atlas_release(void)
+{
+	for (int font = 0; font < OVERLAY_FONT_NUM; font++)
+	{
+		free(overlay_atlas[font].atlas);
+		memset(&overlay_atlas[font], 0, sizeof(OverlayAtlas_t));
+	}
+	overlay_atlas_inited = 0;
+}
+
+int overlay_init(Overlay_t* overlay)
+{
+	if (overlay == NULL)
+	{
+		return OVERLAY_ERROR_PARAM;
+	}
+	memset(overlay, 0, sizeof(Overlay_t));
+	return overlay_atlas_init();
+}
+
+int overlay_text_width(OverlayFont_t font, const char* text)
+{
+	if (!overlay_atlas_inited || font < 0 || font >= OVERLAY_FONT_NUM || text == NULL)
+	{
+		return 0;
+	}
+	int pen_q8 = 0;
+	for (const char* c = text; *c != 0; c++)
+	{
+		pen_q8 += overlay_glyph(&overlay_atlas[font], *c)->advance_q8;
+	}
+	return (pen_q8 + 128) >> 8;
+}
+
+//glyph coverage into the sprite: text in byte 0 and shadow in byte 1 of each pixel, then both are
+//folded into the premultiplied color and the kept share of the frame pixel
+static int overlay_render(OverlayText_t* text)
+{
+	const OverlayAtlas_t* atlas = &overlay_atlas[text->font];
+	int x0 = 0x7fffffff, y0 = 0x7fffffff, x1 = -0x7fffffff, y1 = -0x7fffffff;
+	int pen_q8 = 0;
+	for (const char* c = text->text; *c != 0; c++)
+	{
+		const OverlayGlyph_t* glyph = overlay_glyph(atlas, *c);
+		if (glyph->width > 0)
+		{
+			int gx = ((pen_q8 + 128) >> 8) + glyph->left;
+			x0 = (gx < x0) ? gx : x0;
+			x1 = (gx + glyph->width > x1) ? gx + glyph->width : x1;
+			y0 = (glyph->top < y0) ? glyph->top : y0;
+			y1 = (glyph->top + glyph->height > y1) ? glyph->top + glyph->height : y1;
+		}
+		pen_q8 += glyph->advance_q8;
+	}
+	if (x1 <= x0)
+	{
+		text->width = 0;
+		text->height = 0;
+		return OVERLAY_SUCCESS;
+	}
+	int shadow = text->shadow ? 1 : 0;
+	text->left = x0;
+	text->top = y0;
+	text->width = x1 - x0 + shadow;
+	text->height = y1 - y0 + shadow;
+	int size = text->width * text->height * 4;
+	if (size > text->sprite_size)
+	{
+		free(text->sprite);
+		text->sprite = (uint8_t*)malloc(size);
+		text->sprite_size = (text->sprite != NULL) ? size : 0;
+		if (text->sprite == NULL)
+		{
+			text->width = 0;
+			text->height = 0;
+			return OVERLAY_ERROR_MEM;
+		}
+	}
+	memset(text->sprite, 0, size);
+
+	pen_q8 = 0;
+	for (const char* c = text->text; *c != 0; c++)
+	{
+		const OverlayGlyph_t* glyph = overlay_glyph(atlas, *c);
+		int gx = ((pen_q8 + 128) >> 8) + glyph->left - x0;
+		int gy = glyph->top - y0;
+		pen_q8 += glyph->advance_q8;
+		for (int y = 0; y < glyph->height; y++)
+		{
+			const uint8_t* src = atlas->atlas + glyph->offset + y * glyph->width;
+			uint8_t* dst = text->sprite + ((gy + y) * text->width + gx) * 4;
+			for (int x = 0; x < glyph->width; x++)
+			{
+				uint8_t a = src[x];
+				if (a > dst[x * 4])
+				{
+					dst[x * 4] = a;
+				}
+				if (shadow)
+				{
+					uint8_t* d = dst + (text->width + 1 + x) * 4 + 1;
+					if (a > *d)
+					{
+						*d = a;
+					}
+				}
+			}
+		}
+	}
+
+	//shadow (black) first, then the text over it: kept = (255 - s)(255 - t), color = c * t
+	uint8_t color[3] = { (uint8_t)(text->color & 0xff), (uint8_t)((text->color >> 8) & 0xff), \
+		(uint8_t)((text->color >> 16) & 0xff) };
+	uint8_t* p = text->sprite;
+	for (int i = 0; i < text->width * text->height; i++, p += 4)
+	{
+		uint32_t t = p[0], s = p[1];
+		p[0] = (uint8_t)((color[0] * t + 127) / 255);
+		p[1] = (uint8_t)((color[1] * t + 127) / 255);
+		p[2] = (uint8_t)((color[2] * t + 127) / 255);
+		p[3] = (uint8_t)(((255 - s) * (255 - t) + 127) / 255);
+	}
+	return OVERLAY_SUCCESS;
+}
+
+int overlay_text(Overlay_t* overlay, int slot, OverlayFont_t font, int x, int y, uint32_t color, \
+	uint8_t shadow, const char* text)
+{
+	if (overlay == NULL || slot < 0 || slot >= OVERLAY_TEXT_MAX || font < 0 || font >= OVERLAY_FONT_NUM || \
+		text == NULL)
+	{
+		return OVERLAY_ERROR_PARAM;
+	}
+	if (!overlay_atlas_inited)
+	{
+		return OVERLAY_ERROR_UNAVAILABLE;
+	}
+	OverlayText_t* t = &overlay->text[slot];
+	t->x = x;
+	t->y = y;
+	t->visible = 1;
+	if (t->used && t->font == font && t->color == color && t->shadow == shadow && \
+		strncmp(t->text, text, OVERLAY_TEXT_LEN - 1) == 0)
+	{
+		overlay->reuses++;
+		return OVERLAY_SUCCESS;
+	}
+	t->used = 1;
+	t->font = font;
+	t->color = color;
+	t->shadow = shadow;
+	strncpy(t->text, text, OVERLAY_TEXT_LEN - 1);
+	t->text[OVERLAY_TEXT_LEN - 1] = 0;
+	overlay->renders++;
+	return overlay_render(t);
+}
+
+void overlay_hide(Overlay_t* overlay, int slot)
+{
+	if (overlay != NULL && slot >= 0 && slot < OVERLAY_TEXT_MAX)
+	{
+		overlay->text[slot].visible = 0;
+	}
+}
+
+//dst = color + dst * kept / 255, fully transparent sprite pixels are skipped
+void overlay_blend(const Overlay_t* overlay, uint8_t* dst, int width, int height, int stride)
+{
+	if (overlay == NULL || dst == NULL)
+	{
+		return;
+	}
+	for (int slot = 0; slot < OVERLAY_TEXT_MAX; slot++)
+	{
+		const OverlayText_t* t = &overlay->text[slot];
+		if (!t->used || !t->visible || t->width == 0)
+		{
+			continue;
+		}
+		int left = t->x + t->left, top = t->y + t->top;
+		int sx0 = (left < 0) ? -left : 0;
+		int sy0 = (top < 0) ? -top : 0;
+		int sx1 = (left + t->width > width) ? width - left : t->width;
+		int sy1 = (top + t->height > height) ? height - top : t->height;
+		for (int y = sy0; y < sy1; y++)
+		{
+			const uint8_t* sp = t->sprite + (y * t->width + sx0) * 4;
+			uint8_t* dp = dst + (long)(top + y) * stride + (left + sx0) * 3;
+			for (int x = sx0; x < sx1; x++, sp += 4, dp += 3)
+			{
+				uint32_t kept = sp[3];
+				if (kept == 255)
+				{
+					continue;
+				}
+				for (int c = 0; c < 3; c++)
+				{
+					uint32_t v = sp[c] + (dp[c] * kept + 127) / 255;
+					dp[c] = (uint8_t)((v > 255) ? 255 : v);
+				}
+			}
+		}
+	}
+}
+
+void overlay_release(Overlay_t* overlay)
+{
+	if (overlay == NULL)
+	{
+		return;
+	}
+	for (int slot = 0; slot < OVERLAY_TEXT_MAX; slot++)
+	{
+		free(overlay->text[slot].sprite);
+	}
+	memset(overlay, 0, sizeof(Overlay_t));
+}
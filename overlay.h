@@ -0,0 +1,90 @@
+#ifndef _OVERLAY_H_
+#define _OVERLAY_H_
+
+#include <stdint.h>
+
+#define OVERLAY_SUCCESS 0
+#define OVERLAY_ERROR_PARAM -1
+#define OVERLAY_ERROR_MEM -2
+#define OVERLAY_ERROR_UNAVAILABLE -3    //built without OPENCV_ENABLE, there is nothing to rasterize the fonts
+
+#define OVERLAY_TEXT_MAX 16             //strings per overlay
+#define OVERLAY_TEXT_LEN 64
+#define OVERLAY_GLYPH_FIRST 32          //printable ascii, other characters are drawn as '?'
+#define OVERLAY_GLYPH_LAST 126
+#define OVERLAY_GLYPH_NUM (OVERLAY_GLYPH_LAST - OVERLAY_GLYPH_FIRST + 1)
+
+#define OVERLAY_RGB(r, g, b) (((uint32_t)(r) << 16) | ((uint32_t)(g) << 8) | (uint32_t)(b))
+
+typedef enum {
+    OVERLAY_FONT_PLAIN = 0,             //FONT_HERSHEY_PLAIN at scale 1, the fps/temperature lines
+    OVERLAY_FONT_SMALL,                 //FONT_HERSHEY_SIMPLEX at scale 0.4, the color bar labels
+    OVERLAY_FONT_NUM
+}OverlayFont_t;
+
+//one glyph's coverage in the atlas, placed relative to the pen position on the baseline
+typedef struct {
+    int16_t left;
+    int16_t top;                        //negative above the baseline
+    int16_t width;
+    int16_t height;
+    int32_t advance_q8;                 //pen advance in 1/256 pixel, hershey advances are fractional when scaled
+    uint32_t offset;                    //first byte in the atlas
+}OverlayGlyph_t;
+
+//the pre-rasterized glyphs of a font, built once and shared by every overlay
+typedef struct {
+    int ascent;
+    int descent;
+    OverlayGlyph_t glyph[OVERLAY_GLYPH_NUM];
+    uint8_t* atlas;                     //8 bit coverage of every glyph
+}OverlayAtlas_t;
+
+//one string, rendered into a premultiplied sprite when its text, font or color changes
+//each sprite pixel is b, g, r already scaled by the coverage, and the share of the frame pixel kept (255 - alpha)
+typedef struct {
+    uint8_t used;
+    uint8_t visible;
+    uint8_t shadow;                     //black copy one pixel down and right, as the putText pairs drew it
+    OverlayFont_t font;
+    uint32_t color;
+    char text[OVERLAY_TEXT_LEN];
+    int x;                              //pen start on the baseline, the putText origin
+    int y;
+    int left;                           //sprite rectangle relative to (x, y)
+    int top;
+    int width;
+    int height;
+    uint8_t* sprite;
+    int sprite_size;
+}OverlayText_t;
+
+typedef struct {
+    OverlayText_t text[OVERLAY_TEXT_MAX];
+    uint64_t renders;                   //strings rendered into their sprite
+    uint64_t reuses;                    //strings that kept last frame's sprite
+}Overlay_t;
+
+//rasterize the font atlases on first use, then clear the overlay's strings
+int overlay_init(Overlay_t* overlay);
+
+//set string slot to text at the putText origin (x, y), color OVERLAY_RGB
+//the sprite is only rendered again when text, font, color or shadow differ from the slot's last call
+int overlay_text(Overlay_t* overlay, int slot, OverlayFont_t font, int x, int y, uint32_t color, \
+    uint8_t shadow, const char* text);
+
+//keep the slot's sprite but do not blend it
+void overlay_hide(Overlay_t* overlay, int slot);
+
+//blend every visible string into the BGR888 frame, one pass over each sprite, clipped to the frame
+void overlay_blend(const Overlay_t* overlay, uint8_t* dst, int width, int height, int stride);
+
+//advance of text in pixels, for layout
+int overlay_text_width(OverlayFont_t font, const char* text);
+
+void overlay_release(Overlay_t* overlay);
+
+//free the font atlases, the next overlay_init builds them again
+void overlay_atlas_release(void);
+
+#endif
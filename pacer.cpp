@@ -0,0 +1,167 @@
+#include "pacer.h"
+#include "data.h"
+#include "rtsched.h"
+#include <string.h>
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <time.h>
+#include <errno.h>
+#endif
+
+static void pacer_sleep_until(uint64_t target_us)
+{
+    uint64_t now_us = get_monotonic_us();
+    if (target_us <= now_us)
+    {
+        return;
+    }
+#if defined(_WIN32)
+    Sleep((DWORD)((target_us - now_us + 999) / 1000));
+#else
+    uint64_t wait_us = target_us - now_us;
+    struct timespec wait_time = { (time_t)(wait_us / 1000000), (long)(wait_us % 1000000) * 1000 };
+    while (nanosleep(&wait_time, &wait_time) != 0 && errno == EINTR)
+    {
+    }
+#endif
+    //a timer wakeup: how late the thread runs after the deadline
+    rt_wakeup_record_since(target_us);
+}
+
+static void pacer_push(FramePacer_t* pacer, FrameSlot_t* slot)
+{
+    pacer->queue[(pacer->head + pacer->count) % PACER_MAX_DEPTH] = slot;
+    pacer->count++;
+}
+
+//take what already arrived, never waits
+static void pacer_fill(FramePacer_t* pacer)
+{
+    while (pacer->count < pacer->depth && !pacer->closed)
+    {
+        FrameSlot_t* slot = NULL;
+        int rst = ring_read_acquire(pacer->ring, pacer->consumer_id, 0, &slot);
+        if (rst == RING_CLOSED)
+        {
+            pacer->closed = 1;
+        }
+        if (rst != RING_SUCCESS)
+        {
+            break;
+        }
+        pacer_push(pacer, slot);
+    }
+}
+
+int pacer_attach(FramePacer_t* pacer, FrameRing_t* ring, uint32_t depth)
+{
+    if (pacer == NULL || ring == NULL || depth > PACER_MAX_DEPTH)
+    {
+        return RING_ERROR_PARAM;
+    }
+    memset(pacer, 0, sizeof(FramePacer_t));
+    pacer->ring = ring;
+    pacer->depth = (depth == 0) ? PACER_DEFAULT_DEPTH : depth;
+    pacer->consumer_id = ring_consumer_attach(ring, RING_POLICY_NEXT);
+    if (pacer->consumer_id < 0)
+    {
+        return pacer->consumer_id;
+    }
+    return RING_SUCCESS;
+}
+
+void pacer_detach(FramePacer_t* pacer)
+{
+    if (pacer == NULL || pacer->ring == NULL)
+    {
+        return;
+    }
+    while (pacer->count > 0)
+    {
+        ring_read_release(pacer->ring, pacer->queue[pacer->head]);
+        pacer->head = (pacer->head + 1) % PACER_MAX_DEPTH;
+        pacer->count--;
+    }
+    ring_consumer_detach(pacer->ring, pacer->consumer_id);
+    pacer->ring = NULL;
+}
+
+int pacer_acquire(FramePacer_t* pacer, uint32_t timeout_ms, FrameSlot_t** slot)
+{
+    if (pacer == NULL || pacer->ring == NULL || slot == NULL)
+    {
+        return RING_ERROR_PARAM;
+    }
+    uint64_t deadline_us = get_monotonic_us() + (uint64_t)timeout_ms * 1000;
+    while (1)
+    {
+        pacer_fill(pacer);
+        if (pacer->primed && pacer->count == 0)
+        {
+            //the camera fell behind the cadence, build the margin up again
+            pacer->primed = 0;
+            pacer->stats.underflows++;
+        }
+        if (!pacer->primed && (pacer->count >= pacer->depth || (pacer->closed && pacer->count > 0)))
+        {
+            pacer->primed = 1;
+            pacer->next_out_us = get_monotonic_us();
+        }
+        if (pacer->primed)
+        {
+            break;
+        }
+        if (pacer->closed)
+        {
+            return RING_CLOSED;
+        }
+
+        uint64_t now_us = get_monotonic_us();
+        if (now_us >= deadline_us)
+        {
+            return RING_TIMEOUT;
+        }
+        FrameSlot_t* arrived = NULL;
+        int rst = ring_read_acquire(pacer->ring, pacer->consumer_id, (uint32_t)((deadline_us - now_us + 999) / 1000), \
+            &arrived);
+        if (rst == RING_SUCCESS)
+        {
+            pacer_push(pacer, arrived);
+        }
+        else if (rst == RING_CLOSED)
+        {
+            pacer->closed = 1;
+        }
+        else if (rst != RING_TIMEOUT)
+        {
+            return rst;
+        }
+    }
+
+    pacer_sleep_until(pacer->next_out_us);
+    *slot = pacer->queue[pacer->head];
+    pacer->head = (pacer->head + 1) % PACER_MAX_DEPTH;
+    pacer->count--;
+
+    //a late consumer restarts the cadence from now instead of catching up in a burst
+    uint64_t now_us = get_monotonic_us();
+    pacer->next_out_us += pacer->ring->interval_us.load(std::memory_order_relaxed);
+    if (pacer->next_out_us < now_us)
+    {
+        pacer->next_out_us = now_us;
+    }
+    pacer->stats.frames++;
+    timing_record(TIMING_STAGE_PACER_LATENCY, now_us - (*slot)->desc.timestamp_us);
+    return RING_SUCCESS;
+}
+
+int pacer_stats(FramePacer_t* pacer, FramePacerStats_t* stats)
+{
+    if (pacer == NULL || stats == NULL)
+    {
+        return RING_ERROR_PARAM;
+    }
+    *stats = pacer->stats;
+    return RING_SUCCESS;
+}
@@ -0,0 +1,43 @@
+#ifndef _PACER_H_
+#define _PACER_H_
+
+#include <stdint.h>
+#include "ring.h"
+
+#define PACER_DEFAULT_DEPTH 2
+#define PACER_MAX_DEPTH 4
+
+typedef struct {
+    uint64_t frames;                //frames handed out
+    uint64_t underflows;            //the queue ran empty, the cadence restarted after refilling
+}FramePacerStats_t;
+
+//jitter buffer in front of a pull consumer: holds up to depth frames of the ring and hands them out one
+//measured frame interval apart, so display/encode see a steady cadence instead of the usb arrival times.
+//costs depth frames of latency, and every queued frame holds a ring slot: give the ring depth more slots
+typedef struct {
+    FrameRing_t* ring;
+    int consumer_id;
+    uint32_t depth;
+    FrameSlot_t* queue[PACER_MAX_DEPTH];
+    uint32_t head;
+    uint32_t count;
+    uint8_t primed;                 //the queue was filled to depth since the last underflow
+    uint8_t closed;
+    uint64_t next_out_us;
+    FramePacerStats_t stats;
+}FramePacer_t;
+
+//attach to the ring as a RING_POLICY_NEXT consumer, depth 0 selects PACER_DEFAULT_DEPTH
+int pacer_attach(FramePacer_t* pacer, FrameRing_t* ring, uint32_t depth);
+
+//release the queued frames and detach
+void pacer_detach(FramePacer_t* pacer);
+
+//the next frame at its output time, ring_read_release it when done. returns RING_SUCCESS, RING_TIMEOUT when
+//nothing arrived within timeout_ms, or RING_CLOSED once the ring is closed and the queue is empty
+int pacer_acquire(FramePacer_t* pacer, uint32_t timeout_ms, FrameSlot_t** slot);
+
+int pacer_stats(FramePacer_t* pacer, FramePacerStats_t* stats);
+
+#endif
@@ -0,0 +1,444 @@
+#include "palette.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <atomic>
+#include "libirparse.h"
+#include "memacct.h"
+#include "simd.h"
+
+static std::atomic<Palette_t*> palettes[PALETTE_MODE_NUM];
+static std::atomic<const Palette_t*> palette_active_ptr(NULL);
+static std::atomic<uint8_t> palette_inited(0);
+static pthread_mutex_t palette_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+//replaced user palettes, kept until palette_release
+typedef struct PaletteRetired {
+	Palette_t* palette;
+	struct PaletteRetired* next;
+}PaletteRetired_t;
+static PaletteRetired_t* palette_retired = NULL;
+
+//reserved library modes render a flat placeholder, palette_next skips them
+static int palette_reserved(int mode)
+{
+	return (mode == IRPROC_COLOR_MODE_2) || (mode >= IRPROC_COLOR_MODE_12 && mode <= IRPROC_COLOR_MODE_15);
+}
+
+static inline uint8_t palette_clamp(int v)
+{
+	return (uint8_t)((v < 0) ? 0 : ((v > 255) ? 255 : v));
+}
+
+//rgb is filled, the other formats follow from it. the yuv matches the library chain's full range bt.601
+static void palette_fill_formats(Palette_t* palette)
+{
+	for (int i = 0; i < PALETTE_LUT_SIZE; i++)
+	{
+		int r = palette->rgb[i * 3];
+		int g = palette->rgb[i * 3 + 1];
+		int b = palette->rgb[i * 3 + 2];
+		palette->bgr[i * 3] = (uint8_t)b;
+		palette->bgr[i * 3 + 1] = (uint8_t)g;
+		palette->bgr[i * 3 + 2] = (uint8_t)r;
+		palette->rgba[i * 4] = (uint8_t)r;
+		palette->rgba[i * 4 + 1] = (uint8_t)g;
+		palette->rgba[i * 4 + 2] = (uint8_t)b;
+		palette->rgba[i * 4 + 3] = 255;
+		palette->bgra[i * 4] = (uint8_t)b;
+		palette->bgra[i * 4 + 1] = (uint8_t)g;
+		palette->bgra[i * 4 + 2] = (uint8_t)r;
+		palette->bgra[i * 4 + 3] = 255;
+		if (palette->user)
+		{
+			palette->yuv[i * 3] = palette_clamp((77 * r + 150 * g + 29 * b + 128) >> 8);
+			palette->yuv[i * 3 + 1] = palette_clamp(((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128);
+			palette->yuv[i * 3 + 2] = palette_clamp(((128 * r - 107 * g - 21 * b + 128) >> 8) + 128);
+		}
+	}
+}
+
+//run the library chain once over every Y14 value, each value is fed as a yuyv pair
+//so the pair average equals the value's own chroma. the chain's yuv is kept as the yuv lut
+static Palette_t* palette_build(irproc_color_mode_t color_mode)
+{
+	int pix_num = PALETTE_LUT_SIZE * 2;
+	Palette_t* palette = (Palette_t*)malloc(sizeof(Palette_t));
+	uint16_t* ramp = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+	uint8_t* yuv = (uint8_t*)malloc(pix_num * 2);
+	uint8_t* rgb = (uint8_t*)malloc(pix_num * 3);
+	if (palette == NULL || ramp == NULL || yuv == NULL || rgb == NULL)
+	{
+		free(palette);
+		free(ramp);
+		free(yuv);
+		free(rgb);
+		return NULL;
+	}
+
+	for (int i = 0; i < PALETTE_LUT_SIZE; i++)
+	{
+		ramp[2 * i] = (uint16_t)i;
+		ramp[2 * i + 1] = (uint16_t)i;
+	}
+	palette->color_mode = color_mode;
+	palette->user = 0;
+	if (y14_map_to_yuyv_pseudocolor(ramp, pix_num, color_mode, yuv) != IRPROC_SUCCESS)
+	{
+		free(palette);
+		palette = NULL;
+	}
+	else
+	{
+		yuv422_to_rgb(yuv, pix_num, rgb);
+		for (int i = 0; i < PALETTE_LUT_SIZE; i++)
+		{
+			memcpy(palette->rgb + i * 3, rgb + i * 6, 3);
+			palette->yuv[i * 3] = yuv[i * 4];
+			palette->yuv[i * 3 + 1] = yuv[i * 4 + 1];
+			palette->yuv[i * 3 + 2] = yuv[i * 4 + 3];
+		}
+		palette_fill_formats(palette);
+	}
+
+	free(ramp);
+	free(yuv);
+	free(rgb);
+	return palette;
+}
+
+int palette_init(void)
+{
+	if (palette_inited.load(std::memory_order_acquire))
+	{
+		return PALETTE_SUCCESS;
+	}
+	int ret = PALETTE_SUCCESS;
+	pthread_mutex_lock(&palette_mutex);
+	if (!palette_inited.load(std::memory_order_relaxed))
+	{
+		for (int mode = IRPROC_COLOR_MODE_1; mode < PALETTE_USER_FIRST; mode++)
+		{
+			if (palettes[mode].load(std::memory_order_relaxed) != NULL)
+			{
+				continue;
+			}
+			Palette_t* palette = palette_build((irproc_color_mode_t)mode);
+			if (palette == NULL)
+			{
+				printf("palette: build color mode %d failed\n", mode);
+				ret = PALETTE_ERROR_MEM;
+				continue;
+			}
+			palettes[mode].store(palette, std::memory_order_release);
+			mem_acct_add(MEM_CLASS_LUT, sizeof(Palette_t));
+		}
+		if (palette_active_ptr.load(std::memory_order_relaxed) == NULL)
+		{
+			palette_active_ptr.store(palettes[PALETTE_DEFAULT_MODE].load(std::memory_order_relaxed), \
+				std::memory_order_release);
+		}
+		palette_inited.store(1, std::memory_order_release);
+	}
+	pthread_mutex_unlock(&palette_mutex);
+	return ret;
+}
+
+int palette_load_user(irproc_color_mode_t color_mode, const char* path)
+{
+	if (color_mode < PALETTE_USER_FIRST || color_mode > PALETTE_USER_LAST || path == NULL)
+	{
+		return PALETTE_ERROR_PARAM;
+	}
+	FILE* fp = fopen(path, "rb");
+	if (fp == NULL)
+	{
+		return PALETTE_ERROR_FILE;
+	}
+	uint8_t* entries = (uint8_t*)malloc(PALETTE_LUT_SIZE * 3 + 1);
+	Palette_t* palette = (Palette_t*)malloc(sizeof(Palette_t));
+	if (entries == NULL || palette == NULL)
+	{
+		fclose(fp);
+		free(entries);
+		free(palette);
+		return PALETTE_ERROR_MEM;
+	}
+	size_t size = fread(entries, 1, PALETTE_LUT_SIZE * 3 + 1, fp);
+	fclose(fp);
+	if (size != 256 * 3 && size != PALETTE_LUT_SIZE * 3)
+	{
+		printf("palette: %s holds %d bytes, not 256 or %d rgb triplets\n", path, (int)size, PALETTE_LUT_SIZE);
+		free(entries);
+		free(palette);
+		return PALETTE_ERROR_FILE;
+	}
+
+	palette->color_mode = color_mode;
+	palette->user = 1;
+	if (size == PALETTE_LUT_SIZE * 3)
+	{
+		memcpy(palette->rgb, entries, PALETTE_LUT_SIZE * 3);
+	}
+	else
+	{
+		//entry k sits at Y14 k * 16383 / 255, linear in between
+		for (int i = 0; i < PALETTE_LUT_SIZE; i++)
+		{
+			int pos = i * 255;
+			int k = pos / (PALETTE_LUT_SIZE - 1);
+			int frac = pos % (PALETTE_LUT_SIZE - 1);
+			int k1 = (k < 255) ? k + 1 : k;
+			for (int c = 0; c < 3; c++)
+			{
+				int v0 = entries[k * 3 + c];
+				int v1 = entries[k1 * 3 + c];
+				palette->rgb[i * 3 + c] = (uint8_t)(v0 + ((v1 - v0) * frac + (PALETTE_LUT_SIZE - 1) / 2) / \
+					(PALETTE_LUT_SIZE - 1));
+			}
+		}
+	}
+	free(entries);
+	palette_fill_formats(palette);
+
+	pthread_mutex_lock(&palette_mutex);
+	Palette_t* old = palettes[color_mode].exchange(palette, std::memory_order_acq_rel);
+	//a replaced palette stays until palette_release, counted until then
+	mem_acct_add(MEM_CLASS_LUT, sizeof(Palette_t));
+	if (old != NULL)
+	{
+		const Palette_t* expected = old;
+		palette_active_ptr.compare_exchange_strong(expected, palette, std::memory_order_acq_rel);
+		PaletteRetired_t* retired = (PaletteRetired_t*)malloc(sizeof(PaletteRetired_t));
+		if (retired != NULL)
+		{
+			retired->palette = old;
+			retired->next = palette_retired;
+			palette_retired = retired;
+		}
+	}
+	pthread_mutex_unlock(&palette_mutex);
+	return PALETTE_SUCCESS;
+}
+
+int palette_load_user_dir(const char* dir)
+{
+	if (dir == NULL)
+	{
+		return 0;
+	}
+	int loaded = 0;
+	char path[512];
+	for (int mode = PALETTE_USER_FIRST; mode <= PALETTE_USER_LAST; mode++)
+	{
+		snprintf(path, sizeof(path), "%s/palette_%d.rgb", dir, mode);
+		FILE* fp = fopen(path, "rb");
+		if (fp == NULL)
+		{
+			continue;
+		}
+		fclose(fp);
+		int ret = palette_load_user((irproc_color_mode_t)mode, path);
+		if (ret == PALETTE_SUCCESS)
+		{
+			loaded++;
+		}
+		else
+		{
+			printf("palette: load %s failed (%d)\n", path, ret);
+		}
+	}
+	return loaded;
+}
+
+const Palette_t* palette_get(irproc_color_mode_t color_mode)
+{
+	if (color_mode < IRPROC_COLOR_MODE_1 || color_mode >= PALETTE_MODE_NUM)
+	{
+		return NULL;
+	}
+	palette_init();
+	return palettes[color_mode].load(std::memory_order_acquire);
+}
+
+int palette_select(irproc_color_mode_t color_mode)
+{
+	const Palette_t* palette = palette_get(color_mode);
+	if (palette == NULL)
+	{
+		return PALETTE_ERROR_MODE;
+	}
+	palette_active_ptr.store(palette, std::memory_order_release);
+	return PALETTE_SUCCESS;
+}
+
+const Palette_t* palette_active(void)
+{
+	palette_init();
+	return palette_active_ptr.load(std::memory_order_acquire);
+}
+
+irproc_color_mode_t palette_next(irproc_color_mode_t color_mode)
+{
+	int mode = color_mode;
+	for (int n = 0; n < PALETTE_MODE_NUM; n++)
+	{
+		mode = (mode + 1 < PALETTE_MODE_NUM) ? mode + 1 : IRPROC_COLOR_MODE_1;
+		if (!palette_reserved(mode) && palette_get((irproc_color_mode_t)mode) != NULL)
+		{
+			return (irproc_color_mode_t)mode;
+		}
+	}
+	return color_mode;
+}
+
+void palette_map(const uint8_t* lut, int bpp, const uint16_t* src, int pix_num, uint8_t* dst)
+{
+	if (bpp == 4)
+	{
+		simd_lut32_u16(src, pix_num, 0, 0, PALETTE_LUT_SIZE - 1, NULL, (const uint32_t*)lut, (uint32_t*)dst);
+		return;
+	}
+	for (int i = 0; i < pix_num; i++)
+	{
+		uint32_t v = src[i];
+		const uint8_t* color = lut + ((v < PALETTE_LUT_SIZE) ? v : PALETTE_LUT_SIZE - 1) * 3;
+		dst[0] = color[0];
+		dst[1] = color[1];
+		dst[2] = color[2];
+		dst += 3;
+	}
+}
+
+void palette_map_yuyv(const Palette_t* palette, const uint16_t* src, int pix_num, uint8_t* dst)
+{
+	const uint8_t* lut = palette->yuv;
+	for (int i = 0; i + 1 < pix_num; i += 2)
+	{
+		uint32_t v0 = src[i];
+		uint32_t v1 = src[i + 1];
+		const uint8_t* c0 = lut + ((v0 < PALETTE_LUT_SIZE) ? v0 : PALETTE_LUT_SIZE - 1) * 3;
+		const uint8_t* c1 = lut + ((v1 < PALETTE_LUT_SIZE) ? v1 : PALETTE_LUT_SIZE - 1) * 3;
+		dst[0] = c0[0];
+		dst[1] = (uint8_t)((c0[1] + c1[1]) >> 1);
+		dst[2] = c1[0];
+		dst[3] = (uint8_t)((c0[2] + c1[2]) >> 1);
+		dst += 4;
+	}
+}
+
+static inline uint32_t palette_index8(uint32_t v)
+{
+	return (v * (PALETTE_LUT_SIZE - 1) + 127) / 255;
+}
+
+void palette_map8(const uint8_t* lut, int bpp, const uint8_t* src, int pix_num, uint8_t* dst)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		const uint8_t* color = lut + palette_index8(src[i]) * bpp;
+		dst[0] = color[0];
+		dst[1] = color[1];
+		dst[2] = color[2];
+		if (bpp == 4)
+		{
+			dst[3] = color[3];
+		}
+		dst += bpp;
+	}
+}
+
+void palette_map8_yuyv(const Palette_t* palette, const uint8_t* src, int pix_num, uint8_t* dst)
+{
+	const uint8_t* lut = palette->yuv;
+	for (int i = 0; i + 1 < pix_num; i += 2)
+	{
+		const uint8_t* c0 = lut + palette_index8(src[i]) * 3;
+		const uint8_t* c1 = lut + palette_index8(src[i + 1]) * 3;
+		dst[0] = c0[0];
+		dst[1] = (uint8_t)((c0[1] + c1[1]) >> 1);
+		dst[2] = c1[0];
+		dst[3] = (uint8_t)((c0[2] + c1[2]) >> 1);
+		dst += 4;
+	}
+}
+
+void palette_copy_range(Palette_t* dst, const Palette_t* src, uint16_t low, uint16_t high)
+{
+	if (high >= PALETTE_LUT_SIZE)
+	{
+		high = PALETTE_LUT_SIZE - 1;
+	}
+	if (dst == NULL || src == NULL || low > high)
+	{
+		return;
+	}
+	size_t num = (size_t)high - low + 1;
+	memcpy(dst->bgr + low * 3, src->bgr + low * 3, num * 3);
+	memcpy(dst->rgb + low * 3, src->rgb + low * 3, num * 3);
+	memcpy(dst->rgba + low * 4, src->rgba + low * 4, num * 4);
+	memcpy(dst->bgra + low * 4, src->bgra + low * 4, num * 4);
+	memcpy(dst->yuv + low * 3, src->yuv + low * 3, num * 3);
+}
+
+void palette_fill_range(Palette_t* dst, uint16_t low, uint16_t high, const uint8_t* rgb)
+{
+	if (high >= PALETTE_LUT_SIZE)
+	{
+		high = PALETTE_LUT_SIZE - 1;
+	}
+	if (dst == NULL || rgb == NULL || low > high)
+	{
+		return;
+	}
+	int r = rgb[0], g = rgb[1], b = rgb[2];
+	uint8_t y = palette_clamp((77 * r + 150 * g + 29 * b + 128) >> 8);
+	uint8_t u = palette_clamp(((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128);
+	uint8_t v = palette_clamp(((128 * r - 107 * g - 21 * b + 128) >> 8) + 128);
+	for (uint32_t i = low; i <= high; i++)
+	{
+		dst->bgr[i * 3] = (uint8_t)b;
+		dst->bgr[i * 3 + 1] = (uint8_t)g;
+		dst->bgr[i * 3 + 2] = (uint8_t)r;
+		dst->rgb[i * 3] = (uint8_t)r;
+		dst->rgb[i * 3 + 1] = (uint8_t)g;
+		dst->rgb[i * 3 + 2] = (uint8_t)b;
+		dst->rgba[i * 4] = (uint8_t)r;
+		dst->rgba[i * 4 + 1] = (uint8_t)g;
+		dst->rgba[i * 4 + 2] = (uint8_t)b;
+		dst->rgba[i * 4 + 3] = 255;
+		dst->bgra[i * 4] = (uint8_t)b;
+		dst->bgra[i * 4 + 1] = (uint8_t)g;
+		dst->bgra[i * 4 + 2] = (uint8_t)r;
+		dst->bgra[i * 4 + 3] = 255;
+		dst->yuv[i * 3] = y;
+		dst->yuv[i * 3 + 1] = u;
+		dst->yuv[i * 3 + 2] = v;
+	}
+}
+
+void palette_release(void)
+{
+	pthread_mutex_lock(&palette_mutex);
+	palette_active_ptr.store(NULL, std::memory_order_release);
+	for (int i = 0; i < PALETTE_MODE_NUM; i++)
+	{
+		Palette_t* palette = palettes[i].exchange(NULL, std::memory_order_acq_rel);
+		if (palette != NULL)
+		{
+			mem_acct_release(MEM_CLASS_LUT, sizeof(Palette_t));
+			free(palette);
+		}
+	}
+	while (palette_retired != NULL)
+	{
+		PaletteRetired_t* next = palette_retired->next;
+		mem_acct_release(MEM_CLASS_LUT, sizeof(Palette_t));
+		free(palette_retired->palette);
+		free(palette_retired);
+		palette_retired = next;
+	}
+	palette_inited.store(0, std::memory_order_release);
+	pthread_mutex_unlock(&palette_mutex);
+}
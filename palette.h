@@ -0,0 +1,75 @@
+#ifndef _PALETTE_H_
+#define _PALETTE_H_
+
+#include <stdint.h>
+#include "libirprocess.h"
+
+#define PALETTE_LUT_SIZE 16384          //one entry per Y14 value
+#define PALETTE_MODE_NUM 21             //indexed by irproc_color_mode_t
+#define PALETTE_USER_FIRST IRPROC_COLOR_MODE_16
+#define PALETTE_USER_LAST IRPROC_COLOR_MODE_20
+#define PALETTE_DEFAULT_MODE IRPROC_COLOR_MODE_6
+
+#define PALETTE_SUCCESS 0
+#define PALETTE_ERROR_PARAM -1
+#define PALETTE_ERROR_MEM -2
+#define PALETTE_ERROR_FILE -3
+#define PALETTE_ERROR_MODE -4           //no palette built or loaded for the mode
+
+//every output format of one color mode, read only once published
+typedef struct {
+    irproc_color_mode_t color_mode;
+    uint8_t user;                       //loaded from a file, the library cannot render it
+    uint8_t bgr[PALETTE_LUT_SIZE * 3];
+    uint8_t rgb[PALETTE_LUT_SIZE * 3];
+    uint8_t rgba[PALETTE_LUT_SIZE * 4];
+    uint8_t bgra[PALETTE_LUT_SIZE * 4];
+    uint8_t yuv[PALETTE_LUT_SIZE * 3];  //Y, U, V of the library chain (full range bt.601)
+}Palette_t;
+
+//build the luts of the library modes 1..15 from the library pseudocolor chain, once
+//called by display_init, any getter runs it on first use
+int palette_init(void);
+
+//load user mode 16..20 from a file of 256 or 16384 rgb triplets (raw bytes, coldest first),
+//256 entries are interpolated. a loaded mode is replaced by publishing the new palette,
+//the old one stays allocated until palette_release since a frame may still map through it
+int palette_load_user(irproc_color_mode_t color_mode, const char* path);
+
+//palette_load_user for every dir/palette_<mode>.rgb present, returns the number loaded
+int palette_load_user_dir(const char* dir);
+
+//the palette of color_mode, NULL when the mode has none
+const Palette_t* palette_get(irproc_color_mode_t color_mode);
+
+//make color_mode the active palette, one atomic pointer store
+int palette_select(irproc_color_mode_t color_mode);
+
+//the active palette, one atomic pointer load, PALETTE_DEFAULT_MODE until palette_select
+const Palette_t* palette_active(void);
+
+//the next mode with a palette after color_mode, wrapping around
+irproc_color_mode_t palette_next(irproc_color_mode_t color_mode);
+
+//map Y14 through a bgr/rgb (bpp 3) or rgba/bgra (bpp 4) lut of a palette, values above 16383 take the last entry.
+//bpp 4 stores whole pixels, dst 4 byte aligned
+void palette_map(const uint8_t* lut, int bpp, const uint16_t* src, int pix_num, uint8_t* dst);
+
+//map Y14 to yuyv, each pair shares its averaged chroma, the same bytes as y14_map_to_yuyv_pseudocolor, pix_num even
+void palette_map_yuyv(const Palette_t* palette, const uint16_t* src, int pix_num, uint8_t* dst);
+
+//the same for a y8 plane, each byte stands for the Y14 value v * 16383 / 255
+void palette_map8(const uint8_t* lut, int bpp, const uint8_t* src, int pix_num, uint8_t* dst);
+
+void palette_map8_yuyv(const Palette_t* palette, const uint8_t* src, int pix_num, uint8_t* dst);
+
+//copy entries [low, high] of every format from src, dst being a palette of the caller's (a composed one)
+void palette_copy_range(Palette_t* dst, const Palette_t* src, uint16_t low, uint16_t high);
+
+//paint entries [low, high] of every format with one rgb color, isotherm bands folded into a lut
+void palette_fill_range(Palette_t* dst, uint16_t low, uint16_t high, const uint8_t* rgb);
+
+//free every palette, the next getter builds them again
+void palette_release(void);
+
+#endif
@@ -0,0 +1,162 @@
+#include "perfctr.h"
+#include <string.h>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char* perf_event_names[PERF_EVENT_NUM] = { "cycles", "instructions", "l1d_misses", "llc_misses", \
+    "branch_misses" };
+
+#if defined(__linux__)
+static int perf_event_open_one(PerfEvent_t event, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    switch (event)
+    {
+    case PERF_EVENT_CYCLES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PERF_EVENT_INSTRUCTIONS:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PERF_EVENT_L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case PERF_EVENT_LLC_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    default:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    }
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    //the leader starts disabled, the group is enabled as a whole once it is complete
+    attr.disabled = (group_fd < 0);
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+int perf_counters_open(PerfCounters_t* counters)
+{
+    if (counters == NULL)
+    {
+        return PERF_ERROR_PARAM;
+    }
+    memset(counters, 0, sizeof(PerfCounters_t));
+    counters->leader = -1;
+    for (int i = 0; i < PERF_EVENT_NUM; i++)
+    {
+        counters->fd[i] = -1;
+    }
+#if defined(__linux__)
+    for (int i = 0; i < PERF_EVENT_NUM; i++)
+    {
+        int group_fd = (counters->leader >= 0) ? counters->fd[counters->leader] : -1;
+        int fd = perf_event_open_one((PerfEvent_t)i, group_fd);
+        if (fd < 0)
+        {
+            continue;
+        }
+        counters->fd[i] = fd;
+        counters->leader = (counters->leader >= 0) ? counters->leader : i;
+        counters->valid |= 1u << i;
+        counters->num++;
+    }
+    if (counters->num == 0)
+    {
+        return PERF_ERROR_UNAVAILABLE;
+    }
+    int leader_fd = counters->fd[counters->leader];
+    ioctl(leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return PERF_SUCCESS;
+#else
+    return PERF_ERROR_UNAVAILABLE;
+#endif
+}
+
+void perf_counters_close(PerfCounters_t* counters)
+{
+    if (counters == NULL)
+    {
+        return;
+    }
+#if defined(__linux__)
+    for (int i = 0; i < PERF_EVENT_NUM; i++)
+    {
+        if (counters->fd[i] >= 0)
+        {
+            close(counters->fd[i]);
+        }
+        counters->fd[i] = -1;
+    }
+#endif
+    counters->valid = 0;
+    counters->num = 0;
+    counters->leader = -1;
+}
+
+int perf_counters_read(PerfCounters_t* counters, PerfCounts_t* counts)
+{
+    if (counters == NULL || counts == NULL)
+    {
+        return PERF_ERROR_PARAM;
+    }
+    memset(counts, 0, sizeof(PerfCounts_t));
+    if (counters->num == 0)
+    {
+        return PERF_ERROR_UNAVAILABLE;
+    }
+#if defined(__linux__)
+    //nr, time_enabled, time_running, then the values in the order they joined the group
+    uint64_t data[3 + PERF_EVENT_NUM];
+    ssize_t got = read(counters->fd[counters->leader], data, sizeof(data));
+    if (got < (ssize_t)(3 * sizeof(uint64_t)) || data[0] != (uint64_t)counters->num)
+    {
+        return PERF_ERROR_UNAVAILABLE;
+    }
+    double scale = (data[2] > 0 && data[2] < data[1]) ? (double)data[1] / data[2] : 1.0;
+    int n = 0;
+    for (int i = 0; i < PERF_EVENT_NUM; i++)
+    {
+        if (counters->valid & (1u << i))
+        {
+            counts->value[i] = (scale == 1.0) ? data[3 + n] : (uint64_t)(data[3 + n] * scale);
+            n++;
+        }
+    }
+    return PERF_SUCCESS;
+#else
+    return PERF_ERROR_UNAVAILABLE;
+#endif
+}
+
+void perf_counts_sub(const PerfCounts_t* a, const PerfCounts_t* b, PerfCounts_t* dst)
+{
+    for (int i = 0; i < PERF_EVENT_NUM; i++)
+    {
+        dst->value[i] = (a->value[i] > b->value[i]) ? a->value[i] - b->value[i] : 0;
+    }
+}
+
+const char* perf_event_name(PerfEvent_t event)
+{
+    if (event < 0 || event >= PERF_EVENT_NUM)
+    {
+        return "unknown";
+    }
+    return perf_event_names[event];
+}
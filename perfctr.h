@@ -0,0 +1,49 @@
+#ifndef _PERFCTR_H_
+#define _PERFCTR_H_
+
+//hardware performance counters of the calling thread: one perf_event_open group of cycles, instructions, l1 data
+//read misses, last level cache misses and branch misses, user space only (perf_event_paranoid 2 allows them). the
+//group is read in one read() with its enabled and running times, a group the pmu multiplexed with others is scaled
+//up by them. a counter the cpu or the vm does not have is left out of the group and reads 0 with its bit clear in
+//valid. windows and non linux builds open nothing
+#include <stdint.h>
+
+typedef enum
+{
+    PERF_EVENT_CYCLES = 0,
+    PERF_EVENT_INSTRUCTIONS,
+    PERF_EVENT_L1D_MISSES,
+    PERF_EVENT_LLC_MISSES,
+    PERF_EVENT_BRANCH_MISSES,
+    PERF_EVENT_NUM,
+}PerfEvent_t;
+
+#define PERF_SUCCESS 0
+#define PERF_ERROR_PARAM -1
+#define PERF_ERROR_UNAVAILABLE -2           //no counter could be opened: no pmu, not linux, or not allowed
+
+typedef struct {
+    uint64_t value[PERF_EVENT_NUM];
+}PerfCounts_t;
+
+typedef struct {
+    int fd[PERF_EVENT_NUM];                 //-1 for a counter left out, fd[leader] leads the group
+    int leader;
+    uint32_t valid;                         //bit per PerfEvent_t that counts
+    int num;                                //counters in the group
+}PerfCounters_t;
+
+//open the group on the calling thread, counting from now
+int perf_counters_open(PerfCounters_t* counters);
+
+void perf_counters_close(PerfCounters_t* counters);
+
+//the counts since the open, on the thread that opened the group
+int perf_counters_read(PerfCounters_t* counters, PerfCounts_t* counts);
+
+//dst = a - b
+void perf_counts_sub(const PerfCounts_t* a, const PerfCounts_t* b, PerfCounts_t* dst);
+
+const char* perf_event_name(PerfEvent_t event);
+
+#endif
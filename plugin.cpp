@@ -0,0 +1,582 @@
+#include "plugin.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <new>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "log.h"
+#include "rtsched.h"
+#include "stats.h"
+#if !defined(_WIN32)
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+//the stream's statistics go to the plug-ins as they are, without a copy
+static_assert(sizeof(IrpPlaneStats_t) == sizeof(FrameStats_t), "IrpPlaneStats_t is not FrameStats_t");
+static_assert(offsetof(IrpPlaneStats_t, min_val) == offsetof(FrameStats_t, min_val), "IrpPlaneStats_t min_val");
+static_assert(offsetof(IrpPlaneStats_t, max_y) == offsetof(FrameStats_t, max_y), "IrpPlaneStats_t max_y");
+static_assert(offsetof(IrpPlaneStats_t, pix_num) == offsetof(FrameStats_t, pix_num), "IrpPlaneStats_t pix_num");
+static_assert(offsetof(IrpPlaneStats_t, hist) == offsetof(FrameStats_t, hist), "IrpPlaneStats_t hist");
+static_assert(IRP_HIST_BINS == FRAME_STATS_HIST_BINS, "IrpPlaneStats_t hist bins");
+
+static uint64_t plugin_thread_cpu_us(void)
+{
+#if defined(_WIN32)
+    FILETIME create_time, exit_time, kernel_time, user_time;
+    GetThreadTimes(GetCurrentThread(), &create_time, &exit_time, &kernel_time, &user_time);
+    uint64_t kernel = ((uint64_t)kernel_time.dwHighDateTime << 32) | kernel_time.dwLowDateTime;
+    uint64_t user = ((uint64_t)user_time.dwHighDateTime << 32) | user_time.dwLowDateTime;
+    return (kernel + user) / 10;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static uint64_t plugin_hard_limit_us(uint32_t budget_us)
+{
+    uint64_t limit = (uint64_t)budget_us * PLUGIN_HARD_LIMIT_FACTOR;
+    return (limit > PLUGIN_HARD_LIMIT_MIN_US) ? limit : PLUGIN_HARD_LIMIT_MIN_US;
+}
+
+static int plugin_file_stamp(const char* path, uint64_t* stamp)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        return -1;
+    }
+    *stamp = ((uint64_t)st.st_mtime << 24) ^ (uint64_t)st.st_size;
+    return 0;
+}
+
+static void plugin_instance_free(PluginInstance_t* instance)
+{
+    if (instance == NULL)
+    {
+        return;
+    }
+    if (instance->desc->destroy != NULL)
+    {
+        instance->desc->destroy(instance->state);
+    }
+#if !defined(_WIN32)
+    if (instance->handle != NULL)
+    {
+        dlclose(instance->handle);
+    }
+#endif
+    free(instance);
+}
+
+//what the host reads of a desc of its own major version, the fields of later minors are past on_frame
+static int plugin_desc_check(const IrpPluginDesc_t* desc)
+{
+    if (desc == NULL || desc->struct_size < offsetof(IrpPluginDesc_t, on_frame) + sizeof(desc->on_frame) || \
+        (desc->abi_version >> 16) != IRP_ABI_VERSION_MAJOR || desc->on_frame == NULL)
+    {
+        return PLUGIN_ERROR_VERSION;
+    }
+    return PLUGIN_SUCCESS;
+}
+
+static int plugin_instance_create(const IrpPluginDesc_t* desc, void* handle, const char* config, \
+    PluginInstance_t** out)
+{
+    int ret = plugin_desc_check(desc);
+    if (ret != PLUGIN_SUCCESS)
+    {
+        return ret;
+    }
+    PluginInstance_t* instance = (PluginInstance_t*)calloc(1, sizeof(PluginInstance_t));
+    if (instance == NULL)
+    {
+        return PLUGIN_ERROR_INIT;
+    }
+    instance->desc = desc;
+    instance->budget_us = (desc->budget_us > 0) ? desc->budget_us : PLUGIN_DEFAULT_BUDGET_US;
+    if (desc->create != NULL && desc->create((config != NULL && config[0] != '\0') ? config : NULL, \
+        &instance->state) < 0)
+    {
+        free(instance);
+        return PLUGIN_ERROR_INIT;
+    }
+    //destroy runs before the library goes
+    instance->handle = handle;
+    *out = instance;
+    return PLUGIN_SUCCESS;
+}
+
+#if !defined(_WIN32)
+//dlopen of a path already loaded returns the library loaded before, and a file written over in place changes the
+//code under the running instance. every load opens a copy of its own, unlinked once open
+static void* plugin_open_copy(const char* path)
+{
+    int src = open(path, O_RDONLY);
+    if (src < 0)
+    {
+        return NULL;
+    }
+    char copy[] = "/tmp/irplugin-XXXXXX";
+    int dst = mkstemp(copy);
+    if (dst < 0)
+    {
+        close(src);
+        return NULL;
+    }
+    char buf[65536];
+    ssize_t len;
+    int failed = 0;
+    while ((len = read(src, buf, sizeof(buf))) > 0)
+    {
+        if (write(dst, buf, (size_t)len) != len)
+        {
+            failed = 1;
+            break;
+        }
+    }
+    failed |= (len < 0);
+    close(src);
+    close(dst);
+    void* handle = (failed) ? NULL : dlopen(copy, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL && !failed)
+    {
+        LOG(LOG_LEVEL_WARN, "plugin: %s: %s\n", path, dlerror());
+    }
+    unlink(copy);
+    return handle;
+}
+#endif
+
+static int plugin_instance_load(const char* path, const char* config, PluginInstance_t** out)
+{
+#if defined(_WIN32)
+    return PLUGIN_ERROR_UNAVAILABLE;
+#else
+    void* handle = plugin_open_copy(path);
+    if (handle == NULL)
+    {
+        return PLUGIN_ERROR_LOAD;
+    }
+    IrpDescribeFunc_t describe = (IrpDescribeFunc_t)dlsym(handle, IRP_DESCRIBE_SYMBOL);
+    if (describe == NULL)
+    {
+        dlclose(handle);
+        return PLUGIN_ERROR_LOAD;
+    }
+    int ret = plugin_instance_create(describe(), handle, config, out);
+    if (ret != PLUGIN_SUCCESS)
+    {
+        dlclose(handle);
+    }
+    return ret;
+#endif
+}
+
+//a new instance for the node, the one it did not take yet goes
+static void plugin_slot_publish(PluginSlot_t* slot, PluginInstance_t* instance)
+{
+    plugin_instance_free(slot->retired.exchange(NULL, std::memory_order_acq_rel));
+    plugin_instance_free(slot->pending.exchange(instance, std::memory_order_acq_rel));
+}
+
+int plugin_host_init(PluginHost_t* host, StreamFrameInfo_t* stream_frame_info, const PluginParam_t* param)
+{
+    if (host == NULL)
+    {
+        return PLUGIN_ERROR_PARAM;
+    }
+    //value-initialized: zero, the atomics of the slots included
+    new (host) PluginHost_t();
+    if (param != NULL)
+    {
+        host->param = *param;
+    }
+    host->stream_frame_info = stream_frame_info;
+    for (int i = 0; i < PLUGIN_MAX; i++)
+    {
+        host->slots[i].pending.store(NULL);
+        host->slots[i].retired.store(NULL);
+        host->slots[i].running_since_us.store(0);
+    }
+    pthread_mutex_init(&host->mutex, NULL);
+    return PLUGIN_SUCCESS;
+}
+
+static void plugin_watch_stop(PluginHost_t* host)
+{
+    if (!host->watching)
+    {
+        return;
+    }
+    stop_request(&host->stop);
+    pthread_join(host->thread, NULL);
+    stop_token_release(&host->stop);
+    host->watching = 0;
+}
+
+void plugin_host_release(PluginHost_t* host)
+{
+    if (host == NULL)
+    {
+        return;
+    }
+    plugin_watch_stop(host);
+    for (int i = 0; i < host->slot_num; i++)
+    {
+        PluginSlot_t* slot = &host->slots[i];
+        plugin_instance_free(slot->pending.exchange(NULL));
+        plugin_instance_free(slot->retired.exchange(NULL));
+        plugin_instance_free(slot->current);
+        slot->current = NULL;
+    }
+    host->slot_num = 0;
+    pthread_mutex_destroy(&host->mutex);
+}
+
+static int plugin_host_slot(PluginHost_t* host, const char* path, const IrpPluginDesc_t* desc, const char* config, \
+    PluginInstance_t* instance)
+{
+    pthread_mutex_lock(&host->mutex);
+    if (host->slot_num == PLUGIN_MAX)
+    {
+        pthread_mutex_unlock(&host->mutex);
+        plugin_instance_free(instance);
+        return PLUGIN_ERROR_FULL;
+    }
+    int index = host->slot_num;
+    PluginSlot_t* slot = &host->slots[index];
+    slot->host = host;
+    slot->index = index;
+    snprintf(slot->name, sizeof(slot->name), "%s", (instance->desc->name != NULL) ? instance->desc->name : "plugin");
+    snprintf(slot->path, sizeof(slot->path), "%s", (path != NULL) ? path : "");
+    snprintf(slot->config, sizeof(slot->config), "%s", (config != NULL) ? config : "");
+    slot->linked = desc;
+    if (path != NULL)
+    {
+        plugin_file_stamp(path, &slot->stamp);
+    }
+    slot->stats.budget_us = instance->budget_us;
+    plugin_slot_publish(slot, instance);
+    //the watcher looks at the slots below slot_num
+    host->slot_num = index + 1;
+    pthread_mutex_unlock(&host->mutex);
+    return index;
+}
+
+int plugin_host_add(PluginHost_t* host, const char* path, const char* config)
+{
+    if (host == NULL || path == NULL || strlen(path) >= PLUGIN_PATH_LEN || \
+        (config != NULL && strlen(config) >= PLUGIN_CONFIG_LEN))
+    {
+        return PLUGIN_ERROR_PARAM;
+    }
+    PluginInstance_t* instance = NULL;
+    int ret = plugin_instance_load(path, config, &instance);
+    if (ret != PLUGIN_SUCCESS)
+    {
+        LOG(LOG_LEVEL_WARN, "plugin: %s did not load (%d)\n", path, ret);
+        return ret;
+    }
+    return plugin_host_slot(host, path, NULL, config, instance);
+}
+
+int plugin_host_add_desc(PluginHost_t* host, const IrpPluginDesc_t* desc, const char* config)
+{
+    if (host == NULL || desc == NULL || (config != NULL && strlen(config) >= PLUGIN_CONFIG_LEN))
+    {
+        return PLUGIN_ERROR_PARAM;
+    }
+    PluginInstance_t* instance = NULL;
+    int ret = plugin_instance_create(desc, NULL, config, &instance);
+    if (ret != PLUGIN_SUCCESS)
+    {
+        return ret;
+    }
+    return plugin_host_slot(host, NULL, desc, config, instance);
+}
+
+int plugin_host_reload(PluginHost_t* host, int index)
+{
+    if (host == NULL || index < 0 || index >= host->slot_num)
+    {
+        return PLUGIN_ERROR_PARAM;
+    }
+    PluginSlot_t* slot = &host->slots[index];
+    PluginInstance_t* instance = NULL;
+    int ret = (slot->linked != NULL) ? plugin_instance_create(slot->linked, NULL, slot->config, &instance) : \
+        plugin_instance_load(slot->path, slot->config, &instance);
+    pthread_mutex_lock(&host->mutex);
+    if (ret != PLUGIN_SUCCESS)
+    {
+        slot->stats.load_errors++;
+        pthread_mutex_unlock(&host->mutex);
+        return ret;
+    }
+    plugin_slot_publish(slot, instance);
+    pthread_mutex_unlock(&host->mutex);
+    return PLUGIN_SUCCESS;
+}
+
+static uint32_t plugin_image_format(PluginHost_t* host, const FramePlane_t* plane)
+{
+    if (plane->stride < plane->width * 2)
+    {
+        return IRP_FORMAT_Y8;
+    }
+    const StreamConfig_t* config = (host->stream_frame_info != NULL) ? host->stream_frame_info->config : NULL;
+    if (config == NULL)
+    {
+        return IRP_FORMAT_Y16;
+    }
+    switch (config->image_info.input_format)
+    {
+    case INPUT_FMT_Y14: return IRP_FORMAT_Y14;
+    case INPUT_FMT_YUV422: return IRP_FORMAT_YUYV;
+    case INPUT_FMT_Y8: return IRP_FORMAT_Y8;
+    default: return IRP_FORMAT_Y16;
+    }
+}
+
+static void plugin_view_plane(IrpPlane_t* dst, const FramePlane_t* plane, uint32_t format)
+{
+    if (plane->data == NULL || plane->byte_size == 0)
+    {
+        memset(dst, 0, sizeof(IrpPlane_t));
+        return;
+    }
+    dst->width = plane->width;
+    dst->height = plane->height;
+    dst->stride = plane->stride;
+    dst->format = format;
+    dst->data = plane->data;
+}
+
+static void plugin_print(const char* name, const IrpFrameView_t* view, const IrpOutputs_t* outputs)
+{
+    for (uint32_t i = 0; i < outputs->event_num; i++)
+    {
+        const IrpEvent_t* event = &outputs->events[i];
+        LOG(LOG_LEVEL_INFO, "plugin %s: event %d at (%d, %d) %.2f %.*s (frame %llu)\n", name, event->code, event->x, \
+            event->y, event->value, IRP_TEXT_LEN, event->text, (unsigned long long)view->seq);
+    }
+}
+
+//the node of one plug-in, on a pool worker. GRAPH_SUCCESS either way, a plug-in has no children
+static int plugin_node_run(const FrameDesc_t* desc, void* arg)
+{
+    PluginSlot_t* slot = (PluginSlot_t*)arg;
+    PluginHost_t* host = slot->host;
+    //a new instance starts with one budget of credit and no quarantine
+    PluginInstance_t* next = slot->pending.exchange(NULL, std::memory_order_acq_rel);
+    uint8_t loaded = (next != NULL);
+    if (loaded)
+    {
+        PluginInstance_t* old = slot->current;
+        slot->current = next;
+        slot->credit_us = 0;
+        slot->quarantine = 0;
+        //the watcher destroys it, or it is one nobody took since
+        plugin_instance_free(slot->retired.exchange(old, std::memory_order_acq_rel));
+    }
+    PluginInstance_t* instance = slot->current;
+    if (instance == NULL)
+    {
+        return GRAPH_SUCCESS;
+    }
+    int64_t budget = instance->budget_us;
+    slot->credit_us += budget;
+    slot->credit_us = (slot->credit_us > budget * PLUGIN_CREDIT_FRAMES) ? budget * PLUGIN_CREDIT_FRAMES : \
+        slot->credit_us;
+    uint8_t throttled = 0, quarantined = slot->quarantine, error = 0;
+    uint64_t cpu_us = 0;
+    if (!quarantined && slot->credit_us < 0)
+    {
+        throttled = 1;
+    }
+    else if (!quarantined)
+    {
+        IrpFrameView_t view;
+        view.struct_size = sizeof(IrpFrameView_t);
+        view.flags = ((desc->flags & FRAME_DESC_TEMP_INVALID) ? IRP_FRAME_TEMP_INVALID : 0) | \
+            ((desc->flags & FRAME_DESC_IMAGE_INVALID) ? IRP_FRAME_IMAGE_INVALID : 0) | \
+            ((desc->flags & FRAME_DESC_HDR_FUSED) ? IRP_FRAME_HDR : 0);
+        view.seq = desc->seq;
+        view.timestamp_us = desc->timestamp_us;
+        plugin_view_plane(&view.temp, &desc->temp, IRP_FORMAT_Y14);
+        plugin_view_plane(&view.image, &desc->image, plugin_image_format(host, &desc->image));
+        IrpFrameStats_t stats;
+        stats.temp = (desc->temp_stats != NULL && (desc->flags & FRAME_DESC_TEMP_STATS) && desc->temp_stats->valid) ? \
+            (const IrpPlaneStats_t*)desc->temp_stats : NULL;
+        stats.image = (desc->image_stats != NULL && (desc->flags & FRAME_DESC_IMAGE_STATS) && \
+            desc->image_stats->valid) ? (const IrpPlaneStats_t*)desc->image_stats : NULL;
+        IrpOutputs_t* outputs = &slot->outputs;
+        outputs->value_num = 0;
+        outputs->event_num = 0;
+
+        uint64_t start_us = get_monotonic_us();
+        uint64_t cpu_start = plugin_thread_cpu_us();
+        view.deadline_us = start_us + (uint64_t)slot->credit_us;
+        slot->running_since_us.store(start_us, std::memory_order_release);
+        int rst = instance->desc->on_frame(instance->state, &view, &stats, outputs);
+        slot->running_since_us.store(0, std::memory_order_release);
+        cpu_us = plugin_thread_cpu_us() - cpu_start;
+        uint64_t wall_us = get_monotonic_us() - start_us;
+        slot->credit_us -= (int64_t)cpu_us;
+        error = (rst < 0);
+        if (wall_us > plugin_hard_limit_us(instance->budget_us))
+        {
+            slot->quarantine = 1;
+            LOG(LOG_LEVEL_WARN, "plugin %s: a frame took %llu ms against a budget of %u us, quarantined until it is " \
+                "loaded again\n", slot->name, (unsigned long long)(wall_us / 1000), instance->budget_us);
+        }
+
+        outputs->value_num = (outputs->value_num > IRP_MAX_VALUES) ? IRP_MAX_VALUES : outputs->value_num;
+        outputs->event_num = (outputs->event_num > IRP_MAX_EVENTS) ? IRP_MAX_EVENTS : outputs->event_num;
+        if (!error && outputs->value_num + outputs->event_num > 0)
+        {
+            if (host->param.output_func != NULL)
+            {
+                host->param.output_func(slot->name, &view, outputs, host->param.output_arg);
+            }
+            else
+            {
+                plugin_print(slot->name, &view, outputs);
+            }
+        }
+    }
+    pthread_mutex_lock(&host->mutex);
+    PluginStats_t* stats = &slot->stats;
+    stats->frames++;
+    stats->runs += (!throttled && !quarantined);
+    stats->throttled += throttled;
+    stats->quarantined += quarantined;
+    stats->over_budget += (cpu_us > instance->budget_us);
+    stats->errors += error;
+    stats->loads += loaded;
+    stats->cpu_us += cpu_us;
+    stats->cpu_max_us = (cpu_us > stats->cpu_max_us) ? cpu_us : stats->cpu_max_us;
+    stats->budget_us = instance->budget_us;
+    stats->quarantine = slot->quarantine;
+    pthread_mutex_unlock(&host->mutex);
+    return GRAPH_SUCCESS;
+}
+
+int plugin_host_graph(PluginHost_t* host, Graph_t* graph, int parent)
+{
+    if (host == NULL || graph == NULL)
+    {
+        return PLUGIN_ERROR_PARAM;
+    }
+    for (int i = 0; i < host->slot_num; i++)
+    {
+        PluginSlot_t* slot = &host->slots[i];
+        PluginInstance_t* instance = slot->pending.load(std::memory_order_acquire);
+        const IrpPluginDesc_t* desc = (instance != NULL) ? instance->desc : slot->current->desc;
+        //node names are unique, a plug-in loaded twice is told apart by its index
+        if (graph_find(graph, slot->name) >= 0)
+        {
+            char name[12 + 1 + 11 + 1];     //the name's first 12 characters, '.' and any int
+            int len = snprintf(name, sizeof(name), "%.12s.%d", slot->name, i);
+            if (len < 0 || len >= GRAPH_NAME_LEN)
+            {
+                return PLUGIN_ERROR_PARAM;
+            }
+            memcpy(slot->name, name, len + 1);
+        }
+        uint32_t inputs = ((desc->inputs & IRP_INPUT_TEMP) ? GRAPH_PORT_TEMP : 0) | \
+            ((desc->inputs & IRP_INPUT_IMAGE) ? GRAPH_PORT_IMAGE : 0);
+        GraphStage_t stage = { slot->name, parent, inputs, 0, GRAPH_EDGE_LATEST, 0, GRAPH_THREAD_POOL, \
+            RT_ROLE_ANALYTICS, POOL_STAGE_OTHER, plugin_node_run, slot };
+        int ret = graph_add(graph, &stage);
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+    return PLUGIN_SUCCESS;
+}
+
+static void plugin_watch_slot(PluginHost_t* host, PluginSlot_t* slot)
+{
+    plugin_instance_free(slot->retired.exchange(NULL, std::memory_order_acq_rel));
+    uint64_t since_us = slot->running_since_us.load(std::memory_order_acquire);
+    pthread_mutex_lock(&host->mutex);
+    uint32_t budget_us = slot->stats.budget_us;
+    pthread_mutex_unlock(&host->mutex);
+    //a call that never returns holds its pool worker, nothing but a restart frees it
+    if (since_us != 0 && since_us != slot->reported_us && \
+        get_monotonic_us() - since_us > plugin_hard_limit_us(budget_us))
+    {
+        slot->reported_us = since_us;
+        LOG(LOG_LEVEL_WARN, "plugin %s: on_frame is running for %llu ms, quarantined once it returns\n", slot->name, \
+            (unsigned long long)((get_monotonic_us() - since_us) / 1000));
+    }
+    uint64_t stamp = 0;
+    if (slot->path[0] == '\0' || plugin_file_stamp(slot->path, &stamp) != 0 || stamp == slot->stamp)
+    {
+        return;
+    }
+    slot->stamp = stamp;
+    int ret = plugin_host_reload(host, slot->index);
+    if (ret != PLUGIN_SUCCESS)
+    {
+        LOG(LOG_LEVEL_WARN, "plugin %s: %s did not load (%d), the one before stays\n", slot->name, slot->path, ret);
+        return;
+    }
+    LOG(LOG_LEVEL_INFO, "plugin %s: %s loaded\n", slot->name, slot->path);
+}
+
+static void* plugin_watch_function(void* threadarg)
+{
+    PluginHost_t* host = (PluginHost_t*)threadarg;
+    rt_thread_enter(RT_ROLE_CONTROL, -1, "plugins");
+    while (!stop_token_wait(&host->stop, PLUGIN_POLL_MS))
+    {
+        for (int i = 0; i < host->slot_num; i++)
+        {
+            plugin_watch_slot(host, &host->slots[i]);
+        }
+    }
+    rt_thread_leave();
+    return NULL;
+}
+
+int plugin_host_watch(PluginHost_t* host)
+{
+    if (host == NULL || host->watching)
+    {
+        return PLUGIN_ERROR_PARAM;
+    }
+    if (stop_token_init(&host->stop) != STOP_SUCCESS)
+    {
+        return PLUGIN_ERROR_THREAD;
+    }
+    if (pthread_create(&host->thread, NULL, plugin_watch_function, host) != 0)
+    {
+        stop_token_release(&host->stop);
+        return PLUGIN_ERROR_THREAD;
+    }
+    host->watching = 1;
+    return PLUGIN_SUCCESS;
+}
+
+int plugin_stats(PluginHost_t* host, int index, PluginStats_t* stats)
+{
+    if (host == NULL || stats == NULL || index < 0 || index >= host->slot_num)
+    {
+        return PLUGIN_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&host->mutex);
+    *stats = host->slots[index].stats;
+    pthread_mutex_unlock(&host->mutex);
+    return PLUGIN_SUCCESS;
+}
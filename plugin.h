@@ -0,0 +1,128 @@
+#ifndef _PLUGIN_H_
+#define _PLUGIN_H_
+
+//the host of the analytics plug-ins of irplugin.h: every plug-in is a pool node of the camera's graph (graph.h) fed
+//over a GRAPH_EDGE_LATEST edge, so it runs on the frame's ring slot without a copy, a slow plug-in only ever misses
+//frames and never holds the ring or another branch. each plug-in declares a cpu budget per frame, the host meters
+//the thread cpu time of every call against it: the unused budget of calm frames is credit for a busy one, up to
+//PLUGIN_CREDIT_FRAMES budgets, and while the credit is spent the plug-in's frames are skipped as throttled. native
+//code cannot be stopped in the middle of a call, so the time limit is cooperative: the view's deadline says when
+//the budget is up, and a call still running past PLUGIN_HARD_LIMIT_FACTOR budgets quarantines the plug-in until it
+//is loaded again, its frames skipped. a plug-in file that changes is loaded on the watcher thread and swapped in
+//at the start of its node's next frame, the stream keeps running
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+#include "irplugin.h"
+#include "graph.h"
+#include "stop.h"
+
+#define PLUGIN_MAX 8
+#define PLUGIN_PATH_LEN 256
+#define PLUGIN_CONFIG_LEN 256
+#define PLUGIN_POLL_MS 1000             //the watcher looks at the files' mtime and size this often
+#define PLUGIN_DEFAULT_BUDGET_US 2000   //of a plug-in that declares none
+#define PLUGIN_CREDIT_FRAMES 8          //budgets of unused cpu time a plug-in may save up
+#define PLUGIN_HARD_LIMIT_FACTOR 20     //a call past this many budgets quarantines the plug-in
+#define PLUGIN_HARD_LIMIT_MIN_US 100000
+
+#define PLUGIN_SUCCESS 0
+#define PLUGIN_ERROR_PARAM -1
+#define PLUGIN_ERROR_LOAD -2            //dlopen or the describe symbol failed
+#define PLUGIN_ERROR_VERSION -3         //another IRP_ABI_VERSION_MAJOR, or a desc without on_frame
+#define PLUGIN_ERROR_FULL -4            //PLUGIN_MAX plug-ins
+#define PLUGIN_ERROR_INIT -5            //the plug-in's create failed
+#define PLUGIN_ERROR_THREAD -6
+#define PLUGIN_ERROR_UNAVAILABLE -7     //loading files is linux only, plugin_host_add_desc works everywhere
+
+//a plug-in's outputs of one frame, on its node's pool thread. outputs is valid during the call
+typedef void (*PluginOutputFunc_t)(const char* name, const IrpFrameView_t* view, const IrpOutputs_t* outputs, \
+    void* arg);
+
+typedef struct {
+    PluginOutputFunc_t output_func;     //NULL prints the events
+    void* output_arg;
+}PluginParam_t;
+
+typedef struct {
+    uint64_t frames;                    //the node got
+    uint64_t runs;                      //on_frame calls
+    uint64_t throttled;                 //skipped while the credit was spent
+    uint64_t over_budget;               //calls that took more cpu time than the budget
+    uint64_t errors;                    //on_frame returned an error
+    uint64_t quarantined;               //skipped after a call overran the hard limit
+    uint64_t loads;                     //instances swapped in, the first included
+    uint64_t load_errors;
+    uint64_t cpu_us;                    //of every call
+    uint64_t cpu_max_us;                //the slowest call
+    uint32_t budget_us;                 //of the current instance
+    uint8_t quarantine;                 //the current instance is quarantined
+}PluginStats_t;
+
+//one loaded plug-in: the library, its desc and the state create made
+typedef struct {
+    void* handle;                       //dlopen's, NULL for plugin_host_add_desc
+    const IrpPluginDesc_t* desc;
+    void* state;
+    uint32_t budget_us;
+}PluginInstance_t;
+
+struct PluginHost_t;
+
+typedef struct {
+    struct PluginHost_t* host;
+    int index;
+    char name[GRAPH_NAME_LEN];
+    char path[PLUGIN_PATH_LEN];         //"" for plugin_host_add_desc
+    char config[PLUGIN_CONFIG_LEN];
+    const IrpPluginDesc_t* linked;      //plugin_host_add_desc's
+    PluginInstance_t* current;          //the node's
+    std::atomic<PluginInstance_t*> pending;     //loaded, swapped in by the node's next frame
+    std::atomic<PluginInstance_t*> retired;     //swapped out, destroyed by the watcher or the next load
+    std::atomic<uint64_t> running_since_us;     //start of the call in progress, 0 between calls
+    int64_t credit_us;                  //the node's
+    uint8_t quarantine;
+    uint64_t reported_us;               //the watcher's: running_since_us of the overrun it printed last
+    uint64_t stamp;                     //the file's mtime and size at the last load
+    IrpOutputs_t outputs;
+    PluginStats_t stats;
+}PluginSlot_t;
+
+typedef struct PluginHost_t {
+    PluginParam_t param;
+    StreamFrameInfo_t* stream_frame_info;
+    PluginSlot_t slots[PLUGIN_MAX];
+    int slot_num;
+    pthread_mutex_t mutex;              //loads and stats
+    //plugin_host_watch
+    StopToken_t stop;
+    pthread_t thread;
+    uint8_t watching;
+}PluginHost_t;
+
+//stream_frame_info gives the planes' formats, param may be NULL
+int plugin_host_init(PluginHost_t* host, StreamFrameInfo_t* stream_frame_info, const PluginParam_t* param);
+
+//stops the watcher and destroys every instance, after graph_stop
+void plugin_host_release(PluginHost_t* host);
+
+//load the shared object at path and create its state with config (NULL without), returns the plug-in's index
+int plugin_host_add(PluginHost_t* host, const char* path, const char* config);
+
+//a plug-in linked into the program, the same as a file's but never reloaded
+int plugin_host_add_desc(PluginHost_t* host, const IrpPluginDesc_t* desc, const char* config);
+
+//load plug-in index's file again, it is swapped in by the node's next frame and its quarantine lifted. nothing
+//changes when the file fails to load
+int plugin_host_reload(PluginHost_t* host, int index);
+
+//one pool node per plug-in under parent (GRAPH_SOURCE for the ring), named after the plug-in, before graph_attach
+int plugin_host_graph(PluginHost_t* host, Graph_t* graph, int parent);
+
+//reload the files whose mtime or size changed and report calls past the hard limit, every PLUGIN_POLL_MS on a
+//thread of its own
+int plugin_host_watch(PluginHost_t* host);
+
+int plugin_stats(PluginHost_t* host, int index, PluginStats_t* stats);
+
+#endif
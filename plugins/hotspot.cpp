@@ -0,0 +1,137 @@
+//example analytics plug-in of irplugin.h: the pixels of the temp plane above a threshold, an event on the frame the
+//hot area grows past min_area and another when it is gone. built on its own against irplugin.h only:
+//    g++ -O2 -fPIC -shared -o libirplugin_hotspot.so plugins/hotspot.cpp -I.
+//config "<celsius> [min_area]", 60 and 20 pixels without
+#include "irplugin.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define HOTSPOT_DEFAULT_CELSIUS 60.0f
+#define HOTSPOT_DEFAULT_AREA 20
+#define HOTSPOT_EVENT_RAISE 1
+#define HOTSPOT_EVENT_CLEAR 2
+#define HOTSPOT_CHECK_ROWS 16           //rows between looks at the deadline
+
+typedef struct {
+    uint16_t threshold;                 //1/64 K
+    uint32_t min_area;
+    uint8_t raised;
+}Hotspot_t;
+
+static uint64_t hotspot_now_us(void)
+{
+#if defined(_WIN32)
+    return 0;                           //windows: the deadline is not looked at
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static int hotspot_create(const char* config, void** state)
+{
+    Hotspot_t* hotspot = (Hotspot_t*)calloc(1, sizeof(Hotspot_t));
+    if (hotspot == NULL)
+    {
+        return -1;
+    }
+    float celsius = HOTSPOT_DEFAULT_CELSIUS;
+    int area = HOTSPOT_DEFAULT_AREA;
+    if (config != NULL && sscanf(config, "%f %d", &celsius, &area) < 1)
+    {
+        free(hotspot);
+        return -1;
+    }
+    hotspot->threshold = (uint16_t)((celsius + 273.15f) * 64.0f);
+    hotspot->min_area = (area > 0) ? (uint32_t)area : 1;
+    *state = hotspot;
+    return IRP_SUCCESS;
+}
+
+static void hotspot_destroy(void* state)
+{
+    free(state);
+}
+
+static void hotspot_event(IrpOutputs_t* outputs, int code, int x, int y, float value, const char* text)
+{
+    if (outputs->event_num == IRP_MAX_EVENTS)
+    {
+        return;
+    }
+    IrpEvent_t* event = &outputs->events[outputs->event_num++];
+    event->code = code;
+    event->x = x;
+    event->y = y;
+    event->value = value;
+    snprintf(event->text, sizeof(event->text), "%s", text);
+}
+
+static int hotspot_on_frame(void* state, const IrpFrameView_t* view, const IrpFrameStats_t* stats, \
+    IrpOutputs_t* outputs)
+{
+    Hotspot_t* hotspot = (Hotspot_t*)state;
+    if (view->temp.format != IRP_FORMAT_Y14 || (view->flags & IRP_FRAME_TEMP_INVALID))
+    {
+        return IRP_SUCCESS;
+    }
+    //the shared statistics answer a frame with nothing hot without a look at the pixels
+    uint32_t area = 0;
+    int hot_x = -1, hot_y = -1;
+    if (stats->temp == NULL || stats->temp->max_val >= hotspot->threshold)
+    {
+        const uint8_t* row = (const uint8_t*)view->temp.data;
+        for (uint32_t y = 0; y < view->temp.height; y++, row += view->temp.stride)
+        {
+            const uint16_t* pixel = (const uint16_t*)row;
+            for (uint32_t x = 0; x < view->temp.width; x++)
+            {
+                if (pixel[x] >= hotspot->threshold)
+                {
+                    hot_x = (hot_x < 0) ? (int)x : hot_x;
+                    hot_y = (hot_y < 0) ? (int)y : hot_y;
+                    area++;
+                }
+            }
+            //out of time: the frame is not finished, nothing is reported for it
+            if ((y % HOTSPOT_CHECK_ROWS) == HOTSPOT_CHECK_ROWS - 1 && hotspot_now_us() > view->deadline_us)
+            {
+                return IRP_SUCCESS;
+            }
+        }
+    }
+    outputs->values[0].value = (double)area;
+    snprintf(outputs->values[0].name, sizeof(outputs->values[0].name), "hot_pixels");
+    outputs->value_num = 1;
+    float max_celsius = (stats->temp != NULL) ? stats->temp->max_val / 64.0f - 273.15f : 0.0f;
+    if (!hotspot->raised && area >= hotspot->min_area)
+    {
+        hotspot->raised = 1;
+        hotspot_event(outputs, HOTSPOT_EVENT_RAISE, hot_x, hot_y, max_celsius, "hot spot");
+    }
+    else if (hotspot->raised && area == 0)
+    {
+        hotspot->raised = 0;
+        hotspot_event(outputs, HOTSPOT_EVENT_CLEAR, -1, -1, max_celsius, "hot spot gone");
+    }
+    return IRP_SUCCESS;
+}
+
+static const IrpPluginDesc_t hotspot_desc = {
+    sizeof(IrpPluginDesc_t),
+    IRP_ABI_VERSION,
+    IRP_INPUT_TEMP,
+    1000,
+    "hotspot",
+    hotspot_create,
+    hotspot_destroy,
+    hotspot_on_frame,
+};
+
+extern "C" IRP_EXPORT const IrpPluginDesc_t* irp_plugin_describe(void)
+{
+    return &hotspot_desc;
+}
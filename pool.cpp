@@ -0,0 +1,429 @@
+#include "pool.h"
+#include "data.h"
+#include "rtsched.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(linux) || defined(unix)
+#include <time.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+    pthread_mutex_t mutex;
+    PoolTask_t tasks[POOL_QUEUE_DEPTH];
+    uint32_t head;                      //thieves take from the head (oldest)
+    uint32_t count;                     //the owner pushes and pops at head + count (newest)
+}PoolDeque_t;
+
+typedef struct {
+    PoolDeque_t deque;
+    pthread_t thread;
+    int index;
+}PoolWorker_t;
+
+typedef struct {
+    std::atomic<uint64_t> tasks;
+    std::atomic<uint64_t> cpu_us;
+    std::atomic<uint64_t> wall_us;
+}PoolStageCounter_t;
+
+static PoolWorker_t pool_workers[POOL_MAX_WORKERS];
+static int pool_worker_cnt = 0;
+static std::atomic<int> pool_running(0);
+static std::atomic<int> pool_pending(0);   //tasks in the deques
+static std::atomic<int> pool_active(0);    //tasks being run
+static std::atomic<uint32_t> pool_next_deque(0);
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;        //workers: new task
+static pthread_cond_t pool_idle_cond = PTHREAD_COND_INITIALIZER;   //pool_release: queue drained
+static thread_local int pool_worker_index = -1;
+static std::atomic<uint64_t> pool_signal_us(0);    //the last signal of pool_cond, for the workers' wakeup latency
+static PoolStageCounter_t pool_stage_counter[POOL_STAGE_NUM];
+
+static const char* pool_stage_names[POOL_STAGE_NUM] = {
+    "cut",
+    "stats",
+    "display",
+    "temperature",
+    "encode",
+    "record",
+    "other",
+};
+
+static uint64_t pool_thread_cpu_us(void)
+{
+#if defined(_WIN32)
+    FILETIME create_time, exit_time, kernel_time, user_time;
+    GetThreadTimes(GetCurrentThread(), &create_time, &exit_time, &kernel_time, &user_time);
+    uint64_t kernel = ((uint64_t)kernel_time.dwHighDateTime << 32) | kernel_time.dwLowDateTime;
+    uint64_t user = ((uint64_t)user_time.dwHighDateTime << 32) | user_time.dwLowDateTime;
+    return (kernel + user) / 10;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static int pool_core_num(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long num = sysconf(_SC_NPROCESSORS_ONLN);
+    return (num > 0) ? (int)num : 1;
+#endif
+}
+
+static void pool_task_run(const PoolTask_t* task)
+{
+    uint64_t cpu_start = pool_thread_cpu_us();
+    uint64_t wall_start = get_monotonic_us();
+    task->func(task->arg);
+    if (task->stage >= 0 && task->stage < POOL_STAGE_NUM)
+    {
+        PoolStageCounter_t* counter = &pool_stage_counter[task->stage];
+        counter->tasks.fetch_add(1, std::memory_order_relaxed);
+        counter->cpu_us.fetch_add(pool_thread_cpu_us() - cpu_start, std::memory_order_relaxed);
+        counter->wall_us.fetch_add(get_monotonic_us() - wall_start, std::memory_order_relaxed);
+    }
+}
+
+static int pool_deque_push(PoolDeque_t* deque, const PoolTask_t* task)
+{
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count == POOL_QUEUE_DEPTH)
+    {
+        pthread_mutex_unlock(&deque->mutex);
+        return 0;
+    }
+    deque->tasks[(deque->head + deque->count) % POOL_QUEUE_DEPTH] = *task;
+    deque->count++;
+    pthread_mutex_unlock(&deque->mutex);
+    return 1;
+}
+
+//the owner takes its newest task (still warm in cache), a thief the oldest one
+static int pool_deque_pop(PoolDeque_t* deque, int steal, PoolTask_t* task)
+{
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count == 0)
+    {
+        pthread_mutex_unlock(&deque->mutex);
+        return 0;
+    }
+    if (steal)
+    {
+        *task = deque->tasks[deque->head];
+        deque->head = (deque->head + 1) % POOL_QUEUE_DEPTH;
+    }
+    else
+    {
+        *task = deque->tasks[(deque->head + deque->count - 1) % POOL_QUEUE_DEPTH];
+    }
+    deque->count--;
+    pthread_mutex_unlock(&deque->mutex);
+    return 1;
+}
+
+static int pool_task_take(int index, PoolTask_t* task)
+{
+    if (pool_deque_pop(&pool_workers[index].deque, 0, task))
+    {
+        return 1;
+    }
+    for (int i = 1; i < pool_worker_cnt; i++)
+    {
+        if (pool_deque_pop(&pool_workers[(index + i) % pool_worker_cnt].deque, 1, task))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void* pool_worker(void* threadarg)
+{
+    PoolWorker_t* worker = (PoolWorker_t*)threadarg;
+    pool_worker_index = worker->index;
+    char rt_name[RT_NAME_LEN];
+    snprintf(rt_name, sizeof(rt_name), "pool%d", worker->index);
+    rt_thread_enter(RT_ROLE_ANALYTICS, -1, rt_name);
+    while (1)
+    {
+        PoolTask_t task;
+        //active is raised before pending drops, so pool_release never sees both at 0 mid task
+        pool_active++;
+        if (pool_task_take(worker->index, &task))
+        {
+            pool_pending--;
+            pool_task_run(&task);
+            pool_active--;
+            continue;
+        }
+        pool_active--;
+
+        pthread_mutex_lock(&pool_mutex);
+        if (pool_pending == 0 && pool_active == 0)
+        {
+            pthread_cond_broadcast(&pool_idle_cond);
+        }
+        if (!pool_running && pool_pending == 0)
+        {
+            pthread_mutex_unlock(&pool_mutex);
+            break;
+        }
+        if (pool_pending == 0)
+        {
+            pthread_cond_wait(&pool_cond, &pool_mutex);
+            if (pool_pending > 0)
+            {
+                rt_wakeup_record_since(pool_signal_us.load(std::memory_order_relaxed));
+            }
+        }
+        pthread_mutex_unlock(&pool_mutex);
+    }
+    rt_thread_leave();
+    return NULL;
+}
+
+int pool_init(int worker_num)
+{
+    pthread_mutex_lock(&pool_mutex);
+    if (pool_running)
+    {
+        pthread_mutex_unlock(&pool_mutex);
+        return POOL_SUCCESS;
+    }
+    if (worker_num <= 0)
+    {
+        worker_num = pool_core_num();
+    }
+    if (worker_num > POOL_MAX_WORKERS)
+    {
+        worker_num = POOL_MAX_WORKERS;
+    }
+    pool_running = 1;
+    pool_worker_cnt = 0;
+    for (int i = 0; i < worker_num; i++)
+    {
+        PoolWorker_t* worker = &pool_workers[i];
+        pthread_mutex_init(&worker->deque.mutex, NULL);
+        worker->deque.head = 0;
+        worker->deque.count = 0;
+        worker->index = i;
+        if (pthread_create(&worker->thread, NULL, pool_worker, worker) != 0)
+        {
+            pthread_mutex_destroy(&worker->deque.mutex);
+            break;
+        }
+        pool_worker_cnt++;
+    }
+    if (pool_worker_cnt == 0)
+    {
+        pool_running = 0;
+        pthread_mutex_unlock(&pool_mutex);
+        return POOL_ERROR_PARAM;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    printf("task pool: %d workers\n", pool_worker_cnt);
+    return POOL_SUCCESS;
+}
+
+void pool_release(void)
+{
+    pthread_mutex_lock(&pool_mutex);
+    if (!pool_running)
+    {
+        pthread_mutex_unlock(&pool_mutex);
+        return;
+    }
+    //strands resubmit themselves, wait until nothing is queued or running
+    while (pool_pending > 0 || pool_active > 0)
+    {
+        pthread_cond_broadcast(&pool_cond);
+        pthread_cond_wait(&pool_idle_cond, &pool_mutex);
+    }
+    pool_running = 0;
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_mutex);
+
+    for (int i = 0; i < pool_worker_cnt; i++)
+    {
+        pthread_join(pool_workers[i].thread, NULL);
+        pthread_mutex_destroy(&pool_workers[i].deque.mutex);
+    }
+    pool_worker_cnt = 0;
+}
+
+int pool_worker_num(void)
+{
+    return pool_running ? pool_worker_cnt : 0;
+}
+
+static int pool_task_push(const PoolTask_t* task)
+{
+    if (!pool_running)
+    {
+        return 0;
+    }
+    int start = (pool_worker_index >= 0) ? pool_worker_index : (int)(pool_next_deque++ % pool_worker_cnt);
+    for (int i = 0; i < pool_worker_cnt; i++)
+    {
+        if (pool_deque_push(&pool_workers[(start + i) % pool_worker_cnt].deque, task))
+        {
+            pool_pending++;
+            pthread_mutex_lock(&pool_mutex);
+            pool_signal_us.store(get_monotonic_us(), std::memory_order_relaxed);
+            pthread_cond_signal(&pool_cond);
+            pthread_mutex_unlock(&pool_mutex);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int pool_submit(PoolStage_t stage, PoolFunc_t func, void* arg)
+{
+    if (func == NULL)
+    {
+        return POOL_ERROR_PARAM;
+    }
+    PoolTask_t task = { func, arg, stage };
+    //no pool or every deque full: run it here
+    if (!pool_task_push(&task))
+    {
+        pool_task_run(&task);
+    }
+    return POOL_SUCCESS;
+}
+
+void pool_strand_init(PoolStrand_t* strand)
+{
+    memset(strand->tasks, 0, sizeof(strand->tasks));
+    pthread_mutex_init(&strand->mutex, NULL);
+    pthread_cond_init(&strand->cond, NULL);
+    strand->head = 0;
+    strand->count = 0;
+    strand->scheduled = 0;
+}
+
+void pool_strand_destroy(PoolStrand_t* strand)
+{
+    pool_strand_wait(strand);
+    pthread_mutex_destroy(&strand->mutex);
+    pthread_cond_destroy(&strand->cond);
+}
+
+//runs the strand's oldest task, then requeues itself so other strands get their turn
+static void pool_strand_run(void* arg)
+{
+    PoolStrand_t* strand = (PoolStrand_t*)arg;
+    pthread_mutex_lock(&strand->mutex);
+    PoolTask_t task = strand->tasks[strand->head];
+    pthread_mutex_unlock(&strand->mutex);
+
+    pool_task_run(&task);
+
+    pthread_mutex_lock(&strand->mutex);
+    strand->head = (strand->head + 1) % POOL_STRAND_DEPTH;
+    strand->count--;
+    int more = (strand->count > 0);
+    if (!more)
+    {
+        strand->scheduled = 0;
+        pthread_cond_broadcast(&strand->cond);
+    }
+    pthread_mutex_unlock(&strand->mutex);
+    if (more)
+    {
+        PoolTask_t next = { pool_strand_run, strand, POOL_STAGE_NUM };
+        if (!pool_task_push(&next))
+        {
+            pool_strand_run(strand);
+        }
+    }
+}
+
+int pool_strand_submit(PoolStrand_t* strand, PoolStage_t stage, PoolFunc_t func, void* arg)
+{
+    if (strand == NULL || func == NULL)
+    {
+        return POOL_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&strand->mutex);
+    if (strand->count == POOL_STRAND_DEPTH)
+    {
+        pthread_mutex_unlock(&strand->mutex);
+        return POOL_ERROR_FULL;
+    }
+    PoolTask_t task = { func, arg, stage };
+    strand->tasks[(strand->head + strand->count) % POOL_STRAND_DEPTH] = task;
+    strand->count++;
+    int schedule = !strand->scheduled;
+    strand->scheduled = 1;
+    pthread_mutex_unlock(&strand->mutex);
+
+    if (schedule)
+    {
+        //the strand task itself is not accounted, the stage of each task inside it is
+        PoolTask_t run = { pool_strand_run, strand, POOL_STAGE_NUM };
+        if (!pool_task_push(&run))
+        {
+            pool_strand_run(strand);
+        }
+    }
+    return POOL_SUCCESS;
+}
+
+void pool_strand_wait(PoolStrand_t* strand)
+{
+    pthread_mutex_lock(&strand->mutex);
+    while (strand->scheduled)
+    {
+        pthread_cond_wait(&strand->cond, &strand->mutex);
+    }
+    pthread_mutex_unlock(&strand->mutex);
+}
+
+int pool_stage_stats(PoolStage_t stage, PoolStageStats_t* stats)
+{
+    if (stage < 0 || stage >= POOL_STAGE_NUM || stats == NULL)
+    {
+        return POOL_ERROR_PARAM;
+    }
+    stats->tasks = pool_stage_counter[stage].tasks.load(std::memory_order_relaxed);
+    stats->cpu_us = pool_stage_counter[stage].cpu_us.load(std::memory_order_relaxed);
+    stats->wall_us = pool_stage_counter[stage].wall_us.load(std::memory_order_relaxed);
+    return POOL_SUCCESS;
+}
+
+const char* pool_stage_name(PoolStage_t stage)
+{
+    if (stage < 0 || stage >= POOL_STAGE_NUM)
+    {
+        return "unknown";
+    }
+    return pool_stage_names[stage];
+}
+
+void pool_stats_dump(void)
+{
+    printf("%-16s %10s %12s %12s %10s\n", "pool stage", "tasks", "cpu(ms)", "wall(ms)", "cpu/task(us)");
+    for (int stage = 0; stage < POOL_STAGE_NUM; stage++)
+    {
+        PoolStageStats_t stats;
+        pool_stage_stats((PoolStage_t)stage, &stats);
+        if (stats.tasks == 0)
+        {
+            continue;
+        }
+        printf("%-16s %10llu %12.1f %12.1f %10llu\n", pool_stage_names[stage], (unsigned long long)stats.tasks, \
+            stats.cpu_us / 1000.0, stats.wall_us / 1000.0, (unsigned long long)(stats.cpu_us / stats.tasks));
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define POOL_MAX_WORKERS 16
+#define POOL_QUEUE_DEPTH 256            //tasks per worker deque
+#define POOL_STRAND_DEPTH 8             //tasks waiting in one strand, per camera that is frames in flight
+
+#define POOL_SUCCESS 0
+#define POOL_ERROR_PARAM -1
+#define POOL_ERROR_FULL -2
+
+//per frame stages, every task is accounted to one of them
+typedef enum
+{
+    POOL_STAGE_CUT = 0,
+    POOL_STAGE_STATS,
+    POOL_STAGE_DISPLAY,                 //enhance/colorize/transform
+    POOL_STAGE_TEMPERATURE,             //point/line/roi temperatures
+    POOL_STAGE_ENCODE,
+    POOL_STAGE_RECORD,                  //raw frames into the recording container
+    POOL_STAGE_OTHER,
+    POOL_STAGE_NUM,
+}PoolStage_t;
+
+typedef void (*PoolFunc_t)(void* arg);
+
+typedef struct {
+    PoolFunc_t func;
+    void* arg;
+    PoolStage_t stage;
+}PoolTask_t;
+
+//tasks submitted to one strand run one at a time in submission order, on any worker
+//one strand per camera and stage keeps the camera's frames in order while cameras run in parallel
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    PoolTask_t tasks[POOL_STRAND_DEPTH];
+    uint32_t head;
+    uint32_t count;
+    int scheduled;                      //a worker owns the strand until it is empty
+}PoolStrand_t;
+
+typedef struct {
+    uint64_t tasks;
+    uint64_t cpu_us;                    //thread cpu time spent in the stage's tasks
+    uint64_t wall_us;
+}PoolStageStats_t;
+
+//start worker_num workers, 0 uses the number of cores. without a pool every task runs inline in the caller
+int pool_init(int worker_num);
+
+//run every queued task, then stop the workers
+void pool_release(void);
+
+int pool_worker_num(void);
+
+//queue an independent task. from a worker it goes to the worker's own deque, idle workers steal from it
+int pool_submit(PoolStage_t stage, PoolFunc_t func, void* arg);
+
+void pool_strand_init(PoolStrand_t* strand);
+
+void pool_strand_destroy(PoolStrand_t* strand);
+
+//queue an ordered task, POOL_ERROR_FULL when POOL_STRAND_DEPTH tasks are already waiting
+int pool_strand_submit(PoolStrand_t* strand, PoolStage_t stage, PoolFunc_t func, void* arg);
+
+//wait until every task of the strand has run
+void pool_strand_wait(PoolStrand_t* strand);
+
+int pool_stage_stats(PoolStage_t stage, PoolStageStats_t* stats);
+
+const char* pool_stage_name(PoolStage_t stage);
+
+//print the tasks and cpu time of every stage that ran
+void pool_stats_dump(void);
+
+#endif
@@ -0,0 +1,232 @@
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+#include "simd.h"
+
+int profile_engine_init(ProfileEngine_t* engine, TempDataRes_t temp_res)
+{
+    if (engine == NULL || temp_res.width == 0 || temp_res.height == 0)
+    {
+        return PROFILE_ERROR_PARAM;
+    }
+    memset(engine, 0, sizeof(ProfileEngine_t));
+    engine->temp_res = temp_res;
+    return PROFILE_SUCCESS;
+}
+
+void profile_engine_release(ProfileEngine_t* engine)
+{
+    if (engine == NULL)
+    {
+        return;
+    }
+    free(engine->index);
+    free(engine->weight);
+    free(engine->points);
+    free(engine->profile);
+    engine->index = NULL;
+    engine->weight = NULL;
+    engine->points = NULL;
+    engine->profile = NULL;
+    engine->sample_num = 0;
+    engine->line_num = 0;
+}
+
+void profile_engine_clear(ProfileEngine_t* engine)
+{
+    if (engine != NULL)
+    {
+        engine->line_num = 0;
+        engine->sample_num = 0;
+    }
+}
+
+//the 4 taps of sample i: 256 * x + fx, 256 * y + fy in the frame
+static void profile_taps_set(ProfileEngine_t* engine, int i, int px, int py)
+{
+    int width = engine->temp_res.width, height = engine->temp_res.height;
+    int num = engine->sample_num;
+    int x0 = px >> 8, y0 = py >> 8;
+    int fx = px & 255, fy = py & 255;
+    int x1 = (x0 + 1 < width) ? x0 + 1 : x0;
+    int y1 = (y0 + 1 < height) ? y0 + 1 : y0;
+    //the corner weight rounded, the others from it, so every row and column keeps its share exactly
+    int w11 = (fx * fy + 128) >> 8;
+    engine->index[i] = (uint32_t)(y0 * width + x0);
+    engine->index[num + i] = (uint32_t)(y0 * width + x1);
+    engine->index[2 * num + i] = (uint32_t)(y1 * width + x0);
+    engine->index[3 * num + i] = (uint32_t)(y1 * width + x1);
+    engine->weight[i] = (uint16_t)(256 - fx - fy + w11);
+    engine->weight[num + i] = (uint16_t)(fx - w11);
+    engine->weight[2 * num + i] = (uint16_t)(fy - w11);
+    engine->weight[3 * num + i] = (uint16_t)w11;
+    engine->points[i].x = (px + 128) >> 8;
+    engine->points[i].y = (py + 128) >> 8;
+    engine->points[i].x = (engine->points[i].x < width) ? engine->points[i].x : width - 1;
+    engine->points[i].y = (engine->points[i].y < height) ? engine->points[i].y : height - 1;
+}
+
+int profile_engine_add_line(ProfileEngine_t* engine, Line_t line, ProfileSample_t sample)
+{
+    if (engine == NULL || engine->temp_res.width == 0 || \
+        (sample != PROFILE_SAMPLE_NEAREST && sample != PROFILE_SAMPLE_LINEAR))
+    {
+        return PROFILE_ERROR_PARAM;
+    }
+    int width = engine->temp_res.width, height = engine->temp_res.height;
+    if (line.start_x < 0 || line.start_x >= width || line.end_x < 0 || line.end_x >= width || \
+        line.start_y < 0 || line.start_y >= height || line.end_y < 0 || line.end_y >= height)
+    {
+        return PROFILE_ERROR_PARAM;
+    }
+    if (engine->line_num >= PROFILE_MAX_LINES)
+    {
+        return PROFILE_ERROR_FULL;
+    }
+    int dx = abs(line.end_x - line.start_x), dy = abs(line.end_y - line.start_y);
+    int line_num = ((dx > dy) ? dx : dy) + 1;
+
+    //the tap planes are strided by the sample count, the old samples move to the new stride
+    int old_num = engine->sample_num, num = old_num + line_num;
+    uint32_t* index = (uint32_t*)malloc((size_t)num * 4 * sizeof(uint32_t));
+    uint16_t* weight = (uint16_t*)malloc((size_t)num * 4 * sizeof(uint16_t));
+    Dot_t* points = (Dot_t*)realloc(engine->points, (size_t)num * sizeof(Dot_t));
+    if (points != NULL)
+    {
+        engine->points = points;
+    }
+    uint16_t* profile = (uint16_t*)realloc(engine->profile, (size_t)num * sizeof(uint16_t));
+    if (profile != NULL)
+    {
+        engine->profile = profile;
+    }
+    if (index == NULL || weight == NULL || points == NULL || profile == NULL)
+    {
+        free(index);
+        free(weight);
+        return PROFILE_ERROR_MEM;
+    }
+    for (int k = 0; k < 4 && old_num > 0; k++)
+    {
+        memcpy(index + k * num, engine->index + k * old_num, old_num * sizeof(uint32_t));
+        memcpy(weight + k * num, engine->weight + k * old_num, old_num * sizeof(uint16_t));
+    }
+    free(engine->index);
+    free(engine->weight);
+    engine->index = index;
+    engine->weight = weight;
+    engine->sample_num = num;
+
+    if (sample == PROFILE_SAMPLE_NEAREST)
+    {
+        int sx = (line.start_x < line.end_x) ? 1 : -1, sy = (line.start_y < line.end_y) ? 1 : -1;
+        int err = dx - dy;
+        int x = line.start_x, y = line.start_y;
+        for (int i = old_num; i < num; i++)
+        {
+            profile_taps_set(engine, i, x << 8, y << 8);
+            int e2 = 2 * err;
+            if (e2 > -dy)
+            {
+                err -= dy;
+                x += sx;
+            }
+            if (e2 < dx)
+            {
+                err += dx;
+                y += sy;
+            }
+        }
+    }
+    else
+    {
+        int steps = line_num - 1;
+        int sx = (line.start_x < line.end_x) ? 1 : -1, sy = (line.start_y < line.end_y) ? 1 : -1;
+        for (int i = 0; i < line_num; i++)
+        {
+            //rounded to 1/256 pixel, exact at both ends
+            int px = line.start_x * 256, py = line.start_y * 256;
+            if (steps > 0)
+            {
+                px += sx * (int)(((int64_t)dx * 512 * i + steps) / (2 * steps));
+                py += sy * (int)(((int64_t)dy * 512 * i + steps) / (2 * steps));
+            }
+            profile_taps_set(engine, old_num + i, px, py);
+        }
+    }
+
+    ProfileLine_t* profile_line = &engine->lines[engine->line_num];
+    profile_line->line = line;
+    profile_line->sample = sample;
+    profile_line->offset = old_num;
+    profile_line->num = line_num;
+    return engine->line_num++;
+}
+
+int profile_engine_process(ProfileEngine_t* engine, const uint16_t* temp_data, TempInfo_t* temp_info)
+{
+    if (engine == NULL || temp_data == NULL)
+    {
+        return PROFILE_ERROR_PARAM;
+    }
+    if (engine->sample_num == 0)
+    {
+        return PROFILE_SUCCESS;
+    }
+    uint32_t src_len = (uint32_t)engine->temp_res.width * engine->temp_res.height;
+    simd_gather_weight4_u16(temp_data, src_len, engine->index, engine->weight, engine->sample_num, engine->profile);
+    if (temp_info == NULL)
+    {
+        return PROFILE_SUCCESS;
+    }
+    for (int l = 0; l < engine->line_num; l++)
+    {
+        const ProfileLine_t* profile_line = &engine->lines[l];
+        const uint16_t* profile = engine->profile + profile_line->offset;
+        int num = profile_line->num;
+        uint16_t min_val = 0, max_val = 0;
+        simd_minmax_u16(profile, num, &min_val, &max_val);
+        uint32_t sum = 0;
+        int max_i = 0, min_i = 0;
+        for (int i = 0; i < num; i++)
+        {
+            sum += profile[i];
+        }
+        for (int i = num - 1; i >= 0; i--)
+        {
+            if (profile[i] == max_val)
+            {
+                max_i = i;
+                break;
+            }
+        }
+        for (int i = num - 1; i >= 0; i--)
+        {
+            if (profile[i] == min_val)
+            {
+                min_i = i;
+                break;
+            }
+        }
+        TempInfo_t* info = &temp_info[l];
+        info->max_temp = max_val;
+        info->min_temp = min_val;
+        info->avr_temp = (uint16_t)((sum + num / 2) / num);
+        info->max_cord = engine->points[profile_line->offset + max_i];
+        info->min_cord = engine->points[profile_line->offset + min_i];
+    }
+    return PROFILE_SUCCESS;
+}
+
+const uint16_t* profile_engine_profile(const ProfileEngine_t* engine, int index, int* num)
+{
+    if (engine == NULL || index < 0 || index >= engine->line_num)
+    {
+        return NULL;
+    }
+    if (num != NULL)
+    {
+        *num = engine->lines[index].num;
+    }
+    return engine->profile + engine->lines[index].offset;
+}
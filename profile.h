@@ -0,0 +1,57 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+//temperature profiles along lines: each line is sampled once into gather indices and weights, every frame then
+//gathers the samples of all lines in one simd_gather_weight4_u16 pass. each line gives its whole profile and the
+//max/min/avr of it. the values are the temp plane's own, not the 3x3 filtered ones get_line_temp reports
+#include <stdint.h>
+#include "libirtemp.h"
+
+#define PROFILE_MAX_LINES 64
+
+#define PROFILE_SUCCESS 0
+#define PROFILE_ERROR_PARAM -1
+#define PROFILE_ERROR_FULL -2
+#define PROFILE_ERROR_MEM -3
+
+typedef enum {
+    PROFILE_SAMPLE_NEAREST = 0,         //the bresenham pixels from start to end
+    PROFILE_SAMPLE_LINEAR,              //as many points evenly spaced from start to end, bilinear between 4 pixels
+}ProfileSample_t;
+
+typedef struct {
+    Line_t line;
+    ProfileSample_t sample;
+    int offset;                         //the line's first sample in the engine's arrays
+    int num;                            //max(|dx|, |dy|) + 1 samples
+}ProfileLine_t;
+
+typedef struct {
+    TempDataRes_t temp_res;
+    int line_num;
+    ProfileLine_t lines[PROFILE_MAX_LINES];
+    int sample_num;
+    uint32_t* index;                    //4 * sample_num, tap k of sample i at k * sample_num + i
+    uint16_t* weight;                   //the same layout, Q8 summing to 256
+    Dot_t* points;                      //the pixel nearest each sample
+    uint16_t* profile;                  //the samples of the last frame
+}ProfileEngine_t;
+
+int profile_engine_init(ProfileEngine_t* engine, TempDataRes_t temp_res);
+
+void profile_engine_release(ProfileEngine_t* engine);
+
+//drop every line
+void profile_engine_clear(ProfileEngine_t* engine);
+
+//register a line inside the frame, returns its index or an error code
+int profile_engine_add_line(ProfileEngine_t* engine, Line_t line, ProfileSample_t sample);
+
+//gather the profiles of one temperature frame, temp_info[0 .. line_num) gets each line's max/min/avr and the pixels
+//of max/min (ties go to the last sample), temp_info NULL only gathers
+int profile_engine_process(ProfileEngine_t* engine, const uint16_t* temp_data, TempInfo_t* temp_info);
+
+//the samples of line index from the last profile_engine_process, valid until the next one. NULL for a bad index
+const uint16_t* profile_engine_profile(const ProfileEngine_t* engine, int index, int* num);
+
+#endif
@@ -0,0 +1,204 @@
+#include "prop.h"
+#include <string.h>
+#include <pthread.h>
+
+#define PROP_PAGE_MAX PROP_SHUTTER_NUM
+
+typedef iruvc_error_t (*prop_get_func)(int prop, uint16_t* value);
+typedef iruvc_error_t (*prop_set_func)(int prop, uint16_t value);
+
+typedef struct {
+    int num;
+    prop_get_func get;
+    prop_set_func set;
+    uint8_t valid[PROP_PAGE_MAX];
+    uint16_t value[PROP_PAGE_MAX];
+}PropPage_t;
+
+static iruvc_error_t prop_tpd_read(int prop, uint16_t* value)
+{
+    return get_prop_tpd_params((enum prop_tpd_params)prop, value);
+}
+
+static iruvc_error_t prop_tpd_write(int prop, uint16_t value)
+{
+    return set_prop_tpd_params((enum prop_tpd_params)prop, value);
+}
+
+static iruvc_error_t prop_image_read(int prop, uint16_t* value)
+{
+    return get_prop_image_params((enum prop_image_params)prop, value);
+}
+
+static iruvc_error_t prop_image_write(int prop, uint16_t value)
+{
+    return set_prop_image_params((enum prop_image_params)prop, value);
+}
+
+static iruvc_error_t prop_shutter_read(int prop, uint16_t* value)
+{
+    return get_prop_auto_shutter_params((enum prop_auto_shutter_params)prop, value);
+}
+
+static iruvc_error_t prop_shutter_write(int prop, uint16_t value)
+{
+    return set_prop_auto_shutter_params((enum prop_auto_shutter_params)prop, value);
+}
+
+//prop_mutex guards the pages and the stats and is never held over a vendor call. prop_io_mutex orders the sets
+//and restores among themselves. prop_gen moves on every set, restore and invalidation: a get that missed stores
+//what the device answered only when nothing wrote in the meantime, its answer may be older than that write
+static pthread_mutex_t prop_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t prop_io_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t prop_gen;
+static PropStats_t prop_stats_cur;
+static PropPage_t prop_tpd_page = { PROP_TPD_NUM, prop_tpd_read, prop_tpd_write, {0}, {0} };
+static PropPage_t prop_image_page = { PROP_IMAGE_NUM, prop_image_read, prop_image_write, {0}, {0} };
+static PropPage_t prop_shutter_page = { PROP_SHUTTER_NUM, prop_shutter_read, prop_shutter_write, {0}, {0} };
+
+static void prop_drop_locked(void)
+{
+    memset(prop_tpd_page.valid, 0, sizeof(prop_tpd_page.valid));
+    memset(prop_image_page.valid, 0, sizeof(prop_image_page.valid));
+    memset(prop_shutter_page.valid, 0, sizeof(prop_shutter_page.valid));
+    prop_gen++;
+}
+
+static int prop_page_get(PropPage_t* page, int prop, uint16_t* value)
+{
+    if (prop < 0 || prop >= page->num || value == NULL)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&prop_mutex);
+    if (page->valid[prop])
+    {
+        *value = page->value[prop];
+        prop_stats_cur.hits++;
+        pthread_mutex_unlock(&prop_mutex);
+        return IRUVC_SUCCESS;
+    }
+    uint64_t gen = prop_gen;
+    pthread_mutex_unlock(&prop_mutex);
+
+    uint16_t got = 0;
+    int rst = page->get(prop, &got);
+    pthread_mutex_lock(&prop_mutex);
+    if (rst != IRUVC_SUCCESS)
+    {
+        prop_stats_cur.errors++;
+    }
+    else
+    {
+        prop_stats_cur.reads++;
+        if (gen == prop_gen)
+        {
+            page->value[prop] = got;
+            page->valid[prop] = 1;
+        }
+        *value = got;
+    }
+    pthread_mutex_unlock(&prop_mutex);
+    return rst;
+}
+
+static int prop_page_set(PropPage_t* page, int prop, uint16_t value)
+{
+    if (prop < 0 || prop >= page->num)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&prop_io_mutex);
+    pthread_mutex_lock(&prop_mutex);
+    page->valid[prop] = 0;
+    prop_gen++;
+    pthread_mutex_unlock(&prop_mutex);
+
+    int rst = page->set(prop, value);
+    pthread_mutex_lock(&prop_mutex);
+    if (rst == IRUVC_SUCCESS)
+    {
+        //the value written is what the next get returns, the vendor documents no property moving another
+        page->value[prop] = value;
+        page->valid[prop] = 1;
+        prop_stats_cur.writes++;
+    }
+    else
+    {
+        prop_stats_cur.errors++;
+    }
+    prop_gen++;
+    pthread_mutex_unlock(&prop_mutex);
+    pthread_mutex_unlock(&prop_io_mutex);
+    return rst;
+}
+
+int prop_tpd_get(enum prop_tpd_params prop, uint16_t* value)
+{
+    return prop_page_get(&prop_tpd_page, (int)prop, value);
+}
+
+int prop_tpd_set(enum prop_tpd_params prop, uint16_t value)
+{
+    return prop_page_set(&prop_tpd_page, (int)prop, value);
+}
+
+int prop_image_get(enum prop_image_params prop, uint16_t* value)
+{
+    return prop_page_get(&prop_image_page, (int)prop, value);
+}
+
+int prop_image_set(enum prop_image_params prop, uint16_t value)
+{
+    return prop_page_set(&prop_image_page, (int)prop, value);
+}
+
+int prop_shutter_get(enum prop_auto_shutter_params prop, uint16_t* value)
+{
+    return prop_page_get(&prop_shutter_page, (int)prop, value);
+}
+
+int prop_shutter_set(enum prop_auto_shutter_params prop, uint16_t value)
+{
+    return prop_page_set(&prop_shutter_page, (int)prop, value);
+}
+
+int prop_restore_default(enum prop_default_cfg cfg)
+{
+    pthread_mutex_lock(&prop_io_mutex);
+    pthread_mutex_lock(&prop_mutex);
+    prop_drop_locked();
+    prop_stats_cur.invalidations++;
+    pthread_mutex_unlock(&prop_mutex);
+
+    int rst = restore_default_cfg(cfg);
+    //dropped again after the call, a get that missed while the device restored may have read the old value
+    pthread_mutex_lock(&prop_mutex);
+    prop_drop_locked();
+    if (rst != IRUVC_SUCCESS)
+    {
+        prop_stats_cur.errors++;
+    }
+    pthread_mutex_unlock(&prop_mutex);
+    pthread_mutex_unlock(&prop_io_mutex);
+    return rst;
+}
+
+void prop_cache_invalidate(void)
+{
+    pthread_mutex_lock(&prop_mutex);
+    prop_drop_locked();
+    prop_stats_cur.invalidations++;
+    pthread_mutex_unlock(&prop_mutex);
+}
+
+void prop_stats(PropStats_t* stats)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&prop_mutex);
+    *stats = prop_stats_cur;
+    pthread_mutex_unlock(&prop_mutex);
+}
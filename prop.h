@@ -0,0 +1,40 @@
+#ifndef _PROP_H_
+#define _PROP_H_
+
+//shadow copy of the module's property pages (prop_tpd_params, prop_image_params, prop_auto_shutter_params).
+//a get answers from the copy once it holds the value and goes to the device only on a miss, a set always goes to
+//the device and the copy takes the value when the device accepted it. the copy is dropped where the device may
+//have changed behind it: prop_restore_default, a camera opened or reconnected, a firmware update.
+//the return values are the vendor calls' iruvc_error_t, the functions replace get_/set_prop_xxx_params one for one
+#include <stdint.h>
+#include "libiruvc.h"
+#include "thermal_cam_cmd.h"
+
+#define PROP_TPD_NUM (TPD_PROP_TEMP_MAP_SEL + 1)
+#define PROP_IMAGE_NUM (IMAGE_PROP_SEL_FLYER + 1)
+#define PROP_SHUTTER_NUM (SHUTTER_CHANGE_GAIN_2ND_DELAY + 1)
+
+typedef struct {
+    uint64_t hits;                      //gets answered from the copy
+    uint64_t reads;                     //gets that went to the device
+    uint64_t writes;                    //sets the device accepted
+    uint64_t errors;                    //vendor gets and sets that failed
+    uint64_t invalidations;             //the whole copy dropped
+}PropStats_t;
+
+int prop_tpd_get(enum prop_tpd_params prop, uint16_t* value);
+int prop_tpd_set(enum prop_tpd_params prop, uint16_t value);
+int prop_image_get(enum prop_image_params prop, uint16_t* value);
+int prop_image_set(enum prop_image_params prop, uint16_t value);
+int prop_shutter_get(enum prop_auto_shutter_params prop, uint16_t* value);
+int prop_shutter_set(enum prop_auto_shutter_params prop, uint16_t value);
+
+//restore_default_cfg, the copy is dropped whatever part of the configuration it restored
+int prop_restore_default(enum prop_default_cfg cfg);
+
+//the next get of every property reads the device again
+void prop_cache_invalidate(void);
+
+void prop_stats(PropStats_t* stats);
+
+#endif
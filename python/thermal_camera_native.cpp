@@ -0,0 +1,1946 @@
+//cpython extension over simple_camera: frames are leased ring slots exported through the buffer protocol,
+//np.asarray(frame) is a zero copy (height, width) uint16 view of the Y14 temp plane. a Bus attaches to the shared
+//memory bus of a pipeline running in another process (bus.h), its frames are leased bus slots the same way
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+#include <pthread.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "simple_camera.h"
+#include "temperature.h"
+#include "segment.h"
+#include "bus.h"
+
+#define NATIVE_DEFAULT_TIMEOUT_MS 1000
+#define PREFETCH_DEFAULT_DEPTH 4
+#define PREFETCH_BUSY_WAIT_MS 5         //python holds every lease, the prefetch thread looks again after
+#define PREFETCH_SIGNAL_CHECK_MS 100    //a blocking iterator wakes this often for ctrl-c
+
+typedef struct {
+    PyObject_HEAD
+    SimpleCameraHandle_t* handle;
+    pthread_mutex_t mutex;              //the handle's lease table, taken with the gil released
+    uint8_t opened;
+    uint8_t streaming;
+    uint32_t generation;                //bumped by stop_stream, leases of an older stream are gone
+    Py_ssize_t exports;                 //buffers exported by all frames, stop and close refuse while any is alive
+    Py_ssize_t prefetchers;             //running frames() iterators, stop and close refuse while any is running
+}CameraObject;
+
+typedef struct {
+    PyObject_HEAD
+    BusReader_t reader;
+    pthread_mutex_t mutex;              //the reader's leases, taken with the gil released
+    uint8_t opened;
+    Py_ssize_t exports;                 //buffers exported by all frames, close refuses while any is alive
+}BusObject;
+
+//a camera frame or a bus frame, the other owner is NULL
+typedef struct {
+    PyObject_HEAD
+    CameraObject* camera;
+    BusObject* bus;
+    BusFrame_t bus_frame;
+    SimpleCameraFrameLease_t lease;     //token 0 once released
+    uint32_t generation;
+    Py_ssize_t exports;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+}FrameObject;
+
+//the frames() iterator, a ring of leases the prefetch thread filled and python did not take yet
+typedef struct {
+    PyObject_HEAD
+    CameraObject* camera;
+    pthread_t thread;
+    pthread_mutex_t mutex;              //the queue and the counters, never held across a camera call
+    pthread_cond_t cond;
+    int ready_fd;                       //the camera's, owned by the library
+    int event_fd;
+    int stop_fd;
+    uint8_t started;
+    uint8_t ended;                      //the thread exited
+    uint32_t depth;
+    uint32_t head;
+    uint32_t len;
+    SimpleCameraFrameLease_t queue[SIMPLE_CAMERA_MAX_LEASES];
+    uint64_t prefetched;
+    uint64_t delivered;
+    uint64_t dropped;
+}PrefetchObject;
+
+static PyTypeObject CameraType;
+static PyTypeObject BusType;
+static PyTypeObject FrameType;
+static PyTypeObject PrefetchType;
+static PyTypeObject FrameStatsType;
+static PyTypeObject RoiStatsType;
+static PyTypeObject BlobType;
+
+static PyStructSequence_Field frame_stats_fields[] = {
+    {(char*)"min_val", (char*)"Y14 minimum"},
+    {(char*)"max_val", (char*)"Y14 maximum"},
+    {(char*)"min_x", NULL},
+    {(char*)"min_y", NULL},
+    {(char*)"max_x", NULL},
+    {(char*)"max_y", NULL},
+    {(char*)"mean", (char*)"Y14 mean"},
+    {(char*)"hist_low", (char*)"lower edge of bin 0"},
+    {(char*)"hist_bin_width", NULL},
+    {(char*)"hist", (char*)"tuple of 256 bin counts"},
+    {NULL, NULL}
+};
+
+static PyStructSequence_Desc frame_stats_desc = {
+    (char*)"thermal_camera_native.FrameStats",
+    (char*)"temp plane statistics the stream thread computed for the frame",
+    frame_stats_fields,
+    10
+};
+
+static PyStructSequence_Field roi_stats_fields[] = {
+    {(char*)"min_val", (char*)"Y14 minimum"},
+    {(char*)"max_val", (char*)"Y14 maximum"},
+    {(char*)"min_x", NULL},
+    {(char*)"min_y", NULL},
+    {(char*)"max_x", NULL},
+    {(char*)"max_y", NULL},
+    {(char*)"pix_num", (char*)"pixels of the rect inside the frame"},
+    {(char*)"mean", (char*)"Y14 mean"},
+    {(char*)"min_celsius", NULL},
+    {(char*)"max_celsius", NULL},
+    {(char*)"mean_celsius", NULL},
+    {NULL, NULL}
+};
+
+static PyStructSequence_Desc roi_stats_desc = {
+    (char*)"thermal_camera_native.RoiStats",
+    (char*)"statistics of one rect, clipped to the frame",
+    roi_stats_fields,
+    11
+};
+
+static PyStructSequence_Field blob_fields[] = {
+    {(char*)"area", (char*)"pixels of the cleaned mask"},
+    {(char*)"max_celsius", NULL},
+    {(char*)"max_x", NULL},
+    {(char*)"max_y", NULL},
+    {(char*)"x0", (char*)"inclusive box"},
+    {(char*)"y0", NULL},
+    {(char*)"x1", NULL},
+    {(char*)"y1", NULL},
+    {(char*)"cx", (char*)"centroid, rounded"},
+    {(char*)"cy", NULL},
+    {NULL, NULL}
+};
+
+static PyStructSequence_Desc blob_desc = {
+    (char*)"thermal_camera_native.Blob",
+    (char*)"one 8-connected blob of the segmented temp plane",
+    blob_fields,
+    10
+};
+
+static void camera_lock(CameraObject* camera)
+{
+    //another thread may hold the mutex through a whole acquire timeout
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&camera->mutex);
+    Py_END_ALLOW_THREADS
+}
+
+static void camera_unlock(CameraObject* camera)
+{
+    pthread_mutex_unlock(&camera->mutex);
+}
+
+static PyObject* camera_error(const char* what, int ret)
+{
+    PyErr_Format(PyExc_RuntimeError, "%s failed: %d", what, ret);
+    return NULL;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//Frame
+
+static void frame_release_lease(FrameObject* frame)
+{
+    if (frame->lease.token == 0)
+    {
+        return;
+    }
+    BusObject* bus = frame->bus;
+    if (bus != NULL)
+    {
+        //a lease is one atomic of the mapping, no need to wait for an acquire of another thread
+        if (bus->opened)
+        {
+            bus_reader_release(&bus->reader, &frame->bus_frame);
+        }
+        frame->lease.token = 0;
+        frame->lease.data = NULL;
+        return;
+    }
+    CameraObject* camera = frame->camera;
+    if (frame->generation == camera->generation && camera->streaming)
+    {
+        camera_lock(camera);
+        simple_camera_release_temp_frame(camera->handle, frame->lease.token);
+        camera_unlock(camera);
+    }
+    frame->lease.token = 0;
+    frame->lease.data = NULL;
+}
+
+static int frame_valid(FrameObject* frame)
+{
+    if (frame->bus != NULL)
+    {
+        return frame->lease.token != 0 && frame->bus->opened;
+    }
+    return frame->lease.token != 0 && frame->generation == frame->camera->generation && frame->camera->streaming;
+}
+
+static Py_ssize_t* frame_owner_exports(FrameObject* frame)
+{
+    return (frame->bus != NULL) ? &frame->bus->exports : &frame->camera->exports;
+}
+
+static void frame_dealloc(FrameObject* frame)
+{
+    //exported buffers hold a reference, nothing points into the slot any more
+    frame_release_lease(frame);
+    Py_XDECREF(frame->camera);
+    Py_XDECREF(frame->bus);
+    Py_TYPE(frame)->tp_free((PyObject*)frame);
+}
+
+static int frame_getbuffer(FrameObject* frame, Py_buffer* view, int flags)
+{
+    if (!frame_valid(frame))
+    {
+        PyErr_SetString(PyExc_BufferError, "the frame was released");
+        view->obj = NULL;
+        return -1;
+    }
+    if (flags & PyBUF_WRITABLE)
+    {
+        PyErr_SetString(PyExc_BufferError, "the frame is read only");
+        view->obj = NULL;
+        return -1;
+    }
+    int packed = (frame->strides[0] == frame->shape[1] * 2);
+    if (!packed && (flags & PyBUF_STRIDES) != PyBUF_STRIDES)
+    {
+        PyErr_SetString(PyExc_BufferError, "the frame rows are padded, ask for strides");
+        view->obj = NULL;
+        return -1;
+    }
+    view->buf = frame->lease.data;
+    view->obj = (PyObject*)frame;
+    Py_INCREF(frame);
+    view->len = frame->shape[0] * frame->shape[1] * 2;
+    view->readonly = 1;
+    view->itemsize = 2;
+    view->format = (flags & PyBUF_FORMAT) ? (char*)"H" : NULL;
+    view->ndim = 2;
+    view->shape = (flags & PyBUF_ND) ? frame->shape : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? frame->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    frame->exports++;
+    (*frame_owner_exports(frame))++;
+    return 0;
+}
+
+static void frame_releasebuffer(FrameObject* frame, Py_buffer* view)
+{
+    (void)view;
+    frame->exports--;
+    (*frame_owner_exports(frame))--;
+}
+
+static PyBufferProcs frame_as_buffer = {
+    (getbufferproc)frame_getbuffer,
+    (releasebufferproc)frame_releasebuffer
+};
+
+static PyObject* frame_release(FrameObject* frame, PyObject* unused)
+{
+    (void)unused;
+    if (frame->exports > 0)
+    {
+        PyErr_SetString(PyExc_BufferError, "views of the frame are still alive");
+        return NULL;
+    }
+    frame_release_lease(frame);
+    Py_RETURN_NONE;
+}
+
+static PyObject* frame_enter(FrameObject* frame, PyObject* unused)
+{
+    (void)unused;
+    Py_INCREF(frame);
+    return (PyObject*)frame;
+}
+
+static PyObject* frame_exit(FrameObject* frame, PyObject* args)
+{
+    (void)args;
+    return frame_release(frame, NULL);
+}
+
+static PyObject* frame_stats(FrameObject* frame, PyObject* unused)
+{
+    (void)unused;
+    if (!frame_valid(frame))
+    {
+        PyErr_SetString(PyExc_ValueError, "the frame was released");
+        return NULL;
+    }
+    SimpleCameraFrameStats_t stats;
+    int ret = -1;
+    if (frame->bus != NULL && frame->bus_frame.temp_stats != NULL)
+    {
+        const FrameStats_t* src = frame->bus_frame.temp_stats;
+        stats.min_val = src->min_val;
+        stats.max_val = src->max_val;
+        stats.min_x = src->min_x;
+        stats.min_y = src->min_y;
+        stats.max_x = src->max_x;
+        stats.max_y = src->max_y;
+        stats.mean = src->mean;
+        stats.hist_low = src->hist_low;
+        stats.hist_bin_width = src->hist_bin_width;
+        memcpy(stats.hist, src->hist, sizeof(stats.hist));
+        ret = 0;
+    }
+    else if (frame->bus == NULL)
+    {
+        camera_lock(frame->camera);
+        ret = simple_camera_get_temp_stats(frame->camera->handle, frame->lease.token, &stats);
+        camera_unlock(frame->camera);
+    }
+    if (ret != 0)
+    {
+        //the stream thread computes stats only when the temp stats stage is on
+        Py_RETURN_NONE;
+    }
+
+    PyObject* hist = PyTuple_New(256);
+    if (hist == NULL)
+    {
+        return NULL;
+    }
+    for (int i = 0; i < 256; i++)
+    {
+        PyTuple_SET_ITEM(hist, i, PyLong_FromUnsignedLong(stats.hist[i]));
+    }
+    PyObject* result = PyStructSequence_New(&FrameStatsType);
+    if (result == NULL)
+    {
+        Py_DECREF(hist);
+        return NULL;
+    }
+    PyStructSequence_SET_ITEM(result, 0, PyLong_FromLong(stats.min_val));
+    PyStructSequence_SET_ITEM(result, 1, PyLong_FromLong(stats.max_val));
+    PyStructSequence_SET_ITEM(result, 2, PyLong_FromLong(stats.min_x));
+    PyStructSequence_SET_ITEM(result, 3, PyLong_FromLong(stats.min_y));
+    PyStructSequence_SET_ITEM(result, 4, PyLong_FromLong(stats.max_x));
+    PyStructSequence_SET_ITEM(result, 5, PyLong_FromLong(stats.max_y));
+    PyStructSequence_SET_ITEM(result, 6, PyFloat_FromDouble(stats.mean));
+    PyStructSequence_SET_ITEM(result, 7, PyLong_FromUnsignedLong(stats.hist_low));
+    PyStructSequence_SET_ITEM(result, 8, PyLong_FromUnsignedLong(stats.hist_bin_width));
+    PyStructSequence_SET_ITEM(result, 9, hist);
+    return result;
+}
+
+//celsius of (x, y) points in one temp_points_get_celsius call, the get_point_temp values
+static PyObject* frame_point_temps(FrameObject* frame, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = {"points", "env", NULL};
+    PyObject* points_obj = NULL;
+    int env = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|p", (char**)kwlist, &points_obj, &env))
+    {
+        return NULL;
+    }
+    if (!frame_valid(frame))
+    {
+        PyErr_SetString(PyExc_ValueError, "the frame was released");
+        return NULL;
+    }
+    if (frame->strides[0] != frame->shape[1] * 2)
+    {
+        PyErr_SetString(PyExc_ValueError, "the frame rows are padded");
+        return NULL;
+    }
+    PyObject* seq = PySequence_Fast(points_obj, "points must be a sequence of (x, y)");
+    if (seq == NULL)
+    {
+        return NULL;
+    }
+    Py_ssize_t num = PySequence_Fast_GET_SIZE(seq);
+    Dot_t* points = (Dot_t*)PyMem_Malloc((num > 0 ? num : 1) * sizeof(Dot_t));
+    float* celsius = (float*)PyMem_Malloc((num > 0 ? num : 1) * sizeof(float));
+    if (points == NULL || celsius == NULL)
+    {
+        PyMem_Free(points);
+        PyMem_Free(celsius);
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+    for (Py_ssize_t i = 0; i < num; i++)
+    {
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, i), "ii", &points[i].x, &points[i].y))
+        {
+            PyMem_Free(points);
+            PyMem_Free(celsius);
+            Py_DECREF(seq);
+            return NULL;
+        }
+    }
+    Py_DECREF(seq);
+    TempDataRes_t temp_res = { (uint16_t)frame->shape[1], (uint16_t)frame->shape[0] };
+    temp_points_get_celsius((uint16_t*)frame->lease.data, temp_res, points, (int)num, env, celsius);
+    PyObject* result = PyList_New(num);
+    for (Py_ssize_t i = 0; result != NULL && i < num; i++)
+    {
+        PyList_SET_ITEM(result, i, PyFloat_FromDouble(celsius[i]));
+    }
+    PyMem_Free(points);
+    PyMem_Free(celsius);
+    return result;
+}
+
+//celsius -> raw temp value (kelvin * 64), rounded inward so the window keeps its meaning at the bounds
+static uint16_t frame_temp_of_celsius(double celsius, int upper)
+{
+    double raw = (celsius + 273.15) * 64;
+    raw = upper ? floor(raw) : ceil(raw);
+    return (uint16_t)((raw < 0) ? 0 : ((raw > 65535) ? 65535 : raw));
+}
+
+//the blobs of segment_process over the frame, the people of an occupancy count without a pass in python
+static PyObject* frame_blobs(FrameObject* frame, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = {"min_celsius", "max_celsius", "open", "close", "min_area", NULL};
+    double min_celsius = 28.0, max_celsius = 40.0;
+    int open = 1, close = 1;
+    unsigned int min_area = 20;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|ddiiI", (char**)kwlist, &min_celsius, &max_celsius, &open, \
+        &close, &min_area))
+    {
+        return NULL;
+    }
+    if (!frame_valid(frame))
+    {
+        PyErr_SetString(PyExc_ValueError, "the frame was released");
+        return NULL;
+    }
+    if (frame->strides[0] != frame->shape[1] * 2)
+    {
+        PyErr_SetString(PyExc_ValueError, "the frame rows are padded");
+        return NULL;
+    }
+    if (open < 0 || open > 255 || close < 0 || close > 255)
+    {
+        PyErr_SetString(PyExc_ValueError, "open and close are radii of 0..255");
+        return NULL;
+    }
+    SegmentParam_t param;
+    param.low_temp = frame_temp_of_celsius(min_celsius, 0);
+    param.high_temp = frame_temp_of_celsius(max_celsius, 1);
+    param.open = (uint8_t)open;
+    param.close = (uint8_t)close;
+    param.min_area = min_area;
+    if (param.low_temp > param.high_temp)
+    {
+        return PyList_New(0);
+    }
+    Segment_t segment;
+    TempDataRes_t temp_res = { (uint16_t)frame->shape[1], (uint16_t)frame->shape[0] };
+    int ret = segment_init(&segment, temp_res);
+    if (ret != SEGMENT_SUCCESS)
+    {
+        return (ret == SEGMENT_ERROR_MEM) ? PyErr_NoMemory() : camera_error("segment_init", ret);
+    }
+    int num = segment_process(&segment, (const uint16_t*)frame->lease.data, &param);
+    PyObject* result = (num >= 0) ? PyList_New(num) : camera_error("segment_process", num);
+    for (int i = 0; result != NULL && i < num; i++)
+    {
+        const SegmentBlob_t* blob = &segment.blobs[i];
+        PyObject* item = PyStructSequence_New(&BlobType);
+        if (item == NULL)
+        {
+            Py_CLEAR(result);
+            break;
+        }
+        PyStructSequence_SET_ITEM(item, 0, PyLong_FromUnsignedLong(blob->area));
+        PyStructSequence_SET_ITEM(item, 1, PyFloat_FromDouble(temp_value_converter(blob->max_temp)));
+        PyStructSequence_SET_ITEM(item, 2, PyLong_FromLong(blob->max_x));
+        PyStructSequence_SET_ITEM(item, 3, PyLong_FromLong(blob->max_y));
+        PyStructSequence_SET_ITEM(item, 4, PyLong_FromLong(blob->x0));
+        PyStructSequence_SET_ITEM(item, 5, PyLong_FromLong(blob->y0));
+        PyStructSequence_SET_ITEM(item, 6, PyLong_FromLong(blob->x1));
+        PyStructSequence_SET_ITEM(item, 7, PyLong_FromLong(blob->y1));
+        PyStructSequence_SET_ITEM(item, 8, PyLong_FromLong(blob->cx));
+        PyStructSequence_SET_ITEM(item, 9, PyLong_FromLong(blob->cy));
+        PyList_SET_ITEM(result, i, item);
+    }
+    segment_release(&segment);
+    return result;
+}
+
+static PyObject* frame_get_released(FrameObject* frame, void* closure)
+{
+    (void)closure;
+    return PyBool_FromLong(!frame_valid(frame));
+}
+
+static PyObject* frame_repr(FrameObject* frame)
+{
+    return PyUnicode_FromFormat("<Frame seq=%llu %zdx%zd%s>", (unsigned long long)frame->lease.seq, \
+        frame->shape[1], frame->shape[0], frame_valid(frame) ? "" : " released");
+}
+
+static PyMethodDef frame_methods[] = {
+    {"release", (PyCFunction)frame_release, METH_NOARGS, "hand the slot back to the ring, no view may be alive"},
+    {"stats", (PyCFunction)frame_stats, METH_NOARGS, "FrameStats of the stream thread, None if it computed none"},
+    {"point_temps", (PyCFunction)(void(*)(void))frame_point_temps, METH_VARARGS | METH_KEYWORDS, \
+        "celsius of a list of (x, y), the 3x3 filtered get_point_temp values, outside the frame 0"},
+    {"blobs", (PyCFunction)(void(*)(void))frame_blobs, METH_VARARGS | METH_KEYWORDS, \
+        "Blob list of the pixels in [min_celsius, max_celsius] after opening/closing, min_area or larger"},
+    {"__enter__", (PyCFunction)frame_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)frame_exit, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyMemberDef frame_members[] = {
+    {(char*)"seq", T_ULONGLONG, offsetof(FrameObject, lease.seq), READONLY, (char*)"ring sequence, gaps are drops"},
+    {(char*)"timestamp_us", T_ULONGLONG, offsetof(FrameObject, lease.timestamp_us), READONLY, \
+        (char*)"capture time, monotonic clock"},
+    {(char*)"width", T_UINT, offsetof(FrameObject, lease.width), READONLY, NULL},
+    {(char*)"height", T_UINT, offsetof(FrameObject, lease.height), READONLY, NULL},
+    {(char*)"stride", T_UINT, offsetof(FrameObject, lease.stride), READONLY, (char*)"bytes per row"},
+    {NULL, 0, 0, 0, NULL}
+};
+
+static PyGetSetDef frame_getset[] = {
+    {(char*)"released", (getter)frame_get_released, NULL, NULL, NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+//the lease stays the caller's to give back on failure
+static PyObject* frame_of_lease(CameraObject* camera, const SimpleCameraFrameLease_t* lease)
+{
+    FrameObject* frame = PyObject_New(FrameObject, &FrameType);
+    if (frame == NULL)
+    {
+        return NULL;
+    }
+    Py_INCREF(camera);
+    frame->camera = camera;
+    frame->bus = NULL;
+    frame->lease = *lease;
+    frame->generation = camera->generation;
+    frame->exports = 0;
+    frame->shape[0] = lease->height;
+    frame->shape[1] = lease->width;
+    frame->strides[0] = lease->stride;
+    frame->strides[1] = 2;
+    return (PyObject*)frame;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//Prefetch
+
+//a native thread leases the camera's frames ahead of python into a bounded queue, the oldest queued frame is dropped
+//for a new one when python falls behind. the thread waits on the camera's ready fd without the handle mutex, so an
+//acquire or a release of python never waits behind it. event_fd is readable while frames are queued or after the
+//end, the asyncio side of the same queue
+
+static void prefetch_event_set(PrefetchObject* prefetch)
+{
+    uint64_t one = 1;
+    ssize_t rst = write(prefetch->event_fd, &one, sizeof(one));
+    (void)rst;
+}
+
+static void prefetch_event_clear(PrefetchObject* prefetch)
+{
+    uint64_t cnt = 0;
+    ssize_t rst = read(prefetch->event_fd, &cnt, sizeof(cnt));
+    (void)rst;
+}
+
+//the oldest queued lease, the queue mutex held
+static SimpleCameraFrameLease_t prefetch_take(PrefetchObject* prefetch)
+{
+    SimpleCameraFrameLease_t lease = prefetch->queue[prefetch->head];
+    prefetch->head = (prefetch->head + 1) % SIMPLE_CAMERA_MAX_LEASES;
+    prefetch->len--;
+    if (prefetch->len == 0 && !prefetch->ended)
+    {
+        prefetch_event_clear(prefetch);
+    }
+    return lease;
+}
+
+static void prefetch_give_back(PrefetchObject* prefetch, uint64_t token)
+{
+    pthread_mutex_lock(&prefetch->camera->mutex);
+    simple_camera_release_temp_frame(prefetch->camera->handle, token);
+    pthread_mutex_unlock(&prefetch->camera->mutex);
+}
+
+//0 once ms passed or the ready fd is readable, -1 once close asked the thread to stop. ready_fd -1 waits ms only
+static int prefetch_wait(PrefetchObject* prefetch, int ready_fd, int ms)
+{
+    struct pollfd fds[2];
+    fds[0].fd = prefetch->stop_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = ready_fd;
+    fds[1].events = POLLIN;
+    int ret = poll(fds, (ready_fd >= 0) ? 2 : 1, ms);
+    return (ret > 0 && (fds[0].revents & POLLIN)) ? -1 : 0;
+}
+
+static int prefetch_drop_oldest(PrefetchObject* prefetch)
+{
+    pthread_mutex_lock(&prefetch->mutex);
+    if (prefetch->len == 0)
+    {
+        pthread_mutex_unlock(&prefetch->mutex);
+        return 0;
+    }
+    SimpleCameraFrameLease_t lease = prefetch_take(prefetch);
+    prefetch->dropped++;
+    pthread_mutex_unlock(&prefetch->mutex);
+    prefetch_give_back(prefetch, lease.token);
+    return 1;
+}
+
+static void prefetch_push(PrefetchObject* prefetch, const SimpleCameraFrameLease_t* lease)
+{
+    uint64_t old_token = 0;
+    pthread_mutex_lock(&prefetch->mutex);
+    if (prefetch->len == prefetch->depth)
+    {
+        old_token = prefetch_take(prefetch).token;
+        prefetch->dropped++;
+    }
+    prefetch->queue[(prefetch->head + prefetch->len) % SIMPLE_CAMERA_MAX_LEASES] = *lease;
+    prefetch->len++;
+    prefetch->prefetched++;
+    prefetch_event_set(prefetch);
+    pthread_cond_signal(&prefetch->cond);
+    pthread_mutex_unlock(&prefetch->mutex);
+    if (old_token != 0)
+    {
+        prefetch_give_back(prefetch, old_token);
+    }
+}
+
+static void* prefetch_thread(void* arg)
+{
+    PrefetchObject* prefetch = (PrefetchObject*)arg;
+    CameraObject* camera = prefetch->camera;
+    for (;;)
+    {
+        if (prefetch_wait(prefetch, prefetch->ready_fd, -1) != 0)
+        {
+            break;
+        }
+        SimpleCameraFrameLease_t lease;
+        pthread_mutex_lock(&camera->mutex);
+        int ret = simple_camera_acquire_temp_frame(camera->handle, 0, &lease);
+        pthread_mutex_unlock(&camera->mutex);
+        if (ret == SIMPLE_CAMERA_TIMEOUT)
+        {
+            //the wakeup was spurious
+            continue;
+        }
+        if (ret == SIMPLE_CAMERA_BUSY)
+        {
+            //busy leaves the ready fd set, a new frame is waiting: it takes the lease of the oldest queued one.
+            //with nothing queued python holds every lease, wait for it to release one
+            if (!prefetch_drop_oldest(prefetch) && prefetch_wait(prefetch, -1, PREFETCH_BUSY_WAIT_MS) != 0)
+            {
+                break;
+            }
+            continue;
+        }
+        if (ret != 0)
+        {
+            //the stream thread stopped
+            break;
+        }
+        prefetch_push(prefetch, &lease);
+    }
+    pthread_mutex_lock(&prefetch->mutex);
+    prefetch->ended = 1;
+    prefetch_event_set(prefetch);
+    pthread_cond_broadcast(&prefetch->cond);
+    pthread_mutex_unlock(&prefetch->mutex);
+    return NULL;
+}
+
+//the gil released: the oldest queued frame within timeout_ms, TIMEOUT or CLOSED once the end and nothing queued
+static int prefetch_pop(PrefetchObject* prefetch, uint32_t timeout_ms, SimpleCameraFrameLease_t* lease)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&prefetch->mutex);
+    int wait_ret = 0;
+    while (prefetch->len == 0 && !prefetch->ended && wait_ret != ETIMEDOUT && timeout_ms > 0)
+    {
+        wait_ret = pthread_cond_timedwait(&prefetch->cond, &prefetch->mutex, &deadline);
+    }
+    int ret = prefetch->ended ? SIMPLE_CAMERA_CLOSED : SIMPLE_CAMERA_TIMEOUT;
+    if (prefetch->len > 0)
+    {
+        *lease = prefetch_take(prefetch);
+        prefetch->delivered++;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&prefetch->mutex);
+    return ret;
+}
+
+//stop the thread and give the queued frames back, the fds stay open until dealloc so an awaiting reader still wakes
+static void prefetch_shutdown(PrefetchObject* prefetch)
+{
+    if (!prefetch->started)
+    {
+        return;
+    }
+    uint64_t one = 1;
+    ssize_t rst = write(prefetch->stop_fd, &one, sizeof(one));
+    (void)rst;
+    Py_BEGIN_ALLOW_THREADS
+    pthread_join(prefetch->thread, NULL);
+    uint64_t tokens[SIMPLE_CAMERA_MAX_LEASES];
+    int num = 0;
+    pthread_mutex_lock(&prefetch->mutex);
+    while (prefetch->len > 0)
+    {
+        tokens[num++] = prefetch_take(prefetch).token;
+    }
+    pthread_mutex_unlock(&prefetch->mutex);
+    for (int i = 0; i < num; i++)
+    {
+        prefetch_give_back(prefetch, tokens[i]);
+    }
+    Py_END_ALLOW_THREADS
+    prefetch->started = 0;
+    prefetch->camera->prefetchers--;
+}
+
+static PyObject* prefetch_start(CameraObject* camera, uint32_t depth)
+{
+    camera_lock(camera);
+    int ready_fd = simple_camera_get_ready_fd(camera->handle);
+    camera_unlock(camera);
+    if (ready_fd < 0)
+    {
+        return camera_error("simple_camera_get_ready_fd", ready_fd);
+    }
+    PrefetchObject* prefetch = (PrefetchObject*)PrefetchType.tp_alloc(&PrefetchType, 0);
+    if (prefetch == NULL)
+    {
+        return NULL;
+    }
+    prefetch->event_fd = -1;
+    prefetch->stop_fd = -1;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&prefetch->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&prefetch->mutex, NULL);
+    Py_INCREF(camera);
+    prefetch->camera = camera;
+    prefetch->depth = depth;
+    prefetch->ready_fd = ready_fd;
+    prefetch->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    prefetch->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (prefetch->event_fd < 0 || prefetch->stop_fd < 0)
+    {
+        Py_DECREF(prefetch);
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    if (pthread_create(&prefetch->thread, NULL, prefetch_thread, prefetch) != 0)
+    {
+        Py_DECREF(prefetch);
+        return camera_error("pthread_create", -1);
+    }
+    prefetch->started = 1;
+    camera->prefetchers++;
+    return (PyObject*)prefetch;
+}
+
+static void prefetch_dealloc(PrefetchObject* prefetch)
+{
+    //frames handed out hold their own camera reference
+    if (prefetch->camera != NULL)
+    {
+        prefetch_shutdown(prefetch);
+        pthread_mutex_destroy(&prefetch->mutex);
+        pthread_cond_destroy(&prefetch->cond);
+    }
+    if (prefetch->event_fd >= 0)
+    {
+        close(prefetch->event_fd);
+    }
+    if (prefetch->stop_fd >= 0)
+    {
+        close(prefetch->stop_fd);
+    }
+    Py_XDECREF(prefetch->camera);
+    Py_TYPE(prefetch)->tp_free((PyObject*)prefetch);
+}
+
+static PyObject* prefetch_frame(PrefetchObject* prefetch, const SimpleCameraFrameLease_t* lease)
+{
+    PyObject* frame = frame_of_lease(prefetch->camera, lease);
+    if (frame == NULL)
+    {
+        Py_BEGIN_ALLOW_THREADS
+        prefetch_give_back(prefetch, lease->token);
+        Py_END_ALLOW_THREADS
+    }
+    return frame;
+}
+
+static PyObject* prefetch_get(PrefetchObject* prefetch, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = {"timeout_ms", NULL};
+    unsigned int timeout_ms = NATIVE_DEFAULT_TIMEOUT_MS;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|I", (char**)kwlist, &timeout_ms))
+    {
+        return NULL;
+    }
+    SimpleCameraFrameLease_t lease;
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    ret = prefetch_pop(prefetch, timeout_ms, &lease);
+    Py_END_ALLOW_THREADS
+    if (ret != 0)
+    {
+        Py_RETURN_NONE;
+    }
+    return prefetch_frame(prefetch, &lease);
+}
+
+static PyObject* prefetch_get_nowait(PrefetchObject* prefetch, PyObject* unused)
+{
+    (void)unused;
+    SimpleCameraFrameLease_t lease;
+    //no wait, the queue mutex is only ever held for a few stores
+    if (prefetch_pop(prefetch, 0, &lease) != 0)
+    {
+        Py_RETURN_NONE;
+    }
+    return prefetch_frame(prefetch, &lease);
+}
+
+//blocks until a frame or the end, in slices so that ctrl-c gets through
+static PyObject* prefetch_next(PrefetchObject* prefetch)
+{
+    SimpleCameraFrameLease_t lease;
+    for (;;)
+    {
+        int ret;
+        Py_BEGIN_ALLOW_THREADS
+        ret = prefetch_pop(prefetch, PREFETCH_SIGNAL_CHECK_MS, &lease);
+        Py_END_ALLOW_THREADS
+        if (ret == 0)
+        {
+            return prefetch_frame(prefetch, &lease);
+        }
+        if (ret == SIMPLE_CAMERA_CLOSED || PyErr_CheckSignals() != 0)
+        {
+            return NULL;
+        }
+    }
+}
+
+//__anext__ is a coroutine of the module's own asyncio glue: get_nowait, else await event_fd through add_reader
+static const char* prefetch_async_source =
+    "import asyncio\n"
+    "async def anext(frames):\n"
+    "    while True:\n"
+    "        frame = frames.get_nowait()\n"
+    "        if frame is not None:\n"
+    "            return frame\n"
+    "        if frames.ended:\n"
+    "            raise StopAsyncIteration\n"
+    "        fd = frames.fileno()\n"
+    "        loop = asyncio.get_running_loop()\n"
+    "        ready = loop.create_future()\n"
+    "        loop.add_reader(fd, lambda: ready.done() or ready.set_result(None))\n"
+    "        try:\n"
+    "            await ready\n"
+    "        finally:\n"
+    "            loop.remove_reader(fd)\n";
+
+static PyObject* prefetch_anext(PrefetchObject* prefetch)
+{
+    static PyObject* anext_func = NULL;
+    if (anext_func == NULL)
+    {
+        PyObject* globals = PyDict_New();
+        if (globals == NULL || PyDict_SetItemString(globals, "__builtins__", PyEval_GetBuiltins()) != 0)
+        {
+            Py_XDECREF(globals);
+            return NULL;
+        }
+        PyObject* ret = PyRun_String(prefetch_async_source, Py_file_input, globals, globals);
+        Py_XDECREF(ret);
+        anext_func = (ret != NULL) ? PyDict_GetItemString(globals, "anext") : NULL;
+        Py_XINCREF(anext_func);
+        Py_DECREF(globals);
+        if (anext_func == NULL)
+        {
+            return NULL;
+        }
+    }
+    return PyObject_CallFunctionObjArgs(anext_func, (PyObject*)prefetch, NULL);
+}
+
+static PyObject* prefetch_fileno(PrefetchObject* prefetch, PyObject* unused)
+{
+    (void)unused;
+    return PyLong_FromLong(prefetch->event_fd);
+}
+
+static PyObject* prefetch_stats(PrefetchObject* prefetch, PyObject* unused)
+{
+    (void)unused;
+    pthread_mutex_lock(&prefetch->mutex);
+    unsigned long long prefetched = prefetch->prefetched, delivered = prefetch->delivered;
+    unsigned long long dropped = prefetch->dropped;
+    unsigned int queued = prefetch->len;
+    pthread_mutex_unlock(&prefetch->mutex);
+    return Py_BuildValue("(KKKI)", prefetched, delivered, dropped, queued);
+}
+
+static PyObject* prefetch_close(PrefetchObject* prefetch, PyObject* unused)
+{
+    (void)unused;
+    prefetch_shutdown(prefetch);
+    Py_RETURN_NONE;
+}
+
+static PyObject* prefetch_enter(PrefetchObject* prefetch, PyObject* unused)
+{
+    (void)unused;
+    Py_INCREF(prefetch);
+    return (PyObject*)prefetch;
+}
+
+static PyObject* prefetch_exit(PrefetchObject* prefetch, PyObject* args)
+{
+    (void)args;
+    return prefetch_close(prefetch, NULL);
+}
+
+static PyObject* prefetch_get_ended(PrefetchObject* prefetch, void* closure)
+{
+    (void)closure;
+    pthread_mutex_lock(&prefetch->mutex);
+    int ended = prefetch->ended && prefetch->len == 0;
+    pthread_mutex_unlock(&prefetch->mutex);
+    return PyBool_FromLong(ended);
+}
+
+static PyAsyncMethods prefetch_as_async = {
+    NULL,
+    (unaryfunc)PyObject_SelfIter,
+    (unaryfunc)prefetch_anext
+};
+
+static PyMethodDef prefetch_methods[] = {
+    {"get", (PyCFunction)(void(*)(void))prefetch_get, METH_VARARGS | METH_KEYWORDS, \
+        "get(timeout_ms=1000): the oldest prefetched frame, None on timeout or after the end"},
+    {"get_nowait", (PyCFunction)prefetch_get_nowait, METH_NOARGS, "the oldest prefetched frame or None"},
+    {"fileno", (PyCFunction)prefetch_fileno, METH_NOARGS, \
+        "readable while frames are queued or after the end, for select/add_reader; do not close it"},
+    {"stats", (PyCFunction)prefetch_stats, METH_NOARGS, \
+        "(prefetched, delivered, dropped, queued), dropped were queued frames replaced by newer ones"},
+    {"close", (PyCFunction)prefetch_close, METH_NOARGS, "stop prefetching, the queued frames go back"},
+    {"__enter__", (PyCFunction)prefetch_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)prefetch_exit, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyMemberDef prefetch_members[] = {
+    {(char*)"depth", T_UINT, offsetof(PrefetchObject, depth), READONLY, (char*)"frames queued at most"},
+    {NULL, 0, 0, 0, NULL}
+};
+
+static PyGetSetDef prefetch_getset[] = {
+    {(char*)"ended", (getter)prefetch_get_ended, NULL, (char*)"the stream or the prefetch stopped, nothing queued", \
+        NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+//Camera
+
+static PyObject* camera_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    (void)args;
+    (void)kwds;
+    CameraObject* camera = (CameraObject*)type->tp_alloc(type, 0);
+    if (camera == NULL)
+    {
+        return NULL;
+    }
+    camera->handle = simple_camera_create();
+    if (camera->handle == NULL)
+    {
+        Py_DECREF(camera);
+        return PyErr_NoMemory();
+    }
+    pthread_mutex_init(&camera->mutex, NULL);
+    return (PyObject*)camera;
+}
+
+static void camera_shutdown(CameraObject* camera)
+{
+    if (camera->streaming)
+    {
+        Py_BEGIN_ALLOW_THREADS
+        pthread_mutex_lock(&camera->mutex);
+        simple_camera_stop_stream(camera->handle);
+        pthread_mutex_unlock(&camera->mutex);
+        Py_END_ALLOW_THREADS
+        camera->streaming = 0;
+        camera->generation++;
+    }
+    if (camera->opened)
+    {
+        Py_BEGIN_ALLOW_THREADS
+        simple_camera_close(camera->handle);
+        Py_END_ALLOW_THREADS
+        camera->opened = 0;
+    }
+}
+
+static void camera_dealloc(CameraObject* camera)
+{
+    //frames keep the camera alive, none is left here
+    if (camera->handle != NULL)
+    {
+        camera_shutdown(camera);
+        simple_camera_destroy(camera->handle);
+        pthread_mutex_destroy(&camera->mutex);
+    }
+    Py_TYPE(camera)->tp_free((PyObject*)camera);
+}
+
+static PyObject* camera_open(CameraObject* camera, PyObject* unused)
+{
+    (void)unused;
+    if (camera->opened)
+    {
+        Py_RETURN_NONE;
+    }
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    ret = simple_camera_open(camera->handle);
+    Py_END_ALLOW_THREADS
+    if (ret != 0)
+    {
+        return camera_error("simple_camera_open", ret);
+    }
+    camera->opened = 1;
+    Py_RETURN_NONE;
+}
+
+static PyObject* camera_open_source(CameraObject* camera, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = {"source", "path", NULL};
+    const char* source = NULL;
+    const char* path = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|z", (char**)kwlist, &source, &path))
+    {
+        return NULL;
+    }
+    int source_type;
+    if (strcmp(source, "replay") == 0)
+    {
+        source_type = SIMPLE_CAMERA_SOURCE_REPLAY;
+    }
+    else if (strcmp(source, "synth") == 0)
+    {
+        source_type = SIMPLE_CAMERA_SOURCE_SYNTH;
+    }
+    else
+    {
+        PyErr_Format(PyExc_ValueError, "unknown source '%s', expected 'replay' or 'synth'", source);
+        return NULL;
+    }
+    if (camera->opened)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "the camera is already open");
+        return NULL;
+    }
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    ret = simple_camera_open_source(camera->handle, source_type, path);
+    Py_END_ALLOW_THREADS
+    if (ret != 0)
+    {
+        return camera_error("simple_camera_open_source", ret);
+    }
+    camera->opened = 1;
+    Py_RETURN_NONE;
+}
+
+static PyObject* camera_start_stream(CameraObject* camera, PyObject* unused)
+{
+    (void)unused;
+    if (!camera->opened)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "the camera is not open");
+        return NULL;
+    }
+    if (camera->streaming)
+    {
+        Py_RETURN_NONE;
+    }
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&camera->mutex);
+    ret = simple_camera_start_stream(camera->handle);
+    pthread_mutex_unlock(&camera->mutex);
+    Py_END_ALLOW_THREADS
+    if (ret != 0)
+    {
+        return camera_error("simple_camera_start_stream", ret);
+    }
+    camera->streaming = 1;
+    Py_RETURN_NONE;
+}
+
+static PyObject* camera_stop_stream(CameraObject* camera, PyObject* unused)
+{
+    (void)unused;
+    if (camera->exports > 0)
+    {
+        PyErr_SetString(PyExc_BufferError, "views of leased frames are still alive");
+        return NULL;
+    }
+    if (camera->prefetchers > 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "close the frames() iterators first");
+        return NULL;
+    }
+    if (camera->streaming)
+    {
+        Py_BEGIN_ALLOW_THREADS
+        pthread_mutex_lock(&camera->mutex);
+        simple_camera_stop_stream(camera->handle);
+        pthread_mutex_unlock(&camera->mutex);
+        Py_END_ALLOW_THREADS
+        camera->streaming = 0;
+        camera->generation++;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* camera_close(CameraObject* camera, PyObject* unused)
+{
+    (void)unused;
+    if (camera->exports > 0)
+    {
+        PyErr_SetString(PyExc_BufferError, "views of leased frames are still alive");
+        return NULL;
+    }
+    if (camera->prefetchers > 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "close the frames() iterators first");
+        return NULL;
+    }
+    camera_shutdown(camera);
+    Py_RETURN_NONE;
+}
+
+static PyObject* camera_acquire(CameraObject* camera, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = {"timeout_ms", NULL};
+    unsigned int timeout_ms = NATIVE_DEFAULT_TIMEOUT_MS;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|I", (char**)kwlist, &timeout_ms))
+    {
+        return NULL;
+    }
+    if (!camera->streaming)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "the camera is not streaming");
+        return NULL;
+    }
+
+    SimpleCameraFrameLease_t lease;
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&camera->mutex);
+    ret = simple_camera_acquire_temp_frame(camera->handle, timeout_ms, &lease);
+    pthread_mutex_unlock(&camera->mutex);
+    Py_END_ALLOW_THREADS
+    if (ret == SIMPLE_CAMERA_TIMEOUT || ret == SIMPLE_CAMERA_CLOSED)
+    {
+        Py_RETURN_NONE;
+    }
+    if (ret == SIMPLE_CAMERA_BUSY)
+    {
+        PyErr_SetString(PyExc_BufferError, "every lease is in use, release a frame first");
+        return NULL;
+    }
+    if (ret != 0)
+    {
+        return camera_error("simple_camera_acquire_temp_frame", ret);
+    }
+
+    PyObject* frame = frame_of_lease(camera, &lease);
+    if (frame == NULL)
+    {
+        camera_lock(camera);
+        simple_camera_release_temp_frame(camera->handle, lease.token);
+        camera_unlock(camera);
+    }
+    return frame;
+}
+
+static PyObject* camera_frames(CameraObject* camera, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = {"prefetch", NULL};
+    unsigned int depth = PREFETCH_DEFAULT_DEPTH;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|I", (char**)kwlist, &depth))
+    {
+        return NULL;
+    }
+    if (depth == 0 || depth > SIMPLE_CAMERA_MAX_LEASES)
+    {
+        PyErr_Format(PyExc_ValueError, "prefetch must be in [1, %d]", SIMPLE_CAMERA_MAX_LEASES);
+        return NULL;
+    }
+    if (!camera->streaming)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "the camera is not streaming");
+        return NULL;
+    }
+    return prefetch_start(camera, depth);
+}
+
+static PyObject* camera_get_frames(CameraObject* camera, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = {"n", "out", "timeout_ms", NULL};
+    unsigned int n = 0;
+    PyObject* out = NULL;
+    unsigned int timeout_ms = NATIVE_DEFAULT_TIMEOUT_MS;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "I|OI", (char**)kwlist, &n, &out, &timeout_ms))
+    {
+        return NULL;
+    }
+    if (n == 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "n must be positive");
+        return NULL;
+    }
+    if (!camera->streaming)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "the camera is not streaming");
+        return NULL;
+    }
+    uint32_t width = 0, height = 0;
+    simple_camera_get_temp_size(camera->handle, &width, &height);
+    Py_ssize_t frame_bytes = (Py_ssize_t)width * height * 2;
+
+    //(n, height, width) uint16, a new bytearray or the caller's writable buffer
+    PyObject* result = NULL;
+    Py_buffer out_view;
+    if (out == NULL || out == Py_None)
+    {
+        PyObject* bytes = PyByteArray_FromStringAndSize(NULL, frame_bytes * n);
+        PyObject* view = (bytes != NULL) ? PyMemoryView_FromObject(bytes) : NULL;
+        Py_XDECREF(bytes);
+        PyObject* shape = (view != NULL) ? Py_BuildValue("(III)", n, height, width) : NULL;
+        result = (shape != NULL) ? PyObject_CallMethod(view, "cast", "sO", "H", shape) : NULL;
+        Py_XDECREF(shape);
+        Py_XDECREF(view);
+    }
+    else
+    {
+        Py_INCREF(out);
+        result = out;
+    }
+    if (result == NULL || PyObject_GetBuffer(result, &out_view, PyBUF_CONTIG) != 0)
+    {
+        Py_XDECREF(result);
+        return NULL;
+    }
+    if (out_view.len < frame_bytes * n)
+    {
+        PyErr_Format(PyExc_ValueError, "out holds %zd bytes, %u frames need %zd", out_view.len, n, frame_bytes * n);
+        PyBuffer_Release(&out_view);
+        Py_DECREF(result);
+        return NULL;
+    }
+    SimpleCameraFrameMeta_t* meta = (SimpleCameraFrameMeta_t*)PyMem_Malloc(n * sizeof(SimpleCameraFrameMeta_t));
+    if (meta == NULL)
+    {
+        PyBuffer_Release(&out_view);
+        Py_DECREF(result);
+        return PyErr_NoMemory();
+    }
+
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&camera->mutex);
+    ret = simple_camera_get_frames(camera->handle, n, (uint16_t*)out_view.buf, width * 2, timeout_ms, meta);
+    pthread_mutex_unlock(&camera->mutex);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&out_view);
+    if (ret < 0 && ret != SIMPLE_CAMERA_TIMEOUT && ret != SIMPLE_CAMERA_CLOSED)
+    {
+        PyMem_Free(meta);
+        Py_DECREF(result);
+        return camera_error("simple_camera_get_frames", ret);
+    }
+
+    //fewer than n frames on timeout or when the stream ended, the rest of out is untouched
+    int cnt = (ret > 0) ? ret : 0;
+    PyObject* metas = PyList_New(cnt);
+    for (int i = 0; metas != NULL && i < cnt; i++)
+    {
+        PyList_SET_ITEM(metas, i, Py_BuildValue("(KK)", (unsigned long long)meta[i].seq, \
+            (unsigned long long)meta[i].timestamp_us));
+    }
+    PyMem_Free(meta);
+    if (metas == NULL)
+    {
+        Py_DECREF(result);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", result, metas);
+}
+
+static PyObject* camera_info(CameraObject* camera, PyObject* unused)
+{
+    (void)unused;
+    uint32_t width = 0, height = 0, fps = 0;
+    simple_camera_get_info(camera->handle, &width, &height, &fps);
+    return Py_BuildValue("(III)", width, height, fps);
+}
+
+static PyObject* camera_temp_size(CameraObject* camera, PyObject* unused)
+{
+    (void)unused;
+    uint32_t width = 0, height = 0;
+    simple_camera_get_temp_size(camera->handle, &width, &height);
+    return Py_BuildValue("(II)", width, height);
+}
+
+static PyObject* camera_frame_stats(CameraObject* camera, PyObject* unused)
+{
+    (void)unused;
+    uint64_t frames = 0, dropped = 0;
+    camera_lock(camera);
+    simple_camera_get_frame_stats(camera->handle, &frames, &dropped);
+    camera_unlock(camera);
+    return Py_BuildValue("(KK)", (unsigned long long)frames, (unsigned long long)dropped);
+}
+
+static PyObject* camera_fileno(CameraObject* camera, PyObject* unused)
+{
+    (void)unused;
+    if (!camera->streaming)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "the camera is not streaming");
+        return NULL;
+    }
+    camera_lock(camera);
+    int fd = simple_camera_get_ready_fd(camera->handle);
+    camera_unlock(camera);
+    if (fd < 0)
+    {
+        return camera_error("simple_camera_get_ready_fd", fd);
+    }
+    return PyLong_FromLong(fd);
+}
+
+static PyObject* camera_get_streaming(CameraObject* camera, void* closure)
+{
+    (void)closure;
+    return PyBool_FromLong(camera->streaming);
+}
+
+static PyMethodDef camera_methods[] = {
+    {"open", (PyCFunction)camera_open, METH_NOARGS, "open the uvc camera"},
+    {"open_source", (PyCFunction)(void(*)(void))camera_open_source, METH_VARARGS | METH_KEYWORDS, \
+        "open_source('replay', path) or open_source('synth'): frames without a camera"},
+    {"close", (PyCFunction)camera_close, METH_NOARGS, "stop streaming and close"},
+    {"start_stream", (PyCFunction)camera_start_stream, METH_NOARGS, NULL},
+    {"stop_stream", (PyCFunction)camera_stop_stream, METH_NOARGS, "every lease goes back, no view may be alive"},
+    {"acquire", (PyCFunction)(void(*)(void))camera_acquire, METH_VARARGS | METH_KEYWORDS, \
+        "acquire(timeout_ms=1000): lease the newest temp frame, None on timeout or when the stream ended"},
+    {"get_frames", (PyCFunction)(void(*)(void))camera_get_frames, METH_VARARGS | METH_KEYWORDS, \
+        "get_frames(n, out=None, timeout_ms=1000): copy n temp frames into one (n, height, width) uint16 buffer, "
+        "returns (buffer, [(seq, timestamp_us), ...]), fewer entries on timeout"},
+    {"frames", (PyCFunction)(void(*)(void))camera_frames, METH_VARARGS | METH_KEYWORDS, \
+        "frames(prefetch=4): a native thread leases frames ahead into a queue of prefetch, the oldest dropped when "
+        "full; iterate with for or async for, ends with the stream"},
+    {"fileno", (PyCFunction)camera_fileno, METH_NOARGS, \
+        "readiness fd for select/asyncio add_reader, then acquire(0); wakeups may be spurious, do not close it"},
+    {"info", (PyCFunction)camera_info, METH_NOARGS, "(width, height, fps) of the raw frame"},
+    {"temp_size", (PyCFunction)camera_temp_size, METH_NOARGS, "(width, height) of the temp plane"},
+    {"frame_stats", (PyCFunction)camera_frame_stats, METH_NOARGS, "(frames, dropped) of this reader"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef camera_getset[] = {
+    {(char*)"streaming", (getter)camera_get_streaming, NULL, NULL, NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+//Bus
+
+static PyObject* bus_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = {"name", NULL};
+    const char* name = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|z", (char**)kwlist, &name))
+    {
+        return NULL;
+    }
+    BusObject* bus = (BusObject*)type->tp_alloc(type, 0);
+    if (bus == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_init(&bus->mutex, NULL);
+    int ret = bus_reader_open(&bus->reader, name);
+    if (ret == BUS_SUCCESS && bus->reader.header->temp.byte_size == 0)
+    {
+        bus_reader_close(&bus->reader);
+        Py_DECREF(bus);
+        PyErr_SetString(PyExc_RuntimeError, "the bus carries no temp plane");
+        return NULL;
+    }
+    if (ret != BUS_SUCCESS)
+    {
+        Py_DECREF(bus);
+        PyErr_Format(PyExc_RuntimeError, "bus_reader_open %s failed: %d (is the pipeline running with its bus?)", \
+            (name != NULL) ? name : BUS_DEFAULT_NAME, ret);
+        return NULL;
+    }
+    bus->opened = 1;
+    return (PyObject*)bus;
+}
+
+static void bus_dealloc(BusObject* bus)
+{
+    //frames keep the bus alive, none is left here
+    if (bus->opened)
+    {
+        bus_reader_close(&bus->reader);
+        bus->opened = 0;
+    }
+    pthread_mutex_destroy(&bus->mutex);
+    Py_TYPE(bus)->tp_free((PyObject*)bus);
+}
+
+static PyObject* bus_close(BusObject* bus, PyObject* unused)
+{
+    (void)unused;
+    if (bus->exports > 0)
+    {
+        PyErr_SetString(PyExc_BufferError, "views of leased frames are still alive");
+        return NULL;
+    }
+    if (bus->opened)
+    {
+        Py_BEGIN_ALLOW_THREADS
+        pthread_mutex_lock(&bus->mutex);
+        bus_reader_close(&bus->reader);
+        pthread_mutex_unlock(&bus->mutex);
+        Py_END_ALLOW_THREADS
+        bus->opened = 0;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* bus_acquire(BusObject* bus, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = {"timeout_ms", NULL};
+    unsigned int timeout_ms = NATIVE_DEFAULT_TIMEOUT_MS;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|I", (char**)kwlist, &timeout_ms))
+    {
+        return NULL;
+    }
+    if (!bus->opened)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "the bus is closed");
+        return NULL;
+    }
+
+    BusFrame_t bus_frame;
+    int ret;
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&bus->mutex);
+    ret = bus_reader_acquire(&bus->reader, timeout_ms, &bus_frame);
+    pthread_mutex_unlock(&bus->mutex);
+    Py_END_ALLOW_THREADS
+    if (ret == BUS_ERROR_TIMEOUT || ret == BUS_ERROR_CLOSED)
+    {
+        Py_RETURN_NONE;
+    }
+    if (ret != BUS_SUCCESS)
+    {
+        return camera_error("bus_reader_acquire", ret);
+    }
+
+    FrameObject* frame = PyObject_New(FrameObject, &FrameType);
+    if (frame == NULL)
+    {
+        bus_reader_release(&bus->reader, &bus_frame);
+        return NULL;
+    }
+    const BusPlane_t* temp = &bus->reader.header->temp;
+    Py_INCREF(bus);
+    frame->camera = NULL;
+    frame->bus = bus;
+    frame->bus_frame = bus_frame;
+    frame->lease.data = (uint16_t*)bus_frame.temp;
+    frame->lease.width = temp->width;
+    frame->lease.height = temp->height;
+    frame->lease.stride = temp->stride;
+    frame->lease.seq = bus_frame.seq;
+    frame->lease.timestamp_us = bus_frame.timestamp_us;
+    frame->lease.token = (uint64_t)bus_frame.slot + 1;
+    frame->generation = 0;
+    frame->exports = 0;
+    frame->shape[0] = temp->height;
+    frame->shape[1] = temp->width;
+    frame->strides[0] = temp->stride;
+    frame->strides[1] = 2;
+    return (PyObject*)frame;
+}
+
+static PyObject* bus_info(BusObject* bus, PyObject* unused)
+{
+    (void)unused;
+    if (!bus->opened)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "the bus is closed");
+        return NULL;
+    }
+    const BusHeader_t* header = bus->reader.header;
+    return Py_BuildValue("(III)", header->temp.width, header->temp.height, header->fps);
+}
+
+static PyObject* bus_frame_stats(BusObject* bus, PyObject* unused)
+{
+    (void)unused;
+    return Py_BuildValue("(KK)", (unsigned long long)bus->reader.frames, (unsigned long long)bus->reader.skipped);
+}
+
+static PyObject* bus_get_streaming(BusObject* bus, void* closure)
+{
+    (void)closure;
+    return PyBool_FromLong(bus->opened && !bus->reader.header->closed.load());
+}
+
+static PyMethodDef bus_methods[] = {
+    {"close", (PyCFunction)bus_close, METH_NOARGS, "every lease goes back, no view may be alive"},
+    {"acquire", (PyCFunction)(void(*)(void))bus_acquire, METH_VARARGS | METH_KEYWORDS, \
+        "acquire(timeout_ms=1000): the next Frame, None on timeout or once the publisher stopped"},
+    {"info", (PyCFunction)bus_info, METH_NOARGS, "(width, height, fps) of the temp plane"},
+    {"frame_stats", (PyCFunction)bus_frame_stats, METH_NOARGS, "(frames, skipped) of this reader"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef bus_getset[] = {
+    {(char*)"streaming", (getter)bus_get_streaming, NULL, (char*)"open and the publisher still running", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+//module functions, any buffer of uint16 Y14 values: a Frame, a numpy array, an array('H')
+
+//a 1d or 2d uint16 buffer, rows may be padded
+static int native_get_y14(PyObject* obj, Py_buffer* view, Py_ssize_t* width, Py_ssize_t* height, Py_ssize_t* stride)
+{
+    if (PyObject_GetBuffer(obj, view, PyBUF_STRIDES | PyBUF_FORMAT) != 0)
+    {
+        return -1;
+    }
+    const char* format = view->format ? view->format : "B";
+    if (format[0] == '<' || format[0] == '=' || format[0] == '@')
+    {
+        format++;
+    }
+    if (view->itemsize != 2 || (strcmp(format, "H") != 0 && strcmp(format, "h") != 0))
+    {
+        PyErr_Format(PyExc_TypeError, "expected a uint16 buffer, got format '%s'", view->format ? view->format : "B");
+        PyBuffer_Release(view);
+        return -1;
+    }
+    if (view->ndim == 1 && view->strides[0] == 2)
+    {
+        *width = view->shape[0];
+        *height = 1;
+        *stride = view->shape[0] * 2;
+    }
+    else if (view->ndim == 2 && view->strides[1] == 2 && view->strides[0] >= view->shape[1] * 2)
+    {
+        *width = view->shape[1];
+        *height = view->shape[0];
+        *stride = view->strides[0];
+    }
+    else
+    {
+        PyErr_SetString(PyExc_ValueError, "expected a 1d or 2d buffer with contiguous rows");
+        PyBuffer_Release(view);
+        return -1;
+    }
+    return 0;
+}
+
+//the output as a memoryview of a new bytearray, or the caller's writable buffer of the same shape
+static PyObject* native_output(PyObject* out, Py_ssize_t width, Py_ssize_t height, int ndim, \
+    const char* format, Py_ssize_t itemsize, Py_buffer* out_view)
+{
+    if (out == NULL || out == Py_None)
+    {
+        PyObject* bytes = PyByteArray_FromStringAndSize(NULL, width * height * itemsize);
+        if (bytes == NULL)
+        {
+            return NULL;
+        }
+        PyObject* view = PyMemoryView_FromObject(bytes);
+        Py_DECREF(bytes);
+        if (view == NULL)
+        {
+            return NULL;
+        }
+        PyObject* shape = (ndim == 2) ? Py_BuildValue("(nn)", height, width) : Py_BuildValue("(n)", width);
+        PyObject* cast = (shape != NULL) ? PyObject_CallMethod(view, "cast", "sO", format, shape) : NULL;
+        Py_XDECREF(shape);
+        Py_DECREF(view);
+        if (cast == NULL || PyObject_GetBuffer(cast, out_view, PyBUF_CONTIG) != 0)
+        {
+            Py_XDECREF(cast);
+            return NULL;
+        }
+        return cast;
+    }
+    if (PyObject_GetBuffer(out, out_view, PyBUF_CONTIG) != 0)
+    {
+        return NULL;
+    }
+    if (out_view->len != width * height * itemsize)
+    {
+        PyErr_Format(PyExc_ValueError, "out holds %zd bytes, expected %zd", out_view->len, width * height * itemsize);
+        PyBuffer_Release(out_view);
+        return NULL;
+    }
+    Py_INCREF(out);
+    return out;
+}
+
+static PyObject* native_convert(PyObject* args, PyObject* kwds, int centi)
+{
+    static const char* kwlist[] = {"src", "out", "env_correct", NULL};
+    PyObject* src = NULL;
+    PyObject* out = NULL;
+    int env_correct = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|Op", (char**)kwlist, &src, &out, &env_correct))
+    {
+        return NULL;
+    }
+    Py_buffer src_view;
+    Py_ssize_t width, height, stride;
+    if (native_get_y14(src, &src_view, &width, &height, &stride) != 0)
+    {
+        return NULL;
+    }
+    Py_buffer out_view;
+    PyObject* result = native_output(out, width, height, src_view.ndim, centi ? "h" : "f", centi ? 2 : 4, &out_view);
+    if (result == NULL)
+    {
+        PyBuffer_Release(&src_view);
+        return NULL;
+    }
+
+    int ret = 0;
+    Py_BEGIN_ALLOW_THREADS
+    for (Py_ssize_t row = 0; row < height; row++)
+    {
+        const uint16_t* src_row = (const uint16_t*)((const uint8_t*)src_view.buf + row * stride);
+        int rst;
+        if (centi)
+        {
+            rst = simple_camera_temp_to_centi_celsius(src_row, (uint32_t)width, (int16_t*)out_view.buf + row * width, \
+                env_correct);
+        }
+        else
+        {
+            rst = simple_camera_temp_to_celsius(src_row, (uint32_t)width, (float*)out_view.buf + row * width, \
+                env_correct);
+        }
+        if (rst != 0)
+        {
+            ret = rst;
+        }
+    }
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&out_view);
+    PyBuffer_Release(&src_view);
+    if (ret != 0)
+    {
+        //the values are written uncorrected
+        PyErr_WarnEx(PyExc_RuntimeWarning, "no environment correction table, values are uncorrected", 1);
+    }
+    return result;
+}
+
+static PyObject* native_to_celsius(PyObject* self, PyObject* args, PyObject* kwds)
+{
+    (void)self;
+    return native_convert(args, kwds, 0);
+}
+
+static PyObject* native_to_centi_celsius(PyObject* self, PyObject* args, PyObject* kwds)
+{
+    (void)self;
+    return native_convert(args, kwds, 1);
+}
+
+static PyObject* native_roi_stats(PyObject* self, PyObject* args)
+{
+    (void)self;
+    PyObject* src = NULL;
+    PyObject* rects = NULL;
+    if (!PyArg_ParseTuple(args, "OO", &src, &rects))
+    {
+        return NULL;
+    }
+    PyObject* seq = PySequence_Fast(rects, "rects must be a sequence of (x, y, w, h)");
+    if (seq == NULL)
+    {
+        return NULL;
+    }
+    Py_ssize_t rect_num = PySequence_Fast_GET_SIZE(seq);
+    int* coords = (int*)PyMem_Malloc((rect_num > 0 ? rect_num : 1) * 4 * sizeof(int));
+    SimpleCameraRoiStats_t* stats = (SimpleCameraRoiStats_t*)PyMem_Malloc((rect_num > 0 ? rect_num : 1) * \
+        sizeof(SimpleCameraRoiStats_t));
+    int* found = (int*)PyMem_Malloc((rect_num > 0 ? rect_num : 1) * sizeof(int));
+    if (coords == NULL || stats == NULL || found == NULL)
+    {
+        PyMem_Free(coords);
+        PyMem_Free(stats);
+        PyMem_Free(found);
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+    for (Py_ssize_t i = 0; i < rect_num; i++)
+    {
+        PyObject* rect = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyArg_ParseTuple(rect, "iiii;each rect is a tuple (x, y, w, h)", &coords[i * 4], &coords[i * 4 + 1], \
+            &coords[i * 4 + 2], &coords[i * 4 + 3]))
+        {
+            PyMem_Free(coords);
+            PyMem_Free(stats);
+            PyMem_Free(found);
+            Py_DECREF(seq);
+            return NULL;
+        }
+    }
+    Py_DECREF(seq);
+
+    Py_buffer src_view;
+    Py_ssize_t width, height, stride;
+    if (native_get_y14(src, &src_view, &width, &height, &stride) != 0)
+    {
+        PyMem_Free(coords);
+        PyMem_Free(stats);
+        PyMem_Free(found);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    for (Py_ssize_t i = 0; i < rect_num; i++)
+    {
+        found[i] = (simple_camera_roi_stats((const uint16_t*)src_view.buf, (uint32_t)width, (uint32_t)height, \
+            (uint32_t)stride, coords[i * 4], coords[i * 4 + 1], coords[i * 4 + 2], coords[i * 4 + 3], &stats[i]) == 0);
+    }
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&src_view);
+
+    //rects outside the frame give None
+    PyObject* result = PyList_New(rect_num);
+    for (Py_ssize_t i = 0; result != NULL && i < rect_num; i++)
+    {
+        if (!found[i])
+        {
+            Py_INCREF(Py_None);
+            PyList_SET_ITEM(result, i, Py_None);
+            continue;
+        }
+        PyObject* item = PyStructSequence_New(&RoiStatsType);
+        if (item == NULL)
+        {
+            Py_CLEAR(result);
+            break;
+        }
+        const SimpleCameraRoiStats_t* s = &stats[i];
+        PyStructSequence_SET_ITEM(item, 0, PyLong_FromLong(s->min_val));
+        PyStructSequence_SET_ITEM(item, 1, PyLong_FromLong(s->max_val));
+        PyStructSequence_SET_ITEM(item, 2, PyLong_FromLong(s->min_x));
+        PyStructSequence_SET_ITEM(item, 3, PyLong_FromLong(s->min_y));
+        PyStructSequence_SET_ITEM(item, 4, PyLong_FromLong(s->max_x));
+        PyStructSequence_SET_ITEM(item, 5, PyLong_FromLong(s->max_y));
+        PyStructSequence_SET_ITEM(item, 6, PyLong_FromUnsignedLong(s->pix_num));
+        PyStructSequence_SET_ITEM(item, 7, PyFloat_FromDouble(s->mean));
+        PyStructSequence_SET_ITEM(item, 8, PyFloat_FromDouble(temp_value_converter(s->min_val)));
+        PyStructSequence_SET_ITEM(item, 9, PyFloat_FromDouble(temp_value_converter(s->max_val)));
+        PyStructSequence_SET_ITEM(item, 10, PyFloat_FromDouble(temp_value_converter((uint16_t)(s->mean + 0.5f))));
+        PyList_SET_ITEM(result, i, item);
+    }
+    PyMem_Free(coords);
+    PyMem_Free(stats);
+    PyMem_Free(found);
+    return result;
+}
+
+static PyObject* native_y14_to_celsius(PyObject* self, PyObject* arg)
+{
+    (void)self;
+    unsigned long val = PyLong_AsUnsignedLong(arg);
+    if (PyErr_Occurred())
+    {
+        return NULL;
+    }
+    return PyFloat_FromDouble(temp_value_converter((uint16_t)val));
+}
+
+static PyMethodDef native_methods[] = {
+    {"to_celsius", (PyCFunction)(void(*)(void))native_to_celsius, METH_VARARGS | METH_KEYWORDS, \
+        "to_celsius(src, out=None, env_correct=False): float32 celsius of a uint16 Y14 buffer, same shape"},
+    {"to_centi_celsius", (PyCFunction)(void(*)(void))native_to_centi_celsius, METH_VARARGS | METH_KEYWORDS, \
+        "to_centi_celsius(src, out=None, env_correct=False): int16 0.01 celsius, saturated"},
+    {"roi_stats", (PyCFunction)native_roi_stats, METH_VARARGS, \
+        "roi_stats(src, rects): RoiStats per (x, y, w, h), None for a rect outside the frame"},
+    {"y14_to_celsius", (PyCFunction)native_y14_to_celsius, METH_O, "one Y14 value in celsius"},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef native_module = {
+    PyModuleDef_HEAD_INIT,
+    "thermal_camera_native",
+    "zero copy access to the camera's temp frames",
+    -1,
+    native_methods,
+    NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_thermal_camera_native(void)
+{
+    CameraType.tp_name = "thermal_camera_native.Camera";
+    CameraType.tp_basicsize = sizeof(CameraObject);
+    CameraType.tp_flags = Py_TPFLAGS_DEFAULT;
+    CameraType.tp_doc = "Camera(): open() or open_source(), start_stream(), then acquire() frames";
+    CameraType.tp_new = camera_new;
+    CameraType.tp_dealloc = (destructor)camera_dealloc;
+    CameraType.tp_methods = camera_methods;
+    CameraType.tp_getset = camera_getset;
+
+    BusType.tp_name = "thermal_camera_native.Bus";
+    BusType.tp_basicsize = sizeof(BusObject);
+    BusType.tp_flags = Py_TPFLAGS_DEFAULT;
+    BusType.tp_doc = "Bus(name=None): attach to a running pipeline's frame bus, then acquire() frames";
+    BusType.tp_new = bus_new;
+    BusType.tp_dealloc = (destructor)bus_dealloc;
+    BusType.tp_methods = bus_methods;
+    BusType.tp_getset = bus_getset;
+
+    FrameType.tp_name = "thermal_camera_native.Frame";
+    FrameType.tp_basicsize = sizeof(FrameObject);
+    FrameType.tp_flags = Py_TPFLAGS_DEFAULT;
+    FrameType.tp_doc = "a leased temp frame, a read only (height, width) uint16 buffer until released";
+    FrameType.tp_dealloc = (destructor)frame_dealloc;
+    FrameType.tp_repr = (reprfunc)frame_repr;
+    FrameType.tp_as_buffer = &frame_as_buffer;
+    FrameType.tp_methods = frame_methods;
+    FrameType.tp_members = frame_members;
+    FrameType.tp_getset = frame_getset;
+
+    PrefetchType.tp_name = "thermal_camera_native.Prefetch";
+    PrefetchType.tp_basicsize = sizeof(PrefetchObject);
+    PrefetchType.tp_flags = Py_TPFLAGS_DEFAULT;
+    PrefetchType.tp_doc = "Camera.frames(): prefetched frames for for, async for, get() or fileno() + get_nowait()";
+    PrefetchType.tp_dealloc = (destructor)prefetch_dealloc;
+    PrefetchType.tp_as_async = &prefetch_as_async;
+    PrefetchType.tp_iter = PyObject_SelfIter;
+    PrefetchType.tp_iternext = (iternextfunc)prefetch_next;
+    PrefetchType.tp_methods = prefetch_methods;
+    PrefetchType.tp_members = prefetch_members;
+    PrefetchType.tp_getset = prefetch_getset;
+
+    if (PyType_Ready(&CameraType) < 0 || PyType_Ready(&BusType) < 0 || PyType_Ready(&FrameType) < 0 || \
+        PyType_Ready(&PrefetchType) < 0)
+    {
+        return NULL;
+    }
+    if (FrameStatsType.tp_name == NULL && PyStructSequence_InitType2(&FrameStatsType, &frame_stats_desc) < 0)
+    {
+        return NULL;
+    }
+    if (RoiStatsType.tp_name == NULL && PyStructSequence_InitType2(&RoiStatsType, &roi_stats_desc) < 0)
+    {
+        return NULL;
+    }
+    if (BlobType.tp_name == NULL && PyStructSequence_InitType2(&BlobType, &blob_desc) < 0)
+    {
+        return NULL;
+    }
+
+    PyObject* module = PyModule_Create(&native_module);
+    if (module == NULL)
+    {
+        return NULL;
+    }
+    Py_INCREF(&CameraType);
+    PyModule_AddObject(module, "Camera", (PyObject*)&CameraType);
+    Py_INCREF(&BusType);
+    PyModule_AddObject(module, "Bus", (PyObject*)&BusType);
+    Py_INCREF(&FrameType);
+    PyModule_AddObject(module, "Frame", (PyObject*)&FrameType);
+    Py_INCREF(&PrefetchType);
+    PyModule_AddObject(module, "Prefetch", (PyObject*)&PrefetchType);
+    Py_INCREF(&FrameStatsType);
+    PyModule_AddObject(module, "FrameStats", (PyObject*)&FrameStatsType);
+    Py_INCREF(&RoiStatsType);
+    PyModule_AddObject(module, "RoiStats", (PyObject*)&RoiStatsType);
+    Py_INCREF(&BlobType);
+    PyModule_AddObject(module, "Blob", (PyObject*)&BlobType);
+    PyModule_AddIntConstant(module, "MAX_LEASES", SIMPLE_CAMERA_MAX_LEASES);
+    return module;
+}
@@ -0,0 +1,453 @@
+#include "queue.h"
+#include "memacct.h"
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+#define QUEUE_CELL_HEADER 8             //the cell's sequence number, the element follows
+
+static void queue_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static uint32_t queue_capacity_round(uint32_t capacity)
+{
+    uint32_t rounded = 2;
+    while (rounded < capacity)
+    {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+//one deadline for the whole _wait call, NULL for forever
+static const sync_deadline_t* queue_deadline(sync_deadline_t* deadline, int timeout_ms)
+{
+    if (timeout_ms < 0)
+    {
+        return NULL;
+    }
+    sync_deadline_set(deadline, (uint32_t)timeout_ms);
+    return deadline;
+}
+
+void eventcount_init(EventCount_t* ec)
+{
+    ec->state.store(0);
+    sync_mutex_init(&ec->mutex);
+    sync_cond_init(&ec->cond);
+}
+
+void eventcount_destroy(EventCount_t* ec)
+{
+    sync_cond_destroy(&ec->cond);
+    sync_mutex_destroy(&ec->mutex);
+}
+
+uint32_t eventcount_prepare_wait(EventCount_t* ec)
+{
+    //seq_cst: the waiter count is visible before the condition is read again
+    uint64_t prev = ec->state.fetch_add(1, std::memory_order_seq_cst);
+    return (uint32_t)(prev >> 32);
+}
+
+void eventcount_cancel_wait(EventCount_t* ec)
+{
+    ec->state.fetch_sub(1, std::memory_order_relaxed);
+}
+
+int eventcount_wait(EventCount_t* ec, uint32_t key, const sync_deadline_t* deadline)
+{
+    int rst = QUEUE_SUCCESS;
+    sync_mutex_lock(&ec->mutex);
+    while ((uint32_t)(ec->state.load(std::memory_order_acquire) >> 32) == key)
+    {
+        if (deadline == NULL)
+        {
+            sync_cond_wait(&ec->cond, &ec->mutex);
+        }
+        else if (sync_cond_wait_until(&ec->cond, &ec->mutex, deadline) == SYNC_TIMEOUT)
+        {
+            rst = ((uint32_t)(ec->state.load(std::memory_order_acquire) >> 32) == key) ? QUEUE_ERROR_TIMEOUT : \
+                QUEUE_SUCCESS;
+            break;
+        }
+    }
+    sync_mutex_unlock(&ec->mutex);
+    ec->state.fetch_sub(1, std::memory_order_relaxed);
+    return rst;
+}
+
+void eventcount_notify(EventCount_t* ec)
+{
+    //pairs with the seq_cst of prepare_wait: either the waiter sees the change or this sees the waiter
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if ((uint32_t)ec->state.load(std::memory_order_relaxed) == 0)
+    {
+        return;
+    }
+    ec->state.fetch_add(1ull << 32, std::memory_order_release);
+    //a waiter between its epoch check and its sleep holds the mutex, the broadcast comes after it sleeps
+    sync_mutex_lock(&ec->mutex);
+    sync_cond_broadcast(&ec->cond);
+    sync_mutex_unlock(&ec->mutex);
+}
+
+int spsc_queue_init(SpscQueue_t* queue, uint32_t capacity, uint32_t elem_size)
+{
+    if (queue == NULL || capacity == 0 || capacity > QUEUE_MAX_CAPACITY || elem_size == 0)
+    {
+        return QUEUE_ERROR_PARAM;
+    }
+    capacity = queue_capacity_round(capacity);
+    queue->buffer = (uint8_t*)malloc((size_t)capacity * elem_size);
+    if (queue->buffer == NULL)
+    {
+        return QUEUE_ERROR_MEM;
+    }
+    mem_acct_add(MEM_CLASS_OTHER, (int64_t)capacity * elem_size);
+    queue->head.store(0);
+    queue->tail_cache = 0;
+    queue->tail.store(0);
+    queue->head_cache = 0;
+    queue->mask = capacity - 1;
+    queue->elem_size = elem_size;
+    eventcount_init(&queue->not_empty);
+    eventcount_init(&queue->not_full);
+    return QUEUE_SUCCESS;
+}
+
+void spsc_queue_release(SpscQueue_t* queue)
+{
+    if (queue == NULL || queue->buffer == NULL)
+    {
+        return;
+    }
+    mem_acct_release(MEM_CLASS_OTHER, (uint64_t)(queue->mask + 1) * queue->elem_size);
+    free(queue->buffer);
+    queue->buffer = NULL;
+    eventcount_destroy(&queue->not_empty);
+    eventcount_destroy(&queue->not_full);
+}
+
+int spsc_queue_push(SpscQueue_t* queue, const void* elem)
+{
+    uint32_t tail = queue->tail.load(std::memory_order_relaxed);
+    if (tail - queue->head_cache > queue->mask)
+    {
+        //looks full, read the consumer's line only now
+        queue->head_cache = queue->head.load(std::memory_order_acquire);
+        if (tail - queue->head_cache > queue->mask)
+        {
+            return QUEUE_ERROR_FULL;
+        }
+    }
+    memcpy(queue->buffer + (size_t)(tail & queue->mask) * queue->elem_size, elem, queue->elem_size);
+    queue->tail.store(tail + 1, std::memory_order_release);
+    eventcount_notify(&queue->not_empty);
+    return QUEUE_SUCCESS;
+}
+
+int spsc_queue_pop(SpscQueue_t* queue, void* elem)
+{
+    uint32_t head = queue->head.load(std::memory_order_relaxed);
+    if (head == queue->tail_cache)
+    {
+        queue->tail_cache = queue->tail.load(std::memory_order_acquire);
+        if (head == queue->tail_cache)
+        {
+            return QUEUE_ERROR_EMPTY;
+        }
+    }
+    memcpy(elem, queue->buffer + (size_t)(head & queue->mask) * queue->elem_size, queue->elem_size);
+    queue->head.store(head + 1, std::memory_order_release);
+    eventcount_notify(&queue->not_full);
+    return QUEUE_SUCCESS;
+}
+
+int spsc_queue_push_wait(SpscQueue_t* queue, const void* elem, int timeout_ms)
+{
+    for (int i = 0; i < QUEUE_SPIN; i++)
+    {
+        if (spsc_queue_push(queue, elem) == QUEUE_SUCCESS)
+        {
+            return QUEUE_SUCCESS;
+        }
+        queue_relax();
+    }
+    sync_deadline_t deadline;
+    const sync_deadline_t* until = queue_deadline(&deadline, timeout_ms);
+    while (1)
+    {
+        uint32_t key = eventcount_prepare_wait(&queue->not_full);
+        if (spsc_queue_push(queue, elem) == QUEUE_SUCCESS)
+        {
+            eventcount_cancel_wait(&queue->not_full);
+            return QUEUE_SUCCESS;
+        }
+        if (eventcount_wait(&queue->not_full, key, until) == QUEUE_ERROR_TIMEOUT)
+        {
+            return (spsc_queue_push(queue, elem) == QUEUE_SUCCESS) ? QUEUE_SUCCESS : QUEUE_ERROR_TIMEOUT;
+        }
+    }
+}
+
+int spsc_queue_pop_wait(SpscQueue_t* queue, void* elem, int timeout_ms)
+{
+    for (int i = 0; i < QUEUE_SPIN; i++)
+    {
+        if (spsc_queue_pop(queue, elem) == QUEUE_SUCCESS)
+        {
+            return QUEUE_SUCCESS;
+        }
+        queue_relax();
+    }
+    sync_deadline_t deadline;
+    const sync_deadline_t* until = queue_deadline(&deadline, timeout_ms);
+    while (1)
+    {
+        uint32_t key = eventcount_prepare_wait(&queue->not_empty);
+        if (spsc_queue_pop(queue, elem) == QUEUE_SUCCESS)
+        {
+            eventcount_cancel_wait(&queue->not_empty);
+            return QUEUE_SUCCESS;
+        }
+        if (eventcount_wait(&queue->not_empty, key, until) == QUEUE_ERROR_TIMEOUT)
+        {
+            return (spsc_queue_pop(queue, elem) == QUEUE_SUCCESS) ? QUEUE_SUCCESS : QUEUE_ERROR_TIMEOUT;
+        }
+    }
+}
+
+uint32_t spsc_queue_count(const SpscQueue_t* queue)
+{
+    return queue->tail.load(std::memory_order_acquire) - queue->head.load(std::memory_order_acquire);
+}
+
+static std::atomic<uint32_t>* mpmc_cell_seq(const MpmcQueue_t* queue, uint32_t pos)
+{
+    return (std::atomic<uint32_t>*)(queue->cells + (size_t)(pos & queue->mask) * queue->cell_size);
+}
+
+int mpmc_queue_init(MpmcQueue_t* queue, uint32_t capacity, uint32_t elem_size)
+{
+    if (queue == NULL || capacity == 0 || capacity > QUEUE_MAX_CAPACITY || elem_size == 0 || \
+        elem_size > UINT32_MAX - 2 * QUEUE_CELL_HEADER)
+    {
+        return QUEUE_ERROR_PARAM;
+    }
+    capacity = queue_capacity_round(capacity);
+    queue->mask = capacity - 1;
+    queue->elem_size = elem_size;
+    queue->cell_size = (QUEUE_CELL_HEADER + elem_size + 7) & ~7u;
+    queue->cells = (uint8_t*)malloc((size_t)capacity * queue->cell_size);
+    if (queue->cells == NULL)
+    {
+        return QUEUE_ERROR_MEM;
+    }
+    mem_acct_add(MEM_CLASS_OTHER, (int64_t)capacity * queue->cell_size);
+    //cell i is free for the push at position i
+    for (uint32_t i = 0; i < capacity; i++)
+    {
+        new (queue->cells + (size_t)i * queue->cell_size) std::atomic<uint32_t>(i);
+    }
+    queue->enqueue_pos.store(0);
+    queue->dequeue_pos.store(0);
+    eventcount_init(&queue->not_empty);
+    eventcount_init(&queue->not_full);
+    return QUEUE_SUCCESS;
+}
+
+void mpmc_queue_release(MpmcQueue_t* queue)
+{
+    if (queue == NULL || queue->cells == NULL)
+    {
+        return;
+    }
+    mem_acct_release(MEM_CLASS_OTHER, (uint64_t)(queue->mask + 1) * queue->cell_size);
+    free(queue->cells);
+    queue->cells = NULL;
+    eventcount_destroy(&queue->not_empty);
+    eventcount_destroy(&queue->not_full);
+}
+
+int mpmc_queue_push(MpmcQueue_t* queue, const void* elem)
+{
+    uint32_t pos = queue->enqueue_pos.load(std::memory_order_relaxed);
+    std::atomic<uint32_t>* seq;
+    while (1)
+    {
+        seq = mpmc_cell_seq(queue, pos);
+        int32_t diff = (int32_t)(seq->load(std::memory_order_acquire) - pos);
+        if (diff == 0)
+        {
+            if (queue->enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return QUEUE_ERROR_FULL;    //the cell still holds the element of the previous lap
+        }
+        else
+        {
+            pos = queue->enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    memcpy((uint8_t*)seq + QUEUE_CELL_HEADER, elem, queue->elem_size);
+    seq->store(pos + 1, std::memory_order_release);
+    eventcount_notify(&queue->not_empty);
+    return QUEUE_SUCCESS;
+}
+
+int mpmc_queue_pop(MpmcQueue_t* queue, void* elem)
+{
+    uint32_t pos = queue->dequeue_pos.load(std::memory_order_relaxed);
+    std::atomic<uint32_t>* seq;
+    while (1)
+    {
+        seq = mpmc_cell_seq(queue, pos);
+        int32_t diff = (int32_t)(seq->load(std::memory_order_acquire) - (pos + 1));
+        if (diff == 0)
+        {
+            if (queue->dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return QUEUE_ERROR_EMPTY;
+        }
+        else
+        {
+            pos = queue->dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    memcpy(elem, (const uint8_t*)seq + QUEUE_CELL_HEADER, queue->elem_size);
+    seq->store(pos + queue->mask + 1, std::memory_order_release);
+    eventcount_notify(&queue->not_full);
+    return QUEUE_SUCCESS;
+}
+
+int mpmc_queue_push_wait(MpmcQueue_t* queue, const void* elem, int timeout_ms)
+{
+    for (int i = 0; i < QUEUE_SPIN; i++)
+    {
+        if (mpmc_queue_push(queue, elem) == QUEUE_SUCCESS)
+        {
+            return QUEUE_SUCCESS;
+        }
+        queue_relax();
+    }
+    sync_deadline_t deadline;
+    const sync_deadline_t* until = queue_deadline(&deadline, timeout_ms);
+    while (1)
+    {
+        uint32_t key = eventcount_prepare_wait(&queue->not_full);
+        if (mpmc_queue_push(queue, elem) == QUEUE_SUCCESS)
+        {
+            eventcount_cancel_wait(&queue->not_full);
+            return QUEUE_SUCCESS;
+        }
+        if (eventcount_wait(&queue->not_full, key, until) == QUEUE_ERROR_TIMEOUT)
+        {
+            return (mpmc_queue_push(queue, elem) == QUEUE_SUCCESS) ? QUEUE_SUCCESS : QUEUE_ERROR_TIMEOUT;
+        }
+    }
+}
+
+int mpmc_queue_pop_wait(MpmcQueue_t* queue, void* elem, int timeout_ms)
+{
+    for (int i = 0; i < QUEUE_SPIN; i++)
+    {
+        if (mpmc_queue_pop(queue, elem) == QUEUE_SUCCESS)
+        {
+            return QUEUE_SUCCESS;
+        }
+        queue_relax();
+    }
+    sync_deadline_t deadline;
+    const sync_deadline_t* until = queue_deadline(&deadline, timeout_ms);
+    while (1)
+    {
+        uint32_t key = eventcount_prepare_wait(&queue->not_empty);
+        if (mpmc_queue_pop(queue, elem) == QUEUE_SUCCESS)
+        {
+            eventcount_cancel_wait(&queue->not_empty);
+            return QUEUE_SUCCESS;
+        }
+        if (eventcount_wait(&queue->not_empty, key, until) == QUEUE_ERROR_TIMEOUT)
+        {
+            return (mpmc_queue_pop(queue, elem) == QUEUE_SUCCESS) ? QUEUE_SUCCESS : QUEUE_ERROR_TIMEOUT;
+        }
+    }
+}
+
+uint32_t mpmc_queue_count(const MpmcQueue_t* queue)
+{
+    uint32_t dequeue_pos = queue->dequeue_pos.load(std::memory_order_acquire);
+    uint32_t enqueue_pos = queue->enqueue_pos.load(std::memory_order_acquire);
+    int32_t count = (int32_t)(enqueue_pos - dequeue_pos);
+    return (count < 0) ? 0 : (uint32_t)count;
+}
+
+void triple_buffer_init(TripleBuffer_t* buffer)
+{
+    buffer->middle.store(1);
+    buffer->back = 0;
+    buffer->published = 0;
+    buffer->replaced = 0;
+    buffer->front = 2;
+    buffer->taken = 0;
+}
+
+uint32_t triple_buffer_back(const TripleBuffer_t* buffer)
+{
+    return buffer->back;
+}
+
+int triple_buffer_publish(TripleBuffer_t* buffer)
+{
+    //release: the writes into back are visible before its index, acquire: the consumer is done with what comes back
+    uint32_t prev = buffer->middle.exchange(buffer->back | TRIPLE_BUFFER_FRESH, std::memory_order_acq_rel);
+    buffer->back = prev & ~TRIPLE_BUFFER_FRESH;
+    buffer->published++;
+    if (prev & TRIPLE_BUFFER_FRESH)
+    {
+        buffer->replaced++;
+        return 1;
+    }
+    return 0;
+}
+
+int triple_buffer_take(TripleBuffer_t* buffer)
+{
+    if (!(buffer->middle.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH))
+    {
+        return 0;
+    }
+    uint32_t prev = buffer->middle.exchange(buffer->front, std::memory_order_acq_rel);
+    buffer->front = prev & ~TRIPLE_BUFFER_FRESH;
+    buffer->taken++;
+    return 1;
+}
+
+uint32_t triple_buffer_front(const TripleBuffer_t* buffer)
+{
+    return buffer->front;
+}
+
+int triple_buffer_fresh(const TripleBuffer_t* buffer)
+{
+    return (buffer->middle.load(std::memory_order_acquire) & TRIPLE_BUFFER_FRESH) != 0;
+}
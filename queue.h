@@ -0,0 +1,137 @@
+#ifndef _QUEUE_H_
+#define _QUEUE_H_
+
+//lock free hand-off between pipeline stages, in place of a semaphore pair per stage: a single producer single
+//consumer ring, a bounded multi producer multi consumer queue (a sequence number per cell) and the eventcount
+//both block on. elements are fixed size and copied in and out, the _wait calls poll QUEUE_SPIN times before
+//they sleep and a push or pop only makes a syscall when the other side sleeps
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "sync.h"
+
+#define QUEUE_CACHE_LINE 64             //producer and consumer fields are kept on separate lines
+#define QUEUE_MAX_CAPACITY (1u << 24)
+#define QUEUE_SPIN 128                  //polls of a _wait call before it blocks
+
+#define QUEUE_SUCCESS 0
+#define QUEUE_ERROR_PARAM -1
+#define QUEUE_ERROR_MEM -2
+#define QUEUE_ERROR_FULL -3
+#define QUEUE_ERROR_EMPTY -4
+#define QUEUE_ERROR_TIMEOUT -5
+
+//waiters and an epoch in one word, a notify without waiters is a fence and a load.
+//  key = eventcount_prepare_wait(ec); if (condition) eventcount_cancel_wait(ec); else eventcount_wait(ec, key, NULL);
+typedef struct {
+    std::atomic<uint64_t> state;        //epoch << 32 | waiters
+    sync_mutex_t mutex;
+    sync_cond_t cond;
+}EventCount_t;
+
+void eventcount_init(EventCount_t* ec);
+
+void eventcount_destroy(EventCount_t* ec);
+
+//announce a wait, the condition is checked again after it
+uint32_t eventcount_prepare_wait(EventCount_t* ec);
+
+//the condition held after prepare_wait
+void eventcount_cancel_wait(EventCount_t* ec);
+
+//sleep until a notify after prepare_wait returned key, or the deadline (NULL for none) passed: QUEUE_ERROR_TIMEOUT
+int eventcount_wait(EventCount_t* ec, uint32_t key, const sync_deadline_t* deadline);
+
+//wake every waiter, after the change they wait for is stored
+void eventcount_notify(EventCount_t* ec);
+
+typedef struct {
+    alignas(QUEUE_CACHE_LINE) std::atomic<uint32_t> head;  //consumer
+    uint32_t tail_cache;                                    //the consumer's last look at tail
+    alignas(QUEUE_CACHE_LINE) std::atomic<uint32_t> tail;  //producer
+    uint32_t head_cache;                                    //the producer's last look at head
+    alignas(QUEUE_CACHE_LINE) uint32_t mask;                //capacity - 1
+    uint32_t elem_size;
+    uint8_t* buffer;
+    EventCount_t not_empty;
+    EventCount_t not_full;
+}SpscQueue_t;
+
+//capacity is rounded up to a power of two
+int spsc_queue_init(SpscQueue_t* queue, uint32_t capacity, uint32_t elem_size);
+
+void spsc_queue_release(SpscQueue_t* queue);
+
+//producer thread only, QUEUE_ERROR_FULL
+int spsc_queue_push(SpscQueue_t* queue, const void* elem);
+
+//consumer thread only, QUEUE_ERROR_EMPTY
+int spsc_queue_pop(SpscQueue_t* queue, void* elem);
+
+//timeout_ms < 0 waits forever, QUEUE_ERROR_TIMEOUT
+int spsc_queue_push_wait(SpscQueue_t* queue, const void* elem, int timeout_ms);
+
+int spsc_queue_pop_wait(SpscQueue_t* queue, void* elem, int timeout_ms);
+
+//elements queued, exact on either side's thread
+uint32_t spsc_queue_count(const SpscQueue_t* queue);
+
+typedef struct {
+    alignas(QUEUE_CACHE_LINE) std::atomic<uint32_t> enqueue_pos;
+    alignas(QUEUE_CACHE_LINE) std::atomic<uint32_t> dequeue_pos;
+    alignas(QUEUE_CACHE_LINE) uint32_t mask;
+    uint32_t elem_size;
+    uint32_t cell_size;                 //the cell's sequence number and the element, 8 byte aligned
+    uint8_t* cells;
+    EventCount_t not_empty;
+    EventCount_t not_full;
+}MpmcQueue_t;
+
+int mpmc_queue_init(MpmcQueue_t* queue, uint32_t capacity, uint32_t elem_size);
+
+void mpmc_queue_release(MpmcQueue_t* queue);
+
+//any thread, fifo per producer
+int mpmc_queue_push(MpmcQueue_t* queue, const void* elem);
+
+int mpmc_queue_pop(MpmcQueue_t* queue, void* elem);
+
+int mpmc_queue_push_wait(MpmcQueue_t* queue, const void* elem, int timeout_ms);
+
+int mpmc_queue_pop_wait(MpmcQueue_t* queue, void* elem, int timeout_ms);
+
+//elements queued, a snapshot
+uint32_t mpmc_queue_count(const MpmcQueue_t* queue);
+
+#define TRIPLE_BUFFER_FRESH 0x4         //middle holds a frame the consumer has not taken
+
+//latest value mailbox over three buffers the caller owns, indexed 0..2: the producer writes back and publishes
+//it as the newest, the consumer takes the newest as front. neither side waits, a frame published over one the
+//consumer never took is counted as replaced
+typedef struct {
+    alignas(QUEUE_CACHE_LINE) std::atomic<uint32_t> middle;    //index | TRIPLE_BUFFER_FRESH
+    alignas(QUEUE_CACHE_LINE) uint32_t back;                    //producer
+    uint64_t published;
+    uint64_t replaced;
+    alignas(QUEUE_CACHE_LINE) uint32_t front;                   //consumer
+    uint64_t taken;
+}TripleBuffer_t;
+
+void triple_buffer_init(TripleBuffer_t* buffer);
+
+//producer: the buffer to write next
+uint32_t triple_buffer_back(const TripleBuffer_t* buffer);
+
+//producer: back becomes the newest, 1 when it replaced a newest one that was never taken
+int triple_buffer_publish(TripleBuffer_t* buffer);
+
+//consumer: 1 when front is now a newer buffer, 0 when nothing was published since the last take
+int triple_buffer_take(TripleBuffer_t* buffer);
+
+//consumer: the buffer last taken
+uint32_t triple_buffer_front(const TripleBuffer_t* buffer);
+
+//any thread: a newer buffer waits for the consumer
+int triple_buffer_fresh(const TripleBuffer_t* buffer);
+
+#endif
@@ -0,0 +1,1339 @@
+#include "record.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "libiruvc.h"
+#include "cmdq.h"
+#include "prop.h"
+
+static uint32_t record_align(uint32_t size, uint32_t align)
+{
+    return (size + align - 1) / align * align;
+}
+
+static uint8_t* record_buffer_alloc(uint32_t size)
+{
+#if defined(_WIN32)
+    return (uint8_t*)_aligned_malloc(size, RECORD_ALIGN);
+#else
+    void* data = NULL;
+    if (posix_memalign(&data, RECORD_ALIGN, size) != 0)
+    {
+        return NULL;
+    }
+    return (uint8_t*)data;
+#endif
+}
+
+static void record_buffer_free(uint8_t* data)
+{
+#if defined(_WIN32)
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
+static int record_file_create(Recorder_t* recorder)
+{
+    recorder->direct = 0;
+#if defined(_WIN32)
+    recorder->fp = fopen(recorder->param.path, "wb");
+    return (recorder->fp != NULL) ? RECORD_SUCCESS : RECORD_ERROR_FILE;
+#else
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#if defined(O_DIRECT)
+    if (recorder->param.direct_io)
+    {
+        recorder->fd = open(recorder->param.path, flags | O_DIRECT, 0644);
+        if (recorder->fd >= 0)
+        {
+            recorder->direct = 1;
+            return RECORD_SUCCESS;
+        }
+        //tmpfs and some others refuse O_DIRECT
+        printf("record: O_DIRECT not available (%d), buffered writes\n", errno);
+    }
+#endif
+    recorder->fd = open(recorder->param.path, flags, 0644);
+    return (recorder->fd >= 0) ? RECORD_SUCCESS : RECORD_ERROR_FILE;
+#endif
+}
+
+//size is a multiple of RECORD_ALIGN and data is aligned, as O_DIRECT needs
+static int record_file_write_at(Recorder_t* recorder, uint64_t offset, const uint8_t* data, uint32_t size)
+{
+#if defined(_WIN32)
+    if (_fseeki64(recorder->fp, (long long)offset, SEEK_SET) != 0)
+    {
+        return RECORD_ERROR_FILE;
+    }
+    return (fwrite(data, 1, size, recorder->fp) == size) ? RECORD_SUCCESS : RECORD_ERROR_FILE;
+#else
+    while (size > 0)
+    {
+        ssize_t written = pwrite(recorder->fd, data, size, (off_t)offset);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return RECORD_ERROR_FILE;
+        }
+        data += written;
+        offset += written;
+        size -= (uint32_t)written;
+    }
+    return RECORD_SUCCESS;
+#endif
+}
+
+static void record_file_close(Recorder_t* recorder)
+{
+#if defined(_WIN32)
+    if (recorder->fp != NULL)
+    {
+        fclose(recorder->fp);
+        recorder->fp = NULL;
+    }
+#else
+    if (recorder->fd >= 0)
+    {
+        close(recorder->fd);
+        recorder->fd = -1;
+    }
+#endif
+}
+
+static void record_meta_done(int job_id, int result, void* user_data)
+{
+    Recorder_t* recorder = (Recorder_t*)user_data;
+    pthread_mutex_lock(&recorder->mutex);
+    recorder->meta_pending = 0;
+    pthread_cond_broadcast(&recorder->cond);
+    pthread_mutex_unlock(&recorder->mutex);
+}
+
+//runs on the cmdq worker, between frames
+static int record_meta_query(void* arg)
+{
+    Recorder_t* recorder = (Recorder_t*)arg;
+    uint16_t gain = 0, ems = 0, tau = 0, ta = 0, tu = 0;
+    uint8_t shutter_en = 0, shutter_state = 0;
+    if (prop_tpd_get(TPD_PROP_GAIN_SEL, &gain) != IRUVC_SUCCESS || \
+        prop_tpd_get(TPD_PROP_EMS, &ems) != IRUVC_SUCCESS || \
+        prop_tpd_get(TPD_PROP_TAU, &tau) != IRUVC_SUCCESS || \
+        prop_tpd_get(TPD_PROP_TA, &ta) != IRUVC_SUCCESS || \
+        prop_tpd_get(TPD_PROP_TU, &tu) != IRUVC_SUCCESS || \
+        shutter_sta_get(&shutter_en, &shutter_state) != IRUVC_SUCCESS)
+    {
+        return RECORD_ERROR_FILE;
+    }
+    pthread_mutex_lock(&recorder->mutex);
+    recorder->meta.gain = gain;
+    recorder->meta.ems = ems;
+    recorder->meta.tau = tau;
+    recorder->meta.ta = ta;
+    recorder->meta.tu = tu;
+    recorder->meta.shutter_en = shutter_en;
+    recorder->meta.shutter_state = shutter_state;
+    recorder->meta.flags |= RECORD_META_DEVICE;
+    pthread_mutex_unlock(&recorder->mutex);
+    return RECORD_SUCCESS;
+}
+
+//under the mutex: the frames keep the last known values until the query ran
+static void record_meta_refresh(Recorder_t* recorder)
+{
+    if (recorder->param.meta_interval == 0 || ++recorder->meta_frame_cnt < recorder->param.meta_interval || \
+        recorder->meta_pending)
+    {
+        return;
+    }
+    recorder->meta_frame_cnt = 0;
+    recorder->meta_pending = 1;
+    if (cmdq_submit(record_meta_query, recorder, CMDQ_PRIORITY_READ, 0, record_meta_done, recorder, NULL) \
+        != CMDQ_SUCCESS)
+    {
+        recorder->meta_pending = 0;
+    }
+}
+
+//under the mutex: finish the filling chunk's header and hand it to the writer
+static void record_chunk_queue(Recorder_t* recorder)
+{
+    RecordChunk_t* chunk = &recorder->chunks[recorder->filling];
+    uint32_t used = chunk->used;
+    uint32_t chunk_size = record_align(used, RECORD_ALIGN);
+    RecordChunkHeader_t* header = (RecordChunkHeader_t*)chunk->data;
+    memset(header, 0, sizeof(RecordChunkHeader_t));
+    header->magic = RECORD_CHUNK_MAGIC;
+    header->frame_num = chunk->frame_num;
+    header->chunk_size = chunk_size;
+    header->first_seq = chunk->first_seq;
+    header->first_timestamp_us = chunk->first_timestamp_us;
+    header->last_timestamp_us = chunk->last_timestamp_us;
+    RecordIndexEntry_t* index = (RecordIndexEntry_t*)(chunk->data + sizeof(RecordChunkHeader_t));
+    memset(index + chunk->frame_num, 0, (recorder->header.chunk_frames - chunk->frame_num) * sizeof(RecordIndexEntry_t));
+    memset(chunk->data + used, 0, chunk_size - used);
+
+    int tail = (recorder->write_head + recorder->write_num) % RECORD_MAX_CHUNK_BUFFERS;
+    recorder->write_queue[tail] = recorder->filling;
+    recorder->write_num++;
+    recorder->filling = -1;
+    pthread_cond_broadcast(&recorder->cond);
+}
+
+//a plane as it came, or coded when the plane has a codec. returns the bytes stored
+static uint32_t record_plane_store(CodecContext_t* codec, const uint8_t* data, uint32_t byte_size, int key, \
+    uint8_t* dst, uint32_t* coded_size)
+{
+    *coded_size = 0;
+    if (codec->pix_num > 0)
+    {
+        int size = codec_encode(codec, (const uint16_t*)data, dst, codec_bound(codec->pix_num), key);
+        if (size > 0)
+        {
+            *coded_size = (uint32_t)size;
+            return (uint32_t)size;
+        }
+        //the next coded frame has to decode without this one
+        codec_reset(codec);
+    }
+    memcpy(dst, data, byte_size);
+    return byte_size;
+}
+
+//ring task: copy (or code) the frame into the filling chunk, never waits for the disk
+static void record_task(FrameSlot_t* slot, void* arg)
+{
+    Recorder_t* recorder = (Recorder_t*)arg;
+    pthread_mutex_lock(&recorder->mutex);
+    //after a stream mode switch the planes may be other than the file's header describes
+    if (!recorder->recording || slot->desc.image.byte_size < recorder->header.image_byte_size || \
+        slot->desc.temp.byte_size < recorder->header.temp_byte_size)
+    {
+        pthread_mutex_unlock(&recorder->mutex);
+        return;
+    }
+    record_meta_refresh(recorder);
+    if (recorder->filling < 0)
+    {
+        if (recorder->free_num == 0)
+        {
+            recorder->stats.dropped++;
+            pthread_mutex_unlock(&recorder->mutex);
+            return;
+        }
+        recorder->filling = recorder->free_list[--recorder->free_num];
+        recorder->chunks[recorder->filling].frame_num = 0;
+        recorder->chunks[recorder->filling].used = recorder->chunk_header_size;
+        recorder->chunks[recorder->filling].full_num = 0;
+    }
+
+    RecordFileHeader_t* header = &recorder->header;
+    RecordChunk_t* chunk = &recorder->chunks[recorder->filling];
+    uint32_t offset = chunk->used;
+    uint8_t* record = chunk->data + offset;
+    RecordFrameMeta_t* meta = (RecordFrameMeta_t*)record;
+    *meta = recorder->meta;
+    meta->seq = slot->seq;
+    meta->timestamp_us = slot->desc.timestamp_us;
+    if (slot->desc.flags & FRAME_DESC_TEMP_INVALID)
+    {
+        meta->flags |= RECORD_META_TEMP_INVALID;
+    }
+    uint32_t used = sizeof(RecordFrameMeta_t);
+    //roi tiles: the rois at every frame, the whole frame every full_interval frames
+    int tiles = (header->roi_num > 0 && recorder->full_frame_cnt != 0);
+    if (header->roi_num > 0)
+    {
+        recorder->full_frame_cnt = (recorder->full_frame_cnt + 1) % header->full_interval;
+    }
+    //every chunk's first full frame has the keyframes, a chunk decodes without the ones before it
+    int key = (chunk->full_num == 0);
+    if (tiles)
+    {
+        meta->flags |= RECORD_META_TILES;
+        memcpy(record + used, header->rois, header->roi_num * sizeof(RecordRoi_t));
+        used += header->roi_num * sizeof(RecordRoi_t);
+        uint32_t stride = (slot->desc.temp.stride > 0) ? slot->desc.temp.stride : header->temp_width * 2;
+        for (uint32_t i = 0; i < header->roi_num; i++)
+        {
+            const RecordRoi_t* roi = &header->rois[i];
+            const uint8_t* src = slot->desc.temp.data + roi->y * stride + roi->x * 2;
+            for (uint32_t y = 0; y < roi->height; y++, src += stride)
+            {
+                memcpy(record + used, src, roi->width * 2);
+                used += roi->width * 2;
+            }
+        }
+        recorder->stats.tile_frames++;
+    }
+    else
+    {
+        chunk->full_num++;
+    }
+    if (!tiles && header->image_byte_size > 0)
+    {
+        used += record_plane_store(&recorder->image_codec, slot->desc.image.data, header->image_byte_size, key, \
+            record + used, &meta->image_coded_size);
+    }
+    if (!tiles && header->temp_byte_size > 0)
+    {
+        used += record_plane_store(&recorder->temp_codec, slot->desc.temp.data, header->temp_byte_size, key, \
+            record + used, &meta->temp_coded_size);
+    }
+    uint32_t record_size = record_align(used, RECORD_FRAME_ALIGN);
+    memset(record + used, 0, record_size - used);
+    chunk->used += record_size;
+    recorder->stats.plane_bytes += header->image_byte_size + header->temp_byte_size;
+    recorder->stats.stored_bytes += used - sizeof(RecordFrameMeta_t);
+
+    RecordIndexEntry_t* index = (RecordIndexEntry_t*)(chunk->data + sizeof(RecordChunkHeader_t));
+    index[chunk->frame_num].timestamp_us = slot->desc.timestamp_us;
+    index[chunk->frame_num].offset = offset;
+    index[chunk->frame_num].flags = tiles ? RECORD_INDEX_TILES : 0;
+    if (chunk->frame_num == 0)
+    {
+        chunk->first_seq = slot->seq;
+        chunk->first_timestamp_us = slot->desc.timestamp_us;
+    }
+    chunk->last_timestamp_us = slot->desc.timestamp_us;
+    chunk->frame_num++;
+    recorder->stats.frames++;
+    if (chunk->frame_num == header->chunk_frames)
+    {
+        record_chunk_queue(recorder);
+    }
+    pthread_mutex_unlock(&recorder->mutex);
+}
+
+//writer thread: full chunks go to the file in order, one large aligned write each
+static void* record_writer(void* threadarg)
+{
+    Recorder_t* recorder = (Recorder_t*)threadarg;
+    pthread_mutex_lock(&recorder->mutex);
+    while (1)
+    {
+        while (recorder->write_num == 0 && recorder->writer_running)
+        {
+            pthread_cond_wait(&recorder->cond, &recorder->mutex);
+        }
+        if (recorder->write_num == 0)
+        {
+            break;
+        }
+        int chunk_id = recorder->write_queue[recorder->write_head];
+        RecordChunk_t* chunk = &recorder->chunks[chunk_id];
+        RecordChunkHeader_t* chunk_header = (RecordChunkHeader_t*)chunk->data;
+        uint64_t offset = recorder->file_offset;
+        uint32_t chunk_size = chunk_header->chunk_size;
+        int write_error = recorder->write_error;
+        pthread_mutex_unlock(&recorder->mutex);
+
+        int rst = RECORD_ERROR_FILE;
+        uint64_t start_us = get_monotonic_us();
+        if (!write_error)
+        {
+            rst = record_file_write_at(recorder, offset, chunk->data, chunk_size);
+        }
+        uint64_t write_us = get_monotonic_us() - start_us;
+
+        pthread_mutex_lock(&recorder->mutex);
+        recorder->write_head = (recorder->write_head + 1) % RECORD_MAX_CHUNK_BUFFERS;
+        recorder->write_num--;
+        if (rst == RECORD_SUCCESS)
+        {
+            if (recorder->stats.chunks >= recorder->index_capacity)
+            {
+                uint32_t capacity = (recorder->index_capacity > 0) ? recorder->index_capacity * 2 : 256;
+                RecordChunkEntry_t* index = (RecordChunkEntry_t*)realloc(recorder->index, \
+                    capacity * sizeof(RecordChunkEntry_t));
+                if (index != NULL)
+                {
+                    recorder->index = index;
+                    recorder->index_capacity = capacity;
+                }
+            }
+            if (recorder->stats.chunks < recorder->index_capacity)
+            {
+                RecordChunkEntry_t* entry = &recorder->index[recorder->stats.chunks];
+                entry->offset = offset;
+                entry->first_timestamp_us = chunk->first_timestamp_us;
+                entry->last_timestamp_us = chunk->last_timestamp_us;
+                entry->frame_num = chunk->frame_num;
+                entry->chunk_size = chunk_size;
+            }
+            if (recorder->header.frame_num == 0)
+            {
+                recorder->header.first_timestamp_us = chunk->first_timestamp_us;
+            }
+            recorder->header.last_timestamp_us = chunk->last_timestamp_us;
+            recorder->header.frame_num += chunk->frame_num;
+            recorder->file_offset += chunk_size;
+            recorder->stats.chunks++;
+            recorder->stats.bytes += chunk_size;
+            if (write_us > recorder->stats.write_max_us)
+            {
+                recorder->stats.write_max_us = write_us;
+            }
+        }
+        else if (!recorder->write_error)
+        {
+            //disk full or gone: stop taking frames, what was written stays readable by scanning
+            printf("record: chunk write failed, recording stopped\n");
+            recorder->write_error = 1;
+            recorder->recording = 0;
+        }
+        recorder->free_list[recorder->free_num++] = chunk_id;
+    }
+    pthread_mutex_unlock(&recorder->mutex);
+    return NULL;
+}
+
+//register the recorder as a task consumer of the frame ring
+int record_attach(Recorder_t* recorder, StreamFrameInfo_t* stream_frame_info)
+{
+    if (recorder == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return RECORD_ERROR_PARAM;
+    }
+    memset(recorder, 0, sizeof(Recorder_t));
+    recorder->stream_frame_info = stream_frame_info;
+    recorder->fd = -1;
+    recorder->filling = -1;
+    pthread_mutex_init(&recorder->mutex, NULL);
+    pthread_cond_init(&recorder->cond, NULL);
+    //every frame in order, a frame that can not be queued counts as the consumer's drop
+    recorder->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, \
+        POOL_STAGE_RECORD, record_task, recorder);
+    if (recorder->consumer_id < 0)
+    {
+        pthread_mutex_destroy(&recorder->mutex);
+        pthread_cond_destroy(&recorder->cond);
+        return RECORD_ERROR_PARAM;
+    }
+    return RECORD_SUCCESS;
+}
+
+//create the file and start the writer
+int record_start(Recorder_t* recorder, const RecordParam_t* param)
+{
+    if (recorder == NULL || param == NULL || recorder->stream_frame_info == NULL || param->path[0] == 0)
+    {
+        return RECORD_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&recorder->mutex);
+    int busy = recorder->recording || recorder->writer_running;
+    pthread_mutex_unlock(&recorder->mutex);
+    if (busy)
+    {
+        return RECORD_ERROR_PARAM;
+    }
+
+    StreamFrameInfo_t* stream_frame_info = recorder->stream_frame_info;
+    recorder->param = *param;
+    if (recorder->param.chunk_frames == 0)
+    {
+        recorder->param.chunk_frames = RECORD_DEFAULT_CHUNK_FRAMES;
+    }
+    if (recorder->param.chunk_buffers == 0)
+    {
+        recorder->param.chunk_buffers = RECORD_DEFAULT_CHUNK_BUFFERS;
+    }
+    if (recorder->param.chunk_frames > RECORD_MAX_CHUNK_FRAMES || recorder->param.chunk_buffers < 2 || \
+        recorder->param.chunk_buffers > RECORD_MAX_CHUNK_BUFFERS)
+    {
+        return RECORD_ERROR_PARAM;
+    }
+
+    RecordFileHeader_t* header = &recorder->header;
+    memset(header, 0, sizeof(RecordFileHeader_t));
+    header->magic = RECORD_MAGIC;
+    header->version = RECORD_VERSION;
+    header->header_size = RECORD_ALIGN;
+    header->chunk_frames = recorder->param.chunk_frames;
+    const StreamConfig_t* config = stream_frame_info->config;
+    header->image_width = config->image_info.width;
+    header->image_height = config->image_info.height;
+    header->image_byte_size = config->image_byte_size;
+    header->image_format = config->image_info.input_format;
+    header->temp_width = config->temp_info.width;
+    header->temp_height = config->temp_info.height;
+    header->temp_byte_size = config->temp_byte_size;
+    header->fps = config->camera_param.fps;
+    header->codec = recorder->param.codec;
+    //a coded plane needs a 16 bit sample per pixel, other planes are stored as they came
+    memset(&recorder->image_codec, 0, sizeof(CodecContext_t));
+    memset(&recorder->temp_codec, 0, sizeof(CodecContext_t));
+    uint32_t image_size = header->image_byte_size, temp_size = header->temp_byte_size;
+    if (header->codec == RECORD_CODEC_DELTA)
+    {
+        if (image_size > 0 && image_size == header->image_width * header->image_height * 2)
+        {
+            image_size = codec_bound(header->image_width * header->image_height);
+        }
+        if (temp_size > 0 && temp_size == header->temp_width * header->temp_height * 2)
+        {
+            temp_size = codec_bound(header->temp_width * header->temp_height);
+        }
+    }
+    else if (header->codec != RECORD_CODEC_NONE)
+    {
+        return RECORD_ERROR_PARAM;
+    }
+    //roi tiles are cut from a 16 bit temp plane, every roi inside it
+    uint32_t tiles_size = 0;
+    if (recorder->param.roi_num > 0)
+    {
+        if (recorder->param.roi_num > RECORD_MAX_ROIS || recorder->param.full_interval < 2 || \
+            header->temp_byte_size == 0 || header->temp_byte_size != header->temp_width * header->temp_height * 2)
+        {
+            return RECORD_ERROR_PARAM;
+        }
+        tiles_size = recorder->param.roi_num * sizeof(RecordRoi_t);
+        for (uint32_t i = 0; i < recorder->param.roi_num; i++)
+        {
+            const RecordRoi_t* roi = &recorder->param.rois[i];
+            if (roi->width == 0 || roi->height == 0 || roi->x + roi->width > header->temp_width || \
+                roi->y + roi->height > header->temp_height)
+            {
+                return RECORD_ERROR_PARAM;
+            }
+            tiles_size += roi->width * roi->height * 2;
+        }
+        header->full_interval = recorder->param.full_interval;
+        header->roi_num = recorder->param.roi_num;
+        memcpy(header->rois, recorder->param.rois, header->roi_num * sizeof(RecordRoi_t));
+    }
+    uint32_t full_size = image_size + temp_size;
+    header->frame_size = record_align(sizeof(RecordFrameMeta_t) + ((tiles_size > full_size) ? tiles_size : \
+        full_size), RECORD_FRAME_ALIGN);
+    recorder->chunk_header_size = record_align(sizeof(RecordChunkHeader_t) + \
+        header->chunk_frames * sizeof(RecordIndexEntry_t), RECORD_ALIGN);
+    uint64_t capacity = record_align(recorder->chunk_header_size + header->chunk_frames * header->frame_size, \
+        RECORD_ALIGN);
+    if (capacity > 0x7FFFFFFF)
+    {
+        return RECORD_ERROR_PARAM;
+    }
+    recorder->chunk_capacity = (uint32_t)capacity;
+
+    recorder->free_num = 0;
+    for (uint32_t i = 0; i < recorder->param.chunk_buffers; i++)
+    {
+        recorder->chunks[i].data = record_buffer_alloc(recorder->chunk_capacity);
+        if (recorder->chunks[i].data == NULL)
+        {
+            for (uint32_t j = 0; j < i; j++)
+            {
+                record_buffer_free(recorder->chunks[j].data);
+                recorder->chunks[j].data = NULL;
+            }
+            return RECORD_ERROR_MEM;
+        }
+        recorder->free_list[recorder->free_num++] = i;
+    }
+    if (record_file_create(recorder) != RECORD_SUCCESS)
+    {
+        printf("record: can not create %s\n", recorder->param.path);
+        for (uint32_t i = 0; i < recorder->param.chunk_buffers; i++)
+        {
+            record_buffer_free(recorder->chunks[i].data);
+            recorder->chunks[i].data = NULL;
+        }
+        return RECORD_ERROR_FILE;
+    }
+
+    //the header block is rewritten with the index offset by record_stop
+    uint8_t* block = recorder->chunks[0].data;
+    memset(block, 0, RECORD_ALIGN);
+    memcpy(block, header, sizeof(RecordFileHeader_t));
+    if (record_file_write_at(recorder, 0, block, RECORD_ALIGN) != RECORD_SUCCESS)
+    {
+        record_file_close(recorder);
+        for (uint32_t i = 0; i < recorder->param.chunk_buffers; i++)
+        {
+            record_buffer_free(recorder->chunks[i].data);
+            recorder->chunks[i].data = NULL;
+        }
+        return RECORD_ERROR_FILE;
+    }
+
+    if ((image_size != header->image_byte_size && codec_init(&recorder->image_codec, header->image_width, \
+        header->image_height, 0) != CODEC_SUCCESS) || (temp_size != header->temp_byte_size && \
+        codec_init(&recorder->temp_codec, header->temp_width, header->temp_height, 0) != CODEC_SUCCESS))
+    {
+        codec_release(&recorder->image_codec);
+        codec_release(&recorder->temp_codec);
+        record_file_close(recorder);
+        for (uint32_t i = 0; i < recorder->param.chunk_buffers; i++)
+        {
+            record_buffer_free(recorder->chunks[i].data);
+            recorder->chunks[i].data = NULL;
+        }
+        return RECORD_ERROR_MEM;
+    }
+
+    recorder->file_offset = RECORD_ALIGN;
+    recorder->filling = -1;
+    recorder->write_head = 0;
+    recorder->write_num = 0;
+    recorder->write_error = 0;
+    recorder->meta_frame_cnt = recorder->param.meta_interval;   //query on the first frame
+    recorder->full_frame_cnt = 0;                               //the first frame is a full one
+    memset(&recorder->stats, 0, sizeof(RecordStats_t));
+    recorder->writer_running = 1;
+    if (pthread_create(&recorder->writer, NULL, record_writer, recorder) != 0)
+    {
+        recorder->writer_running = 0;
+        codec_release(&recorder->image_codec);
+        codec_release(&recorder->temp_codec);
+        record_file_close(recorder);
+        for (uint32_t i = 0; i < recorder->param.chunk_buffers; i++)
+        {
+            record_buffer_free(recorder->chunks[i].data);
+            recorder->chunks[i].data = NULL;
+        }
+        return RECORD_ERROR_MEM;
+    }
+    pthread_mutex_lock(&recorder->mutex);
+    recorder->recording = 1;
+    pthread_mutex_unlock(&recorder->mutex);
+    printf("record: %s, %u frames x %u bytes per chunk%s%s\n", recorder->param.path, header->chunk_frames, \
+        header->frame_size, recorder->direct ? ", O_DIRECT" : "", \
+        (header->codec == RECORD_CODEC_DELTA) ? ", delta coded" : "");
+    if (header->roi_num > 0)
+    {
+        printf("record: %u roi tiles every frame, the full frame every %u\n", header->roi_num, header->full_interval);
+    }
+    return RECORD_SUCCESS;
+}
+
+//flush the partial chunk, write the index and the final header
+int record_stop(Recorder_t* recorder)
+{
+    if (recorder == NULL)
+    {
+        return RECORD_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&recorder->mutex);
+    if (!recorder->writer_running)
+    {
+        pthread_mutex_unlock(&recorder->mutex);
+        return RECORD_ERROR_PARAM;
+    }
+    recorder->recording = 0;
+    if (recorder->filling >= 0)
+    {
+        if (recorder->chunks[recorder->filling].frame_num > 0)
+        {
+            record_chunk_queue(recorder);
+        }
+        else
+        {
+            recorder->free_list[recorder->free_num++] = recorder->filling;
+            recorder->filling = -1;
+        }
+    }
+    //a queued metadata query still points at the recorder
+    while (recorder->meta_pending)
+    {
+        pthread_cond_wait(&recorder->cond, &recorder->mutex);
+    }
+    recorder->writer_running = 0;
+    pthread_cond_broadcast(&recorder->cond);
+    pthread_mutex_unlock(&recorder->mutex);
+    pthread_join(recorder->writer, NULL);
+
+    int rst = RECORD_SUCCESS;
+    RecordFileHeader_t* header = &recorder->header;
+    uint32_t chunk_num = (uint32_t)recorder->stats.chunks;
+    if (!recorder->write_error && chunk_num <= recorder->index_capacity)
+    {
+        uint32_t index_size = record_align(sizeof(RecordIndexHeader_t) + chunk_num * sizeof(RecordChunkEntry_t), \
+            RECORD_ALIGN);
+        uint8_t* block = record_buffer_alloc(index_size);
+        if (block != NULL)
+        {
+            memset(block, 0, index_size);
+            RecordIndexHeader_t* index_header = (RecordIndexHeader_t*)block;
+            index_header->magic = RECORD_INDEX_MAGIC;
+            index_header->chunk_num = chunk_num;
+            if (chunk_num > 0)
+            {
+                memcpy(block + sizeof(RecordIndexHeader_t), recorder->index, chunk_num * sizeof(RecordChunkEntry_t));
+            }
+            rst = record_file_write_at(recorder, recorder->file_offset, block, index_size);
+            if (rst == RECORD_SUCCESS)
+            {
+                header->chunk_num = chunk_num;
+                header->index_offset = recorder->file_offset;
+                memset(block, 0, RECORD_ALIGN);
+                memcpy(block, header, sizeof(RecordFileHeader_t));
+                rst = record_file_write_at(recorder, 0, block, RECORD_ALIGN);
+            }
+            record_buffer_free(block);
+        }
+        else
+        {
+            rst = RECORD_ERROR_MEM;
+        }
+    }
+    else
+    {
+        rst = RECORD_ERROR_FILE;
+    }
+    record_file_close(recorder);
+
+    for (uint32_t i = 0; i < recorder->param.chunk_buffers; i++)
+    {
+        record_buffer_free(recorder->chunks[i].data);
+        recorder->chunks[i].data = NULL;
+    }
+    free(recorder->index);
+    recorder->index = NULL;
+    recorder->index_capacity = 0;
+    codec_release(&recorder->image_codec);
+    codec_release(&recorder->temp_codec);
+    printf("record: %llu frames in %llu chunks, %llu dropped, slowest write %lluus\n", \
+        (unsigned long long)recorder->stats.frames, (unsigned long long)recorder->stats.chunks, \
+        (unsigned long long)recorder->stats.dropped, (unsigned long long)recorder->stats.write_max_us);
+    if (header->codec == RECORD_CODEC_DELTA && header->roi_num == 0 && recorder->stats.stored_bytes > 0)
+    {
+        printf("record: planes coded %.2f:1\n", (double)recorder->stats.plane_bytes / recorder->stats.stored_bytes);
+    }
+    else if (header->roi_num > 0 && recorder->stats.stored_bytes > 0)
+    {
+        printf("record: %llu tile frames, planes stored %.2f:1\n", (unsigned long long)recorder->stats.tile_frames, \
+            (double)recorder->stats.plane_bytes / recorder->stats.stored_bytes);
+    }
+    return rst;
+}
+
+void record_meta_set(Recorder_t* recorder, const RecordFrameMeta_t* meta)
+{
+    if (recorder == NULL || meta == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&recorder->mutex);
+    recorder->meta.gain = meta->gain;
+    recorder->meta.ems = meta->ems;
+    recorder->meta.tau = meta->tau;
+    recorder->meta.ta = meta->ta;
+    recorder->meta.tu = meta->tu;
+    recorder->meta.shutter_en = meta->shutter_en;
+    recorder->meta.shutter_state = meta->shutter_state;
+    recorder->meta.flags |= RECORD_META_USER;
+    pthread_mutex_unlock(&recorder->mutex);
+}
+
+int record_stats(Recorder_t* recorder, RecordStats_t* stats)
+{
+    if (recorder == NULL || stats == NULL)
+    {
+        return RECORD_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&recorder->mutex);
+    *stats = recorder->stats;
+    pthread_mutex_unlock(&recorder->mutex);
+    return RECORD_SUCCESS;
+}
+
+static int record_read_at(RecordReader_t* reader, uint64_t offset, void* data, uint32_t size)
+{
+    if (reader->map != NULL)
+    {
+        if (offset > reader->map_size || size > reader->map_size - offset)
+        {
+            return RECORD_ERROR_FILE;
+        }
+        memcpy(data, reader->map + offset, size);
+        return RECORD_SUCCESS;
+    }
+#if defined(_WIN32)
+    if (_fseeki64(reader->fp, (long long)offset, SEEK_SET) != 0)
+    {
+        return RECORD_ERROR_FILE;
+    }
+    return (fread(data, 1, size, reader->fp) == size) ? RECORD_SUCCESS : RECORD_ERROR_FILE;
+#else
+    uint8_t* dst = (uint8_t*)data;
+    while (size > 0)
+    {
+        ssize_t got = pread(reader->fd, dst, size, (off_t)offset);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            return RECORD_ERROR_FILE;
+        }
+        dst += got;
+        offset += got;
+        size -= (uint32_t)got;
+    }
+    return RECORD_SUCCESS;
+#endif
+}
+
+//no index: walk the chunk headers from the first one until the file ends or a chunk is incomplete
+static int record_reader_scan(RecordReader_t* reader)
+{
+    uint32_t capacity = 0;
+    uint64_t offset = reader->header.header_size;
+    RecordChunkHeader_t chunk;
+    while (record_read_at(reader, offset, &chunk, sizeof(chunk)) == RECORD_SUCCESS && \
+        chunk.magic == RECORD_CHUNK_MAGIC && chunk.chunk_size >= reader->chunk_header_size && \
+        chunk.frame_num <= reader->header.chunk_frames)
+    {
+        //the chunk's last byte has to be there too
+        uint8_t last;
+        if (record_read_at(reader, offset + chunk.chunk_size - 1, &last, 1) != RECORD_SUCCESS)
+        {
+            break;
+        }
+        if (reader->chunk_num >= capacity)
+        {
+            capacity = (capacity > 0) ? capacity * 2 : 256;
+            RecordChunkEntry_t* chunks = (RecordChunkEntry_t*)realloc(reader->chunks, \
+                capacity * sizeof(RecordChunkEntry_t));
+            if (chunks == NULL)
+            {
+                return RECORD_ERROR_MEM;
+            }
+            reader->chunks = chunks;
+        }
+        RecordChunkEntry_t* entry = &reader->chunks[reader->chunk_num++];
+        entry->offset = offset;
+        entry->first_timestamp_us = chunk.first_timestamp_us;
+        entry->last_timestamp_us = chunk.last_timestamp_us;
+        entry->frame_num = chunk.frame_num;
+        entry->chunk_size = chunk.chunk_size;
+        offset += chunk.chunk_size;
+    }
+    return RECORD_SUCCESS;
+}
+
+int record_reader_open(RecordReader_t* reader, const char* path)
+{
+    if (reader == NULL || path == NULL)
+    {
+        return RECORD_ERROR_PARAM;
+    }
+    memset(reader, 0, sizeof(RecordReader_t));
+    reader->fd = -1;
+    reader->chunk_cur = -1;
+#if defined(_WIN32)
+    reader->fp = fopen(path, "rb");
+    if (reader->fp == NULL)
+    {
+        return RECORD_ERROR_FILE;
+    }
+#else
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0)
+    {
+        return RECORD_ERROR_FILE;
+    }
+#endif
+    RecordFileHeader_t* header = &reader->header;
+    if (record_read_at(reader, 0, header, sizeof(RecordFileHeader_t)) != RECORD_SUCCESS || \
+        header->magic != RECORD_MAGIC || header->version < 1 || header->version > RECORD_VERSION || \
+        header->chunk_frames == 0 || header->chunk_frames > RECORD_MAX_CHUNK_FRAMES || \
+        header->frame_size < sizeof(RecordFrameMeta_t) + header->image_byte_size + header->temp_byte_size)
+    {
+        record_reader_close(reader);
+        return RECORD_ERROR_FORMAT;
+    }
+    reader->chunk_header_size = record_align(sizeof(RecordChunkHeader_t) + \
+        header->chunk_frames * sizeof(RecordIndexEntry_t), RECORD_ALIGN);
+    reader->chunk_index = (RecordIndexEntry_t*)malloc(header->chunk_frames * sizeof(RecordIndexEntry_t));
+    if (reader->chunk_index == NULL)
+    {
+        record_reader_close(reader);
+        return RECORD_ERROR_MEM;
+    }
+    //version 1 headers end before the codec, the rest of their block is zero
+    int rst_codec = CODEC_SUCCESS;
+    if (header->codec == RECORD_CODEC_DELTA)
+    {
+        uint32_t bound = 0;
+        if (header->image_byte_size == header->image_width * header->image_height * 2 && header->image_byte_size > 0)
+        {
+            rst_codec = codec_init(&reader->image_codec, header->image_width, header->image_height, 0);
+            bound = codec_bound(header->image_width * header->image_height);
+        }
+        if (header->temp_byte_size == header->temp_width * header->temp_height * 2 && header->temp_byte_size > 0)
+        {
+            if (codec_init(&reader->temp_codec, header->temp_width, header->temp_height, 0) != CODEC_SUCCESS)
+            {
+                rst_codec = CODEC_ERROR_MEM;
+            }
+            uint32_t temp_bound = codec_bound(header->temp_width * header->temp_height);
+            bound = (temp_bound > bound) ? temp_bound : bound;
+        }
+        reader->coded = (uint8_t*)malloc((bound > 0) ? bound : 1);
+        if (rst_codec != CODEC_SUCCESS || reader->coded == NULL)
+        {
+            record_reader_close(reader);
+            return RECORD_ERROR_MEM;
+        }
+    }
+    else if (header->codec != RECORD_CODEC_NONE)
+    {
+        record_reader_close(reader);
+        return RECORD_ERROR_FORMAT;
+    }
+    //roi tiles, version 3: the last full frame is kept to draw the tile frames onto
+    if (header->roi_num > 0)
+    {
+        int valid = (header->roi_num <= RECORD_MAX_ROIS && header->full_interval >= 2 && header->temp_byte_size > 0 && \
+            header->temp_byte_size == header->temp_width * header->temp_height * 2);
+        for (uint32_t i = 0; valid && i < header->roi_num; i++)
+        {
+            const RecordRoi_t* roi = &header->rois[i];
+            valid = (roi->width > 0 && roi->height > 0 && roi->x + roi->width <= header->temp_width && \
+                roi->y + roi->height <= header->temp_height);
+        }
+        if (!valid)
+        {
+            record_reader_close(reader);
+            return RECORD_ERROR_FORMAT;
+        }
+        reader->tiles_size = header->frame_size - sizeof(RecordFrameMeta_t);
+        reader->full_image = (uint8_t*)calloc(1, (header->image_byte_size > 0) ? header->image_byte_size : 1);
+        reader->full_temp = (uint8_t*)calloc(1, header->temp_byte_size);
+        reader->tiles = (uint8_t*)malloc(reader->tiles_size);
+        if (reader->full_image == NULL || reader->full_temp == NULL || reader->tiles == NULL)
+        {
+            record_reader_close(reader);
+            return RECORD_ERROR_MEM;
+        }
+    }
+
+    int rst = RECORD_ERROR_FORMAT;
+    RecordIndexHeader_t index_header;
+    if (header->index_offset != 0 && \
+        record_read_at(reader, header->index_offset, &index_header, sizeof(index_header)) == RECORD_SUCCESS && \
+        index_header.magic == RECORD_INDEX_MAGIC && index_header.chunk_num == header->chunk_num)
+    {
+        reader->chunks = (RecordChunkEntry_t*)malloc((index_header.chunk_num + 1) * sizeof(RecordChunkEntry_t));
+        if (reader->chunks != NULL && record_read_at(reader, header->index_offset + sizeof(index_header), \
+            reader->chunks, index_header.chunk_num * sizeof(RecordChunkEntry_t)) == RECORD_SUCCESS)
+        {
+            reader->chunk_num = index_header.chunk_num;
+            rst = RECORD_SUCCESS;
+        }
+    }
+    if (rst != RECORD_SUCCESS)
+    {
+        free(reader->chunks);
+        reader->chunks = NULL;
+        reader->chunk_num = 0;
+        rst = record_reader_scan(reader);
+    }
+    if (rst != RECORD_SUCCESS)
+    {
+        record_reader_close(reader);
+    }
+    return rst;
+}
+
+static int record_reader_load(RecordReader_t* reader, int chunk_id)
+{
+    RecordChunkEntry_t* entry = &reader->chunks[chunk_id];
+    if (record_read_at(reader, entry->offset, &reader->chunk, sizeof(RecordChunkHeader_t)) != RECORD_SUCCESS || \
+        reader->chunk.magic != RECORD_CHUNK_MAGIC || reader->chunk.frame_num > reader->header.chunk_frames || \
+        record_read_at(reader, entry->offset + sizeof(RecordChunkHeader_t), reader->chunk_index, \
+        reader->chunk.frame_num * sizeof(RecordIndexEntry_t)) != RECORD_SUCCESS)
+    {
+        return RECORD_ERROR_FORMAT;
+    }
+    reader->chunk_cur = chunk_id;
+    reader->frame_cur = 0;
+    codec_reset(&reader->image_codec);
+    codec_reset(&reader->temp_codec);
+    return RECORD_SUCCESS;
+}
+
+//load chunk_id for a jump: a chunk that starts with roi tiles needs the last full frame before it, the chunks
+//before are walked back to the one that has it and read up to it
+static int record_reader_enter(RecordReader_t* reader, int chunk_id)
+{
+    int rst = record_reader_load(reader, chunk_id);
+    if (rst != RECORD_SUCCESS || reader->header.roi_num == 0 || reader->chunk.frame_num == 0 || \
+        !(reader->chunk_index[0].flags & RECORD_INDEX_TILES))
+    {
+        return rst;
+    }
+    //no full frame before the chunk, a cut recording: the tiles are drawn onto zeros
+    memset(reader->full_image, 0, (reader->header.image_byte_size > 0) ? reader->header.image_byte_size : 1);
+    memset(reader->full_temp, 0, reader->header.temp_byte_size);
+    for (int id = chunk_id - 1; id >= 0; id--)
+    {
+        rst = record_reader_load(reader, id);
+        if (rst != RECORD_SUCCESS)
+        {
+            return rst;
+        }
+        int last = (int)reader->chunk.frame_num - 1;
+        while (last >= 0 && (reader->chunk_index[last].flags & RECORD_INDEX_TILES))
+        {
+            last--;
+        }
+        if (last < 0)
+        {
+            continue;
+        }
+        //a coded full frame needs the ones before it in its chunk
+        if (reader->header.codec == RECORD_CODEC_NONE)
+        {
+            reader->frame_cur = (uint32_t)last;
+        }
+        while ((int)reader->frame_cur <= last)
+        {
+            rst = record_reader_next(reader, NULL, NULL, NULL);
+            if (rst != RECORD_SUCCESS)
+            {
+                return rst;
+            }
+        }
+        break;
+    }
+    return record_reader_load(reader, chunk_id);
+}
+
+int record_reader_seek_chunk(RecordReader_t* reader, uint32_t chunk_id)
+{
+    if (reader == NULL)
+    {
+        return RECORD_ERROR_PARAM;
+    }
+    if (chunk_id >= reader->chunk_num)
+    {
+        reader->chunk_cur = (int)reader->chunk_num;
+        reader->frame_cur = 0;
+        reader->chunk.frame_num = 0;
+        return RECORD_END;
+    }
+    return record_reader_enter(reader, (int)chunk_id);
+}
+
+int record_reader_map(RecordReader_t* reader)
+{
+    if (reader == NULL)
+    {
+        return RECORD_ERROR_PARAM;
+    }
+#if defined(_WIN32)
+    return RECORD_ERROR_FILE;
+#else
+    if (reader->map != NULL)
+    {
+        return RECORD_SUCCESS;
+    }
+    struct stat st;
+    if (fstat(reader->fd, &st) != 0 || st.st_size <= 0)
+    {
+        return RECORD_ERROR_FILE;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        return RECORD_ERROR_FILE;
+    }
+    //chunks are read front to back
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    reader->map = (const uint8_t*)map;
+    reader->map_size = (uint64_t)st.st_size;
+    return RECORD_SUCCESS;
+#endif
+}
+
+int record_reader_seek(RecordReader_t* reader, uint64_t timestamp_us)
+{
+    if (reader == NULL)
+    {
+        return RECORD_ERROR_PARAM;
+    }
+    //first chunk that ends at or after the timestamp
+    uint32_t lo = 0, hi = reader->chunk_num;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (reader->chunks[mid].last_timestamp_us < timestamp_us)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    if (lo >= reader->chunk_num)
+    {
+        reader->chunk_cur = (int)reader->chunk_num;
+        reader->frame_cur = 0;
+        return RECORD_END;
+    }
+    int rst = record_reader_enter(reader, (int)lo);
+    if (rst != RECORD_SUCCESS)
+    {
+        return rst;
+    }
+    uint32_t target = 0;
+    while (target < reader->chunk.frame_num && reader->chunk_index[target].timestamp_us < timestamp_us)
+    {
+        target++;
+    }
+    if (reader->header.codec == RECORD_CODEC_NONE && reader->header.roi_num == 0)
+    {
+        reader->frame_cur = target;
+        return RECORD_SUCCESS;
+    }
+    //delta frames need every frame from the keyframe on, tile frames the full frame before them
+    while (reader->frame_cur < target)
+    {
+        rst = record_reader_next(reader, NULL, NULL, NULL);
+        if (rst != RECORD_SUCCESS)
+        {
+            return rst;
+        }
+    }
+    return RECORD_SUCCESS;
+}
+
+//one plane of a coded recording: coded planes are decoded even when skipped, the next frame refers to them
+static int record_reader_plane(RecordReader_t* reader, uint64_t offset, uint32_t byte_size, uint32_t coded_size, \
+    CodecContext_t* codec, uint8_t* data)
+{
+    if (coded_size == 0)
+    {
+        if (data != NULL && record_read_at(reader, offset, data, byte_size) != RECORD_SUCCESS)
+        {
+            return RECORD_ERROR_FILE;
+        }
+        //a plane stored as it came breaks the chain, the next coded one is a keyframe
+        codec_reset(codec);
+        return RECORD_SUCCESS;
+    }
+    if (codec->pix_num == 0 || coded_size > codec_bound(codec->pix_num))
+    {
+        return RECORD_ERROR_FORMAT;
+    }
+    if (record_read_at(reader, offset, reader->coded, coded_size) != RECORD_SUCCESS)
+    {
+        return RECORD_ERROR_FILE;
+    }
+    return (codec_decode(codec, reader->coded, coded_size, (uint16_t*)data) == CODEC_SUCCESS) ? \
+        RECORD_SUCCESS : RECORD_ERROR_FORMAT;
+}
+
+static int record_reader_decode(RecordReader_t* reader, uint64_t offset, RecordFrameMeta_t* meta, uint8_t* image, \
+    uint8_t* temp)
+{
+    RecordFileHeader_t* header = &reader->header;
+    if (record_read_at(reader, offset, meta, sizeof(RecordFrameMeta_t)) != RECORD_SUCCESS)
+    {
+        return RECORD_ERROR_FILE;
+    }
+    offset += sizeof(RecordFrameMeta_t);
+    int rst = RECORD_SUCCESS;
+    if (header->image_byte_size > 0)
+    {
+        rst = record_reader_plane(reader, offset, header->image_byte_size, meta->image_coded_size, \
+            &reader->image_codec, image);
+        offset += (meta->image_coded_size > 0) ? meta->image_coded_size : header->image_byte_size;
+    }
+    if (rst == RECORD_SUCCESS && header->temp_byte_size > 0)
+    {
+        rst = record_reader_plane(reader, offset, header->temp_byte_size, meta->temp_coded_size, \
+            &reader->temp_codec, temp);
+    }
+    return rst;
+}
+
+//roi tiles: a full frame is kept as the background, a tile frame is the background with its tiles drawn on
+static int record_reader_tiled(RecordReader_t* reader, uint64_t offset, RecordFrameMeta_t* meta, uint8_t* image, \
+    uint8_t* temp)
+{
+    RecordFileHeader_t* header = &reader->header;
+    if (!(reader->chunk_index[reader->frame_cur].flags & RECORD_INDEX_TILES))
+    {
+        int rst = record_reader_decode(reader, offset, meta, reader->full_image, reader->full_temp);
+        if (rst != RECORD_SUCCESS)
+        {
+            return rst;
+        }
+    }
+    else if (record_read_at(reader, offset, meta, sizeof(RecordFrameMeta_t)) != RECORD_SUCCESS)
+    {
+        return RECORD_ERROR_FILE;
+    }
+    if (image != NULL && header->image_byte_size > 0)
+    {
+        memcpy(image, reader->full_image, header->image_byte_size);
+    }
+    if (temp == NULL)
+    {
+        return RECORD_SUCCESS;
+    }
+    memcpy(temp, reader->full_temp, header->temp_byte_size);
+    if (!(reader->chunk_index[reader->frame_cur].flags & RECORD_INDEX_TILES))
+    {
+        return RECORD_SUCCESS;
+    }
+    //the frame's own table, then the tiles in its order
+    offset += sizeof(RecordFrameMeta_t);
+    uint32_t table_size = header->roi_num * sizeof(RecordRoi_t);
+    if (record_read_at(reader, offset, reader->tiles, table_size) != RECORD_SUCCESS)
+    {
+        return RECORD_ERROR_FILE;
+    }
+    const RecordRoi_t* rois = (const RecordRoi_t*)reader->tiles;
+    uint32_t size = table_size;
+    for (uint32_t i = 0; i < header->roi_num; i++)
+    {
+        if (rois[i].x + rois[i].width > header->temp_width || rois[i].y + rois[i].height > header->temp_height)
+        {
+            return RECORD_ERROR_FORMAT;
+        }
+        size += rois[i].width * rois[i].height * 2;
+    }
+    if (size > reader->tiles_size || record_read_at(reader, offset + table_size, reader->tiles + table_size, \
+        size - table_size) != RECORD_SUCCESS)
+    {
+        return RECORD_ERROR_FORMAT;
+    }
+    const uint8_t* src = reader->tiles + table_size;
+    uint32_t stride = header->temp_width * 2;
+    for (uint32_t i = 0; i < header->roi_num; i++)
+    {
+        uint8_t* dst = temp + rois[i].y * stride + rois[i].x * 2;
+        for (uint32_t y = 0; y < rois[i].height; y++, dst += stride, src += rois[i].width * 2)
+        {
+            memcpy(dst, src, rois[i].width * 2);
+        }
+    }
+    return RECORD_SUCCESS;
+}
+
+int record_reader_next(RecordReader_t* reader, RecordFrameMeta_t* meta, uint8_t* image, uint8_t* temp)
+{
+    if (reader == NULL)
+    {
+        return RECORD_ERROR_PARAM;
+    }
+    while (reader->chunk_cur < 0 || reader->frame_cur >= reader->chunk.frame_num)
+    {
+        int next = reader->chunk_cur + 1;
+        if (next >= (int)reader->chunk_num)
+        {
+            reader->chunk_cur = (int)reader->chunk_num;
+            reader->frame_cur = 0;
+            reader->chunk.frame_num = 0;
+            return RECORD_END;
+        }
+        int rst = record_reader_load(reader, next);
+        if (rst != RECORD_SUCCESS)
+        {
+            return rst;
+        }
+    }
+
+    uint64_t offset = reader->chunks[reader->chunk_cur].offset + reader->chunk_index[reader->frame_cur].offset;
+    RecordFileHeader_t* header = &reader->header;
+    if (header->roi_num > 0)
+    {
+        RecordFrameMeta_t local;
+        int rst = record_reader_tiled(reader, offset, (meta != NULL) ? meta : &local, image, temp);
+        if (rst == RECORD_SUCCESS)
+        {
+            reader->frame_cur++;
+        }
+        return rst;
+    }
+    if (header->codec == RECORD_CODEC_DELTA)
+    {
+        RecordFrameMeta_t local;
+        int rst = record_reader_decode(reader, offset, (meta != NULL) ? meta : &local, image, temp);
+        if (rst == RECORD_SUCCESS)
+        {
+            reader->frame_cur++;
+        }
+        return rst;
+    }
+    if (meta != NULL && record_read_at(reader, offset, meta, sizeof(RecordFrameMeta_t)) != RECORD_SUCCESS)
+    {
+        return RECORD_ERROR_FILE;
+    }
+    offset += sizeof(RecordFrameMeta_t);
+    if (image != NULL && header->image_byte_size > 0 && \
+        record_read_at(reader, offset, image, header->image_byte_size) != RECORD_SUCCESS)
+    {
+        return RECORD_ERROR_FILE;
+    }
+    offset += header->image_byte_size;
+    if (temp != NULL && header->temp_byte_size > 0 && \
+        record_read_at(reader, offset, temp, header->temp_byte_size) != RECORD_SUCCESS)
+    {
+        return RECORD_ERROR_FILE;
+    }
+    reader->frame_cur++;
+    return RECORD_SUCCESS;
+}
+
+void record_reader_close(RecordReader_t* reader)
+{
+    if (reader == NULL)
+    {
+        return;
+    }
+#if defined(_WIN32)
+    if (reader->fp != NULL)
+    {
+        fclose(reader->fp);
+        reader->fp = NULL;
+    }
+#else
+    if (reader->map != NULL)
+    {
+        munmap((void*)reader->map, (size_t)reader->map_size);
+        reader->map = NULL;
+        reader->map_size = 0;
+    }
+    if (reader->fd >= 0)
+    {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+#endif
+    free(reader->chunks);
+    reader->chunks = NULL;
+    free(reader->chunk_index);
+    reader->chunk_index = NULL;
+    free(reader->coded);
+    reader->coded = NULL;
+    free(reader->full_image);
+    reader->full_image = NULL;
+    free(reader->full_temp);
+    reader->full_temp = NULL;
+    free(reader->tiles);
+    reader->tiles = NULL;
+    codec_release(&reader->image_codec);
+    codec_release(&reader->temp_codec);
+    reader->chunk_num = 0;
+}
@@ -0,0 +1,263 @@
+#ifndef _RECORD_H_
+#define _RECORD_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "data.h"
+#include "codec.h"
+
+#define RECORD_MAGIC 0x43525249         //"IRRC"
+#define RECORD_CHUNK_MAGIC 0x4B4E4843   //"CHNK"
+#define RECORD_INDEX_MAGIC 0x58444E49   //"INDX"
+#define RECORD_VERSION 3                //2 added the plane codec, 3 the roi tiles, older files read without them
+#define RECORD_ALIGN 4096               //file header, chunks and the index start at and fill whole blocks
+#define RECORD_FRAME_ALIGN 64           //frame records inside a chunk
+#define RECORD_DEFAULT_CHUNK_FRAMES 16
+#define RECORD_MAX_CHUNK_FRAMES 256
+#define RECORD_DEFAULT_CHUNK_BUFFERS 4
+#define RECORD_MAX_CHUNK_BUFFERS 16
+#define RECORD_DEFAULT_META_INTERVAL 25 //frames between two metadata queries
+#define RECORD_PATH_LEN 256
+#define RECORD_MAX_ROIS 8               //regions of the temp plane a tile frame holds
+
+#define RECORD_SUCCESS 0
+#define RECORD_ERROR_PARAM -1
+#define RECORD_ERROR_FILE -2
+#define RECORD_ERROR_MEM -3
+#define RECORD_ERROR_FORMAT -4
+#define RECORD_END -5
+
+#define RECORD_META_DEVICE 0x1          //gain/ems/tau/ta/tu/shutter were read from the device
+#define RECORD_META_USER 0x2            //set by record_meta_set
+#define RECORD_META_TEMP_INVALID 0x4    //the frame had FRAME_DESC_TEMP_INVALID: gain switch, shutter or nuc
+#define RECORD_META_TILES 0x8           //a tile frame: only the rois of the temp plane are its own, the rest of the temp
+                                        //plane and the image plane are the last full frame's
+
+#define RECORD_INDEX_TILES 0x1          //RecordIndexEntry_t flags: the frame record is a tile frame
+
+#define RECORD_CODEC_NONE 0              //planes stored as they came
+#define RECORD_CODEC_DELTA 1             //16 bit planes coded by codec.h, every chunk starts with a keyframe
+
+//file layout, all little endian:
+//  RecordFileHeader_t, padded to RECORD_ALIGN
+//  chunks: RecordChunkHeader_t + chunk_frames RecordIndexEntry_t padded to RECORD_ALIGN, then the frames
+//          (RecordFrameMeta_t, image plane, temp plane, padded to RECORD_FRAME_ALIGN), padded to RECORD_ALIGN
+//          with RECORD_CODEC_DELTA a plane is a coded frame of its coded size, frame records differ in size
+//          with roi tiles (roi_num > 0) every full_interval-th frame is a full one, the others are tile frames:
+//          RecordFrameMeta_t, roi_num RecordRoi_t, then each roi's rows of the temp plane, stored as they came
+//  index: RecordIndexHeader_t + one RecordChunkEntry_t per chunk, padded to RECORD_ALIGN
+//the header's index_offset is written when the recording is stopped, a file without it is read by scanning the chunks
+
+//a region of the temp plane, pixels
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+}RecordRoi_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;               //RECORD_ALIGN, the first chunk starts here
+    uint32_t chunk_frames;              //most frames in a chunk, sizes the chunk headers' index
+    uint32_t image_width;
+    uint32_t image_height;
+    uint32_t image_byte_size;           //0 without an image plane
+    uint32_t image_format;              //InputFormat_t
+    uint32_t temp_width;
+    uint32_t temp_height;
+    uint32_t temp_byte_size;            //0 without a temp plane
+    uint32_t fps;
+    uint32_t frame_size;                //one frame record (the largest one when coded), RECORD_FRAME_ALIGN aligned
+    uint32_t chunk_num;                 //0 until the recording is stopped
+    uint64_t index_offset;              //0 until the recording is stopped
+    uint64_t frame_num;
+    uint64_t first_timestamp_us;
+    uint64_t last_timestamp_us;
+    uint32_t codec;                     //RECORD_CODEC_xxx
+    uint32_t reserved;
+    uint32_t full_interval;             //roi tiles: frames from one full frame to the next
+    uint32_t roi_num;                   //regions of a tile frame, 0 records full frames only
+    RecordRoi_t rois[RECORD_MAX_ROIS];
+}RecordFileHeader_t;
+
+//per frame metadata, the raw property values as prop_tpd_get returns them
+typedef struct {
+    uint64_t seq;                       //ring sequence, gaps are frames dropped before the recorder
+    uint64_t timestamp_us;              //monotonic time when uvc_frame_get returned
+    uint32_t flags;                     //RECORD_META_xxx, 0 when nothing is known
+    uint16_t gain;                      //TPD_PROP_GAIN_SEL
+    uint16_t ems;                       //TPD_PROP_EMS
+    uint16_t tau;                       //TPD_PROP_TAU
+    uint16_t ta;                        //TPD_PROP_TA
+    uint16_t tu;                        //TPD_PROP_TU
+    uint8_t shutter_en;                 //shutter_sta_get
+    uint8_t shutter_state;
+    uint32_t image_coded_size;          //bytes of the coded image plane, 0 when it is stored as it came
+    uint32_t temp_coded_size;
+}RecordFrameMeta_t;
+
+typedef struct {
+    uint64_t timestamp_us;
+    uint32_t offset;                    //frame record, from the start of the chunk
+    uint32_t flags;                     //RECORD_INDEX_xxx, 0 before version 3
+}RecordIndexEntry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t frame_num;
+    uint32_t chunk_size;                //bytes including the padding, the next chunk follows
+    uint32_t reserved;
+    uint64_t first_seq;
+    uint64_t first_timestamp_us;
+    uint64_t last_timestamp_us;
+}RecordChunkHeader_t;
+
+typedef struct {
+    uint64_t offset;                    //chunk header, from the start of the file
+    uint64_t first_timestamp_us;
+    uint64_t last_timestamp_us;
+    uint32_t frame_num;
+    uint32_t chunk_size;
+}RecordChunkEntry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t chunk_num;
+}RecordIndexHeader_t;
+
+typedef struct {
+    char path[RECORD_PATH_LEN];
+    uint32_t chunk_frames;              //0 selects RECORD_DEFAULT_CHUNK_FRAMES
+    uint32_t chunk_buffers;             //chunks being filled or written, 0 selects RECORD_DEFAULT_CHUNK_BUFFERS
+    uint32_t meta_interval;             //frames between metadata queries through cmdq, 0 never queries the device
+    uint8_t direct_io;                  //O_DIRECT on linux, buffered writes when the file system refuses it
+    uint8_t codec;                      //RECORD_CODEC_xxx
+    //roi tiles: the rois of the temp plane at every frame, the whole frame every full_interval frames (at least 2),
+    //for a region that matters at the full rate in a scene that does not. roi_num 0 records full frames only
+    uint32_t full_interval;
+    uint32_t roi_num;
+    RecordRoi_t rois[RECORD_MAX_ROIS];
+}RecordParam_t;
+
+typedef struct {
+    uint64_t frames;                    //frames written into chunks
+    uint64_t dropped;                   //frames skipped because every chunk buffer was waiting for the disk
+    uint64_t chunks;                    //chunks written
+    uint64_t bytes;                     //bytes written
+    uint64_t write_max_us;              //slowest chunk write
+    uint64_t plane_bytes;               //image and temp bytes of the written frames as they came
+    uint64_t stored_bytes;              //the same planes as stored, below plane_bytes when coded or tiled
+    uint64_t tile_frames;               //of frames, the ones stored as roi tiles
+}RecordStats_t;
+
+typedef struct {
+    uint8_t* data;                      //RECORD_ALIGN aligned, chunk_capacity bytes
+    uint32_t frame_num;
+    uint32_t used;                      //bytes up to the end of the last frame record
+    uint32_t full_num;                  //full frames, the first one has the keyframes
+    uint64_t first_seq;
+    uint64_t first_timestamp_us;
+    uint64_t last_timestamp_us;
+}RecordChunk_t;
+
+//a ring task consumer that writes every frame into the container, a writer thread does the file io
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    RecordParam_t param;
+    RecordFileHeader_t header;
+    int consumer_id;
+    uint8_t recording;
+    uint8_t writer_running;
+    uint8_t meta_pending;               //a metadata query is queued on cmdq
+    int fd;                             //posix
+    FILE* fp;                           //windows
+    uint8_t direct;                     //the file is open with O_DIRECT
+    uint64_t file_offset;               //next chunk
+    uint32_t chunk_header_size;
+    uint32_t chunk_capacity;
+    RecordChunk_t chunks[RECORD_MAX_CHUNK_BUFFERS];
+    int filling;                        //chunk taking frames, -1 none
+    int free_list[RECORD_MAX_CHUNK_BUFFERS];
+    int free_num;
+    int write_queue[RECORD_MAX_CHUNK_BUFFERS];  //full chunks in file order
+    int write_head;
+    int write_num;
+    RecordChunkEntry_t* index;          //one entry per written chunk
+    uint32_t index_capacity;
+    int write_error;
+    RecordFrameMeta_t meta;             //latest known metadata, copied into every frame
+    CodecContext_t image_codec;         //RECORD_CODEC_DELTA, pix_num 0 when the plane is not coded
+    CodecContext_t temp_codec;
+    uint32_t meta_frame_cnt;
+    uint32_t full_frame_cnt;            //roi tiles: frames since the last full one, 0 takes a full one
+    RecordStats_t stats;
+    pthread_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+}Recorder_t;
+
+//register the recorder as a task consumer of the camera's frame ring, before streaming
+//the recorder must stay valid until the ring is closed, frames are ignored while it is not recording
+int record_attach(Recorder_t* recorder, StreamFrameInfo_t* stream_frame_info);
+
+//create param->path and start writing every frame of the ring, can be called while streaming
+int record_start(Recorder_t* recorder, const RecordParam_t* param);
+
+//write the partial chunk and the chunk index, then close the file
+int record_stop(Recorder_t* recorder);
+
+//metadata the device is not asked for (or not yet), flags RECORD_META_USER
+void record_meta_set(Recorder_t* recorder, const RecordFrameMeta_t* meta);
+
+int record_stats(Recorder_t* recorder, RecordStats_t* stats);
+
+//sequential or seeking reader of a recording
+typedef struct {
+    int fd;
+    FILE* fp;
+    const uint8_t* map;                 //record_reader_map: the whole file, reads are copies from it
+    uint64_t map_size;
+    RecordFileHeader_t header;
+    RecordChunkEntry_t* chunks;
+    uint32_t chunk_num;
+    uint32_t chunk_header_size;
+    RecordIndexEntry_t* chunk_index;    //index of the current chunk
+    RecordChunkHeader_t chunk;
+    int chunk_cur;                      //-1 before the first chunk is loaded
+    uint32_t frame_cur;                 //next frame in the current chunk
+    uint8_t* coded;                     //RECORD_CODEC_DELTA: one coded plane
+    CodecContext_t image_codec;
+    CodecContext_t temp_codec;
+    //roi tiles: the last full frame, a tile frame is drawn onto it
+    uint8_t* full_image;
+    uint8_t* full_temp;
+    uint8_t* tiles;                     //one tile frame's table and tiles
+    uint32_t tiles_size;
+}RecordReader_t;
+
+//open a recording, a file without the chunk index (recording interrupted) is indexed by scanning its chunks
+int record_reader_open(RecordReader_t* reader, const char* path);
+
+//position at the first frame with timestamp >= timestamp_us
+//a coded recording decodes from the chunk's keyframe up to it
+int record_reader_seek(RecordReader_t* reader, uint64_t timestamp_us);
+
+//position at the first frame of chunk chunk_id (0..chunk_num-1), a coded chunk starts with its keyframe so the
+//chunks can be read by as many readers in parallel. a chunk that starts with roi tiles reads the last full frame
+//of the chunks before it first
+int record_reader_seek_chunk(RecordReader_t* reader, uint32_t chunk_id);
+
+//map the file read only, the reads become copies out of the page cache instead of pread calls.
+//RECORD_ERROR_FILE where it can not be mapped (windows), the reader then keeps reading the file
+int record_reader_map(RecordReader_t* reader);
+
+//read the next frame, NULL skips a part. returns RECORD_END after the last one. a tile frame comes back whole: its
+//rois drawn onto the temp plane of the last full frame, the image plane that frame's, meta flags RECORD_META_TILES
+int record_reader_next(RecordReader_t* reader, RecordFrameMeta_t* meta, uint8_t* image, uint8_t* temp);
+
+void record_reader_close(RecordReader_t* reader);
+
+#endif
@@ -0,0 +1,447 @@
+#include "reprocess.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "record.h"
+#include "ring.h"
+#include "pool.h"
+#include "palette.h"
+#include "snapshot.h"
+#include "jpeg.h"
+#include "tempunit.h"
+
+typedef struct Reprocess_s Reprocess_t;
+
+//one chunk in flight: the reader, the stage state and the chunk's outputs until they are written in order
+typedef struct {
+    Reprocess_t* owner;
+    uint32_t chunk_id;
+    int done;
+    int result;
+    int reader_open;
+    RecordReader_t reader;
+    RoiEngine_t roi_engine;
+    TempInfo_t roi_info[ROI_MAX_NUM];
+    uint8_t* image;
+    uint16_t* temp;
+    uint16_t* corrected;
+    uint8_t* ycc;
+    uint8_t* jpeg;
+    uint32_t jpeg_capacity;
+    //correction, org_* from the frames' recorded parameters
+    int org_valid;
+    EnvParam_t org_param;
+    EnvFactor_t org_factor;
+    EnvParam_t new_param;
+    EnvFactor_t new_factor;
+    NucFactor_t nuc_factor;
+    TempCalInfo_t cal_info;
+    TempEnvMap_t* map;
+    //outputs of the chunk
+    char* summary;
+    uint32_t summary_len;
+    uint32_t summary_capacity;
+    uint8_t* video;
+    uint32_t video_len;
+    uint32_t video_capacity;
+    uint64_t frames;
+    uint64_t corrected_frames;
+    uint64_t uncorrected_frames;
+    uint64_t map_builds;
+}ReprocessSlot_t;
+
+struct Reprocess_s {
+    const ReprocessParam_t* param;
+    RecordFileHeader_t header;
+    const Palette_t* palette;
+    JpegEncoder_t jpeg;
+    EnvParam_t new_param;
+    EnvFactor_t new_factor;
+    ReprocessSlot_t* slots;
+    int slot_num;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+static int reprocess_reserve(uint8_t** data, uint32_t* capacity, uint32_t len, uint32_t more)
+{
+    if (len + more <= *capacity)
+    {
+        return 0;
+    }
+    uint32_t next = (*capacity > 0) ? *capacity : 4096;
+    while (next < len + more)
+    {
+        next *= 2;
+    }
+    uint8_t* grown = (uint8_t*)realloc(*data, next);
+    if (grown == NULL)
+    {
+        return -1;
+    }
+    *data = grown;
+    *capacity = next;
+    return 0;
+}
+
+static void reprocess_slot_release(ReprocessSlot_t* slot)
+{
+    if (slot->reader_open)
+    {
+        record_reader_close(&slot->reader);
+        roi_engine_release(&slot->roi_engine);
+        slot->reader_open = 0;
+    }
+    free(slot->image);
+    free(slot->temp);
+    free(slot->corrected);
+    free(slot->ycc);
+    free(slot->jpeg);
+    free(slot->map);
+    free(slot->summary);
+    free(slot->video);
+    memset(slot, 0, sizeof(ReprocessSlot_t));
+}
+
+//the slot's reader and buffers, once, from its first task
+static int reprocess_slot_open(ReprocessSlot_t* slot)
+{
+    Reprocess_t* ctx = slot->owner;
+    const RecordFileHeader_t* header = &ctx->header;
+    if (record_reader_open(&slot->reader, ctx->param->input) != RECORD_SUCCESS)
+    {
+        return REPROCESS_ERROR_FORMAT;
+    }
+    record_reader_map(&slot->reader);
+    TempDataRes_t temp_res = { (uint16_t)header->temp_width, (uint16_t)header->temp_height };
+    roi_engine_init(&slot->roi_engine, temp_res);
+    slot->reader_open = 1;
+
+    uint32_t width = (header->image_width > header->temp_width) ? header->image_width : header->temp_width;
+    uint32_t height = (header->image_height > header->temp_height) ? header->image_height : header->temp_height;
+    slot->image = (uint8_t*)malloc((header->image_byte_size > 0) ? header->image_byte_size : 1);
+    slot->temp = (uint16_t*)malloc((header->temp_byte_size > 0) ? header->temp_byte_size : 2);
+    slot->corrected = (uint16_t*)malloc((header->temp_byte_size > 0) ? header->temp_byte_size : 2);
+    slot->ycc = (uint8_t*)malloc((size_t)width * height * 3 + 1);
+    slot->jpeg_capacity = jpeg_bound(width, height, 0);
+    slot->jpeg = (uint8_t*)malloc(slot->jpeg_capacity);
+    slot->map = (TempEnvMap_t*)malloc(sizeof(TempEnvMap_t));
+    if (slot->image == NULL || slot->temp == NULL || slot->corrected == NULL || slot->ycc == NULL || \
+        slot->jpeg == NULL || slot->map == NULL)
+    {
+        return REPROCESS_ERROR_MEM;
+    }
+
+    const ReprocessParam_t* param = ctx->param;
+    int roi_num = 0;
+    for (int i = 0; i < param->rect_num; i++)
+    {
+        roi_num += (roi_engine_add_rect(&slot->roi_engine, param->rects[i]) >= 0);
+    }
+    for (int i = 0; i < param->line_num; i++)
+    {
+        roi_num += (roi_engine_add_line(&slot->roi_engine, param->lines[i]) >= 0);
+    }
+    if (roi_num == 0)
+    {
+        Area_t frame = { 0, 0, (int)header->temp_width, (int)header->temp_height };
+        roi_engine_add_rect(&slot->roi_engine, frame);
+    }
+
+    slot->new_param = ctx->new_param;
+    slot->new_factor = ctx->new_factor;
+    TempCalInfo_t cal_info = { &slot->org_param, &slot->new_param, param->nuc_gain, &slot->nuc_factor, \
+        &slot->org_factor, &slot->new_factor, (uint16_t*)param->nuc_table };
+    slot->cal_info = cal_info;
+    temp_env_map_init(slot->map, &slot->cal_info);
+    return REPROCESS_SUCCESS;
+}
+
+//the frame's temperatures through the new environment, NULL when it stays as recorded
+static const uint16_t* reprocess_correct(ReprocessSlot_t* slot, const RecordFrameMeta_t* meta, int pix_num)
+{
+    const ReprocessParam_t* param = slot->owner->param;
+    if (param->nuc_table == NULL || param->correct_table == NULL || !(meta->flags & RECORD_META_DEVICE) || \
+        meta->gain != param->nuc_gain || (meta->flags & RECORD_META_TEMP_INVALID))
+    {
+        return NULL;
+    }
+    EnvParam_t org_param = { meta->ems, meta->tau, meta->ta, meta->tu };
+    if (!slot->org_valid || memcmp(&org_param, &slot->org_param, sizeof(EnvParam_t)) != 0)
+    {
+        slot->org_param = org_param;
+        slot->org_valid = (calculate_org_KE_and_BE_with_nuc_t(&slot->org_param, (uint16_t*)param->nuc_table, \
+            param->nuc_gain, &slot->org_factor) == IRTEMP_SUCCESS) ? 1 : -1;
+    }
+    if (slot->org_valid < 0)
+    {
+        return NULL;
+    }
+    int rst = temp_env_map_update(slot->map);
+    if (rst < 0)
+    {
+        return NULL;
+    }
+    slot->map_builds += (rst > 0);
+    temp_env_map_apply(slot->map, slot->temp, pix_num, slot->corrected);
+    return slot->corrected;
+}
+
+static int reprocess_summary(ReprocessSlot_t* slot, const RecordFrameMeta_t* meta, int roi_num, int corrected)
+{
+    for (int i = 0; i < roi_num; i++)
+    {
+        if (reprocess_reserve((uint8_t**)&slot->summary, &slot->summary_capacity, slot->summary_len, 128) != 0)
+        {
+            return REPROCESS_ERROR_MEM;
+        }
+        const TempInfo_t* info = &slot->roi_info[i];
+        slot->summary_len += snprintf(slot->summary + slot->summary_len, slot->summary_capacity - slot->summary_len, \
+            "%llu,%llu,%d,%.2f,%.2f,%.2f,%d\n", (unsigned long long)meta->seq, (unsigned long long)meta->timestamp_us, \
+            i, temp_celsius_of_raw(info->min_temp), temp_celsius_of_raw(info->max_temp), \
+            temp_celsius_of_raw(info->avr_temp), corrected);
+    }
+    return REPROCESS_SUCCESS;
+}
+
+static int reprocess_render(ReprocessSlot_t* slot, const uint16_t* temp)
+{
+    Reprocess_t* ctx = slot->owner;
+    const RecordFileHeader_t* header = &ctx->header;
+    FrameDesc_t desc;
+    memset(&desc, 0, sizeof(desc));
+    if (header->image_byte_size > 0)
+    {
+        uint32_t bpp = header->image_byte_size / (header->image_width * header->image_height);
+        FramePlane_t image = { slot->image, header->image_width, header->image_height, header->image_width * bpp, \
+            header->image_byte_size };
+        desc.image = image;
+    }
+    if (header->temp_byte_size > 0)
+    {
+        FramePlane_t plane = { (uint8_t*)temp, header->temp_width, header->temp_height, header->temp_width * 2, \
+            header->temp_byte_size };
+        desc.temp = plane;
+    }
+    uint32_t width = 0, height = 0;
+    if (snapshot_color_frame(ctx->palette, &desc, (InputFormat_t)header->image_format, slot->ycc, &width, \
+        &height) < 0)
+    {
+        return REPROCESS_SUCCESS;
+    }
+    int size = jpeg_encode(&ctx->jpeg, slot->ycc, width, height, NULL, 0, slot->jpeg, slot->jpeg_capacity);
+    if (size < 0)
+    {
+        return REPROCESS_ERROR_MEM;
+    }
+    if (reprocess_reserve(&slot->video, &slot->video_capacity, slot->video_len, (uint32_t)size) != 0)
+    {
+        return REPROCESS_ERROR_MEM;
+    }
+    memcpy(slot->video + slot->video_len, slot->jpeg, size);
+    slot->video_len += size;
+    return REPROCESS_SUCCESS;
+}
+
+//pool task: every frame of one chunk
+static void reprocess_chunk(void* arg)
+{
+    ReprocessSlot_t* slot = (ReprocessSlot_t*)arg;
+    Reprocess_t* ctx = slot->owner;
+    const ReprocessParam_t* param = ctx->param;
+    const RecordFileHeader_t* header = &ctx->header;
+    int pix_num = header->temp_width * header->temp_height;
+    slot->summary_len = 0;
+    slot->video_len = 0;
+    slot->frames = 0;
+    slot->corrected_frames = 0;
+    slot->uncorrected_frames = 0;
+    slot->map_builds = 0;
+
+    int rst = slot->reader_open ? REPROCESS_SUCCESS : reprocess_slot_open(slot);
+    if (rst == REPROCESS_SUCCESS && record_reader_seek_chunk(&slot->reader, slot->chunk_id) != RECORD_SUCCESS)
+    {
+        rst = REPROCESS_ERROR_FORMAT;
+    }
+    //the chunk ends where the reader moves on to the next one
+    uint32_t frame_num = (rst == REPROCESS_SUCCESS) ? slot->reader.chunk.frame_num : 0;
+    for (uint32_t n = 0; n < frame_num && rst == REPROCESS_SUCCESS; n++)
+    {
+        RecordFrameMeta_t meta;
+        if (record_reader_next(&slot->reader, &meta, slot->image, (uint8_t*)slot->temp) != RECORD_SUCCESS)
+        {
+            rst = REPROCESS_ERROR_FORMAT;
+            break;
+        }
+        const uint16_t* temp = slot->temp;
+        if (pix_num > 0)
+        {
+            const uint16_t* corrected = reprocess_correct(slot, &meta, pix_num);
+            temp = (corrected != NULL) ? corrected : temp;
+            slot->corrected_frames += (corrected != NULL);
+            slot->uncorrected_frames += (corrected == NULL);
+            if (param->summary_path != NULL)
+            {
+                //a line the library can not walk gives zeros, the other rois still count
+                roi_engine_process(&slot->roi_engine, (uint16_t*)temp, slot->roi_info);
+                rst = reprocess_summary(slot, &meta, slot->roi_engine.roi_num, corrected != NULL);
+            }
+        }
+        if (rst == REPROCESS_SUCCESS && param->video_path != NULL)
+        {
+            rst = reprocess_render(slot, temp);
+        }
+        slot->frames++;
+    }
+
+    pthread_mutex_lock(&ctx->mutex);
+    slot->result = rst;
+    slot->done = 1;
+    pthread_cond_broadcast(&ctx->cond);
+    pthread_mutex_unlock(&ctx->mutex);
+}
+
+static int reprocess_write(FILE* fp, const void* data, uint32_t size)
+{
+    return (fp == NULL || size == 0 || fwrite(data, 1, size, fp) == size) ? REPROCESS_SUCCESS : REPROCESS_ERROR_FILE;
+}
+
+int reprocess_run(const ReprocessParam_t* param, ReprocessStats_t* stats)
+{
+    ReprocessStats_t local;
+    stats = (stats != NULL) ? stats : &local;
+    memset(stats, 0, sizeof(ReprocessStats_t));
+    if (param == NULL || param->input == NULL)
+    {
+        return REPROCESS_ERROR_PARAM;
+    }
+    uint64_t start_us = get_monotonic_us();
+
+    //the chunk list and the header, the tasks open readers of their own
+    RecordReader_t reader;
+    int open_rst = record_reader_open(&reader, param->input);
+    if (open_rst != RECORD_SUCCESS)
+    {
+        return (open_rst == RECORD_ERROR_FILE) ? REPROCESS_ERROR_FILE : REPROCESS_ERROR_FORMAT;
+    }
+    uint32_t chunk_num = reader.chunk_num;
+    if (chunk_num > 0)
+    {
+        stats->recorded_us = reader.chunks[chunk_num - 1].last_timestamp_us - reader.chunks[0].first_timestamp_us;
+    }
+
+    Reprocess_t* ctx = (Reprocess_t*)calloc(1, sizeof(Reprocess_t));
+    if (ctx == NULL)
+    {
+        record_reader_close(&reader);
+        return REPROCESS_ERROR_MEM;
+    }
+    ctx->param = param;
+    ctx->header = reader.header;
+    record_reader_close(&reader);
+    pthread_mutex_init(&ctx->mutex, NULL);
+    pthread_cond_init(&ctx->cond, NULL);
+    jpeg_init(&ctx->jpeg, (param->quality > 0) ? param->quality : REPROCESS_DEFAULT_QUALITY);
+    palette_init();
+    ctx->palette = palette_get(param->color_mode);
+    ctx->palette = (ctx->palette != NULL) ? ctx->palette : palette_get(PALETTE_DEFAULT_MODE);
+
+    int rst = REPROCESS_SUCCESS;
+    if (param->nuc_table != NULL && param->correct_table != NULL && \
+        temp_env_factor_calc(param->correct_table, param->nuc_table, param->nuc_gain, param->ems, param->ta, \
+        param->tu, param->dist, param->hum, &ctx->new_param, &ctx->new_factor) != 0)
+    {
+        rst = REPROCESS_ERROR_CORRECT;
+    }
+    FILE* summary_fp = NULL;
+    FILE* video_fp = NULL;
+    if (rst == REPROCESS_SUCCESS && param->summary_path != NULL)
+    {
+        summary_fp = fopen(param->summary_path, "wb");
+        static const char columns[] = "seq,timestamp_us,roi,min,max,avr,corrected\n";
+        rst = (summary_fp != NULL) ? reprocess_write(summary_fp, columns, sizeof(columns) - 1) : REPROCESS_ERROR_FILE;
+    }
+    if (rst == REPROCESS_SUCCESS && param->video_path != NULL)
+    {
+        video_fp = fopen(param->video_path, "wb");
+        rst = (video_fp != NULL) ? REPROCESS_SUCCESS : REPROCESS_ERROR_FILE;
+    }
+    int workers = pool_worker_num();
+    ctx->slot_num = REPROCESS_SLOTS_PER_WORKER * ((workers > 0) ? workers : 1);
+    ctx->slots = (ReprocessSlot_t*)calloc(ctx->slot_num, sizeof(ReprocessSlot_t));
+    rst = (rst == REPROCESS_SUCCESS && ctx->slots == NULL) ? REPROCESS_ERROR_MEM : rst;
+
+    //chunk c runs in slot c % slot_num, a slot takes its next chunk once its last one is written
+    uint32_t next_submit = 0, next_write = 0;
+    while (rst == REPROCESS_SUCCESS && next_write < chunk_num)
+    {
+        while (next_submit < chunk_num && next_submit - next_write < (uint32_t)ctx->slot_num)
+        {
+            ReprocessSlot_t* slot = &ctx->slots[next_submit % ctx->slot_num];
+            slot->owner = ctx;
+            slot->chunk_id = next_submit++;
+            slot->done = 0;
+            if (pool_submit(POOL_STAGE_OTHER, reprocess_chunk, slot) != POOL_SUCCESS)
+            {
+                reprocess_chunk(slot);
+            }
+        }
+        ReprocessSlot_t* slot = &ctx->slots[next_write % ctx->slot_num];
+        pthread_mutex_lock(&ctx->mutex);
+        while (!slot->done)
+        {
+            pthread_cond_wait(&ctx->cond, &ctx->mutex);
+        }
+        pthread_mutex_unlock(&ctx->mutex);
+        rst = slot->result;
+        if (rst == REPROCESS_SUCCESS)
+        {
+            rst = reprocess_write(summary_fp, slot->summary, slot->summary_len);
+        }
+        if (rst == REPROCESS_SUCCESS)
+        {
+            rst = reprocess_write(video_fp, slot->video, slot->video_len);
+        }
+        if (rst == REPROCESS_SUCCESS)
+        {
+            stats->frames += slot->frames;
+            stats->chunks++;
+            stats->corrected += slot->corrected_frames;
+            stats->uncorrected += slot->uncorrected_frames;
+            stats->map_builds += slot->map_builds;
+            stats->summary_bytes += slot->summary_len;
+            stats->video_bytes += slot->video_len;
+        }
+        next_write++;
+    }
+    //an error stops the submitting, the chunks still running finish before their slots go
+    pthread_mutex_lock(&ctx->mutex);
+    for (uint32_t chunk = next_write; chunk < next_submit; chunk++)
+    {
+        while (!ctx->slots[chunk % ctx->slot_num].done)
+        {
+            pthread_cond_wait(&ctx->cond, &ctx->mutex);
+        }
+    }
+    pthread_mutex_unlock(&ctx->mutex);
+
+    if (summary_fp != NULL && fclose(summary_fp) != 0 && rst == REPROCESS_SUCCESS)
+    {
+        rst = REPROCESS_ERROR_FILE;
+    }
+    if (video_fp != NULL && fclose(video_fp) != 0 && rst == REPROCESS_SUCCESS)
+    {
+        rst = REPROCESS_ERROR_FILE;
+    }
+    for (int i = 0; ctx->slots != NULL && i < ctx->slot_num; i++)
+    {
+        reprocess_slot_release(&ctx->slots[i]);
+    }
+    free(ctx->slots);
+    pthread_mutex_destroy(&ctx->mutex);
+    pthread_cond_destroy(&ctx->cond);
+    free(ctx);
+    stats->elapsed_us = get_monotonic_us() - start_us;
+    return rst;
+}
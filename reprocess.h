@@ -0,0 +1,61 @@
+#ifndef _REPROCESS_H_
+#define _REPROCESS_H_
+
+//offline re-processing of a recording: every frame through the environment correction of new ems/ta/tu/distance,
+//the rois' min/max/avr and the palette rendering of the live pipeline, as fast as the cores go. the file is
+//mapped, each chunk of it is one task pool task with its own reader (chunks start with a keyframe), and the
+//results are written in chunk order by the caller's thread
+#include <stdint.h>
+#include "temperature.h"
+#include "roi.h"
+
+#define REPROCESS_SLOTS_PER_WORKER 2    //chunks in flight per pool worker, done ones wait for their turn
+#define REPROCESS_DEFAULT_QUALITY 85
+
+#define REPROCESS_SUCCESS 0
+#define REPROCESS_ERROR_PARAM -1
+#define REPROCESS_ERROR_FILE -2
+#define REPROCESS_ERROR_MEM -3
+#define REPROCESS_ERROR_FORMAT -4       //the recording, or a frame of it, could not be read
+#define REPROCESS_ERROR_CORRECT -5      //the new environment gives no factors with these tables
+
+typedef struct {
+    const char* input;                  //the recording
+    const char* summary_path;           //csv of seq, timestamp, roi, min/max/avr celsius per frame and roi, NULL none
+    const char* video_path;             //the rendered frames as a motion jpeg stream, NULL none
+    //correction: nuc_table (NUCT_LEN) and correct_table (TEMP_CORRECT_TABLE_LEN) of the recording's camera,
+    //NULL keeps the recorded temperatures. frames are corrected from their recorded ems/tau/ta/tu, frames of
+    //another gain than nuc_gain or without the device's parameters stay as they are
+    const uint16_t* nuc_table;
+    const uint16_t* correct_table;
+    uint8_t nuc_gain;
+    double ems;
+    double ta;                          //celsius
+    double tu;
+    double dist;                        //m
+    double hum;                         //0..1
+    irproc_color_mode_t color_mode;     //palette of the rendering
+    int quality;                        //jpeg 1..100, 0 selects REPROCESS_DEFAULT_QUALITY
+    Area_t rects[ROI_MAX_NUM];          //roi 0.. in the summary, then the lines. none: the whole frame
+    int rect_num;
+    Line_t lines[ROI_MAX_NUM];
+    int line_num;
+}ReprocessParam_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t chunks;
+    uint64_t corrected;                 //frames through the new environment
+    uint64_t uncorrected;               //frames kept as recorded: no device parameters, another gain
+    uint64_t map_builds;                //correction maps built, one per recorded parameter set and chunk task
+    uint64_t summary_bytes;
+    uint64_t video_bytes;
+    uint64_t elapsed_us;
+    uint64_t recorded_us;               //first to last frame of the recording
+}ReprocessStats_t;
+
+//process param->input on the task pool (pool_init first, inline without one), returns when every output is
+//written. stats (may be NULL) is filled also on an error, up to the last chunk written
+int reprocess_run(const ReprocessParam_t* param, ReprocessStats_t* stats);
+
+#endif
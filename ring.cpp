@@ -0,0 +1,1085 @@
+#include "ring.h"
+#include "libirparse.h"
+#include "simd.h"
+#include "rtsched.h"
+#include "data.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(linux) || defined(unix)
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+static void ring_plane_set(FramePlane_t* plane, uint8_t* data, uint32_t width, uint32_t height, uint32_t byte_size)
+{
+    //a layout without the plane has none, whatever the slot's buffer holds
+    plane->data = (byte_size > 0) ? data : NULL;
+    plane->width = width;
+    plane->height = height;
+    plane->stride = (height > 0) ? byte_size / height : 0;
+    plane->byte_size = byte_size;
+}
+
+//create the ring and preallocate every slot
+FrameRing_t* ring_create(RingFormat_t* format, uint32_t depth, uint8_t* drain_frame)
+{
+    if (format == NULL)
+    {
+        return NULL;
+    }
+    if (depth == 0)
+    {
+        depth = FRAME_RING_DEFAULT_DEPTH;
+    }
+    if (depth < 2 || depth > FRAME_RING_MAX_DEPTH)
+    {
+        printf("ring depth %d out of range\n", depth);
+        return NULL;
+    }
+
+    FrameRing_t* ring = new FrameRing_t();
+    ring->depth = depth;
+    ring->format = *format;
+    ring->drain_frame = drain_frame;
+    ring->hold_warn_us = RING_HOLD_WARN_MS * 1000;
+    sync_mutex_init(&ring->mutex);
+    sync_cond_init(&ring->cond);
+    for (int i = 0; i < FRAME_RING_MAX_CONSUMERS; i++)
+    {
+        ring->consumers[i].event_fd = -1;
+    }
+    for (uint32_t i = 0; i < depth; i++)
+    {
+        FrameSlot_t* slot = &ring->slots[i];
+        slot->state.store(SLOT_STATE_FREE);
+        slot->last_reader.store(-1);
+        if (format->frame_pool != NULL)
+        {
+            slot->raw_frame = (uint8_t*)frame_pool_alloc(format->frame_pool, format->camera_param.frame_size);
+        }
+        else
+        {
+            slot->raw_frame = (uint8_t*)uvc_frame_buf_create(format->camera_param);
+        }
+        if (slot->raw_frame == NULL)
+        {
+            printf("ring slot %d alloc failed\n", i);
+            ring_destroy(ring);
+            return NULL;
+        }
+        if (format->zero_copy)
+        {
+            //the two halves of the raw frame are contiguous, the planes just point into it
+            slot->image_frame = slot->raw_frame;
+            slot->temp_frame = slot->raw_frame + format->image_byte_size + format->info_byte_size;
+            if (format->info_byte_size > 0)
+            {
+                slot->image_info_frame = slot->raw_frame + format->image_byte_size;
+                slot->temp_info_frame = slot->temp_frame + format->temp_byte_size;
+            }
+        }
+        else if (format->frame_pool != NULL)
+        {
+            slot->image_frame = (uint8_t*)frame_pool_alloc(format->frame_pool, format->image_byte_size);
+            slot->temp_frame = (uint8_t*)frame_pool_alloc(format->frame_pool, format->temp_byte_size);
+            if (format->info_byte_size > 0)
+            {
+                slot->image_info_frame = (uint8_t*)frame_pool_alloc(format->frame_pool, format->info_byte_size);
+                slot->temp_info_frame = (uint8_t*)frame_pool_alloc(format->frame_pool, format->info_byte_size);
+            }
+            if (slot->image_frame == NULL || slot->temp_frame == NULL || \
+                (format->info_byte_size > 0 && (slot->image_info_frame == NULL || slot->temp_info_frame == NULL)))
+            {
+                printf("ring slot %d: frame pool too small\n", i);
+                ring_destroy(ring);
+                return NULL;
+            }
+        }
+        else
+        {
+            slot->image_frame = (uint8_t*)malloc(format->image_byte_size);
+            slot->temp_frame = (uint8_t*)malloc(format->temp_byte_size);
+            if (format->info_byte_size > 0)
+            {
+                slot->image_info_frame = (uint8_t*)malloc(format->info_byte_size);
+                slot->temp_info_frame = (uint8_t*)malloc(format->info_byte_size);
+            }
+            if (slot->image_frame == NULL || slot->temp_frame == NULL || \
+                (format->info_byte_size > 0 && (slot->image_info_frame == NULL || slot->temp_info_frame == NULL)))
+            {
+                printf("ring slot %d alloc failed\n", i);
+                ring_destroy(ring);
+                return NULL;
+            }
+        }
+        ring_plane_set(&slot->desc.image, slot->image_frame, format->image_width, format->image_height, \
+                       format->image_byte_size);
+        ring_plane_set(&slot->desc.temp, slot->temp_frame, format->temp_width, format->temp_height, \
+                       format->temp_byte_size);
+        slot->desc.image_info = slot->image_info_frame;
+        slot->desc.temp_info = slot->temp_info_frame;
+        if (format->temp_byte_size > 0 && frame_pyramid_init(&slot->temp_pyramid, format->temp_width, \
+            format->temp_height) == FRAME_STATS_ERROR_MEM)
+        {
+            printf("ring slot %d alloc failed\n", i);
+            ring_destroy(ring);
+            return NULL;
+        }
+        slot->raw_capacity = format->camera_param.frame_size;
+        slot->own_planes = (!format->zero_copy && format->frame_pool == NULL);
+        slot->image_capacity = slot->own_planes ? format->image_byte_size : 0;
+        slot->temp_capacity = slot->own_planes ? format->temp_byte_size : 0;
+    }
+    return ring;
+}
+
+//grow the heap buffer to byte_size, the old one goes only once the new one is there
+static int ring_buf_fit(uint8_t** buf, uint32_t* capacity, uint32_t byte_size)
+{
+    if (*capacity >= byte_size)
+    {
+        return 1;
+    }
+    uint8_t* grown = (uint8_t*)malloc(byte_size);
+    if (grown == NULL)
+    {
+        return 0;
+    }
+    free(*buf);
+    *buf = grown;
+    *capacity = byte_size;
+    return 1;
+}
+
+//cut the slot's buffers for the ring's current layout, the slot is being written so nobody reads it
+static int ring_slot_reformat(FrameRing_t* ring, FrameSlot_t* slot)
+{
+    const RingFormat_t* format = &ring->format;
+    if (slot->raw_capacity < format->camera_param.frame_size)
+    {
+        uint8_t* raw_frame = (uint8_t*)uvc_frame_buf_create(format->camera_param);
+        if (raw_frame == NULL)
+        {
+            return RING_ERROR_PARAM;
+        }
+        uvc_frame_buf_release(slot->raw_frame);
+        slot->raw_frame = raw_frame;
+        slot->raw_capacity = format->camera_param.frame_size;
+    }
+    if (format->zero_copy)
+    {
+        if (slot->own_planes)
+        {
+            free(slot->image_frame);
+            free(slot->temp_frame);
+            slot->image_capacity = 0;
+            slot->temp_capacity = 0;
+            slot->own_planes = 0;
+        }
+        slot->image_frame = slot->raw_frame;
+        slot->temp_frame = slot->raw_frame + format->image_byte_size;
+    }
+    else
+    {
+        if (!slot->own_planes)
+        {
+            slot->image_frame = NULL;
+            slot->temp_frame = NULL;
+            slot->own_planes = 1;
+        }
+        if (!ring_buf_fit(&slot->image_frame, &slot->image_capacity, format->image_byte_size) || \
+            !ring_buf_fit(&slot->temp_frame, &slot->temp_capacity, format->temp_byte_size))
+        {
+            return RING_ERROR_PARAM;
+        }
+    }
+    //a layout without a temp plane leaves the pyramid for the next one with it
+    if (format->temp_byte_size > 0 && (slot->temp_pyramid.width != format->temp_width || \
+        slot->temp_pyramid.height != format->temp_height))
+    {
+        frame_pyramid_release(&slot->temp_pyramid);
+        if (frame_pyramid_init(&slot->temp_pyramid, format->temp_width, format->temp_height) == FRAME_STATS_ERROR_MEM)
+        {
+            return RING_ERROR_PARAM;
+        }
+    }
+    ring_plane_set(&slot->desc.image, slot->image_frame, format->image_width, format->image_height, \
+                   format->image_byte_size);
+    ring_plane_set(&slot->desc.temp, slot->temp_frame, format->temp_width, format->temp_height, \
+                   format->temp_byte_size);
+    //the statistics of the last frame were of the old planes
+    slot->image_stats.valid = 0;
+    slot->temp_stats.valid = 0;
+    slot->temp_pyramid.valid = 0;
+    slot->profiles.valid = 0;
+    slot->format_gen = ring->format_gen;
+    return RING_SUCCESS;
+}
+
+int ring_format_change(FrameRing_t* ring, const RingFormat_t* format, uint8_t* drain_frame)
+{
+    const RingFormat_t* old_format = (ring != NULL) ? &ring->format : NULL;
+    if (ring == NULL || format == NULL || drain_frame == NULL || old_format->frame_pool != NULL || \
+        format->frame_pool != NULL || old_format->info_byte_size > 0 || format->info_byte_size > 0 || \
+        old_format->image_y8 || format->image_y8)
+    {
+        return RING_ERROR_PARAM;
+    }
+    ring->format = *format;
+    ring->drain_frame = drain_frame;
+    ring->format_gen++;
+    ring->format_changed = 1;
+    return RING_SUCCESS;
+}
+
+static void ring_consumer_fd_close(RingConsumer_t* consumer)
+{
+#if defined(__linux__)
+    if (consumer->event_fd >= 0)
+    {
+        close(consumer->event_fd);
+    }
+#endif
+    consumer->event_fd = -1;
+#if defined(_WIN32)
+    if (consumer->event_handle != NULL)
+    {
+        CloseHandle((HANDLE)consumer->event_handle);
+    }
+#endif
+    consumer->event_handle = NULL;
+}
+
+//wake the consumers waiting on their readiness fd or event, called with the ring mutex held
+static void ring_consumer_fd_signal(FrameRing_t* ring)
+{
+#if defined(__linux__)
+    for (int i = 0; i < FRAME_RING_MAX_CONSUMERS; i++)
+    {
+        RingConsumer_t* consumer = &ring->consumers[i];
+        if (consumer->attached && consumer->event_fd >= 0)
+        {
+            //a full counter is still readable, nothing is lost
+            uint64_t one = 1;
+            ssize_t rst = write(consumer->event_fd, &one, sizeof(one));
+            (void)rst;
+        }
+    }
+#elif defined(_WIN32)
+    for (int i = 0; i < FRAME_RING_MAX_CONSUMERS; i++)
+    {
+        RingConsumer_t* consumer = &ring->consumers[i];
+        if (consumer->attached && consumer->event_handle != NULL)
+        {
+            SetEvent((HANDLE)consumer->event_handle);
+        }
+    }
+#else
+    (void)ring;
+#endif
+}
+
+//release the ring and all slot buffers
+void ring_destroy(FrameRing_t* ring)
+{
+    if (ring == NULL)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < ring->depth; i++)
+    {
+        FrameSlot_t* slot = &ring->slots[i];
+        frame_pyramid_release(&slot->temp_pyramid);
+        if (ring->format.frame_pool != NULL)
+        {
+            //the pool's owner releases the whole region at once
+            continue;
+        }
+        if (slot->own_planes)
+        {
+            free(slot->image_frame);
+            free(slot->temp_frame);
+            free(slot->image_info_frame);
+            free(slot->temp_info_frame);
+        }
+        if (slot->raw_frame != NULL)
+        {
+            uvc_frame_buf_release(slot->raw_frame);
+        }
+    }
+    for (int i = 0; i < FRAME_RING_MAX_CONSUMERS; i++)
+    {
+        ring_consumer_fd_close(&ring->consumers[i]);
+    }
+    sync_mutex_destroy(&ring->mutex);
+    sync_cond_destroy(&ring->cond);
+    delete ring;
+}
+
+//choose the oldest slot nobody reads and mark it as writing
+FrameSlot_t* ring_write_begin(FrameRing_t* ring)
+{
+    for (int retry = 0; retry < 2; retry++)
+    {
+        FrameSlot_t* oldest = NULL;
+        for (uint32_t i = 0; i < ring->depth; i++)
+        {
+            FrameSlot_t* slot = &ring->slots[i];
+            if (slot->state.load(std::memory_order_acquire) != SLOT_STATE_FREE)
+            {
+                continue;
+            }
+            if (oldest == NULL || slot->seq < oldest->seq)
+            {
+                oldest = slot;
+            }
+        }
+        if (oldest == NULL)
+        {
+            return NULL;
+        }
+        int expected = SLOT_STATE_FREE;
+        if (oldest->state.compare_exchange_strong(expected, SLOT_STATE_WRITING, std::memory_order_acq_rel))
+        {
+            oldest->tag_flags = 0;
+            if (oldest->format_gen != ring->format_gen && ring_slot_reformat(ring, oldest) != RING_SUCCESS)
+            {
+                //half cut for the new layout, the old frame is gone with it
+                printf("ring slot alloc for the new format failed\n");
+                ring_write_abort(ring, oldest);
+                return NULL;
+            }
+            return oldest;
+        }
+    }
+    return NULL;
+}
+
+//publish the slot
+//one queued frame of a task consumer, the frame it gets follows the consumer's policy
+static void ring_task_run(void* arg)
+{
+    RingConsumer_t* consumer = (RingConsumer_t*)arg;
+    FrameRing_t* ring = (FrameRing_t*)consumer->ring;
+    FrameSlot_t* slot = NULL;
+    if (ring_read_acquire(ring, consumer->id, 0, &slot) == RING_SUCCESS)
+    {
+        consumer->task(slot, consumer->task_arg);
+        ring_read_release(ring, slot);
+    }
+}
+
+//usb delivery only ever adds delay: the frames' arrival less their period count is at least the fixed delay,
+//the least of the window takes the jitter out. a period change or an overlong gap restarts the clock
+static uint64_t ring_capture_time(FrameRing_t* ring, FrameSlot_t* slot, uint64_t timestamp_us)
+{
+    uint64_t period_us = ring->capture_period_us;
+    if (period_us == 0)
+    {
+        period_us = ring->interval_us.load(std::memory_order_relaxed);
+    }
+    uint8_t counted = (slot->tag_flags & FRAME_DESC_META) != 0;
+    uint64_t periods = 0;
+    if (ring->capture_num > 0 && period_us > 0 && timestamp_us > ring->capture_us)
+    {
+        if (counted && ring->capture_counted)
+        {
+            periods = (uint32_t)(slot->desc.meta.counter - ring->capture_counter);
+        }
+        else
+        {
+            //from the jitter free estimate of the last frame, arrivals are late by less than half a period
+            periods = (timestamp_us - ring->capture_us + period_us / 2) / period_us;
+            periods = (periods == 0) ? 1 : periods;
+        }
+    }
+    if (periods == 0 || periods > RING_CAPTURE_WINDOW)
+    {
+        ring->capture_base_us = timestamp_us;
+        ring->capture_index = 0;
+        ring->capture_num = 0;
+    }
+    else
+    {
+        ring->capture_index += periods;
+    }
+    int64_t resid = (int64_t)(timestamp_us - ring->capture_base_us) - (int64_t)(ring->capture_index * period_us);
+    ring->capture_resid[ring->capture_num % RING_CAPTURE_WINDOW] = resid;
+    ring->capture_num++;
+    uint32_t num = (ring->capture_num < RING_CAPTURE_WINDOW) ? ring->capture_num : RING_CAPTURE_WINDOW;
+    int64_t least = resid;
+    for (uint32_t i = 0; i < num; i++)
+    {
+        least = (ring->capture_resid[i] < least) ? ring->capture_resid[i] : least;
+    }
+    ring->capture_us = ring->capture_base_us + ring->capture_index * period_us + least;
+    ring->capture_counter = slot->desc.meta.counter;
+    ring->capture_counted = counted;
+    return (ring->capture_us > ring->capture_latency_us) ? ring->capture_us - ring->capture_latency_us : 0;
+}
+
+void ring_write_commit(FrameRing_t* ring, FrameSlot_t* slot, uint64_t timestamp_us)
+{
+    uint64_t capture_us = ring_capture_time(ring, slot, timestamp_us);
+    if (ring->last_commit_us != 0 && timestamp_us > ring->last_commit_us)
+    {
+        //a gap (drops, reconnect) counts as a few long intervals, the average follows a lasting fps change slowly
+        uint64_t delta_us = timestamp_us - ring->last_commit_us;
+        uint32_t interval_us = ring->interval_us.load(std::memory_order_relaxed);
+        if (interval_us == 0)
+        {
+            interval_us = (uint32_t)((delta_us > 1000000) ? 1000000 : delta_us);
+        }
+        else
+        {
+            if (delta_us > (uint64_t)interval_us * RING_TIMEOUT_INTERVALS)
+            {
+                delta_us = (uint64_t)interval_us * RING_TIMEOUT_INTERVALS;
+            }
+            interval_us = (uint32_t)((interval_us * 7ull + delta_us) / 8);
+        }
+        ring->interval_us.store(interval_us, std::memory_order_relaxed);
+    }
+    ring->last_commit_us = timestamp_us;
+    ring->write_seq++;
+    ring->produced++;
+    slot->seq = ring->write_seq;
+    slot->desc.seq = ring->write_seq;
+    slot->desc.timestamp_us = timestamp_us;
+    slot->desc.capture_us = capture_us;
+    slot->desc.image_stats = slot->image_stats.valid ? &slot->image_stats : NULL;
+    slot->desc.temp_stats = slot->temp_stats.valid ? &slot->temp_stats : NULL;
+    slot->desc.image_tiles = (slot->image_stats.valid && slot->image_tiles.valid) ? &slot->image_tiles : NULL;
+    slot->desc.temp_tiles = (slot->temp_stats.valid && slot->temp_tiles.valid) ? &slot->temp_tiles : NULL;
+    slot->desc.temp_pyramid = (slot->temp_stats.valid && slot->temp_pyramid.valid) ? &slot->temp_pyramid : NULL;
+    slot->desc.profiles = slot->profiles.valid ? &slot->profiles : NULL;
+    slot->desc.flags = (slot->image_stats.valid ? FRAME_DESC_IMAGE_STATS : 0) | \
+                       (slot->temp_stats.valid ? FRAME_DESC_TEMP_STATS : 0) | \
+                       (ring->format.zero_copy ? FRAME_DESC_ZERO_COPY : 0) | \
+                       (ring->format_changed ? FRAME_DESC_FORMAT_CHANGE : 0) | slot->tag_flags;
+    slot->desc.format_gen = slot->format_gen;
+    ring->format_changed = 0;
+    slot->state.store(SLOT_STATE_FREE, std::memory_order_release);
+    ring->published_seq.store(ring->write_seq, std::memory_order_release);
+
+    sync_mutex_lock(&ring->mutex);
+    ring->signal_us.store(get_monotonic_us(), std::memory_order_relaxed);
+    sync_cond_broadcast(&ring->cond);
+    ring_consumer_fd_signal(ring);
+    sync_mutex_unlock(&ring->mutex);
+
+    //attach/detach of task consumers happen on the producer side, the list is stable here
+    for (int i = 0; i < FRAME_RING_MAX_CONSUMERS; i++)
+    {
+        RingConsumer_t* consumer = &ring->consumers[i];
+        if (consumer->attached && consumer->task != NULL)
+        {
+            //a full strand is a consumer that lags, the frame is skipped or counted as a drop by its policy
+            pool_strand_submit(&consumer->strand, consumer->task_stage, ring_task_run, consumer);
+        }
+    }
+}
+
+//give the slot back unpublished, its previous content is no longer valid
+void ring_write_abort(FrameRing_t* ring, FrameSlot_t* slot)
+{
+    slot->seq = 0;
+    slot->desc.seq = 0;
+    slot->state.store(SLOT_STATE_FREE, std::memory_order_release);
+}
+
+void ring_write_drop(FrameRing_t* ring)
+{
+    ring->producer_dropped++;
+    uint64_t now_us = get_monotonic_us();
+    if (now_us - ring->hold_report_us < RING_HOLD_REPORT_MS * 1000ull)
+    {
+        return;
+    }
+    FrameSlot_t* oldest = NULL;
+    uint64_t oldest_us = 0;
+    for (uint32_t i = 0; i < ring->depth; i++)
+    {
+        FrameSlot_t* slot = &ring->slots[i];
+        uint64_t hold_us = slot->hold_us.load(std::memory_order_relaxed);
+        if (slot->state.load(std::memory_order_relaxed) > 0 && hold_us > 0 && (oldest == NULL || hold_us < oldest_us))
+        {
+            oldest = slot;
+            oldest_us = hold_us;
+        }
+    }
+    //a snapshot, a reader may let go meanwhile
+    if (oldest != NULL && now_us > oldest_us && now_us - oldest_us > ring->hold_warn_us)
+    {
+        ring->hold_report_us = now_us;
+        printf("ring: every slot held, frame %llu for %llu ms by %d readers, consumer %d took it last\n", \
+            (unsigned long long)oldest->seq.load(std::memory_order_relaxed), \
+            (unsigned long long)((now_us - oldest_us) / 1000), oldest->state.load(std::memory_order_relaxed), \
+            oldest->last_reader.load(std::memory_order_relaxed));
+    }
+}
+
+//write_seq is producer only, the next commit publishes past the gap
+void ring_write_skip(FrameRing_t* ring, uint64_t frames)
+{
+    ring->write_seq += frames;
+    ring->producer_lost += frames;
+    //the module restarts its counter with the stream
+    ring->hw_counter_valid = 0;
+}
+
+void ring_close(FrameRing_t* ring)
+{
+    sync_mutex_lock(&ring->mutex);
+    ring->closed.store(1);
+    sync_cond_broadcast(&ring->cond);
+    ring_consumer_fd_signal(ring);
+    sync_mutex_unlock(&ring->mutex);
+
+    for (int i = 0; i < FRAME_RING_MAX_CONSUMERS; i++)
+    {
+        RingConsumer_t* consumer = &ring->consumers[i];
+        if (consumer->attached && consumer->task != NULL)
+        {
+            pool_strand_destroy(&consumer->strand);
+            consumer->task = NULL;
+            printf("ring task consumer %d (%s) frames:%llu dropped:%llu\n", i, \
+                pool_stage_name(consumer->task_stage), (unsigned long long)consumer->frames, \
+                (unsigned long long)consumer->dropped);
+            ring_consumer_detach(ring, i);
+        }
+    }
+}
+
+//wait until every consumer thread has left the ring
+int ring_wait_detached(FrameRing_t* ring, uint32_t timeout_ms)
+{
+    sync_deadline_t deadline;
+    sync_deadline_set(&deadline, timeout_ms);
+    int rst = RING_SUCCESS;
+    sync_mutex_lock(&ring->mutex);
+    while (ring->attached_cnt.load() > 0)
+    {
+        if (sync_cond_wait_until(&ring->cond, &ring->mutex, &deadline) != SYNC_SUCCESS)
+        {
+            rst = (ring->attached_cnt.load() > 0) ? RING_TIMEOUT : RING_SUCCESS;
+            break;
+        }
+    }
+    sync_mutex_unlock(&ring->mutex);
+    return rst;
+}
+
+int ring_consumer_attach(FrameRing_t* ring, RingPolicy_t policy)
+{
+    if (ring == NULL)
+    {
+        return RING_ERROR_PARAM;
+    }
+    int id = RING_ERROR_PARAM;
+    sync_mutex_lock(&ring->mutex);
+    for (int i = 0; i < FRAME_RING_MAX_CONSUMERS; i++)
+    {
+        RingConsumer_t* consumer = &ring->consumers[i];
+        if (!consumer->attached)
+        {
+            memset(consumer, 0, sizeof(RingConsumer_t));
+            consumer->event_fd = -1;
+            consumer->attached = 1;
+            consumer->policy = policy;
+            //start from the current frame, older frames are not counted as drops
+            consumer->last_seq = ring->published_seq.load();
+            ring->attached_cnt++;
+            id = i;
+            break;
+        }
+    }
+    sync_mutex_unlock(&ring->mutex);
+    return id;
+}
+
+void ring_consumer_detach(FrameRing_t* ring, int consumer_id)
+{
+    if (ring == NULL || consumer_id < 0 || consumer_id >= FRAME_RING_MAX_CONSUMERS)
+    {
+        return;
+    }
+    sync_mutex_lock(&ring->mutex);
+    if (ring->consumers[consumer_id].attached)
+    {
+        ring->consumers[consumer_id].attached = 0;
+        ring_consumer_fd_close(&ring->consumers[consumer_id]);
+        ring->attached_cnt--;
+    }
+    sync_cond_broadcast(&ring->cond);
+    sync_mutex_unlock(&ring->mutex);
+}
+
+int ring_consumer_attach_task(FrameRing_t* ring, RingPolicy_t policy, PoolStage_t stage, \
+    RingTaskFunc_t func, void* arg)
+{
+    if (func == NULL)
+    {
+        return RING_ERROR_PARAM;
+    }
+    int id = ring_consumer_attach(ring, policy);
+    if (id < 0)
+    {
+        return id;
+    }
+    RingConsumer_t* consumer = &ring->consumers[id];
+    pool_strand_init(&consumer->strand);
+    consumer->task_arg = arg;
+    consumer->task_stage = stage;
+    consumer->ring = ring;
+    consumer->id = id;
+    consumer->task = func;
+    return id;
+}
+
+//try to take a reference to the oldest published frame with seq >= target
+static FrameSlot_t* ring_try_acquire(FrameRing_t* ring, uint64_t target)
+{
+    for (int retry = 0; retry < 4; retry++)
+    {
+        FrameSlot_t* best = NULL;
+        uint64_t best_seq = 0;
+        for (uint32_t i = 0; i < ring->depth; i++)
+        {
+            FrameSlot_t* slot = &ring->slots[i];
+            uint64_t seq = slot->seq;
+            if (slot->state.load(std::memory_order_acquire) == SLOT_STATE_WRITING || seq < target || seq == 0)
+            {
+                continue;
+            }
+            if (best == NULL || seq < best_seq)
+            {
+                best = slot;
+                best_seq = seq;
+            }
+        }
+        if (best == NULL)
+        {
+            return NULL;
+        }
+
+        //a release callback holds the slot for a moment, the frame stays and is taken afterwards
+        int state = best->state.load(std::memory_order_acquire);
+        while (state >= 0 || state == SLOT_STATE_RELEASING)
+        {
+            if (state == SLOT_STATE_RELEASING)
+            {
+                state = best->state.load(std::memory_order_acquire);
+                continue;
+            }
+            if (best->state.compare_exchange_weak(state, state + 1, std::memory_order_acq_rel))
+            {
+                break;
+            }
+        }
+        if (state < 0)
+        {
+            continue;   //the producer took it in the meantime
+        }
+        if (state == 0)
+        {
+            best->hold_us.store(get_monotonic_us(), std::memory_order_relaxed);
+        }
+        if (best->seq == best_seq)
+        {
+            return best;
+        }
+        ring_read_release(ring, best);  //rewritten before we got the reference
+    }
+    return NULL;
+}
+
+//take a reference to the next frame according to the consumer's policy
+int ring_read_acquire(FrameRing_t* ring, int consumer_id, uint32_t timeout_ms, FrameSlot_t** slot)
+{
+    if (ring == NULL || slot == NULL || consumer_id < 0 || consumer_id >= FRAME_RING_MAX_CONSUMERS)
+    {
+        return RING_ERROR_PARAM;
+    }
+    RingConsumer_t* consumer = &ring->consumers[consumer_id];
+    sync_deadline_t deadline;
+    uint8_t deadline_set = 0;
+    uint8_t waited = 0;
+#if defined(__linux__)
+    if (consumer->event_fd >= 0)
+    {
+        //cleared before looking, a frame published after this signals it again
+        uint64_t cnt;
+        ssize_t rst = read(consumer->event_fd, &cnt, sizeof(cnt));
+        (void)rst;
+    }
+#elif defined(_WIN32)
+    if (consumer->event_handle != NULL)
+    {
+        ResetEvent((HANDLE)consumer->event_handle);
+    }
+#endif
+
+    while (1)
+    {
+        uint64_t newest = ring->published_seq.load(std::memory_order_acquire);
+        if (newest > consumer->last_seq)
+        {
+            uint64_t target = (consumer->policy == RING_POLICY_NEWEST) ? newest : consumer->last_seq + 1;
+            FrameSlot_t* found = ring_try_acquire(ring, target);
+            if (found == NULL && consumer->policy == RING_POLICY_NEWEST)
+            {
+                found = ring_try_acquire(ring, consumer->last_seq + 1);
+            }
+            if (found != NULL)
+            {
+                consumer->dropped += found->seq - consumer->last_seq - 1;
+                consumer->last_seq = found->seq;
+                consumer->frames++;
+                found->last_reader.store(consumer_id, std::memory_order_relaxed);
+                *slot = found;
+                if (waited)
+                {
+                    rt_wakeup_record_since(ring->signal_us.load(std::memory_order_relaxed));
+                }
+                return RING_SUCCESS;
+            }
+        }
+        if (ring->closed.load())
+        {
+            return RING_CLOSED;
+        }
+
+        if (!deadline_set)
+        {
+            sync_deadline_set(&deadline, timeout_ms);
+            deadline_set = 1;
+        }
+        int wait_rst = SYNC_SUCCESS;
+        sync_mutex_lock(&ring->mutex);
+        if (ring->published_seq.load() == newest && !ring->closed.load())
+        {
+            wait_rst = sync_cond_wait_until(&ring->cond, &ring->mutex, &deadline);
+            waited = 1;
+        }
+        sync_mutex_unlock(&ring->mutex);
+        if (wait_rst != SYNC_SUCCESS && ring->published_seq.load() == newest)
+        {
+            return RING_TIMEOUT;
+        }
+    }
+}
+
+//the hold ends with the last reference: without a release callback that is a plain decrement, with one the slot
+//passes SLOT_STATE_RELEASING so the callback still sees the frame
+void ring_read_release(FrameRing_t* ring, FrameSlot_t* slot)
+{
+    if (slot == NULL)
+    {
+        return;
+    }
+    //read while still held, a new first reader overwrites it only after the count reached 0
+    uint64_t hold_us = slot->hold_us.load(std::memory_order_relaxed);
+    RingReleaseFunc_t release_func = (ring != NULL) ? ring->release_func : NULL;
+    if (release_func == NULL)
+    {
+        if (slot->state.fetch_sub(1, std::memory_order_acq_rel) != 1 || ring == NULL)
+        {
+            return;
+        }
+    }
+    else
+    {
+        int state = slot->state.load(std::memory_order_acquire);
+        while (1)
+        {
+            if (state > 1)
+            {
+                if (slot->state.compare_exchange_weak(state, state - 1, std::memory_order_acq_rel))
+                {
+                    return;
+                }
+            }
+            else if (slot->state.compare_exchange_weak(state, SLOT_STATE_RELEASING, std::memory_order_acq_rel))
+            {
+                break;
+            }
+        }
+    }
+    uint64_t held_us = (hold_us > 0) ? get_monotonic_us() - hold_us : 0;
+    timing_hist_record(&ring->hold_hist, held_us);
+    if (held_us > ring->hold_warn_us)
+    {
+        ring->long_holds.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (release_func != NULL)
+    {
+        release_func(slot, held_us, ring->release_arg);
+        slot->state.store(SLOT_STATE_FREE, std::memory_order_release);
+    }
+}
+
+void ring_release_func_set(FrameRing_t* ring, RingReleaseFunc_t func, void* arg)
+{
+    if (ring != NULL)
+    {
+        ring->release_arg = arg;
+        ring->release_func = func;
+    }
+}
+
+void ring_capture_clock_set(FrameRing_t* ring, uint32_t period_us, uint32_t latency_us)
+{
+    if (ring != NULL)
+    {
+        if (ring->capture_period_us != period_us)
+        {
+            ring->capture_num = 0;
+        }
+        ring->capture_period_us = period_us;
+        ring->capture_latency_us = latency_us;
+    }
+}
+
+void ring_hold_warn_set(FrameRing_t* ring, uint32_t warn_ms)
+{
+    if (ring != NULL)
+    {
+        ring->hold_warn_us = warn_ms * 1000;
+    }
+}
+
+void ring_hold_stats(FrameRing_t* ring, TimingStats_t* stats, uint64_t* long_holds)
+{
+    if (ring == NULL)
+    {
+        return;
+    }
+    if (stats != NULL)
+    {
+        timing_hist_stats(&ring->hold_hist, stats);
+    }
+    if (long_holds != NULL)
+    {
+        *long_holds = ring->long_holds.load(std::memory_order_relaxed);
+    }
+}
+
+//the count is above 0 while the caller holds it, the producer cannot take the slot in between
+void ring_slot_ref(FrameSlot_t* slot)
+{
+    if (slot != NULL)
+    {
+        slot->state.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+//the counter and vtemp fields of the image info line, read where the line is
+static void ring_slot_meta(FrameRing_t* ring, FrameSlot_t* slot)
+{
+    const uint8_t* info = slot->desc.image_info;
+    if (info == NULL || ring->format.info_byte_size < RING_INFO_VTEMP_OFFSET + 2)
+    {
+        return;
+    }
+    FrameMeta_t* meta = &slot->desc.meta;
+    meta->counter = (uint32_t)info[RING_INFO_COUNTER_OFFSET] | (uint32_t)info[RING_INFO_COUNTER_OFFSET + 1] << 8 | \
+                    (uint32_t)info[RING_INFO_COUNTER_OFFSET + 2] << 16 | (uint32_t)info[RING_INFO_COUNTER_OFFSET + 3] << 24;
+    meta->vtemp = (uint16_t)(info[RING_INFO_VTEMP_OFFSET] | info[RING_INFO_VTEMP_OFFSET + 1] << 8);
+    slot->tag_flags |= FRAME_DESC_META;
+    uint32_t gap = meta->counter - ring->hw_counter - 1;
+    if (ring->hw_counter_valid && gap > 0 && gap < RING_INFO_GAP_MAX)
+    {
+        ring->hw_lost += gap;
+    }
+    ring->hw_counter = meta->counter;
+    ring->hw_counter_valid = 1;
+}
+
+//split the raw frame, zero-copy slots already view into it
+void ring_slot_cut(FrameRing_t* ring, FrameSlot_t* slot)
+{
+    RingFormat_t* format = &ring->format;
+    uint8_t temp_due = (format->temp_interval <= 1 || ring->cut_cnt % format->temp_interval == 0);
+    ring->cut_cnt++;
+    if (format->zero_copy)
+    {
+        ring_slot_meta(ring, slot);
+        return;
+    }
+    if (!temp_due && format->temp_byte_size > 0)
+    {
+        slot->tag_flags |= FRAME_DESC_TEMP_SKIPPED;
+    }
+    if (!format->image_y8)
+    {
+        if (format->info_byte_size > 0 && temp_due)
+        {
+            //image, image info line, temp, temp info line
+            DataInfo_t image = { (int)format->image_byte_size, slot->image_frame };
+            DataInfo_t image_info = { (int)format->info_byte_size, slot->image_info_frame };
+            DataInfo_t temp = { (int)format->temp_byte_size, slot->temp_frame };
+            DataInfo_t temp_info = { (int)format->info_byte_size, slot->temp_info_frame };
+            ac020_frame_data_cut(slot->raw_frame, image, image_info, temp, temp_info);
+        }
+        else if (temp_due && format->temp_byte_size > 0)
+        {
+            raw_data_cut(slot->raw_frame, format->image_byte_size, format->temp_byte_size, \
+                         slot->image_frame, slot->temp_frame);
+        }
+        else
+        {
+            memcpy(slot->image_frame, slot->raw_frame, format->image_byte_size);
+            if (format->info_byte_size > 0)
+            {
+                memcpy(slot->image_info_frame, slot->raw_frame + format->image_byte_size, format->info_byte_size);
+            }
+        }
+        ring_slot_meta(ring, slot);
+        return;
+    }
+
+    //the wire carries 16 bit pixels: stretched once here, every consumer reads a byte per pixel
+    int pix_num = (int)(format->image_width * format->image_height);
+    const uint16_t* image = (const uint16_t*)slot->raw_frame;
+    uint16_t min_val = 0, max_val = 0;
+    simd_minmax_u16(image, pix_num, &min_val, &max_val);
+    simd_stretch_u16_u8(image, pix_num, min_val, (uint32_t)(max_val - min_val), slot->image_frame);
+    uint8_t* temp_raw = slot->raw_frame + pix_num * 2 + format->info_byte_size;
+    if (format->info_byte_size > 0)
+    {
+        memcpy(slot->image_info_frame, slot->raw_frame + pix_num * 2, format->info_byte_size);
+    }
+    if (temp_due && format->temp_byte_size > 0)
+    {
+        memcpy(slot->temp_frame, temp_raw, format->temp_byte_size);
+        if (format->info_byte_size > 0)
+        {
+            memcpy(slot->temp_info_frame, temp_raw + format->temp_byte_size, format->info_byte_size);
+        }
+    }
+    ring_slot_meta(ring, slot);
+}
+
+//copy the planes out of the slot, the caller holds a read reference while copying
+int ring_slot_copy(FrameSlot_t* slot, uint8_t* image_dst, uint8_t* temp_dst)
+{
+    if (slot == NULL)
+    {
+        return RING_ERROR_PARAM;
+    }
+    if (image_dst != NULL && slot->desc.image.byte_size > 0)
+    {
+        memcpy(image_dst, slot->desc.image.data, slot->desc.image.byte_size);
+    }
+    if (temp_dst != NULL && slot->desc.temp.byte_size > 0)
+    {
+        memcpy(temp_dst, slot->desc.temp.data, slot->desc.temp.byte_size);
+    }
+    return RING_SUCCESS;
+}
+
+//the producer signals the fd from ring_write_commit and ring_close, under the ring mutex like detach closes it
+int ring_consumer_fd(FrameRing_t* ring, int consumer_id)
+{
+    if (ring == NULL || consumer_id < 0 || consumer_id >= FRAME_RING_MAX_CONSUMERS)
+    {
+        return RING_ERROR_PARAM;
+    }
+#if defined(__linux__)
+    int fd = RING_ERROR_PARAM;
+    sync_mutex_lock(&ring->mutex);
+    RingConsumer_t* consumer = &ring->consumers[consumer_id];
+    if (consumer->attached && consumer->task == NULL)
+    {
+        if (consumer->event_fd < 0)
+        {
+            consumer->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            //a frame or the close may already be there
+            if (consumer->event_fd >= 0 && \
+                (ring->published_seq.load() > consumer->last_seq || ring->closed.load()))
+            {
+                uint64_t one = 1;
+                ssize_t rst = write(consumer->event_fd, &one, sizeof(one));
+                (void)rst;
+            }
+        }
+        fd = (consumer->event_fd >= 0) ? consumer->event_fd : RING_ERROR_UNAVAILABLE;
+    }
+    sync_mutex_unlock(&ring->mutex);
+    return fd;
+#else
+    return RING_ERROR_UNAVAILABLE;
+#endif
+}
+
+//manual reset so every waiter on the handle sees it, ring_read_acquire resets it before looking
+void* ring_consumer_event(FrameRing_t* ring, int consumer_id)
+{
+    if (ring == NULL || consumer_id < 0 || consumer_id >= FRAME_RING_MAX_CONSUMERS)
+    {
+        return NULL;
+    }
+#if defined(_WIN32)
+    void* event = NULL;
+    sync_mutex_lock(&ring->mutex);
+    RingConsumer_t* consumer = &ring->consumers[consumer_id];
+    if (consumer->attached && consumer->task == NULL)
+    {
+        if (consumer->event_handle == NULL)
+        {
+            consumer->event_handle = CreateEventA(NULL, TRUE, FALSE, NULL);
+            //a frame or the close may already be there
+            if (consumer->event_handle != NULL && \
+                (ring->published_seq.load() > consumer->last_seq || ring->closed.load()))
+            {
+                SetEvent((HANDLE)consumer->event_handle);
+            }
+        }
+        event = consumer->event_handle;
+    }
+    sync_mutex_unlock(&ring->mutex);
+    return event;
+#else
+    return NULL;
+#endif
+}
+
+uint32_t ring_frame_timeout_ms(FrameRing_t* ring, uint32_t max_ms)
+{
+    uint32_t interval_us = (ring != NULL) ? ring->interval_us.load(std::memory_order_relaxed) : 0;
+    if (interval_us == 0)
+    {
+        return max_ms;
+    }
+    uint32_t timeout_ms = (interval_us * RING_TIMEOUT_INTERVALS + 999) / 1000;
+    if (timeout_ms < RING_TIMEOUT_MIN_MS)
+    {
+        timeout_ms = RING_TIMEOUT_MIN_MS;
+    }
+    return (timeout_ms < max_ms) ? timeout_ms : max_ms;
+}
+
+int ring_consumer_stats(FrameRing_t* ring, int consumer_id, uint64_t* frames, uint64_t* dropped)
+{
+    if (ring == NULL || consumer_id < 0 || consumer_id >= FRAME_RING_MAX_CONSUMERS)
+    {
+        return RING_ERROR_PARAM;
+    }
+    if (frames != NULL)
+    {
+        *frames = ring->consumers[consumer_id].frames;
+    }
+    if (dropped != NULL)
+    {
+        *dropped = ring->consumers[consumer_id].dropped;
+    }
+    return RING_SUCCESS;
+}
@@ -0,0 +1,314 @@
+#ifndef _RING_H_
+#define _RING_H_
+
+#include <stdint.h>
+#include <atomic>
+#include "libiruvc.h"
+#include "stats.h"
+#include "pool.h"
+#include "framepool.h"
+#include "sync.h"
+#include "timing.h"
+
+#define FRAME_RING_DEFAULT_DEPTH 4
+#define FRAME_RING_MAX_DEPTH 16
+#define FRAME_RING_MAX_CONSUMERS 8
+
+#define RING_SUCCESS 0
+#define RING_ERROR_PARAM -1
+#define RING_TIMEOUT -2
+#define RING_CLOSED -3
+#define RING_ERROR_UNAVAILABLE -4   //readiness fds are linux only
+
+//slot state: >0 is the reader count, every reader holds one reference
+#define SLOT_STATE_FREE 0
+#define SLOT_STATE_WRITING -1
+#define SLOT_STATE_RELEASING -2     //the last reference is gone, the release callback still reads the frame
+
+#define RING_CACHE_LINE 64          //fields written by different threads are kept on separate lines
+#define RING_TIMEOUT_INTERVALS 4    //ring_frame_timeout_ms: a frame later than this many intervals is overdue
+#define RING_TIMEOUT_MIN_MS 20
+//ac020 image info line fields, byte offsets, little endian. libirparse documents only where the lines are,
+//check against cur_vtemp_get when bringing up a new module
+#define RING_INFO_COUNTER_OFFSET 0  //32 bit frame counter of the module, one up per frame
+#define RING_INFO_VTEMP_OFFSET 4    //16 bit sensor temperature, the unit of cur_vtemp_get
+#define RING_INFO_GAP_MAX 65536     //a larger jump of the counter is a module restart, not lost frames
+#define RING_HOLD_WARN_MS 500       //a slot held longer than this is a long hold, ring_hold_warn_set
+#define RING_HOLD_REPORT_MS 1000    //a full ring reports its longest held slot at most this often
+#define RING_CAPTURE_WINDOW 32      //frames the capture clock takes its least delayed arrival from
+
+//FrameDesc_t flags
+#define FRAME_DESC_IMAGE_STATS 0x01 //image_stats points at valid statistics
+#define FRAME_DESC_TEMP_STATS 0x02
+#define FRAME_DESC_ZERO_COPY 0x04   //the planes are views into the raw frame
+#define FRAME_DESC_GAIN_TRANSITION 0x08 //the sensor is switching gain, temperatures are off: skip rather than wait
+#define FRAME_DESC_SHUTTER_CLOSED 0x10  //the overexposure guard closed the shutter, the frame shows the shutter
+#define FRAME_DESC_SHUTTER_NUC 0x20     //shutter close or nuc in progress, frozen or flat: hold the last good output
+#define FRAME_DESC_HDR_FUSED 0x40     //the temp plane is the dual gain fusion of hdr.h, extended range
+#define FRAME_DESC_TEMP_SKIPPED 0x80   //temp_interval: this frame's temp plane was not cut, it holds an older one
+#define FRAME_DESC_META 0x100         //meta holds the fields of the frame's image info line
+#define FRAME_DESC_CORRUPT 0x200      //integrity.h: a stale or partly written transfer, committed for the record only
+#define FRAME_DESC_STAB 0x400         //stab.h: motion holds the view's shift since the last frame and its jitter
+#define FRAME_DESC_FORMAT_CHANGE 0x800  //the first frame of a new ring_format_change layout, the planes differ from before
+#define FRAME_DESC_TEMP_INVALID (FRAME_DESC_GAIN_TRANSITION | FRAME_DESC_SHUTTER_CLOSED | FRAME_DESC_SHUTTER_NUC | \
+    FRAME_DESC_TEMP_SKIPPED | FRAME_DESC_CORRUPT)
+#define FRAME_DESC_IMAGE_INVALID (FRAME_DESC_SHUTTER_CLOSED | FRAME_DESC_SHUTTER_NUC | FRAME_DESC_CORRUPT)
+
+typedef enum
+{
+    RING_POLICY_NEWEST = 0,     //always jump to the latest published frame, skip the rest
+    RING_POLICY_NEXT,           //take frames in order, frames overwritten before read count as drops
+}RingPolicy_t;
+
+typedef struct {
+    uint8_t* data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;            //bytes per line
+    uint32_t byte_size;
+}FramePlane_t;
+
+//the parsed image info line of an ac020 frame
+typedef struct {
+    uint32_t counter;           //the module's frame counter
+    uint16_t vtemp;             //sensor temperature as cur_vtemp_get returns it, without the command round trip
+}FrameMeta_t;
+
+typedef struct {
+    CameraParam_t camera_param;
+    uint32_t image_byte_size;
+    uint32_t image_width;
+    uint32_t image_height;
+    uint32_t temp_byte_size;
+    uint32_t temp_width;
+    uint32_t temp_height;
+    uint8_t zero_copy;          //image/temp planes are views into raw_frame instead of cut copies
+    uint8_t image_y8;           //the raw frame's image half is 16 bit, the cut stretches it into the Y8 image plane
+    uint32_t temp_interval;     //cut the temp plane every temp_interval frames, 0/1 every frame
+    uint32_t info_byte_size;    //ac020: bytes of the info line after the image and after the temp plane, 0 without
+    FramePool_t* frame_pool;    //slot planes are carved from it instead of the heap, it must outlive the ring
+}RingFormat_t;
+
+//the motion of the view stab.h measured, valid with FRAME_DESC_STAB. a point of the steady view is at
+//(x + jitter_x, y + jitter_y) in this frame, turned by jitter_angle about the plane center
+typedef struct {
+    float dx;                   //shift of the scene since the last measured frame, pixels
+    float dy;
+    float angle;                //turn since the last measured frame, radians, 0 without rotation
+    float jitter_x;             //the summed up shifts less their smoothed path, what the compensation undoes
+    float jitter_y;
+    float jitter_angle;
+}FrameMotion_t;
+
+//one published frame as its consumers see it. the producer fills it before ring_write_commit and nobody
+//writes it while a reader holds the slot, so every stage takes its frame from here instead of the
+//stream's shared StreamFrameInfo_t
+typedef struct {
+    uint64_t seq;
+    uint64_t timestamp_us;      //monotonic time when uvc_frame_get returned
+    uint64_t capture_us;        //the same clock at capture: arrivals without the usb jitter, less the device's latency
+    FramePlane_t image;
+    FramePlane_t temp;
+    const FrameStats_t* image_stats;    //NULL when the stream thread computed none
+    const FrameStats_t* temp_stats;
+    const FrameTiles_t* image_tiles;    //tile signatures of the stats pass, NULL when not computed
+    const FrameTiles_t* temp_tiles;
+    const FramePyramid_t* temp_pyramid; //min/max/mean levels of the temp plane, NULL when not built
+    const FrameProfiles_t* profiles;    //projection profiles for stab.h, NULL when not computed
+    const uint8_t* image_info;  //ac020 info lines, info_byte_size bytes each, NULL without
+    const uint8_t* temp_info;
+    FrameMeta_t meta;           //valid with FRAME_DESC_META
+    FrameMotion_t motion;       //valid with FRAME_DESC_STAB
+    uint32_t flags;             //FRAME_DESC_xxx
+    uint32_t format_gen;        //the ring_format_change layout of the planes, 0 the one of ring_create
+}FrameDesc_t;
+
+typedef struct {
+    FrameDesc_t desc;
+    uint8_t* raw_frame;
+    uint8_t* image_frame;       //same as desc.image.data
+    uint8_t* temp_frame;        //same as desc.temp.data
+    uint8_t* image_info_frame;  //same as desc.image_info, in the raw frame with zero_copy
+    uint8_t* temp_info_frame;
+    FrameStats_t image_stats;   //filled by the stream thread for Y14/Y16 image planes
+    FrameStats_t temp_stats;    //filled by the stream thread when there is a temp plane
+    FrameTiles_t image_tiles;   //computed along with the stats blocks
+    FrameTiles_t temp_tiles;
+    FramePyramid_t temp_pyramid;    //allocated with the slot when the temp plane is large enough for a level
+    FrameProfiles_t profiles;   //of the image plane, of the temp plane without a Y14/Y16 one, with a stab.h only
+    uint32_t tag_flags;         //FRAME_DESC_xxx the producer adds to the frame, cleared by ring_write_begin
+    uint32_t format_gen;        //the layout the buffers are cut for, producer only
+    uint32_t raw_capacity;      //bytes allocated behind raw_frame, image_frame and temp_frame
+    uint32_t image_capacity;
+    uint32_t temp_capacity;
+    uint8_t own_planes;         //image_frame/temp_frame are the slot's heap buffers, not views into raw_frame
+    std::atomic<uint64_t> seq;  //0 means the slot holds no valid frame, desc.seq once it is held
+    std::atomic<uint64_t> hold_us;  //when the first of its current readers took it
+    std::atomic<int> last_reader;   //consumer id of the latest ring_read_acquire, -1 before
+    alignas(RING_CACHE_LINE) std::atomic<int> state;    //every acquire/release writes it, away from the frame
+}FrameSlot_t;
+
+//task consumer callback, the slot is held for the duration of the call
+typedef void (*RingTaskFunc_t)(FrameSlot_t* slot, void* arg);
+
+//the last reference of a slot was released, held_us after the first reader took it. the frame is still intact and
+//the slot out of reach of readers and producer until the callback returns, keep it short
+typedef void (*RingReleaseFunc_t)(FrameSlot_t* slot, uint64_t held_us, void* arg);
+
+//each consumer on its own line, its counters are written by its own thread
+typedef struct alignas(RING_CACHE_LINE) {
+    uint8_t attached;
+    RingPolicy_t policy;
+    uint64_t last_seq;
+    uint64_t frames;
+    uint64_t dropped;
+    RingTaskFunc_t task;        //task consumer: one pool task per published frame instead of a thread
+    void* task_arg;
+    PoolStage_t task_stage;
+    PoolStrand_t strand;        //the consumer's tasks run in frame order, one at a time
+    void* ring;
+    int id;
+    int event_fd;               //ring_consumer_fd: eventfd the producer signals, -1 until asked for
+    void* event_handle;         //ring_consumer_event: the windows counterpart, a manual reset event, NULL until asked for
+}RingConsumer_t;
+
+typedef struct {
+    uint32_t depth;
+    RingFormat_t format;
+    FrameSlot_t slots[FRAME_RING_MAX_DEPTH];
+    RingConsumer_t consumers[FRAME_RING_MAX_CONSUMERS];
+    alignas(RING_CACHE_LINE) std::atomic<uint64_t> published_seq;  //read by every consumer
+    alignas(RING_CACHE_LINE) uint64_t write_seq;                    //producer only from here on
+
+    uint64_t produced;
+    uint64_t producer_dropped;  //frames received while every slot was held by a consumer
+    uint64_t producer_lost;     //sequence numbers skipped while the device was gone
+    uint64_t hw_lost;           //frames the module's counter skipped, lost before they reached the host
+    uint64_t capture_timeouts;  //uvc_frame_get/frame source calls that failed, usb timeouts mostly
+    uint32_t hw_counter;        //the last frame's counter, producer only
+    uint8_t hw_counter_valid;
+    uint64_t last_commit_us;    //arrival of the newest frame, producer only
+    uint32_t capture_period_us; //ring_capture_clock_set, 0 follows interval_us
+    uint32_t capture_latency_us;
+    uint64_t capture_base_us;   //capture clock, producer only: the arrival its frame periods count from
+    uint64_t capture_index;     //frame periods from capture_base_us to the newest frame
+    uint64_t capture_us;        //the newest frame's capture time before the latency
+    uint32_t capture_counter;   //its module frame counter
+    uint8_t capture_counted;    //the counter is valid, FRAME_DESC_META
+    uint32_t capture_num;       //arrivals in capture_resid, 0 restarts the clock
+    int64_t capture_resid[RING_CAPTURE_WINDOW]; //arrival - base - index * period of the latest frames
+    uint64_t cut_cnt;           //frames cut, producer only
+    std::atomic<uint32_t> interval_us;  //moving average of the arrival spacing, 0 before the second frame
+    uint8_t* drain_frame;       //scratch target for uvc_frame_get when no slot is free
+    uint32_t format_gen;        //ring_format_change count, producer only
+    uint8_t format_changed;     //the next commit is the first of the new layout
+    std::atomic<uint64_t> signal_us;    //the last broadcast of cond, the woken consumers' wakeup latency starts here
+    std::atomic<int> closed;
+    std::atomic<int> attached_cnt;
+    RingReleaseFunc_t release_func; //ring_release_func_set, NULL without
+    void* release_arg;
+    uint32_t hold_warn_us;
+    TimingHist_t hold_hist;         //first reference -> last release, of every hold
+    std::atomic<uint64_t> long_holds;   //holds longer than hold_warn_us
+    uint64_t hold_report_us;        //producer only, the last report of a full ring
+    sync_mutex_t mutex;
+    sync_cond_t cond;
+}FrameRing_t;
+
+//create the ring and preallocate every slot, depth 0 selects FRAME_RING_DEFAULT_DEPTH
+FrameRing_t* ring_create(RingFormat_t* format, uint32_t depth, uint8_t* drain_frame);
+
+//release the ring and all slot buffers. all consumers must have detached
+void ring_destroy(FrameRing_t* ring);
+
+//producer: get a slot to write the next frame into. never blocks, returns NULL when all slots are held
+FrameSlot_t* ring_write_begin(FrameRing_t* ring);
+
+//producer: a new layout of the frames from the next ring_write_begin on (a stream mode switch). each slot is cut
+//for it when it is next written, only the buffers too small for it are allocated again, so the frames the
+//consumers still hold keep their planes. the first frame of the layout carries FRAME_DESC_FORMAT_CHANGE.
+//drain_frame must hold the new frame_size. the info lines, the y8 cut and a frame pool stay in ring_create's
+//layout, RING_ERROR_PARAM
+int ring_format_change(FrameRing_t* ring, const RingFormat_t* format, uint8_t* drain_frame);
+
+//producer: publish the written slot and wake up waiting consumers
+void ring_write_commit(FrameRing_t* ring, FrameSlot_t* slot, uint64_t timestamp_us);
+
+//producer: give the slot back without publishing (frame get failed)
+void ring_write_abort(FrameRing_t* ring, FrameSlot_t* slot);
+
+//producer: count a frame that was received without a free slot. the slot held the longest is reported once it is
+//a long hold, at most every RING_HOLD_REPORT_MS
+void ring_write_drop(FrameRing_t* ring);
+
+//producer: leave a gap of frames sequence numbers, the frames the device did not deliver.
+//consumers count them as drops
+void ring_write_skip(FrameRing_t* ring, uint64_t frames);
+
+//producer: the frame period of the device (0 follows the measured interval) and its latency from exposure to
+//uvc_frame_get returning. desc.capture_us is the least delayed arrival of the last RING_CAPTURE_WINDOW frames
+//carried forward in periods (module frame counter with ac020 info lines), less the latency, so frames of cameras
+//on one host compare across rings
+void ring_capture_clock_set(FrameRing_t* ring, uint32_t period_us, uint32_t latency_us);
+
+//producer: no more frames, wake up all consumers
+void ring_close(FrameRing_t* ring);
+
+//producer: wait until every consumer has detached, returns RING_TIMEOUT if still attached
+int ring_wait_detached(FrameRing_t* ring, uint32_t timeout_ms);
+
+//register a consumer, returns the consumer id or RING_ERROR_PARAM
+int ring_consumer_attach(FrameRing_t* ring, RingPolicy_t policy);
+
+//unregister a consumer, the ring must not be used by this consumer afterwards
+void ring_consumer_detach(FrameRing_t* ring, int consumer_id);
+
+//register a consumer run by the task pool: ring_write_commit queues func(slot, arg) on the consumer's strand
+//task consumers are attached before streaming and detached by ring_close once their queued frames ran
+int ring_consumer_attach_task(FrameRing_t* ring, RingPolicy_t policy, PoolStage_t stage, \
+    RingTaskFunc_t func, void* arg);
+
+//consumer: take a reference to the next frame according to the consumer's policy
+int ring_read_acquire(FrameRing_t* ring, int consumer_id, uint32_t timeout_ms, FrameSlot_t** slot);
+
+//consumer: drop the reference taken by ring_read_acquire
+void ring_read_release(FrameRing_t* ring, FrameSlot_t* slot);
+
+//call func whenever the last reference of a slot is released, before the producer may reuse it. set it before
+//streaming, NULL removes it
+void ring_release_func_set(FrameRing_t* ring, RingReleaseFunc_t func, void* arg);
+
+//holds longer than warn_ms count as long holds, default RING_HOLD_WARN_MS
+void ring_hold_warn_set(FrameRing_t* ring, uint32_t warn_ms);
+
+//how long slots stayed held and how often longer than the warning
+void ring_hold_stats(FrameRing_t* ring, TimingStats_t* stats, uint64_t* long_holds);
+
+//take one more reference to a slot the caller holds, for another reader of the same frame. ring_read_release
+//drops it, the producer reuses the slot once every reference is gone
+void ring_slot_ref(FrameSlot_t* slot);
+
+//split the slot's raw frame into its image/temp planes (and ac020 info lines), the planes are not copied
+//for zero-copy rings. the image info line is parsed into desc.meta in place, counter gaps count as hw_lost
+void ring_slot_cut(FrameRing_t* ring, FrameSlot_t* slot);
+
+//copy the slot's planes out so the frame can be kept after ring_read_release, NULL skips a plane
+int ring_slot_copy(FrameSlot_t* slot, uint8_t* image_dst, uint8_t* temp_dst);
+
+//get a readiness fd for epoll/poll/select: it turns readable when a frame may be waiting for the consumer or the
+//ring is closed, then ring_read_acquire with timeout 0 takes the frame and clears it. wakeups can be spurious,
+//RING_TIMEOUT means wait again. the fd belongs to the ring and is closed by ring_consumer_detach
+int ring_consumer_fd(FrameRing_t* ring, int consumer_id);
+
+//the same for WaitForSingleObject/WaitForMultipleObjects/RegisterWaitForSingleObject on windows: a HANDLE (event) that
+//is set under the same conditions, NULL elsewhere or when it could not be created
+void* ring_consumer_event(FrameRing_t* ring, int consumer_id);
+
+//get the consumer's frame and drop counters
+int ring_consumer_stats(FrameRing_t* ring, int consumer_id, uint64_t* frames, uint64_t* dropped);
+
+//how long a consumer should wait for the next frame: RING_TIMEOUT_INTERVALS measured intervals,
+//at least RING_TIMEOUT_MIN_MS and at most max_ms, max_ms until the interval is known
+uint32_t ring_frame_timeout_ms(FrameRing_t* ring, uint32_t max_ms);
+
+#endif
@@ -0,0 +1,919 @@
+#include "roi.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static const char* roi_type_names[] = { "rect", "line", "polygon", "ellipse", "polyline" };
+
+//largest level with 2^level <= len
+static int roi_level_of(int len)
+{
+    int level = 0;
+    while ((2 << level) <= len)
+    {
+        level++;
+    }
+    return level;
+}
+
+//the tables only grow, a wider rect or span adds levels
+static int roi_levels_grow(RoiEngine_t* engine, int levels)
+{
+    if (levels <= engine->levels)
+    {
+        return ROI_SUCCESS;
+    }
+    size_t table_size = (size_t)levels * engine->temp_res.width * engine->temp_res.height * sizeof(uint32_t);
+    uint32_t* max_table = (uint32_t*)realloc(engine->max_table, table_size);
+    if (max_table == NULL)
+    {
+        return ROI_ERROR_MEM;
+    }
+    engine->max_table = max_table;
+    uint32_t* min_table = (uint32_t*)realloc(engine->min_table, table_size);
+    if (min_table == NULL)
+    {
+        return ROI_ERROR_MEM;
+    }
+    engine->min_table = min_table;
+    engine->levels = levels;
+    return ROI_SUCCESS;
+}
+
+//the rows a table roi reads and the sparse table planes each of them needs
+static void roi_rows_mark(const Roi_t* roi, uint8_t* rows, uint8_t* row_levels)
+{
+    if (roi->type == ROI_TYPE_RECT)
+    {
+        const Area_t* rect = &roi->rect;
+        int levels = roi_level_of(rect->width) + 1;
+        //the first row is read from filter_frame directly
+        for (int y = rect->start_y + 1; y < rect->start_y + rect->height; y++)
+        {
+            if (row_levels[y] < levels)
+            {
+                row_levels[y] = (uint8_t)levels;
+            }
+        }
+        memset(rows + rect->start_y, 1, rect->height);
+        return;
+    }
+    for (int i = 0; i < roi->span_num; i++)
+    {
+        const RoiSpan_t* span = &roi->spans[i];
+        int levels = roi_level_of(span->x1 - span->x0 + 1) + 1;
+        if (row_levels[span->y] < levels)
+        {
+            row_levels[span->y] = (uint8_t)levels;
+        }
+        rows[span->y] = 1;
+    }
+}
+
+static void roi_spans_free(RoiEngine_t* engine)
+{
+    for (int i = 0; i < engine->roi_num; i++)
+    {
+        free(engine->roi[i].spans);
+        engine->roi[i].spans = NULL;
+        engine->roi[i].span_num = 0;
+    }
+}
+
+int roi_engine_init(RoiEngine_t* engine, TempDataRes_t temp_res)
+{
+    if (engine == NULL || temp_res.width == 0 || temp_res.height == 0)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    memset(engine, 0, sizeof(RoiEngine_t));
+    engine->temp_res = temp_res;
+    int pix_num = temp_res.width * temp_res.height;
+    engine->filter_frame = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    engine->sum_table = (uint32_t*)malloc((temp_res.width + 1) * (temp_res.height + 1) * sizeof(uint32_t));
+    engine->column_buffer = (uint32_t*)malloc(3 * temp_res.width * sizeof(uint32_t));
+    engine->row_levels = (uint8_t*)calloc(temp_res.height, sizeof(uint8_t));
+    engine->filter_rows = (uint8_t*)calloc(temp_res.height, sizeof(uint8_t));
+    engine->dirty_levels = (uint8_t*)calloc(temp_res.height, sizeof(uint8_t));
+    engine->dirty_rows = (uint8_t*)calloc(temp_res.height, sizeof(uint8_t));
+    if (engine->filter_frame == NULL || engine->sum_table == NULL || engine->column_buffer == NULL || \
+        engine->row_levels == NULL || engine->filter_rows == NULL || engine->dirty_levels == NULL || \
+        engine->dirty_rows == NULL)
+    {
+        roi_engine_release(engine);
+        return ROI_ERROR_MEM;
+    }
+    return ROI_SUCCESS;
+}
+
+void roi_engine_release(RoiEngine_t* engine)
+{
+    if (engine == NULL)
+    {
+        return;
+    }
+    free(engine->filter_frame);
+    free(engine->sum_table);
+    free(engine->column_buffer);
+    free(engine->row_levels);
+    free(engine->filter_rows);
+    free(engine->dirty_levels);
+    free(engine->dirty_rows);
+    free(engine->max_table);
+    free(engine->min_table);
+    roi_spans_free(engine);
+    engine->filter_frame = NULL;
+    engine->sum_table = NULL;
+    engine->column_buffer = NULL;
+    engine->row_levels = NULL;
+    engine->filter_rows = NULL;
+    engine->dirty_levels = NULL;
+    engine->dirty_rows = NULL;
+    engine->max_table = NULL;
+    engine->min_table = NULL;
+    engine->levels = 0;
+    engine->roi_num = 0;
+}
+
+void roi_engine_clear(RoiEngine_t* engine)
+{
+    if (engine != NULL && engine->row_levels != NULL)
+    {
+        roi_spans_free(engine);
+        engine->roi_num = 0;
+        engine->tiles_ref.valid = 0;
+        engine->offset_x = 0;
+        engine->offset_y = 0;
+        engine->offset_num = 0;
+        memset(engine->row_levels, 0, engine->temp_res.height);
+        memset(engine->filter_rows, 0, engine->temp_res.height);
+    }
+}
+
+int roi_engine_add_rect(RoiEngine_t* engine, Area_t rect)
+{
+    if (engine == NULL || engine->filter_frame == NULL)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    int width = engine->temp_res.width, height = engine->temp_res.height;
+    if (rect.start_x < 0 || rect.start_y < 0 || rect.width <= 0 || rect.height <= 0 || \
+        rect.start_x + rect.width > width || rect.start_y + rect.height > height)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    if (engine->roi_num >= ROI_MAX_NUM)
+    {
+        return ROI_ERROR_FULL;
+    }
+
+    if (roi_levels_grow(engine, roi_level_of(rect.width) + 1) != ROI_SUCCESS)
+    {
+        return ROI_ERROR_MEM;
+    }
+
+    Roi_t* roi = &engine->roi[engine->roi_num];
+    memset(roi, 0, sizeof(Roi_t));
+    roi->type = ROI_TYPE_RECT;
+    roi->rect = rect;
+    roi_rows_mark(roi, engine->filter_rows, engine->row_levels);
+    engine->tiles_ref.valid = 0;
+    return engine->roi_num++;
+}
+
+int roi_engine_add_line(RoiEngine_t* engine, Line_t line)
+{
+    if (engine == NULL || engine->filter_frame == NULL)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    int width = engine->temp_res.width, height = engine->temp_res.height;
+    if (line.start_x < 0 || line.start_x >= width || line.end_x < 0 || line.end_x >= width || \
+        line.start_y < 0 || line.start_y >= height || line.end_y < 0 || line.end_y >= height)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    if (engine->roi_num >= ROI_MAX_NUM)
+    {
+        return ROI_ERROR_FULL;
+    }
+    Roi_t* roi = &engine->roi[engine->roi_num];
+    memset(roi, 0, sizeof(Roi_t));
+    roi->type = ROI_TYPE_LINE;
+    roi->line = line;
+    engine->tiles_ref.valid = 0;
+    return engine->roi_num++;
+}
+
+//the bounding box of vertices that are all inside the frame
+static int roi_vertices_box(const RoiEngine_t* engine, const Dot_t* vertices, int num, Area_t* box)
+{
+    int x0 = vertices[0].x, x1 = x0, y0 = vertices[0].y, y1 = y0;
+    for (int i = 0; i < num; i++)
+    {
+        const Dot_t* v = &vertices[i];
+        if (v->x < 0 || v->x >= engine->temp_res.width || v->y < 0 || v->y >= engine->temp_res.height)
+        {
+            return ROI_ERROR_PARAM;
+        }
+        x0 = (v->x < x0) ? v->x : x0;
+        x1 = (v->x > x1) ? v->x : x1;
+        y0 = (v->y < y0) ? v->y : y0;
+        y1 = (v->y > y1) ? v->y : y1;
+    }
+    box->start_x = x0;
+    box->start_y = y0;
+    box->width = x1 - x0 + 1;
+    box->height = y1 - y0 + 1;
+    return ROI_SUCCESS;
+}
+
+//bresenham from a to b into the box's mask, both ends included
+static void roi_mask_segment(uint8_t* mask, const Area_t* box, Dot_t a, Dot_t b)
+{
+    int dx = abs(b.x - a.x), dy = -abs(b.y - a.y);
+    int sx = (a.x < b.x) ? 1 : -1, sy = (a.y < b.y) ? 1 : -1;
+    int err = dx + dy;
+    int x = a.x, y = a.y;
+    while (1)
+    {
+        mask[(y - box->start_y) * box->width + x - box->start_x] = 1;
+        if (x == b.x && y == b.y)
+        {
+            break;
+        }
+        int e2 = 2 * err;
+        if (e2 >= dy)
+        {
+            err += dy;
+            x += sx;
+        }
+        if (e2 <= dx)
+        {
+            err += dx;
+            y += sy;
+        }
+    }
+}
+
+//the box's mask becomes the new roi's spans, the mask stays the caller's
+static int roi_spans_add(RoiEngine_t* engine, RoiType_t type, const Area_t* box, const uint8_t* mask)
+{
+    int span_num = 0;
+    for (int i = 0; i < box->width * box->height; i++)
+    {
+        span_num += (mask[i] && (i % box->width == 0 || !mask[i - 1]));
+    }
+    RoiSpan_t* spans = (RoiSpan_t*)malloc((span_num > 0 ? span_num : 1) * sizeof(RoiSpan_t));
+    if (spans == NULL)
+    {
+        return ROI_ERROR_MEM;
+    }
+    int max_len = 1;
+    RoiSpan_t* span = spans;
+    for (int y = 0; y < box->height; y++)
+    {
+        const uint8_t* row = mask + y * box->width;
+        for (int x = 0; x < box->width; x++)
+        {
+            if (!row[x])
+            {
+                continue;
+            }
+            int start = x;
+            while (x + 1 < box->width && row[x + 1])
+            {
+                x++;
+            }
+            span->y = (uint16_t)(box->start_y + y);
+            span->x0 = (uint16_t)(box->start_x + start);
+            span->x1 = (uint16_t)(box->start_x + x);
+            max_len = (x - start + 1 > max_len) ? x - start + 1 : max_len;
+            span++;
+        }
+    }
+    if (roi_levels_grow(engine, roi_level_of(max_len) + 1) != ROI_SUCCESS)
+    {
+        free(spans);
+        return ROI_ERROR_MEM;
+    }
+
+    Roi_t* roi = &engine->roi[engine->roi_num];
+    memset(roi, 0, sizeof(Roi_t));
+    roi->type = type;
+    roi->rect = *box;
+    roi->spans = spans;
+    roi->span_num = span_num;
+    roi_rows_mark(roi, engine->filter_rows, engine->row_levels);
+    engine->tiles_ref.valid = 0;
+    return engine->roi_num++;
+}
+
+int roi_engine_add_polygon(RoiEngine_t* engine, const Dot_t* vertices, int num)
+{
+    Area_t box;
+    if (engine == NULL || engine->filter_frame == NULL || vertices == NULL || num < 3 || \
+        roi_vertices_box(engine, vertices, num, &box) != ROI_SUCCESS)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    if (engine->roi_num >= ROI_MAX_NUM)
+    {
+        return ROI_ERROR_FULL;
+    }
+    uint8_t* mask = (uint8_t*)calloc((size_t)box.width * box.height, 1);
+    double* cross = (double*)malloc(num * sizeof(double));
+    if (mask == NULL || cross == NULL)
+    {
+        free(mask);
+        free(cross);
+        return ROI_ERROR_MEM;
+    }
+    //per row the edges crossing the pixel centers, each edge half open so a vertex on the row counts once
+    for (int y = box.start_y; y < box.start_y + box.height; y++)
+    {
+        int cross_num = 0;
+        for (int i = 0; i < num; i++)
+        {
+            Dot_t a = vertices[i], b = vertices[(i + 1) % num];
+            if ((a.y > y) != (b.y > y))
+            {
+                double x = a.x + (double)(y - a.y) * (b.x - a.x) / (b.y - a.y);
+                int k = cross_num++;
+                for (; k > 0 && cross[k - 1] > x; k--)
+                {
+                    cross[k] = cross[k - 1];
+                }
+                cross[k] = x;
+            }
+        }
+        uint8_t* row = mask + (y - box.start_y) * box.width - box.start_x;
+        for (int k = 0; k + 1 < cross_num; k += 2)
+        {
+            int x0 = (int)ceil(cross[k]), x1 = (int)floor(cross[k + 1]);
+            for (int x = x0; x <= x1; x++)
+            {
+                row[x] = 1;
+            }
+        }
+    }
+    for (int i = 0; i < num; i++)
+    {
+        roi_mask_segment(mask, &box, vertices[i], vertices[(i + 1) % num]);
+    }
+    int rst = roi_spans_add(engine, ROI_TYPE_POLYGON, &box, mask);
+    free(mask);
+    free(cross);
+    return rst;
+}
+
+int roi_engine_add_ellipse(RoiEngine_t* engine, Dot_t center, int radius_x, int radius_y)
+{
+    if (engine == NULL || engine->filter_frame == NULL || radius_x < 0 || radius_y < 0 || \
+        center.x - radius_x < 0 || center.x + radius_x >= engine->temp_res.width || \
+        center.y - radius_y < 0 || center.y + radius_y >= engine->temp_res.height)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    if (engine->roi_num >= ROI_MAX_NUM)
+    {
+        return ROI_ERROR_FULL;
+    }
+    Area_t box = { center.x - radius_x, center.y - radius_y, 2 * radius_x + 1, 2 * radius_y + 1 };
+    uint8_t* mask = (uint8_t*)calloc((size_t)box.width * box.height, 1);
+    if (mask == NULL)
+    {
+        return ROI_ERROR_MEM;
+    }
+    //the widest dx of each row with dx^2 * ry^2 + dy^2 * rx^2 <= rx^2 * ry^2, exact in integers
+    int64_t rx2 = (int64_t)radius_x * radius_x, ry2 = (int64_t)radius_y * radius_y;
+    for (int dy = -radius_y; dy <= radius_y; dy++)
+    {
+        int half = radius_x;
+        if (radius_y > 0)
+        {
+            int64_t limit = rx2 * ry2 - (int64_t)dy * dy * rx2;
+            half = (int)sqrt((double)limit / ry2);
+            while ((int64_t)(half + 1) * (half + 1) * ry2 <= limit)
+            {
+                half++;
+            }
+            while (half > 0 && (int64_t)half * half * ry2 > limit)
+            {
+                half--;
+            }
+        }
+        memset(mask + (dy + radius_y) * box.width + radius_x - half, 1, 2 * half + 1);
+    }
+    int rst = roi_spans_add(engine, ROI_TYPE_ELLIPSE, &box, mask);
+    free(mask);
+    return rst;
+}
+
+int roi_engine_add_polyline(RoiEngine_t* engine, const Dot_t* vertices, int num)
+{
+    Area_t box;
+    if (engine == NULL || engine->filter_frame == NULL || vertices == NULL || num < 2 || \
+        roi_vertices_box(engine, vertices, num, &box) != ROI_SUCCESS)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    if (engine->roi_num >= ROI_MAX_NUM)
+    {
+        return ROI_ERROR_FULL;
+    }
+    uint8_t* mask = (uint8_t*)calloc((size_t)box.width * box.height, 1);
+    if (mask == NULL)
+    {
+        return ROI_ERROR_MEM;
+    }
+    for (int i = 0; i + 1 < num; i++)
+    {
+        roi_mask_segment(mask, &box, vertices[i], vertices[i + 1]);
+    }
+    int rst = roi_spans_add(engine, ROI_TYPE_POLYLINE, &box, mask);
+    free(mask);
+    return rst;
+}
+
+//the pixels a roi covers, inclusive
+static void roi_box_of(const Roi_t* roi, int* x0, int* y0, int* x1, int* y1)
+{
+    if (roi->type == ROI_TYPE_LINE)
+    {
+        const Line_t* line = &roi->line;
+        *x0 = (line->start_x < line->end_x) ? line->start_x : line->end_x;
+        *x1 = (line->start_x < line->end_x) ? line->end_x : line->start_x;
+        *y0 = (line->start_y < line->end_y) ? line->start_y : line->end_y;
+        *y1 = (line->start_y < line->end_y) ? line->end_y : line->start_y;
+        return;
+    }
+    *x0 = roi->rect.start_x;
+    *y0 = roi->rect.start_y;
+    *x1 = roi->rect.start_x + roi->rect.width - 1;
+    *y1 = roi->rect.start_y + roi->rect.height - 1;
+}
+
+static void roi_shift(Roi_t* roi, int dx, int dy)
+{
+    roi->rect.start_x += dx;
+    roi->rect.start_y += dy;
+    roi->line.start_x += dx;
+    roi->line.end_x += dx;
+    roi->line.start_y += dy;
+    roi->line.end_y += dy;
+    for (int i = 0; i < roi->span_num; i++)
+    {
+        roi->spans[i].y = (uint16_t)(roi->spans[i].y + dy);
+        roi->spans[i].x0 = (uint16_t)(roi->spans[i].x0 + dx);
+        roi->spans[i].x1 = (uint16_t)(roi->spans[i].x1 + dx);
+    }
+}
+
+int roi_engine_offset_set(RoiEngine_t* engine, int dx, int dy)
+{
+    if (engine == NULL || engine->row_levels == NULL)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    //the union of the registered boxes decides how far they may go
+    int width = engine->temp_res.width, height = engine->temp_res.height;
+    int min_x = width, min_y = height, max_x = -1, max_y = -1;
+    for (int i = 0; i < engine->roi_num; i++)
+    {
+        int x0, y0, x1, y1;
+        roi_box_of(&engine->roi[i], &x0, &y0, &x1, &y1);
+        int ox = (i < engine->offset_num) ? engine->offset_x : 0;
+        int oy = (i < engine->offset_num) ? engine->offset_y : 0;
+        min_x = (x0 - ox < min_x) ? x0 - ox : min_x;
+        min_y = (y0 - oy < min_y) ? y0 - oy : min_y;
+        max_x = (x1 - ox > max_x) ? x1 - ox : max_x;
+        max_y = (y1 - oy > max_y) ? y1 - oy : max_y;
+    }
+    if (engine->roi_num > 0)
+    {
+        dx = (dx < -min_x) ? -min_x : ((dx > width - 1 - max_x) ? width - 1 - max_x : dx);
+        dy = (dy < -min_y) ? -min_y : ((dy > height - 1 - max_y) ? height - 1 - max_y : dy);
+    }
+    if (dx == engine->offset_x && dy == engine->offset_y && engine->offset_num == engine->roi_num)
+    {
+        return ROI_SUCCESS;
+    }
+    memset(engine->row_levels, 0, height);
+    memset(engine->filter_rows, 0, height);
+    for (int i = 0; i < engine->roi_num; i++)
+    {
+        Roi_t* roi = &engine->roi[i];
+        int ox = (i < engine->offset_num) ? engine->offset_x : 0;
+        int oy = (i < engine->offset_num) ? engine->offset_y : 0;
+        roi_shift(roi, dx - ox, dy - oy);
+        if (roi->type != ROI_TYPE_LINE)
+        {
+            roi_rows_mark(roi, engine->filter_rows, engine->row_levels);
+        }
+    }
+    engine->offset_x = dx;
+    engine->offset_y = dy;
+    engine->offset_num = engine->roi_num;
+    engine->tiles_ref.valid = 0;
+    return ROI_SUCCESS;
+}
+
+const char* roi_type_name(RoiType_t type)
+{
+    return (type >= ROI_TYPE_RECT && type <= ROI_TYPE_POLYLINE) ? roi_type_names[type] : "unknown";
+}
+
+//interior pixels drop the min and max of the 3x3 neighbourhood and round the mean of the other 7,
+//the border follows the library's own edge handling
+static void roi_filter_build(RoiEngine_t* engine, const uint8_t* filter_rows, uint16_t* temp_data)
+{
+    int width = engine->temp_res.width, height = engine->temp_res.height;
+    uint16_t* dst = engine->filter_frame;
+    uint32_t* col_sum = engine->column_buffer;
+    uint32_t* col_max = col_sum + width;
+    uint32_t* col_min = col_max + width;
+    for (int y = 1; y < height - 1; y++)
+    {
+        if (filter_rows[y] == 0)
+        {
+            continue;
+        }
+        //3 pixel column sum/max/min, each output pixel then combines three neighbouring columns
+        const uint16_t* up = temp_data + (y - 1) * width;
+        const uint16_t* mid = up + width;
+        const uint16_t* down = mid + width;
+        for (int x = 0; x < width; x++)
+        {
+            uint32_t a = up[x], b = mid[x], c = down[x];
+            uint32_t hi = (a > b) ? a : b, lo = (a < b) ? a : b;
+            col_sum[x] = a + b + c;
+            col_max[x] = (hi > c) ? hi : c;
+            col_min[x] = (lo < c) ? lo : c;
+        }
+        uint16_t* row = dst + y * width;
+        for (int x = 1; x < width - 1; x++)
+        {
+            uint32_t hi = (col_max[x - 1] > col_max[x]) ? col_max[x - 1] : col_max[x];
+            uint32_t lo = (col_min[x - 1] < col_min[x]) ? col_min[x - 1] : col_min[x];
+            hi = (hi > col_max[x + 1]) ? hi : col_max[x + 1];
+            lo = (lo < col_min[x + 1]) ? lo : col_min[x + 1];
+            row[x] = (uint16_t)((col_sum[x - 1] + col_sum[x] + col_sum[x + 1] - hi - lo + 3) / 7);
+        }
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        if (filter_rows[y] == 0)
+        {
+            continue;
+        }
+        int step = (y == 0 || y == height - 1 || width < 2) ? 1 : width - 1;
+        for (int x = 0; x < width; x += step)
+        {
+            Dot_t point = { x, y };
+            get_point_temp(temp_data, engine->temp_res, point, &dst[y * width + x]);
+        }
+    }
+}
+
+//sums wrap at 32 bit, a rect's difference stays exact while its own sum fits
+static void roi_sum_build(RoiEngine_t* engine, const uint8_t* filter_rows)
+{
+    int width = engine->temp_res.width, height = engine->temp_res.height;
+    int stride = width + 1;
+    uint32_t* sum = engine->sum_table;
+    memset(sum, 0, stride * sizeof(uint32_t));
+    for (int y = 0; y < height; y++)
+    {
+        const uint16_t* src = engine->filter_frame + y * width;
+        uint32_t* above = sum + y * stride;
+        uint32_t* cur = above + stride;
+        //no rect reads the unfiltered rows, they add nothing
+        if (filter_rows[y] == 0)
+        {
+            memcpy(cur, above, stride * sizeof(uint32_t));
+            continue;
+        }
+        uint32_t row_sum = 0;
+        cur[0] = 0;
+        for (int x = 0; x < width; x++)
+        {
+            row_sum += src[x];
+            cur[x + 1] = above[x + 1] + row_sum;
+        }
+    }
+}
+
+static void roi_sparse_build(RoiEngine_t* engine, const uint8_t* row_levels)
+{
+    int width = engine->temp_res.width, height = engine->temp_res.height;
+    int pix_num = width * height;
+    for (int y = 0; y < height; y++)
+    {
+        if (row_levels[y] == 0)
+        {
+            continue;
+        }
+        int row = y * width;
+        for (int x = 0; x < width; x++)
+        {
+            uint32_t v = (uint32_t)engine->filter_frame[row + x] << 16;
+            engine->max_table[row + x] = v | (uint32_t)x;
+            engine->min_table[row + x] = v | (uint32_t)(65535 - x);
+        }
+    }
+    for (int level = 1; level < engine->levels; level++)
+    {
+        int half = 1 << (level - 1);
+        const uint32_t* max_prev = engine->max_table + (size_t)(level - 1) * pix_num;
+        const uint32_t* min_prev = engine->min_table + (size_t)(level - 1) * pix_num;
+        uint32_t* max_cur = engine->max_table + (size_t)level * pix_num;
+        uint32_t* min_cur = engine->min_table + (size_t)level * pix_num;
+        for (int y = 0; y < height; y++)
+        {
+            if (row_levels[y] <= level)
+            {
+                continue;
+            }
+            int row = y * width;
+            for (int x = 0; x + 2 * half <= width; x++)
+            {
+                uint32_t a = max_prev[row + x], b = max_prev[row + x + half];
+                max_cur[row + x] = (a > b) ? a : b;
+                a = min_prev[row + x];
+                b = min_prev[row + x + half];
+                min_cur[row + x] = (a < b) ? a : b;
+            }
+        }
+    }
+}
+
+//get_rect_temp takes max/min from the rect except the first row, where only the last pixel counts,
+//ties go to the last pixel in row order. avr covers the whole rect
+static void roi_rect_query(RoiEngine_t* engine, const Area_t* rect, TempInfo_t* temp_info)
+{
+    int width = engine->temp_res.width;
+    int pix_num = width * engine->temp_res.height;
+    int x0 = rect->start_x, x1 = rect->start_x + rect->width - 1;
+    int y0 = rect->start_y, y1 = rect->start_y + rect->height - 1;
+
+    uint32_t max_val = engine->filter_frame[y0 * width + x1], min_val = max_val;
+    int max_x = x1, max_y = y0, min_x = x1, min_y = y0;
+    int level = roi_level_of(rect->width);
+    const uint32_t* max_plane = engine->max_table + (size_t)level * pix_num;
+    const uint32_t* min_plane = engine->min_table + (size_t)level * pix_num;
+    int xb = x1 - (1 << level) + 1;
+    for (int y = y0 + 1; y <= y1; y++)
+    {
+        int row = y * width;
+        uint32_t a = max_plane[row + x0], b = max_plane[row + xb];
+        uint32_t key = (a > b) ? a : b;
+        if ((key >> 16) >= max_val)
+        {
+            max_val = key >> 16;
+            max_x = key & 0xFFFF;
+            max_y = y;
+        }
+        a = min_plane[row + x0];
+        b = min_plane[row + xb];
+        key = (a < b) ? a : b;
+        if ((key >> 16) <= min_val)
+        {
+            min_val = key >> 16;
+            min_x = 65535 - (key & 0xFFFF);
+            min_y = y;
+        }
+    }
+
+    int stride = width + 1;
+    const uint32_t* sum = engine->sum_table;
+    uint32_t rect_sum = sum[(y1 + 1) * stride + x1 + 1] - sum[y0 * stride + x1 + 1] - \
+        sum[(y1 + 1) * stride + x0] + sum[y0 * stride + x0];
+    uint64_t rect_num = (uint64_t)rect->width * rect->height;
+
+    temp_info->max_temp = (uint16_t)max_val;
+    temp_info->min_temp = (uint16_t)min_val;
+    temp_info->avr_temp = (uint16_t)((rect_sum + rect_num / 2) / rect_num);
+    temp_info->max_cord.x = max_x;
+    temp_info->max_cord.y = max_y;
+    temp_info->min_cord.x = min_x;
+    temp_info->min_cord.y = min_y;
+}
+
+//one sparse table lookup pair and one summed-area difference per span
+static void roi_span_query(RoiEngine_t* engine, const Roi_t* roi, TempInfo_t* temp_info)
+{
+    int width = engine->temp_res.width;
+    int pix_num = width * engine->temp_res.height;
+    int stride = width + 1;
+    const uint32_t* sum = engine->sum_table;
+    uint32_t max_key = 0, min_key = UINT32_MAX;
+    int max_y = 0, min_y = 0;
+    uint64_t roi_sum = 0, roi_num = 0;
+    for (int i = 0; i < roi->span_num; i++)
+    {
+        const RoiSpan_t* span = &roi->spans[i];
+        int len = span->x1 - span->x0 + 1;
+        int level = roi_level_of(len);
+        int row = span->y * width;
+        const uint32_t* max_plane = engine->max_table + (size_t)level * pix_num + row;
+        const uint32_t* min_plane = engine->min_table + (size_t)level * pix_num + row;
+        int xb = span->x1 - (1 << level) + 1;
+        uint32_t a = max_plane[span->x0], b = max_plane[xb];
+        uint32_t key = (a > b) ? a : b;
+        if ((key >> 16) >= (max_key >> 16))
+        {
+            max_key = key;
+            max_y = span->y;
+        }
+        a = min_plane[span->x0];
+        b = min_plane[xb];
+        key = (a < b) ? a : b;
+        if ((key >> 16) <= (min_key >> 16))
+        {
+            min_key = key;
+            min_y = span->y;
+        }
+        const uint32_t* above = sum + span->y * stride;
+        const uint32_t* cur = above + stride;
+        roi_sum += (cur[span->x1 + 1] - above[span->x1 + 1]) - (cur[span->x0] - above[span->x0]);
+        roi_num += len;
+    }
+
+    temp_info->max_temp = (uint16_t)(max_key >> 16);
+    temp_info->min_temp = (uint16_t)(min_key >> 16);
+    temp_info->avr_temp = (uint16_t)((roi_sum + roi_num / 2) / roi_num);
+    temp_info->max_cord.x = max_key & 0xFFFF;
+    temp_info->max_cord.y = max_y;
+    temp_info->min_cord.x = 65535 - (min_key & 0xFFFF);
+    temp_info->min_cord.y = min_y;
+}
+
+int roi_engine_process(RoiEngine_t* engine, uint16_t* temp_data, TempInfo_t* temp_info)
+{
+    if (engine == NULL || engine->filter_frame == NULL || temp_data == NULL || temp_info == NULL)
+    {
+        return ROI_ERROR_PARAM;
+    }
+
+    int has_rect = 0;
+    for (int i = 0; i < engine->roi_num; i++)
+    {
+        if (engine->roi[i].type != ROI_TYPE_LINE)
+        {
+            has_rect = 1;
+            break;
+        }
+    }
+    if (has_rect)
+    {
+        roi_filter_build(engine, engine->filter_rows, temp_data);
+        roi_sum_build(engine, engine->filter_rows);
+        roi_sparse_build(engine, engine->row_levels);
+    }
+
+    int ret = ROI_SUCCESS;
+    for (int i = 0; i < engine->roi_num; i++)
+    {
+        Roi_t* roi = &engine->roi[i];
+        if (roi->type == ROI_TYPE_RECT)
+        {
+            roi_rect_query(engine, &roi->rect, &temp_info[i]);
+            continue;
+        }
+        if (roi->type != ROI_TYPE_LINE)
+        {
+            roi_span_query(engine, roi, &temp_info[i]);
+            continue;
+        }
+        //lines touch few pixels and the library walks its own path, they stay on get_line_temp
+        if (get_line_temp(temp_data, engine->temp_res, roi->line, &temp_info[i]) != IRTEMP_SUCCESS)
+        {
+            memset(&temp_info[i], 0, sizeof(TempInfo_t));
+            ret = ROI_ERROR_TEMP;
+        }
+    }
+    return ret;
+}
+
+//the tiles a pixel rect [x0, x1] x [y0, y1] overlaps hold a change
+static int roi_tiles_touched(const RoiEngine_t* engine, int x0, int y0, int x1, int y1)
+{
+    int cols = engine->tiles_ref.cols;
+    int max_x = engine->temp_res.width - 1, max_y = engine->temp_res.height - 1;
+    x0 = (x0 < 0) ? 0 : x0;
+    y0 = (y0 < 0) ? 0 : y0;
+    x1 = (x1 > max_x) ? max_x : x1;
+    y1 = (y1 > max_y) ? max_y : y1;
+    for (int ty = y0 / FRAME_TILES_SIZE; ty <= y1 / FRAME_TILES_SIZE; ty++)
+    {
+        for (int tx = x0 / FRAME_TILES_SIZE; tx <= x1 / FRAME_TILES_SIZE; tx++)
+        {
+            if (engine->tile_changed[ty * cols + tx])
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int roi_engine_process_tiles(RoiEngine_t* engine, uint16_t* temp_data, const FrameTiles_t* tiles, \
+    TempInfo_t* temp_info)
+{
+    if (engine == NULL || engine->filter_frame == NULL || temp_data == NULL || temp_info == NULL)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    int width = engine->temp_res.width, height = engine->temp_res.height;
+    if (tiles == NULL || !engine->tiles_ref.valid || tiles->cols != engine->tiles_ref.cols || \
+        tiles->rows != engine->tiles_ref.rows)
+    {
+        int ret = roi_engine_process(engine, temp_data, temp_info);
+        if (tiles != NULL && tiles->valid)
+        {
+            engine->tiles_ref = *tiles;
+        }
+        return ret;
+    }
+    //temperatures are 1/64 K, the default tolerance is an eighth of a kelvin
+    int tile_num = frame_tiles_changed(&engine->tiles_ref, tiles, width, height, FRAME_TILES_DEFAULT_TOLERANCE, \
+        engine->tile_changed);
+    if (tile_num == 0)
+    {
+        return ROI_SUCCESS;
+    }
+
+    int has_rect = 0;
+    memset(engine->dirty_rows, 0, height);
+    memset(engine->dirty_levels, 0, height);
+    for (int i = 0; i < engine->roi_num; i++)
+    {
+        Roi_t* roi = &engine->roi[i];
+        if (roi->type != ROI_TYPE_LINE)
+        {
+            //a span shape is redone when a tile under its bounding box changed
+            const Area_t* rect = &roi->rect;
+            engine->roi_dirty[i] = (uint8_t)roi_tiles_touched(engine, rect->start_x - 1, rect->start_y - 1, \
+                rect->start_x + rect->width, rect->start_y + rect->height);
+            if (!engine->roi_dirty[i])
+            {
+                continue;
+            }
+            has_rect = 1;
+            roi_rows_mark(roi, engine->dirty_rows, engine->dirty_levels);
+            continue;
+        }
+        const Line_t* line = &roi->line;
+        int x0 = (line->start_x < line->end_x) ? line->start_x : line->end_x;
+        int x1 = (line->start_x < line->end_x) ? line->end_x : line->start_x;
+        int y0 = (line->start_y < line->end_y) ? line->start_y : line->end_y;
+        int y1 = (line->start_y < line->end_y) ? line->end_y : line->start_y;
+        engine->roi_dirty[i] = (uint8_t)roi_tiles_touched(engine, x0 - 1, y0 - 1, x1 + 1, y1 + 1);
+    }
+    if (has_rect)
+    {
+        //rows no dirty rect covers keep their old tables, the dirty rects' sums only span dirty rows
+        roi_filter_build(engine, engine->dirty_rows, temp_data);
+        roi_sum_build(engine, engine->dirty_rows);
+        roi_sparse_build(engine, engine->dirty_levels);
+    }
+
+    int ret = ROI_SUCCESS;
+    for (int i = 0; i < engine->roi_num; i++)
+    {
+        Roi_t* roi = &engine->roi[i];
+        if (!engine->roi_dirty[i])
+        {
+            continue;
+        }
+        if (roi->type == ROI_TYPE_RECT)
+        {
+            roi_rect_query(engine, &roi->rect, &temp_info[i]);
+            continue;
+        }
+        if (roi->type != ROI_TYPE_LINE)
+        {
+            roi_span_query(engine, roi, &temp_info[i]);
+            continue;
+        }
+        if (get_line_temp(temp_data, engine->temp_res, roi->line, &temp_info[i]) != IRTEMP_SUCCESS)
+        {
+            memset(&temp_info[i], 0, sizeof(TempInfo_t));
+            ret = ROI_ERROR_TEMP;
+        }
+    }
+
+    //a changed tile's reference moves on, slow drifts below the tolerance still add up to a change
+    int cols = tiles->cols;
+    for (int i = 0; i < cols * tiles->rows; i++)
+    {
+        if (engine->tile_changed[i])
+        {
+            engine->tiles_ref.sum[i] = tiles->sum[i];
+            engine->tiles_ref.max[i] = tiles->max[i];
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,108 @@
+#ifndef _ROI_H_
+#define _ROI_H_
+
+#include <stdint.h>
+#include "libirtemp.h"
+#include "stats.h"
+
+#define ROI_MAX_NUM 64
+
+#define ROI_SUCCESS 0
+#define ROI_ERROR_PARAM -1
+#define ROI_ERROR_FULL -2
+#define ROI_ERROR_MEM -3
+#define ROI_ERROR_TEMP -4
+
+typedef enum {
+    ROI_TYPE_RECT = 0,
+    ROI_TYPE_LINE,
+    ROI_TYPE_POLYGON,
+    ROI_TYPE_ELLIPSE,
+    ROI_TYPE_POLYLINE,
+}RoiType_t;
+
+//one row run of a shape's pixels, x0..x1 inclusive
+typedef struct {
+    uint16_t y;
+    uint16_t x0;
+    uint16_t x1;
+}RoiSpan_t;
+
+typedef struct {
+    RoiType_t type;
+    Area_t rect;                    //the bounding box of the span shapes
+    Line_t line;
+    RoiSpan_t* spans;               //polygon, ellipse and polyline, rasterized once in row order
+    int span_num;
+}Roi_t;
+
+//rois are registered once, every frame is then answered in one call
+//results match get_rect_temp/get_line_temp: values are the 3x3 filtered temperatures get_point_temp returns
+typedef struct {
+    TempDataRes_t temp_res;
+    int roi_num;
+    Roi_t roi[ROI_MAX_NUM];
+    int levels;                     //row sparse table planes allocated, enough for the widest rect
+    uint8_t* row_levels;            //per row, planes the rects covering it need, 0 skips the row
+    uint8_t* filter_rows;           //per row, 1 when a rect covers it, only those rows are filtered
+    uint16_t* filter_frame;         //get_point_temp of every pixel in the filtered rows
+    uint32_t* sum_table;            //(width+1)*(height+1) summed-area table of filter_frame
+    uint32_t* max_table;            //levels planes, (value << 16) | x of the max over [x, x + 2^level)
+    uint32_t* min_table;            //levels planes, (value << 16) | (65535 - x) of the min, so ties keep the last x
+    uint32_t* column_buffer;        //3 * width, column sum/max/min of the row being filtered
+    uint8_t* dirty_rows;            //roi_engine_process_tiles: filter_rows/row_levels of the rects to redo
+    uint8_t* dirty_levels;
+    FrameTiles_t tiles_ref;         //per tile, the signature the results were last computed from
+    uint8_t tile_changed[FRAME_TILES_MAX];
+    uint8_t roi_dirty[ROI_MAX_NUM];
+    int offset_x;                   //roi_engine_offset_set, added to the rois registered before it
+    int offset_y;
+    int offset_num;                 //rois the offset is applied to, the ones added later are at 0 until the next call
+}RoiEngine_t;
+
+int roi_engine_init(RoiEngine_t* engine, TempDataRes_t temp_res);
+
+void roi_engine_release(RoiEngine_t* engine);
+
+//drop every registered roi, the buffers are kept
+void roi_engine_clear(RoiEngine_t* engine);
+
+//register a rect inside the frame, returns its index in the result array or an error code
+int roi_engine_add_rect(RoiEngine_t* engine, Area_t rect);
+
+//register a line, returns its index in the result array or an error code
+int roi_engine_add_line(RoiEngine_t* engine, Line_t line);
+
+//the span shapes are rasterized into row spans when they are added. their results are over the same filtered
+//temperatures as the rects and cost per span O(1) for avr and two lookups for max/min, whatever the shape.
+//ties of max/min go to the last pixel in row order, avr covers every pixel. all vertices inside the frame
+
+//a closed polygon of num >= 3 vertices: the pixels whose centers are inside (even-odd rule) and its outline
+int roi_engine_add_polygon(RoiEngine_t* engine, const Dot_t* vertices, int num);
+
+//the axis aligned ellipse (x - cx)^2 / rx^2 + (y - cy)^2 / ry^2 <= 1, a radius 0 makes it a line
+int roi_engine_add_ellipse(RoiEngine_t* engine, Dot_t center, int radius_x, int radius_y);
+
+//the pixels of num >= 2 vertices joined by straight segments, each pixel counted once
+int roi_engine_add_polyline(RoiEngine_t* engine, const Dot_t* vertices, int num);
+
+const char* roi_type_name(RoiType_t type);
+
+//move every roi by (dx, dy) from where it was registered, the stabilization's jitter keeps them on their targets.
+//the offset is clamped so no roi leaves the frame, an unchanged one costs nothing, a changed one recomputes every
+//roi on the next process call. roi_engine_clear puts it back to 0
+int roi_engine_offset_set(RoiEngine_t* engine, int dx, int dy);
+
+//fill temp_info[0 .. roi_num) for one temperature frame
+//the tables are built in one pass over the rows the rects cover, then each rect costs one lookup per row
+//for max/min and O(1) for avr
+int roi_engine_process(RoiEngine_t* engine, uint16_t* temp_data, TempInfo_t* temp_info);
+
+//roi_engine_process for the rois touching a tile that changed since their last result (the 3x3 filter
+//reaches one pixel out), the others keep temp_info as the caller left it, so it must persist across calls.
+//tiles NULL, an added or cleared roi, or another layout recomputes every roi. the reference lives in the
+//engine, so an engine serves one result array
+int roi_engine_process_tiles(RoiEngine_t* engine, uint16_t* temp_data, const FrameTiles_t* tiles, \
+    TempInfo_t* temp_info);
+
+#endif
@@ -0,0 +1,197 @@
+#include "roiwin.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char* roi_window_stat_names[] = { "max", "min", "avr" };
+
+int roi_windows_init(RoiWindows_t* windows, const RoiWindowParam_t* param)
+{
+    if (windows == NULL || param == NULL || param->num <= 0 || param->num > ROI_WINDOW_MAX)
+    {
+        return ROI_WINDOW_ERROR_PARAM;
+    }
+    memset(windows, 0, sizeof(RoiWindows_t));
+    for (int i = 0; i < param->num; i++)
+    {
+        if (param->horizon_ms[i] < ROI_WINDOW_BUCKETS)
+        {
+            return ROI_WINDOW_ERROR_PARAM;
+        }
+        windows->bucket_us[i] = (uint64_t)param->horizon_ms[i] * 1000 / ROI_WINDOW_BUCKETS;
+    }
+    windows->state = (RoiWindowState_t*)calloc((size_t)ROI_MAX_NUM * param->num, sizeof(RoiWindowState_t));
+    if (windows->state == NULL)
+    {
+        return ROI_WINDOW_ERROR_MEM;
+    }
+    windows->param = *param;
+    return ROI_WINDOW_SUCCESS;
+}
+
+void roi_windows_release(RoiWindows_t* windows)
+{
+    if (windows == NULL)
+    {
+        return;
+    }
+    free(windows->state);
+    windows->state = NULL;
+    windows->param.num = 0;
+}
+
+void roi_windows_reset(RoiWindows_t* windows, int roi)
+{
+    if (windows == NULL || windows->state == NULL || roi >= ROI_MAX_NUM)
+    {
+        return;
+    }
+    int num = windows->param.num;
+    if (roi < 0)
+    {
+        memset(windows->state, 0, (size_t)ROI_MAX_NUM * num * sizeof(RoiWindowState_t));
+        return;
+    }
+    memset(&windows->state[roi * num], 0, num * sizeof(RoiWindowState_t));
+}
+
+//the buckets after the current one up to seq start empty, the ones they replace leave the window
+static void roi_window_advance(RoiWindowState_t* state, uint32_t seq)
+{
+    uint32_t steps = seq - state->seq;
+    steps = (steps < ROI_WINDOW_BUCKETS) ? steps : ROI_WINDOW_BUCKETS;
+    for (uint32_t i = 1; i <= steps; i++)
+    {
+        int slot = (state->seq + i) % ROI_WINDOW_BUCKETS;
+        state->sum -= state->bucket_sum[slot];
+        state->count -= state->bucket_count[slot];
+        state->bucket_sum[slot] = 0;
+        state->bucket_count[slot] = 0;
+    }
+
+    //the closed bucket goes to the back of both queues, the entries it dominates can never be the answer again
+    RoiWindowEntry_t* queue = state->max_queue;
+    while (state->max_len > 0 && queue[(state->max_head + state->max_len - 1) % ROI_WINDOW_BUCKETS].value <= \
+        state->cur_max)
+    {
+        state->max_len--;
+    }
+    queue[(state->max_head + state->max_len) % ROI_WINDOW_BUCKETS] = { state->seq, state->cur_max };
+    state->max_len++;
+    queue = state->min_queue;
+    while (state->min_len > 0 && queue[(state->min_head + state->min_len - 1) % ROI_WINDOW_BUCKETS].value >= \
+        state->cur_min)
+    {
+        state->min_len--;
+    }
+    queue[(state->min_head + state->min_len) % ROI_WINDOW_BUCKETS] = { state->seq, state->cur_min };
+    state->min_len++;
+
+    //and the front leaves with the buckets ROI_WINDOW_BUCKETS or more before seq
+    while (state->max_len > 0 && seq - state->max_queue[state->max_head].seq >= ROI_WINDOW_BUCKETS)
+    {
+        state->max_head = (state->max_head + 1) % ROI_WINDOW_BUCKETS;
+        state->max_len--;
+    }
+    while (state->min_len > 0 && seq - state->min_queue[state->min_head].seq >= ROI_WINDOW_BUCKETS)
+    {
+        state->min_head = (state->min_head + 1) % ROI_WINDOW_BUCKETS;
+        state->min_len--;
+    }
+    state->seq = seq;
+    state->cur_max = 0;
+    state->cur_min = 65535;
+}
+
+static void roi_window_add(RoiWindowState_t* state, uint64_t bucket_us, const TempInfo_t* info, uint64_t timestamp_us)
+{
+    if (!state->started)
+    {
+        memset(state, 0, sizeof(RoiWindowState_t));
+        state->started = 1;
+        state->first_us = timestamp_us;
+        state->cur_min = 65535;
+    }
+    //a timestamp going back stays in the current bucket
+    uint64_t since_us = (timestamp_us > state->first_us) ? timestamp_us - state->first_us : 0;
+    uint32_t seq = (uint32_t)(since_us / bucket_us);
+    if (seq > state->seq)
+    {
+        roi_window_advance(state, seq);
+    }
+    state->cur_max = (info->max_temp > state->cur_max) ? info->max_temp : state->cur_max;
+    state->cur_min = (info->min_temp < state->cur_min) ? info->min_temp : state->cur_min;
+    int slot = state->seq % ROI_WINDOW_BUCKETS;
+    state->bucket_sum[slot] += info->avr_temp;
+    state->bucket_count[slot]++;
+    state->sum += info->avr_temp;
+    state->count++;
+}
+
+int roi_windows_update(RoiWindows_t* windows, const TempInfo_t* temp_info, int roi_num, uint64_t timestamp_us)
+{
+    if (windows == NULL || windows->state == NULL || temp_info == NULL || roi_num < 0 || roi_num > ROI_MAX_NUM)
+    {
+        return ROI_WINDOW_ERROR_PARAM;
+    }
+    int num = windows->param.num;
+    for (int roi = 0; roi < roi_num; roi++)
+    {
+        for (int i = 0; i < num; i++)
+        {
+            roi_window_add(&windows->state[roi * num + i], windows->bucket_us[i], &temp_info[roi], timestamp_us);
+        }
+    }
+    return ROI_WINDOW_SUCCESS;
+}
+
+int roi_windows_get(const RoiWindows_t* windows, int roi, int horizon, RoiWindowValue_t* value)
+{
+    if (windows == NULL || windows->state == NULL || roi < 0 || roi >= ROI_MAX_NUM || horizon < 0 || \
+        horizon >= windows->param.num || value == NULL)
+    {
+        return ROI_WINDOW_ERROR_PARAM;
+    }
+    memset(value, 0, sizeof(RoiWindowValue_t));
+    const RoiWindowState_t* state = &windows->state[roi * windows->param.num + horizon];
+    if (!state->started || state->count == 0)
+    {
+        return ROI_WINDOW_SUCCESS;
+    }
+    uint16_t max_temp = state->cur_max, min_temp = state->cur_min;
+    if (state->max_len > 0 && state->max_queue[state->max_head].value > max_temp)
+    {
+        max_temp = state->max_queue[state->max_head].value;
+    }
+    if (state->min_len > 0 && state->min_queue[state->min_head].value < min_temp)
+    {
+        min_temp = state->min_queue[state->min_head].value;
+    }
+    value->max_temp = max_temp;
+    value->min_temp = min_temp;
+    value->avr_temp = (uint16_t)((state->sum + state->count / 2) / state->count);
+    value->samples = state->count;
+    value->full = (state->seq >= ROI_WINDOW_BUCKETS - 1);
+    return ROI_WINDOW_SUCCESS;
+}
+
+uint16_t roi_window_stat(const RoiWindowValue_t* value, RoiWindowStat_t stat)
+{
+    switch (stat)
+    {
+    case ROI_WINDOW_MIN_TEMP:
+        return value->min_temp;
+    case ROI_WINDOW_AVR_TEMP:
+        return value->avr_temp;
+    default:
+        return value->max_temp;
+    }
+}
+
+const char* roi_window_stat_name(RoiWindowStat_t stat)
+{
+    if (stat < ROI_WINDOW_MAX_TEMP || stat > ROI_WINDOW_AVR_TEMP)
+    {
+        return "unknown";
+    }
+    return roi_window_stat_names[stat];
+}
@@ -0,0 +1,85 @@
+#ifndef _ROIWIN_H_
+#define _ROIWIN_H_
+
+//rolling max/min/avr of every roi of an engine over fixed horizons, for rules like "max over the last 60 s" or
+//"5 minute average". a horizon is split into ROI_WINDOW_BUCKETS buckets of horizon / ROI_WINDOW_BUCKETS: max/min
+//keep a monotonic deque of the closed buckets, avr a ring of bucket sums, so a frame costs O(1) amortized per roi
+//and horizon and the memory is fixed at init. the window is the current bucket and the ROI_WINDOW_BUCKETS - 1
+//before it, so it reaches back between horizon - bucket and horizon. avr is the mean of the per frame avr values
+#include <stdint.h>
+#include "roi.h"
+
+#define ROI_WINDOW_MAX 4                //horizons per window set
+#define ROI_WINDOW_BUCKETS 64
+
+#define ROI_WINDOW_SUCCESS 0
+#define ROI_WINDOW_ERROR_PARAM -1
+#define ROI_WINDOW_ERROR_MEM -2
+
+typedef enum {
+    ROI_WINDOW_MAX_TEMP = 0,
+    ROI_WINDOW_MIN_TEMP,
+    ROI_WINDOW_AVR_TEMP,
+}RoiWindowStat_t;
+
+typedef struct {
+    uint32_t horizon_ms[ROI_WINDOW_MAX];    //at least ROI_WINDOW_BUCKETS ms each
+    int num;
+}RoiWindowParam_t;
+
+//one roi over one horizon as of the last update, temperatures in raw values like TempInfo_t
+typedef struct {
+    uint16_t max_temp;
+    uint16_t min_temp;
+    uint16_t avr_temp;
+    uint32_t samples;                   //frames in the window, 0 before the first
+    uint8_t full;                       //the whole window lies after the roi's first sample
+}RoiWindowValue_t;
+
+typedef struct {
+    uint32_t seq;                       //bucket number since the first sample
+    uint16_t value;
+}RoiWindowEntry_t;
+
+typedef struct {
+    uint64_t first_us;
+    uint32_t seq;                       //current bucket
+    uint8_t started;
+    uint16_t cur_max;                   //of the current bucket
+    uint16_t cur_min;
+    uint16_t max_head;
+    uint16_t max_len;
+    uint16_t min_head;
+    uint16_t min_len;
+    uint64_t sum;                       //avr values of the window, the current bucket included
+    uint32_t count;
+    uint64_t bucket_sum[ROI_WINDOW_BUCKETS];    //by seq % ROI_WINDOW_BUCKETS
+    uint32_t bucket_count[ROI_WINDOW_BUCKETS];
+    RoiWindowEntry_t max_queue[ROI_WINDOW_BUCKETS];    //closed buckets, seq rising and max falling
+    RoiWindowEntry_t min_queue[ROI_WINDOW_BUCKETS];    //closed buckets, seq rising and min rising
+}RoiWindowState_t;
+
+typedef struct {
+    RoiWindowParam_t param;
+    uint64_t bucket_us[ROI_WINDOW_MAX];
+    RoiWindowState_t* state;            //ROI_MAX_NUM * param.num, roi major
+}RoiWindows_t;
+
+int roi_windows_init(RoiWindows_t* windows, const RoiWindowParam_t* param);
+
+void roi_windows_release(RoiWindows_t* windows);
+
+//forget the roi's samples, for a roi registered again under the index. roi -1 forgets every roi
+void roi_windows_reset(RoiWindows_t* windows, int roi);
+
+//add one frame's results of rois 0 .. roi_num, the temp_info of roi_engine_process. timestamp_us rising
+int roi_windows_update(RoiWindows_t* windows, const TempInfo_t* temp_info, int roi_num, uint64_t timestamp_us);
+
+int roi_windows_get(const RoiWindows_t* windows, int roi, int horizon, RoiWindowValue_t* value);
+
+//the stat of a window value
+uint16_t roi_window_stat(const RoiWindowValue_t* value, RoiWindowStat_t stat);
+
+const char* roi_window_stat_name(RoiWindowStat_t stat);
+
+#endif
@@ -0,0 +1,522 @@
+#include "rtsched.h"
+#include "data.h"
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <atomic>
+#if defined(_WIN32)
+#include <Windows.h>
+#include <avrt.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "avrt.lib")
+#endif
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+#define RT_CPU_WORDS 16                 //1024 cpus, CPU_SETSIZE of glibc
+
+typedef struct {
+    uint64_t bits[RT_CPU_WORDS];
+}RtCpuSet_t;
+
+typedef struct {
+    char name[RT_NAME_LEN];
+    std::atomic<int> running;
+    int role;
+    int camera_index;
+    int policy;
+    int priority;
+    int cpu_num;
+    char cpus[RT_CPUS_LEN];
+    TimingHist_t wakeup;
+}RtThread_t;
+
+static const char* rt_role_names[RT_ROLE_NUM] = { "acquisition", "display", "analytics", "control" };
+static const char* rt_policy_names[RT_POLICY_NUM] = { "normal", "fifo", "rr" };
+
+static pthread_mutex_t rt_mutex = PTHREAD_MUTEX_INITIALIZER;
+static RtParam_t rt_param;
+static uint8_t rt_param_valid = 0;
+static uint8_t rt_memory_locked = 0;
+static RtThread_t rt_threads[RT_MAX_THREADS];
+static std::atomic<int> rt_thread_cnt(0);
+static thread_local RtThread_t* rt_self = NULL;
+#if defined(_WIN32)
+static thread_local HANDLE rt_mmcss_task = NULL;
+#endif
+
+void rt_param_default(RtParam_t* param)
+{
+    if (param == NULL)
+    {
+        return;
+    }
+    memset(param, 0, sizeof(RtParam_t));
+    param->role[RT_ROLE_ACQUISITION].policy = RT_POLICY_FIFO;
+    param->role[RT_ROLE_ACQUISITION].priority = 50;
+    param->role[RT_ROLE_ANALYTICS].priority = 5;
+}
+
+static void rt_cpu_add(RtCpuSet_t* set, long cpu)
+{
+    if (cpu >= 0 && cpu < RT_CPU_WORDS * 64)
+    {
+        set->bits[cpu / 64] |= (uint64_t)1 << (cpu % 64);
+    }
+}
+
+static int rt_cpu_has(const RtCpuSet_t* set, int cpu)
+{
+    return (set->bits[cpu / 64] >> (cpu % 64)) & 1;
+}
+
+static int rt_cpu_count(const RtCpuSet_t* set)
+{
+    int count = 0;
+    for (int cpu = 0; cpu < RT_CPU_WORDS * 64; cpu++)
+    {
+        count += rt_cpu_has(set, cpu);
+    }
+    return count;
+}
+
+//"2,4-6" from text up to end into set, RT_ERROR_PARAM for anything else
+static int rt_cpus_parse(const char* text, const char* end, RtCpuSet_t* set)
+{
+    while (text < end)
+    {
+        char* next;
+        long first = strtol(text, &next, 10);
+        if (next == text || first < 0)
+        {
+            return RT_ERROR_PARAM;
+        }
+        long last = first;
+        text = next;
+        if (text < end && *text == '-')
+        {
+            last = strtol(text + 1, &next, 10);
+            if (next == text + 1 || last < first)
+            {
+                return RT_ERROR_PARAM;
+            }
+            text = next;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            rt_cpu_add(set, cpu);
+        }
+        if (text < end && *text != ',')
+        {
+            return RT_ERROR_PARAM;
+        }
+        text += (text < end) ? 1 : 0;
+    }
+    return RT_SUCCESS;
+}
+
+//the camera's list of an acquisition cpus text, every list for camera_index -1. the list's text goes into item
+static int rt_cpus_select(const char* cpus, int camera_index, RtCpuSet_t* set, char* item, int item_len)
+{
+    memset(set, 0, sizeof(RtCpuSet_t));
+    item[0] = '\0';
+    const char* start = cpus;
+    for (int index = 0; *start != '\0'; index++)
+    {
+        const char* end = strchr(start, ';');
+        int last = (end == NULL);
+        end = last ? start + strlen(start) : end;
+        if (camera_index < 0 || index == camera_index || (last && index < camera_index))
+        {
+            if (rt_cpus_parse(start, end, set) != RT_SUCCESS)
+            {
+                return RT_ERROR_PARAM;
+            }
+            snprintf(item, item_len, "%.*s", (int)(end - start), start);
+            if (camera_index >= 0)
+            {
+                break;
+            }
+        }
+        start = last ? end : end + 1;
+    }
+    if (camera_index < 0)
+    {
+        snprintf(item, item_len, "%s", cpus);
+    }
+    return RT_SUCCESS;
+}
+
+static int rt_cpu_online(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int num = (int)info.dwNumberOfProcessors;
+#else
+    int num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return (num < 1) ? 1 : ((num > RT_CPU_WORDS * 64) ? RT_CPU_WORDS * 64 : num);
+}
+
+//the thread's cpus: its own list, or with isolate every online cpu the acquisition lists leave
+static int rt_cpus_of(const RtParam_t* param, RtRole_t role, int camera_index, RtCpuSet_t* set, char* item, \
+    int item_len)
+{
+    const char* cpus = param->role[role].cpus;
+    if (cpus[0] != '\0')
+    {
+        return rt_cpus_select(cpus, (role == RT_ROLE_ACQUISITION) ? camera_index : -1, set, item, item_len);
+    }
+    memset(set, 0, sizeof(RtCpuSet_t));
+    item[0] = '\0';
+    if (!param->isolate || role == RT_ROLE_ACQUISITION || param->role[RT_ROLE_ACQUISITION].cpus[0] == '\0')
+    {
+        return RT_SUCCESS;
+    }
+    RtCpuSet_t acquisition;
+    char unused[RT_CPUS_LEN];
+    if (rt_cpus_select(param->role[RT_ROLE_ACQUISITION].cpus, -1, &acquisition, unused, sizeof(unused)) != RT_SUCCESS)
+    {
+        return RT_ERROR_PARAM;
+    }
+    int online = rt_cpu_online();
+    for (int cpu = 0; cpu < online; cpu++)
+    {
+        if (!rt_cpu_has(&acquisition, cpu))
+        {
+            rt_cpu_add(set, cpu);
+        }
+    }
+    if (rt_cpu_count(set) == 0)
+    {
+        return RT_SUCCESS;              //nothing left over, the thread may run anywhere
+    }
+    snprintf(item, item_len, "isolated");
+    return RT_SUCCESS;
+}
+
+static int rt_affinity_apply(const RtCpuSet_t* set)
+{
+#if defined(__linux__)
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu = 0; cpu < RT_CPU_WORDS * 64 && cpu < CPU_SETSIZE; cpu++)
+    {
+        if (rt_cpu_has(set, cpu))
+        {
+            CPU_SET(cpu, &cpu_set);
+        }
+    }
+    return (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0) ? RT_SUCCESS : RT_ERROR_PARAM;
+#elif defined(_WIN32)
+    //one processor group, its first 64 cpus
+    DWORD_PTR mask = (DWORD_PTR)set->bits[0];
+    return (mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0) ? RT_SUCCESS : RT_ERROR_PARAM;
+#else
+    (void)set;
+    return RT_ERROR_UNAVAILABLE;
+#endif
+}
+
+//policy and priority are updated to what the thread got
+static int rt_policy_apply(RtRole_t role, int* policy, int* priority)
+{
+#if defined(_WIN32)
+    int rst = RT_SUCCESS;
+    if (role == RT_ROLE_ACQUISITION)
+    {
+        //the multimedia class scheduler raises the capture task while it works, the process stays at its class
+        DWORD task_index = 0;
+        rt_mmcss_task = AvSetMmThreadCharacteristicsA("Capture", &task_index);
+        if (rt_mmcss_task == NULL)
+        {
+            return RT_ERROR_UNAVAILABLE;
+        }
+        AvSetMmThreadPriority(rt_mmcss_task, (*policy != RT_POLICY_NORMAL) ? AVRT_PRIORITY_HIGH : AVRT_PRIORITY_NORMAL);
+        return RT_SUCCESS;
+    }
+    int level = THREAD_PRIORITY_NORMAL;
+    if (*policy != RT_POLICY_NORMAL)
+    {
+        level = THREAD_PRIORITY_HIGHEST;
+    }
+    else if (*priority != 0)
+    {
+        level = (*priority < 0) ? THREAD_PRIORITY_ABOVE_NORMAL : THREAD_PRIORITY_BELOW_NORMAL;
+    }
+    if (!SetThreadPriority(GetCurrentThread(), level))
+    {
+        rst = RT_ERROR_PERM;
+    }
+    return rst;
+#else
+    (void)role;
+    int rst = RT_SUCCESS;
+    struct sched_param sp;
+    memset(&sp, 0, sizeof(sp));
+    if (*policy == RT_POLICY_FIFO || *policy == RT_POLICY_RR)
+    {
+        int sched_policy = (*policy == RT_POLICY_FIFO) ? SCHED_FIFO : SCHED_RR;
+        int min_priority = sched_get_priority_min(sched_policy);
+        int max_priority = sched_get_priority_max(sched_policy);
+        *priority = (*priority < min_priority) ? min_priority : ((*priority > max_priority) ? max_priority : *priority);
+        sp.sched_priority = *priority;
+        if (pthread_setschedparam(pthread_self(), sched_policy, &sp) == 0)
+        {
+            return RT_SUCCESS;
+        }
+        //no CAP_SYS_NICE or RLIMIT_RTPRIO: the best a normal thread gets
+        rst = RT_ERROR_PERM;
+        *policy = RT_POLICY_NORMAL;
+        *priority = RT_FALLBACK_NICE;
+    }
+    sp.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+#if defined(__linux__)
+    //linux nice values are per thread
+    id_t tid = (id_t)syscall(SYS_gettid);
+    if (setpriority(PRIO_PROCESS, tid, *priority) != 0 && rst == RT_SUCCESS)
+    {
+        rst = RT_ERROR_PERM;
+    }
+    errno = 0;
+    int nice_now = getpriority(PRIO_PROCESS, tid);
+    *priority = (errno == 0) ? nice_now : *priority;
+#else
+    if (*priority != 0 && rst == RT_SUCCESS)
+    {
+        rst = RT_ERROR_UNAVAILABLE;
+    }
+#endif
+    return rst;
+#endif
+}
+
+int rt_init(const RtParam_t* param)
+{
+    if (param == NULL)
+    {
+        return RT_ERROR_PARAM;
+    }
+    for (int role = 0; role < RT_ROLE_NUM; role++)
+    {
+        if (param->role[role].policy < 0 || param->role[role].policy >= RT_POLICY_NUM)
+        {
+            return RT_ERROR_PARAM;
+        }
+    }
+    pthread_mutex_lock(&rt_mutex);
+    rt_param = *param;
+    rt_param_valid = 1;
+    int rst = RT_SUCCESS;
+#if defined(_WIN32)
+    if (param->lock_memory)
+    {
+        rst = RT_ERROR_UNAVAILABLE;
+    }
+#else
+    if (param->lock_memory && !rt_memory_locked)
+    {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+        {
+            rt_memory_locked = 1;
+        }
+        else
+        {
+            printf("rt: mlockall failed(%d), raise RLIMIT_MEMLOCK\n", errno);
+            rst = RT_ERROR_PERM;
+        }
+    }
+    else if (!param->lock_memory && rt_memory_locked)
+    {
+        munlockall();
+        rt_memory_locked = 0;
+    }
+#endif
+    pthread_mutex_unlock(&rt_mutex);
+    return rst;
+}
+
+static RtThread_t* rt_thread_slot(const char* name)
+{
+    int cnt = rt_thread_cnt.load();
+    for (int i = 0; i < cnt; i++)
+    {
+        if (strncmp(rt_threads[i].name, name, RT_NAME_LEN - 1) == 0)
+        {
+            return &rt_threads[i];
+        }
+    }
+    if (cnt >= RT_MAX_THREADS)
+    {
+        return NULL;
+    }
+    RtThread_t* thread = &rt_threads[cnt];
+    snprintf(thread->name, sizeof(thread->name), "%s", name);
+    rt_thread_cnt.store(cnt + 1);
+    return thread;
+}
+
+int rt_thread_enter(RtRole_t role, int camera_index, const char* name)
+{
+    if (role < 0 || role >= RT_ROLE_NUM || name == NULL)
+    {
+        return RT_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&rt_mutex);
+    if (!rt_param_valid)
+    {
+        rt_param_default(&rt_param);
+        rt_param_valid = 1;
+    }
+    RtParam_t param = rt_param;
+    RtThread_t* thread = rt_thread_slot(name);
+    pthread_mutex_unlock(&rt_mutex);
+    if (thread == NULL)
+    {
+        return RT_ERROR_FULL;
+    }
+
+    int rst = RT_SUCCESS;
+    RtCpuSet_t set;
+    char cpus[RT_CPUS_LEN];
+    int cpu_num = 0;
+    if (rt_cpus_of(&param, role, camera_index, &set, cpus, sizeof(cpus)) != RT_SUCCESS)
+    {
+        rst = RT_ERROR_PARAM;
+        printf("rt: %s cpu list \"%s\" does not parse\n", name, param.role[role].cpus);
+        cpus[0] = '\0';
+    }
+    else if (cpus[0] != '\0')
+    {
+        cpu_num = rt_cpu_count(&set);
+        int affinity_rst = rt_affinity_apply(&set);
+        if (affinity_rst != RT_SUCCESS)
+        {
+            rst = affinity_rst;
+            printf("rt: %s cpus %s refused(%d), it runs anywhere\n", name, cpus, rst);
+            cpu_num = 0;
+            cpus[0] = '\0';
+        }
+    }
+    int policy = param.role[role].policy;
+    int priority = param.role[role].priority;
+    int policy_rst = rt_policy_apply(role, &policy, &priority);
+    if (policy_rst != RT_SUCCESS && rst == RT_SUCCESS)
+    {
+        rst = policy_rst;
+    }
+
+    thread->role = role;
+    thread->camera_index = camera_index;
+    thread->policy = policy;
+    thread->priority = priority;
+    thread->cpu_num = cpu_num;
+    snprintf(thread->cpus, sizeof(thread->cpus), "%s", cpus);
+    thread->running.store(1);
+    rt_self = thread;
+
+    if (policy != param.role[role].policy)
+    {
+        printf("rt: %s %s refused, %s at nice %d\n", thread->name, rt_policy_names[param.role[role].policy], \
+            rt_policy_names[policy], priority);
+    }
+    else if (policy_rst != RT_SUCCESS)
+    {
+        printf("rt: %s %s %d not applied(%d)\n", thread->name, rt_policy_names[policy], priority, policy_rst);
+    }
+    return rst;
+}
+
+void rt_thread_leave(void)
+{
+#if defined(_WIN32)
+    if (rt_mmcss_task != NULL)
+    {
+        AvRevertMmThreadCharacteristics(rt_mmcss_task);
+        rt_mmcss_task = NULL;
+    }
+#endif
+    if (rt_self != NULL)
+    {
+        rt_self->running.store(0);
+        rt_self = NULL;
+    }
+}
+
+void rt_wakeup_record(uint64_t latency_us)
+{
+    if (rt_self != NULL)
+    {
+        timing_hist_record(&rt_self->wakeup, latency_us);
+    }
+}
+
+uint64_t rt_wakeup_record_since(uint64_t signal_us)
+{
+    uint64_t now_us = get_monotonic_us();
+    rt_wakeup_record((now_us > signal_us) ? now_us - signal_us : 0);
+    return now_us;
+}
+
+int rt_thread_num(void)
+{
+    return rt_thread_cnt.load();
+}
+
+int rt_thread_stats(int index, RtThreadStats_t* stats)
+{
+    if (index < 0 || index >= rt_thread_cnt.load() || stats == NULL)
+    {
+        return RT_ERROR_PARAM;
+    }
+    RtThread_t* thread = &rt_threads[index];
+    memcpy(stats->name, thread->name, RT_NAME_LEN);
+    stats->role = thread->role;
+    stats->camera_index = thread->camera_index;
+    stats->policy = thread->policy;
+    stats->priority = thread->priority;
+    stats->cpu_num = thread->cpu_num;
+    memcpy(stats->cpus, thread->cpus, RT_CPUS_LEN);
+    stats->running = thread->running.load();
+    timing_hist_stats(&thread->wakeup, &stats->wakeup);
+    return RT_SUCCESS;
+}
+
+void rt_dump(FILE* fp)
+{
+    fp = (fp != NULL) ? fp : stdout;
+    fprintf(fp, "%-14s %-11s %-10s %-10s %10s %8s %8s %8s %8s\n", "thread", "role", "sched", "cpus", "wakeups", \
+        "mean", "p50", "p99", "max");
+    for (int i = 0; i < rt_thread_num(); i++)
+    {
+        RtThreadStats_t stats;
+        rt_thread_stats(i, &stats);
+        char sched[16];
+        snprintf(sched, sizeof(sched), "%s %d", rt_policy_names[stats.policy], stats.priority);
+        fprintf(fp, "%-14s %-11s %-10s %-10s %10llu %8llu %8llu %8llu %8llu%s\n", stats.name, rt_role_names[stats.role], \
+            sched, (stats.cpus[0] != '\0') ? stats.cpus : "any", (unsigned long long)stats.wakeup.count, \
+            (unsigned long long)stats.wakeup.mean_us, (unsigned long long)stats.wakeup.p50_us, \
+            (unsigned long long)stats.wakeup.p99_us, (unsigned long long)stats.wakeup.max_us, \
+            stats.running ? "" : " (exited)");
+    }
+}
+
+const char* rt_role_name(RtRole_t role)
+{
+    return (role >= 0 && role < RT_ROLE_NUM) ? rt_role_names[role] : "unknown";
+}
+
+const char* rt_policy_name(RtPolicy_t policy)
+{
+    return (policy >= 0 && policy < RT_POLICY_NUM) ? rt_policy_names[policy] : "unknown";
+}
@@ -0,0 +1,94 @@
+#ifndef _RTSCHED_H_
+#define _RTSCHED_H_
+
+//per thread scheduling instead of one nice value for the whole process. every long lived thread names its role
+//when it starts and the role's policy, priority and cpus are applied to that thread only. the threads also record
+//how late they run after being woken, rt_dump prints it per thread for tuning the pinning
+#include <stdint.h>
+#include <stdio.h>
+#include "timing.h"
+
+#define RT_SUCCESS 0
+#define RT_ERROR_PARAM -1
+#define RT_ERROR_PERM -2                //policy, priority or memory lock refused: CAP_SYS_NICE, RLIMIT_RTPRIO, RLIMIT_MEMLOCK
+#define RT_ERROR_UNAVAILABLE -3         //not on this platform
+#define RT_ERROR_FULL -4                //RT_MAX_THREADS names registered
+
+#define RT_MAX_THREADS 64
+#define RT_NAME_LEN 16
+#define RT_CPUS_LEN 64
+#define RT_FALLBACK_NICE -20            //a refused fifo/rr policy falls back to normal at this nice value
+
+typedef enum
+{
+    RT_POLICY_NORMAL = 0,               //SCHED_OTHER with priority as the nice value
+    RT_POLICY_FIFO,
+    RT_POLICY_RR,
+    RT_POLICY_NUM
+}RtPolicy_t;
+
+typedef enum
+{
+    RT_ROLE_ACQUISITION = 0,            //a camera's stream thread or callback hand-off thread
+    RT_ROLE_DISPLAY,                    //display thread and the sink's ui thread
+    RT_ROLE_ANALYTICS,                  //temperature, task pool workers, calibration
+    RT_ROLE_CONTROL,                    //commands, config watcher, logger
+    RT_ROLE_NUM
+}RtRole_t;
+
+typedef struct {
+    int policy;                         //RtPolicy_t
+    int priority;                       //1..99 for fifo/rr, the nice value -20..19 for normal
+    char cpus[RT_CPUS_LEN];             //cpu list "2,4-6", empty for any. acquisition: one list per camera split by
+                                        //';', cameras past the last list take the last one
+}RtThreadParam_t;
+
+typedef struct {
+    RtThreadParam_t role[RT_ROLE_NUM];
+    int isolate;                        //threads of the other roles without a cpu list keep off the acquisition cpus
+    int lock_memory;                    //mlockall of the current and future pages, no page faults on the frame path
+}RtParam_t;
+
+typedef struct {
+    char name[RT_NAME_LEN];
+    int role;                           //RtRole_t
+    int camera_index;                   //-1 for a thread of no camera
+    int policy;                         //applied, RT_POLICY_NORMAL after a refused fifo/rr
+    int priority;
+    int cpu_num;                        //cpus of the affinity, 0 for any
+    char cpus[RT_CPUS_LEN];             //the list applied, "isolated" for the cpus left by the acquisition ones
+    int running;
+    TimingStats_t wakeup;               //signal -> the woken thread runs, us
+}RtThreadStats_t;
+
+//acquisition fifo 50, display and control normal, analytics normal at nice 5, no pinning, no memory lock
+void rt_param_default(RtParam_t* param);
+
+//the parameters threads get from now on, and the memory lock. threads already running keep theirs
+int rt_init(const RtParam_t* param);
+
+//apply the role's parameters to the calling thread and register it as name. a thread entering again with the
+//same name reuses its slot and statistics. returns RT_SUCCESS or the first part that failed, the rest still applies
+int rt_thread_enter(RtRole_t role, int camera_index, const char* name);
+
+//the calling thread exits, reverts what cannot outlive it (the windows mmcss task)
+void rt_thread_leave(void);
+
+//the calling thread woke up latency_us after it was signaled, a no-op for threads that did not enter
+void rt_wakeup_record(uint64_t latency_us);
+
+//signal_us to now, returns now
+uint64_t rt_wakeup_record_since(uint64_t signal_us);
+
+int rt_thread_num(void);
+
+int rt_thread_stats(int index, RtThreadStats_t* stats);
+
+//one line per registered thread: role, what was applied, the wakeup latency percentiles
+void rt_dump(FILE* fp);
+
+const char* rt_role_name(RtRole_t role);
+
+const char* rt_policy_name(RtPolicy_t policy);
+
+#endif
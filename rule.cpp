@@ -0,0 +1,862 @@
+#include "rule.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <new>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "data.h"
+#include "log.h"
+#include "rtsched.h"
+#include "tempunit.h"
+
+typedef enum
+{
+    RULE_TOK_END = 0,                   //end of the line or a comment
+    RULE_TOK_NUM,
+    RULE_TOK_IDENT,
+    RULE_TOK_STRING,
+    RULE_TOK_OP,
+}RuleTok_t;
+
+//binary operators by precedence level, 0 binds the weakest
+typedef struct {
+    const char* text;
+    RuleOp_t op;
+    int level;
+}RuleBinop_t;
+
+#define RULE_BINOP_LEVELS 6
+
+static const RuleBinop_t rule_binops[] = {
+    { "||", RULE_OP_OR, 0 }, { "&&", RULE_OP_AND, 1 },
+    { "==", RULE_OP_EQ, 2 }, { "!=", RULE_OP_NE, 2 },
+    { "<", RULE_OP_LT, 3 }, { "<=", RULE_OP_LE, 3 }, { ">", RULE_OP_GT, 3 }, { ">=", RULE_OP_GE, 3 },
+    { "+", RULE_OP_ADD, 4 }, { "-", RULE_OP_SUB, 4 },
+    { "*", RULE_OP_MUL, 5 }, { "/", RULE_OP_DIV, 5 },
+};
+
+static const char* rule_stat_names[] = { "max", "min", "avr" };
+static const char* rule_blob_names[] = { "count", "area", "hot_area", "max" };
+
+//one file being compiled, the lexer looks one token ahead
+typedef struct {
+    const RuleParam_t* param;
+    RuleSet_t* set;
+    char roi_names[RULE_MAX_NAMES][RULE_NAME_LEN];
+    uint8_t roi_index[RULE_MAX_NAMES];
+    int name_num;
+    const char* p;
+    RuleTok_t tok;
+    char text[RULE_NAME_LEN];
+    float num;
+    int reg;                            //the next free register of the rule
+    int line;
+    int failed;
+    char* error;
+    int error_len;
+}RuleCompiler_t;
+
+static void rule_fail(RuleCompiler_t* c, const char* fmt, ...)
+{
+    if (c->failed)
+    {
+        return;
+    }
+    c->failed = 1;
+    if (c->error == NULL || c->error_len <= 0)
+    {
+        return;
+    }
+    int len = snprintf(c->error, c->error_len, "line %d: ", c->line);
+    if (len >= 0 && len < c->error_len)
+    {
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(c->error + len, c->error_len - len, fmt, args);
+        va_end(args);
+    }
+}
+
+static void rule_next(RuleCompiler_t* c)
+{
+    const char* p = c->p;
+    while (*p == ' ' || *p == '\t')
+    {
+        p++;
+    }
+    c->text[0] = '\0';
+    if (c->failed || *p == '\0' || *p == '#')
+    {
+        c->tok = RULE_TOK_END;
+        c->p = p;
+        return;
+    }
+    if (isdigit((unsigned char)*p) || (*p == '.' && isdigit((unsigned char)p[1])))
+    {
+        char* end = NULL;
+        c->num = strtof(p, &end);
+        c->tok = RULE_TOK_NUM;
+        c->p = end;
+        return;
+    }
+    if (isalpha((unsigned char)*p) || *p == '_' || *p == '"')
+    {
+        int quoted = (*p == '"');
+        p += quoted;
+        int len = 0;
+        while ((quoted) ? (*p != '"' && *p != '\0') : (isalnum((unsigned char)*p) || *p == '_'))
+        {
+            if (len >= RULE_NAME_LEN - 1)
+            {
+                rule_fail(c, "name longer than %d characters", RULE_NAME_LEN - 1);
+                c->tok = RULE_TOK_END;
+                return;
+            }
+            c->text[len++] = *p++;
+        }
+        c->text[len] = '\0';
+        if (quoted && *p++ != '"')
+        {
+            rule_fail(c, "unterminated string");
+            c->tok = RULE_TOK_END;
+            return;
+        }
+        c->tok = (quoted) ? RULE_TOK_STRING : RULE_TOK_IDENT;
+        c->p = p;
+        return;
+    }
+    static const char* two[] = { "||", "&&", "==", "!=", "<=", ">=" };
+    for (int i = 0; i < (int)(sizeof(two) / sizeof(two[0])); i++)
+    {
+        if (p[0] == two[i][0] && p[1] == two[i][1])
+        {
+            memcpy(c->text, two[i], 3);
+            c->tok = RULE_TOK_OP;
+            c->p = p + 2;
+            return;
+        }
+    }
+    if (strchr("<>+-*/!().:=", *p) == NULL)
+    {
+        rule_fail(c, "unexpected '%c'", *p);
+        c->tok = RULE_TOK_END;
+        return;
+    }
+    c->text[0] = *p;
+    c->text[1] = '\0';
+    c->tok = RULE_TOK_OP;
+    c->p = p + 1;
+}
+
+static int rule_is(const RuleCompiler_t* c, RuleTok_t tok, const char* text)
+{
+    return c->tok == tok && strcmp(c->text, text) == 0;
+}
+
+static void rule_expect(RuleCompiler_t* c, const char* text)
+{
+    if (!rule_is(c, RULE_TOK_OP, text))
+    {
+        rule_fail(c, "expected '%s'", text);
+        return;
+    }
+    rule_next(c);
+}
+
+static void rule_emit(RuleCompiler_t* c, RuleOp_t op, int dst, int a, int b, float k)
+{
+    RuleSet_t* set = c->set;
+    if (c->failed)
+    {
+        return;
+    }
+    if (set->code_len >= RULE_MAX_CODE)
+    {
+        rule_fail(c, "more than %d instructions", RULE_MAX_CODE);
+        return;
+    }
+    RuleInsn_t* insn = &set->code[set->code_len++];
+    insn->op = (uint8_t)op;
+    insn->dst = (uint8_t)dst;
+    insn->a = (uint8_t)a;
+    insn->b = (uint8_t)b;
+    insn->k = k;
+}
+
+static int rule_reg(RuleCompiler_t* c)
+{
+    if (c->reg >= RULE_MAX_REGS)
+    {
+        rule_fail(c, "expression deeper than %d registers", RULE_MAX_REGS);
+        return 0;
+    }
+    return c->reg++;
+}
+
+static int rule_stat_of(const char* name, int len)
+{
+    for (int s = 0; s < 3; s++)
+    {
+        if ((int)strlen(rule_stat_names[s]) == len && strncmp(name, rule_stat_names[s], len) == 0)
+        {
+            return s;
+        }
+    }
+    return -1;
+}
+
+//max/min/avr of the frame, or max_<n><s|m|h> over a horizon of the engine's windows
+static void rule_roi_field(RuleCompiler_t* c, int roi)
+{
+    const char* field = c->text;
+    const char* under = strchr(field, '_');
+    int stat = rule_stat_of(field, (under != NULL) ? (int)(under - field) : (int)strlen(field));
+    if (stat < 0)
+    {
+        rule_fail(c, "unknown roi field '%s'", field);
+        return;
+    }
+    int dst = rule_reg(c);
+    if (under == NULL)
+    {
+        rule_emit(c, RULE_OP_ROI, dst, roi, stat, 0.0f);
+        return;
+    }
+    char* unit = NULL;
+    unsigned long n = strtoul(under + 1, &unit, 10);
+    uint64_t scale = (strcmp(unit, "s") == 0) ? 1000 : ((strcmp(unit, "m") == 0) ? 60000 : \
+        ((strcmp(unit, "h") == 0) ? 3600000 : 0));
+    if (unit == under + 1 || scale == 0)
+    {
+        rule_fail(c, "'%s': a window is <stat>_<n>s, m or h", field);
+        return;
+    }
+    for (int h = 0; h < c->param->horizon_num; h++)
+    {
+        if ((uint64_t)c->param->horizon_ms[h] == n * scale)
+        {
+            rule_emit(c, RULE_OP_WINDOW, dst, roi, stat | (h << 2), 0.0f);
+            return;
+        }
+    }
+    rule_fail(c, "'%s': no window of %lu ms", field, (unsigned long)(n * scale));
+}
+
+static int rule_expr(RuleCompiler_t* c, int level);
+
+static int rule_primary(RuleCompiler_t* c)
+{
+    if (c->tok == RULE_TOK_NUM)
+    {
+        int dst = rule_reg(c);
+        rule_emit(c, RULE_OP_CONST, dst, 0, 0, c->num);
+        rule_next(c);
+        return dst;
+    }
+    if (rule_is(c, RULE_TOK_OP, "("))
+    {
+        rule_next(c);
+        int dst = rule_expr(c, 0);
+        rule_expect(c, ")");
+        return dst;
+    }
+    if (rule_is(c, RULE_TOK_IDENT, "roi"))
+    {
+        rule_next(c);
+        rule_expect(c, "(");
+        int roi = -1;
+        if (c->tok == RULE_TOK_STRING)
+        {
+            for (int i = 0; i < c->name_num && roi < 0; i++)
+            {
+                roi = (strcmp(c->roi_names[i], c->text) == 0) ? c->roi_index[i] : -1;
+            }
+            if (roi < 0)
+            {
+                rule_fail(c, "unknown roi \"%s\"", c->text);
+            }
+        }
+        else if (c->tok == RULE_TOK_NUM && c->num >= 0 && c->num < ROI_MAX_NUM && c->num == (int)c->num)
+        {
+            roi = (int)c->num;
+        }
+        else
+        {
+            rule_fail(c, "roi takes a name or an index below %d", ROI_MAX_NUM);
+        }
+        rule_next(c);
+        rule_expect(c, ")");
+        rule_expect(c, ".");
+        if (c->tok != RULE_TOK_IDENT)
+        {
+            rule_fail(c, "expected a roi field");
+            return 0;
+        }
+        int dst = c->reg;
+        rule_roi_field(c, (roi < 0) ? 0 : roi);
+        rule_next(c);
+        return dst;
+    }
+    if (rule_is(c, RULE_TOK_IDENT, "blob") || rule_is(c, RULE_TOK_IDENT, "frame"))
+    {
+        int blob = (c->text[0] == 'b');
+        rule_next(c);
+        rule_expect(c, ".");
+        int field = -1;
+        for (int i = 0; c->tok == RULE_TOK_IDENT && blob && i < RULE_BLOB_FIELD_NUM; i++)
+        {
+            field = (strcmp(c->text, rule_blob_names[i]) == 0) ? i : field;
+        }
+        if (c->tok == RULE_TOK_IDENT && !blob)
+        {
+            field = rule_stat_of(c->text, (int)strlen(c->text));
+        }
+        if (field < 0)
+        {
+            rule_fail(c, "unknown %s field '%s'", (blob) ? "blob" : "frame", c->text);
+            return 0;
+        }
+        int dst = rule_reg(c);
+        rule_emit(c, (blob) ? RULE_OP_BLOB : RULE_OP_FRAME, dst, field, 0, 0.0f);
+        rule_next(c);
+        return dst;
+    }
+    rule_fail(c, (c->tok == RULE_TOK_END) ? "expression ends early" : "unexpected '%s'", c->text);
+    return 0;
+}
+
+static int rule_unary(RuleCompiler_t* c)
+{
+    if (rule_is(c, RULE_TOK_OP, "!") || rule_is(c, RULE_TOK_OP, "-"))
+    {
+        RuleOp_t op = (c->text[0] == '!') ? RULE_OP_NOT : RULE_OP_NEG;
+        rule_next(c);
+        int dst = rule_unary(c);
+        rule_emit(c, op, dst, dst, 0, 0.0f);
+        return dst;
+    }
+    return rule_primary(c);
+}
+
+//left to right at one level, the right operand's register is free again after each operator
+static int rule_expr(RuleCompiler_t* c, int level)
+{
+    if (level >= RULE_BINOP_LEVELS)
+    {
+        return rule_unary(c);
+    }
+    int dst = rule_expr(c, level + 1);
+    while (!c->failed && c->tok == RULE_TOK_OP)
+    {
+        const RuleBinop_t* binop = NULL;
+        for (int i = 0; i < (int)(sizeof(rule_binops) / sizeof(rule_binops[0])) && binop == NULL; i++)
+        {
+            binop = (rule_binops[i].level == level && strcmp(rule_binops[i].text, c->text) == 0) ? &rule_binops[i] : NULL;
+        }
+        if (binop == NULL)
+        {
+            break;
+        }
+        rule_next(c);
+        int rhs = rule_expr(c, level + 1);
+        rule_emit(c, binop->op, dst, dst, rhs, 0.0f);
+        c->reg = dst + 1;
+    }
+    return dst;
+}
+
+//roi <name> = <index>, or rule <name>: <expression>
+static void rule_statement(RuleCompiler_t* c)
+{
+    RuleSet_t* set = c->set;
+    rule_next(c);
+    if (c->tok == RULE_TOK_END)
+    {
+        return;
+    }
+    int is_roi = rule_is(c, RULE_TOK_IDENT, "roi");
+    if (!is_roi && !rule_is(c, RULE_TOK_IDENT, "rule"))
+    {
+        rule_fail(c, "a line is 'roi <name> = <index>' or 'rule <name>: <expression>'");
+        return;
+    }
+    rule_next(c);
+    if (c->tok != RULE_TOK_IDENT)
+    {
+        rule_fail(c, "expected a name");
+        return;
+    }
+    char name[RULE_NAME_LEN];
+    memcpy(name, c->text, sizeof(name));
+    rule_next(c);
+    if (is_roi)
+    {
+        rule_expect(c, "=");
+        if (c->failed || c->tok != RULE_TOK_NUM || c->num < 0 || c->num >= ROI_MAX_NUM || c->num != (int)c->num)
+        {
+            rule_fail(c, "a roi index is below %d", ROI_MAX_NUM);
+            return;
+        }
+        int index = (int)c->num;
+        rule_next(c);
+        if (c->tok != RULE_TOK_END)
+        {
+            rule_fail(c, "unexpected '%s' after the index", c->text);
+            return;
+        }
+        for (int i = 0; i < c->name_num; i++)
+        {
+            if (strcmp(c->roi_names[i], name) == 0)
+            {
+                c->roi_index[i] = (uint8_t)index;
+                return;
+            }
+        }
+        if (c->name_num >= RULE_MAX_NAMES)
+        {
+            rule_fail(c, "more than %d roi names", RULE_MAX_NAMES);
+            return;
+        }
+        memcpy(c->roi_names[c->name_num], name, RULE_NAME_LEN);
+        c->roi_index[c->name_num++] = (uint8_t)index;
+        return;
+    }
+    if (set->rule_num >= RULE_MAX_RULES)
+    {
+        rule_fail(c, "more than %d rules", RULE_MAX_RULES);
+        return;
+    }
+    for (int i = 0; i < set->rule_num; i++)
+    {
+        if (strcmp(set->names[i], name) == 0)
+        {
+            rule_fail(c, "rule %s is defined on line %d", name, set->line[i]);
+            return;
+        }
+    }
+    rule_expect(c, ":");
+    c->reg = 0;
+    set->code_start[set->rule_num] = set->code_len;
+    int result = rule_expr(c, 0);
+    if (!c->failed && c->tok != RULE_TOK_END)
+    {
+        rule_fail(c, "unexpected '%s'", c->text);
+    }
+    rule_emit(c, RULE_OP_END, 0, result, 0, 0.0f);
+    if (c->failed)
+    {
+        return;
+    }
+    memcpy(set->names[set->rule_num], name, RULE_NAME_LEN);
+    set->line[set->rule_num] = (uint16_t)c->line;
+    set->rule_num++;
+    set->code_start[set->rule_num] = set->code_len;
+}
+
+int rule_set_compile(const char* text, const RuleParam_t* param, RuleSet_t* set, char* error, int error_len)
+{
+    if (text == NULL || param == NULL || set == NULL)
+    {
+        return RULE_ERROR_PARAM;
+    }
+    memset(set, 0, sizeof(RuleSet_t));
+    RuleCompiler_t* c = (RuleCompiler_t*)calloc(1, sizeof(RuleCompiler_t));
+    if (c == NULL)
+    {
+        return RULE_ERROR_MEM;
+    }
+    c->param = param;
+    c->set = set;
+    c->error = error;
+    c->error_len = error_len;
+    if (error != NULL && error_len > 0)
+    {
+        error[0] = '\0';
+    }
+    char line[RULE_LINE_LEN];
+    const char* p = text;
+    while (*p != '\0' && !c->failed)
+    {
+        const char* end = strchr(p, '\n');
+        size_t len = (end != NULL) ? (size_t)(end - p) : strlen(p);
+        c->line++;
+        if (len >= sizeof(line))
+        {
+            rule_fail(c, "longer than %d characters", RULE_LINE_LEN - 1);
+            break;
+        }
+        memcpy(line, p, len);
+        line[len] = '\0';
+        if (len > 0 && line[len - 1] == '\r')
+        {
+            line[len - 1] = '\0';
+        }
+        c->p = line;
+        rule_statement(c);
+        p += len + (end != NULL);
+    }
+    int failed = c->failed;
+    free(c);
+    return (failed) ? RULE_ERROR_SYNTAX : RULE_SUCCESS;
+}
+
+int rule_engine_init(RuleEngine_t* engine, const RuleParam_t* param)
+{
+    if (engine == NULL || param == NULL || param->horizon_num < 0 || param->horizon_num > ROI_WINDOW_MAX)
+    {
+        return RULE_ERROR_PARAM;
+    }
+    //value-initialized: zero, the atomics included
+    new (engine) RuleEngine_t();
+    engine->param = *param;
+    pthread_mutex_init(&engine->mutex, NULL);
+    return RULE_SUCCESS;
+}
+
+static void rule_watch_stop(RuleEngine_t* engine)
+{
+    if (!engine->watching)
+    {
+        return;
+    }
+    stop_request(&engine->stop);
+    pthread_join(engine->thread, NULL);
+    stop_token_release(&engine->stop);
+    engine->watching = 0;
+}
+
+void rule_engine_release(RuleEngine_t* engine)
+{
+    if (engine == NULL)
+    {
+        return;
+    }
+    rule_watch_stop(engine);
+    free(engine->pending.exchange(NULL));
+    free(engine->retired.exchange(NULL));
+    free(engine->current);
+    engine->current = NULL;
+    pthread_mutex_destroy(&engine->mutex);
+}
+
+int rule_engine_load_text(RuleEngine_t* engine, const char* text, char* error, int error_len)
+{
+    if (engine == NULL || text == NULL)
+    {
+        return RULE_ERROR_PARAM;
+    }
+    RuleSet_t* set = (RuleSet_t*)malloc(sizeof(RuleSet_t));
+    if (set == NULL)
+    {
+        return RULE_ERROR_MEM;
+    }
+    int ret = rule_set_compile(text, &engine->param, set, error, error_len);
+    pthread_mutex_lock(&engine->mutex);
+    if (ret != RULE_SUCCESS)
+    {
+        engine->stats.load_errors++;
+        pthread_mutex_unlock(&engine->mutex);
+        free(set);
+        return ret;
+    }
+    //the set the evaluation swapped out last time, then one loaded before and never taken
+    free(engine->retired.exchange(NULL, std::memory_order_acq_rel));
+    free(engine->pending.exchange(set, std::memory_order_acq_rel));
+    pthread_mutex_unlock(&engine->mutex);
+    return RULE_SUCCESS;
+}
+
+int rule_engine_load(RuleEngine_t* engine, const char* path, char* error, int error_len)
+{
+    if (engine == NULL || path == NULL)
+    {
+        return RULE_ERROR_PARAM;
+    }
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        if (error != NULL && error_len > 0)
+        {
+            snprintf(error, error_len, "can not open %s", path);
+        }
+        return RULE_ERROR_FILE;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char* text = (size >= 0) ? (char*)malloc((size_t)size + 1) : NULL;
+    if (text == NULL)
+    {
+        fclose(fp);
+        return RULE_ERROR_MEM;
+    }
+    size_t len = fread(text, 1, (size_t)size, fp);
+    fclose(fp);
+    text[len] = '\0';
+    int ret = rule_engine_load_text(engine, text, error, error_len);
+    free(text);
+    return ret;
+}
+
+static int rule_file_stamp(const char* path, uint64_t* stamp)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        return -1;
+    }
+    *stamp = ((uint64_t)st.st_mtime << 24) ^ (uint64_t)st.st_size;
+    return 0;
+}
+
+static void rule_engine_reload(RuleEngine_t* engine)
+{
+    char error[RULE_ERROR_LEN];
+    if (rule_engine_load(engine, engine->path, error, sizeof(error)) != RULE_SUCCESS)
+    {
+        LOG(LOG_LEVEL_WARN, "rules: %s: %s, the rules before stay\n", engine->path, error);
+        return;
+    }
+    LOG(LOG_LEVEL_INFO, "rules: %s loaded\n", engine->path);
+}
+
+static void* rule_watch_function(void* threadarg)
+{
+    RuleEngine_t* engine = (RuleEngine_t*)threadarg;
+    uint64_t stamp = 0;
+    uint8_t stamped = (rule_file_stamp(engine->path, &stamp) == 0);
+    rt_thread_enter(RT_ROLE_CONTROL, -1, "rules");
+    while (!stop_token_wait(&engine->stop, RULE_POLL_MS))
+    {
+        uint64_t now_stamp = 0;
+        if (rule_file_stamp(engine->path, &now_stamp) != 0 || (stamped && now_stamp == stamp))
+        {
+            continue;
+        }
+        stamp = now_stamp;
+        stamped = 1;
+        rule_engine_reload(engine);
+    }
+    rt_thread_leave();
+    return NULL;
+}
+
+int rule_engine_watch(RuleEngine_t* engine, const char* path)
+{
+    if (engine == NULL || path == NULL || strlen(path) >= RULE_PATH_LEN || engine->watching)
+    {
+        return RULE_ERROR_PARAM;
+    }
+    snprintf(engine->path, sizeof(engine->path), "%s", path);
+    char error[RULE_ERROR_LEN];
+    int ret = rule_engine_load(engine, path, error, sizeof(error));
+    if (ret != RULE_SUCCESS)
+    {
+        LOG(LOG_LEVEL_WARN, "rules: %s: %s\n", path, error);
+    }
+    if (stop_token_init(&engine->stop) != STOP_SUCCESS)
+    {
+        return RULE_ERROR_THREAD;
+    }
+    if (pthread_create(&engine->thread, NULL, rule_watch_function, engine) != 0)
+    {
+        stop_token_release(&engine->stop);
+        return RULE_ERROR_THREAD;
+    }
+    engine->watching = 1;
+    return ret;
+}
+
+static inline float rule_celsius(float raw)
+{
+    return raw / (1 << TEMP_RAW_SHIFT) - 273.15f;
+}
+
+static inline int rule_true(float v)
+{
+    //nan is neither
+    return v > 0.0f || v < 0.0f;
+}
+
+static inline float rule_stat(const TempInfo_t* info, int stat)
+{
+    return (float)((stat == ROI_WINDOW_MAX_TEMP) ? info->max_temp : ((stat == ROI_WINDOW_MIN_TEMP) ? info->min_temp : \
+        info->avr_temp));
+}
+
+static float rule_load(const RuleInsn_t* insn, const RuleInput_t* input)
+{
+    switch (insn->op)
+    {
+    case RULE_OP_ROI:
+        return (input->roi != NULL && insn->a < input->roi_num) ? rule_celsius(rule_stat(&input->roi[insn->a], \
+            insn->b)) : NAN;
+    case RULE_OP_WINDOW:
+    {
+        RoiWindowValue_t value;
+        if (input->windows == NULL || (insn->b >> 2) >= input->windows->param.num || \
+            roi_windows_get(input->windows, insn->a, insn->b >> 2, &value) != ROI_WINDOW_SUCCESS || value.samples == 0)
+        {
+            return NAN;
+        }
+        return rule_celsius((float)roi_window_stat(&value, (RoiWindowStat_t)(insn->b & 3)));
+    }
+    case RULE_OP_BLOB:
+    {
+        const AlarmBlobSummary_t* blobs = input->blobs;
+        if (blobs == NULL)
+        {
+            return NAN;
+        }
+        return (insn->a == RULE_BLOB_COUNT) ? (float)blobs->count : ((insn->a == RULE_BLOB_AREA) ? (float)blobs->area : \
+            ((insn->a == RULE_BLOB_HOT_AREA) ? (float)blobs->hot_area : \
+            ((blobs->count > 0) ? rule_celsius((float)blobs->max_temp) : NAN)));
+    }
+    default:
+    {
+        const FrameStats_t* frame = input->frame;
+        if (frame == NULL || !frame->valid)
+        {
+            return NAN;
+        }
+        return rule_celsius((insn->a == ROI_WINDOW_MAX_TEMP) ? (float)frame->max_val : \
+            ((insn->a == ROI_WINDOW_MIN_TEMP) ? (float)frame->min_val : frame->mean));
+    }
+    }
+}
+
+int rule_engine_eval(RuleEngine_t* engine, const RuleInput_t* input)
+{
+    if (engine == NULL || input == NULL)
+    {
+        return RULE_ERROR_PARAM;
+    }
+    uint64_t start_us = get_monotonic_us();
+    //a new set starts with every rule false, the ones holding raise on this frame
+    RuleSet_t* next = engine->pending.exchange(NULL, std::memory_order_acq_rel);
+    uint8_t loaded = (next != NULL);
+    if (loaded)
+    {
+        RuleSet_t* old = engine->current;
+        engine->current = next;
+        memset(engine->state, 0, sizeof(engine->state));
+        //the load frees it, or it is one nobody took since
+        free(engine->retired.exchange(old, std::memory_order_acq_rel));
+    }
+    const RuleSet_t* set = engine->current;
+    if (set == NULL)
+    {
+        return 0;
+    }
+    float* regs = engine->regs;
+    int hold_num = 0, event_num = 0;
+    for (int r = 0; r < set->rule_num; r++)
+    {
+        const RuleInsn_t* insn = set->code + set->code_start[r];
+        const RuleInsn_t* end = set->code + set->code_start[r + 1];
+        int result = 0;
+        for (; insn < end; insn++)
+        {
+            float a = regs[insn->a], b = regs[insn->b];
+            switch (insn->op)
+            {
+            case RULE_OP_CONST: regs[insn->dst] = insn->k; break;
+            case RULE_OP_ROI:
+            case RULE_OP_WINDOW:
+            case RULE_OP_BLOB:
+            case RULE_OP_FRAME: regs[insn->dst] = rule_load(insn, input); break;
+            case RULE_OP_ADD: regs[insn->dst] = a + b; break;
+            case RULE_OP_SUB: regs[insn->dst] = a - b; break;
+            case RULE_OP_MUL: regs[insn->dst] = a * b; break;
+            case RULE_OP_DIV: regs[insn->dst] = a / b; break;
+            case RULE_OP_LT: regs[insn->dst] = (float)(a < b); break;
+            case RULE_OP_LE: regs[insn->dst] = (float)(a <= b); break;
+            case RULE_OP_GT: regs[insn->dst] = (float)(a > b); break;
+            case RULE_OP_GE: regs[insn->dst] = (float)(a >= b); break;
+            case RULE_OP_EQ: regs[insn->dst] = (float)(a == b); break;
+            case RULE_OP_NE: regs[insn->dst] = (float)(a != b); break;
+            case RULE_OP_AND: regs[insn->dst] = (float)(rule_true(a) && rule_true(b)); break;
+            case RULE_OP_OR: regs[insn->dst] = (float)(rule_true(a) || rule_true(b)); break;
+            case RULE_OP_NEG: regs[insn->dst] = -a; break;
+            case RULE_OP_NOT: regs[insn->dst] = (a != a) ? a : (float)!rule_true(a); break;
+            default: result = rule_true(a); break;
+            }
+        }
+        hold_num += result;
+        if (result != engine->state[r])
+        {
+            engine->state[r] = (uint8_t)result;
+            RuleEvent_t* event = &engine->events[event_num++];
+            event->seq = input->seq;
+            event->timestamp_us = input->timestamp_us;
+            event->type = (uint16_t)((result) ? RULE_EVENT_RAISE : RULE_EVENT_CLEAR);
+            event->rule = (uint16_t)r;
+            event->name = set->names[r];
+        }
+    }
+    if (event_num > 0 && engine->param.event_func != NULL)
+    {
+        engine->param.event_func(engine->events, event_num, engine->param.event_arg);
+    }
+    else
+    {
+        for (int i = 0; i < event_num; i++)
+        {
+            const RuleEvent_t* event = &engine->events[i];
+            LOG(LOG_LEVEL_INFO, "rule %s %s (frame %llu)\n", event->name, \
+                (event->type == RULE_EVENT_RAISE) ? "raised" : "cleared", (unsigned long long)event->seq);
+        }
+    }
+    uint64_t eval_us = get_monotonic_us() - start_us;
+    pthread_mutex_lock(&engine->mutex);
+    engine->stats.frames++;
+    engine->stats.insns += set->code_len;
+    engine->stats.loads += loaded;
+    for (int i = 0; i < event_num; i++)
+    {
+        engine->stats.raised += (engine->events[i].type == RULE_EVENT_RAISE);
+    }
+    engine->stats.eval_max_us = (eval_us > engine->stats.eval_max_us) ? eval_us : engine->stats.eval_max_us;
+    pthread_mutex_unlock(&engine->mutex);
+    return hold_num;
+}
+
+int rule_engine_stats(RuleEngine_t* engine, RuleStats_t* stats)
+{
+    if (engine == NULL || stats == NULL)
+    {
+        return RULE_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&engine->mutex);
+    *stats = engine->stats;
+    pthread_mutex_unlock(&engine->mutex);
+    return RULE_SUCCESS;
+}
+
+const char* rule_op_name(RuleOp_t op)
+{
+    static const char* names[RULE_OP_NUM] = { "const", "roi", "window", "blob", "frame", "add", "sub", "mul", "div", \
+        "lt", "le", "gt", "ge", "eq", "ne", "and", "or", "neg", "not", "end" };
+    return (op >= 0 && op < RULE_OP_NUM) ? names[op] : "unknown";
+}
+
+void rule_set_dump(const RuleSet_t* set, FILE* fp)
+{
+    if (set == NULL || fp == NULL)
+    {
+        return;
+    }
+    for (int r = 0; r < set->rule_num; r++)
+    {
+        fprintf(fp, "rule %s (line %d)\n", set->names[r], set->line[r]);
+        for (uint32_t i = set->code_start[r]; i < set->code_start[r + 1]; i++)
+        {
+            const RuleInsn_t* insn = &set->code[i];
+            fprintf(fp, "  %4u %-6s r%d, %d, %d, %g\n", i, rule_op_name((RuleOp_t)insn->op), insn->dst, insn->a, insn->b, \
+                insn->k);
+        }
+    }
+}
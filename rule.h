@@ -0,0 +1,186 @@
+#ifndef _RULE_H_
+#define _RULE_H_
+
+//alarm rules in a small expression language, compiled at load time into a register bytecode and evaluated once
+//per frame over the statistics the frame already has (roi results, roi windows, the alarm engine's blobs, the
+//temp plane's stats), no allocation on the frame path. a rule file has one statement per line, '#' comments:
+//    roi panel3 = 2                                        name roi 2 of the analytics
+//    rule panel3_hot: roi("panel3").max_60s > 85 && blob.area > 20
+//operands: numbers (temperatures in celsius), roi("name") or roi(index) with .max/.min/.avr of the frame or
+//.max_<n>s/.min_<n>m/.avr_<n>h over a window horizon of the engine, blob.count/.area/.hot_area/.max (the largest
+//and hottest of the frame's blobs), frame.max/.min/.avr. operators by rising precedence: || && == != < <= > >=
+//+ - * / and the unary ! -. a comparison is 1 or 0, && and || take non zero as true. an input the frame does
+//not have (a roi past the analytics' count, no blobs source, no stats) is nan, it stays nan through ! and every
+//comparison with it is false. a rule raises an event on the frame it turns true and clears on the frame it turns
+//false. a new file is compiled on the loading thread and swapped in at the start of the next evaluation, the
+//stream keeps running
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <atomic>
+#include "alarm.h"
+#include "roi.h"
+#include "roiwin.h"
+#include "stats.h"
+#include "stop.h"
+
+#define RULE_MAX_RULES 256
+#define RULE_MAX_CODE 8192              //instructions of one rule set
+#define RULE_MAX_REGS 32                //registers of one rule, the expression depth it allows
+#define RULE_MAX_NAMES ROI_MAX_NUM
+#define RULE_NAME_LEN 32
+#define RULE_LINE_LEN 512
+#define RULE_ERROR_LEN 160
+#define RULE_PATH_LEN 256
+#define RULE_POLL_MS 1000               //the watcher looks at the file's mtime and size this often
+
+#define RULE_SUCCESS 0
+#define RULE_ERROR_PARAM -1
+#define RULE_ERROR_MEM -2
+#define RULE_ERROR_FILE -3
+#define RULE_ERROR_SYNTAX -4            //the error text has the line and the reason
+#define RULE_ERROR_THREAD -5
+
+typedef enum
+{
+    RULE_OP_CONST = 0,                  //dst = k
+    RULE_OP_ROI,                        //dst = roi a's stat b (RoiWindowStat_t) of the frame
+    RULE_OP_WINDOW,                     //dst = roi a's stat b & 3 over horizon b >> 2
+    RULE_OP_BLOB,                       //dst = blob field a (RuleBlobField_t)
+    RULE_OP_FRAME,                      //dst = frame field a (RoiWindowStat_t)
+    RULE_OP_ADD,                        //dst = a op b
+    RULE_OP_SUB,
+    RULE_OP_MUL,
+    RULE_OP_DIV,
+    RULE_OP_LT,
+    RULE_OP_LE,
+    RULE_OP_GT,
+    RULE_OP_GE,
+    RULE_OP_EQ,
+    RULE_OP_NE,
+    RULE_OP_AND,
+    RULE_OP_OR,
+    RULE_OP_NEG,                        //dst = op a
+    RULE_OP_NOT,
+    RULE_OP_END,                        //the rule's result is register a
+    RULE_OP_NUM
+}RuleOp_t;
+
+typedef enum
+{
+    RULE_BLOB_COUNT = 0,
+    RULE_BLOB_AREA,                     //the largest blob's pixels
+    RULE_BLOB_HOT_AREA,                 //the largest hot area
+    RULE_BLOB_MAX,                      //the hottest blob's max, celsius
+    RULE_BLOB_FIELD_NUM
+}RuleBlobField_t;
+
+typedef enum
+{
+    RULE_EVENT_RAISE = 1,
+    RULE_EVENT_CLEAR,
+}RuleEventType_t;
+
+//8 bytes, a rule set's code is one array
+typedef struct {
+    uint8_t op;                         //RuleOp_t
+    uint8_t dst;
+    uint8_t a;
+    uint8_t b;
+    float k;
+}RuleInsn_t;
+
+//one compiled file, read only once published
+typedef struct {
+    int rule_num;
+    int code_len;
+    uint32_t code_start[RULE_MAX_RULES + 1];    //rule i's code is [code_start[i], code_start[i + 1])
+    uint16_t line[RULE_MAX_RULES];      //of the file, for the prints
+    char names[RULE_MAX_RULES][RULE_NAME_LEN];
+    RuleInsn_t code[RULE_MAX_CODE];
+}RuleSet_t;
+
+//what one evaluation reads, any member may be NULL
+typedef struct {
+    uint64_t seq;
+    uint64_t timestamp_us;
+    const TempInfo_t* roi;              //roi results of the frame, raw values
+    int roi_num;
+    const RoiWindows_t* windows;        //the horizons the rule set was compiled against
+    const AlarmBlobSummary_t* blobs;    //alarm_engine_blob_summary
+    const FrameStats_t* frame;          //the temp plane's stats
+}RuleInput_t;
+
+typedef struct {
+    uint64_t seq;
+    uint64_t timestamp_us;
+    uint16_t type;                      //RuleEventType_t
+    uint16_t rule;
+    const char* name;                   //valid during the callback
+}RuleEvent_t;
+
+//called on the evaluating thread with the events of one frame
+typedef void (*RuleEventFunc_t)(const RuleEvent_t* events, int event_num, void* arg);
+
+typedef struct {
+    uint32_t horizon_ms[ROI_WINDOW_MAX];    //the window horizons .max_60s and the like may name, the analytics' ones
+    int horizon_num;
+    RuleEventFunc_t event_func;         //NULL prints the events
+    void* event_arg;
+}RuleParam_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t insns;                     //instructions run
+    uint64_t raised;
+    uint64_t loads;                     //rule sets swapped in
+    uint64_t load_errors;
+    uint64_t eval_max_us;               //the slowest evaluation
+}RuleStats_t;
+
+typedef struct {
+    RuleParam_t param;
+    RuleSet_t* current;                 //the evaluating thread's
+    std::atomic<RuleSet_t*> pending;    //loaded, swapped in by the next evaluation
+    std::atomic<RuleSet_t*> retired;    //swapped out, freed by the next load
+    uint8_t state[RULE_MAX_RULES];      //result of every rule on the last frame
+    RuleEvent_t events[RULE_MAX_RULES];
+    float regs[RULE_MAX_REGS];
+    RuleStats_t stats;
+    pthread_mutex_t mutex;              //loads and stats
+    //rule_engine_watch
+    char path[RULE_PATH_LEN];
+    StopToken_t stop;
+    pthread_t thread;
+    uint8_t watching;
+}RuleEngine_t;
+
+//compile text (the lines of a rule file) into set against param's horizons. error gets the line and the reason
+int rule_set_compile(const char* text, const RuleParam_t* param, RuleSet_t* set, char* error, int error_len);
+
+int rule_engine_init(RuleEngine_t* engine, const RuleParam_t* param);
+
+//stops the watcher, after the last evaluation
+void rule_engine_release(RuleEngine_t* engine);
+
+//rule_set_compile into a new set, nothing changes when a line fails. any thread, the next evaluation switches
+//to the set
+int rule_engine_load_text(RuleEngine_t* engine, const char* text, char* error, int error_len);
+
+int rule_engine_load(RuleEngine_t* engine, const char* path, char* error, int error_len);
+
+//load path, then again whenever its mtime or size changes, polled every RULE_POLL_MS on a thread of its own. a
+//file that fails to compile is reported and the rules before stay
+int rule_engine_watch(RuleEngine_t* engine, const char* path);
+
+//every rule over input, the events of the rules that turned go to event_func. returns how many rules hold
+int rule_engine_eval(RuleEngine_t* engine, const RuleInput_t* input);
+
+int rule_engine_stats(RuleEngine_t* engine, RuleStats_t* stats);
+
+//the instructions of a set, one per line
+void rule_set_dump(const RuleSet_t* set, FILE* fp);
+
+const char* rule_op_name(RuleOp_t op);
+
+#endif
@@ -2,91 +2,441 @@
 
 int frame_idx = 0;
 
-//load the stream frame info
-void load_stream_frame_info(StreamFrameInfo_t* stream_frame_info)
+//load the stream frame info from the runtime settings, -1 when the display has no conversion for the image format
+int load_stream_frame_info(StreamFrameInfo_t* stream_frame_info, const Conf_t* conf)
 {
-#if defined(IMAGE_AND_TEMP_OUTPUT)
+    //image_and_temp: the image half and the temp half share the frame, the other modes stream one plane
+    uint8_t both = (conf->stream_mode == IR_STREAM_IMAGE_AND_TEMP);
+    stream_frame_info->image_info.width = stream_frame_info->camera_param.width;
+    stream_frame_info->image_info.height = both ? stream_frame_info->camera_param.height / 2 : \
+        stream_frame_info->camera_param.height;
+    stream_frame_info->image_info.rotate_side = (RotateSide_t)conf->display.rotate;
+    stream_frame_info->image_info.mirror_flip_status = (MirrorFlipStatus_t)conf->display.mirror_flip;
+    stream_frame_info->image_info.pseudo_color_status = (PseudoColor_t)conf->display.pseudo_color;
+    stream_frame_info->image_info.img_enhance_status = (ImgEnhance_t)conf->display.enhance;
+    stream_frame_info->image_info.input_format = INPUT_FMT_Y16;           // 使用Y16格式支持伪彩色
+    stream_frame_info->image_info.output_format = (OutputFormat_t)conf->output_format;  // if display on opencv,please select BGR888
+    stream_frame_info->image_byte_size = stream_frame_info->image_info.width * stream_frame_info->image_info.height * 2;
+    stream_frame_info->temp_byte_size = 0;
+    stream_frame_info->ring_depth = conf->ring_depth;
+    if (both)
     {
-        stream_frame_info->image_info.width = stream_frame_info->camera_param.width;
-        stream_frame_info->image_info.height = stream_frame_info->camera_param.height/2;
-        stream_frame_info->image_info.rotate_side = NO_ROTATE;
-        stream_frame_info->image_info.mirror_flip_status = STATUS_NO_MIRROR_FLIP;
-        stream_frame_info->image_info.pseudo_color_status = PSEUDO_COLOR_ON;  // 启用伪彩色
-        stream_frame_info->image_info.img_enhance_status = IMG_ENHANCE_ON;    // 启用图像增强
-        stream_frame_info->image_info.input_format = INPUT_FMT_Y16;           // 使用Y16格式支持伪彩色
-        stream_frame_info->image_info.output_format = OUTPUT_FMT_BGR888;      // if display on opencv,please select BGR888
-
         stream_frame_info->temp_info.width = stream_frame_info->camera_param.width;
         stream_frame_info->temp_info.height = stream_frame_info->camera_param.height/2;
         stream_frame_info->temp_info.rotate_side = NO_ROTATE;
         stream_frame_info->temp_info.mirror_flip_status = STATUS_NO_MIRROR_FLIP;
-        stream_frame_info->image_byte_size = stream_frame_info->image_info.width * stream_frame_info->image_info.height*2;
-        stream_frame_info->temp_byte_size = stream_frame_info->temp_info.width * stream_frame_info->temp_info.height * 2;  //no temp frame input
+        stream_frame_info->temp_byte_size = stream_frame_info->temp_info.width * stream_frame_info->temp_info.height * 2;
+        stream_frame_info->zero_copy = 1;   //image/temp frames are views into the raw frame
+    }
+    if (both && conf->info_lines)
+    {
+        //frame counter and vtemp come with every frame, the halves lose a line each
+        stream_frame_info->image_info.height = (stream_frame_info->camera_param.height - 2) / 2;
+        stream_frame_info->temp_info.height = stream_frame_info->image_info.height;
+        stream_frame_info->image_byte_size = stream_frame_info->image_info.width * stream_frame_info->image_info.height * 2;
+        stream_frame_info->temp_byte_size = stream_frame_info->temp_info.width * stream_frame_info->temp_info.height * 2;
+        stream_frame_info->info_byte_size = stream_frame_info->camera_param.width * 2;
+    }
+    if (both && conf->y8_preview > 0)
+    {
+        //half the image bytes through the ring and its consumers, the temp plane at a reduced rate
+        stream_frame_info->image_info.input_format = INPUT_FMT_Y8;
+        stream_frame_info->image_info.img_enhance_status = IMG_ENHANCE_OFF;
+        stream_frame_info->image_byte_size = stream_frame_info->image_info.width * stream_frame_info->image_info.height;
+        stream_frame_info->temp_interval = conf->y8_preview;
+        stream_frame_info->zero_copy = 0;
     }
-#elif defined(IMAGE_OUTPUT)
-    stream_frame_info->image_info.width = stream_frame_info->camera_param.width;
-    stream_frame_info->image_info.height = stream_frame_info->camera_param.height;
-    stream_frame_info->image_info.rotate_side = NO_ROTATE;
-    stream_frame_info->image_info.mirror_flip_status = STATUS_NO_MIRROR_FLIP;
-    stream_frame_info->image_info.pseudo_color_status = PSEUDO_COLOR_ON;  // 启用伪彩色
-    stream_frame_info->image_info.img_enhance_status = IMG_ENHANCE_ON;    // 启用图像增强
-    stream_frame_info->image_info.input_format = INPUT_FMT_Y16;           // 使用Y16格式支持伪彩色
-    stream_frame_info->image_info.output_format = OUTPUT_FMT_BGR888;      // if display on opencv,please select BGR888
-
-    stream_frame_info->image_byte_size = stream_frame_info->image_info.width * stream_frame_info->image_info.height * 2;
-    stream_frame_info->temp_byte_size = 0;
 
-#elif defined(TEMP_OUTPUT)
-    stream_frame_info->image_info.width = stream_frame_info->camera_param.width;
-    stream_frame_info->image_info.height = stream_frame_info->camera_param.height;
-    stream_frame_info->image_info.rotate_side = NO_ROTATE;
-    stream_frame_info->image_info.mirror_flip_status = STATUS_NO_MIRROR_FLIP;
-    stream_frame_info->image_info.pseudo_color_status = PSEUDO_COLOR_ON;  // 启用伪彩色
-    stream_frame_info->image_info.img_enhance_status = IMG_ENHANCE_ON;    // 启用图像增强
-    stream_frame_info->image_info.input_format = INPUT_FMT_Y16;           // 使用Y16格式支持伪彩色
-    stream_frame_info->image_info.output_format = OUTPUT_FMT_BGR888;      // if display on opencv,please select BGR888
+#if defined(FRAME_POOL)
+    static FramePoolParam_t frame_pool_param;
+    frame_pool_default_param(&frame_pool_param);
+    frame_pool_param.numa_node = FRAME_POOL_NUMA_NODE;
+    stream_frame_info->frame_pool_param = &frame_pool_param;
+#endif
 
-    stream_frame_info->image_byte_size = stream_frame_info->image_info.width * stream_frame_info->image_info.height * 2;
-    stream_frame_info->temp_byte_size = 0;
+    //the display's variant is fixed by these settings, a combination without one is refused here
+    if (display_pipeline_select(&stream_frame_info->image_info) == NULL)
+    {
+        printf("image format %d -> %d is not supported\n", stream_frame_info->image_info.input_format, \
+            stream_frame_info->image_info.output_format);
+        return -1;
+    }
+    return create_data_demo(stream_frame_info);
+}
+//the compile time choices of sample.h as the defaults a config file changes
+static void sample_conf_default(Conf_t* conf)
+{
+#if defined(DISPLAY_SINK)
+    display_sink_param.type = DISPLAY_SINK;
+    snprintf(display_sink_param.path, sizeof(display_sink_param.path), "%s", DISPLAY_SINK_PATH);
+#endif
+    conf_default(conf);
+#if defined(USER_FUNCTION_CALLBACK) && defined(CALLBACK_HANDOFF)
+    conf->run_mode = CONF_RUN_HANDOFF;
+#elif defined(USER_FUNCTION_CALLBACK)
+    conf->run_mode = CONF_RUN_CALLBACK;
+#endif
+#if defined(DISPLAY_PACING)
+    conf->ring_depth = FRAME_RING_DEFAULT_DEPTH + DISPLAY_PACING;
 #endif
+#if defined(AC020_INFO_LINES)
+    conf->info_lines = 1;
+#endif
+#if defined(Y8_PREVIEW)
+    conf->y8_preview = Y8_PREVIEW;
+#endif
+#if defined(DISPLAY_WINDOWS)
+    //e.g. two breaker panels of a 256x192 image
+    Area_t windows[2] = { { 16, 24, 64, 48 }, { 160, 96, 72, 64 } };
+    memcpy(conf->windows.rects, windows, sizeof(windows));
+    conf->windows.num = 2;
+    conf->window_refresh = DISPLAY_WINDOWS;
+#endif
+#if defined(DISPLAY_ISOTHERM)
+    //e.g. skin temperature in green, overheating in red
+    DisplayIsotherm_t bands[2] = { { 33.0f, 37.5f, { 0, 200, 0 } }, { 60.0f, 1000.0f, { 255, 0, 0 } } };
+    memcpy(conf->isotherms.bands, bands, sizeof(bands));
+    conf->isotherms.num = 2;
+#endif
+}
+
+//the config file over the defaults, written with every key and its value when there is none yet
+static void sample_conf_load(const char* path, Conf_t* conf)
+{
+    sample_conf_default(conf);
+    char error[CONF_ERROR_LEN];
+    int rst = conf_load(path, conf, error, sizeof(error));
+    if (rst == CONF_ERROR_FILE)
+    {
+        FILE* fp = fopen(path, "w");
+        if (fp != NULL)
+        {
+            conf_schema_write(fp, conf);
+            fclose(fp);
+            printf("conf: wrote the defaults into %s\n", path);
+        }
+    }
+    else if (rst != CONF_SUCCESS)
+    {
+        printf("conf: %s, the defaults are used\n", error);
+    }
+}
 
+//the threads of one run leave with it: the cmd thread and the waits of main, stop.h
+static StopToken_t sample_stop;
 
+//stream format changes reopen the stream: the stream thread leaves, main goes round again
+static void sample_conf_restart(const Conf_t* conf, void* arg)
+{
+    stop_request(&sample_stop);
+    if (arg != NULL)
+    {
+        ir_camera_stream_stop((StreamFrameInfo_t*)arg);
+    }
+}
+
+//the stream thread restarts its uvc stream in the new mode, the ones it cannot switch to reopen the stream
+static int sample_conf_mode(int stream_mode, void* arg)
+{
+    return ir_camera_stream_mode_switch((StreamFrameInfo_t*)arg, (IrStreamMode_t)stream_mode);
+}
 
-    create_data_demo(stream_frame_info);
+//the callback modes run until enter, or until a config change asks for a restart
+static void sample_wait_enter(void)
+{
+    while (!conf_restart_pending())
+    {
+        int ready = cmd_stdin_wait(&sample_stop, CMD_POLL_MS);
+        if (ready < 0)
+        {
+            return;
+        }
+        if (ready > 0)
+        {
+            getchar();
+            return;
+        }
+    }
 }
+
+//the vendor libraries and LOG together: ERROR_PRINT keeps their errors and the sample's own reports
 void log_level_register(log_level_t log_level)
 {
     switch(log_level)
     {
         case(DEBUG_PRINT):
         {
-            iruvc_log_register(IRUVC_LOG_DEBUG);
-            irtemp_log_register(IRTEMP_LOG_DEBUG);
-            irproc_log_register(IRPROC_LOG_DEBUG);
-            irparse_log_register(IRPARSE_LOG_DEBUG);
+            log_level_set(LOG_LEVEL_DEBUG);
             break;
         }
         case(ERROR_PRINT):
         {
-            iruvc_log_register(IRUVC_LOG_ERROR);
-            irtemp_log_register(IRTEMP_LOG_ERROR);
-            irproc_log_register(IRPROC_LOG_ERROR);
-            irparse_log_register(IRPARSE_LOG_ERROR);
+            log_level_set(LOG_LEVEL_INFO);
             break;
         }
         case(NO_PRINT):
         default:
         {
-            iruvc_log_register(IRUVC_LOG_NO_PRINT);
-            irtemp_log_register(IRTEMP_LOG_NO_PRINT);
-            irproc_log_register(IRPROC_LOG_NO_PRINT);
-            irparse_log_register(IRPARSE_LOG_NO_PRINT);
+            log_level_set(LOG_LEVEL_OFF);
             break;
         }
     }
 
 }
 
+#if defined(ENCODE_STREAM)
+//the annex-b packets back to back are a raw h264 file, ffplay/vlc play it as it is
+static void encode_stream_write(const uint8_t* data, uint32_t size, uint64_t timestamp_us, int key, void* arg)
+{
+    fwrite(data, 1, size, (FILE*)arg);
+}
+#endif
+
+#if defined(FEVER_SCREENING)
+//one line per verdict, the readings in between only go to the log of a real gate
+static void screen_reading_print(const ScreenReading_t* readings, int reading_num, void* arg)
+{
+    for (int i = 0; i < reading_num; i++)
+    {
+        const ScreenReading_t* reading = &readings[i];
+        if (reading->decided)
+        {
+            printf("screen %s: person %d %.2f C (peak %.2f, offset %+.2f%s) at (%d,%d), latency %u us\n", \
+                screen_verdict_name((ScreenVerdict_t)reading->verdict), reading->track_id, reading->celsius, \
+                reading->peak_celsius, reading->offset_celsius, reading->referenced ? "" : ", no blackbody", \
+                reading->hot_x, reading->hot_y, reading->latency_us);
+        }
+    }
+}
+#endif
+
+#if defined(BLOB_TRACKING)
+static void tracker_print(const TrackerTrack_t* tracks, int track_num, uint64_t seq, void* arg)
+{
+    TrackerEngine_t* engine = (TrackerEngine_t*)arg;
+    for (int i = 0; i < track_num; i++)
+    {
+        if (tracks[i].dwell_alarm)
+        {
+            printf("tracker: object %d stayed %llu s at (%.0f,%.0f)\n", tracks[i].id, \
+                (unsigned long long)((tracks[i].last_us - tracks[i].first_us) / 1000000), tracks[i].x, tracks[i].y);
+        }
+    }
+    if (seq % 250 == 0)
+    {
+        printf("tracker: %d tracked, %llu counted\n", track_num, (unsigned long long)engine->tracker.stats.confirmed);
+    }
+}
+#endif
+
+#if defined(OBJECT_DETECTION)
+static void infer_result_print(const InferResult_t* results, int result_num, void* arg)
+{
+    for (int i = 0; i < result_num; i++)
+    {
+        const InferResult_t* result = &results[i];
+        for (int j = 0; j < result->detection_num; j++)
+        {
+            const InferDetection_t* detection = &result->detections[j];
+            printf("infer: frame %llu class %d score %.2f box (%.0f,%.0f)-(%.0f,%.0f), latency %u us\n", \
+                (unsigned long long)result->seq, detection->class_id, detection->score, \
+                detection->x0, detection->y0, detection->x1, detection->y1, result->latency_us);
+        }
+    }
+}
+#endif
+
+#if defined(WEB_DASHBOARD)
+static Web_t web_dashboard;
+#endif
+#if defined(MQTT_PUBLISHER)
+static Mqtt_t mqtt_publisher;
+#endif
+#if defined(CONTROL_SERVER)
+static Control_t control_server;
+#endif
+#if defined(CMD_BROKER)
+static CmdBroker_t cmd_broker;
+#endif
+#if defined(BLACK_BOX)
+static BlackBox_t black_box;
+#endif
+
+#if defined(ALARM_ENGINE)
+#if defined(EVENT_CLIP)
+static Clip_t event_clip;
+#endif
+#if defined(ALARM_SNAPSHOT)
+static Snapshot_t alarm_snapshot;
+#endif
+#if defined(ALARM_BURST)
+static Burst_t alarm_burst;
+
+//the raw frames back to back as they came, np.fromfile(path, np.uint16).reshape(frames, -1) in numpy
+static void alarm_burst_save(const BurstBlock_t* block, void* arg)
+{
+    static int burst_cnt = 0;
+    char path[64];
+    snprintf(path, sizeof(path), "burst_%d.raw", burst_cnt++);
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < block->frames; i++)
+    {
+        fwrite(block->data + (size_t)i * block->frame_stride, 1, block->frame_size, fp);
+    }
+    fclose(fp);
+    uint64_t span_us = (block->frames > 1) ? block->timestamps_us[block->frames - 1] - block->timestamps_us[0] : 0;
+    printf("burst: %u frames of %u bytes in %llu us into %s, %u timeouts\n", block->frames, block->frame_size, \
+        (unsigned long long)span_us, path, block->timeouts);
+}
+#endif
+
+static void alarm_event_print(const AlarmEvent_t* events, int event_num, void* arg)
+{
+    for (int i = 0; i < event_num; i++)
+    {
+        const AlarmEvent_t* event = &events[i];
+        printf("alarm %s: track %d max=%f at (%d,%d), box (%d,%d)-(%d,%d), %u pixels, latency %u us\n", \
+            alarm_event_name((AlarmEventType_t)event->type), event->track_id, temp_value_converter(event->max_temp), \
+            event->max_x, event->max_y, event->x0, event->y0, event->x1, event->y1, event->area, event->latency_us);
+#if defined(BLACK_BOX)
+        blackbox_alarm(&black_box, event);
+#endif
+#if defined(EVENT_CLIP)
+        //an alarm raised while a clip is being written extends it
+        if (event->type == ALARM_EVENT_RAISE)
+        {
+            char clip_path[CLIP_PATH_LEN];
+            snprintf(clip_path, sizeof(clip_path), "clip_%d.irr", event->track_id);
+            clip_trigger(&event_clip, clip_path);
+        }
+#endif
+#if defined(ALARM_BURST)
+        //an alarm raised while a burst runs or is saved gets none
+        if (event->type == ALARM_EVENT_RAISE)
+        {
+            burst_trigger(&alarm_burst);
+        }
+#endif
+#if defined(ALARM_SNAPSHOT)
+        if (event->type == ALARM_EVENT_RAISE)
+        {
+            char snapshot_path[SNAPSHOT_PATH_LEN];
+            snprintf(snapshot_path, sizeof(snapshot_path), "alarm_%d.jpg", event->track_id);
+            snapshot_request(&alarm_snapshot, snapshot_path, SNAPSHOT_FORMAT_JPEG);
+        }
+#endif
+#if defined(LOW_POWER_IDLE)
+        static int raised = 0;
+        StreamFrameInfo_t* stream_frame_info = (StreamFrameInfo_t*)arg;
+        if (event->type == ALARM_EVENT_RAISE && raised++ == 0)
+        {
+            ir_camera_fps_set(stream_frame_info, stream_frame_info->camera_param.fps);
+        }
+        else if (event->type == ALARM_EVENT_CLEAR && raised > 0 && --raised == 0)
+        {
+            ir_camera_fps_set(stream_frame_info, IR_CAMERA_FPS_LOW);
+        }
+#endif
+    }
+#if defined(WEB_DASHBOARD)
+    web_alarm_events(events, event_num, &web_dashboard);
+#endif
+#if defined(MQTT_PUBLISHER)
+    mqtt_alarm_events(events, event_num, &mqtt_publisher);
+#endif
+}
+#endif
+
+#if defined(RATE_ALARM)
+//the events' temperatures are rises in raw units per second
+static void rate_event_print(const AlarmEvent_t* events, int event_num, void* arg)
+{
+    for (int i = 0; i < event_num; i++)
+    {
+        const AlarmEvent_t* event = &events[i];
+        printf("rate alarm %s: track %d rising %.2f K/s at (%d,%d), box (%d,%d)-(%d,%d), %u pixels\n", \
+            alarm_event_name((AlarmEventType_t)event->type), event->track_id, \
+            (float)event->max_temp / (1 << TEMP_RAW_SHIFT), event->max_x, event->max_y, event->x0, event->y0, \
+            event->x1, event->y1, event->area);
+    }
+}
+#endif
+
+#if defined(ANOMALY_DETECT)
+//the events' temperatures are background scores, squared sigmas in Q4
+static void anomaly_event_print(const AlarmEvent_t* events, int event_num, void* arg)
+{
+    for (int i = 0; i < event_num; i++)
+    {
+        const AlarmEvent_t* event = &events[i];
+        printf("anomaly %s: track %d %.1f sigma at (%d,%d), box (%d,%d)-(%d,%d), %u pixels\n", \
+            alarm_event_name((AlarmEventType_t)event->type), event->track_id, sqrtf((float)event->max_temp / 16), \
+            event->max_x, event->max_y, event->x0, event->y0, event->x1, event->y1, event->area);
+    }
+}
+#endif
+
+#if defined(MULTI_POINT_CALIB)
+//the setpoints and fixture of multi_point_calibration, the output temperatures are measured instead of fixed
+static void* mpcal_function(void* arg)
+{
+    MpCal_t* cal = (MpCal_t*)arg;
+    for (uint32_t i = 0; i < cal->param.point_num; i++)
+    {
+        printf("mpcal: waiting for setpoint %u (%.1f) in %s\n", i, cal->param.points[i].setting_temp, MPCAL_STEP_PATH);
+        while (mpcal_step_wait(MPCAL_STEP_PATH, (int)i, 1000) == MPCAL_TIMEOUT)
+        {
+            if (!cal->stream_frame_info->is_streaming)
+            {
+                return NULL;
+            }
+        }
+        if (mpcal_capture(cal, (int)i, 60 * 1000) != MPCAL_SUCCESS)
+        {
+            printf("mpcal: setpoint %u capture failed\n", i);
+            return NULL;
+        }
+    }
+    int rst = mpcal_compute_all(&cal, 1, 60 * 1000);
+    mpcal_print(cal);
+    printf("mpcal: %s\n", (rst == 1) ? (MPCAL_WRITE_BACK ? "tables written" : "done") : "failed");
+    return NULL;
+}
+#endif
+
+#if defined(HOST_DPC)
+static BadPix_t badpix;
+static Accum_t badpix_accum;
+
+//image plane noise of 64 frames at a time, pixels gone bad are corrected from the next frame on
+static void* badpix_function(void* arg)
+{
+    StreamFrameInfo_t* stream_frame_info = (StreamFrameInfo_t*)arg;
+    while (stream_frame_info->is_streaming)
+    {
+        accum_start(&badpix_accum, 64);
+        while (accum_wait(&badpix_accum, 1000) < 64)
+        {
+            if (!stream_frame_info->is_streaming)
+            {
+                return NULL;
+            }
+        }
+        int num = badpix_detect(&badpix, &badpix_accum, NULL);
+        if (num > 0)
+        {
+            printf("badpix: %d new bad pixels\n", num);
+            badpix_save(&badpix, BADPIX_MAP_PATH);
+        }
+    }
+    return NULL;
+}
+#endif
+
 void print_and_record_version(void)
 {
     puts(IR_SAMPLE_VERSION);
@@ -121,6 +471,10 @@ void usr_test_func(void* frame, void* usr_param)
         return;
     }
 
+    if (frame != NULL)
+    {
+        cmdq_frame_mark(get_monotonic_us());
+    }
     if ((frame != NULL) && (stream_frame_info->raw_frame != NULL))
     {
         memcpy(stream_frame_info->raw_frame, frame, stream_frame_info->camera_param.frame_size);
@@ -128,110 +482,984 @@ void usr_test_func(void* frame, void* usr_param)
 
     if (stream_frame_info->raw_frame != NULL)
     {
-        raw_data_cut((uint8_t*)stream_frame_info->raw_frame, stream_frame_info->image_byte_size, \
-            stream_frame_info->temp_byte_size, (uint8_t*)stream_frame_info->image_frame, \
-            (uint8_t*)stream_frame_info->temp_frame);
+        //zero-copy frames already point into raw_frame
+        if (!stream_frame_info->zero_copy)
+        {
+            raw_data_cut((uint8_t*)stream_frame_info->raw_frame, stream_frame_info->image_byte_size, \
+                stream_frame_info->temp_byte_size, (uint8_t*)stream_frame_info->image_frame, \
+                (uint8_t*)stream_frame_info->temp_frame);
+        }
         display_one_frame(stream_frame_info);
     }
 
     //printf("test_func:%d\n", ((unsigned short*)frame)[10]);
-    printf("frame_idx:%d\n", frame_idx);
+    LOG_RATE(LOG_LEVEL_INFO, 1000, "frame_idx:%d\n", frame_idx);
     frame_idx++;
 }
 
 
-int main(void)
+//sample -i <index> -n <num>: the index-th of num identical modules on this host, default 0 of 1
+int main(int argc, char* argv[])
 {
-    //set priority to highest level
-#if defined(_WIN32)
-    SetPriorityClass(GetCurrentProcess(), HIGH_PRIORITY_CLASS);
-#elif defined(linux) || defined(unix)
-    setpriority(PRIO_PROCESS, 0, -20);
+    int camera_index = 0;
+    int camera_num = 1;
+    const char* conf_path = CONF_PATH;
+    for (int arg = 1; arg + 1 < argc; arg += 2)
+    {
+        if (strcmp(argv[arg], "-i") == 0)
+        {
+            camera_index = atoi(argv[arg + 1]);
+        }
+        else if (strcmp(argv[arg], "-n") == 0)
+        {
+            camera_num = atoi(argv[arg + 1]);
+        }
+        else if (strcmp(argv[arg], "-c") == 0)
+        {
+            conf_path = argv[arg + 1];
+        }
+    }
+
+#if defined(PALETTE_DIR)
+    display_palette_dir = PALETTE_DIR;
+#endif
+#if defined(DISPLAY_GPU)
+    display_gpu_enabled = 1;
+#endif
+#if defined(DISPLAY_TILE_REUSE)
+    display_tile_reuse = 1;
+#endif
+#if defined(LOCKED_SPAN)
+    TempSpanParam_t span_param = { LOCKED_SPAN, 0, NULL };
+    if (temp_span_lock(&span_param) != TEMP_SPAN_SUCCESS)
+    {
+        printf("locked span: invalid range\n");
+    }
 #endif
 
     //version
     print_and_record_version();
     log_level_register(ERROR_PRINT);
+    log_start(NULL);    //per frame reports are formatted and written by the log thread
+#if defined(MEMORY_BUDGET_MB)
+    mem_acct_budget_set(MEMORY_BUDGET_MB * 1048576ull);
+#endif
+#if defined(FAST_REOPEN)
+    ir_camera_fast_reopen_set(1);
+#endif
+#if defined(USB_PLAN)
+    ir_camera_usb_plan_set(1);
+#endif
+#if defined(AUTO_RECONNECT)
+    IrReconnectParam_t reconnect_param = { 0 };
+    reconnect_param.enable = 1;
+    ir_camera_reconnect_set(&reconnect_param);
+#endif
 #if defined(LOOP_TEST)
     for (int i = 0;i < 100;i++)
     {
+#else
+    //a config change of the stream format comes back here with the new settings
+    do
+    {
 #endif
         int rst;
         StreamFrameInfo_t stream_frame_info = { 0 };
+        Conf_t conf;
+        sample_conf_load(conf_path, &conf);
+        stop_token_init(&sample_stop);
+        //every thread takes the policy and the cpus of its role as it starts, rtsched.h
+        rt_init(&conf.rt);
+        ir_camera_stream_mode_set((IrStreamMode_t)conf.stream_mode);
+        display_sink_param.type = (DisplaySinkType_t)conf.display_sink;
+        snprintf(display_sink_param.path, sizeof(display_sink_param.path), "%s", conf.display_sink_path);
+        //the display picks the live part up with its first frame
+        conf_apply_live(&conf);
 
-        rst = ir_camera_open(&stream_frame_info.camera_param);
+        stream_frame_info.camera_index = camera_index;
+#if defined(DISPLAY_PACING)
+        display_pacing_depth = DISPLAY_PACING;
+#endif
+#if defined(FRAME_SOURCE)
+        //the pipeline runs unchanged, only the raw frames come from the file or the generator
+        static FrameSource_t frame_source;
+        FrameSourceParam_t source_param = { FRAME_SOURCE };
+        strcpy(source_param.path, FRAME_SOURCE_PATH);
+        source_param.paced = FRAME_SOURCE_PACED;
+        if (frame_source_open(&frame_source, &source_param) != SOURCE_SUCCESS)
+        {
+            puts("frame source open failed!\n");
+            getchar();
+            return 0;
+        }
+        frame_source_camera_param(&frame_source, &stream_frame_info.camera_param);
+        stream_frame_info.frame_source = &frame_source;
+        cmdq_init();
+#else
+        rst = ir_camera_open_same(&stream_frame_info.camera_param, camera_index, camera_num);
         if (rst < 0)
         {
             puts("ir camera open failed!\n");
             getchar();
             return 0;
         }
-        vdcmd_set_polling_wait_time(10000);
+        cmd_batch_poll_default(CMD_BATCH_POLL_MS);
         command_init();
+        calib_cache_load(get_temp_cal_info());  //nuc-t/kt/bt from calib_<sn>_<gain>.bin, spi only when it is missing or stale
+        calib_cache_load_gains();               //both gains' nuc-t and tau tables resident for gain switches
+        cmdq_init();    //vendor commands from now on run one at a time between frames
+#if defined(USB_TRANSFER_DEPTH)
+        UsbXferParam_t usb_xfer_param = { 0 };
+        usb_xfer_param.depth = USB_TRANSFER_DEPTH;
+        usb_xfer_param.iso_packets = USB_TRANSFER_ISO_PACKETS;
+        usb_xfer_param_set(camera_index, &usb_xfer_param);
+#endif
+#endif
 
 #ifdef UPDATE_FW
         log_level_register(DEBUG_PRINT);
-        FILE* fp = NULL;
-        uint8_t firmware_data[256 * 1024] = { 0 };
-        fp=fopen("AC010_FW_new.bin", "rb");
-        fread(firmware_data, 1, sizeof(firmware_data), fp);
-        fclose(fp);
-        update_fw(firmware_data,sizeof(firmware_data));
+        update_fw_cmd("AC010_FW_new.bin");
         uvc_camera_close(); 
-        puts("firmware updated");
         getchar();
         return 0;
 #endif
 
-        load_stream_frame_info(&stream_frame_info);
-
-//user function callback mode
-#ifdef USER_FUNCTION_CALLBACK
-        display_init(&stream_frame_info);
-        rst = ir_camera_stream_on_with_callback(&stream_frame_info, usr_test_func);
-
-        //if (rst < 0)
-        //{
-        //    puts("ir camera stream on failed!\n");
-        //    getchar();
-        //    return 0;
-        //}
-        puts("ir camera stream on!\n");
-        getchar();
-        //Sleep(10000);
-        //while (1);
-        ir_camera_stream_off_with_callback(&stream_frame_info);
-        display_release();
-
-//multiple thread function mode
-#else
-        rst = ir_camera_stream_on(&stream_frame_info);
-        if (rst < 0)
+        if (load_stream_frame_info(&stream_frame_info, &conf) != 0)
         {
-            puts("ir camera stream on failed!\n");
+            puts("load stream frame info failed!\n");
             getchar();
             return 0;
         }
+#if defined(AUTO_GAIN_SWITCH)
+        static GainCtrl_t gain_ctrl;
+        gain_ctrl_init(&gain_ctrl, NULL, stream_frame_info.camera_param.fps);
+        gain_ctrl.calib = stream_frame_info.calib;
+        stream_frame_info.gain_ctrl = &gain_ctrl;
+#endif
+#if defined(HDR_FUSION) && !defined(AUTO_GAIN_SWITCH)
+        static Hdr_t hdr;
+        if (hdr_init(&hdr, NULL, stream_frame_info.temp_info.width, stream_frame_info.temp_info.height) == HDR_SUCCESS)
+        {
+            hdr.calib = stream_frame_info.calib;
+            stream_frame_info.hdr = &hdr;
+        }
+#endif
+#if defined(OVEREXPOSURE_GUARD)
+        static ExposureGuard_t exposure_guard;
+        exposure_guard_init(&exposure_guard, NULL, stream_frame_info.camera_param.fps, stream_frame_info.gain_ctrl);
+        stream_frame_info.exposure_guard = &exposure_guard;
+#endif
+#if defined(SHUTTER_MONITOR)
+        static ShutterMon_t shutter_mon;
+        shutter_mon_init(&shutter_mon, NULL);
+        stream_frame_info.shutter_mon = &shutter_mon;
+#endif
+#if defined(LATENCY_PROBE)
+        static LatencyProbe_t latency_probe;
+        latency_probe_init(&latency_probe, NULL);
+        stream_frame_info.latency_probe = &latency_probe;
+#endif
+#if defined(SENSOR_HOUSEKEEP)
+        static Housekeep_t housekeep;
+        housekeep_init(&housekeep, NULL);
+        stream_frame_info.housekeep = &housekeep;
+#endif
+#if defined(HOST_DPC)
+        if (badpix_init(&badpix, stream_frame_info.image_info.width, stream_frame_info.image_info.height, \
+            BADPIX_PLANE_IMAGE | BADPIX_PLANE_TEMP) == BADPIX_SUCCESS)
+        {
+            printf("badpix: %d pixels from %s\n", badpix_load(&badpix, BADPIX_MAP_PATH), BADPIX_MAP_PATH);
+            stream_frame_info.badpix = &badpix;
+        }
+#endif
 
-        pthread_t tid_stream, tid_display, tid_temperature, tid_cmd;
+        if (conf.run_mode == CONF_RUN_HANDOFF)
+        {
+            pthread_t tid_display, tid_temperature;
+            rst = ir_camera_stream_on_with_handoff(&stream_frame_info);
+            if (rst < 0)
+            {
+                puts("ir camera stream on failed!\n");
+                getchar();
+                return 0;
+            }
+            pthread_create(&tid_temperature, NULL, temperature_function, &stream_frame_info);
+            pthread_create(&tid_display, NULL, display_function, &stream_frame_info);
+            puts("ir camera stream on!\n");
+            conf_watch_start(conf_path, &conf, sample_conf_restart, NULL);
+            sample_wait_enter();
+            stop_request(&sample_stop);
+            conf_watch_stop();
+            ir_camera_stream_off_with_handoff(&stream_frame_info);
+            pthread_join(tid_display, NULL);
+            pthread_join(tid_temperature, NULL);
+        }
+        //user function callback mode
+        else if (conf.run_mode == CONF_RUN_CALLBACK)
+        {
+            display_init(&stream_frame_info);
+            rst = ir_camera_stream_on_with_callback(&stream_frame_info, (void*)usr_test_func);
 
-        pthread_create(&tid_temperature, NULL, temperature_function, &stream_frame_info);
-        pthread_create(&tid_display, NULL, display_function, &stream_frame_info);
-        pthread_create(&tid_stream, NULL, stream_function, &stream_frame_info);
-        pthread_create(&tid_cmd, NULL, cmd_function, NULL);
+            //if (rst < 0)
+            //{
+            //    puts("ir camera stream on failed!\n");
+            //    getchar();
+            //    return 0;
+            //}
+            puts("ir camera stream on!\n");
+            conf_watch_start(conf_path, &conf, sample_conf_restart, NULL);
+            sample_wait_enter();
+            stop_request(&sample_stop);
+            conf_watch_stop();
+            //Sleep(10000);
+            //while (1);
+            ir_camera_stream_off_with_callback(&stream_frame_info);
+            display_release();
+        }
+        //multiple thread function mode
+        else
+        {
+            rst = ir_camera_stream_on(&stream_frame_info);
+            if (rst < 0)
+            {
+                puts("ir camera stream on failed!\n");
+                getchar();
+                return 0;
+            }
 
+            pthread_t tid_stream, tid_display, tid_temperature, tid_cmd;
 
-        pthread_join(tid_stream, NULL);
-        pthread_cancel(tid_display);
-        pthread_cancel(tid_temperature);
-        pthread_cancel(tid_cmd);
+#if defined(TASK_POOL)
+            pool_init(0);
+            display_band_num = (uint8_t)pool_worker_num();    //colorize/transform in row bands across the workers
+            temperature_task_attach(&stream_frame_info);
+#if defined(RAW_RECORD)
+            static Recorder_t recorder;
+            RecordParam_t record_param = { 0 };
+            strcpy(record_param.path, RAW_RECORD_PATH);
+            record_param.meta_interval = RECORD_DEFAULT_META_INTERVAL;
+            record_param.direct_io = 1;
+            record_param.codec = RAW_RECORD_CODEC;
+            if (RAW_RECORD_FULL_INTERVAL > 1)
+            {
+                record_param.full_interval = RAW_RECORD_FULL_INTERVAL;
+                record_param.roi_num = 1;
+                RecordRoi_t roi = { 50,50,20,20 };  //the demo rect of the temperature readout
+                record_param.rois[0] = roi;
+            }
+            if (record_attach(&recorder, &stream_frame_info) == RECORD_SUCCESS)
+            {
+                record_start(&recorder, &record_param);
+            }
+#endif
+#if defined(BLACK_BOX)
+            BlackboxParam_t black_box_param = { { 0 } };
+            strcpy(black_box_param.path, BLACK_BOX_PATH);
+            black_box_param.size_mb = BLACK_BOX_SIZE_MB;
+            if (blackbox_attach(&black_box, &stream_frame_info) == BLACKBOX_SUCCESS)
+            {
+                blackbox_start(&black_box, &black_box_param);
+            }
+#endif
+#if defined(ZARR_EXPORT)
+            static Exporter_t exporter;
+            ExportParam_t export_param = { { 0 } };
+            strcpy(export_param.path, ZARR_EXPORT_PATH);
+            export_param.level = EXPORT_DEFAULT_LEVEL;
+            if (export_attach(&exporter, &stream_frame_info) == EXPORT_SUCCESS)
+            {
+                export_start(&exporter, &export_param);
+            }
+#endif
+#if defined(ENCODE_STREAM)
+            static Encoder_t encoder;
+            EncodeParam_t encode_param = { ENCODE_CODEC_H264 };
+            encode_param.backend = ENCODE_BACKEND_AUTO;
+            encode_param.color_mode = IRPROC_COLOR_MODE_6;
+            encode_param.packet_func = encode_stream_write;
+            encode_param.packet_arg = fopen(ENCODE_STREAM_PATH, "wb");
+            if (encode_param.packet_arg != NULL && encode_attach(&encoder, &stream_frame_info) == ENCODE_SUCCESS && \
+                encode_start(&encoder, &encode_param) != ENCODE_SUCCESS)
+            {
+                printf("encode stream start failed\n");
+            }
+#endif
+#if defined(LOOPBACK_OUTPUT)
+            static Loopback_t loopback;
+            LoopbackParam_t loopback_param = { LOOPBACK_DEVICE, LOOPBACK_FORMAT, IRPROC_COLOR_MODE_6, LOOPBACK_RADIOMETRIC };
+            if (loopback_attach(&loopback, &stream_frame_info) == LOOPBACK_SUCCESS && \
+                loopback_start(&loopback, &loopback_param) != LOOPBACK_SUCCESS)
+            {
+                printf("loopback output start failed\n");
+            }
+#endif
+#if defined(FRAME_BUS)
+            static Bus_t frame_bus;
+            BusParam_t bus_param = { FRAME_BUS_NAME, 0, 1, 1 };
+            if (bus_attach(&frame_bus, &stream_frame_info) == BUS_SUCCESS && \
+                bus_start(&frame_bus, &bus_param) != BUS_SUCCESS)
+            {
+                printf("frame bus start failed\n");
+            }
+#endif
+#if defined(TEMP_QUERY)
+            static TempQuery_t temp_query;
+            TempQueryParam_t temp_query_param = { 1, NULL };
+            if (temp_query_attach(&temp_query, &stream_frame_info, &temp_query_param) == TEMP_QUERY_SUCCESS)
+            {
+                command_query_set(&temp_query);
+            }
+#endif
+#if defined(STREAM_SERVER)
+            //one encoder feeds every rtsp client, the radiometric track is coded once per frame for all of them
+            static StreamServer_t stream_server;
+            static Encoder_t stream_encoder;
+            StreamServerParam_t server_param = { STREAM_SERVER_PORT, ENCODE_CODEC_H264, NULL };
+            server_param.deadband = STREAM_SERVER_DEADBAND;
+            EncodeParam_t stream_encode_param = { ENCODE_CODEC_H264 };
+            stream_encode_param.color_mode = IRPROC_COLOR_MODE_6;
+            stream_encode_param.packet_func = stream_server_video_packet;
+            stream_encode_param.packet_arg = &stream_server;
+            if (stream_server_attach(&stream_server, &stream_frame_info) == STREAM_SUCCESS && \
+                stream_server_start(&stream_server, &server_param) == STREAM_SUCCESS && \
+                encode_attach(&stream_encoder, &stream_frame_info) == ENCODE_SUCCESS && \
+                encode_start(&stream_encoder, &stream_encode_param) != ENCODE_SUCCESS)
+            {
+                printf("stream server has no encoder, only the radiometric track is served\n");
+            }
+#endif
+#if defined(WEB_DASHBOARD)
+            //frames are colored and encoded only while a browser is connected
+            WebParam_t web_param = { WEB_DASHBOARD_PORT, WEB_DEFAULT_QUALITY, 1 };
+            if (web_attach(&web_dashboard, &stream_frame_info) != WEB_SUCCESS || \
+                web_start(&web_dashboard, &web_param) != WEB_SUCCESS)
+            {
+                printf("web dashboard start failed\n");
+            }
+#endif
+#if defined(TELEMETRY)
+            //the demo rois of temperature.cpp, every frame, 50/0 celsius limits
+            static Telemetry_t telemetry;
+            if (telemetry_attach(&telemetry, &stream_frame_info) == TELEMETRY_SUCCESS)
+            {
+                TempThreshold_t threshold = { 323, 273 };
+                Dot_t point = { (int)stream_frame_info.temp_info.width / 2, (int)stream_frame_info.temp_info.height / 2 };
+                Area_t rect = { 50,50,20,20 };
+                Line_t line = { (int)stream_frame_info.temp_info.width / 2, (int)stream_frame_info.temp_info.height - 1, \
+                    (int)stream_frame_info.temp_info.width / 2, 0 };
+                telemetry_add_point(&telemetry, point, &threshold);
+                telemetry_add_rect(&telemetry, rect, &threshold);
+                telemetry_add_line(&telemetry, line, &threshold);
+                TelemetryParam_t telemetry_param = { TELEMETRY_DEFAULT_SHM_NAME };
+                strcpy(telemetry_param.group, TELEMETRY_GROUP);
+                telemetry_param.batch_frames = 5;
+                telemetry_start(&telemetry, &telemetry_param);
+            }
+#endif
+#if defined(ROI_HISTORY)
+            //raw points for a day, 1 s rollups for a week, 1 min and 1 h ones kept
+            static Tsdb_t tsdb;
+            if (tsdb_attach(&tsdb, &stream_frame_info) == TSDB_SUCCESS)
+            {
+                Area_t rect = { 50,50,20,20 };
+                tsdb_add_rect(&tsdb, rect);
+                TsdbParam_t tsdb_param = { ROI_HISTORY_PATH };
+                tsdb_param.retain_s[TSDB_TIER_RAW] = 86400;
+                tsdb_param.retain_s[TSDB_TIER_SECOND] = 7 * 86400;
+                tsdb_start(&tsdb, &tsdb_param);
+            }
+#endif
+#if defined(MQTT_PUBLISHER)
+            //the broker may be down, the client keeps connecting while the summaries wait in their slots
+            if (mqtt_attach(&mqtt_publisher, &stream_frame_info) == MQTT_SUCCESS)
+            {
+                Area_t rect = { 50,50,20,20 };
+                mqtt_add_rect(&mqtt_publisher, rect);
+                MqttParam_t mqtt_param = { MQTT_BROKER };
+                mqtt_start(&mqtt_publisher, &mqtt_param);
+            }
+#endif
+#if defined(ALARM_ENGINE)
+            //a hot spot of 4 pixels on 2 frames raises, gone for 5 frames clears
+            static AlarmEngine_t alarm_engine;
+            AlarmParam_t alarm_param = { ALARM_TEMP_OF_CELSIUS(ALARM_RAISE_CELSIUS), ALARM_TEMP_OF_CELSIUS(ALARM_CLEAR_CELSIUS) };
+            alarm_param.min_area = 4;
+            alarm_param.raise_frames = 2;
+            alarm_param.clear_frames = 5;
+            alarm_param.match_distance = 4;
+            alarm_param.update_interval = 25;
+            alarm_param.event_func = alarm_event_print;
+            alarm_param.event_arg = &stream_frame_info;
+#if defined(EVENT_CLIP)
+            if (clip_attach(&event_clip, &stream_frame_info) == CLIP_SUCCESS)
+            {
+                ClipParam_t clip_param = { CLIP_PREROLL_MS, CLIP_POSTROLL_MS };
+                clip_start(&event_clip, &clip_param);
+            }
+#endif
+#if defined(ALARM_SNAPSHOT)
+            snapshot_start(&alarm_snapshot, &stream_frame_info, 0);
+#endif
+#if defined(ALARM_BURST)
+            if (burst_init(&alarm_burst, &stream_frame_info, BURST_FRAMES, alarm_burst_save, NULL) == BURST_SUCCESS)
+            {
+                command_burst_set(&alarm_burst);
+            }
+#endif
+            if (alarm_engine_attach(&alarm_engine, &stream_frame_info) == ALARM_SUCCESS)
+            {
+                alarm_engine_start(&alarm_engine, &alarm_param);
+            }
+#endif
+#if defined(ALARM_RULES)
+            //the horizons of the demo analytics, a missing file waits for one to appear
+            static RuleEngine_t rule_engine;
+            RuleParam_t rule_param = { { 60000, 300000 }, 2, NULL, NULL };
+            if (rule_engine_init(&rule_engine, &rule_param) == RULE_SUCCESS)
+            {
+                rule_engine_watch(&rule_engine, ALARM_RULES);
+#if defined(ALARM_ENGINE)
+                temperature_rules_set(&rule_engine, &alarm_engine);
+#else
+                temperature_rules_set(&rule_engine, NULL);
+#endif
+            }
 #endif
+#if defined(ANALYTICS_PLUGIN)
+            //a graph of its own on the ring, the plug-in's node misses frames rather than hold the stream
+            static PluginHost_t plugin_host;
+            static Graph_t plugin_graph;
+            uint8_t plugin_started = 0;
+            plugin_host_init(&plugin_host, &stream_frame_info, NULL);
+            graph_init(&plugin_graph);
+            if (plugin_host_add(&plugin_host, ANALYTICS_PLUGIN, ANALYTICS_PLUGIN_CONFIG) >= 0 && \
+                plugin_host_graph(&plugin_host, &plugin_graph, GRAPH_SOURCE) == PLUGIN_SUCCESS)
+            {
+                char plugin_error[GRAPH_ERROR_LEN] = "";
+                if (graph_attach(&plugin_graph, &stream_frame_info, plugin_error, sizeof(plugin_error)) == GRAPH_SUCCESS && \
+                    graph_start(&plugin_graph) == GRAPH_SUCCESS)
+                {
+                    plugin_host_watch(&plugin_host);
+                    plugin_started = 1;
+                }
+                else
+                {
+                    printf("analytics plugin: %s\n", plugin_error);
+                }
+            }
+#endif
+#if defined(FEVER_SCREENING)
+            //faces at 30-42 C, the 3x3 hottest pixels of each, a verdict after 5 frames
+            static ScreenEngine_t screen_engine;
+            ScreenParam_t screen_param;
+            memset(&screen_param, 0, sizeof(screen_param));
+            screen_param.person.low_temp = ALARM_TEMP_OF_CELSIUS(30);
+            screen_param.person.high_temp = ALARM_TEMP_OF_CELSIUS(42);
+            screen_param.person.open = 1;
+            screen_param.person.close = 1;
+            screen_param.person.min_area = 30;
+            screen_param.hotspot_radius = 6;
+            screen_param.top_n = 9;
+            screen_param.blackbody.start_x = stream_frame_info.temp_info.width - 16;
+            screen_param.blackbody.start_y = 4;
+            screen_param.blackbody.width = 12;
+            screen_param.blackbody.height = 12;
+            screen_param.blackbody_celsius = BLACKBODY_CELSIUS;
+            screen_param.fever_celsius = FEVER_CELSIUS;
+            screen_param.confirm_frames = 5;
+            screen_param.lost_frames = 5;
+            screen_param.match_distance = 8;
+            screen_param.reading_func = screen_reading_print;
+            if (screen_engine_attach(&screen_engine, &stream_frame_info) == SCREEN_SUCCESS)
+            {
+                screen_engine_start(&screen_engine, &screen_param);
+            }
+#endif
+#if defined(BLOB_TRACKING)
+            static TrackerEngine_t tracker_engine;
+            SegmentParam_t tracker_segment = { ALARM_TEMP_OF_CELSIUS(30), ALARM_TEMP_OF_CELSIUS(42), 1, 1, 20 };
+            TrackerParam_t tracker_param = { 0.1f, 12.0f, 3, 10, 0.5f, 1.0f, (uint64_t)DWELL_SECONDS * 1000000 };
+            if (tracker_engine_attach(&tracker_engine, &stream_frame_info) == TRACKER_SUCCESS)
+            {
+                tracker_engine_start(&tracker_engine, &tracker_segment, &tracker_param, tracker_print, &tracker_engine);
+            }
+#endif
+#if defined(OBJECT_DETECTION)
+            //fixed normalization keeps the scene's contrast, a per frame stretch would amplify the noise of empty scenes
+            static Infer_t infer;
+            InferParam_t infer_param;
+            memset(&infer_param, 0, sizeof(infer_param));
+            infer_param.type = INFER_TENSOR_F32;
+            infer_param.norm = INFER_NORM_FIXED;
+            infer_param.mean = 8192.0f;
+            infer_param.std = 2048.0f;
+            infer_param.width = stream_frame_info.image_info.width;
+            infer_param.height = stream_frame_info.image_info.height;
+            infer_param.batch = 1;
+            infer_param.score_threshold = 0.4f;
+            infer_param.tensorrt = INFER_TENSORRT;
+            infer_init(&infer);
+            if (infer_backend_onnxruntime() == NULL)
+            {
+                printf("infer: built without onnxruntime\n");
+            }
+            else if (infer_attach(&infer, &stream_frame_info) >= 0)
+            {
+                infer_start(&infer, &infer_param, infer_backend_onnxruntime(), INFER_MODEL_PATH, infer_result_print, NULL);
+            }
+#endif
+#if defined(MULTI_POINT_CALIB)
+            static MpCal_t mpcal;
+            pthread_t tid_mpcal;
+            MpcalParam_t mpcal_param = { MPCAL_MODE_KTBT_NUC, P2, LOW_GAIN, 3 };
+            const float setting_temp[3] = { 123.9f, 259.4f, 415.9f };
+            for (int i = 0; i < 3; i++)
+            {
+                EnvCorrectParam env = { 0.25f, 0.95f, 0.5f, 25, 25 };
+                mpcal_param.points[i].setting_temp = setting_temp[i];
+                mpcal_param.points[i].env = env;
+            }
+            mpcal_param.write_back = MPCAL_WRITE_BACK;
+            uint8_t mpcal_started = (mpcal_init(&mpcal, &mpcal_param, &stream_frame_info) == MPCAL_SUCCESS && \
+                pthread_create(&tid_mpcal, NULL, mpcal_function, &mpcal) == 0);
+            if (!mpcal_started)
+            {
+                printf("multi point calibration start failed\n");
+            }
+#endif
+#if defined(FRAME_INTEGRATION)
+            static Accum_t accum;
+            uint8_t accum_started = (accum_init(&accum, stream_frame_info.temp_info.width, stream_frame_info.temp_info.height) \
+                == ACCUM_SUCCESS);
+            if (accum_started && (accum_attach(&accum, &stream_frame_info, ACCUM_PLANE_TEMP) != ACCUM_SUCCESS || \
+                accum_start(&accum, FRAME_INTEGRATION) != ACCUM_SUCCESS))
+            {
+                printf("frame integration start failed\n");
+            }
+#endif
+#if defined(MAX_HOLD)
+            static AccumHold_t max_hold;
+            static Snapshot_t max_hold_snapshot;
+            uint8_t max_hold_started = (accum_hold_init(&max_hold, stream_frame_info.temp_info.width, \
+                stream_frame_info.temp_info.height, MAX_HOLD_DECAY) == ACCUM_SUCCESS && \
+                accum_hold_attach(&max_hold, &stream_frame_info, ACCUM_PLANE_TEMP) == ACCUM_SUCCESS && \
+                snapshot_start(&max_hold_snapshot, &stream_frame_info, 0) == SNAPSHOT_SUCCESS);
+            if (!max_hold_started)
+            {
+                printf("max hold start failed\n");
+            }
+#endif
+#if defined(RATE_ALARM)
+            //4 pixels rising on 5 frames raise, 10 frames below half the rate clear
+            static AccumRate_t rate_alarm;
+            AccumRateParam_t rate_param;
+            memset(&rate_param, 0, sizeof(rate_param));
+            rate_param.alarm.raise_temp = (uint16_t)TEMP_RAW_OF_KELVIN_DELTA(RATE_ALARM);
+            rate_param.alarm.clear_temp = (uint16_t)TEMP_RAW_OF_KELVIN_DELTA(RATE_ALARM / 2);
+            rate_param.alarm.min_area = 4;
+            rate_param.alarm.raise_frames = 5;
+            rate_param.alarm.clear_frames = 10;
+            rate_param.alarm.match_distance = 4;
+            rate_param.alarm.event_func = rate_event_print;
+            if (accum_rate_init(&rate_alarm, stream_frame_info.temp_info.width, stream_frame_info.temp_info.height, \
+                &rate_param) != ACCUM_SUCCESS || accum_rate_attach(&rate_alarm, &stream_frame_info) != ACCUM_SUCCESS)
+            {
+                printf("rate alarm start failed\n");
+            }
+#endif
+#if defined(ANOMALY_DETECT)
+            //the default learning rate, 4 pixels off on 3 frames raise, 10 frames back clear
+            static AccumBackground_t anomaly;
+            AccumBackgroundParam_t anomaly_param;
+            memset(&anomaly_param, 0, sizeof(anomaly_param));
+            anomaly_param.alarm.raise_temp = ACCUM_BACKGROUND_OF_SIGMA(ANOMALY_DETECT);
+            anomaly_param.alarm.clear_temp = ACCUM_BACKGROUND_OF_SIGMA(ANOMALY_DETECT - 1);
+            anomaly_param.alarm.min_area = 4;
+            anomaly_param.alarm.raise_frames = 3;
+            anomaly_param.alarm.clear_frames = 10;
+            anomaly_param.alarm.match_distance = 4;
+            anomaly_param.alarm.event_func = anomaly_event_print;
+            if (accum_background_init(&anomaly, stream_frame_info.temp_info.width, \
+                stream_frame_info.temp_info.height, &anomaly_param) != ACCUM_SUCCESS || \
+                accum_background_attach(&anomaly, &stream_frame_info) != ACCUM_SUCCESS)
+            {
+                printf("anomaly detection start failed\n");
+            }
+#endif
+#if defined(HOST_DPC)
+            pthread_t tid_badpix;
+            uint8_t badpix_started = (stream_frame_info.badpix != NULL && \
+                accum_init(&badpix_accum, badpix.width, badpix.height) == ACCUM_SUCCESS && \
+                accum_attach(&badpix_accum, &stream_frame_info, ACCUM_PLANE_IMAGE) == ACCUM_SUCCESS && \
+                pthread_create(&tid_badpix, NULL, badpix_function, &stream_frame_info) == 0);
+#endif
+            //the window sink keeps highgui on its own ui thread, so the display runs as a task in every build
+            display_init(&stream_frame_info);
+            display_task_attach(&stream_frame_info);
+#else
+            pthread_create(&tid_temperature, NULL, temperature_function, &stream_frame_info);
+            pthread_create(&tid_display, NULL, display_function, &stream_frame_info);
+#endif
+#if defined(METRICS_EXPORTER)
+            //scrapes read the ring and timing counters as they are, the frame path does nothing for them
+            static Metrics_t metrics;
+            MetricsParam_t metrics_param = { METRICS_PORT };
+            if (metrics_attach(&metrics, &stream_frame_info) == METRICS_SUCCESS)
+            {
+                metrics_start(&metrics, &metrics_param);
+            }
+#endif
+#if defined(CONTROL_SERVER)
+            ControlParam_t control_param = { CONTROL_SERVER_PORT };
+            if (control_attach(&control_server, &stream_frame_info) != CONTROL_SUCCESS || \
+                control_start(&control_server, &control_param) != CONTROL_SUCCESS)
+            {
+                printf("control server start failed\n");
+            }
+#endif
+#if defined(CMD_BROKER)
+            //requests of other processes go on the same command queue as the pipeline's and the control's
+            CmdBrokerParam_t cmd_broker_param;
+            memset(&cmd_broker_param, 0, sizeof(cmd_broker_param));
+            snprintf(cmd_broker_param.path, sizeof(cmd_broker_param.path), "%s", CMD_BROKER);
+            cmd_broker_param.camera_index = camera_index;
+            cmd_broker_start(&cmd_broker, &cmd_broker_param);
+#endif
+#if defined(TRACE_EVENTS)
+            trace_start();
+#endif
+#if defined(STAGE_PERF_COUNTERS)
+            timing_perf_enable(1);
+#endif
+#if defined(DUTY_CYCLE)
+            static DutyCycle_t duty;
+            DutyParam_t duty_param;
+            duty_default_param(&duty_param);
+            duty_param.period_ms = DUTY_CYCLE * 1000;
+            duty_param.result_frames = DUTY_RESULT_FRAMES;
+            duty_init(&duty, &duty_param, &stream_frame_info);
+#endif
+#if defined(FRAME_INTEGRITY)
+            static FrameIntegrity_t integrity;
+            integrity_init(&integrity, NULL, &stream_frame_info);
+#endif
+#if defined(IMAGE_STAB)
+            static Stab_t stab;
+            stab_init(&stab, NULL, &stream_frame_info);
+#endif
+            pthread_create(&tid_stream, NULL, stream_function, &stream_frame_info);
+            pthread_create(&tid_cmd, NULL, cmd_function, &sample_stop);
+#if defined(ALARM_ENGINE) && defined(LOW_POWER_IDLE)
+            ir_camera_fps_set(&stream_frame_info, IR_CAMERA_FPS_LOW);
+#endif
+            conf_mode_switch_set(sample_conf_mode, &stream_frame_info);
+            conf_watch_start(conf_path, &conf, sample_conf_restart, &stream_frame_info);
 
+            pthread_join(tid_stream, NULL);
+#if defined(DUTY_CYCLE)
+            DutyStats_t duty_stats_all;
+            if (duty_stats(&duty, &duty_stats_all) == DUTY_SUCCESS)
+            {
+                printf("duty cycle: %llu cycles, %llu results, wake to result p50:%llums max:%llums, awake %.1f%%", \
+                    (unsigned long long)duty_stats_all.cycles, (unsigned long long)duty_stats_all.results, \
+                    (unsigned long long)duty_stats_all.wake_to_result.p50_us / 1000, \
+                    (unsigned long long)duty_stats_all.wake_to_result.max_us / 1000, \
+                    100.0 * duty_stats_all.awake_us / (duty_stats_all.awake_us + duty_stats_all.asleep_us + 1));
+                if (duty_stats_all.power_valid && duty_stats_all.cycles > 1)
+                {
+                    printf(", %.1f mJ per cycle", duty_stats_all.energy_mj / (duty_stats_all.cycles - 1));
+                }
+                printf("\n");
+            }
+            duty_release(&duty);
+#endif
+            //libusb under libiruvc, nothing without a real module
+            UsbXferStats_t usb_xfer_stats_all;
+            if (usb_xfer_stats(stream_frame_info.camera_index, &usb_xfer_stats_all) == USB_XFER_SUCCESS && \
+                usb_xfer_stats_all.submitted > 0)
+            {
+                printf("usb transfers: %llu completed (%llu short), %llu errors (%llu timeouts), %llu cancelled, " \
+                    "%llu resubmitted, %llu held, %u in flight at most, %u bytes each\n", \
+                    (unsigned long long)usb_xfer_stats_all.completed, \
+                    (unsigned long long)usb_xfer_stats_all.short_transfers, (unsigned long long)usb_xfer_stats_all.errors, \
+                    (unsigned long long)usb_xfer_stats_all.timeouts, (unsigned long long)usb_xfer_stats_all.cancelled, \
+                    (unsigned long long)usb_xfer_stats_all.resubmitted, (unsigned long long)usb_xfer_stats_all.held, usb_xfer_stats_all.in_flight_max, \
+                    usb_xfer_stats_all.transfer_length);
+            }
+#if defined(FRAME_INTEGRITY)
+            IntegrityStats_t integrity_stats_all;
+            if (integrity_stats(&integrity, &integrity_stats_all) == INTEGRITY_SUCCESS)
+            {
+                printf("frame integrity: %llu of %llu frames bad (%llu frozen, %llu out of range, %llu torn), " \
+                    "%u in a row at most, %llu restarts\n", (unsigned long long)integrity_stats_all.bad, \
+                    (unsigned long long)integrity_stats_all.frames, (unsigned long long)integrity_stats_all.frozen, \
+                    (unsigned long long)integrity_stats_all.range, (unsigned long long)integrity_stats_all.structure, \
+                    integrity_stats_all.bad_run_max, (unsigned long long)integrity_stats_all.restarts);
+            }
+            integrity_release(&integrity);
+#endif
+#if defined(IMAGE_STAB)
+            StabStats_t stab_stats_all;
+            if (stab_stats(&stab, &stab_stats_all) == STAB_SUCCESS)
+            {
+                printf("stabilization: %llu of %llu frames measured, %llu lost, %llu clamped, shift max %.1f px, " \
+                    "jitter rms %.2f px max %.1f px\n", (unsigned long long)stab_stats_all.measured, \
+                    (unsigned long long)stab_stats_all.frames, (unsigned long long)stab_stats_all.lost, \
+                    (unsigned long long)stab_stats_all.clamped, stab_stats_all.shift_max, stab_stats_all.jitter_rms, \
+                    stab_stats_all.jitter_max);
+            }
+            stab_release(&stab);
+#endif
+            //a restart asked already, a stream that ended by itself (a command, a lost device) stops the rest here
+            stop_request(&sample_stop);
+            conf_watch_stop();
+            conf_mode_switch_set(NULL, NULL);
+#if defined(METRICS_EXPORTER)
+            metrics_stop(&metrics);
+#endif
+#if defined(CONTROL_SERVER)
+            control_stop(&control_server);
+#endif
+#if defined(CMD_BROKER)
+            cmd_broker_stop(&cmd_broker);
+#endif
+            //display and temperature leave by themselves once the frame ring is closed
+#if defined(TASK_POOL)
+            display_release();
+#if defined(RAW_RECORD)
+            record_stop(&recorder);
+#endif
+#if defined(BLACK_BOX)
+            blackbox_stop(&black_box);
+            BlackboxStats_t black_box_stats;
+            if (blackbox_stats(&black_box, &black_box_stats) == BLACKBOX_SUCCESS)
+            {
+                printf("black box: %llu frames, %llu events, %llu laps, %.2f of the planes, %llu syncs up to %llu us, " \
+                    "frames up to %llu us\n", (unsigned long long)black_box_stats.frames, \
+                    (unsigned long long)black_box_stats.events, (unsigned long long)black_box_stats.laps, \
+                    black_box_stats.plane_bytes ? (double)black_box_stats.bytes / black_box_stats.plane_bytes : 0.0, \
+                    (unsigned long long)black_box_stats.syncs, (unsigned long long)black_box_stats.sync_max_us, \
+                    (unsigned long long)black_box_stats.write_max_us);
+            }
+#endif
+#if defined(ZARR_EXPORT)
+            export_stop(&exporter);
+#endif
+#if defined(ENCODE_STREAM)
+            encode_stop(&encoder);
+            if (encode_param.packet_arg != NULL)
+            {
+                fclose((FILE*)encode_param.packet_arg);
+            }
+#endif
+#if defined(LOOPBACK_OUTPUT)
+            loopback_stop(&loopback);
+#endif
+#if defined(FRAME_BUS)
+            bus_stop(&frame_bus);
+#endif
+#if defined(TEMP_QUERY)
+            command_query_set(NULL);
+            TempQueryStats_t temp_query_stats_all;
+            if (temp_query_stats(&temp_query, &temp_query_stats_all) == TEMP_QUERY_SUCCESS)
+            {
+                printf("temp query: %llu frames, %llu skipped, %llu while busy\n", \
+                    (unsigned long long)temp_query_stats_all.frames, (unsigned long long)temp_query_stats_all.skipped, \
+                    (unsigned long long)temp_query_stats_all.busy);
+            }
+            temp_query_stop(&temp_query);
+#endif
+#if defined(STREAM_SERVER)
+            encode_stop(&stream_encoder);
+            stream_server_stop(&stream_server);
+#endif
+#if defined(WEB_DASHBOARD)
+            web_stop(&web_dashboard);
+#endif
+#if defined(TELEMETRY)
+            telemetry_stop(&telemetry);
+#endif
+#if defined(ROI_HISTORY)
+            tsdb_stop(&tsdb);
+#endif
+#if defined(ALARM_RULES)
+            temperature_rules_set(NULL, NULL);
+            rule_engine_release(&rule_engine);
+#endif
+#if defined(ANALYTICS_PLUGIN)
+            if (plugin_started)
+            {
+                graph_stop(&plugin_graph);
+                PluginStats_t plugin_stats_all;
+                plugin_stats(&plugin_host, 0, &plugin_stats_all);
+                printf("analytics plugin: %llu frames, %llu runs, %llu throttled, %llu over budget, %llu quarantined, " \
+                    "cpu max %llu us of %u\n", (unsigned long long)plugin_stats_all.frames, \
+                    (unsigned long long)plugin_stats_all.runs, (unsigned long long)plugin_stats_all.throttled, \
+                    (unsigned long long)plugin_stats_all.over_budget, (unsigned long long)plugin_stats_all.quarantined, \
+                    (unsigned long long)plugin_stats_all.cpu_max_us, plugin_stats_all.budget_us);
+            }
+            plugin_host_release(&plugin_host);
+#endif
+#if defined(ALARM_ENGINE)
+            alarm_engine_stop(&alarm_engine);
+#if defined(EVENT_CLIP)
+            clip_stop(&event_clip);
+#endif
+#if defined(ALARM_SNAPSHOT)
+            snapshot_stop(&alarm_snapshot);
+#endif
+#if defined(ALARM_BURST)
+            command_burst_set(NULL);
+            burst_destroy(&alarm_burst);
+#endif
+#endif
+#if defined(MQTT_PUBLISHER)
+            mqtt_stop(&mqtt_publisher);
+#endif
+#if defined(FEVER_SCREENING)
+            screen_engine_stop(&screen_engine);
+#endif
+#if defined(BLOB_TRACKING)
+            tracker_engine_stop(&tracker_engine);
+#endif
+#if defined(OBJECT_DETECTION)
+            infer_release(&infer);
+#endif
+#if defined(MULTI_POINT_CALIB)
+            if (mpcal_started)
+            {
+                //a setpoint wait leaves with the stream, a capture still waiting for frames after its timeout
+                pthread_join(tid_mpcal, NULL);
+                mpcal_release(&mpcal);
+            }
+#endif
+#if defined(FRAME_INTEGRATION)
+            if (accum_started)
+            {
+                float netd_mk = 0;
+                int accum_frames = accum_wait(&accum, 1);
+                accum_stop(&accum);
+                if (accum_noise(&accum, NULL, &netd_mk) == ACCUM_SUCCESS)
+                {
+                    printf("frame integration: %d frames netd:%.1fmK\n", accum_frames, netd_mk);
+                }
+            }
+#endif
+#if defined(MAX_HOLD)
+            if (max_hold_started)
+            {
+                //the stream has ended, the files take the last frame's metadata
+                accum_hold_export(&max_hold, ACCUM_HOLD_MAX, &max_hold_snapshot, MAX_HOLD "_max.tiff", \
+                    SNAPSHOT_FORMAT_TIFF);
+                accum_hold_export(&max_hold, ACCUM_HOLD_MIN, &max_hold_snapshot, MAX_HOLD "_min.tiff", \
+                    SNAPSHOT_FORMAT_TIFF);
+                snapshot_flush(&max_hold_snapshot, 2000);
+                snapshot_stop(&max_hold_snapshot);
+                printf("max hold: %u frames over %.1fs\n", max_hold.frames, \
+                    (max_hold.last_us - max_hold.first_us) / 1000000.0);
+            }
+#endif
+#if defined(HOST_DPC)
+            if (badpix_started)
+            {
+                pthread_join(tid_badpix, NULL);
+            }
+#endif
+            pool_stats_dump();
+            pool_release();
+#if defined(FRAME_INTEGRATION)
+            accum_release(&accum);
+#endif
+#if defined(MAX_HOLD)
+            accum_hold_release(&max_hold);
+#endif
+#if defined(RATE_ALARM)
+            AlarmStats_t rate_stats;
+            if (accum_rate_stats(&rate_alarm, &rate_stats) == ACCUM_SUCCESS)
+            {
+                printf("rate alarm: %llu frames, %llu raised\n", (unsigned long long)rate_stats.frames, \
+                    (unsigned long long)rate_stats.raised);
+            }
+            accum_rate_release(&rate_alarm);
+#endif
+#if defined(ANOMALY_DETECT)
+            AlarmStats_t anomaly_stats;
+            if (accum_background_stats(&anomaly, &anomaly_stats) == ACCUM_SUCCESS)
+            {
+                printf("anomaly detection: %llu frames, %llu raised\n", (unsigned long long)anomaly_stats.frames, \
+                    (unsigned long long)anomaly_stats.raised);
+            }
+            accum_background_release(&anomaly);
+#endif
+#if defined(HOST_DPC)
+            accum_release(&badpix_accum);
+#endif
+#else
+            pthread_join(tid_display, NULL);
+            pthread_join(tid_temperature, NULL);
+#endif
+            //the cmd thread wakes with the stop out of its stdin wait, nothing is cancelled mid read
+            pthread_join(tid_cmd, NULL);
+        }
+#if defined(SENSOR_HOUSEKEEP)
+        HousekeepSnapshot_t housekeep_snapshot;
+        if (housekeep_get(&housekeep, &housekeep_snapshot) > 0)
+        {
+            printf("vtemp:%d shutter vtemp:%d lens vtemp:%d\n", housekeep_snapshot.vtemp, \
+                housekeep_snapshot.shutter_vtemp, housekeep_snapshot.lens_vtemp);
+        }
+        housekeep_release(&housekeep);
+#endif
+#if defined(HOST_DPC)
+        badpix_release(&badpix);
+#endif
+#if defined(LATENCY_PROBE)
+        latency_probe_dump(&latency_probe);
+        latency_probe_release(&latency_probe);
+#endif
+#if defined(SHUTTER_MONITOR)
+        shutter_mon_release(&shutter_mon);
+#endif
+#if defined(OVEREXPOSURE_GUARD)
+        exposure_guard_release(&exposure_guard);
+#endif
+#if defined(HDR_FUSION) && !defined(AUTO_GAIN_SWITCH)
+        hdr_release(&hdr);
+#endif
+#if defined(AUTO_GAIN_SWITCH)
+        gain_ctrl_release(&gain_ctrl);
+#endif
+        cmdq_release();
+#if defined(TRACE_EVENTS)
+        trace_stop();
+        uint64_t trace_events = 0, trace_lost = 0;
+        trace_counts(&trace_events, &trace_lost);
+        if (trace_dump(TRACE_PATH) == TRACE_SUCCESS)
+        {
+            printf("trace: %llu events into %s, the oldest %llu overwritten\n", (unsigned long long)trace_events, \
+                TRACE_PATH, (unsigned long long)trace_lost);
+        }
+#endif
+
+#if defined(FRAME_SOURCE)
+        frame_source_close(&frame_source);
+#else
         uvc_camera_close();
+#endif
+        printf("stop: the run was torn down in %.1f ms\n", stop_token_elapsed_us(&sample_stop) / 1000.0);
+        stop_token_release(&sample_stop);
 #if defined(LOOP_TEST)
         printf("test cycle=%d\n",i);
     }
+#else
+    } while (conf_restart_take());
+#endif
+#if defined(FAST_REOPEN) && !defined(FRAME_SOURCE)
+    ir_camera_release();
 #endif
+    mem_acct_dump(stdout);     //the run's peak, and what was never released
+    rt_dump(stdout);           //wakeup latency of every thread the run started
+    log_stop();
     puts("EXIT");
     getchar();
     return 0;
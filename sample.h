@@ -9,11 +9,134 @@
 #endif
 
 #include <stdio.h>
+#include <math.h>
 
 #include "cmd.h"
+#include "calib.h"
 #include "camera.h"
 #include "display.h"
 #include "temperature.h"
+#include "record.h"
+#include "export.h"
+#include "encode.h"
+#include "stream.h"
+#include "telemetry.h"
+#include "metrics.h"
+#include "trace.h"
+#include "log.h"
+#include "memacct.h"
+#include "conf.h"
+#include "tsdb.h"
+#include "alarm.h"
+#include "clip.h"
+#include "snapshot.h"
+#include "screen.h"
+#include "tracker.h"
+#include "infer.h"
+#include "loopback.h"
+#include "bus.h"
+#include "web.h"
+#include "mqtt.h"
+#include "control.h"
+#include "cmdbroker.h"
+#include "mpcal.h"
+#include "accum.h"
+#include "badpix.h"
+#include "cmdbatch.h"
+#include "burst.h"
+#include "duty.h"
+#include "integrity.h"
+#include "stab.h"
+#include "blackbox.h"
+#include "usbxfer.h"
+#include "tempquery.h"
+#include "plugin.h"
+
+#define TASK_POOL     //per frame stages run on a shared task pool, only acquisition/display/cmd keep a thread
+//#define RAW_RECORD    //with TASK_POOL: record every raw image/temp frame into RAW_RECORD_PATH
+#define RAW_RECORD_PATH "ir_record.irr"
+#define RAW_RECORD_CODEC RECORD_CODEC_DELTA  //RECORD_CODEC_NONE stores the planes as they came
+#define RAW_RECORD_FULL_INTERVAL 0      //above 1: the demo roi of the temp plane every frame, the full frame this often
+//#define BLACK_BOX     //with TASK_POOL: the last minutes of frames and alarms in the crash safe ring BLACK_BOX_PATH
+#define BLACK_BOX_PATH "ir_blackbox.bin"
+#define BLACK_BOX_SIZE_MB 256
+//#define ZARR_EXPORT   //with TASK_POOL: every frame's 16 bit planes into the zarr group ZARR_EXPORT_PATH for numpy/xarray
+#define ZARR_EXPORT_PATH "ir_export.zarr"
+//#define FRAME_SOURCE FRAME_SOURCE_REPLAY   //multiple thread mode without a camera: REPLAY plays FRAME_SOURCE_PATH, SYNTH generates frames, VOSPI reads spi/i2c
+#define FRAME_SOURCE_PATH "ir_replay.irr"
+#define FRAME_SOURCE_PACED 1            //0 hands the frames over as fast as the pipeline takes them
+//#define ENCODE_STREAM  //with TASK_POOL: encode the colorized image into ENCODE_STREAM_PATH as annex-b h264
+#define ENCODE_STREAM_PATH "ir_stream.h264"
+//#define LOOPBACK_OUTPUT  //with TASK_POOL: processed frames into the v4l2loopback node LOOPBACK_DEVICE for ffmpeg/gstreamer/ml readers
+#define LOOPBACK_DEVICE LOOPBACK_DEFAULT_DEVICE
+#define LOOPBACK_FORMAT LOOPBACK_FMT_NV12   //YUYV, or GREY16 (LOOPBACK_RADIOMETRIC 1 takes the temp plane)
+#define LOOPBACK_RADIOMETRIC 0
+//#define FRAME_BUS      //with TASK_POOL: image and temp planes into the shared memory bus FRAME_BUS_NAME for reader processes
+#define FRAME_BUS_NAME BUS_DEFAULT_NAME
+//#define TEMP_QUERY     //with TASK_POOL: point/line/rect queries answered from the newest frame, commands 17/18 read their point there
+//#define STREAM_SERVER  //with TASK_POOL: rtsp server on STREAM_SERVER_PORT, tracks "video" and "radiometric"
+#define STREAM_SERVER_PORT STREAM_DEFAULT_PORT
+#define STREAM_SERVER_DEADBAND TEMP_RAW_OF_KELVIN_DELTA(0.125) //radiometric delta records, 0 for lossless
+//#define WEB_DASHBOARD  //with TASK_POOL: browser dashboard on WEB_DASHBOARD_PORT, jpeg frames, stats and alarm events
+#define WEB_DASHBOARD_PORT WEB_DEFAULT_PORT
+//#define TELEMETRY      //with TASK_POOL: point/rect/line temperatures and alarms into shared memory and udp multicast
+#define TELEMETRY_GROUP "239.255.42.1"
+//#define METRICS_EXPORTER   //prometheus text on http://<host>:METRICS_PORT/metrics: fps, drops, usb timeouts, reconnects, ring lag, stage latencies
+#define METRICS_PORT METRICS_DEFAULT_PORT
+//#define CONTROL_SERVER     //http://<host>:CONTROL_SERVER_PORT/control?ems=0.95&distance=2: parameter changes on the command queue, between frames
+#define CONTROL_SERVER_PORT CONTROL_DEFAULT_PORT
+//#define CMD_BROKER CMD_BROKER_DEFAULT_PATH    //vendor commands of this module for other processes at CMD_BROKER.<-i>: ircmd -i 1 gain low
+//#define MEMORY_BUDGET_MB 256   //ring slots, arenas, luts, clip pre-roll and encoder buffers within it, the ring and pre-roll shrink to fit
+//#define STAGE_PERF_COUNTERS   //cycles, instructions, cache and branch misses per stage in the 't' timing dump (perf_event_open, linux)
+#define TRACE_PATH "ir_trace.json"   //cmake -DTRACE_EVENTS=ON: stream/display/temperature/cmd trace from stream start, chrome trace json at exit
+//#define ROI_HISTORY    //with TASK_POOL: the demo rect's min/max/avr with 1s/1min/1h rollups into ROI_HISTORY_PATH.<tier>.<start>
+#define ROI_HISTORY_PATH "roi_history"
+//#define MQTT_PUBLISHER //with TASK_POOL: the demo rect's 1 s summaries and the alarm events (ALARM_ENGINE) to the broker MQTT_BROKER
+#define MQTT_BROKER "localhost"
+//#define ALARM_ENGINE   //with TASK_POOL: full frame hot spot alarms, raised at ALARM_RAISE_CELSIUS, cleared under ALARM_CLEAR_CELSIUS
+#define ALARM_RAISE_CELSIUS 80
+#define ALARM_CLEAR_CELSIUS 70
+//#define EVENT_CLIP     //with ALARM_ENGINE: each raised alarm writes clip_<track>.irr, CLIP_PREROLL_MS before to CLIP_POSTROLL_MS after it
+#define CLIP_PREROLL_MS 10000
+#define CLIP_POSTROLL_MS 5000
+//#define ALARM_BURST    //with ALARM_ENGINE: a raised alarm (or command 36) takes BURST_FRAMES raw frames capture only into burst_<n>.raw
+#define BURST_FRAMES 100
+//#define ALARM_SNAPSHOT //with ALARM_ENGINE: each raised alarm writes alarm_<track>.jpg, colored with the temp plane and its metadata inside
+//#define ALARM_RULES "rules.txt"    //with TASK_POOL: alarm rules over the demo rois and their 60 s/5 min windows (the blobs with ALARM_ENGINE), hot reloaded
+//#define ANALYTICS_PLUGIN "./libirplugin_hotspot.so"    //with TASK_POOL: an irplugin.h plug-in on the temp frames (make plugins), in its cpu budget, hot reloaded
+#define ANALYTICS_PLUGIN_CONFIG "60 20"   //the hotspot plug-in's celsius and pixels
+//#define FEVER_SCREENING    //with TASK_POOL: per person verdicts against FEVER_CELSIUS, a blackbody at the image's top right corner
+#define FEVER_CELSIUS 37.5f
+#define BLACKBODY_CELSIUS 35.0f
+//#define BLOB_TRACKING      //with TASK_POOL: track ids of the 30-42 C blobs, a count and a dwell alarm after DWELL_SECONDS
+#define DWELL_SECONDS 30
+//#define OBJECT_DETECTION   //with TASK_POOL and onnxruntime: INFER_MODEL_PATH on the image plane, float [1, rows, 6] detections out
+#define INFER_MODEL_PATH "detector.onnx"
+#define INFER_TENSORRT 0                //1 tries the tensorrt execution provider first
+//#define MULTI_POINT_CALIB  //with TASK_POOL: blackbody captures at the demo's 3 setpoints, run one process per camera with -i/-n
+#define MPCAL_STEP_PATH "mpcal_step"    //the fixture writes the reached setpoint index, every camera process waits on it
+#define MPCAL_WRITE_BACK 0              //1 writes the new kt/bt/nuc-t tables into the module
+//#define HOST_DPC    //with TASK_POOL: correct the pixels of BADPIX_MAP_PATH on the host, detect new ones every 64 frames and save them
+#define BADPIX_MAP_PATH "badpix.txt"
+//#define FRAME_INTEGRATION 64   //with TASK_POOL: sum the first 64 temp frames in the ring, print the mean and netd at the end
+//#define MAX_HOLD "hold"    //with TASK_POOL: per pixel max/min hold of the temp plane, hold_max.tiff and hold_min.tiff at the end
+#define MAX_HOLD_DECAY 0    //raw temp units per frame the holds relax toward the scene, 0 keeps the extremes of the run
+//#define RATE_ALARM 2.0f    //with TASK_POOL: blobs warming faster than 2 K/s raise alarms, they clear under half of it
+//#define ANOMALY_DETECT 4.0f    //with TASK_POOL: blobs over 4 sigma off the learned background raise alarms, under 3 clear
+//#define LOW_POWER_IDLE //with ALARM_ENGINE: stream at IR_CAMERA_FPS_LOW, the full rate while an alarm is raised
+//#define DUTY_CYCLE 60  //battery nodes: wake every 60 s, close the stream once DUTY_RESULT_FRAMES stable frames were processed
+#define DUTY_RESULT_FRAMES 2    //ALARM_ENGINE raises on 2 frames
+//#define PALETTE_DIR "palettes"  //user pseudocolor modes 16..20 from PALETTE_DIR/palette_<mode>.rgb, 'p' cycles the palettes
+//#define DISPLAY_PACING 2            //frames of jitter buffer in front of the display thread, a steady cadence
+//#define DISPLAY_WINDOWS 25          //only the two example regions below are processed, the full frame every 25 frames
+//#define DISPLAY_ISOTHERM            //paint the example temperature bands below over the palette
+//#define DISPLAY_TILE_REUSE          //static scenes: only the tiles that changed since they were drawn are colorized again
+//#define LOCKED_SPAN 20.0f, 120.0f    //the palette over a fixed celsius range, the same colors in every camera, no min/max scan
+//#define DISPLAY_GPU                 //colorize and transform through opencl when a device is found, 'g' toggles
+//#define DISPLAY_SINK DISPLAY_SINK_SHM   //NULL/WINDOW/FB/SHM/D3D11/GL/KMS output of the display, headless builds default to NULL (D3D11 on windows)
+#define DISPLAY_SINK_PATH ""            //fb or drm device or shm name, empty selects /dev/fb0, /dev/dri/card0 or /irsample_display
+//#define FRAME_POOL                    //each camera's ring frames in one mlocked huge page region, see RLIMIT_MEMLOCK
+#define FRAME_POOL_NUMA_NODE -1         //node the region is bound to, -1 leaves it to the first touch
 
 #define IR_SAMPLE_VERSION "libirsample 1.2.5"
 
@@ -24,6 +147,23 @@ typedef enum {
     NO_PRINT,
 }log_level_t;
 
-//#define USER_FUNCTION_CALLBACK
+#define CONF_PATH "ir_sample.conf"     //runtime settings over the defines here, -c <path>. written with the defaults when missing
+//#define USER_FUNCTION_CALLBACK      //the default run_mode of CONF_PATH
+//#define CALLBACK_HANDOFF    //with USER_FUNCTION_CALLBACK: the callback only fills the frame ring, display/temperature consume it
 //#define LOOP_TEST
+//#define FAST_REOPEN     //reopen from the cached device and stream parameters, the libusb context stays across close/open
+//#define USB_PLAN        //bandwidth factors from where the modules sit on the usb controllers instead of 1/camera_num
+//#define AUTO_GAIN_SWITCH    //switch high/low gain from the temp histogram, commands go through the command queue
+//#define OVEREXPOSURE_GUARD  //close the shutter while too many pixels are above the gain's range
+//#define AC020_INFO_LINES    //with IMAGE_AND_TEMP_OUTPUT: ac020 frames carry one info line after each half
+//#define Y8_PREVIEW 5    //with IMAGE_AND_TEMP_OUTPUT: a y8 image plane and the temp plane of every 5th frame, ring paths only
+//#define HDR_FUSION      //alternate high/low gain and fuse them into one extended range temp frame, not with AUTO_GAIN_SWITCH
+//#define SHUTTER_MONITOR     //tag the frames of shutter closes and nuc, alarm holds and the encoder repeats over them
+//#define FRAME_INTEGRITY     //drop repeated and torn frames uvc_frame_get returned fine, 2s of them restart the stream
+//#define IMAGE_STAB          //measure the view's jitter on a moving mount from the row/column profiles, the rois follow it
+//#define USB_TRANSFER_DEPTH 2    //at most 2 libusb stream transfers in flight, USB_TRANSFER_ISO_PACKETS packets each
+#define USB_TRANSFER_ISO_PACKETS 0  //0 keeps libiruvc's
+//#define LATENCY_PROBE       //close the shutter every 3s and time the closed frame to each sink, printed at the end
+//#define SENSOR_HOUSEKEEP    //vtemp, shutter and lens vtemp read in one batch every 2s between frames, cached for any thread
+//#define AUTO_RECONNECT  //a camera that stops delivering frames is reopened in the background, the stream goes on
 //#define UPDATE_FW
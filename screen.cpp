@@ -0,0 +1,446 @@
+#include "screen.h"
+#include "temperature.h"
+#include "timing.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define SCREEN_OFFSET_SHIFT 3           //the blackbody offset follows 1/8 of each new reading
+
+int screen_engine_init(ScreenEngine_t* engine, TempDataRes_t temp_res)
+{
+    if (engine == NULL || temp_res.width == 0 || temp_res.height == 0)
+    {
+        return SCREEN_ERROR_PARAM;
+    }
+    memset(engine, 0, sizeof(ScreenEngine_t));
+    engine->temp_res = temp_res;
+    engine->consumer_id = -1;
+    int ret = segment_init(&engine->segment, temp_res);
+    if (ret != SEGMENT_SUCCESS)
+    {
+        memset(engine, 0, sizeof(ScreenEngine_t));
+        return (ret == SEGMENT_ERROR_MEM) ? SCREEN_ERROR_MEM : SCREEN_ERROR_PARAM;
+    }
+    pthread_mutex_init(&engine->mutex, NULL);
+    return SCREEN_SUCCESS;
+}
+
+void screen_engine_release(ScreenEngine_t* engine)
+{
+    if (engine == NULL || engine->segment.mask == NULL)
+    {
+        return;
+    }
+    segment_release(&engine->segment);
+    pthread_mutex_destroy(&engine->mutex);
+    memset(engine, 0, sizeof(ScreenEngine_t));
+}
+
+//mean raw value of the blackbody roi clipped to the frame, 0 when nothing of it is inside
+static int screen_blackbody_read(const ScreenEngine_t* engine, const uint16_t* temp_data, float* mean)
+{
+    const Area_t* roi = &engine->param.blackbody;
+    int width = engine->temp_res.width, height = engine->temp_res.height;
+    int x0 = (roi->start_x < 0) ? 0 : roi->start_x;
+    int y0 = (roi->start_y < 0) ? 0 : roi->start_y;
+    int x1 = roi->start_x + roi->width;
+    int y1 = roi->start_y + roi->height;
+    x1 = (x1 > width) ? width : x1;
+    y1 = (y1 > height) ? height : y1;
+    if (roi->width <= 0 || roi->height <= 0 || x0 >= x1 || y0 >= y1)
+    {
+        return 0;
+    }
+    uint64_t sum = 0;
+    for (int y = y0; y < y1; y++)
+    {
+        const uint16_t* row = temp_data + y * width;
+        for (int x = x0; x < x1; x++)
+        {
+            sum += row[x];
+        }
+    }
+    *mean = (float)sum / (float)((x1 - x0) * (y1 - y0));
+    return 1;
+}
+
+static int screen_blob_on_blackbody(const ScreenEngine_t* engine, const SegmentBlob_t* blob)
+{
+    const Area_t* roi = &engine->param.blackbody;
+    if (roi->width <= 0 || roi->height <= 0)
+    {
+        return 0;
+    }
+    return blob->x0 < roi->start_x + roi->width && roi->start_x <= blob->x1 && \
+        blob->y0 < roi->start_y + roi->height && roi->start_y <= blob->y1;
+}
+
+//mean raw value of the top_n hottest mask pixels in the window around the blob's peak. a min heap of top_n
+//values keeps the hottest so far, a pixel only enters over the coldest of them, so nothing is sorted
+static float screen_hotspot(const ScreenEngine_t* engine, const uint16_t* temp_data, const SegmentBlob_t* blob)
+{
+    const Segment_t* segment = &engine->segment;
+    int width = engine->temp_res.width, height = engine->temp_res.height;
+    int r = engine->param.hotspot_radius;
+    int x0 = (blob->max_x - r < 0) ? 0 : blob->max_x - r;
+    int y0 = (blob->max_y - r < 0) ? 0 : blob->max_y - r;
+    int x1 = (blob->max_x + r >= width) ? width - 1 : blob->max_x + r;
+    int y1 = (blob->max_y + r >= height) ? height - 1 : blob->max_y + r;
+    int top_n = engine->param.top_n;
+    uint16_t heap[SCREEN_TOP_MAX];
+    int num = 0;
+    for (int y = y0; y <= y1; y++)
+    {
+        const uint16_t* row = temp_data + y * width;
+        for (int x = x0; x <= x1; x++)
+        {
+            if (!segment_mask_get(segment, x, y))
+            {
+                continue;
+            }
+            uint16_t v = row[x];
+            int i;
+            if (num < top_n)
+            {
+                //sift up
+                i = num++;
+                while (i > 0 && heap[(i - 1) / 2] > v)
+                {
+                    heap[i] = heap[(i - 1) / 2];
+                    i = (i - 1) / 2;
+                }
+                heap[i] = v;
+                continue;
+            }
+            if (v <= heap[0])
+            {
+                continue;
+            }
+            //replace the coldest and sift down
+            i = 0;
+            for (;;)
+            {
+                int c = 2 * i + 1;
+                if (c >= num)
+                {
+                    break;
+                }
+                if (c + 1 < num && heap[c + 1] < heap[c])
+                {
+                    c++;
+                }
+                if (heap[c] >= v)
+                {
+                    break;
+                }
+                heap[i] = heap[c];
+                i = c;
+            }
+            heap[i] = v;
+        }
+    }
+    if (num == 0)
+    {
+        return (float)blob->max_temp;
+    }
+    uint32_t sum = 0;
+    for (int i = 0; i < num; i++)
+    {
+        sum += heap[i];
+    }
+    return (float)sum / (float)num;
+}
+
+//raw temp values are linear in kelvin * 64
+static float screen_celsius_of(float raw)
+{
+    int base = (int)raw;
+    base = (base > 65534) ? 65534 : base;
+    float low = temp_value_converter((uint16_t)base);
+    return low + (temp_value_converter((uint16_t)(base + 1)) - low) * (raw - (float)base);
+}
+
+static int screen_blob_near(const SegmentBlob_t* a, const SegmentBlob_t* b, int distance)
+{
+    return a->x0 <= b->x1 + distance && b->x0 <= a->x1 + distance && \
+        a->y0 <= b->y1 + distance && b->y0 <= a->y1 + distance;
+}
+
+static void screen_reading_add(ScreenEngine_t* engine, int* reading_num, ScreenTrack_t* track, float celsius, \
+    uint8_t decided, uint64_t seq, uint64_t timestamp_us)
+{
+    ScreenReading_t* reading = &engine->readings[(*reading_num)++];
+    const SegmentBlob_t* blob = &track->blob;
+    reading->seq = seq;
+    reading->timestamp_us = timestamp_us;
+    reading->track_id = track->id;
+    reading->verdict = track->verdict;
+    reading->decided = decided;
+    reading->referenced = engine->offset_valid;
+    reading->frames = (uint16_t)((track->frames > 65535) ? 65535 : track->frames);
+    reading->celsius = celsius;
+    reading->peak_celsius = track->peak_celsius;
+    reading->offset_celsius = engine->offset_valid ? engine->offset_celsius : 0.0f;
+    reading->hot_x = blob->max_x;
+    reading->hot_y = blob->max_y;
+    reading->x0 = blob->x0;
+    reading->y0 = blob->y0;
+    reading->x1 = blob->x1;
+    reading->y1 = blob->y1;
+    reading->latency_us = 0;
+}
+
+//the hotspot of a matched or new track, the verdict once the track has confirm_frames frames. a normal
+//verdict turns into a fever when a later frame reaches fever_celsius, a fever stays
+static void screen_track_update(ScreenEngine_t* engine, int* reading_num, ScreenTrack_t* track, \
+    const uint16_t* temp_data, uint64_t seq, uint64_t timestamp_us)
+{
+    const ScreenParam_t* param = &engine->param;
+    float celsius = screen_celsius_of(screen_hotspot(engine, temp_data, &track->blob));
+    if (engine->offset_valid)
+    {
+        celsius += engine->offset_celsius;
+    }
+    track->peak_celsius = (track->frames == 1 || celsius > track->peak_celsius) ? celsius : track->peak_celsius;
+    uint8_t decided = 0;
+    if (track->frames >= param->confirm_frames && track->verdict != SCREEN_VERDICT_FEVER)
+    {
+        uint16_t verdict = (track->peak_celsius >= param->fever_celsius) ? SCREEN_VERDICT_FEVER : SCREEN_VERDICT_NORMAL;
+        if (verdict != track->verdict)
+        {
+            track->verdict = verdict;
+            decided = 1;
+            engine->stats.fevers += (verdict == SCREEN_VERDICT_FEVER);
+        }
+    }
+    screen_reading_add(engine, reading_num, track, celsius, decided, seq, timestamp_us);
+}
+
+//the alarm engine's matching: a track takes the nearest blob around its last box, blobs no track took start one
+static int screen_track(ScreenEngine_t* engine, const uint16_t* temp_data, uint64_t seq, uint64_t timestamp_us)
+{
+    const ScreenParam_t* param = &engine->param;
+    const Segment_t* segment = &engine->segment;
+    uint8_t blob_used[SEGMENT_MAX_BLOBS] = { 0 };
+    int reading_num = 0;
+    for (int b = 0; b < segment->blob_num; b++)
+    {
+        blob_used[b] = (uint8_t)screen_blob_on_blackbody(engine, &segment->blobs[b]);
+    }
+    for (int t = 0; t < SCREEN_MAX_TRACKS; t++)
+    {
+        ScreenTrack_t* track = &engine->tracks[t];
+        if (!track->used)
+        {
+            continue;
+        }
+        int best = -1;
+        uint32_t best_dist = 0xFFFFFFFF;
+        for (int b = 0; b < segment->blob_num; b++)
+        {
+            const SegmentBlob_t* blob = &segment->blobs[b];
+            if (blob_used[b] || !screen_blob_near(&track->blob, blob, param->match_distance))
+            {
+                continue;
+            }
+            int dx = blob->cx - track->blob.cx, dy = blob->cy - track->blob.cy;
+            uint32_t dist = (uint32_t)(dx * dx + dy * dy);
+            if (dist < best_dist)
+            {
+                best = b;
+                best_dist = dist;
+            }
+        }
+        if (best < 0)
+        {
+            if (++track->miss_frames >= param->lost_frames)
+            {
+                track->used = 0;
+            }
+            continue;
+        }
+        blob_used[best] = 1;
+        track->blob = segment->blobs[best];
+        track->miss_frames = 0;
+        track->frames++;
+        screen_track_update(engine, &reading_num, track, temp_data, seq, timestamp_us);
+    }
+
+    int free_track = 0;
+    for (int b = 0; b < segment->blob_num; b++)
+    {
+        if (blob_used[b])
+        {
+            continue;
+        }
+        while (free_track < SCREEN_MAX_TRACKS && engine->tracks[free_track].used)
+        {
+            free_track++;
+        }
+        if (free_track >= SCREEN_MAX_TRACKS)
+        {
+            engine->stats.dropped_blobs++;
+            continue;
+        }
+        ScreenTrack_t* track = &engine->tracks[free_track];
+        memset(track, 0, sizeof(ScreenTrack_t));
+        track->used = 1;
+        track->id = engine->track_next++;
+        track->frames = 1;
+        track->blob = segment->blobs[b];
+        engine->stats.people++;
+        screen_track_update(engine, &reading_num, track, temp_data, seq, timestamp_us);
+    }
+    return reading_num;
+}
+
+int screen_engine_process(ScreenEngine_t* engine, const uint16_t* temp_data, uint64_t seq, uint64_t timestamp_us)
+{
+    if (engine == NULL || engine->segment.mask == NULL || temp_data == NULL)
+    {
+        return SCREEN_ERROR_PARAM;
+    }
+    float blackbody = 0.0f;
+    if (screen_blackbody_read(engine, temp_data, &blackbody))
+    {
+        float offset = engine->param.blackbody_celsius - screen_celsius_of(blackbody);
+        engine->offset_celsius = engine->offset_valid ? \
+            engine->offset_celsius + (offset - engine->offset_celsius) / (1 << SCREEN_OFFSET_SHIFT) : offset;
+        engine->offset_valid = 1;
+    }
+    else
+    {
+        engine->stats.unreferenced++;
+    }
+    if (segment_process(&engine->segment, temp_data, &engine->param.person) < 0)
+    {
+        return SCREEN_ERROR_PARAM;
+    }
+    int reading_num = screen_track(engine, temp_data, seq, timestamp_us);
+    engine->stats.frames++;
+    uint64_t now_us = get_monotonic_us();
+    uint32_t latency_us = (uint32_t)((now_us > timestamp_us) ? now_us - timestamp_us : 0);
+    timing_record(TIMING_STAGE_SCREEN, latency_us);
+    engine->stats.late += (latency_us > SCREEN_LATENCY_BUDGET_US);
+    if (reading_num == 0)
+    {
+        return 0;
+    }
+    for (int i = 0; i < reading_num; i++)
+    {
+        engine->readings[i].latency_us = latency_us;
+    }
+    if (engine->param.reading_func != NULL)
+    {
+        engine->param.reading_func(engine->readings, reading_num, engine->param.reading_arg);
+    }
+    return reading_num;
+}
+
+static void screen_engine_task(FrameSlot_t* slot, void* arg)
+{
+    ScreenEngine_t* engine = (ScreenEngine_t*)arg;
+    pthread_mutex_lock(&engine->mutex);
+    //a gain switch, the closed shutter or the nuc moves every temperature, the tracks wait for the next good frame
+    if (engine->running && slot->desc.temp.data != NULL && !(slot->desc.flags & FRAME_DESC_TEMP_INVALID))
+    {
+        screen_engine_process(engine, (uint16_t*)slot->desc.temp.data, slot->seq, slot->desc.timestamp_us);
+    }
+    pthread_mutex_unlock(&engine->mutex);
+}
+
+int screen_engine_attach(ScreenEngine_t* engine, StreamFrameInfo_t* stream_frame_info)
+{
+    if (engine == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL || \
+        stream_frame_info->temp_byte_size == 0)
+    {
+        return SCREEN_ERROR_PARAM;
+    }
+    TempDataRes_t temp_res = { (uint16_t)stream_frame_info->temp_info.width, (uint16_t)stream_frame_info->temp_info.height };
+    int ret = screen_engine_init(engine, temp_res);
+    if (ret != SCREEN_SUCCESS)
+    {
+        return ret;
+    }
+    engine->stream_frame_info = stream_frame_info;
+    //the newest frame only: a frame left behind would push the verdict past the latency budget
+    engine->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEWEST, \
+        POOL_STAGE_TEMPERATURE, screen_engine_task, engine);
+    if (engine->consumer_id < 0)
+    {
+        screen_engine_release(engine);
+        return SCREEN_ERROR_PARAM;
+    }
+    return SCREEN_SUCCESS;
+}
+
+int screen_engine_start(ScreenEngine_t* engine, const ScreenParam_t* param)
+{
+    if (engine == NULL || engine->segment.mask == NULL || param == NULL || \
+        param->person.low_temp > param->person.high_temp || param->top_n == 0 || param->top_n > SCREEN_TOP_MAX)
+    {
+        return SCREEN_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&engine->mutex);
+    engine->param = *param;
+    if (engine->param.confirm_frames == 0)
+    {
+        engine->param.confirm_frames = 1;
+    }
+    if (engine->param.lost_frames == 0)
+    {
+        engine->param.lost_frames = 1;
+    }
+    memset(engine->tracks, 0, sizeof(engine->tracks));
+    engine->offset_valid = 0;
+    engine->running = 1;
+    pthread_mutex_unlock(&engine->mutex);
+    return SCREEN_SUCCESS;
+}
+
+int screen_engine_stop(ScreenEngine_t* engine)
+{
+    if (engine == NULL)
+    {
+        return SCREEN_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&engine->mutex);
+    if (engine->running)
+    {
+        engine->running = 0;
+        printf("screen: %llu frames, %llu people, %llu fevers, %llu dropped, %llu late, %llu unreferenced\n", \
+            (unsigned long long)engine->stats.frames, (unsigned long long)engine->stats.people, \
+            (unsigned long long)engine->stats.fevers, (unsigned long long)engine->stats.dropped_blobs, \
+            (unsigned long long)engine->stats.late, (unsigned long long)engine->stats.unreferenced);
+    }
+    pthread_mutex_unlock(&engine->mutex);
+    return SCREEN_SUCCESS;
+}
+
+int screen_engine_stats(ScreenEngine_t* engine, ScreenStats_t* stats)
+{
+    if (engine == NULL || stats == NULL)
+    {
+        return SCREEN_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&engine->mutex);
+    *stats = engine->stats;
+    pthread_mutex_unlock(&engine->mutex);
+    return SCREEN_SUCCESS;
+}
+
+const char* screen_verdict_name(ScreenVerdict_t verdict)
+{
+    switch (verdict)
+    {
+    case SCREEN_VERDICT_PENDING:
+        return "pending";
+    case SCREEN_VERDICT_NORMAL:
+        return "normal";
+    case SCREEN_VERDICT_FEVER:
+        return "fever";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef _SCREEN_H_
+#define _SCREEN_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+#include "libirtemp.h"
+#include "segment.h"
+
+#define SCREEN_MAX_TRACKS 16            //people followed at a time
+#define SCREEN_TOP_MAX 64               //hottest pixels averaged per hotspot
+#define SCREEN_LATENCY_BUDGET_US 50000  //frame received -> readings out, over it counts as late
+
+#define SCREEN_SUCCESS 0
+#define SCREEN_ERROR_PARAM -1
+#define SCREEN_ERROR_MEM -2
+
+typedef enum
+{
+    SCREEN_VERDICT_PENDING = 0,         //seen on fewer than confirm_frames frames
+    SCREEN_VERDICT_NORMAL,
+    SCREEN_VERDICT_FEVER,               //the peak reached fever_celsius, stays until the track ends
+}ScreenVerdict_t;
+
+//one person on one frame, celsius after the blackbody offset
+typedef struct {
+    uint64_t seq;                       //ring sequence of the frame
+    uint64_t timestamp_us;              //monotonic time the frame was received
+    uint16_t track_id;
+    uint16_t verdict;                   //ScreenVerdict_t
+    uint8_t decided;                    //the verdict was reached on this frame
+    uint8_t referenced;                 //the blackbody offset is applied
+    uint16_t frames;                    //frames the person was seen, saturated
+    float celsius;                      //mean of the hotspot's top_n pixels
+    float peak_celsius;                 //highest celsius of the track so far
+    float offset_celsius;               //blackbody setpoint - blackbody reading, added to celsius
+    uint16_t hot_x;                     //hottest pixel of the hotspot
+    uint16_t hot_y;
+    uint16_t x0;                        //the person's blob, inclusive
+    uint16_t y0;
+    uint16_t x1;
+    uint16_t y1;
+    uint32_t latency_us;                //frame received -> readings out
+}ScreenReading_t;
+
+//called from the ring task with the readings of one frame, one per tracked person
+typedef void (*ScreenReadingFunc_t)(const ScreenReading_t* readings, int reading_num, void* arg);
+
+typedef struct {
+    SegmentParam_t person;              //skin range, morphology and min_area of a face/person blob
+    uint16_t hotspot_radius;            //the hotspot window, (2r + 1)^2 pixels around the blob's peak
+    uint16_t top_n;                     //hottest mask pixels of the window averaged, 1..SCREEN_TOP_MAX
+    Area_t blackbody;                   //reference source in the frame, width 0 screens uncompensated
+    float blackbody_celsius;            //its setpoint
+    float fever_celsius;
+    uint16_t confirm_frames;            //frames before the verdict, 0 selects 1
+    uint16_t lost_frames;               //frames without the blob before the track ends, 0 selects 1
+    uint16_t match_distance;            //pixels a blob may move between two frames and keep its track
+    ScreenReadingFunc_t reading_func;
+    void* reading_arg;
+}ScreenParam_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t people;                    //tracks started
+    uint64_t fevers;
+    uint64_t dropped_blobs;             //no free track
+    uint64_t late;                      //frames over SCREEN_LATENCY_BUDGET_US
+    uint64_t unreferenced;              //frames without a usable blackbody reading
+}ScreenStats_t;
+
+typedef struct {
+    uint8_t used;
+    uint16_t id;
+    uint16_t verdict;
+    uint32_t frames;
+    uint32_t miss_frames;
+    float peak_celsius;
+    SegmentBlob_t blob;                 //the last matched blob
+}ScreenTrack_t;
+
+//elevated temperature screening: the person blobs of segment_process, per blob the top_n hottest pixels
+//around its peak (bounded min heap, no sort of the window), a blackbody roi of known temperature as the
+//in-frame offset, the blobs tracked across frames and a verdict per person after confirm_frames frames
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    ScreenParam_t param;
+    int consumer_id;
+    uint8_t running;
+    TempDataRes_t temp_res;
+    Segment_t segment;
+    float offset_celsius;               //blackbody offset, smoothed over frames
+    uint8_t offset_valid;
+    ScreenTrack_t tracks[SCREEN_MAX_TRACKS];
+    uint16_t track_next;
+    ScreenReading_t readings[SCREEN_MAX_TRACKS];
+    ScreenStats_t stats;
+    pthread_mutex_t mutex;
+}ScreenEngine_t;
+
+//buffers for one temp resolution, no frame ring involved
+int screen_engine_init(ScreenEngine_t* engine, TempDataRes_t temp_res);
+
+void screen_engine_release(ScreenEngine_t* engine);
+
+//register the engine as a task consumer of the camera's frame ring, before streaming
+int screen_engine_attach(ScreenEngine_t* engine, StreamFrameInfo_t* stream_frame_info);
+
+//set the ranges and rules, the tracks and the blackbody offset start empty
+int screen_engine_start(ScreenEngine_t* engine, const ScreenParam_t* param);
+
+int screen_engine_stop(ScreenEngine_t* engine);
+
+//one temp frame: segment, reference, track, then the readings go to reading_func and stay in engine->readings
+//returns the number of readings or an error code
+int screen_engine_process(ScreenEngine_t* engine, const uint16_t* temp_data, uint64_t seq, uint64_t timestamp_us);
+
+int screen_engine_stats(ScreenEngine_t* engine, ScreenStats_t* stats);
+
+const char* screen_verdict_name(ScreenVerdict_t verdict);
+
+#endif
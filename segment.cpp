@@ -0,0 +1,390 @@
+#include "segment.h"
+#include "simd.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define SEGMENT_NO_LABEL 0xFFFFFFFF
+
+//lowest set bit, word != 0
+static inline int segment_ctz(uint64_t word)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (int)index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+int segment_init(Segment_t* segment, TempDataRes_t temp_res)
+{
+    if (segment == NULL || temp_res.width == 0 || temp_res.height == 0)
+    {
+        return SEGMENT_ERROR_PARAM;
+    }
+    memset(segment, 0, sizeof(Segment_t));
+    segment->temp_res = temp_res;
+    segment->words = (temp_res.width + 63) / 64;
+    //runs of one row are separated by a background pixel, at most width / 2 + 1 of them
+    uint32_t run_cap = temp_res.width / 2 + 1;
+    segment->label_cap = run_cap * temp_res.height;
+    size_t mask_size = (size_t)segment->words * temp_res.height * sizeof(uint64_t);
+    segment->mask = (uint64_t*)malloc(mask_size);
+    segment->tmp = (uint64_t*)malloc(mask_size);
+    segment->row_mask = (uint8_t*)malloc(temp_res.width);
+    segment->run_x0 = (uint16_t*)malloc(2 * run_cap * sizeof(uint16_t));
+    segment->run_x1 = (uint16_t*)malloc(2 * run_cap * sizeof(uint16_t));
+    segment->run_label = (uint32_t*)malloc(2 * run_cap * sizeof(uint32_t));
+    segment->parent = (uint32_t*)malloc(segment->label_cap * sizeof(uint32_t));
+    segment->label_blob = (SegmentLabel_t*)malloc(segment->label_cap * sizeof(SegmentLabel_t));
+    if (segment->mask == NULL || segment->tmp == NULL || segment->row_mask == NULL || segment->run_x0 == NULL || \
+        segment->run_x1 == NULL || segment->run_label == NULL || segment->parent == NULL || segment->label_blob == NULL)
+    {
+        segment_release(segment);
+        return SEGMENT_ERROR_MEM;
+    }
+    memset(segment->mask, 0, mask_size);
+    return SEGMENT_SUCCESS;
+}
+
+void segment_release(Segment_t* segment)
+{
+    if (segment == NULL)
+    {
+        return;
+    }
+    free(segment->mask);
+    free(segment->tmp);
+    free(segment->row_mask);
+    free(segment->run_x0);
+    free(segment->run_x1);
+    free(segment->run_label);
+    free(segment->parent);
+    free(segment->label_blob);
+    memset(segment, 0, sizeof(Segment_t));
+}
+
+//bit i of the result is the low bit of byte i
+static inline uint64_t segment_pack8(uint64_t bytes)
+{
+    return ((bytes & 0x0101010101010101ULL) * 0x0102040810204080ULL) >> 56;
+}
+
+//[low_temp, high_temp] of every row, 64 pixels per word
+static void segment_mask_build(Segment_t* segment, const uint16_t* temp_data, const SegmentParam_t* param)
+{
+    int width = segment->temp_res.width, height = segment->temp_res.height;
+    uint8_t* row_mask = segment->row_mask;
+    //1 in range, 2 above. without a value above high_temp the second threshold marks the range itself
+    int full = (param->high_temp == 0xFFFF);
+    uint16_t hi = full ? param->low_temp : (uint16_t)(param->high_temp + 1);
+    int shift = full ? 1 : 0;
+    for (int y = 0; y < height; y++)
+    {
+        uint64_t* dst = segment->mask + y * segment->words;
+        simd_threshold2_u16(temp_data + y * width, width, param->low_temp, hi, row_mask);
+        memset(dst, 0, segment->words * sizeof(uint64_t));
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            uint64_t bytes;
+            memcpy(&bytes, row_mask + x, 8);
+            dst[x >> 6] |= segment_pack8(bytes >> shift) << (x & 63);
+        }
+        for (; x < width; x++)
+        {
+            dst[x >> 6] |= (uint64_t)((row_mask[x] >> shift) & 1) << (x & 63);
+        }
+    }
+}
+
+//one 3x3 erosion (and of the 9 neighbours, the outside counts as foreground so blobs at the border
+//keep their edge) or dilation (or, the outside is background), mask -> tmp across, tmp -> mask down
+static void segment_morph(Segment_t* segment, int erode)
+{
+    int words = segment->words, height = segment->temp_res.height;
+    int tail = segment->temp_res.width & 63;
+    uint64_t valid = (tail == 0) ? ~0ULL : ((1ULL << tail) - 1);
+    uint64_t fill = erode ? ~0ULL : 0;
+    for (int y = 0; y < height; y++)
+    {
+        const uint64_t* src = segment->mask + y * words;
+        uint64_t* dst = segment->tmp + y * words;
+        uint64_t prev = fill;
+        uint64_t cur = src[0] | ((words == 1) ? (~valid & fill) : 0);
+        for (int k = 0; k < words; k++)
+        {
+            uint64_t next = (k + 1 < words) ? (src[k + 1] | ((k + 2 == words) ? (~valid & fill) : 0)) : fill;
+            uint64_t left = (cur << 1) | (prev >> 63);
+            uint64_t right = (cur >> 1) | (next << 63);
+            dst[k] = erode ? (cur & left & right) : (cur | left | right);
+            prev = cur;
+            cur = next;
+        }
+    }
+    for (int y = 0; y < height; y++)
+    {
+        const uint64_t* up = (y > 0) ? segment->tmp + (y - 1) * words : NULL;
+        const uint64_t* mid = segment->tmp + y * words;
+        const uint64_t* down = (y + 1 < height) ? segment->tmp + (y + 1) * words : NULL;
+        uint64_t* dst = segment->mask + y * words;
+        for (int k = 0; k < words; k++)
+        {
+            uint64_t a = (up != NULL) ? up[k] : fill;
+            uint64_t b = (down != NULL) ? down[k] : fill;
+            dst[k] = erode ? (a & mid[k] & b) : (a | mid[k] | b);
+        }
+        dst[words - 1] &= valid;
+    }
+}
+
+//path halving, the roots stay the smallest label of their set
+static inline uint32_t segment_find(uint32_t* parent, uint32_t label)
+{
+    while (parent[label] != label)
+    {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+    return label;
+}
+
+//the peak keeps the first pixel in raster order on ties
+static void segment_label_merge(SegmentLabel_t* dst, const SegmentLabel_t* src)
+{
+    SegmentBlob_t* d = &dst->blob;
+    const SegmentBlob_t* s = &src->blob;
+    d->area += s->area;
+    dst->sum_x += src->sum_x;
+    dst->sum_y += src->sum_y;
+    if (s->max_temp > d->max_temp || (s->max_temp == d->max_temp && \
+        (s->max_y < d->max_y || (s->max_y == d->max_y && s->max_x < d->max_x))))
+    {
+        d->max_temp = s->max_temp;
+        d->max_x = s->max_x;
+        d->max_y = s->max_y;
+    }
+    d->x0 = (s->x0 < d->x0) ? s->x0 : d->x0;
+    d->y0 = (s->y0 < d->y0) ? s->y0 : d->y0;
+    d->x1 = (s->x1 > d->x1) ? s->x1 : d->x1;
+    d->y1 = (s->y1 > d->y1) ? s->y1 : d->y1;
+}
+
+static uint32_t segment_union(Segment_t* segment, uint32_t a, uint32_t b)
+{
+    a = segment_find(segment->parent, a);
+    b = segment_find(segment->parent, b);
+    if (a == b)
+    {
+        return a;
+    }
+    if (b < a)
+    {
+        uint32_t t = a;
+        a = b;
+        b = t;
+    }
+    segment->parent[b] = a;
+    segment_label_merge(&segment->label_blob[a], &segment->label_blob[b]);
+    return a;
+}
+
+//a blob over SEGMENT_MAX_BLOBS replaces the smallest one kept
+static void segment_blob_keep(Segment_t* segment, const SegmentLabel_t* label)
+{
+    SegmentBlob_t blob = label->blob;
+    blob.cx = (uint16_t)((label->sum_x + blob.area / 2) / blob.area);
+    blob.cy = (uint16_t)((label->sum_y + blob.area / 2) / blob.area);
+    segment->stats.blobs++;
+    if (segment->blob_num < SEGMENT_MAX_BLOBS)
+    {
+        segment->blobs[segment->blob_num++] = blob;
+        return;
+    }
+    segment->stats.dropped_blobs++;
+    int smallest = 0;
+    for (int i = 1; i < SEGMENT_MAX_BLOBS; i++)
+    {
+        if (segment->blobs[i].area < segment->blobs[smallest].area)
+        {
+            smallest = i;
+        }
+    }
+    if (blob.area > segment->blobs[smallest].area)
+    {
+        segment->blobs[smallest] = blob;
+    }
+}
+
+//first run of a mask row at or after x, returns 0 when there is none
+static inline int segment_run_next(const uint64_t* row, int words, int width, int* x, int* x1)
+{
+    int k = *x >> 6;
+    if (k >= words)
+    {
+        return 0;
+    }
+    uint64_t word = row[k] & (~0ULL << (*x & 63));
+    while (word == 0)
+    {
+        if (++k >= words)
+        {
+            return 0;
+        }
+        word = row[k];
+    }
+    int start = (k << 6) + segment_ctz(word);
+    //the end is the first background pixel after start, the bits past width are background
+    word = ~row[k] & (~0ULL << (start & 63));
+    while (word == 0 && ++k < words)
+    {
+        word = ~row[k];
+    }
+    int end = (word == 0) ? width : (k << 6) + segment_ctz(word);
+    *x = start;
+    *x1 = ((end > width) ? width : end) - 1;
+    return 1;
+}
+
+//the same raster pass as the alarm engine, over the runs of the cleaned mask
+static void segment_label(Segment_t* segment, const uint16_t* temp_data, uint32_t min_area)
+{
+    int width = segment->temp_res.width, height = segment->temp_res.height;
+    int words = segment->words;
+    int run_cap = width / 2 + 1;
+    uint16_t* prev_x0 = segment->run_x0;
+    uint16_t* prev_x1 = segment->run_x1;
+    uint32_t* prev_label = segment->run_label;
+    uint16_t* cur_x0 = prev_x0 + run_cap;
+    uint16_t* cur_x1 = prev_x1 + run_cap;
+    uint32_t* cur_label = prev_label + run_cap;
+    uint32_t* parent = segment->parent;
+    uint32_t label_num = 0;
+    int prev_num = 0;
+    segment->pix_num = 0;
+
+    for (int y = 0; y < height; y++)
+    {
+        const uint64_t* mask = segment->mask + y * words;
+        const uint16_t* row = temp_data + y * width;
+        int cur_num = 0, p = 0, x = 0, x1 = 0;
+        while (segment_run_next(mask, words, width, &x, &x1))
+        {
+            SegmentLabel_t run;
+            run.blob.max_temp = row[x];
+            run.blob.max_x = (uint16_t)x;
+            run.blob.max_y = (uint16_t)y;
+            run.blob.x0 = (uint16_t)x;
+            run.blob.x1 = (uint16_t)x1;
+            run.blob.y0 = run.blob.y1 = (uint16_t)y;
+            run.blob.area = x1 - x + 1;
+            run.sum_x = (uint64_t)(x + x1) * run.blob.area / 2;
+            run.sum_y = (uint64_t)y * run.blob.area;
+            for (int i = x + 1; i <= x1; i++)
+            {
+                if (row[i] > run.blob.max_temp)
+                {
+                    run.blob.max_temp = row[i];
+                    run.blob.max_x = (uint16_t)i;
+                }
+            }
+            segment->pix_num += run.blob.area;
+            x = x1 + 1;
+
+            //8-connected: every run of the row above overlapping [x0 - 1, x1 + 1]
+            while (p < prev_num && prev_x1[p] + 1 < run.blob.x0)
+            {
+                p++;
+            }
+            uint32_t label = SEGMENT_NO_LABEL;
+            int q = p;
+            for (; q < prev_num && prev_x0[q] <= run.blob.x1 + 1; q++)
+            {
+                label = (label == SEGMENT_NO_LABEL) ? segment_find(parent, prev_label[q]) : \
+                    segment_union(segment, label, prev_label[q]);
+            }
+            //the last one may reach the next run of this row as well
+            if (q > p)
+            {
+                p = q - 1;
+            }
+            if (label == SEGMENT_NO_LABEL)
+            {
+                label = label_num++;
+                parent[label] = label;
+                segment->label_blob[label] = run;
+            }
+            else
+            {
+                segment_label_merge(&segment->label_blob[label], &run);
+            }
+            cur_x0[cur_num] = run.blob.x0;
+            cur_x1[cur_num] = run.blob.x1;
+            cur_label[cur_num] = label;
+            cur_num++;
+        }
+
+        uint16_t* t16 = prev_x0;
+        prev_x0 = cur_x0;
+        cur_x0 = t16;
+        t16 = prev_x1;
+        prev_x1 = cur_x1;
+        cur_x1 = t16;
+        uint32_t* t32 = prev_label;
+        prev_label = cur_label;
+        cur_label = t32;
+        prev_num = cur_num;
+    }
+
+    segment->blob_num = 0;
+    for (uint32_t label = 0; label < label_num; label++)
+    {
+        if (parent[label] == label && segment->label_blob[label].blob.area >= min_area)
+        {
+            segment_blob_keep(segment, &segment->label_blob[label]);
+        }
+    }
+}
+
+int segment_process(Segment_t* segment, const uint16_t* temp_data, const SegmentParam_t* param)
+{
+    if (segment == NULL || segment->mask == NULL || temp_data == NULL || param == NULL || \
+        param->low_temp > param->high_temp)
+    {
+        return SEGMENT_ERROR_PARAM;
+    }
+    segment_mask_build(segment, temp_data, param);
+    for (int i = 0; i < param->open; i++)
+    {
+        segment_morph(segment, 1);
+    }
+    for (int i = 0; i < param->open; i++)
+    {
+        segment_morph(segment, 0);
+    }
+    for (int i = 0; i < param->close; i++)
+    {
+        segment_morph(segment, 0);
+    }
+    for (int i = 0; i < param->close; i++)
+    {
+        segment_morph(segment, 1);
+    }
+    segment_label(segment, temp_data, param->min_area);
+    segment->stats.frames++;
+    return segment->blob_num;
+}
+
+int segment_stats(Segment_t* segment, SegmentStats_t* stats)
+{
+    if (segment == NULL || stats == NULL)
+    {
+        return SEGMENT_ERROR_PARAM;
+    }
+    *stats = segment->stats;
+    return SEGMENT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+#ifndef _SEGMENT_H_
+#define _SEGMENT_H_
+
+#include <stdint.h>
+#include "libirtemp.h"
+
+#define SEGMENT_MAX_BLOBS 256           //blobs kept per frame, the largest ones
+
+#define SEGMENT_SUCCESS 0
+#define SEGMENT_ERROR_PARAM -1
+#define SEGMENT_ERROR_MEM -2
+
+typedef struct {
+    uint16_t low_temp;                  //raw temp values (kelvin * 64), pixels in [low_temp, high_temp] are foreground
+    uint16_t high_temp;
+    uint8_t open;                       //opening radius: open 3x3 erosions then as many dilations, removes specks and bridges
+    uint8_t close;                      //closing radius after the opening: dilations then erosions, fills pinholes
+    uint32_t min_area;                  //smaller blobs are dropped, 0 keeps every blob
+}SegmentParam_t;
+
+//one 8-connected component of the cleaned mask, raw temps, the box is inclusive
+typedef struct {
+    uint32_t area;
+    uint16_t max_temp;
+    uint16_t max_x;
+    uint16_t max_y;
+    uint16_t x0;
+    uint16_t y0;
+    uint16_t x1;
+    uint16_t y1;
+    uint16_t cx;                        //centroid, rounded
+    uint16_t cy;
+}SegmentBlob_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t blobs;                     //kept, at min_area or larger
+    uint64_t dropped_blobs;             //over SEGMENT_MAX_BLOBS
+}SegmentStats_t;
+
+typedef struct {
+    SegmentBlob_t blob;
+    uint64_t sum_x;
+    uint64_t sum_y;
+}SegmentLabel_t;
+
+//people detection in the temp plane: a range mask packed 64 pixels per word, 3x3 morphology on whole words
+//(the rows above and below, the words shifted by one pixel), and the runs of the cleaned mask labelled in one
+//raster pass like the alarm engine, the blob statistics merged at the union-find roots
+typedef struct {
+    TempDataRes_t temp_res;
+    int words;                          //uint64_t per mask row, bit x % 64 of word x / 64 is pixel x
+    uint64_t* mask;                     //the cleaned mask of the last frame, the bits past width stay 0
+    uint64_t* tmp;
+    uint8_t* row_mask;                  //simd_threshold2_u16 of one row
+    uint16_t* run_x0;                   //runs of the previous and the current row
+    uint16_t* run_x1;
+    uint32_t* run_label;
+    uint32_t* parent;
+    SegmentLabel_t* label_blob;         //accumulated at the root while the frame is scanned
+    uint32_t label_cap;
+    SegmentBlob_t blobs[SEGMENT_MAX_BLOBS];
+    int blob_num;
+    uint32_t pix_num;                   //foreground pixels of the cleaned mask
+    SegmentStats_t stats;
+}Segment_t;
+
+int segment_init(Segment_t* segment, TempDataRes_t temp_res);
+
+void segment_release(Segment_t* segment);
+
+//one temp frame: mask, morphology, labelling. the blobs stay in segment->blobs in raster order of their
+//first pixel, segment->mask holds the cleaned mask. returns the number of blobs or an error code
+int segment_process(Segment_t* segment, const uint16_t* temp_data, const SegmentParam_t* param);
+
+static inline int segment_mask_get(const Segment_t* segment, int x, int y)
+{
+    return (int)((segment->mask[y * segment->words + (x >> 6)] >> (x & 63)) & 1);
+}
+
+int segment_stats(Segment_t* segment, SegmentStats_t* stats);
+
+#endif
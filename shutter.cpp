@@ -0,0 +1,154 @@
+#include "shutter.h"
+#include <string.h>
+#include "data.h"
+#include "ring.h"
+#include "cmdq.h"
+#include "thermal_cam_cmd.h"
+
+//runs on the cmdq worker
+static int shutter_mon_poll(void* arg)
+{
+    ShutterMon_t* mon = (ShutterMon_t*)arg;
+    uint8_t shutter_en = 0, shutter_state = 0;
+    int rst = shutter_sta_get(&shutter_en, &shutter_state);
+    if (rst == IRUVC_SUCCESS)
+    {
+        pthread_mutex_lock(&mon->mutex);
+        mon->device_closed = (shutter_state == 0);
+        mon->stats.polls++;
+        pthread_mutex_unlock(&mon->mutex);
+    }
+    return rst;
+}
+
+static void shutter_mon_poll_done(int job_id, int result, void* user_data)
+{
+    ShutterMon_t* mon = (ShutterMon_t*)user_data;
+    pthread_mutex_lock(&mon->mutex);
+    mon->poll_pending = 0;
+    pthread_cond_broadcast(&mon->cond);
+    pthread_mutex_unlock(&mon->mutex);
+}
+
+int shutter_mon_init(ShutterMon_t* mon, const ShutterMonParam_t* param)
+{
+    if (mon == NULL)
+    {
+        return SHUTTER_MON_ERROR_PARAM;
+    }
+    memset(mon, 0, sizeof(ShutterMon_t));
+    if (param != NULL)
+    {
+        mon->param = *param;
+    }
+    else
+    {
+        mon->param.poll_interval_ms = SHUTTER_MON_POLL_MS;
+        mon->param.hold_ms = SHUTTER_MON_HOLD_MS;
+        mon->param.range_drop = SHUTTER_MON_RANGE_DROP;
+    }
+    pthread_mutex_init(&mon->mutex, NULL);
+    pthread_cond_init(&mon->cond, NULL);
+    return SHUTTER_MON_SUCCESS;
+}
+
+void shutter_mon_release(ShutterMon_t* mon)
+{
+    if (mon == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&mon->mutex);
+    while (mon->poll_pending)
+    {
+        pthread_cond_wait(&mon->cond, &mon->mutex);
+    }
+    pthread_mutex_unlock(&mon->mutex);
+    pthread_mutex_destroy(&mon->mutex);
+    pthread_cond_destroy(&mon->cond);
+}
+
+//flat: the closed shutter fills the view. frozen: the sensor repeats its last frame during the nuc,
+//live frames never have exactly the same min, max and mean
+static uint8_t shutter_mon_detect(ShutterMon_t* mon, const FrameStats_t* stats, uint64_t timestamp_us)
+{
+    uint32_t range = stats->max_val - stats->min_val;
+    uint8_t flat = (mon->range_avg > 0.0f && range < mon->range_avg * mon->param.range_drop);
+    if (flat && mon->in_event && !mon->device_closed && \
+        timestamp_us - mon->event_start_us > (uint64_t)SHUTTER_MON_MAX_EVENT_MS * 1000)
+    {
+        //no shutter stays closed this long on its own, the scene itself went flat
+        mon->range_avg = (float)range;
+        flat = 0;
+    }
+    uint8_t frozen = (mon->range_avg > 0.0f && stats->min_val == mon->last_min && stats->max_val == mon->last_max && \
+        stats->mean == mon->last_mean);
+    mon->last_min = stats->min_val;
+    mon->last_max = stats->max_val;
+    mon->last_mean = stats->mean;
+    if (!flat && !frozen)
+    {
+        mon->range_avg = (mon->range_avg == 0.0f) ? (float)range : mon->range_avg + (range - mon->range_avg) / 16;
+    }
+    return flat || frozen;
+}
+
+uint32_t shutter_mon_frame(ShutterMon_t* mon, const FrameStats_t* stats, uint64_t timestamp_us)
+{
+    if (mon == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&mon->mutex);
+    if (mon->param.poll_interval_ms > 0 && !mon->poll_pending && \
+        timestamp_us - mon->last_poll_us >= (uint64_t)mon->param.poll_interval_ms * 1000)
+    {
+        mon->last_poll_us = timestamp_us;
+        mon->poll_pending = 1;
+        if (cmdq_submit(shutter_mon_poll, mon, CMDQ_PRIORITY_READ, 0, shutter_mon_poll_done, mon, NULL) \
+            != CMDQ_SUCCESS)
+        {
+            mon->poll_pending = 0;
+        }
+    }
+
+    uint8_t event = mon->device_closed;
+    if (stats != NULL && stats->valid)
+    {
+        event |= shutter_mon_detect(mon, stats, timestamp_us);
+    }
+    if (event)
+    {
+        if (!mon->in_event)
+        {
+            mon->stats.events++;
+            mon->event_start_us = timestamp_us;
+        }
+        mon->in_event = 1;
+        mon->hold_until_us = timestamp_us + (uint64_t)mon->param.hold_ms * 1000;
+    }
+    else
+    {
+        mon->in_event = 0;
+    }
+    uint32_t flags = 0;
+    if (event || timestamp_us < mon->hold_until_us)
+    {
+        mon->stats.frames++;
+        flags = FRAME_DESC_SHUTTER_NUC;
+    }
+    pthread_mutex_unlock(&mon->mutex);
+    return flags;
+}
+
+int shutter_mon_stats(ShutterMon_t* mon, ShutterMonStats_t* stats)
+{
+    if (mon == NULL || stats == NULL)
+    {
+        return SHUTTER_MON_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&mon->mutex);
+    *stats = mon->stats;
+    pthread_mutex_unlock(&mon->mutex);
+    return SHUTTER_MON_SUCCESS;
+}
@@ -0,0 +1,60 @@
+#ifndef _SHUTTER_H_
+#define _SHUTTER_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "stats.h"
+
+#define SHUTTER_MON_POLL_MS 1000        //shutter_sta_get between two frames through the command queue
+#define SHUTTER_MON_HOLD_MS 300         //frames after the event are still tagged, the nuc settles
+#define SHUTTER_MON_RANGE_DROP 0.25f    //a frame whose min..max range falls below this share of the usual one
+#define SHUTTER_MON_MAX_EVENT_MS 2000   //flat for longer without the device reporting the shutter: a flat scene
+
+#define SHUTTER_MON_SUCCESS 0
+#define SHUTTER_MON_ERROR_PARAM -1
+
+typedef struct {
+    uint32_t poll_interval_ms;          //0 leaves the device alone and detects from the statistics only
+    uint32_t hold_ms;
+    float range_drop;
+}ShutterMonParam_t;
+
+typedef struct {
+    uint64_t events;                    //shutter closes or nuc freezes seen
+    uint64_t frames;                    //frames tagged FRAME_DESC_SHUTTER_NUC
+    uint64_t polls;                     //shutter_sta_get answers
+}ShutterMonStats_t;
+
+//tags the frames of one camera that a shutter close or nuc spoiled, manual, automatic or the exposure guard's:
+//the device's shutter state polled at a low rate, plus frames that come out flat (the shutter) or repeated
+//(frozen during the nuc) by their statistics. consumers hold their last good output for tagged frames
+typedef struct ShutterMon_t {
+    ShutterMonParam_t param;
+    uint8_t device_closed;              //last poll answer
+    uint8_t poll_pending;
+    uint64_t last_poll_us;
+    float range_avg;                    //moving average of max - min over good frames, 0 before the first
+    uint16_t last_min;
+    uint16_t last_max;
+    float last_mean;
+    uint8_t in_event;
+    uint64_t event_start_us;
+    uint64_t hold_until_us;
+    ShutterMonStats_t stats;
+    pthread_mutex_t mutex;              //the cmdq worker answers the polls
+    pthread_cond_t cond;
+}ShutterMon_t;
+
+//param NULL selects the SHUTTER_MON_xxx defaults
+int shutter_mon_init(ShutterMon_t* mon, const ShutterMonParam_t* param);
+
+//wait for a queued poll and release the monitor
+void shutter_mon_release(ShutterMon_t* mon);
+
+//one frame from the stream thread with the statistics of its temp plane (or image plane without one),
+//returns the FRAME_DESC_xxx flags for the frame
+uint32_t shutter_mon_frame(ShutterMon_t* mon, const FrameStats_t* stats, uint64_t timestamp_us);
+
+int shutter_mon_stats(ShutterMon_t* mon, ShutterMonStats_t* stats);
+
+#endif
@@ -0,0 +1,3587 @@
+#include "simd.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SIMD_TARGET_SSE41
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_AVX512
+#else
+#define SIMD_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw")))
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+static int simd_detected = -1;
+static int simd_level = -1;
+
+SimdLevel_t simd_level_detect(void)
+{
+	if (simd_detected >= 0)
+	{
+		return (SimdLevel_t)simd_detected;
+	}
+
+	int level = SIMD_LEVEL_SCALAR;
+#if defined(SIMD_X86)
+#if defined(_MSC_VER)
+	int info[4] = { 0 };
+	__cpuid(info, 1);
+	if (info[2] & (1 << 19))
+	{
+		level = SIMD_LEVEL_SSE41;
+	}
+	//avx2 also needs the os to save the ymm registers
+	if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6))
+	{
+		__cpuidex(info, 7, 0);
+		if (info[1] & (1 << 5))
+		{
+			level = SIMD_LEVEL_AVX2;
+		}
+		//avx-512 f and bw, with the opmask and zmm state enabled as well
+		if ((info[1] & (1 << 16)) && (info[1] & (1 << 30)) && ((_xgetbv(0) & 0xE6) == 0xE6))
+		{
+			level = SIMD_LEVEL_AVX512;
+		}
+	}
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.1"))
+	{
+		level = SIMD_LEVEL_SSE41;
+	}
+	if (__builtin_cpu_supports("avx2"))
+	{
+		level = SIMD_LEVEL_AVX2;
+	}
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+	{
+		level = SIMD_LEVEL_AVX512;
+	}
+#endif
+#elif defined(SIMD_NEON)
+	level = SIMD_LEVEL_NEON;
+#endif
+
+	simd_detected = level;
+	return (SimdLevel_t)level;
+}
+
+SimdLevel_t simd_level_get(void)
+{
+	if (simd_level < 0)
+	{
+		simd_level = simd_level_detect();
+	}
+	return (SimdLevel_t)simd_level;
+}
+
+void simd_level_set(SimdLevel_t level)
+{
+	SimdLevel_t detected = simd_level_detect();
+	//neon and the x86 levels are not ordered against each other
+	int x86 = (level != SIMD_LEVEL_NEON && detected != SIMD_LEVEL_NEON);
+	if (level == SIMD_LEVEL_SCALAR || level == detected || (x86 && level < detected))
+	{
+		simd_level = level;
+	}
+	else
+	{
+		simd_level = detected;
+	}
+}
+
+const char* simd_level_name(SimdLevel_t level)
+{
+	switch (level)
+	{
+	case SIMD_LEVEL_SSE41:
+		return "sse4.1";
+	case SIMD_LEVEL_AVX2:
+		return "avx2";
+	case SIMD_LEVEL_NEON:
+		return "neon";
+	case SIMD_LEVEL_AVX512:
+		return "avx512";
+	case SIMD_LEVEL_SCALAR:
+	default:
+		return "scalar";
+	}
+}
+
+
+static void minmax_u16_scalar(const uint16_t* src, int pix_num, uint16_t* min_val, uint16_t* max_val)
+{
+	uint16_t min_tmp = 65535, max_tmp = 0;
+	for (int i = 0; i < pix_num; i++)
+	{
+		if (src[i] < min_tmp) min_tmp = src[i];
+		if (src[i] > max_tmp) max_tmp = src[i];
+	}
+	*min_val = min_tmp;
+	*max_val = max_tmp;
+}
+
+static void stretch_u16_scalar(const uint16_t* src, int pix_num, uint16_t min_val, uint32_t range, uint16_t* dst)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		dst[i] = (uint16_t)(((uint32_t)(src[i] - min_val) * 16383) / range);
+	}
+}
+
+static int range_minmax_u16_scalar(const uint16_t* src, int pix_num, uint16_t lo, uint16_t hi, \
+	uint16_t* min_val, uint16_t* max_val)
+{
+	int count = 0;
+	uint16_t min_tmp = 65535, max_tmp = 0;
+	for (int i = 0; i < pix_num; i++)
+	{
+		uint16_t v = src[i];
+		if (v >= lo && v <= hi)
+		{
+			count++;
+			if (v < min_tmp) min_tmp = v;
+			if (v > max_tmp) max_tmp = v;
+		}
+	}
+	*min_val = min_tmp;
+	*max_val = max_tmp;
+	return count;
+}
+
+static void u16_to_f32_scalar(const uint16_t* src, int pix_num, double scale, double offset, float* dst)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		dst[i] = (float)(src[i] * scale + offset);
+	}
+}
+
+static inline int16_t s16_saturate(int32_t v)
+{
+	return (int16_t)((v > 32767) ? 32767 : ((v < -32768) ? -32768 : v));
+}
+
+static void u16_to_s16_fixed_scalar(const uint16_t* src, int pix_num, uint32_t mul, int shift, int32_t offset, int16_t* dst)
+{
+	uint32_t round = (1u << shift) >> 1;
+	for (int i = 0; i < pix_num; i++)
+	{
+		dst[i] = s16_saturate((int32_t)((src[i] * mul + round) >> shift) + offset);
+	}
+}
+
+static void u16_to_s8_fixed_scalar(const uint16_t* src, int pix_num, uint32_t mul, int shift, int32_t offset, int8_t* dst)
+{
+	uint32_t round = (1u << shift) >> 1;
+	for (int i = 0; i < pix_num; i++)
+	{
+		int32_t v = (int32_t)((src[i] * mul + round) >> shift) + offset;
+		dst[i] = (int8_t)((v > 127) ? 127 : ((v < -128) ? -128 : v));
+	}
+}
+
+//outputs [start, num) of simd_reduce2x2_u16
+static void reduce2x2_u16_scalar(const uint16_t* const* rows, int start, int num, uint16_t* min_dst, \
+	uint16_t* max_dst, uint16_t* mean_dst)
+{
+	for (int i = start; i < num; i++)
+	{
+		int x = 2 * i;
+		uint16_t lo0 = (rows[0][x] < rows[0][x + 1]) ? rows[0][x] : rows[0][x + 1];
+		uint16_t lo1 = (rows[1][x] < rows[1][x + 1]) ? rows[1][x] : rows[1][x + 1];
+		uint16_t hi0 = (rows[2][x] > rows[2][x + 1]) ? rows[2][x] : rows[2][x + 1];
+		uint16_t hi1 = (rows[3][x] > rows[3][x + 1]) ? rows[3][x] : rows[3][x + 1];
+		min_dst[i] = (lo0 < lo1) ? lo0 : lo1;
+		max_dst[i] = (hi0 > hi1) ? hi0 : hi1;
+		mean_dst[i] = (uint16_t)(((uint32_t)rows[4][x] + rows[4][x + 1] + rows[5][x] + rows[5][x + 1] + 2) >> 2);
+	}
+}
+
+static void delta_zigzag_u16_scalar(const uint16_t* cur, const uint16_t* ref, int pix_num, uint16_t* dst)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		int16_t d = (int16_t)(cur[i] - ref[i]);
+		dst[i] = (uint16_t)((d << 1) ^ (d >> 15));
+	}
+}
+
+static void delta_zigzag_deadband_u16_scalar(const uint16_t* cur, uint16_t* ref, int pix_num, uint16_t deadband, \
+	uint16_t* dst)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		int16_t d = (int16_t)(cur[i] - ref[i]);
+		uint16_t a = (uint16_t)((d < 0) ? -d : d);
+		if (a > deadband)
+		{
+			dst[i] = (uint16_t)((d << 1) ^ (d >> 15));
+			ref[i] = cur[i];
+		}
+		else
+		{
+			dst[i] = 0;
+		}
+	}
+}
+
+static void undelta_zigzag_u16_scalar(const uint16_t* src, const uint16_t* ref, int pix_num, uint16_t* dst)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		uint16_t z = src[i];
+		dst[i] = (uint16_t)(ref[i] + ((z >> 1) ^ (uint16_t)(0 - (z & 1))));
+	}
+}
+
+static void accumulate_u16_scalar(const uint16_t* src, int pix_num, uint32_t* acc)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		acc[i] += src[i];
+	}
+}
+
+static void accumulate_sq_u16_scalar(const uint16_t* src, const uint16_t* ref, int pix_num, uint32_t* sum, uint64_t* sq)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		int64_t d = (int32_t)src[i] - (int32_t)ref[i];
+		sum[i] += src[i];
+		sq[i] += (uint64_t)(d * d);
+	}
+}
+
+static void window_u16_scalar(const uint16_t* in, const uint16_t* out, int pix_num, uint32_t* sum)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		sum[i] += (uint32_t)in[i] - (uint32_t)out[i];
+	}
+}
+
+static void hold_u16_scalar(const uint16_t* src, int pix_num, uint16_t decay, uint16_t* max_val, uint16_t* min_val)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		uint16_t hi = (max_val[i] > decay) ? (uint16_t)(max_val[i] - decay) : 0;
+		uint16_t lo = (min_val[i] < 65535 - decay) ? (uint16_t)(min_val[i] + decay) : 65535;
+		max_val[i] = (src[i] > hi) ? src[i] : hi;
+		min_val[i] = (src[i] < lo) ? src[i] : lo;
+	}
+}
+
+static void rate_u16_scalar(const uint16_t* src, int pix_num, int level_shift, int slope_shift, uint32_t mul, \
+	int32_t* level, int32_t* slope, uint16_t* dst)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		int32_t l = level[i] + ((((int32_t)src[i] << 8) - level[i]) >> level_shift);
+		int32_t s = slope[i] + (l - level[i]) - (slope[i] >> slope_shift);
+		level[i] = l;
+		slope[i] = s;
+		s >>= slope_shift;
+		uint32_t c = (s < 0) ? 0 : ((s > SIMD_RATE_SLOPE_MAX) ? SIMD_RATE_SLOPE_MAX : (uint32_t)s);
+		uint32_t r = (c * mul) >> 12;
+		dst[i] = (uint16_t)((r > 65535) ? 65535 : r);
+	}
+}
+
+static void background_u16_scalar(const uint16_t* src, int pix_num, int shift, int32_t var_floor, int32_t* mean, \
+	int32_t* var, uint16_t* dst)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		int32_t d = ((int32_t)src[i] << 8) - mean[i];
+		mean[i] += d >> shift;
+		int32_t q = d >> 4;
+		q = (q > 32767) ? 32767 : ((q < -32767) ? -32767 : q);
+		int32_t d2 = q * q;
+		int32_t v0 = var[i];
+		var[i] = v0 + ((d2 - v0) >> shift);
+		float z = (float)d2 * 16.0f / (float)((v0 > var_floor) ? v0 : var_floor);
+		z = (z < 65535.0f) ? z : 65535.0f;
+		dst[i] = (uint16_t)(int32_t)z;
+	}
+}
+
+static void gather_mean4_u16_scalar(const uint16_t* src, const uint32_t* nbr, int stride, int num, uint16_t* dst)
+{
+	for (int i = 0; i < num; i++)
+	{
+		dst[i] = (uint16_t)(((uint32_t)src[nbr[i]] + src[nbr[stride + i]] + src[nbr[2 * stride + i]] + \
+			src[nbr[3 * stride + i]] + 2) >> 2);
+	}
+}
+
+static void gather_weight4_u16_scalar(const uint16_t* src, const uint32_t* idx, const uint16_t* weight, int stride, \
+	int num, uint16_t* dst)
+{
+	for (int i = 0; i < num; i++)
+	{
+		uint32_t acc = 128;
+		for (int k = 0; k < 4; k++)
+		{
+			acc += (uint32_t)src[idx[k * stride + i]] * weight[k * stride + i];
+		}
+		dst[i] = (uint16_t)(acc >> 8);
+	}
+}
+
+static void lut4_lerp_u16_scalar(const uint16_t* src, int num, uint16_t low, uint16_t high, uint32_t scale, \
+	const uint16_t* const* lut, const uint16_t* wx, uint16_t wy, uint16_t* dst)
+{
+	for (int i = 0; i < num; i++)
+	{
+		uint32_t v = src[i];
+		v = (v < low) ? low : ((v > high) ? high : v);
+		uint32_t b = ((v - low) * scale) >> 16;
+		uint32_t a = (uint32_t)lut[0][b] * (256 - wx[i]) + (uint32_t)lut[1][b] * wx[i];
+		uint32_t c = (uint32_t)lut[2][b] * (256 - wx[i]) + (uint32_t)lut[3][b] * wx[i];
+		dst[i] = (uint16_t)((a * (256 - wy) + c * wy + 32768) >> 16);
+	}
+}
+
+static void lut32_u16_scalar(const uint16_t* src, int num, int shift, uint32_t lo, uint32_t hi, const uint16_t* index, \
+	const uint32_t* lut, uint32_t* dst)
+{
+	for (int i = 0; i < num; i++)
+	{
+		uint32_t v = (uint32_t)src[i] >> shift;
+		v = ((v < lo) ? lo : ((v > hi) ? hi : v)) - lo;
+		dst[i] = lut[(index != NULL) ? index[v] : v];
+	}
+}
+
+static void dde_u16_scalar(const uint16_t* src, const uint32_t* sum, int num, uint32_t inv, const uint16_t* lut, \
+	int32_t gain, uint16_t* dst)
+{
+	for (int i = 0; i < num; i++)
+	{
+		int32_t base = (int32_t)(((uint64_t)sum[i] * inv) >> 32);
+		int32_t d = ((int32_t)src[i] << 2) - base;
+		int32_t v = (int32_t)lut[(base + 2) >> 2] + ((d * gain + 512) >> 10);
+		dst[i] = (uint16_t)((v < 0) ? 0 : ((v > 16383) ? 16383 : v));
+	}
+}
+
+static void threshold2_u16_scalar(const uint16_t* src, int pix_num, uint16_t lo, uint16_t hi, uint8_t* dst)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		dst[i] = (uint8_t)((src[i] >= lo) + (src[i] >= hi));
+	}
+}
+
+static void tnr_u16_scalar(const uint16_t* src, int shift, int pix_num, uint16_t low, uint16_t range, \
+	uint16_t still_weight, uint16_t slope, uint16_t* history, uint16_t* dst)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		int32_t h = history[i];
+		int32_t diff = ((src[i] >> shift) << 1) - h;
+		int32_t d = ((diff < 0) ? -diff : diff) >> 1;
+		int32_t m = (d > low) ? d - low : 0;
+		m = (m < range) ? m : range;
+		int32_t w = (m == range) ? 32767 : still_weight + m * slope;
+		h += (diff * w + 0x4000) >> 15;
+		history[i] = (uint16_t)h;
+		dst[i] = (uint16_t)(((h + 1) >> 1) << shift);
+	}
+}
+
+static void fir_u16_scalar(const uint16_t* const* src, const int16_t* weight, int taps, int shift, int begin, \
+	int pix_num, uint16_t* dst)
+{
+	for (int i = begin; i < pix_num; i++)
+	{
+		int32_t sum = 0x2000;
+		for (int k = 0; k < taps; k++)
+		{
+			sum += weight[k] * (int32_t)(src[k][i] >> shift);
+		}
+		sum >>= 14;
+		dst[i] = (uint16_t)((sum < 0) ? 0 : ((sum > 16383) ? 16383 : sum));
+	}
+}
+
+//q = min(v, 16383) * 255 = 16384 * a + b, q / 16383 = a + (a + b) / 16383 and a + b < 2 * 16383
+static inline uint8_t gray_y14_y8(uint16_t v)
+{
+	uint32_t q = (uint32_t)((v < 16383) ? v : 16383) * 255;
+	return (uint8_t)((q + (q >> 14) + 1) >> 14);
+}
+
+//v * 255 / 65535 is v / 257, a 16.24 reciprocal is exact over uint16
+static inline uint8_t gray_y16_y8(uint16_t v)
+{
+	return (uint8_t)(((uint32_t)v * 65281u) >> 24);
+}
+
+//yuyv: luma at even bytes, dst the luma plane otherwise
+static void gray_to_yuv_scalar(const uint16_t* src, int pix_num, int depth, int yuyv, uint8_t* dst)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		uint8_t y = (depth == 16) ? gray_y16_y8(src[i]) : gray_y14_y8(src[i]);
+		if (yuyv)
+		{
+			dst[2 * i] = y;
+			dst[2 * i + 1] = 128;
+		}
+		else
+		{
+			dst[i] = y;
+		}
+	}
+}
+
+static inline int bitplane_width(uint32_t any)
+{
+	int width = 0;
+	while (any >> width)
+	{
+		width++;
+	}
+	return width;
+}
+
+static int bitplane_pack_scalar(const uint16_t* src, int block_num, uint8_t* widths, uint8_t* planes)
+{
+	uint8_t* out = planes;
+	for (int b = 0; b < block_num; b++)
+	{
+		const uint16_t* v = src + b * SIMD_BITPLANE_BLOCK;
+		uint32_t any = 0;
+		for (int j = 0; j < SIMD_BITPLANE_BLOCK; j++)
+		{
+			any |= v[j];
+		}
+		int width = bitplane_width(any);
+		widths[b] = (uint8_t)width;
+		for (int k = width - 1; k >= 0; k--)
+		{
+			uint32_t plane = 0;
+			for (int j = 0; j < SIMD_BITPLANE_BLOCK; j++)
+			{
+				plane |= (uint32_t)((v[j] >> k) & 1) << j;
+			}
+			memcpy(out, &plane, 4);
+			out += 4;
+		}
+	}
+	return (int)(out - planes);
+}
+
+static int bitplane_unpack_scalar(const uint8_t* widths, const uint8_t* planes, int block_num, uint16_t* dst)
+{
+	const uint8_t* in = planes;
+	for (int b = 0; b < block_num; b++)
+	{
+		uint16_t* v = dst + b * SIMD_BITPLANE_BLOCK;
+		memset(v, 0, SIMD_BITPLANE_BLOCK * sizeof(uint16_t));
+		for (int k = widths[b] - 1; k >= 0; k--)
+		{
+			uint32_t plane;
+			memcpy(&plane, in, 4);
+			in += 4;
+			for (int j = 0; j < SIMD_BITPLANE_BLOCK; j++)
+			{
+				v[j] |= (uint16_t)(((plane >> j) & 1) << k);
+			}
+		}
+	}
+	return (int)(in - planes);
+}
+
+//merge the vector lanes into the scalar tail result
+static int range_minmax_lanes_merge(const uint16_t* lane_min, const uint16_t* lane_max, int lane_num, \
+	int count, uint16_t* min_val, uint16_t* max_val)
+{
+	for (int k = 0; k < lane_num; k++)
+	{
+		if (lane_min[k] < *min_val) *min_val = lane_min[k];
+		if (lane_max[k] > *max_val) *max_val = lane_max[k];
+	}
+	return count;
+}
+
+static void hdr_fuse_u16_scalar(const uint16_t* high, const uint16_t* low, int pix_num, uint16_t knee, int knee_shift, \
+	uint16_t motion, int newer_low, uint16_t* dst)
+{
+	int32_t full = 1 << knee_shift;
+	for (int i = 0; i < pix_num; i++)
+	{
+		int32_t h = high[i];
+		int32_t d = (int32_t)low[i] - h;
+		int32_t w = h - knee;
+		w = (w < 0) ? 0 : ((w > full) ? full : w);
+		int32_t f = h + ((d * w) >> knee_shift);
+		if ((d < 0 ? -d : d) > motion && w < full)
+		{
+			f = newer_low ? low[i] : h;
+		}
+		dst[i] = (uint16_t)f;
+	}
+}
+
+static void stretch_u16_u8_scalar(const uint16_t* src, int pix_num, uint16_t min_val, float scale, uint8_t* dst)
+{
+	for (int i = 0; i < pix_num; i++)
+	{
+		uint32_t v = (src[i] > min_val) ? (uint32_t)(src[i] - min_val) : 0;
+		dst[i] = (uint8_t)(int32_t)((float)v * scale);
+	}
+}
+
+static void remap_bgr_scalar(const uint8_t* src, int stride, const uint32_t* base, const uint16_t* frac, int num, \
+	uint8_t* dst)
+{
+	for (int i = 0; i < num; i++)
+	{
+		const uint8_t* p = src + base[i];
+		int fx = frac[i] & 0xff;
+		int fy = frac[i] >> 8;
+		for (int c = 0; c < 3; c++)
+		{
+			int top = p[c] * (64 - fx) + p[3 + c] * fx;
+			int bottom = p[stride + c] * (64 - fx) + p[stride + 3 + c] * fx;
+			dst[3 * i + c] = (uint8_t)((top * (64 - fy) + bottom * fy + 2048) >> 12);
+		}
+	}
+}
+
+static void edge_add_bgr_scalar(const uint8_t* prev, const uint8_t* cur, const uint8_t* next, int num, int strength, \
+	uint8_t* bgr)
+{
+	for (int i = 0; i < num; i++)
+	{
+		int sum = prev[i - 1] + prev[i] + prev[i + 1] + cur[i - 1] + cur[i] + cur[i + 1] + \
+			next[i - 1] + next[i] + next[i + 1];
+		int e = (((9 * cur[i] - sum) >> 3) * strength) >> 4;
+		e = (e > 127) ? 127 : ((e < -128) ? -128 : e);
+		for (int c = 0; c < 3; c++)
+		{
+			int v = bgr[3 * i + c] + e;
+			bgr[3 * i + c] = (uint8_t)((v > 255) ? 255 : ((v < 0) ? 0 : v));
+		}
+	}
+}
+
+static void remap_add_u16_scalar(const uint16_t* src, int stride, const uint32_t* base, const uint16_t* frac, \
+	const uint16_t* weight, int num, uint16_t* dst)
+{
+	for (int i = 0; i < num; i++)
+	{
+		const uint16_t* p = src + base[i];
+		uint32_t fx = frac[i] & 0xff;
+		uint32_t fy = frac[i] >> 8;
+		uint32_t top = p[0] * (64 - fx) + p[1] * fx;
+		uint32_t bottom = p[stride] * (64 - fx) + p[stride + 1] * fx;
+		uint32_t v = (top * (64 - fy) + bottom * fy + 2048) >> 12;
+		uint32_t sum = dst[i] + ((v * weight[i] + 128) >> 8);
+		dst[i] = (uint16_t)((sum > 65535) ? 65535 : sum);
+	}
+}
+
+static void remap_row_u16_scalar(const uint16_t* src, int stride, const uint32_t* col, const uint8_t* fx, uint32_t fy, \
+	int num, uint16_t* dst)
+{
+	for (int i = 0; i < num; i++)
+	{
+		const uint16_t* p = src + col[i];
+		uint32_t top = p[0] * (64 - fx[i]) + p[1] * fx[i];
+		uint32_t bottom = p[stride] * (64 - fx[i]) + p[stride + 1] * fx[i];
+		dst[i] = (uint16_t)((top * (64 - fy) + bottom * fy + 2048) >> 12);
+	}
+}
+
+#if defined(SIMD_X86)
+SIMD_TARGET_SSE41
+static void minmax_u16_sse41(const uint16_t* src, int pix_num, uint16_t* min_val, uint16_t* max_val)
+{
+	int i = 0;
+	__m128i vmin = _mm_set1_epi16((short)0xFFFF);
+	__m128i vmax = _mm_setzero_si128();
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		vmin = _mm_min_epu16(vmin, v);
+		vmax = _mm_max_epu16(vmax, v);
+	}
+	uint16_t lane_min[8], lane_max[8];
+	_mm_storeu_si128((__m128i*)lane_min, vmin);
+	_mm_storeu_si128((__m128i*)lane_max, vmax);
+	uint16_t min_tmp, max_tmp;
+	minmax_u16_scalar(src + i, pix_num - i, &min_tmp, &max_tmp);
+	for (int k = 0; k < 8; k++)
+	{
+		if (lane_min[k] < min_tmp) min_tmp = lane_min[k];
+		if (lane_max[k] > max_tmp) max_tmp = lane_max[k];
+	}
+	*min_val = min_tmp;
+	*max_val = max_tmp;
+}
+
+//4 lanes: q = trunc(n * inv), then fix the +-1 float error against the exact remainder
+SIMD_TARGET_SSE41
+static inline __m128i stretch_u32x4_sse41(__m128i n, __m128 inv, __m128i range, __m128i range_max, __m128i scale)
+{
+	__m128i q = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(n), inv));
+	__m128i r = _mm_sub_epi32(_mm_mullo_epi32(n, scale), _mm_mullo_epi32(q, range));
+	q = _mm_add_epi32(q, _mm_cmpgt_epi32(_mm_setzero_si128(), r));
+	q = _mm_sub_epi32(q, _mm_cmpgt_epi32(r, range_max));
+	return q;
+}
+
+SIMD_TARGET_SSE41
+static void stretch_u16_sse41(const uint16_t* src, int pix_num, uint16_t min_val, uint32_t range, uint16_t* dst)
+{
+	int i = 0;
+	__m128i vmin = _mm_set1_epi16((short)min_val);
+	__m128 inv = _mm_set1_ps(16383.0f / (float)range);
+	__m128i vrange = _mm_set1_epi32((int)range);
+	__m128i vrange_max = _mm_set1_epi32((int)range - 1);
+	__m128i scale = _mm_set1_epi32(16383);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m128i n = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(src + i)), vmin);
+		__m128i lo = stretch_u32x4_sse41(_mm_cvtepu16_epi32(n), inv, vrange, vrange_max, scale);
+		__m128i hi = stretch_u32x4_sse41(_mm_cvtepu16_epi32(_mm_srli_si128(n, 8)), inv, vrange, vrange_max, scale);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi32(lo, hi));
+	}
+	stretch_u16_scalar(src + i, pix_num - i, min_val, range, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void minmax_u16_avx2(const uint16_t* src, int pix_num, uint16_t* min_val, uint16_t* max_val)
+{
+	int i = 0;
+	__m256i vmin = _mm256_set1_epi16((short)0xFFFF);
+	__m256i vmax = _mm256_setzero_si256();
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+		vmin = _mm256_min_epu16(vmin, v);
+		vmax = _mm256_max_epu16(vmax, v);
+	}
+	uint16_t lane_min[16], lane_max[16];
+	_mm256_storeu_si256((__m256i*)lane_min, vmin);
+	_mm256_storeu_si256((__m256i*)lane_max, vmax);
+	uint16_t min_tmp, max_tmp;
+	minmax_u16_scalar(src + i, pix_num - i, &min_tmp, &max_tmp);
+	for (int k = 0; k < 16; k++)
+	{
+		if (lane_min[k] < min_tmp) min_tmp = lane_min[k];
+		if (lane_max[k] > max_tmp) max_tmp = lane_max[k];
+	}
+	*min_val = min_tmp;
+	*max_val = max_tmp;
+}
+
+SIMD_TARGET_AVX2
+static inline __m256i stretch_u32x8_avx2(__m256i n, __m256 inv, __m256i range, __m256i range_max, __m256i scale)
+{
+	__m256i q = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(n), inv));
+	__m256i r = _mm256_sub_epi32(_mm256_mullo_epi32(n, scale), _mm256_mullo_epi32(q, range));
+	q = _mm256_add_epi32(q, _mm256_cmpgt_epi32(_mm256_setzero_si256(), r));
+	q = _mm256_sub_epi32(q, _mm256_cmpgt_epi32(r, range_max));
+	return q;
+}
+
+SIMD_TARGET_AVX2
+static void stretch_u16_avx2(const uint16_t* src, int pix_num, uint16_t min_val, uint32_t range, uint16_t* dst)
+{
+	int i = 0;
+	__m256i vmin = _mm256_set1_epi16((short)min_val);
+	__m256 inv = _mm256_set1_ps(16383.0f / (float)range);
+	__m256i vrange = _mm256_set1_epi32((int)range);
+	__m256i vrange_max = _mm256_set1_epi32((int)range - 1);
+	__m256i scale = _mm256_set1_epi32(16383);
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i n = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(src + i)), vmin);
+		__m256i lo = stretch_u32x8_avx2(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(n)), inv, vrange, vrange_max, scale);
+		__m256i hi = stretch_u32x8_avx2(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(n, 1)), inv, vrange, vrange_max, scale);
+		//packus works per 128 bit lane, put the quadwords back in order
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+		_mm256_storeu_si256((__m256i*)(dst + i), packed);
+	}
+	stretch_u16_scalar(src + i, pix_num - i, min_val, range, dst + i);
+}
+
+//values outside the range are forced to 0xFFFF for the min and to 0 for the max
+SIMD_TARGET_SSE41
+static int range_minmax_u16_sse41(const uint16_t* src, int pix_num, uint16_t lo, uint16_t hi, \
+	uint16_t* min_val, uint16_t* max_val)
+{
+	int i = 0;
+	int count = 0;
+	__m128i vlo = _mm_set1_epi16((short)lo);
+	__m128i vhi = _mm_set1_epi16((short)hi);
+	__m128i vmin = _mm_set1_epi16((short)0xFFFF);
+	__m128i vmax = _mm_setzero_si128();
+	__m128i ones = _mm_set1_epi16((short)0xFFFF);
+	//16 bit lane counters are flushed before they can overflow
+	while (i + 8 <= pix_num)
+	{
+		__m128i vcount = _mm_setzero_si128();
+		int block_end = (pix_num - i > 8 * 32767) ? i + 8 * 32767 : pix_num;
+		for (; i + 8 <= block_end; i += 8)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+			__m128i in = _mm_and_si128(_mm_cmpeq_epi16(_mm_max_epu16(v, vlo), v), _mm_cmpeq_epi16(_mm_min_epu16(v, vhi), v));
+			vmin = _mm_min_epu16(vmin, _mm_or_si128(v, _mm_xor_si128(in, ones)));
+			vmax = _mm_max_epu16(vmax, _mm_and_si128(v, in));
+			vcount = _mm_sub_epi16(vcount, in);
+		}
+		int32_t lane_count[4];
+		_mm_storeu_si128((__m128i*)lane_count, _mm_madd_epi16(vcount, _mm_set1_epi16(1)));
+		count += lane_count[0] + lane_count[1] + lane_count[2] + lane_count[3];
+	}
+	uint16_t lane_min[8], lane_max[8];
+	_mm_storeu_si128((__m128i*)lane_min, vmin);
+	_mm_storeu_si128((__m128i*)lane_max, vmax);
+	count += range_minmax_u16_scalar(src + i, pix_num - i, lo, hi, min_val, max_val);
+	return range_minmax_lanes_merge(lane_min, lane_max, 8, count, min_val, max_val);
+}
+
+SIMD_TARGET_AVX2
+static int range_minmax_u16_avx2(const uint16_t* src, int pix_num, uint16_t lo, uint16_t hi, \
+	uint16_t* min_val, uint16_t* max_val)
+{
+	int i = 0;
+	int count = 0;
+	__m256i vlo = _mm256_set1_epi16((short)lo);
+	__m256i vhi = _mm256_set1_epi16((short)hi);
+	__m256i vmin = _mm256_set1_epi16((short)0xFFFF);
+	__m256i vmax = _mm256_setzero_si256();
+	__m256i ones = _mm256_set1_epi16((short)0xFFFF);
+	while (i + 16 <= pix_num)
+	{
+		__m256i vcount = _mm256_setzero_si256();
+		int block_end = (pix_num - i > 16 * 32767) ? i + 16 * 32767 : pix_num;
+		for (; i + 16 <= block_end; i += 16)
+		{
+			__m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+			__m256i in = _mm256_and_si256(_mm256_cmpeq_epi16(_mm256_max_epu16(v, vlo), v), \
+				_mm256_cmpeq_epi16(_mm256_min_epu16(v, vhi), v));
+			vmin = _mm256_min_epu16(vmin, _mm256_or_si256(v, _mm256_xor_si256(in, ones)));
+			vmax = _mm256_max_epu16(vmax, _mm256_and_si256(v, in));
+			vcount = _mm256_sub_epi16(vcount, in);
+		}
+		int32_t lane_count[8];
+		_mm256_storeu_si256((__m256i*)lane_count, _mm256_madd_epi16(vcount, _mm256_set1_epi16(1)));
+		for (int k = 0; k < 8; k++)
+		{
+			count += lane_count[k];
+		}
+	}
+	uint16_t lane_min[16], lane_max[16];
+	_mm256_storeu_si256((__m256i*)lane_min, vmin);
+	_mm256_storeu_si256((__m256i*)lane_max, vmax);
+	count += range_minmax_u16_scalar(src + i, pix_num - i, lo, hi, min_val, max_val);
+	return range_minmax_lanes_merge(lane_min, lane_max, 16, count, min_val, max_val);
+}
+//the multiply-add runs in double so every lane rounds exactly like the scalar expression
+SIMD_TARGET_SSE41
+static void u16_to_f32_sse41(const uint16_t* src, int pix_num, double scale, double offset, float* dst)
+{
+	int i = 0;
+	__m128d vscale = _mm_set1_pd(scale);
+	__m128d voffset = _mm_set1_pd(offset);
+	for (; i + 4 <= pix_num; i += 4)
+	{
+		__m128i n = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+		__m128d lo = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(n), vscale), voffset);
+		__m128d hi = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(n, 8)), vscale), voffset);
+		_mm_storeu_ps(dst + i, _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)));
+	}
+	u16_to_f32_scalar(src + i, pix_num - i, scale, offset, dst + i);
+}
+
+SIMD_TARGET_SSE41
+static void u16_to_s16_fixed_sse41(const uint16_t* src, int pix_num, uint32_t mul, int shift, int32_t offset, int16_t* dst)
+{
+	int i = 0;
+	__m128i vmul = _mm_set1_epi32((int)mul);
+	__m128i vround = _mm_set1_epi32((int)((1u << shift) >> 1));
+	__m128i voffset = _mm_set1_epi32(offset);
+	__m128i vshift = _mm_cvtsi32_si128(shift);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i lo = _mm_mullo_epi32(_mm_cvtepu16_epi32(v), vmul);
+		__m128i hi = _mm_mullo_epi32(_mm_cvtepu16_epi32(_mm_srli_si128(v, 8)), vmul);
+		lo = _mm_add_epi32(_mm_srl_epi32(_mm_add_epi32(lo, vround), vshift), voffset);
+		hi = _mm_add_epi32(_mm_srl_epi32(_mm_add_epi32(hi, vround), vshift), voffset);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(lo, hi));
+	}
+	u16_to_s16_fixed_scalar(src + i, pix_num - i, mul, shift, offset, dst + i);
+}
+
+SIMD_TARGET_SSE41
+static void u16_to_s8_fixed_sse41(const uint16_t* src, int pix_num, uint32_t mul, int shift, int32_t offset, int8_t* dst)
+{
+	int i = 0;
+	__m128i vmul = _mm_set1_epi32((int)mul);
+	__m128i vround = _mm_set1_epi32((int)((1u << shift) >> 1));
+	__m128i voffset = _mm_set1_epi32(offset);
+	__m128i vshift = _mm_cvtsi32_si128(shift);
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m128i s16[2];
+		for (int k = 0; k < 2; k++)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + i + 8 * k));
+			__m128i lo = _mm_mullo_epi32(_mm_cvtepu16_epi32(v), vmul);
+			__m128i hi = _mm_mullo_epi32(_mm_cvtepu16_epi32(_mm_srli_si128(v, 8)), vmul);
+			lo = _mm_add_epi32(_mm_srl_epi32(_mm_add_epi32(lo, vround), vshift), voffset);
+			hi = _mm_add_epi32(_mm_srl_epi32(_mm_add_epi32(hi, vround), vshift), voffset);
+			s16[k] = _mm_packs_epi32(lo, hi);
+		}
+		//saturating twice is saturating once, int16 covers int8
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi16(s16[0], s16[1]));
+	}
+	u16_to_s8_fixed_scalar(src + i, pix_num - i, mul, shift, offset, dst + i);
+}
+
+SIMD_TARGET_SSE41
+static void reduce2x2_u16_sse41(const uint16_t* const* rows, int num, uint16_t* min_dst, uint16_t* max_dst, \
+	uint16_t* mean_dst)
+{
+	int i = 0;
+	__m128i lo_mask = _mm_set1_epi32(0xffff);
+	__m128i vround = _mm_set1_epi32(2);
+	for (; i + 8 <= num; i += 8)
+	{
+		int x = 2 * i;
+		__m128i v[6][2];
+		for (int r = 0; r < 6; r++)
+		{
+			v[r][0] = _mm_loadu_si128((const __m128i*)(rows[r] + x));
+			v[r][1] = _mm_loadu_si128((const __m128i*)(rows[r] + x + 8));
+		}
+		//the two rows first, then the horizontal pair of each 32 bit lane
+		__m128i lo[2], hi[2], sum[2];
+		for (int k = 0; k < 2; k++)
+		{
+			__m128i a = _mm_min_epu16(v[0][k], v[1][k]);
+			__m128i b = _mm_max_epu16(v[2][k], v[3][k]);
+			lo[k] = _mm_min_epi32(_mm_and_si128(a, lo_mask), _mm_srli_epi32(a, 16));
+			hi[k] = _mm_max_epi32(_mm_and_si128(b, lo_mask), _mm_srli_epi32(b, 16));
+			sum[k] = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(v[4][k], lo_mask), _mm_srli_epi32(v[4][k], 16)), \
+				_mm_add_epi32(_mm_and_si128(v[5][k], lo_mask), _mm_srli_epi32(v[5][k], 16)));
+			sum[k] = _mm_srli_epi32(_mm_add_epi32(sum[k], vround), 2);
+		}
+		_mm_storeu_si128((__m128i*)(min_dst + i), _mm_packus_epi32(lo[0], lo[1]));
+		_mm_storeu_si128((__m128i*)(max_dst + i), _mm_packus_epi32(hi[0], hi[1]));
+		_mm_storeu_si128((__m128i*)(mean_dst + i), _mm_packus_epi32(sum[0], sum[1]));
+	}
+	reduce2x2_u16_scalar(rows, i, num, min_dst, max_dst, mean_dst);
+}
+
+SIMD_TARGET_AVX2
+static void u16_to_f32_avx2(const uint16_t* src, int pix_num, double scale, double offset, float* dst)
+{
+	int i = 0;
+	__m256d vscale = _mm256_set1_pd(scale);
+	__m256d voffset = _mm256_set1_pd(offset);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m256i n = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+		__m256d lo = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(n)), vscale), voffset);
+		__m256d hi = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(n, 1)), vscale), voffset);
+		_mm_storeu_ps(dst + i, _mm256_cvtpd_ps(lo));
+		_mm_storeu_ps(dst + i + 4, _mm256_cvtpd_ps(hi));
+	}
+	u16_to_f32_scalar(src + i, pix_num - i, scale, offset, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void u16_to_s16_fixed_avx2(const uint16_t* src, int pix_num, uint32_t mul, int shift, int32_t offset, int16_t* dst)
+{
+	int i = 0;
+	__m256i vmul = _mm256_set1_epi32((int)mul);
+	__m256i vround = _mm256_set1_epi32((int)((1u << shift) >> 1));
+	__m256i voffset = _mm256_set1_epi32(offset);
+	__m128i vshift = _mm_cvtsi32_si128(shift);
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i lo = _mm256_mullo_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)), vmul);
+		__m256i hi = _mm256_mullo_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1)), vmul);
+		lo = _mm256_add_epi32(_mm256_srl_epi32(_mm256_add_epi32(lo, vround), vshift), voffset);
+		hi = _mm256_add_epi32(_mm256_srl_epi32(_mm256_add_epi32(hi, vround), vshift), voffset);
+		//packs works per 128 bit lane, put the quadwords back in order
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+		_mm256_storeu_si256((__m256i*)(dst + i), packed);
+	}
+	u16_to_s16_fixed_scalar(src + i, pix_num - i, mul, shift, offset, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void u16_to_s8_fixed_avx2(const uint16_t* src, int pix_num, uint32_t mul, int shift, int32_t offset, int8_t* dst)
+{
+	int i = 0;
+	__m256i vmul = _mm256_set1_epi32((int)mul);
+	__m256i vround = _mm256_set1_epi32((int)((1u << shift) >> 1));
+	__m256i voffset = _mm256_set1_epi32(offset);
+	__m128i vshift = _mm_cvtsi32_si128(shift);
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i lo = _mm256_mullo_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)), vmul);
+		__m256i hi = _mm256_mullo_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1)), vmul);
+		lo = _mm256_add_epi32(_mm256_srl_epi32(_mm256_add_epi32(lo, vround), vshift), voffset);
+		hi = _mm256_add_epi32(_mm256_srl_epi32(_mm256_add_epi32(hi, vround), vshift), voffset);
+		//per lane packs: lo lane holds pixels 0-3 and 8-11, the 64 bit shuffle restores the order
+		__m256i s16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi16(_mm256_castsi256_si128(s16), _mm256_extracti128_si256(s16, 1)));
+	}
+	u16_to_s8_fixed_scalar(src + i, pix_num - i, mul, shift, offset, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void reduce2x2_u16_avx2(const uint16_t* const* rows, int num, uint16_t* min_dst, uint16_t* max_dst, \
+	uint16_t* mean_dst)
+{
+	int i = 0;
+	__m256i lo_mask = _mm256_set1_epi32(0xffff);
+	__m256i vround = _mm256_set1_epi32(2);
+	for (; i + 16 <= num; i += 16)
+	{
+		int x = 2 * i;
+		__m256i v[6][2];
+		for (int r = 0; r < 6; r++)
+		{
+			v[r][0] = _mm256_loadu_si256((const __m256i*)(rows[r] + x));
+			v[r][1] = _mm256_loadu_si256((const __m256i*)(rows[r] + x + 16));
+		}
+		__m256i lo[2], hi[2], sum[2];
+		for (int k = 0; k < 2; k++)
+		{
+			__m256i a = _mm256_min_epu16(v[0][k], v[1][k]);
+			__m256i b = _mm256_max_epu16(v[2][k], v[3][k]);
+			lo[k] = _mm256_min_epi32(_mm256_and_si256(a, lo_mask), _mm256_srli_epi32(a, 16));
+			hi[k] = _mm256_max_epi32(_mm256_and_si256(b, lo_mask), _mm256_srli_epi32(b, 16));
+			sum[k] = _mm256_add_epi32(_mm256_add_epi32(_mm256_and_si256(v[4][k], lo_mask), \
+				_mm256_srli_epi32(v[4][k], 16)), _mm256_add_epi32(_mm256_and_si256(v[5][k], lo_mask), \
+				_mm256_srli_epi32(v[5][k], 16)));
+			sum[k] = _mm256_srli_epi32(_mm256_add_epi32(sum[k], vround), 2);
+		}
+		//packus works per 128 bit lane, put the quadwords back in order
+		_mm256_storeu_si256((__m256i*)(min_dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi32(lo[0], lo[1]), 0xD8));
+		_mm256_storeu_si256((__m256i*)(max_dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi32(hi[0], hi[1]), 0xD8));
+		_mm256_storeu_si256((__m256i*)(mean_dst + i), \
+			_mm256_permute4x64_epi64(_mm256_packus_epi32(sum[0], sum[1]), 0xD8));
+	}
+	reduce2x2_u16_scalar(rows, i, num, min_dst, max_dst, mean_dst);
+}
+SIMD_TARGET_SSE41
+static void delta_zigzag_u16_sse41(const uint16_t* cur, const uint16_t* ref, int pix_num, uint16_t* dst)
+{
+	int i = 0;
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m128i d = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(cur + i)), _mm_loadu_si128((const __m128i*)(ref + i)));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_slli_epi16(d, 1), _mm_srai_epi16(d, 15)));
+	}
+	delta_zigzag_u16_scalar(cur + i, ref + i, pix_num - i, dst + i);
+}
+
+//|d| as unsigned, -32768 included, against deadband + 1
+SIMD_TARGET_SSE41
+static void delta_zigzag_deadband_u16_sse41(const uint16_t* cur, uint16_t* ref, int pix_num, uint16_t deadband, \
+	uint16_t* dst)
+{
+	int i = 0;
+	__m128i limit = _mm_set1_epi16((short)(deadband + 1));
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m128i c = _mm_loadu_si128((const __m128i*)(cur + i));
+		__m128i r = _mm_loadu_si128((const __m128i*)(ref + i));
+		__m128i d = _mm_sub_epi16(c, r);
+		__m128i a = _mm_abs_epi16(d);
+		__m128i keep = _mm_cmpeq_epi16(_mm_max_epu16(a, limit), a);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_and_si128(keep, _mm_xor_si128(_mm_slli_epi16(d, 1), _mm_srai_epi16(d, 15))));
+		_mm_storeu_si128((__m128i*)(ref + i), _mm_blendv_epi8(r, c, keep));
+	}
+	delta_zigzag_deadband_u16_scalar(cur + i, ref + i, pix_num - i, deadband, dst + i);
+}
+
+SIMD_TARGET_SSE41
+static void undelta_zigzag_u16_sse41(const uint16_t* src, const uint16_t* ref, int pix_num, uint16_t* dst)
+{
+	int i = 0;
+	__m128i one = _mm_set1_epi16(1);
+	__m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m128i z = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i d = _mm_xor_si128(_mm_srli_epi16(z, 1), _mm_sub_epi16(zero, _mm_and_si128(z, one)));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi16(_mm_loadu_si128((const __m128i*)(ref + i)), d));
+	}
+	undelta_zigzag_u16_scalar(src + i, ref + i, pix_num - i, dst + i);
+}
+
+SIMD_TARGET_SSE41
+static void accumulate_u16_sse41(const uint16_t* src, int pix_num, uint32_t* acc)
+{
+	int i = 0;
+	__m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i* a = (__m128i*)(acc + i);
+		_mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(v, zero)));
+		_mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(v, zero)));
+	}
+	accumulate_u16_scalar(src + i, pix_num - i, acc + i);
+}
+
+//the squares of |d| < 65536 fit the low 32 bits _mm_mul_epi32 multiplies
+SIMD_TARGET_SSE41
+static void accumulate_sq_u16_sse41(const uint16_t* src, const uint16_t* ref, int pix_num, uint32_t* sum, uint64_t* sq)
+{
+	int i = 0;
+	for (; i + 4 <= pix_num; i += 4)
+	{
+		__m128i v = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+		__m128i d = _mm_sub_epi32(v, _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)(ref + i))));
+		_mm_storeu_si128((__m128i*)(sum + i), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(sum + i)), v));
+		__m128i sq02 = _mm_mul_epi32(d, d);
+		__m128i sq13 = _mm_mul_epi32(_mm_srli_epi64(d, 32), _mm_srli_epi64(d, 32));
+		__m128i* s = (__m128i*)(sq + i);
+		_mm_storeu_si128(s, _mm_add_epi64(_mm_loadu_si128(s), _mm_unpacklo_epi64(sq02, sq13)));
+		_mm_storeu_si128(s + 1, _mm_add_epi64(_mm_loadu_si128(s + 1), _mm_unpackhi_epi64(sq02, sq13)));
+	}
+	accumulate_sq_u16_scalar(src + i, ref + i, pix_num - i, sum + i, sq + i);
+}
+
+SIMD_TARGET_SSE41
+static void window_u16_sse41(const uint16_t* in, const uint16_t* out, int pix_num, uint32_t* sum)
+{
+	int i = 0;
+	__m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(in + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(out + i));
+		__m128i* s = (__m128i*)(sum + i);
+		__m128i lo = _mm_sub_epi32(_mm_unpacklo_epi16(a, zero), _mm_unpacklo_epi16(b, zero));
+		__m128i hi = _mm_sub_epi32(_mm_unpackhi_epi16(a, zero), _mm_unpackhi_epi16(b, zero));
+		_mm_storeu_si128(s, _mm_add_epi32(_mm_loadu_si128(s), lo));
+		_mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1), hi));
+	}
+	window_u16_scalar(in + i, out + i, pix_num - i, sum + i);
+}
+
+SIMD_TARGET_SSE41
+static void hold_u16_sse41(const uint16_t* src, int pix_num, uint16_t decay, uint16_t* max_val, uint16_t* min_val)
+{
+	int i = 0;
+	__m128i d = _mm_set1_epi16((short)decay);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i hi = _mm_subs_epu16(_mm_loadu_si128((const __m128i*)(max_val + i)), d);
+		__m128i lo = _mm_adds_epu16(_mm_loadu_si128((const __m128i*)(min_val + i)), d);
+		_mm_storeu_si128((__m128i*)(max_val + i), _mm_max_epu16(v, hi));
+		_mm_storeu_si128((__m128i*)(min_val + i), _mm_min_epu16(v, lo));
+	}
+	hold_u16_scalar(src + i, pix_num - i, decay, max_val + i, min_val + i);
+}
+
+SIMD_TARGET_SSE41
+static void rate_u16_sse41(const uint16_t* src, int pix_num, int level_shift, int slope_shift, uint32_t mul, \
+	int32_t* level, int32_t* slope, uint16_t* dst)
+{
+	int i = 0;
+	__m128i ls = _mm_cvtsi32_si128(level_shift);
+	__m128i ss = _mm_cvtsi32_si128(slope_shift);
+	__m128i vmul = _mm_set1_epi32((int)mul);
+	__m128i zero = _mm_setzero_si128();
+	__m128i cap = _mm_set1_epi32(SIMD_RATE_SLOPE_MAX);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i r[2];
+		for (int h = 0; h < 2; h++)
+		{
+			__m128i t = _mm_slli_epi32((h == 0) ? _mm_unpacklo_epi16(v, zero) : _mm_unpackhi_epi16(v, zero), 8);
+			__m128i* lp = (__m128i*)(level + i + h * 4);
+			__m128i* sp = (__m128i*)(slope + i + h * 4);
+			__m128i l0 = _mm_loadu_si128(lp);
+			__m128i s0 = _mm_loadu_si128(sp);
+			__m128i l = _mm_add_epi32(l0, _mm_sra_epi32(_mm_sub_epi32(t, l0), ls));
+			__m128i s = _mm_sub_epi32(_mm_add_epi32(s0, _mm_sub_epi32(l, l0)), _mm_sra_epi32(s0, ss));
+			_mm_storeu_si128(lp, l);
+			_mm_storeu_si128(sp, s);
+			__m128i c = _mm_min_epi32(_mm_max_epi32(_mm_sra_epi32(s, ss), zero), cap);
+			r[h] = _mm_srli_epi32(_mm_mullo_epi32(c, vmul), 12);
+		}
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi32(r[0], r[1]));
+	}
+	rate_u16_scalar(src + i, pix_num - i, level_shift, slope_shift, mul, level + i, slope + i, dst + i);
+}
+
+SIMD_TARGET_SSE41
+static void background_u16_sse41(const uint16_t* src, int pix_num, int shift, int32_t var_floor, int32_t* mean, \
+	int32_t* var, uint16_t* dst)
+{
+	int i = 0;
+	__m128i vs = _mm_cvtsi32_si128(shift);
+	__m128i lo = _mm_set1_epi32(-32767);
+	__m128i hi = _mm_set1_epi32(32767);
+	__m128i vfloor = _mm_set1_epi32(var_floor);
+	__m128i zero = _mm_setzero_si128();
+	__m128 scale = _mm_set1_ps(16.0f);
+	__m128 cap = _mm_set1_ps(65535.0f);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m128i v16 = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i z[2];
+		for (int h = 0; h < 2; h++)
+		{
+			__m128i t = _mm_slli_epi32((h == 0) ? _mm_unpacklo_epi16(v16, zero) : _mm_unpackhi_epi16(v16, zero), 8);
+			__m128i* mp = (__m128i*)(mean + i + h * 4);
+			__m128i* vp = (__m128i*)(var + i + h * 4);
+			__m128i m = _mm_loadu_si128(mp);
+			__m128i d = _mm_sub_epi32(t, m);
+			_mm_storeu_si128(mp, _mm_add_epi32(m, _mm_sra_epi32(d, vs)));
+			__m128i q = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(d, 4), lo), hi);
+			__m128i d2 = _mm_mullo_epi32(q, q);
+			__m128i v0 = _mm_loadu_si128(vp);
+			_mm_storeu_si128(vp, _mm_add_epi32(v0, _mm_sra_epi32(_mm_sub_epi32(d2, v0), vs)));
+			__m128 f = _mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(d2), scale), _mm_cvtepi32_ps(_mm_max_epi32(v0, vfloor)));
+			z[h] = _mm_cvttps_epi32(_mm_min_ps(f, cap));
+		}
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi32(z[0], z[1]));
+	}
+	background_u16_scalar(src + i, pix_num - i, shift, var_floor, mean + i, var + i, dst + i);
+}
+
+//unsigned v >= t is max(v, t) == v, each true compare is -1
+SIMD_TARGET_SSE41
+static void threshold2_u16_sse41(const uint16_t* src, int pix_num, uint16_t lo, uint16_t hi, uint8_t* dst)
+{
+	int i = 0;
+	__m128i vlo = _mm_set1_epi16((short)lo);
+	__m128i vhi = _mm_set1_epi16((short)hi);
+	__m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(src + i + 8));
+		__m128i ca = _mm_add_epi16(_mm_cmpeq_epi16(_mm_max_epu16(a, vlo), a), _mm_cmpeq_epi16(_mm_max_epu16(a, vhi), a));
+		__m128i cb = _mm_add_epi16(_mm_cmpeq_epi16(_mm_max_epu16(b, vlo), b), _mm_cmpeq_epi16(_mm_max_epu16(b, vhi), b));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(_mm_sub_epi16(zero, ca), _mm_sub_epi16(zero, cb)));
+	}
+	threshold2_u16_scalar(src + i, pix_num - i, lo, hi, dst + i);
+}
+
+//the luma of gray_y14_y8/gray_y16_y8 in 16 bit lanes: a = v * 1020 >> 16 is q >> 14, b the low 14 bits of q
+SIMD_TARGET_SSE41
+static inline __m128i gray_luma_sse41(__m128i v, int depth)
+{
+	if (depth == 16)
+	{
+		return _mm_srli_epi16(_mm_mulhi_epu16(v, _mm_set1_epi16((short)0xFF01)), 8);
+	}
+	v = _mm_min_epu16(v, _mm_set1_epi16(16383));
+	__m128i a = _mm_mulhi_epu16(v, _mm_set1_epi16(1020));
+	__m128i b = _mm_and_si128(_mm_mullo_epi16(v, _mm_set1_epi16(255)), _mm_set1_epi16(0x3FFF));
+	return _mm_add_epi16(a, _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(a, b), _mm_set1_epi16(1)), 14));
+}
+
+//yuyv is the luma lane with 128 in its high byte
+SIMD_TARGET_SSE41
+static void gray_to_yuv_sse41(const uint16_t* src, int pix_num, int depth, int yuyv, uint8_t* dst)
+{
+	int i = 0;
+	__m128i chroma = _mm_set1_epi16((short)0x8000);
+	if (yuyv)
+	{
+		for (; i + 8 <= pix_num; i += 8)
+		{
+			__m128i y = gray_luma_sse41(_mm_loadu_si128((const __m128i*)(src + i)), depth);
+			_mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_or_si128(y, chroma));
+		}
+		gray_to_yuv_scalar(src + i, pix_num - i, depth, yuyv, dst + 2 * i);
+		return;
+	}
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m128i a = gray_luma_sse41(_mm_loadu_si128((const __m128i*)(src + i)), depth);
+		__m128i b = gray_luma_sse41(_mm_loadu_si128((const __m128i*)(src + i + 8)), depth);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(a, b));
+	}
+	gray_to_yuv_scalar(src + i, pix_num - i, depth, yuyv, dst + i);
+}
+
+//history and the doubled source fit in int16, mulhrs is the rounded Q15 product of the scalar code
+SIMD_TARGET_SSE41
+static void tnr_u16_sse41(const uint16_t* src, int shift, int pix_num, uint16_t low, uint16_t range, \
+	uint16_t still_weight, uint16_t slope, uint16_t* history, uint16_t* dst)
+{
+	int i = 0;
+	__m128i vlow = _mm_set1_epi16((short)low);
+	__m128i vrange = _mm_set1_epi16((short)range);
+	__m128i vstill = _mm_set1_epi16((short)still_weight);
+	__m128i vslope = _mm_set1_epi16((short)slope);
+	__m128i vmax = _mm_set1_epi16(32767);
+	__m128i one = _mm_set1_epi16(1);
+	__m128i vshift = _mm_cvtsi32_si128(shift);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m128i h = _mm_loadu_si128((const __m128i*)(history + i));
+		__m128i c = _mm_slli_epi16(_mm_srl_epi16(_mm_loadu_si128((const __m128i*)(src + i)), vshift), 1);
+		__m128i diff = _mm_sub_epi16(c, h);
+		__m128i m = _mm_min_epu16(_mm_subs_epu16(_mm_srli_epi16(_mm_abs_epi16(diff), 1), vlow), vrange);
+		__m128i w = _mm_add_epi16(vstill, _mm_mullo_epi16(m, vslope));
+		w = _mm_blendv_epi8(w, vmax, _mm_cmpeq_epi16(m, vrange));
+		h = _mm_add_epi16(h, _mm_mulhrs_epi16(diff, w));
+		_mm_storeu_si128((__m128i*)(history + i), h);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_sll_epi16(_mm_srli_epi16(_mm_add_epi16(h, one), 1), vshift));
+	}
+	tnr_u16_scalar(src + i, shift, pix_num - i, low, range, still_weight, slope, history + i, dst + i);
+}
+
+//the tap pairs are interleaved so madd gives two taps per 32 bit lane, packus clamps below 0
+SIMD_TARGET_SSE41
+static void fir_u16_sse41(const uint16_t* const* src, const int16_t* weight, int taps, int shift, int pix_num, \
+	uint16_t* dst)
+{
+	int i = 0;
+	__m128i w01 = _mm_set1_epi32((int)(((uint32_t)(uint16_t)weight[1] << 16) | (uint16_t)weight[0]));
+	__m128i w23 = (taps == 4) ? _mm_set1_epi32((int)(((uint32_t)(uint16_t)weight[3] << 16) | (uint16_t)weight[2])) : \
+		_mm_setzero_si128();
+	__m128i round = _mm_set1_epi32(0x2000);
+	__m128i vmax = _mm_set1_epi16(16383);
+	__m128i vshift = _mm_cvtsi32_si128(shift);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m128i s0 = _mm_srl_epi16(_mm_loadu_si128((const __m128i*)(src[0] + i)), vshift);
+		__m128i s1 = _mm_srl_epi16(_mm_loadu_si128((const __m128i*)(src[1] + i)), vshift);
+		__m128i lo = _mm_add_epi32(round, _mm_madd_epi16(_mm_unpacklo_epi16(s0, s1), w01));
+		__m128i hi = _mm_add_epi32(round, _mm_madd_epi16(_mm_unpackhi_epi16(s0, s1), w01));
+		if (taps == 4)
+		{
+			__m128i s2 = _mm_srl_epi16(_mm_loadu_si128((const __m128i*)(src[2] + i)), vshift);
+			__m128i s3 = _mm_srl_epi16(_mm_loadu_si128((const __m128i*)(src[3] + i)), vshift);
+			lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(s2, s3), w23));
+			hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(s2, s3), w23));
+		}
+		__m128i out = _mm_packus_epi32(_mm_srai_epi32(lo, 14), _mm_srai_epi32(hi, 14));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_min_epu16(out, vmax));
+	}
+	fir_u16_scalar(src, weight, taps, shift, i, pix_num, dst);
+}
+
+//plane k: shift bit k up to the sign, the signed pack keeps it and movemask collects 16 values at once
+SIMD_TARGET_SSE41
+static int bitplane_pack_sse41(const uint16_t* src, int block_num, uint8_t* widths, uint8_t* planes)
+{
+	uint8_t* out = planes;
+	for (int b = 0; b < block_num; b++)
+	{
+		const __m128i* v = (const __m128i*)(src + b * SIMD_BITPLANE_BLOCK);
+		__m128i v0 = _mm_loadu_si128(v), v1 = _mm_loadu_si128(v + 1);
+		__m128i v2 = _mm_loadu_si128(v + 2), v3 = _mm_loadu_si128(v + 3);
+		__m128i any = _mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3));
+		any = _mm_or_si128(any, _mm_srli_si128(any, 8));
+		any = _mm_or_si128(any, _mm_srli_si128(any, 4));
+		any = _mm_or_si128(any, _mm_srli_si128(any, 2));
+		int width = bitplane_width((uint32_t)_mm_extract_epi16(any, 0));
+		widths[b] = (uint8_t)width;
+		for (int k = width - 1; k >= 0; k--)
+		{
+			__m128i s = _mm_cvtsi32_si128(15 - k);
+			uint32_t lo = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(_mm_sll_epi16(v0, s), _mm_sll_epi16(v1, s)));
+			uint32_t hi = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(_mm_sll_epi16(v2, s), _mm_sll_epi16(v3, s)));
+			uint32_t plane = lo | (hi << 16);
+			memcpy(out, &plane, 4);
+			out += 4;
+		}
+	}
+	return (int)(out - planes);
+}
+
+SIMD_TARGET_SSE41
+static int bitplane_unpack_sse41(const uint8_t* widths, const uint8_t* planes, int block_num, uint16_t* dst)
+{
+	const uint8_t* in = planes;
+	__m128i bits = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+	for (int b = 0; b < block_num; b++)
+	{
+		__m128i o0 = _mm_setzero_si128(), o1 = _mm_setzero_si128();
+		__m128i o2 = _mm_setzero_si128(), o3 = _mm_setzero_si128();
+		for (int k = widths[b] - 1; k >= 0; k--)
+		{
+			uint32_t plane;
+			memcpy(&plane, in, 4);
+			in += 4;
+			__m128i bit = _mm_set1_epi16((short)(1 << k));
+			__m128i m0 = _mm_and_si128(_mm_set1_epi16((short)(plane & 0xFF)), bits);
+			__m128i m1 = _mm_and_si128(_mm_set1_epi16((short)((plane >> 8) & 0xFF)), bits);
+			__m128i m2 = _mm_and_si128(_mm_set1_epi16((short)((plane >> 16) & 0xFF)), bits);
+			__m128i m3 = _mm_and_si128(_mm_set1_epi16((short)(plane >> 24)), bits);
+			o0 = _mm_or_si128(o0, _mm_and_si128(_mm_cmpeq_epi16(m0, bits), bit));
+			o1 = _mm_or_si128(o1, _mm_and_si128(_mm_cmpeq_epi16(m1, bits), bit));
+			o2 = _mm_or_si128(o2, _mm_and_si128(_mm_cmpeq_epi16(m2, bits), bit));
+			o3 = _mm_or_si128(o3, _mm_and_si128(_mm_cmpeq_epi16(m3, bits), bit));
+		}
+		__m128i* v = (__m128i*)(dst + b * SIMD_BITPLANE_BLOCK);
+		_mm_storeu_si128(v, o0);
+		_mm_storeu_si128(v + 1, o1);
+		_mm_storeu_si128(v + 2, o2);
+		_mm_storeu_si128(v + 3, o3);
+	}
+	return (int)(in - planes);
+}
+
+SIMD_TARGET_AVX2
+static void delta_zigzag_u16_avx2(const uint16_t* cur, const uint16_t* ref, int pix_num, uint16_t* dst)
+{
+	int i = 0;
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i d = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(cur + i)), \
+			_mm256_loadu_si256((const __m256i*)(ref + i)));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(_mm256_slli_epi16(d, 1), _mm256_srai_epi16(d, 15)));
+	}
+	delta_zigzag_u16_scalar(cur + i, ref + i, pix_num - i, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void delta_zigzag_deadband_u16_avx2(const uint16_t* cur, uint16_t* ref, int pix_num, uint16_t deadband, \
+	uint16_t* dst)
+{
+	int i = 0;
+	__m256i limit = _mm256_set1_epi16((short)(deadband + 1));
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i c = _mm256_loadu_si256((const __m256i*)(cur + i));
+		__m256i r = _mm256_loadu_si256((const __m256i*)(ref + i));
+		__m256i d = _mm256_sub_epi16(c, r);
+		__m256i a = _mm256_abs_epi16(d);
+		__m256i keep = _mm256_cmpeq_epi16(_mm256_max_epu16(a, limit), a);
+		_mm256_storeu_si256((__m256i*)(dst + i), \
+			_mm256_and_si256(keep, _mm256_xor_si256(_mm256_slli_epi16(d, 1), _mm256_srai_epi16(d, 15))));
+		_mm256_storeu_si256((__m256i*)(ref + i), _mm256_blendv_epi8(r, c, keep));
+	}
+	delta_zigzag_deadband_u16_scalar(cur + i, ref + i, pix_num - i, deadband, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void undelta_zigzag_u16_avx2(const uint16_t* src, const uint16_t* ref, int pix_num, uint16_t* dst)
+{
+	int i = 0;
+	__m256i one = _mm256_set1_epi16(1);
+	__m256i zero = _mm256_setzero_si256();
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i z = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i d = _mm256_xor_si256(_mm256_srli_epi16(z, 1), _mm256_sub_epi16(zero, _mm256_and_si256(z, one)));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(ref + i)), d));
+	}
+	undelta_zigzag_u16_scalar(src + i, ref + i, pix_num - i, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void accumulate_u16_avx2(const uint16_t* src, int pix_num, uint32_t* acc)
+{
+	int i = 0;
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i* a = (__m256i*)(acc + i);
+		__m256i lo = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+		__m256i hi = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i + 8)));
+		_mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), lo));
+		_mm256_storeu_si256(a + 1, _mm256_add_epi32(_mm256_loadu_si256(a + 1), hi));
+	}
+	accumulate_u16_scalar(src + i, pix_num - i, acc + i);
+}
+
+SIMD_TARGET_AVX2
+static void accumulate_sq_u16_avx2(const uint16_t* src, const uint16_t* ref, int pix_num, uint32_t* sum, uint64_t* sq)
+{
+	int i = 0;
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+		__m256i d = _mm256_sub_epi32(v, _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(ref + i))));
+		_mm256_storeu_si256((__m256i*)(sum + i), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(sum + i)), v));
+		__m256i d_lo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(d));
+		__m256i d_hi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(d, 1));
+		__m256i* s = (__m256i*)(sq + i);
+		_mm256_storeu_si256(s, _mm256_add_epi64(_mm256_loadu_si256(s), _mm256_mul_epi32(d_lo, d_lo)));
+		_mm256_storeu_si256(s + 1, _mm256_add_epi64(_mm256_loadu_si256(s + 1), _mm256_mul_epi32(d_hi, d_hi)));
+	}
+	accumulate_sq_u16_scalar(src + i, ref + i, pix_num - i, sum + i, sq + i);
+}
+
+SIMD_TARGET_AVX2
+static void window_u16_avx2(const uint16_t* in, const uint16_t* out, int pix_num, uint32_t* sum)
+{
+	int i = 0;
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m256i a = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(in + i)));
+		__m256i b = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(out + i)));
+		__m256i* s = (__m256i*)(sum + i);
+		_mm256_storeu_si256(s, _mm256_add_epi32(_mm256_loadu_si256(s), _mm256_sub_epi32(a, b)));
+	}
+	window_u16_scalar(in + i, out + i, pix_num - i, sum + i);
+}
+
+SIMD_TARGET_AVX2
+static void hold_u16_avx2(const uint16_t* src, int pix_num, uint16_t decay, uint16_t* max_val, uint16_t* min_val)
+{
+	int i = 0;
+	__m256i d = _mm256_set1_epi16((short)decay);
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i hi = _mm256_subs_epu16(_mm256_loadu_si256((const __m256i*)(max_val + i)), d);
+		__m256i lo = _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(min_val + i)), d);
+		_mm256_storeu_si256((__m256i*)(max_val + i), _mm256_max_epu16(v, hi));
+		_mm256_storeu_si256((__m256i*)(min_val + i), _mm256_min_epu16(v, lo));
+	}
+	hold_u16_scalar(src + i, pix_num - i, decay, max_val + i, min_val + i);
+}
+
+//the pack works per 128 bit lane, the permute puts the quarters back in order
+SIMD_TARGET_AVX2
+static void rate_u16_avx2(const uint16_t* src, int pix_num, int level_shift, int slope_shift, uint32_t mul, \
+	int32_t* level, int32_t* slope, uint16_t* dst)
+{
+	int i = 0;
+	__m128i ls = _mm_cvtsi32_si128(level_shift);
+	__m128i ss = _mm_cvtsi32_si128(slope_shift);
+	__m256i vmul = _mm256_set1_epi32((int)mul);
+	__m256i zero = _mm256_setzero_si256();
+	__m256i cap = _mm256_set1_epi32(SIMD_RATE_SLOPE_MAX);
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i r[2];
+		for (int h = 0; h < 2; h++)
+		{
+			__m256i t = _mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i + h * 8))), 8);
+			__m256i* lp = (__m256i*)(level + i + h * 8);
+			__m256i* sp = (__m256i*)(slope + i + h * 8);
+			__m256i l0 = _mm256_loadu_si256(lp);
+			__m256i s0 = _mm256_loadu_si256(sp);
+			__m256i l = _mm256_add_epi32(l0, _mm256_sra_epi32(_mm256_sub_epi32(t, l0), ls));
+			__m256i s = _mm256_sub_epi32(_mm256_add_epi32(s0, _mm256_sub_epi32(l, l0)), _mm256_sra_epi32(s0, ss));
+			_mm256_storeu_si256(lp, l);
+			_mm256_storeu_si256(sp, s);
+			__m256i c = _mm256_min_epi32(_mm256_max_epi32(_mm256_sra_epi32(s, ss), zero), cap);
+			r[h] = _mm256_srli_epi32(_mm256_mullo_epi32(c, vmul), 12);
+		}
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi32(r[0], r[1]), 0xD8));
+	}
+	rate_u16_scalar(src + i, pix_num - i, level_shift, slope_shift, mul, level + i, slope + i, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void background_u16_avx2(const uint16_t* src, int pix_num, int shift, int32_t var_floor, int32_t* mean, \
+	int32_t* var, uint16_t* dst)
+{
+	int i = 0;
+	__m128i vs = _mm_cvtsi32_si128(shift);
+	__m256i lo = _mm256_set1_epi32(-32767);
+	__m256i hi = _mm256_set1_epi32(32767);
+	__m256i vfloor = _mm256_set1_epi32(var_floor);
+	__m256 scale = _mm256_set1_ps(16.0f);
+	__m256 cap = _mm256_set1_ps(65535.0f);
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i z[2];
+		for (int h = 0; h < 2; h++)
+		{
+			__m256i t = _mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i + h * 8))), 8);
+			__m256i* mp = (__m256i*)(mean + i + h * 8);
+			__m256i* vp = (__m256i*)(var + i + h * 8);
+			__m256i m = _mm256_loadu_si256(mp);
+			__m256i d = _mm256_sub_epi32(t, m);
+			_mm256_storeu_si256(mp, _mm256_add_epi32(m, _mm256_sra_epi32(d, vs)));
+			__m256i q = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(d, 4), lo), hi);
+			__m256i d2 = _mm256_mullo_epi32(q, q);
+			__m256i v0 = _mm256_loadu_si256(vp);
+			_mm256_storeu_si256(vp, _mm256_add_epi32(v0, _mm256_sra_epi32(_mm256_sub_epi32(d2, v0), vs)));
+			__m256 f = _mm256_div_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(d2), scale), \
+				_mm256_cvtepi32_ps(_mm256_max_epi32(v0, vfloor)));
+			z[h] = _mm256_cvttps_epi32(_mm256_min_ps(f, cap));
+		}
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi32(z[0], z[1]), 0xD8));
+	}
+	background_u16_scalar(src + i, pix_num - i, shift, var_floor, mean + i, var + i, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void gather_mean4_u16_avx2(const uint16_t* src, uint32_t src_len, const uint32_t* nbr, int num, \
+	uint16_t* dst)
+{
+	//32 bit gathers read the pixel and the next one, groups touching the last pixel go scalar
+	const __m256i limit = _mm256_set1_epi32((int)src_len - 2);
+	const __m256i mask = _mm256_set1_epi32(0xffff);
+	int i = 0;
+	for (; i + 8 <= num; i += 8)
+	{
+		__m256i idx[4];
+		__m256i over = _mm256_setzero_si256();
+		for (int k = 0; k < 4; k++)
+		{
+			idx[k] = _mm256_loadu_si256((const __m256i*)(nbr + k * num + i));
+			over = _mm256_or_si256(over, _mm256_cmpgt_epi32(idx[k], limit));
+		}
+		if (!_mm256_testz_si256(over, over))
+		{
+			gather_mean4_u16_scalar(src, nbr + i, num, 8, dst + i);
+			continue;
+		}
+		__m256i acc = _mm256_set1_epi32(2);
+		for (int k = 0; k < 4; k++)
+		{
+			acc = _mm256_add_epi32(acc, _mm256_and_si256(_mm256_i32gather_epi32((const int*)src, idx[k], 2), mask));
+		}
+		acc = _mm256_srli_epi32(acc, 2);
+		__m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+		_mm_storeu_si128((__m128i*)(dst + i), packed);
+	}
+	gather_mean4_u16_scalar(src, nbr + i, num, num - i, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void gather_weight4_u16_avx2(const uint16_t* src, uint32_t src_len, const uint32_t* idx, const uint16_t* weight, \
+	int num, uint16_t* dst)
+{
+	//the same 32 bit gathers as gather_mean4_u16_avx2, each tap times its weight
+	const __m256i limit = _mm256_set1_epi32((int)src_len - 2);
+	const __m256i mask = _mm256_set1_epi32(0xffff);
+	int i = 0;
+	for (; i + 8 <= num; i += 8)
+	{
+		__m256i index[4];
+		__m256i over = _mm256_setzero_si256();
+		for (int k = 0; k < 4; k++)
+		{
+			index[k] = _mm256_loadu_si256((const __m256i*)(idx + k * num + i));
+			over = _mm256_or_si256(over, _mm256_cmpgt_epi32(index[k], limit));
+		}
+		if (!_mm256_testz_si256(over, over))
+		{
+			gather_weight4_u16_scalar(src, idx + i, weight + i, num, 8, dst + i);
+			continue;
+		}
+		__m256i acc = _mm256_set1_epi32(128);
+		for (int k = 0; k < 4; k++)
+		{
+			__m256i v = _mm256_and_si256(_mm256_i32gather_epi32((const int*)src, index[k], 2), mask);
+			__m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(weight + k * num + i)));
+			acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(v, w));
+		}
+		acc = _mm256_srli_epi32(acc, 8);
+		__m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+		_mm_storeu_si128((__m128i*)(dst + i), packed);
+	}
+	gather_weight4_u16_scalar(src, idx + i, weight + i, num, num - i, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void lut4_lerp_u16_avx2(const uint16_t* src, int num, uint16_t low, uint16_t high, uint32_t scale, \
+	const uint16_t* const* lut, const uint16_t* wx, uint16_t wy, uint16_t* dst)
+{
+	//32 bit gathers read the entry and the next one, the luts are padded for it
+	const __m256i vlow = _mm256_set1_epi32(low);
+	const __m256i vhigh = _mm256_set1_epi32(high);
+	const __m256i vscale = _mm256_set1_epi32((int)scale);
+	const __m256i mask = _mm256_set1_epi32(0xffff);
+	const __m256i full = _mm256_set1_epi32(256);
+	const __m256i wy1 = _mm256_set1_epi32(wy);
+	const __m256i wy0 = _mm256_set1_epi32(256 - wy);
+	const __m256i round = _mm256_set1_epi32(32768);
+	int i = 0;
+	for (; i + 8 <= num; i += 8)
+	{
+		__m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+		v = _mm256_min_epu32(_mm256_max_epu32(v, vlow), vhigh);
+		__m256i bin = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(v, vlow), vscale), 16);
+		__m256i w1 = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(wx + i)));
+		__m256i w0 = _mm256_sub_epi32(full, w1);
+		__m256i l[4];
+		for (int k = 0; k < 4; k++)
+		{
+			l[k] = _mm256_and_si256(_mm256_i32gather_epi32((const int*)lut[k], bin, 2), mask);
+		}
+		__m256i a = _mm256_add_epi32(_mm256_mullo_epi32(l[0], w0), _mm256_mullo_epi32(l[1], w1));
+		__m256i c = _mm256_add_epi32(_mm256_mullo_epi32(l[2], w0), _mm256_mullo_epi32(l[3], w1));
+		__m256i acc = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(a, wy0), _mm256_mullo_epi32(c, wy1)), round);
+		acc = _mm256_srli_epi32(acc, 16);
+		__m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+		_mm_storeu_si128((__m128i*)(dst + i), packed);
+	}
+	lut4_lerp_u16_scalar(src + i, num - i, low, high, scale, lut, wx + i, wy, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void lut32_u16_avx2(const uint16_t* src, int num, int shift, uint32_t lo, uint32_t hi, const uint16_t* index, \
+	const uint32_t* lut, uint32_t* dst)
+{
+	//pixels up to a 32 byte boundary of dst go scalar, every store after them is aligned. the 32 bit index
+	//gathers read the entry and the next one
+	int head = (int)(((32 - ((uintptr_t)dst & 31)) & 31) >> 2);
+	head = (head < num) ? head : num;
+	lut32_u16_scalar(src, head, shift, lo, hi, index, lut, dst);
+	const __m128i vshift = _mm_cvtsi32_si128(shift);
+	const __m256i vlo = _mm256_set1_epi32((int)lo);
+	const __m256i vhi = _mm256_set1_epi32((int)hi);
+	const __m256i mask = _mm256_set1_epi32(0xffff);
+	int i = head;
+	for (; i + 8 <= num; i += 8)
+	{
+		__m256i v = _mm256_srl_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i))), vshift);
+		v = _mm256_sub_epi32(_mm256_min_epu32(_mm256_max_epu32(v, vlo), vhi), vlo);
+		if (index != NULL)
+		{
+			v = _mm256_and_si256(_mm256_i32gather_epi32((const int*)index, v, 2), mask);
+		}
+		_mm256_store_si256((__m256i*)(dst + i), _mm256_i32gather_epi32((const int*)lut, v, 4));
+	}
+	lut32_u16_scalar(src + i, num - i, shift, lo, hi, index, lut, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void dde_u16_avx2(const uint16_t* src, const uint32_t* sum, int num, uint32_t inv, const uint16_t* lut, \
+	uint32_t lut_len, int32_t gain, uint16_t* dst)
+{
+	//the high half of sum * inv from two 32x32->64 multiplies, even and odd lanes. 32 bit gathers read the
+	//entry and the next one, groups touching the last entry go scalar
+	const __m256i vinv = _mm256_set1_epi32((int)inv);
+	const __m256i vgain = _mm256_set1_epi32(gain);
+	const __m256i two = _mm256_set1_epi32(2);
+	const __m256i round = _mm256_set1_epi32(512);
+	const __m256i limit = _mm256_set1_epi32((int)lut_len - 2);
+	const __m256i mask = _mm256_set1_epi32(0xffff);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i vmax = _mm256_set1_epi32(16383);
+	int i = 0;
+	for (; i + 8 <= num; i += 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i*)(sum + i));
+		__m256i even = _mm256_srli_epi64(_mm256_mul_epu32(s, vinv), 32);
+		__m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(s, 32), vinv);
+		__m256i base = _mm256_blend_epi32(even, odd, 0xAA);
+		__m256i index = _mm256_srli_epi32(_mm256_add_epi32(base, two), 2);
+		__m256i over = _mm256_cmpgt_epi32(index, limit);
+		if (!_mm256_testz_si256(over, over))
+		{
+			dde_u16_scalar(src + i, sum + i, 8, inv, lut, gain, dst + i);
+			continue;
+		}
+		__m256i v = _mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i))), 2);
+		__m256i d = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(v, base), vgain), \
+			round), 10);
+		__m256i mapped = _mm256_and_si256(_mm256_i32gather_epi32((const int*)lut, index, 2), mask);
+		__m256i out = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(mapped, d), zero), vmax);
+		__m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(out), _mm256_extracti128_si256(out, 1));
+		_mm_storeu_si128((__m128i*)(dst + i), packed);
+	}
+	dde_u16_scalar(src + i, sum + i, num - i, inv, lut, gain, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void threshold2_u16_avx2(const uint16_t* src, int pix_num, uint16_t lo, uint16_t hi, uint8_t* dst)
+{
+	int i = 0;
+	__m256i vlo = _mm256_set1_epi16((short)lo);
+	__m256i vhi = _mm256_set1_epi16((short)hi);
+	__m256i zero = _mm256_setzero_si256();
+	for (; i + 32 <= pix_num; i += 32)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 16));
+		__m256i ca = _mm256_add_epi16(_mm256_cmpeq_epi16(_mm256_max_epu16(a, vlo), a), \
+			_mm256_cmpeq_epi16(_mm256_max_epu16(a, vhi), a));
+		__m256i cb = _mm256_add_epi16(_mm256_cmpeq_epi16(_mm256_max_epu16(b, vlo), b), \
+			_mm256_cmpeq_epi16(_mm256_max_epu16(b, vhi), b));
+		__m256i packed = _mm256_packus_epi16(_mm256_sub_epi16(zero, ca), _mm256_sub_epi16(zero, cb));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(packed, 0xD8));
+	}
+	threshold2_u16_scalar(src + i, pix_num - i, lo, hi, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static inline __m256i gray_luma_avx2(__m256i v, int depth)
+{
+	if (depth == 16)
+	{
+		return _mm256_srli_epi16(_mm256_mulhi_epu16(v, _mm256_set1_epi16((short)0xFF01)), 8);
+	}
+	v = _mm256_min_epu16(v, _mm256_set1_epi16(16383));
+	__m256i a = _mm256_mulhi_epu16(v, _mm256_set1_epi16(1020));
+	__m256i b = _mm256_and_si256(_mm256_mullo_epi16(v, _mm256_set1_epi16(255)), _mm256_set1_epi16(0x3FFF));
+	return _mm256_add_epi16(a, _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(a, b), _mm256_set1_epi16(1)), 14));
+}
+
+SIMD_TARGET_AVX2
+static void gray_to_yuv_avx2(const uint16_t* src, int pix_num, int depth, int yuyv, uint8_t* dst)
+{
+	int i = 0;
+	__m256i chroma = _mm256_set1_epi16((short)0x8000);
+	if (yuyv)
+	{
+		for (; i + 16 <= pix_num; i += 16)
+		{
+			__m256i y = gray_luma_avx2(_mm256_loadu_si256((const __m256i*)(src + i)), depth);
+			_mm256_storeu_si256((__m256i*)(dst + 2 * i), _mm256_or_si256(y, chroma));
+		}
+		gray_to_yuv_scalar(src + i, pix_num - i, depth, yuyv, dst + 2 * i);
+		return;
+	}
+	for (; i + 32 <= pix_num; i += 32)
+	{
+		__m256i a = gray_luma_avx2(_mm256_loadu_si256((const __m256i*)(src + i)), depth);
+		__m256i b = gray_luma_avx2(_mm256_loadu_si256((const __m256i*)(src + i + 16)), depth);
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8));
+	}
+	gray_to_yuv_scalar(src + i, pix_num - i, depth, yuyv, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void tnr_u16_avx2(const uint16_t* src, int shift, int pix_num, uint16_t low, uint16_t range, \
+	uint16_t still_weight, uint16_t slope, uint16_t* history, uint16_t* dst)
+{
+	int i = 0;
+	__m256i vlow = _mm256_set1_epi16((short)low);
+	__m256i vrange = _mm256_set1_epi16((short)range);
+	__m256i vstill = _mm256_set1_epi16((short)still_weight);
+	__m256i vslope = _mm256_set1_epi16((short)slope);
+	__m256i vmax = _mm256_set1_epi16(32767);
+	__m256i one = _mm256_set1_epi16(1);
+	__m128i vshift = _mm_cvtsi32_si128(shift);
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i h = _mm256_loadu_si256((const __m256i*)(history + i));
+		__m256i c = _mm256_slli_epi16(_mm256_srl_epi16(_mm256_loadu_si256((const __m256i*)(src + i)), vshift), 1);
+		__m256i diff = _mm256_sub_epi16(c, h);
+		__m256i m = _mm256_min_epu16(_mm256_subs_epu16(_mm256_srli_epi16(_mm256_abs_epi16(diff), 1), vlow), vrange);
+		__m256i w = _mm256_add_epi16(vstill, _mm256_mullo_epi16(m, vslope));
+		w = _mm256_blendv_epi8(w, vmax, _mm256_cmpeq_epi16(m, vrange));
+		h = _mm256_add_epi16(h, _mm256_mulhrs_epi16(diff, w));
+		_mm256_storeu_si256((__m256i*)(history + i), h);
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_sll_epi16(_mm256_srli_epi16(_mm256_add_epi16(h, one), 1), vshift));
+	}
+	tnr_u16_scalar(src + i, shift, pix_num - i, low, range, still_weight, slope, history + i, dst + i);
+}
+
+//unpack and pack both work within 128 bit lanes, so the values come out in order
+SIMD_TARGET_AVX2
+static void fir_u16_avx2(const uint16_t* const* src, const int16_t* weight, int taps, int shift, int pix_num, \
+	uint16_t* dst)
+{
+	int i = 0;
+	__m256i w01 = _mm256_set1_epi32((int)(((uint32_t)(uint16_t)weight[1] << 16) | (uint16_t)weight[0]));
+	__m256i w23 = (taps == 4) ? _mm256_set1_epi32((int)(((uint32_t)(uint16_t)weight[3] << 16) | (uint16_t)weight[2])) : \
+		_mm256_setzero_si256();
+	__m256i round = _mm256_set1_epi32(0x2000);
+	__m256i vmax = _mm256_set1_epi16(16383);
+	__m128i vshift = _mm_cvtsi32_si128(shift);
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i s0 = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i*)(src[0] + i)), vshift);
+		__m256i s1 = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i*)(src[1] + i)), vshift);
+		__m256i lo = _mm256_add_epi32(round, _mm256_madd_epi16(_mm256_unpacklo_epi16(s0, s1), w01));
+		__m256i hi = _mm256_add_epi32(round, _mm256_madd_epi16(_mm256_unpackhi_epi16(s0, s1), w01));
+		if (taps == 4)
+		{
+			__m256i s2 = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i*)(src[2] + i)), vshift);
+			__m256i s3 = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i*)(src[3] + i)), vshift);
+			lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(s2, s3), w23));
+			hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(s2, s3), w23));
+		}
+		__m256i out = _mm256_packus_epi32(_mm256_srai_epi32(lo, 14), _mm256_srai_epi32(hi, 14));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_min_epu16(out, vmax));
+	}
+	fir_u16_scalar(src, weight, taps, shift, i, pix_num, dst);
+}
+
+//the lane crossing permute puts the in-lane pack back in value order, one movemask is a whole plane
+SIMD_TARGET_AVX2
+static int bitplane_pack_avx2(const uint16_t* src, int block_num, uint8_t* widths, uint8_t* planes)
+{
+	uint8_t* out = planes;
+	for (int b = 0; b < block_num; b++)
+	{
+		const __m256i* v = (const __m256i*)(src + b * SIMD_BITPLANE_BLOCK);
+		__m256i v0 = _mm256_loadu_si256(v), v1 = _mm256_loadu_si256(v + 1);
+		__m128i any = _mm_or_si128(_mm256_castsi256_si128(_mm256_or_si256(v0, v1)), \
+			_mm256_extracti128_si256(_mm256_or_si256(v0, v1), 1));
+		any = _mm_or_si128(any, _mm_srli_si128(any, 8));
+		any = _mm_or_si128(any, _mm_srli_si128(any, 4));
+		any = _mm_or_si128(any, _mm_srli_si128(any, 2));
+		int width = bitplane_width((uint32_t)_mm_extract_epi16(any, 0));
+		widths[b] = (uint8_t)width;
+		for (int k = width - 1; k >= 0; k--)
+		{
+			__m128i s = _mm_cvtsi32_si128(15 - k);
+			__m256i packed = _mm256_packs_epi16(_mm256_sll_epi16(v0, s), _mm256_sll_epi16(v1, s));
+			uint32_t plane = (uint32_t)_mm256_movemask_epi8(_mm256_permute4x64_epi64(packed, 0xD8));
+			memcpy(out, &plane, 4);
+			out += 4;
+		}
+	}
+	return (int)(out - planes);
+}
+
+SIMD_TARGET_AVX2
+static int bitplane_unpack_avx2(const uint8_t* widths, const uint8_t* planes, int block_num, uint16_t* dst)
+{
+	const uint8_t* in = planes;
+	__m256i bits = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, \
+		(short)0x8000);
+	for (int b = 0; b < block_num; b++)
+	{
+		__m256i o0 = _mm256_setzero_si256(), o1 = _mm256_setzero_si256();
+		for (int k = widths[b] - 1; k >= 0; k--)
+		{
+			uint32_t plane;
+			memcpy(&plane, in, 4);
+			in += 4;
+			__m256i bit = _mm256_set1_epi16((short)(1 << k));
+			__m256i m0 = _mm256_and_si256(_mm256_set1_epi16((short)(plane & 0xFFFF)), bits);
+			__m256i m1 = _mm256_and_si256(_mm256_set1_epi16((short)(plane >> 16)), bits);
+			o0 = _mm256_or_si256(o0, _mm256_and_si256(_mm256_cmpeq_epi16(m0, bits), bit));
+			o1 = _mm256_or_si256(o1, _mm256_and_si256(_mm256_cmpeq_epi16(m1, bits), bit));
+		}
+		__m256i* v = (__m256i*)(dst + b * SIMD_BITPLANE_BLOCK);
+		_mm256_storeu_si256(v, o0);
+		_mm256_storeu_si256(v + 1, o1);
+	}
+	return (int)(in - planes);
+}
+
+SIMD_TARGET_SSE41
+static inline __m128i hdr_fuse_lanes_sse41(__m128i h, __m128i l, __m128i vknee, __m128i vfull, __m128i vshift, \
+	__m128i vmotion, int newer_low)
+{
+	__m128i d = _mm_sub_epi32(l, h);
+	__m128i w = _mm_min_epi32(_mm_max_epi32(_mm_sub_epi32(h, vknee), _mm_setzero_si128()), vfull);
+	__m128i f = _mm_add_epi32(h, _mm_sra_epi32(_mm_mullo_epi32(d, w), vshift));
+	__m128i moved = _mm_and_si128(_mm_cmpgt_epi32(_mm_abs_epi32(d), vmotion), _mm_cmpgt_epi32(vfull, w));
+	return _mm_blendv_epi8(f, newer_low ? l : h, moved);
+}
+
+SIMD_TARGET_SSE41
+static void hdr_fuse_u16_sse41(const uint16_t* high, const uint16_t* low, int pix_num, uint16_t knee, int knee_shift, \
+	uint16_t motion, int newer_low, uint16_t* dst)
+{
+	int i = 0;
+	__m128i vknee = _mm_set1_epi32(knee);
+	__m128i vfull = _mm_set1_epi32(1 << knee_shift);
+	__m128i vshift = _mm_cvtsi32_si128(knee_shift);
+	__m128i vmotion = _mm_set1_epi32(motion);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		__m128i h = _mm_loadu_si128((const __m128i*)(high + i));
+		__m128i l = _mm_loadu_si128((const __m128i*)(low + i));
+		__m128i lo = hdr_fuse_lanes_sse41(_mm_cvtepu16_epi32(h), _mm_cvtepu16_epi32(l), vknee, vfull, vshift, \
+			vmotion, newer_low);
+		__m128i hi = hdr_fuse_lanes_sse41(_mm_cvtepu16_epi32(_mm_srli_si128(h, 8)), \
+			_mm_cvtepu16_epi32(_mm_srli_si128(l, 8)), vknee, vfull, vshift, vmotion, newer_low);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi32(lo, hi));
+	}
+	hdr_fuse_u16_scalar(high + i, low + i, pix_num - i, knee, knee_shift, motion, newer_low, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static inline __m256i hdr_fuse_lanes_avx2(__m256i h, __m256i l, __m256i vknee, __m256i vfull, __m128i vshift, \
+	__m256i vmotion, int newer_low)
+{
+	__m256i d = _mm256_sub_epi32(l, h);
+	__m256i w = _mm256_min_epi32(_mm256_max_epi32(_mm256_sub_epi32(h, vknee), _mm256_setzero_si256()), vfull);
+	__m256i f = _mm256_add_epi32(h, _mm256_sra_epi32(_mm256_mullo_epi32(d, w), vshift));
+	__m256i moved = _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_abs_epi32(d), vmotion), _mm256_cmpgt_epi32(vfull, w));
+	return _mm256_blendv_epi8(f, newer_low ? l : h, moved);
+}
+
+SIMD_TARGET_AVX2
+static void hdr_fuse_u16_avx2(const uint16_t* high, const uint16_t* low, int pix_num, uint16_t knee, int knee_shift, \
+	uint16_t motion, int newer_low, uint16_t* dst)
+{
+	int i = 0;
+	__m256i vknee = _mm256_set1_epi32(knee);
+	__m256i vfull = _mm256_set1_epi32(1 << knee_shift);
+	__m128i vshift = _mm_cvtsi32_si128(knee_shift);
+	__m256i vmotion = _mm256_set1_epi32(motion);
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i h = _mm256_loadu_si256((const __m256i*)(high + i));
+		__m256i l = _mm256_loadu_si256((const __m256i*)(low + i));
+		__m256i lo = hdr_fuse_lanes_avx2(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(h)), \
+			_mm256_cvtepu16_epi32(_mm256_castsi256_si128(l)), vknee, vfull, vshift, vmotion, newer_low);
+		__m256i hi = hdr_fuse_lanes_avx2(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(h, 1)), \
+			_mm256_cvtepu16_epi32(_mm256_extracti128_si256(l, 1)), vknee, vfull, vshift, vmotion, newer_low);
+		//packus works per 128 bit lane, put the quadwords back in order
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8));
+	}
+	hdr_fuse_u16_scalar(high + i, low + i, pix_num - i, knee, knee_shift, motion, newer_low, dst + i);
+}
+SIMD_TARGET_SSE41
+static void stretch_u16_u8_sse41(const uint16_t* src, int pix_num, uint16_t min_val, float scale, uint8_t* dst)
+{
+	int i = 0;
+	__m128i vmin = _mm_set1_epi16((short)min_val);
+	__m128 vscale = _mm_set1_ps(scale);
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m128i v[2];
+		for (int k = 0; k < 2; k++)
+		{
+			__m128i x = _mm_subs_epu16(_mm_loadu_si128((const __m128i*)(src + i + k * 8)), vmin);
+			__m128i lo = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(x)), vscale));
+			__m128i hi = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(x, 8))), vscale));
+			v[k] = _mm_packus_epi32(lo, hi);
+		}
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(v[0], v[1]));
+	}
+	stretch_u16_u8_scalar(src + i, pix_num - i, min_val, scale, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void stretch_u16_u8_avx2(const uint16_t* src, int pix_num, uint16_t min_val, float scale, uint8_t* dst)
+{
+	int i = 0;
+	__m256i vmin = _mm256_set1_epi16((short)min_val);
+	__m256 vscale = _mm256_set1_ps(scale);
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m256i x = _mm256_subs_epu16(_mm256_loadu_si256((const __m256i*)(src + i)), vmin);
+		__m256i lo = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps( \
+			_mm256_cvtepu16_epi32(_mm256_castsi256_si128(x))), vscale));
+		__m256i hi = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps( \
+			_mm256_cvtepu16_epi32(_mm256_extracti128_si256(x, 1))), vscale));
+		//packus works per 128 bit lane, put the quadwords back in order
+		__m256i v = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(_mm256_castsi256_si128(v), \
+			_mm256_extracti128_si256(v, 1)));
+	}
+	stretch_u16_u8_scalar(src + i, pix_num - i, min_val, scale, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void remap_add_u16_avx2(const uint16_t* src, uint32_t src_len, int stride, const uint32_t* base, \
+	const uint16_t* frac, const uint16_t* weight, int num, uint16_t* dst)
+{
+	//a 32 bit gather takes both horizontal taps, groups reaching past the plane go scalar
+	const __m256i limit = _mm256_set1_epi32((int)src_len - stride - 2);
+	const __m256i low16 = _mm256_set1_epi32(0xffff);
+	const __m256i v64 = _mm256_set1_epi32(64);
+	int i = 0;
+	for (; i + 8 <= num; i += 8)
+	{
+		__m256i idx = _mm256_loadu_si256((const __m256i*)(base + i));
+		__m256i over = _mm256_cmpgt_epi32(idx, limit);
+		if (!_mm256_testz_si256(over, over))
+		{
+			remap_add_u16_scalar(src, stride, base + i, frac + i, weight + i, 8, dst + i);
+			continue;
+		}
+		__m256i g0 = _mm256_i32gather_epi32((const int*)src, idx, 2);
+		__m256i g1 = _mm256_i32gather_epi32((const int*)(src + stride), idx, 2);
+		__m256i f = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(frac + i)));
+		__m256i fx = _mm256_and_si256(f, _mm256_set1_epi32(0xff));
+		__m256i fy = _mm256_srli_epi32(f, 8);
+		__m256i gx = _mm256_sub_epi32(v64, fx);
+		__m256i top = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(g0, low16), gx), \
+			_mm256_mullo_epi32(_mm256_srli_epi32(g0, 16), fx));
+		__m256i bottom = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(g1, low16), gx), \
+			_mm256_mullo_epi32(_mm256_srli_epi32(g1, 16), fx));
+		__m256i v = _mm256_add_epi32(_mm256_mullo_epi32(top, _mm256_sub_epi32(v64, fy)), _mm256_mullo_epi32(bottom, fy));
+		v = _mm256_srli_epi32(_mm256_add_epi32(v, _mm256_set1_epi32(2048)), 12);
+		__m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(weight + i)));
+		__m256i a = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(v, w), _mm256_set1_epi32(128)), 8);
+		__m256i sum = _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(dst + i))), a);
+		sum = _mm256_min_epu32(sum, low16);
+		//packus works per 128 bit lane, put the quadwords back in order
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(sum, sum), 0xD8);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm256_castsi256_si128(packed));
+	}
+	remap_add_u16_scalar(src, stride, base + i, frac + i, weight + i, num - i, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void remap_row_u16_avx2(const uint16_t* src, uint32_t src_len, int stride, const uint32_t* col, \
+	const uint8_t* fx, uint32_t fy, int num, uint16_t* dst)
+{
+	//the gathers of remap_add_u16_avx2, one fy for the row
+	const __m256i limit = _mm256_set1_epi32((int)src_len - stride - 2);
+	const __m256i low16 = _mm256_set1_epi32(0xffff);
+	const __m256i v64 = _mm256_set1_epi32(64);
+	const __m256i vfy = _mm256_set1_epi32((int)fy);
+	const __m256i gy = _mm256_set1_epi32(64 - (int)fy);
+	const __m256i round = _mm256_set1_epi32(2048);
+	int i = 0;
+	for (; i + 8 <= num; i += 8)
+	{
+		__m256i idx = _mm256_loadu_si256((const __m256i*)(col + i));
+		__m256i over = _mm256_cmpgt_epi32(idx, limit);
+		if (!_mm256_testz_si256(over, over))
+		{
+			remap_row_u16_scalar(src, stride, col + i, fx + i, fy, 8, dst + i);
+			continue;
+		}
+		__m256i g0 = _mm256_i32gather_epi32((const int*)src, idx, 2);
+		__m256i g1 = _mm256_i32gather_epi32((const int*)(src + stride), idx, 2);
+		__m256i wx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(fx + i)));
+		__m256i gx = _mm256_sub_epi32(v64, wx);
+		__m256i top = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(g0, low16), gx), \
+			_mm256_mullo_epi32(_mm256_srli_epi32(g0, 16), wx));
+		__m256i bottom = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(g1, low16), gx), \
+			_mm256_mullo_epi32(_mm256_srli_epi32(g1, 16), wx));
+		__m256i v = _mm256_add_epi32(_mm256_mullo_epi32(top, gy), _mm256_mullo_epi32(bottom, vfy));
+		v = _mm256_srli_epi32(_mm256_add_epi32(v, round), 12);
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), 0xD8);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm256_castsi256_si128(packed));
+	}
+	remap_row_u16_scalar(src, stride, col + i, fx + i, fy, num - i, dst + i);
+}
+
+SIMD_TARGET_AVX2
+static void remap_bgr_avx2(const uint8_t* src, uint32_t src_len, int stride, const uint32_t* base, const uint16_t* frac, \
+	int num, uint8_t* dst)
+{
+	//32 bit gathers read a pixel and one byte more, groups reaching past the frame go scalar
+	const __m256i limit = _mm256_set1_epi32((int)src_len - stride - 7);
+	const __m256i v64 = _mm256_set1_epi32(64);
+	const __m256i vround = _mm256_set1_epi32(2048);
+	const __m128i compact = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	const __m256i vcompact = _mm256_broadcastsi128_si256(compact);
+	int i = 0;
+	//the 8 pixels are stored as 2 x 16 bytes of which 12 count, 2 more pixels keep the last store inside the row
+	for (; i + 10 <= num; i += 8)
+	{
+		__m256i idx = _mm256_loadu_si256((const __m256i*)(base + i));
+		if (!_mm256_testz_si256(_mm256_cmpgt_epi32(idx, limit), _mm256_cmpgt_epi32(idx, limit)))
+		{
+			remap_bgr_scalar(src, stride, base + i, frac + i, 8, dst + 3 * i);
+			continue;
+		}
+		__m256i t00 = _mm256_i32gather_epi32((const int*)src, idx, 1);
+		__m256i t01 = _mm256_i32gather_epi32((const int*)(src + 3), idx, 1);
+		__m256i t10 = _mm256_i32gather_epi32((const int*)(src + stride), idx, 1);
+		__m256i t11 = _mm256_i32gather_epi32((const int*)(src + stride + 3), idx, 1);
+		__m256i f = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(frac + i)));
+		__m256i fx = _mm256_and_si256(f, _mm256_set1_epi32(0xff));
+		__m256i fy = _mm256_srli_epi32(f, 8);
+		//(64 - fx, fx) bytes for two channels per lane, (64 - fy, fy) words
+		__m256i wx = _mm256_sub_epi32(_mm256_add_epi32(v64, _mm256_slli_epi32(fx, 8)), fx);
+		wx = _mm256_or_si256(wx, _mm256_slli_epi32(wx, 16));
+		__m256i wy = _mm256_sub_epi32(_mm256_add_epi32(v64, _mm256_slli_epi32(fy, 16)), fy);
+		__m256i wx_lo = _mm256_unpacklo_epi32(wx, wx);
+		__m256i wx_hi = _mm256_unpackhi_epi32(wx, wx);
+		//per lane: pixels 0-1 and 2-3, 4 channels each, in 16 bits
+		__m256i top_lo = _mm256_maddubs_epi16(_mm256_unpacklo_epi8(t00, t01), wx_lo);
+		__m256i top_hi = _mm256_maddubs_epi16(_mm256_unpackhi_epi8(t00, t01), wx_hi);
+		__m256i bottom_lo = _mm256_maddubs_epi16(_mm256_unpacklo_epi8(t10, t11), wx_lo);
+		__m256i bottom_hi = _mm256_maddubs_epi16(_mm256_unpackhi_epi8(t10, t11), wx_hi);
+		__m256i p0 = _mm256_madd_epi16(_mm256_unpacklo_epi16(top_lo, bottom_lo), _mm256_shuffle_epi32(wy, 0x00));
+		__m256i p1 = _mm256_madd_epi16(_mm256_unpackhi_epi16(top_lo, bottom_lo), _mm256_shuffle_epi32(wy, 0x55));
+		__m256i p2 = _mm256_madd_epi16(_mm256_unpacklo_epi16(top_hi, bottom_hi), _mm256_shuffle_epi32(wy, 0xAA));
+		__m256i p3 = _mm256_madd_epi16(_mm256_unpackhi_epi16(top_hi, bottom_hi), _mm256_shuffle_epi32(wy, 0xFF));
+		p0 = _mm256_srli_epi32(_mm256_add_epi32(p0, vround), 12);
+		p1 = _mm256_srli_epi32(_mm256_add_epi32(p1, vround), 12);
+		p2 = _mm256_srli_epi32(_mm256_add_epi32(p2, vround), 12);
+		p3 = _mm256_srli_epi32(_mm256_add_epi32(p3, vround), 12);
+		__m256i bgrx = _mm256_packus_epi16(_mm256_packs_epi32(p0, p1), _mm256_packs_epi32(p2, p3));
+		__m256i bgr = _mm256_shuffle_epi8(bgrx, vcompact);
+		_mm_storeu_si128((__m128i*)(dst + 3 * i), _mm256_castsi256_si128(bgr));
+		_mm_storeu_si128((__m128i*)(dst + 3 * i + 12), _mm256_extracti128_si256(bgr, 1));
+	}
+	remap_bgr_scalar(src, stride, base + i, frac + i, num - i, dst + 3 * i);
+}
+
+//9 * center - the 3x3 sum of 8 pixels in 16 bits, sum and center below 2^12
+SIMD_TARGET_SSE41
+static inline __m128i edge_laplace8_sse41(const uint8_t* prev, const uint8_t* cur, const uint8_t* next)
+{
+	__m128i sum = _mm_setzero_si128();
+	const uint8_t* rows[3] = { prev, cur, next };
+	for (int r = 0; r < 3; r++)
+	{
+		sum = _mm_add_epi16(sum, _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(rows[r] - 1))));
+		sum = _mm_add_epi16(sum, _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)rows[r])));
+		sum = _mm_add_epi16(sum, _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(rows[r] + 1))));
+	}
+	__m128i c = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)cur));
+	return _mm_sub_epi16(_mm_add_epi16(_mm_slli_epi16(c, 3), c), sum);
+}
+
+SIMD_TARGET_SSE41
+static void edge_add_bgr_sse41(const uint8_t* prev, const uint8_t* cur, const uint8_t* next, int num, int strength, \
+	uint8_t* bgr)
+{
+	const __m128i vstrength = _mm_set1_epi16((int16_t)strength);
+	const __m128i sign = _mm_set1_epi8((char)0x80);
+	//each edge byte three times, for the 48 bytes of 16 bgr pixels
+	const __m128i spread0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+	const __m128i spread1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+	const __m128i spread2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+	int i = 0;
+	for (; i + 16 <= num; i += 16)
+	{
+		__m128i lo = edge_laplace8_sse41(prev + i, cur + i, next + i);
+		__m128i hi = edge_laplace8_sse41(prev + i + 8, cur + i + 8, next + i + 8);
+		lo = _mm_srai_epi16(_mm_mullo_epi16(_mm_srai_epi16(lo, 3), vstrength), 4);
+		hi = _mm_srai_epi16(_mm_mullo_epi16(_mm_srai_epi16(hi, 3), vstrength), 4);
+		__m128i e = _mm_packs_epi16(lo, hi);
+		//u8 + s8 with saturation: shift the bytes to signed, add, shift back
+		__m128i* out = (__m128i*)(bgr + 3 * i);
+		__m128i b0 = _mm_xor_si128(_mm_loadu_si128(out), sign);
+		__m128i b1 = _mm_xor_si128(_mm_loadu_si128(out + 1), sign);
+		__m128i b2 = _mm_xor_si128(_mm_loadu_si128(out + 2), sign);
+		_mm_storeu_si128(out, _mm_xor_si128(_mm_adds_epi8(b0, _mm_shuffle_epi8(e, spread0)), sign));
+		_mm_storeu_si128(out + 1, _mm_xor_si128(_mm_adds_epi8(b1, _mm_shuffle_epi8(e, spread1)), sign));
+		_mm_storeu_si128(out + 2, _mm_xor_si128(_mm_adds_epi8(b2, _mm_shuffle_epi8(e, spread2)), sign));
+	}
+	edge_add_bgr_scalar(prev + i, cur + i, next + i, num - i, strength, bgr + 3 * i);
+}
+
+//avx-512 f+bw: the kernels that are a plain load, a lane wise op and a store. the others run their avx2 version
+SIMD_TARGET_AVX512
+static void minmax_u16_avx512(const uint16_t* src, int pix_num, uint16_t* min_val, uint16_t* max_val)
+{
+	int i = 0;
+	__m512i vmin = _mm512_set1_epi16((short)0xFFFF);
+	__m512i vmax = _mm512_setzero_si512();
+	for (; i + 32 <= pix_num; i += 32)
+	{
+		__m512i v = _mm512_loadu_si512((const void*)(src + i));
+		vmin = _mm512_min_epu16(vmin, v);
+		vmax = _mm512_max_epu16(vmax, v);
+	}
+	uint16_t lane_min[32], lane_max[32];
+	_mm512_storeu_si512((void*)lane_min, vmin);
+	_mm512_storeu_si512((void*)lane_max, vmax);
+	uint16_t min_tmp, max_tmp;
+	minmax_u16_scalar(src + i, pix_num - i, &min_tmp, &max_tmp);
+	for (int k = 0; k < 32; k++)
+	{
+		if (lane_min[k] < min_tmp) min_tmp = lane_min[k];
+		if (lane_max[k] > max_tmp) max_tmp = lane_max[k];
+	}
+	*min_val = min_tmp;
+	*max_val = max_tmp;
+}
+
+//the correction of stretch_u32x4_sse41 with mask registers
+SIMD_TARGET_AVX512
+static inline __m256i stretch_u32x16_avx512(__m256i n16, __m512 inv, __m512i range, __m512i range_max, __m512i scale)
+{
+	__m512i n = _mm512_cvtepu16_epi32(n16);
+	__m512i one = _mm512_set1_epi32(1);
+	__m512i q = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_cvtepi32_ps(n), inv));
+	__m512i r = _mm512_sub_epi32(_mm512_mullo_epi32(n, scale), _mm512_mullo_epi32(q, range));
+	q = _mm512_mask_sub_epi32(q, _mm512_cmplt_epi32_mask(r, _mm512_setzero_si512()), q, one);
+	q = _mm512_mask_add_epi32(q, _mm512_cmpgt_epi32_mask(r, range_max), q, one);
+	return _mm512_cvtusepi32_epi16(q);
+}
+
+SIMD_TARGET_AVX512
+static void stretch_u16_avx512(const uint16_t* src, int pix_num, uint16_t min_val, uint32_t range, uint16_t* dst)
+{
+	int i = 0;
+	__m512i vmin = _mm512_set1_epi16((short)min_val);
+	__m512 inv = _mm512_set1_ps(16383.0f / (float)range);
+	__m512i vrange = _mm512_set1_epi32((int)range);
+	__m512i vrange_max = _mm512_set1_epi32((int)range - 1);
+	__m512i scale = _mm512_set1_epi32(16383);
+	for (; i + 32 <= pix_num; i += 32)
+	{
+		__m512i n = _mm512_sub_epi16(_mm512_loadu_si512((const void*)(src + i)), vmin);
+		__m256i lo = stretch_u32x16_avx512(_mm512_castsi512_si256(n), inv, vrange, vrange_max, scale);
+		__m256i hi = stretch_u32x16_avx512(_mm512_extracti64x4_epi64(n, 1), inv, vrange, vrange_max, scale);
+		_mm256_storeu_si256((__m256i*)(dst + i), lo);
+		_mm256_storeu_si256((__m256i*)(dst + i + 16), hi);
+	}
+	stretch_u16_scalar(src + i, pix_num - i, min_val, range, dst + i);
+}
+
+SIMD_TARGET_AVX512
+static void stretch_u16_u8_avx512(const uint16_t* src, int pix_num, uint16_t min_val, float scale, uint8_t* dst)
+{
+	int i = 0;
+	__m512i vmin = _mm512_set1_epi16((short)min_val);
+	__m512 vscale = _mm512_set1_ps(scale);
+	for (; i + 32 <= pix_num; i += 32)
+	{
+		__m512i x = _mm512_subs_epu16(_mm512_loadu_si512((const void*)(src + i)), vmin);
+		__m512i lo = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_cvtepi32_ps( \
+			_mm512_cvtepu16_epi32(_mm512_castsi512_si256(x))), vscale));
+		__m512i hi = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_cvtepi32_ps( \
+			_mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(x, 1))), vscale));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm512_cvtusepi32_epi8(lo));
+		_mm_storeu_si128((__m128i*)(dst + i + 16), _mm512_cvtusepi32_epi8(hi));
+	}
+	stretch_u16_u8_scalar(src + i, pix_num - i, min_val, scale, dst + i);
+}
+
+SIMD_TARGET_AVX512
+static void accumulate_u16_avx512(const uint16_t* src, int pix_num, uint32_t* acc)
+{
+	int i = 0;
+	for (; i + 32 <= pix_num; i += 32)
+	{
+		__m512i lo = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(src + i)));
+		__m512i hi = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(src + i + 16)));
+		_mm512_storeu_si512((void*)(acc + i), _mm512_add_epi32(_mm512_loadu_si512((const void*)(acc + i)), lo));
+		_mm512_storeu_si512((void*)(acc + i + 16), _mm512_add_epi32(_mm512_loadu_si512((const void*)(acc + i + 16)), hi));
+	}
+	accumulate_u16_scalar(src + i, pix_num - i, acc + i);
+}
+
+SIMD_TARGET_AVX512
+static void window_u16_avx512(const uint16_t* in, const uint16_t* out, int pix_num, uint32_t* sum)
+{
+	int i = 0;
+	for (; i + 16 <= pix_num; i += 16)
+	{
+		__m512i a = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(in + i)));
+		__m512i b = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(out + i)));
+		__m512i s = _mm512_loadu_si512((const void*)(sum + i));
+		_mm512_storeu_si512((void*)(sum + i), _mm512_add_epi32(s, _mm512_sub_epi32(a, b)));
+	}
+	window_u16_scalar(in + i, out + i, pix_num - i, sum + i);
+}
+
+SIMD_TARGET_AVX512
+static void hold_u16_avx512(const uint16_t* src, int pix_num, uint16_t decay, uint16_t* max_val, uint16_t* min_val)
+{
+	int i = 0;
+	__m512i d = _mm512_set1_epi16((short)decay);
+	for (; i + 32 <= pix_num; i += 32)
+	{
+		__m512i v = _mm512_loadu_si512((const void*)(src + i));
+		__m512i hi = _mm512_subs_epu16(_mm512_loadu_si512((const void*)(max_val + i)), d);
+		__m512i lo = _mm512_adds_epu16(_mm512_loadu_si512((const void*)(min_val + i)), d);
+		_mm512_storeu_si512((void*)(max_val + i), _mm512_max_epu16(v, hi));
+		_mm512_storeu_si512((void*)(min_val + i), _mm512_min_epu16(v, lo));
+	}
+	hold_u16_scalar(src + i, pix_num - i, decay, max_val + i, min_val + i);
+}
+
+SIMD_TARGET_AVX512
+static void threshold2_u16_avx512(const uint16_t* src, int pix_num, uint16_t lo, uint16_t hi, uint8_t* dst)
+{
+	int i = 0;
+	__m512i vlo = _mm512_set1_epi16((short)lo);
+	__m512i vhi = _mm512_set1_epi16((short)hi);
+	__m512i one = _mm512_set1_epi16(1);
+	for (; i + 32 <= pix_num; i += 32)
+	{
+		__m512i a = _mm512_loadu_si512((const void*)(src + i));
+		__m512i c = _mm512_add_epi16(_mm512_maskz_mov_epi16(_mm512_cmpge_epu16_mask(a, vlo), one), \
+			_mm512_maskz_mov_epi16(_mm512_cmpge_epu16_mask(a, vhi), one));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm512_cvtepi16_epi8(c));
+	}
+	threshold2_u16_scalar(src + i, pix_num - i, lo, hi, dst + i);
+}
+#endif
+
+#if defined(SIMD_NEON)
+static void minmax_u16_neon(const uint16_t* src, int pix_num, uint16_t* min_val, uint16_t* max_val)
+{
+	int i = 0;
+	uint16x8_t vmin = vdupq_n_u16(0xFFFF);
+	uint16x8_t vmax = vdupq_n_u16(0);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		uint16x8_t v = vld1q_u16(src + i);
+		vmin = vminq_u16(vmin, v);
+		vmax = vmaxq_u16(vmax, v);
+	}
+	uint16_t lane_min[8], lane_max[8];
+	vst1q_u16(lane_min, vmin);
+	vst1q_u16(lane_max, vmax);
+	uint16_t min_tmp, max_tmp;
+	minmax_u16_scalar(src + i, pix_num - i, &min_tmp, &max_tmp);
+	for (int k = 0; k < 8; k++)
+	{
+		if (lane_min[k] < min_tmp) min_tmp = lane_min[k];
+		if (lane_max[k] > max_tmp) max_tmp = lane_max[k];
+	}
+	*min_val = min_tmp;
+	*max_val = max_tmp;
+}
+
+static inline uint16x4_t stretch_u32x4_neon(uint32x4_t n, float32x4_t inv, int32x4_t range, int32x4_t range_max, int32x4_t scale)
+{
+	int32x4_t q = vreinterpretq_s32_u32(vcvtq_u32_f32(vmulq_f32(vcvtq_f32_u32(n), inv)));
+	int32x4_t r = vsubq_s32(vmulq_s32(vreinterpretq_s32_u32(n), scale), vmulq_s32(q, range));
+	//comparison masks are all ones, adding -1 / subtracting -1 moves q by one
+	q = vaddq_s32(q, vreinterpretq_s32_u32(vcltq_s32(r, vdupq_n_s32(0))));
+	q = vsubq_s32(q, vreinterpretq_s32_u32(vcgtq_s32(r, range_max)));
+	return vqmovun_s32(q);
+}
+
+static void stretch_u16_neon(const uint16_t* src, int pix_num, uint16_t min_val, uint32_t range, uint16_t* dst)
+{
+	int i = 0;
+	uint16x8_t vmin = vdupq_n_u16(min_val);
+	float32x4_t inv = vdupq_n_f32(16383.0f / (float)range);
+	int32x4_t vrange = vdupq_n_s32((int)range);
+	int32x4_t vrange_max = vdupq_n_s32((int)range - 1);
+	int32x4_t scale = vdupq_n_s32(16383);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		uint16x8_t n = vsubq_u16(vld1q_u16(src + i), vmin);
+		uint16x4_t lo = stretch_u32x4_neon(vmovl_u16(vget_low_u16(n)), inv, vrange, vrange_max, scale);
+		uint16x4_t hi = stretch_u32x4_neon(vmovl_u16(vget_high_u16(n)), inv, vrange, vrange_max, scale);
+		vst1q_u16(dst + i, vcombine_u16(lo, hi));
+	}
+	stretch_u16_scalar(src + i, pix_num - i, min_val, range, dst + i);
+}
+
+static int range_minmax_u16_neon(const uint16_t* src, int pix_num, uint16_t lo, uint16_t hi, \
+	uint16_t* min_val, uint16_t* max_val)
+{
+	int i = 0;
+	uint16x8_t vlo = vdupq_n_u16(lo);
+	uint16x8_t vhi = vdupq_n_u16(hi);
+	uint16x8_t vmin = vdupq_n_u16(0xFFFF);
+	uint16x8_t vmax = vdupq_n_u16(0);
+	uint32x4_t vcount = vdupq_n_u32(0);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		uint16x8_t v = vld1q_u16(src + i);
+		uint16x8_t in = vandq_u16(vcgeq_u16(v, vlo), vcleq_u16(v, vhi));
+		vmin = vminq_u16(vmin, vorrq_u16(v, vmvnq_u16(in)));
+		vmax = vmaxq_u16(vmax, vandq_u16(v, in));
+		vcount = vpadalq_u16(vcount, vshrq_n_u16(in, 15));
+	}
+	uint16_t lane_min[8], lane_max[8];
+	uint32_t lane_count[4];
+	vst1q_u16(lane_min, vmin);
+	vst1q_u16(lane_max, vmax);
+	vst1q_u32(lane_count, vcount);
+	int count = (int)(lane_count[0] + lane_count[1] + lane_count[2] + lane_count[3]);
+	count += range_minmax_u16_scalar(src + i, pix_num - i, lo, hi, min_val, max_val);
+	return range_minmax_lanes_merge(lane_min, lane_max, 8, count, min_val, max_val);
+}
+static void u16_to_f32_neon(const uint16_t* src, int pix_num, double scale, double offset, float* dst)
+{
+	int i = 0;
+#if defined(__aarch64__)
+	float64x2_t vscale = vdupq_n_f64(scale);
+	float64x2_t voffset = vdupq_n_f64(offset);
+	for (; i + 4 <= pix_num; i += 4)
+	{
+		uint32x4_t n = vmovl_u16(vld1_u16(src + i));
+		float64x2_t lo = vaddq_f64(vmulq_f64(vcvtq_f64_u64(vmovl_u32(vget_low_u32(n))), vscale), voffset);
+		float64x2_t hi = vaddq_f64(vmulq_f64(vcvtq_f64_u64(vmovl_u32(vget_high_u32(n))), vscale), voffset);
+		vst1q_f32(dst + i, vcombine_f32(vcvt_f32_f64(lo), vcvt_f32_f64(hi)));
+	}
+#endif
+	//32 bit arm has no double lanes, it stays on the exact scalar path
+	u16_to_f32_scalar(src + i, pix_num - i, scale, offset, dst + i);
+}
+
+static void u16_to_s16_fixed_neon(const uint16_t* src, int pix_num, uint32_t mul, int shift, int32_t offset, int16_t* dst)
+{
+	int i = 0;
+	uint32x4_t vmul = vdupq_n_u32(mul);
+	uint32x4_t vround = vdupq_n_u32((1u << shift) >> 1);
+	int32x4_t vshift = vdupq_n_s32(-shift);
+	int32x4_t voffset = vdupq_n_s32(offset);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		uint16x8_t v = vld1q_u16(src + i);
+		uint32x4_t lo = vshlq_u32(vmlaq_u32(vround, vmovl_u16(vget_low_u16(v)), vmul), vshift);
+		uint32x4_t hi = vshlq_u32(vmlaq_u32(vround, vmovl_u16(vget_high_u16(v)), vmul), vshift);
+		int16x4_t lo16 = vqmovn_s32(vaddq_s32(vreinterpretq_s32_u32(lo), voffset));
+		int16x4_t hi16 = vqmovn_s32(vaddq_s32(vreinterpretq_s32_u32(hi), voffset));
+		vst1q_s16(dst + i, vcombine_s16(lo16, hi16));
+	}
+	u16_to_s16_fixed_scalar(src + i, pix_num - i, mul, shift, offset, dst + i);
+}
+
+static void u16_to_s8_fixed_neon(const uint16_t* src, int pix_num, uint32_t mul, int shift, int32_t offset, int8_t* dst)
+{
+	int i = 0;
+	uint32x4_t vmul = vdupq_n_u32(mul);
+	uint32x4_t vround = vdupq_n_u32((1u << shift) >> 1);
+	int32x4_t vshift = vdupq_n_s32(-shift);
+	int32x4_t voffset = vdupq_n_s32(offset);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		uint16x8_t v = vld1q_u16(src + i);
+		uint32x4_t lo = vshlq_u32(vmlaq_u32(vround, vmovl_u16(vget_low_u16(v)), vmul), vshift);
+		uint32x4_t hi = vshlq_u32(vmlaq_u32(vround, vmovl_u16(vget_high_u16(v)), vmul), vshift);
+		int16x4_t lo16 = vqmovn_s32(vaddq_s32(vreinterpretq_s32_u32(lo), voffset));
+		int16x4_t hi16 = vqmovn_s32(vaddq_s32(vreinterpretq_s32_u32(hi), voffset));
+		vst1_s8(dst + i, vqmovn_s16(vcombine_s16(lo16, hi16)));
+	}
+	u16_to_s8_fixed_scalar(src + i, pix_num - i, mul, shift, offset, dst + i);
+}
+
+static void reduce2x2_u16_neon(const uint16_t* const* rows, int num, uint16_t* min_dst, uint16_t* max_dst, \
+	uint16_t* mean_dst)
+{
+	int i = 0;
+	for (; i + 8 <= num; i += 8)
+	{
+		int x = 2 * i;
+		//vld2 splits even and odd pixels, the horizontal pairs line up
+		uint16x8x2_t v[6];
+		for (int r = 0; r < 6; r++)
+		{
+			v[r] = vld2q_u16(rows[r] + x);
+		}
+		vst1q_u16(min_dst + i, vminq_u16(vminq_u16(v[0].val[0], v[0].val[1]), vminq_u16(v[1].val[0], v[1].val[1])));
+		vst1q_u16(max_dst + i, vmaxq_u16(vmaxq_u16(v[2].val[0], v[2].val[1]), vmaxq_u16(v[3].val[0], v[3].val[1])));
+		uint32x4_t lo = vaddq_u32(vaddl_u16(vget_low_u16(v[4].val[0]), vget_low_u16(v[4].val[1])), \
+			vaddl_u16(vget_low_u16(v[5].val[0]), vget_low_u16(v[5].val[1])));
+		uint32x4_t hi = vaddq_u32(vaddl_u16(vget_high_u16(v[4].val[0]), vget_high_u16(v[4].val[1])), \
+			vaddl_u16(vget_high_u16(v[5].val[0]), vget_high_u16(v[5].val[1])));
+		vst1q_u16(mean_dst + i, vcombine_u16(vrshrn_n_u32(lo, 2), vrshrn_n_u32(hi, 2)));
+	}
+	reduce2x2_u16_scalar(rows, i, num, min_dst, max_dst, mean_dst);
+}
+static void delta_zigzag_u16_neon(const uint16_t* cur, const uint16_t* ref, int pix_num, uint16_t* dst)
+{
+	int i = 0;
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		int16x8_t d = vreinterpretq_s16_u16(vsubq_u16(vld1q_u16(cur + i), vld1q_u16(ref + i)));
+		vst1q_u16(dst + i, vreinterpretq_u16_s16(veorq_s16(vshlq_n_s16(d, 1), vshrq_n_s16(d, 15))));
+	}
+	delta_zigzag_u16_scalar(cur + i, ref + i, pix_num - i, dst + i);
+}
+
+static void delta_zigzag_deadband_u16_neon(const uint16_t* cur, uint16_t* ref, int pix_num, uint16_t deadband, \
+	uint16_t* dst)
+{
+	int i = 0;
+	uint16x8_t limit = vdupq_n_u16(deadband);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		uint16x8_t c = vld1q_u16(cur + i);
+		uint16x8_t r = vld1q_u16(ref + i);
+		int16x8_t d = vreinterpretq_s16_u16(vsubq_u16(c, r));
+		uint16x8_t keep = vcgtq_u16(vreinterpretq_u16_s16(vabsq_s16(d)), limit);
+		vst1q_u16(dst + i, vandq_u16(keep, vreinterpretq_u16_s16(veorq_s16(vshlq_n_s16(d, 1), vshrq_n_s16(d, 15)))));
+		vst1q_u16(ref + i, vbslq_u16(keep, c, r));
+	}
+	delta_zigzag_deadband_u16_scalar(cur + i, ref + i, pix_num - i, deadband, dst + i);
+}
+
+static void undelta_zigzag_u16_neon(const uint16_t* src, const uint16_t* ref, int pix_num, uint16_t* dst)
+{
+	int i = 0;
+	uint16x8_t one = vdupq_n_u16(1);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		uint16x8_t z = vld1q_u16(src + i);
+		int16x8_t sign = vnegq_s16(vreinterpretq_s16_u16(vandq_u16(z, one)));
+		uint16x8_t d = veorq_u16(vshrq_n_u16(z, 1), vreinterpretq_u16_s16(sign));
+		vst1q_u16(dst + i, vaddq_u16(vld1q_u16(ref + i), d));
+	}
+	undelta_zigzag_u16_scalar(src + i, ref + i, pix_num - i, dst + i);
+}
+
+static void accumulate_u16_neon(const uint16_t* src, int pix_num, uint32_t* acc)
+{
+	int i = 0;
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		uint16x8_t v = vld1q_u16(src + i);
+		vst1q_u32(acc + i, vaddw_u16(vld1q_u32(acc + i), vget_low_u16(v)));
+		vst1q_u32(acc + i + 4, vaddw_u16(vld1q_u32(acc + i + 4), vget_high_u16(v)));
+	}
+	accumulate_u16_scalar(src + i, pix_num - i, acc + i);
+}
+
+static void accumulate_sq_u16_neon(const uint16_t* src, const uint16_t* ref, int pix_num, uint32_t* sum, uint64_t* sq)
+{
+	int i = 0;
+	for (; i + 4 <= pix_num; i += 4)
+	{
+		uint16x4_t v = vld1_u16(src + i);
+		int32x4_t d = vreinterpretq_s32_u32(vsubl_u16(v, vld1_u16(ref + i)));
+		vst1q_u32(sum + i, vaddw_u16(vld1q_u32(sum + i), v));
+		int64x2_t lo = vmull_s32(vget_low_s32(d), vget_low_s32(d));
+		int64x2_t hi = vmull_s32(vget_high_s32(d), vget_high_s32(d));
+		vst1q_u64(sq + i, vaddq_u64(vld1q_u64(sq + i), vreinterpretq_u64_s64(lo)));
+		vst1q_u64(sq + i + 2, vaddq_u64(vld1q_u64(sq + i + 2), vreinterpretq_u64_s64(hi)));
+	}
+	accumulate_sq_u16_scalar(src + i, ref + i, pix_num - i, sum + i, sq + i);
+}
+
+static void window_u16_neon(const uint16_t* in, const uint16_t* out, int pix_num, uint32_t* sum)
+{
+	int i = 0;
+	for (; i + 4 <= pix_num; i += 4)
+	{
+		vst1q_u32(sum + i, vaddq_u32(vld1q_u32(sum + i), vsubl_u16(vld1_u16(in + i), vld1_u16(out + i))));
+	}
+	window_u16_scalar(in + i, out + i, pix_num - i, sum + i);
+}
+
+static void hold_u16_neon(const uint16_t* src, int pix_num, uint16_t decay, uint16_t* max_val, uint16_t* min_val)
+{
+	int i = 0;
+	uint16x8_t d = vdupq_n_u16(decay);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		uint16x8_t v = vld1q_u16(src + i);
+		vst1q_u16(max_val + i, vmaxq_u16(v, vqsubq_u16(vld1q_u16(max_val + i), d)));
+		vst1q_u16(min_val + i, vminq_u16(v, vqaddq_u16(vld1q_u16(min_val + i), d)));
+	}
+	hold_u16_scalar(src + i, pix_num - i, decay, max_val + i, min_val + i);
+}
+
+static void rate_u16_neon(const uint16_t* src, int pix_num, int level_shift, int slope_shift, uint32_t mul, \
+	int32_t* level, int32_t* slope, uint16_t* dst)
+{
+	int i = 0;
+	int32x4_t ls = vdupq_n_s32(-level_shift);
+	int32x4_t ss = vdupq_n_s32(-slope_shift);
+	int32x4_t zero = vdupq_n_s32(0);
+	int32x4_t cap = vdupq_n_s32(SIMD_RATE_SLOPE_MAX);
+	for (; i + 4 <= pix_num; i += 4)
+	{
+		int32x4_t t = vreinterpretq_s32_u32(vshlq_n_u32(vmovl_u16(vld1_u16(src + i)), 8));
+		int32x4_t l0 = vld1q_s32(level + i);
+		int32x4_t s0 = vld1q_s32(slope + i);
+		int32x4_t l = vaddq_s32(l0, vshlq_s32(vsubq_s32(t, l0), ls));
+		int32x4_t s = vsubq_s32(vaddq_s32(s0, vsubq_s32(l, l0)), vshlq_s32(s0, ss));
+		vst1q_s32(level + i, l);
+		vst1q_s32(slope + i, s);
+		uint32x4_t c = vreinterpretq_u32_s32(vminq_s32(vmaxq_s32(vshlq_s32(s, ss), zero), cap));
+		vst1_u16(dst + i, vqmovn_u32(vshrq_n_u32(vmulq_n_u32(c, mul), 12)));
+	}
+	rate_u16_scalar(src + i, pix_num - i, level_shift, slope_shift, mul, level + i, slope + i, dst + i);
+}
+
+//the division needs aarch64, armv7 runs the scalar loop
+static void background_u16_neon(const uint16_t* src, int pix_num, int shift, int32_t var_floor, int32_t* mean, \
+	int32_t* var, uint16_t* dst)
+{
+	int i = 0;
+#if defined(__aarch64__)
+	int32x4_t vs = vdupq_n_s32(-shift);
+	int32x4_t lo = vdupq_n_s32(-32767);
+	int32x4_t hi = vdupq_n_s32(32767);
+	int32x4_t vfloor = vdupq_n_s32(var_floor);
+	float32x4_t cap = vdupq_n_f32(65535.0f);
+	for (; i + 4 <= pix_num; i += 4)
+	{
+		int32x4_t t = vreinterpretq_s32_u32(vshlq_n_u32(vmovl_u16(vld1_u16(src + i)), 8));
+		int32x4_t m = vld1q_s32(mean + i);
+		int32x4_t d = vsubq_s32(t, m);
+		vst1q_s32(mean + i, vaddq_s32(m, vshlq_s32(d, vs)));
+		int32x4_t q = vminq_s32(vmaxq_s32(vshrq_n_s32(d, 4), lo), hi);
+		int32x4_t d2 = vmulq_s32(q, q);
+		int32x4_t v0 = vld1q_s32(var + i);
+		vst1q_s32(var + i, vaddq_s32(v0, vshlq_s32(vsubq_s32(d2, v0), vs)));
+		float32x4_t f = vdivq_f32(vmulq_n_f32(vcvtq_f32_s32(d2), 16.0f), vcvtq_f32_s32(vmaxq_s32(v0, vfloor)));
+		vst1_u16(dst + i, vqmovun_s32(vcvtq_s32_f32(vminq_f32(f, cap))));
+	}
+#endif
+	background_u16_scalar(src + i, pix_num - i, shift, var_floor, mean + i, var + i, dst + i);
+}
+
+static void threshold2_u16_neon(const uint16_t* src, int pix_num, uint16_t lo, uint16_t hi, uint8_t* dst)
+{
+	int i = 0;
+	uint16x8_t vlo = vdupq_n_u16(lo);
+	uint16x8_t vhi = vdupq_n_u16(hi);
+	uint16x8_t zero = vdupq_n_u16(0);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		uint16x8_t v = vld1q_u16(src + i);
+		uint16x8_t c = vaddq_u16(vcgeq_u16(v, vlo), vcgeq_u16(v, vhi));
+		vst1_u8(dst + i, vmovn_u16(vsubq_u16(zero, c)));
+	}
+	threshold2_u16_scalar(src + i, pix_num - i, lo, hi, dst + i);
+}
+
+static inline uint16x8_t gray_luma_neon(uint16x8_t v, int depth)
+{
+	if (depth == 16)
+	{
+		uint32x4_t lo = vshrq_n_u32(vmull_n_u16(vget_low_u16(v), 65281), 24);
+		uint32x4_t hi = vshrq_n_u32(vmull_n_u16(vget_high_u16(v), 65281), 24);
+		return vcombine_u16(vmovn_u32(lo), vmovn_u32(hi));
+	}
+	v = vminq_u16(v, vdupq_n_u16(16383));
+	uint32x4_t one = vdupq_n_u32(1);
+	uint32x4_t qlo = vmull_n_u16(vget_low_u16(v), 255);
+	uint32x4_t qhi = vmull_n_u16(vget_high_u16(v), 255);
+	qlo = vshrq_n_u32(vaddq_u32(vaddq_u32(qlo, vshrq_n_u32(qlo, 14)), one), 14);
+	qhi = vshrq_n_u32(vaddq_u32(vaddq_u32(qhi, vshrq_n_u32(qhi, 14)), one), 14);
+	return vcombine_u16(vmovn_u32(qlo), vmovn_u32(qhi));
+}
+
+static void gray_to_yuv_neon(const uint16_t* src, int pix_num, int depth, int yuyv, uint8_t* dst)
+{
+	int i = 0;
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		uint8x8_t y = vmovn_u16(gray_luma_neon(vld1q_u16(src + i), depth));
+		if (yuyv)
+		{
+			uint8x8x2_t pair = { { y, vdup_n_u8(128) } };
+			vst2_u8(dst + 2 * i, pair);
+		}
+		else
+		{
+			vst1_u8(dst + i, y);
+		}
+	}
+	gray_to_yuv_scalar(src + i, pix_num - i, depth, yuyv, yuyv ? dst + 2 * i : dst + i);
+}
+
+//vqrdmulhq is (2 * a * b + 0x8000) >> 16, the same rounded Q15 product
+static void tnr_u16_neon(const uint16_t* src, int shift, int pix_num, uint16_t low, uint16_t range, \
+	uint16_t still_weight, uint16_t slope, uint16_t* history, uint16_t* dst)
+{
+	int i = 0;
+	uint16x8_t vlow = vdupq_n_u16(low);
+	uint16x8_t vrange = vdupq_n_u16(range);
+	uint16x8_t vstill = vdupq_n_u16(still_weight);
+	uint16x8_t vslope = vdupq_n_u16(slope);
+	uint16x8_t vmax = vdupq_n_u16(32767);
+	int16x8_t vshr = vdupq_n_s16((int16_t)-shift);
+	int16x8_t vshl = vdupq_n_s16((int16_t)shift);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		int16x8_t h = vreinterpretq_s16_u16(vld1q_u16(history + i));
+		int16x8_t c = vreinterpretq_s16_u16(vshlq_n_u16(vshlq_u16(vld1q_u16(src + i), vshr), 1));
+		int16x8_t diff = vsubq_s16(c, h);
+		uint16x8_t m = vminq_u16(vqsubq_u16(vshrq_n_u16(vreinterpretq_u16_s16(vabsq_s16(diff)), 1), vlow), vrange);
+		uint16x8_t w = vbslq_u16(vceqq_u16(m, vrange), vmax, vmlaq_u16(vstill, m, vslope));
+		h = vaddq_s16(h, vqrdmulhq_s16(diff, vreinterpretq_s16_u16(w)));
+		vst1q_u16(history + i, vreinterpretq_u16_s16(h));
+		uint16x8_t out = vshrq_n_u16(vaddq_u16(vreinterpretq_u16_s16(h), vdupq_n_u16(1)), 1);
+		vst1q_u16(dst + i, vshlq_u16(out, vshl));
+	}
+	tnr_u16_scalar(src + i, shift, pix_num - i, low, range, still_weight, slope, history + i, dst + i);
+}
+
+//vqrshrun adds the same 0x2000 before the shift and saturates negative sums to 0
+static void fir_u16_neon(const uint16_t* const* src, const int16_t* weight, int taps, int shift, int pix_num, \
+	uint16_t* dst)
+{
+	int i = 0;
+	int16x8_t vshr = vdupq_n_s16((int16_t)-shift);
+	uint16x8_t vmax = vdupq_n_u16(16383);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		int16x8_t s0 = vreinterpretq_s16_u16(vshlq_u16(vld1q_u16(src[0] + i), vshr));
+		int16x8_t s1 = vreinterpretq_s16_u16(vshlq_u16(vld1q_u16(src[1] + i), vshr));
+		int32x4_t lo = vmlal_n_s16(vmull_n_s16(vget_low_s16(s0), weight[0]), vget_low_s16(s1), weight[1]);
+		int32x4_t hi = vmlal_n_s16(vmull_n_s16(vget_high_s16(s0), weight[0]), vget_high_s16(s1), weight[1]);
+		if (taps == 4)
+		{
+			int16x8_t s2 = vreinterpretq_s16_u16(vshlq_u16(vld1q_u16(src[2] + i), vshr));
+			int16x8_t s3 = vreinterpretq_s16_u16(vshlq_u16(vld1q_u16(src[3] + i), vshr));
+			lo = vmlal_n_s16(vmlal_n_s16(lo, vget_low_s16(s2), weight[2]), vget_low_s16(s3), weight[3]);
+			hi = vmlal_n_s16(vmlal_n_s16(hi, vget_high_s16(s2), weight[2]), vget_high_s16(s3), weight[3]);
+		}
+		uint16x8_t out = vcombine_u16(vqrshrun_n_s32(lo, 14), vqrshrun_n_s32(hi, 14));
+		vst1q_u16(dst + i, vminq_u16(out, vmax));
+	}
+	fir_u16_scalar(src, weight, taps, shift, i, pix_num, dst);
+}
+
+#if defined(__aarch64__)
+//plane k: test bit k, weight the lanes by their position and add them up
+static int bitplane_pack_neon(const uint16_t* src, int block_num, uint8_t* widths, uint8_t* planes)
+{
+	static const uint16_t weight_table[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+	uint16x8_t weights = vld1q_u16(weight_table);
+	uint8_t* out = planes;
+	for (int b = 0; b < block_num; b++)
+	{
+		const uint16_t* v = src + b * SIMD_BITPLANE_BLOCK;
+		uint16x8_t v0 = vld1q_u16(v), v1 = vld1q_u16(v + 8), v2 = vld1q_u16(v + 16), v3 = vld1q_u16(v + 24);
+		int width = bitplane_width(vmaxvq_u16(vorrq_u16(vorrq_u16(v0, v1), vorrq_u16(v2, v3))));
+		widths[b] = (uint8_t)width;
+		for (int k = width - 1; k >= 0; k--)
+		{
+			uint16x8_t bit = vdupq_n_u16((uint16_t)(1 << k));
+			uint32_t plane = (uint32_t)vaddvq_u16(vandq_u16(vtstq_u16(v0, bit), weights)) | \
+				((uint32_t)vaddvq_u16(vandq_u16(vtstq_u16(v1, bit), weights)) << 8) | \
+				((uint32_t)vaddvq_u16(vandq_u16(vtstq_u16(v2, bit), weights)) << 16) | \
+				((uint32_t)vaddvq_u16(vandq_u16(vtstq_u16(v3, bit), weights)) << 24);
+			memcpy(out, &plane, 4);
+			out += 4;
+		}
+	}
+	return (int)(out - planes);
+}
+#endif
+
+static int bitplane_unpack_neon(const uint8_t* widths, const uint8_t* planes, int block_num, uint16_t* dst)
+{
+	static const uint16_t weight_table[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+	uint16x8_t weights = vld1q_u16(weight_table);
+	const uint8_t* in = planes;
+	for (int b = 0; b < block_num; b++)
+	{
+		uint16x8_t o0 = vdupq_n_u16(0), o1 = vdupq_n_u16(0), o2 = vdupq_n_u16(0), o3 = vdupq_n_u16(0);
+		for (int k = widths[b] - 1; k >= 0; k--)
+		{
+			uint32_t plane;
+			memcpy(&plane, in, 4);
+			in += 4;
+			uint16x8_t bit = vdupq_n_u16((uint16_t)(1 << k));
+			o0 = vorrq_u16(o0, vandq_u16(vtstq_u16(vdupq_n_u16((uint16_t)(plane & 0xFF)), weights), bit));
+			o1 = vorrq_u16(o1, vandq_u16(vtstq_u16(vdupq_n_u16((uint16_t)((plane >> 8) & 0xFF)), weights), bit));
+			o2 = vorrq_u16(o2, vandq_u16(vtstq_u16(vdupq_n_u16((uint16_t)((plane >> 16) & 0xFF)), weights), bit));
+			o3 = vorrq_u16(o3, vandq_u16(vtstq_u16(vdupq_n_u16((uint16_t)(plane >> 24)), weights), bit));
+		}
+		uint16_t* v = dst + b * SIMD_BITPLANE_BLOCK;
+		vst1q_u16(v, o0);
+		vst1q_u16(v + 8, o1);
+		vst1q_u16(v + 16, o2);
+		vst1q_u16(v + 24, o3);
+	}
+	return (int)(in - planes);
+}
+
+static inline uint16x4_t hdr_fuse_lanes_neon(uint16x4_t high, uint16x4_t low, int32x4_t vknee, int32x4_t vfull, \
+	int32x4_t vshift, int32x4_t vmotion, int newer_low)
+{
+	int32x4_t h = vreinterpretq_s32_u32(vmovl_u16(high));
+	int32x4_t l = vreinterpretq_s32_u32(vmovl_u16(low));
+	int32x4_t d = vsubq_s32(l, h);
+	int32x4_t w = vminq_s32(vmaxq_s32(vsubq_s32(h, vknee), vdupq_n_s32(0)), vfull);
+	int32x4_t f = vaddq_s32(h, vshlq_s32(vmulq_s32(d, w), vshift));
+	uint32x4_t moved = vandq_u32(vcgtq_s32(vabsq_s32(d), vmotion), vcltq_s32(w, vfull));
+	f = vbslq_s32(moved, newer_low ? l : h, f);
+	return vqmovun_s32(f);
+}
+
+static void hdr_fuse_u16_neon(const uint16_t* high, const uint16_t* low, int pix_num, uint16_t knee, int knee_shift, \
+	uint16_t motion, int newer_low, uint16_t* dst)
+{
+	int i = 0;
+	int32x4_t vknee = vdupq_n_s32(knee);
+	int32x4_t vfull = vdupq_n_s32(1 << knee_shift);
+	int32x4_t vshift = vdupq_n_s32(-knee_shift);
+	int32x4_t vmotion = vdupq_n_s32(motion);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		uint16x8_t h = vld1q_u16(high + i);
+		uint16x8_t l = vld1q_u16(low + i);
+		uint16x4_t lo = hdr_fuse_lanes_neon(vget_low_u16(h), vget_low_u16(l), vknee, vfull, vshift, vmotion, newer_low);
+		uint16x4_t hi = hdr_fuse_lanes_neon(vget_high_u16(h), vget_high_u16(l), vknee, vfull, vshift, vmotion, \
+			newer_low);
+		vst1q_u16(dst + i, vcombine_u16(lo, hi));
+	}
+	hdr_fuse_u16_scalar(high + i, low + i, pix_num - i, knee, knee_shift, motion, newer_low, dst + i);
+}
+static void stretch_u16_u8_neon(const uint16_t* src, int pix_num, uint16_t min_val, float scale, uint8_t* dst)
+{
+	int i = 0;
+	uint16x8_t vmin = vdupq_n_u16(min_val);
+	float32x4_t vscale = vdupq_n_f32(scale);
+	for (; i + 8 <= pix_num; i += 8)
+	{
+		uint16x8_t x = vqsubq_u16(vld1q_u16(src + i), vmin);
+		uint32x4_t lo = vcvtq_u32_f32(vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(x))), vscale));
+		uint32x4_t hi = vcvtq_u32_f32(vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(x))), vscale));
+		vst1_u8(dst + i, vqmovn_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi))));
+	}
+	stretch_u16_u8_scalar(src + i, pix_num - i, min_val, scale, dst + i);
+}
+
+static inline int16x8_t edge_laplace8_neon(const uint8_t* prev, const uint8_t* cur, const uint8_t* next)
+{
+	uint16x8_t sum = vdupq_n_u16(0);
+	const uint8_t* rows[3] = { prev, cur, next };
+	for (int r = 0; r < 3; r++)
+	{
+		sum = vaddw_u8(sum, vld1_u8(rows[r] - 1));
+		sum = vaddw_u8(sum, vld1_u8(rows[r]));
+		sum = vaddw_u8(sum, vld1_u8(rows[r] + 1));
+	}
+	uint16x8_t c9 = vmull_u8(vld1_u8(cur), vdup_n_u8(9));
+	return vsubq_s16(vreinterpretq_s16_u16(c9), vreinterpretq_s16_u16(sum));
+}
+
+static void edge_add_bgr_neon(const uint8_t* prev, const uint8_t* cur, const uint8_t* next, int num, int strength, \
+	uint8_t* bgr)
+{
+	int16x8_t vstrength = vdupq_n_s16((int16_t)strength);
+	uint8x16_t sign = vdupq_n_u8(0x80);
+	int i = 0;
+	for (; i + 16 <= num; i += 16)
+	{
+		int16x8_t lo = vshrq_n_s16(vmulq_s16(vshrq_n_s16(edge_laplace8_neon(prev + i, cur + i, next + i), 3), vstrength), 4);
+		int16x8_t hi = vshrq_n_s16(vmulq_s16(vshrq_n_s16(edge_laplace8_neon(prev + i + 8, cur + i + 8, next + i + 8), 3), \
+			vstrength), 4);
+		int8x16_t e = vcombine_s8(vqmovn_s16(lo), vqmovn_s16(hi));
+		//the channels come apart on the load, u8 + s8 saturates through the signed range
+		uint8x16x3_t v = vld3q_u8(bgr + 3 * i);
+		for (int c = 0; c < 3; c++)
+		{
+			int8x16_t s = vreinterpretq_s8_u8(veorq_u8(v.val[c], sign));
+			v.val[c] = veorq_u8(vreinterpretq_u8_s8(vqaddq_s8(s, e)), sign);
+		}
+		vst3q_u8(bgr + 3 * i, v);
+	}
+	edge_add_bgr_scalar(prev + i, cur + i, next + i, num - i, strength, bgr + 3 * i);
+}
+#endif
+
+
+void simd_minmax_u16(const uint16_t* src, int pix_num, uint16_t* min_val, uint16_t* max_val)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+		minmax_u16_avx512(src, pix_num, min_val, max_val);
+		return;
+	case SIMD_LEVEL_AVX2:
+		minmax_u16_avx2(src, pix_num, min_val, max_val);
+		return;
+	case SIMD_LEVEL_SSE41:
+		minmax_u16_sse41(src, pix_num, min_val, max_val);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		minmax_u16_neon(src, pix_num, min_val, max_val);
+		return;
+#endif
+	default:
+		minmax_u16_scalar(src, pix_num, min_val, max_val);
+		return;
+	}
+}
+
+void simd_stretch_u16(const uint16_t* src, int pix_num, uint16_t min_val, uint32_t range, uint16_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+		stretch_u16_avx512(src, pix_num, min_val, range, dst);
+		return;
+	case SIMD_LEVEL_AVX2:
+		stretch_u16_avx2(src, pix_num, min_val, range, dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		stretch_u16_sse41(src, pix_num, min_val, range, dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		stretch_u16_neon(src, pix_num, min_val, range, dst);
+		return;
+#endif
+	default:
+		stretch_u16_scalar(src, pix_num, min_val, range, dst);
+		return;
+	}
+}
+
+int simd_range_minmax_u16(const uint16_t* src, int pix_num, uint16_t lo, uint16_t hi, \
+	uint16_t* min_val, uint16_t* max_val)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		return range_minmax_u16_avx2(src, pix_num, lo, hi, min_val, max_val);
+	case SIMD_LEVEL_SSE41:
+		return range_minmax_u16_sse41(src, pix_num, lo, hi, min_val, max_val);
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		return range_minmax_u16_neon(src, pix_num, lo, hi, min_val, max_val);
+#endif
+	default:
+		return range_minmax_u16_scalar(src, pix_num, lo, hi, min_val, max_val);
+	}
+}
+
+void simd_u16_to_f32(const uint16_t* src, int pix_num, double scale, double offset, float* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		u16_to_f32_avx2(src, pix_num, scale, offset, dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		u16_to_f32_sse41(src, pix_num, scale, offset, dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		u16_to_f32_neon(src, pix_num, scale, offset, dst);
+		return;
+#endif
+	default:
+		u16_to_f32_scalar(src, pix_num, scale, offset, dst);
+		return;
+	}
+}
+
+void simd_u16_to_s16_fixed(const uint16_t* src, int pix_num, uint32_t mul, int shift, int32_t offset, int16_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		u16_to_s16_fixed_avx2(src, pix_num, mul, shift, offset, dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		u16_to_s16_fixed_sse41(src, pix_num, mul, shift, offset, dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		u16_to_s16_fixed_neon(src, pix_num, mul, shift, offset, dst);
+		return;
+#endif
+	default:
+		u16_to_s16_fixed_scalar(src, pix_num, mul, shift, offset, dst);
+		return;
+	}
+}
+
+void simd_u16_to_s8_fixed(const uint16_t* src, int pix_num, uint32_t mul, int shift, int32_t offset, int8_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		u16_to_s8_fixed_avx2(src, pix_num, mul, shift, offset, dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		u16_to_s8_fixed_sse41(src, pix_num, mul, shift, offset, dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		u16_to_s8_fixed_neon(src, pix_num, mul, shift, offset, dst);
+		return;
+#endif
+	default:
+		u16_to_s8_fixed_scalar(src, pix_num, mul, shift, offset, dst);
+		return;
+	}
+}
+
+void simd_reduce2x2_u16(const uint16_t* const* rows, int num, uint16_t* min_dst, uint16_t* max_dst, uint16_t* mean_dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		reduce2x2_u16_avx2(rows, num, min_dst, max_dst, mean_dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		reduce2x2_u16_sse41(rows, num, min_dst, max_dst, mean_dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		reduce2x2_u16_neon(rows, num, min_dst, max_dst, mean_dst);
+		return;
+#endif
+	default:
+		reduce2x2_u16_scalar(rows, 0, num, min_dst, max_dst, mean_dst);
+		return;
+	}
+}
+
+
+void simd_delta_zigzag_u16(const uint16_t* cur, const uint16_t* ref, int pix_num, uint16_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		delta_zigzag_u16_avx2(cur, ref, pix_num, dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		delta_zigzag_u16_sse41(cur, ref, pix_num, dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		delta_zigzag_u16_neon(cur, ref, pix_num, dst);
+		return;
+#endif
+	default:
+		delta_zigzag_u16_scalar(cur, ref, pix_num, dst);
+		return;
+	}
+}
+
+void simd_delta_zigzag_deadband_u16(const uint16_t* cur, uint16_t* ref, int pix_num, uint16_t deadband, uint16_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		delta_zigzag_deadband_u16_avx2(cur, ref, pix_num, deadband, dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		delta_zigzag_deadband_u16_sse41(cur, ref, pix_num, deadband, dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		delta_zigzag_deadband_u16_neon(cur, ref, pix_num, deadband, dst);
+		return;
+#endif
+	default:
+		delta_zigzag_deadband_u16_scalar(cur, ref, pix_num, deadband, dst);
+		return;
+	}
+}
+
+void simd_undelta_zigzag_u16(const uint16_t* src, const uint16_t* ref, int pix_num, uint16_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		undelta_zigzag_u16_avx2(src, ref, pix_num, dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		undelta_zigzag_u16_sse41(src, ref, pix_num, dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		undelta_zigzag_u16_neon(src, ref, pix_num, dst);
+		return;
+#endif
+	default:
+		undelta_zigzag_u16_scalar(src, ref, pix_num, dst);
+		return;
+	}
+}
+
+void simd_accumulate_u16(const uint16_t* src, int pix_num, uint32_t* acc)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+		accumulate_u16_avx512(src, pix_num, acc);
+		return;
+	case SIMD_LEVEL_AVX2:
+		accumulate_u16_avx2(src, pix_num, acc);
+		return;
+	case SIMD_LEVEL_SSE41:
+		accumulate_u16_sse41(src, pix_num, acc);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		accumulate_u16_neon(src, pix_num, acc);
+		return;
+#endif
+	default:
+		accumulate_u16_scalar(src, pix_num, acc);
+		return;
+	}
+}
+
+void simd_accumulate_sq_u16(const uint16_t* src, const uint16_t* ref, int pix_num, uint32_t* sum, uint64_t* sq)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		accumulate_sq_u16_avx2(src, ref, pix_num, sum, sq);
+		return;
+	case SIMD_LEVEL_SSE41:
+		accumulate_sq_u16_sse41(src, ref, pix_num, sum, sq);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		accumulate_sq_u16_neon(src, ref, pix_num, sum, sq);
+		return;
+#endif
+	default:
+		accumulate_sq_u16_scalar(src, ref, pix_num, sum, sq);
+		return;
+	}
+}
+
+void simd_window_u16(const uint16_t* in, const uint16_t* out, int pix_num, uint32_t* sum)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+		window_u16_avx512(in, out, pix_num, sum);
+		return;
+	case SIMD_LEVEL_AVX2:
+		window_u16_avx2(in, out, pix_num, sum);
+		return;
+	case SIMD_LEVEL_SSE41:
+		window_u16_sse41(in, out, pix_num, sum);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		window_u16_neon(in, out, pix_num, sum);
+		return;
+#endif
+	default:
+		window_u16_scalar(in, out, pix_num, sum);
+		return;
+	}
+}
+
+void simd_hold_u16(const uint16_t* src, int pix_num, uint16_t decay, uint16_t* max_val, uint16_t* min_val)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+		hold_u16_avx512(src, pix_num, decay, max_val, min_val);
+		return;
+	case SIMD_LEVEL_AVX2:
+		hold_u16_avx2(src, pix_num, decay, max_val, min_val);
+		return;
+	case SIMD_LEVEL_SSE41:
+		hold_u16_sse41(src, pix_num, decay, max_val, min_val);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		hold_u16_neon(src, pix_num, decay, max_val, min_val);
+		return;
+#endif
+	default:
+		hold_u16_scalar(src, pix_num, decay, max_val, min_val);
+		return;
+	}
+}
+
+void simd_rate_u16(const uint16_t* src, int pix_num, int level_shift, int slope_shift, uint32_t mul, \
+	int32_t* level, int32_t* slope, uint16_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		rate_u16_avx2(src, pix_num, level_shift, slope_shift, mul, level, slope, dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		rate_u16_sse41(src, pix_num, level_shift, slope_shift, mul, level, slope, dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		rate_u16_neon(src, pix_num, level_shift, slope_shift, mul, level, slope, dst);
+		return;
+#endif
+	default:
+		rate_u16_scalar(src, pix_num, level_shift, slope_shift, mul, level, slope, dst);
+		return;
+	}
+}
+
+void simd_background_u16(const uint16_t* src, int pix_num, int shift, int32_t var_floor, int32_t* mean, int32_t* var, \
+	uint16_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		background_u16_avx2(src, pix_num, shift, var_floor, mean, var, dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		background_u16_sse41(src, pix_num, shift, var_floor, mean, var, dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		background_u16_neon(src, pix_num, shift, var_floor, mean, var, dst);
+		return;
+#endif
+	default:
+		background_u16_scalar(src, pix_num, shift, var_floor, mean, var, dst);
+		return;
+	}
+}
+
+void simd_gather_mean4_u16(const uint16_t* src, uint32_t src_len, const uint32_t* nbr, int num, uint16_t* dst)
+{
+#if defined(SIMD_X86)
+	SimdLevel_t level = simd_level_get();
+	if ((level == SIMD_LEVEL_AVX2 || level == SIMD_LEVEL_AVX512) && src_len >= 2)
+	{
+		gather_mean4_u16_avx2(src, src_len, nbr, num, dst);
+		return;
+	}
+#endif
+	(void)src_len;
+	gather_mean4_u16_scalar(src, nbr, num, num, dst);
+}
+
+void simd_gather_weight4_u16(const uint16_t* src, uint32_t src_len, const uint32_t* idx, const uint16_t* weight, \
+	int num, uint16_t* dst)
+{
+#if defined(SIMD_X86)
+	SimdLevel_t level = simd_level_get();
+	if ((level == SIMD_LEVEL_AVX2 || level == SIMD_LEVEL_AVX512) && src_len >= 2)
+	{
+		gather_weight4_u16_avx2(src, src_len, idx, weight, num, dst);
+		return;
+	}
+#endif
+	(void)src_len;
+	gather_weight4_u16_scalar(src, idx, weight, num, num, dst);
+}
+
+void simd_lut4_lerp_u16(const uint16_t* src, int num, uint16_t low, uint16_t high, uint32_t scale, \
+	const uint16_t* const* lut, const uint16_t* wx, uint16_t wy, uint16_t* dst)
+{
+#if defined(SIMD_X86)
+	SimdLevel_t level = simd_level_get();
+	if (level == SIMD_LEVEL_AVX2 || level == SIMD_LEVEL_AVX512)
+	{
+		lut4_lerp_u16_avx2(src, num, low, high, scale, lut, wx, wy, dst);
+		return;
+	}
+#endif
+	lut4_lerp_u16_scalar(src, num, low, high, scale, lut, wx, wy, dst);
+}
+
+void simd_lut32_u16(const uint16_t* src, int num, int shift, uint32_t lo, uint32_t hi, const uint16_t* index, \
+	const uint32_t* lut, uint32_t* dst)
+{
+#if defined(SIMD_X86)
+	SimdLevel_t level = simd_level_get();
+	if ((level == SIMD_LEVEL_AVX2 || level == SIMD_LEVEL_AVX512) && ((uintptr_t)dst & 3) == 0)
+	{
+		lut32_u16_avx2(src, num, shift, lo, hi, index, lut, dst);
+		return;
+	}
+#endif
+	lut32_u16_scalar(src, num, shift, lo, hi, index, lut, dst);
+}
+
+void simd_dde_u16(const uint16_t* src, const uint32_t* sum, int num, uint32_t inv, const uint16_t* lut, \
+	uint32_t lut_len, int32_t gain, uint16_t* dst)
+{
+#if defined(SIMD_X86)
+	SimdLevel_t level = simd_level_get();
+	if ((level == SIMD_LEVEL_AVX2 || level == SIMD_LEVEL_AVX512) && lut_len >= 2)
+	{
+		dde_u16_avx2(src, sum, num, inv, lut, lut_len, gain, dst);
+		return;
+	}
+#endif
+	(void)lut_len;
+	dde_u16_scalar(src, sum, num, inv, lut, gain, dst);
+}
+
+void simd_tnr_u16(const uint16_t* src, int shift, int pix_num, uint16_t low, uint16_t range, uint16_t still_weight, \
+	uint16_t slope, uint16_t* history, uint16_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		tnr_u16_avx2(src, shift, pix_num, low, range, still_weight, slope, history, dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		tnr_u16_sse41(src, shift, pix_num, low, range, still_weight, slope, history, dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		tnr_u16_neon(src, shift, pix_num, low, range, still_weight, slope, history, dst);
+		return;
+#endif
+	default:
+		tnr_u16_scalar(src, shift, pix_num, low, range, still_weight, slope, history, dst);
+		return;
+	}
+}
+
+void simd_fir_u16(const uint16_t* const* src, const int16_t* weight, int taps, int shift, int pix_num, uint16_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		fir_u16_avx2(src, weight, taps, shift, pix_num, dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		fir_u16_sse41(src, weight, taps, shift, pix_num, dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		fir_u16_neon(src, weight, taps, shift, pix_num, dst);
+		return;
+#endif
+	default:
+		fir_u16_scalar(src, weight, taps, shift, 0, pix_num, dst);
+		return;
+	}
+}
+
+void simd_threshold2_u16(const uint16_t* src, int pix_num, uint16_t lo, uint16_t hi, uint8_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+		threshold2_u16_avx512(src, pix_num, lo, hi, dst);
+		return;
+	case SIMD_LEVEL_AVX2:
+		threshold2_u16_avx2(src, pix_num, lo, hi, dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		threshold2_u16_sse41(src, pix_num, lo, hi, dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		threshold2_u16_neon(src, pix_num, lo, hi, dst);
+		return;
+#endif
+	default:
+		threshold2_u16_scalar(src, pix_num, lo, hi, dst);
+		return;
+	}
+}
+
+void simd_gray_to_yuv(const uint16_t* src, int pix_num, int depth, SimdYuvLayout_t layout, uint8_t* dst)
+{
+	int yuyv = (layout == SIMD_YUV_YUYV);
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		gray_to_yuv_avx2(src, pix_num, depth, yuyv, dst);
+		break;
+	case SIMD_LEVEL_SSE41:
+		gray_to_yuv_sse41(src, pix_num, depth, yuyv, dst);
+		break;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		gray_to_yuv_neon(src, pix_num, depth, yuyv, dst);
+		break;
+#endif
+	default:
+		gray_to_yuv_scalar(src, pix_num, depth, yuyv, dst);
+		break;
+	}
+	//semi-planar: the neutral chroma plane after the luma
+	if (!yuyv)
+	{
+		memset(dst + pix_num, 128, (layout == SIMD_YUV_NV12) ? pix_num / 2 : pix_num);
+	}
+}
+
+int simd_bitplane_pack(const uint16_t* src, int block_num, uint8_t* widths, uint8_t* planes)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		return bitplane_pack_avx2(src, block_num, widths, planes);
+	case SIMD_LEVEL_SSE41:
+		return bitplane_pack_sse41(src, block_num, widths, planes);
+#endif
+#if defined(SIMD_NEON) && defined(__aarch64__)
+	case SIMD_LEVEL_NEON:
+		return bitplane_pack_neon(src, block_num, widths, planes);
+#endif
+	default:
+		return bitplane_pack_scalar(src, block_num, widths, planes);
+	}
+}
+
+int simd_bitplane_unpack(const uint8_t* widths, const uint8_t* planes, int block_num, uint16_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		return bitplane_unpack_avx2(widths, planes, block_num, dst);
+	case SIMD_LEVEL_SSE41:
+		return bitplane_unpack_sse41(widths, planes, block_num, dst);
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		return bitplane_unpack_neon(widths, planes, block_num, dst);
+#endif
+	default:
+		return bitplane_unpack_scalar(widths, planes, block_num, dst);
+	}
+}
+
+void simd_hdr_fuse_u16(const uint16_t* high, const uint16_t* low, int pix_num, uint16_t knee, int knee_shift, \
+	uint16_t motion, int newer_low, uint16_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		hdr_fuse_u16_avx2(high, low, pix_num, knee, knee_shift, motion, newer_low, dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		hdr_fuse_u16_sse41(high, low, pix_num, knee, knee_shift, motion, newer_low, dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		hdr_fuse_u16_neon(high, low, pix_num, knee, knee_shift, motion, newer_low, dst);
+		return;
+#endif
+	default:
+		hdr_fuse_u16_scalar(high, low, pix_num, knee, knee_shift, motion, newer_low, dst);
+		return;
+	}
+}
+
+void simd_stretch_u16_u8(const uint16_t* src, int pix_num, uint16_t min_val, uint32_t range, uint8_t* dst)
+{
+	float scale = 255.0f / (float)((range > 0) ? range : 1);
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+		stretch_u16_u8_avx512(src, pix_num, min_val, scale, dst);
+		return;
+	case SIMD_LEVEL_AVX2:
+		stretch_u16_u8_avx2(src, pix_num, min_val, scale, dst);
+		return;
+	case SIMD_LEVEL_SSE41:
+		stretch_u16_u8_sse41(src, pix_num, min_val, scale, dst);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		stretch_u16_u8_neon(src, pix_num, min_val, scale, dst);
+		return;
+#endif
+	default:
+		stretch_u16_u8_scalar(src, pix_num, min_val, scale, dst);
+		return;
+	}
+}
+
+void simd_remap_bgr(const uint8_t* src, uint32_t src_len, int stride, const uint32_t* base, const uint16_t* frac, \
+	int num, uint8_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		remap_bgr_avx2(src, src_len, stride, base, frac, num, dst);
+		return;
+#endif
+	default:
+		//sse4.1 and neon have no gather, the taps are not contiguous
+		remap_bgr_scalar(src, stride, base, frac, num, dst);
+		return;
+	}
+}
+
+void simd_remap_row_u16(const uint16_t* src, uint32_t src_len, int stride, const uint32_t* col, const uint8_t* fx, \
+	uint32_t fy, int num, uint16_t* dst)
+{
+#if defined(SIMD_X86)
+	SimdLevel_t level = simd_level_get();
+	if ((level == SIMD_LEVEL_AVX2 || level == SIMD_LEVEL_AVX512) && src_len >= (uint32_t)stride + 2)
+	{
+		remap_row_u16_avx2(src, src_len, stride, col, fx, fy, num, dst);
+		return;
+	}
+#endif
+	(void)src_len;
+	remap_row_u16_scalar(src, stride, col, fx, fy, num, dst);
+}
+
+void simd_edge_add_bgr(const uint8_t* prev, const uint8_t* cur, const uint8_t* next, int num, int strength, uint8_t* bgr)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+	case SIMD_LEVEL_SSE41:
+		edge_add_bgr_sse41(prev, cur, next, num, strength, bgr);
+		return;
+#endif
+#if defined(SIMD_NEON)
+	case SIMD_LEVEL_NEON:
+		edge_add_bgr_neon(prev, cur, next, num, strength, bgr);
+		return;
+#endif
+	default:
+		edge_add_bgr_scalar(prev, cur, next, num, strength, bgr);
+		return;
+	}
+}
+
+void simd_remap_add_u16(const uint16_t* src, uint32_t src_len, int stride, const uint32_t* base, const uint16_t* frac, \
+	const uint16_t* weight, int num, uint16_t* dst)
+{
+	switch (simd_level_get())
+	{
+#if defined(SIMD_X86)
+	case SIMD_LEVEL_AVX512:
+	case SIMD_LEVEL_AVX2:
+		remap_add_u16_avx2(src, src_len, stride, base, frac, weight, num, dst);
+		return;
+#endif
+	default:
+		remap_add_u16_scalar(src, stride, base, frac, weight, num, dst);
+		return;
+	}
+}
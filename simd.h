@@ -0,0 +1,187 @@
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+#include <stdint.h>
+
+typedef enum
+{
+    SIMD_LEVEL_SCALAR = 0,
+    SIMD_LEVEL_SSE41,
+    SIMD_LEVEL_AVX2,
+    SIMD_LEVEL_NEON,
+    SIMD_LEVEL_AVX512,              //f and bw, kernels without a 512 bit version run their avx2 one
+}SimdLevel_t;
+
+//best level supported by this cpu, detected once
+SimdLevel_t simd_level_detect(void);
+
+//level the kernels currently dispatch to
+SimdLevel_t simd_level_get(void);
+
+//force a lower level for comparison, levels the cpu does not support fall back to the detected one
+void simd_level_set(SimdLevel_t level);
+
+const char* simd_level_name(SimdLevel_t level);
+
+//min and max of a uint16 frame
+void simd_minmax_u16(const uint16_t* src, int pix_num, uint16_t* min_val, uint16_t* max_val);
+
+//dst = (src - min_val) * 16383 / range, src must be in [min_val, min_val + range], range > 0
+//the division is a reciprocal multiply with one correction step, results equal the integer division
+void simd_stretch_u16(const uint16_t* src, int pix_num, uint16_t min_val, uint32_t range, uint16_t* dst);
+
+//dst = (src - min_val) * (255.0f / range) truncated, the y8 plane of a 16 bit one, src below min_val maps to 0
+//and src must not exceed min_val + range
+void simd_stretch_u16_u8(const uint16_t* src, int pix_num, uint16_t min_val, uint32_t range, uint8_t* dst);
+
+//min, max and count of the values inside [lo, hi], min/max stay 65535/0 when no value is inside
+int simd_range_minmax_u16(const uint16_t* src, int pix_num, uint16_t lo, uint16_t hi, \
+    uint16_t* min_val, uint16_t* max_val);
+
+//dst = (float)(src * scale + offset), evaluated in double so the result does not depend on the level
+void simd_u16_to_f32(const uint16_t* src, int pix_num, double scale, double offset, float* dst);
+
+//dst = saturate_int16(((src * mul + (1 << shift >> 1)) >> shift) + offset), src * mul must fit in 31 bits
+void simd_u16_to_s16_fixed(const uint16_t* src, int pix_num, uint32_t mul, int shift, int32_t offset, int16_t* dst);
+
+//simd_u16_to_s16_fixed saturated to int8, the quantized input of an int8 model
+void simd_u16_to_s8_fixed(const uint16_t* src, int pix_num, uint32_t mul, int shift, int32_t offset, int8_t* dst);
+
+//one row of a 2x2 min/max/mean pyramid level over pixels 2i and 2i + 1 of two rows each: rows[0]/rows[1] are the
+//min rows, rows[2]/rows[3] the max rows and rows[4]/rows[5] the mean rows below, each 2 * num values long.
+//min_dst[i] and max_dst[i] are the min and max of their four, mean_dst[i] = (sum of its four + 2) >> 2.
+//a level built from a plane passes the plane's two rows for all three
+void simd_reduce2x2_u16(const uint16_t* const* rows, int num, uint16_t* min_dst, uint16_t* max_dst, uint16_t* mean_dst);
+
+//dst = zigzag((int16_t)(cur - ref)): small differences of either sign become small codes, ref may overlap cur
+void simd_delta_zigzag_u16(const uint16_t* cur, const uint16_t* ref, int pix_num, uint16_t* dst);
+
+//simd_delta_zigzag_u16 for lossy delta coding: a difference of at most deadband either way codes as 0 and leaves
+//ref, any other one codes as usual and moves ref to cur, so ref is what a decoder of dst has. deadband < 32768
+void simd_delta_zigzag_deadband_u16(const uint16_t* cur, uint16_t* ref, int pix_num, uint16_t deadband, uint16_t* dst);
+
+//inverse of simd_delta_zigzag_u16: dst = ref + unzigzag(src), dst may be src or ref
+void simd_undelta_zigzag_u16(const uint16_t* src, const uint16_t* ref, int pix_num, uint16_t* dst);
+
+//acc[i] += src[i], frame averaging. 65536 frames of any value fit
+void simd_accumulate_u16(const uint16_t* src, int pix_num, uint32_t* acc);
+
+//sum[i] += src[i], sq[i] += (src[i] - ref[i])^2. squares of the difference to a reference frame stay
+//small for noise, a variance from them does not cancel out
+void simd_accumulate_sq_u16(const uint16_t* src, const uint16_t* ref, int pix_num, uint32_t* sum, uint64_t* sq);
+
+//sum[i] += in[i] - out[i], a moving window over frames
+void simd_window_u16(const uint16_t* in, const uint16_t* out, int pix_num, uint32_t* sum);
+
+//max_val[i] = max(src[i], max_val[i] - decay), min_val[i] = min(src[i], min_val[i] + decay) saturated: per pixel
+//hold of the extremes that relaxes toward the scene by decay per frame, 0 holds for good
+void simd_hold_u16(const uint16_t* src, int pix_num, uint16_t decay, uint16_t* max_val, uint16_t* min_val);
+
+#define SIMD_RATE_SLOPE_MAX 0xFFFFF     //4096 raw units per frame, the largest slope the rate is made of
+
+//rate of change in fixed point: level (raw << 8) += ((src << 8) - level) >> level_shift, slope is the sum form of an
+//exponential average of the level's change, s = slope >> slope_shift is the change per frame in raw << 8 and
+//slope += (level - level before) - s, without the dead band of a truncating average.
+//dst = min((min(max(s, 0), SIMD_RATE_SLOPE_MAX) * mul) >> 12, 65535): with mul the frame rate in Q4 (< 4096) the
+//rise in raw units per second, falls give 0. slope_shift <= 8
+void simd_rate_u16(const uint16_t* src, int pix_num, int level_shift, int slope_shift, uint32_t mul, \
+    int32_t* level, int32_t* slope, uint16_t* dst);
+
+//exponentially weighted running mean and variance (the learning rate 2^-shift): d = (src << 8) - mean,
+//mean += d >> shift, q = clamp(d >> 4, +-32767) the deviation in raw << 4, var (raw^2 << 8) += (q * q - var) >> shift,
+//dst = min(q * q * 16 / max(var, var_floor), 65535) truncated: the squared deviation in sigmas, Q4, before the
+//frame is learned. var_floor >= 1, the division is float, the same at every level
+void simd_background_u16(const uint16_t* src, int pix_num, int shift, int32_t var_floor, int32_t* mean, int32_t* var, \
+    uint16_t* dst);
+
+//dst[i] = (src[nbr[i]] + src[nbr[num + i]] + src[nbr[2 * num + i]] + src[nbr[3 * num + i]] + 2) >> 2,
+//the mean of 4 gathered pixels, every index below src_len. avx2 gathers, the other levels run the scalar loop
+void simd_gather_mean4_u16(const uint16_t* src, uint32_t src_len, const uint32_t* nbr, int num, uint16_t* dst);
+
+//dst[i] = (sum over k of src[idx[k * num + i]] * weight[k * num + i] + 128) >> 8, 4 taps laid out as in
+//simd_gather_mean4_u16 with Q8 weights summing to at most 256. avx2 gathers, the other levels run the scalar loop
+void simd_gather_weight4_u16(const uint16_t* src, uint32_t src_len, const uint32_t* idx, const uint16_t* weight, \
+    int num, uint16_t* dst);
+
+//bilinear blend of 4 luts (clahe.h): b = ((min(max(src, low), high) - low) * scale) >> 16,
+//a = lut[0][b] * (256 - wx[i]) + lut[1][b] * wx[i], c = lut[2][b] * (256 - wx[i]) + lut[3][b] * wx[i],
+//dst[i] = (a * (256 - wy) + c * wy + 32768) >> 16. weights Q8 in [0, 256], lut entries up to 16383 and every
+//lut readable one entry past the largest b. avx2 gathers, the other levels run the scalar loop
+void simd_lut4_lerp_u16(const uint16_t* src, int num, uint16_t low, uint16_t high, uint32_t scale, \
+    const uint16_t* const* lut, const uint16_t* wx, uint16_t wy, uint16_t* dst);
+
+//4 byte pixels through a palette lut (bgra32/rgba32): v = min(max(src[i] >> shift, lo), hi) - lo,
+//dst[i] = lut[index[v]], lut[v] with index NULL (the stretch or agc table of a colorize plan). index readable one
+//entry past hi - lo, dst 4 byte aligned. avx2 gathers and stores 32 byte aligned after a scalar head, the other
+//levels run the scalar loop
+void simd_lut32_u16(const uint16_t* src, int num, int shift, uint32_t lo, uint32_t hi, const uint16_t* index, \
+    const uint32_t* lut, uint32_t* dst);
+
+//detail enhancement on top of a lut (dde.h): base = (sum[i] * inv) >> 32, the box mean in Q2 out of a running
+//sum, d = (src[i] << 2) - base, dst[i] = clamp(lut[(base + 2) >> 2] + ((d * gain + 512) >> 10), 0, 16383).
+//gain Q8, |d * gain| below 2^31. avx2 gathers, the other levels run the scalar loop
+void simd_dde_u16(const uint16_t* src, const uint32_t* sum, int num, uint32_t inv, const uint16_t* lut, \
+    uint32_t lut_len, int32_t gain, uint16_t* dst);
+
+//dst = (src >= lo) + (src >= hi), lo <= hi: 0 below lo, 1 in [lo, hi), 2 at or above hi
+void simd_threshold2_u16(const uint16_t* src, int pix_num, uint16_t lo, uint16_t hi, uint8_t* dst);
+
+//recursive temporal filter, history is Y14 << 1. per pixel d = |(src >> shift) - history / 2|,
+//m = min(max(d - low, 0), range), w = (m == range) ? 32767 : still_weight + m * slope (Q15 weight of the new frame)
+//history += round((((src >> shift) << 1) - history) * w / 32768), dst = ((history + 1) >> 1) << shift
+//still_weight + range * slope must stay below 32768, dst may be src
+void simd_tnr_u16(const uint16_t* src, int shift, int pix_num, uint16_t low, uint16_t range, uint16_t still_weight, \
+    uint16_t slope, uint16_t* history, uint16_t* dst);
+
+//dst = min(max((sum of weight[k] * (src[k][i] >> shift) + 0x2000) >> 14, 0), 16383) over taps 2 or 4 rows,
+//Q14 weights, one pass of a separable resampling filter. the shifted sources must stay below 32768
+void simd_fir_u16(const uint16_t* const* src, const int16_t* weight, int taps, int shift, int pix_num, uint16_t* dst);
+
+typedef enum
+{
+    SIMD_YUV_YUYV = 0,              //packed Y0 U Y1 V
+    SIMD_YUV_NV12,                  //luma plane, then pix_num / 2 bytes of interleaved chroma
+    SIMD_YUV_NV16,                  //luma plane, then pix_num bytes of interleaved chroma
+}SimdYuvLayout_t;
+
+//gray Y14 (depth 14) or Y16 (depth 16) -> 8 bit yuv in one pass, luma = min(src, max) * 255 / max rounded down
+//with max = 2^depth - 1, chroma 128: the bytes of libirparse's y14_to_yuv444/y14_to_nv12/y16_to_nv12. pix_num even
+void simd_gray_to_yuv(const uint16_t* src, int pix_num, int depth, SimdYuvLayout_t layout, uint8_t* dst);
+
+//dual gain fusion of two temp frames in the same units: d = low - high, w = min(max(high - knee, 0), 1 << knee_shift),
+//dst = high + ((d * w) >> knee_shift), the low gain frame fades in over the knee. where |d| > motion below the end
+//of the knee the scene moved between the frames, dst is the newer frame's value. knee_shift <= 14
+void simd_hdr_fuse_u16(const uint16_t* high, const uint16_t* low, int pix_num, uint16_t knee, int knee_shift, \
+    uint16_t motion, int newer_low, uint16_t* dst);
+
+//bilinear bgr888 resampling at precomputed taps: pixel i blends the 2x2 pixels from src + base[i] (byte offset,
+//the top left one) with Q6 weights fx = frac[i] & 0xff and fy = frac[i] >> 8, both 0..64. src_len bytes of src
+//are readable, every 2x2 block must lie inside them
+void simd_remap_bgr(const uint8_t* src, uint32_t src_len, int stride, const uint32_t* base, const uint16_t* frac, \
+    int num, uint8_t* dst);
+
+//dst = min(dst + ((bilinear * weight[i] + 128) >> 8), 65535): the 2x2 values from src + base[i] (element offset) blended
+//with Q6 weights as simd_remap_bgr's, scaled by the Q8 weight[i] (0..256) and accumulated. src_len values are readable
+void simd_remap_add_u16(const uint16_t* src, uint32_t src_len, int stride, const uint32_t* base, const uint16_t* frac, \
+    const uint16_t* weight, int num, uint16_t* dst);
+
+//one row of a separable bilinear resampling (zoom.h): dst[i] blends the 2x2 values from src + col[i] with the Q6
+//weights fx[i] and fy (0..64) and the rounding of simd_remap_add_u16. src_len values of src are readable, every
+//2x2 block must lie inside them
+void simd_remap_row_u16(const uint16_t* src, uint32_t src_len, int stride, const uint32_t* col, const uint8_t* fx, \
+    uint32_t fy, int num, uint16_t* dst);
+
+//msx style detail: e = ((9 * cur[i] - 3x3 sum) >> 3) * strength >> 4 saturated to int8 and added to the three
+//channels of bgr pixel i with saturation. reads the gray rows from index -1 to num
+void simd_edge_add_bgr(const uint8_t* prev, const uint8_t* cur, const uint8_t* next, int num, int strength, uint8_t* bgr);
+
+#define SIMD_BITPLANE_BLOCK 32
+
+//per block of SIMD_BITPLANE_BLOCK values: widths[b] = significant bits of the block's largest value, then
+//widths[b] 32 bit planes, most significant first, bit j of a plane from value j. returns bytes written to planes
+int simd_bitplane_pack(const uint16_t* src, int block_num, uint8_t* widths, uint8_t* planes);
+
+//inverse of simd_bitplane_pack, widths must be <= 16. returns bytes read from planes
+int simd_bitplane_unpack(const uint8_t* widths, const uint8_t* planes, int block_num, uint16_t* dst);
+
+#endif
@@ -1,23 +1,66 @@
 #include "simple_camera.h"
 #include "camera.h"
 #include "data.h"
+#include "simd.h"
 #include <stdlib.h>
 #include <string.h>
 
+// 租用中的一帧，token为0表示空闲
+typedef struct {
+    uint64_t token;
+    FrameSlot_t* slot;
+} SimpleCameraLease_t;
+
 struct SimpleCameraHandle_t {
     CameraParam_t camera_param;
     StreamFrameInfo_t stream_frame_info;
     uint8_t* raw_frame;
     uint16_t* temp_frame;
     uint8_t* image_frame;
+    FrameSource_t frame_source;
+    uint8_t source_opened;      // open_source: frames from frame_source instead of the camera
+    pthread_t stream_thread;
+    uint8_t stream_thread_started;
+    int consumer_id;            // frame ring consumer, -1 when not attached
+    FrameSlot_t* slot;          // frame held since the last get_frame, released by the next one
+    SimpleCameraLease_t leases[SIMPLE_CAMERA_MAX_LEASES];
+    uint64_t lease_token;       // last token handed out, 0 is never used
 };
 
+// 释放当前持有的帧并从frame ring注销，之后stream线程可以释放ring
+static void simple_camera_detach(SimpleCameraHandle_t* handle) {
+    FrameRing_t* ring = handle->stream_frame_info.frame_ring;
+    if (!ring) {
+        // stream线程已经释放了ring
+        handle->slot = NULL;
+        memset(handle->leases, 0, sizeof(handle->leases));
+        handle->consumer_id = -1;
+        return;
+    }
+    if (handle->slot) {
+        ring_read_release(ring, handle->slot);
+        handle->slot = NULL;
+    }
+    for (int i = 0; i < SIMPLE_CAMERA_MAX_LEASES; i++) {
+        if (handle->leases[i].token) {
+            ring_read_release(ring, handle->leases[i].slot);
+            handle->leases[i].token = 0;
+            handle->leases[i].slot = NULL;
+        }
+    }
+    if (handle->consumer_id >= 0) {
+        ring_consumer_detach(ring, handle->consumer_id);
+        handle->consumer_id = -1;
+    }
+}
+
 extern "C" {
 
 SimpleCameraHandle_t* simple_camera_create(void) {
     SimpleCameraHandle_t* handle = (SimpleCameraHandle_t*)malloc(sizeof(SimpleCameraHandle_t));
     if (handle) {
         memset(handle, 0, sizeof(SimpleCameraHandle_t));
+        handle->consumer_id = -1;
     }
     return handle;
 }
@@ -28,6 +71,19 @@ void simple_camera_destroy(SimpleCameraHandle_t* handle) {
     }
 }
 
+// 尺寸取自打开时得到的camera_param，256x192/384x288/640x512机芯相同
+// both: 原始帧上半为图像，下半为温度；否则整帧为图像，没有温度
+static void simple_camera_frame_info(SimpleCameraHandle_t* handle, int both) {
+    StreamFrameInfo_t* info = &handle->stream_frame_info;
+    info->camera_param = handle->camera_param;
+    info->image_info.width = handle->camera_param.width;
+    info->image_info.height = both ? handle->camera_param.height / 2 : handle->camera_param.height;
+    info->temp_info.width = both ? handle->camera_param.width : 0;
+    info->temp_info.height = both ? handle->camera_param.height / 2 : 0;
+    info->image_byte_size = info->image_info.width * info->image_info.height * 2;
+    info->temp_byte_size = info->temp_info.width * info->temp_info.height * 2;
+}
+
 int simple_camera_open(SimpleCameraHandle_t* handle) {
     if (!handle) return -1;
     
@@ -35,13 +91,7 @@ int simple_camera_open(SimpleCameraHandle_t* handle) {
     if (ret != 0) return ret;
     
     // 初始化 stream_frame_info
-    handle->stream_frame_info.camera_param = handle->camera_param;
-    handle->stream_frame_info.image_info.width = 256;
-    handle->stream_frame_info.image_info.height = 192;
-    handle->stream_frame_info.temp_info.width = 256;
-    handle->stream_frame_info.temp_info.height = 192;
-    handle->stream_frame_info.image_byte_size = 256 * 192 * 2;
-    handle->stream_frame_info.temp_byte_size = 256 * 192 * 2;
+    simple_camera_frame_info(handle, ir_camera_stream_mode() == IR_STREAM_IMAGE_AND_TEMP);
     
     // 分配缓冲区
     create_data_demo(&handle->stream_frame_info);
@@ -49,40 +99,330 @@ int simple_camera_open(SimpleCameraHandle_t* handle) {
     return 0;
 }
 
+int simple_camera_open_source(SimpleCameraHandle_t* handle, int source_type, const char* path) {
+    if (!handle || (source_type != SIMPLE_CAMERA_SOURCE_REPLAY && source_type != SIMPLE_CAMERA_SOURCE_SYNTH)) return -1;
+    if (handle->source_opened) return -1;
+
+    FrameSourceParam_t param;
+    memset(&param, 0, sizeof(param));
+    param.type = (source_type == SIMPLE_CAMERA_SOURCE_REPLAY) ? FRAME_SOURCE_REPLAY : FRAME_SOURCE_SYNTH;
+    if (path) {
+        strncpy(param.path, path, sizeof(param.path) - 1);
+    }
+    param.paced = 1;
+    param.loop = 1;
+    int ret = frame_source_open(&handle->frame_source, &param);
+    if (ret != SOURCE_SUCCESS) return ret;
+    frame_source_camera_param(&handle->frame_source, &handle->camera_param);
+    handle->source_opened = 1;
+
+    // 与相机相同的上下两半
+    simple_camera_frame_info(handle, 1);
+    handle->stream_frame_info.image_info.input_format = INPUT_FMT_Y16;
+    handle->stream_frame_info.frame_source = &handle->frame_source;
+    return 0;
+}
+
 int simple_camera_close(SimpleCameraHandle_t* handle) {
     if (!handle) return -1;
     
+    simple_camera_stop_stream(handle);
     destroy_data_demo(&handle->stream_frame_info);
-    ir_camera_close();
+    if (handle->source_opened) {
+        frame_source_close(&handle->frame_source);
+        handle->stream_frame_info.frame_source = NULL;
+        handle->source_opened = 0;
+    } else {
+        ir_camera_close();
+    }
     
     return 0;
 }
 
 int simple_camera_start_stream(SimpleCameraHandle_t* handle) {
     if (!handle) return -1;
-    return ir_camera_stream_on(&handle->stream_frame_info);
+    if (handle->stream_thread_started) return 0;
+
+    // stream线程退出时会释放缓冲区，重新出图前重新申请
+    if (create_data_demo(&handle->stream_frame_info) != 0) return -1;
+    int ret = ir_camera_stream_on(&handle->stream_frame_info);
+    if (ret < 0) return ret;
+
+    // 在stream线程开始写帧之前注册，只取最新帧
+    handle->consumer_id = ring_consumer_attach(handle->stream_frame_info.frame_ring, RING_POLICY_NEWEST);
+    if (handle->consumer_id < 0) {
+        ir_camera_stream_off(&handle->stream_frame_info);
+        return -1;
+    }
+    if (pthread_create(&handle->stream_thread, NULL, stream_function, &handle->stream_frame_info) != 0) {
+        simple_camera_detach(handle);
+        ir_camera_stream_off(&handle->stream_frame_info);
+        return -1;
+    }
+    handle->stream_thread_started = 1;
+    return 0;
 }
 
 int simple_camera_stop_stream(SimpleCameraHandle_t* handle) {
     if (!handle) return -1;
-    return ir_camera_stream_off(&handle->stream_frame_info);
+    if (!handle->stream_thread_started) return 0;
+
+    // stream线程退出时关闭ring、等待消费者注销，然后调用ir_camera_stream_off
+    ir_camera_stream_stop(&handle->stream_frame_info);
+    simple_camera_detach(handle);
+    pthread_join(handle->stream_thread, NULL);
+    handle->stream_thread_started = 0;
+    return 0;
+}
+
+int simple_camera_wait_frame(SimpleCameraHandle_t* handle, uint32_t timeout_ms, uint64_t* seq, uint64_t* timestamp_us) {
+    if (!handle) return -1;
+    FrameRing_t* ring = handle->stream_frame_info.frame_ring;
+    if (handle->consumer_id < 0 || !ring) return SIMPLE_CAMERA_CLOSED;
+
+    // 上一帧在这里归还，get_temp_data返回的指针到下一次取帧前一直有效
+    if (handle->slot) {
+        ring_read_release(ring, handle->slot);
+        handle->slot = NULL;
+    }
+
+    FrameSlot_t* slot = NULL;
+    int rst = ring_read_acquire(ring, handle->consumer_id, timeout_ms, &slot);
+    if (rst == RING_TIMEOUT) return SIMPLE_CAMERA_TIMEOUT;
+    if (rst == RING_CLOSED) {
+        // stream线程已停止，马上注销以免它等待
+        simple_camera_detach(handle);
+        return SIMPLE_CAMERA_CLOSED;
+    }
+    if (rst != RING_SUCCESS) return -1;
+
+    handle->slot = slot;
+    if (seq) *seq = slot->seq.load();
+    if (timestamp_us) *timestamp_us = slot->desc.timestamp_us;
+    return 0;
 }
 
 int simple_camera_get_frame(SimpleCameraHandle_t* handle, uint32_t timeout_ms) {
-    if (!handle) return -1;
-    
-    // 这里应该从 stream_frame_info 获取数据
-    // 简化版本：直接返回成功（实际应该等待新帧）
+    return simple_camera_wait_frame(handle, timeout_ms, NULL, NULL);
+}
+
+int simple_camera_get_frames(SimpleCameraHandle_t* handle, uint32_t n, uint16_t* dst, uint32_t stride, \
+    uint32_t timeout_ms, SimpleCameraFrameMeta_t* meta) {
+    if (!handle || !dst || n == 0) return -1;
+    FrameRing_t* ring = handle->stream_frame_info.frame_ring;
+    if (handle->consumer_id < 0 || !ring) return SIMPLE_CAMERA_CLOSED;
+    uint32_t width = handle->stream_frame_info.temp_info.width;
+    uint32_t height = handle->stream_frame_info.temp_info.height;
+    if (stride == 0) stride = width * 2;
+    if (stride < width * 2) return -1;
+
+    if (handle->slot) {
+        ring_read_release(ring, handle->slot);
+        handle->slot = NULL;
+    }
+
+    // 每帧拷贝后马上归还，整批只占一个槽位
+    uint64_t deadline = get_monotonic_us() + (uint64_t)timeout_ms * 1000;
+    uint32_t cnt = 0;
+    int rst = RING_SUCCESS;
+    while (cnt < n) {
+        uint64_t now = get_monotonic_us();
+        uint32_t wait_ms = (now < deadline) ? (uint32_t)((deadline - now + 999) / 1000) : 0;
+        FrameSlot_t* slot = NULL;
+        rst = ring_read_acquire(ring, handle->consumer_id, wait_ms, &slot);
+        if (rst != RING_SUCCESS) break;
+
+        uint8_t* dst_frame = (uint8_t*)dst + (size_t)cnt * height * stride;
+        const uint8_t* src = (const uint8_t*)slot->desc.temp.data;
+        uint32_t row_bytes = slot->desc.temp.width * 2;
+        if (row_bytes > width * 2) row_bytes = width * 2;
+        uint32_t rows = (slot->desc.temp.height < height) ? slot->desc.temp.height : height;
+        if (slot->desc.temp.stride == stride && row_bytes == stride) {
+            memcpy(dst_frame, src, (size_t)rows * stride);
+        } else {
+            for (uint32_t row = 0; row < rows; row++) {
+                memcpy(dst_frame + (size_t)row * stride, src + (size_t)row * slot->desc.temp.stride, row_bytes);
+            }
+        }
+        if (meta) {
+            meta[cnt].seq = slot->seq.load();
+            meta[cnt].timestamp_us = slot->desc.timestamp_us;
+        }
+        ring_read_release(ring, slot);
+        cnt++;
+    }
+    if (rst == RING_CLOSED) {
+        simple_camera_detach(handle);
+    }
+    if (cnt > 0) return (int)cnt;
+    if (rst == RING_TIMEOUT) return SIMPLE_CAMERA_TIMEOUT;
+    if (rst == RING_CLOSED) return SIMPLE_CAMERA_CLOSED;
+    return -1;
+}
+
+int simple_camera_acquire_temp_frame(SimpleCameraHandle_t* handle, uint32_t timeout_ms, SimpleCameraFrameLease_t* lease) {
+    if (!handle || !lease) return -1;
+    FrameRing_t* ring = handle->stream_frame_info.frame_ring;
+    if (handle->consumer_id < 0 || !ring) return SIMPLE_CAMERA_CLOSED;
+
+    // 每个租约占住一个槽位，至少留一个给stream线程写入
+    int free_index = -1;
+    int lease_cnt = (handle->slot != NULL) ? 1 : 0;
+    for (int i = 0; i < SIMPLE_CAMERA_MAX_LEASES; i++) {
+        if (handle->leases[i].token) {
+            lease_cnt++;
+        } else if (free_index < 0) {
+            free_index = i;
+        }
+    }
+    if (free_index < 0 || lease_cnt + 1 >= (int)ring->depth) return SIMPLE_CAMERA_BUSY;
+
+    FrameSlot_t* slot = NULL;
+    int rst = ring_read_acquire(ring, handle->consumer_id, timeout_ms, &slot);
+    if (rst == RING_TIMEOUT) return SIMPLE_CAMERA_TIMEOUT;
+    if (rst == RING_CLOSED) {
+        simple_camera_detach(handle);
+        return SIMPLE_CAMERA_CLOSED;
+    }
+    if (rst != RING_SUCCESS) return -1;
+
+    handle->leases[free_index].token = ++handle->lease_token;
+    handle->leases[free_index].slot = slot;
+    lease->data = (uint16_t*)slot->desc.temp.data;
+    lease->width = slot->desc.temp.width;
+    lease->height = slot->desc.temp.height;
+    lease->stride = slot->desc.temp.stride;
+    lease->seq = slot->seq.load();
+    lease->timestamp_us = slot->desc.timestamp_us;
+    lease->token = handle->leases[free_index].token;
+    return 0;
+}
+
+int simple_camera_release_temp_frame(SimpleCameraHandle_t* handle, uint64_t token) {
+    if (!handle || token == 0) return -1;
+    for (int i = 0; i < SIMPLE_CAMERA_MAX_LEASES; i++) {
+        if (handle->leases[i].token == token) {
+            // ring已被stream线程释放时租约已经失效，不再归还
+            if (handle->stream_frame_info.frame_ring) {
+                ring_read_release(handle->stream_frame_info.frame_ring, handle->leases[i].slot);
+            }
+            handle->leases[i].token = 0;
+            handle->leases[i].slot = NULL;
+            return 0;
+        }
+    }
+    // 未知或已归还的token，包括stop_stream时统一归还的租约
+    return -1;
+}
+
+int simple_camera_get_temp_stats(SimpleCameraHandle_t* handle, uint64_t token, SimpleCameraFrameStats_t* stats) {
+    if (!handle || !stats) return -1;
+    FrameSlot_t* slot = NULL;
+    if (token == 0) {
+        slot = handle->slot;
+    } else {
+        for (int i = 0; i < SIMPLE_CAMERA_MAX_LEASES; i++) {
+            if (handle->leases[i].token == token) {
+                slot = handle->leases[i].slot;
+                break;
+            }
+        }
+    }
+    if (!slot || !slot->temp_stats.valid) return -1;
+
+    const FrameStats_t* src = &slot->temp_stats;
+    stats->min_val = src->min_val;
+    stats->max_val = src->max_val;
+    stats->min_x = src->min_x;
+    stats->min_y = src->min_y;
+    stats->max_x = src->max_x;
+    stats->max_y = src->max_y;
+    stats->mean = src->mean;
+    stats->hist_low = src->hist_low;
+    stats->hist_bin_width = src->hist_bin_width;
+    memcpy(stats->hist, src->hist, sizeof(stats->hist));
+    return 0;
+}
+
+int simple_camera_temp_to_celsius(const uint16_t* temp_data, uint32_t pix_num, float* dst, int env_correct) {
+    if (!temp_data || !dst) return -1;
+    if (env_correct) return temp_frame_to_celsius_env(temp_data, (int)pix_num, dst);
+    temp_frame_to_celsius(temp_data, (int)pix_num, dst);
+    return 0;
+}
+
+int simple_camera_temp_to_centi_celsius(const uint16_t* temp_data, uint32_t pix_num, int16_t* dst, int env_correct) {
+    if (!temp_data || !dst) return -1;
+    if (env_correct) return temp_frame_to_centi_celsius_env(temp_data, (int)pix_num, dst);
+    temp_frame_to_centi_celsius(temp_data, (int)pix_num, dst);
+    return 0;
+}
+
+int simple_camera_roi_stats(const uint16_t* temp_data, uint32_t width, uint32_t height, uint32_t stride, \
+    int x, int y, int w, int h, SimpleCameraRoiStats_t* stats) {
+    if (!temp_data || !stats || stride < width * 2) return -1;
+    int x0 = (x > 0) ? x : 0, y0 = (y > 0) ? y : 0;
+    int x1 = (x + w < (int)width) ? x + w : (int)width;
+    int y1 = (y + h < (int)height) ? y + h : (int)height;
+    if (x0 >= x1 || y0 >= y1) return -1;
+
+    // 每行先用simd求最值，只有刷新了最值的行才再找坐标
+    uint16_t min_val = 0xFFFF, max_val = 0;
+    uint64_t sum = 0;
+    int row_num = x1 - x0;
+    for (int row = y0; row < y1; row++) {
+        const uint16_t* src = (const uint16_t*)((const uint8_t*)temp_data + (size_t)row * stride) + x0;
+        uint16_t row_min, row_max;
+        simd_minmax_u16(src, row_num, &row_min, &row_max);
+        if (row_min < min_val || row == y0) {
+            min_val = row_min;
+            int i = 0;
+            while (src[i] != row_min) i++;
+            stats->min_x = (uint16_t)(x0 + i);
+            stats->min_y = (uint16_t)row;
+        }
+        if (row_max > max_val || row == y0) {
+            max_val = row_max;
+            int i = 0;
+            while (src[i] != row_max) i++;
+            stats->max_x = (uint16_t)(x0 + i);
+            stats->max_y = (uint16_t)row;
+        }
+        uint32_t row_sum = 0;
+        for (int i = 0; i < row_num; i++) {
+            row_sum += src[i];
+        }
+        sum += row_sum;
+    }
+    stats->min_val = min_val;
+    stats->max_val = max_val;
+    stats->pix_num = (uint32_t)(row_num * (y1 - y0));
+    stats->mean = (float)((double)sum / stats->pix_num);
     return 0;
 }
 
+int simple_camera_get_ready_fd(SimpleCameraHandle_t* handle) {
+    if (!handle) return -1;
+    if (handle->consumer_id < 0 || !handle->stream_frame_info.frame_ring) return SIMPLE_CAMERA_CLOSED;
+    int fd = ring_consumer_fd(handle->stream_frame_info.frame_ring, handle->consumer_id);
+    return (fd >= 0) ? fd : -1;
+}
+
+int simple_camera_get_frame_stats(SimpleCameraHandle_t* handle, uint64_t* frames, uint64_t* dropped) {
+    if (!handle || !frames || !dropped) return -1;
+    if (handle->consumer_id < 0 || !handle->stream_frame_info.frame_ring) return SIMPLE_CAMERA_CLOSED;
+    return ring_consumer_stats(handle->stream_frame_info.frame_ring, handle->consumer_id, frames, dropped);
+}
+
 uint16_t* simple_camera_get_temp_data(SimpleCameraHandle_t* handle) {
     if (!handle) return NULL;
+    if (handle->slot) return (uint16_t*)handle->slot->temp_frame;
     return (uint16_t*)handle->stream_frame_info.temp_frame;
 }
 
 uint8_t* simple_camera_get_image_data(SimpleCameraHandle_t* handle) {
     if (!handle) return NULL;
+    if (handle->slot) return handle->slot->image_frame;
     return handle->stream_frame_info.image_frame;
 }
 
@@ -108,4 +448,36 @@ int simple_camera_get_info(SimpleCameraHandle_t* handle, uint32_t* width, uint32
     return 0;
 }
 
+int simple_camera_get_stage_count(void) {
+    return TIMING_STAGE_NUM;
+}
+
+const char* simple_camera_get_stage_name(int stage) {
+    return timing_stage_name((TimingStage_t)stage);
+}
+
+int simple_camera_get_stage_stats(SimpleCameraHandle_t* handle, int stage, SimpleCameraStageStats_t* stats) {
+    if (!handle || !stats) return -1;
+    TimingStats_t timing_stats;
+    if (timing_stats_get((TimingStage_t)stage, &timing_stats) != 0) return -1;
+    stats->count = timing_stats.count;
+    stats->mean_us = timing_stats.mean_us;
+    stats->p50_us = timing_stats.p50_us;
+    stats->p99_us = timing_stats.p99_us;
+    stats->max_us = timing_stats.max_us;
+    return 0;
+}
+
+int simple_camera_reset_stage_stats(SimpleCameraHandle_t* handle) {
+    if (!handle) return -1;
+    timing_reset();
+    return 0;
+}
+
+int simple_camera_set_stats_dump_interval(SimpleCameraHandle_t* handle, uint32_t interval_s) {
+    if (!handle) return -1;
+    timing_dump_interval_set(interval_s);
+    return 0;
+}
+
 } // extern "C"
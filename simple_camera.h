@@ -9,14 +9,100 @@ extern "C" {
 
 typedef struct SimpleCameraHandle_t SimpleCameraHandle_t;
 
+// 取帧返回值
+#define SIMPLE_CAMERA_TIMEOUT -2    // timeout_ms内没有新帧
+#define SIMPLE_CAMERA_CLOSED -3     // 未出图或stream线程已停止
+#define SIMPLE_CAMERA_BUSY -4       // 租约已满，需要先归还
+
+#define SIMPLE_CAMERA_MAX_LEASES 8  // 同时租用的帧数上限，另外还受ring深度限制
+
 // 相机控制函数
 SimpleCameraHandle_t* simple_camera_create(void);
 void simple_camera_destroy(SimpleCameraHandle_t* handle);
 int simple_camera_open(SimpleCameraHandle_t* handle);
+// 不接相机时的帧来源：record模块的录像(path)或生成的场景，之后start_stream等接口照常使用
+#define SIMPLE_CAMERA_SOURCE_REPLAY 1
+#define SIMPLE_CAMERA_SOURCE_SYNTH 2
+int simple_camera_open_source(SimpleCameraHandle_t* handle, int source_type, const char* path);
 int simple_camera_close(SimpleCameraHandle_t* handle);
 int simple_camera_start_stream(SimpleCameraHandle_t* handle);
 int simple_camera_stop_stream(SimpleCameraHandle_t* handle);
+// 阻塞等待新的一帧，最多timeout_ms。成功返回0，上一帧同时归还
+// 数据指针在下一次取帧或停止出图之前有效
 int simple_camera_get_frame(SimpleCameraHandle_t* handle, uint32_t timeout_ms);
+// 同get_frame，另外返回帧序号（单调递增，不连续表示丢帧）和取帧时间（单调时钟，单位us）
+int simple_camera_wait_frame(SimpleCameraHandle_t* handle, uint32_t timeout_ms, uint64_t* seq, uint64_t* timestamp_us);
+// 批量取帧的每帧信息
+typedef struct {
+    uint64_t seq;
+    uint64_t timestamp_us;
+} SimpleCameraFrameMeta_t;
+
+// 连续取n帧温度数据，第i帧拷贝到dst + i * height * stride，组成(n, height, width)的连续数组
+// stride为dst每行字节数，0表示width * 2；timeout_ms为整批的超时，meta可为NULL，否则至少n项
+// 返回拷贝的帧数，超时或stream线程停止时可能少于n，未取到任何帧时返回TIMEOUT/CLOSED。上一帧同时归还
+int simple_camera_get_frames(SimpleCameraHandle_t* handle, uint32_t n, uint16_t* dst, uint32_t stride, \
+    uint32_t timeout_ms, SimpleCameraFrameMeta_t* meta);
+// 可读时表示可能有新帧或stream线程已停止，用于epoll/select/asyncio，之后用timeout_ms为0取帧
+// 唤醒可能是虚假的，取帧返回TIMEOUT时继续等待。fd属于库，stop_stream后失效，不要close
+int simple_camera_get_ready_fd(SimpleCameraHandle_t* handle);
+// 已取到的帧数和被新帧覆盖而跳过的帧数
+int simple_camera_get_frame_stats(SimpleCameraHandle_t* handle, uint64_t* frames, uint64_t* dropped);
+
+// 直接租用ring中的温度帧，不拷贝。data为Y14数据，按stride字节换行
+typedef struct {
+    uint16_t* data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;            // 每行字节数
+    uint64_t seq;
+    uint64_t timestamp_us;
+    uint64_t token;             // 归还时使用
+} SimpleCameraFrameLease_t;
+
+// 等待新的一帧并租用，归还前stream线程不会覆盖该槽位。租约未归还时占用一个ring槽位
+int simple_camera_acquire_temp_frame(SimpleCameraHandle_t* handle, uint32_t timeout_ms, SimpleCameraFrameLease_t* lease);
+// 归还租约，stop_stream会归还所有未归还的租约，之后data不可再访问
+int simple_camera_release_temp_frame(SimpleCameraHandle_t* handle, uint64_t token);
+
+// stream线程对温度帧做的统计，值为Y14（1/64 K）
+typedef struct {
+    uint16_t min_val;
+    uint16_t max_val;
+    uint16_t min_x;
+    uint16_t min_y;
+    uint16_t max_x;
+    uint16_t max_y;
+    float mean;
+    uint32_t hist_low;          // 第i个bin统计[hist_low + i * hist_bin_width, hist_low + (i + 1) * hist_bin_width)
+    uint32_t hist_bin_width;
+    uint32_t hist[256];
+} SimpleCameraFrameStats_t;
+
+// 取温度帧统计，token为租约token，0表示get_frame取到的当前帧
+int simple_camera_get_temp_stats(SimpleCameraHandle_t* handle, uint64_t token, SimpleCameraFrameStats_t* stats);
+
+// 整帧温度转换，env_correct非0时查环境修正表(calculate_new_env_cali_parameter建表)
+// 返回-1表示参数错误或还没有修正表，后者已写入未修正的值
+int simple_camera_temp_to_celsius(const uint16_t* temp_data, uint32_t pix_num, float* dst, int env_correct);
+// 单位0.01摄氏度，超出int16范围时饱和
+int simple_camera_temp_to_centi_celsius(const uint16_t* temp_data, uint32_t pix_num, int16_t* dst, int env_correct);
+
+// 矩形区域统计，值为Y14（1/64 K）
+typedef struct {
+    uint16_t min_val;
+    uint16_t max_val;
+    uint16_t min_x;             // 第一个最小值的帧坐标，按行序
+    uint16_t min_y;
+    uint16_t max_x;
+    uint16_t max_y;
+    uint32_t pix_num;
+    float mean;
+} SimpleCameraRoiStats_t;
+
+// stride为每行字节数，区域超出帧的部分被裁掉，完全在帧外时返回-1
+int simple_camera_roi_stats(const uint16_t* temp_data, uint32_t width, uint32_t height, uint32_t stride, \
+    int x, int y, int w, int h, SimpleCameraRoiStats_t* stats);
 
 // 数据访问函数
 uint16_t* simple_camera_get_temp_data(SimpleCameraHandle_t* handle);
@@ -25,6 +111,21 @@ int simple_camera_get_temp_size(SimpleCameraHandle_t* handle, uint32_t* width, u
 int simple_camera_get_image_size(SimpleCameraHandle_t* handle, uint32_t* width, uint32_t* height);
 int simple_camera_get_info(SimpleCameraHandle_t* handle, uint32_t* width, uint32_t* height, uint32_t* fps);
 
+// 各阶段耗时统计，单位us
+typedef struct {
+    uint64_t count;
+    uint64_t mean_us;
+    uint64_t p50_us;
+    uint64_t p99_us;
+    uint64_t max_us;
+} SimpleCameraStageStats_t;
+
+int simple_camera_get_stage_count(void);
+const char* simple_camera_get_stage_name(int stage);
+int simple_camera_get_stage_stats(SimpleCameraHandle_t* handle, int stage, SimpleCameraStageStats_t* stats);
+int simple_camera_reset_stage_stats(SimpleCameraHandle_t* handle);
+int simple_camera_set_stats_dump_interval(SimpleCameraHandle_t* handle, uint32_t interval_s);
+
 #ifdef __cplusplus
 }
 #endif
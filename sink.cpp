@@ -0,0 +1,1861 @@
+#include "sink.h"
+#include "display.h"
+#include "rtsched.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <new>
+#if defined(_WIN32)
+#include <Windows.h>
+#include <d3d11.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "d3d11.lib")
+#endif
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#if defined(__linux__)
+#include <linux/fb.h>
+#endif
+#endif
+#if defined(DISPLAY_KMS)
+#include <poll.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#endif
+#if defined(DISPLAY_GL)
+#include <EGL/egl.h>
+#include <GLES3/gl3.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#endif
+
+static const char* display_sink_names[DISPLAY_SINK_NUM] = { "null", "window", "fb", "shm", "d3d11", "gl", "kms" };
+
+const char* display_sink_name(DisplaySinkType_t type)
+{
+    return (type >= 0 && type < DISPLAY_SINK_NUM) ? display_sink_names[type] : "unknown";
+}
+
+static const char* display_sink_path(const DisplaySink_t* sink, const char* default_path)
+{
+    return (sink->param.path[0] != 0) ? sink->param.path : default_path;
+}
+
+/*************************************** ui thread ***************************************/
+//the sinks that show frames on a thread of their own: window, d3d11, gl, fb and kms
+#if defined(DISPLAY_WINDOW) || defined(_WIN32) || defined(__linux__) || defined(DISPLAY_GL)
+#define SINK_UI_THREAD
+#endif
+
+#ifdef SINK_UI_THREAD
+//wait up to timeout_ms (< 0 for as long as the sink runs) for a new frame and make it the front one, 1 then
+static int display_sink_ui_next(DisplaySink_t* sink, int timeout_ms)
+{
+    if (triple_buffer_take(&sink->ui_buffer))
+    {
+        return 1;
+    }
+    sync_deadline_t deadline;
+    if (timeout_ms >= 0)
+    {
+        sync_deadline_set(&deadline, (uint32_t)timeout_ms);
+    }
+    uint32_t key = eventcount_prepare_wait(&sink->ui_event);
+    if (triple_buffer_fresh(&sink->ui_buffer) || !sink->ui_running.load(std::memory_order_acquire))
+    {
+        eventcount_cancel_wait(&sink->ui_event);
+    }
+    else
+    {
+        eventcount_wait(&sink->ui_event, key, (timeout_ms >= 0) ? &deadline : NULL);
+    }
+    return triple_buffer_take(&sink->ui_buffer);
+}
+
+static DisplaySinkFrame_t* display_sink_ui_front(DisplaySink_t* sink)
+{
+    return &sink->ui_frame[triple_buffer_front(&sink->ui_buffer)];
+}
+
+//ui thread only, a full queue drops the key
+static void display_sink_key_push(DisplaySink_t* sink, int key)
+{
+    uint32_t head = sink->key_head.load(std::memory_order_relaxed);
+    if (key >= 0 && head - sink->key_tail.load(std::memory_order_acquire) < SINK_KEY_QUEUE)
+    {
+        sink->key[head & (SINK_KEY_QUEUE - 1)] = key & 0xff;
+        sink->key_head.store(head + 1, std::memory_order_release);
+    }
+}
+
+static int display_sink_ui_open(DisplaySink_t* sink, void* (*ui_function)(void*))
+{
+    triple_buffer_init(&sink->ui_buffer);
+    eventcount_init(&sink->ui_event);
+    sink->ui_running.store(1);
+    if (pthread_create(&sink->ui_thread, NULL, ui_function, sink) != 0)
+    {
+        eventcount_destroy(&sink->ui_event);
+        return SINK_ERROR_OPEN;
+    }
+    sink->ui_started = 1;
+    return SINK_SUCCESS;
+}
+
+static int display_sink_ui_present(DisplaySink_t* sink, const uint8_t* frame, int width, int height, int stride)
+{
+    //the back frame belongs to the caller until it is published, copying into it needs no lock
+    DisplaySinkFrame_t* back = &sink->ui_frame[triple_buffer_back(&sink->ui_buffer)];
+    int size = width * height * 3;
+    if (back->size < size)
+    {
+        free(back->data);
+        back->data = (uint8_t*)malloc(size);
+        back->size = (back->data != NULL) ? size : 0;
+        if (back->data == NULL)
+        {
+            return SINK_ERROR_PARAM;
+        }
+    }
+    for (int y = 0; y < height; y++)
+    {
+        memcpy(back->data + (long)y * width * 3, frame + (long)y * stride, (size_t)width * 3);
+    }
+    back->width = width;
+    back->height = height;
+    back->raw = 0;
+
+    triple_buffer_publish(&sink->ui_buffer);
+    eventcount_notify(&sink->ui_event);
+    return SINK_SUCCESS;
+}
+
+#if defined(DISPLAY_GL)
+//the raw frame with copies of its tables, the palette only when it changed since the back frame last had it
+static int display_sink_ui_present_raw(DisplaySink_t* sink, const uint16_t* frame, int width, int height, int stride, \
+    const DisplaySinkRaw_t* raw)
+{
+    DisplaySinkFrame_t* back = &sink->ui_frame[triple_buffer_back(&sink->ui_buffer)];
+    int size = width * height * 2;
+    if (back->size < size)
+    {
+        free(back->data);
+        back->data = (uint8_t*)malloc(size);
+        back->size = (back->data != NULL) ? size : 0;
+    }
+    if (back->lut == NULL)
+    {
+        back->lut = (uint8_t*)malloc(COLOR_LUT_SIZE * 3);
+        back->agc_lut = (uint16_t*)malloc(COLOR_LUT_SIZE * sizeof(uint16_t));
+        back->lut_gen = 0;
+    }
+    if (back->data == NULL || back->lut == NULL || back->agc_lut == NULL)
+    {
+        return SINK_ERROR_PARAM;
+    }
+    for (int y = 0; y < height; y++)
+    {
+        memcpy(back->data + (long)y * width * 2, frame + (long)y * stride, (size_t)width * 2);
+    }
+    if (back->lut_gen != sink->lut_gen)
+    {
+        memcpy(back->lut, sink->lut, COLOR_LUT_SIZE * 3);
+        back->lut_gen = sink->lut_gen;
+    }
+    back->raw_param = *raw;
+    back->raw_param.lut = back->lut;
+    if (raw->map == COLORIZE_MAP_HIST_AGC)
+    {
+        memcpy(back->agc_lut, raw->agc_lut, COLOR_LUT_SIZE * sizeof(uint16_t));
+    }
+    back->raw_param.agc_lut = back->agc_lut;
+    back->width = width;
+    back->height = height;
+    back->raw = 1;
+
+    triple_buffer_publish(&sink->ui_buffer);
+    eventcount_notify(&sink->ui_event);
+    return SINK_SUCCESS;
+}
+#endif
+
+static int display_sink_ui_poll_key(DisplaySink_t* sink)
+{
+    uint32_t tail = sink->key_tail.load(std::memory_order_relaxed);
+    if (tail == sink->key_head.load(std::memory_order_acquire))
+    {
+        return SINK_KEY_NONE;
+    }
+    int key = sink->key[tail & (SINK_KEY_QUEUE - 1)];
+    sink->key_tail.store(tail + 1, std::memory_order_release);
+    return key;
+}
+
+static void display_sink_ui_close(DisplaySink_t* sink)
+{
+    if (sink->ui_started)
+    {
+        sink->ui_running.store(0, std::memory_order_release);
+        eventcount_notify(&sink->ui_event);
+        pthread_join(sink->ui_thread, NULL);
+        eventcount_destroy(&sink->ui_event);
+        sink->ui_started = 0;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        free(sink->ui_frame[i].data);
+        free(sink->ui_frame[i].lut);
+        free(sink->ui_frame[i].agc_lut);
+        memset(&sink->ui_frame[i], 0, sizeof(DisplaySinkFrame_t));
+    }
+}
+
+//sinks with key input
+static int display_sink_is_ui(DisplaySinkType_t type)
+{
+    return type == DISPLAY_SINK_WINDOW || type == DISPLAY_SINK_D3D11 || type == DISPLAY_SINK_GL;
+}
+
+static int display_sink_is_threaded(DisplaySinkType_t type)
+{
+    return display_sink_is_ui(type) || type == DISPLAY_SINK_FB || type == DISPLAY_SINK_KMS;
+}
+#endif
+
+/*************************************** window ***************************************/
+#ifdef DISPLAY_WINDOW
+//highgui windows belong to the thread that created them: the window lives and dies here, and the 1 ms
+//waitKey that draws it and pumps its events only ever sleeps this thread
+static void* display_sink_window_function(void* arg)
+{
+    DisplaySink_t* sink = (DisplaySink_t*)arg;
+    const char* title = display_sink_path(sink, SINK_WINDOW_DEFAULT_TITLE);
+    rt_thread_enter(RT_ROLE_DISPLAY, -1, "sink_ui");
+    cv::namedWindow(title, cv::WINDOW_AUTOSIZE);
+    while (sink->ui_running.load(std::memory_order_acquire))
+    {
+        if (display_sink_ui_next(sink, SINK_UI_INTERVAL_MS))
+        {
+            DisplaySinkFrame_t* frame = display_sink_ui_front(sink);
+            cv::Mat image(frame->height, frame->width, CV_8UC3, frame->data);
+            cv::imshow(title, image);
+            sink->ui_shown++;
+        }
+        display_sink_key_push(sink, cv::waitKey(1));
+    }
+    cv::destroyWindow(title);
+    rt_thread_leave();
+    return NULL;
+}
+#endif
+
+/*************************************** d3d11 ***************************************/
+#if defined(_WIN32)
+#define SINK_D3D11_CLASS "irsample_display"
+
+//everything d3d belongs to the ui thread
+typedef struct {
+    HWND hwnd;
+    ID3D11Device* device;
+    ID3D11DeviceContext* context;
+    IDXGISwapChain* swap_chain;
+    ID3D11Texture2D* texture;           //dynamic bgra of the frame size, rewritten with WRITE_DISCARD per frame
+    int width;
+    int height;
+}DisplayD3d11_t;
+
+static LRESULT CALLBACK display_sink_d3d11_proc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
+{
+    DisplaySink_t* sink = (DisplaySink_t*)GetWindowLongPtrA(hwnd, GWLP_USERDATA);
+    switch (msg)
+    {
+    case WM_CHAR:
+        if (sink != NULL)
+        {
+            display_sink_key_push(sink, (int)wparam);
+        }
+        return 0;
+    case WM_CLOSE:
+        //the window lives as long as the sink, like the highgui one
+        return 0;
+    default:
+        break;
+    }
+    return DefWindowProcA(hwnd, msg, wparam, lparam);
+}
+
+static int display_sink_d3d11_create(DisplayD3d11_t* d3d, DisplaySink_t* sink)
+{
+    WNDCLASSEXA wc;
+    memset(&wc, 0, sizeof(wc));
+    wc.cbSize = sizeof(wc);
+    wc.lpfnWndProc = display_sink_d3d11_proc;
+    wc.hInstance = GetModuleHandleA(NULL);
+    wc.hCursor = LoadCursor(NULL, IDC_ARROW);
+    wc.lpszClassName = SINK_D3D11_CLASS;
+    if (RegisterClassExA(&wc) == 0 && GetLastError() != ERROR_CLASS_ALREADY_EXISTS)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    d3d->hwnd = CreateWindowExA(0, SINK_D3D11_CLASS, display_sink_path(sink, SINK_WINDOW_DEFAULT_TITLE), \
+        WS_OVERLAPPEDWINDOW, CW_USEDEFAULT, CW_USEDEFAULT, 640, 480, NULL, NULL, wc.hInstance, NULL);
+    if (d3d->hwnd == NULL)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    SetWindowLongPtrA(d3d->hwnd, GWLP_USERDATA, (LONG_PTR)sink);
+
+    //flip model from windows 10 on, the blt model before it
+    static const DXGI_SWAP_EFFECT effects[2] = { DXGI_SWAP_EFFECT_FLIP_DISCARD, DXGI_SWAP_EFFECT_DISCARD };
+    static const UINT buffers[2] = { 2, 1 };
+    DXGI_SWAP_CHAIN_DESC desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.BufferDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+    desc.OutputWindow = d3d->hwnd;
+    desc.Windowed = TRUE;
+    HRESULT hr = E_FAIL;
+    for (int i = 0; i < 2 && FAILED(hr); i++)
+    {
+        desc.SwapEffect = effects[i];
+        desc.BufferCount = buffers[i];
+        hr = D3D11CreateDeviceAndSwapChain(NULL, D3D_DRIVER_TYPE_HARDWARE, NULL, 0, NULL, 0, D3D11_SDK_VERSION, \
+            &desc, &d3d->swap_chain, &d3d->device, NULL, &d3d->context);
+    }
+    if (FAILED(hr))
+    {
+        return SINK_ERROR_OPEN;
+    }
+    ShowWindow(d3d->hwnd, SW_SHOWNORMAL);
+    return SINK_SUCCESS;
+}
+
+//the texture and the back buffers follow the frame size, the client area is set to it once per change
+static int display_sink_d3d11_resize(DisplayD3d11_t* d3d, int width, int height)
+{
+    if (d3d->texture != NULL)
+    {
+        d3d->texture->Release();
+        d3d->texture = NULL;
+    }
+    D3D11_TEXTURE2D_DESC desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    if (FAILED(d3d->device->CreateTexture2D(&desc, NULL, &d3d->texture)))
+    {
+        d3d->texture = NULL;
+        return SINK_ERROR_OPEN;
+    }
+    if (FAILED(d3d->swap_chain->ResizeBuffers(0, width, height, DXGI_FORMAT_UNKNOWN, 0)))
+    {
+        d3d->texture->Release();
+        d3d->texture = NULL;
+        return SINK_ERROR_OPEN;
+    }
+    d3d->width = width;
+    d3d->height = height;
+    RECT rect = { 0, 0, width, height };
+    AdjustWindowRect(&rect, WS_OVERLAPPEDWINDOW, FALSE);
+    SetWindowPos(d3d->hwnd, NULL, 0, 0, rect.right - rect.left, rect.bottom - rect.top, SWP_NOMOVE | SWP_NOZORDER);
+    return SINK_SUCCESS;
+}
+
+//bgr888 into the mapped texture, one gpu copy into the back buffer, present on the next vblank
+static void display_sink_d3d11_show(DisplayD3d11_t* d3d, const DisplaySinkFrame_t* frame)
+{
+    if ((d3d->texture == NULL || frame->width != d3d->width || frame->height != d3d->height) && \
+        display_sink_d3d11_resize(d3d, frame->width, frame->height) != SINK_SUCCESS)
+    {
+        return;
+    }
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (FAILED(d3d->context->Map(d3d->texture, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+    {
+        return;
+    }
+    for (int y = 0; y < frame->height; y++)
+    {
+        const uint8_t* src = frame->data + (long)y * frame->width * 3;
+        uint8_t* dst = (uint8_t*)mapped.pData + (size_t)y * mapped.RowPitch;
+        for (int x = 0; x < frame->width; x++)
+        {
+            dst[4 * x] = src[3 * x];
+            dst[4 * x + 1] = src[3 * x + 1];
+            dst[4 * x + 2] = src[3 * x + 2];
+            dst[4 * x + 3] = 0xff;
+        }
+    }
+    d3d->context->Unmap(d3d->texture, 0);
+    ID3D11Texture2D* back = NULL;
+    if (SUCCEEDED(d3d->swap_chain->GetBuffer(0, __uuidof(ID3D11Texture2D), (void**)&back)))
+    {
+        d3d->context->CopyResource(back, d3d->texture);
+        back->Release();
+    }
+    d3d->swap_chain->Present(1, 0);
+}
+
+static void display_sink_d3d11_destroy(DisplayD3d11_t* d3d)
+{
+    if (d3d->texture != NULL)
+    {
+        d3d->texture->Release();
+    }
+    if (d3d->swap_chain != NULL)
+    {
+        d3d->swap_chain->Release();
+    }
+    if (d3d->context != NULL)
+    {
+        d3d->context->Release();
+    }
+    if (d3d->device != NULL)
+    {
+        d3d->device->Release();
+    }
+    if (d3d->hwnd != NULL)
+    {
+        DestroyWindow(d3d->hwnd);
+    }
+    memset(d3d, 0, sizeof(DisplayD3d11_t));
+}
+
+//win32 windows belong to the thread that created them, their messages are pumped here between frames
+static void* display_sink_d3d11_function(void* arg)
+{
+    DisplaySink_t* sink = (DisplaySink_t*)arg;
+    DisplayD3d11_t d3d;
+    memset(&d3d, 0, sizeof(d3d));
+    rt_thread_enter(RT_ROLE_DISPLAY, -1, "sink_ui");
+    if (display_sink_d3d11_create(&d3d, sink) != SINK_SUCCESS)
+    {
+        printf("display sink d3d11: no window or device, frames are dropped\n");
+    }
+    while (sink->ui_running.load(std::memory_order_acquire))
+    {
+        if (display_sink_ui_next(sink, SINK_UI_INTERVAL_MS) && d3d.swap_chain != NULL)
+        {
+            display_sink_d3d11_show(&d3d, display_sink_ui_front(sink));
+            sink->ui_shown++;
+        }
+        MSG msg;
+        while (PeekMessageA(&msg, NULL, 0, 0, PM_REMOVE))
+        {
+            TranslateMessage(&msg);
+            DispatchMessageA(&msg);
+        }
+    }
+    display_sink_d3d11_destroy(&d3d);
+    rt_thread_leave();
+    return NULL;
+}
+#endif
+
+/*************************************** gl ***************************************/
+#if defined(DISPLAY_GL)
+//a full window triangle, the fragment shader works in frame pixels
+static const char* display_sink_gl_vertex =
+    "#version 300 es\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = vec4(float((gl_VertexID & 1) * 4 - 1), float((gl_VertexID & 2) * 2 - 1), 0.0, 1.0);\n"
+    "}\n";
+
+//mode 0 a raw frame: its window pixel goes through the zoom and transform back to a source position, the value
+//there (bilinear when zoomed so) is mapped like colorize_plan_apply and looked up in the palette. mode 1 a
+//composed bgr frame, mode 2 the palette's bar. the luts are 128 x 128 textures, gles has no 1d ones and 16384
+//texels in a row are more than many gpus take
+static const char* display_sink_gl_fragment =
+    "#version 300 es\n"
+    "precision highp float;\n"
+    "precision highp int;\n"
+    "precision highp usampler2D;\n"
+    "uniform usampler2D frame;\n"
+    "uniform usampler2D agc;\n"
+    "uniform sampler2D palette;\n"
+    "uniform sampler2D image;\n"
+    "uniform int mode;\n"
+    "uniform int shift;\n"
+    "uniform int map;\n"
+    "uniform uint lo;\n"
+    "uniform uint hi;\n"
+    "uniform int bilinear;\n"
+    "uniform vec4 view;\n"
+    "uniform vec2 out_size;\n"
+    "uniform vec2 origin;\n"
+    "uniform vec2 step_x;\n"
+    "uniform vec2 step_y;\n"
+    "out vec4 color;\n"
+    "uint lut_offset(uint s)\n"
+    "{\n"
+    "    uint v = s >> uint(shift);\n"
+    "    if (map == 1)\n"
+    "    {\n"
+    "        v = clamp(v, lo, hi);\n"
+    "        return (v - lo) * 16383u / max(hi - lo, 1u);\n"
+    "    }\n"
+    "    v = min(v, 16383u);\n"
+    "    if (map == 2) return texelFetch(agc, ivec2(int(v & 127u), int(v >> 7)), 0).r;\n"
+    "    return v;\n"
+    "}\n"
+    "vec3 lut(uint i)\n"
+    "{\n"
+    "    return texelFetch(palette, ivec2(int(i & 127u), int(i >> 7)), 0).bgr;\n"
+    "}\n"
+    "uint raw(ivec2 p)\n"
+    "{\n"
+    "    return texelFetch(frame, clamp(p, ivec2(0), textureSize(frame, 0) - 1), 0).r;\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 p = vec2(gl_FragCoord.x - view.x, view.y + view.w - gl_FragCoord.y);\n"
+    "    if (mode == 2)\n"
+    "    {\n"
+    "        color = vec4(lut(uint(clamp((1.0 - p.y / view.w) * 16383.0 + 0.5, 0.0, 16383.0))), 1.0);\n"
+    "        return;\n"
+    "    }\n"
+    "    vec2 o = p * out_size / view.zw - 0.5;\n"
+    "    if (mode == 1)\n"
+    "    {\n"
+    "        ivec2 q = clamp(ivec2(floor(o + 0.5)), ivec2(0), ivec2(out_size) - 1);\n"
+    "        color = vec4(texelFetch(image, q, 0).bgr, 1.0);\n"
+    "        return;\n"
+    "    }\n"
+    "    vec2 s = origin + o.x * step_x + o.y * step_y;\n"
+    "    uint v;\n"
+    "    if (bilinear != 0)\n"
+    "    {\n"
+    "        vec2 f = floor(s);\n"
+    "        vec2 w = s - f;\n"
+    "        ivec2 i = ivec2(f);\n"
+    "        float top = mix(float(raw(i)), float(raw(i + ivec2(1, 0))), w.x);\n"
+    "        float bottom = mix(float(raw(i + ivec2(0, 1))), float(raw(i + ivec2(1, 1))), w.x);\n"
+    "        v = uint(mix(top, bottom, w.y) + 0.5);\n"
+    "    }\n"
+    "    else\n"
+    "    {\n"
+    "        v = raw(ivec2(floor(s + 0.5)));\n"
+    "    }\n"
+    "    color = vec4(lut(lut_offset(v)), 1.0);\n"
+    "}\n";
+
+typedef enum
+{
+    SINK_GL_U_MODE = 0,
+    SINK_GL_U_SHIFT,
+    SINK_GL_U_MAP,
+    SINK_GL_U_LO,
+    SINK_GL_U_HI,
+    SINK_GL_U_BILINEAR,
+    SINK_GL_U_VIEW,
+    SINK_GL_U_OUT_SIZE,
+    SINK_GL_U_ORIGIN,
+    SINK_GL_U_STEP_X,
+    SINK_GL_U_STEP_Y,
+    SINK_GL_U_NUM,
+}DisplayGlUniform_t;
+
+static const char* display_sink_gl_uniforms[SINK_GL_U_NUM] = { "mode", "shift", "map", "lo", "hi", "bilinear", \
+    "view", "out_size", "origin", "step_x", "step_y" };
+
+//the x window and everything gl belong to the ui thread
+typedef struct {
+    Display* x;
+    Window window;
+    Atom delete_atom;
+    EGLDisplay egl;
+    EGLSurface surface;
+    EGLContext context;
+    GLuint program;
+    GLuint vao;
+    GLint uniform[SINK_GL_U_NUM];
+    GLuint frame_tex;                   //R16UI of the raw frames
+    GLuint image_tex;                   //RGB8 of the composed frames
+    GLuint lut_tex;                     //RGB8 128 x 128, the palette's bgr bytes
+    GLuint agc_tex;                     //R16UI 128 x 128
+    GLuint pbo[SINK_GL_PBOS];
+    uint32_t pbo_size[SINK_GL_PBOS];
+    int pbo_next;
+    int frame_width;                    //size of frame_tex, image_tex
+    int frame_height;
+    int image_width;
+    int image_height;
+    int win_width;
+    int win_height;
+    uint64_t lut_gen;                   //of the palette in lut_tex
+    char caption[SINK_PATH_LEN];
+}DisplayGl_t;
+
+static GLuint display_sink_gl_shader(GLenum type, const char* source)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    GLint ok = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok)
+    {
+        char log[512];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        printf("display sink gl: shader: %s\n", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+//immutable storage, a size change makes a new texture
+static void display_sink_gl_texture(GLuint* tex, GLenum internal_format, int width, int height)
+{
+    if (*tex != 0)
+    {
+        glDeleteTextures(1, tex);
+    }
+    glGenTextures(1, tex);
+    glBindTexture(GL_TEXTURE_2D, *tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexStorage2D(GL_TEXTURE_2D, 1, internal_format, width, height);
+}
+
+//the frame goes through the next pbo: mapped with its old contents invalidated, so the driver hands out memory
+//the gpu is not reading, and the texture is filled from it without the cpu waiting for the copy. gles 3.0 has
+//no persistent mapping, a map per frame of a buffer the gpu is done with gets close to it
+static void display_sink_gl_upload(DisplayGl_t* gl, GLuint tex, const uint8_t* data, int width, int height, \
+    int bytes, GLenum format, GLenum type)
+{
+    uint32_t size = (uint32_t)width * height * bytes;
+    int index = gl->pbo_next;
+    gl->pbo_next = (gl->pbo_next + 1) % SINK_GL_PBOS;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->pbo[index]);
+    if (gl->pbo_size[index] < size)
+    {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        gl->pbo_size[index] = size;
+    }
+    void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (dst != NULL)
+    {
+        memcpy(dst, data, size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, (const void*)0);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+static void display_sink_gl_destroy(DisplayGl_t* gl)
+{
+    if (gl->context != EGL_NO_CONTEXT && gl->context != NULL)
+    {
+        GLuint tex[4] = { gl->frame_tex, gl->image_tex, gl->lut_tex, gl->agc_tex };
+        glDeleteTextures(4, tex);
+        glDeleteBuffers(SINK_GL_PBOS, gl->pbo);
+        glDeleteVertexArrays(1, &gl->vao);
+        glDeleteProgram(gl->program);
+        eglMakeCurrent(gl->egl, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(gl->egl, gl->context);
+    }
+    if (gl->surface != EGL_NO_SURFACE && gl->surface != NULL)
+    {
+        eglDestroySurface(gl->egl, gl->surface);
+    }
+    if (gl->egl != EGL_NO_DISPLAY && gl->egl != NULL)
+    {
+        eglTerminate(gl->egl);
+    }
+    if (gl->x != NULL)
+    {
+        if (gl->window != 0)
+        {
+            XDestroyWindow(gl->x, gl->window);
+        }
+        XCloseDisplay(gl->x);
+    }
+    memset(gl, 0, sizeof(DisplayGl_t));
+}
+
+static int display_sink_gl_create(DisplayGl_t* gl, DisplaySink_t* sink)
+{
+    gl->x = XOpenDisplay(NULL);
+    if (gl->x == NULL)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    gl->win_width = 640;
+    gl->win_height = 480;
+    gl->window = XCreateSimpleWindow(gl->x, DefaultRootWindow(gl->x), 0, 0, gl->win_width, gl->win_height, 0, 0, 0);
+    XSelectInput(gl->x, gl->window, KeyPressMask);
+    XStoreName(gl->x, gl->window, display_sink_path(sink, SINK_WINDOW_DEFAULT_TITLE));
+    //the window lives as long as the sink, like the highgui one: closing it is ignored
+    gl->delete_atom = XInternAtom(gl->x, "WM_DELETE_WINDOW", False);
+    XSetWMProtocols(gl->x, gl->window, &gl->delete_atom, 1);
+    XMapWindow(gl->x, gl->window);
+
+    static const EGLint config_attr[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT, EGL_SURFACE_TYPE, EGL_WINDOW_BIT, \
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_NONE };
+    static const EGLint context_attr[] = { EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE };
+    EGLConfig config;
+    EGLint config_num = 0;
+    gl->egl = eglGetDisplay((EGLNativeDisplayType)gl->x);
+    if (gl->egl == EGL_NO_DISPLAY || !eglInitialize(gl->egl, NULL, NULL) || !eglBindAPI(EGL_OPENGL_ES_API) || \
+        !eglChooseConfig(gl->egl, config_attr, &config, 1, &config_num) || config_num < 1)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    gl->surface = eglCreateWindowSurface(gl->egl, config, (EGLNativeWindowType)gl->window, NULL);
+    gl->context = eglCreateContext(gl->egl, config, EGL_NO_CONTEXT, context_attr);
+    if (gl->surface == EGL_NO_SURFACE || gl->context == EGL_NO_CONTEXT || \
+        !eglMakeCurrent(gl->egl, gl->surface, gl->surface, gl->context))
+    {
+        return SINK_ERROR_OPEN;
+    }
+    eglSwapInterval(gl->egl, 1);
+
+    GLuint vertex = display_sink_gl_shader(GL_VERTEX_SHADER, display_sink_gl_vertex);
+    GLuint fragment = display_sink_gl_shader(GL_FRAGMENT_SHADER, display_sink_gl_fragment);
+    if (vertex == 0 || fragment == 0)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    gl->program = glCreateProgram();
+    glAttachShader(gl->program, vertex);
+    glAttachShader(gl->program, fragment);
+    glLinkProgram(gl->program);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+    GLint ok = 0;
+    glGetProgramiv(gl->program, GL_LINK_STATUS, &ok);
+    if (!ok)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    glUseProgram(gl->program);
+    for (int i = 0; i < SINK_GL_U_NUM; i++)
+    {
+        gl->uniform[i] = glGetUniformLocation(gl->program, display_sink_gl_uniforms[i]);
+    }
+    glUniform1i(glGetUniformLocation(gl->program, "frame"), 0);
+    glUniform1i(glGetUniformLocation(gl->program, "agc"), 1);
+    glUniform1i(glGetUniformLocation(gl->program, "palette"), 2);
+    glUniform1i(glGetUniformLocation(gl->program, "image"), 3);
+    display_sink_gl_texture(&gl->lut_tex, GL_RGB8, 128, COLOR_LUT_SIZE / 128);
+    display_sink_gl_texture(&gl->agc_tex, GL_R16UI, 128, COLOR_LUT_SIZE / 128);
+    glGenBuffers(SINK_GL_PBOS, gl->pbo);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    //the fragment shader runs once per pixel, a vertex array of nothing feeds its triangle
+    glGenVertexArrays(1, &gl->vao);
+    glBindVertexArray(gl->vao);
+    printf("display sink gl: %s\n", (const char*)glGetString(GL_RENDERER));
+    return SINK_SUCCESS;
+}
+
+//output pixel o of the frame reads source position origin + o.x * step_x + o.y * step_y: the transform map's
+//linear steps as source pixel vectors, then the zoom window's magnification around its center
+static void display_sink_gl_mapping(DisplayGl_t* gl, const DisplaySinkRaw_t* raw, int width, int height)
+{
+    const TransformMap_t* map = &raw->transform;
+    float base_x = (float)(map->base % width), base_y = (float)(map->base / width);
+    float sx[2] = { 0, 0 }, sy[2] = { 0, 0 };
+    long steps[2] = { map->step_x, map->step_y };
+    float* vec[2] = { sx, sy };
+    for (int i = 0; i < 2; i++)
+    {
+        if (steps[i] == 1 || steps[i] == -1)
+        {
+            vec[i][0] = (float)steps[i];
+        }
+        else
+        {
+            vec[i][1] = (float)(steps[i] / width);
+        }
+    }
+    int zoomed = zoom_view_active(&raw->zoom);
+    float factor = zoomed ? raw->zoom.factor : 1.0f;
+    float first_x = zoomed ? raw->zoom.center_x * width - 0.5f * width / factor : 0.0f;
+    float first_y = zoomed ? raw->zoom.center_y * height - 0.5f * height / factor : 0.0f;
+    glUniform2f(gl->uniform[SINK_GL_U_ORIGIN], first_x + (base_x + 0.5f) / factor - 0.5f, \
+        first_y + (base_y + 0.5f) / factor - 0.5f);
+    glUniform2f(gl->uniform[SINK_GL_U_STEP_X], sx[0] / factor, sx[1] / factor);
+    glUniform2f(gl->uniform[SINK_GL_U_STEP_Y], sy[0] / factor, sy[1] / factor);
+    glUniform1i(gl->uniform[SINK_GL_U_BILINEAR], zoomed && raw->zoom.sample == ZOOM_SAMPLE_BILINEAR);
+}
+
+static void display_sink_gl_draw(DisplayGl_t* gl, int mode, int x, int width, int height)
+{
+    glViewport(x, 0, width, height);
+    glUniform1i(gl->uniform[SINK_GL_U_MODE], mode);
+    glUniform4f(gl->uniform[SINK_GL_U_VIEW], (float)x, 0.0f, (float)width, (float)height);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+//the window follows the shown frame and its bar, one pixel per frame pixel like the highgui window
+static void display_sink_gl_show(DisplayGl_t* gl, const DisplaySinkFrame_t* frame)
+{
+    const DisplaySinkRaw_t* raw = &frame->raw_param;
+    int out_width = frame->raw ? raw->transform.out_width : frame->width;
+    int out_height = frame->raw ? raw->transform.out_height : frame->height;
+    int bar = frame->raw && raw->color_bar;
+    int win_width = out_width + (bar ? SINK_GL_BAR_MARGIN + SINK_GL_BAR_WIDTH : 0);
+    if (win_width != gl->win_width || out_height != gl->win_height)
+    {
+        XResizeWindow(gl->x, gl->window, win_width, out_height);
+        gl->win_width = win_width;
+        gl->win_height = out_height;
+    }
+    if (frame->raw && strcmp(raw->caption, gl->caption) != 0)
+    {
+        snprintf(gl->caption, sizeof(gl->caption), "%s", raw->caption);
+        XStoreName(gl->x, gl->window, gl->caption);
+    }
+    glViewport(0, 0, gl->win_width, gl->win_height);
+    glClearColor(0, 0, 0, 1);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glUniform2f(gl->uniform[SINK_GL_U_OUT_SIZE], (float)out_width, (float)out_height);
+    if (frame->raw)
+    {
+        if (gl->frame_tex == 0 || frame->width != gl->frame_width || frame->height != gl->frame_height)
+        {
+            display_sink_gl_texture(&gl->frame_tex, GL_R16UI, frame->width, frame->height);
+            gl->frame_width = frame->width;
+            gl->frame_height = frame->height;
+        }
+        display_sink_gl_upload(gl, gl->frame_tex, frame->data, frame->width, frame->height, 2, GL_RED_INTEGER, \
+            GL_UNSIGNED_SHORT);
+        if (gl->lut_gen != frame->lut_gen)
+        {
+            glBindTexture(GL_TEXTURE_2D, gl->lut_tex);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 128, COLOR_LUT_SIZE / 128, GL_RGB, GL_UNSIGNED_BYTE, raw->lut);
+            gl->lut_gen = frame->lut_gen;
+        }
+        if (raw->map == COLORIZE_MAP_HIST_AGC)
+        {
+            glBindTexture(GL_TEXTURE_2D, gl->agc_tex);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 128, COLOR_LUT_SIZE / 128, GL_RED_INTEGER, GL_UNSIGNED_SHORT, \
+                raw->agc_lut);
+        }
+        glUniform1i(gl->uniform[SINK_GL_U_SHIFT], raw->shift);
+        glUniform1i(gl->uniform[SINK_GL_U_MAP], (int)raw->map);
+        glUniform1ui(gl->uniform[SINK_GL_U_LO], raw->lo);
+        glUniform1ui(gl->uniform[SINK_GL_U_HI], raw->hi);
+        display_sink_gl_mapping(gl, raw, frame->width, frame->height);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, gl->frame_tex);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, gl->agc_tex);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, gl->lut_tex);
+        glActiveTexture(GL_TEXTURE0);
+        display_sink_gl_draw(gl, 0, 0, out_width, out_height);
+        if (bar)
+        {
+            display_sink_gl_draw(gl, 2, out_width + SINK_GL_BAR_MARGIN, SINK_GL_BAR_WIDTH, out_height);
+        }
+    }
+    else
+    {
+        if (gl->image_tex == 0 || frame->width != gl->image_width || frame->height != gl->image_height)
+        {
+            display_sink_gl_texture(&gl->image_tex, GL_RGB8, frame->width, frame->height);
+            gl->image_width = frame->width;
+            gl->image_height = frame->height;
+        }
+        display_sink_gl_upload(gl, gl->image_tex, frame->data, frame->width, frame->height, 3, GL_RGB, \
+            GL_UNSIGNED_BYTE);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, gl->image_tex);
+        glActiveTexture(GL_TEXTURE0);
+        display_sink_gl_draw(gl, 1, 0, out_width, out_height);
+    }
+    eglSwapBuffers(gl->egl, gl->surface);
+}
+
+//the x events are pumped here between frames, keys go to the queue like the highgui window's
+static void* display_sink_gl_function(void* arg)
+{
+    DisplaySink_t* sink = (DisplaySink_t*)arg;
+    DisplayGl_t gl;
+    memset(&gl, 0, sizeof(gl));
+    rt_thread_enter(RT_ROLE_DISPLAY, -1, "sink_ui");
+    int ready = (display_sink_gl_create(&gl, sink) == SINK_SUCCESS);
+    if (!ready)
+    {
+        printf("display sink gl: no x display, egl or gles 3 context, frames are dropped\n");
+    }
+    while (sink->ui_running.load(std::memory_order_acquire))
+    {
+        if (display_sink_ui_next(sink, SINK_UI_INTERVAL_MS) && ready)
+        {
+            display_sink_gl_show(&gl, display_sink_ui_front(sink));
+            sink->ui_shown++;
+        }
+        while (gl.x != NULL && XPending(gl.x) > 0)
+        {
+            XEvent event;
+            XNextEvent(gl.x, &event);
+            char text[8];
+            KeySym sym;
+            if (event.type == KeyPress && XLookupString(&event.xkey, text, sizeof(text), &sym, NULL) > 0)
+            {
+                display_sink_key_push(sink, (uint8_t)text[0]);
+            }
+        }
+    }
+    display_sink_gl_destroy(&gl);
+    rt_thread_leave();
+    return NULL;
+}
+#endif
+
+/*************************************** fb ***************************************/
+#if defined(__linux__)
+static int display_sink_fb_open(DisplaySink_t* sink)
+{
+    const char* path = display_sink_path(sink, SINK_FB_DEFAULT_PATH);
+    sink->fb_fd = open(path, O_RDWR);
+    if (sink->fb_fd < 0)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    struct fb_var_screeninfo var;
+    struct fb_fix_screeninfo fix;
+    if (ioctl(sink->fb_fd, FBIOGET_VSCREENINFO, &var) < 0 || ioctl(sink->fb_fd, FBIOGET_FSCREENINFO, &fix) < 0)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    if ((var.bits_per_pixel != 16 && var.bits_per_pixel != 24 && var.bits_per_pixel != 32) || \
+        fix.type != FB_TYPE_PACKED_PIXELS || fix.visual != FB_VISUAL_TRUECOLOR)
+    {
+        return SINK_ERROR_FORMAT;
+    }
+    sink->fb_width = var.xres;
+    sink->fb_height = var.yres;
+    sink->fb_stride = fix.line_length;
+    sink->fb_bpp = var.bits_per_pixel;
+    sink->fb_offset[0] = var.blue.offset;
+    sink->fb_offset[1] = var.green.offset;
+    sink->fb_offset[2] = var.red.offset;
+    sink->fb_length[0] = var.blue.length;
+    sink->fb_length[1] = var.green.length;
+    sink->fb_length[2] = var.red.length;
+    sink->fb_size = fix.smem_len;
+    void* mem = mmap(NULL, sink->fb_size, PROT_READ | PROT_WRITE, MAP_SHARED, sink->fb_fd, 0);
+    if (mem == MAP_FAILED)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    //draw into the visible page of a panned framebuffer
+    sink->fb_mem = (uint8_t*)mem;
+    sink->fb_page = var.yoffset * fix.line_length + var.xoffset * (var.bits_per_pixel / 8);
+    if ((uint64_t)sink->fb_page + (uint64_t)sink->fb_height * sink->fb_stride > sink->fb_size)
+    {
+        return SINK_ERROR_FORMAT;
+    }
+    memset(sink->fb_mem + sink->fb_page, 0, (size_t)sink->fb_height * sink->fb_stride);
+    printf("display sink fb: %s %ux%u %ubpp\n", path, sink->fb_width, sink->fb_height, sink->fb_bpp);
+    return SINK_SUCCESS;
+}
+
+//bgr888 into xrgb8888, the common case of fb and the format of the kms buffers, byte copy without packing
+static void display_sink_xrgb_row(uint8_t* dst, const uint8_t* src, int width)
+{
+    for (int x = 0; x < width; x++)
+    {
+        dst[4 * x] = src[3 * x];
+        dst[4 * x + 1] = src[3 * x + 1];
+        dst[4 * x + 2] = src[3 * x + 2];
+        dst[4 * x + 3] = 0xff;
+    }
+}
+
+//centered on the screen, clipped when the frame is larger
+static int display_sink_fb_present(DisplaySink_t* sink, const uint8_t* frame, int width, int height, int stride)
+{
+    int copy_width = (width < (int)sink->fb_width) ? width : (int)sink->fb_width;
+    int copy_height = (height < (int)sink->fb_height) ? height : (int)sink->fb_height;
+    int src_x = (width - copy_width) / 2;
+    int src_y = (height - copy_height) / 2;
+    int dst_x = ((int)sink->fb_width - copy_width) / 2;
+    int dst_y = ((int)sink->fb_height - copy_height) / 2;
+    int bytes = sink->fb_bpp / 8;
+    uint32_t shift[3];
+    for (int c = 0; c < 3; c++)
+    {
+        shift[c] = 8 - sink->fb_length[c];
+    }
+    for (int y = 0; y < copy_height; y++)
+    {
+        const uint8_t* src = frame + (long)(src_y + y) * stride + src_x * 3;
+        uint8_t* dst = sink->fb_mem + sink->fb_page + (size_t)(dst_y + y) * sink->fb_stride + (size_t)dst_x * bytes;
+        if (bytes == 4 && sink->fb_offset[0] == 0 && sink->fb_offset[1] == 8 && sink->fb_offset[2] == 16)
+        {
+            display_sink_xrgb_row(dst, src, copy_width);
+            continue;
+        }
+        for (int x = 0; x < copy_width; x++)
+        {
+            uint32_t pixel = ((uint32_t)(src[3 * x] >> shift[0]) << sink->fb_offset[0]) | \
+                ((uint32_t)(src[3 * x + 1] >> shift[1]) << sink->fb_offset[1]) | \
+                ((uint32_t)(src[3 * x + 2] >> shift[2]) << sink->fb_offset[2]);
+            for (int b = 0; b < bytes; b++)
+            {
+                dst[bytes * x + b] = (uint8_t)(pixel >> (8 * b));
+            }
+        }
+    }
+    return SINK_SUCCESS;
+}
+
+//the conversion into the framebuffer's pixel format runs here, off the display thread
+static void* display_sink_fb_function(void* arg)
+{
+    DisplaySink_t* sink = (DisplaySink_t*)arg;
+    rt_thread_enter(RT_ROLE_DISPLAY, -1, "sink_fb");
+    while (sink->ui_running.load(std::memory_order_acquire))
+    {
+        if (display_sink_ui_next(sink, -1))
+        {
+            const DisplaySinkFrame_t* frame = display_sink_ui_front(sink);
+            display_sink_fb_present(sink, frame->data, frame->width, frame->height, frame->width * 3);
+            sink->ui_shown++;
+        }
+    }
+    rt_thread_leave();
+    return NULL;
+}
+
+static void display_sink_fb_close(DisplaySink_t* sink)
+{
+    if (sink->fb_mem != NULL)
+    {
+        munmap(sink->fb_mem, sink->fb_size);
+        sink->fb_mem = NULL;
+    }
+    if (sink->fb_fd >= 0)
+    {
+        close(sink->fb_fd);
+        sink->fb_fd = -1;
+    }
+}
+#endif
+
+/*************************************** kms ***************************************/
+#if defined(DISPLAY_KMS)
+typedef struct {
+    uint32_t handle;
+    uint32_t fb_id;
+    uint32_t pitch;
+    uint64_t size;
+    uint8_t* map;
+    int width;                          //frame last written, the border around it is black
+    int height;
+}DisplayKmsBuffer_t;
+
+struct DisplayKms_t {
+    int fd;
+    uint32_t connector_id;
+    uint32_t crtc_id;
+    drmModeModeInfo mode;
+    drmModeCrtc* saved_crtc;            //what was scanned out before, restored by close
+    DisplayKmsBuffer_t buffer[SINK_KMS_BUFFERS];
+    int buffers;                        //created so far
+    //under mutex: the buffer on screen, the one queued for the next vblank and the newest complete one, -1 none
+    pthread_mutex_t mutex;
+    int scanned;
+    int pending;
+    int ready;
+    uint64_t replaced;                  //ready buffers written over before they were flipped to
+    uint64_t flip_errors;
+};
+
+static void display_sink_kms_destroy(DisplayKms_t* kms)
+{
+    if (kms->saved_crtc != NULL)
+    {
+        drmModeSetCrtc(kms->fd, kms->saved_crtc->crtc_id, kms->saved_crtc->buffer_id, kms->saved_crtc->x, \
+            kms->saved_crtc->y, &kms->connector_id, 1, &kms->saved_crtc->mode);
+        drmModeFreeCrtc(kms->saved_crtc);
+    }
+    for (int i = 0; i < kms->buffers; i++)
+    {
+        DisplayKmsBuffer_t* buffer = &kms->buffer[i];
+        if (buffer->map != NULL)
+        {
+            munmap(buffer->map, buffer->size);
+        }
+        if (buffer->fb_id != 0)
+        {
+            drmModeRmFB(kms->fd, buffer->fb_id);
+        }
+        struct drm_mode_destroy_dumb destroy;
+        memset(&destroy, 0, sizeof(destroy));
+        destroy.handle = buffer->handle;
+        drmIoctl(kms->fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+    }
+    if (kms->fd >= 0)
+    {
+        close(kms->fd);
+    }
+    pthread_mutex_destroy(&kms->mutex);
+    free(kms);
+}
+
+//the first connected connector in its preferred mode, on the crtc its encoder drives or the first one it can use
+static int display_sink_kms_connector(DisplayKms_t* kms)
+{
+    drmModeRes* res = drmModeGetResources(kms->fd);
+    if (res == NULL)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    int rst = SINK_ERROR_OPEN;
+    for (int i = 0; i < res->count_connectors && rst != SINK_SUCCESS; i++)
+    {
+        drmModeConnector* conn = drmModeGetConnector(kms->fd, res->connectors[i]);
+        if (conn == NULL)
+        {
+            continue;
+        }
+        if (conn->connection == DRM_MODE_CONNECTED && conn->count_modes > 0)
+        {
+            kms->mode = conn->modes[0];
+            for (int m = 0; m < conn->count_modes; m++)
+            {
+                if (conn->modes[m].type & DRM_MODE_TYPE_PREFERRED)
+                {
+                    kms->mode = conn->modes[m];
+                    break;
+                }
+            }
+            uint32_t crtc_id = 0;
+            drmModeEncoder* enc = (conn->encoder_id != 0) ? drmModeGetEncoder(kms->fd, conn->encoder_id) : NULL;
+            if (enc != NULL)
+            {
+                crtc_id = enc->crtc_id;
+                drmModeFreeEncoder(enc);
+            }
+            for (int e = 0; e < conn->count_encoders && crtc_id == 0; e++)
+            {
+                enc = drmModeGetEncoder(kms->fd, conn->encoders[e]);
+                if (enc == NULL)
+                {
+                    continue;
+                }
+                for (int c = 0; c < res->count_crtcs; c++)
+                {
+                    if (enc->possible_crtcs & (1u << c))
+                    {
+                        crtc_id = res->crtcs[c];
+                        break;
+                    }
+                }
+                drmModeFreeEncoder(enc);
+            }
+            if (crtc_id != 0)
+            {
+                kms->connector_id = conn->connector_id;
+                kms->crtc_id = crtc_id;
+                rst = SINK_SUCCESS;
+            }
+        }
+        drmModeFreeConnector(conn);
+    }
+    drmModeFreeResources(res);
+    return rst;
+}
+
+static int display_sink_kms_buffer(DisplayKms_t* kms, DisplayKmsBuffer_t* buffer)
+{
+    struct drm_mode_create_dumb create;
+    memset(&create, 0, sizeof(create));
+    create.width = kms->mode.hdisplay;
+    create.height = kms->mode.vdisplay;
+    create.bpp = 32;
+    if (drmIoctl(kms->fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) < 0)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    buffer->handle = create.handle;
+    buffer->pitch = create.pitch;
+    buffer->size = create.size;
+    kms->buffers++;
+    if (drmModeAddFB(kms->fd, create.width, create.height, 24, 32, create.pitch, create.handle, &buffer->fb_id) != 0)
+    {
+        buffer->fb_id = 0;
+        return SINK_ERROR_OPEN;
+    }
+    struct drm_mode_map_dumb map;
+    memset(&map, 0, sizeof(map));
+    map.handle = create.handle;
+    if (drmIoctl(kms->fd, DRM_IOCTL_MODE_MAP_DUMB, &map) < 0)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    void* mem = mmap(NULL, buffer->size, PROT_READ | PROT_WRITE, MAP_SHARED, kms->fd, map.offset);
+    if (mem == MAP_FAILED)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    buffer->map = (uint8_t*)mem;
+    memset(buffer->map, 0, buffer->size);
+    return SINK_SUCCESS;
+}
+
+static int display_sink_kms_open(DisplaySink_t* sink)
+{
+    const char* path = display_sink_path(sink, SINK_KMS_DEFAULT_PATH);
+    DisplayKms_t* kms = (DisplayKms_t*)calloc(1, sizeof(DisplayKms_t));
+    if (kms == NULL)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    pthread_mutex_init(&kms->mutex, NULL);
+    kms->scanned = -1;
+    kms->pending = -1;
+    kms->ready = -1;
+    kms->fd = open(path, O_RDWR | O_CLOEXEC);
+    uint64_t dumb = 0;
+    if (kms->fd < 0 || drmGetCap(kms->fd, DRM_CAP_DUMB_BUFFER, &dumb) < 0 || !dumb || \
+        display_sink_kms_connector(kms) != SINK_SUCCESS)
+    {
+        printf("display sink kms: no connected output on %s\n", path);
+        display_sink_kms_destroy(kms);
+        return SINK_ERROR_OPEN;
+    }
+    for (int i = 0; i < SINK_KMS_BUFFERS; i++)
+    {
+        if (display_sink_kms_buffer(kms, &kms->buffer[i]) != SINK_SUCCESS)
+        {
+            display_sink_kms_destroy(kms);
+            return SINK_ERROR_OPEN;
+        }
+    }
+    //the modeset needs drm master, another display server holding it fails here
+    kms->saved_crtc = drmModeGetCrtc(kms->fd, kms->crtc_id);
+    if (drmModeSetCrtc(kms->fd, kms->crtc_id, kms->buffer[0].fb_id, 0, 0, &kms->connector_id, 1, &kms->mode) != 0)
+    {
+        printf("display sink kms: modeset on %s failed, is a display server running\n", path);
+        display_sink_kms_destroy(kms);
+        return SINK_ERROR_OPEN;
+    }
+    kms->scanned = 0;
+    sink->kms = kms;
+    printf("display sink kms: %s %ux%u@%u\n", path, kms->mode.hdisplay, kms->mode.vdisplay, kms->mode.vrefresh);
+    return SINK_SUCCESS;
+}
+
+//writes straight into a dumb buffer that is neither on screen nor queued, centered and clipped like fb. a
+//ready buffer the sink thread has not flipped to yet is written over, the display only ever shows the newest
+static int display_sink_kms_present(DisplaySink_t* sink, const uint8_t* frame, int width, int height, int stride)
+{
+    DisplayKms_t* kms = sink->kms;
+    pthread_mutex_lock(&kms->mutex);
+    int index = -1;
+    for (int i = 0; i < SINK_KMS_BUFFERS && index < 0; i++)
+    {
+        if (i != kms->scanned && i != kms->pending && i != kms->ready)
+        {
+            index = i;
+        }
+    }
+    if (index < 0)
+    {
+        index = kms->ready;
+        kms->ready = -1;
+        kms->replaced++;
+    }
+    pthread_mutex_unlock(&kms->mutex);
+
+    DisplayKmsBuffer_t* buffer = &kms->buffer[index];
+    int screen_width = kms->mode.hdisplay;
+    int screen_height = kms->mode.vdisplay;
+    if (buffer->width != width || buffer->height != height)
+    {
+        memset(buffer->map, 0, buffer->size);
+        buffer->width = width;
+        buffer->height = height;
+    }
+    int copy_width = (width < screen_width) ? width : screen_width;
+    int copy_height = (height < screen_height) ? height : screen_height;
+    int src_x = (width - copy_width) / 2;
+    int src_y = (height - copy_height) / 2;
+    int dst_x = (screen_width - copy_width) / 2;
+    int dst_y = (screen_height - copy_height) / 2;
+    for (int y = 0; y < copy_height; y++)
+    {
+        display_sink_xrgb_row(buffer->map + (size_t)(dst_y + y) * buffer->pitch + (size_t)dst_x * 4, \
+            frame + (long)(src_y + y) * stride + src_x * 3, copy_width);
+    }
+
+    pthread_mutex_lock(&kms->mutex);
+    if (kms->ready >= 0)
+    {
+        kms->replaced++;
+    }
+    kms->ready = index;
+    pthread_mutex_unlock(&kms->mutex);
+    eventcount_notify(&sink->ui_event);
+    return SINK_SUCCESS;
+}
+
+static void display_sink_kms_flipped(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec, \
+    void* user_data)
+{
+    DisplaySink_t* sink = (DisplaySink_t*)user_data;
+    DisplayKms_t* kms = sink->kms;
+    pthread_mutex_lock(&kms->mutex);
+    kms->scanned = kms->pending;
+    kms->pending = -1;
+    pthread_mutex_unlock(&kms->mutex);
+    sink->ui_shown++;
+}
+
+//wait for the queued flip's vblank, up to timeout_ms
+static void display_sink_kms_wait_flip(DisplaySink_t* sink, int timeout_ms)
+{
+    struct pollfd pfd;
+    pfd.fd = sink->kms->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, timeout_ms) > 0)
+    {
+        drmEventContext ctx;
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.version = 2;
+        ctx.page_flip_handler = display_sink_kms_flipped;
+        drmHandleEvent(sink->kms->fd, &ctx);
+    }
+}
+
+//the page flips: one is queued at a time, on the newest ready buffer, and the thread sleeps in the vblank wait
+//until it completed. with nothing queued it waits for present
+static void* display_sink_kms_function(void* arg)
+{
+    DisplaySink_t* sink = (DisplaySink_t*)arg;
+    DisplayKms_t* kms = sink->kms;
+    rt_thread_enter(RT_ROLE_DISPLAY, -1, "sink_kms");
+    while (sink->ui_running.load(std::memory_order_acquire))
+    {
+        uint32_t key = eventcount_prepare_wait(&sink->ui_event);
+        pthread_mutex_lock(&kms->mutex);
+        int pending = kms->pending;
+        int index = -1;
+        if (pending < 0 && kms->ready >= 0)
+        {
+            index = kms->ready;
+            kms->ready = -1;
+            kms->pending = index;
+        }
+        pthread_mutex_unlock(&kms->mutex);
+        if (index >= 0)
+        {
+            eventcount_cancel_wait(&sink->ui_event);
+            //a failed flip drops the frame, the next present brings another
+            if (drmModePageFlip(kms->fd, kms->crtc_id, kms->buffer[index].fb_id, DRM_MODE_PAGE_FLIP_EVENT, sink) != 0)
+            {
+                pthread_mutex_lock(&kms->mutex);
+                kms->pending = -1;
+                kms->flip_errors++;
+                pthread_mutex_unlock(&kms->mutex);
+            }
+        }
+        else if (pending >= 0)
+        {
+            eventcount_cancel_wait(&sink->ui_event);
+            display_sink_kms_wait_flip(sink, SINK_UI_INTERVAL_MS);
+        }
+        else
+        {
+            eventcount_wait(&sink->ui_event, key, NULL);
+        }
+    }
+    //the buffers are not taken off the screen with a flip still queued on one of them
+    if (kms->pending >= 0)
+    {
+        display_sink_kms_wait_flip(sink, 100);
+    }
+    rt_thread_leave();
+    return NULL;
+}
+
+static void display_sink_kms_close(DisplaySink_t* sink)
+{
+    if (sink->kms != NULL)
+    {
+        if (sink->kms->flip_errors != 0)
+        {
+            printf("display sink kms: %llu page flips failed\n", (unsigned long long)sink->kms->flip_errors);
+        }
+        display_sink_kms_destroy(sink->kms);
+        sink->kms = NULL;
+    }
+}
+#endif
+
+/*************************************** shm ***************************************/
+#if !defined(_WIN32)
+static uint8_t* display_shm_data(DisplayShmHeader_t* shm, int index)
+{
+    return (uint8_t*)shm + sizeof(DisplayShmHeader_t) + (size_t)index * shm->buffer_size;
+}
+
+static int display_sink_shm_open(DisplaySink_t* sink)
+{
+    uint32_t max_width = sink->param.shm_max_width ? sink->param.shm_max_width : SINK_SHM_DEFAULT_WIDTH;
+    uint32_t max_height = sink->param.shm_max_height ? sink->param.shm_max_height : SINK_SHM_DEFAULT_HEIGHT;
+    uint32_t buffer_size = max_width * max_height * 3;
+    const char* name = display_sink_path(sink, SINK_SHM_DEFAULT_NAME);
+    sink->shm_size = sizeof(DisplayShmHeader_t) + (size_t)SINK_SHM_BUFFERS * buffer_size;
+    sink->shm_fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (sink->shm_fd < 0 || ftruncate(sink->shm_fd, sink->shm_size) < 0)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    void* data = mmap(NULL, sink->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, sink->shm_fd, 0);
+    if (data == MAP_FAILED)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    //a reader of an older segment sees the magic cleared until the new one is set up
+    sink->shm = (DisplayShmHeader_t*)data;
+    sink->shm->magic = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < SINK_SHM_BUFFERS; i++)
+    {
+        sink->shm->buffer[i].seq.store(0, std::memory_order_relaxed);
+    }
+    sink->shm->version = SINK_SHM_VERSION;
+    sink->shm->buffer_size = buffer_size;
+    sink->shm->frame_pos.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    sink->shm->magic = SINK_SHM_MAGIC;
+    printf("display sink shm: %s up to %ux%u\n", name, max_width, max_height);
+    return SINK_SUCCESS;
+}
+
+static int display_sink_shm_present(DisplaySink_t* sink, const uint8_t* frame, int width, int height, int stride)
+{
+    DisplayShmHeader_t* shm = sink->shm;
+    uint32_t row_size = (uint32_t)width * 3;
+    if ((uint64_t)row_size * height > shm->buffer_size)
+    {
+        return SINK_ERROR_PARAM;
+    }
+    uint64_t pos = shm->frame_pos.load(std::memory_order_relaxed);
+    int index = (int)(pos % SINK_SHM_BUFFERS);
+    DisplayShmBuffer_t* buffer = &shm->buffer[index];
+    buffer->seq.store(2 * pos + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    uint8_t* dst = display_shm_data(shm, index);
+    for (int y = 0; y < height; y++)
+    {
+        memcpy(dst + (size_t)y * row_size, frame + (long)y * stride, row_size);
+    }
+    buffer->width = width;
+    buffer->height = height;
+    buffer->stride = row_size;
+    buffer->timestamp_us = get_monotonic_us();
+    buffer->seq.store(2 * pos + 2, std::memory_order_release);
+    shm->frame_pos.store(pos + 1, std::memory_order_release);
+    return SINK_SUCCESS;
+}
+
+static void display_sink_shm_close(DisplaySink_t* sink)
+{
+    if (sink->shm != NULL)
+    {
+        munmap(sink->shm, sink->shm_size);
+        sink->shm = NULL;
+        shm_unlink(display_sink_path(sink, SINK_SHM_DEFAULT_NAME));
+    }
+    if (sink->shm_fd >= 0)
+    {
+        close(sink->shm_fd);
+        sink->shm_fd = -1;
+    }
+}
+#endif
+
+/*************************************** sink ***************************************/
+int display_sink_open(DisplaySink_t* sink, const DisplaySinkParam_t* param)
+{
+    if (sink == NULL || param == NULL || param->type < 0 || param->type >= DISPLAY_SINK_NUM)
+    {
+        return SINK_ERROR_PARAM;
+    }
+    //value-initialized: zero, the atomics, the event count and the triple buffer included
+    new (sink) DisplaySink_t();
+    sink->param = *param;
+    sink->param.path[SINK_PATH_LEN - 1] = 0;
+    sink->fb_fd = -1;
+    sink->shm_fd = -1;
+
+    int rst = SINK_SUCCESS;
+    switch (param->type)
+    {
+    case DISPLAY_SINK_NULL:
+        break;
+    case DISPLAY_SINK_WINDOW:
+#ifdef DISPLAY_WINDOW
+        rst = display_sink_ui_open(sink, display_sink_window_function);
+#else
+        rst = SINK_ERROR_UNAVAILABLE;
+#endif
+        break;
+    case DISPLAY_SINK_FB:
+#if defined(__linux__)
+        rst = display_sink_fb_open(sink);
+        if (rst == SINK_SUCCESS)
+        {
+            rst = display_sink_ui_open(sink, display_sink_fb_function);
+        }
+#else
+        rst = SINK_ERROR_UNAVAILABLE;
+#endif
+        break;
+    case DISPLAY_SINK_SHM:
+#if !defined(_WIN32)
+        rst = display_sink_shm_open(sink);
+#else
+        rst = SINK_ERROR_UNAVAILABLE;
+#endif
+        break;
+    case DISPLAY_SINK_D3D11:
+#if defined(_WIN32)
+        rst = display_sink_ui_open(sink, display_sink_d3d11_function);
+#else
+        rst = SINK_ERROR_UNAVAILABLE;
+#endif
+        break;
+    case DISPLAY_SINK_GL:
+#if defined(DISPLAY_GL)
+        rst = display_sink_ui_open(sink, display_sink_gl_function);
+#else
+        rst = SINK_ERROR_UNAVAILABLE;
+#endif
+        break;
+    case DISPLAY_SINK_KMS:
+#if defined(DISPLAY_KMS)
+        rst = display_sink_kms_open(sink);
+        if (rst == SINK_SUCCESS)
+        {
+            rst = display_sink_ui_open(sink, display_sink_kms_function);
+        }
+#else
+        rst = SINK_ERROR_UNAVAILABLE;
+#endif
+        break;
+    default:
+        break;
+    }
+    if (rst != SINK_SUCCESS)
+    {
+        display_sink_close(sink);
+        return rst;
+    }
+    sink->opened = 1;
+    return SINK_SUCCESS;
+}
+
+int display_sink_present(DisplaySink_t* sink, const uint8_t* frame, int width, int height, int stride)
+{
+    if (sink == NULL || !sink->opened || frame == NULL || width <= 0 || height <= 0 || stride < width * 3)
+    {
+        return SINK_ERROR_PARAM;
+    }
+    int rst = SINK_SUCCESS;
+    switch (sink->param.type)
+    {
+#ifdef DISPLAY_WINDOW
+    case DISPLAY_SINK_WINDOW:
+        rst = display_sink_ui_present(sink, frame, width, height, stride);
+        break;
+#endif
+#if defined(_WIN32)
+    case DISPLAY_SINK_D3D11:
+        rst = display_sink_ui_present(sink, frame, width, height, stride);
+        break;
+#endif
+#if defined(DISPLAY_GL)
+    case DISPLAY_SINK_GL:
+        rst = display_sink_ui_present(sink, frame, width, height, stride);
+        break;
+#endif
+#if defined(__linux__)
+    case DISPLAY_SINK_FB:
+        rst = display_sink_ui_present(sink, frame, width, height, stride);
+        break;
+#endif
+#if defined(DISPLAY_KMS)
+    case DISPLAY_SINK_KMS:
+        rst = display_sink_kms_present(sink, frame, width, height, stride);
+        break;
+#endif
+#if !defined(_WIN32)
+    case DISPLAY_SINK_SHM:
+        rst = display_sink_shm_present(sink, frame, width, height, stride);
+        break;
+#endif
+    default:
+        break;
+    }
+    if (rst == SINK_SUCCESS)
+    {
+        sink->frames++;
+    }
+    else
+    {
+        sink->drops++;
+    }
+    return rst;
+}
+
+int display_sink_takes_raw(const DisplaySink_t* sink)
+{
+#if defined(DISPLAY_GL)
+    return sink != NULL && sink->opened && sink->param.type == DISPLAY_SINK_GL;
+#else
+    return 0;
+#endif
+}
+
+int display_sink_present_raw(DisplaySink_t* sink, const uint16_t* frame, int width, int height, int stride, \
+    const DisplaySinkRaw_t* raw)
+{
+    if (sink == NULL || !sink->opened || frame == NULL || raw == NULL || raw->lut == NULL || width < 2 || \
+        height < 2 || stride < width || (raw->map == COLORIZE_MAP_HIST_AGC && raw->agc_lut == NULL))
+    {
+        return SINK_ERROR_PARAM;
+    }
+    if (!display_sink_takes_raw(sink))
+    {
+        return SINK_ERROR_FORMAT;
+    }
+    int rst = SINK_ERROR_FORMAT;
+#if defined(DISPLAY_GL)
+    //the palette changes with the color mode and the isotherms, a compare per frame finds it
+    if (sink->lut == NULL)
+    {
+        sink->lut = (uint8_t*)malloc(COLOR_LUT_SIZE * 3);
+    }
+    if (sink->lut == NULL)
+    {
+        rst = SINK_ERROR_PARAM;
+    }
+    else
+    {
+        if (sink->lut_gen == 0 || memcmp(sink->lut, raw->lut, COLOR_LUT_SIZE * 3) != 0)
+        {
+            memcpy(sink->lut, raw->lut, COLOR_LUT_SIZE * 3);
+            sink->lut_gen++;
+        }
+        rst = display_sink_ui_present_raw(sink, frame, width, height, stride, raw);
+    }
+#endif
+    if (rst == SINK_SUCCESS)
+    {
+        sink->frames++;
+    }
+    else
+    {
+        sink->drops++;
+    }
+    return rst;
+}
+
+int display_sink_poll_key(DisplaySink_t* sink)
+{
+#ifdef SINK_UI_THREAD
+    if (sink != NULL && sink->opened && display_sink_is_ui(sink->param.type))
+    {
+        return display_sink_ui_poll_key(sink);
+    }
+#endif
+    return SINK_KEY_NONE;
+}
+
+void display_sink_close(DisplaySink_t* sink)
+{
+    if (sink == NULL)
+    {
+        return;
+    }
+#ifdef SINK_UI_THREAD
+    if (display_sink_is_threaded(sink->param.type))
+    {
+        display_sink_ui_close(sink);
+    }
+#endif
+#if defined(__linux__)
+    display_sink_fb_close(sink);
+#endif
+#if defined(DISPLAY_KMS)
+    display_sink_kms_close(sink);
+#endif
+#if !defined(_WIN32)
+    display_sink_shm_close(sink);
+#endif
+    free(sink->lut);
+    sink->lut = NULL;
+    sink->lut_gen = 0;
+    sink->opened = 0;
+}
+
+void display_sink_stats(const DisplaySink_t* sink, DisplaySinkStats_t* stats)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+    memset(stats, 0, sizeof(DisplaySinkStats_t));
+    if (sink == NULL)
+    {
+        return;
+    }
+    stats->presented = sink->frames + sink->drops;
+    stats->failed = sink->drops;
+    stats->shown = sink->frames;
+#ifdef SINK_UI_THREAD
+    if (display_sink_is_threaded(sink->param.type))
+    {
+        stats->shown = sink->ui_shown;
+        stats->replaced = sink->ui_buffer.replaced;
+    }
+#endif
+#if defined(DISPLAY_KMS)
+    if (sink->param.type == DISPLAY_SINK_KMS && sink->kms != NULL)
+    {
+        stats->replaced = sink->kms->replaced;
+    }
+#endif
+}
+
+/*************************************** shm reader ***************************************/
+#if !defined(_WIN32)
+int display_shm_reader_open(DisplayShmReader_t* reader, const char* shm_name)
+{
+    if (reader == NULL)
+    {
+        return SINK_ERROR_PARAM;
+    }
+    memset(reader, 0, sizeof(DisplayShmReader_t));
+    reader->shm_fd = shm_open((shm_name != NULL) ? shm_name : SINK_SHM_DEFAULT_NAME, O_RDONLY, 0);
+    if (reader->shm_fd < 0)
+    {
+        return SINK_ERROR_OPEN;
+    }
+    DisplayShmHeader_t header;
+    if (pread(reader->shm_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || \
+        header.magic != SINK_SHM_MAGIC || header.version != SINK_SHM_VERSION || header.buffer_size == 0)
+    {
+        close(reader->shm_fd);
+        reader->shm_fd = -1;
+        return SINK_ERROR_OPEN;
+    }
+    reader->shm_size = sizeof(DisplayShmHeader_t) + (size_t)SINK_SHM_BUFFERS * header.buffer_size;
+    void* data = mmap(NULL, reader->shm_size, PROT_READ, MAP_SHARED, reader->shm_fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close(reader->shm_fd);
+        reader->shm_fd = -1;
+        return SINK_ERROR_OPEN;
+    }
+    reader->shm = (DisplayShmHeader_t*)data;
+    return SINK_SUCCESS;
+}
+
+int display_shm_reader_frame(DisplayShmReader_t* reader, uint8_t* dst, int dst_size, int* width, int* height)
+{
+    if (reader == NULL || reader->shm == NULL || dst == NULL)
+    {
+        return SINK_ERROR_PARAM;
+    }
+    for (;;)
+    {
+        uint64_t frame_pos = reader->shm->frame_pos.load(std::memory_order_acquire);
+        if (frame_pos == 0 || frame_pos <= reader->frame_pos)
+        {
+            return SINK_EMPTY;
+        }
+        uint64_t pos = frame_pos - 1;
+        DisplayShmBuffer_t* buffer = &reader->shm->buffer[pos % SINK_SHM_BUFFERS];
+        uint64_t seq = buffer->seq.load(std::memory_order_acquire);
+        if (seq != 2 * pos + 2)
+        {
+            continue;
+        }
+        int frame_width = buffer->width;
+        int frame_height = buffer->height;
+        size_t frame_size = (size_t)buffer->stride * frame_height;
+        if (frame_size > (size_t)dst_size || frame_size > reader->shm->buffer_size)
+        {
+            return SINK_ERROR_PARAM;
+        }
+        memcpy(dst, (const void*)((const uint8_t*)reader->shm + sizeof(DisplayShmHeader_t) + \
+            (size_t)(pos % SINK_SHM_BUFFERS) * reader->shm->buffer_size), frame_size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        //the writer came back to this buffer while it was copied, take the newer frame
+        if (buffer->seq.load(std::memory_order_relaxed) != seq)
+        {
+            continue;
+        }
+        reader->frame_pos = frame_pos;
+        if (width != NULL)
+        {
+            *width = frame_width;
+        }
+        if (height != NULL)
+        {
+            *height = frame_height;
+        }
+        return SINK_SUCCESS;
+    }
+}
+
+void display_shm_reader_close(DisplayShmReader_t* reader)
+{
+    if (reader == NULL)
+    {
+        return;
+    }
+    if (reader->shm != NULL)
+    {
+        munmap(reader->shm, reader->shm_size);
+        reader->shm = NULL;
+    }
+    if (reader->shm_fd >= 0)
+    {
+        close(reader->shm_fd);
+        reader->shm_fd = -1;
+    }
+}
+#else
+int display_shm_reader_open(DisplayShmReader_t* reader, const char* shm_name)
+{
+    return SINK_ERROR_UNAVAILABLE;
+}
+
+int display_shm_reader_frame(DisplayShmReader_t* reader, uint8_t* dst, int dst_size, int* width, int* height)
+{
+    return SINK_ERROR_PARAM;
+}
+
+void display_shm_reader_close(DisplayShmReader_t* reader)
+{
+}
+#endif
@@ -0,0 +1,195 @@
+#ifndef _SINK_H_
+#define _SINK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <atomic>
+#include "sync.h"
+#include "queue.h"
+#include "colorize.h"
+#include "transform.h"
+#include "zoom.h"
+
+#define SINK_SUCCESS 0
+#define SINK_ERROR_PARAM -1
+#define SINK_ERROR_OPEN -2
+#define SINK_ERROR_UNAVAILABLE -3       //the sink is compiled out of this build (window in DISPLAY_HEADLESS, fb/shm off linux, d3d11 off windows, gl without DISPLAY_GL, kms without DISPLAY_KMS)
+#define SINK_ERROR_FORMAT -4            //framebuffer pixel format without a conversion
+#define SINK_EMPTY -5                   //shm reader: no frame since the last one read
+
+#define SINK_KEY_NONE -1
+#define SINK_KEY_QUEUE 16               //keys the ui thread holds for display_sink_poll_key, power of 2
+#define SINK_UI_INTERVAL_MS 16          //the window's events are pumped at least this often without new frames
+#define SINK_PATH_LEN 64
+#define SINK_FB_DEFAULT_PATH "/dev/fb0"
+#define SINK_KMS_DEFAULT_PATH "/dev/dri/card0"
+#define SINK_SHM_DEFAULT_NAME "/irsample_display"
+#define SINK_WINDOW_DEFAULT_TITLE "Test"
+#define SINK_SHM_DEFAULT_WIDTH 2048     //largest frame the shm buffers take, larger frames are dropped
+#define SINK_SHM_DEFAULT_HEIGHT 1536
+#define SINK_SHM_MAGIC 0x53445249       //"IRDS"
+#define SINK_SHM_VERSION 1
+#define SINK_SHM_BUFFERS 2
+#define SINK_GL_PBOS 2                  //upload buffers the gl sink cycles through, one is written while the gpu reads the other
+#define SINK_GL_BAR_MARGIN 10           //the color bar right of the frame, window pixels
+#define SINK_GL_BAR_WIDTH 20
+#define SINK_KMS_BUFFERS 3               //dumb buffers: one scanned out, one queued for the next vblank, one written
+
+typedef enum
+{
+    DISPLAY_SINK_NULL = 0,              //frames are rendered and dropped, for benchmarks and gateways
+    DISPLAY_SINK_WINDOW,                //opencv highgui window on its own ui thread, the only sink with key input
+    DISPLAY_SINK_FB,                    //linux fbdev, centered and clipped; drm drivers provide it through fbdev emulation
+    DISPLAY_SINK_SHM,                   //posix shared memory, double buffered for a local viewer or streamer
+    DISPLAY_SINK_D3D11,                 //windows: win32 window presented through a d3d11 swap chain, key input like window
+    DISPLAY_SINK_GL,                    //x11 window through egl and gles 3, takes Y14 frames and colors them in a shader
+    DISPLAY_SINK_KMS,                   //linux drm/kms without a desktop: dumb buffers scanned out, page flips on vblank
+    DISPLAY_SINK_NUM
+}DisplaySinkType_t;
+
+typedef struct {
+    DisplaySinkType_t type;
+    char path[SINK_PATH_LEN];           //window title, fb or drm device or shm name, empty selects the default
+    uint32_t shm_max_width;             //0 selects SINK_SHM_DEFAULT_xxx
+    uint32_t shm_max_height;
+}DisplaySinkParam_t;
+
+//shared memory: the header, then SINK_SHM_BUFFERS buffers of buffer_size bytes. frame n goes into buffer n % 2
+//whose seq is 2 * n + 1 while it is written and 2 * n + 2 once complete, so a reader has a whole frame
+//period to copy the newest frame before the writer comes back to its buffer
+typedef struct {
+    std::atomic<uint64_t> seq;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;                    //bytes per row, rows are packed BGR888
+    uint32_t reserved;
+    uint64_t timestamp_us;              //monotonic time of the present call
+    uint64_t reserved2[4];              //one cache line
+}DisplayShmBuffer_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t buffer_size;
+    uint32_t reserved;
+    std::atomic<uint64_t> frame_pos;    //frames published so far
+    uint64_t reserved2[5];
+    DisplayShmBuffer_t buffer[SINK_SHM_BUFFERS];
+}DisplayShmHeader_t;
+
+//a Y14/Y16 frame the sink colors itself: the lookups of its colorize plan, its mirror/rotate and the zoom view
+//the display would have resampled it with, the same mapping as the fused colorize path
+typedef struct {
+    const uint8_t* lut;                 //bgr lut of COLOR_LUT_SIZE entries, copied by present when it changed
+    const uint16_t* agc_lut;            //COLOR_LUT_SIZE entries with map COLORIZE_MAP_HIST_AGC, copied by present
+    int shift;
+    ColorizeMap_t map;
+    uint32_t lo;
+    uint32_t hi;
+    TransformMap_t transform;           //frame_transform_map_get of the frame, out size is the shown frame's
+    ZoomView_t zoom;                    //in source pixels, before the transform like display_image_process_zoom
+    uint8_t color_bar;                  //the palette's bar right of the frame
+    char caption[SINK_PATH_LEN];        //the fps and temperature line the overlay would draw, the window title
+}DisplaySinkRaw_t;
+
+typedef struct {
+    uint8_t* data;                      //packed BGR888, or the uint16 values of a raw frame
+    int width;
+    int height;
+    int size;                           //allocated bytes
+    uint8_t raw;                        //a display_sink_present_raw frame
+    DisplaySinkRaw_t raw_param;         //its lut and agc_lut point into lut and agc_lut below
+    uint8_t* lut;
+    uint16_t* agc_lut;
+    uint64_t lut_gen;                   //the sink's lut_gen when lut was copied
+}DisplaySinkFrame_t;
+
+struct DisplayKms_t;                    //sink.cpp, the libdrm state
+
+typedef struct {
+    DisplaySinkParam_t param;
+    uint8_t opened;
+    uint64_t frames;
+    uint64_t drops;                     //frames the sink could not take
+    //window/d3d11/fb: the sink's own thread owns the highgui or win32 window or writes the framebuffer, shows the
+    //newest frame and pumps the events. present copies into the back frame of a triple buffer and publishes it,
+    //processing never waits for the display and the display never queues
+    pthread_t ui_thread;
+    EventCount_t ui_event;              //present wakes the sink thread, no syscall while it is busy
+    std::atomic<uint8_t> ui_running;
+    uint8_t ui_started;
+    DisplaySinkFrame_t ui_frame[3];
+    TripleBuffer_t ui_buffer;           //back written by present, front shown by the sink thread
+    uint64_t ui_shown;                  //frames shown, the others were replaced before the sink thread got to them
+    std::atomic<uint32_t> key_head;     //single producer (ui thread), single consumer (poll_key)
+    std::atomic<uint32_t> key_tail;
+    int key[SINK_KEY_QUEUE];
+    //fb
+    int fb_fd;
+    uint8_t* fb_mem;
+    uint32_t fb_size;
+    uint32_t fb_page;                   //byte offset of the visible page in fb_mem
+    uint32_t fb_width;
+    uint32_t fb_height;
+    uint32_t fb_stride;
+    uint32_t fb_bpp;
+    uint8_t fb_offset[3];               //bit offset of blue, green, red
+    uint8_t fb_length[3];
+    //shm
+    int shm_fd;
+    DisplayShmHeader_t* shm;
+    size_t shm_size;
+    //kms: present writes the newest buffer, the sink thread flips to it
+    struct DisplayKms_t* kms;
+    //gl: the palette of the last raw frame, lut_gen moves when it changed
+    uint8_t* lut;
+    uint64_t lut_gen;
+}DisplaySink_t;
+
+typedef struct {
+    uint64_t presented;                 //frames handed to the sink
+    uint64_t shown;                     //drawn, written or published
+    uint64_t replaced;                  //dropped for display: a newer frame came before the sink thread took it
+    uint64_t failed;                    //the sink could not take them
+}DisplaySinkStats_t;
+
+int display_sink_open(DisplaySink_t* sink, const DisplaySinkParam_t* param);
+
+//hand one composed BGR888 frame to the sink, never waits for input or the window
+int display_sink_present(DisplaySink_t* sink, const uint8_t* frame, int width, int height, int stride);
+
+//the sink takes display_sink_present_raw frames
+int display_sink_takes_raw(const DisplaySink_t* sink);
+
+//hand one width x height Y14/Y16 frame (stride values per row) to a sink that colors it itself, 2 bytes per pixel
+//instead of 3. SINK_ERROR_FORMAT for the sinks that do not take raw frames
+int display_sink_present_raw(DisplaySink_t* sink, const uint16_t* frame, int width, int height, int stride, \
+    const DisplaySinkRaw_t* raw);
+
+//the oldest key the ui thread has seen or SINK_KEY_NONE, never waits
+int display_sink_poll_key(DisplaySink_t* sink);
+
+void display_sink_close(DisplaySink_t* sink);
+
+//counters of the sink, any thread, a read may be an increment behind
+void display_sink_stats(const DisplaySink_t* sink, DisplaySinkStats_t* stats);
+
+const char* display_sink_name(DisplaySinkType_t type);
+
+//local viewer of the shm sink
+typedef struct {
+    int shm_fd;
+    DisplayShmHeader_t* shm;
+    size_t shm_size;
+    uint64_t frame_pos;                 //frames seen, the next read waits for a newer one
+}DisplayShmReader_t;
+
+int display_shm_reader_open(DisplayShmReader_t* reader, const char* shm_name);
+
+//copy the newest frame as packed BGR888 rows into dst of dst_size bytes, SINK_EMPTY when there is none newer
+int display_shm_reader_frame(DisplayShmReader_t* reader, uint8_t* dst, int dst_size, int* width, int* height);
+
+void display_shm_reader_close(DisplayShmReader_t* reader);
+
+#endif
@@ -0,0 +1,766 @@
+#include "snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libiruvc.h"
+#include "cmdq.h"
+#include "prop.h"
+#include "tempspan.h"
+
+#define SNAPSHOT_TIFF_TAGS 12
+
+//absolute CLOCK_REALTIME deadline for pthread_cond_timedwait
+static void snapshot_deadline(struct timespec* ts, uint32_t timeout_ms)
+{
+#if defined(_WIN32)
+    timespec_get(ts, TIME_UTC);
+#elif defined(linux) || defined(unix)
+    clock_gettime(CLOCK_REALTIME, ts);
+#endif
+    ts->tv_sec += (time_t)(timeout_ms / 1000);
+    ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+//cmdq job: the module's calibration parameters, kept for the snapshots after it
+static int snapshot_meta_query(void* arg)
+{
+    Snapshot_t* snapshot = (Snapshot_t*)arg;
+    uint16_t values[5];
+    if (prop_tpd_get(TPD_PROP_GAIN_SEL, &values[0]) != IRUVC_SUCCESS || \
+        prop_tpd_get(TPD_PROP_EMS, &values[1]) != IRUVC_SUCCESS || \
+        prop_tpd_get(TPD_PROP_TAU, &values[2]) != IRUVC_SUCCESS || \
+        prop_tpd_get(TPD_PROP_TA, &values[3]) != IRUVC_SUCCESS || \
+        prop_tpd_get(TPD_PROP_TU, &values[4]) != IRUVC_SUCCESS)
+    {
+        return SNAPSHOT_ERROR_FRAME;
+    }
+    pthread_mutex_lock(&snapshot->mutex);
+    memcpy(snapshot->device, values, sizeof(values));
+    snapshot->device_valid = 1;
+    pthread_mutex_unlock(&snapshot->mutex);
+    return SNAPSHOT_SUCCESS;
+}
+
+static void snapshot_meta_done(int job_id, int result, void* user_data)
+{
+    Snapshot_t* snapshot = (Snapshot_t*)user_data;
+    pthread_mutex_lock(&snapshot->mutex);
+    snapshot->meta_pending = 0;
+    pthread_cond_broadcast(&snapshot->cond);
+    pthread_mutex_unlock(&snapshot->mutex);
+}
+
+//worker: ask the module for its parameters, a snapshot taken before the answer carries the last known ones
+static uint8_t snapshot_meta_refresh(Snapshot_t* snapshot, uint16_t device[5])
+{
+    pthread_mutex_lock(&snapshot->mutex);
+    if (!snapshot->meta_pending)
+    {
+        snapshot->meta_pending = 1;
+        snapshot->device_valid = 0;
+        if (cmdq_submit(snapshot_meta_query, snapshot, CMDQ_PRIORITY_READ, 0, snapshot_meta_done, snapshot, NULL) \
+            != CMDQ_SUCCESS)
+        {
+            snapshot->meta_pending = 0;
+        }
+    }
+    struct timespec deadline;
+    snapshot_deadline(&deadline, SNAPSHOT_META_TIMEOUT_MS);
+    while (snapshot->meta_pending && snapshot->running)
+    {
+        if (pthread_cond_timedwait(&snapshot->cond, &snapshot->mutex, &deadline) != 0)
+        {
+            break;
+        }
+    }
+    uint8_t valid = snapshot->device_valid;
+    memcpy(device, snapshot->device, 5 * sizeof(uint16_t));
+    pthread_mutex_unlock(&snapshot->mutex);
+    return valid;
+}
+
+int snapshot_color_frame(const Palette_t* palette, const FrameDesc_t* desc, InputFormat_t format, uint8_t* ycc, \
+    uint32_t* width, uint32_t* height)
+{
+    return snapshot_color_frame_zoom(palette, desc, format, NULL, NULL, ycc, width, height);
+}
+
+//what colors one frame row by row: its temp plane through the locked span's lut, its image plane through the
+//palette (zoomed through map), or else its temp plane stretched from low over range
+typedef struct {
+    const Palette_t* palette;
+    const TempSpan_t* span;
+    const FrameDesc_t* desc;
+    InputFormat_t format;
+    ZoomMap_t* map;
+    int image;
+    int zoomed;
+    uint16_t low;
+    uint32_t range;
+    uint32_t width;
+    uint32_t height;
+}SnapshotColor_t;
+
+static int snapshot_color_begin(SnapshotColor_t* color, const Palette_t* palette, const FrameDesc_t* desc, \
+    InputFormat_t format, const ZoomView_t* view, ZoomMap_t* map)
+{
+    memset(color, 0, sizeof(SnapshotColor_t));
+    color->palette = palette;
+    color->desc = desc;
+    color->format = format;
+    color->map = map;
+    //the temp plane in place of an image plane of its size, the callers sized their buffers for either
+    const FramePlane_t* temp = &desc->temp;
+    const FramePlane_t* image = &desc->image;
+    int temp_sized = (image->data == NULL || (image->width == temp->width && image->height == temp->height));
+    color->span = (palette != NULL && temp_sized && temp->data != NULL && temp->width > 0 && temp->height > 0) ? \
+        temp_span_get(palette, 0) : NULL;
+    if (color->span != NULL)
+    {
+        color->width = temp->width;
+        color->height = temp->height;
+        return 0;
+    }
+    int colorable = (format == INPUT_FMT_Y14 || format == INPUT_FMT_Y16 || format == INPUT_FMT_Y8 || \
+        format == INPUT_FMT_YUV422);
+    if (palette != NULL && colorable && image->data != NULL && image->width > 0 && image->height > 0)
+    {
+        color->image = 1;
+        color->width = image->width;
+        color->height = image->height;
+        color->zoomed = zoom_view_active(view) && map != NULL && (format == INPUT_FMT_Y14 || format == INPUT_FMT_Y16) && \
+            zoom_map_update(map, view, (int)image->width, (int)image->height, (int)(image->stride / 2)) == ZOOM_SUCCESS;
+        return 0;
+    }
+    if (palette == NULL || temp->data == NULL || temp->width == 0 || temp->height == 0)
+    {
+        return -1;
+    }
+    color->width = temp->width;
+    color->height = temp->height;
+    uint16_t low = 0xFFFF, high = 0;
+    for (uint32_t y = 0; y < temp->height; y++)
+    {
+        const uint16_t* src = (const uint16_t*)(temp->data + (size_t)y * temp->stride);
+        for (uint32_t x = 0; x < temp->width; x++)
+        {
+            low = (src[x] < low) ? src[x] : low;
+            high = (src[x] > high) ? src[x] : high;
+        }
+    }
+    color->low = low;
+    color->range = (high > low) ? high - low : 1;
+    return 0;
+}
+
+//row y into dst, 3 bytes per pixel
+static void snapshot_color_row(const SnapshotColor_t* color, uint32_t y, uint8_t* dst)
+{
+    const Palette_t* palette = color->palette;
+    if (color->span != NULL)
+    {
+        const FramePlane_t* temp = &color->desc->temp;
+        temp_span_map(color->span->yuv, (const uint16_t*)(temp->data + (size_t)y * temp->stride), (int)temp->width, dst);
+        return;
+    }
+    if (!color->image)
+    {
+        const FramePlane_t* temp = &color->desc->temp;
+        const uint16_t* src = (const uint16_t*)(temp->data + (size_t)y * temp->stride);
+        for (uint32_t x = 0; x < temp->width; x++)
+        {
+            const uint8_t* entry = palette->yuv + ((uint32_t)(src[x] - color->low) * (PALETTE_LUT_SIZE - 1) / \
+                color->range) * 3;
+            dst[x * 3] = entry[0];
+            dst[x * 3 + 1] = entry[1];
+            dst[x * 3 + 2] = entry[2];
+        }
+        return;
+    }
+    const FramePlane_t* image = &color->desc->image;
+    const uint8_t* src = image->data + (size_t)y * image->stride;
+    if (color->zoomed)
+    {
+        palette_map(palette->yuv, 3, zoom_map_line(color->map, (const uint16_t*)image->data, (int)y), \
+            (int)image->width, dst);
+    }
+    else if (color->format == INPUT_FMT_Y14 || color->format == INPUT_FMT_Y16)
+    {
+        palette_map(palette->yuv, 3, (const uint16_t*)src, (int)image->width, dst);
+    }
+    else if (color->format == INPUT_FMT_Y8)
+    {
+        palette_map8(palette->yuv, 3, src, (int)image->width, dst);
+    }
+    else
+    {
+        //already colored by the module, each yuyv pair shares its chroma
+        for (uint32_t x = 0; x + 1 < image->width; x += 2, src += 4, dst += 6)
+        {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[3];
+            dst[3] = src[2];
+            dst[4] = src[1];
+            dst[5] = src[3];
+        }
+    }
+}
+
+int snapshot_color_frame_zoom(const Palette_t* palette, const FrameDesc_t* desc, InputFormat_t format, \
+    const ZoomView_t* view, ZoomMap_t* map, uint8_t* ycc, uint32_t* width, uint32_t* height)
+{
+    SnapshotColor_t color;
+    if (snapshot_color_begin(&color, palette, desc, format, view, map) < 0)
+    {
+        return -1;
+    }
+    *width = color.width;
+    *height = color.height;
+    for (uint32_t y = 0; y < color.height; y++)
+    {
+        snapshot_color_row(&color, y, ycc + (size_t)y * color.width * 3);
+    }
+    return palette->color_mode;
+}
+
+int snapshot_color_frame_yuv420(const Palette_t* palette, const FrameDesc_t* desc, InputFormat_t format, \
+    const ZoomView_t* view, ZoomMap_t* map, uint8_t* data, uint8_t* rows, JpegYuv420_t* yuv)
+{
+    SnapshotColor_t color;
+    if (snapshot_color_begin(&color, palette, desc, format, view, map) < 0)
+    {
+        return -1;
+    }
+    jpeg_yuv420_planes(yuv, data, color.width, color.height);
+    uint32_t padded_width = yuv->stride[0];
+    uint32_t padded_height = (color.height + 15) & ~15u;
+    uint8_t* row[2] = { rows, rows + (size_t)padded_width * 3 };
+    //a row pair at a time: both colored into rows, the right edge repeated, then the luma and the 2x2 chroma
+    for (uint32_t y = 0; y < color.height; y += 2)
+    {
+        for (int r = 0; r < 2; r++)
+        {
+            uint32_t sy = (y + r < color.height) ? y + r : color.height - 1;
+            snapshot_color_row(&color, sy, row[r]);
+            for (uint32_t x = color.width; x < padded_width; x++)
+            {
+                memcpy(row[r] + x * 3, row[r] + (color.width - 1) * 3, 3);
+            }
+            uint8_t* luma = yuv->plane[0] + (size_t)(y + r) * yuv->stride[0];
+            for (uint32_t x = 0; x < padded_width; x++)
+            {
+                luma[x] = row[r][x * 3];
+            }
+        }
+        uint8_t* cb = yuv->plane[1] + (size_t)(y / 2) * yuv->stride[1];
+        uint8_t* cr = yuv->plane[2] + (size_t)(y / 2) * yuv->stride[2];
+        for (uint32_t x = 0; x < padded_width / 2; x++)
+        {
+            const uint8_t* a = row[0] + x * 6;
+            const uint8_t* b = row[1] + x * 6;
+            cb[x] = (uint8_t)((a[1] + a[4] + b[1] + b[4] + 2) >> 2);
+            cr[x] = (uint8_t)((a[2] + a[5] + b[2] + b[5] + 2) >> 2);
+        }
+    }
+    //the bottom padding repeats the last row of every plane
+    uint32_t luma_rows = (color.height + 1) & ~1u;
+    for (uint32_t y = luma_rows; y < padded_height; y++)
+    {
+        memcpy(yuv->plane[0] + (size_t)y * yuv->stride[0], yuv->plane[0] + (size_t)(luma_rows - 1) * yuv->stride[0], \
+            yuv->stride[0]);
+    }
+    for (int c = 1; c < 3; c++)
+    {
+        for (uint32_t y = luma_rows / 2; y < padded_height / 2; y++)
+        {
+            memcpy(yuv->plane[c] + (size_t)y * yuv->stride[c], yuv->plane[c] + (size_t)(luma_rows / 2 - 1) * \
+                yuv->stride[c], yuv->stride[c]);
+        }
+    }
+    return palette->color_mode;
+}
+
+//the meta, then the temp plane row by row
+static void snapshot_payload_copy(const SnapshotMeta_t* meta, const FramePlane_t* temp, uint8_t* dst)
+{
+    memcpy(dst, meta, sizeof(SnapshotMeta_t));
+    dst += sizeof(SnapshotMeta_t);
+    for (uint32_t y = 0; y < meta->temp_height; y++)
+    {
+        memcpy(dst, temp->data + (size_t)y * temp->stride, meta->temp_width * sizeof(uint16_t));
+        dst += meta->temp_width * sizeof(uint16_t);
+    }
+}
+
+//APP9 segments in place: the payload was copied in behind room for every segment's header and moves down
+//to its segment. returns the bytes used
+static uint32_t snapshot_jpeg_app(uint8_t* app, uint32_t payload_size)
+{
+    const uint32_t per_segment = JPEG_APP_MAX - SNAPSHOT_JPEG_ID_LEN;
+    uint32_t segment_num = (payload_size + per_segment - 1) / per_segment;
+    uint32_t overhead = 4 + SNAPSHOT_JPEG_ID_LEN;
+    const uint8_t* payload = app + segment_num * overhead;
+    uint8_t* p = app;
+    for (uint32_t i = 0; i < segment_num; i++)
+    {
+        uint32_t size = (payload_size - i * per_segment < per_segment) ? payload_size - i * per_segment : per_segment;
+        uint8_t* data = p + overhead;
+        memmove(data, payload + i * per_segment, size);
+        p[0] = 0xFF;
+        p[1] = SNAPSHOT_JPEG_MARKER;
+        p[2] = (uint8_t)((2 + SNAPSHOT_JPEG_ID_LEN + size) >> 8);
+        p[3] = (uint8_t)(2 + SNAPSHOT_JPEG_ID_LEN + size);
+        memcpy(p + 4, "IRTEMP", 7);
+        p[11] = (uint8_t)i;
+        p[12] = (uint8_t)segment_num;
+        p = data + size;
+    }
+    return (uint32_t)(p - app);
+}
+
+static uint32_t snapshot_app_bound(uint32_t temp_pix)
+{
+    uint32_t payload = sizeof(SnapshotMeta_t) + temp_pix * sizeof(uint16_t);
+    uint32_t segment_num = (payload + JPEG_APP_MAX - SNAPSHOT_JPEG_ID_LEN - 1) / (JPEG_APP_MAX - SNAPSHOT_JPEG_ID_LEN);
+    return segment_num * (4 + SNAPSHOT_JPEG_ID_LEN) + payload;
+}
+
+static uint8_t* snapshot_tiff_tag(uint8_t* p, uint16_t tag, uint16_t type, uint32_t count, uint32_t value)
+{
+    memcpy(p, &tag, 2);
+    memcpy(p + 2, &type, 2);
+    memcpy(p + 4, &count, 4);
+    memcpy(p + 8, &value, 4);
+    return p + 12;
+}
+
+//a little endian baseline tiff: header, one ifd, the description, the meta and the plane. returns its size
+static uint32_t snapshot_tiff_build(const SnapshotMeta_t* meta, const FramePlane_t* temp, uint8_t* dst)
+{
+    char text[192];
+    int text_len = snprintf(text, sizeof(text), "radiometric temp plane: celsius = value / %u - 273.15, " \
+        "gain %u ems %u tau %u ta %u tu %u%s", meta->temp_unit, meta->gain, meta->ems, meta->tau, meta->ta, meta->tu, \
+        (meta->flags & SNAPSHOT_META_DEVICE) ? "" : " (not read from the module)") + 1;
+    uint32_t ifd_size = 2 + SNAPSHOT_TIFF_TAGS * 12 + 4;
+    uint32_t text_offset = 8 + ifd_size;
+    uint32_t meta_offset = (text_offset + text_len + 3) / 4 * 4;
+    uint32_t data_offset = meta_offset + sizeof(SnapshotMeta_t);
+    uint32_t data_size = meta->temp_width * meta->temp_height * sizeof(uint16_t);
+
+    uint8_t* p = dst;
+    static const uint8_t header[4] = { 'I', 'I', 42, 0 };
+    memcpy(p, header, 4);
+    uint32_t ifd_offset = 8;
+    memcpy(p + 4, &ifd_offset, 4);
+    p += 8;
+    uint16_t tag_num = SNAPSHOT_TIFF_TAGS;
+    memcpy(p, &tag_num, 2);
+    p += 2;
+    //types: 2 ascii, 3 short, 4 long, 7 undefined. ascending tags
+    p = snapshot_tiff_tag(p, 256, 4, 1, meta->temp_width);
+    p = snapshot_tiff_tag(p, 257, 4, 1, meta->temp_height);
+    p = snapshot_tiff_tag(p, 258, 3, 1, 16);
+    p = snapshot_tiff_tag(p, 259, 3, 1, 1);
+    p = snapshot_tiff_tag(p, 262, 3, 1, 1);
+    p = snapshot_tiff_tag(p, 270, 2, (uint32_t)text_len, text_offset);
+    p = snapshot_tiff_tag(p, 273, 4, 1, data_offset);
+    p = snapshot_tiff_tag(p, 277, 3, 1, 1);
+    p = snapshot_tiff_tag(p, 278, 4, 1, meta->temp_height);
+    p = snapshot_tiff_tag(p, 279, 4, 1, data_size);
+    p = snapshot_tiff_tag(p, 339, 3, 1, 1);
+    p = snapshot_tiff_tag(p, SNAPSHOT_TIFF_TAG_META, 7, sizeof(SnapshotMeta_t), meta_offset);
+    memset(p, 0, 4);
+    memcpy(dst + text_offset, text, text_len);
+    memset(dst + text_offset + text_len, 0, meta_offset - text_offset - text_len);
+    snapshot_payload_copy(meta, temp, dst + meta_offset);
+    return data_offset + data_size;
+}
+
+static int snapshot_file_write(const char* path, const uint8_t* data, uint32_t size)
+{
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        return SNAPSHOT_ERROR_FILE;
+    }
+    int rst = (fwrite(data, 1, size, fp) == size) ? SNAPSHOT_SUCCESS : SNAPSHOT_ERROR_FILE;
+    if (fclose(fp) != 0)
+    {
+        rst = SNAPSHOT_ERROR_FILE;
+    }
+    return rst;
+}
+
+//worker: one request, the slot held only while the planes are colored and copied out
+static int snapshot_take(Snapshot_t* snapshot, const SnapshotRequest_t* request, uint64_t* hold_us)
+{
+    uint16_t device[5];
+    uint8_t device_valid = snapshot_meta_refresh(snapshot, device);
+    //the first palette_active builds the luts, not while a slot is held
+    const Palette_t* palette = palette_active();
+    FramePlane_t held;
+    memset(&held, 0, sizeof(FramePlane_t));
+    if (request->func != NULL)
+    {
+        int rst = request->func(request->arg, snapshot->plane_buf, snapshot->plane_capacity, &held.width, &held.height);
+        if (rst != SNAPSHOT_SUCCESS || held.width == 0 || held.height == 0 || \
+            held.width * held.height > snapshot->plane_capacity)
+        {
+            return SNAPSHOT_ERROR_FRAME;
+        }
+        held.data = (uint8_t*)snapshot->plane_buf;
+        held.stride = held.width * sizeof(uint16_t);
+        held.byte_size = held.stride * held.height;
+    }
+    FrameRing_t* ring = snapshot->stream_frame_info->frame_ring;
+    FrameSlot_t* slot = NULL;
+    //a held plane does not need the frame, only its metadata
+    uint32_t timeout_ms = ring_frame_timeout_ms(ring, (request->func != NULL) ? 100 : 1000);
+    if (ring_read_acquire(ring, snapshot->consumer_id, timeout_ms, &slot) != RING_SUCCESS)
+    {
+        slot = NULL;
+        if (request->func == NULL)
+        {
+            return SNAPSHOT_ERROR_FRAME;
+        }
+    }
+    uint64_t hold_start_us = get_monotonic_us();
+    FrameDesc_t desc;
+    memset(&desc, 0, sizeof(FrameDesc_t));
+    if (slot != NULL)
+    {
+        desc = slot->desc;
+    }
+    else
+    {
+        desc.timestamp_us = hold_start_us;
+    }
+    if (request->func != NULL)
+    {
+        //the held plane is made of valid frames, the frame's other plane is not what it shows
+        if (request->plane == SNAPSHOT_PLANE_TEMP)
+        {
+            desc.temp = held;
+            memset(&desc.image, 0, sizeof(FramePlane_t));
+        }
+        else
+        {
+            desc.image = held;
+            memset(&desc.temp, 0, sizeof(FramePlane_t));
+        }
+        desc.flags &= ~FRAME_DESC_TEMP_INVALID;
+    }
+    const FramePlane_t* temp = &desc.temp;
+    SnapshotMeta_t meta;
+    memset(&meta, 0, sizeof(SnapshotMeta_t));
+    meta.magic = SNAPSHOT_META_MAGIC;
+    meta.version = SNAPSHOT_VERSION;
+    meta.size = sizeof(SnapshotMeta_t);
+    meta.seq = desc.seq;
+    meta.timestamp_us = desc.timestamp_us;
+    struct timespec wall;
+    timespec_get(&wall, TIME_UTC);
+    meta.unix_us = (uint64_t)((int64_t)wall.tv_sec * 1000000 + wall.tv_nsec / 1000 - \
+        (int64_t)(hold_start_us - desc.timestamp_us));
+    if (temp->data != NULL)
+    {
+        meta.temp_width = (uint16_t)temp->width;
+        meta.temp_height = (uint16_t)temp->height;
+    }
+    meta.image_width = (uint16_t)desc.image.width;
+    meta.image_height = (uint16_t)desc.image.height;
+    meta.temp_unit = SNAPSHOT_TEMP_UNIT;
+    if (device_valid)
+    {
+        meta.gain = device[0];
+        meta.ems = device[1];
+        meta.tau = device[2];
+        meta.ta = device[3];
+        meta.tu = device[4];
+        meta.flags |= SNAPSHOT_META_DEVICE;
+    }
+    if (desc.flags & FRAME_DESC_META)
+    {
+        meta.vtemp = desc.meta.vtemp;
+        meta.flags |= SNAPSHOT_META_VTEMP;
+    }
+    if (desc.flags & FRAME_DESC_TEMP_INVALID)
+    {
+        meta.flags |= SNAPSHOT_META_TEMP_INVALID;
+    }
+    if (request->func != NULL)
+    {
+        meta.flags |= SNAPSHOT_META_PLANE;
+    }
+
+    int rst = SNAPSHOT_SUCCESS;
+    uint32_t width = 0, height = 0, size = 0;
+    if (request->format == SNAPSHOT_FORMAT_TIFF)
+    {
+        rst = (meta.temp_width > 0) ? rst : SNAPSHOT_ERROR_FRAME;
+        size = (rst == SNAPSHOT_SUCCESS) ? snapshot_tiff_build(&meta, temp, snapshot->app) : 0;
+    }
+    else
+    {
+        int color_mode = snapshot_color_frame(palette, &desc, \
+            snapshot->stream_frame_info->config->image_info.input_format, snapshot->ycc, &width, &height);
+        meta.color_mode = (uint16_t)((color_mode >= 0) ? color_mode : 0);
+        rst = (color_mode >= 0) ? rst : SNAPSHOT_ERROR_FRAME;
+        if (rst == SNAPSHOT_SUCCESS)
+        {
+            uint32_t payload_size = sizeof(SnapshotMeta_t) + meta.temp_width * meta.temp_height * sizeof(uint16_t);
+            uint32_t segment_num = (payload_size + JPEG_APP_MAX - SNAPSHOT_JPEG_ID_LEN - 1) / \
+                (JPEG_APP_MAX - SNAPSHOT_JPEG_ID_LEN);
+            snapshot_payload_copy(&meta, temp, snapshot->app + segment_num * (4 + SNAPSHOT_JPEG_ID_LEN));
+            size = payload_size;
+        }
+    }
+    if (slot != NULL)
+    {
+        ring_read_release(ring, slot);
+    }
+    *hold_us = get_monotonic_us() - hold_start_us;
+    if (rst != SNAPSHOT_SUCCESS)
+    {
+        return rst;
+    }
+
+    if (request->format == SNAPSHOT_FORMAT_TIFF)
+    {
+        return snapshot_file_write(request->path, snapshot->app, size);
+    }
+    uint32_t app_size = snapshot_jpeg_app(snapshot->app, size);
+    int file_size = jpeg_encode(&snapshot->jpeg, snapshot->ycc, width, height, snapshot->app, app_size, \
+        snapshot->file, snapshot->file_capacity);
+    if (file_size < 0)
+    {
+        return SNAPSHOT_ERROR_MEM;
+    }
+    return snapshot_file_write(request->path, snapshot->file, (uint32_t)file_size);
+}
+
+static void* snapshot_worker(void* threadarg)
+{
+    Snapshot_t* snapshot = (Snapshot_t*)threadarg;
+    pthread_mutex_lock(&snapshot->mutex);
+    while (1)
+    {
+        while (snapshot->running && snapshot->queue_num == 0)
+        {
+            pthread_cond_wait(&snapshot->cond, &snapshot->mutex);
+        }
+        if (!snapshot->running)
+        {
+            break;
+        }
+        SnapshotRequest_t request = snapshot->queue[snapshot->queue_head];
+        pthread_mutex_unlock(&snapshot->mutex);
+
+        uint64_t start_us = get_monotonic_us();
+        uint64_t hold_us = 0;
+        int rst = snapshot_take(snapshot, &request, &hold_us);
+        uint64_t encode_us = get_monotonic_us() - start_us - hold_us;
+        if (rst != SNAPSHOT_SUCCESS)
+        {
+            printf("snapshot: %s failed (%d)\n", request.path, rst);
+        }
+
+        pthread_mutex_lock(&snapshot->mutex);
+        snapshot->queue_head = (snapshot->queue_head + 1) % SNAPSHOT_QUEUE_LEN;
+        snapshot->queue_num--;
+        pthread_cond_broadcast(&snapshot->cond);
+        if (rst == SNAPSHOT_SUCCESS)
+        {
+            snapshot->stats.written++;
+        }
+        else
+        {
+            snapshot->stats.failed++;
+        }
+        snapshot->stats.hold_max_us = (hold_us > snapshot->stats.hold_max_us) ? hold_us : snapshot->stats.hold_max_us;
+        snapshot->stats.encode_max_us = (encode_us > snapshot->stats.encode_max_us) ? encode_us : \
+            snapshot->stats.encode_max_us;
+    }
+    pthread_mutex_unlock(&snapshot->mutex);
+    return NULL;
+}
+
+static void snapshot_buffers_free(Snapshot_t* snapshot)
+{
+    free(snapshot->ycc);
+    free(snapshot->app);
+    free(snapshot->file);
+    free(snapshot->plane_buf);
+    snapshot->ycc = NULL;
+    snapshot->app = NULL;
+    snapshot->file = NULL;
+    snapshot->plane_buf = NULL;
+}
+
+int snapshot_start(Snapshot_t* snapshot, StreamFrameInfo_t* stream_frame_info, int quality)
+{
+    if (snapshot == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL || \
+        stream_frame_info->config == NULL || quality < 0 || quality > 100)
+    {
+        return SNAPSHOT_ERROR_PARAM;
+    }
+    memset(snapshot, 0, sizeof(Snapshot_t));
+    snapshot->stream_frame_info = stream_frame_info;
+    jpeg_init(&snapshot->jpeg, (quality > 0) ? quality : JPEG_DEFAULT_QUALITY);
+    //the jpeg is the image plane or the temp plane, whichever is larger
+    const StreamConfig_t* config = stream_frame_info->config;
+    uint32_t image_pix = config->image_info.width * config->image_info.height;
+    uint32_t temp_pix = config->temp_info.width * config->temp_info.height;
+    uint32_t pix = (image_pix > temp_pix) ? image_pix : temp_pix;
+    uint32_t width = (image_pix > temp_pix) ? config->image_info.width : config->temp_info.width;
+    uint32_t height = (image_pix > temp_pix) ? config->image_info.height : config->temp_info.height;
+    uint32_t tiff_size = 8 + 2 + SNAPSHOT_TIFF_TAGS * 12 + 4 + 192 + 4 + sizeof(SnapshotMeta_t) + \
+        temp_pix * sizeof(uint16_t);
+    snapshot->app_capacity = snapshot_app_bound(temp_pix);
+    snapshot->app_capacity = (tiff_size > snapshot->app_capacity) ? tiff_size : snapshot->app_capacity;
+    snapshot->file_capacity = jpeg_bound(width, height, snapshot->app_capacity);
+    snapshot->ycc = (uint8_t*)malloc((size_t)pix * 3);
+    snapshot->app = (uint8_t*)malloc(snapshot->app_capacity);
+    snapshot->file = (uint8_t*)malloc(snapshot->file_capacity);
+    snapshot->plane_capacity = pix;
+    snapshot->plane_buf = (uint16_t*)malloc((size_t)pix * sizeof(uint16_t));
+    if (pix == 0 || snapshot->ycc == NULL || snapshot->app == NULL || snapshot->file == NULL || \
+        snapshot->plane_buf == NULL)
+    {
+        snapshot_buffers_free(snapshot);
+        return (pix == 0) ? SNAPSHOT_ERROR_PARAM : SNAPSHOT_ERROR_MEM;
+    }
+    //newest frame when asked for, nothing is read in between
+    snapshot->consumer_id = ring_consumer_attach(stream_frame_info->frame_ring, RING_POLICY_NEWEST);
+    if (snapshot->consumer_id < 0)
+    {
+        snapshot_buffers_free(snapshot);
+        return SNAPSHOT_ERROR_PARAM;
+    }
+    pthread_mutex_init(&snapshot->mutex, NULL);
+    pthread_cond_init(&snapshot->cond, NULL);
+    snapshot->running = 1;
+    if (pthread_create(&snapshot->worker, NULL, snapshot_worker, snapshot) != 0)
+    {
+        snapshot->running = 0;
+        ring_consumer_detach(stream_frame_info->frame_ring, snapshot->consumer_id);
+        snapshot_buffers_free(snapshot);
+        pthread_mutex_destroy(&snapshot->mutex);
+        pthread_cond_destroy(&snapshot->cond);
+        return SNAPSHOT_ERROR_MEM;
+    }
+    return SNAPSHOT_SUCCESS;
+}
+
+int snapshot_stop(Snapshot_t* snapshot)
+{
+    if (snapshot == NULL || snapshot->stream_frame_info == NULL)
+    {
+        return SNAPSHOT_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&snapshot->mutex);
+    if (!snapshot->running)
+    {
+        pthread_mutex_unlock(&snapshot->mutex);
+        return SNAPSHOT_ERROR_PARAM;
+    }
+    snapshot->running = 0;
+    pthread_cond_broadcast(&snapshot->cond);
+    pthread_mutex_unlock(&snapshot->mutex);
+    pthread_join(snapshot->worker, NULL);
+
+    //a meta query still out finishes against the mutex
+    pthread_mutex_lock(&snapshot->mutex);
+    while (snapshot->meta_pending)
+    {
+        pthread_cond_wait(&snapshot->cond, &snapshot->mutex);
+    }
+    pthread_mutex_unlock(&snapshot->mutex);
+    ring_consumer_detach(snapshot->stream_frame_info->frame_ring, snapshot->consumer_id);
+    snapshot_buffers_free(snapshot);
+    snapshot->stats.failed += snapshot->queue_num;
+    snapshot->queue_num = 0;
+    printf("snapshot: %llu written, %llu failed, %llu dropped, slot held %llu us at most\n", \
+        (unsigned long long)snapshot->stats.written, (unsigned long long)snapshot->stats.failed, \
+        (unsigned long long)snapshot->stats.dropped, (unsigned long long)snapshot->stats.hold_max_us);
+    return SNAPSHOT_SUCCESS;
+}
+
+int snapshot_request(Snapshot_t* snapshot, const char* path, SnapshotFormat_t format)
+{
+    return snapshot_request_plane(snapshot, path, format, SNAPSHOT_PLANE_TEMP, NULL, NULL);
+}
+
+int snapshot_request_plane(Snapshot_t* snapshot, const char* path, SnapshotFormat_t format, SnapshotPlane_t plane, \
+    SnapshotPlaneFunc_t func, void* arg)
+{
+    if (snapshot == NULL || path == NULL || strlen(path) >= SNAPSHOT_PATH_LEN || \
+        (format != SNAPSHOT_FORMAT_JPEG && format != SNAPSHOT_FORMAT_TIFF) || \
+        (plane != SNAPSHOT_PLANE_TEMP && plane != SNAPSHOT_PLANE_IMAGE))
+    {
+        return SNAPSHOT_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&snapshot->mutex);
+    if (!snapshot->running)
+    {
+        pthread_mutex_unlock(&snapshot->mutex);
+        return SNAPSHOT_ERROR_PARAM;
+    }
+    snapshot->stats.requested++;
+    if (snapshot->queue_num == SNAPSHOT_QUEUE_LEN)
+    {
+        snapshot->stats.dropped++;
+        pthread_mutex_unlock(&snapshot->mutex);
+        return SNAPSHOT_ERROR_FULL;
+    }
+    SnapshotRequest_t* request = &snapshot->queue[(snapshot->queue_head + snapshot->queue_num) % SNAPSHOT_QUEUE_LEN];
+    strcpy(request->path, path);
+    request->format = format;
+    request->plane = plane;
+    request->func = func;
+    request->arg = arg;
+    snapshot->queue_num++;
+    pthread_cond_broadcast(&snapshot->cond);
+    pthread_mutex_unlock(&snapshot->mutex);
+    return SNAPSHOT_SUCCESS;
+}
+
+int snapshot_flush(Snapshot_t* snapshot, uint32_t timeout_ms)
+{
+    if (snapshot == NULL || snapshot->stream_frame_info == NULL)
+    {
+        return SNAPSHOT_ERROR_PARAM;
+    }
+    struct timespec deadline;
+    snapshot_deadline(&deadline, timeout_ms);
+    pthread_mutex_lock(&snapshot->mutex);
+    while (snapshot->running && snapshot->queue_num > 0)
+    {
+        if (pthread_cond_timedwait(&snapshot->cond, &snapshot->mutex, &deadline) != 0)
+        {
+            break;
+        }
+    }
+    int rst = (snapshot->queue_num == 0) ? SNAPSHOT_SUCCESS : SNAPSHOT_ERROR_FULL;
+    pthread_mutex_unlock(&snapshot->mutex);
+    return rst;
+}
+
+int snapshot_stats(Snapshot_t* snapshot, SnapshotStats_t* stats)
+{
+    if (snapshot == NULL || stats == NULL)
+    {
+        return SNAPSHOT_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&snapshot->mutex);
+    *stats = snapshot->stats;
+    pthread_mutex_unlock(&snapshot->mutex);
+    return SNAPSHOT_SUCCESS;
+}
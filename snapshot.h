@@ -0,0 +1,156 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+#include "jpeg.h"
+#include "palette.h"
+#include "zoom.h"
+
+#define SNAPSHOT_QUEUE_LEN 8
+#define SNAPSHOT_PATH_LEN 256
+#define SNAPSHOT_META_MAGIC 0x4D535249  //"IRSM"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_JPEG_MARKER 0xE9       //APP9
+#define SNAPSHOT_JPEG_ID_LEN 9          //"IRTEMP\0", the segment index and the segment count
+#define SNAPSHOT_TIFF_TAG_META 65000    //private tag, UNDEFINED, the SnapshotMeta_t
+#define SNAPSHOT_META_TIMEOUT_MS 200    //wait for the module's parameters before taking the frame
+#define SNAPSHOT_TEMP_UNIT 64           //raw temp values per kelvin
+
+//SnapshotMeta_t flags
+#define SNAPSHOT_META_DEVICE 0x01       //gain..tu were read from the module for this snapshot
+#define SNAPSHOT_META_TEMP_INVALID 0x02 //FRAME_DESC_TEMP_INVALID: shutter, nuc or gain switch, temperatures are off
+#define SNAPSHOT_META_VTEMP 0x04        //vtemp is the frame's sensor temperature
+#define SNAPSHOT_META_PLANE 0x08        //a plane is the requester's (a hold image), not the frame's. seq and time are
+                                        //of the newest frame when it was taken, 0 and now without one
+
+#define SNAPSHOT_SUCCESS 0
+#define SNAPSHOT_ERROR_PARAM -1
+#define SNAPSHOT_ERROR_FULL -2          //SNAPSHOT_QUEUE_LEN requests are waiting
+#define SNAPSHOT_ERROR_MEM -3
+#define SNAPSHOT_ERROR_FILE -4
+#define SNAPSHOT_ERROR_FRAME -5         //no frame arrived, or it lacks the plane the format needs
+
+typedef enum
+{
+    SNAPSHOT_FORMAT_JPEG = 0,           //the palette colored image plane, the temp plane and the meta in APP9 segments
+    SNAPSHOT_FORMAT_TIFF,               //the temp plane as 16 bit gray, the meta in SNAPSHOT_TIFF_TAG_META
+}SnapshotFormat_t;
+
+//radiometric metadata of one snapshot, little endian. fields are only ever appended, size tells how many
+//celsius = temp value / SNAPSHOT_TEMP_UNIT - 273.15, before any correction of ems/tau/ta/tu
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;                      //sizeof(SnapshotMeta_t) of the writer
+    uint64_t seq;                       //ring sequence number of the frame
+    uint64_t timestamp_us;              //monotonic time the frame arrived
+    uint64_t unix_us;                   //the same as unix time
+    uint16_t temp_width;                //0 without a temp payload
+    uint16_t temp_height;
+    uint16_t image_width;
+    uint16_t image_height;
+    uint16_t temp_unit;                 //SNAPSHOT_TEMP_UNIT
+    uint16_t gain;                      //TPD_PROP_GAIN_SEL, with SNAPSHOT_META_DEVICE
+    uint16_t ems;                       //TPD_PROP_EMS, TAU, TA and TU as prop_tpd_get returns them
+    uint16_t tau;
+    uint16_t ta;
+    uint16_t tu;
+    uint16_t vtemp;                     //with SNAPSHOT_META_VTEMP
+    uint16_t color_mode;                //irproc_color_mode_t of the jpeg's palette
+    uint32_t flags;                     //SNAPSHOT_META_xxx
+    uint32_t reserved;
+}SnapshotMeta_t;
+
+typedef enum
+{
+    SNAPSHOT_PLANE_TEMP = 0,            //the tiff's plane, jpegs color it stretched over its range
+    SNAPSHOT_PLANE_IMAGE,               //colored through the palette, the frame's temp plane is left out
+}SnapshotPlane_t;
+
+//fill dst (capacity values, rows packed) with the plane to write in place of the frame's, on the worker before it
+//takes the frame. returns SNAPSHOT_SUCCESS with the plane's size
+typedef int (*SnapshotPlaneFunc_t)(void* arg, uint16_t* dst, uint32_t capacity, uint32_t* width, uint32_t* height);
+
+typedef struct {
+    char path[SNAPSHOT_PATH_LEN];
+    SnapshotFormat_t format;
+    SnapshotPlane_t plane;
+    SnapshotPlaneFunc_t func;           //NULL writes the frame as it is
+    void* arg;
+}SnapshotRequest_t;
+
+typedef struct {
+    uint64_t requested;
+    uint64_t written;
+    uint64_t failed;
+    uint64_t dropped;                   //requests refused with SNAPSHOT_ERROR_FULL
+    uint64_t hold_max_us;               //longest a ring slot was held, the frame is never copied to be kept
+    uint64_t encode_max_us;             //slowest encode and write
+}SnapshotStats_t;
+
+//a worker thread turning requests into files: it takes the newest frame of the ring as a held slot,
+//colors and copies out what the file needs, releases the slot and encodes and writes on its own time.
+//the stream, display and temperature threads never wait on it
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    int consumer_id;
+    uint8_t running;
+    JpegEncoder_t jpeg;
+    SnapshotRequest_t queue[SNAPSHOT_QUEUE_LEN];
+    uint32_t queue_head;                //next request, queue_num of them waiting
+    uint32_t queue_num;
+    uint8_t* ycc;                       //the colored image plane, 3 bytes per pixel
+    uint8_t* app;                       //the jpeg's APP9 segments, or the whole tiff
+    uint32_t app_capacity;
+    uint8_t* file;                      //the jpeg
+    uint32_t file_capacity;
+    uint16_t* plane_buf;                //what a request's func fills, the larger plane of the stream
+    uint32_t plane_capacity;
+    uint16_t device[5];                 //gain, ems, tau, ta, tu as last read
+    uint8_t device_valid;
+    uint8_t meta_pending;               //a cmdq query is out
+    SnapshotStats_t stats;
+    pthread_t worker;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+}Snapshot_t;
+
+//attach to the camera's frame ring and start the worker, jpegs at quality 1..100 (0 selects JPEG_DEFAULT_QUALITY)
+int snapshot_start(Snapshot_t* snapshot, StreamFrameInfo_t* stream_frame_info, int quality);
+
+//requests still waiting are dropped
+int snapshot_stop(Snapshot_t* snapshot);
+
+//queue a snapshot of the newest frame into path, returns at once. SNAPSHOT_ERROR_FULL when the queue is full
+int snapshot_request(Snapshot_t* snapshot, const char* path, SnapshotFormat_t format);
+
+//snapshot_request with func's plane in place of the frame's, with the newest frame's metadata. arg stays the
+//caller's until the snapshot is stopped. the file is written without a frame to take when the stream ended
+int snapshot_request_plane(Snapshot_t* snapshot, const char* path, SnapshotFormat_t format, SnapshotPlane_t plane, \
+    SnapshotPlaneFunc_t func, void* arg);
+
+//wait until the requests queued so far are written, SNAPSHOT_ERROR_FULL when some still wait after timeout_ms
+int snapshot_flush(Snapshot_t* snapshot, uint32_t timeout_ms);
+
+int snapshot_stats(Snapshot_t* snapshot, SnapshotStats_t* stats);
+
+//the frame's image plane through the palette's yuv lut into ycc (3 bytes per pixel), a plane the palette can not
+//take gives the temp plane stretched over its range, a locked span (tempspan.h) the temp plane through the span's
+//lut unzoomed. the jpegs' colors, for every module that shows a frame. returns the palette's mode, -1 when there is nothing to color
+int snapshot_color_frame(const Palette_t* palette, const FrameDesc_t* desc, InputFormat_t format, uint8_t* ycc, \
+    uint32_t* width, uint32_t* height);
+
+//snapshot_color_frame of a zoomed view: a Y14/Y16 image plane is resampled row by row through map (updated for
+//view and the plane) as it is colored, the other planes are colored in full. view NULL or x1 is the full frame
+int snapshot_color_frame_zoom(const Palette_t* palette, const FrameDesc_t* desc, InputFormat_t format, \
+    const ZoomView_t* view, ZoomMap_t* map, uint8_t* ycc, uint32_t* width, uint32_t* height);
+
+//snapshot_color_frame_zoom into the padded 4:2:0 planes jpeg_encode_yuv420 takes, laid out in data
+//(jpeg_yuv420_size of the plane). rows holds two colored rows, (width + 15) * 6 bytes, each 2x2 block averages
+//its chroma
+int snapshot_color_frame_yuv420(const Palette_t* palette, const FrameDesc_t* desc, InputFormat_t format, \
+    const ZoomView_t* view, ZoomMap_t* map, uint8_t* data, uint8_t* rows, JpegYuv420_t* yuv);
+
+#endif
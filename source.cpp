@@ -0,0 +1,427 @@
+#include "source.h"
+#include <stdlib.h>
+#include <string.h>
+#include "thermal_cam_cmd.h"
+#include "rtsched.h"
+#include "tempunit.h"
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <time.h>
+#include <errno.h>
+#endif
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+#endif
+
+#define SOURCE_VOSPI_MODE 8             //PreviewStartParam_t mode VOSPI_MODE
+#define SOURCE_SPIDEV_BUFSIZ 4096       //spidev's default transfer limit, /sys/module/spidev/parameters/bufsiz
+#define SOURCE_PAGE_SIZE 4096
+
+static const char* frame_source_names[] = { "uvc", "replay", "synth", "vospi" };
+
+static void source_sleep_until(uint64_t target_us)
+{
+    uint64_t now_us = get_monotonic_us();
+    if (target_us <= now_us)
+    {
+        return;
+    }
+#if defined(_WIN32)
+    Sleep((DWORD)((target_us - now_us + 999) / 1000));
+#else
+    uint64_t wait_us = target_us - now_us;
+    struct timespec wait_time = { (time_t)(wait_us / 1000000), (long)(wait_us % 1000000) * 1000 };
+    while (nanosleep(&wait_time, &wait_time) != 0 && errno == EINTR)
+    {
+    }
+#endif
+    //a timer wakeup: how late the thread runs after the deadline
+    rt_wakeup_record_since(target_us);
+}
+
+#if defined(__linux__)
+static uint32_t source_spidev_bufsiz(void)
+{
+    uint32_t bufsiz = SOURCE_SPIDEV_BUFSIZ;
+    FILE* fp = fopen("/sys/module/spidev/parameters/bufsiz", "r");
+    if (fp != NULL)
+    {
+        if (fscanf(fp, "%u", &bufsiz) != 1 || bufsiz == 0)
+        {
+            bufsiz = SOURCE_SPIDEV_BUFSIZ;
+        }
+        fclose(fp);
+    }
+    return bufsiz;
+}
+
+//ccitt crc16 of a packet, the id's top nibble and the crc field count as zero
+static uint16_t source_vospi_crc(const uint8_t* packet, uint32_t size)
+{
+    uint16_t crc = 0;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        uint8_t byte = (i == 0) ? (packet[0] & 0x0F) : ((i == 2 || i == 3) ? 0 : packet[i]);
+        crc ^= (uint16_t)(byte << 8);
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+//i2c carries the vendor commands from here on, the sensor streams its 16 bit lines on the spi port
+static int source_vospi_open(FrameSource_t* source)
+{
+    FrameSourceParam_t* param = &source->param;
+    if (param->spi_device[0] == 0)
+    {
+        strcpy(param->spi_device, SOURCE_DEFAULT_SPI_DEVICE);
+    }
+    if (param->i2c_device[0] == 0)
+    {
+        strcpy(param->i2c_device, SOURCE_DEFAULT_I2C_DEVICE);
+    }
+    if (param->spi_speed_hz == 0)
+    {
+        param->spi_speed_hz = SOURCE_DEFAULT_SPI_HZ;
+    }
+    if (register_i2c_device_node(param->i2c_device) != IRUVC_SUCCESS || \
+        vdcmd_init_by_type(VDCMD_I2C_VDCMD) != IRUVC_SUCCESS)
+    {
+        printf("frame source: no i2c control on %s\n", param->i2c_device);
+        return SOURCE_ERROR_OPEN;
+    }
+    set_vospi_y8_mode(0);
+
+    source->spi_fd = open(param->spi_device, O_RDWR);
+    if (source->spi_fd < 0)
+    {
+        printf("frame source: can not open %s\n", param->spi_device);
+        return SOURCE_ERROR_OPEN;
+    }
+    uint8_t mode = SPI_MODE_3;
+    uint8_t bits = 8;
+    if (ioctl(source->spi_fd, SPI_IOC_WR_MODE, &mode) < 0 || ioctl(source->spi_fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 || \
+        ioctl(source->spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &param->spi_speed_hz) < 0)
+    {
+        close(source->spi_fd);
+        source->spi_fd = -1;
+        return SOURCE_ERROR_OPEN;
+    }
+
+    //whole packets per transfer, so every transfer starts on a packet
+    source->packet_size = SOURCE_VOSPI_HEADER + param->width * 2;
+    uint32_t packets = source_spidev_bufsiz() / source->packet_size;
+    packets = (packets > 0) ? packets : 1;
+    void* buf = NULL;
+    if (posix_memalign(&buf, SOURCE_PAGE_SIZE, (size_t)packets * source->packet_size) != 0)
+    {
+        close(source->spi_fd);
+        source->spi_fd = -1;
+        return SOURCE_ERROR_PARAM;
+    }
+    source->spi_buf = (uint8_t*)buf;
+    source->spi_packets = packets;
+    source->spi_pos = packets;
+
+    if (i2c_start_stream(PREVIEW_PATH0, 0, (uint16_t)param->width, (uint16_t)param->height, (uint8_t)param->fps, \
+        SOURCE_VOSPI_MODE) < 0)
+    {
+        printf("frame source: i2c_start_stream failed\n");
+        free(source->spi_buf);
+        source->spi_buf = NULL;
+        close(source->spi_fd);
+        source->spi_fd = -1;
+        return SOURCE_ERROR_OPEN;
+    }
+    return SOURCE_SUCCESS;
+}
+
+//the lines of one frame in order, a missing or damaged line waits for the next frame's line 0
+static int source_vospi_frame(FrameSource_t* source, uint8_t* raw_frame)
+{
+    uint32_t line_bytes = source->param.width * 2;
+    uint32_t lines = source->param.height;
+    uint32_t transfer_size = source->spi_packets * source->packet_size;
+    uint32_t next_line = 0;
+    uint64_t deadline_us = get_monotonic_us() + SOURCE_VOSPI_TIMEOUT_MS * 1000;
+    while (next_line < lines)
+    {
+        if (source->spi_pos >= source->spi_packets)
+        {
+            if (get_monotonic_us() > deadline_us)
+            {
+                return SOURCE_ERROR_TIMEOUT;
+            }
+            struct spi_ioc_transfer transfer;
+            memset(&transfer, 0, sizeof(transfer));
+            transfer.rx_buf = (uintptr_t)source->spi_buf;
+            transfer.len = transfer_size;
+            transfer.speed_hz = source->param.spi_speed_hz;
+            transfer.bits_per_word = 8;
+            if (ioctl(source->spi_fd, SPI_IOC_MESSAGE(1), &transfer) < 0)
+            {
+                return SOURCE_ERROR_OPEN;
+            }
+            source->spi_pos = 0;
+        }
+        const uint8_t* packet = source->spi_buf + source->spi_pos * source->packet_size;
+        source->spi_pos++;
+        uint16_t id = (uint16_t)((packet[0] << 8) | packet[1]);
+        if ((id & 0x0F00) == 0x0F00)
+        {
+            continue;
+        }
+        uint16_t crc = (uint16_t)((packet[2] << 8) | packet[3]);
+        if (source_vospi_crc(packet, source->packet_size) != crc)
+        {
+            source->crc_errors++;
+            next_line = 0;
+            continue;
+        }
+        uint32_t line = id & 0x0FFF;
+        if (line != next_line)
+        {
+            if (next_line > 0)
+            {
+                source->resyncs++;
+            }
+            next_line = 0;
+            if (line != 0)
+            {
+                continue;
+            }
+        }
+        memcpy(raw_frame + (size_t)line * line_bytes, packet + SOURCE_VOSPI_HEADER, line_bytes);
+        next_line++;
+    }
+    return SOURCE_SUCCESS;
+}
+
+static void source_vospi_close(FrameSource_t* source)
+{
+    if (source->spi_fd >= 0)
+    {
+        i2c_stop_stream(PREVIEW_PATH0);
+        close(source->spi_fd);
+    }
+    free(source->spi_buf);
+    source->spi_buf = NULL;
+    source->spi_fd = -1;
+}
+#else
+static int source_vospi_open(FrameSource_t* source)
+{
+    return SOURCE_ERROR_UNAVAILABLE;
+}
+
+static int source_vospi_frame(FrameSource_t* source, uint8_t* raw_frame)
+{
+    return SOURCE_ERROR_UNAVAILABLE;
+}
+
+static void source_vospi_close(FrameSource_t* source)
+{
+}
+#endif
+
+int frame_source_open(FrameSource_t* source, const FrameSourceParam_t* param)
+{
+    if (source == NULL || param == NULL || param->type > FRAME_SOURCE_VOSPI)
+    {
+        return SOURCE_ERROR_PARAM;
+    }
+    memset(source, 0, sizeof(FrameSource_t));
+    source->param = *param;
+    source->seed = 12345;
+    source->spi_fd = -1;
+    if (param->type == FRAME_SOURCE_REPLAY)
+    {
+        int rst = record_reader_open(&source->reader, param->path);
+        if (rst != RECORD_SUCCESS)
+        {
+            printf("frame source: can not replay %s (%d)\n", param->path, rst);
+            return (rst == RECORD_ERROR_FILE) ? SOURCE_ERROR_OPEN : SOURCE_ERROR_FORMAT;
+        }
+        source->image_byte_size = source->reader.header.image_byte_size;
+        source->temp_byte_size = source->reader.header.temp_byte_size;
+    }
+    else if (param->type == FRAME_SOURCE_SYNTH || param->type == FRAME_SOURCE_VOSPI)
+    {
+        if (source->param.width == 0)
+        {
+            source->param.width = SOURCE_DEFAULT_WIDTH;
+        }
+        if (source->param.height == 0)
+        {
+            source->param.height = SOURCE_DEFAULT_HEIGHT;
+        }
+        if (source->param.fps == 0)
+        {
+            source->param.fps = SOURCE_DEFAULT_FPS;
+        }
+        if (source->param.height % 2 != 0)
+        {
+            return SOURCE_ERROR_PARAM;
+        }
+        source->image_byte_size = source->param.width * source->param.height;
+        source->temp_byte_size = source->image_byte_size;
+        if (param->type == FRAME_SOURCE_VOSPI)
+        {
+            return source_vospi_open(source);
+        }
+    }
+    return SOURCE_SUCCESS;
+}
+
+int frame_source_camera_param(FrameSource_t* source, CameraParam_t* camera_param)
+{
+    if (source == NULL || camera_param == NULL)
+    {
+        return SOURCE_ERROR_PARAM;
+    }
+    if (source->param.type == FRAME_SOURCE_REPLAY)
+    {
+        RecordFileHeader_t* header = &source->reader.header;
+        camera_param->width = (header->image_byte_size > 0) ? header->image_width : header->temp_width;
+        camera_param->height = ((header->image_byte_size > 0) ? header->image_height : 0) + \
+            ((header->temp_byte_size > 0) ? header->temp_height : 0);
+        camera_param->fps = (header->fps > 0) ? header->fps : SOURCE_DEFAULT_FPS;
+        camera_param->frame_size = header->image_byte_size + header->temp_byte_size;
+        camera_param->timeout_ms_delay = 1000;
+    }
+    else if (source->param.type == FRAME_SOURCE_SYNTH || source->param.type == FRAME_SOURCE_VOSPI)
+    {
+        camera_param->width = source->param.width;
+        camera_param->height = source->param.height;
+        camera_param->fps = source->param.fps;
+        camera_param->frame_size = source->param.width * source->param.height * 2;
+        camera_param->timeout_ms_delay = 1000;
+    }
+    return SOURCE_SUCCESS;
+}
+
+//background around 22C with a warm 34C blob circling the frame, temp in 1/64 K and the image derived from it
+static void source_synth_frame(FrameSource_t* source, uint8_t* raw_frame)
+{
+    int width = (int)source->param.width;
+    int height = (int)source->param.height / 2;
+    uint16_t* image = (uint16_t*)raw_frame;
+    uint16_t* temp = image + width * height;
+    int step = (int)(source->frame_cnt % 200);
+    int cx = width / 4 + ((step < 100) ? step : 200 - step) * width / 200;
+    int cy = height / 2;
+    int r = height / 4;
+    uint32_t seed = source->seed;
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            seed = seed * 1103515245 + 12345;
+            int noise = (int)((seed >> 16) % 41) - 20;
+            int inside = (x - cx) * (x - cx) + (y - cy) * (y - cy) < r * r;
+            int value = TEMP_RAW_OF_CELSIUS(inside ? 34.0 : 22.0) + y + noise;
+            temp[y * width + x] = (uint16_t)value;
+            int image_value = (value - 17000) * 16;
+            image[y * width + x] = (uint16_t)((image_value < 0) ? 0 : ((image_value > 65535) ? 65535 : image_value));
+        }
+    }
+    source->seed = seed;
+}
+
+static int source_replay_frame(FrameSource_t* source, uint8_t* raw_frame, uint64_t* timestamp_us)
+{
+    RecordFrameMeta_t meta;
+    int rst = record_reader_next(&source->reader, &meta, raw_frame, raw_frame + source->image_byte_size);
+    if (rst == RECORD_END && source->param.loop && source->frame_cnt > 0)
+    {
+        //the pacing clock starts over with the first frame
+        record_reader_seek(&source->reader, 0);
+        source->frame_cnt = 0;
+        rst = record_reader_next(&source->reader, &meta, raw_frame, raw_frame + source->image_byte_size);
+    }
+    if (rst == RECORD_END)
+    {
+        return SOURCE_END;
+    }
+    if (rst != RECORD_SUCCESS)
+    {
+        return SOURCE_ERROR_FORMAT;
+    }
+    *timestamp_us = meta.timestamp_us;
+    return SOURCE_SUCCESS;
+}
+
+int frame_source_get(FrameSource_t* source, uint8_t* raw_frame)
+{
+    if (source == NULL || raw_frame == NULL)
+    {
+        return SOURCE_ERROR_PARAM;
+    }
+    if (source->param.type == FRAME_SOURCE_UVC)
+    {
+        return uvc_frame_get(raw_frame);
+    }
+    if (source->param.type == FRAME_SOURCE_VOSPI)
+    {
+        return source_vospi_frame(source, raw_frame);
+    }
+
+    uint64_t due_us = 0;
+    if (source->param.type == FRAME_SOURCE_REPLAY)
+    {
+        uint64_t timestamp_us = 0;
+        int rst = source_replay_frame(source, raw_frame, &timestamp_us);
+        if (rst != SOURCE_SUCCESS)
+        {
+            return rst;
+        }
+        if (source->frame_cnt == 0)
+        {
+            source->first_timestamp_us = timestamp_us;
+        }
+        due_us = (timestamp_us > source->first_timestamp_us) ? timestamp_us - source->first_timestamp_us : 0;
+    }
+    else
+    {
+        source_synth_frame(source, raw_frame);
+        due_us = source->frame_cnt * 1000000 / source->param.fps;
+    }
+    if (source->frame_cnt == 0)
+    {
+        source->start_us = get_monotonic_us();
+    }
+    source->frame_cnt++;
+    if (source->param.paced)
+    {
+        source_sleep_until(source->start_us + due_us);
+    }
+    return SOURCE_SUCCESS;
+}
+
+void frame_source_close(FrameSource_t* source)
+{
+    if (source == NULL)
+    {
+        return;
+    }
+    if (source->param.type == FRAME_SOURCE_REPLAY)
+    {
+        record_reader_close(&source->reader);
+    }
+    else if (source->param.type == FRAME_SOURCE_VOSPI)
+    {
+        source_vospi_close(source);
+    }
+}
+
+const char* frame_source_name(FrameSourceType_t type)
+{
+    return (type <= FRAME_SOURCE_VOSPI) ? frame_source_names[type] : "unknown";
+}
@@ -0,0 +1,80 @@
+#ifndef _SOURCE_H_
+#define _SOURCE_H_
+
+#include <stdint.h>
+#include "libiruvc.h"
+#include "record.h"
+
+#define SOURCE_DEFAULT_WIDTH 256
+#define SOURCE_DEFAULT_HEIGHT 384       //raw frame rows: the image half, then the temp half
+#define SOURCE_DEFAULT_FPS 25
+#define SOURCE_DEVICE_LEN 64
+#define SOURCE_DEFAULT_SPI_DEVICE "/dev/spidev0.0"
+#define SOURCE_DEFAULT_I2C_DEVICE "/dev/i2c-1"
+#define SOURCE_DEFAULT_SPI_HZ 20000000
+#define SOURCE_VOSPI_HEADER 4           //in front of each line: big endian id (line number, 0x0Fxx discard) and crc16
+#define SOURCE_VOSPI_TIMEOUT_MS 1000    //no complete frame within this is an error, as uvc_frame_get's timeout
+
+#define SOURCE_SUCCESS 0
+#define SOURCE_ERROR_PARAM -1
+#define SOURCE_ERROR_OPEN -2
+#define SOURCE_ERROR_FORMAT -3          //the recording's planes do not make a raw frame of the stream
+#define SOURCE_END -4                   //a replay without loop played its last frame
+#define SOURCE_ERROR_TIMEOUT -5         //vospi: no complete frame in SOURCE_VOSPI_TIMEOUT_MS
+#define SOURCE_ERROR_UNAVAILABLE -6     //vospi is linux only
+
+typedef enum
+{
+    FRAME_SOURCE_UVC = 0,               //uvc_frame_get of the open camera
+    FRAME_SOURCE_REPLAY,                //a recording of record.h
+    FRAME_SOURCE_SYNTH,                 //a generated scene, no file and no camera
+    FRAME_SOURCE_VOSPI,                 //lines over spi, commands over i2c: boards where usb is the bottleneck
+}FrameSourceType_t;
+
+typedef struct {
+    FrameSourceType_t type;
+    char path[RECORD_PATH_LEN];         //replay
+    uint8_t paced;                      //replay at the recorded times, synth at fps. 0 as fast as frames are taken
+    uint8_t loop;                       //replay: start over after the last frame
+    uint32_t width;                     //synth/vospi: raw frame size and rate, 0 selects SOURCE_DEFAULT_xxx
+    uint32_t height;
+    uint32_t fps;
+    char spi_device[SOURCE_DEVICE_LEN]; //vospi, empty selects SOURCE_DEFAULT_SPI_DEVICE/I2C_DEVICE
+    char i2c_device[SOURCE_DEVICE_LEN];
+    uint32_t spi_speed_hz;              //0 selects SOURCE_DEFAULT_SPI_HZ
+}FrameSourceParam_t;
+
+//where stream_function takes its raw frames from
+typedef struct FrameSource_t {
+    FrameSourceParam_t param;
+    RecordReader_t reader;
+    uint32_t image_byte_size;           //the raw frame is the image plane, then the temp plane
+    uint32_t temp_byte_size;
+    uint64_t frame_cnt;
+    uint64_t start_us;                  //pacing: monotonic time of the first frame since the (re)start
+    uint64_t first_timestamp_us;        //replay: recorded time of that frame
+    uint32_t seed;
+    int spi_fd;                         //vospi
+    uint8_t* spi_buf;                   //page aligned, whole packets per transfer for the spi controller's dma
+    uint32_t packet_size;
+    uint32_t spi_packets;               //packets of the last transfer
+    uint32_t spi_pos;                   //next one to take, the rest belongs to the next frame
+    uint64_t resyncs;                   //frames restarted because a line was missing
+    uint64_t crc_errors;
+}FrameSource_t;
+
+int frame_source_open(FrameSource_t* source, const FrameSourceParam_t* param);
+
+//the stream parameters ir_camera_open would give for this source, load_stream_frame_info works from them
+//a uvc source leaves camera_param as ir_camera_open filled it
+int frame_source_camera_param(FrameSource_t* source, CameraParam_t* camera_param);
+
+//the next raw frame of camera_param.frame_size bytes, waits like uvc_frame_get when paced
+//vospi takes the lines straight from the spi transfers into raw_frame, the device sets the pace
+int frame_source_get(FrameSource_t* source, uint8_t* raw_frame);
+
+void frame_source_close(FrameSource_t* source);
+
+const char* frame_source_name(FrameSourceType_t type);
+
+#endif
@@ -0,0 +1,377 @@
+#include "stab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+//the profiles of a frame: rows whole or left and right, columns whole or top and bottom
+#define STAB_ROWS 0
+#define STAB_ROWS_RIGHT 1
+#define STAB_COLS 2
+#define STAB_COLS_BOTTOM 3
+#define STAB_PROFILES 4
+
+//a * wa + b * wb per pixel with the mean taken out, returns the mean absolute deviation that is left
+static float stab_profile_prepare(float* dst, const uint32_t* a, float wa, const uint32_t* b, float wb, int n)
+{
+    double mean = 0;
+    for (int i = 0; i < n; i++)
+    {
+        dst[i] = a[i] * wa + ((b != NULL) ? b[i] * wb : 0.0f);
+        mean += dst[i];
+    }
+    float m = (float)(mean / n);
+    double dev = 0;
+    for (int i = 0; i < n; i++)
+    {
+        dst[i] -= m;
+        dev += fabsf(dst[i]);
+    }
+    return (float)(dev / n);
+}
+
+//the shift s with cur[i] ~ prev[i - s], the mean absolute difference of the overlap for each one and a parabola
+//through the best three. returns 0 when the best is at the edge of the range, the view moved further or cut
+static int stab_match(const float* prev, const float* cur, int n, int max_shift, float* shift)
+{
+    float cost[2 * STAB_MAX_SHIFT + 1];
+    for (int s = -max_shift; s <= max_shift; s++)
+    {
+        int i0 = (s > 0) ? s : 0;
+        int i1 = (s < 0) ? n + s : n;
+        float sad = 0;
+        for (int i = i0; i < i1; i++)
+        {
+            sad += fabsf(cur[i] - prev[i - s]);
+        }
+        cost[s + max_shift] = sad / (i1 - i0);
+    }
+    //outwards from 0, ties go to the smaller shift and a still frame reads as still
+    int best = max_shift;
+    for (int s = 1; s <= max_shift; s++)
+    {
+        best = (cost[max_shift - s] < cost[best]) ? max_shift - s : best;
+        best = (cost[max_shift + s] < cost[best]) ? max_shift + s : best;
+    }
+    *shift = (float)(best - max_shift);
+    if (best == 0 || best == 2 * max_shift)
+    {
+        return 0;
+    }
+    float c0 = cost[best - 1], c1 = cost[best], c2 = cost[best + 1];
+    float den = c0 - 2 * c1 + c2;
+    if (den > 0)
+    {
+        //a flat valley puts the vertex anywhere, it is between the neighbours of the best
+        float sub = 0.5f * (c0 - c2) / den;
+        *shift += (sub > 0.5f) ? 0.5f : ((sub < -0.5f) ? -0.5f : sub);
+    }
+    return 1;
+}
+
+void stab_default_param(StabParam_t* param)
+{
+    if (param == NULL)
+    {
+        return;
+    }
+    memset(param, 0, sizeof(StabParam_t));
+    param->max_shift = STAB_DEFAULT_MAX_SHIFT;
+    param->smooth = STAB_DEFAULT_SMOOTH;
+    param->max_correction = STAB_DEFAULT_MAX_CORRECTION;
+    param->min_contrast = STAB_DEFAULT_MIN_CONTRAST;
+    param->rotation = 0;
+}
+
+int stab_init(Stab_t* stab, const StabParam_t* param, StreamFrameInfo_t* stream_frame_info)
+{
+    if (stab == NULL || stream_frame_info == NULL)
+    {
+        return STAB_ERROR_PARAM;
+    }
+    StabParam_t default_param;
+    if (param == NULL)
+    {
+        stab_default_param(&default_param);
+        param = &default_param;
+    }
+    if (param->max_shift > STAB_MAX_SHIFT || param->smooth < 0 || param->smooth > 1 || param->min_contrast < 0)
+    {
+        return STAB_ERROR_PARAM;
+    }
+    memset(stab, 0, sizeof(Stab_t));
+    stab->param = *param;
+    if (stab->param.max_shift == 0)
+    {
+        stab->param.max_shift = STAB_DEFAULT_MAX_SHIFT;
+    }
+    stab->prev = (float*)malloc(2 * STAB_PROFILES * FRAME_PROFILES_MAX * sizeof(float));
+    if (stab->prev == NULL)
+    {
+        return STAB_ERROR_MEM;
+    }
+    stab->cur = stab->prev + STAB_PROFILES * FRAME_PROFILES_MAX;
+    sync_mutex_init(&stab->mutex);
+    stab->stream_frame_info = stream_frame_info;
+    stream_frame_info->stab = stab;
+    printf("stabilization: +-%u px per frame, smooth %.2f, correction up to %u px%s\n", stab->param.max_shift, \
+        stab->param.smooth, stab->param.max_correction, stab->param.rotation ? ", with rotation" : "");
+    return STAB_SUCCESS;
+}
+
+void stab_release(Stab_t* stab)
+{
+    if (stab == NULL || stab->stream_frame_info == NULL)
+    {
+        return;
+    }
+    if (stab->stream_frame_info->stab == stab)
+    {
+        stab->stream_frame_info->stab = NULL;
+    }
+    stab->stream_frame_info = NULL;
+    //prev and cur are one block, swapped in place
+    free((stab->prev < stab->cur) ? stab->prev : stab->cur);
+    stab->prev = NULL;
+    stab->cur = NULL;
+    sync_mutex_destroy(&stab->mutex);
+}
+
+//one axis: the shift of the profile pair, 0 on a flat one. lost is set when the match ran out of range
+static float stab_axis(Stab_t* stab, int index, int n, int max_shift, float contrast, uint32_t* flat, uint8_t* lost)
+{
+    float shift = 0;
+    if (contrast < stab->param.min_contrast)
+    {
+        (*flat)++;
+        return 0;
+    }
+    if (!stab_match(stab->prev + index * FRAME_PROFILES_MAX, stab->cur + index * FRAME_PROFILES_MAX, n, max_shift, \
+        &shift))
+    {
+        *lost = 1;
+    }
+    return shift;
+}
+
+uint32_t stab_frame(Stab_t* stab, FrameSlot_t* slot)
+{
+    const FrameProfiles_t* profiles = &slot->profiles;
+    if ((slot->tag_flags & FRAME_DESC_IMAGE_INVALID) || !profiles->valid)
+    {
+        //the next good frame is matched against the last good one
+        sync_mutex_lock(&stab->mutex);
+        stab->stats.frames++;
+        stab->stats.skipped++;
+        sync_mutex_unlock(&stab->mutex);
+        return 0;
+    }
+    int width = profiles->width, height = profiles->height;
+    if (width != stab->width || height != stab->height)
+    {
+        stab->prev_valid = 0;
+        stab->width = (uint16_t)width;
+        stab->height = (uint16_t)height;
+    }
+    int split_x = profiles->split_x, split_y = profiles->split_y;
+    int rotation = stab->param.rotation && split_x > 0 && split_y > 0;
+    float contrast[STAB_PROFILES] = { 0, 0, 0, 0 };
+    float* cur = stab->cur;
+    if (rotation)
+    {
+        contrast[STAB_ROWS] = stab_profile_prepare(cur + STAB_ROWS * FRAME_PROFILES_MAX, profiles->row[0], \
+            1.0f / split_x, NULL, 0, height);
+        contrast[STAB_ROWS_RIGHT] = stab_profile_prepare(cur + STAB_ROWS_RIGHT * FRAME_PROFILES_MAX, \
+            profiles->row[1], 1.0f / (width - split_x), NULL, 0, height);
+        contrast[STAB_COLS] = stab_profile_prepare(cur + STAB_COLS * FRAME_PROFILES_MAX, profiles->col[0], \
+            1.0f / split_y, NULL, 0, width);
+        contrast[STAB_COLS_BOTTOM] = stab_profile_prepare(cur + STAB_COLS_BOTTOM * FRAME_PROFILES_MAX, \
+            profiles->col[1], 1.0f / (height - split_y), NULL, 0, width);
+    }
+    else
+    {
+        contrast[STAB_ROWS] = stab_profile_prepare(cur + STAB_ROWS * FRAME_PROFILES_MAX, profiles->row[0], \
+            1.0f / width, profiles->row[1], 1.0f / width, height);
+        contrast[STAB_COLS] = stab_profile_prepare(cur + STAB_COLS * FRAME_PROFILES_MAX, profiles->col[0], \
+            1.0f / height, profiles->col[1], 1.0f / height, width);
+    }
+
+    float dx = 0, dy = 0, angle = 0;
+    uint32_t flat = 0;
+    uint8_t lost = 0;
+    uint8_t measured = stab->prev_valid;
+    if (measured)
+    {
+        //half the profile stays in the overlap
+        int max_x = ((int)stab->param.max_shift < width / 4) ? (int)stab->param.max_shift : width / 4;
+        int max_y = ((int)stab->param.max_shift < height / 4) ? (int)stab->param.max_shift : height / 4;
+        if (rotation)
+        {
+            float dy_left = stab_axis(stab, STAB_ROWS, height, max_y, contrast[STAB_ROWS], &flat, &lost);
+            float dy_right = stab_axis(stab, STAB_ROWS_RIGHT, height, max_y, contrast[STAB_ROWS_RIGHT], &flat, &lost);
+            float dx_top = stab_axis(stab, STAB_COLS, width, max_x, contrast[STAB_COLS], &flat, &lost);
+            float dx_bottom = stab_axis(stab, STAB_COLS_BOTTOM, width, max_x, contrast[STAB_COLS_BOTTOM], &flat, &lost);
+            //the halves turn apart about the center: the right rows go down and the top columns right. a pair
+            //with a flat half gives no turn
+            float min_contrast = stab->param.min_contrast;
+            int rows_ok = (contrast[STAB_ROWS] >= min_contrast && contrast[STAB_ROWS_RIGHT] >= min_contrast);
+            int cols_ok = (contrast[STAB_COLS] >= min_contrast && contrast[STAB_COLS_BOTTOM] >= min_contrast);
+            float angle_rows = rows_ok ? (dy_right - dy_left) / (width * 0.5f) : 0;
+            float angle_cols = cols_ok ? (dx_top - dx_bottom) / (height * 0.5f) : 0;
+            dy = (dy_left + dy_right) * 0.5f;
+            dx = (dx_top + dx_bottom) * 0.5f;
+            angle = (rows_ok + cols_ok > 0) ? (angle_rows + angle_cols) / (rows_ok + cols_ok) : 0;
+        }
+        else
+        {
+            dy = stab_axis(stab, STAB_ROWS, height, max_y, contrast[STAB_ROWS], &flat, &lost);
+            dx = stab_axis(stab, STAB_COLS, width, max_x, contrast[STAB_COLS], &flat, &lost);
+        }
+    }
+    float* swap = stab->prev;
+    stab->prev = stab->cur;
+    stab->cur = swap;
+    stab->prev_valid = 1;
+
+    uint8_t clamped = 0;
+    if (lost)
+    {
+        //a cut or a jolt past max_shift, the new view is the steady one
+        dx = dy = angle = 0;
+        stab->path_x = stab->path_y = stab->path_angle = 0;
+        stab->smooth_x = stab->smooth_y = stab->smooth_angle = 0;
+    }
+    else
+    {
+        double smooth = stab->param.smooth;
+        stab->path_x += dx;
+        stab->path_y += dy;
+        stab->path_angle += angle;
+        stab->smooth_x = smooth * stab->smooth_x + (1 - smooth) * stab->path_x;
+        stab->smooth_y = smooth * stab->smooth_y + (1 - smooth) * stab->path_y;
+        stab->smooth_angle = smooth * stab->smooth_angle + (1 - smooth) * stab->path_angle;
+        double limit = stab->param.max_correction;
+        double jx = stab->path_x - stab->smooth_x, jy = stab->path_y - stab->smooth_y;
+        if (fabs(jx) > limit || fabs(jy) > limit)
+        {
+            //the smoothed path is pulled along, the view never drifts further than max_correction
+            jx = (jx > limit) ? limit : ((jx < -limit) ? -limit : jx);
+            jy = (jy > limit) ? limit : ((jy < -limit) ? -limit : jy);
+            stab->smooth_x = stab->path_x - jx;
+            stab->smooth_y = stab->path_y - jy;
+            clamped = 1;
+        }
+    }
+    FrameMotion_t* motion = &slot->desc.motion;
+    motion->dx = dx;
+    motion->dy = dy;
+    motion->angle = angle;
+    motion->jitter_x = (float)(stab->path_x - stab->smooth_x);
+    motion->jitter_y = (float)(stab->path_y - stab->smooth_y);
+    motion->jitter_angle = (float)(stab->path_angle - stab->smooth_angle);
+
+    float shift = sqrtf(dx * dx + dy * dy);
+    float jitter_sq = motion->jitter_x * motion->jitter_x + motion->jitter_y * motion->jitter_y;
+    sync_mutex_lock(&stab->mutex);
+    StabStats_t* stats = &stab->stats;
+    stats->frames++;
+    stats->measured += measured;
+    stats->flat += flat;
+    stats->lost += lost;
+    stats->clamped += clamped;
+    stats->shift_max = (shift > stats->shift_max) ? shift : stats->shift_max;
+    stats->jitter_max = (sqrtf(jitter_sq) > stats->jitter_max) ? sqrtf(jitter_sq) : stats->jitter_max;
+    stab->jitter_sq += measured ? jitter_sq : 0;
+    sync_mutex_unlock(&stab->mutex);
+    return FRAME_DESC_STAB;
+}
+
+void stab_roi_follow(RoiEngine_t* engine, const FrameDesc_t* desc)
+{
+    if (engine == NULL || desc == NULL || !(desc->flags & FRAME_DESC_STAB))
+    {
+        return;
+    }
+    //the profiles may come from the image plane, the rois are on the temp plane
+    float scale_x = 1.0f, scale_y = 1.0f;
+    if (desc->profiles != NULL && desc->profiles->width > 0 && desc->profiles->height > 0)
+    {
+        scale_x = (float)engine->temp_res.width / desc->profiles->width;
+        scale_y = (float)engine->temp_res.height / desc->profiles->height;
+    }
+    roi_engine_offset_set(engine, (int)lroundf(desc->motion.jitter_x * scale_x), \
+        (int)lroundf(desc->motion.jitter_y * scale_y));
+}
+
+void stab_warp(const FrameMotion_t* motion, const uint16_t* src, uint32_t src_stride, uint16_t* dst, \
+    uint32_t dst_stride, int width, int height)
+{
+    if (motion == NULL || src == NULL || dst == NULL || width <= 0 || height <= 0)
+    {
+        return;
+    }
+    int jx = (int)lroundf(motion->jitter_x), jy = (int)lroundf(motion->jitter_y);
+    float angle = motion->jitter_angle;
+    //under half a pixel of turn at the corners is a plain shift, one copy per row and the edges replicated
+    if (fabsf(angle) * (width + height) < 1.0f)
+    {
+        int x0 = (jx < 0) ? -jx : 0;
+        int x1 = (width - jx < width) ? width - jx : width;
+        for (int y = 0; y < height; y++)
+        {
+            int sy = y + jy;
+            sy = (sy < 0) ? 0 : ((sy >= height) ? height - 1 : sy);
+            const uint16_t* line = (const uint16_t*)((const uint8_t*)src + (size_t)sy * src_stride);
+            uint16_t* out = (uint16_t*)((uint8_t*)dst + (size_t)y * dst_stride);
+            if (x0 >= x1)
+            {
+                //shifted out entirely, the nearest edge column
+                uint16_t v = line[(jx < 0) ? 0 : width - 1];
+                for (int x = 0; x < width; x++)
+                {
+                    out[x] = v;
+                }
+                continue;
+            }
+            for (int x = 0; x < x0; x++)
+            {
+                out[x] = line[0];
+            }
+            memcpy(out + x0, line + x0 + jx, (size_t)(x1 - x0) * sizeof(uint16_t));
+            for (int x = x1; x < width; x++)
+            {
+                out[x] = line[width - 1];
+            }
+        }
+        return;
+    }
+    //nearest pixel of the turned and shifted point, stepped along the row
+    float cx = (width - 1) * 0.5f, cy = (height - 1) * 0.5f;
+    float cos_a = cosf(angle), sin_a = sinf(angle);
+    for (int y = 0; y < height; y++)
+    {
+        uint16_t* out = (uint16_t*)((uint8_t*)dst + (size_t)y * dst_stride);
+        float fx = cx + (0 - cx) * cos_a - (y - cy) * sin_a + motion->jitter_x;
+        float fy = cy + (0 - cx) * sin_a + (y - cy) * cos_a + motion->jitter_y;
+        for (int x = 0; x < width; x++, fx += cos_a, fy += sin_a)
+        {
+            int sx = (int)lroundf(fx), sy = (int)lroundf(fy);
+            sx = (sx < 0) ? 0 : ((sx >= width) ? width - 1 : sx);
+            sy = (sy < 0) ? 0 : ((sy >= height) ? height - 1 : sy);
+            out[x] = ((const uint16_t*)((const uint8_t*)src + (size_t)sy * src_stride))[sx];
+        }
+    }
+}
+
+int stab_stats(Stab_t* stab, StabStats_t* stats)
+{
+    if (stab == NULL || stats == NULL)
+    {
+        return STAB_ERROR_PARAM;
+    }
+    sync_mutex_lock(&stab->mutex);
+    *stats = stab->stats;
+    stats->jitter_rms = (stab->stats.measured > 0) ? (float)sqrt(stab->jitter_sq / stab->stats.measured) : 0;
+    sync_mutex_unlock(&stab->mutex);
+    return STAB_SUCCESS;
+}
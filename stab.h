@@ -0,0 +1,89 @@
+#ifndef _STAB_H_
+#define _STAB_H_
+
+//digital stabilization for cameras on a moving mount: the global shift between two frames from the projection
+//profiles of the stats pass (stats.h, row and column sums, none of the pixels read again). the zero mean profiles
+//of a frame are matched against the last measured one's over +-max_shift by the mean absolute difference of the
+//overlap, and a parabola through the best three gives the subpixel. with rotation the left and right row profiles
+//and the top and bottom column profiles are matched on their own, the difference of their shifts over the distance
+//of the halves is the turn. the shifts add up to the camera path, a first order low pass of it is the intended
+//motion (a pan, the vehicle turning) and the rest the jitter, committed in desc.motion with FRAME_DESC_STAB.
+//the cheap compensation moves the rois by the jitter (stab_roi_follow), stab_warp moves a whole plane
+#include <stdint.h>
+#include "sync.h"
+#include "data.h"
+#include "roi.h"
+
+#define STAB_MAX_SHIFT 32
+#define STAB_DEFAULT_MAX_SHIFT 12           //pixels between two frames, more is taken for a cut and starts over
+#define STAB_DEFAULT_SMOOTH 0.9f            //of the smoothed path kept per frame, higher follows a pan slower
+#define STAB_DEFAULT_MAX_CORRECTION 24      //pixels, the jitter is clamped to it and the smoothed path catches up
+#define STAB_DEFAULT_MIN_CONTRAST 2.0f      //mean absolute deviation of a profile, plane units per pixel
+
+#define STAB_SUCCESS 0
+#define STAB_ERROR_PARAM -1
+#define STAB_ERROR_MEM -2
+
+typedef struct {
+    uint32_t max_shift;                 //0 selects STAB_DEFAULT_MAX_SHIFT, at most STAB_MAX_SHIFT
+    float smooth;                       //0..1, 0 takes every shift for intended and corrects nothing
+    uint32_t max_correction;            //pixels
+    float min_contrast;                 //a flatter profile gives no shift on its axis, a featureless sky or road
+    uint8_t rotation;                   //1 measures the turn as well, four matches instead of two
+}StabParam_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t measured;                  //frames matched against the last one
+    uint64_t skipped;                   //frames tagged FRAME_DESC_IMAGE_INVALID or without profiles
+    uint64_t flat;                      //axes under min_contrast
+    uint64_t lost;                      //best match at max_shift, the path starts over
+    uint64_t clamped;                   //frames whose jitter was over max_correction
+    float shift_max;                    //largest frame to frame shift, pixels
+    float jitter_max;                   //largest jitter, pixels
+    float jitter_rms;
+}StabStats_t;
+
+typedef struct Stab_t {
+    StabParam_t param;
+    StreamFrameInfo_t* stream_frame_info;
+    //stream thread only
+    float* prev;                        //4 x FRAME_PROFILES_MAX zero mean profiles of the last measured frame
+    float* cur;
+    uint8_t prev_valid;
+    uint16_t width;
+    uint16_t height;
+    double path_x;                      //summed up shifts and turns
+    double path_y;
+    double path_angle;
+    double smooth_x;                    //their low pass
+    double smooth_y;
+    double smooth_angle;
+    double jitter_sq;                   //sum of the squared jitters of the measured frames
+    StabStats_t stats;
+    sync_mutex_t mutex;                 //stats against stab_stats
+}Stab_t;
+
+void stab_default_param(StabParam_t* param);
+
+//hook the stabilization into the stream thread of stream_frame_info, the stats pass then adds the profiles.
+//param NULL: the defaults
+int stab_init(Stab_t* stab, const StabParam_t* param, StreamFrameInfo_t* stream_frame_info);
+
+void stab_release(Stab_t* stab);
+
+//stream thread: the prepared slot, returns FRAME_DESC_STAB with slot->desc.motion filled, 0 when it measured none
+uint32_t stab_frame(Stab_t* stab, FrameSlot_t* slot);
+
+//a consumer's rois follow the jitter of its frame: the engine's offset is the rounded jitter, the frames without
+//FRAME_DESC_STAB keep the last one. translation only, the turn is left to stab_warp
+void stab_roi_follow(RoiEngine_t* engine, const FrameDesc_t* desc);
+
+//dst = the steady view of a 16 bit plane: each pixel read at its point in the frame, jitter_angle included, edges
+//replicated. strides in bytes, dst must not overlap src
+void stab_warp(const FrameMotion_t* motion, const uint16_t* src, uint32_t src_stride, uint16_t* dst, \
+    uint32_t dst_stride, int width, int height);
+
+int stab_stats(Stab_t* stab, StabStats_t* stats);
+
+#endif
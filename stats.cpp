@@ -0,0 +1,743 @@
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include "simd.h"
+
+void frame_stats_clear(FrameStats_t* stats)
+{
+    if (stats != NULL)
+    {
+        stats->valid = 0;
+    }
+}
+
+float frame_stats_share_above(const FrameStats_t* stats, uint32_t value)
+{
+    if (value <= stats->min_val)
+    {
+        return 1.0f;
+    }
+    if (value > stats->max_val || stats->pix_num == 0)
+    {
+        return 0.0f;
+    }
+    uint32_t offset = value - stats->hist_low;
+    uint32_t bin = offset / stats->hist_bin_width;
+    if (bin >= FRAME_STATS_HIST_BINS)
+    {
+        return 0.0f;
+    }
+    float above = stats->hist[bin] * (float)(stats->hist_bin_width - offset % stats->hist_bin_width) / \
+        stats->hist_bin_width;
+    for (uint32_t i = bin + 1; i < FRAME_STATS_HIST_BINS; i++)
+    {
+        above += stats->hist[i];
+    }
+    return above / stats->pix_num;
+}
+
+int frame_stats_compute(const uint16_t* src, int width, int height, FrameStats_t* stats)
+{
+    return frame_stats_compute_tiled(src, width, height, stats, NULL);
+}
+
+int frame_tiles_changed(const FrameTiles_t* prev, const FrameTiles_t* cur, int width, int height, \
+    uint32_t tolerance, uint8_t* changed)
+{
+    int cols = (width + FRAME_TILES_SIZE - 1) / FRAME_TILES_SIZE;
+    int rows = (height + FRAME_TILES_SIZE - 1) / FRAME_TILES_SIZE;
+    int tile_num = cols * rows;
+    if (tile_num > FRAME_TILES_MAX)
+    {
+        tile_num = FRAME_TILES_MAX;
+    }
+    if (prev == NULL || cur == NULL || !prev->valid || !cur->valid || prev->cols != cols || prev->rows != rows || \
+        cur->cols != cols || cur->rows != rows)
+    {
+        memset(changed, 1, tile_num);
+        return tile_num;
+    }
+    int changed_num = 0;
+    for (int ty = 0; ty < rows; ty++)
+    {
+        int tile_h = (ty == rows - 1) ? height - ty * FRAME_TILES_SIZE : FRAME_TILES_SIZE;
+        for (int tx = 0; tx < cols; tx++)
+        {
+            int tile_w = (tx == cols - 1) ? width - tx * FRAME_TILES_SIZE : FRAME_TILES_SIZE;
+            int i = ty * cols + tx;
+            uint32_t n = (uint32_t)(tile_w * tile_h);
+            uint32_t sum_diff = (cur->sum[i] > prev->sum[i]) ? cur->sum[i] - prev->sum[i] : prev->sum[i] - cur->sum[i];
+            uint32_t max_diff = (cur->max[i] > prev->max[i]) ? cur->max[i] - prev->max[i] : prev->max[i] - cur->max[i];
+            changed[i] = (sum_diff > tolerance * n || max_diff > tolerance * 4);
+            changed_num += changed[i];
+        }
+    }
+    return changed_num;
+}
+
+int frame_stats_compute_tiled(const uint16_t* src, int width, int height, FrameStats_t* stats, FrameTiles_t* tiles)
+{
+    return frame_stats_compute_profiled(src, width, height, stats, tiles, NULL);
+}
+
+int frame_stats_compute_profiled(const uint16_t* src, int width, int height, FrameStats_t* stats, FrameTiles_t* tiles, \
+    FrameProfiles_t* profiles)
+{
+    if (src == NULL || stats == NULL || width <= 0 || height <= 0 || width > 65535 || height > 65535)
+    {
+        return FRAME_STATS_ERROR_PARAM;
+    }
+    int cols = (width + FRAME_TILES_SIZE - 1) / FRAME_TILES_SIZE;
+    int rows = (height + FRAME_TILES_SIZE - 1) / FRAME_TILES_SIZE;
+    if (tiles != NULL)
+    {
+        tiles->valid = 0;
+        if (cols * rows > FRAME_TILES_MAX)
+        {
+            tiles = NULL;
+        }
+        else
+        {
+            tiles->cols = (uint16_t)cols;
+            tiles->rows = (uint16_t)rows;
+            memset(tiles->sum, 0, cols * rows * sizeof(uint32_t));
+            memset(tiles->max, 0, cols * rows * sizeof(uint16_t));
+            memset(tiles->max_pos, 0, cols * rows);
+        }
+    }
+    if (profiles != NULL)
+    {
+        profiles->valid = 0;
+        if (width > FRAME_PROFILES_MAX || height > FRAME_PROFILES_MAX)
+        {
+            profiles = NULL;
+        }
+        else
+        {
+            profiles->width = (uint16_t)width;
+            profiles->height = (uint16_t)height;
+            profiles->split_x = (uint16_t)((cols / 2) * FRAME_TILES_SIZE);
+            profiles->split_y = (uint16_t)(height / 2);
+            memset(profiles->col, 0, sizeof(profiles->col));
+        }
+    }
+
+    //the fine histogram lives on the stack, only its 256 bin fold is kept in the block
+    uint32_t fine_hist[FRAME_STATS_FINE_BINS];
+    memset(fine_hist, 0, sizeof(fine_hist));
+    uint32_t min_val = 65535, max_val = 0;
+    int min_index = 0, max_index = 0;
+    uint64_t sum = 0;
+    int pix_num = width * height;
+    //row by row in tile wide pieces, each piece adds to its tile's signature
+    for (int y = 0; y < height; y++)
+    {
+        uint32_t* tile_sum = (tiles != NULL) ? tiles->sum + (y / FRAME_TILES_SIZE) * cols : NULL;
+        uint16_t* tile_max = (tiles != NULL) ? tiles->max + (y / FRAME_TILES_SIZE) * cols : NULL;
+        uint8_t* tile_pos = (tiles != NULL) ? tiles->max_pos + (y / FRAME_TILES_SIZE) * cols : NULL;
+        uint32_t side_sum[2] = { 0, 0 };
+        for (int x0 = 0; x0 < width; x0 += FRAME_TILES_SIZE)
+        {
+            int x1 = (x0 + FRAME_TILES_SIZE < width) ? x0 + FRAME_TILES_SIZE : width;
+            uint32_t piece_sum = 0, piece_max = 0;
+            for (int i = y * width + x0; i < y * width + x1; i++)
+            {
+                uint32_t v = src[i];
+                fine_hist[v >> FRAME_STATS_FINE_SHIFT]++;
+                piece_sum += v;
+                piece_max = (v > piece_max) ? v : piece_max;
+                if (v < min_val)
+                {
+                    min_val = v;
+                    min_index = i;
+                }
+                if (v > max_val)
+                {
+                    max_val = v;
+                    max_index = i;
+                }
+            }
+            sum += piece_sum;
+            side_sum[profiles != NULL && x0 >= profiles->split_x] += piece_sum;
+            if (tile_sum != NULL)
+            {
+                int t = x0 / FRAME_TILES_SIZE;
+                tile_sum[t] += piece_sum;
+                //a row raising the tile's max is looked at again for where, a few rows of a tile at most
+                if (piece_max > tile_max[t])
+                {
+                    tile_max[t] = (uint16_t)piece_max;
+                    int i = y * width + x0;
+                    while (src[i] != piece_max)
+                    {
+                        i++;
+                    }
+                    tile_pos[t] = (uint8_t)(((y % FRAME_TILES_SIZE) << 4) | (i - y * width - x0));
+                }
+            }
+        }
+        if (profiles != NULL)
+        {
+            profiles->row[0][y] = side_sum[0];
+            profiles->row[1][y] = side_sum[1];
+            simd_accumulate_u16(src + y * width, width, profiles->col[y >= profiles->split_y]);
+        }
+    }
+    if (tiles != NULL)
+    {
+        tiles->valid = 1;
+    }
+    if (profiles != NULL)
+    {
+        profiles->valid = 1;
+    }
+
+    stats->min_val = (uint16_t)min_val;
+    stats->max_val = (uint16_t)max_val;
+    stats->min_x = (uint16_t)(min_index % width);
+    stats->min_y = (uint16_t)(min_index / width);
+    stats->max_x = (uint16_t)(max_index % width);
+    stats->max_y = (uint16_t)(max_index / width);
+    stats->pix_num = (uint32_t)pix_num;
+    stats->mean = (float)((double)sum / pix_num);
+
+    //fold the occupied fine bins into FRAME_STATS_HIST_BINS equal bins
+    uint32_t fine_lo = min_val >> FRAME_STATS_FINE_SHIFT;
+    uint32_t fine_hi = max_val >> FRAME_STATS_FINE_SHIFT;
+    uint32_t fine_per_bin = (fine_hi - fine_lo + FRAME_STATS_HIST_BINS) / FRAME_STATS_HIST_BINS;
+    stats->hist_low = fine_lo << FRAME_STATS_FINE_SHIFT;
+    stats->hist_bin_width = fine_per_bin << FRAME_STATS_FINE_SHIFT;
+    memset(stats->hist, 0, sizeof(stats->hist));
+    for (uint32_t f = fine_lo; f <= fine_hi; f++)
+    {
+        stats->hist[(f - fine_lo) / fine_per_bin] += fine_hist[f];
+    }
+    stats->valid = 1;
+    return FRAME_STATS_SUCCESS;
+}
+
+void frame_pyramid_level_size(int width, int height, int level, int* level_width, int* level_height)
+{
+    for (int i = 0; i <= level; i++)
+    {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    *level_width = width;
+    *level_height = height;
+}
+
+int frame_pyramid_init(FramePyramid_t* pyramid, int width, int height)
+{
+    if (pyramid == NULL)
+    {
+        return FRAME_STATS_ERROR_PARAM;
+    }
+    memset(pyramid, 0, sizeof(FramePyramid_t));
+    if (width <= 0 || height <= 0 || width > 65535 || height > 65535)
+    {
+        return FRAME_STATS_ERROR_PARAM;
+    }
+    uint32_t cells = 0;
+    int level_num = 0;
+    int w = width, h = height;
+    while (level_num < FRAME_PYRAMID_MAX_LEVELS)
+    {
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+        if (w < FRAME_PYRAMID_MIN_WIDTH || h < FRAME_PYRAMID_MIN_HEIGHT)
+        {
+            break;
+        }
+        pyramid->level[level_num].width = (uint16_t)w;
+        pyramid->level[level_num].height = (uint16_t)h;
+        cells += (uint32_t)(w * h);
+        level_num++;
+    }
+    if (level_num == 0)
+    {
+        return FRAME_STATS_ERROR_PARAM;
+    }
+    pyramid->buffer = (uint16_t*)malloc(cells * 3 * sizeof(uint16_t));
+    if (pyramid->buffer == NULL)
+    {
+        return FRAME_STATS_ERROR_MEM;
+    }
+    uint16_t* p = pyramid->buffer;
+    for (int i = 0; i < level_num; i++)
+    {
+        FramePyramidLevel_t* level = &pyramid->level[i];
+        uint32_t n = (uint32_t)(level->width * level->height);
+        level->min = p;
+        level->max = p + n;
+        level->mean = p + 2 * n;
+        p += 3 * n;
+    }
+    pyramid->level_num = (uint8_t)level_num;
+    pyramid->width = (uint16_t)width;
+    pyramid->height = (uint16_t)height;
+    return FRAME_STATS_SUCCESS;
+}
+
+void frame_pyramid_release(FramePyramid_t* pyramid)
+{
+    if (pyramid != NULL)
+    {
+        free(pyramid->buffer);
+        memset(pyramid, 0, sizeof(FramePyramid_t));
+    }
+}
+
+int frame_pyramid_build(FramePyramid_t* pyramid, const uint16_t* src)
+{
+    if (pyramid == NULL || pyramid->buffer == NULL || src == NULL)
+    {
+        return FRAME_STATS_ERROR_PARAM;
+    }
+    for (int l = 0; l < pyramid->level_num; l++)
+    {
+        const FramePyramidLevel_t* below = (l > 0) ? &pyramid->level[l - 1] : NULL;
+        FramePyramidLevel_t* level = &pyramid->level[l];
+        int src_w = (below != NULL) ? below->width : pyramid->width;
+        int src_h = (below != NULL) ? below->height : pyramid->height;
+        const uint16_t* src_min = (below != NULL) ? below->min : src;
+        const uint16_t* src_max = (below != NULL) ? below->max : src;
+        const uint16_t* src_mean = (below != NULL) ? below->mean : src;
+        int w = level->width;
+        for (int y = 0; y < level->height; y++)
+        {
+            int y0 = 2 * y;
+            int y1 = (y0 + 1 < src_h) ? y0 + 1 : y0;
+            const uint16_t* rows[6] = { src_min + y0 * src_w, src_min + y1 * src_w, src_max + y0 * src_w, \
+                src_max + y1 * src_w, src_mean + y0 * src_w, src_mean + y1 * src_w };
+            uint16_t* dst_min = level->min + y * w;
+            uint16_t* dst_max = level->max + y * w;
+            uint16_t* dst_mean = level->mean + y * w;
+            simd_reduce2x2_u16(rows, src_w / 2, dst_min, dst_max, dst_mean);
+            if (src_w & 1)
+            {
+                int x = src_w - 1;
+                dst_min[w - 1] = (rows[0][x] < rows[1][x]) ? rows[0][x] : rows[1][x];
+                dst_max[w - 1] = (rows[2][x] > rows[3][x]) ? rows[2][x] : rows[3][x];
+                dst_mean[w - 1] = (uint16_t)(((uint32_t)rows[4][x] + rows[5][x] + 1) >> 1);
+            }
+        }
+    }
+    pyramid->valid = 1;
+    return FRAME_STATS_SUCCESS;
+}
+
+typedef struct {
+    uint16_t value;
+    int16_t level;                  //-1 for a plane pixel
+    uint16_t x;
+    uint16_t y;
+}FramePyramidCell_t;
+
+static void frame_pyramid_push(FramePyramidCell_t* heap, int* num, FramePyramidCell_t cell)
+{
+    int i = (*num)++;
+    while (i > 0 && heap[(i - 1) / 2].value < cell.value)
+    {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = cell;
+}
+
+static FramePyramidCell_t frame_pyramid_pop(FramePyramidCell_t* heap, int* num)
+{
+    FramePyramidCell_t top = heap[0];
+    FramePyramidCell_t last = heap[--(*num)];
+    int i = 0;
+    for (;;)
+    {
+        int c = 2 * i + 1;
+        if (c >= *num)
+        {
+            break;
+        }
+        if (c + 1 < *num && heap[c + 1].value > heap[c].value)
+        {
+            c++;
+        }
+        if (heap[c].value <= last.value)
+        {
+            break;
+        }
+        heap[i] = heap[c];
+        i = c;
+    }
+    if (*num > 0)
+    {
+        heap[i] = last;
+    }
+    return top;
+}
+
+//the cells of level l (-1 the pixels) under [x0, x1] x [y0, y1] and in (cx0..cx1, cy0..cy1), 0 when the heap is full
+static int frame_pyramid_open(const FramePyramid_t* pyramid, const uint16_t* src, int l, int cx0, int cy0, \
+    int cx1, int cy1, int x0, int y0, int x1, int y1, FramePyramidCell_t* heap, int* num)
+{
+    int shift = l + 1;
+    int w = (l >= 0) ? pyramid->level[l].width : pyramid->width;
+    cx0 = (cx0 > (x0 >> shift)) ? cx0 : x0 >> shift;
+    cy0 = (cy0 > (y0 >> shift)) ? cy0 : y0 >> shift;
+    cx1 = (cx1 < (x1 >> shift)) ? cx1 : x1 >> shift;
+    cy1 = (cy1 < (y1 >> shift)) ? cy1 : y1 >> shift;
+    const uint16_t* values = (l >= 0) ? pyramid->level[l].max : src;
+    for (int y = cy0; y <= cy1; y++)
+    {
+        for (int x = cx0; x <= cx1; x++)
+        {
+            if (*num >= FRAME_PYRAMID_SEARCH_MAX)
+            {
+                return 0;
+            }
+            FramePyramidCell_t cell = { values[y * w + x], (int16_t)l, (uint16_t)x, (uint16_t)y };
+            frame_pyramid_push(heap, num, cell);
+        }
+    }
+    return 1;
+}
+
+int frame_pyramid_rect_max(const FramePyramid_t* pyramid, const uint16_t* src, int x0, int y0, int x1, int y1, \
+    FramePyramidPeak_t* peak)
+{
+    if (pyramid == NULL || src == NULL || peak == NULL || !pyramid->valid)
+    {
+        return FRAME_STATS_ERROR_PARAM;
+    }
+    x0 = (x0 < 0) ? 0 : x0;
+    y0 = (y0 < 0) ? 0 : y0;
+    x1 = (x1 >= pyramid->width) ? pyramid->width - 1 : x1;
+    y1 = (y1 >= pyramid->height) ? pyramid->height - 1 : y1;
+    if (x0 > x1 || y0 > y1)
+    {
+        return FRAME_STATS_ERROR_PARAM;
+    }
+    FramePyramidCell_t heap[FRAME_PYRAMID_SEARCH_MAX];
+    int num = 0;
+    int top = pyramid->level_num - 1;
+    int ok = frame_pyramid_open(pyramid, src, top, 0, 0, pyramid->level[top].width - 1, \
+        pyramid->level[top].height - 1, x0, y0, x1, y1, heap, &num);
+    while (ok && num > 0)
+    {
+        FramePyramidCell_t cell = frame_pyramid_pop(heap, &num);
+        if (cell.level < 0)
+        {
+            peak->value = cell.value;
+            peak->x = cell.x;
+            peak->y = cell.y;
+            return FRAME_STATS_SUCCESS;
+        }
+        int l = cell.level - 1;
+        int w = (l >= 0) ? pyramid->level[l].width : pyramid->width;
+        int h = (l >= 0) ? pyramid->level[l].height : pyramid->height;
+        int cx1 = (2 * cell.x + 1 < w) ? 2 * cell.x + 1 : w - 1;
+        int cy1 = (2 * cell.y + 1 < h) ? 2 * cell.y + 1 : h - 1;
+        ok = frame_pyramid_open(pyramid, src, l, 2 * cell.x, 2 * cell.y, cx1, cy1, x0, y0, x1, y1, heap, &num);
+    }
+
+    //too many cells left open at once, a flat rect mostly: scan it
+    int width = pyramid->width;
+    peak->value = src[y0 * width + x0];
+    peak->x = (uint16_t)x0;
+    peak->y = (uint16_t)y0;
+    for (int y = y0; y <= y1; y++)
+    {
+        const uint16_t* row = src + y * width;
+        for (int x = x0; x <= x1; x++)
+        {
+            if (row[x] > peak->value)
+            {
+                peak->value = row[x];
+                peak->x = (uint16_t)x;
+                peak->y = (uint16_t)y;
+            }
+        }
+    }
+    return FRAME_STATS_SUCCESS;
+}
+
+int frame_pyramid_peaks(const FramePyramid_t* pyramid, const uint16_t* src, int level, uint16_t threshold, \
+    FramePyramidPeak_t* peaks, int num)
+{
+    if (pyramid == NULL || src == NULL || peaks == NULL || !pyramid->valid || level < 0 || \
+        level >= pyramid->level_num || num <= 0)
+    {
+        return FRAME_STATS_ERROR_PARAM;
+    }
+    const FramePyramidLevel_t* lvl = &pyramid->level[level];
+    int w = lvl->width, h = lvl->height;
+    int shift = level + 1;
+    int peak_num = 0;
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            uint16_t v = lvl->max[y * w + x];
+            if (v < threshold)
+            {
+                continue;
+            }
+            //a plateau counts once, at its first cell in row order
+            int local = 1;
+            for (int dy = -1; dy <= 1 && local; dy++)
+            {
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    int nx = x + dx, ny = y + dy;
+                    if ((dx == 0 && dy == 0) || nx < 0 || ny < 0 || nx >= w || ny >= h)
+                    {
+                        continue;
+                    }
+                    uint16_t n = lvl->max[ny * w + nx];
+                    if (n > v || (n == v && (dy < 0 || (dy == 0 && dx < 0))))
+                    {
+                        local = 0;
+                        break;
+                    }
+                }
+            }
+            if (!local || (peak_num == num && v <= peaks[num - 1].value))
+            {
+                continue;
+            }
+            FramePyramidPeak_t peak;
+            frame_pyramid_rect_max(pyramid, src, x << shift, y << shift, ((x + 1) << shift) - 1, \
+                ((y + 1) << shift) - 1, &peak);
+            int i = (peak_num < num) ? peak_num++ : num - 1;
+            while (i > 0 && peaks[i - 1].value < peak.value)
+            {
+                peaks[i] = peaks[i - 1];
+                i--;
+            }
+            peaks[i] = peak;
+        }
+    }
+    return peak_num;
+}
+
+typedef struct {
+    uint16_t value;
+    uint16_t x;
+    uint16_t y;
+    uint16_t cell;
+    uint8_t located;                //x/y hold value, else value only bounds the cell
+}FrameTopkCandidate_t;
+
+typedef struct {
+    const uint16_t* src;
+    int width;
+    int height;
+    int edge;                       //cell edge in pixels
+    int cols;
+    uint16_t threshold;
+    int distance2;
+    const FramePyramidPeak_t* peaks;
+    int peak_num;
+}FrameTopkSearch_t;
+
+//hotter first, then the lower cell, so equal values come out in a fixed order
+static inline int frame_topk_before(const FrameTopkCandidate_t* a, const FrameTopkCandidate_t* b)
+{
+    return a->value > b->value || (a->value == b->value && a->cell < b->cell);
+}
+
+static void frame_topk_push(FrameTopkCandidate_t* heap, int* num, FrameTopkCandidate_t candidate)
+{
+    int i = (*num)++;
+    while (i > 0 && frame_topk_before(&candidate, &heap[(i - 1) / 2]))
+    {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = candidate;
+}
+
+static FrameTopkCandidate_t frame_topk_pop(FrameTopkCandidate_t* heap, int* num)
+{
+    FrameTopkCandidate_t top = heap[0];
+    FrameTopkCandidate_t last = heap[--(*num)];
+    int i = 0;
+    for (;;)
+    {
+        int c = 2 * i + 1;
+        if (c >= *num)
+        {
+            break;
+        }
+        if (c + 1 < *num && frame_topk_before(&heap[c + 1], &heap[c]))
+        {
+            c++;
+        }
+        if (!frame_topk_before(&heap[c], &last))
+        {
+            break;
+        }
+        heap[i] = heap[c];
+        i = c;
+    }
+    if (*num > 0)
+    {
+        heap[i] = last;
+    }
+    return top;
+}
+
+static int frame_topk_suppressed(const FrameTopkSearch_t* search, const FramePyramidPeak_t* const* near, \
+    int near_num, int x, int y)
+{
+    for (int i = 0; i < near_num; i++)
+    {
+        int dx = x - near[i]->x, dy = y - near[i]->y;
+        if (dx * dx + dy * dy < search->distance2)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//the cell's hottest pixel at or above the threshold outside the reported points' reach, the first in row order.
+//0 when there is none
+static int frame_topk_locate(const FrameTopkSearch_t* search, FrameTopkCandidate_t* candidate)
+{
+    int x0 = (candidate->cell % search->cols) * search->edge;
+    int y0 = (candidate->cell / search->cols) * search->edge;
+    int x1 = (x0 + search->edge < search->width) ? x0 + search->edge : search->width;
+    int y1 = (y0 + search->edge < search->height) ? y0 + search->edge : search->height;
+    //only the points whose reach touches the cell can suppress in it
+    const FramePyramidPeak_t* near[FRAME_TOPK_MAX];
+    int near_num = 0;
+    for (int i = 0; i < search->peak_num; i++)
+    {
+        const FramePyramidPeak_t* peak = &search->peaks[i];
+        int dx = (peak->x < x0) ? x0 - peak->x : ((peak->x >= x1) ? peak->x - x1 + 1 : 0);
+        int dy = (peak->y < y0) ? y0 - peak->y : ((peak->y >= y1) ? peak->y - y1 + 1 : 0);
+        if (dx * dx + dy * dy < search->distance2)
+        {
+            near[near_num++] = peak;
+        }
+    }
+    int found = 0;
+    uint16_t best = search->threshold;
+    for (int y = y0; y < y1; y++)
+    {
+        const uint16_t* row = search->src + y * search->width;
+        for (int x = x0; x < x1; x++)
+        {
+            if (row[x] < best || (found && row[x] == best) || frame_topk_suppressed(search, near, near_num, x, y))
+            {
+                continue;
+            }
+            best = row[x];
+            candidate->x = (uint16_t)x;
+            candidate->y = (uint16_t)y;
+            found = 1;
+        }
+    }
+    candidate->value = best;
+    candidate->located = 1;
+    return found;
+}
+
+int frame_topk(const uint16_t* src, int width, int height, const FrameTiles_t* tiles, const FramePyramid_t* pyramid, \
+    const FrameTopkParam_t* param, FramePyramidPeak_t* peaks, int k)
+{
+    if (src == NULL || param == NULL || peaks == NULL || width <= 0 || height <= 0 || k <= 0 || k > FRAME_TOPK_MAX)
+    {
+        return FRAME_STATS_ERROR_PARAM;
+    }
+    FrameTopkSearch_t search;
+    search.src = src;
+    search.width = width;
+    search.height = height;
+    search.edge = FRAME_TILES_SIZE;
+    search.cols = (width + FRAME_TILES_SIZE - 1) / FRAME_TILES_SIZE;
+    int rows = (height + FRAME_TILES_SIZE - 1) / FRAME_TILES_SIZE;
+    search.threshold = param->threshold;
+    int distance = (param->min_distance > 0) ? param->min_distance : 1;
+    search.distance2 = distance * distance;
+    search.peaks = peaks;
+    search.peak_num = 0;
+
+    //the cells and their bounds: the tiles with their max where it is, or a pyramid level's max cells
+    FrameTopkCandidate_t heap[FRAME_TILES_MAX];
+    int num = 0;
+    int level = -1;
+    int use_tiles = (tiles != NULL && tiles->valid && tiles->cols == search.cols && tiles->rows == rows);
+    if (!use_tiles && pyramid != NULL && pyramid->valid && pyramid->width == width && pyramid->height == height)
+    {
+        //level l cells are 2^(l+1) pixels wide, the first one of the tile size or coarser with few enough cells
+        for (int l = 0; l < pyramid->level_num && level < 0; l++)
+        {
+            if ((2 << l) >= FRAME_TILES_SIZE && pyramid->level[l].width * pyramid->level[l].height <= FRAME_TILES_MAX)
+            {
+                level = l;
+            }
+        }
+        if (level >= 0)
+        {
+            search.edge = 2 << level;
+            search.cols = pyramid->level[level].width;
+            rows = pyramid->level[level].height;
+        }
+    }
+    if (search.cols * rows > FRAME_TILES_MAX)
+    {
+        return FRAME_STATS_ERROR_PARAM;
+    }
+    for (int cell = 0; cell < search.cols * rows; cell++)
+    {
+        FrameTopkCandidate_t candidate = { 0, 0, 0, (uint16_t)cell, 0 };
+        if (use_tiles)
+        {
+            candidate.value = tiles->max[cell];
+            candidate.x = (uint16_t)((cell % search.cols) * FRAME_TILES_SIZE + (tiles->max_pos[cell] & 15));
+            candidate.y = (uint16_t)((cell / search.cols) * FRAME_TILES_SIZE + (tiles->max_pos[cell] >> 4));
+            candidate.located = 1;
+        }
+        else if (level >= 0)
+        {
+            candidate.value = pyramid->level[level].max[cell];
+        }
+        else if (!frame_topk_locate(&search, &candidate))
+        {
+            continue;
+        }
+        if (candidate.value >= search.threshold)
+        {
+            frame_topk_push(heap, &num, candidate);
+        }
+    }
+
+    //the hottest candidate is reported unless a point reported before reaches it, then its cell offers the next
+    while (search.peak_num < k && num > 0)
+    {
+        FrameTopkCandidate_t candidate = frame_topk_pop(heap, &num);
+        if (candidate.located)
+        {
+            int suppressed = 0;
+            for (int i = 0; i < search.peak_num && !suppressed; i++)
+            {
+                int dx = candidate.x - peaks[i].x, dy = candidate.y - peaks[i].y;
+                suppressed = (dx * dx + dy * dy < search.distance2);
+            }
+            if (!suppressed)
+            {
+                FramePyramidPeak_t* peak = &peaks[search.peak_num++];
+                peak->value = candidate.value;
+                peak->x = candidate.x;
+                peak->y = candidate.y;
+            }
+        }
+        //a candidate's value bounds what is left of its cell, so the cell goes back with its next pixel
+        if (frame_topk_locate(&search, &candidate))
+        {
+            frame_topk_push(heap, &num, candidate);
+        }
+    }
+    return search.peak_num;
+}
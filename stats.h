@@ -0,0 +1,156 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+
+#define FRAME_STATS_HIST_BINS 256
+#define FRAME_STATS_FINE_SHIFT 4    //accumulation bins are 16 values wide (0.25K on temperature data)
+#define FRAME_STATS_FINE_BINS (65536 >> FRAME_STATS_FINE_SHIFT)
+
+#define FRAME_TILES_SIZE 16         //tile edge in pixels, the right/bottom tiles may be smaller
+#define FRAME_TILES_MAX 1280        //640x512 in 16 pixel tiles
+#define FRAME_TILES_DEFAULT_TOLERANCE 8     //mean shift in plane values still taken as noise, max allows 4x
+
+#define FRAME_PROFILES_MAX 1024     //plane width and height the projection profiles cover
+
+#define FRAME_PYRAMID_MAX_LEVELS 8
+#define FRAME_PYRAMID_MIN_WIDTH 16      //the coarsest level is the last one still 16x12 or larger
+#define FRAME_PYRAMID_MIN_HEIGHT 12
+#define FRAME_PYRAMID_SEARCH_MAX 512    //cells a coarse to fine search keeps open, past it the rect is scanned
+
+#define FRAME_TOPK_MAX 64           //points one frame_topk call reports at most
+
+#define FRAME_STATS_SUCCESS 0
+#define FRAME_STATS_ERROR_PARAM -1
+#define FRAME_STATS_ERROR_MEM -2
+
+//statistics of one uint16 plane, computed once by the stream thread and shared by every consumer
+typedef struct {
+    uint8_t valid;
+    uint16_t min_val;
+    uint16_t max_val;
+    uint16_t min_x;                 //first pixel holding min_val, in row order
+    uint16_t min_y;
+    uint16_t max_x;                 //first pixel holding max_val, in row order
+    uint16_t max_y;
+    uint32_t pix_num;
+    float mean;
+    //bin i counts values in [hist_low + i * hist_bin_width, hist_low + (i + 1) * hist_bin_width)
+    //the bins cover [min_val, max_val], edges are multiples of the 16 value accumulation bins
+    uint32_t hist_low;
+    uint32_t hist_bin_width;
+    uint32_t hist[FRAME_STATS_HIST_BINS];
+}FrameStats_t;
+
+//per tile signature of one plane for change detection. an exact hash flips on every frame of sensor noise,
+//a tile's sum and max are compared with a tolerance instead
+typedef struct {
+    uint8_t valid;
+    uint16_t cols;
+    uint16_t rows;
+    uint32_t sum[FRAME_TILES_MAX];  //row major, cols x rows
+    uint16_t max[FRAME_TILES_MAX];
+    uint8_t max_pos[FRAME_TILES_MAX];   //(y << 4) | x of the first pixel holding max, in the tile, in row order
+}FrameTiles_t;
+
+//projection profiles of one plane: the sum of every row over the left and the right part of the plane, and of
+//every column over the top and the bottom part, split at a tile edge. row[0][y] + row[1][y] is the whole row,
+//the two sides shift apart when the view rotates
+typedef struct {
+    uint8_t valid;
+    uint16_t width;
+    uint16_t height;
+    uint16_t split_x;               //first column of the right part, 0 for a plane one tile wide
+    uint16_t split_y;               //first row of the bottom part
+    uint32_t row[2][FRAME_PROFILES_MAX];
+    uint32_t col[2][FRAME_PROFILES_MAX];
+}FrameProfiles_t;
+
+//one level of a pyramid, row major width x height cells
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    uint16_t* min;
+    uint16_t* max;
+    uint16_t* mean;                 //rounded mean of the four below, edge cells repeat their last row/column
+}FramePyramidLevel_t;
+
+//2x2 min/max/mean reductions of one plane for coarse queries: level 0 is half the plane, each level half the one
+//before, an odd edge covers the plane's last row or column alone. a cell's max bounds every pixel under it, so a
+//search starts at the top and only opens the cells that can still hold the answer
+typedef struct {
+    uint8_t valid;
+    uint8_t level_num;
+    uint16_t width;                 //of the plane
+    uint16_t height;
+    FramePyramidLevel_t level[FRAME_PYRAMID_MAX_LEVELS];
+    uint16_t* buffer;               //every level's cells, allocated once by frame_pyramid_init
+}FramePyramid_t;
+
+typedef struct {
+    uint16_t value;
+    uint16_t x;                     //a plane pixel holding value
+    uint16_t y;
+}FramePyramidPeak_t;
+
+typedef struct {
+    uint16_t threshold;             //pixels under it are never reported
+    uint16_t min_distance;          //pixels between two reported points at least, euclidean, 0 taken as 1
+}FrameTopkParam_t;
+
+//min/max with their coordinates, mean and histogram in a single pass over the plane
+int frame_stats_compute(const uint16_t* src, int width, int height, FrameStats_t* stats);
+
+//frame_stats_compute plus the tile signatures in the same pass, tiles NULL computes none
+//a plane with more than FRAME_TILES_MAX tiles leaves tiles invalid
+int frame_stats_compute_tiled(const uint16_t* src, int width, int height, FrameStats_t* stats, FrameTiles_t* tiles);
+
+//frame_stats_compute_tiled plus the projection profiles in the same pass, profiles NULL computes none. the row
+//sums come from the tile pieces, the column sums are one simd_accumulate_u16 per row. a plane past
+//FRAME_PROFILES_MAX leaves profiles invalid
+int frame_stats_compute_profiled(const uint16_t* src, int width, int height, FrameStats_t* stats, FrameTiles_t* tiles, \
+    FrameProfiles_t* profiles);
+
+//compare the tiles of two frames of a width x height plane, changed[i] is set to 1 for a tile whose mean moved by more than tolerance or whose max moved by more than
+//4 * tolerance, 0 otherwise. returns the number changed, every tile when prev is NULL or of another layout
+int frame_tiles_changed(const FrameTiles_t* prev, const FrameTiles_t* cur, int width, int height, \
+    uint32_t tolerance, uint8_t* changed);
+
+//mark the block as not computed, consumers fall back to their own pass
+void frame_stats_clear(FrameStats_t* stats);
+
+//share of the pixels at or above value from the histogram, linear inside the bin holding it
+float frame_stats_share_above(const FrameStats_t* stats, uint32_t value);
+
+//size the levels of a width x height plane and allocate them, FRAME_STATS_ERROR_PARAM for a plane too small for
+//one level of FRAME_PYRAMID_MIN_WIDTH x FRAME_PYRAMID_MIN_HEIGHT
+int frame_pyramid_init(FramePyramid_t* pyramid, int width, int height);
+
+void frame_pyramid_release(FramePyramid_t* pyramid);
+
+//the size of a level of a width x height plane, without building anything
+void frame_pyramid_level_size(int width, int height, int level, int* level_width, int* level_height);
+
+//every level from the plane, contiguous rows of the size given to init
+int frame_pyramid_build(FramePyramid_t* pyramid, const uint16_t* src);
+
+//max of the plane pixels in [x0, x1] x [y0, y1] and a pixel holding it, coarse to fine: the cells are opened
+//best bound first, so the search ends at the first pixel that is not below any open cell. src is the plane the
+//pyramid was built from
+int frame_pyramid_rect_max(const FramePyramid_t* pyramid, const uint16_t* src, int x0, int y0, int x1, int y1, \
+    FramePyramidPeak_t* peak);
+
+//local maxima of the level's max plane at or above threshold, each refined to its pixel, hottest first.
+//returns how many of at most num were written to peaks
+int frame_pyramid_peaks(const FramePyramid_t* pyramid, const uint16_t* src, int level, uint16_t threshold, \
+    FramePyramidPeak_t* peaks, int num);
+
+//the k hottest points of a width x height plane, hottest first, each at least min_distance from every hotter one
+//reported (greedy non maximum suppression, ties by cell and then in row order). the cells are the stats pass' tiles: their max and
+//where it is seed the search, a cell is scanned again only when a reported point suppresses its candidate or came
+//from it. without valid tiles of the plane the cells are a pyramid level of the tile size or coarser, without
+//either the plane is scanned once for the tile maxima. returns how many of at most k (FRAME_TOPK_MAX) were written
+int frame_topk(const uint16_t* src, int width, int height, const FrameTiles_t* tiles, const FramePyramid_t* pyramid, \
+    const FrameTopkParam_t* param, FramePyramidPeak_t* peaks, int k);
+
+#endif
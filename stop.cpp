@@ -0,0 +1,149 @@
+#include "stop.h"
+#include "data.h"
+#include <string.h>
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+int stop_token_init(StopToken_t* token)
+{
+    if (token == NULL)
+    {
+        return STOP_ERROR_PARAM;
+    }
+    token->stopped.store(0);
+    token->request_us.store(0);
+    sync_mutex_init(&token->mutex);
+    sync_cond_init(&token->cond);
+#if defined(_WIN32)
+    token->event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (token->event == NULL)
+    {
+        sync_cond_destroy(&token->cond);
+        sync_mutex_destroy(&token->mutex);
+        return STOP_ERROR_OPEN;
+    }
+#else
+    if (pipe(token->wake_fd) < 0)
+    {
+        token->wake_fd[0] = -1;
+        token->wake_fd[1] = -1;
+        sync_cond_destroy(&token->cond);
+        sync_mutex_destroy(&token->mutex);
+        return STOP_ERROR_OPEN;
+    }
+    fcntl(token->wake_fd[0], F_SETFL, fcntl(token->wake_fd[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(token->wake_fd[1], F_SETFL, fcntl(token->wake_fd[1], F_GETFL, 0) | O_NONBLOCK);
+#endif
+    return STOP_SUCCESS;
+}
+
+void stop_token_release(StopToken_t* token)
+{
+    if (token == NULL)
+    {
+        return;
+    }
+#if defined(_WIN32)
+    if (token->event != NULL)
+    {
+        CloseHandle((HANDLE)token->event);
+        token->event = NULL;
+    }
+#else
+    for (int i = 0; i < 2; i++)
+    {
+        if (token->wake_fd[i] >= 0)
+        {
+            close(token->wake_fd[i]);
+            token->wake_fd[i] = -1;
+        }
+    }
+#endif
+    sync_cond_destroy(&token->cond);
+    sync_mutex_destroy(&token->mutex);
+}
+
+void stop_request(StopToken_t* token)
+{
+    if (token == NULL)
+    {
+        return;
+    }
+    sync_mutex_lock(&token->mutex);
+    int stopped = token->stopped.exchange(1, std::memory_order_acq_rel);
+    if (!stopped)
+    {
+        token->request_us.store(get_monotonic_us(), std::memory_order_relaxed);
+        sync_cond_broadcast(&token->cond);
+    }
+    sync_mutex_unlock(&token->mutex);
+    if (stopped)
+    {
+        return;
+    }
+#if defined(_WIN32)
+    SetEvent((HANDLE)token->event);
+#else
+    //the byte is never read, the fd stays readable
+    uint8_t wake = 1;
+    if (write(token->wake_fd[1], &wake, 1) < 0)
+    {
+    }
+#endif
+}
+
+int stop_requested(const StopToken_t* token)
+{
+    return (token != NULL) ? token->stopped.load(std::memory_order_acquire) : 0;
+}
+
+int stop_token_wait(StopToken_t* token, uint32_t timeout_ms)
+{
+    if (token == NULL)
+    {
+        return 0;
+    }
+    sync_deadline_t deadline;
+    sync_deadline_set(&deadline, timeout_ms);
+    sync_mutex_lock(&token->mutex);
+    while (!token->stopped.load(std::memory_order_relaxed))
+    {
+        if (sync_cond_wait_until(&token->cond, &token->mutex, &deadline) != SYNC_SUCCESS)
+        {
+            break;
+        }
+    }
+    int stopped = token->stopped.load(std::memory_order_relaxed);
+    sync_mutex_unlock(&token->mutex);
+    return stopped;
+}
+
+int stop_token_fd(const StopToken_t* token)
+{
+#if defined(_WIN32)
+    (void)token;
+    return -1;
+#else
+    return (token != NULL) ? token->wake_fd[0] : -1;
+#endif
+}
+
+void* stop_token_event(const StopToken_t* token)
+{
+#if defined(_WIN32)
+    return (token != NULL) ? token->event : NULL;
+#else
+    (void)token;
+    return NULL;
+#endif
+}
+
+uint64_t stop_token_elapsed_us(const StopToken_t* token)
+{
+    uint64_t request_us = (token != NULL) ? token->request_us.load(std::memory_order_relaxed) : 0;
+    return (request_us > 0) ? get_monotonic_us() - request_us : 0;
+}
@@ -0,0 +1,48 @@
+#ifndef _STOP_H_
+#define _STOP_H_
+
+//cooperative stop of the threads of one run, in place of pthread_cancel: a thread checks stop_requested between
+//steps and waits through stop_token_wait, or polls stop_token_fd (stop_token_event on windows) next to its own
+//fds, so a stop wakes every wait at once. requested once, the token stays stopped until it is released
+#include <stdint.h>
+#include <atomic>
+#include "sync.h"
+
+#define STOP_SUCCESS 0
+#define STOP_ERROR_PARAM -1
+#define STOP_ERROR_OPEN -2
+
+typedef struct {
+    std::atomic<int> stopped;
+    std::atomic<uint64_t> request_us;   //monotonic time of the first stop_request
+    sync_mutex_t mutex;
+    sync_cond_t cond;
+#if defined(_WIN32)
+    void* event;                        //manual reset, set by the stop
+#else
+    int wake_fd[2];                     //the read end turns readable with the stop
+#endif
+}StopToken_t;
+
+int stop_token_init(StopToken_t* token);
+
+void stop_token_release(StopToken_t* token);
+
+//any thread, any number of times
+void stop_request(StopToken_t* token);
+
+int stop_requested(const StopToken_t* token);
+
+//sleep up to timeout_ms, 1 when the stop came first
+int stop_token_wait(StopToken_t* token, uint32_t timeout_ms);
+
+//readable once stopped (POLLIN), for poll/select next to other fds. -1 on windows
+int stop_token_fd(const StopToken_t* token);
+
+//signaled once stopped, for WaitForMultipleObjects. NULL off windows
+void* stop_token_event(const StopToken_t* token);
+
+//microseconds since the stop was requested, 0 before
+uint64_t stop_token_elapsed_us(const StopToken_t* token);
+
+#endif
@@ -0,0 +1,1245 @@
+#include "stream.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "libiruvc.h"
+#include "cmdq.h"
+#include "tempunit.h"
+#include "prop.h"
+#include "stab.h"
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+#if defined(__linux__) && !defined(UDP_SEGMENT)
+#define UDP_SEGMENT 103                 //linux/udp.h, kernels from 4.18
+#endif
+
+#define STREAM_PT_VIDEO 96
+#define STREAM_PT_RADIOMETRIC 97
+#define STREAM_PT_PREVIEW 98
+#define STREAM_RTP_HEADER 16            //'$', channel, length and the 12 byte rtp header
+#define STREAM_POLL_MS 100
+
+static const char* stream_track_names[STREAM_TRACK_NUM] = { "video", "radiometric", "radiometric-preview" };
+static const uint8_t stream_track_pt[STREAM_TRACK_NUM] = { STREAM_PT_VIDEO, STREAM_PT_RADIOMETRIC, STREAM_PT_PREVIEW };
+
+//the lock is held by the caller for every function below that takes the server
+static StreamPacket_t* stream_packet_alloc(StreamServer_t* server, uint32_t capacity)
+{
+    for (int i = 0; i < server->cache_num; i++)
+    {
+        if (server->cache[i]->capacity >= capacity)
+        {
+            StreamPacket_t* packet = server->cache[i];
+            server->cache[i] = server->cache[--server->cache_num];
+            return packet;
+        }
+    }
+    StreamPacket_t* packet = (StreamPacket_t*)malloc(sizeof(StreamPacket_t));
+    if (packet == NULL)
+    {
+        return NULL;
+    }
+    packet->data = (uint8_t*)malloc(capacity);
+    if (packet->data == NULL)
+    {
+        free(packet);
+        return NULL;
+    }
+    packet->capacity = capacity;
+    return packet;
+}
+
+static void stream_packet_release(StreamServer_t* server, StreamPacket_t* packet)
+{
+    if (--packet->ref > 0)
+    {
+        return;
+    }
+    if (server->cache_num < STREAM_PACKET_CACHE)
+    {
+        server->cache[server->cache_num++] = packet;
+        return;
+    }
+    //the cache keeps the larger buffers
+    int smallest = 0;
+    for (int i = 1; i < server->cache_num; i++)
+    {
+        if (server->cache[i]->capacity < server->cache[smallest]->capacity)
+        {
+            smallest = i;
+        }
+    }
+    if (server->cache[smallest]->capacity < packet->capacity)
+    {
+        StreamPacket_t* tmp = server->cache[smallest];
+        server->cache[smallest] = packet;
+        packet = tmp;
+    }
+    free(packet->data);
+    free(packet);
+}
+
+//the interleaved and rtp headers of one packet, returns where its payload goes
+static uint8_t* stream_rtp_begin(StreamServer_t* server, StreamPacket_t* packet, int track_id, uint32_t rtp_time, \
+    int marker, uint32_t payload_size)
+{
+    uint8_t* p = packet->data + packet->size;
+    uint32_t length = 12 + payload_size;
+    uint16_t seq = server->rtp_seq[track_id]++;
+    uint32_t ssrc = server->rtp_ssrc[track_id];
+    p[0] = '$';
+    p[1] = (uint8_t)(track_id * 2);
+    p[2] = (uint8_t)(length >> 8);
+    p[3] = (uint8_t)length;
+    p[4] = 0x80;
+    p[5] = (uint8_t)((marker ? 0x80 : 0) | stream_track_pt[track_id]);
+    p[6] = (uint8_t)(seq >> 8);
+    p[7] = (uint8_t)seq;
+    p[8] = (uint8_t)(rtp_time >> 24);
+    p[9] = (uint8_t)(rtp_time >> 16);
+    p[10] = (uint8_t)(rtp_time >> 8);
+    p[11] = (uint8_t)rtp_time;
+    p[12] = (uint8_t)(ssrc >> 24);
+    p[13] = (uint8_t)(ssrc >> 16);
+    p[14] = (uint8_t)(ssrc >> 8);
+    p[15] = (uint8_t)ssrc;
+    packet->size += STREAM_RTP_HEADER + payload_size;
+    return p + STREAM_RTP_HEADER;
+}
+
+static void stream_client_reset(StreamServer_t* server, StreamClient_t* client)
+{
+    while (client->queue_num > 0)
+    {
+        stream_packet_release(server, client->queue[client->queue_head]);
+        client->queue_head = (client->queue_head + 1) % STREAM_CLIENT_QUEUE;
+        client->queue_num--;
+    }
+    client->queue_head = 0;
+    client->queue_sent = 0;
+}
+
+static void stream_wanted_update(StreamServer_t* server)
+{
+    server->radiometric_wanted = 0;
+    server->preview_wanted = 0;
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+    {
+        StreamClient_t* client = &server->clients[i];
+        if (client->fd >= 0 && client->playing && !client->closing)
+        {
+            server->radiometric_wanted |= ((client->tracks & STREAM_TRACK_RADIOMETRIC) != 0);
+            server->preview_wanted |= ((client->tracks & STREAM_TRACK_PREVIEW) != 0);
+        }
+    }
+}
+
+//queue the frame to every playing client of its track, one reference each
+static void stream_publish(StreamServer_t* server, StreamPacket_t* packet)
+{
+    packet->ref = 1;
+    int dropped = 0;
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+    {
+        StreamClient_t* client = &server->clients[i];
+        if (client->fd < 0 || !client->playing || client->closing || !(client->tracks & packet->track))
+        {
+            continue;
+        }
+        if (client->wait_key & packet->track)
+        {
+            if (!packet->key)
+            {
+                continue;
+            }
+            client->wait_key &= (uint8_t)~packet->track;
+        }
+        if (client->queue_num == STREAM_CLIENT_QUEUE)
+        {
+            //a slow client is closed instead of holding the others back, the server thread closes its socket
+            stream_client_reset(server, client);
+            client->closing = 1;
+            client->reply_len = 0;
+            client->reply_sent = 0;
+            server->stats.dropped_clients++;
+            dropped = 1;
+            continue;
+        }
+        client->queue[(client->queue_head + client->queue_num) % STREAM_CLIENT_QUEUE] = packet;
+        client->queue_num++;
+        packet->ref++;
+    }
+    server->stats.frames++;
+    if (dropped)
+    {
+        stream_wanted_update(server);
+    }
+    stream_packet_release(server, packet);
+#if !defined(_WIN32)
+    uint8_t wake = 1;
+    if (write(server->wake_fd[1], &wake, 1) < 0)
+    {
+        //the pipe is full, the server thread is already woken
+    }
+#endif
+}
+
+static const uint8_t* stream_start_code(const uint8_t* p, const uint8_t* end)
+{
+    for (; p + 3 <= end; p++)
+    {
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+        {
+            return p + 3;
+        }
+    }
+    return end;
+}
+
+//one nal unit: a single packet, or fragments (h264 FU-A, h265 FU) when it is larger than a payload
+static void stream_video_nal(StreamServer_t* server, StreamPacket_t* packet, const uint8_t* nal, uint32_t size, \
+    uint32_t rtp_time, int last)
+{
+    if (size <= STREAM_RTP_PAYLOAD)
+    {
+        memcpy(stream_rtp_begin(server, packet, 0, rtp_time, last, size), nal, size);
+        return;
+    }
+    int hevc = (server->param.codec == ENCODE_CODEC_HEVC);
+    uint32_t nal_header = hevc ? 2 : 1;
+    uint32_t fu_header = nal_header + 1;
+    const uint8_t* src = nal + nal_header;
+    uint32_t left = size - nal_header;
+    int start = 1;
+    while (left > 0)
+    {
+        uint32_t chunk = (left > STREAM_RTP_PAYLOAD - fu_header) ? STREAM_RTP_PAYLOAD - fu_header : left;
+        int end = (chunk == left);
+        uint8_t* p = stream_rtp_begin(server, packet, 0, rtp_time, last && end, fu_header + chunk);
+        uint8_t se = (uint8_t)((start ? 0x80 : 0) | (end ? 0x40 : 0));
+        if (hevc)
+        {
+            p[0] = (uint8_t)((nal[0] & 0x81) | (49 << 1));
+            p[1] = nal[1];
+            p[2] = (uint8_t)(se | ((nal[0] >> 1) & 0x3F));
+        }
+        else
+        {
+            p[0] = (uint8_t)((nal[0] & 0xE0) | 28);
+            p[1] = (uint8_t)(se | (nal[0] & 0x1F));
+        }
+        memcpy(p + fu_header, src, chunk);
+        src += chunk;
+        left -= chunk;
+        start = 0;
+    }
+}
+
+void stream_server_video_packet(const uint8_t* data, uint32_t size, uint64_t timestamp_us, int key, void* arg)
+{
+    StreamServer_t* server = (StreamServer_t*)arg;
+    if (server == NULL || data == NULL || size == 0)
+    {
+        return;
+    }
+    const uint8_t* end = data + size;
+    uint32_t nal_num = 0;
+    for (const uint8_t* p = stream_start_code(data, end); p < end; p = stream_start_code(p, end))
+    {
+        nal_num++;
+    }
+    pthread_mutex_lock(&server->mutex);
+    if (!server->running)
+    {
+        pthread_mutex_unlock(&server->mutex);
+        return;
+    }
+    uint32_t capacity = size + (size / (STREAM_RTP_PAYLOAD - 3) + nal_num + 1) * (STREAM_RTP_HEADER + 3);
+    StreamPacket_t* packet = stream_packet_alloc(server, capacity);
+    if (packet == NULL)
+    {
+        pthread_mutex_unlock(&server->mutex);
+        return;
+    }
+    packet->size = 0;
+    packet->track = STREAM_TRACK_VIDEO;
+    packet->key = (uint8_t)key;
+    uint32_t rtp_time = (uint32_t)(timestamp_us * 9 / 100);
+    const uint8_t* nal = stream_start_code(data, end);
+    while (nal < end)
+    {
+        const uint8_t* next = stream_start_code(nal, end);
+        const uint8_t* nal_end = (next < end) ? next - 3 : end;
+        //the zero in front of a four byte start code belongs to no nal
+        while (nal_end > nal && nal_end[-1] == 0)
+        {
+            nal_end--;
+        }
+        if (nal_end > nal)
+        {
+            stream_video_nal(server, packet, nal, (uint32_t)(nal_end - nal), rtp_time, next >= end);
+        }
+        nal = next;
+    }
+    stream_publish(server, packet);
+    pthread_mutex_unlock(&server->mutex);
+}
+
+#if !defined(_WIN32)
+//cmdq job: the module's calibration parameters, the keyframes after it carry them
+static int stream_calibration_query(void* arg)
+{
+    StreamServer_t* server = (StreamServer_t*)arg;
+    uint16_t values[5];
+    if (prop_tpd_get(TPD_PROP_GAIN_SEL, &values[0]) != IRUVC_SUCCESS || \
+        prop_tpd_get(TPD_PROP_EMS, &values[1]) != IRUVC_SUCCESS || \
+        prop_tpd_get(TPD_PROP_TAU, &values[2]) != IRUVC_SUCCESS || \
+        prop_tpd_get(TPD_PROP_TA, &values[3]) != IRUVC_SUCCESS || \
+        prop_tpd_get(TPD_PROP_TU, &values[4]) != IRUVC_SUCCESS)
+    {
+        return STREAM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&server->mutex);
+    memcpy(server->calibration, values, sizeof(values));
+    server->calibration_valid = 1;
+    pthread_mutex_unlock(&server->mutex);
+    return STREAM_SUCCESS;
+}
+
+static void stream_calibration_done(int job_id, int result, void* user_data)
+{
+    StreamServer_t* server = (StreamServer_t*)user_data;
+    pthread_mutex_lock(&server->mutex);
+    server->calibration_pending = 0;
+    pthread_cond_broadcast(&server->cond);
+    pthread_mutex_unlock(&server->mutex);
+}
+#endif
+
+//one record of the radiometric or the preview track: the plane as a codec frame plus the roi results in
+//server->roi_info, packetized and queued to the track's clients. a keyframe also asks the module for its
+//calibration again, the answer comes with a later one
+static void stream_radiometric_record(StreamServer_t* server, FrameSlot_t* slot, int track_id, CodecContext_t* codec, \
+    const uint16_t* plane, int roi_num)
+{
+    uint8_t track = (uint8_t)(1 << track_id);
+    uint8_t* coded = server->radiometric + sizeof(StreamRadiometricHeader_t);
+    int coded_size = codec_encode(codec, plane, coded, codec_bound(codec->pix_num), (server->key_wanted & track) != 0);
+    if (coded_size <= 0)
+    {
+        return;
+    }
+    int key = (codec_frame_type(coded, (uint32_t)coded_size) == CODEC_FRAME_KEY);
+    server->key_wanted &= (uint8_t)~track;
+#if !defined(_WIN32)
+    if (key && !server->calibration_pending)
+    {
+        server->calibration_pending = 1;
+        if (cmdq_submit(stream_calibration_query, server, CMDQ_PRIORITY_READ, 0, stream_calibration_done, server, \
+            NULL) != CMDQ_SUCCESS)
+        {
+            server->calibration_pending = 0;
+        }
+    }
+#endif
+    StreamRadiometricHeader_t* header = (StreamRadiometricHeader_t*)server->radiometric;
+    header->magic = STREAM_RADIOMETRIC_MAGIC;
+    header->width = (uint16_t)codec->width;
+    header->height = (uint16_t)codec->height;
+    header->seq = slot->seq;
+    header->timestamp_us = slot->desc.timestamp_us;
+    header->coded_size = (uint32_t)coded_size;
+    header->roi_num = (uint16_t)roi_num;
+    header->version = STREAM_RADIOMETRIC_VERSION;
+    header->flags = (uint16_t)((key ? STREAM_RADIOMETRIC_KEY : 0) | \
+        (server->calibration_valid ? STREAM_RADIOMETRIC_CALIBRATION : 0));
+    header->temp_unit = 1 << TEMP_RAW_SHIFT;
+    header->deadband = codec->deadband;
+    header->gain = server->calibration[0];
+    header->ems = server->calibration[1];
+    header->tau = server->calibration[2];
+    header->ta = server->calibration[3];
+    header->tu = server->calibration[4];
+    StreamRoiResult_t* result = (StreamRoiResult_t*)(coded + coded_size);
+    for (int i = 0; i < roi_num; i++)
+    {
+        result[i].max_temp = server->roi_info[i].max_temp;
+        result[i].min_temp = server->roi_info[i].min_temp;
+        result[i].avr_temp = server->roi_info[i].avr_temp;
+        result[i].reserved = 0;
+        result[i].max_x = (uint16_t)server->roi_info[i].max_cord.x;
+        result[i].max_y = (uint16_t)server->roi_info[i].max_cord.y;
+        result[i].min_x = (uint16_t)server->roi_info[i].min_cord.x;
+        result[i].min_y = (uint16_t)server->roi_info[i].min_cord.y;
+    }
+    uint32_t record_size = sizeof(StreamRadiometricHeader_t) + coded_size + roi_num * sizeof(StreamRoiResult_t);
+
+    StreamPacket_t* packet = stream_packet_alloc(server, record_size + \
+        (record_size / STREAM_RTP_PAYLOAD + 1) * STREAM_RTP_HEADER);
+    if (packet == NULL)
+    {
+        return;
+    }
+    packet->size = 0;
+    packet->track = track;
+    packet->key = (uint8_t)key;
+    if (track_id == 1)
+    {
+        server->stats.radiometric_bytes += record_size;
+        server->stats.radiometric_keys += key;
+    }
+    uint32_t rtp_time = (uint32_t)(slot->desc.timestamp_us * 9 / 100);
+    for (uint32_t offset = 0; offset < record_size; offset += STREAM_RTP_PAYLOAD)
+    {
+        uint32_t chunk = (record_size - offset > STREAM_RTP_PAYLOAD) ? STREAM_RTP_PAYLOAD : record_size - offset;
+        memcpy(stream_rtp_begin(server, packet, track_id, rtp_time, offset + chunk == record_size, chunk), \
+            server->radiometric + offset, chunk);
+    }
+    stream_publish(server, packet);
+}
+
+//ring task: the radiometric and preview records, only while a client plays the track
+static void stream_radiometric_task(FrameSlot_t* slot, void* arg)
+{
+    StreamServer_t* server = (StreamServer_t*)arg;
+    pthread_mutex_lock(&server->mutex);
+    const FramePyramid_t* pyramid = slot->desc.temp_pyramid;
+    uint8_t preview = server->preview_wanted && server->preview_level >= 0 && pyramid != NULL && \
+        server->preview_level < pyramid->level_num;
+    if (!server->running || (!server->radiometric_wanted && !preview) || slot->desc.temp.data == NULL || \
+        server->radiometric == NULL)
+    {
+        pthread_mutex_unlock(&server->mutex);
+        return;
+    }
+    int roi_num = 0;
+    RoiEngine_t* engine = server->param.roi_engine;
+    stab_roi_follow(engine, &slot->desc);
+    if (engine != NULL && engine->roi_num > 0 && \
+        roi_engine_process_tiles(engine, (uint16_t*)slot->desc.temp.data, slot->desc.temp_tiles, \
+            server->roi_info) == ROI_SUCCESS)
+    {
+        roi_num = engine->roi_num;
+    }
+    if (server->radiometric_wanted)
+    {
+        stream_radiometric_record(server, slot, 1, &server->temp_codec, (const uint16_t*)slot->desc.temp.data, \
+            roi_num);
+    }
+    if (preview)
+    {
+        stream_radiometric_record(server, slot, 2, &server->preview_codec, pyramid->level[server->preview_level].max, \
+            roi_num);
+    }
+    pthread_mutex_unlock(&server->mutex);
+}
+
+int stream_server_attach(StreamServer_t* server, StreamFrameInfo_t* stream_frame_info)
+{
+    if (server == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return STREAM_ERROR_PARAM;
+    }
+    memset(server, 0, sizeof(StreamServer_t));
+    server->stream_frame_info = stream_frame_info;
+    server->listen_fd = -1;
+    server->udp_fd = -1;
+    server->preview_level = -1;
+    server->wake_fd[0] = -1;
+    server->wake_fd[1] = -1;
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+    {
+        server->clients[i].fd = -1;
+    }
+    pthread_mutex_init(&server->mutex, NULL);
+    pthread_cond_init(&server->cond, NULL);
+    //viewers want the newest temperatures, not every one
+    server->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEWEST, \
+        POOL_STAGE_ENCODE, stream_radiometric_task, server);
+    if (server->consumer_id < 0)
+    {
+        pthread_cond_destroy(&server->cond);
+        pthread_mutex_destroy(&server->mutex);
+        return STREAM_ERROR_PARAM;
+    }
+    return STREAM_SUCCESS;
+}
+
+#if !defined(_WIN32)
+static void stream_reply(StreamClient_t* client, const char* status, int cseq, const char* headers, \
+    const char* body)
+{
+    uint32_t body_len = (body != NULL) ? (uint32_t)strlen(body) : 0;
+    int len = snprintf(client->reply + client->reply_len, STREAM_REPLY_LEN - client->reply_len, \
+        "RTSP/1.0 %s\r\nCSeq: %d\r\n%s", status, cseq, (headers != NULL) ? headers : "");
+    if (len < 0 || client->reply_len + len >= STREAM_REPLY_LEN)
+    {
+        client->closing = 1;
+        return;
+    }
+    client->reply_len += len;
+    if (body_len > 0)
+    {
+        len = snprintf(client->reply + client->reply_len, STREAM_REPLY_LEN - client->reply_len, \
+            "Content-Length: %u\r\n\r\n%s", body_len, body);
+    }
+    else
+    {
+        len = snprintf(client->reply + client->reply_len, STREAM_REPLY_LEN - client->reply_len, "\r\n");
+    }
+    if (len < 0 || client->reply_len + len >= STREAM_REPLY_LEN)
+    {
+        client->closing = 1;
+        return;
+    }
+    client->reply_len += len;
+}
+
+//value of a request header, empty when it is missing
+static void stream_header_get(const char* request, const char* name, char* value, int value_len)
+{
+    size_t name_len = strlen(name);
+    value[0] = 0;
+    for (const char* line = strstr(request, "\r\n"); line != NULL; line = strstr(line, "\r\n"))
+    {
+        line += 2;
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':')
+        {
+            const char* p = line + name_len + 1;
+            while (*p == ' ')
+            {
+                p++;
+            }
+            int len = 0;
+            while (p[len] != 0 && p[len] != '\r' && len < value_len - 1)
+            {
+                len++;
+            }
+            memcpy(value, p, len);
+            value[len] = 0;
+            return;
+        }
+    }
+}
+
+static void stream_client_request(StreamServer_t* server, StreamClient_t* client, char* request)
+{
+    char method[16] = { 0 }, url[256] = { 0 }, value[256], headers[512];
+    sscanf(request, "%15s %255s", method, url);
+    stream_header_get(request, "CSeq", value, sizeof(value));
+    int cseq = atoi(value);
+    int temp = (server->stream_frame_info->config->temp_byte_size > 0);
+
+    if (strcmp(method, "OPTIONS") == 0)
+    {
+        stream_reply(client, "200 OK", cseq, "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER\r\n", NULL);
+    }
+    else if (strcmp(method, "DESCRIBE") == 0)
+    {
+        char sdp[1024];
+        int len = snprintf(sdp, sizeof(sdp), "v=0\r\no=- 0 0 IN IP4 0.0.0.0\r\ns=ir camera\r\nt=0 0\r\na=control:*\r\n" \
+            "m=video 0 RTP/AVP %d\r\na=rtpmap:%d %s/90000\r\n%sa=control:%s\r\n", STREAM_PT_VIDEO, STREAM_PT_VIDEO, \
+            (server->param.codec == ENCODE_CODEC_HEVC) ? "H265" : "H264", \
+            (server->param.codec == ENCODE_CODEC_HEVC) ? "" : "a=fmtp:96 packetization-mode=1\r\n", \
+            stream_track_names[0]);
+        for (int track_id = 1; temp && track_id < STREAM_TRACK_NUM; track_id++)
+        {
+            if (track_id == 2 && server->preview_level < 0)
+            {
+                continue;
+            }
+            len += snprintf(sdp + len, sizeof(sdp) - len, "m=application 0 RTP/AVP %d\r\na=rtpmap:%d x-ir-radiometric/90000\r\n" \
+                "a=control:%s\r\n", stream_track_pt[track_id], stream_track_pt[track_id], stream_track_names[track_id]);
+        }
+        snprintf(headers, sizeof(headers), "Content-Base: %s/\r\nContent-Type: application/sdp\r\n", url);
+        stream_reply(client, "200 OK", cseq, headers, sdp);
+    }
+    else if (strcmp(method, "SETUP") == 0)
+    {
+        const char* track = strrchr(url, '/');
+        track = (track != NULL) ? track + 1 : url;
+        int track_id = -1;
+        for (int i = 0; i < STREAM_TRACK_NUM; i++)
+        {
+            if (strcmp(track, stream_track_names[i]) == 0 && (i == 0 || temp) && (i != 2 || server->preview_level >= 0))
+            {
+                track_id = i;
+            }
+        }
+        stream_header_get(request, "Transport", value, sizeof(value));
+        int tcp = (strstr(value, "RTP/AVP/TCP") != NULL);
+        const char* client_port = strstr(value, "client_port=");
+        int rtp_port = 0, rtcp_port = 0;
+        if (client_port != NULL && sscanf(client_port, "client_port=%d-%d", &rtp_port, &rtcp_port) < 2)
+        {
+            rtcp_port = rtp_port + 1;
+        }
+        if (track_id < 0)
+        {
+            stream_reply(client, "404 Not Found", cseq, NULL, NULL);
+        }
+        else if (!tcp && (server->udp_fd < 0 || client->udp_addr == 0 || rtp_port <= 0 || rtp_port > 0xFFFF))
+        {
+            //rtp/udp needs the client's port and an ipv4 peer
+            stream_reply(client, "461 Unsupported Transport", cseq, NULL, NULL);
+        }
+        else
+        {
+            if (client->session == 0)
+            {
+                client->session = ++server->session_next;
+            }
+            uint8_t track = (uint8_t)(1 << track_id);
+            client->tracks |= track;
+            if (tcp)
+            {
+                client->udp_tracks &= (uint8_t)~track;
+                snprintf(headers, sizeof(headers), "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d;ssrc=%08X\r\n" \
+                    "Session: %08X\r\n", track_id * 2, track_id * 2 + 1, server->rtp_ssrc[track_id], client->session);
+            }
+            else
+            {
+                client->udp_tracks |= track;
+                client->udp_port[track_id] = htons((uint16_t)rtp_port);
+                snprintf(headers, sizeof(headers), "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%u-%u;" \
+                    "ssrc=%08X\r\nSession: %08X\r\n", rtp_port, rtcp_port, server->param.port, server->param.port + 1, \
+                    server->rtp_ssrc[track_id], client->session);
+            }
+            stream_reply(client, "200 OK", cseq, headers, NULL);
+        }
+    }
+    else if (strcmp(method, "PLAY") == 0)
+    {
+        if (client->tracks == 0)
+        {
+            stream_reply(client, "455 Method Not Valid in This State", cseq, NULL, NULL);
+            return;
+        }
+        snprintf(headers, sizeof(headers), "Session: %08X\r\nRange: npt=0.000-\r\n", client->session);
+        stream_reply(client, "200 OK", cseq, headers, NULL);
+        //every track starts at a keyframe, the radiometric ones code the next record as one
+        client->playing = 1;
+        client->wait_key = client->tracks;
+        server->key_wanted |= (uint8_t)(client->tracks & (STREAM_TRACK_RADIOMETRIC | STREAM_TRACK_PREVIEW));
+        stream_wanted_update(server);
+    }
+    else if (strcmp(method, "TEARDOWN") == 0)
+    {
+        stream_reply(client, "200 OK", cseq, NULL, NULL);
+        client->playing = 0;
+        client->closing = 1;
+        stream_client_reset(server, client);
+        stream_wanted_update(server);
+    }
+    else if (strcmp(method, "GET_PARAMETER") == 0 || strcmp(method, "SET_PARAMETER") == 0)
+    {
+        //keep alive
+        stream_reply(client, "200 OK", cseq, NULL, NULL);
+    }
+    else
+    {
+        stream_reply(client, "501 Not Implemented", cseq, NULL, NULL);
+    }
+}
+
+static void stream_client_close(StreamServer_t* server, StreamClient_t* client)
+{
+    stream_client_reset(server, client);
+    close(client->fd);
+    memset(client, 0, sizeof(StreamClient_t));
+    client->fd = -1;
+    stream_wanted_update(server);
+}
+
+//returns -1 when the connection is gone
+static int stream_client_read(StreamServer_t* server, StreamClient_t* client)
+{
+    int len = (int)recv(client->fd, client->request + client->request_len, \
+        STREAM_REQUEST_LEN - 1 - client->request_len, 0);
+    if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+        return -1;
+    }
+    if (len < 0)
+    {
+        return 0;
+    }
+    client->request_len += len;
+    while (client->request_len > 0)
+    {
+        uint32_t used = 0;
+        if (client->skip > 0)
+        {
+            used = (client->skip < client->request_len) ? client->skip : client->request_len;
+            client->skip -= used;
+        }
+        else if (client->request[0] == '$')
+        {
+            //rtcp receiver reports on the interleaved channels are not used
+            if (client->request_len < 4)
+            {
+                break;
+            }
+            client->skip = 4 + (((uint8_t)client->request[2] << 8) | (uint8_t)client->request[3]);
+            continue;
+        }
+        else
+        {
+            client->request[client->request_len] = 0;
+            char* end = strstr(client->request, "\r\n\r\n");
+            if (end == NULL)
+            {
+                return (client->request_len == STREAM_REQUEST_LEN - 1) ? -1 : 0;
+            }
+            end[2] = 0;
+            stream_client_request(server, client, client->request);
+            used = (uint32_t)(end + 4 - client->request);
+        }
+        memmove(client->request, client->request + used, client->request_len - used);
+        client->request_len -= used;
+    }
+    return 0;
+}
+
+static int stream_send(StreamServer_t* server, int fd, const uint8_t* data, uint32_t size, uint32_t* sent)
+{
+    while (*sent < size)
+    {
+        int len = (int)send(fd, data + *sent, size - *sent, MSG_NOSIGNAL);
+        if (len < 0)
+        {
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        }
+        *sent += len;
+        server->stats.bytes += len;
+    }
+    return 1;
+}
+
+#if !defined(__linux__)
+struct mmsghdr
+{
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+
+static int sendmmsg(int fd, struct mmsghdr* msgs, unsigned int num, int flags)
+{
+    unsigned int i = 0;
+    for (; i < num; i++)
+    {
+        int len = (int)sendmsg(fd, &msgs[i].msg_hdr, flags);
+        if (len < 0)
+        {
+            return (i > 0) ? (int)i : -1;
+        }
+        msgs[i].msg_len = (unsigned int)len;
+    }
+    return (int)i;
+}
+#endif
+
+//the udp frames at the head of the client's queue, from queue_sent on, in one sendmmsg: every rtp packet is one
+//iovec of the shared interleaved buffer without its 4 byte prefix, and with gso a run of full sized packets of one
+//track goes out as one message the kernel splits into datagrams. what the socket did not take stays queued.
+//returns the messages sent
+static int stream_client_send_udp(StreamServer_t* server, StreamClient_t* client)
+{
+    struct mmsghdr msgs[STREAM_UDP_BATCH];
+    struct iovec iovs[STREAM_UDP_BATCH * STREAM_UDP_SEGMENTS];
+    struct sockaddr_in addrs[STREAM_UDP_BATCH];
+    uint32_t ends[STREAM_UDP_BATCH][2];     //queue position after each message: frames done, offset in the next
+    uint32_t segments[STREAM_UDP_BATCH];
+    uint32_t segment_size[STREAM_UDP_BATCH];
+#if defined(__linux__)
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    }control[STREAM_UDP_BATCH];
+#endif
+    int msg_num = 0;
+    int last_track = -1;
+    uint32_t frames = 0;
+    uint32_t offset = client->queue_sent;
+    while (frames < client->queue_num)
+    {
+        StreamPacket_t* packet = client->queue[(client->queue_head + frames) % STREAM_CLIENT_QUEUE];
+        if (!(client->udp_tracks & packet->track))
+        {
+            break;
+        }
+        const uint8_t* p = packet->data + offset;
+        int track_id = p[1] / 2;
+        uint32_t size = ((uint32_t)p[2] << 8) | p[3];
+        int m = msg_num - 1;
+        //a run continues with a packet of the run's size, the one shorter packet ends it
+        if (!(server->udp_gso && m >= 0 && track_id == last_track && segments[m] < STREAM_UDP_SEGMENTS && \
+            size <= segment_size[m] && iovs[m * STREAM_UDP_SEGMENTS + segments[m] - 1].iov_len == segment_size[m]))
+        {
+            if (msg_num == STREAM_UDP_BATCH)
+            {
+                break;
+            }
+            m = msg_num++;
+            memset(&msgs[m], 0, sizeof(struct mmsghdr));
+            memset(&addrs[m], 0, sizeof(struct sockaddr_in));
+            addrs[m].sin_family = AF_INET;
+            addrs[m].sin_addr.s_addr = client->udp_addr;
+            addrs[m].sin_port = client->udp_port[track_id];
+            msgs[m].msg_hdr.msg_name = &addrs[m];
+            msgs[m].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msgs[m].msg_hdr.msg_iov = &iovs[m * STREAM_UDP_SEGMENTS];
+            segments[m] = 0;
+            segment_size[m] = size;
+            last_track = track_id;
+        }
+        iovs[m * STREAM_UDP_SEGMENTS + segments[m]].iov_base = (void*)(p + 4);
+        iovs[m * STREAM_UDP_SEGMENTS + segments[m]].iov_len = size;
+        segments[m]++;
+        offset += 4 + size;
+        if (offset >= packet->size)
+        {
+            frames++;
+            offset = 0;
+        }
+        ends[m][0] = frames;
+        ends[m][1] = offset;
+    }
+    if (msg_num == 0)
+    {
+        return 0;
+    }
+    for (int m = 0; m < msg_num; m++)
+    {
+        msgs[m].msg_hdr.msg_iovlen = segments[m];
+#if defined(__linux__)
+        if (segments[m] > 1)
+        {
+            msgs[m].msg_hdr.msg_control = control[m].buf;
+            msgs[m].msg_hdr.msg_controllen = sizeof(control[m].buf);
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msgs[m].msg_hdr);
+            cmsg->cmsg_level = IPPROTO_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso_size = (uint16_t)segment_size[m];
+            memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+        }
+#endif
+    }
+    int sent = sendmmsg(server->udp_fd, msgs, (unsigned int)msg_num, 0);
+    server->stats.udp_calls++;
+    if (sent < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ENOBUFS)
+        {
+            return 0;
+        }
+        if (segments[0] > 1 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP))
+        {
+            //no gso on this kernel or route, the next call sends every packet alone
+            server->udp_gso = 0;
+            return 0;
+        }
+        //refused for good (no route, icmp unreachable), the message is dropped and the rest goes on
+        server->stats.udp_dropped += segments[0];
+        sent = 1;
+        msgs[0].msg_len = 0;
+    }
+    uint32_t done = ends[sent - 1][0];
+    for (int m = 0; m < sent; m++)
+    {
+        if (msgs[m].msg_len > 0)
+        {
+            server->stats.udp_datagrams += segments[m];
+            server->stats.bytes += msgs[m].msg_len;
+        }
+    }
+    for (uint32_t i = 0; i < done; i++)
+    {
+        stream_packet_release(server, client->queue[client->queue_head]);
+        client->queue_head = (client->queue_head + 1) % STREAM_CLIENT_QUEUE;
+        client->queue_num--;
+    }
+    client->queue_sent = ends[sent - 1][1];
+    return sent;
+}
+
+//a started packet is finished before a reply goes out, then the queued frames follow
+//returns -1 when the connection is gone
+static int stream_client_flush(StreamServer_t* server, StreamClient_t* client)
+{
+    int first = (client->queue_sent > 0);
+    for (;;)
+    {
+        if (!first && client->reply_sent < client->reply_len)
+        {
+            int rst = stream_send(server, client->fd, (const uint8_t*)client->reply, client->reply_len, \
+                &client->reply_sent);
+            if (rst <= 0)
+            {
+                return rst;
+            }
+            client->reply_len = 0;
+            client->reply_sent = 0;
+        }
+        if (client->queue_num == 0)
+        {
+            return 0;
+        }
+        StreamPacket_t* packet = client->queue[client->queue_head];
+        if (client->udp_tracks & packet->track)
+        {
+            if (stream_client_send_udp(server, client) == 0)
+            {
+                return 0;
+            }
+            first = 0;
+            continue;
+        }
+        int rst = stream_send(server, client->fd, packet->data, packet->size, &client->queue_sent);
+        if (rst <= 0)
+        {
+            return rst;
+        }
+        stream_packet_release(server, packet);
+        client->queue_head = (client->queue_head + 1) % STREAM_CLIENT_QUEUE;
+        client->queue_num--;
+        client->queue_sent = 0;
+        first = 0;
+    }
+}
+
+static void stream_accept(StreamServer_t* server)
+{
+    int fd = accept(server->listen_fd, NULL, NULL);
+    if (fd < 0)
+    {
+        return;
+    }
+    StreamClient_t* client = NULL;
+    for (int i = 0; i < STREAM_MAX_CLIENTS && client == NULL; i++)
+    {
+        if (server->clients[i].fd < 0)
+        {
+            client = &server->clients[i];
+        }
+    }
+    if (client == NULL)
+    {
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    memset(client, 0, sizeof(StreamClient_t));
+    client->fd = fd;
+    struct sockaddr_in peer;
+    socklen_t peer_len = sizeof(peer);
+    if (getpeername(fd, (struct sockaddr*)&peer, &peer_len) == 0 && peer.sin_family == AF_INET)
+    {
+        client->udp_addr = peer.sin_addr.s_addr;
+    }
+    server->stats.clients++;
+}
+
+//server thread: accepts, answers rtsp requests and sends the queued frames
+static void* stream_server_function(void* threadarg)
+{
+    StreamServer_t* server = (StreamServer_t*)threadarg;
+    struct pollfd pfds[STREAM_MAX_CLIENTS + 2];
+    int pfd_client[STREAM_MAX_CLIENTS + 2];
+    pthread_mutex_lock(&server->mutex);
+    while (server->running)
+    {
+        int pfd_num = 0;
+        pfds[pfd_num].fd = server->listen_fd;
+        pfds[pfd_num].events = POLLIN;
+        pfd_client[pfd_num++] = -1;
+        pfds[pfd_num].fd = server->wake_fd[0];
+        pfds[pfd_num].events = POLLIN;
+        pfd_client[pfd_num++] = -1;
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+        {
+            StreamClient_t* client = &server->clients[i];
+            if (client->fd < 0)
+            {
+                continue;
+            }
+            pfds[pfd_num].fd = client->fd;
+            pfds[pfd_num].events = POLLIN;
+            //udp frames at the head do not wait for the connection, they go with the next wake
+            if (client->reply_sent < client->reply_len || (client->queue_num > 0 && \
+                !(client->udp_tracks & client->queue[client->queue_head]->track)))
+            {
+                pfds[pfd_num].events |= POLLOUT;
+            }
+            pfd_client[pfd_num++] = i;
+        }
+        pthread_mutex_unlock(&server->mutex);
+        poll(pfds, pfd_num, STREAM_POLL_MS);
+        pthread_mutex_lock(&server->mutex);
+
+        if (pfds[1].revents & POLLIN)
+        {
+            uint8_t wake[64];
+            while (read(server->wake_fd[0], wake, sizeof(wake)) > 0)
+            {
+            }
+        }
+        if (pfds[0].revents & POLLIN)
+        {
+            stream_accept(server);
+        }
+        for (int n = 2; n < pfd_num; n++)
+        {
+            StreamClient_t* client = &server->clients[pfd_client[n]];
+            //a client dropped by a publisher while polling
+            if (client->fd != pfds[n].fd)
+            {
+                continue;
+            }
+            if ((pfds[n].revents & (POLLERR | POLLHUP | POLLNVAL)) || \
+                ((pfds[n].revents & POLLIN) && stream_client_read(server, client) < 0))
+            {
+                stream_client_close(server, client);
+            }
+        }
+        //frames queued while polling are sent without waiting for POLLOUT
+        for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+        {
+            StreamClient_t* client = &server->clients[i];
+            if (client->fd < 0)
+            {
+                continue;
+            }
+            if (stream_client_flush(server, client) < 0 || \
+                (client->closing && client->reply_sent == client->reply_len && client->queue_num == 0))
+            {
+                stream_client_close(server, client);
+            }
+        }
+    }
+    pthread_mutex_unlock(&server->mutex);
+    return NULL;
+}
+
+//bind the port, open the wake pipe, size the radiometric record and start the server thread
+int stream_server_start(StreamServer_t* server, const StreamServerParam_t* param)
+{
+    if (server == NULL || param == NULL || server->stream_frame_info == NULL || server->running)
+    {
+        return STREAM_ERROR_PARAM;
+    }
+    server->param = *param;
+    if (server->param.port == 0)
+    {
+        server->param.port = STREAM_DEFAULT_PORT;
+    }
+    const FrameInfo_t* temp_info = &server->stream_frame_info->config->temp_info;
+    if (server->stream_frame_info->config->temp_byte_size > 0)
+    {
+        uint32_t key_interval = (server->param.key_interval > 0) ? server->param.key_interval : \
+            STREAM_RADIOMETRIC_DEFAULT_KEY_INTERVAL;
+        uint16_t deadband = (server->param.deadband < 0x8000) ? server->param.deadband : 0x7FFF;
+        if (codec_init(&server->temp_codec, temp_info->width, temp_info->height, key_interval) != CODEC_SUCCESS)
+        {
+            return STREAM_ERROR_MEM;
+        }
+        server->temp_codec.deadband = deadband;
+        server->radiometric = (uint8_t*)malloc(sizeof(StreamRadiometricHeader_t) + \
+            codec_bound(server->temp_codec.pix_num) + ROI_MAX_NUM * sizeof(StreamRoiResult_t));
+        if (server->radiometric == NULL)
+        {
+            codec_release(&server->temp_codec);
+            return STREAM_ERROR_MEM;
+        }
+        //the finest pyramid level the shift asks for that the plane has, the ring builds it with every frame
+        int shift = (server->param.preview_shift > 0) ? server->param.preview_shift : STREAM_PREVIEW_DEFAULT_SHIFT;
+        for (server->preview_level = shift - 1; server->preview_level >= 0; server->preview_level--)
+        {
+            int width = 0, height = 0;
+            frame_pyramid_level_size(temp_info->width, temp_info->height, server->preview_level, &width, &height);
+            if (server->preview_level < FRAME_PYRAMID_MAX_LEVELS && width >= FRAME_PYRAMID_MIN_WIDTH && \
+                height >= FRAME_PYRAMID_MIN_HEIGHT)
+            {
+                if (codec_init(&server->preview_codec, width, height, key_interval) != CODEC_SUCCESS)
+                {
+                    server->preview_level = -1;
+                }
+                server->preview_codec.deadband = deadband;
+                break;
+            }
+        }
+    }
+
+    server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(server->param.port);
+    if (server->listen_fd < 0 || \
+        setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 || \
+        bind(server->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(server->listen_fd, 4) < 0 || \
+        pipe(server->wake_fd) < 0)
+    {
+        printf("stream server: listen on port %u failed\n", server->param.port);
+        stream_server_stop(server);
+        return STREAM_ERROR_SOCKET;
+    }
+    fcntl(server->listen_fd, F_SETFL, fcntl(server->listen_fd, F_GETFL, 0) | O_NONBLOCK);
+    //rtp/udp goes out of one socket on the rtsp port number, without it the clients get the interleaved transport
+    server->udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (server->udp_fd >= 0 && bind(server->udp_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        close(server->udp_fd);
+        server->udp_fd = -1;
+    }
+    if (server->udp_fd >= 0)
+    {
+        int sndbuf = 1 << 20;
+        setsockopt(server->udp_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        fcntl(server->udp_fd, F_SETFL, fcntl(server->udp_fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+#if defined(__linux__)
+    server->udp_gso = 1;
+#endif
+    fcntl(server->wake_fd[0], F_SETFL, fcntl(server->wake_fd[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(server->wake_fd[1], F_SETFL, fcntl(server->wake_fd[1], F_GETFL, 0) | O_NONBLOCK);
+
+    uint64_t now_us = get_monotonic_us();
+    server->rtp_ssrc[0] = (uint32_t)(now_us * 2654435761u);
+    server->rtp_ssrc[1] = server->rtp_ssrc[0] ^ 0x5A5A5A5A;
+    server->rtp_ssrc[2] = server->rtp_ssrc[0] ^ 0xA5A5A5A5;
+    server->rtp_seq[0] = (uint16_t)now_us;
+    server->rtp_seq[1] = (uint16_t)(now_us >> 16);
+    server->rtp_seq[2] = (uint16_t)(now_us >> 32);
+    memset(&server->stats, 0, sizeof(StreamServerStats_t));
+    server->running = 1;
+    if (pthread_create(&server->thread, NULL, stream_server_function, server) != 0)
+    {
+        server->running = 0;
+        stream_server_stop(server);
+        return STREAM_ERROR_SOCKET;
+    }
+    printf("stream server: rtsp://<host>:%u/ (tcp interleaved%s)\n", server->param.port, \
+        (server->udp_fd >= 0) ? ", rtp/udp" : "");
+    return STREAM_SUCCESS;
+}
+
+int stream_server_stop(StreamServer_t* server)
+{
+    if (server == NULL)
+    {
+        return STREAM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&server->mutex);
+    int running = server->running;
+    server->running = 0;
+    pthread_mutex_unlock(&server->mutex);
+    if (running)
+    {
+        uint8_t wake = 1;
+        if (write(server->wake_fd[1], &wake, 1) < 0)
+        {
+        }
+        pthread_join(server->thread, NULL);
+    }
+
+    pthread_mutex_lock(&server->mutex);
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++)
+    {
+        if (server->clients[i].fd >= 0)
+        {
+            stream_client_close(server, &server->clients[i]);
+        }
+    }
+    if (server->listen_fd >= 0)
+    {
+        close(server->listen_fd);
+        server->listen_fd = -1;
+    }
+    if (server->udp_fd >= 0)
+    {
+        close(server->udp_fd);
+        server->udp_fd = -1;
+    }
+    //a calibration query still out finishes against the mutex
+    while (server->calibration_pending)
+    {
+        pthread_cond_wait(&server->cond, &server->mutex);
+    }
+    server->calibration_valid = 0;
+    server->key_wanted = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        if (server->wake_fd[i] >= 0)
+        {
+            close(server->wake_fd[i]);
+            server->wake_fd[i] = -1;
+        }
+    }
+    for (int i = 0; i < server->cache_num; i++)
+    {
+        free(server->cache[i]->data);
+        free(server->cache[i]);
+    }
+    server->cache_num = 0;
+    free(server->radiometric);
+    server->radiometric = NULL;
+    codec_release(&server->temp_codec);
+    codec_release(&server->preview_codec);
+    server->preview_level = -1;
+    pthread_mutex_unlock(&server->mutex);
+    if (running)
+    {
+        printf("stream server: %llu clients, %llu dropped as too slow, %llu frames, %llu bytes sent, " \
+            "%llu radiometric bytes (%llu keyframes), %llu udp datagrams in %llu calls, %llu dropped\n", \
+            (unsigned long long)server->stats.clients, (unsigned long long)server->stats.dropped_clients, \
+            (unsigned long long)server->stats.frames, (unsigned long long)server->stats.bytes, \
+            (unsigned long long)server->stats.radiometric_bytes, (unsigned long long)server->stats.radiometric_keys, \
+            (unsigned long long)server->stats.udp_datagrams, (unsigned long long)server->stats.udp_calls, \
+            (unsigned long long)server->stats.udp_dropped);
+    }
+    return STREAM_SUCCESS;
+}
+#else
+int stream_server_start(StreamServer_t* server, const StreamServerParam_t* param)
+{
+    //the server is written against posix sockets and poll
+    return STREAM_ERROR_SOCKET;
+}
+
+int stream_server_stop(StreamServer_t* server)
+{
+    return STREAM_SUCCESS;
+}
+#endif
+
+int stream_server_stats(StreamServer_t* server, StreamServerStats_t* stats)
+{
+    if (server == NULL || stats == NULL)
+    {
+        return STREAM_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&server->mutex);
+    *stats = server->stats;
+    pthread_mutex_unlock(&server->mutex);
+    return STREAM_SUCCESS;
+}
@@ -0,0 +1,182 @@
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+#include "codec.h"
+#include "encode.h"
+#include "roi.h"
+
+#define STREAM_DEFAULT_PORT 8554
+#define STREAM_MAX_CLIENTS 8
+#define STREAM_CLIENT_QUEUE 64          //frames waiting for one client, a client falling further behind is closed
+#define STREAM_PACKET_CACHE 16          //released frame buffers kept for reuse
+#define STREAM_RTP_PAYLOAD 1400         //bytes of one rtp packet's payload
+#define STREAM_UDP_BATCH 64             //datagrams, or segmented messages, of one sendmmsg
+#define STREAM_UDP_SEGMENTS 32          //rtp packets of one UDP_SEGMENT message, 32 * 1412 is under 64k
+#define STREAM_REQUEST_LEN 2048
+#define STREAM_REPLY_LEN 2048
+
+#define STREAM_SUCCESS 0
+#define STREAM_ERROR_PARAM -1
+#define STREAM_ERROR_MEM -2
+#define STREAM_ERROR_SOCKET -3
+
+//rtsp tracks a client can SETUP, each uses a fixed interleaved channel pair
+#define STREAM_TRACK_VIDEO 0x1          //the encoder's h264/h265, interleaved=0-1
+#define STREAM_TRACK_RADIOMETRIC 0x2    //coded temp frames and roi results, interleaved=2-3
+#define STREAM_TRACK_PREVIEW 0x4        //the same records of a temp pyramid level's max plane, interleaved=4-5
+#define STREAM_TRACK_NUM 3
+#define STREAM_PREVIEW_DEFAULT_SHIFT 2  //the preview is a quarter of the plane's width and height
+#define STREAM_RADIOMETRIC_DEFAULT_KEY_INTERVAL 100    //records per keyframe, a client that joins asks for one at once
+
+#define STREAM_RADIOMETRIC_MAGIC 0x4D525249 //"IRRM"
+#define STREAM_RADIOMETRIC_VERSION 2
+
+//StreamRadiometricHeader_t flags
+#define STREAM_RADIOMETRIC_KEY 0x1      //the plane is a codec keyframe, a client starts decoding here
+#define STREAM_RADIOMETRIC_CALIBRATION 0x2  //gain, ems, tau, ta and tu are the module's
+
+//one record of the radiometric track, split over rtp packets of one timestamp, the last one has the marker bit
+//followed by coded_size bytes of the temp plane (codec.h frame) and roi_num StreamRoiResult_t. the planes are a
+//keyframe every key interval and delta frames against the record before in between, a client that lost a record
+//(rtp/udp, the sequence numbers tell) waits for the next keyframe. a preview record has the pyramid level's size
+//and its plane is the level's max, every hotspot survives; the roi results stay in full plane coordinates
+typedef struct {
+    uint32_t magic;
+    uint16_t width;
+    uint16_t height;
+    uint64_t seq;
+    uint64_t timestamp_us;
+    uint32_t coded_size;
+    uint16_t roi_num;
+    uint16_t version;                   //STREAM_RADIOMETRIC_VERSION
+    uint16_t flags;                     //STREAM_RADIOMETRIC_xxx
+    uint16_t temp_unit;                 //raw temp values per kelvin, celsius = value / temp_unit - 273.15
+    uint16_t deadband;                  //largest raw error a delta record leaves in a pixel, 0 lossless
+    uint16_t gain;                      //TPD_PROP_GAIN_SEL, EMS, TAU, TA and TU as prop_tpd_get returns
+    uint16_t ems;                       //them, the last ones known, with STREAM_RADIOMETRIC_CALIBRATION
+    uint16_t tau;
+    uint16_t ta;
+    uint16_t tu;
+}StreamRadiometricHeader_t;
+
+//a roi engine result, raw temp values (kelvin * 64, temp_value_converter gives celsius)
+typedef struct {
+    uint16_t max_temp;
+    uint16_t min_temp;
+    uint16_t avr_temp;
+    uint16_t reserved;
+    uint16_t max_x;
+    uint16_t max_y;
+    uint16_t min_x;
+    uint16_t min_y;
+}StreamRoiResult_t;
+
+//a frame's interleaved rtp packets, shared by every client it is queued to
+typedef struct {
+    int ref;                            //queues holding it, under the server mutex
+    uint32_t size;
+    uint32_t capacity;
+    uint8_t track;
+    uint8_t key;                        //the frame starts a gop or is a radiometric keyframe, a client starts with one
+    uint8_t* data;
+}StreamPacket_t;
+
+typedef struct {
+    int fd;                             //-1 for a free entry
+    uint32_t session;
+    uint8_t tracks;                     //STREAM_TRACK_xxx set up
+    uint8_t playing;
+    uint8_t wait_key;                   //STREAM_TRACK_xxx whose packets are skipped up to the next keyframe
+    uint8_t udp_tracks;                 //tracks set up over rtp/udp, the others go interleaved
+    uint32_t udp_addr;                  //the client's address, network order
+    uint16_t udp_port[STREAM_TRACK_NUM];    //rtp port of each udp track, network order
+    uint8_t closing;                    //close once the reply is sent
+    char request[STREAM_REQUEST_LEN];
+    uint32_t request_len;
+    uint32_t skip;                      //bytes of an interleaved rtcp packet from the client still to discard
+    char reply[STREAM_REPLY_LEN];
+    uint32_t reply_len;
+    uint32_t reply_sent;
+    StreamPacket_t* queue[STREAM_CLIENT_QUEUE];
+    uint32_t queue_head;
+    uint32_t queue_num;
+    uint32_t queue_sent;                //bytes of the head packet already sent
+}StreamClient_t;
+
+typedef struct {
+    uint16_t port;                      //0 selects STREAM_DEFAULT_PORT
+    EncodeCodec_t codec;                //what the encoder feeding stream_server_video_packet produces
+    RoiEngine_t* roi_engine;            //rois reported on the radiometric track, NULL reports none
+    uint8_t preview_shift;              //the preview track is 1 << preview_shift times smaller on each axis,
+                                        //0 selects STREAM_PREVIEW_DEFAULT_SHIFT, the coarsest level caps it
+    uint32_t key_interval;              //radiometric and preview records per keyframe, 0 selects
+                                        //STREAM_RADIOMETRIC_DEFAULT_KEY_INTERVAL, 1 makes every record a keyframe
+    uint16_t deadband;                  //raw temp error a delta record may leave in a pixel, 0 lossless. sensor
+                                        //noise below it costs no bits, a static scene codes to its block widths
+}StreamServerParam_t;
+
+typedef struct {
+    uint64_t clients;                   //accepted connections
+    uint64_t dropped_clients;           //closed because their queue was full
+    uint64_t frames;                    //frames packetized, video, radiometric and preview
+    uint64_t bytes;                     //bytes sent to all clients
+    uint64_t radiometric_bytes;         //records coded for the radiometric track, keyframes and deltas
+    uint64_t radiometric_keys;
+    uint64_t udp_datagrams;             //rtp packets sent over udp
+    uint64_t udp_calls;                 //sendmmsg calls that sent them
+    uint64_t udp_dropped;               //rtp packets the kernel refused for good
+}StreamServerStats_t;
+
+//rtsp server, rtp interleaved over the rtsp connection or rtp/udp per track. every frame is packetized once and
+//queued to each playing client, udp clients get their queue in batches of sendmmsg, runs of full sized packets
+//as one UDP_SEGMENT (gso) message each where the kernel has it
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    StreamServerParam_t param;
+    int consumer_id;
+    uint8_t running;
+    int listen_fd;
+    int wake_fd[2];                     //a queued frame wakes the server thread
+    int udp_fd;                         //rtp/udp sends to every client, bound to param.port, -1 without
+    uint8_t udp_gso;                    //UDP_SEGMENT works, cleared when the kernel refuses it
+    StreamClient_t clients[STREAM_MAX_CLIENTS];
+    uint32_t session_next;
+    uint16_t rtp_seq[STREAM_TRACK_NUM]; //per track, shared by all clients
+    uint32_t rtp_ssrc[STREAM_TRACK_NUM];
+    uint8_t radiometric_wanted;         //a playing client has the radiometric track
+    uint8_t preview_wanted;
+    uint8_t key_wanted;                 //STREAM_TRACK_xxx whose next record is a keyframe, for a client that joined
+    uint8_t calibration_valid;
+    uint8_t calibration_pending;        //a cmdq query is out
+    uint16_t calibration[5];            //gain, ems, tau, ta, tu as last read
+    int preview_level;                  //the temp pyramid level of the preview track, -1 without one
+    CodecContext_t temp_codec;
+    CodecContext_t preview_codec;
+    TempInfo_t roi_info[ROI_MAX_NUM];
+    uint8_t* radiometric;               //one record before packetizing
+    StreamPacket_t* cache[STREAM_PACKET_CACHE];
+    int cache_num;
+    StreamServerStats_t stats;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;                //the calibration query ended
+}StreamServer_t;
+
+//register the radiometric track as a task consumer of the camera's frame ring, before streaming
+int stream_server_attach(StreamServer_t* server, StreamFrameInfo_t* stream_frame_info);
+
+//listen on param->port and serve clients from a server thread
+int stream_server_start(StreamServer_t* server, const StreamServerParam_t* param);
+
+//close every client and the listening socket
+int stream_server_stop(StreamServer_t* server);
+
+//EncodePacketFunc_t of the video track, arg is the server
+void stream_server_video_packet(const uint8_t* data, uint32_t size, uint64_t timestamp_us, int key, void* arg);
+
+int stream_server_stats(StreamServer_t* server, StreamServerStats_t* stats);
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef _SYNC_H_
+#define _SYNC_H_
+
+//the lock and condition variable of the frame hand-offs. windows gets the native slim reader/writer lock and
+//condition variable (no kernel object, no pthreadVC2 emulation in the frame path), elsewhere they are pthread's.
+//header only, locks are taken exclusively
+#include <stdint.h>
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#define SYNC_SUCCESS 0
+#define SYNC_TIMEOUT 1
+
+#if defined(_WIN32)
+typedef SRWLOCK sync_mutex_t;
+typedef CONDITION_VARIABLE sync_cond_t;
+typedef ULONGLONG sync_deadline_t;      //GetTickCount64 ms
+#else
+typedef pthread_mutex_t sync_mutex_t;
+typedef pthread_cond_t sync_cond_t;
+typedef struct timespec sync_deadline_t;    //CLOCK_REALTIME of pthread_cond_timedwait
+#endif
+
+#if defined(_WIN32)
+#define SYNC_MUTEX_INITIALIZER SRWLOCK_INIT
+#define SYNC_COND_INITIALIZER CONDITION_VARIABLE_INIT
+#else
+#define SYNC_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define SYNC_COND_INITIALIZER PTHREAD_COND_INITIALIZER
+#endif
+
+static inline void sync_mutex_init(sync_mutex_t* mutex)
+{
+#if defined(_WIN32)
+    InitializeSRWLock(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+static inline void sync_mutex_destroy(sync_mutex_t* mutex)
+{
+#if defined(_WIN32)
+    (void)mutex;
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+static inline void sync_mutex_lock(sync_mutex_t* mutex)
+{
+#if defined(_WIN32)
+    AcquireSRWLockExclusive(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+static inline void sync_mutex_unlock(sync_mutex_t* mutex)
+{
+#if defined(_WIN32)
+    ReleaseSRWLockExclusive(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+static inline void sync_cond_init(sync_cond_t* cond)
+{
+#if defined(_WIN32)
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+static inline void sync_cond_destroy(sync_cond_t* cond)
+{
+#if defined(_WIN32)
+    (void)cond;
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+static inline void sync_cond_broadcast(sync_cond_t* cond)
+{
+#if defined(_WIN32)
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+static inline void sync_cond_signal(sync_cond_t* cond)
+{
+#if defined(_WIN32)
+    WakeConditionVariable(cond);
+#else
+    pthread_cond_signal(cond);
+#endif
+}
+
+//wait with mutex held until signaled, wakeups can be spurious
+static inline void sync_cond_wait(sync_cond_t* cond, sync_mutex_t* mutex)
+{
+#if defined(_WIN32)
+    SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+//timeout_ms from now, one deadline serves every wait of a loop
+static inline void sync_deadline_set(sync_deadline_t* deadline, uint32_t timeout_ms)
+{
+#if defined(_WIN32)
+    *deadline = GetTickCount64() + timeout_ms;
+#else
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += timeout_ms / 1000;
+    deadline->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+#endif
+}
+
+//wait with mutex held until signaled or the deadline passed, SYNC_TIMEOUT then. wakeups can be spurious
+static inline int sync_cond_wait_until(sync_cond_t* cond, sync_mutex_t* mutex, const sync_deadline_t* deadline)
+{
+#if defined(_WIN32)
+    ULONGLONG now = GetTickCount64();
+    if (now >= *deadline)
+    {
+        return SYNC_TIMEOUT;
+    }
+    if (!SleepConditionVariableSRW(cond, mutex, (DWORD)(*deadline - now), 0))
+    {
+        return (GetLastError() == ERROR_TIMEOUT) ? SYNC_TIMEOUT : SYNC_SUCCESS;
+    }
+    return SYNC_SUCCESS;
+#else
+    return (pthread_cond_timedwait(cond, mutex, deadline) != 0) ? SYNC_TIMEOUT : SYNC_SUCCESS;
+#endif
+}
+
+#endif
@@ -0,0 +1,305 @@
+#include "tau.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+int tau_corrector_init(TauCorrector_t* corrector, TempCalInfo_t* temp_cal_info, const uint16_t* correct_table, \
+    float ems, float ta)
+{
+    if (corrector == NULL || temp_cal_info == NULL || correct_table == NULL)
+    {
+        return TAU_ERROR_PARAM;
+    }
+    memset(corrector, 0, sizeof(TauCorrector_t));
+    corrector->temp_cal_info = temp_cal_info;
+    corrector->correct_table = correct_table;
+    corrector->ems = ems;
+    corrector->ta = ta;
+    corrector->org_celsius = (float*)malloc(TEMP_LUT_SIZE * sizeof(float));
+    corrector->temp_map = (uint16_t*)malloc(TAU_BUCKET_MAX * TEMP_LUT_SIZE * sizeof(uint16_t));
+    if (corrector->org_celsius == NULL || corrector->temp_map == NULL)
+    {
+        tau_corrector_release(corrector);
+        return TAU_ERROR_MEM;
+    }
+    return TAU_SUCCESS;
+}
+
+void tau_corrector_release(TauCorrector_t* corrector)
+{
+    if (corrector == NULL)
+    {
+        return;
+    }
+    free(corrector->org_celsius);
+    free(corrector->temp_map);
+    corrector->org_celsius = NULL;
+    corrector->temp_map = NULL;
+    corrector->dist_num = 0;
+    corrector->org_valid = 0;
+}
+
+int tau_corrector_add_dist(TauCorrector_t* corrector, float dist)
+{
+    if (corrector == NULL || corrector->temp_map == NULL || dist < 0.25f || dist > 49.99f)
+    {
+        return TAU_ERROR_PARAM;
+    }
+    if (corrector->dist_num >= TAU_BUCKET_MAX)
+    {
+        return TAU_ERROR_FULL;
+    }
+    corrector->dist[corrector->dist_num] = dist;
+    corrector->dist_ems[corrector->dist_num] = corrector->ems;
+    corrector->dist_own_ems[corrector->dist_num] = 0;
+    corrector->dist_valid[corrector->dist_num] = 0;
+    return corrector->dist_num++;
+}
+
+int tau_corrector_add_class(TauCorrector_t* corrector, float ems, float dist)
+{
+    if (corrector == NULL || ems < 0.01f || ems > 1.0f)
+    {
+        return TAU_ERROR_PARAM;
+    }
+    for (int bucket = 0; bucket < corrector->dist_num; bucket++)
+    {
+        if (corrector->dist_own_ems[bucket] && corrector->dist_ems[bucket] == ems && corrector->dist[bucket] == dist)
+        {
+            return bucket;
+        }
+    }
+    int bucket = tau_corrector_add_dist(corrector, dist);
+    if (bucket >= 0)
+    {
+        corrector->dist_ems[bucket] = ems;
+        corrector->dist_own_ems[bucket] = 1;
+    }
+    return bucket;
+}
+
+int tau_corrector_set_env(TauCorrector_t* corrector, float ems, float ta)
+{
+    if (corrector == NULL)
+    {
+        return TAU_ERROR_PARAM;
+    }
+    //a new ta changes every bucket, a new ems only the ones without an emissivity of their own
+    for (int bucket = 0; bucket < corrector->dist_num; bucket++)
+    {
+        if (corrector->ta != ta || (!corrector->dist_own_ems[bucket] && corrector->dist_ems[bucket] != ems))
+        {
+            corrector->dist_valid[bucket] = 0;
+        }
+        if (!corrector->dist_own_ems[bucket])
+        {
+            corrector->dist_ems[bucket] = ems;
+        }
+    }
+    corrector->ems = ems;
+    corrector->ta = ta;
+    return TAU_SUCCESS;
+}
+
+//uncorrected temperature of every bucket center, TEMP_LUT_INVALID_CELSIUS marks a bucket the calibration rejects
+static void tau_org_build(TauCorrector_t* corrector)
+{
+    temp_calc_without_any_correct_lut(corrector->temp_cal_info, corrector->org_celsius);
+    corrector->org_env_factor = *corrector->temp_cal_info->org_env_factor;
+    corrector->org_valid = 1;
+    memset(corrector->dist_valid, 0, sizeof(corrector->dist_valid));
+}
+
+//the two pass loop of command 18, buckets the chain rejects keep their center value
+static void tau_dist_build(TauCorrector_t* corrector, int bucket)
+{
+    uint16_t* temp_map = corrector->temp_map + (size_t)bucket * TEMP_LUT_SIZE;
+    float dist = corrector->dist[bucket];
+    float ems = corrector->dist_ems[bucket];
+    for (int i = 0; i < TEMP_LUT_SIZE; i++)
+    {
+        uint32_t temp_val = (i << TEMP_LUT_SHIFT) + (1 << (TEMP_LUT_SHIFT - 1));
+        float org_temp = corrector->org_celsius[i];
+        uint16_t tau = 0;
+        float new_temp1 = 0, new_temp2 = 0;
+        if (org_temp > TEMP_LUT_INVALID_CELSIUS && \
+            read_tau_with_target_temp_and_dist(corrector->correct_table, org_temp, dist, &tau) == IRTEMP_SUCCESS && \
+            temp_correct(ems, tau, corrector->ta, org_temp, &new_temp1) == IRTEMP_SUCCESS && \
+            read_tau_with_target_temp_and_dist(corrector->correct_table, new_temp1, dist, &tau) == IRTEMP_SUCCESS && \
+            temp_correct(ems, tau, corrector->ta, org_temp, &new_temp2) == IRTEMP_SUCCESS)
+        {
+            double kelvin64 = ((double)new_temp2 + 273.15) * 64 + 0.5;
+            temp_val = (kelvin64 <= 0) ? 0 : ((kelvin64 >= 65535) ? 65535 : (uint32_t)kelvin64);
+        }
+        temp_map[i] = (uint16_t)temp_val;
+    }
+    corrector->dist_valid[bucket] = 1;
+}
+
+int tau_corrector_update(TauCorrector_t* corrector)
+{
+    if (corrector == NULL || corrector->temp_map == NULL)
+    {
+        return TAU_ERROR_PARAM;
+    }
+    if (!corrector->org_valid || \
+        memcmp(&corrector->org_env_factor, corrector->temp_cal_info->org_env_factor, sizeof(EnvFactor_t)) != 0)
+    {
+        tau_org_build(corrector);
+    }
+    for (int bucket = 0; bucket < corrector->dist_num; bucket++)
+    {
+        if (!corrector->dist_valid[bucket])
+        {
+            tau_dist_build(corrector, bucket);
+        }
+    }
+    return TAU_SUCCESS;
+}
+
+int tau_corrector_apply(TauCorrector_t* corrector, const uint16_t* temp_data, const uint8_t* dist_index, \
+    int pix_num, uint16_t* dst)
+{
+    if (temp_data == NULL || dst == NULL || tau_corrector_update(corrector) != TAU_SUCCESS)
+    {
+        return TAU_ERROR_PARAM;
+    }
+    if (dist_index == NULL)
+    {
+        if (corrector->dist_num == 0)
+        {
+            memmove(dst, temp_data, pix_num * sizeof(uint16_t));
+            return TAU_SUCCESS;
+        }
+        const uint16_t* temp_map = corrector->temp_map;
+        for (int i = 0; i < pix_num; i++)
+        {
+            dst[i] = temp_map[temp_data[i] >> TEMP_LUT_SHIFT];
+        }
+        return TAU_SUCCESS;
+    }
+
+    int dist_num = corrector->dist_num;
+    const uint16_t* temp_map = corrector->temp_map;
+    for (int i = 0; i < pix_num; i++)
+    {
+        int bucket = dist_index[i];
+        uint16_t v = temp_data[i];
+        dst[i] = (bucket < dist_num) ? temp_map[bucket * TEMP_LUT_SIZE + (v >> TEMP_LUT_SHIFT)] : v;
+    }
+    return TAU_SUCCESS;
+}
+
+void tau_dist_map_fill_rect(uint8_t* dist_index, int width, Area_t rect, uint8_t bucket)
+{
+    if (dist_index == NULL || rect.width <= 0 || rect.height <= 0)
+    {
+        return;
+    }
+    for (int y = rect.start_y; y < rect.start_y + rect.height; y++)
+    {
+        memset(dist_index + y * width + rect.start_x, bucket, rect.width);
+    }
+}
+
+//the bucket of dist following the corrector's ems, registered when there is none
+static int tau_corrector_find_dist(TauCorrector_t* corrector, float dist)
+{
+    for (int bucket = 0; bucket < corrector->dist_num; bucket++)
+    {
+        if (!corrector->dist_own_ems[bucket] && corrector->dist[bucket] == dist)
+        {
+            return bucket;
+        }
+    }
+    return tau_corrector_add_dist(corrector, dist);
+}
+
+int tau_dist_map_quantize(TauCorrector_t* corrector, const float* ems_map, const float* dist_map, int pix_num, \
+    float ems_step, float dist_step, uint8_t* dist_index)
+{
+    if (corrector == NULL || dist_map == NULL || dist_index == NULL || pix_num < 0 || ems_step <= 0 || dist_step <= 0)
+    {
+        return TAU_ERROR_PARAM;
+    }
+    int full = 0;
+    //painted maps are runs of one material, the class of the previous pixel is the likely one
+    float last_ems = -1, last_dist = -1;
+    int last_bucket = TAU_BUCKET_NONE;
+    for (int i = 0; i < pix_num; i++)
+    {
+        float ems = (ems_map != NULL) ? ems_map[i] : corrector->ems;
+        float dist = dist_map[i];
+        if (ems != last_ems || dist != last_dist)
+        {
+            float class_ems = roundf(ems / ems_step) * ems_step;
+            float class_dist = roundf(dist / dist_step) * dist_step;
+            class_ems = (class_ems < 0.01f) ? 0.01f : ((class_ems > 1.0f) ? 1.0f : class_ems);
+            class_dist = (class_dist < 0.25f) ? 0.25f : ((class_dist > 49.99f) ? 49.99f : class_dist);
+            int bucket = (ems_map != NULL) ? tau_corrector_add_class(corrector, class_ems, class_dist) : \
+                tau_corrector_find_dist(corrector, class_dist);
+            full |= (bucket == TAU_ERROR_FULL);
+            last_bucket = (bucket >= 0) ? bucket : TAU_BUCKET_NONE;
+            last_ems = ems;
+            last_dist = dist;
+        }
+        dist_index[i] = (uint8_t)last_bucket;
+    }
+    return full ? TAU_ERROR_FULL : corrector->dist_num;
+}
+
+int tau_dist_map_load(TauCorrector_t* corrector, const char* path, int width, int height, uint8_t* dist_index)
+{
+    if (corrector == NULL || path == NULL || dist_index == NULL || width <= 0 || height <= 0)
+    {
+        return TAU_ERROR_PARAM;
+    }
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return TAU_ERROR_FILE;
+    }
+    memset(dist_index, TAU_BUCKET_NONE, (size_t)width * height);
+    char line[128];
+    int num = 0;
+    int rst = TAU_SUCCESS;
+    while (rst >= 0 && fgets(line, sizeof(line), fp) != NULL)
+    {
+        Area_t rect;
+        float ems, dist;
+        if (line[0] == '#')
+        {
+            continue;
+        }
+        if (sscanf(line, "default %f %f", &ems, &dist) == 2)
+        {
+            rst = tau_corrector_add_class(corrector, ems, dist);
+            if (rst >= 0)
+            {
+                //the rects read so far stay on top
+                for (int i = 0; i < width * height; i++)
+                {
+                    dist_index[i] = (dist_index[i] == TAU_BUCKET_NONE) ? (uint8_t)rst : dist_index[i];
+                }
+            }
+        }
+        else if (sscanf(line, "%d %d %d %d %f %f", &rect.start_x, &rect.start_y, &rect.width, &rect.height, \
+            &ems, &dist) == 6)
+        {
+            //clipped to the frame
+            int x1 = rect.start_x + rect.width, y1 = rect.start_y + rect.height;
+            rect.start_x = (rect.start_x < 0) ? 0 : rect.start_x;
+            rect.start_y = (rect.start_y < 0) ? 0 : rect.start_y;
+            rect.width = ((x1 > width) ? width : x1) - rect.start_x;
+            rect.height = ((y1 > height) ? height : y1) - rect.start_y;
+            rst = tau_corrector_add_class(corrector, ems, dist);
+            if (rst >= 0)
+            {
+                tau_dist_map_fill_rect(dist_index, width, rect, (uint8_t)rst);
+                num++;
+            }
+        }
+    }
+    fclose(fp);
+    return (rst < 0) ? rst : num;
+}
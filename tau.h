@@ -0,0 +1,74 @@
+#ifndef _TAU_H_
+#define _TAU_H_
+
+#include <stdint.h>
+#include "temperature.h"
+
+#define TAU_BUCKET_MAX 16           //distance buckets per corrector
+#define TAU_BUCKET_NONE 0xFF        //a distance map entry left uncorrected
+
+#define TAU_SUCCESS 0
+#define TAU_ERROR_PARAM -1
+#define TAU_ERROR_FULL -2
+#define TAU_ERROR_MEM -3
+#define TAU_ERROR_FILE -4
+
+//the distance aware correction of command 18 for whole frames:
+//uncorrected temp -> read_tau_with_target_temp_and_dist -> temp_correct, then tau looked up again with the
+//first result and temp_correct once more. the chain only depends on the temperature and the distance, so it is
+//evaluated once per (temp_val bucket, distance bucket) and every pixel becomes one table lookup.
+//a distance bucket may carry its own emissivity, so a bucket is a material class (emissivity, distance) of
+//the scene and the distance map its per pixel class index
+typedef struct {
+    TempCalInfo_t* temp_cal_info;
+    const uint16_t* correct_table;  //the table after get_compitible_correct_table
+    float ems;
+    float ta;
+    int dist_num;
+    float dist[TAU_BUCKET_MAX];     //unit:m, 0.25-49.99
+    float dist_ems[TAU_BUCKET_MAX]; //the bucket's emissivity
+    uint8_t dist_own_ems[TAU_BUCKET_MAX]; //0: the bucket follows ems and tau_corrector_set_env
+    uint8_t dist_valid[TAU_BUCKET_MAX];
+    int org_valid;
+    EnvFactor_t org_env_factor;     //org_celsius is built for this factor
+    float* org_celsius;             //TEMP_LUT_SIZE, temp_calc_without_any_correct of every temp_val bucket
+    uint16_t* temp_map;             //TAU_BUCKET_MAX * TEMP_LUT_SIZE corrected temp_val (kelvin*64)
+}TauCorrector_t;
+
+int tau_corrector_init(TauCorrector_t* corrector, TempCalInfo_t* temp_cal_info, const uint16_t* correct_table, \
+    float ems, float ta);
+
+void tau_corrector_release(TauCorrector_t* corrector);
+
+//register a distance, returns its bucket index for the distance map
+int tau_corrector_add_dist(TauCorrector_t* corrector, float dist);
+
+//the bucket of a material class with its own emissivity, an existing one when the class is registered already
+int tau_corrector_add_class(TauCorrector_t* corrector, float ems, float dist);
+
+//new emissivity / atmospheric temperature, the distance tables are rebuilt on the next apply
+int tau_corrector_set_env(TauCorrector_t* corrector, float ems, float ta);
+
+//build the tables that are missing or stale, apply calls it too
+int tau_corrector_update(TauCorrector_t* corrector);
+
+//dist_index gives every pixel's distance bucket, NULL uses bucket 0 for the whole frame
+//pixels whose bucket is not registered are copied unchanged. src and dst may be the same buffer
+int tau_corrector_apply(TauCorrector_t* corrector, const uint16_t* temp_data, const uint8_t* dist_index, \
+    int pix_num, uint16_t* dst);
+
+//set the distance bucket of one rect in a width wide distance map, for per roi distances
+void tau_dist_map_fill_rect(uint8_t* dist_index, int width, Area_t rect, uint8_t bucket);
+
+//per pixel emissivity and distance (a painted scene) quantized to ems_step and dist_step, every class becomes a
+//bucket of dist_index. ems_map NULL uses the corrector's ems. returns the buckets registered or TAU_ERROR_FULL,
+//the pixels of classes that did not fit are TAU_BUCKET_NONE
+int tau_dist_map_quantize(TauCorrector_t* corrector, const float* ems_map, const float* dist_map, int pix_num, \
+    float ems_step, float dist_step, uint8_t* dist_index);
+
+//scene file of a width x height frame, '#' comments: "x y w h ems dist" lines paint rects in order, a later rect
+//over an earlier one, "default ems dist" sets the pixels no rect covers (TAU_BUCKET_NONE without it).
+//returns the rects read or TAU_ERROR_xxx
+int tau_dist_map_load(TauCorrector_t* corrector, const char* path, int width, int height, uint8_t* dist_index);
+
+#endif
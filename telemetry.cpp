@@ -0,0 +1,565 @@
+#include "telemetry.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "stab.h"
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+//raw temp value (kelvin * 64) -> the integer kelvin the libirtemp alarms compare
+static inline uint16_t telemetry_kelvin(uint16_t temp_val)
+{
+    return (uint16_t)((temp_val + 32) >> 6);
+}
+
+//the lock is held by the caller
+static void telemetry_datagram_send(Telemetry_t* telemetry)
+{
+    if (telemetry->datagram_records == 0)
+    {
+        return;
+    }
+    TelemetryDatagramHeader_t* header = (TelemetryDatagramHeader_t*)telemetry->datagram;
+    header->magic = TELEMETRY_MAGIC;
+    header->version = TELEMETRY_VERSION;
+    header->record_num = (uint16_t)telemetry->datagram_records;
+    header->datagram_seq = telemetry->datagram_seq++;
+#if !defined(_WIN32)
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = telemetry->group_addr;
+    addr.sin_port = htons(telemetry->param.port);
+    size_t size = sizeof(TelemetryDatagramHeader_t) + telemetry->datagram_records * sizeof(TelemetryRecord_t);
+    //a full socket buffer loses the datagram instead of stalling the stage
+    if (sendto(telemetry->udp_fd, telemetry->datagram, size, MSG_DONTWAIT, (struct sockaddr*)&addr, \
+        sizeof(addr)) == (ssize_t)size)
+    {
+        telemetry->stats.datagrams++;
+    }
+    else
+    {
+        telemetry->stats.send_errors++;
+    }
+#endif
+    telemetry->datagram_records = 0;
+    telemetry->batch_cnt = 0;
+}
+
+//the lock is held by the caller
+static void telemetry_publish_locked(Telemetry_t* telemetry, const TelemetryRecord_t* records, int record_num)
+{
+    for (int i = 0; i < record_num; i++)
+    {
+        if (telemetry->shm != NULL)
+        {
+            uint64_t pos = telemetry->shm->write_pos.load(std::memory_order_relaxed);
+            TelemetrySlot_t* slot = &telemetry->slots[pos & (telemetry->param.slot_num - 1)];
+            slot->seq.store(2 * pos + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot->record = records[i];
+            slot->seq.store(2 * pos + 2, std::memory_order_release);
+            telemetry->shm->write_pos.store(pos + 1, std::memory_order_release);
+        }
+        if (telemetry->udp_fd >= 0)
+        {
+            TelemetryRecord_t* dst = (TelemetryRecord_t*)(telemetry->datagram + sizeof(TelemetryDatagramHeader_t));
+            dst[telemetry->datagram_records++] = records[i];
+            if (telemetry->datagram_records == TELEMETRY_DATAGRAM_RECORDS)
+            {
+                telemetry_datagram_send(telemetry);
+            }
+        }
+    }
+    telemetry->stats.records += record_num;
+}
+
+int telemetry_publish(Telemetry_t* telemetry, const TelemetryRecord_t* records, int record_num)
+{
+    if (telemetry == NULL || records == NULL || record_num < 0)
+    {
+        return TELEMETRY_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&telemetry->mutex);
+    if (telemetry->running)
+    {
+        telemetry_publish_locked(telemetry, records, record_num);
+    }
+    pthread_mutex_unlock(&telemetry->mutex);
+    return TELEMETRY_SUCCESS;
+}
+
+static void telemetry_record_set(TelemetryRecord_t* record, FrameSlot_t* slot, TelemetryType_t type, int index, \
+    const TempInfo_t* info, const TempThreshold_t* threshold)
+{
+    record->seq = slot->seq;
+    record->timestamp_us = slot->desc.timestamp_us;
+    record->type = (uint16_t)type;
+    record->index = (uint16_t)index;
+    record->alarm = TEMP_NORMAL;
+    record->reserved = 0;
+    record->max_temp = info->max_temp;
+    record->min_temp = info->min_temp;
+    record->avr_temp = info->avr_temp;
+    record->reserved2 = 0;
+    record->max_x = (uint16_t)info->max_cord.x;
+    record->max_y = (uint16_t)info->max_cord.y;
+    record->min_x = (uint16_t)info->min_cord.x;
+    record->min_y = (uint16_t)info->min_cord.y;
+    if (threshold != NULL)
+    {
+        TempInfo_t kelvin = *info;
+        kelvin.max_temp = telemetry_kelvin(info->max_temp);
+        kelvin.min_temp = telemetry_kelvin(info->min_temp);
+        kelvin.avr_temp = telemetry_kelvin(info->avr_temp);
+        record->alarm = (uint16_t)((type == TELEMETRY_POINT) ? \
+            point_over_threshold_alarm(*threshold, kelvin.max_temp) : \
+            line_rect_over_threshold_alarm(*threshold, &kelvin));
+    }
+}
+
+//ring task: every registered point/line/rect of the frame, then the records go out together
+static void telemetry_task(FrameSlot_t* slot, void* arg)
+{
+    Telemetry_t* telemetry = (Telemetry_t*)arg;
+    pthread_mutex_lock(&telemetry->mutex);
+    if (!telemetry->running || slot->desc.temp.data == NULL || (telemetry->frame_cnt++ % telemetry->param.interval) != 0)
+    {
+        pthread_mutex_unlock(&telemetry->mutex);
+        return;
+    }
+    uint16_t* temp_data = (uint16_t*)slot->desc.temp.data;
+    TempDataRes_t temp_res = telemetry->roi_engine.temp_res;
+    int record_num = 0;
+    for (int i = 0; i < telemetry->point_num; i++)
+    {
+        TelemetryPoint_t* point = &telemetry->points[i];
+        TempInfo_t info;
+        uint16_t temp = 0;
+        if (get_point_temp(temp_data, temp_res, point->point, &temp) != IRTEMP_SUCCESS)
+        {
+            continue;
+        }
+        info.max_temp = info.min_temp = info.avr_temp = temp;
+        info.max_cord = info.min_cord = point->point;
+        telemetry_record_set(&telemetry->frame_records[record_num++], slot, TELEMETRY_POINT, i, &info, \
+            point->has_threshold ? &point->threshold : NULL);
+    }
+    RoiEngine_t* engine = &telemetry->roi_engine;
+    stab_roi_follow(engine, &slot->desc);
+    if (engine->roi_num > 0 && roi_engine_process_tiles(engine, temp_data, slot->desc.temp_tiles, \
+        telemetry->roi_info) == ROI_SUCCESS)
+    {
+        for (int i = 0; i < engine->roi_num; i++)
+        {
+            TelemetryType_t type = (engine->roi[i].type == ROI_TYPE_LINE) ? TELEMETRY_LINE : TELEMETRY_RECT;
+            telemetry_record_set(&telemetry->frame_records[record_num++], slot, type, telemetry->roi_index[i], \
+                &telemetry->roi_info[i], telemetry->roi_has_threshold[i] ? &telemetry->roi_threshold[i] : NULL);
+        }
+    }
+    telemetry_publish_locked(telemetry, telemetry->frame_records, record_num);
+    telemetry->stats.frames++;
+    //a datagram carries up to batch_frames frames, a full one has already gone out
+    if (telemetry->udp_fd >= 0 && ++telemetry->batch_cnt >= telemetry->param.batch_frames)
+    {
+        telemetry_datagram_send(telemetry);
+    }
+    pthread_mutex_unlock(&telemetry->mutex);
+}
+
+int telemetry_attach(Telemetry_t* telemetry, StreamFrameInfo_t* stream_frame_info)
+{
+    if (telemetry == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL || \
+        stream_frame_info->temp_byte_size == 0)
+    {
+        return TELEMETRY_ERROR_PARAM;
+    }
+    memset(telemetry, 0, sizeof(Telemetry_t));
+    telemetry->stream_frame_info = stream_frame_info;
+    telemetry->shm_fd = -1;
+    telemetry->udp_fd = -1;
+    TempDataRes_t temp_res = { (uint16_t)stream_frame_info->temp_info.width, (uint16_t)stream_frame_info->temp_info.height };
+    if (roi_engine_init(&telemetry->roi_engine, temp_res) != ROI_SUCCESS)
+    {
+        return TELEMETRY_ERROR_PARAM;
+    }
+    pthread_mutex_init(&telemetry->mutex, NULL);
+    //alarms need every frame, a frame the stage could not take counts as the consumer's drop
+    telemetry->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, \
+        POOL_STAGE_TEMPERATURE, telemetry_task, telemetry);
+    if (telemetry->consumer_id < 0)
+    {
+        roi_engine_release(&telemetry->roi_engine);
+        pthread_mutex_destroy(&telemetry->mutex);
+        return TELEMETRY_ERROR_PARAM;
+    }
+    return TELEMETRY_SUCCESS;
+}
+
+int telemetry_add_point(Telemetry_t* telemetry, Dot_t point, const TempThreshold_t* threshold)
+{
+    if (telemetry == NULL || telemetry->stream_frame_info == NULL)
+    {
+        return TELEMETRY_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&telemetry->mutex);
+    if (telemetry->point_num == TELEMETRY_MAX_POINTS)
+    {
+        pthread_mutex_unlock(&telemetry->mutex);
+        return TELEMETRY_ERROR_FULL;
+    }
+    int index = telemetry->point_num++;
+    telemetry->points[index].point = point;
+    telemetry->points[index].has_threshold = (threshold != NULL);
+    if (threshold != NULL)
+    {
+        telemetry->points[index].threshold = *threshold;
+    }
+    pthread_mutex_unlock(&telemetry->mutex);
+    return index;
+}
+
+//roi_id is the engine's index of the roi just added, or its error code
+static int telemetry_roi_added(Telemetry_t* telemetry, int roi_id, int* type_num, const TempThreshold_t* threshold)
+{
+    if (roi_id < 0)
+    {
+        return (roi_id == ROI_ERROR_FULL) ? TELEMETRY_ERROR_FULL : TELEMETRY_ERROR_PARAM;
+    }
+    int index = (*type_num)++;
+    telemetry->roi_index[roi_id] = (uint16_t)index;
+    telemetry->roi_has_threshold[roi_id] = (threshold != NULL);
+    if (threshold != NULL)
+    {
+        telemetry->roi_threshold[roi_id] = *threshold;
+    }
+    return index;
+}
+
+int telemetry_add_line(Telemetry_t* telemetry, Line_t line, const TempThreshold_t* threshold)
+{
+    if (telemetry == NULL || telemetry->stream_frame_info == NULL)
+    {
+        return TELEMETRY_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&telemetry->mutex);
+    int rst = telemetry_roi_added(telemetry, roi_engine_add_line(&telemetry->roi_engine, line), \
+        &telemetry->line_num, threshold);
+    pthread_mutex_unlock(&telemetry->mutex);
+    return rst;
+}
+
+int telemetry_add_rect(Telemetry_t* telemetry, Area_t rect, const TempThreshold_t* threshold)
+{
+    if (telemetry == NULL || telemetry->stream_frame_info == NULL)
+    {
+        return TELEMETRY_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&telemetry->mutex);
+    int rst = telemetry_roi_added(telemetry, roi_engine_add_rect(&telemetry->roi_engine, rect), \
+        &telemetry->rect_num, threshold);
+    pthread_mutex_unlock(&telemetry->mutex);
+    return rst;
+}
+
+#if !defined(_WIN32)
+static void telemetry_close(Telemetry_t* telemetry)
+{
+    if (telemetry->shm != NULL)
+    {
+        munmap(telemetry->shm, telemetry->shm_size);
+        telemetry->shm = NULL;
+        telemetry->slots = NULL;
+        shm_unlink(telemetry->param.shm_name);
+    }
+    if (telemetry->shm_fd >= 0)
+    {
+        close(telemetry->shm_fd);
+        telemetry->shm_fd = -1;
+    }
+    if (telemetry->udp_fd >= 0)
+    {
+        close(telemetry->udp_fd);
+        telemetry->udp_fd = -1;
+    }
+}
+
+static int telemetry_shm_create(Telemetry_t* telemetry)
+{
+    telemetry->shm_size = sizeof(TelemetryShmHeader_t) + (size_t)telemetry->param.slot_num * sizeof(TelemetrySlot_t);
+    telemetry->shm_fd = shm_open(telemetry->param.shm_name, O_CREAT | O_RDWR, 0644);
+    if (telemetry->shm_fd < 0 || ftruncate(telemetry->shm_fd, telemetry->shm_size) < 0)
+    {
+        return TELEMETRY_ERROR_SHM;
+    }
+    void* data = mmap(NULL, telemetry->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, telemetry->shm_fd, 0);
+    if (data == MAP_FAILED)
+    {
+        return TELEMETRY_ERROR_SHM;
+    }
+    //a reader of an older ring sees the magic cleared until the new one is set up
+    telemetry->shm = (TelemetryShmHeader_t*)data;
+    telemetry->shm->magic = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    telemetry->slots = (TelemetrySlot_t*)((uint8_t*)data + sizeof(TelemetryShmHeader_t));
+    for (uint32_t i = 0; i < telemetry->param.slot_num; i++)
+    {
+        telemetry->slots[i].seq.store(0, std::memory_order_relaxed);
+    }
+    telemetry->shm->version = TELEMETRY_VERSION;
+    telemetry->shm->slot_num = telemetry->param.slot_num;
+    telemetry->shm->record_size = sizeof(TelemetryRecord_t);
+    telemetry->shm->write_pos.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    telemetry->shm->magic = TELEMETRY_MAGIC;
+    return TELEMETRY_SUCCESS;
+}
+
+static int telemetry_udp_open(Telemetry_t* telemetry)
+{
+    struct in_addr group;
+    if (inet_pton(AF_INET, telemetry->param.group, &group) != 1)
+    {
+        return TELEMETRY_ERROR_PARAM;
+    }
+    telemetry->group_addr = group.s_addr;
+    telemetry->udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (telemetry->udp_fd < 0)
+    {
+        return TELEMETRY_ERROR_SOCKET;
+    }
+    unsigned char ttl = (telemetry->param.ttl > 0) ? telemetry->param.ttl : 1;
+    setsockopt(telemetry->udp_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    return TELEMETRY_SUCCESS;
+}
+#else
+static void telemetry_close(Telemetry_t* telemetry)
+{
+}
+
+static int telemetry_shm_create(Telemetry_t* telemetry)
+{
+    //posix shared memory only
+    return TELEMETRY_ERROR_SHM;
+}
+
+static int telemetry_udp_open(Telemetry_t* telemetry)
+{
+    return TELEMETRY_ERROR_SOCKET;
+}
+#endif
+
+int telemetry_start(Telemetry_t* telemetry, const TelemetryParam_t* param)
+{
+    if (telemetry == NULL || param == NULL || telemetry->stream_frame_info == NULL)
+    {
+        return TELEMETRY_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&telemetry->mutex);
+    if (telemetry->running)
+    {
+        pthread_mutex_unlock(&telemetry->mutex);
+        return TELEMETRY_ERROR_PARAM;
+    }
+    telemetry->param = *param;
+    if (telemetry->param.slot_num == 0)
+    {
+        telemetry->param.slot_num = TELEMETRY_DEFAULT_SLOTS;
+    }
+    if (telemetry->param.port == 0)
+    {
+        telemetry->param.port = TELEMETRY_DEFAULT_PORT;
+    }
+    if (telemetry->param.interval == 0)
+    {
+        telemetry->param.interval = 1;
+    }
+    if (telemetry->param.batch_frames == 0)
+    {
+        telemetry->param.batch_frames = 1;
+    }
+    //slots are picked with a mask
+    if ((telemetry->param.slot_num & (telemetry->param.slot_num - 1)) != 0)
+    {
+        pthread_mutex_unlock(&telemetry->mutex);
+        return TELEMETRY_ERROR_PARAM;
+    }
+    int rst = TELEMETRY_SUCCESS;
+    if (telemetry->param.shm_name[0] != 0)
+    {
+        rst = telemetry_shm_create(telemetry);
+    }
+    if (rst == TELEMETRY_SUCCESS && telemetry->param.group[0] != 0)
+    {
+        rst = telemetry_udp_open(telemetry);
+    }
+    if (rst != TELEMETRY_SUCCESS)
+    {
+        telemetry_close(telemetry);
+        pthread_mutex_unlock(&telemetry->mutex);
+        return rst;
+    }
+    memset(&telemetry->stats, 0, sizeof(TelemetryStats_t));
+    telemetry->datagram_records = 0;
+    telemetry->batch_cnt = 0;
+    telemetry->frame_cnt = 0;
+    telemetry->running = 1;
+    pthread_mutex_unlock(&telemetry->mutex);
+    return TELEMETRY_SUCCESS;
+}
+
+int telemetry_stop(Telemetry_t* telemetry)
+{
+    if (telemetry == NULL)
+    {
+        return TELEMETRY_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&telemetry->mutex);
+    if (!telemetry->running)
+    {
+        pthread_mutex_unlock(&telemetry->mutex);
+        return TELEMETRY_SUCCESS;
+    }
+    telemetry->running = 0;
+    if (telemetry->udp_fd >= 0)
+    {
+        telemetry_datagram_send(telemetry);
+    }
+    telemetry_close(telemetry);
+    printf("telemetry: %llu frames, %llu records, %llu datagrams, %llu send errors\n", \
+        (unsigned long long)telemetry->stats.frames, (unsigned long long)telemetry->stats.records, \
+        (unsigned long long)telemetry->stats.datagrams, (unsigned long long)telemetry->stats.send_errors);
+    pthread_mutex_unlock(&telemetry->mutex);
+    return TELEMETRY_SUCCESS;
+}
+
+int telemetry_stats(Telemetry_t* telemetry, TelemetryStats_t* stats)
+{
+    if (telemetry == NULL || stats == NULL)
+    {
+        return TELEMETRY_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&telemetry->mutex);
+    *stats = telemetry->stats;
+    pthread_mutex_unlock(&telemetry->mutex);
+    return TELEMETRY_SUCCESS;
+}
+
+#if !defined(_WIN32)
+int telemetry_reader_open(TelemetryReader_t* reader, const char* shm_name)
+{
+    if (reader == NULL || shm_name == NULL)
+    {
+        return TELEMETRY_ERROR_PARAM;
+    }
+    memset(reader, 0, sizeof(TelemetryReader_t));
+    reader->shm_fd = shm_open(shm_name, O_RDONLY, 0);
+    if (reader->shm_fd < 0)
+    {
+        return TELEMETRY_ERROR_SHM;
+    }
+    TelemetryShmHeader_t header;
+    if (pread(reader->shm_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || \
+        header.magic != TELEMETRY_MAGIC || header.version != TELEMETRY_VERSION || \
+        header.record_size != sizeof(TelemetryRecord_t) || header.slot_num == 0)
+    {
+        close(reader->shm_fd);
+        reader->shm_fd = -1;
+        return TELEMETRY_ERROR_SHM;
+    }
+    reader->shm_size = sizeof(TelemetryShmHeader_t) + (size_t)header.slot_num * sizeof(TelemetrySlot_t);
+    void* data = mmap(NULL, reader->shm_size, PROT_READ, MAP_SHARED, reader->shm_fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close(reader->shm_fd);
+        reader->shm_fd = -1;
+        return TELEMETRY_ERROR_SHM;
+    }
+    reader->shm = (TelemetryShmHeader_t*)data;
+    reader->slots = (TelemetrySlot_t*)((uint8_t*)data + sizeof(TelemetryShmHeader_t));
+    reader->pos = reader->shm->write_pos.load(std::memory_order_acquire);
+    return TELEMETRY_SUCCESS;
+}
+
+int telemetry_reader_next(TelemetryReader_t* reader, TelemetryRecord_t* record, uint64_t* lost)
+{
+    if (reader == NULL || reader->shm == NULL || record == NULL)
+    {
+        return TELEMETRY_ERROR_PARAM;
+    }
+    uint32_t slot_num = reader->shm->slot_num;
+    for (;;)
+    {
+        uint64_t write_pos = reader->shm->write_pos.load(std::memory_order_acquire);
+        if (reader->pos >= write_pos)
+        {
+            return TELEMETRY_EMPTY;
+        }
+        //the writer went round the ring past the reader
+        if (write_pos - reader->pos > slot_num)
+        {
+            if (lost != NULL)
+            {
+                *lost += write_pos - slot_num - reader->pos;
+            }
+            reader->pos = write_pos - slot_num;
+        }
+        TelemetrySlot_t* slot = &reader->slots[reader->pos & (slot_num - 1)];
+        uint64_t seq = slot->seq.load(std::memory_order_acquire);
+        if (seq == 2 * reader->pos + 2)
+        {
+            memcpy(record, (const void*)&slot->record, sizeof(TelemetryRecord_t));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot->seq.load(std::memory_order_relaxed) == seq)
+            {
+                reader->pos++;
+                return TELEMETRY_SUCCESS;
+            }
+        }
+        //overwritten while it was read
+        if (lost != NULL)
+        {
+            (*lost)++;
+        }
+        reader->pos++;
+    }
+}
+
+void telemetry_reader_close(TelemetryReader_t* reader)
+{
+    if (reader == NULL)
+    {
+        return;
+    }
+    if (reader->shm != NULL)
+    {
+        munmap(reader->shm, reader->shm_size);
+        reader->shm = NULL;
+    }
+    if (reader->shm_fd >= 0)
+    {
+        close(reader->shm_fd);
+        reader->shm_fd = -1;
+    }
+}
+#else
+int telemetry_reader_open(TelemetryReader_t* reader, const char* shm_name)
+{
+    return TELEMETRY_ERROR_SHM;
+}
+
+int telemetry_reader_next(TelemetryReader_t* reader, TelemetryRecord_t* record, uint64_t* lost)
+{
+    return TELEMETRY_ERROR_PARAM;
+}
+
+void telemetry_reader_close(TelemetryReader_t* reader)
+{
+}
+#endif
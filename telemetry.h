@@ -0,0 +1,170 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <atomic>
+#include "data.h"
+#include "libirtemp.h"
+#include "roi.h"
+
+#define TELEMETRY_MAGIC 0x4D4C4554      //"TELM"
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_NAME_LEN 64
+#define TELEMETRY_DEFAULT_SHM_NAME "/ir_telemetry"
+#define TELEMETRY_DEFAULT_SLOTS 4096    //shared memory records, a power of two
+#define TELEMETRY_DEFAULT_PORT 5600
+#define TELEMETRY_MAX_POINTS 16
+#define TELEMETRY_DATAGRAM_RECORDS 32   //records in one udp datagram, 1296 bytes
+#define TELEMETRY_MAX_FRAME_RECORDS (TELEMETRY_MAX_POINTS + ROI_MAX_NUM)
+
+#define TELEMETRY_SUCCESS 0
+#define TELEMETRY_ERROR_PARAM -1
+#define TELEMETRY_ERROR_SHM -2
+#define TELEMETRY_ERROR_SOCKET -3
+#define TELEMETRY_ERROR_FULL -4
+#define TELEMETRY_EMPTY -5              //the reader is at the newest record
+
+typedef enum
+{
+    TELEMETRY_POINT = 0,
+    TELEMETRY_LINE,
+    TELEMETRY_RECT,
+}TelemetryType_t;
+
+//one point/line/rect of one frame, 40 bytes, little endian
+//temperatures are raw temp values (kelvin * 64), a point has max = min = avr at its own coordinate
+typedef struct {
+    uint64_t seq;                       //ring sequence of the frame
+    uint64_t timestamp_us;              //monotonic time the frame was received
+    uint16_t type;                      //TelemetryType_t
+    uint16_t index;                     //order of registration within the type
+    uint16_t alarm;                     //AlarmType_t, TEMP_NORMAL without a threshold
+    uint16_t reserved;
+    uint16_t max_temp;
+    uint16_t min_temp;
+    uint16_t avr_temp;
+    uint16_t reserved2;
+    uint16_t max_x;
+    uint16_t max_y;
+    uint16_t min_x;
+    uint16_t min_y;
+}TelemetryRecord_t;
+
+//shared memory: the header, then slot_num slots. record pos goes into slot pos % slot_num
+//its seq is 2 * pos + 1 while it is written and 2 * pos + 2 once complete (a seqlock per slot)
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_num;
+    uint32_t record_size;
+    std::atomic<uint64_t> write_pos;    //records published so far
+    uint64_t reserved[5];               //one cache line
+}TelemetryShmHeader_t;
+
+typedef struct {
+    std::atomic<uint64_t> seq;
+    TelemetryRecord_t record;
+}TelemetrySlot_t;
+
+//udp datagram: the header, then record_num records
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_num;
+    uint64_t datagram_seq;              //gaps are lost datagrams
+}TelemetryDatagramHeader_t;
+
+typedef struct {
+    char shm_name[TELEMETRY_NAME_LEN];  //empty: no shared memory ring
+    uint32_t slot_num;                  //0 selects TELEMETRY_DEFAULT_SLOTS
+    char group[TELEMETRY_NAME_LEN];     //multicast address, empty: no udp feed
+    uint16_t port;                      //0 selects TELEMETRY_DEFAULT_PORT
+    uint8_t ttl;                        //0 keeps the multicast on the local network (ttl 1)
+    uint32_t interval;                  //frames between two evaluations, 0 or 1 evaluates every frame
+    uint32_t batch_frames;              //evaluated frames per datagram at most, a full datagram goes out earlier
+}TelemetryParam_t;
+
+typedef struct {
+    uint64_t frames;                    //frames evaluated
+    uint64_t records;
+    uint64_t datagrams;
+    uint64_t send_errors;
+}TelemetryStats_t;
+
+typedef struct {
+    Dot_t point;
+    TempThreshold_t threshold;
+    uint8_t has_threshold;
+}TelemetryPoint_t;
+
+//a ring task consumer evaluating the registered points/lines/rects and their thresholds
+//every record goes into the shared memory ring and the current datagram, nothing is allocated per frame
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    TelemetryParam_t param;
+    int consumer_id;
+    uint8_t running;
+    int shm_fd;
+    TelemetryShmHeader_t* shm;
+    TelemetrySlot_t* slots;
+    size_t shm_size;
+    int udp_fd;
+    uint32_t group_addr;                //network order
+    TelemetryPoint_t points[TELEMETRY_MAX_POINTS];
+    int point_num;
+    RoiEngine_t roi_engine;             //the lines and rects
+    TempThreshold_t roi_threshold[ROI_MAX_NUM];
+    uint8_t roi_has_threshold[ROI_MAX_NUM];
+    uint16_t roi_index[ROI_MAX_NUM];    //engine roi -> index within its type
+    int line_num;
+    int rect_num;
+    TempInfo_t roi_info[ROI_MAX_NUM];
+    TelemetryRecord_t frame_records[TELEMETRY_MAX_FRAME_RECORDS];
+    uint8_t datagram[sizeof(TelemetryDatagramHeader_t) + TELEMETRY_DATAGRAM_RECORDS * sizeof(TelemetryRecord_t)];
+    uint32_t datagram_records;
+    uint32_t batch_cnt;                 //evaluated frames in the current datagram
+    uint64_t datagram_seq;
+    uint32_t frame_cnt;
+    TelemetryStats_t stats;
+    pthread_mutex_t mutex;
+}Telemetry_t;
+
+//register the stage as a task consumer of the camera's frame ring, before streaming
+int telemetry_attach(Telemetry_t* telemetry, StreamFrameInfo_t* stream_frame_info);
+
+//threshold NULL reports the temperatures without an alarm. returns the index within the type or an error code
+int telemetry_add_point(Telemetry_t* telemetry, Dot_t point, const TempThreshold_t* threshold);
+int telemetry_add_line(Telemetry_t* telemetry, Line_t line, const TempThreshold_t* threshold);
+int telemetry_add_rect(Telemetry_t* telemetry, Area_t rect, const TempThreshold_t* threshold);
+
+//create the shared memory ring and the multicast socket, then start publishing
+int telemetry_start(Telemetry_t* telemetry, const TelemetryParam_t* param);
+
+//send the partial datagram and unmap the ring, the shared memory name is removed
+int telemetry_stop(Telemetry_t* telemetry);
+
+//publish records of the caller's own into the ring and the datagram, next to the stage's
+int telemetry_publish(Telemetry_t* telemetry, const TelemetryRecord_t* records, int record_num);
+
+int telemetry_stats(Telemetry_t* telemetry, TelemetryStats_t* stats);
+
+//local consumer of the shared memory ring, starts at the newest record
+typedef struct {
+    int shm_fd;
+    TelemetryShmHeader_t* shm;
+    TelemetrySlot_t* slots;
+    size_t shm_size;
+    uint64_t pos;                       //next record to read
+}TelemetryReader_t;
+
+int telemetry_reader_open(TelemetryReader_t* reader, const char* shm_name);
+
+//next record, TELEMETRY_EMPTY when there is none. records overwritten before they were read are skipped
+//and counted into lost (may be NULL)
+int telemetry_reader_next(TelemetryReader_t* reader, TelemetryRecord_t* record, uint64_t* lost);
+
+void telemetry_reader_close(TelemetryReader_t* reader);
+
+#endif
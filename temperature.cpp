@@ -1,157 +1,1299 @@
 #include "temperature.h"
+#include "trace.h"
+#include "log.h"
+#include "rtsched.h"
+#include "simd.h"
+#include "pool.h"
+#include "memacct.h"
+#include "stab.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
 
 
-//温度修正相关的参数
-EnvParam_t org_env_param = { 0,0,0,0 };             //原始环境变量
-EnvParam_t new_env_param = { 0,0,0,0 };             //新的环境变量
-uint8_t gain_flag = 1;
+uint32_t temp_report_interval = TEMP_REPORT_INTERVAL;   //打印温度的帧间隔，报警每帧检测
 
-NucFactor_t nuc_factor = { 0,0,0 };                  //温度映射二次函数系数
-EnvFactor_t org_env_factor = { 0 };                 //原始修正参数
-EnvFactor_t new_env_factor = { 0 };                 //新的修正参数
-uint16_t nuc_table[NUCT_LEN] = { 0 };               //温度映射表
-uint16_t correct_table[4 * 14 * 64 + 128];				//环境变量修正表
+//calculate_new_env_cali_parameter的输入，量化成设备单位作为缓存的键
+typedef struct {
+    uint32_t table_hash;            //correct_table和nuc_table的内容
+    uint8_t gain_flag;
+    int ems;                        //1/16384
+    int ta;                         //1/16 K
+    int tu;
+    int dist_cm;
+    int hum_milli;
+}TempEnvKey_t;
 
+typedef struct {
+    TempEnvKey_t key;
+    uint64_t used;                  //最近一次命中，替换最久未用的
+    EnvParam_t env_param;
+    EnvFactor_t env_factor;
+}TempEnvCache_t;
 
-TempCalInfo_t temp_cal_info = { &org_env_param, &new_env_param, gain_flag, &nuc_factor,\
-                                & org_env_factor, &new_env_factor, nuc_table };
+enum {
+    TEMP_ENV_LUT_IDLE = 0,
+    TEMP_ENV_LUT_RUNNING,
+    TEMP_ENV_LUT_AGAIN,             //建表期间参数又变了，建完再建一次
+};
+
+//一个增益的常驻表和由它们导出的修正表。当前增益的参数就是上下文的org_env_factor/new_env_param/new_env_factor，
+//没有常驻表(temp_gain_tables_set之前)的增益用上下文的nuc_table
+typedef struct {
+    struct TempCalibCtx_t* ctx;
+    int gain;                       //ctx->bank的下标
+    int loaded;
+    uint16_t nuc[NUCT_LEN];
+    uint16_t correct[TEMP_CORRECT_TABLE_LEN];
+    int correct_valid;
+    EnvParam_t org_env_param;       //org_env_factor由它算出，不是当前增益时用
+    EnvFactor_t org_env_factor;
+    EnvParam_t new_env_param;
+    EnvFactor_t new_env_factor;
+    //建表用的参数快照，建表期间calculate_new_env_cali_parameter可以继续修改参数
+    EnvParam_t build_param[2];
+    EnvFactor_t build_factor[2];
+    TempCalInfo_t build_info;
+    TempEnvMap_t map;
+    const TempCalibSnapshot_t* snapshot;    //这个增益最近建好的快照，还没有建表时为NULL
+    int lut_state;
+    int lut_keyed;                  //lut_key是最近一次建表的输入
+    TempEnvKey_t lut_key;
+    EnvFactor_t lut_org_factor;
+}TempEnvBank_t;
+
+//最近一次calculate_new_env_cali_parameter的输入，之后才常驻的增益用它算自己的参数
+typedef struct {
+    int valid;
+    double ems;
+    double ta;
+    double tu;
+    double dist;
+    double hum;
+}TempEnvInputs_t;
+
+//被替换的快照，读者可能还在用，TEMP_CALIB_RETIRE_MS之后才释放
+typedef struct TempCalibRetired {
+    const TempCalibSnapshot_t* snapshot;
+    uint64_t retired_us;
+    struct TempCalibRetired* next;
+}TempCalibRetired_t;
+
+struct TempCalibCtx_t {
+    //温度修正相关的参数，info指向它们，是当前增益的
+    EnvParam_t org_env_param;       //原始环境变量
+    EnvParam_t new_env_param;       //新的环境变量
+    NucFactor_t nuc_factor;         //温度映射二次函数系数
+    EnvFactor_t org_env_factor;     //原始修正参数
+    EnvFactor_t new_env_factor;     //新的修正参数
+    uint16_t nuc_table[NUCT_LEN];   //温度映射表
+    uint16_t correct_table[TEMP_CORRECT_TABLE_LEN];    //环境变量修正表
+    TempCalInfo_t info;
+    TempCalibStage_t stage;
+    TempEnvBank_t bank[TEMP_GAIN_NUM];
+    std::atomic<int> gain;          //帧使用的增益
+    TempEnvInputs_t inputs;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    TempEnvCache_t cache[TEMP_ENV_CACHE_NUM];
+    int cache_num;
+    uint64_t cache_clock;
+    TempEnvStats_t stats;
+    std::atomic<const TempCalibSnapshot_t*> current;    //帧修正用的快照，只整体替换
+    uint64_t version;
+    TempCalibRetired_t* retired;
+};
+
+TempCalibCtx_t* temp_calib_create(void)
+{
+    TempCalibCtx_t* ctx = new TempCalibCtx_t();
+    ctx->info.org_env_param = &ctx->org_env_param;
+    ctx->info.new_env_param = &ctx->new_env_param;
+    ctx->info.gain_flag = HIGH_GAIN;
+    ctx->info.nuc_factor = &ctx->nuc_factor;
+    ctx->info.org_env_factor = &ctx->org_env_factor;
+    ctx->info.new_env_factor = &ctx->new_env_factor;
+    ctx->info.nuc_table = ctx->nuc_table;
+    for (int gain = 0; gain < TEMP_GAIN_NUM; gain++)
+    {
+        ctx->bank[gain].ctx = ctx;
+        ctx->bank[gain].gain = gain;
+    }
+    ctx->gain.store(HIGH_GAIN);
+    ctx->current.store(NULL);
+    pthread_mutex_init(&ctx->mutex, NULL);
+    pthread_cond_init(&ctx->cond, NULL);
+    return ctx;
+}
+
+//NULL is the default context the calls without one use, made on first use
+static TempCalibCtx_t* temp_calib_ctx(TempCalibCtx_t* ctx)
+{
+    if (ctx != NULL)
+    {
+        return ctx;
+    }
+    static TempCalibCtx_t* default_ctx = temp_calib_create();
+    return default_ctx;
+}
+
+static void temp_calib_snapshot_free(const TempCalibSnapshot_t* snapshot)
+{
+    if (snapshot != NULL)
+    {
+        free((void*)snapshot);
+        mem_acct_add(MEM_CLASS_LUT, -(int64_t)sizeof(TempCalibSnapshot_t));
+    }
+}
+
+void temp_calib_destroy(TempCalibCtx_t* ctx)
+{
+    if (ctx == NULL || ctx == temp_calib_ctx(NULL))
+    {
+        return;
+    }
+    //the pool tasks still building hold the banks
+    temp_env_lut_wait_ctx(ctx);
+    for (int gain = 0; gain < TEMP_GAIN_NUM; gain++)
+    {
+        temp_calib_snapshot_free(ctx->bank[gain].snapshot);
+    }
+    while (ctx->retired != NULL)
+    {
+        TempCalibRetired_t* next = ctx->retired->next;
+        temp_calib_snapshot_free(ctx->retired->snapshot);
+        free(ctx->retired);
+        ctx->retired = next;
+    }
+    pthread_mutex_destroy(&ctx->mutex);
+    pthread_cond_destroy(&ctx->cond);
+    delete ctx;
+}
+
+TempCalibCtx_t* temp_calib_default(void)
+{
+    return temp_calib_ctx(NULL);
+}
+
+TempCalInfo_t* temp_calib_info(TempCalibCtx_t* ctx)
+{
+    return &temp_calib_ctx(ctx)->info;
+}
+
+uint16_t* temp_calib_correct_table(TempCalibCtx_t* ctx)
+{
+    return temp_calib_ctx(ctx)->correct_table;
+}
+
+TempCalibStage_t* temp_calib_stage(TempCalibCtx_t* ctx)
+{
+    return &temp_calib_ctx(ctx)->stage;
+}
+
+const TempCalibSnapshot_t* temp_calib_acquire(TempCalibCtx_t* ctx)
+{
+    return temp_calib_ctx(ctx)->current.load(std::memory_order_acquire);
+}
 
 TempCalInfo_t* get_temp_cal_info(void)
 {
-    return &temp_cal_info;
+    return temp_calib_info(NULL);
+}
+
+
+//temperature value to actual temp(Celsius)
+float temp_value_converter(uint16_t temp_val)
+{
+    return temp_celsius_of_raw(temp_val);
+}
+
+
+//fnv-1a of the tables the factors come from, a tau table of the other gain read into the same buffer is a new key
+static uint32_t temp_env_table_hash(uint32_t hash, const uint16_t* table, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        hash = (hash ^ table[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int temp_env_key_equal(const TempEnvKey_t* a, const TempEnvKey_t* b)
+{
+    return a->table_hash == b->table_hash && a->gain_flag == b->gain_flag && a->ems == b->ems && \
+        a->ta == b->ta && a->tu == b->tu && a->dist_cm == b->dist_cm && a->hum_milli == b->hum_milli;
+}
+
+//the corrected table of a is still good enough for b
+static int temp_env_key_near(const TempEnvKey_t* a, const TempEnvKey_t* b)
+{
+    return a->table_hash == b->table_hash && a->gain_flag == b->gain_flag && \
+        abs(a->ems - b->ems) <= TEMP_ENV_LUT_TOL_EMS * (1 << 14) && \
+        abs(a->ta - b->ta) <= TEMP_ENV_LUT_TOL_CELSIUS * (1 << 4) && \
+        abs(a->tu - b->tu) <= TEMP_ENV_LUT_TOL_CELSIUS * (1 << 4) && \
+        abs(a->dist_cm - b->dist_cm) <= TEMP_ENV_LUT_TOL_DIST * 100 && \
+        abs(a->hum_milli - b->hum_milli) <= TEMP_ENV_LUT_TOL_HUM * 1000;
+}
+
+static const uint16_t* temp_env_bank_nuc(const TempEnvBank_t* bank)
+{
+    return bank->loaded ? bank->nuc : bank->ctx->nuc_table;
+}
+
+//the lock is held. the original factor of the bank: the context's for the current gain, else the bank's own, made
+//again when the device parameters were read anew
+static EnvFactor_t temp_env_bank_org(TempEnvBank_t* bank)
+{
+    TempCalibCtx_t* ctx = bank->ctx;
+    if (bank->gain == ctx->gain.load())
+    {
+        return ctx->org_env_factor;
+    }
+    if (memcmp(&bank->org_env_param, &ctx->org_env_param, sizeof(EnvParam_t)) != 0)
+    {
+        bank->org_env_param = ctx->org_env_param;
+        if (calculate_org_KE_and_BE_with_nuc_t(&bank->org_env_param, temp_env_bank_nuc(bank), (uint8_t)bank->gain, \
+            &bank->org_env_factor) != IRTEMP_SUCCESS)
+        {
+            memset(&bank->org_env_factor, 0, sizeof(EnvFactor_t));
+        }
+    }
+    return bank->org_env_factor;
+}
+
+//the lock is held. snapshot becomes the bank's, and the frames' when the bank is the current gain. the one it
+//replaces may still be read, it is freed TEMP_CALIB_RETIRE_MS later on one of the next publishes
+static void temp_calib_publish(TempEnvBank_t* bank, const TempCalibSnapshot_t* snapshot)
+{
+    TempCalibCtx_t* ctx = bank->ctx;
+    const TempCalibSnapshot_t* old = bank->snapshot;
+    bank->snapshot = snapshot;
+    if (bank->gain == ctx->gain.load())
+    {
+        ctx->current.store(snapshot, std::memory_order_release);
+        ctx->stats.published++;
+    }
+    uint64_t now_us = get_monotonic_us();
+    TempCalibRetired_t** link = &ctx->retired;
+    while (*link != NULL)
+    {
+        TempCalibRetired_t* retired = *link;
+        if (now_us - retired->retired_us >= TEMP_CALIB_RETIRE_MS * 1000ull)
+        {
+            *link = retired->next;
+            temp_calib_snapshot_free(retired->snapshot);
+            free(retired);
+            continue;
+        }
+        link = &retired->next;
+    }
+    if (old != NULL)
+    {
+        TempCalibRetired_t* retired = (TempCalibRetired_t*)malloc(sizeof(TempCalibRetired_t));
+        if (retired != NULL)
+        {
+            retired->snapshot = old;
+            retired->retired_us = now_us;
+            retired->next = ctx->retired;
+            ctx->retired = retired;
+        }
+    }
+}
+
+static void temp_env_lut_build(void* arg);
+
+//the inputs quantized as the cache key, so a cached result is exactly what this gives
+int temp_env_factor_calc(const uint16_t* correct_table, const uint16_t* nuc, uint8_t gain, double ems, double ta, \
+    double tu, double dist, double hum, EnvParam_t* env_param, EnvFactor_t* env_factor)
+{
+    if (correct_table == NULL || nuc == NULL || env_param == NULL || env_factor == NULL)
+    {
+        return -3;
+    }
+    int ta_q = (int)((ta + 273.15) * (1 << 4));
+    int dist_cm = (int)lround(dist * 100);
+    int hum_milli = (int)lround(hum * 1000);
+    uint16_t tau = 0;
+    if (read_tau(correct_table, hum_milli / 1000.0f, (float)(ta_q / 16.0 - 273.15), dist_cm / 100.0f, &tau) != \
+        IRTEMP_SUCCESS)
+    {
+        return -1;
+    }
+    env_param->EMS = (int)(ems * (1 << 14));
+    env_param->TAU = tau;
+    env_param->Ta = ta_q;
+    env_param->Tu = (int)((tu + 273.15) * (1 << 4));
+    return (calculate_new_KE_and_BE_with_nuc_t(env_param, (uint16_t*)nuc, gain, env_factor) == IRTEMP_SUCCESS) ? 0 : -2;
+}
+
+//the lock is held. start the bank's rebuild, or let the running one build once more
+static void temp_env_lut_schedule(TempEnvBank_t* bank)
+{
+    if (bank->lut_state != TEMP_ENV_LUT_IDLE)
+    {
+        bank->lut_state = TEMP_ENV_LUT_AGAIN;
+        return;
+    }
+    bank->lut_state = TEMP_ENV_LUT_RUNNING;
+    pthread_mutex_unlock(&bank->ctx->mutex);
+    pool_submit(POOL_STAGE_OTHER, temp_env_lut_build, bank);
+    pthread_mutex_lock(&bank->ctx->mutex);
+}
+
+//the factors of one gain for the inputs. read_tau and calculate_new_KE_and_BE_with_nuc_t see the quantized
+//inputs, so a cached result is exactly the one a new calculation would give
+static int temp_env_bank_calc(TempEnvBank_t* bank, const uint16_t* correct_table, const TempEnvInputs_t* inputs)
+{
+    TempCalibCtx_t* ctx = bank->ctx;
+    const uint16_t* nuc = temp_env_bank_nuc(bank);
+    TempEnvKey_t key;
+    key.table_hash = temp_env_table_hash(temp_env_table_hash(2166136261u, correct_table, TEMP_CORRECT_TABLE_LEN), \
+        nuc, NUCT_LEN);
+    key.gain_flag = (uint8_t)bank->gain;
+    key.ems = (int)(inputs->ems * (1 << 14));
+    key.ta = (int)((inputs->ta + 273.15) * (1 << 4));
+    key.tu = (int)((inputs->tu + 273.15) * (1 << 4));
+    key.dist_cm = (int)lround(inputs->dist * 100);
+    key.hum_milli = (int)lround(inputs->hum * 1000);
+
+    EnvParam_t env_param = { 0,0,0,0 };
+    EnvFactor_t env_factor = { 0 };
+    int hit = -1;
+    pthread_mutex_lock(&ctx->mutex);
+    for (int i = 0; i < ctx->cache_num && hit < 0; i++)
+    {
+        if (temp_env_key_equal(&ctx->cache[i].key, &key))
+        {
+            hit = i;
+            ctx->cache[i].used = ++ctx->cache_clock;
+            env_param = ctx->cache[i].env_param;
+            env_factor = ctx->cache[i].env_factor;
+            ctx->stats.hits++;
+        }
+    }
+    pthread_mutex_unlock(&ctx->mutex);
+
+    if (hit < 0)
+    {
+        int rst = temp_env_factor_calc(correct_table, nuc, (uint8_t)bank->gain, inputs->ems, inputs->ta, \
+            inputs->tu, inputs->dist, inputs->hum, &env_param, &env_factor);
+        if (rst != 0)
+        {
+            printf((rst == -2) ? "calculate_KE_and_BE failed\n" : "read tau failed\n");
+            return -1;
+        }
+        printf("tau=%d\n", env_param.TAU);
+    }
+
+    pthread_mutex_lock(&ctx->mutex);
+    if (hit < 0)
+    {
+        int slot = ctx->cache_num;
+        if (ctx->cache_num < TEMP_ENV_CACHE_NUM)
+        {
+            ctx->cache_num++;
+        }
+        else
+        {
+            slot = 0;
+            for (int i = 1; i < TEMP_ENV_CACHE_NUM; i++)
+            {
+                slot = (ctx->cache[i].used < ctx->cache[slot].used) ? i : slot;
+            }
+        }
+        ctx->cache[slot].key = key;
+        ctx->cache[slot].used = ++ctx->cache_clock;
+        ctx->cache[slot].env_param = env_param;
+        ctx->cache[slot].env_factor = env_factor;
+    }
+    bank->new_env_param = env_param;
+    bank->new_env_factor = env_factor;
+    if (bank->gain == ctx->gain.load())
+    {
+        ctx->new_env_param = env_param;
+        ctx->new_env_factor = env_factor;
+    }
+    EnvFactor_t org_factor = temp_env_bank_org(bank);
+    if (!bank->lut_keyed || !temp_env_key_near(&bank->lut_key, &key) || \
+        memcmp(&bank->lut_org_factor, &org_factor, sizeof(EnvFactor_t)) != 0)
+    {
+        bank->lut_key = key;
+        bank->lut_org_factor = org_factor;
+        bank->lut_keyed = 1;
+        temp_env_lut_schedule(bank);
+    }
+    else
+    {
+        ctx->stats.lut_kept++;
+    }
+    pthread_mutex_unlock(&ctx->mutex);
+    return 0;
+}
+
+//该函数的功能是计算新的环境变量校正参数
+// ems: 目标发射率(0.01-1)
+// ta:大气温度(单位:摄氏度)
+// tu:反射温度(单位:摄氏度)
+// dist:目标距离(0.25-49.99,单位:m)
+// hum: 环境相对湿度(0-1)
+//calculate the new environmental variable correction parameters
+//the current gain takes correct_table, the other resident gain its own table, both corrected tables are rebuilt
+//side by side so a gain switch finds its table ready
+int calculate_new_env_cali_parameter_ctx(TempCalibCtx_t* ctx, uint16_t* correct_table, double ems, double ta, \
+    double tu, double dist, double hum)
+{
+    if (correct_table == NULL)
+    {
+        return -1;
+    }
+    ctx = temp_calib_ctx(ctx);
+    TempEnvInputs_t inputs = { 1, ems, ta, tu, dist, hum };
+    pthread_mutex_lock(&ctx->mutex);
+    ctx->stats.calls++;
+    ctx->inputs = inputs;
+    int gain = ctx->gain.load();
+    pthread_mutex_unlock(&ctx->mutex);
+
+    int rst = temp_env_bank_calc(&ctx->bank[gain], correct_table, &inputs);
+    for (int other = 0; other < TEMP_GAIN_NUM; other++)
+    {
+        TempEnvBank_t* bank = &ctx->bank[other];
+        if (other != gain && bank->loaded && bank->correct_valid)
+        {
+            temp_env_bank_calc(bank, bank->correct, &inputs);
+        }
+    }
+    return rst;
+}
+
+int calculate_new_env_cali_parameter(uint16_t* correct_table, double ems, double ta, double tu, double dist, double hum)
+{
+    return calculate_new_env_cali_parameter_ctx(NULL, correct_table, ems, ta, tu, dist, hum);
+}
+
+int temp_gain_tables_set_ctx(TempCalibCtx_t* ctx, int gain, const uint16_t* nuc, const uint16_t* correct)
+{
+    if (gain < 0 || gain >= TEMP_GAIN_NUM || nuc == NULL)
+    {
+        return -1;
+    }
+    ctx = temp_calib_ctx(ctx);
+    TempEnvBank_t* bank = &ctx->bank[gain];
+    pthread_mutex_lock(&ctx->mutex);
+    memcpy(bank->nuc, nuc, sizeof(bank->nuc));
+    bank->correct_valid = (correct != NULL);
+    if (correct != NULL)
+    {
+        memcpy(bank->correct, correct, sizeof(bank->correct));
+    }
+    bank->loaded = 1;
+    //the frames' gain keeps the context's tables in step
+    if (gain == ctx->gain.load())
+    {
+        memcpy(ctx->nuc_table, nuc, sizeof(ctx->nuc_table));
+    }
+    memset(&bank->org_env_param, 0xFF, sizeof(EnvParam_t));
+    TempEnvInputs_t inputs = ctx->inputs;
+    pthread_mutex_unlock(&ctx->mutex);
+    temp_nuc_tables_update(bank->nuc);
+    if (inputs.valid && correct != NULL)
+    {
+        temp_env_bank_calc(bank, bank->correct, &inputs);
+    }
+    return 0;
+}
+
+int temp_gain_tables_set(int gain, const uint16_t* nuc, const uint16_t* correct)
+{
+    return temp_gain_tables_set_ctx(NULL, gain, nuc, correct);
+}
+
+int temp_gain_select_ctx(TempCalibCtx_t* ctx, int gain)
+{
+    ctx = temp_calib_ctx(ctx);
+    if (gain < 0 || gain >= TEMP_GAIN_NUM || !ctx->bank[gain].loaded)
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&ctx->mutex);
+    int cur = ctx->gain.load();
+    if (cur != gain)
+    {
+        //the gain left keeps what the context held for it
+        TempEnvBank_t* old_bank = &ctx->bank[cur];
+        if (!old_bank->loaded)
+        {
+            memcpy(old_bank->nuc, ctx->nuc_table, sizeof(old_bank->nuc));
+            old_bank->loaded = 1;
+        }
+        old_bank->org_env_param = ctx->org_env_param;
+        old_bank->org_env_factor = ctx->org_env_factor;
+        old_bank->new_env_param = ctx->new_env_param;
+        old_bank->new_env_factor = ctx->new_env_factor;
+
+        TempEnvBank_t* bank = &ctx->bank[gain];
+        ctx->gain.store(gain);
+        bank->org_env_param.EMS = ~ctx->org_env_param.EMS;
+        ctx->org_env_factor = temp_env_bank_org(bank);
+        memcpy(ctx->nuc_table, bank->nuc, sizeof(ctx->nuc_table));
+        ctx->new_env_param = bank->new_env_param;
+        ctx->new_env_factor = bank->new_env_factor;
+        ctx->info.gain_flag = (uint8_t)gain;
+        //the gain's snapshot was built for it already, the switch only swaps the pointer
+        ctx->current.store(bank->snapshot, std::memory_order_release);
+        ctx->stats.published++;
+    }
+    pthread_mutex_unlock(&ctx->mutex);
+    return 0;
+}
+
+int temp_gain_select(int gain)
+{
+    return temp_gain_select_ctx(NULL, gain);
+}
+
+int temp_gain_active_ctx(TempCalibCtx_t* ctx)
+{
+    return temp_calib_ctx(ctx)->gain.load();
+}
+
+int temp_gain_active(void)
+{
+    return temp_gain_active_ctx(NULL);
+}
+
+int temp_env_stats_ctx(TempCalibCtx_t* ctx, TempEnvStats_t* stats)
+{
+    if (stats == NULL)
+    {
+        return -1;
+    }
+    ctx = temp_calib_ctx(ctx);
+    pthread_mutex_lock(&ctx->mutex);
+    *stats = ctx->stats;
+    pthread_mutex_unlock(&ctx->mutex);
+    return 0;
+}
+
+int temp_env_stats(TempEnvStats_t* stats)
+{
+    return temp_env_stats_ctx(NULL, stats);
+}
+
+//reverse_calc_NUC_with_env_correct的结果按温度值缓存，一帧只对没见过的值调用库函数，之后的帧只查表
+enum {
+    TEMP_NUC_UNKNOWN = 0,
+    TEMP_NUC_VALID,
+    TEMP_NUC_FAILED,
+};
+
+typedef struct {
+    NucFactor_t nuc_factor;         //表对应的系数，变化时清空
+    uint8_t state[65536];
+    uint16_t nuc[65536];
+}TempNucLut_t;
+
+static TempNucLut_t temp_nuc_lut;
+static pthread_mutex_t temp_nuc_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+//reverse temp data to nuc
+int reverse_temp_frame_to_nuc(uint16_t* org_temp, NucFactor_t* nuc_factor, int pix_num, uint16_t* nuc_data)
+{
+    if (org_temp == NULL || nuc_factor == NULL || nuc_data == NULL)
+    {
+        return -1;
+    }
+    int ret = 0;
+    pthread_mutex_lock(&temp_nuc_mutex);
+    TempNucLut_t* lut = &temp_nuc_lut;
+    if (memcmp(&lut->nuc_factor, nuc_factor, sizeof(NucFactor_t)) != 0)
+    {
+        lut->nuc_factor = *nuc_factor;
+        memset(lut->state, TEMP_NUC_UNKNOWN, sizeof(lut->state));
+    }
+    for (int i = 0; i < pix_num; i++)
+    {
+        uint16_t value = org_temp[i];
+        if (lut->state[value] == TEMP_NUC_UNKNOWN)
+        {
+            //org_temp is in 1/16 K, the library takes kelvin
+            lut->state[value] = (reverse_calc_NUC_with_env_correct(nuc_factor, value / 16.0, &lut->nuc[value]) == \
+                IRTEMP_SUCCESS) ? TEMP_NUC_VALID : TEMP_NUC_FAILED;
+        }
+        if (lut->state[value] != TEMP_NUC_VALID)
+        {
+            printf("reverse_calc_NUC_with_env_correct failed\n");
+            ret = -1;
+            break;
+        }
+        nuc_data[i] = lut->nuc[value];
+    }
+    pthread_mutex_unlock(&temp_nuc_mutex);
+    return ret;
+}
+
+
+//NUC-T表的反查(温度->NUC)和正查(NUC->温度)表，按表的内容缓存，换表时重建
+//inv为每个温度段中心的reverse_calc_NUC_with_nuc_t(库函数逐项查找整张表)，fwd为每个NUC值的remap_temp
+enum {
+    TEMP_NUC_TABLES_EMPTY = 0,
+    TEMP_NUC_TABLES_BUILDING,
+    TEMP_NUC_TABLES_READY,
+};
+
+typedef struct {
+    int state;
+    int users;                      //acquire之后还在查表的调用者，为0时才能换成别的表
+    uint64_t used;                  //最近一次使用，替换最久未用的
+    uint16_t table[NUCT_LEN];       //建表用的NUC-T表
+    uint8_t inv_valid[TEMP_LUT_SIZE];
+    uint16_t inv[TEMP_LUT_SIZE];
+    uint8_t fwd_valid[TEMP_NUC_RANGE];
+    uint16_t fwd[TEMP_NUC_RANGE];   //温度，1/16 K
+}TempNucTables_t;
+
+static TempNucTables_t temp_nuc_tables[TEMP_NUC_TABLES_NUM];
+static uint64_t temp_nuc_tables_clock = 0;
+static pthread_mutex_t temp_nuc_tables_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t temp_nuc_tables_cond = PTHREAD_COND_INITIALIZER;
+
+//the temperature (K) the corrected tables evaluate bucket i at
+static double temp_lut_center(int i)
+{
+    return ((i << TEMP_LUT_SHIFT) + ((1 << TEMP_LUT_SHIFT) - 1) / 2.0) / 64;
+}
+
+//the bucket org_temp is the exact center of, -1 for any other temperature
+static int temp_lut_center_bucket(double org_temp)
+{
+    double steps = org_temp * 128;
+    if (!(steps >= 0 && steps < 65536 * 2) || steps != floor(steps) || ((int)steps & 7) != 3)
+    {
+        return -1;
+    }
+    return (int)steps >> 3;
+}
+
+static void temp_nuc_tables_build(TempNucTables_t* tables)
+{
+    for (int i = 0; i < TEMP_LUT_SIZE; i++)
+    {
+        tables->inv_valid[i] = (reverse_calc_NUC_with_nuc_t(tables->table, temp_lut_center(i) - 273.15, \
+            &tables->inv[i]) == IRTEMP_SUCCESS);
+    }
+    for (int nuc = 0; nuc < TEMP_NUC_RANGE; nuc++)
+    {
+        tables->fwd_valid[nuc] = (remap_temp(tables->table, (uint16_t)nuc, &tables->fwd[nuc]) == IRTEMP_SUCCESS);
+    }
+}
+
+//the tables of nuc_table's content. build 0 only finds ready ones, 1 builds them when no entry has them.
+//NULL when they are missing, or every entry is in use by other tables
+static TempNucTables_t* temp_nuc_tables_acquire(const uint16_t* nuc_table, int build)
+{
+    if (nuc_table == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_lock(&temp_nuc_tables_mutex);
+    while (1)
+    {
+        TempNucTables_t* found = NULL;
+        TempNucTables_t* victim = NULL;
+        for (int i = 0; i < TEMP_NUC_TABLES_NUM; i++)
+        {
+            TempNucTables_t* tables = &temp_nuc_tables[i];
+            if (tables->state != TEMP_NUC_TABLES_EMPTY && memcmp(tables->table, nuc_table, sizeof(tables->table)) == 0)
+            {
+                found = tables;
+                break;
+            }
+            if (tables->users == 0 && (victim == NULL || tables->used < victim->used))
+            {
+                victim = tables;
+            }
+        }
+        if (found != NULL && found->state == TEMP_NUC_TABLES_READY)
+        {
+            found->users++;
+            found->used = ++temp_nuc_tables_clock;
+            pthread_mutex_unlock(&temp_nuc_tables_mutex);
+            return found;
+        }
+        if (found != NULL && build)
+        {
+            //another thread builds them
+            pthread_cond_wait(&temp_nuc_tables_cond, &temp_nuc_tables_mutex);
+            continue;
+        }
+        if (found != NULL || victim == NULL || !build)
+        {
+            pthread_mutex_unlock(&temp_nuc_tables_mutex);
+            return NULL;
+        }
+        victim->state = TEMP_NUC_TABLES_BUILDING;
+        victim->users = 1;
+        memcpy(victim->table, nuc_table, sizeof(victim->table));
+        pthread_mutex_unlock(&temp_nuc_tables_mutex);
+
+        TRACE_BEGIN("nuc_tables");
+        temp_nuc_tables_build(victim);
+        TRACE_END("nuc_tables");
+        pthread_mutex_lock(&temp_nuc_tables_mutex);
+        victim->state = TEMP_NUC_TABLES_READY;
+        victim->used = ++temp_nuc_tables_clock;
+        pthread_cond_broadcast(&temp_nuc_tables_cond);
+        pthread_mutex_unlock(&temp_nuc_tables_mutex);
+        return victim;
+    }
+}
+
+static void temp_nuc_tables_release(TempNucTables_t* tables)
+{
+    if (tables == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&temp_nuc_tables_mutex);
+    tables->users--;
+    pthread_mutex_unlock(&temp_nuc_tables_mutex);
+}
+
+static void temp_nuc_tables_task(void* arg)
+{
+    temp_nuc_tables_release(temp_nuc_tables_acquire((const uint16_t*)arg, 1));
+}
+
+void temp_nuc_tables_update(const uint16_t* nuc_table)
+{
+    if (nuc_table != NULL)
+    {
+        pool_submit(POOL_STAGE_OTHER, temp_nuc_tables_task, (void*)nuc_table);
+    }
+}
+
+//reverse_calc_NUC_with_nuc_t, one lookup for the bucket centers when the tables are there
+static int temp_nuc_reverse(const TempNucTables_t* tables, uint16_t* nuc_table, double org_temp, uint16_t* nuc_cal)
+{
+    int bucket = (tables != NULL) ? temp_lut_center_bucket(org_temp) : -1;
+    if (bucket >= 0)
+    {
+        *nuc_cal = tables->inv[bucket];
+        return tables->inv_valid[bucket] ? 0 : -1;
+    }
+    return (reverse_calc_NUC_with_nuc_t(nuc_table, org_temp - 273.15, nuc_cal) == IRTEMP_SUCCESS) ? 0 : -1;
+}
+
+//remap_temp, the library indexes the table with nuc / 2 unchecked, values past its end fail here
+static int temp_nuc_remap(const TempNucTables_t* tables, const uint16_t* nuc_table, uint16_t nuc, uint16_t* temp_data)
+{
+    if (nuc >= TEMP_NUC_RANGE)
+    {
+        return -1;
+    }
+    if (tables != NULL)
+    {
+        *temp_data = tables->fwd[nuc];
+        return tables->fwd_valid[nuc] ? 0 : -1;
+    }
+    return (remap_temp(nuc_table, nuc, temp_data) == IRTEMP_SUCCESS) ? 0 : -1;
+}
+
+//the whole environment correction chain, verbose prints every step. tables (may be NULL) replaces the two
+//searches of the nuc-t table with lookups
+static int temp_env_recalc(TempCalInfo_t* temp_cal_info, const TempNucTables_t* tables, double org_temp, \
+    double* new_temp, int verbose)
+{
+    uint16_t nuc_cal = 0;
+    uint16_t nuc_org = 0;
+    irtemp_error_t ret;
+    uint16_t temp_data = 0;
+
+    int rst = temp_nuc_reverse(tables, temp_cal_info->nuc_table, org_temp, &nuc_cal);
+    if (verbose) LOG(LOG_LEVEL_DEBUG, "nuc_cal=%d\n", nuc_cal);
+    if (rst != 0)
+    {
+        if (verbose) LOG(LOG_LEVEL_ERROR, "reverse_calc_NUC_with_nuc_t failed\n");
+        return -1;
+    };
+    ret = reverse_calc_NUC_without_env_correct(temp_cal_info->org_env_factor, nuc_cal, &nuc_org);
+    if (verbose)
+    {
+        LOG(LOG_LEVEL_DEBUG, "nuc_org=%d\n", nuc_org);
+        LOG(LOG_LEVEL_DEBUG, "K_E=%d,B_E=%d\n", temp_cal_info->org_env_factor->K_E, temp_cal_info->org_env_factor->B_E);
+    }
+    if (ret != IRTEMP_SUCCESS)
+    {
+        if (verbose) LOG(LOG_LEVEL_ERROR, "reverse_calc_NUC_without_env_correct failed\n");
+        return -1;
+    };
+    ret = recalc_NUC_with_env_correct(temp_cal_info->new_env_factor, nuc_org, &nuc_cal);
+    if (verbose)
+    {
+        LOG(LOG_LEVEL_DEBUG, "nuc_cal=%d\n", nuc_cal);
+        LOG(LOG_LEVEL_DEBUG, "K_E=%d,B_E=%d\n", temp_cal_info->new_env_factor->K_E, temp_cal_info->new_env_factor->B_E);
+    }
+    if (ret != IRTEMP_SUCCESS)
+    {
+        if (verbose) LOG(LOG_LEVEL_ERROR, "recalc_NUC_with_env_correct failed\n");
+        return -1;
+    };
+    if (temp_nuc_remap(tables, temp_cal_info->nuc_table, nuc_cal, &temp_data) != 0)
+    {
+        if (verbose) LOG(LOG_LEVEL_ERROR, "remap_temp failed\n");
+        return -1;
+    };
+    *new_temp = (double)temp_data / 16;
+    return 0;
+}
+
+// recalibrate the temperature with new environment parameters
+// org_temp,unit:K    new_temp,unit:K
+int temp_calc_with_new_env_calibration(TempCalInfo_t* temp_cal_info, double org_temp, double* new_temp)
+{
+    TempNucTables_t* tables = temp_nuc_tables_acquire(temp_cal_info->nuc_table, 0);
+    int ret = temp_env_recalc(temp_cal_info, tables, org_temp, new_temp, 1);
+    temp_nuc_tables_release(tables);
+    return ret;
+}
+
+static int16_t temp_centi_celsius_of(double celsius)
+{
+    double centi = floor(celsius * 100 + 0.5);
+    return (int16_t)((centi > 32767) ? 32767 : ((centi < -32768) ? -32768 : centi));
+}
+
+void temp_env_map_init(TempEnvMap_t* env_map, TempCalInfo_t* temp_cal_info)
+{
+    if (env_map == NULL)
+    {
+        return;
+    }
+    memset(env_map, 0, sizeof(TempEnvMap_t));
+    env_map->temp_cal_info = temp_cal_info;
+}
+
+static int temp_env_map_stale(const TempEnvMap_t* env_map)
+{
+    const TempCalInfo_t* info = env_map->temp_cal_info;
+    return !env_map->valid || \
+        memcmp(&env_map->env_param, info->new_env_param, sizeof(EnvParam_t)) != 0 || \
+        memcmp(&env_map->org_env_factor, info->org_env_factor, sizeof(EnvFactor_t)) != 0 || \
+        memcmp(&env_map->new_env_factor, info->new_env_factor, sizeof(EnvFactor_t)) != 0;
+}
+
+//每个表项取该段(4个temp_val)的中心值修正，修正失败的温度段映射到自身的中心值
+int temp_env_map_update(TempEnvMap_t* env_map)
+{
+    if (env_map == NULL || env_map->temp_cal_info == NULL)
+    {
+        return -1;
+    }
+    if (!temp_env_map_stale(env_map))
+    {
+        return 0;
+    }
+
+    TempCalInfo_t* info = env_map->temp_cal_info;
+    env_map->env_param = *info->new_env_param;
+    env_map->org_env_factor = *info->org_env_factor;
+    env_map->new_env_factor = *info->new_env_factor;
+    env_map->failed = 0;
+    TempNucTables_t* tables = temp_nuc_tables_acquire(info->nuc_table, 1);
+    for (int i = 0; i < TEMP_LUT_SIZE; i++)
+    {
+        double new_temp = 0;
+        uint32_t temp_val = (i << TEMP_LUT_SHIFT) + (1 << (TEMP_LUT_SHIFT - 1));
+        if (temp_env_recalc(info, tables, temp_lut_center(i), &new_temp, 0) == 0)
+        {
+            //remap_temp gives kelvin*16, temp_val is kelvin*64
+            temp_val = (uint32_t)(new_temp * 64 + 0.5);
+        }
+        else
+        {
+            env_map->failed++;
+        }
+        env_map->temp_map[i] = (uint16_t)((temp_val > 65535) ? 65535 : temp_val);
+    }
+    temp_nuc_tables_release(tables);
+    env_map->valid = 1;
+    return 1;
+}
+
+int temp_env_map_apply(TempEnvMap_t* env_map, const uint16_t* temp_data, int pix_num, uint16_t* dst)
+{
+    if (temp_data == NULL || dst == NULL || temp_env_map_update(env_map) < 0)
+    {
+        return -1;
+    }
+    const uint16_t* temp_map = env_map->temp_map;
+    for (int i = 0; i < pix_num; i++)
+    {
+        dst[i] = temp_map[temp_data[i] >> TEMP_LUT_SHIFT];
+    }
+    return 0;
+}
+
+//参数变化时由增益的temp_env_map重建摄氏度表，建好的表连同建表参数作为新快照整体发布
+//任务池上建表，每个增益一个任务可以并行，建表期间又有新参数时用最新的参数再建一次，只有这里写bank的map
+static void temp_env_lut_build(void* arg)
+{
+    TempEnvBank_t* bank = (TempEnvBank_t*)arg;
+    TempCalibCtx_t* ctx = bank->ctx;
+    pthread_mutex_lock(&ctx->mutex);
+    do
+    {
+        bank->lut_state = TEMP_ENV_LUT_RUNNING;
+        if (bank->gain == ctx->gain.load())
+        {
+            bank->build_param[0] = ctx->org_env_param;
+            bank->build_factor[0] = ctx->org_env_factor;
+            bank->build_param[1] = ctx->new_env_param;
+            bank->build_factor[1] = ctx->new_env_factor;
+        }
+        else
+        {
+            temp_env_bank_org(bank);
+            bank->build_param[0] = bank->org_env_param;
+            bank->build_factor[0] = bank->org_env_factor;
+            bank->build_param[1] = bank->new_env_param;
+            bank->build_factor[1] = bank->new_env_factor;
+        }
+        TempCalInfo_t info = { &bank->build_param[0], &bank->build_param[1], (uint8_t)bank->gain, &ctx->nuc_factor, \
+            &bank->build_factor[0], &bank->build_factor[1], (uint16_t*)temp_env_bank_nuc(bank) };
+        bank->build_info = info;
+        if (bank->map.temp_cal_info != &bank->build_info)
+        {
+            temp_env_map_init(&bank->map, &bank->build_info);
+        }
+        int first = (bank->snapshot == NULL);
+        pthread_mutex_unlock(&ctx->mutex);
+
+        TempCalibSnapshot_t* snapshot = NULL;
+        if (temp_env_map_update(&bank->map) != 0 || first)
+        {
+            snapshot = (TempCalibSnapshot_t*)malloc(sizeof(TempCalibSnapshot_t));
+        }
+        if (snapshot != NULL)
+        {
+            mem_acct_add(MEM_CLASS_LUT, sizeof(TempCalibSnapshot_t));
+            snapshot->gain = (uint8_t)bank->gain;
+            snapshot->org_env_param = bank->build_param[0];
+            snapshot->org_env_factor = bank->map.org_env_factor;
+            snapshot->new_env_param = bank->map.env_param;
+            snapshot->new_env_factor = bank->map.new_env_factor;
+            snapshot->nuc_factor = ctx->nuc_factor;
+            memcpy(snapshot->nuc_table, bank->build_info.nuc_table, sizeof(snapshot->nuc_table));
+            snapshot->failed = bank->map.failed;
+            for (int i = 0; i < TEMP_LUT_SIZE; i++)
+            {
+                double celsius = (double)bank->map.temp_map[i] / 64 - 273.15;
+                snapshot->celsius[i] = (float)celsius;
+                snapshot->centi_celsius[i] = temp_centi_celsius_of(celsius);
+            }
+            printf("temperature lut of gain %d rebuilt, %d of %d entries out of the calibrated range\n", bank->gain, \
+                bank->map.failed, TEMP_LUT_SIZE);
+        }
+        pthread_mutex_lock(&ctx->mutex);
+        if (snapshot != NULL)
+        {
+            snapshot->version = ++ctx->version;
+            temp_calib_publish(bank, snapshot);
+            ctx->stats.lut_builds++;
+        }
+    } while (bank->lut_state == TEMP_ENV_LUT_AGAIN);
+    bank->lut_state = TEMP_ENV_LUT_IDLE;
+    pthread_cond_broadcast(&ctx->cond);
+    pthread_mutex_unlock(&ctx->mutex);
+}
+
+void temp_env_lut_update_ctx(TempCalibCtx_t* ctx)
+{
+    ctx = temp_calib_ctx(ctx);
+    pthread_mutex_lock(&ctx->mutex);
+    temp_env_lut_schedule(&ctx->bank[ctx->gain.load()]);
+    pthread_mutex_unlock(&ctx->mutex);
+}
+
+void temp_env_lut_update(void)
+{
+    temp_env_lut_update_ctx(NULL);
+}
+
+void temp_env_lut_wait_ctx(TempCalibCtx_t* ctx)
+{
+    ctx = temp_calib_ctx(ctx);
+    pthread_mutex_lock(&ctx->mutex);
+    for (int gain = 0; gain < TEMP_GAIN_NUM; gain++)
+    {
+        while (ctx->bank[gain].lut_state != TEMP_ENV_LUT_IDLE)
+        {
+            pthread_cond_wait(&ctx->cond, &ctx->mutex);
+        }
+    }
+    pthread_mutex_unlock(&ctx->mutex);
+}
+
+void temp_env_lut_wait(void)
+{
+    temp_env_lut_wait_ctx(NULL);
+}
+
+void temp_frame_to_celsius(const uint16_t* temp_data, int pix_num, float* dst)
+{
+    simd_u16_to_f32(temp_data, pix_num, 1.0 / 64, -273.15, dst);
+}
+
+//(v / 64 - 273.15) * 100 = v * 25 / 16 - 27315, all integer, temp_centi_of_raw of every pixel
+void temp_frame_to_centi_celsius(const uint16_t* temp_data, int pix_num, int16_t* dst)
+{
+    simd_u16_to_s16_fixed(temp_data, pix_num, TEMP_CENTI_MUL, TEMP_CENTI_SHIFT, -TEMP_CENTI_ZERO, dst);
+}
+
+int temp_frame_to_celsius_env_ctx(TempCalibCtx_t* ctx, const uint16_t* temp_data, int pix_num, float* dst)
+{
+    const TempCalibSnapshot_t* snapshot = temp_calib_acquire(ctx);
+    if (snapshot == NULL)
+    {
+        temp_frame_to_celsius(temp_data, pix_num, dst);
+        return -1;
+    }
+    const float* lut = snapshot->celsius;
+    for (int i = 0; i < pix_num; i++)
+    {
+        dst[i] = lut[temp_data[i] >> TEMP_LUT_SHIFT];
+    }
+    return 0;
 }
 
-
-//temperature value to actual temp(Celsius)
-float temp_value_converter(uint16_t temp_val)
+int temp_frame_to_celsius_env(const uint16_t* temp_data, int pix_num, float* dst)
 {
-    return ((double)temp_val / 64 - 273.15);
+    return temp_frame_to_celsius_env_ctx(NULL, temp_data, pix_num, dst);
 }
 
-
-//该函数的功能是计算新的环境变量校正参数
-// ems: 目标发射率(0.01-1)
-// ta:大气温度(单位:摄氏度)
-// tu:反射温度(单位:摄氏度)
-// dist:目标距离(0.25-49.99,单位:m)
-// hum: 环境相对湿度(0-1)
-//calculate the new environmental variable correction parameters
-int calculate_new_env_cali_parameter(uint16_t* correct_table, double ems, double ta, double tu, double dist, double hum)
+int temp_frame_to_centi_celsius_env_ctx(TempCalibCtx_t* ctx, const uint16_t* temp_data, int pix_num, int16_t* dst)
 {
-    uint16_t tau = 0;
-    if (read_tau(correct_table, hum, ta, dist, &tau) != IRTEMP_SUCCESS)
+    const TempCalibSnapshot_t* snapshot = temp_calib_acquire(ctx);
+    if (snapshot == NULL)
     {
-        printf("read tau failed\n");
+        temp_frame_to_centi_celsius(temp_data, pix_num, dst);
         return -1;
     }
-    printf("tau=%d\n", tau);
-    new_env_param.EMS = ems * (1 << 14);
-    new_env_param.TAU = tau;
-    new_env_param.Ta = (ta + 273.15) * (1 << 4);
-    new_env_param.Tu = (tu + 273.15) * (1 << 4);
-    if (calculate_new_KE_and_BE_with_nuc_t(&new_env_param, nuc_table, gain_flag, &new_env_factor) != IRTEMP_SUCCESS)
+    const int16_t* lut = snapshot->centi_celsius;
+    for (int i = 0; i < pix_num; i++)
     {
-        printf("calculate_KE_and_BE failed\n");
-        return -1;
+        dst[i] = lut[temp_data[i] >> TEMP_LUT_SHIFT];
     }
     return 0;
 }
 
+int temp_frame_to_centi_celsius_env(const uint16_t* temp_data, int pix_num, int16_t* dst)
+{
+    return temp_frame_to_centi_celsius_env_ctx(NULL, temp_data, pix_num, dst);
+}
 
-//reverse temp data to nuc
-int reverse_temp_frame_to_nuc(uint16_t* org_temp, NucFactor_t* nuc_factor, int pix_num, uint16_t* nuc_data)
+//the 3x3 mean without its max and min, what get_point_temp returns off the border
+static inline uint16_t temp_point_filtered(const uint16_t* center, int width)
 {
-    int ret = 0;
-    int i = 0;
-    while (i < pix_num)
+    uint32_t sum = 0, hi = 0, lo = 0xffff;
+    for (int dy = -1; dy <= 1; dy++)
     {
-        double temp = *org_temp / 16;
-        ret = reverse_calc_NUC_with_env_correct(nuc_factor, temp, nuc_data);
-        if (ret != IRTEMP_SUCCESS)
+        const uint16_t* row = center + dy * width;
+        for (int dx = -1; dx <= 1; dx++)
         {
-            printf("reverse_calc_NUC_with_env_correct failed\n");
-            return -1;
-        };
-        org_temp++;
-        nuc_data++;
-        i++;
+            uint32_t v = row[dx];
+            sum += v;
+            hi = (v > hi) ? v : hi;
+            lo = (v < lo) ? v : lo;
+        }
     }
-    return 0;
+    return (uint16_t)((sum - hi - lo + 3) / 7);
 }
 
-
-// recalibrate the temperature with new environment parameters
-// org_temp,unit:K    new_temp,unit:K
-int temp_calc_with_new_env_calibration(TempCalInfo_t* temp_cal_info, double org_temp, double* new_temp)
+static inline uint16_t temp_point_one(uint16_t* temp_data, TempDataRes_t temp_res, int x, int y)
 {
-    uint16_t nuc_cal = 0;
-    uint16_t nuc_org = 0;
-    irtemp_error_t ret;
-    uint16_t temp_data = 0;
+    int width = temp_res.width;
+    if (x > 0 && y > 0 && x < width - 1 && y < temp_res.height - 1)
+    {
+        return temp_point_filtered(temp_data + y * width + x, width);
+    }
+    Dot_t point = { x, y };
+    uint16_t temp = 0;
+    get_point_temp(temp_data, temp_res, point, &temp);
+    return temp;
+}
 
-    ret = reverse_calc_NUC_with_nuc_t(temp_cal_info->nuc_table, org_temp - 273.15, &nuc_cal);
-    printf("nuc_cal=%d\n", nuc_cal);
-    if (ret != IRTEMP_SUCCESS)
+int temp_points_get(uint16_t* temp_data, TempDataRes_t temp_res, const Dot_t* points, int num, uint16_t* dst)
+{
+    if (temp_data == NULL || points == NULL || dst == NULL)
     {
-        printf("reverse_calc_NUC_with_nuc_t failed\n");
         return -1;
-    };
-    ret = reverse_calc_NUC_without_env_correct(temp_cal_info->org_env_factor, nuc_cal, &nuc_org);
-    printf("nuc_org=%d\n", nuc_org);
-    printf("K_E=%d,B_E=%d\n", temp_cal_info->org_env_factor->K_E, temp_cal_info->org_env_factor->B_E);
-    if (ret != IRTEMP_SUCCESS)
+    }
+    int inside = 0;
+    for (int i = 0; i < num; i++)
     {
-        printf("reverse_calc_NUC_without_env_correct failed\n");
-        return -1;
-    };
-    ret = recalc_NUC_with_env_correct(temp_cal_info->new_env_factor, nuc_org, &nuc_cal);
-    printf("nuc_cal=%d\n", nuc_cal);
-    printf("K_E=%d,B_E=%d\n", temp_cal_info->new_env_factor->K_E, temp_cal_info->new_env_factor->B_E);
-    if (ret != IRTEMP_SUCCESS)
+        if (points[i].x < 0 || points[i].y < 0 || points[i].x >= temp_res.width || points[i].y >= temp_res.height)
+        {
+            dst[i] = 0;
+            continue;
+        }
+        dst[i] = temp_point_one(temp_data, temp_res, points[i].x, points[i].y);
+        inside++;
+    }
+    return inside;
+}
+
+int temp_mask_get(uint16_t* temp_data, TempDataRes_t temp_res, const uint8_t* mask, uint16_t* dst)
+{
+    if (temp_data == NULL || mask == NULL || dst == NULL)
     {
-        printf("recalc_NUC_with_env_correct failed\n");
         return -1;
-    };
-    ret = remap_temp(temp_cal_info->nuc_table, nuc_cal, &temp_data);
-    if (ret != IRTEMP_SUCCESS)
+    }
+    int width = temp_res.width, height = temp_res.height;
+    int num = 0;
+    for (int y = 0; y < height; y++)
+    {
+        const uint8_t* mask_row = mask + y * width;
+        uint16_t* dst_row = dst + y * width;
+        uint8_t border_row = (y == 0 || y == height - 1);
+        for (int x = 0; x < width; x++)
+        {
+            if (mask_row[x] == 0)
+            {
+                continue;
+            }
+            if (border_row || x == 0 || x == width - 1)
+            {
+                dst_row[x] = temp_point_one(temp_data, temp_res, x, y);
+            }
+            else
+            {
+                dst_row[x] = temp_point_filtered(temp_data + y * width + x, width);
+            }
+            num++;
+        }
+    }
+    return num;
+}
+
+int temp_points_get_celsius_ctx(TempCalibCtx_t* ctx, uint16_t* temp_data, TempDataRes_t temp_res, const Dot_t* points, \
+    int num, int env, float* dst)
+{
+    if (temp_data == NULL || points == NULL || dst == NULL)
     {
-        printf("remap_temp failed\n");
         return -1;
-    };
-    *new_temp = (double)temp_data / 16;
-    return 0;
+    }
+    const TempCalibSnapshot_t* snapshot = env ? temp_calib_acquire(ctx) : NULL;
+    const float* lut = (snapshot != NULL) ? snapshot->celsius : NULL;
+    int inside = 0;
+    for (int i = 0; i < num; i++)
+    {
+        if (points[i].x < 0 || points[i].y < 0 || points[i].x >= temp_res.width || points[i].y >= temp_res.height)
+        {
+            dst[i] = 0;
+            continue;
+        }
+        uint16_t temp = temp_point_one(temp_data, temp_res, points[i].x, points[i].y);
+        dst[i] = (lut != NULL) ? lut[temp >> TEMP_LUT_SHIFT] : temp_value_converter(temp);
+        inside++;
+    }
+    return inside;
+}
+
+int temp_points_get_celsius(uint16_t* temp_data, TempDataRes_t temp_res, const Dot_t* points, int num, int env, \
+    float* dst)
+{
+    return temp_points_get_celsius_ctx(NULL, temp_data, temp_res, points, num, env, dst);
+}
+
+int temp_points_verify(uint16_t* temp_data, TempDataRes_t temp_res)
+{
+    int pix_num = temp_res.width * temp_res.height;
+    uint8_t* mask = (uint8_t*)malloc(pix_num);
+    uint16_t* batch = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+    int mismatch = -1;
+    if (temp_data != NULL && mask != NULL && batch != NULL)
+    {
+        memset(mask, 1, pix_num);
+        temp_mask_get(temp_data, temp_res, mask, batch);
+        mismatch = 0;
+        for (int y = 0; y < temp_res.height; y++)
+        {
+            for (int x = 0; x < temp_res.width; x++)
+            {
+                Dot_t point = { x, y };
+                uint16_t temp = 0;
+                get_point_temp(temp_data, temp_res, point, &temp);
+                mismatch += (temp != batch[y * temp_res.width + x]);
+            }
+        }
+    }
+    free(mask);
+    free(batch);
+    return mismatch;
 }
 
 // recalibrate the temperature with new environment parameters
 // org_temp,unit:K    new_temp,unit:K
-int temp_calc_without_any_correct(TempCalInfo_t* temp_cal_info, double org_temp, double* new_temp)
+static int temp_org_recalc(TempCalInfo_t* temp_cal_info, const TempNucTables_t* tables, double org_temp, \
+    double* new_temp, int verbose)
 {
     uint16_t nuc_cal = 0;
     uint16_t nuc_org = 0;
     irtemp_error_t ret;
     uint16_t temp_data = 0;
-    ret = reverse_calc_NUC_with_nuc_t(temp_cal_info->nuc_table, org_temp - 273.15, &nuc_cal);
-    if (ret != IRTEMP_SUCCESS)
+    if (temp_nuc_reverse(tables, temp_cal_info->nuc_table, org_temp, &nuc_cal) != 0)
     {
-        printf("reverse_calc_NUC_with_nuc_t failed\n");
+        if (verbose) printf("reverse_calc_NUC_with_nuc_t failed\n");
         return -1;
     };
     ret = reverse_calc_NUC_without_env_correct(temp_cal_info->org_env_factor, nuc_cal, &nuc_org);
     if (ret != IRTEMP_SUCCESS)
     {
-        printf("reverse_calc_NUC_without_env_correct failed\n");
+        if (verbose) printf("reverse_calc_NUC_without_env_correct failed\n");
         return -1;
     };
-    ret = remap_temp(temp_cal_info->nuc_table, nuc_org, &temp_data);
-    if (ret != IRTEMP_SUCCESS)
+    if (temp_nuc_remap(tables, temp_cal_info->nuc_table, nuc_org, &temp_data) != 0)
     {
-        printf("remap_temp failed\n");
+        if (verbose) printf("remap_temp failed\n");
         return -1;
     };
     *new_temp = (double)temp_data / 16;
     return 0;
 }
 
+int temp_calc_without_any_correct(TempCalInfo_t* temp_cal_info, double org_temp, double* new_temp)
+{
+    TempNucTables_t* tables = temp_nuc_tables_acquire(temp_cal_info->nuc_table, 0);
+    int ret = temp_org_recalc(temp_cal_info, tables, org_temp, new_temp, 1);
+    temp_nuc_tables_release(tables);
+    return ret;
+}
+
+int temp_calc_without_any_correct_lut(TempCalInfo_t* temp_cal_info, float* org_celsius)
+{
+    if (temp_cal_info == NULL || org_celsius == NULL)
+    {
+        return -1;
+    }
+    TempNucTables_t* tables = temp_nuc_tables_acquire(temp_cal_info->nuc_table, 1);
+    int failed = 0;
+    for (int i = 0; i < TEMP_LUT_SIZE; i++)
+    {
+        double org_temp = 0;
+        if (temp_org_recalc(temp_cal_info, tables, temp_lut_center(i), &org_temp, 0) != 0 || org_temp <= 0)
+        {
+            org_celsius[i] = TEMP_LUT_INVALID_CELSIUS;
+            failed++;
+            continue;
+        }
+        org_celsius[i] = (float)(org_temp - 273.15);
+    }
+    temp_nuc_tables_release(tables);
+    return failed;
+}
+
 void print_cali_info(TempCalInfo_t* temp_cal_info)
 {
     printf("origin ems = %d \n", temp_cal_info->org_env_param->EMS);
@@ -177,25 +1319,25 @@ void print_cali_info(TempCalInfo_t* temp_cal_info)
 //detect the point's temperature
 void point_temp_demo(uint16_t* temp_data, TempDataRes_t temp_res)
 {
-    Dot_t point = { 128,96 };
+    Dot_t point = { temp_res.width / 2, temp_res.height / 2 };
     uint16_t temp = 0;
     if (get_point_temp(temp_data, temp_res, point, &temp) == IRTEMP_SUCCESS)
     {
-        printf("point(%d,%d)temp:%f\n", point.x, point.y, temp_value_converter(temp));
+        LOG(LOG_LEVEL_INFO, "point(%d,%d)temp:%f\n", point.x, point.y, temp_value_converter(temp));
     }
 }
 
 
 void line_temp_demo(uint16_t* temp_data, TempDataRes_t temp_res)
 {
-    Line_t line = { 128,191, 128,0, };
+    Line_t line = { temp_res.width / 2, temp_res.height - 1, temp_res.width / 2, 0 };
     //Line_t line = { 191,128,0,128 };
     //Line_t line = { 20,50,128,30, };
     TempInfo_t temp_info = { 0 };
 
     if (get_line_temp(temp_data, temp_res, line, &temp_info) == IRTEMP_SUCCESS)
     {
-        printf("current line temp: max=%f, min=%f, avr=%f\n", \
+        LOG(LOG_LEVEL_INFO, "current line temp: max=%f, min=%f, avr=%f\n", \
             temp_value_converter(temp_info.max_temp), \
             temp_value_converter(temp_info.min_temp), \
             temp_value_converter(temp_info.avr_temp));
@@ -212,7 +1354,7 @@ void rect_temp_demo(uint16_t* temp_data, TempDataRes_t temp_res)
 
     if (get_rect_temp(temp_data, temp_res, rect, &temp_info) == IRTEMP_SUCCESS)
     {
-        printf("rectangle temp: max=%f, min=%f, avr=%f\n", \
+        LOG(LOG_LEVEL_INFO, "rectangle temp: max=%f, min=%f, avr=%f\n", \
             temp_value_converter(temp_info.max_temp), \
             temp_value_converter(temp_info.min_temp), \
             temp_value_converter(temp_info.avr_temp));
@@ -220,7 +1362,360 @@ void rect_temp_demo(uint16_t* temp_data, TempDataRes_t temp_res)
 }
 
 
+//detect the temperature of all registered rectangles and lines, the rois are set up on the first frame
+void roi_temp_demo(uint16_t* temp_data, TempDataRes_t temp_res)
+{
+    static RoiEngine_t roi_engine;
+    static int roi_engine_ready = 0;
+    if (!roi_engine_ready)
+    {
+        if (roi_engine_init(&roi_engine, temp_res) != ROI_SUCCESS)
+        {
+            printf("roi engine init failed\n");
+            return;
+        }
+        Area_t rect = { 50,50,20,20 };
+        Line_t line = { temp_res.width / 2, temp_res.height - 1, temp_res.width / 2, 0 };
+        roi_engine_add_rect(&roi_engine, rect);
+        roi_engine_add_line(&roi_engine, line);
+        roi_engine_ready = 1;
+    }
+
+    TempInfo_t temp_info[ROI_MAX_NUM];
+    if (roi_engine_process(&roi_engine, temp_data, temp_info) != ROI_SUCCESS)
+    {
+        return;
+    }
+    for (int i = 0; i < roi_engine.roi_num; i++)
+    {
+        LOG(LOG_LEVEL_INFO, "roi %d temp: max=%f, min=%f, avr=%f\n", i, \
+            temp_value_converter(temp_info[i].max_temp), \
+            temp_value_converter(temp_info[i].min_temp), \
+            temp_value_converter(temp_info[i].avr_temp));
+    }
+}
+
+
+int temp_analytics_init(TempAnalytics_t* analytics, TempDataRes_t temp_res, uint32_t report_interval)
+{
+    if (analytics == NULL)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    memset(analytics, 0, sizeof(TempAnalytics_t));
+    analytics->report_interval = report_interval;
+    return roi_engine_init(&analytics->roi_engine, temp_res);
+}
+
+void temp_analytics_release(TempAnalytics_t* analytics)
+{
+    if (analytics != NULL)
+    {
+        roi_engine_release(&analytics->roi_engine);
+        roi_windows_release(&analytics->windows);
+    }
+}
+
+static int temp_analytics_added(TempAnalytics_t* analytics, int roi_id, uint8_t is_point, const TempThreshold_t* threshold)
+{
+    if (roi_id < 0)
+    {
+        return roi_id;
+    }
+    analytics->is_point[roi_id] = is_point;
+    analytics->has_threshold[roi_id] = (threshold != NULL);
+    if (threshold != NULL)
+    {
+        analytics->threshold[roi_id] = *threshold;
+    }
+    analytics->alarm[roi_id] = TEMP_NORMAL;
+    analytics->has_window_rule[roi_id] = 0;
+    analytics->window_alarm[roi_id] = TEMP_NORMAL;
+    roi_windows_reset(&analytics->windows, roi_id);
+    return roi_id;
+}
+
+int temp_analytics_add_point(TempAnalytics_t* analytics, Dot_t point, const TempThreshold_t* threshold)
+{
+    if (analytics == NULL)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    Area_t rect = { point.x, point.y, 1, 1 };
+    return temp_analytics_added(analytics, roi_engine_add_rect(&analytics->roi_engine, rect), 1, threshold);
+}
+
+int temp_analytics_add_line(TempAnalytics_t* analytics, Line_t line, const TempThreshold_t* threshold)
+{
+    if (analytics == NULL)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    return temp_analytics_added(analytics, roi_engine_add_line(&analytics->roi_engine, line), 0, threshold);
+}
+
+int temp_analytics_add_rect(TempAnalytics_t* analytics, Area_t rect, const TempThreshold_t* threshold)
+{
+    if (analytics == NULL)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    return temp_analytics_added(analytics, roi_engine_add_rect(&analytics->roi_engine, rect), 0, threshold);
+}
+
+int temp_analytics_windows_set(TempAnalytics_t* analytics, const uint32_t* horizon_ms, int num)
+{
+    if (analytics == NULL || horizon_ms == NULL || num <= 0 || num > ROI_WINDOW_MAX)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    RoiWindowParam_t param;
+    memset(&param, 0, sizeof(param));
+    memcpy(param.horizon_ms, horizon_ms, num * sizeof(uint32_t));
+    param.num = num;
+    roi_windows_release(&analytics->windows);
+    memset(analytics->has_window_rule, 0, sizeof(analytics->has_window_rule));
+    memset(analytics->window_alarm, TEMP_NORMAL, sizeof(analytics->window_alarm));
+    int ret = roi_windows_init(&analytics->windows, &param);
+    if (ret != ROI_WINDOW_SUCCESS)
+    {
+        return (ret == ROI_WINDOW_ERROR_MEM) ? ROI_ERROR_MEM : ROI_ERROR_PARAM;
+    }
+    return ROI_SUCCESS;
+}
+
+int temp_analytics_window_rule(TempAnalytics_t* analytics, int roi, int horizon, RoiWindowStat_t stat, \
+    const TempThreshold_t* threshold)
+{
+    if (analytics == NULL || roi < 0 || roi >= analytics->roi_engine.roi_num || horizon < 0 || \
+        horizon >= analytics->windows.param.num || stat < ROI_WINDOW_MAX_TEMP || stat > ROI_WINDOW_AVR_TEMP)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    analytics->has_window_rule[roi] = (threshold != NULL);
+    analytics->window_alarm[roi] = TEMP_NORMAL;
+    if (threshold != NULL)
+    {
+        analytics->window_horizon[roi] = (uint8_t)horizon;
+        analytics->window_stat[roi] = (uint8_t)stat;
+        analytics->window_threshold[roi] = *threshold;
+    }
+    return ROI_SUCCESS;
+}
+
+//raw temp value (kelvin * 64) -> the integer kelvin the libirtemp alarms compare
+static inline uint16_t temp_kelvin_of(uint16_t temp_val)
+{
+    return (uint16_t)((temp_val + 32) >> 6);
+}
+
+static void temp_analytics_print(TempAnalytics_t* analytics, int i, const char* prefix)
+{
+    const TempInfo_t* info = &analytics->temp_info[i];
+    if (analytics->is_point[i])
+    {
+        Area_t* rect = &analytics->roi_engine.roi[i].rect;
+        LOG(LOG_LEVEL_INFO, "%spoint(%d,%d)temp:%f\n", prefix, rect->start_x, rect->start_y, temp_value_converter(info->max_temp));
+        return;
+    }
+    LOG(LOG_LEVEL_INFO, "%sroi %d temp: max=%f, min=%f, avr=%f\n", prefix, i, \
+        temp_value_converter(info->max_temp), \
+        temp_value_converter(info->min_temp), \
+        temp_value_converter(info->avr_temp));
+}
+
+//the roi's window rule on this frame, TEMP_NORMAL without one or while an avr window fills
+static uint8_t temp_analytics_window_check(TempAnalytics_t* analytics, int i, RoiWindowValue_t* value)
+{
+    if (!analytics->has_window_rule[i] || \
+        roi_windows_get(&analytics->windows, i, analytics->window_horizon[i], value) != ROI_WINDOW_SUCCESS || \
+        value->samples == 0 || (analytics->window_stat[i] == ROI_WINDOW_AVR_TEMP && !value->full))
+    {
+        return TEMP_NORMAL;
+    }
+    int kelvin = temp_kelvin_of(roi_window_stat(value, (RoiWindowStat_t)analytics->window_stat[i]));
+    const TempThreshold_t* threshold = &analytics->window_threshold[i];
+    if (kelvin > threshold->upper_limit)
+    {
+        return OVER_HEAT;
+    }
+    return (kelvin < threshold->lower_limit) ? OVER_COLD : TEMP_NORMAL;
+}
+
+int temp_analytics_process(TempAnalytics_t* analytics, uint16_t* temp_data)
+{
+    return temp_analytics_process_at(analytics, temp_data, get_monotonic_us());
+}
+
+int temp_analytics_process_at(TempAnalytics_t* analytics, uint16_t* temp_data, uint64_t timestamp_us)
+{
+    if (analytics == NULL || temp_data == NULL)
+    {
+        return ROI_ERROR_PARAM;
+    }
+    RoiEngine_t* engine = &analytics->roi_engine;
+    if (engine->roi_num == 0)
+    {
+        return 0;
+    }
+    int ret = roi_engine_process(engine, temp_data, analytics->temp_info);
+    if (ret != ROI_SUCCESS)
+    {
+        return ret;
+    }
+    if (analytics->windows.param.num > 0)
+    {
+        roi_windows_update(&analytics->windows, analytics->temp_info, engine->roi_num, timestamp_us);
+    }
+
+    static const char* alarm_name[] = { "alarm cleared: ", "over heat: ", "over cold: " };
+    int report = (analytics->report_interval > 0 && analytics->frames % analytics->report_interval == 0);
+    int alarm_num = 0;
+    for (int i = 0; i < engine->roi_num; i++)
+    {
+        uint8_t alarm = TEMP_NORMAL;
+        if (analytics->has_threshold[i])
+        {
+            TempInfo_t kelvin = analytics->temp_info[i];
+            kelvin.max_temp = temp_kelvin_of(kelvin.max_temp);
+            kelvin.min_temp = temp_kelvin_of(kelvin.min_temp);
+            kelvin.avr_temp = temp_kelvin_of(kelvin.avr_temp);
+            alarm = (uint8_t)(analytics->is_point[i] ? \
+                point_over_threshold_alarm(analytics->threshold[i], kelvin.max_temp) : \
+                line_rect_over_threshold_alarm(analytics->threshold[i], &kelvin));
+            if (alarm > OVER_COLD)
+            {
+                alarm = TEMP_NORMAL;
+            }
+        }
+        //an alarm goes out on the frame it changes, not at the report interval
+        if (alarm != analytics->alarm[i])
+        {
+            analytics->alarms += (alarm != TEMP_NORMAL);
+            analytics->alarm[i] = alarm;
+            temp_analytics_print(analytics, i, alarm_name[alarm]);
+        }
+        else if (report)
+        {
+            temp_analytics_print(analytics, i, "");
+        }
+        RoiWindowValue_t value;
+        uint8_t window_alarm = temp_analytics_window_check(analytics, i, &value);
+        if (window_alarm != analytics->window_alarm[i])
+        {
+            analytics->alarms += (window_alarm != TEMP_NORMAL);
+            analytics->window_alarm[i] = window_alarm;
+            RoiWindowStat_t stat = (RoiWindowStat_t)analytics->window_stat[i];
+            LOG(LOG_LEVEL_INFO, "%sroi %d %s over %u s: %f\n", alarm_name[window_alarm], i, roi_window_stat_name(stat), \
+                analytics->windows.param.horizon_ms[analytics->window_horizon[i]] / 1000, \
+                temp_value_converter(roi_window_stat(&value, stat)));
+        }
+        alarm_num += (alarm != TEMP_NORMAL || window_alarm != TEMP_NORMAL);
+    }
+    analytics->frames++;
+    return alarm_num;
+}
+
+
+//the analytics of the temperature thread/task, the rois are set up on the first frame
+static TempAnalytics_t temp_analytics;
+static int temp_analytics_ready = 0;
+static RuleEngine_t* temp_rules = NULL;
+static AlarmEngine_t* temp_rules_blobs = NULL;
+
+void temperature_rules_set(RuleEngine_t* rules, AlarmEngine_t* blobs)
+{
+    temp_rules = rules;
+    temp_rules_blobs = blobs;
+}
+
+static int temp_analytics_setup(TempDataRes_t temp_res)
+{
+    if (temp_analytics_init(&temp_analytics, temp_res, temp_report_interval) != ROI_SUCCESS)
+    {
+        printf("temperature analytics init failed\n");
+        return -1;
+    }
+    //kelvin: over heat above 50 degree celsius, over cold below 0
+    TempThreshold_t threshold = { 323, 273 };
+    Dot_t point = { temp_res.width / 2, temp_res.height / 2 };
+    Area_t rect = { 50,50,20,20 };
+    Line_t line = { temp_res.width / 2, temp_res.height - 1, temp_res.width / 2, 0 };
+    temp_analytics_add_point(&temp_analytics, point, &threshold);
+    int rect_id = temp_analytics_add_rect(&temp_analytics, rect, &threshold);
+    temp_analytics_add_line(&temp_analytics, line, &threshold);
+    //and the rect's 5 minute average over 40 degree celsius, its 60 s max stays readable from the windows
+    const uint32_t horizon_ms[] = { 60000, 300000 };
+    TempThreshold_t avr_threshold = { 313, 0 };
+    if (temp_analytics_windows_set(&temp_analytics, horizon_ms, 2) == ROI_SUCCESS)
+    {
+        temp_analytics_window_rule(&temp_analytics, rect_id, 1, ROI_WINDOW_AVR_TEMP, &avr_threshold);
+    }
+    return 0;
+}
+
 //temperature thead function
+//temperature detection of one frame, every frame is checked, the readings are printed every temp_report_interval frames
+static void temperature_one_frame(StreamFrameInfo_t* stream_frame_info, FrameSlot_t* slot)
+{
+    const StreamConfig_t* config = stream_frame_info->config;
+    //the frame's own temp plane, the frames of an image only stream mode have none
+    TempDataRes_t temp_res = { (uint16_t)slot->desc.temp.width, (uint16_t)slot->desc.temp.height };
+    uint64_t process_start_us = timing_record_since(TIMING_STAGE_TEMP_QUEUE, slot->desc.timestamp_us);
+    TRACE_BEGIN_VALUE("temp_frame", slot->desc.seq);
+    //mid gain switch the temperatures belong to neither gain, with the shutter closed to no scene
+    if (slot->desc.temp.data != NULL && !(slot->desc.flags & FRAME_DESC_TEMP_INVALID))
+    {
+        if (!temp_analytics_ready)
+        {
+            temp_analytics_ready = (temp_analytics_setup(temp_res) == 0) ? 1 : -1;
+        }
+        if (temp_analytics_ready > 0)
+        {
+            //the readings keep their time when the sensor rate is switched
+            uint32_t fps = stream_frame_info->fps;
+            uint32_t full_fps = config->camera_param.fps;
+            temp_analytics.report_interval = temp_report_interval;
+            if (temp_report_interval > 0 && fps > 0 && full_fps > 0 && fps != full_fps)
+            {
+                temp_analytics.report_interval = (temp_report_interval * fps + full_fps / 2) / full_fps;
+                temp_analytics.report_interval = (temp_analytics.report_interval > 0) ? temp_analytics.report_interval : 1;
+            }
+            stab_roi_follow(&temp_analytics.roi_engine, &slot->desc);
+            temp_analytics_process_at(&temp_analytics, (uint16_t*)slot->temp_frame, slot->desc.timestamp_us);
+            if (temp_rules != NULL)
+            {
+                //the alarm engine runs on its own consumer, its blobs are the last frame it finished
+                AlarmBlobSummary_t blobs;
+                uint8_t has_blobs = (temp_rules_blobs != NULL && \
+                    alarm_engine_blob_summary(temp_rules_blobs, &blobs) == ALARM_SUCCESS);
+                RuleInput_t input = { slot->desc.seq, slot->desc.timestamp_us, temp_analytics.temp_info, \
+                    temp_analytics.roi_engine.roi_num, &temp_analytics.windows, (has_blobs) ? &blobs : NULL, \
+                    slot->desc.temp_stats };
+                rule_engine_eval(temp_rules, &input);
+            }
+        }
+    }
+    TRACE_END("temp_frame");
+    timing_record_since(TIMING_STAGE_TEMP_PROCESS, process_start_us);
+}
+
+static void temperature_task(FrameSlot_t* slot, void* arg)
+{
+    //the consumer sees every frame in order, a short spike is not missed
+    temperature_one_frame((StreamFrameInfo_t*)arg, slot);
+}
+
+int temperature_task_attach(StreamFrameInfo_t* stream_frame_info)
+{
+    if (stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return -1;
+    }
+    return ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, POOL_STAGE_TEMPERATURE, \
+        temperature_task, stream_frame_info);
+}
+
 void* temperature_function(void* threadarg)
 {
     StreamFrameInfo_t* stream_frame_info;
@@ -230,34 +1725,41 @@ void* temperature_function(void* threadarg)
         return NULL;
     }
 
-    TempDataRes_t temp_res = { stream_frame_info->temp_info.width, stream_frame_info->temp_info.height };
-    int timer = 0;
-    int i = 0;
-    while (is_streaming || (i <= stream_time * fps))
+    FrameRing_t* ring = stream_frame_info->frame_ring;
+    //temperature takes the frames in order, overwritten ones are counted as drops
+    int consumer_id = ring_consumer_attach(ring, RING_POLICY_NEXT);
+    if (consumer_id < 0)
     {
-#if defined(_WIN32)
-        WaitForSingleObject(temp_sem, INFINITE);	//waitting for temp singnal 
-#elif defined(linux) || defined(unix)
-        sem_wait(&temp_sem);
-#endif
-        if (timer % 25 == 0)	//colect one frame at an interval of 25 frames 
+        printf("temperature thread attach frame ring failed\n");
+        return NULL;
+    }
+    TRACE_THREAD_NAME("temperature");
+    char rt_name[RT_NAME_LEN];
+    snprintf(rt_name, sizeof(rt_name), "temp%d", stream_frame_info->camera_index);
+    rt_thread_enter(RT_ROLE_ANALYTICS, stream_frame_info->camera_index, rt_name);
+
+    while (1)
+    {
+        FrameSlot_t* slot = NULL;
+        TRACE_BEGIN("ring_wait");
+        int rst = ring_read_acquire(ring, consumer_id, \
+            ring_frame_timeout_ms(ring, stream_frame_info->camera_param.timeout_ms_delay), &slot);
+        TRACE_END("ring_wait");
+        if (rst == RING_CLOSED)
         {
-            if (stream_frame_info->temp_byte_size > 0)
-            {
-                point_temp_demo((uint16_t*)stream_frame_info->temp_frame, temp_res);
-                //line_temp_demo((uint16_t*)stream_frame_info->temp_frame, temp_res);
-                //rect_temp_demo((uint16_t*)stream_frame_info->temp_frame, temp_res);
-            }
-            timer = 0;
+            break;
+        }
+        if (rst != RING_SUCCESS)
+        {
+            continue;
         }
-        timer++;
-        i++;
-#if defined(_WIN32)
-        ReleaseSemaphore(temp_done_sem, 1, NULL);	//release temp singnal  
-#elif defined(linux) || defined(unix)
-        sem_post(&temp_done_sem);
-#endif
+        temperature_one_frame(stream_frame_info, slot);
+        ring_read_release(ring, slot);
     }
-    printf("temperature thread exit!!\n");
+    uint64_t frames = 0, dropped = 0;
+    ring_consumer_stats(ring, consumer_id, &frames, &dropped);
+    ring_consumer_detach(ring, consumer_id);
+    printf("temperature thread exit!! frames:%llu dropped:%llu\n", (unsigned long long)frames, (unsigned long long)dropped);
+    rt_thread_leave();
     return NULL;
 }
\ No newline at end of file
@@ -5,25 +5,214 @@
 #include "data.h"
 #include "libirtemp.h"
 #include "libirprocess.h"
+#include "roi.h"
+#include "roiwin.h"
+#include "rule.h"
+#include "tempunit.h"
 
 #define NUCT_LEN 8192
 
 #define HEAD_SIZE 128
-extern TempCalInfo_t temp_cal_info;				
-extern uint16_t correct_table[4 * 14 * 64+128];				
-// get temperature calibration information
+
+//frames between two printed readings, the thresholds are checked on every frame
+#define TEMP_REPORT_INTERVAL 25
+
+//environment corrected lookup table, indexed by temp_val >> TEMP_LUT_SHIFT (the 1/16K steps temp_calc works in)
+#define TEMP_LUT_SHIFT 2
+#define TEMP_LUT_SIZE (65536 >> TEMP_LUT_SHIFT)
+
+//uint16 entries of the tau table read_tau and calculate_new_env_cali_parameter take
+#define TEMP_CORRECT_TABLE_LEN (4 * 14 * 64 + 128)
+
+//calculate_new_env_cali_parameter keeps tau and K_E/B_E of the last inputs, keyed by the inputs in device units
+//(ems 1/16384, ta/tu 1/16 K), the distance in cm, the humidity in 1/1000, the gain and the tables' content
+#define TEMP_ENV_CACHE_NUM 8
+
+//inputs this close to the ones the corrected table was built for keep the table, the factors still change
+#define TEMP_ENV_LUT_TOL_EMS 0.002
+#define TEMP_ENV_LUT_TOL_CELSIUS 0.1
+#define TEMP_ENV_LUT_TOL_DIST 0.05
+#define TEMP_ENV_LUT_TOL_HUM 0.01
+
+//gains with tables of their own, indexed by LOW_GAIN / HIGH_GAIN
+#define TEMP_GAIN_NUM 2
+
+//nuc values the nuc-t table covers, remap_temp reads entry nuc / 2
+#define TEMP_NUC_RANGE (NUCT_LEN * 2)
+
+//nuc-t tables whose inverse (bucket center -> nuc) and forward (nuc -> temperature) lookups are kept: the
+//resident gains' and two more for tools and tables being replaced
+#define TEMP_NUC_TABLES_NUM (TEMP_GAIN_NUM + 2)
+
+//bucket the chain rejects in temp_calc_without_any_correct_lut
+#define TEMP_LUT_INVALID_CELSIUS -274.0f
+
+//raw temp_val -> environment corrected temp_val for one TempCalInfo_t, the chain of
+//temp_calc_with_new_env_calibration evaluated once per table entry at the entry's center
+typedef struct {
+    TempCalInfo_t* temp_cal_info;
+    int valid;
+    EnvParam_t env_param;           //parameters and factors the map was built for
+    EnvFactor_t org_env_factor;
+    EnvFactor_t new_env_factor;
+    int failed;                     //entries outside the calibrated range, they map to their own center
+    uint16_t temp_map[TEMP_LUT_SIZE];
+}TempEnvMap_t;
+
+typedef struct {
+    uint64_t calls;                 //calculate_new_env_cali_parameter
+    uint64_t hits;                  //answered from the cache, no read_tau/calculate_new_KE_and_BE_with_nuc_t
+    uint64_t lut_builds;            //corrected tables rebuilt
+    uint64_t lut_kept;              //changes within the TEMP_ENV_LUT_TOL_ tolerances, the table stayed
+    uint64_t published;             //snapshots the frames switched to, rebuilt tables and gain switches
+}TempEnvStats_t;
+
+//a replaced snapshot stays readable this long, a reader takes one per frame or call and does not keep it
+#define TEMP_CALIB_RETIRE_MS 1000
+
+//one camera's calibration: the working parameters TempCalInfo_t points at, the tau table, the resident gains,
+//the staged multi point results and the snapshot its frames are corrected with. every call taking one treats
+//NULL as the default context, the one the calls without a context work on
+typedef struct TempCalibCtx_t TempCalibCtx_t;
+
+//what the frames of one gain are corrected with, immutable once published: a rebuilt table or a gain switch
+//swaps the whole snapshot atomically, so the workers read it without a lock
+typedef struct {
+    uint8_t gain;
+    EnvParam_t org_env_param;
+    EnvParam_t new_env_param;
+    NucFactor_t nuc_factor;
+    EnvFactor_t org_env_factor;
+    EnvFactor_t new_env_factor;
+    uint16_t nuc_table[NUCT_LEN];
+    int failed;                     //entries outside the calibrated range, they map to their own center
+    uint64_t version;               //counts the snapshots built in the context
+    float celsius[TEMP_LUT_SIZE];
+    int16_t centi_celsius[TEMP_LUT_SIZE];
+}TempCalibSnapshot_t;
+
+//multi point results commands 30/33 stage until 31/34/35 write them to the device
+typedef struct {
+    uint16_t new_nuc_table[NUC_T_SIZE];
+    uint16_t new_kt[KT_SIZE];
+    int16_t new_bt[BT_SIZE];
+}TempCalibStage_t;
+
+TempCalibCtx_t* temp_calib_create(void);
+
+//waits for the context's rebuilds, the default context is never destroyed
+void temp_calib_destroy(TempCalibCtx_t* ctx);
+
+TempCalibCtx_t* temp_calib_default(void);
+
+//the working parameters and tables read_nuc_parameter/calibration write, not for the frame workers
+TempCalInfo_t* temp_calib_info(TempCalibCtx_t* ctx);
+
+//TEMP_CORRECT_TABLE_LEN entries of scratch for the tau table the commands read
+uint16_t* temp_calib_correct_table(TempCalibCtx_t* ctx);
+
+TempCalibStage_t* temp_calib_stage(TempCalibCtx_t* ctx);
+
+//the current snapshot, lock free, NULL while no corrected table is built. valid for TEMP_CALIB_RETIRE_MS after
+//it was replaced
+const TempCalibSnapshot_t* temp_calib_acquire(TempCalibCtx_t* ctx);
+
+// get temperature calibration information, temp_calib_info of the default context
 TempCalInfo_t* get_temp_cal_info(void);
 
 // print temperature calibration information
 void print_cali_info(TempCalInfo_t* temp_cal_info);
 
-//convert temperature value to real temperature.
+//convert temperature value to real temperature, temp_celsius_of_raw. for presentation, the analytics stay in
+//raw values or TempCenti_t
 float temp_value_converter(uint16_t temp_val);
 
-//calculate the new environmental variable correction parameters
+//temp_value_converter for a whole frame, float celsius, same values as the per pixel call
+void temp_frame_to_celsius(const uint16_t* temp_data, int pix_num, float* dst);
+
+//whole frame in centi-degree celsius, rounded, saturated to the int16 range (-273.15 .. 327.67)
+void temp_frame_to_centi_celsius(const uint16_t* temp_data, int pix_num, int16_t* dst);
+
+//whole frame through temp_calc_with_new_env_calibration, looked up from the table calculate_new_env_cali_parameter builds
+//returns -1 and writes the uncorrected values while no table has been built
+int temp_frame_to_celsius_env(const uint16_t* temp_data, int pix_num, float* dst);
+
+int temp_frame_to_centi_celsius_env(const uint16_t* temp_data, int pix_num, int16_t* dst);
+
+//the two above on the snapshot of ctx, taken once per call
+int temp_frame_to_celsius_env_ctx(TempCalibCtx_t* ctx, const uint16_t* temp_data, int pix_num, float* dst);
+int temp_frame_to_centi_celsius_env_ctx(TempCalibCtx_t* ctx, const uint16_t* temp_data, int pix_num, int16_t* dst);
+
+//rebuild the environment corrected table if the current new/org environment factors differ from the table's.
+//the rebuild runs on the task pool (inline without one), the frames keep the current table until it is done
+void temp_env_lut_update(void);
+void temp_env_lut_update_ctx(TempCalibCtx_t* ctx);
+
+//wait for a rebuild temp_env_lut_update started
+void temp_env_lut_wait(void);
+void temp_env_lut_wait_ctx(TempCalibCtx_t* ctx);
+
+void temp_env_map_init(TempEnvMap_t* env_map, TempCalInfo_t* temp_cal_info);
+
+//rebuild when the environment parameters or factors changed, returns 1 rebuilt, 0 still current, -1 param error
+int temp_env_map_update(TempEnvMap_t* env_map);
+
+//dst = corrected temp_val of every pixel, one table lookup each, rebuilds the map first when it is stale
+//src and dst may be the same buffer
+int temp_env_map_apply(TempEnvMap_t* env_map, const uint16_t* temp_data, int pix_num, uint16_t* dst);
+
+//calculate the new environmental variable correction parameters, correct_table has TEMP_CORRECT_TABLE_LEN entries.
+//inputs seen before are answered from the cache, the environment corrected table is rebuilt in the background
+//when the inputs moved beyond the TEMP_ENV_LUT_TOL_ tolerances or the gain or a table changed
 int calculate_new_env_cali_parameter(uint16_t* correct_table, double ems, double ta, double tu, double dist, double hum);
+int calculate_new_env_cali_parameter_ctx(TempCalibCtx_t* ctx, uint16_t* correct_table, double ems, double ta, \
+    double tu, double dist, double hum);
+
+int temp_env_stats(TempEnvStats_t* stats);
+int temp_env_stats_ctx(TempCalibCtx_t* ctx, TempEnvStats_t* stats);
+
+//the new parameters and factors calculate_new_env_cali_parameter derives, without touching any global: for tools
+//correcting frames of another camera or gain. returns 0, -1 read_tau failed, -2 the factors failed, -3 param error
+int temp_env_factor_calc(const uint16_t* correct_table, const uint16_t* nuc_table, uint8_t gain, double ems, double ta, \
+    double tu, double dist, double hum, EnvParam_t* env_param, EnvFactor_t* env_factor);
+
+//keep the nuc-t table (NUCT_LEN) and the tau correct table (TEMP_CORRECT_TABLE_LEN, may be NULL) of the gain
+//resident. calculate_new_env_cali_parameter then derives the factors and the corrected table of every resident
+//gain, each on its own pool task, so a gain switch does not wait for the flash or a rebuild
+int temp_gain_tables_set(int gain, const uint16_t* nuc_table, const uint16_t* correct_table);
+int temp_gain_tables_set_ctx(TempCalibCtx_t* ctx, int gain, const uint16_t* nuc_table, const uint16_t* correct_table);
+
+//the gain the frames are measured with changed, on the device or by auto_gain_switch: nuc_table, the factors and
+//the corrected table of the resident gain take over from the next frame. -1 when the gain has no tables
+int temp_gain_select(int gain);
+int temp_gain_select_ctx(TempCalibCtx_t* ctx, int gain);
+
+//the gain temp_gain_select last took
+int temp_gain_active(void);
+int temp_gain_active_ctx(TempCalibCtx_t* ctx);
+
+//get_point_temp of many points in one call, the same 3x3 filtered temp_val: the interior computed here in one
+//pass, the frame border through the library. dst[i] for points[i], points outside the frame get 0.
+//returns the points inside the frame
+int temp_points_get(uint16_t* temp_data, TempDataRes_t temp_res, const Dot_t* points, int num, uint16_t* dst);
+
+//temp_points_get of every pixel whose mask byte is not 0 (temp_res sized), dst written only there.
+//returns the pixels converted
+int temp_mask_get(uint16_t* temp_data, TempDataRes_t temp_res, const uint8_t* mask, uint16_t* dst);
+
+//temp_points_get in celsius: temp_value_converter of the value, or with env through the environment corrected
+//table of temp_frame_to_celsius_env (uncorrected while none is built)
+int temp_points_get_celsius(uint16_t* temp_data, TempDataRes_t temp_res, const Dot_t* points, int num, int env, \
+    float* dst);
+int temp_points_get_celsius_ctx(TempCalibCtx_t* ctx, uint16_t* temp_data, TempDataRes_t temp_res, const Dot_t* points, \
+    int num, int env, float* dst);
+
+//compare temp_mask_get over the whole frame against get_point_temp per pixel, returns the pixels that differ
+int temp_points_verify(uint16_t* temp_data, TempDataRes_t temp_res);
 
-//reverse temp data to nuc
+//reverse temp data to nuc: reverse_calc_NUC_with_env_correct of every pixel, org_temp in 1/16 K.
+//the results are kept per value for the nuc_factor, a frame calls the library only for values not seen before.
+//returns -1 at the first value the library fails on, nuc_data is written up to it
 int reverse_temp_frame_to_nuc(uint16_t* org_temp, NucFactor_t* nuc_factor, int pix_num, uint16_t* nuc_data);
 
 // recalculate the temperature with new environment parameters
@@ -32,16 +221,84 @@ int temp_calc_with_new_env_calibration(TempCalInfo_t* temp_cal_info, double org_
 // recalculate temperature with out any correct
 int temp_calc_without_any_correct(TempCalInfo_t* temp_cal_info, double org_temp, double* new_temp);
 
+//temp_calc_without_any_correct of every bucket center (TEMP_LUT_SIZE, celsius, TEMP_LUT_INVALID_CELSIUS where the
+//chain fails) through the nuc-t lookups, built first when the table has none. returns the buckets that failed
+int temp_calc_without_any_correct_lut(TempCalInfo_t* temp_cal_info, float* org_celsius);
+
+//build the nuc-t lookups of nuc_table's content on the task pool (inline without one): for a table just loaded or
+//replaced, so the next corrected table does not wait for them. the two calls above and temp_env_map_update use
+//them for the bucket centers, other temperatures still search the table through the library
+void temp_nuc_tables_update(const uint16_t* nuc_table);
+
 //get line temperature's info
 void line_temp_demo(uint16_t* temp_data, TempDataRes_t temp_res);
 
 //get rectangle temperature's info
 void rect_temp_demo(uint16_t* temp_data, TempDataRes_t temp_res);
 
+//get several rectangles' and lines' temperature info in one pass
+void roi_temp_demo(uint16_t* temp_data, TempDataRes_t temp_res);
+
 //get point temperature's info
 void point_temp_demo(uint16_t* temp_data, TempDataRes_t temp_res);
 
+//per frame temperature analytics: every point/line/rect and its threshold goes through one roi engine pass
+//a point is a 1x1 rect of the engine, its max/min/avr is the get_point_temp value
+typedef struct {
+    RoiEngine_t roi_engine;
+    TempThreshold_t threshold[ROI_MAX_NUM];
+    uint8_t has_threshold[ROI_MAX_NUM];
+    uint8_t is_point[ROI_MAX_NUM];
+    uint8_t alarm[ROI_MAX_NUM];     //AlarmType_t of the last frame
+    TempInfo_t temp_info[ROI_MAX_NUM];
+    uint32_t report_interval;       //frames between two printed readings, 0 prints only the alarms
+    uint64_t frames;
+    uint64_t alarms;                //alarms raised, a roi staying over its threshold counts once
+    RoiWindows_t windows;           //temp_analytics_windows_set, param.num 0 without
+    uint8_t has_window_rule[ROI_MAX_NUM];
+    uint8_t window_horizon[ROI_MAX_NUM];
+    uint8_t window_stat[ROI_MAX_NUM];   //RoiWindowStat_t
+    TempThreshold_t window_threshold[ROI_MAX_NUM];
+    uint8_t window_alarm[ROI_MAX_NUM];  //AlarmType_t of the window rule on the last frame
+}TempAnalytics_t;
+
+int temp_analytics_init(TempAnalytics_t* analytics, TempDataRes_t temp_res, uint32_t report_interval);
+
+void temp_analytics_release(TempAnalytics_t* analytics);
+
+//threshold in kelvin like the libirtemp alarms, NULL only reports. returns the roi index or an error code
+int temp_analytics_add_point(TempAnalytics_t* analytics, Dot_t point, const TempThreshold_t* threshold);
+int temp_analytics_add_line(TempAnalytics_t* analytics, Line_t line, const TempThreshold_t* threshold);
+int temp_analytics_add_rect(TempAnalytics_t* analytics, Area_t rect, const TempThreshold_t* threshold);
+
+//rolling windows over the given horizons for every roi (roiwin.h), fed by each process call. replaces the windows
+//set before and drops their rules
+int temp_analytics_windows_set(TempAnalytics_t* analytics, const uint32_t* horizon_ms, int num);
+
+//a rule on the roi's window: its max, min or avr over the horizon against a threshold in kelvin like the frame
+//thresholds, over heat above upper_limit and over cold below lower_limit. an avr rule waits for a full window,
+//the max/min ones hold from the first frame. NULL removes the roi's rule
+int temp_analytics_window_rule(TempAnalytics_t* analytics, int roi, int horizon, RoiWindowStat_t stat, \
+    const TempThreshold_t* threshold);
+
+//one frame: an alarm is printed on the frame it is raised or cleared, the readings every report_interval frames
+//returns the number of rois over their threshold or their window rule
+int temp_analytics_process(TempAnalytics_t* analytics, uint16_t* temp_data);
+
+//temp_analytics_process of the frame taken at timestamp_us (get_monotonic_us), the time the windows go by
+int temp_analytics_process_at(TempAnalytics_t* analytics, uint16_t* temp_data, uint64_t timestamp_us);
+
+//frames between two printed readings of the temperature thread/task, TEMP_REPORT_INTERVAL by default
+extern uint32_t temp_report_interval;
+
+//evaluate rules over the analytics' rois and windows of every frame, blobs from the alarm engine's last frame
+//(NULL none). call before streaming, NULL NULL after it stopped
+void temperature_rules_set(RuleEngine_t* rules, AlarmEngine_t* blobs);
+
 //temperature detection thread
 void* temperature_function(void* threadarg);
 
+//temperature detection as a task consumer of the frame ring instead of a thread, call before streaming
+int temperature_task_attach(StreamFrameInfo_t* stream_frame_info);
+
 #endif
@@ -0,0 +1,256 @@
+#include "tempquery.h"
+#include <string.h>
+#include <thread>
+#include <new>
+
+//give back the slots of the holders nobody reads any more, the current one stays. the load of readers pairs with
+//the query's count then check: either the query sees the holder is no longer current or we see its count
+static void temp_query_reclaim(TempQuery_t* query, int current)
+{
+    FrameRing_t* ring = query->stream_frame_info->frame_ring;
+    for (int i = 0; i < TEMP_QUERY_HOLDS; i++)
+    {
+        TempQueryHold_t* hold = &query->holds[i];
+        FrameSlot_t* slot = hold->slot.load(std::memory_order_relaxed);
+        if (i == current || slot == NULL || hold->readers.load() != 0)
+        {
+            continue;
+        }
+        hold->slot.store(NULL, std::memory_order_relaxed);
+        ring_read_release(ring, slot);
+    }
+}
+
+static void temp_query_task(FrameSlot_t* slot, void* arg)
+{
+    TempQuery_t* query = (TempQuery_t*)arg;
+    const FrameDesc_t* desc = &slot->desc;
+    if (desc->temp.data == NULL || desc->temp.width == 0 || (desc->flags & FRAME_DESC_TEMP_INVALID))
+    {
+        query->skipped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    int current = query->current.load(std::memory_order_relaxed);
+    temp_query_reclaim(query, current);
+    int free_hold = -1;
+    for (int i = 0; i < TEMP_QUERY_HOLDS && free_hold < 0; i++)
+    {
+        if (i != current && query->holds[i].slot.load(std::memory_order_relaxed) == NULL)
+        {
+            free_hold = i;
+        }
+    }
+    if (free_hold < 0)
+    {
+        query->busy.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    //the slot is ours beyond the task, the holder is published before it turns current
+    ring_slot_ref(slot);
+    query->holds[free_hold].slot.store(slot, std::memory_order_release);
+    query->current.store(free_hold);
+    temp_query_reclaim(query, free_hold);
+    query->frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+int temp_query_attach(TempQuery_t* query, StreamFrameInfo_t* stream_frame_info, const TempQueryParam_t* param)
+{
+    if (query == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return TEMP_QUERY_ERROR_PARAM;
+    }
+    //value-initialized: zero, the atomics included
+    new (query) TempQuery_t();
+    query->stream_frame_info = stream_frame_info;
+    if (param != NULL)
+    {
+        query->param = *param;
+    }
+    query->current.store(-1);
+    //only the newest frame is of interest, the ones in between are never asked for
+    query->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEWEST, \
+        POOL_STAGE_OTHER, temp_query_task, query);
+    if (query->consumer_id < 0)
+    {
+        return TEMP_QUERY_ERROR_PARAM;
+    }
+    return TEMP_QUERY_SUCCESS;
+}
+
+void temp_query_stop(TempQuery_t* query)
+{
+    if (query == NULL || query->stream_frame_info == NULL)
+    {
+        return;
+    }
+    query->current.store(-1);
+    FrameRing_t* ring = query->stream_frame_info->frame_ring;
+    for (int i = 0; i < TEMP_QUERY_HOLDS; i++)
+    {
+        TempQueryHold_t* hold = &query->holds[i];
+        FrameSlot_t* slot = hold->slot.load(std::memory_order_relaxed);
+        if (slot == NULL)
+        {
+            continue;
+        }
+        while (hold->readers.load() != 0)
+        {
+            std::this_thread::yield();
+        }
+        hold->slot.store(NULL, std::memory_order_relaxed);
+        ring_read_release(ring, slot);
+    }
+}
+
+//count into the current holder, NULL before the first frame. a holder that stopped being current between the
+//count and the check may be given back any time, the query backs out and takes the new one
+static FrameSlot_t* temp_query_enter(TempQuery_t* query, TempQueryHold_t** entered)
+{
+    for (;;)
+    {
+        int current = query->current.load(std::memory_order_acquire);
+        if (current < 0)
+        {
+            return NULL;
+        }
+        TempQueryHold_t* hold = &query->holds[current];
+        hold->readers.fetch_add(1);
+        if (query->current.load() == current)
+        {
+            FrameSlot_t* slot = hold->slot.load(std::memory_order_acquire);
+            if (slot != NULL)
+            {
+                *entered = hold;
+                return slot;
+            }
+        }
+        hold->readers.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+static void temp_query_leave(TempQueryHold_t* hold)
+{
+    hold->readers.fetch_sub(1, std::memory_order_release);
+}
+
+static void temp_query_result(TempQuery_t* query, const FrameDesc_t* desc, const TempInfo_t* info, \
+    TempQueryResult_t* result)
+{
+    result->seq = desc->seq;
+    result->timestamp_us = desc->timestamp_us;
+    result->info = *info;
+    const TempCalibSnapshot_t* snapshot = (query->param.env) ? temp_calib_acquire(query->param.calib) : NULL;
+    result->env = (snapshot != NULL);
+    if (snapshot != NULL)
+    {
+        result->max_celsius = snapshot->celsius[info->max_temp >> TEMP_LUT_SHIFT];
+        result->min_celsius = snapshot->celsius[info->min_temp >> TEMP_LUT_SHIFT];
+        result->avr_celsius = snapshot->celsius[info->avr_temp >> TEMP_LUT_SHIFT];
+        return;
+    }
+    result->max_celsius = temp_value_converter(info->max_temp);
+    result->min_celsius = temp_value_converter(info->min_temp);
+    result->avr_celsius = temp_value_converter(info->avr_temp);
+}
+
+static int temp_query_inside(const FrameDesc_t* desc, int x, int y)
+{
+    return x >= 0 && y >= 0 && x < (int)desc->temp.width && y < (int)desc->temp.height;
+}
+
+int temp_query_point(TempQuery_t* query, int x, int y, TempQueryResult_t* result)
+{
+    if (query == NULL || result == NULL)
+    {
+        return TEMP_QUERY_ERROR_PARAM;
+    }
+    TempQueryHold_t* hold = NULL;
+    FrameSlot_t* slot = temp_query_enter(query, &hold);
+    if (slot == NULL)
+    {
+        return TEMP_QUERY_ERROR_NO_FRAME;
+    }
+    const FrameDesc_t* desc = &slot->desc;
+    if (!temp_query_inside(desc, x, y))
+    {
+        temp_query_leave(hold);
+        return TEMP_QUERY_ERROR_RANGE;
+    }
+    TempDataRes_t temp_res = { (uint16_t)desc->temp.width, (uint16_t)desc->temp.height };
+    Dot_t point = { x, y };
+    TempInfo_t info;
+    memset(&info, 0, sizeof(info));
+    get_point_temp((uint16_t*)desc->temp.data, temp_res, point, &info.max_temp);
+    info.min_temp = info.avr_temp = info.max_temp;
+    info.max_cord = info.min_cord = point;
+    temp_query_result(query, desc, &info, result);
+    temp_query_leave(hold);
+    return TEMP_QUERY_SUCCESS;
+}
+
+int temp_query_line(TempQuery_t* query, Line_t line, TempQueryResult_t* result)
+{
+    if (query == NULL || result == NULL)
+    {
+        return TEMP_QUERY_ERROR_PARAM;
+    }
+    TempQueryHold_t* hold = NULL;
+    FrameSlot_t* slot = temp_query_enter(query, &hold);
+    if (slot == NULL)
+    {
+        return TEMP_QUERY_ERROR_NO_FRAME;
+    }
+    const FrameDesc_t* desc = &slot->desc;
+    if (!temp_query_inside(desc, line.start_x, line.start_y) || !temp_query_inside(desc, line.end_x, line.end_y))
+    {
+        temp_query_leave(hold);
+        return TEMP_QUERY_ERROR_RANGE;
+    }
+    TempDataRes_t temp_res = { (uint16_t)desc->temp.width, (uint16_t)desc->temp.height };
+    TempInfo_t info;
+    memset(&info, 0, sizeof(info));
+    get_line_temp((uint16_t*)desc->temp.data, temp_res, line, &info);
+    temp_query_result(query, desc, &info, result);
+    temp_query_leave(hold);
+    return TEMP_QUERY_SUCCESS;
+}
+
+int temp_query_rect(TempQuery_t* query, Area_t rect, TempQueryResult_t* result)
+{
+    if (query == NULL || result == NULL)
+    {
+        return TEMP_QUERY_ERROR_PARAM;
+    }
+    TempQueryHold_t* hold = NULL;
+    FrameSlot_t* slot = temp_query_enter(query, &hold);
+    if (slot == NULL)
+    {
+        return TEMP_QUERY_ERROR_NO_FRAME;
+    }
+    const FrameDesc_t* desc = &slot->desc;
+    if (rect.width <= 0 || rect.height <= 0 || !temp_query_inside(desc, rect.start_x, rect.start_y) || \
+        !temp_query_inside(desc, rect.start_x + rect.width - 1, rect.start_y + rect.height - 1))
+    {
+        temp_query_leave(hold);
+        return TEMP_QUERY_ERROR_RANGE;
+    }
+    TempDataRes_t temp_res = { (uint16_t)desc->temp.width, (uint16_t)desc->temp.height };
+    TempInfo_t info;
+    memset(&info, 0, sizeof(info));
+    get_rect_temp((uint16_t*)desc->temp.data, temp_res, rect, &info);
+    temp_query_result(query, desc, &info, result);
+    temp_query_leave(hold);
+    return TEMP_QUERY_SUCCESS;
+}
+
+int temp_query_stats(TempQuery_t* query, TempQueryStats_t* stats)
+{
+    if (query == NULL || stats == NULL)
+    {
+        return TEMP_QUERY_ERROR_PARAM;
+    }
+    stats->frames = query->frames.load(std::memory_order_relaxed);
+    stats->skipped = query->skipped.load(std::memory_order_relaxed);
+    stats->busy = query->busy.load(std::memory_order_relaxed);
+    return TEMP_QUERY_SUCCESS;
+}
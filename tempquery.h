@@ -0,0 +1,77 @@
+#ifndef _TEMPQUERY_H_
+#define _TEMPQUERY_H_
+
+//point, line and rect temperatures of the newest frame without a command round trip: a ring task consumer keeps a
+//reference to the latest frame with a valid temp plane and the queries read the ring slot in place, no usb traffic
+//and no copy. the frame is handed over through TEMP_QUERY_HOLDS holders: a query counts itself into the current
+//holder and checks the holder is still current, the consumer gives a holder's slot back to the ring only once
+//nobody counts in it. queries take no lock and never wait for the consumer; a frame arriving while the holder
+//before is still read is skipped, the queries stay on the current one
+#include <stdint.h>
+#include <atomic>
+#include "data.h"
+#include "libirtemp.h"
+#include "temperature.h"
+
+#define TEMP_QUERY_HOLDS 2              //the current frame and the one queries may still be reading
+
+#define TEMP_QUERY_SUCCESS 0
+#define TEMP_QUERY_ERROR_PARAM -1
+#define TEMP_QUERY_ERROR_NO_FRAME -2    //no valid temp frame yet, or stopped
+#define TEMP_QUERY_ERROR_RANGE -3       //the point, line or rect leaves the temp plane
+
+typedef struct {
+    uint8_t env;                        //celsius through the calibration snapshot's environment correction
+    TempCalibCtx_t* calib;              //the snapshot's context, NULL the default one
+}TempQueryParam_t;
+
+//one answer, from one frame
+typedef struct {
+    uint64_t seq;
+    uint64_t timestamp_us;
+    TempInfo_t info;                    //raw temp_val, a point has max = min = avr at the point
+    float max_celsius;
+    float min_celsius;
+    float avr_celsius;
+    uint8_t env;                        //the correction was applied, 0 without a snapshot or with param.env 0
+}TempQueryResult_t;
+
+typedef struct {
+    uint64_t frames;                    //frames the queries switched to
+    uint64_t skipped;                   //invalid or missing temp planes, the frame before stayed
+    uint64_t busy;                      //no free holder, queries were still reading the frame before
+}TempQueryStats_t;
+
+//readers of different holders write different lines
+typedef struct alignas(RING_CACHE_LINE) {
+    std::atomic<FrameSlot_t*> slot;     //a reference of ours, NULL for a free holder
+    std::atomic<int> readers;
+}TempQueryHold_t;
+
+typedef struct TempQuery_t {
+    StreamFrameInfo_t* stream_frame_info;
+    TempQueryParam_t param;
+    int consumer_id;
+    TempQueryHold_t holds[TEMP_QUERY_HOLDS];
+    alignas(RING_CACHE_LINE) std::atomic<int> current;  //holder of the newest frame, -1 before the first
+    std::atomic<uint64_t> frames;       //consumer only, read by temp_query_stats
+    std::atomic<uint64_t> skipped;
+    std::atomic<uint64_t> busy;
+}TempQuery_t;
+
+//register the service as a task consumer of the frame ring, param NULL answers uncorrected celsius
+int temp_query_attach(TempQuery_t* query, StreamFrameInfo_t* stream_frame_info, const TempQueryParam_t* param);
+
+//after the ring is closed: give the held frames back, waiting for the queries still reading them
+void temp_query_stop(TempQuery_t* query);
+
+//the 3x3 filtered point of get_point_temp, what tpd_get_point_temp_info answers from the device
+int temp_query_point(TempQuery_t* query, int x, int y, TempQueryResult_t* result);
+
+int temp_query_line(TempQuery_t* query, Line_t line, TempQueryResult_t* result);
+
+int temp_query_rect(TempQuery_t* query, Area_t rect, TempQueryResult_t* result);
+
+int temp_query_stats(TempQuery_t* query, TempQueryStats_t* stats);
+
+#endif
@@ -0,0 +1,242 @@
+#include "tempspan.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <atomic>
+#include "data.h"
+#include "memacct.h"
+
+//a replaced lut, readers may still map through it, freed TEMP_SPAN_RETIRE_MS later
+typedef struct TempSpanRetired {
+    TempSpan_t* span;
+    uint64_t retired_us;
+    struct TempSpanRetired* next;
+}TempSpanRetired_t;
+
+static pthread_mutex_t temp_span_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::atomic<TempSpan_t*> temp_span_cache[TEMP_SPAN_CACHE_NUM];
+static std::atomic<uint32_t> temp_span_gen(0);
+static std::atomic<uint8_t> temp_span_locked(0);
+static std::atomic<uint64_t> temp_span_range_bits(0);  //low | high << 32, the float bits
+static TempSpanParam_t temp_span_param;            //under the mutex
+static uint64_t temp_span_built[TEMP_SPAN_CACHE_NUM];    //build order of the cache entries, the oldest is replaced
+static uint64_t temp_span_clock = 0;
+static TempSpanRetired_t* temp_span_retired = NULL;
+
+static uint64_t temp_span_calib_version(const TempSpanParam_t* param, const TempCalibSnapshot_t** snapshot)
+{
+    *snapshot = (param->env) ? temp_calib_acquire(param->calib) : NULL;
+    return (*snapshot != NULL) ? (*snapshot)->version : 0;
+}
+
+static int temp_span_match(const TempSpan_t* span, uint32_t gen, const Palette_t* palette, uint32_t palette_version)
+{
+    if (span == NULL || span->lock_gen != gen || span->palette != palette || span->palette_version != palette_version)
+    {
+        return 0;
+    }
+    const TempCalibSnapshot_t* snapshot;
+    return temp_span_calib_version(&span->param, &snapshot) == span->calib_version;
+}
+
+//every bucket's celsius at its center onto the palette's entries, then the entries' colors
+static void temp_span_build(TempSpan_t* span, const TempSpanParam_t* param, uint32_t gen, const Palette_t* palette, \
+    uint32_t palette_version)
+{
+    span->param = *param;
+    span->lock_gen = gen;
+    span->palette = palette;
+    span->palette_version = palette_version;
+    const TempCalibSnapshot_t* snapshot;
+    span->calib_version = temp_span_calib_version(param, &snapshot);
+    float scale = (PALETTE_LUT_SIZE - 1) / (param->high_celsius - param->low_celsius);
+    for (int b = 0; b < TEMP_LUT_SIZE; b++)
+    {
+        float celsius = (snapshot != NULL) ? snapshot->celsius[b] : \
+            temp_value_converter((uint16_t)((b << TEMP_LUT_SHIFT) + (1 << (TEMP_LUT_SHIFT - 1))));
+        float pos = (celsius - param->low_celsius) * scale;
+        uint16_t entry = (pos <= 0.0f) ? 0 : ((pos >= PALETTE_LUT_SIZE - 1) ? PALETTE_LUT_SIZE - 1 : \
+            (uint16_t)(pos + 0.5f));
+        span->entry[b] = entry;
+        memcpy(span->bgr + b * 3, palette->bgr + entry * 3, 3);
+        memcpy(span->yuv + b * 3, palette->yuv + entry * 3, 3);
+    }
+}
+
+//the mutex is held. frees the retired luts past TEMP_SPAN_RETIRE_MS, then retires span
+static void temp_span_retire(TempSpan_t* span)
+{
+    uint64_t now_us = get_monotonic_us();
+    TempSpanRetired_t** link = &temp_span_retired;
+    while (*link != NULL)
+    {
+        TempSpanRetired_t* retired = *link;
+        if (now_us - retired->retired_us >= TEMP_SPAN_RETIRE_MS * 1000ull)
+        {
+            *link = retired->next;
+            mem_acct_release(MEM_CLASS_LUT, sizeof(TempSpan_t));
+            free(retired->span);
+            free(retired);
+            continue;
+        }
+        link = &retired->next;
+    }
+    if (span == NULL)
+    {
+        return;
+    }
+    TempSpanRetired_t* retired = (TempSpanRetired_t*)malloc(sizeof(TempSpanRetired_t));
+    if (retired == NULL)
+    {
+        //never freed rather than freed under a reader
+        return;
+    }
+    retired->span = span;
+    retired->retired_us = now_us;
+    retired->next = temp_span_retired;
+    temp_span_retired = retired;
+}
+
+//the mutex is held. a lut of palette in place of the oldest cache entry
+static const TempSpan_t* temp_span_publish(const Palette_t* palette, uint32_t palette_version)
+{
+    TempSpan_t* span = (TempSpan_t*)malloc(sizeof(TempSpan_t));
+    if (span == NULL)
+    {
+        return NULL;
+    }
+    mem_acct_add(MEM_CLASS_LUT, sizeof(TempSpan_t));
+    temp_span_build(span, &temp_span_param, temp_span_gen.load(std::memory_order_relaxed), palette, palette_version);
+    int oldest = 0;
+    for (int i = 0; i < TEMP_SPAN_CACHE_NUM; i++)
+    {
+        if (temp_span_cache[i].load(std::memory_order_relaxed) == NULL)
+        {
+            oldest = i;
+            break;
+        }
+        oldest = (temp_span_built[i] < temp_span_built[oldest]) ? i : oldest;
+    }
+    temp_span_built[oldest] = ++temp_span_clock;
+    temp_span_retire(temp_span_cache[oldest].exchange(span, std::memory_order_acq_rel));
+    return span;
+}
+
+int temp_span_lock(const TempSpanParam_t* param)
+{
+    if (param != NULL && !(param->high_celsius > param->low_celsius))
+    {
+        return TEMP_SPAN_ERROR_PARAM;
+    }
+    //built before the lock, palette_active may build the palettes
+    const Palette_t* palette = (param != NULL) ? palette_active() : NULL;
+    if (param != NULL && palette == NULL)
+    {
+        return TEMP_SPAN_ERROR_MEM;
+    }
+    int ret = TEMP_SPAN_SUCCESS;
+    pthread_mutex_lock(&temp_span_mutex);
+    temp_span_gen.fetch_add(1, std::memory_order_acq_rel);
+    for (int i = 0; i < TEMP_SPAN_CACHE_NUM; i++)
+    {
+        temp_span_retire(temp_span_cache[i].exchange(NULL, std::memory_order_acq_rel));
+    }
+    temp_span_locked.store(0, std::memory_order_release);
+    if (param != NULL)
+    {
+        temp_span_param = *param;
+        uint32_t low_bits, high_bits;
+        memcpy(&low_bits, &param->low_celsius, sizeof(low_bits));
+        memcpy(&high_bits, &param->high_celsius, sizeof(high_bits));
+        temp_span_range_bits.store(low_bits | ((uint64_t)high_bits << 32), std::memory_order_relaxed);
+        temp_span_locked.store(1, std::memory_order_release);
+        if (temp_span_publish(palette, 0) == NULL)
+        {
+            temp_span_locked.store(0, std::memory_order_release);
+            ret = TEMP_SPAN_ERROR_MEM;
+        }
+    }
+    pthread_mutex_unlock(&temp_span_mutex);
+    return ret;
+}
+
+int temp_span_range(float* low_celsius, float* high_celsius)
+{
+    if (!temp_span_locked.load(std::memory_order_acquire) || low_celsius == NULL || high_celsius == NULL)
+    {
+        return -1;
+    }
+    uint64_t bits = temp_span_range_bits.load(std::memory_order_relaxed);
+    uint32_t low_bits = (uint32_t)bits, high_bits = (uint32_t)(bits >> 32);
+    memcpy(low_celsius, &low_bits, sizeof(float));
+    memcpy(high_celsius, &high_bits, sizeof(float));
+    return 0;
+}
+
+const TempSpan_t* temp_span_get(const Palette_t* palette, uint32_t palette_version)
+{
+    if (palette == NULL || !temp_span_locked.load(std::memory_order_acquire))
+    {
+        return NULL;
+    }
+    uint32_t gen = temp_span_gen.load(std::memory_order_acquire);
+    for (int i = 0; i < TEMP_SPAN_CACHE_NUM; i++)
+    {
+        const TempSpan_t* span = temp_span_cache[i].load(std::memory_order_acquire);
+        if (temp_span_match(span, gen, palette, palette_version))
+        {
+            return span;
+        }
+    }
+    //another reader may have built it meanwhile
+    const TempSpan_t* span = NULL;
+    pthread_mutex_lock(&temp_span_mutex);
+    gen = temp_span_gen.load(std::memory_order_relaxed);
+    for (int i = 0; i < TEMP_SPAN_CACHE_NUM && span == NULL; i++)
+    {
+        const TempSpan_t* cached = temp_span_cache[i].load(std::memory_order_relaxed);
+        span = temp_span_match(cached, gen, palette, palette_version) ? cached : NULL;
+    }
+    if (span == NULL && temp_span_locked.load(std::memory_order_relaxed))
+    {
+        span = temp_span_publish(palette, palette_version);
+    }
+    pthread_mutex_unlock(&temp_span_mutex);
+    return span;
+}
+
+void temp_span_map(const uint8_t* lut, const uint16_t* src, int pix_num, uint8_t* dst)
+{
+    for (int i = 0; i < pix_num; i++)
+    {
+        const uint8_t* color = lut + (src[i] >> TEMP_LUT_SHIFT) * 3;
+        dst[0] = color[0];
+        dst[1] = color[1];
+        dst[2] = color[2];
+        dst += 3;
+    }
+}
+
+void temp_span_release(void)
+{
+    pthread_mutex_lock(&temp_span_mutex);
+    temp_span_gen.fetch_add(1, std::memory_order_acq_rel);
+    for (int i = 0; i < TEMP_SPAN_CACHE_NUM; i++)
+    {
+        TempSpan_t* span = temp_span_cache[i].exchange(NULL, std::memory_order_acq_rel);
+        if (span != NULL)
+        {
+            mem_acct_release(MEM_CLASS_LUT, sizeof(TempSpan_t));
+            free(span);
+        }
+    }
+    while (temp_span_retired != NULL)
+    {
+        TempSpanRetired_t* next = temp_span_retired->next;
+        mem_acct_release(MEM_CLASS_LUT, sizeof(TempSpan_t));
+        free(temp_span_retired->span);
+        free(temp_span_retired);
+        temp_span_retired = next;
+    }
+    pthread_mutex_unlock(&temp_span_mutex);
+}
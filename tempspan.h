@@ -0,0 +1,57 @@
+#ifndef _TEMPSPAN_H_
+#define _TEMPSPAN_H_
+
+//locked span: the palette spread over a fixed celsius range instead of each frame's min/max, so one temperature
+//has one color in every frame and every camera. the span is one lut per palette indexed by the temp plane's
+//raw value >> TEMP_LUT_SHIFT, each bucket's celsius taken from the Y14 -> temperature map (or the calibration
+//snapshot's corrected table), so the frames map straight from the temp plane with no min/max scan and no
+//stretch. the luts are immutable once published and shared by every reader: the display, the mosaic and the
+//snapshot colors of the web dashboard
+#include <stdint.h>
+#include "palette.h"
+#include "temperature.h"
+
+#define TEMP_SPAN_CACHE_NUM 4           //palettes with a built lut at a time (the active one, the display's copy)
+#define TEMP_SPAN_RETIRE_MS 1000        //a replaced lut stays readable this long, readers take one per frame
+
+#define TEMP_SPAN_SUCCESS 0
+#define TEMP_SPAN_ERROR_PARAM -1
+#define TEMP_SPAN_ERROR_MEM -2
+
+typedef struct {
+    float low_celsius;                  //the palette's first entry, colder clamps to it
+    float high_celsius;                 //the last entry, hotter clamps to it
+    uint8_t env;                        //buckets through the calibration snapshot's environment correction
+    TempCalibCtx_t* calib;              //the snapshot's context, NULL the default one
+}TempSpanParam_t;
+
+//one palette over the span, read only once published
+typedef struct {
+    TempSpanParam_t param;
+    uint32_t lock_gen;                  //the temp_span_lock it was built for
+    const Palette_t* palette;
+    uint32_t palette_version;           //the caller's repaint count of a palette changed in place
+    uint64_t calib_version;             //the snapshot the buckets were corrected with, 0 uncorrected
+    uint16_t entry[TEMP_LUT_SIZE];      //palette entry of each bucket
+    uint8_t bgr[TEMP_LUT_SIZE * 3];
+    uint8_t yuv[TEMP_LUT_SIZE * 3];     //Y, U, V like the palette's
+}TempSpan_t;
+
+//lock the span for every reader, param NULL unlocks. the lut of the active palette is built right away
+int temp_span_lock(const TempSpanParam_t* param);
+
+//the locked range, -1 while unlocked. lock free, for the color bar and the labels of a frame
+int temp_span_range(float* low_celsius, float* high_celsius);
+
+//the span's lut of palette, NULL while unlocked. lock free while the palette, its version and the calibration
+//snapshot stay, else the lut is built (under a lock) and replaces the oldest of TEMP_SPAN_CACHE_NUM
+const TempSpan_t* temp_span_get(const Palette_t* palette, uint32_t palette_version);
+
+//map temp plane values through a span's bgr or yuv lut, 3 bytes per pixel
+void temp_span_map(const uint8_t* lut, const uint16_t* src, int pix_num, uint8_t* dst);
+
+//free every lut after the readers stopped (the palettes are released), the lock stays and the next
+//temp_span_get builds again
+void temp_span_release(void);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef _TEMPUNIT_H_
+#define _TEMPUNIT_H_
+
+//the fixed point temperature units of the tree. the temp plane, thresholds, roi results and alarm events stay in
+//its raw unit, kelvin * 64, analytics that want a signed linear unit use centi-degree celsius in an int16, and
+//float celsius is only made for presentation (prints, overlays, python). the firmware's tpd_get_max_temp and
+//the libirtemp calibration chain work in kelvin * 16. every frame conversion is integer (simd_u16_to_s16_fixed)
+#include <stdint.h>
+
+typedef uint16_t TempRaw_t;             //kelvin * 64, the Y14 temp plane
+typedef int16_t TempCenti_t;            //centi-degree celsius, -273.15 .. 327.67
+
+#define TEMP_RAW_SHIFT 6                //raw = kelvin << TEMP_RAW_SHIFT
+#define TEMP_FW_SHIFT 4                 //firmware / calibration values, kelvin << TEMP_FW_SHIFT
+#define TEMP_CENTI_ZERO 27315           //0 celsius in centi-kelvin
+
+//raw -> centi celsius: (raw * 25 + 8) >> 4 - 27315, the simd_u16_to_s16_fixed parameters of a frame
+#define TEMP_CENTI_MUL 25
+#define TEMP_CENTI_SHIFT 4
+
+//a celsius constant in raw units, truncated the way the thresholds of the tree always were
+#define TEMP_RAW_OF_CELSIUS(c) ((int)(((c) + 273.15) * (1 << TEMP_RAW_SHIFT)))
+
+//the same for a temperature difference, no offset
+#define TEMP_RAW_OF_KELVIN_DELTA(k) ((int)((k) * (1 << TEMP_RAW_SHIFT)))
+
+static inline TempCenti_t temp_centi_of_raw(TempRaw_t raw)
+{
+    int32_t centi = (int32_t)(((uint32_t)raw * TEMP_CENTI_MUL + (1u << (TEMP_CENTI_SHIFT - 1))) >> \
+        TEMP_CENTI_SHIFT) - TEMP_CENTI_ZERO;
+    return (TempCenti_t)((centi > 32767) ? 32767 : centi);
+}
+
+//the nearest raw value, saturated to the uint16 range
+static inline TempRaw_t temp_raw_of_centi(TempCenti_t centi)
+{
+    int32_t raw = ((int32_t)centi + TEMP_CENTI_ZERO) * (1 << TEMP_CENTI_SHIFT);
+    raw = (raw + TEMP_CENTI_MUL / 2) / TEMP_CENTI_MUL;
+    return (TempRaw_t)((raw < 0) ? 0 : ((raw > 65535) ? 65535 : raw));
+}
+
+static inline TempRaw_t temp_raw_of_fw(uint16_t fw)
+{
+    uint32_t raw = (uint32_t)fw << (TEMP_RAW_SHIFT - TEMP_FW_SHIFT);
+    return (TempRaw_t)((raw > 65535) ? 65535 : raw);
+}
+
+//presentation only
+static inline float temp_celsius_of_raw(TempRaw_t raw)
+{
+    return (float)((double)raw / (1 << TEMP_RAW_SHIFT) - 273.15);
+}
+
+static inline float temp_celsius_of_centi(TempCenti_t centi)
+{
+    return (float)centi / 100;
+}
+
+#endif
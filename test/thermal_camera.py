@@ -13,140 +13,156 @@ import numpy as np
 import cv2
 import time
 import os
-from ctypes import POINTER, Structure, c_void_p, c_int, c_uint, c_uint8, c_uint16, c_uint32, c_double
+import sys
 
 
 # ============================================================
 # 第一部分：底层 C 库接口封装
 # ============================================================
 
+def _load_native():
+    """
+    加载 thermal_camera_native 扩展模块（make python 编译），放在 sdk/ 或仓库根目录
+    扩展模块直接链接 C++ 库，帧以 buffer protocol 导出，np.asarray 不拷贝
+    """
+    current_dir = os.path.dirname(os.path.abspath(__file__))
+    libs_path = os.path.join(current_dir, "libs")
+    
+    # 预加载依赖库，扩展模块的 rpath 是相对路径，从其他目录启动时找不到
+    for lib_name in ["libusb-1.0.so.0", "libirtemp.so", "libirprocess.so", "libiruvc.so", "libirparse.so"]:
+        lib_path = os.path.join(libs_path, lib_name)
+        if os.path.exists(lib_path):
+            ctypes.CDLL(lib_path, mode=ctypes.RTLD_GLOBAL)
+        else:
+            print(f"⚠ 警告: 依赖库不存在: {lib_path}")
+    
+    for path in [os.path.join(current_dir, "sdk"), os.path.dirname(current_dir)]:
+        if path not in sys.path:
+            sys.path.insert(0, path)
+    try:
+        import thermal_camera_native
+    except ImportError as e:
+        raise FileNotFoundError(f"找不到 thermal_camera_native 扩展模块，请先在仓库根目录执行 make python: {e}")
+    return thermal_camera_native
+
+
+class TemperatureFrameLease:
+    """
+    租用的温度帧，frame 直接指向 C 库 ring 中的槽位（不拷贝）
+    
+    用法:
+        with sdk.lease_temperature_frame() as lease:
+            if lease.frame is not None:
+                ...  # 只在 with 内部使用 lease.frame
+    退出 with 时归还槽位；frame 的切片等视图仍存活时，槽位在最后一个视图释放时归还
+    需要保留数据时请 copy()
+    """
+    
+    def __init__(self, sdk, timeout_ms):
+        self.sdk = sdk
+        self.timeout_ms = timeout_ms
+        self.frame = None
+        self.stats = None
+        self.seq = 0
+        self.timestamp_us = 0
+        self._native = None
+    
+    def __enter__(self):
+        self._native = self.sdk.acquire_native_frame(self.timeout_ms)
+        if self._native is not None:
+            self.frame = np.asarray(self._native)
+            self.stats = self._native.stats()
+            self.seq = self._native.seq
+            self.timestamp_us = self._native.timestamp_us
+        return self
+    
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.frame = None
+        if self._native is not None:
+            try:
+                self._native.release()
+            except BufferError:
+                pass  # 还有视图引用该帧，最后一个视图释放时自动归还
+            self._native = None
+        return False
+
+
 class ThermalCameraSDK:
     """
     红外相机 SDK 封装类
     
-    这个类封装了 C++ 编写的底层库，提供 Python 可以直接调用的接口
-    主要功能：
+    这个类封装了 C++ 编写的底层库（thermal_camera_native 扩展模块），主要功能：
     1. 打开/关闭相机
-    2. 获取温度数据帧
-    3. 温度数据转换（Y14 格式 -> 摄氏度）
+    2. 获取温度数据帧（零拷贝 numpy 视图）
+    3. 温度数据转换（Y14 格式 -> 摄氏度）和区域统计，由 C++ 完成，转换时释放 GIL
     """
     
     def __init__(self):
-        """初始化 SDK，加载动态库"""
-        # 获取当前脚本所在目录
-        current_dir = os.path.dirname(os.path.abspath(__file__))
-        
-        # 库文件路径
-        sdk_path = os.path.join(current_dir, "sdk/libtemperature.so")
-        libs_path = os.path.join(current_dir, "libs")
-        
-        # 检查库文件是否存在
-        if not os.path.exists(sdk_path):
-            raise FileNotFoundError(f"找不到库文件: {sdk_path}")
-        
-        # 预加载依赖库（必须在加载 libtemperature.so 之前）
-        # 使用 RTLD_GLOBAL 确保符号全局可见
-        try:
-            # 依赖库列表
-            dep_libs = [
-                "libirtemp.so",
-                "libirprocess.so",
-                "libiruvc.so",
-                "libirparse.so"
-            ]
-            
-            for lib_name in dep_libs:
-                lib_path = os.path.join(libs_path, lib_name)
-                if os.path.exists(lib_path):
-                    ctypes.CDLL(lib_path, mode=ctypes.RTLD_GLOBAL)
-                else:
-                    print(f"⚠ 警告: 依赖库不存在: {lib_path}")
-        except Exception as e:
-            print(f"⚠ 加载依赖库时出错: {e}")
-        
-        # 加载主库
-        self.lib = ctypes.CDLL(sdk_path)
-        self.camera_handle = None
-        
-        # 设置函数接口
-        self._setup_functions()
+        """初始化 SDK，加载扩展模块"""
+        self.native = _load_native()
+        self.camera = None
+        self.bus_attached = False       # camera 是另一个进程的帧总线（bus.h），不是本进程打开的相机
+        self.frame_seq = 0              # 最近一帧的序号
+        self.frame_timestamp_us = 0     # 最近一帧的取帧时间（单调时钟，us）
+        self.dropped_frames = 0         # 根据序号间隔统计的丢帧数
+        self._leases = {}               # acquire_temperature_frame 返回的 token -> 原生帧
         
         print(f"✓ SDK 初始化成功")
-        print(f"  核心库: {sdk_path}")
+        print(f"  扩展模块: {self.native.__file__}")
     
-    def _setup_functions(self):
-        """
-        设置 C 函数的参数类型和返回值类型
-        这是 Python ctypes 调用 C 函数的必要步骤
+    def open_camera(self, source=None, path=None):
         """
-        # 1. 相机句柄创建/销毁
-        self.lib.simple_camera_create.restype = c_void_p
-        self.lib.simple_camera_destroy.argtypes = [c_void_p]
-        
-        # 2. 相机打开/关闭
-        self.lib.simple_camera_open.argtypes = [c_void_p]
-        self.lib.simple_camera_open.restype = c_int
-        
-        self.lib.simple_camera_close.argtypes = [c_void_p]
-        self.lib.simple_camera_close.restype = c_int
-        
-        # 3. 流式传输控制
-        self.lib.simple_camera_start_stream.argtypes = [c_void_p]
-        self.lib.simple_camera_start_stream.restype = c_int
-        
-        self.lib.simple_camera_stop_stream.argtypes = [c_void_p]
-        self.lib.simple_camera_stop_stream.restype = c_int
-        
-        # 4. 帧数据获取
-        self.lib.simple_camera_get_frame.argtypes = [c_void_p, c_uint32]
-        self.lib.simple_camera_get_frame.restype = c_int
+        打开红外相机
         
-        self.lib.simple_camera_get_temp_data.argtypes = [c_void_p]
-        self.lib.simple_camera_get_temp_data.restype = POINTER(c_uint16)
+        参数:
+            source: None=USB 相机, "replay"=回放 path 录像, "synth"=生成的场景（无相机调试）
         
-        self.lib.simple_camera_get_temp_size.argtypes = [c_void_p, POINTER(c_uint32), POINTER(c_uint32)]
-        self.lib.simple_camera_get_temp_size.restype = c_int
+        返回:
+            bool: True=成功, False=失败
+        """
+        self.camera = self.native.Camera()
+        try:
+            if source is None:
+                self.camera.open()
+            else:
+                self.camera.open_source(source, path)
+        except RuntimeError as e:
+            print(f"✗ 打开相机失败: {e}")
+            self.camera = None
+            return False
         
-        self.lib.simple_camera_get_info.argtypes = [c_void_p, POINTER(c_uint32), POINTER(c_uint32), POINTER(c_uint32)]
-        self.lib.simple_camera_get_info.restype = c_int
+        width, height, fps = self.camera.info()
+        print(f"✓ 相机打开成功: {width}x{height} @ {fps}fps")
+        return True
     
-    def open_camera(self):
+    def attach_bus(self, name=None):
         """
-        打开红外相机
+        连接另一个进程中正在运行的管道的共享内存帧总线（sample.h 的 FRAME_BUS），不打开相机
+        帧同样是零拷贝租用，之后 acquire_* / lease_* 的用法不变，不需要 start_stream
+        
+        参数:
+            name: 共享内存对象名，None 为默认的 /ircam-bus
         
         返回:
             bool: True=成功, False=失败
         """
-        # 创建相机句柄
-        self.camera_handle = self.lib.simple_camera_create()
-        if not self.camera_handle:
-            print("✗ 创建相机句柄失败")
-            return False
-        
-        # 打开相机
-        ret = self.lib.simple_camera_open(self.camera_handle)
-        if ret < 0:
-            print(f"✗ 打开相机失败，错误码: {ret}")
+        try:
+            self.camera = self.native.Bus(name)
+        except RuntimeError as e:
+            print(f"✗ 连接帧总线失败: {e}")
+            self.camera = None
             return False
-        
-        # 获取相机信息
-        width = c_uint32()
-        height = c_uint32()
-        fps = c_uint32()
-        self.lib.simple_camera_get_info(self.camera_handle, 
-                                       ctypes.byref(width),
-                                       ctypes.byref(height),
-                                       ctypes.byref(fps))
-        
-        print(f"✓ 相机打开成功: {width.value}x{height.value} @ {fps.value}fps")
+        self.bus_attached = True
+        width, height, fps = self.camera.info()
+        print(f"✓ 帧总线连接成功: {width}x{height} @ {fps}fps")
         return True
     
     def close_camera(self):
         """关闭红外相机"""
-        if self.camera_handle:
-            self.lib.simple_camera_close(self.camera_handle)
-            self.lib.simple_camera_destroy(self.camera_handle)
-            self.camera_handle = None
+        if self.camera:
+            self._leases.clear()
+            self.camera.close()
+            self.camera = None
             print("✓ 相机已关闭")
     
     def start_stream(self):
@@ -156,57 +172,177 @@ class ThermalCameraSDK:
         返回:
             bool: True=成功, False=失败
         """
-        if not self.camera_handle:
+        if not self.camera:
             return False
-        
-        ret = self.lib.simple_camera_start_stream(self.camera_handle)
-        if ret < 0:
-            print(f"✗ 启动流传输失败，错误码: {ret}")
+        try:
+            self.camera.start_stream()
+        except RuntimeError as e:
+            print(f"✗ 启动流传输失败: {e}")
             return False
         
         print("✓ 流传输已启动")
         return True
     
     def stop_stream(self):
-        """停止数据流传输"""
-        if self.camera_handle:
-            self.lib.simple_camera_stop_stream(self.camera_handle)
+        """停止数据流传输，租用帧的视图必须先释放"""
+        if self.camera:
+            self._leases.clear()
+            if not self.bus_attached:
+                self.camera.stop_stream()
             print("✓ 流传输已停止")
     
+    def acquire_native_frame(self, timeout_ms=1000):
+        """
+        租用一帧，返回 thermal_camera_native.Frame（buffer protocol，np.asarray 不拷贝）
+        
+        返回:
+            Frame: 归还前有效，release() 或 with 语句归还
+            None: 超时或未出图
+        """
+        if not self.camera or not self.camera.streaming:
+            return None
+        frame = self.camera.acquire(timeout_ms)
+        if frame is None:
+            return None
+        if self.frame_seq and frame.seq > self.frame_seq + 1:
+            self.dropped_frames += frame.seq - self.frame_seq - 1
+        self.frame_seq = frame.seq
+        self.frame_timestamp_us = frame.timestamp_us
+        return frame
+    
     def get_temperature_frame(self):
         """
-        获取一帧温度数据
+        获取一帧温度数据（拷贝）
         
         返回:
             numpy.ndarray: 温度帧数据（Y14格式），shape=(192, 256), dtype=uint16
             None: 获取失败
         """
-        if not self.camera_handle:
+        frame = self.acquire_native_frame(1000)
+        if frame is None:
             return None
+        with frame:
+            view = np.asarray(frame)
+            temp_frame = view.copy()
+            del view
+        return temp_frame
+    
+    def get_temperature_frames(self, n, out=None, timeout_ms=None):
+        """
+        一次取 n 帧温度数据到一个 (n, height, width) 的连续数组，适合采集训练数据
         
-        # 获取一帧数据
-        ret = self.lib.simple_camera_get_frame(self.camera_handle, 1000)
-        if ret < 0:
-            return None
+        参数:
+            out: 可复用的 uint16 数组，None 时新建
+            timeout_ms: 整批的超时，默认按帧率留出两倍时间
+        
+        返回:
+            (numpy.ndarray, list): 帧数据和每帧的 (seq, timestamp_us)，超时时只有前 len(list) 帧有效
+        """
+        if not self.camera or not self.camera.streaming:
+            return None, []
+        if timeout_ms is None:
+            fps = self.camera.info()[2] or 25
+            timeout_ms = int(n * 2000 / fps) + 1000
+        if self.bus_attached:
+            buf, metas = self._get_bus_frames(n, out, timeout_ms)
+        else:
+            buf, metas = self.camera.get_frames(n, out, timeout_ms)
+        for seq, timestamp_us in metas:
+            if self.frame_seq and seq > self.frame_seq + 1:
+                self.dropped_frames += seq - self.frame_seq - 1
+            self.frame_seq = seq
+            self.frame_timestamp_us = timestamp_us
+        return (out if out is not None else np.asarray(buf)), metas
+    
+    def _get_bus_frames(self, n, out, timeout_ms):
+        """帧总线没有批量接口，逐帧租用后拷入 out"""
+        width, height, _ = self.camera.info()
+        buf = out if out is not None else np.empty((n, height, width), dtype=np.uint16)
+        metas = []
+        deadline = time.monotonic() + timeout_ms / 1000.0
+        while len(metas) < n:
+            remaining_ms = int((deadline - time.monotonic()) * 1000)
+            frame = self.camera.acquire(remaining_ms) if remaining_ms > 0 else None
+            if frame is None:
+                break
+            with frame:
+                view = np.asarray(frame)
+                buf[len(metas)] = view
+                del view
+            metas.append((frame.seq, frame.timestamp_us))
+        return buf, metas
+    
+    def acquire_temperature_frame(self, timeout_ms=1000, info=None):
+        """
+        租用一帧温度数据，返回的数组直接引用 C 库的缓冲区
         
-        # 获取温度帧尺寸
-        width = c_uint32()
-        height = c_uint32()
-        self.lib.simple_camera_get_temp_size(self.camera_handle,
-                                            ctypes.byref(width),
-                                            ctypes.byref(height))
+        返回:
+            (numpy.ndarray, token): shape=(height, width), dtype=uint16，归还前有效
+            (None, 0): 获取失败
+        """
+        frame = self.acquire_native_frame(timeout_ms)
+        if frame is None:
+            return None, 0
+        if info is not None:
+            info.seq = frame.seq
+            info.timestamp_us = frame.timestamp_us
+        token = frame.seq
+        self._leases[token] = frame
+        return np.asarray(frame), token
+    
+    def release_temperature_frame(self, token):
+        """归还 acquire_temperature_frame 租用的帧，数组仍被引用时在其释放后归还"""
+        frame = self._leases.pop(token, None)
+        if frame is not None:
+            try:
+                frame.release()
+            except BufferError:
+                pass
+    
+    def get_temperature_stats(self, token=0):
+        """
+        获取 C 库在取帧时已算好的温度统计
         
-        # 获取温度数据指针
-        data_ptr = self.lib.simple_camera_get_temp_data(self.camera_handle)
-        if not data_ptr:
+        返回:
+            FrameStats: 最小/最大值及坐标、均值、256 bin 直方图（Y14 格式）
+            None: 没有统计信息
+        """
+        frame = self._leases.get(token)
+        if frame is None:
             return None
+        return frame.stats()
+    
+    def get_roi_stats(self, y14_frame, rects):
+        """
+        矩形区域统计，rects 为 [(x, y, w, h), ...]，超出帧的部分被裁掉
+        
+        返回:
+            list: 每个区域一个 RoiStats（Y14 最值及坐标、均值和对应摄氏度），完全在帧外时为 None
+        """
+        return self.native.roi_stats(y14_frame, rects)
+    
+    def lease_temperature_frame(self, timeout_ms=1000):
+        """租用一帧温度数据，配合 with 使用，退出时自动归还"""
+        return TemperatureFrameLease(self, timeout_ms)
+    
+    def frames(self, prefetch=4):
+        """
+        预取迭代器：C++ 线程提前租用最多 prefetch 帧，处理当前帧时下一帧已经就绪
         
-        # 转换为 numpy 数组
-        size = width.value * height.value
-        temp_array = np.ctypeslib.as_array(data_ptr, shape=(size,))
-        temp_frame = temp_array.reshape((height.value, width.value)).copy()
+        用法:
+            with sdk.frames(prefetch=4) as frames:
+                for frame in frames:        # 协程中用 async for frame in frames
+                    with frame:
+                        y14 = np.asarray(frame)
+        队列满时丢弃最旧的一帧，frames.stats() 返回 (prefetched, delivered, dropped, queued)
+        出流停止时迭代结束；stop_stream / close_camera 之前先退出 with
         
-        return temp_frame
+        返回:
+            Prefetch: 未出图或连接的是帧总线时为 None
+        """
+        if not self.camera or self.bus_attached or not self.camera.streaming:
+            return None
+        return self.camera.frames(prefetch)
     
     @staticmethod
     def y14_to_celsius(y14_value):
@@ -225,19 +361,37 @@ class ThermalCameraSDK:
         """
         return (float(y14_value) / 64.0) - 273.15
     
-    @staticmethod
-    def y14_frame_to_celsius(y14_frame):
+    def y14_frame_to_celsius(self, y14_frame, env_correct=False):
         """
         将整帧 Y14 数据转换为摄氏度
         
+        参数:
+            y14_frame: Y14 格式的温度帧（numpy数组或租用的帧，行可以有间隔）
+            env_correct: 使用 C 库的环境修正表（需先调用 calculate_new_env_cali_parameter）
+            
+        返回:
+            numpy.ndarray: 摄氏度温度帧（float32）
+        """
+        src = np.asarray(y14_frame, dtype=np.uint16)
+        dst = np.empty(src.shape, dtype=np.float32)
+        self.native.to_celsius(src, dst, env_correct)
+        return dst
+    
+    def y14_frame_to_centi_celsius(self, y14_frame, env_correct=False):
+        """
+        将整帧 Y14 数据转换为 0.01 摄氏度的 int16，超出范围时饱和
+        
         参数:
             y14_frame: Y14 格式的温度帧（numpy数组）
+            env_correct: 使用 C 库的环境修正表
             
         返回:
-            numpy.ndarray: 摄氏度温度帧
+            numpy.ndarray: 0.01 摄氏度温度帧（int16）
         """
-        return (y14_frame.astype(np.float32) / 64.0) - 273.15
-
+        src = np.asarray(y14_frame, dtype=np.uint16)
+        dst = np.empty(src.shape, dtype=np.int16)
+        self.native.to_centi_celsius(src, dst, env_correct)
+        return dst
 
 # ============================================================
 # 第二部分：热成像显示应用
@@ -254,9 +408,11 @@ class ThermalCameraApp:
     4. 支持十字准星和中心点温度显示
     """
     
-    def __init__(self):
-        """初始化应用"""
+    def __init__(self, bus_name=None, use_bus=False):
+        """初始化应用，use_bus 时连接正在运行的管道的帧总线而不打开相机"""
         self.sdk = None
+        self.use_bus = use_bus
+        self.bus_name = bus_name
         
         # 显示设置
         self.colormap = cv2.COLORMAP_JET  # 默认使用 JET 伪彩色
@@ -298,6 +454,10 @@ class ThermalCameraApp:
             # 创建 SDK 实例
             self.sdk = ThermalCameraSDK()
             
+            # 连接另一个进程的帧总线，相机由那个进程打开
+            if self.use_bus:
+                return self.sdk.attach_bus(self.bus_name)
+            
             # 打开相机
             if not self.sdk.open_camera():
                 return False
@@ -315,7 +475,7 @@ class ThermalCameraApp:
             traceback.print_exc()
             return False
     
-    def process_frame(self, y14_frame):
+    def process_frame(self, y14_frame, frame_stats=None):
         """
         处理温度帧，生成可视化图像
         
@@ -329,6 +489,7 @@ class ThermalCameraApp:
         
         参数:
             y14_frame: Y14 格式的温度帧
+            frame_stats: C 库算好的帧统计（FrameStats），None 时在这里计算
             
         返回:
             numpy.ndarray: BGR 格式的可视化图像
@@ -336,10 +497,15 @@ class ThermalCameraApp:
         # 步骤1: 转换为摄氏度
         celsius_frame = self.sdk.y14_frame_to_celsius(y14_frame)
         
-        # 步骤2: 计算温度统计
-        min_temp = np.min(celsius_frame)
-        max_temp = np.max(celsius_frame)
-        mean_temp = np.mean(celsius_frame)
+        # 步骤2: 温度统计，优先使用 C 库的统计结果
+        if frame_stats is not None:
+            min_temp = self.sdk.y14_to_celsius(frame_stats.min_val)
+            max_temp = self.sdk.y14_to_celsius(frame_stats.max_val)
+            mean_temp = frame_stats.mean / 64.0 - 273.15
+        else:
+            min_temp = np.min(celsius_frame)
+            max_temp = np.max(celsius_frame)
+            mean_temp = np.mean(celsius_frame)
         std_temp = np.std(celsius_frame)
         
         # 自动调整显示范围
@@ -461,14 +627,14 @@ class ThermalCameraApp:
         try:
             # 主循环
             while True:
-                # 获取一帧温度数据
-                temp_frame = self.sdk.get_temperature_frame()
-                if temp_frame is None:
-                    print(".", end="", flush=True)  # 显示进度点
-                    continue
-                
-                # 处理并显示
-                display_image = self.process_frame(temp_frame)
+                # 租用一帧温度数据（零拷贝），处理完立即归还
+                with self.sdk.lease_temperature_frame() as lease:
+                    if lease.frame is None:
+                        print(".", end="", flush=True)  # 显示进度点
+                        continue
+                    
+                    # 处理并显示（process_frame 只生成新数组，不保留 lease.frame）
+                    display_image = self.process_frame(lease.frame, lease.stats)
                 cv2.imshow(window_name, display_image)
                 
                 self.frame_count += 1
@@ -546,8 +712,14 @@ class ThermalCameraApp:
 # ============================================================
 
 def main():
-    """主函数"""
-    app = ThermalCameraApp()
+    """主函数，--bus [name] 连接正在运行的管道的帧总线"""
+    use_bus = "--bus" in sys.argv
+    bus_name = None
+    if use_bus:
+        index = sys.argv.index("--bus")
+        if index + 1 < len(sys.argv) and not sys.argv[index + 1].startswith("-"):
+            bus_name = sys.argv[index + 1]
+    app = ThermalCameraApp(bus_name, use_bus)
     return app.run()
 
 
@@ -53,7 +53,7 @@ class DevCfg(Structure):
 
 
 class CameraStreamInfo(Structure):
-    """相机流信息结构"""
+    """相机流信息结构（没有扩展模块时的 ctypes 路径）"""
     _fields_ = [
         ("format", c_char_p),
         ("width", c_uint),
@@ -64,7 +64,7 @@ class CameraStreamInfo(Structure):
 
 
 class CameraParam(Structure):
-    """相机参数结构"""
+    """相机参数结构（没有扩展模块时的 ctypes 路径）"""
     _fields_ = [
         ("dev_cfg", DevCfg),
         ("format", c_char_p),
@@ -95,9 +95,9 @@ def temp_value_converter(temp_val):
     return (float(temp_val) / 64.0 - 273.15)
 
 
-def temp_array_converter(temp_array):
+def temp_array_converter(temp_array, native=None):
     """
-    批量转换温度数组（使用 NumPy 向量化操作）
+    批量转换温度数组，有扩展模块时由 C++ 转换（释放 GIL）
     
     参数:
         temp_array: np.ndarray (uint16) 原始温度数据
@@ -105,7 +105,12 @@ def temp_array_converter(temp_array):
     返回:
         np.ndarray (float32): 摄氏度温度数据
     """
-    return (temp_array.astype(np.float32) / 64.0 - 273.15)
+    if native is None:
+        return (temp_array.astype(np.float32) / 64.0 - 273.15)
+    src = np.asarray(temp_array, dtype=np.uint16)
+    dst = np.empty(src.shape, dtype=np.float32)
+    native.to_celsius(src, dst)
+    return dst
 
 
 # ========================================================================
@@ -114,7 +119,11 @@ def temp_array_converter(temp_array):
 
 class ThermalCameraSDK:
     """
-    红外相机 SDK 主类
+    红外相机 SDK 主类，基于 thermal_camera_native 扩展模块（simple_camera 的 C++ 封装）
+    
+    取帧、数据分离和统计都在 C++ 中完成，get_frame 返回的温度数组直接引用 ring 中的槽位。
+    sdk_path 中没有 thermal_camera_native.pyd 时（Windows 下还没有它的构建）通过 ctypes
+    直接调用 libiruvc.dll/libirparse.dll，数据分离由 raw_data_cut 完成，get_frame 返回拷贝
     
     用法示例:
         sdk = ThermalCameraSDK()
@@ -137,9 +146,11 @@ class ThermalCameraSDK:
         初始化 SDK
         
         参数:
-            sdk_path: DLL 文件所在目录（默认 'sdk'）
+            sdk_path: DLL 和 thermal_camera_native.pyd（可选）所在目录（默认 'sdk'）
         """
         self.sdk_path = os.path.abspath(sdk_path)
+        self.native = None
+        self.camera = None
         self.libiruvc = None
         self.libirparse = None
         self.is_initialized = False
@@ -147,80 +158,98 @@ class ThermalCameraSDK:
         self.is_streaming = False
         
         # 相机参数
-        self.camera_param = None
         self.width = 0
         self.height = 0
+        self.fps = 0
         self.frame_size = 0
         
         # 分离后的尺寸
         self.temp_width = 0
         self.temp_height = 0
+        
+        # ctypes 路径的相机参数和缓冲区
+        self.camera_param = None
         self.image_byte_size = 0
         self.temp_byte_size = 0
-        
-        # 缓冲区
         self.frame_buffer = None
         self.image_buffer = None
         self.temp_buffer = None
         
+        # 上一次 get_frame 租用的帧，下一次取帧时归还
+        self._frame = None
+        
         # 统计信息
         self.frame_count = 0
+        self.dropped_frames = 0
+        self._last_seq = 0
         self.version_info = {}
     
     def _load_libraries(self):
-        """加载 DLL 库"""
+        """加载 DLL 库和扩展模块"""
         try:
             os.add_dll_directory(self.sdk_path)
+            if self.sdk_path not in sys.path:
+                sys.path.insert(0, self.sdk_path)
+            try:
+                import thermal_camera_native
+                self.native = thermal_camera_native
+            except ImportError:
+                self.native = None
             
+            # 版本和设备列表扩展模块没有提供，直接调用 libiruvc
             self.libiruvc = CDLL(os.path.join(self.sdk_path, 'libiruvc.dll'))
-            self.libirparse = CDLL(os.path.join(self.sdk_path, 'libirparse.dll'))
-            
-            # 设置函数签名 - libiruvc
             self.libiruvc.iruvc_version_number.argtypes = []
             self.libiruvc.iruvc_version_number.restype = c_char_p
-            
-            self.libiruvc.uvc_camera_init.argtypes = []
-            self.libiruvc.uvc_camera_init.restype = c_int
-            
             self.libiruvc.uvc_camera_list.argtypes = [POINTER(DevCfg)]
             self.libiruvc.uvc_camera_list.restype = c_int
             
-            self.libiruvc.uvc_camera_info_get.argtypes = [DevCfg, POINTER(CameraStreamInfo)]
-            self.libiruvc.uvc_camera_info_get.restype = c_int
-            
-            self.libiruvc.uvc_camera_open.argtypes = [DevCfg]
-            self.libiruvc.uvc_camera_open.restype = c_int
-            
-            self.libiruvc.uvc_camera_stream_start.argtypes = [CameraParam, c_void_p]
-            self.libiruvc.uvc_camera_stream_start.restype = c_int
-            
-            self.libiruvc.uvc_frame_get.argtypes = [c_void_p]
-            self.libiruvc.uvc_frame_get.restype = c_int
-            
-            self.libiruvc.uvc_camera_stream_close.argtypes = [c_int]
-            self.libiruvc.uvc_camera_stream_close.restype = c_int
-            
-            self.libiruvc.uvc_camera_close.argtypes = []
-            self.libiruvc.uvc_camera_close.restype = None
-            
-            self.libiruvc.uvc_camera_release.argtypes = []
-            self.libiruvc.uvc_camera_release.restype = None
-            
-            # 设置函数签名 - libirparse
-            self.libirparse.raw_data_cut.argtypes = [
-                POINTER(c_uint8), c_int, c_int, 
-                POINTER(c_uint8), POINTER(c_uint8)
-            ]
-            self.libirparse.raw_data_cut.restype = c_int
+            if self.native is None:
+                self._load_ctypes_libraries()
             
             return True
             
         except Exception as e:
-            raise RuntimeError(f"加载 DLL 失败: {e}")
+            raise RuntimeError(f"加载 DLL 或 thermal_camera_native 失败: {e}")
+    
+    def _load_ctypes_libraries(self):
+        """没有扩展模块时取帧和数据分离所需的 libiruvc/libirparse 函数"""
+        self.libirparse = CDLL(os.path.join(self.sdk_path, 'libirparse.dll'))
+        
+        # 设置函数签名 - libiruvc
+        self.libiruvc.uvc_camera_init.argtypes = []
+        self.libiruvc.uvc_camera_init.restype = c_int
+        
+        self.libiruvc.uvc_camera_info_get.argtypes = [DevCfg, POINTER(CameraStreamInfo)]
+        self.libiruvc.uvc_camera_info_get.restype = c_int
+        
+        self.libiruvc.uvc_camera_open.argtypes = [DevCfg]
+        self.libiruvc.uvc_camera_open.restype = c_int
+        
+        self.libiruvc.uvc_camera_stream_start.argtypes = [CameraParam, c_void_p]
+        self.libiruvc.uvc_camera_stream_start.restype = c_int
+        
+        self.libiruvc.uvc_frame_get.argtypes = [c_void_p]
+        self.libiruvc.uvc_frame_get.restype = c_int
+        
+        self.libiruvc.uvc_camera_stream_close.argtypes = [c_int]
+        self.libiruvc.uvc_camera_stream_close.restype = c_int
+        
+        self.libiruvc.uvc_camera_close.argtypes = []
+        self.libiruvc.uvc_camera_close.restype = None
+        
+        self.libiruvc.uvc_camera_release.argtypes = []
+        self.libiruvc.uvc_camera_release.restype = None
+        
+        # 设置函数签名 - libirparse
+        self.libirparse.raw_data_cut.argtypes = [
+            POINTER(c_uint8), c_int, c_int, 
+            POINTER(c_uint8), POINTER(c_uint8)
+        ]
+        self.libirparse.raw_data_cut.restype = c_int
     
     def initialize(self):
         """
-        初始化 SDK 和 UVC 库
+        初始化 SDK
         
         返回:
             bool: 成功返回 True
@@ -235,10 +264,11 @@ class ThermalCameraSDK:
         version = self.libiruvc.iruvc_version_number()
         self.version_info['libiruvc'] = version.decode('utf-8')
         
-        # 初始化 UVC
-        ret = self.libiruvc.uvc_camera_init()
-        if ret != 0:
-            raise RuntimeError(f"UVC 初始化失败 (ret={ret})")
+        # ctypes 路径：初始化 UVC，扩展模块在打开相机时自己初始化
+        if self.native is None:
+            ret = self.libiruvc.uvc_camera_init()
+            if ret != 0:
+                raise RuntimeError(f"UVC 初始化失败 (ret={ret})")
         
         self.is_initialized = True
         return True
@@ -273,15 +303,16 @@ class ThermalCameraSDK:
         
         return devices
     
-    def open_camera(self, use_384_mode=True):
+    def open_camera(self, use_384_mode=True, source=None, path=None):
         """
         打开相机
         
         参数:
-            use_384_mode: 是否使用 256x384 模式（默认 True，用于温度数据分离）
+            use_384_mode: 必须为 True，C++ 库固定使用 256x384 模式（图像+温度）
+            source: None=USB 相机, "replay"=回放 path 录像, "synth"=生成的场景（需要扩展模块）
         
         返回:
-            dict: 相机信息 {'width': 256, 'height': 384, 'resolutions': [...]}
+            dict: 相机信息 {'width': 256, 'height': 384, ...}
         """
         if not self.is_initialized:
             raise RuntimeError("SDK 未初始化，请先调用 initialize()")
@@ -289,6 +320,180 @@ class ThermalCameraSDK:
         if self.is_camera_opened:
             return self.get_camera_info()
         
+        if self.native is None:
+            if source is not None:
+                raise RuntimeError("回放和生成的场景需要 thermal_camera_native 扩展模块")
+            return self._open_camera_ctypes(use_384_mode)
+        
+        if not use_384_mode:
+            raise RuntimeError("只支持 256x384 模式，温度数据在帧的下半部分")
+        
+        self.camera = self.native.Camera()
+        if source is None:
+            self.camera.open()
+        else:
+            self.camera.open_source(source, path)
+        
+        self.width, self.height, self.fps = self.camera.info()
+        self.temp_width, self.temp_height = self.camera.temp_size()
+        self.frame_size = self.width * self.height * 2
+        self.is_camera_opened = True
+        
+        return {
+            'width': self.width,
+            'height': self.height,
+            'fps': self.fps,
+            'frame_size': self.frame_size,
+            'temp_width': self.temp_width,
+            'temp_height': self.temp_height,
+            'resolutions': [{'index': 0, 'width': self.width, 'height': self.height, 'format': 'yuyv'}],
+            'use_384_mode': use_384_mode
+        }
+    
+    def start_stream(self):
+        """
+        启动视频流
+        
+        返回:
+            bool: 成功返回 True
+        """
+        if not self.is_camera_opened:
+            raise RuntimeError("相机未打开，请先调用 open_camera()")
+        
+        if self.is_streaming:
+            return True
+        
+        if self.native is None:
+            self._start_stream_ctypes()
+        else:
+            self.camera.start_stream()
+        self.is_streaming = True
+        self.frame_count = 0
+        
+        return True
+    
+    def _drop_frame(self):
+        """归还上一帧，数组还被引用时在最后一个引用释放后归还"""
+        if self._frame is not None:
+            try:
+                self._frame.release()
+            except BufferError:
+                pass
+            self._frame = None
+    
+    def get_frame(self, max_retries=10):
+        """
+        获取一帧数据（温度数据由 C++ 分离，不拷贝）
+        
+        参数:
+            max_retries: 最大等待次数，每次最多 DEFAULT_TIMEOUT / 10 毫秒（默认 10）
+        
+        返回:
+            dict 或 None: {
+                'frame_number': 帧号,
+                'seq': ring 帧序号，不连续表示丢帧,
+                'timestamp_us': 取帧时间（单调时钟，us）,
+                'raw_frame': 温度原始数据（uint16 numpy array，只读视图），
+                'temperature_raw': 同 raw_frame，
+                'temperature_celsius': 温度数据（摄氏度，float32 numpy array），
+                'image_raw': None，扩展模块只导出温度数据,
+                'stats': {
+                    'raw_min': 原始最小值,
+                    'raw_max': 原始最大值,
+                    'raw_avg': 原始平均值,
+                    'temp_min': 温度最小值（°C）,
+                    'temp_max': 温度最大值（°C）,
+                    'temp_avg': 温度平均值（°C）,
+                }
+            }
+            raw_frame 在下一次 get_frame 或 stop_stream 前有效，需要保留时请 copy()。
+            没有扩展模块时没有 seq/timestamp_us，数组是拷贝，384 模式下 image_raw 为图像数据
+        """
+        if not self.is_streaming:
+            raise RuntimeError("视频流未启动，请先调用 start_stream()")
+        
+        if self.native is None:
+            return self._get_frame_ctypes(max_retries)
+        
+        self._drop_frame()
+        frame = None
+        for _ in range(max_retries):
+            frame = self.camera.acquire(DEFAULT_TIMEOUT // 10)
+            if frame is not None:
+                break
+        if frame is None:
+            return None
+        
+        if self.frame_count and frame.seq > self._last_seq + 1:
+            self.dropped_frames += frame.seq - self._last_seq - 1
+        self._last_seq = frame.seq
+        self.frame_count += 1
+        self._frame = frame
+        
+        # 零拷贝视图，转换和统计在 C++ 中完成
+        temp_raw = np.asarray(frame)
+        temp_celsius = temp_array_converter(temp_raw, self.native)
+        roi = self.native.roi_stats(frame, [(0, 0, frame.width, frame.height)])[0]
+        
+        return {
+            'frame_number': self.frame_count,
+            'seq': frame.seq,
+            'timestamp_us': frame.timestamp_us,
+            'raw_frame': temp_raw,
+            'temperature_raw': temp_raw,
+            'temperature_celsius': temp_celsius,
+            'image_raw': None,
+            'stats': {
+                'raw_min': int(roi.min_val),
+                'raw_max': int(roi.max_val),
+                'raw_avg': float(roi.mean),
+                'temp_min': float(roi.min_celsius),
+                'temp_max': float(roi.max_celsius),
+                'temp_avg': float(roi.mean) / 64.0 - 273.15,
+            }
+        }
+    
+    def stop_stream(self):
+        """停止视频流，get_frame 返回的数组必须先释放"""
+        if not self.is_streaming:
+            return
+        
+        if self.native is None:
+            self._stop_stream_ctypes()
+        else:
+            self._drop_frame()
+            self.camera.stop_stream()
+        self.is_streaming = False
+    
+    def close_camera(self):
+        """关闭相机"""
+        if self.is_streaming:
+            self.stop_stream()
+        
+        if not self.is_camera_opened:
+            return
+        
+        if self.native is None:
+            self.libiruvc.uvc_camera_close()
+        else:
+            self.camera.close()
+            self.camera = None
+        self.is_camera_opened = False
+    
+    def release(self):
+        """释放所有资源"""
+        if self.is_streaming:
+            self.stop_stream()
+        
+        if self.is_camera_opened:
+            self.close_camera()
+        
+        if self.is_initialized and self.native is None:
+            self.libiruvc.uvc_camera_release()
+        self.is_initialized = False
+    
+    def _open_camera_ctypes(self, use_384_mode):
+        """ctypes 路径：按 VID/PID 找到相机并选择分辨率"""
         # 列出设备
         devs_cfg = (DevCfg * 64)()
         ret = self.libiruvc.uvc_camera_list(devs_cfg)
@@ -360,6 +565,7 @@ class ThermalCameraSDK:
         self.width = self.camera_param.width
         self.height = self.camera_param.height
         self.frame_size = self.camera_param.frame_size
+        self.fps = self.camera_param.fps
         
         # 计算分离后的尺寸（仅在 384 模式下）
         if use_384_mode:
@@ -386,19 +592,8 @@ class ThermalCameraSDK:
             'use_384_mode': use_384_mode
         }
     
-    def start_stream(self):
-        """
-        启动视频流
-        
-        返回:
-            bool: 成功返回 True
-        """
-        if not self.is_camera_opened:
-            raise RuntimeError("相机未打开，请先调用 open_camera()")
-        
-        if self.is_streaming:
-            return True
-        
+    def _start_stream_ctypes(self):
+        """ctypes 路径：启动流并分配缓冲区"""
         # 启动流
         ret = self.libiruvc.uvc_camera_stream_start(self.camera_param, None)
         if ret < 0:
@@ -410,39 +605,9 @@ class ThermalCameraSDK:
         if self.height == 384:  # 组合模式
             self.image_buffer = (c_uint8 * self.image_byte_size)()
             self.temp_buffer = (c_uint8 * self.temp_byte_size)()
-        
-        self.is_streaming = True
-        self.frame_count = 0
-        
-        return True
     
-    def get_frame(self, max_retries=10):
-        """
-        获取一帧数据（包含温度数据分离）
-        
-        参数:
-            max_retries: 最大重试次数（默认 10）
-        
-        返回:
-            dict 或 None: {
-                'frame_number': 帧号,
-                'raw_frame': 原始数据（uint16 numpy array），
-                'temperature_raw': 温度原始数据（uint16 numpy array），
-                'temperature_celsius': 温度数据（摄氏度，float32 numpy array），
-                'image_raw': 图像原始数据（uint16 numpy array，仅 384 模式），
-                'stats': {
-                    'raw_min': 原始最小值,
-                    'raw_max': 原始最大值,
-                    'raw_avg': 原始平均值,
-                    'temp_min': 温度最小值（°C）,
-                    'temp_max': 温度最大值（°C）,
-                    'temp_avg': 温度平均值（°C）,
-                }
-            }
-        """
-        if not self.is_streaming:
-            raise RuntimeError("视频流未启动，请先调用 start_stream()")
-        
+    def _get_frame_ctypes(self, max_retries):
+        """ctypes 路径：uvc_frame_get 取帧，raw_data_cut 分离，返回拷贝"""
         # 获取原始帧
         retry_count = 0
         while retry_count < max_retries:
@@ -523,11 +688,8 @@ class ThermalCameraSDK:
             }
         }
     
-    def stop_stream(self):
-        """停止视频流"""
-        if not self.is_streaming:
-            return
-        
+    def _stop_stream_ctypes(self):
+        """ctypes 路径：停止流并释放缓冲区"""
         self.libiruvc.uvc_camera_stream_close(1)
         self.is_streaming = False
         
@@ -536,29 +698,6 @@ class ThermalCameraSDK:
         self.image_buffer = None
         self.temp_buffer = None
     
-    def close_camera(self):
-        """关闭相机"""
-        if self.is_streaming:
-            self.stop_stream()
-        
-        if not self.is_camera_opened:
-            return
-        
-        self.libiruvc.uvc_camera_close()
-        self.is_camera_opened = False
-    
-    def release(self):
-        """释放所有资源"""
-        if self.is_streaming:
-            self.stop_stream()
-        
-        if self.is_camera_opened:
-            self.close_camera()
-        
-        if self.is_initialized:
-            self.libiruvc.uvc_camera_release()
-            self.is_initialized = False
-    
     def get_camera_info(self):
         """获取当前相机信息"""
         if not self.is_camera_opened:
@@ -570,9 +709,10 @@ class ThermalCameraSDK:
             'temp_width': self.temp_width,
             'temp_height': self.temp_height,
             'frame_size': self.frame_size,
-            'fps': self.camera_param.fps,
+            'fps': self.fps,
             'is_streaming': self.is_streaming,
             'frame_count': self.frame_count,
+            'dropped_frames': self.dropped_frames,
         }
     
     def get_version_info(self):
@@ -601,7 +741,7 @@ def create_thermal_camera_sdk(sdk_path='sdk'):
     创建红外相机 SDK 实例（便捷函数）
     
     参数:
-        sdk_path: DLL 文件所在目录
+        sdk_path: DLL 和扩展模块所在目录
     
     返回:
         ThermalCameraSDK: SDK 实例
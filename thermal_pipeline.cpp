@@ -0,0 +1,428 @@
+#include "thermal_pipeline.h"
+#include "simple_camera.h"
+#include "temperature.h"
+#include "timing.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <atomic>
+
+static_assert(TP_MAX_LEASES == SIMPLE_CAMERA_MAX_LEASES, "a tp lease is a simple_camera lease");
+static_assert(TP_SOURCE_REPLAY == SIMPLE_CAMERA_SOURCE_REPLAY && TP_SOURCE_SYNTH == SIMPLE_CAMERA_SOURCE_SYNTH, \
+    "source types are passed through");
+static_assert(TP_ERROR_TIMEOUT == SIMPLE_CAMERA_TIMEOUT && TP_ERROR_CLOSED == SIMPLE_CAMERA_CLOSED && \
+    TP_ERROR_BUSY == SIMPLE_CAMERA_BUSY, "simple_camera codes are passed through");
+static_assert(sizeof(((TpFrameStats_t*)0)->hist) == sizeof(((SimpleCameraFrameStats_t*)0)->hist), "same histogram");
+
+struct TpPipeline_t {
+    SimpleCameraHandle_t* handle;
+    pthread_mutex_t mutex;              //the handle and the lease table
+    int source;
+    uint8_t streaming;
+    TpFrameLease_t leases[TP_MAX_LEASES];   //token 0 when free, the roi queries read the frame from here
+};
+
+//the camera layer's stream state is process wide
+static std::atomic<int> tp_camera_pipelines(0);
+static std::atomic<TpPipeline_t*> tp_streaming(NULL);
+
+static const char* tp_error_strings[] = { "success", "invalid parameter", "timeout", "not streaming", "busy", \
+    "abi version mismatch", "device did not open", "out of memory" };
+
+//copy the first struct_size bytes of a filled struct out, struct_size itself is the caller's
+static void tp_struct_out(void* dst, const void* src, uint32_t src_size)
+{
+    uint32_t size = *(const uint32_t*)dst;
+    size = (size < src_size) ? size : src_size;
+    if (size > sizeof(uint32_t))
+    {
+        memcpy((uint8_t*)dst + sizeof(uint32_t), (const uint8_t*)src + sizeof(uint32_t), size - sizeof(uint32_t));
+    }
+}
+
+static int tp_result(int ret)
+{
+    if (ret >= 0 || ret == TP_ERROR_TIMEOUT || ret == TP_ERROR_CLOSED || ret == TP_ERROR_BUSY)
+    {
+        return ret;
+    }
+    return TP_ERROR_PARAM;
+}
+
+static TpFrameLease_t* tp_lease_find(TpPipeline_t* pipeline, uint64_t token)
+{
+    for (int i = 0; token != 0 && i < TP_MAX_LEASES; i++)
+    {
+        if (pipeline->leases[i].token == token)
+        {
+            return &pipeline->leases[i];
+        }
+    }
+    return NULL;
+}
+
+uint32_t tp_abi_version(void)
+{
+    return TP_ABI_VERSION;
+}
+
+const char* tp_error_string(int error)
+{
+    int index = -error;
+    if (index < 0 || index >= (int)(sizeof(tp_error_strings) / sizeof(tp_error_strings[0])))
+    {
+        return "unknown error";
+    }
+    return tp_error_strings[index];
+}
+
+void tp_pipeline_param_default(TpPipelineParam_t* param)
+{
+    if (param == NULL)
+    {
+        return;
+    }
+    memset(param, 0, sizeof(TpPipelineParam_t));
+    param->struct_size = sizeof(TpPipelineParam_t);
+    param->abi_version = TP_ABI_VERSION;
+    param->source = TP_SOURCE_CAMERA;
+}
+
+int tp_pipeline_create(const TpPipelineParam_t* param, TpPipeline_t** pipeline)
+{
+    if (param == NULL || pipeline == NULL || param->struct_size < sizeof(TpPipelineParam_t))
+    {
+        return TP_ERROR_PARAM;
+    }
+    if ((param->abi_version >> 16) != TP_ABI_VERSION_MAJOR)
+    {
+        return TP_ERROR_VERSION;
+    }
+    if (param->source != TP_SOURCE_CAMERA && param->source != TP_SOURCE_REPLAY && param->source != TP_SOURCE_SYNTH)
+    {
+        return TP_ERROR_PARAM;
+    }
+    *pipeline = NULL;
+    if (param->source == TP_SOURCE_CAMERA && tp_camera_pipelines.fetch_add(1) != 0)
+    {
+        tp_camera_pipelines.fetch_sub(1);
+        return TP_ERROR_BUSY;
+    }
+
+    TpPipeline_t* p = (TpPipeline_t*)calloc(1, sizeof(TpPipeline_t));
+    SimpleCameraHandle_t* handle = (p != NULL) ? simple_camera_create() : NULL;
+    if (handle == NULL)
+    {
+        free(p);
+        if (param->source == TP_SOURCE_CAMERA)
+        {
+            tp_camera_pipelines.fetch_sub(1);
+        }
+        return TP_ERROR_MEM;
+    }
+    char path[TP_PATH_LEN];
+    memcpy(path, param->path, TP_PATH_LEN);
+    path[TP_PATH_LEN - 1] = '\0';
+    int ret = (param->source == TP_SOURCE_CAMERA) ? simple_camera_open(handle) : \
+        simple_camera_open_source(handle, param->source, (path[0] != '\0') ? path : NULL);
+    if (ret != 0)
+    {
+        simple_camera_destroy(handle);
+        free(p);
+        if (param->source == TP_SOURCE_CAMERA)
+        {
+            tp_camera_pipelines.fetch_sub(1);
+        }
+        return TP_ERROR_DEVICE;
+    }
+    p->handle = handle;
+    p->source = param->source;
+    pthread_mutex_init(&p->mutex, NULL);
+    *pipeline = p;
+    return TP_SUCCESS;
+}
+
+void tp_pipeline_destroy(TpPipeline_t* pipeline)
+{
+    if (pipeline == NULL)
+    {
+        return;
+    }
+    tp_pipeline_stop(pipeline);
+    simple_camera_close(pipeline->handle);
+    simple_camera_destroy(pipeline->handle);
+    if (pipeline->source == TP_SOURCE_CAMERA)
+    {
+        tp_camera_pipelines.fetch_sub(1);
+    }
+    pthread_mutex_destroy(&pipeline->mutex);
+    free(pipeline);
+}
+
+int tp_pipeline_start(TpPipeline_t* pipeline)
+{
+    if (pipeline == NULL)
+    {
+        return TP_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&pipeline->mutex);
+    int ret = TP_SUCCESS;
+    if (!pipeline->streaming)
+    {
+        TpPipeline_t* idle = NULL;
+        if (!tp_streaming.compare_exchange_strong(idle, pipeline))
+        {
+            ret = TP_ERROR_BUSY;
+        }
+        else if (simple_camera_start_stream(pipeline->handle) != 0)
+        {
+            tp_streaming.store(NULL);
+            ret = TP_ERROR_DEVICE;
+        }
+        else
+        {
+            pipeline->streaming = 1;
+        }
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    return ret;
+}
+
+int tp_pipeline_stop(TpPipeline_t* pipeline)
+{
+    if (pipeline == NULL)
+    {
+        return TP_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&pipeline->mutex);
+    if (pipeline->streaming)
+    {
+        //the stream stop releases every lease of the handle
+        simple_camera_stop_stream(pipeline->handle);
+        memset(pipeline->leases, 0, sizeof(pipeline->leases));
+        pipeline->streaming = 0;
+        tp_streaming.store(NULL);
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    return TP_SUCCESS;
+}
+
+int tp_pipeline_info(TpPipeline_t* pipeline, TpPipelineInfo_t* info)
+{
+    if (pipeline == NULL || info == NULL || info->struct_size < sizeof(uint32_t))
+    {
+        return TP_ERROR_PARAM;
+    }
+    TpPipelineInfo_t out;
+    memset(&out, 0, sizeof(out));
+    uint32_t raw_width, raw_height;
+    pthread_mutex_lock(&pipeline->mutex);
+    simple_camera_get_temp_size(pipeline->handle, &out.width, &out.height);
+    simple_camera_get_info(pipeline->handle, &raw_width, &raw_height, &out.fps);
+    pthread_mutex_unlock(&pipeline->mutex);
+    tp_struct_out(info, &out, sizeof(out));
+    return TP_SUCCESS;
+}
+
+int tp_pipeline_ready_fd(TpPipeline_t* pipeline)
+{
+    if (pipeline == NULL)
+    {
+        return TP_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&pipeline->mutex);
+    int fd = simple_camera_get_ready_fd(pipeline->handle);
+    pthread_mutex_unlock(&pipeline->mutex);
+    return tp_result(fd);
+}
+
+int tp_pipeline_stats(TpPipeline_t* pipeline, TpPipelineStats_t* stats)
+{
+    if (pipeline == NULL || stats == NULL || stats->struct_size < sizeof(uint32_t))
+    {
+        return TP_ERROR_PARAM;
+    }
+    TpPipelineStats_t out;
+    memset(&out, 0, sizeof(out));
+    pthread_mutex_lock(&pipeline->mutex);
+    int ret = simple_camera_get_frame_stats(pipeline->handle, &out.frames, &out.dropped);
+    for (int i = 0; i < TP_MAX_LEASES; i++)
+    {
+        out.leases += (pipeline->leases[i].token != 0);
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    if (ret != 0)
+    {
+        return tp_result(ret);
+    }
+    tp_struct_out(stats, &out, sizeof(out));
+    return TP_SUCCESS;
+}
+
+int tp_frame_acquire(TpPipeline_t* pipeline, uint32_t timeout_ms, TpFrameLease_t* lease)
+{
+    if (pipeline == NULL || lease == NULL)
+    {
+        return TP_ERROR_PARAM;
+    }
+    SimpleCameraFrameLease_t frame;
+    pthread_mutex_lock(&pipeline->mutex);
+    int ret = simple_camera_acquire_temp_frame(pipeline->handle, timeout_ms, &frame);
+    if (ret == 0)
+    {
+        TpFrameLease_t* held = NULL;
+        for (int i = 0; held == NULL && i < TP_MAX_LEASES; i++)
+        {
+            held = (pipeline->leases[i].token == 0) ? &pipeline->leases[i] : NULL;
+        }
+        //simple_camera may hand out more leases than the table holds
+        if (held == NULL)
+        {
+            simple_camera_release_temp_frame(pipeline->handle, frame.token);
+            pthread_mutex_unlock(&pipeline->mutex);
+            return TP_ERROR_BUSY;
+        }
+        memset(held, 0, sizeof(TpFrameLease_t));
+        held->seq = frame.seq;
+        held->timestamp_us = frame.timestamp_us;
+        held->token = frame.token;
+        held->width = frame.width;
+        held->height = frame.height;
+        held->stride = frame.stride;
+        held->data = frame.data;
+        memcpy(lease, held, sizeof(TpFrameLease_t));
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    return tp_result(ret);
+}
+
+int tp_frame_release(TpPipeline_t* pipeline, uint64_t token)
+{
+    if (pipeline == NULL || token == 0)
+    {
+        return TP_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&pipeline->mutex);
+    TpFrameLease_t* held = tp_lease_find(pipeline, token);
+    int ret = (held != NULL) ? simple_camera_release_temp_frame(pipeline->handle, token) : TP_ERROR_PARAM;
+    if (held != NULL)
+    {
+        held->token = 0;
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    return tp_result(ret);
+}
+
+int tp_frame_stats(TpPipeline_t* pipeline, uint64_t token, TpFrameStats_t* stats)
+{
+    if (pipeline == NULL || stats == NULL || token == 0)
+    {
+        return TP_ERROR_PARAM;
+    }
+    SimpleCameraFrameStats_t src;
+    pthread_mutex_lock(&pipeline->mutex);
+    int ret = (tp_lease_find(pipeline, token) != NULL) ? \
+        simple_camera_get_temp_stats(pipeline->handle, token, &src) : TP_ERROR_PARAM;
+    pthread_mutex_unlock(&pipeline->mutex);
+    if (ret != 0)
+    {
+        return tp_result(ret);
+    }
+    stats->min_val = src.min_val;
+    stats->max_val = src.max_val;
+    stats->min_x = src.min_x;
+    stats->min_y = src.min_y;
+    stats->max_x = src.max_x;
+    stats->max_y = src.max_y;
+    stats->mean = src.mean;
+    stats->hist_low = src.hist_low;
+    stats->hist_bin_width = src.hist_bin_width;
+    memcpy(stats->hist, src.hist, sizeof(stats->hist));
+    return TP_SUCCESS;
+}
+
+int tp_roi_stats_batch(TpPipeline_t* pipeline, uint64_t token, const TpRoi_t* rois, uint32_t roi_num, \
+    TpRoiStats_t* stats)
+{
+    if (pipeline == NULL || (roi_num > 0 && (rois == NULL || stats == NULL)))
+    {
+        return TP_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&pipeline->mutex);
+    TpFrameLease_t* held = tp_lease_find(pipeline, token);
+    if (held == NULL)
+    {
+        pthread_mutex_unlock(&pipeline->mutex);
+        return TP_ERROR_PARAM;
+    }
+    //the slot stays leased while the mutex is held, the frame cannot go away under the queries
+    int inside = 0;
+    for (uint32_t i = 0; i < roi_num; i++)
+    {
+        SimpleCameraRoiStats_t roi;
+        TpRoiStats_t* out = &stats[i];
+        memset(out, 0, sizeof(TpRoiStats_t));
+        if (simple_camera_roi_stats(held->data, held->width, held->height, held->stride, rois[i].x, rois[i].y, \
+            rois[i].w, rois[i].h, &roi) != 0)
+        {
+            out->status = TP_ERROR_PARAM;
+            continue;
+        }
+        out->pix_num = roi.pix_num;
+        out->min_val = roi.min_val;
+        out->max_val = roi.max_val;
+        out->min_x = roi.min_x;
+        out->min_y = roi.min_y;
+        out->max_x = roi.max_x;
+        out->max_y = roi.max_y;
+        out->mean = roi.mean;
+        out->min_c = temp_value_converter(roi.min_val);
+        out->max_c = temp_value_converter(roi.max_val);
+        out->mean_c = (float)((double)roi.mean / 64 - 273.15);
+        inside++;
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    return inside;
+}
+
+int tp_temp_to_celsius(const uint16_t* temp_data, uint32_t pix_num, float* dst, int env_correct)
+{
+    return tp_result(simple_camera_temp_to_celsius(temp_data, pix_num, dst, env_correct));
+}
+
+int tp_temp_to_centi_celsius(const uint16_t* temp_data, uint32_t pix_num, int16_t* dst, int env_correct)
+{
+    return tp_result(simple_camera_temp_to_centi_celsius(temp_data, pix_num, dst, env_correct));
+}
+
+int tp_stage_count(void)
+{
+    return TIMING_STAGE_NUM;
+}
+
+const char* tp_stage_name(int stage)
+{
+    return timing_stage_name((TimingStage_t)stage);
+}
+
+int tp_stage_stats(int stage, TpStageStats_t* stats)
+{
+    TimingStats_t timing_stats;
+    if (stats == NULL || stage < 0 || stage >= TIMING_STAGE_NUM || \
+        timing_stats_get((TimingStage_t)stage, &timing_stats) != 0)
+    {
+        return TP_ERROR_PARAM;
+    }
+    stats->count = timing_stats.count;
+    stats->mean_us = timing_stats.mean_us;
+    stats->p50_us = timing_stats.p50_us;
+    stats->p99_us = timing_stats.p99_us;
+    stats->max_us = timing_stats.max_us;
+    return TP_SUCCESS;
+}
+
+void tp_stage_stats_reset(void)
+{
+    timing_reset();
+}
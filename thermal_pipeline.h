@@ -0,0 +1,190 @@
+#ifndef _THERMAL_PIPELINE_H_
+#define _THERMAL_PIPELINE_H_
+
+//versioned c abi of the processing pipeline, libthermal_pipeline.a / libthermal_pipeline.so. everything a binding
+//needs is a handle, plain structs of fixed width fields and int return codes: no c++ types, no callbacks into the
+//binding, no library allocated memory to free. a binding mirrors the structs field by field, every struct keeps
+//its 64 bit fields 8 byte aligned with explicit padding so the natural layout is the same everywhere, pointers
+//come last
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//TP_STATIC for the static library, TP_BUILD while building the shared one
+#if defined(TP_STATIC)
+#define TP_API
+#elif defined(_WIN32)
+#if defined(TP_BUILD)
+#define TP_API __declspec(dllexport)
+#else
+#define TP_API __declspec(dllimport)
+#endif
+#else
+#define TP_API __attribute__((visibility("default")))
+#endif
+
+//the major version changes when a function or a struct field changes meaning, the minor version when something
+//is added at the end. structs that grow start with struct_size, the library reads only what the caller's version has
+#define TP_ABI_VERSION_MAJOR 1
+#define TP_ABI_VERSION_MINOR 1
+#define TP_ABI_VERSION ((TP_ABI_VERSION_MAJOR << 16) | TP_ABI_VERSION_MINOR)
+
+#define TP_SUCCESS 0
+#define TP_ERROR_PARAM -1
+#define TP_ERROR_TIMEOUT -2            //no new frame within timeout_ms
+#define TP_ERROR_CLOSED -3             //not streaming, or the stream stopped
+#define TP_ERROR_BUSY -4               //every lease is in use, or another pipeline of the process is streaming
+#define TP_ERROR_VERSION -5            //the caller was built against another major version
+#define TP_ERROR_DEVICE -6             //the camera or the replay source did not open
+#define TP_ERROR_MEM -7
+
+#define TP_SOURCE_CAMERA 0
+#define TP_SOURCE_REPLAY 1             //a record.h recording at path, looped and paced at its frame rate
+#define TP_SOURCE_SYNTH 2              //the generated scene of source.h
+
+#define TP_PATH_LEN 256
+#define TP_MAX_LEASES 8
+#define TP_HIST_BINS 256
+
+typedef struct TpPipeline_t TpPipeline_t;
+
+typedef struct {
+    uint32_t struct_size;               //sizeof(TpPipelineParam_t)
+    uint32_t abi_version;               //TP_ABI_VERSION
+    int32_t source;                     //TP_SOURCE_xxx
+    uint32_t reserved;
+    char path[TP_PATH_LEN];             //recording of TP_SOURCE_REPLAY
+}TpPipelineParam_t;
+
+typedef struct {
+    uint32_t struct_size;
+    uint32_t width;                     //of the temp plane
+    uint32_t height;
+    uint32_t fps;
+}TpPipelineInfo_t;
+
+//a ring slot held by the caller, data is the Y14 temp plane (1/64 K) with stride bytes per row. the stream does
+//not overwrite it until tp_frame_release, tp_pipeline_stop releases every lease and data goes away with it
+typedef struct {
+    uint64_t seq;                       //monotonic, a gap is a dropped frame
+    uint64_t timestamp_us;              //capture time, monotonic clock
+    uint64_t token;                     //of tp_frame_release and the per frame queries, never 0
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t reserved;
+    const uint16_t* data;               //last, the only field whose size depends on the target
+}TpFrameLease_t;
+
+typedef struct {
+    int32_t x;
+    int32_t y;
+    int32_t w;
+    int32_t h;
+}TpRoi_t;
+
+typedef struct {
+    int32_t status;                     //TP_SUCCESS, or TP_ERROR_PARAM for a rectangle outside the frame
+    uint32_t pix_num;
+    uint16_t min_val;                   //Y14
+    uint16_t max_val;
+    uint16_t min_x;                     //first minimum in row order
+    uint16_t min_y;
+    uint16_t max_x;
+    uint16_t max_y;
+    float mean;                         //Y14
+    float min_c;                        //celsius of min_val/max_val/mean
+    float max_c;
+    float mean_c;
+}TpRoiStats_t;
+
+//the stats the stream computed for the frame, Y14
+typedef struct {
+    uint16_t min_val;
+    uint16_t max_val;
+    uint16_t min_x;
+    uint16_t min_y;
+    uint16_t max_x;
+    uint16_t max_y;
+    float mean;
+    uint32_t hist_low;                  //bin i counts [hist_low + i * hist_bin_width, hist_low + (i + 1) * hist_bin_width)
+    uint32_t hist_bin_width;
+    uint32_t hist[TP_HIST_BINS];
+}TpFrameStats_t;
+
+typedef struct {
+    uint32_t struct_size;
+    uint32_t leases;                    //held right now
+    uint64_t frames;                    //acquired since tp_pipeline_start
+    uint64_t dropped;                   //overwritten by newer ones before they were acquired
+}TpPipelineStats_t;
+
+typedef struct {
+    uint64_t count;
+    uint64_t mean_us;
+    uint64_t p50_us;
+    uint64_t p99_us;
+    uint64_t max_us;
+}TpStageStats_t;
+
+//TP_ABI_VERSION of the library, a binding checks the major version before anything else
+TP_API uint32_t tp_abi_version(void);
+
+TP_API const char* tp_error_string(int error);
+
+TP_API void tp_pipeline_param_default(TpPipelineParam_t* param);
+
+//open the source. the camera layer underneath keeps process wide state: one camera pipeline per process, and one
+//pipeline of any source streaming at a time
+TP_API int tp_pipeline_create(const TpPipelineParam_t* param, TpPipeline_t** pipeline);
+
+//stop, close and free, pipeline may be NULL
+TP_API void tp_pipeline_destroy(TpPipeline_t* pipeline);
+
+TP_API int tp_pipeline_start(TpPipeline_t* pipeline);
+
+//releases every lease
+TP_API int tp_pipeline_stop(TpPipeline_t* pipeline);
+
+TP_API int tp_pipeline_info(TpPipeline_t* pipeline, TpPipelineInfo_t* info);
+
+//readable when a new frame may be there or the stream stopped (epoll/select/asyncio), then acquire with timeout 0.
+//owned by the library and gone after tp_pipeline_stop
+TP_API int tp_pipeline_ready_fd(TpPipeline_t* pipeline);
+
+TP_API int tp_pipeline_stats(TpPipeline_t* pipeline, TpPipelineStats_t* stats);
+
+//wait up to timeout_ms for a frame newer than the last one and lease it without a copy. calls on one pipeline
+//are serialized inside, a blocking acquire holds off the other calls on the same pipeline until it returns
+TP_API int tp_frame_acquire(TpPipeline_t* pipeline, uint32_t timeout_ms, TpFrameLease_t* lease);
+
+TP_API int tp_frame_release(TpPipeline_t* pipeline, uint64_t token);
+
+TP_API int tp_frame_stats(TpPipeline_t* pipeline, uint64_t token, TpFrameStats_t* stats);
+
+//roi_num rectangles of the leased frame in one call, stats[i] of rois[i] (clipped to the frame). returns how many
+//are inside the frame, or an error for the whole call
+TP_API int tp_roi_stats_batch(TpPipeline_t* pipeline, uint64_t token, const TpRoi_t* rois, uint32_t roi_num, \
+    TpRoiStats_t* stats);
+
+//whole frame to celsius, env_correct through the environment correction table (TP_ERROR_PARAM while none is
+//built, the uncorrected values are written then)
+TP_API int tp_temp_to_celsius(const uint16_t* temp_data, uint32_t pix_num, float* dst, int env_correct);
+
+//the same in centi-degree celsius, rounded and saturated to the int16 range: integer math and half the buffer
+TP_API int tp_temp_to_centi_celsius(const uint16_t* temp_data, uint32_t pix_num, int16_t* dst, int env_correct);
+
+//timing stages of the process, timing.h
+TP_API int tp_stage_count(void);
+TP_API const char* tp_stage_name(int stage);
+TP_API int tp_stage_stats(int stage, TpStageStats_t* stats);
+TP_API void tp_stage_stats_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
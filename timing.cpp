@@ -0,0 +1,369 @@
+#include "timing.h"
+#include "data.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <atomic>
+
+#define TIMING_PERF_MARKS 8         //marks of a thread kept for the nested stages, the display chain nests 2
+
+typedef struct {
+    std::atomic<uint64_t> samples;
+    std::atomic<uint64_t> value[PERF_EVENT_NUM];
+}TimingPerfSum_t;
+
+typedef struct {
+    PerfCounters_t counters;
+    int available;
+    int next;
+    uint64_t mark_us[TIMING_PERF_MARKS];
+    PerfCounts_t mark[TIMING_PERF_MARKS];
+}TimingPerfThread_t;
+
+static TimingHist_t timing_hist[TIMING_STAGE_NUM];
+static TimingPerfSum_t timing_perf[TIMING_STAGE_NUM];
+static std::atomic<int> timing_perf_enabled(0);
+static pthread_key_t timing_perf_key;
+static pthread_once_t timing_perf_once = PTHREAD_ONCE_INIT;
+static std::atomic<uint32_t> timing_dump_interval_s(0);
+static std::atomic<uint64_t> timing_last_dump_us(0);
+
+static const char* timing_stage_names[TIMING_STAGE_NUM] = {
+    "capture",
+    "cut",
+    "stats",
+    "display_queue",
+    "display_nr",
+    "display_upscale",
+    "enhance_stretch",
+    "enhance_hist_agc",
+    "enhance_lib",
+    "enhance_clahe",
+    "enhance_dde",
+    "display_process",
+    "display_transform",
+    "display_render",
+    "display_total",
+    "display_latency",
+    "temp_queue",
+    "temp_process",
+    "alarm_latency",
+    "screen_latency",
+    "infer_queue",
+    "infer_latency",
+    "cmd_wait",
+    "cmd_exec",
+    "callback",
+    "open",
+    "open_to_frame",
+    "startup",
+    "frame_interval",
+    "arrival_jitter",
+    "pacer_latency",
+    "mqtt_publish",
+};
+
+//values below 8 get their own bucket, above that each power of two is split in 8
+static int timing_bucket_index(uint64_t value)
+{
+    if (value < 8)
+    {
+        return (int)value;
+    }
+    int exp = 3;
+    while ((value >> (exp + 1)) != 0)
+    {
+        exp++;
+    }
+    int index = (exp - 2) * 8 + (int)((value >> (exp - 3)) & 7);
+    return (index < TIMING_BUCKETS) ? index : TIMING_BUCKETS - 1;
+}
+
+static uint64_t timing_bucket_upper(int index)
+{
+    if (index < 8)
+    {
+        return (uint64_t)index;
+    }
+    int exp = index / 8 + 2;
+    uint64_t lower = (uint64_t)(8 + index % 8) << (exp - 3);
+    return lower + ((uint64_t)1 << (exp - 3)) - 1;
+}
+
+void timing_hist_record(TimingHist_t* hist, uint64_t duration_us)
+{
+    hist->buckets[timing_bucket_index(duration_us)].fetch_add(1, std::memory_order_relaxed);
+    hist->sum_us.fetch_add(duration_us, std::memory_order_relaxed);
+    hist->count.fetch_add(1, std::memory_order_relaxed);
+    uint64_t cur_max = hist->max_us.load(std::memory_order_relaxed);
+    while (duration_us > cur_max && \
+        !hist->max_us.compare_exchange_weak(cur_max, duration_us, std::memory_order_relaxed))
+    {
+    }
+}
+
+void timing_record(TimingStage_t stage, uint64_t duration_us)
+{
+    if (stage < 0 || stage >= TIMING_STAGE_NUM)
+    {
+        return;
+    }
+    timing_hist_record(&timing_hist[stage], duration_us);
+}
+
+static void timing_perf_thread_free(void* arg)
+{
+    TimingPerfThread_t* thread = (TimingPerfThread_t*)arg;
+    perf_counters_close(&thread->counters);
+    free(thread);
+}
+
+static void timing_perf_key_create(void)
+{
+    pthread_key_create(&timing_perf_key, timing_perf_thread_free);
+}
+
+//the calling thread's counters, opened at its first mark. NULL where they can not be opened
+static TimingPerfThread_t* timing_perf_thread(void)
+{
+    pthread_once(&timing_perf_once, timing_perf_key_create);
+    TimingPerfThread_t* thread = (TimingPerfThread_t*)pthread_getspecific(timing_perf_key);
+    if (thread == NULL)
+    {
+        thread = (TimingPerfThread_t*)calloc(1, sizeof(TimingPerfThread_t));
+        if (thread == NULL)
+        {
+            return NULL;
+        }
+        thread->available = (perf_counters_open(&thread->counters) == PERF_SUCCESS);
+        pthread_setspecific(timing_perf_key, thread);
+    }
+    return thread->available ? thread : NULL;
+}
+
+//counts the stage since the mark of start_us, then marks now_us
+static void timing_perf_mark(TimingStage_t stage, uint64_t start_us, uint64_t now_us)
+{
+    TimingPerfThread_t* thread = timing_perf_thread();
+    PerfCounts_t now;
+    if (thread == NULL || perf_counters_read(&thread->counters, &now) != PERF_SUCCESS)
+    {
+        return;
+    }
+    if (stage >= 0 && stage < TIMING_STAGE_NUM)
+    {
+        //the oldest mark of start_us, so a nested stage started in the same us does not shorten the outer one
+        for (int i = 1; i <= TIMING_PERF_MARKS; i++)
+        {
+            int index = (thread->next + i) % TIMING_PERF_MARKS;
+            if (thread->mark_us[index] != start_us || start_us == 0)
+            {
+                continue;
+            }
+            PerfCounts_t delta;
+            perf_counts_sub(&now, &thread->mark[index], &delta);
+            TimingPerfSum_t* sum = &timing_perf[stage];
+            for (int event = 0; event < PERF_EVENT_NUM; event++)
+            {
+                sum->value[event].fetch_add(delta.value[event], std::memory_order_relaxed);
+            }
+            sum->samples.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+    thread->mark_us[thread->next] = now_us;
+    thread->mark[thread->next] = now;
+    thread->next = (thread->next + 1) % TIMING_PERF_MARKS;
+}
+
+uint64_t timing_record_since(TimingStage_t stage, uint64_t start_us)
+{
+    uint64_t now_us = get_monotonic_us();
+    timing_record(stage, (now_us > start_us) ? now_us - start_us : 0);
+    if (timing_perf_enabled.load(std::memory_order_relaxed))
+    {
+        timing_perf_mark(stage, start_us, now_us);
+    }
+    return now_us;
+}
+
+uint64_t timing_start(void)
+{
+    uint64_t now_us = get_monotonic_us();
+    if (timing_perf_enabled.load(std::memory_order_relaxed))
+    {
+        timing_perf_mark(TIMING_STAGE_NUM, 0, now_us);
+    }
+    return now_us;
+}
+
+void timing_perf_enable(int enable)
+{
+    timing_perf_enabled.store(enable != 0);
+}
+
+int timing_perf_get(TimingStage_t stage, TimingPerf_t* perf)
+{
+    if (stage < 0 || stage >= TIMING_STAGE_NUM || perf == NULL)
+    {
+        return -1;
+    }
+    perf->samples = timing_perf[stage].samples.load(std::memory_order_relaxed);
+    for (int event = 0; event < PERF_EVENT_NUM; event++)
+    {
+        perf->value[event] = timing_perf[stage].value[event].load(std::memory_order_relaxed);
+    }
+    return 0;
+}
+
+void timing_hist_stats(TimingHist_t* hist, TimingStats_t* stats)
+{
+    uint64_t buckets[TIMING_BUCKETS];
+    uint64_t count = 0;
+    //the snapshot is not atomic as a whole, counts come from the buckets themselves
+    for (int i = 0; i < TIMING_BUCKETS; i++)
+    {
+        buckets[i] = hist->buckets[i].load(std::memory_order_relaxed);
+        count += buckets[i];
+    }
+
+    stats->count = count;
+    stats->max_us = hist->max_us.load(std::memory_order_relaxed);
+    uint64_t hist_count = hist->count.load(std::memory_order_relaxed);
+    stats->sum_us = hist->sum_us.load(std::memory_order_relaxed);
+    stats->mean_us = (hist_count > 0) ? stats->sum_us / hist_count : 0;
+    stats->p50_us = 0;
+    stats->p99_us = 0;
+    if (count == 0)
+    {
+        return;
+    }
+
+    uint64_t p50_target = (count * 50 + 99) / 100;
+    uint64_t p99_target = (count * 99 + 99) / 100;
+    uint64_t sum = 0;
+    int p50_found = 0;
+    for (int i = 0; i < TIMING_BUCKETS; i++)
+    {
+        sum += buckets[i];
+        if (!p50_found && sum >= p50_target)
+        {
+            stats->p50_us = timing_bucket_upper(i);
+            p50_found = 1;
+        }
+        if (sum >= p99_target)
+        {
+            stats->p99_us = timing_bucket_upper(i);
+            break;
+        }
+    }
+    if (stats->p50_us > stats->max_us) stats->p50_us = stats->max_us;
+    if (stats->p99_us > stats->max_us) stats->p99_us = stats->max_us;
+}
+
+int timing_stats_get(TimingStage_t stage, TimingStats_t* stats)
+{
+    if (stage < 0 || stage >= TIMING_STAGE_NUM || stats == NULL)
+    {
+        return -1;
+    }
+    timing_hist_stats(&timing_hist[stage], stats);
+    return 0;
+}
+
+void timing_hist_reset(TimingHist_t* hist)
+{
+    for (int i = 0; i < TIMING_BUCKETS; i++)
+    {
+        hist->buckets[i].store(0, std::memory_order_relaxed);
+    }
+    hist->count.store(0, std::memory_order_relaxed);
+    hist->sum_us.store(0, std::memory_order_relaxed);
+    hist->max_us.store(0, std::memory_order_relaxed);
+}
+
+void timing_reset(void)
+{
+    for (int stage = 0; stage < TIMING_STAGE_NUM; stage++)
+    {
+        timing_hist_reset(&timing_hist[stage]);
+        timing_perf[stage].samples.store(0, std::memory_order_relaxed);
+        for (int event = 0; event < PERF_EVENT_NUM; event++)
+        {
+            timing_perf[stage].value[event].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+const char* timing_stage_name(TimingStage_t stage)
+{
+    if (stage < 0 || stage >= TIMING_STAGE_NUM)
+    {
+        return "unknown";
+    }
+    return timing_stage_names[stage];
+}
+
+void timing_dump(void)
+{
+    printf("%-18s %10s %10s %10s %10s %10s\n", "stage(us)", "count", "mean", "p50", "p99", "max");
+    for (int stage = 0; stage < TIMING_STAGE_NUM; stage++)
+    {
+        TimingStats_t stats;
+        timing_stats_get((TimingStage_t)stage, &stats);
+        if (stats.count == 0)
+        {
+            continue;
+        }
+        printf("%-18s %10llu %10llu %10llu %10llu %10llu\n", timing_stage_name((TimingStage_t)stage), \
+            (unsigned long long)stats.count, (unsigned long long)stats.mean_us, \
+            (unsigned long long)stats.p50_us, (unsigned long long)stats.p99_us, \
+            (unsigned long long)stats.max_us);
+    }
+    //the counters per sample of the stages that had them
+    int header = 0;
+    for (int stage = 0; stage < TIMING_STAGE_NUM; stage++)
+    {
+        TimingPerf_t perf;
+        timing_perf_get((TimingStage_t)stage, &perf);
+        if (perf.samples == 0)
+        {
+            continue;
+        }
+        if (!header)
+        {
+            printf("%-18s %10s %12s %12s %6s %10s %10s %10s\n", "stage(perf)", "samples", "cycles", "instructions", \
+                "ipc", "l1d_miss", "llc_miss", "br_miss");
+            header = 1;
+        }
+        double samples = (double)perf.samples;
+        double cycles = (double)perf.value[PERF_EVENT_CYCLES];
+        printf("%-18s %10llu %12.0f %12.0f %6.2f %10.0f %10.0f %10.0f\n", timing_stage_name((TimingStage_t)stage), \
+            (unsigned long long)perf.samples, cycles / samples, perf.value[PERF_EVENT_INSTRUCTIONS] / samples, \
+            (cycles > 0) ? perf.value[PERF_EVENT_INSTRUCTIONS] / cycles : 0.0, \
+            perf.value[PERF_EVENT_L1D_MISSES] / samples, perf.value[PERF_EVENT_LLC_MISSES] / samples, \
+            perf.value[PERF_EVENT_BRANCH_MISSES] / samples);
+    }
+}
+
+void timing_dump_interval_set(uint32_t interval_s)
+{
+    timing_dump_interval_s.store(interval_s);
+    timing_last_dump_us.store(get_monotonic_us());
+}
+
+void timing_dump_check(void)
+{
+    uint32_t interval_s = timing_dump_interval_s.load(std::memory_order_relaxed);
+    if (interval_s == 0)
+    {
+        return;
+    }
+    uint64_t now_us = get_monotonic_us();
+    uint64_t last_us = timing_last_dump_us.load(std::memory_order_relaxed);
+    if (now_us - last_us >= (uint64_t)interval_s * 1000000 && \
+        timing_last_dump_us.compare_exchange_strong(last_us, now_us))
+    {
+        timing_dump();
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef _TIMING_H_
+#define _TIMING_H_
+
+#include "perfctr.h"
+#include <stdint.h>
+#include <atomic>
+
+#define TIMING_BUCKETS 320          //8 buckets per power of two, unit:us
+
+//every stage is a duration in us, measured on get_monotonic_us
+typedef enum
+{
+    TIMING_STAGE_CAPTURE = 0,       //uvc_frame_get call
+    TIMING_STAGE_CUT,               //uvc_frame_get return -> raw_data_cut done
+    TIMING_STAGE_STATS,             //corrections and statistics of the image/temp planes, the two in parallel
+    TIMING_STAGE_DISPLAY_QUEUE,     //uvc_frame_get return -> display_one_frame start
+    TIMING_STAGE_DISPLAY_NR,        //noise reduction before enhance, only when display_nr_mode is on
+    TIMING_STAGE_DISPLAY_UPSCALE,   //Y14 upscale of display_upscale_factor, counted in display_process as well
+    TIMING_STAGE_ENHANCE_STRETCH,   //enhance_image_frame of the Y14 chain, one stage per implementation,
+    TIMING_STAGE_ENHANCE_HIST_AGC,  //the fused lut paths fold stretch/hist agc into display_process
+    TIMING_STAGE_ENHANCE_LIB,
+    TIMING_STAGE_ENHANCE_CLAHE,
+    TIMING_STAGE_ENHANCE_DDE,
+    TIMING_STAGE_DISPLAY_PROCESS,   //enhance/pseudocolor or human segmentation
+    TIMING_STAGE_DISPLAY_TRANSFORM, //mirror/flip/rotate
+    TIMING_STAGE_DISPLAY_RENDER,    //overlay and sink present
+    TIMING_STAGE_DISPLAY_TOTAL,     //display_one_frame start -> end
+    TIMING_STAGE_DISPLAY_LATENCY,   //uvc_frame_get return -> display_one_frame end
+    TIMING_STAGE_TEMP_QUEUE,        //uvc_frame_get return -> temperature processing start
+    TIMING_STAGE_TEMP_PROCESS,      //temperature processing of one frame
+    TIMING_STAGE_ALARM,             //uvc_frame_get return -> the frame's alarm events out
+    TIMING_STAGE_SCREEN,            //uvc_frame_get return -> the frame's screening readings out
+    TIMING_STAGE_INFER_QUEUE,       //uvc_frame_get return -> the frame's batch dispatched to the backend
+    TIMING_STAGE_INFER,             //uvc_frame_get return -> the frame's detections out, batching included
+    TIMING_STAGE_CMD_WAIT,          //cmdq_submit -> the command starts on the worker
+    TIMING_STAGE_CMD_EXEC,          //one vendor command on the worker
+    TIMING_STAGE_CALLBACK,          //time spent inside the libiruvc frame callback
+    TIMING_STAGE_OPEN,              //ir_camera_open_same, enumeration included unless fast reopen had the module cached
+    TIMING_STAGE_OPEN_TO_FRAME,     //ir_camera_open_same start -> the stream's first frame, once per open
+    TIMING_STAGE_STARTUP,           //process start -> the first frame of the process, one sample
+    TIMING_STAGE_FRAME_INTERVAL,    //arrival spacing of consecutive frames
+    TIMING_STAGE_ARRIVAL_JITTER,    //|spacing - the ring's average interval|
+    TIMING_STAGE_PACER_LATENCY,     //arrival -> a frame pacer handed the frame out
+    TIMING_STAGE_MQTT_PUBLISH,      //an mqtt message made -> written (qos 0) or acknowledged (qos 1)
+    TIMING_STAGE_NUM,
+}TimingStage_t;
+
+typedef struct {
+    uint64_t count;
+    uint64_t mean_us;
+    uint64_t p50_us;                //percentiles are bucket upper bounds, within 12.5%
+    uint64_t p99_us;
+    uint64_t max_us;
+    uint64_t sum_us;                //of every sample, for exporters reporting averages over their own windows
+}TimingStats_t;
+
+//hardware counters of a stage, summed over the samples that had them
+typedef struct {
+    uint64_t samples;
+    uint64_t value[PERF_EVENT_NUM];
+}TimingPerf_t;
+
+//the histogram behind each stage, for modules keeping their own (zero initialized when static)
+typedef struct {
+    std::atomic<uint64_t> buckets[TIMING_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum_us;
+    std::atomic<uint64_t> max_us;
+}TimingHist_t;
+
+void timing_hist_record(TimingHist_t* hist, uint64_t duration_us);
+
+void timing_hist_stats(TimingHist_t* hist, TimingStats_t* stats);
+
+void timing_hist_reset(TimingHist_t* hist);
+
+//add one duration to the stage's histogram, lock free, callable from any thread
+void timing_record(TimingStage_t stage, uint64_t duration_us);
+
+//record now - start_us and return now
+uint64_t timing_record_since(TimingStage_t stage, uint64_t start_us);
+
+//snapshot of the stage's histogram, returns -1 for an invalid stage
+int timing_stats_get(TimingStage_t stage, TimingStats_t* stats);
+
+//hardware counters per stage (perfctr.h), off by default. each thread opens its own counter group when it first
+//marks; a timing_record_since return and timing_start are marks, and timing_record_since adds the counts since the
+//mark its start_us came from. a stage started from a frame timestamp or on another thread gets no counts
+void timing_perf_enable(int enable);
+
+//get_monotonic_us for a stage start, marking the thread's counters when they are enabled
+uint64_t timing_start(void);
+
+//the counters of the stage so far, samples 0 when it had none. returns -1 for an invalid stage
+int timing_perf_get(TimingStage_t stage, TimingPerf_t* perf);
+
+//clear all histograms
+void timing_reset(void);
+
+const char* timing_stage_name(TimingStage_t stage);
+
+//print every stage that has samples
+void timing_dump(void);
+
+//dump from timing_dump_check every interval_s seconds, 0 disables
+void timing_dump_interval_set(uint32_t interval_s);
+
+//called once per frame by the stream thread, dumps when the interval has passed
+void timing_dump_check(void);
+
+#endif
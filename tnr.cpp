@@ -0,0 +1,146 @@
+#include "tnr.h"
+#include "simd.h"
+#include <stdlib.h>
+#include <string.h>
+
+static Tnr_t display_tnr;
+static uint8_t display_tnr_inited = 0;
+
+void tnr_default_param(TnrParam_t* param)
+{
+	param->still_ratio = 0.25f;
+	param->motion_low = 32;
+	param->motion_high = 128;
+}
+
+int tnr_init(Tnr_t* tnr, TnrParam_t* param)
+{
+	if (tnr == NULL)
+	{
+		return TNR_ERROR_PARAM;
+	}
+	memset(tnr, 0, sizeof(Tnr_t));
+	if (param != NULL)
+	{
+		tnr->param = *param;
+	}
+	else
+	{
+		tnr_default_param(&tnr->param);
+	}
+	return TNR_SUCCESS;
+}
+
+void tnr_release(Tnr_t* tnr)
+{
+	if (tnr != NULL)
+	{
+		free(tnr->history);
+		tnr->history = NULL;
+		tnr->pix_num = 0;
+		tnr->history_valid = 0;
+	}
+}
+
+void tnr_reset(Tnr_t* tnr)
+{
+	if (tnr != NULL)
+	{
+		tnr->history_valid = 0;
+	}
+}
+
+Tnr_t* get_display_tnr(void)
+{
+	if (!display_tnr_inited)
+	{
+		tnr_init(&display_tnr, NULL);
+		display_tnr_inited = 1;
+	}
+	return &display_tnr;
+}
+
+//the history for a pix_num frame, 1 when it was seeded from src and the frame passes through unfiltered
+static int tnr_history_prepare(Tnr_t* tnr, const uint16_t* src, int pix_num, int shift)
+{
+	if (tnr->pix_num != pix_num)
+	{
+		free(tnr->history);
+		tnr->history = (uint16_t*)malloc(pix_num * sizeof(uint16_t));
+		tnr->pix_num = (tnr->history != NULL) ? pix_num : 0;
+		tnr->history_valid = 0;
+		if (tnr->history == NULL)
+		{
+			return TNR_ERROR_MEM;
+		}
+	}
+	if (!tnr->history_valid)
+	{
+		for (int i = 0; i < pix_num; i++)
+		{
+			tnr->history[i] = (uint16_t)((src[i] >> shift) << 1);
+		}
+		tnr->history_valid = 1;
+		return 1;
+	}
+	return TNR_SUCCESS;
+}
+
+//Q15 weights from the parameters, read every frame so they can be tuned live
+static void tnr_filter(Tnr_t* tnr, const uint16_t* src, int pix_num, int shift, uint16_t* history, uint16_t* dst)
+{
+	float ratio = tnr->param.still_ratio;
+	ratio = (ratio < 0.0f) ? 0.0f : ((ratio > 1.0f) ? 1.0f : ratio);
+	uint16_t still_weight = (uint16_t)(ratio * 32767 + 0.5f);
+	uint16_t low = tnr->param.motion_low;
+	uint16_t range = (tnr->param.motion_high > low) ? tnr->param.motion_high - low : 1;
+	uint16_t slope = (uint16_t)((32767 - still_weight) / range);
+	simd_tnr_u16(src, shift, pix_num, low, range, still_weight, slope, history, dst);
+}
+
+int tnr_process(Tnr_t* tnr, const uint16_t* src, int pix_num, int shift, uint16_t* dst)
+{
+	if (tnr == NULL || src == NULL || dst == NULL || pix_num <= 0 || shift < 0 || shift > 2)
+	{
+		return TNR_ERROR_PARAM;
+	}
+	int rst = tnr_history_prepare(tnr, src, pix_num, shift);
+	if (rst < 0)
+	{
+		return rst;
+	}
+	if (rst == 1)
+	{
+		if (dst != src)
+		{
+			memcpy(dst, src, pix_num * sizeof(uint16_t));
+		}
+		return TNR_SUCCESS;
+	}
+	tnr_filter(tnr, src, pix_num, shift, tnr->history, dst);
+	return TNR_SUCCESS;
+}
+
+int tnr_process_span(Tnr_t* tnr, const uint16_t* src, int pix_num, int begin, int end, int shift, uint16_t* dst)
+{
+	if (tnr == NULL || src == NULL || dst == NULL || pix_num <= 0 || shift < 0 || shift > 2 || \
+		begin < 0 || end > pix_num || begin >= end)
+	{
+		return TNR_ERROR_PARAM;
+	}
+	int rst = tnr_history_prepare(tnr, src, pix_num, shift);
+	if (rst < 0)
+	{
+		return rst;
+	}
+	if (rst == 1)
+	{
+		if (dst != src)
+		{
+			memcpy(dst + begin, src + begin, (end - begin) * sizeof(uint16_t));
+		}
+		return TNR_SUCCESS;
+	}
+	tnr_filter(tnr, src + begin, end - begin, shift, tnr->history + begin, dst + begin);
+	return TNR_SUCCESS;
+}
@@ -0,0 +1,47 @@
+#ifndef _TNR_H_
+#define _TNR_H_
+
+#include <stdint.h>
+
+#define TNR_SUCCESS 0
+#define TNR_ERROR_PARAM -1
+#define TNR_ERROR_MEM -2
+
+//a pixel's new value is blended into its history by a weight growing with |new - history|:
+//still_ratio up to motion_low (noise), linearly up to 1 at motion_high (motion), so moving edges do not smear
+typedef struct {
+    float still_ratio;              //weight of the new frame where nothing moves, 1 disables the filter
+    uint16_t motion_low;            //Y14 difference still treated as noise
+    uint16_t motion_high;           //Y14 difference from which the new frame is taken as it is
+}TnrParam_t;
+
+typedef struct {
+    TnrParam_t param;
+    int pix_num;                    //size of the history, it restarts when the frame size changes
+    uint16_t* history;              //filtered Y14 << 1, the extra bit keeps small steps from stalling
+    uint8_t history_valid;
+}Tnr_t;
+
+//still_ratio 0.25 (about 7 frames at rest), motion 32..128 Y14
+void tnr_default_param(TnrParam_t* param);
+
+//param NULL takes the default, the history is allocated by the first frame
+int tnr_init(Tnr_t* tnr, TnrParam_t* param);
+
+void tnr_release(Tnr_t* tnr);
+
+//the next frame starts a new history, after a scene cut or a gain switch
+void tnr_reset(Tnr_t* tnr);
+
+//the tnr state used by the display pipeline
+Tnr_t* get_display_tnr(void);
+
+//filter one frame in fixed point, src is shifted right by shift to get Y14 and dst keeps the source's format
+//dst may be src
+int tnr_process(Tnr_t* tnr, const uint16_t* src, int pix_num, int shift, uint16_t* dst);
+
+//tnr_process of pixels [begin, end) of a pix_num frame only, the rest of the history keeps its last value
+//a new history is seeded from the whole src
+int tnr_process_span(Tnr_t* tnr, const uint16_t* src, int pix_num, int begin, int end, int shift, uint16_t* dst);
+
+#endif
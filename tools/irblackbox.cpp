@@ -0,0 +1,223 @@
+//recovery of a black box (blackbox.h) after a crash, a power cut or a clean stop
+//usage: irblackbox [-o frames.raw] [-t timeline.csv] box
+//prints the box, the recovered timeline in wall time (runs of frames, the gaps between them, every alarm and note)
+//and what the recovery found. -o writes the decoded frames back to back, image then temp plane as in the header:
+//np.fromfile(path, np.uint16).reshape(frames, -1) in numpy. -t writes one line per record
+#include "blackbox.h"
+#include "tempunit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int irblackbox_usage(const char* name)
+{
+    printf("usage: %s [-o frames.raw] [-t timeline.csv] box\n", name);
+    return -1;
+}
+
+//monotonic us of the box as utc wall time, to the millisecond
+static const char* irblackbox_wall(const BlackboxFileHeader_t* header, uint64_t timestamp_us, char* text, size_t size)
+{
+    int64_t wall_us = (int64_t)timestamp_us + header->wall_offset_us;
+    time_t seconds = (time_t)(wall_us / 1000000);
+    struct tm tm_wall;
+#if defined(_WIN32)
+    gmtime_s(&tm_wall, &seconds);
+#else
+    gmtime_r(&seconds, &tm_wall);
+#endif
+    size_t len = strftime(text, size, "%Y-%m-%d %H:%M:%S", &tm_wall);
+    snprintf(text + len, size - len, ".%03d", (int)(wall_us % 1000000 / 1000));
+    return text;
+}
+
+typedef struct {
+    uint64_t frames;
+    uint64_t first_us;
+    uint64_t last_us;
+    uint64_t first_index;
+    uint64_t last_index;
+    uint64_t undecodable;
+}IrblackboxRun_t;
+
+static void irblackbox_run_print(const BlackboxFileHeader_t* header, IrblackboxRun_t* run)
+{
+    if (run->frames == 0)
+    {
+        return;
+    }
+    char first[32];
+    printf("%s  frames %llu..%llu, %llu in %.3f s, %llu undecodable before a keyframe\n", \
+        irblackbox_wall(header, run->first_us, first, sizeof(first)), (unsigned long long)run->first_index, \
+        (unsigned long long)run->last_index, (unsigned long long)run->frames, (run->last_us - run->first_us) / 1e6, \
+        (unsigned long long)run->undecodable);
+    memset(run, 0, sizeof(IrblackboxRun_t));
+}
+
+int main(int argc, char* argv[])
+{
+    const char* input = NULL;
+    const char* raw_path = NULL;
+    const char* csv_path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (argv[i][0] != '-')
+        {
+            input = argv[i];
+            continue;
+        }
+        if (value == NULL)
+        {
+            return irblackbox_usage(argv[0]);
+        }
+        i++;
+        if (strcmp(argv[i - 1], "-o") == 0)
+        {
+            raw_path = value;
+        }
+        else if (strcmp(argv[i - 1], "-t") == 0)
+        {
+            csv_path = value;
+        }
+        else
+        {
+            return irblackbox_usage(argv[0]);
+        }
+    }
+    if (input == NULL)
+    {
+        return irblackbox_usage(argv[0]);
+    }
+
+    static BlackboxReader_t reader;
+    int rst = blackbox_reader_open(&reader, input);
+    if (rst != BLACKBOX_SUCCESS)
+    {
+        printf("irblackbox: can not read %s (%d)\n", input, rst);
+        return -1;
+    }
+    const BlackboxFileHeader_t* header = &reader.header;
+    char wall[32];
+    printf("irblackbox: %s, %llu MB of records, image %ux%u (%u bytes), temp %ux%u (%u bytes), %u fps\n", input, \
+        (unsigned long long)(header->data_size >> 20), header->image_width, header->image_height, \
+        header->image_byte_size, header->temp_width, header->temp_height, header->temp_byte_size, header->fps);
+    printf("irblackbox: last synced %s, %u laps, next seq %llu\n", irblackbox_wall(header, header->synced_us, wall, \
+        sizeof(wall)), header->laps, (unsigned long long)header->next_seq);
+
+    uint8_t* image = (uint8_t*)malloc(header->image_byte_size + 1);
+    uint8_t* temp = (uint8_t*)malloc(header->temp_byte_size + 1);
+    FILE* raw_fp = (raw_path != NULL) ? fopen(raw_path, "wb") : NULL;
+    FILE* csv_fp = (csv_path != NULL) ? fopen(csv_path, "w") : NULL;
+    if (image == NULL || temp == NULL || (raw_path != NULL && raw_fp == NULL) || (csv_path != NULL && csv_fp == NULL))
+    {
+        printf("irblackbox: can not write the output\n");
+        free(image);
+        free(temp);
+        blackbox_reader_close(&reader);
+        return -1;
+    }
+    if (csv_fp != NULL)
+    {
+        fprintf(csv_fp, "seq,wall,timestamp_us,type,frame_seq,frame_index,decoded,temp_min,temp_max,detail\n");
+    }
+
+    IrblackboxRun_t run;
+    memset(&run, 0, sizeof(IrblackboxRun_t));
+    uint64_t last_seq = 0, written = 0;
+    BlackboxItem_t item;
+    while (blackbox_reader_next(&reader, &item, raw_fp ? image : NULL, raw_fp ? temp : NULL) == BLACKBOX_SUCCESS)
+    {
+        irblackbox_wall(header, item.timestamp_us, wall, sizeof(wall));
+        if (last_seq != 0 && item.seq != last_seq + 1)
+        {
+            irblackbox_run_print(header, &run);
+            printf("%*s  -- %llu records lost --\n", 23, "", (unsigned long long)(item.seq - last_seq - 1));
+        }
+        last_seq = item.seq;
+        if (item.type == BLACKBOX_RECORD_FRAME)
+        {
+            const BlackboxFrame_t* frame = &item.frame;
+            if (run.frames > 0 && frame->frame_index != run.last_index + 1)
+            {
+                irblackbox_run_print(header, &run);
+            }
+            if (run.frames == 0)
+            {
+                run.first_us = item.timestamp_us;
+                run.first_index = frame->frame_index;
+            }
+            run.frames++;
+            run.last_us = item.timestamp_us;
+            run.last_index = frame->frame_index;
+            run.undecodable += !item.decoded;
+            if (raw_fp != NULL && item.decoded)
+            {
+                fwrite(image, 1, header->image_byte_size, raw_fp);
+                fwrite(temp, 1, header->temp_byte_size, raw_fp);
+                written++;
+            }
+            if (csv_fp != NULL)
+            {
+                //the temperatures stay empty for frames without statistics
+                char temps[32] = ",";
+                if (frame->temp_max > 0)
+                {
+                    snprintf(temps, sizeof(temps), "%.2f,%.2f", temp_celsius_of_raw(frame->temp_min), \
+                        temp_celsius_of_raw(frame->temp_max));
+                }
+                fprintf(csv_fp, "%llu,%s,%llu,frame,%llu,%llu,%d,%s,\n", (unsigned long long)item.seq, wall, \
+                    (unsigned long long)item.timestamp_us, (unsigned long long)frame->frame_seq, \
+                    (unsigned long long)frame->frame_index, item.decoded, temps);
+            }
+            continue;
+        }
+        //the events stand between the runs, in their order
+        irblackbox_run_print(header, &run);
+        if (item.type == BLACKBOX_RECORD_ALARM)
+        {
+            const AlarmEvent_t* event = &item.alarm;
+            printf("%s  alarm %s: track %d max %.2fC at (%d,%d), box (%d,%d)-(%d,%d), %u pixels\n", wall, \
+                alarm_event_name((AlarmEventType_t)event->type), event->track_id, temp_celsius_of_raw(event->max_temp), \
+                event->max_x, event->max_y, event->x0, event->y0, event->x1, event->y1, event->area);
+            if (csv_fp != NULL)
+            {
+                fprintf(csv_fp, "%llu,%s,%llu,alarm,%llu,,,,%.2f,%s track %d\n", (unsigned long long)item.seq, wall, \
+                    (unsigned long long)item.timestamp_us, (unsigned long long)event->seq, \
+                    temp_celsius_of_raw(event->max_temp), alarm_event_name((AlarmEventType_t)event->type), \
+                    event->track_id);
+            }
+        }
+        else if (item.type == BLACKBOX_RECORD_NOTE)
+        {
+            printf("%s  %s\n", wall, item.text);
+            if (csv_fp != NULL)
+            {
+                fprintf(csv_fp, "%llu,%s,%llu,note,,,,,,%s\n", (unsigned long long)item.seq, wall, \
+                    (unsigned long long)item.timestamp_us, item.text);
+            }
+        }
+    }
+    irblackbox_run_print(header, &run);
+
+    const BlackboxRecovery_t* recovery = &reader.recovery;
+    printf("irblackbox: %llu records (%llu frames, %llu events), %llu torn, %llu gaps, %llu undecodable\n", \
+        (unsigned long long)recovery->records, (unsigned long long)recovery->frames, \
+        (unsigned long long)recovery->events, (unsigned long long)recovery->torn, (unsigned long long)recovery->gaps, \
+        (unsigned long long)recovery->undecodable);
+    if (raw_fp != NULL)
+    {
+        printf("irblackbox: %llu frames of %u bytes into %s\n", (unsigned long long)written, \
+            header->image_byte_size + header->temp_byte_size, raw_path);
+        fclose(raw_fp);
+    }
+    if (csv_fp != NULL)
+    {
+        fclose(csv_fp);
+    }
+    free(image);
+    free(temp);
+    blackbox_reader_close(&reader);
+    return 0;
+}
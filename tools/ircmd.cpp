@@ -0,0 +1,172 @@
+//vendor commands to a running module from another process, through the broker of its sample process
+//usage: ircmd [-i camera] [-s path] [-p critical|read|normal|long] [-t timeout_ms] op [args]
+//ops: cmd <n> (the stdin command numbers), get tpd|image|shutter <prop>, set tpd|image|shutter <prop> <value>,
+//gain high|low, stats (the module's command queue: pending, worst wait and run time per priority)
+//the command runs in the module's queue between frames like its own, the reply tells how long it waited
+#include "cmdbroker.h"
+#include "gain.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IRCMD_TIMEOUT_MS 60000          //long commands (dpc, table writes) hold the module for many seconds
+#define IRCMD_MAX_ARGS 4
+
+static const char* ircmd_priority_names[CMDQ_PRIORITY_NUM] = { "critical", "read", "normal", "long" };
+static const char* ircmd_page_names[CMD_BROKER_PAGE_NUM] = { "tpd", "image", "shutter" };
+
+static int ircmd_usage(const char* name)
+{
+    printf("usage: %s [-i camera] [-s path] [-p critical|read|normal|long] [-t timeout_ms] op [args]\n", name);
+    printf("  cmd <n>                          command n of the module's command menu\n");
+    printf("  get tpd|image|shutter <prop>     property page and index of the vendor enums\n");
+    printf("  set tpd|image|shutter <prop> <value>\n");
+    printf("  gain high|low                    critical, with the gain's calibration tables\n");
+    printf("  stats                            the module's command queue\n");
+    return -1;
+}
+
+static int ircmd_lookup(const char* const* names, int num, const char* name)
+{
+    for (int i = 0; i < num; i++)
+    {
+        if (strcmp(names[i], name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static const char* ircmd_result_name(int result)
+{
+    switch (result)
+    {
+    case CMD_BROKER_ERROR_PARAM: return "bad request";
+    case CMD_BROKER_ERROR_BUSY: return "busy";
+    case CMD_BROKER_ERROR_VERSION: return "other broker version";
+    case CMD_BROKER_ERROR_QUEUE: return "command queue refused";
+    case CMDQ_CLOSED: return "queue closed before it ran";
+    default: return (result == 0) ? "ok" : "failed";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int camera_index = 0, priority = CMD_BROKER_PRIORITY_DEFAULT, timeout_ms = IRCMD_TIMEOUT_MS;
+    const char* path = NULL;
+    const char* args[IRCMD_MAX_ARGS] = { NULL };
+    int arg_num = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (argv[i][0] != '-' || arg_num > 0)
+        {
+            if (arg_num == IRCMD_MAX_ARGS)
+            {
+                return ircmd_usage(argv[0]);
+            }
+            args[arg_num++] = argv[i];
+            continue;
+        }
+        if (value == NULL)
+        {
+            return ircmd_usage(argv[0]);
+        }
+        i++;
+        if (strcmp(argv[i - 1], "-i") == 0)
+        {
+            camera_index = atoi(value);
+        }
+        else if (strcmp(argv[i - 1], "-s") == 0)
+        {
+            path = value;
+        }
+        else if (strcmp(argv[i - 1], "-p") == 0)
+        {
+            priority = ircmd_lookup(ircmd_priority_names, CMDQ_PRIORITY_NUM, value);
+            if (priority < 0)
+            {
+                return ircmd_usage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i - 1], "-t") == 0)
+        {
+            timeout_ms = atoi(value);
+        }
+        else
+        {
+            return ircmd_usage(argv[0]);
+        }
+    }
+    if (arg_num == 0)
+    {
+        return ircmd_usage(argv[0]);
+    }
+
+    CmdBrokerOp_t op = CMD_BROKER_OP_NUM;
+    int32_t arg[3] = { 0 };
+    if (strcmp(args[0], "cmd") == 0 && arg_num == 2)
+    {
+        op = CMD_BROKER_OP_COMMAND;
+        arg[0] = atoi(args[1]);
+    }
+    else if ((strcmp(args[0], "get") == 0 && arg_num == 3) || (strcmp(args[0], "set") == 0 && arg_num == 4))
+    {
+        op = (args[0][0] == 'g') ? CMD_BROKER_OP_PROP_GET : CMD_BROKER_OP_PROP_SET;
+        arg[0] = ircmd_lookup(ircmd_page_names, CMD_BROKER_PAGE_NUM, args[1]);
+        arg[1] = atoi(args[2]);
+        arg[2] = (arg_num == 4) ? atoi(args[3]) : 0;
+        if (arg[0] < 0)
+        {
+            return ircmd_usage(argv[0]);
+        }
+    }
+    else if (strcmp(args[0], "gain") == 0 && arg_num == 2 && \
+        (strcmp(args[1], "high") == 0 || strcmp(args[1], "low") == 0))
+    {
+        op = CMD_BROKER_OP_GAIN;
+        arg[0] = (strcmp(args[1], "high") == 0) ? GAIN_CTRL_HIGH : GAIN_CTRL_LOW;
+    }
+    else if (strcmp(args[0], "stats") == 0 && arg_num == 1)
+    {
+        op = CMD_BROKER_OP_STATS;
+    }
+    else
+    {
+        return ircmd_usage(argv[0]);
+    }
+
+    CmdBrokerConn_t conn;
+    int rst = cmd_broker_connect(&conn, path, camera_index);
+    if (rst != CMD_BROKER_SUCCESS)
+    {
+        printf("ircmd: no broker for camera %d (%d), is its sample running with CMD_BROKER?\n", camera_index, rst);
+        return -1;
+    }
+    CmdBrokerReply_t reply;
+    rst = cmd_broker_call(&conn, op, priority, arg[0], arg[1], arg[2], timeout_ms, &reply);
+    cmd_broker_disconnect(&conn);
+    if (rst != CMD_BROKER_SUCCESS)
+    {
+        printf("ircmd: %s\n", (rst == CMD_BROKER_ERROR_TIMEOUT) ? "no reply in time" : "connection lost");
+        return -1;
+    }
+    if (op == CMD_BROKER_OP_STATS)
+    {
+        for (int p = 0; p < CMDQ_PRIORITY_NUM; p++)
+        {
+            printf("%-8s pending %u, run %llu, wait max %.1f ms, exec max %.1f ms\n", ircmd_priority_names[p], \
+                reply.pending[p], (unsigned long long)reply.stats.jobs[p], reply.stats.wait_max_us[p] / 1e3, \
+                reply.stats.exec_max_us[p] / 1e3);
+        }
+        return 0;
+    }
+    printf("%s (%d)", ircmd_result_name(reply.result), reply.result);
+    if (op == CMD_BROKER_OP_PROP_GET && reply.result == 0)
+    {
+        printf(", value %d", reply.value);
+    }
+    printf(", waited %.1f ms, ran %.1f ms\n", reply.wait_us / 1e3, reply.exec_us / 1e3);
+    return (reply.result == 0) ? 0 : -1;
+}
@@ -0,0 +1,181 @@
+//offline export of a recording (record.h) into a zarr v2 group, export.h
+//usage: irexport [-n chunk_frames] [-b chunk_buffers] [-z level] [-j workers] [-e ems] [-a ta] [-u tu] [-d dist]
+//                [-H hum] recording out.zarr
+//the Y14/Y16 image plane and the temp plane become T x H x W uint16 arrays chunked by -n frames, zlib level -z
+//(0 stores them as they are). -e/-a/-u (celsius)/-d (m)/-H (0..1) describe the scene, written as attributes.
+//the chunks compress on -j workers, 0 or none uses every core. in python: xarray.open_zarr("out.zarr")
+#include "export.h"
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IREXPORT_DEFAULT_EMS 0.95f
+#define IREXPORT_DEFAULT_TA 25
+#define IREXPORT_DEFAULT_TU 25
+#define IREXPORT_DEFAULT_DIST 0.25f
+#define IREXPORT_DEFAULT_HUM 0.5f
+
+static int irexport_usage(const char* name)
+{
+    printf("usage: %s [-n chunk_frames] [-b chunk_buffers] [-z level] [-j workers] [-e ems] [-a ta] [-u tu] " \
+        "[-d dist] [-H hum] recording out.zarr\n", name);
+    return -1;
+}
+
+int main(int argc, char* argv[])
+{
+    static ExportParam_t param;
+    param.level = EXPORT_DEFAULT_LEVEL;
+    param.chunk_buffers = EXPORT_MAX_CHUNK_BUFFERS;
+    //written once any of them is given
+    param.env.ems = IREXPORT_DEFAULT_EMS;
+    param.env.ta = IREXPORT_DEFAULT_TA;
+    param.env.tu = IREXPORT_DEFAULT_TU;
+    param.env.dist = IREXPORT_DEFAULT_DIST;
+    param.env.hum = IREXPORT_DEFAULT_HUM;
+    const char* input = NULL;
+    const char* output = NULL;
+    int workers = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (argv[i][0] != '-')
+        {
+            if (input == NULL)
+            {
+                input = argv[i];
+            }
+            else
+            {
+                output = argv[i];
+            }
+            continue;
+        }
+        if (value == NULL)
+        {
+            return irexport_usage(argv[0]);
+        }
+        i++;
+        if (strcmp(argv[i - 1], "-n") == 0)
+        {
+            param.chunk_frames = atoi(value);
+        }
+        else if (strcmp(argv[i - 1], "-b") == 0)
+        {
+            param.chunk_buffers = atoi(value);
+        }
+        else if (strcmp(argv[i - 1], "-z") == 0)
+        {
+            param.level = atoi(value);
+        }
+        else if (strcmp(argv[i - 1], "-j") == 0)
+        {
+            workers = atoi(value);
+        }
+        else if (strcmp(argv[i - 1], "-e") == 0)
+        {
+            param.env.ems = (float)atof(value);
+            param.env.valid = 1;
+        }
+        else if (strcmp(argv[i - 1], "-a") == 0)
+        {
+            param.env.ta = (float)atof(value);
+            param.env.valid = 1;
+        }
+        else if (strcmp(argv[i - 1], "-u") == 0)
+        {
+            param.env.tu = (float)atof(value);
+            param.env.valid = 1;
+        }
+        else if (strcmp(argv[i - 1], "-d") == 0)
+        {
+            param.env.dist = (float)atof(value);
+            param.env.valid = 1;
+        }
+        else if (strcmp(argv[i - 1], "-H") == 0)
+        {
+            param.env.hum = (float)atof(value);
+            param.env.valid = 1;
+        }
+        else
+        {
+            return irexport_usage(argv[0]);
+        }
+    }
+    if (input == NULL || output == NULL || strlen(output) >= EXPORT_PATH_LEN)
+    {
+        return irexport_usage(argv[0]);
+    }
+    strcpy(param.path, output);
+
+    static RecordReader_t reader;
+    if (record_reader_open(&reader, input) != RECORD_SUCCESS)
+    {
+        printf("irexport: can not read %s\n", input);
+        return -1;
+    }
+    record_reader_map(&reader);
+    const RecordFileHeader_t* header = &reader.header;
+    if (header->roi_num > 0)
+    {
+        //tile frames come out whole, the last full frame with the tiles on, their flags say which they are
+        printf("irexport: %u roi tiles every frame, the full frame every %u\n", header->roi_num, header->full_interval);
+    }
+    ExportShape_t shape = { { 0 } };
+    if ((header->image_format == INPUT_FMT_Y14 || header->image_format == INPUT_FMT_Y16) && \
+        header->image_byte_size > 0 && header->image_byte_size == header->image_width * header->image_height * 2)
+    {
+        shape.width[EXPORT_PLANE_IMAGE] = header->image_width;
+        shape.height[EXPORT_PLANE_IMAGE] = header->image_height;
+    }
+    if (header->temp_byte_size > 0 && header->temp_byte_size == header->temp_width * header->temp_height * 2)
+    {
+        shape.width[EXPORT_PLANE_TEMP] = header->temp_width;
+        shape.height[EXPORT_PLANE_TEMP] = header->temp_height;
+    }
+    shape.fps = header->fps;
+    uint8_t* image = (uint8_t*)malloc(header->image_byte_size + 1);
+    uint8_t* temp = (uint8_t*)malloc(header->temp_byte_size + 1);
+    if (image == NULL || temp == NULL)
+    {
+        record_reader_close(&reader);
+        return -1;
+    }
+
+    pool_init(workers);
+    static Exporter_t exporter;
+    export_init(&exporter);
+    int rst = export_open(&exporter, &param, &shape);
+    uint64_t start_us = get_monotonic_us();
+    if (rst == EXPORT_SUCCESS)
+    {
+        RecordFrameMeta_t meta;
+        while (rst == EXPORT_SUCCESS && record_reader_next(&reader, &meta, \
+            (header->image_byte_size > 0) ? image : NULL, (header->temp_byte_size > 0) ? temp : NULL) == RECORD_SUCCESS)
+        {
+            rst = export_frame(&exporter, &meta, (const uint16_t*)image, (const uint16_t*)temp, 1);
+        }
+        int close_rst = export_close(&exporter);
+        rst = (rst != EXPORT_SUCCESS) ? rst : close_rst;
+    }
+    uint64_t elapsed_us = get_monotonic_us() - start_us;
+    int worker_num = pool_worker_num();
+    pool_release();
+    record_reader_close(&reader);
+    free(image);
+    free(temp);
+
+    ExportStats_t stats;
+    export_stats(&exporter, &stats);
+    double seconds = (elapsed_us > 0) ? elapsed_us / 1e6 : 1e-6;
+    printf("irexport: %llu frames, %.2f s on %d workers, %.0f fps, %llu plane bytes stored in %llu\n", \
+        (unsigned long long)stats.frames, seconds, worker_num, stats.frames / seconds, \
+        (unsigned long long)stats.plane_bytes, (unsigned long long)stats.stored_bytes);
+    if (rst != EXPORT_SUCCESS)
+    {
+        printf("irexport: failed %d\n", rst);
+        return 1;
+    }
+    return 0;
+}
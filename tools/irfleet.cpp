@@ -0,0 +1,536 @@
+//maintenance of every attached module at once, without the scanf menu of cmd_function
+//usage: irfleet [-n cameras] [-p parallel] [-t timeout_s] [-j result.json] action [arg]
+//actions: info, update_fw fw.bin, restore all|tpd|prop|user|dpc|k, dpc [wait_s], backup dir
+//the vendor library drives one module per process (its commands have no device handle), so each module gets a
+//worker process of its own: it opens the module with uvc_camera_open_same, runs the action and reports over a
+//pipe. the parent prints the progress, the throughput at the end and -j writes one json object with a result per
+//module ("-" for stdout). backup writes <dir>/<sn>_kt.bin, _bt.bin and _nuct.bin, np.fromfile with uint16/int16
+#include "camera.h"
+#include "cmd.h"
+#include "cmdbatch.h"
+#include "flash.h"
+#include "prop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#define IRFLEET_PROGRESS_MS 1000        //a summary line this often while workers run
+#define IRFLEET_KT_LEN 1201
+#define IRFLEET_NUCT_LEN 8192
+#define IRFLEET_DPC_WAIT_S 30           //what command 23 waits
+
+#define IRFLEET_SUCCESS 0
+#define IRFLEET_ERROR_OPEN -1001        //ir_camera_open_same failed
+#define IRFLEET_ERROR_FILE -1002
+#define IRFLEET_ERROR_WORKER -1003      //the worker died before its result
+#define IRFLEET_ERROR_TIMEOUT -1004     //killed after -t
+
+typedef enum {
+    IRFLEET_ACTION_INFO = 0,
+    IRFLEET_ACTION_UPDATE_FW,
+    IRFLEET_ACTION_RESTORE,
+    IRFLEET_ACTION_DPC,
+    IRFLEET_ACTION_BACKUP,
+}IrfleetAction_t;
+
+typedef enum {
+    IRFLEET_PHASE_WAITING = 0,
+    IRFLEET_PHASE_OPEN,
+    IRFLEET_PHASE_RUN,
+    IRFLEET_PHASE_DONE,
+}IrfleetPhase_t;
+
+static const char* irfleet_phase_names[] = { "waiting", "open", "running", "done" };
+
+typedef struct {
+    IrfleetAction_t action;
+    const char* name;
+    const char* arg;
+    int restore_cfg;                    //prop_default_cfg of restore
+    uint16_t dpc_wait_s;
+    int camera_num;
+}IrfleetJob_t;
+
+//one message of a worker, smaller than PIPE_BUF so a write is atomic
+typedef struct {
+    int32_t phase;
+    int32_t result;
+    uint64_t bytes;                     //moved over usb by the action
+    uint64_t us;                        //of the action, the open excluded
+    char sn[32];
+    char detail[96];
+}IrfleetReport_t;
+
+typedef struct {
+    IrfleetReport_t report;
+    int fd;                             //-1 before the start and after the result
+    uint64_t start_us;
+    uint64_t end_us;
+#if !defined(_WIN32)
+    pid_t pid;
+#endif
+}IrfleetWorker_t;
+
+static int irfleet_usage(const char* name)
+{
+    printf("usage: %s [-n cameras] [-p parallel] [-t timeout_s] [-j result.json] action [arg]\n", name);
+    printf("actions: info, update_fw fw.bin, restore all|tpd|prop|user|dpc|k, dpc [wait_s], backup dir\n");
+    return -1;
+}
+
+static int irfleet_job_parse(IrfleetJob_t* job, const char* action, const char* arg)
+{
+    static const char* restore_names[] = { "all", "k", "tpd", "prop", "user", "dpc" };
+    job->name = action;
+    job->arg = arg;
+    if (strcmp(action, "info") == 0)
+    {
+        job->action = IRFLEET_ACTION_INFO;
+        return 0;
+    }
+    if (strcmp(action, "update_fw") == 0)
+    {
+        job->action = IRFLEET_ACTION_UPDATE_FW;
+        return (arg != NULL) ? 0 : -1;
+    }
+    if (strcmp(action, "restore") == 0)
+    {
+        //the enum order of prop_default_cfg, DEF_CFG_ALL .. DEF_CFG_DEAD_PIXEL
+        job->action = IRFLEET_ACTION_RESTORE;
+        for (int i = 0; arg != NULL && i < (int)(sizeof(restore_names) / sizeof(restore_names[0])); i++)
+        {
+            if (strcmp(arg, restore_names[i]) == 0)
+            {
+                job->restore_cfg = i;
+                return 0;
+            }
+        }
+        return -1;
+    }
+    if (strcmp(action, "dpc") == 0)
+    {
+        job->action = IRFLEET_ACTION_DPC;
+        job->dpc_wait_s = (arg != NULL) ? (uint16_t)atoi(arg) : IRFLEET_DPC_WAIT_S;
+        return 0;
+    }
+    if (strcmp(action, "backup") == 0)
+    {
+        job->action = IRFLEET_ACTION_BACKUP;
+        return (arg != NULL) ? 0 : -1;
+    }
+    return -1;
+}
+
+#if !defined(_WIN32)
+static void irfleet_report(int fd, IrfleetReport_t* report, IrfleetPhase_t phase)
+{
+    report->phase = phase;
+    ssize_t rst = write(fd, report, sizeof(IrfleetReport_t));
+    (void)rst;
+}
+
+//the sn kept to characters every file system and json string accepts, camera<index> for a module without one
+static void irfleet_sn_read(int index, char* sn, size_t size)
+{
+    uint8_t sn_content[64] = { 0 };
+    size_t len = 0;
+    if (get_sn(sn_content) == IRUVC_SUCCESS)
+    {
+        for (; len + 1 < size && sn_content[len] != 0; len++)
+        {
+            uint8_t c = sn_content[len];
+            int valid = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-';
+            sn[len] = valid ? (char)c : '_';
+        }
+    }
+    sn[len] = 0;
+    if (len == 0)
+    {
+        snprintf(sn, size, "camera%d", index);
+    }
+}
+
+static int irfleet_file_write(const char* dir, const char* sn, const char* suffix, const void* data, size_t size)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s_%s.bin", dir, sn, suffix);
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        return IRFLEET_ERROR_FILE;
+    }
+    size_t written = fwrite(data, 1, size, fp);
+    int closed = fclose(fp);
+    return (written == size && closed == 0) ? IRFLEET_SUCCESS : IRFLEET_ERROR_FILE;
+}
+
+//kt/bt/nuc-t and the calib parameters in one command batch, as command 32 reads them
+static int irfleet_backup(const IrfleetJob_t* job, IrfleetReport_t* report)
+{
+    static uint16_t kt_array[IRFLEET_KT_LEN];
+    static int16_t bt_array[IRFLEET_KT_LEN];
+    static uint16_t nuct_array[IRFLEET_NUCT_LEN];
+    TempCalibParam_t calib_param;
+    memset(&calib_param, 0, sizeof(calib_param));
+    CmdBatch_t batch;
+    cmd_batch_init(&batch, CMD_BATCH_STOP_ON_ERROR, 0);
+    cmd_batch_transfer(&batch, CMD_BATCH_KT_READ, kt_array);
+    cmd_batch_transfer(&batch, CMD_BATCH_BT_READ, bt_array);
+    cmd_batch_transfer(&batch, CMD_BATCH_NUC_T_READ, nuct_array);
+    cmd_batch_transfer(&batch, CMD_BATCH_CALIB_PARAM_READ, &calib_param);
+    int rst = cmd_batch_exec(&batch);
+    if (rst != CMD_BATCH_SUCCESS)
+    {
+        return rst;
+    }
+    report->bytes = sizeof(kt_array) + sizeof(bt_array) + sizeof(nuct_array) + sizeof(calib_param);
+    snprintf(report->detail, sizeof(report->detail), "ktemp=%u btemp=%d address_ca=%u", calib_param.Ktemp, \
+        calib_param.Btemp, calib_param.AddressCA);
+    rst = irfleet_file_write(job->arg, report->sn, "kt", kt_array, sizeof(kt_array));
+    if (rst == IRFLEET_SUCCESS)
+    {
+        rst = irfleet_file_write(job->arg, report->sn, "bt", bt_array, sizeof(bt_array));
+    }
+    if (rst == IRFLEET_SUCCESS)
+    {
+        rst = irfleet_file_write(job->arg, report->sn, "nuct", nuct_array, sizeof(nuct_array));
+    }
+    return rst;
+}
+
+static int irfleet_action(const IrfleetJob_t* job, IrfleetReport_t* report)
+{
+    switch (job->action)
+    {
+    case IRFLEET_ACTION_INFO:
+    {
+        uint8_t version[64] = { 0 };
+        int rst = get_device_info(DEV_INFO_FW_BUILD_VERSION_INFO, version);
+        for (int i = 0; i < (int)sizeof(version) && version[i] != 0; i++)
+        {
+            version[i] = (version[i] >= 0x20 && version[i] < 0x7f && version[i] != '"' && version[i] != '\\') ? \
+                version[i] : '_';
+        }
+        snprintf(report->detail, sizeof(report->detail), "%s", (const char*)version);
+        return rst;
+    }
+    case IRFLEET_ACTION_UPDATE_FW:
+    {
+        flash_stats_reset();
+        int rst = flash_update_fw_file(job->arg);
+        FlashStats_t stats;
+        flash_stats_get(&stats);
+        report->bytes = stats.write_bytes;
+        return rst;
+    }
+    case IRFLEET_ACTION_RESTORE:
+        return prop_restore_default((enum prop_default_cfg)job->restore_cfg);
+    case IRFLEET_ACTION_DPC:
+        return dpc_auto_calibration(job->dpc_wait_s);
+    default:
+        return irfleet_backup(job, report);
+    }
+}
+
+//runs in the forked process, the libusb context is its own
+static void irfleet_worker(const IrfleetJob_t* job, int index, int fd)
+{
+    IrfleetReport_t report;
+    memset(&report, 0, sizeof(report));
+    snprintf(report.sn, sizeof(report.sn), "camera%d", index);
+    irfleet_report(fd, &report, IRFLEET_PHASE_OPEN);
+    CameraParam_t camera_param;
+    memset(&camera_param, 0, sizeof(camera_param));
+    if (ir_camera_open_same(&camera_param, index, job->camera_num) < 0)
+    {
+        report.result = IRFLEET_ERROR_OPEN;
+        irfleet_report(fd, &report, IRFLEET_PHASE_DONE);
+        return;
+    }
+    cmd_batch_poll_default(CMD_BATCH_POLL_MS);
+    command_init();
+    irfleet_sn_read(index, report.sn, sizeof(report.sn));
+    irfleet_report(fd, &report, IRFLEET_PHASE_RUN);
+    uint64_t start_us = get_monotonic_us();
+    report.result = irfleet_action(job, &report);
+    report.us = get_monotonic_us() - start_us;
+    ir_camera_close();
+    irfleet_report(fd, &report, IRFLEET_PHASE_DONE);
+}
+
+static int irfleet_start(const IrfleetJob_t* job, IrfleetWorker_t* worker, int index)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        return -1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        irfleet_worker(job, index, fds[1]);
+        fflush(stdout);
+        _exit(0);
+    }
+    close(fds[1]);
+    worker->pid = pid;
+    worker->fd = fds[0];
+    worker->start_us = get_monotonic_us();
+    return 0;
+}
+
+//the result is in, or the worker is gone without one
+static void irfleet_finish(IrfleetWorker_t* worker, int index, int result)
+{
+    if (worker->report.phase != IRFLEET_PHASE_DONE)
+    {
+        worker->report.phase = IRFLEET_PHASE_DONE;
+        worker->report.result = result;
+    }
+    close(worker->fd);
+    worker->fd = -1;
+    waitpid(worker->pid, NULL, 0);
+    worker->end_us = get_monotonic_us();
+    const IrfleetReport_t* report = &worker->report;
+    printf("irfleet: camera %d %s %s:%d in %.1f s%s%s\n", index, report->sn, (report->result == 0) ? "done" : \
+        "FAILED", report->result, (worker->end_us - worker->start_us) / 1e6, report->detail[0] ? ", " : "", \
+        report->detail);
+}
+
+static void irfleet_read(IrfleetWorker_t* worker, int index)
+{
+    IrfleetReport_t report;
+    ssize_t got = read(worker->fd, &report, sizeof(report));
+    if (got != (ssize_t)sizeof(report))
+    {
+        irfleet_finish(worker, index, IRFLEET_ERROR_WORKER);
+        return;
+    }
+    worker->report = report;
+    if (report.phase == IRFLEET_PHASE_DONE)
+    {
+        irfleet_finish(worker, index, report.result);
+        return;
+    }
+    printf("irfleet: camera %d %s %s\n", index, report.sn, irfleet_phase_names[report.phase]);
+}
+
+static void irfleet_json_write(FILE* fp, const IrfleetJob_t* job, const IrfleetWorker_t* workers, int failed, \
+    uint64_t elapsed_us)
+{
+    fprintf(fp, "{\"action\": \"%s\", \"arg\": ", job->name);
+    if (job->arg != NULL)
+    {
+        fputc('"', fp);
+        for (const char* c = job->arg; *c != 0; c++)
+        {
+            if (*c == '"' || *c == '\\')
+            {
+                fputc('\\', fp);
+            }
+            fputc((unsigned char)*c >= 0x20 ? *c : '_', fp);
+        }
+        fputc('"', fp);
+    }
+    else
+    {
+        fprintf(fp, "null");
+    }
+    fprintf(fp, ", \"cameras\": %d, \"failed\": %d, \"elapsed_ms\": %.1f, \"devices\": [", job->camera_num, failed, \
+        elapsed_us / 1e3);
+    for (int i = 0; i < job->camera_num; i++)
+    {
+        const IrfleetReport_t* report = &workers[i].report;
+        fprintf(fp, "%s\n  {\"index\": %d, \"sn\": \"%s\", \"result\": %d, \"ms\": %.1f, \"action_ms\": %.1f, " \
+            "\"bytes\": %llu, \"detail\": \"%s\"}", (i > 0) ? "," : "", i, report->sn, report->result, \
+            (workers[i].end_us - workers[i].start_us) / 1e3, report->us / 1e3, (unsigned long long)report->bytes, \
+            report->detail);
+    }
+    fprintf(fp, "\n]}\n");
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+    int camera_num = 0, parallel = 0, timeout_s = 0;
+    const char* json_path = NULL;
+    const char* action = NULL;
+    const char* arg = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (argv[i][0] != '-')
+        {
+            if (action == NULL)
+            {
+                action = argv[i];
+            }
+            else
+            {
+                arg = argv[i];
+            }
+            continue;
+        }
+        if (value == NULL)
+        {
+            return irfleet_usage(argv[0]);
+        }
+        i++;
+        if (strcmp(argv[i - 1], "-n") == 0)
+        {
+            camera_num = atoi(value);
+        }
+        else if (strcmp(argv[i - 1], "-p") == 0)
+        {
+            parallel = atoi(value);
+        }
+        else if (strcmp(argv[i - 1], "-t") == 0)
+        {
+            timeout_s = atoi(value);
+        }
+        else if (strcmp(argv[i - 1], "-j") == 0)
+        {
+            json_path = value;
+        }
+        else
+        {
+            return irfleet_usage(argv[0]);
+        }
+    }
+    IrfleetJob_t job;
+    memset(&job, 0, sizeof(job));
+    if (action == NULL || irfleet_job_parse(&job, action, arg) != 0)
+    {
+        return irfleet_usage(argv[0]);
+    }
+#if defined(_WIN32)
+    (void)camera_num;
+    (void)parallel;
+    (void)timeout_s;
+    (void)json_path;
+    printf("irfleet: a worker process per module needs fork, linux only\n");
+    return -1;
+#else
+    if (camera_num <= 0)
+    {
+        //counted in this process, the context is released before the workers open their own
+        camera_num = ir_camera_count();
+        ir_camera_release();
+    }
+    if (camera_num <= 0)
+    {
+        printf("irfleet: no module found\n");
+        return -1;
+    }
+    camera_num = (camera_num > IR_CAMERA_MAX_NUM) ? IR_CAMERA_MAX_NUM : camera_num;
+    parallel = (parallel <= 0 || parallel > camera_num) ? camera_num : parallel;
+    job.camera_num = camera_num;
+    printf("irfleet: %s on %d modules, %d at a time\n", job.name, camera_num, parallel);
+
+    static IrfleetWorker_t workers[IR_CAMERA_MAX_NUM];
+    for (int i = 0; i < camera_num; i++)
+    {
+        memset(&workers[i], 0, sizeof(IrfleetWorker_t));
+        workers[i].fd = -1;
+        snprintf(workers[i].report.sn, sizeof(workers[i].report.sn), "camera%d", i);
+    }
+    uint64_t start_us = get_monotonic_us(), progress_us = start_us;
+    int next = 0, done = 0;
+    while (done < camera_num)
+    {
+        struct pollfd fds[IR_CAMERA_MAX_NUM];
+        int index[IR_CAMERA_MAX_NUM];
+        int running = 0;
+        for (int i = 0; i < camera_num; i++)
+        {
+            if (workers[i].fd >= 0)
+            {
+                fds[running].fd = workers[i].fd;
+                fds[running].events = POLLIN;
+                index[running++] = i;
+            }
+        }
+        for (; running < parallel && next < camera_num; next++)
+        {
+            if (irfleet_start(&job, &workers[next], next) != 0)
+            {
+                workers[next].start_us = workers[next].end_us = get_monotonic_us();
+                workers[next].report.phase = IRFLEET_PHASE_DONE;
+                workers[next].report.result = IRFLEET_ERROR_WORKER;
+                done++;
+                continue;
+            }
+            fds[running].fd = workers[next].fd;
+            fds[running].events = POLLIN;
+            index[running++] = next;
+        }
+        if (running == 0)
+        {
+            continue;
+        }
+        poll(fds, running, IRFLEET_PROGRESS_MS);
+        uint64_t now_us = get_monotonic_us();
+        for (int i = 0; i < running; i++)
+        {
+            IrfleetWorker_t* worker = &workers[index[i]];
+            if (fds[i].revents != 0)
+            {
+                irfleet_read(worker, index[i]);
+            }
+            else if (timeout_s > 0 && now_us - worker->start_us > (uint64_t)timeout_s * 1000000)
+            {
+                kill(worker->pid, SIGKILL);
+                irfleet_finish(worker, index[i], IRFLEET_ERROR_TIMEOUT);
+            }
+            done += (worker->fd < 0);
+        }
+        if (now_us - progress_us >= IRFLEET_PROGRESS_MS * 1000ull && done < camera_num)
+        {
+            progress_us = now_us;
+            printf("irfleet: %d/%d done, %d running, %d waiting, %.0f s\n", done, camera_num, next - done, \
+                camera_num - next, (now_us - start_us) / 1e6);
+        }
+    }
+
+    uint64_t elapsed_us = get_monotonic_us() - start_us;
+    int failed = 0;
+    uint64_t bytes = 0;
+    for (int i = 0; i < camera_num; i++)
+    {
+        failed += (workers[i].report.result != 0);
+        bytes += workers[i].report.bytes;
+    }
+    double seconds = (elapsed_us > 0) ? elapsed_us / 1e6 : 1e-6;
+    printf("irfleet: %d of %d modules ok in %.1f s, %.1f modules/min, %.1f kB at %.1f kB/s\n", camera_num - failed, \
+        camera_num, seconds, camera_num * 60.0 / seconds, bytes / 1024.0, bytes / 1024.0 / seconds);
+    if (json_path != NULL)
+    {
+        FILE* fp = (strcmp(json_path, "-") == 0) ? stdout : fopen(json_path, "w");
+        if (fp == NULL)
+        {
+            printf("irfleet: can not write %s\n", json_path);
+            return -1;
+        }
+        irfleet_json_write(fp, &job, workers, failed, elapsed_us);
+        if (fp != stdout)
+        {
+            fclose(fp);
+        }
+    }
+    return (failed == 0) ? 0 : -1;
+#endif
+}
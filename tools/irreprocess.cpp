@@ -0,0 +1,192 @@
+//offline re-processing of a recording (record.h) on every core, reprocess.h
+//usage: irreprocess [-c calib_cache.bin] [-t tau.bin] [-e ems] [-a ta] [-u tu] [-d dist] [-H hum] [-p color_mode]
+//                   [-r x,y,w,h]... [-l x0,y0,x1,y1]... [-s summary.csv] [-o video.mjpeg] [-q quality] [-j workers]
+//                   recording
+//-c takes the nuc-t table, its gain and the tau table of that gain from the camera's calib_<sn>_<gain>.bin, -t reads
+//another tau table. with -c the temperatures are corrected to the new ems/ta/tu (celsius)/dist (m)/hum (0..1),
+//without it they stay as recorded. -s writes the rois' (-r rects, -l lines, the whole frame without either)
+//min/max/avr of every frame, -o the frames rendered through palette -p as a motion jpeg stream
+//(ffplay -f mjpeg video.mjpeg). -j 0 or none uses every core
+#include "reprocess.h"
+#include "calib.h"
+#include "pool.h"
+#include "palette.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IRREPROCESS_DEFAULT_EMS 0.95
+#define IRREPROCESS_DEFAULT_TA 25
+#define IRREPROCESS_DEFAULT_TU 25
+#define IRREPROCESS_DEFAULT_DIST 0.25
+#define IRREPROCESS_DEFAULT_HUM 0.5
+
+static uint16_t nuc_table_file[NUCT_LEN];
+static uint16_t correct_table_file[TEMP_CORRECT_TABLE_LEN];
+
+static int irreprocess_usage(const char* name)
+{
+    printf("usage: %s [-c calib_cache.bin] [-t tau.bin] [-e ems] [-a ta] [-u tu] [-d dist] [-H hum] " \
+        "[-p color_mode] [-r x,y,w,h]... [-l x0,y0,x1,y1]... [-s summary.csv] [-o video.mjpeg] [-q quality] " \
+        "[-j workers] recording\n", name);
+    return -1;
+}
+
+static int irreprocess_read(const char* path, void* dst, uint32_t size)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    size_t got = fread(dst, 1, size, fp);
+    fclose(fp);
+    return (got > 0) ? 0 : -1;
+}
+
+int main(int argc, char* argv[])
+{
+    static ReprocessParam_t param;
+    param.ems = IRREPROCESS_DEFAULT_EMS;
+    param.ta = IRREPROCESS_DEFAULT_TA;
+    param.tu = IRREPROCESS_DEFAULT_TU;
+    param.dist = IRREPROCESS_DEFAULT_DIST;
+    param.hum = IRREPROCESS_DEFAULT_HUM;
+    param.color_mode = PALETTE_DEFAULT_MODE;
+    const char* calib_path = NULL;
+    const char* tau_path = NULL;
+    int workers = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (argv[i][0] != '-')
+        {
+            param.input = argv[i];
+            continue;
+        }
+        if (value == NULL)
+        {
+            return irreprocess_usage(argv[0]);
+        }
+        i++;
+        if (strcmp(argv[i - 1], "-c") == 0)
+        {
+            calib_path = value;
+        }
+        else if (strcmp(argv[i - 1], "-t") == 0)
+        {
+            tau_path = value;
+        }
+        else if (strcmp(argv[i - 1], "-e") == 0)
+        {
+            param.ems = atof(value);
+        }
+        else if (strcmp(argv[i - 1], "-a") == 0)
+        {
+            param.ta = atof(value);
+        }
+        else if (strcmp(argv[i - 1], "-u") == 0)
+        {
+            param.tu = atof(value);
+        }
+        else if (strcmp(argv[i - 1], "-d") == 0)
+        {
+            param.dist = atof(value);
+        }
+        else if (strcmp(argv[i - 1], "-H") == 0)
+        {
+            param.hum = atof(value);
+        }
+        else if (strcmp(argv[i - 1], "-p") == 0)
+        {
+            param.color_mode = (irproc_color_mode_t)atoi(value);
+        }
+        else if (strcmp(argv[i - 1], "-q") == 0)
+        {
+            param.quality = atoi(value);
+        }
+        else if (strcmp(argv[i - 1], "-j") == 0)
+        {
+            workers = atoi(value);
+        }
+        else if (strcmp(argv[i - 1], "-s") == 0)
+        {
+            param.summary_path = value;
+        }
+        else if (strcmp(argv[i - 1], "-o") == 0)
+        {
+            param.video_path = value;
+        }
+        else if (strcmp(argv[i - 1], "-r") == 0 && param.rect_num < ROI_MAX_NUM)
+        {
+            Area_t* rect = &param.rects[param.rect_num];
+            if (sscanf(value, "%d,%d,%d,%d", &rect->start_x, &rect->start_y, &rect->width, &rect->height) != 4)
+            {
+                return irreprocess_usage(argv[0]);
+            }
+            param.rect_num++;
+        }
+        else if (strcmp(argv[i - 1], "-l") == 0 && param.line_num < ROI_MAX_NUM)
+        {
+            Line_t* line = &param.lines[param.line_num];
+            if (sscanf(value, "%d,%d,%d,%d", &line->start_x, &line->start_y, &line->end_x, &line->end_y) != 4)
+            {
+                return irreprocess_usage(argv[0]);
+            }
+            param.line_num++;
+        }
+        else
+        {
+            return irreprocess_usage(argv[0]);
+        }
+    }
+    if (param.input == NULL || (param.summary_path == NULL && param.video_path == NULL))
+    {
+        return irreprocess_usage(argv[0]);
+    }
+    irproc_log_register(IRPROC_LOG_NO_PRINT);
+    irtemp_log_register(IRTEMP_LOG_NO_PRINT);
+
+    if (calib_path != NULL)
+    {
+        uint32_t gain = HIGH_GAIN;
+        if (calib_file_table(calib_path, CALIB_SECTION_NUC_T, nuc_table_file, sizeof(nuc_table_file), &gain) != \
+            (int)sizeof(nuc_table_file))
+        {
+            printf("irreprocess: %s has no nuc-t table\n", calib_path);
+            return -1;
+        }
+        int tau_ok = (tau_path != NULL) ? \
+            (irreprocess_read(tau_path, correct_table_file, sizeof(correct_table_file)) == 0) : \
+            (calib_file_table(calib_path, (gain == HIGH_GAIN) ? CALIB_SECTION_TAU_H : CALIB_SECTION_TAU_L, \
+            correct_table_file, sizeof(correct_table_file), NULL) > 0);
+        if (!tau_ok)
+        {
+            printf("irreprocess: no tau table, give one with -t\n");
+            return -1;
+        }
+        param.nuc_table = nuc_table_file;
+        param.correct_table = correct_table_file;
+        param.nuc_gain = (uint8_t)gain;
+    }
+
+    pool_init(workers);
+    ReprocessStats_t stats;
+    int rst = reprocess_run(&param, &stats);
+    int worker_num = pool_worker_num();
+    pool_release();
+    double seconds = (stats.elapsed_us > 0) ? stats.elapsed_us / 1e6 : 1e-6;
+    printf("irreprocess: %llu frames in %llu chunks, %.2f s on %d workers, %.0f fps, %.1fx real time\n", \
+        (unsigned long long)stats.frames, (unsigned long long)stats.chunks, seconds, worker_num, \
+        stats.frames / seconds, stats.recorded_us / 1e6 / seconds);
+    printf("irreprocess: %llu corrected, %llu as recorded, %llu correction maps, %llu summary bytes, " \
+        "%llu video bytes\n", (unsigned long long)stats.corrected, (unsigned long long)stats.uncorrected, \
+        (unsigned long long)stats.map_builds, (unsigned long long)stats.summary_bytes, \
+        (unsigned long long)stats.video_bytes);
+    if (rst != REPROCESS_SUCCESS)
+    {
+        printf("irreprocess: failed %d\n", rst);
+        return 1;
+    }
+    return 0;
+}
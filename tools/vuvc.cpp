@@ -0,0 +1,1152 @@
+//virtual libiruvc: the libiruvc.h / thermal_cam_cmd.h functions the tree calls, over synthetic or replayed frames
+//instead of a module, for load tests of many cameras on a machine without them. it is built as libiruvc.so in
+//its own directory and the unchanged sample, bench or sdk find it before libs/ through LD_LIBRARY_PATH:
+//    VUVC_CAMERAS=16 LD_LIBRARY_PATH=_gate_build/vuvc:libs ./sample -i 3 -n 16
+//configured by the environment, read by uvc_camera_init:
+//    VUVC_CAMERAS        modules listed, 1
+//    VUVC_WIDTH/HEIGHT   sensor, 256x192. the stream list has WxH (one plane) and Wx2H (image and temp stacked)
+//    VUVC_FPS            25
+//    VUVC_REPLAY         raw file of whole frames of the opened stream, looped. synthetic scene without it
+//    VUVC_JITTER_US      a frame is captured up to this late, 0
+//    VUVC_DROP_PERMILLE  frames the module loses, 0
+//    VUVC_USB_MBPS       bus throughput at bandwidth factor 1 (MB/s), 40. a frame that would arrive a period late
+//                        is lost like on a saturated bus, 0 transfers take no time
+//    VUVC_CMD_US         latency of every vendor command, 2000
+//    VUVC_SPI_KBPS       flash read/write throughput, 1000
+//    VUVC_UNPLUG_AFTER   the module goes away after this many frames of a stream, 0 never
+//    VUVC_UNPLUG_MS      and is back after, 2000
+//    VUVC_SEED           scene, noise, jitter and drops, the module index is added
+//    VUVC_QUIET          no summary line at uvc_camera_close
+//one module per process like the vendor library, the current one is what uvc_camera_open/_same opened
+#include "libiruvc.h"
+#include "tempunit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define VUVC_VERSION "vuvc 1.0"
+#define VUVC_MAX_CAMERAS 64                 //what camera.cpp's device list holds
+#define VUVC_FLASH_SIZE 0x400000
+#define VUVC_NUCT_HIGH_ADDR 0xda000         //calib.cpp's nuc-t addresses, CALIB_NUC_T_BYTES each
+#define VUVC_NUCT_LOW_ADDR 0xd3000
+#define VUVC_NUCT_LEN 8192
+#define VUVC_KT_LEN 1201
+#define VUVC_PROP_NUM 64
+#define VUVC_BACKGROUND_C 25
+#define VUVC_BLOB_C 60
+#define VUVC_HIGH_GAIN 1                    //libirtemp.h's HIGH_GAIN
+
+typedef void* (*vuvc_callback_t)(void* frame, void* usr_param);
+
+typedef struct {
+    uint32_t cameras;
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;
+    const char* replay;
+    uint32_t jitter_us;
+    uint32_t drop_permille;
+    uint32_t usb_mbps;
+    uint32_t cmd_us;
+    uint32_t spi_kbps;
+    uint32_t unplug_after;
+    uint32_t unplug_ms;
+    uint32_t seed;
+    uint32_t quiet;
+}VuvcConfig_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t dropped;                       //VUVC_DROP_PERMILLE
+    uint64_t bus_lost;                      //the transfer would have ended a period late
+    uint64_t stale;                         //arrived and replaced by the next one before uvc_frame_get came
+    uint64_t timeouts;
+    uint64_t commands;
+}VuvcStats_t;
+
+typedef struct {
+    int streaming;
+    uint32_t width;                         //of the stream, the sensor's or stacked
+    uint32_t height;
+    uint32_t frame_size;
+    uint32_t timeout_ms;
+    uint64_t t0_us;
+    uint64_t period_us;
+    uint64_t transfer_us;
+    uint64_t next;                          //capture index of the next frame
+    uint64_t last_arrival_us;
+    uint64_t delivered;
+    FILE* replay_fp;
+    vuvc_callback_t callback;
+    void* callback_param;
+    pthread_t callback_thread;
+    volatile int callback_run;
+    void* callback_frame;
+}VuvcStream_t;
+
+static VuvcConfig_t vuvc_cfg;
+static VuvcStats_t vuvc_stats;
+static VuvcStream_t vuvc_stream;
+static pthread_mutex_t vuvc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int vuvc_ready;
+static int vuvc_opened = -1;                //module index
+static float vuvc_bandwidth = 1.0f;
+static uint32_t vuvc_poll_ms = 10000;
+static uint64_t vuvc_unplugged_until_us;
+static uint64_t vuvc_shutter_closed_us;     //shutter_manual_switch(SHUTTER_CLOSE) returned, 0 open
+static char vuvc_names[VUVC_MAX_CAMERAS][16];
+static uint16_t vuvc_tpd[VUVC_PROP_NUM];
+static uint16_t vuvc_image[VUVC_PROP_NUM];
+static uint16_t vuvc_shutter[VUVC_PROP_NUM];
+static uint16_t vuvc_kt[VUVC_KT_LEN];
+static int16_t vuvc_bt[VUVC_KT_LEN];
+static uint8_t* vuvc_flash;
+static uint16_t* vuvc_base;                 //the scene's temp plane without the blob
+static uint16_t* vuvc_last;                 //temp plane of the last frame, what the point temperatures read
+
+static uint64_t vuvc_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void vuvc_sleep_until(uint64_t us)
+{
+    struct timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+    {
+    }
+}
+
+static void vuvc_sleep_us(uint64_t us)
+{
+    if (us > 0)
+    {
+        vuvc_sleep_until(vuvc_now_us() + us);
+    }
+}
+
+//splitmix64, the same value for the same seed and frame on every run
+static uint64_t vuvc_hash(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static uint32_t vuvc_env(const char* name, uint32_t def)
+{
+    const char* value = getenv(name);
+    return (value != NULL && value[0] != 0) ? (uint32_t)strtoul(value, NULL, 0) : def;
+}
+
+//every vendor command costs the usb control transfer's time
+static void vuvc_command(uint32_t bytes)
+{
+    pthread_mutex_lock(&vuvc_mutex);
+    vuvc_stats.commands++;
+    pthread_mutex_unlock(&vuvc_mutex);
+    uint64_t us = vuvc_cfg.cmd_us;
+    if (bytes > 0 && vuvc_cfg.spi_kbps > 0)
+    {
+        us += (uint64_t)bytes * 1000 / vuvc_cfg.spi_kbps;
+    }
+    vuvc_sleep_us(us);
+}
+
+static int vuvc_unplugged(void)
+{
+    return vuvc_unplugged_until_us != 0 && vuvc_now_us() < vuvc_unplugged_until_us;
+}
+
+static void vuvc_props_default(int tpd, int image, int shutter)
+{
+    if (tpd)
+    {
+        memset(vuvc_tpd, 0, sizeof(vuvc_tpd));
+        vuvc_tpd[TPD_PROP_DISTANCE] = 64;           //0.25 m in 1/256 m
+        vuvc_tpd[TPD_PROP_TU] = 300;
+        vuvc_tpd[TPD_PROP_TA] = 300;
+        vuvc_tpd[TPD_PROP_EMS] = 128;
+        vuvc_tpd[TPD_PROP_TAU] = 128;
+        vuvc_tpd[TPD_PROP_GAIN_SEL] = VUVC_HIGH_GAIN;
+    }
+    if (image)
+    {
+        memset(vuvc_image, 0, sizeof(vuvc_image));
+        vuvc_image[IMAGE_PROP_LEVEL_TNR] = 2;
+        vuvc_image[IMAGE_PROP_LEVEL_SNR] = 1;
+        vuvc_image[IMAGE_PROP_LEVEL_DDE] = 3;
+        vuvc_image[IMAGE_PROP_LEVEL_BRIGHTNESS] = 50;
+        vuvc_image[IMAGE_PROP_LEVEL_CONTRAST] = 50;
+    }
+    if (shutter)
+    {
+        memset(vuvc_shutter, 0, sizeof(vuvc_shutter));
+        vuvc_shutter[SHUTTER_PROP_SWITCH] = 1;
+        vuvc_shutter[SHUTTER_PROP_MIN_INTERVAL] = 5;
+        vuvc_shutter[SHUTTER_PROP_MAX_INTERVAL] = 5;
+    }
+}
+
+static void vuvc_put16_be(uint8_t* dst, uint16_t value)
+{
+    dst[0] = (uint8_t)(value >> 8);
+    dst[1] = (uint8_t)value;
+}
+
+//monotonic nuc-t tables like the module's, high gain -54 .. 690 celsius as bench's, low gain up to about 1300.
+//the flash holds them byte swapped
+static void vuvc_flash_init(void)
+{
+    memset(vuvc_flash, 0xff, VUVC_FLASH_SIZE);
+    for (int i = 0; i < VUVC_NUCT_LEN; i++)
+    {
+        uint16_t high = (uint16_t)(3500 + 1.7 * i - 0.00003 * i * (double)i);
+        uint16_t low = (uint16_t)(3500 + 3.5 * i - 0.0001 * i * (double)i);
+        vuvc_put16_be(vuvc_flash + VUVC_NUCT_HIGH_ADDR + i * 2, high);
+        vuvc_put16_be(vuvc_flash + VUVC_NUCT_LOW_ADDR + i * 2, low);
+    }
+    for (int i = 0; i < VUVC_KT_LEN; i++)
+    {
+        vuvc_kt[i] = 10000;
+        vuvc_bt[i] = 0;
+    }
+}
+
+//a left to right gradient of a few kelvin around VUVC_BACKGROUND_C with fixed pattern noise
+static void vuvc_scene_init(int index)
+{
+    uint32_t w = vuvc_cfg.width, h = vuvc_cfg.height;
+    int background = TEMP_RAW_OF_CELSIUS(VUVC_BACKGROUND_C);
+    for (uint32_t y = 0; y < h; y++)
+    {
+        for (uint32_t x = 0; x < w; x++)
+        {
+            uint64_t r = vuvc_hash(((uint64_t)(vuvc_cfg.seed + index) << 40) ^ ((uint64_t)y << 20) ^ x);
+            int gradient = (int)(x * TEMP_RAW_OF_KELVIN_DELTA(4) / w) - TEMP_RAW_OF_KELVIN_DELTA(2);
+            int noise = (int)(r % 33) - 16;
+            vuvc_base[y * w + x] = (uint16_t)(background + gradient + noise);
+        }
+    }
+    memcpy(vuvc_last, vuvc_base, (size_t)w * h * sizeof(uint16_t));
+}
+
+//the temp plane of capture k: the background and a warm disc moving on a lissajous path
+static void vuvc_scene_frame(uint64_t k, uint16_t* temp)
+{
+    int w = (int)vuvc_cfg.width, h = (int)vuvc_cfg.height;
+    memcpy(temp, vuvc_base, (size_t)w * h * sizeof(uint16_t));
+    int radius = (h / 8 > 2) ? h / 8 : 2;
+    int phase = (int)(k % 360);
+    int cx = w / 2 + (int)((w / 2 - radius) * ((phase < 180) ? phase - 90 : 270 - phase) / 90);
+    int cy = h / 2 + (int)((h / 2 - radius) * (((phase * 2) % 360 < 180) ? (phase * 2) % 360 - 90 : \
+        270 - (phase * 2) % 360) / 90);
+    uint16_t blob = (uint16_t)TEMP_RAW_OF_CELSIUS(VUVC_BLOB_C);
+    for (int y = cy - radius; y <= cy + radius; y++)
+    {
+        if (y < 0 || y >= h)
+        {
+            continue;
+        }
+        for (int x = cx - radius; x <= cx + radius; x++)
+        {
+            if (x >= 0 && x < w && (x - cx) * (x - cx) + (y - cy) * (y - cy) <= radius * radius)
+            {
+                temp[y * w + x] = blob;
+            }
+        }
+    }
+}
+
+//capture k into the stream's frame: the planes it carries, or the next frame of the replay file. the closed
+//shutter fills the view with its own flat temperature
+static void vuvc_frame_fill(uint64_t k, uint8_t* dst, int closed)
+{
+    VuvcStream_t* stream = &vuvc_stream;
+    uint32_t plane = vuvc_cfg.width * vuvc_cfg.height;
+    if (closed)
+    {
+        uint16_t shutter = (uint16_t)TEMP_RAW_OF_CELSIUS(VUVC_BACKGROUND_C);
+        for (uint32_t i = 0; i < plane; i++)
+        {
+            vuvc_last[i] = shutter;
+        }
+        for (uint32_t offset = 0; offset + plane * 2 <= stream->frame_size; offset += plane * 2)
+        {
+            memcpy(dst + offset, vuvc_last, plane * sizeof(uint16_t));
+        }
+        return;
+    }
+    if (stream->replay_fp != NULL)
+    {
+        if (fread(dst, 1, stream->frame_size, stream->replay_fp) != stream->frame_size)
+        {
+            rewind(stream->replay_fp);
+            if (fread(dst, 1, stream->frame_size, stream->replay_fp) != stream->frame_size)
+            {
+                memset(dst, 0, stream->frame_size);
+            }
+        }
+        if (stream->frame_size >= plane * 4)
+        {
+            memcpy(vuvc_last, dst + plane * 2, plane * sizeof(uint16_t));
+        }
+        return;
+    }
+    vuvc_scene_frame(k, vuvc_last);
+    if (stream->frame_size >= plane * 4)
+    {
+        //the image half is the y16 of the same scene
+        memcpy(dst, vuvc_last, plane * sizeof(uint16_t));
+        memcpy(dst + plane * 2, vuvc_last, plane * sizeof(uint16_t));
+    }
+    else
+    {
+        uint32_t bytes = (stream->frame_size < plane * 2) ? stream->frame_size : plane * 2;
+        memcpy(dst, vuvc_last, bytes);
+    }
+}
+
+static void vuvc_stats_print(void)
+{
+    if (!vuvc_cfg.quiet)
+    {
+        printf("vuvc camera %d: %llu frames, %llu dropped, %llu lost on the bus, %llu stale, %llu timeouts, " \
+            "%llu commands\n", vuvc_opened, (unsigned long long)vuvc_stats.frames, \
+            (unsigned long long)vuvc_stats.dropped, (unsigned long long)vuvc_stats.bus_lost, \
+            (unsigned long long)vuvc_stats.stale, (unsigned long long)vuvc_stats.timeouts, \
+            (unsigned long long)vuvc_stats.commands);
+    }
+}
+
+char* libiruvc_version(void)
+{
+    return (char*)VUVC_VERSION;
+}
+
+const char* iruvc_version_number(void)
+{
+    return VUVC_VERSION;
+}
+
+char* product_type(void)
+{
+    return (char*)PRODUCT_TYPE;
+}
+
+void iruvc_log_register(iruvc_log_level_t log_level)
+{
+    (void)log_level;
+}
+
+iruvc_error_t uvc_camera_init(void)
+{
+    if (vuvc_ready)
+    {
+        return IRUVC_SUCCESS;
+    }
+    vuvc_cfg.cameras = vuvc_env("VUVC_CAMERAS", 1);
+    vuvc_cfg.cameras = (vuvc_cfg.cameras > VUVC_MAX_CAMERAS) ? VUVC_MAX_CAMERAS : vuvc_cfg.cameras;
+    vuvc_cfg.width = vuvc_env("VUVC_WIDTH", 256);
+    vuvc_cfg.height = vuvc_env("VUVC_HEIGHT", 192);
+    vuvc_cfg.fps = vuvc_env("VUVC_FPS", 25);
+    vuvc_cfg.replay = getenv("VUVC_REPLAY");
+    vuvc_cfg.jitter_us = vuvc_env("VUVC_JITTER_US", 0);
+    vuvc_cfg.drop_permille = vuvc_env("VUVC_DROP_PERMILLE", 0);
+    vuvc_cfg.usb_mbps = vuvc_env("VUVC_USB_MBPS", 40);
+    vuvc_cfg.cmd_us = vuvc_env("VUVC_CMD_US", 2000);
+    vuvc_cfg.spi_kbps = vuvc_env("VUVC_SPI_KBPS", 1000);
+    vuvc_cfg.unplug_after = vuvc_env("VUVC_UNPLUG_AFTER", 0);
+    vuvc_cfg.unplug_ms = vuvc_env("VUVC_UNPLUG_MS", 2000);
+    vuvc_cfg.seed = vuvc_env("VUVC_SEED", 1);
+    vuvc_cfg.quiet = vuvc_env("VUVC_QUIET", 0);
+    if (vuvc_cfg.width == 0 || vuvc_cfg.height == 0 || vuvc_cfg.fps == 0)
+    {
+        return IRUVC_UVC_INIT_FAIL;
+    }
+    size_t plane = (size_t)vuvc_cfg.width * vuvc_cfg.height * sizeof(uint16_t);
+    vuvc_flash = (uint8_t*)malloc(VUVC_FLASH_SIZE);
+    vuvc_base = (uint16_t*)malloc(plane);
+    vuvc_last = (uint16_t*)malloc(plane);
+    if (vuvc_flash == NULL || vuvc_base == NULL || vuvc_last == NULL)
+    {
+        free(vuvc_flash);
+        free(vuvc_base);
+        free(vuvc_last);
+        vuvc_flash = NULL;
+        vuvc_base = NULL;
+        vuvc_last = NULL;
+        return IRUVC_UVC_INIT_FAIL;
+    }
+    for (uint32_t i = 0; i < vuvc_cfg.cameras; i++)
+    {
+        snprintf(vuvc_names[i], sizeof(vuvc_names[i]), "vuvc-%u", i);
+    }
+    vuvc_flash_init();
+    vuvc_props_default(1, 1, 1);
+    vuvc_ready = 1;
+    return IRUVC_SUCCESS;
+}
+
+void uvc_camera_release(void)
+{
+    if (!vuvc_ready)
+    {
+        return;
+    }
+    free(vuvc_flash);
+    free(vuvc_base);
+    free(vuvc_last);
+    vuvc_flash = NULL;
+    vuvc_base = NULL;
+    vuvc_last = NULL;
+    vuvc_ready = 0;
+}
+
+//the unplugged module is missing from the list until it is back
+iruvc_error_t uvc_camera_list(DevCfg_t devs_cfg[])
+{
+    if (!vuvc_ready || devs_cfg == NULL)
+    {
+        return IRUVC_GET_DEVICE_LIST_FAIL;
+    }
+    if (vuvc_unplugged())
+    {
+        return IRUVC_SUCCESS;
+    }
+    for (uint32_t i = 0; i < vuvc_cfg.cameras; i++)
+    {
+        devs_cfg[i].vid = 0x0BDA;
+        devs_cfg[i].pid = 0x5840;
+        devs_cfg[i].name = vuvc_names[i];
+    }
+    return IRUVC_SUCCESS;
+}
+
+//format, size and fps of the sensor and of the two planes stacked, the list ends with a zero entry
+iruvc_error_t uvc_camera_info_get(DevCfg_t dev_cfg, CameraStreamInfo_t camera_stream_info[])
+{
+    (void)dev_cfg;
+    if (!vuvc_ready || camera_stream_info == NULL)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        memset(&camera_stream_info[i], 0, sizeof(CameraStreamInfo_t));
+        camera_stream_info[i].format = (char*)FORMAT_YUY2;
+        camera_stream_info[i].width = vuvc_cfg.width;
+        camera_stream_info[i].height = vuvc_cfg.height * (i + 1);
+        camera_stream_info[i].frame_size = camera_stream_info[i].width * camera_stream_info[i].height * 2;
+        camera_stream_info[i].fps[0] = vuvc_cfg.fps;
+    }
+    memset(&camera_stream_info[2], 0, sizeof(CameraStreamInfo_t));
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t uvc_camera_open_same(DevCfg_t dev_cfg, int same_dev_index)
+{
+    (void)dev_cfg;
+    if (!vuvc_ready || same_dev_index < 0 || same_dev_index >= (int)vuvc_cfg.cameras)
+    {
+        return IRUVC_FIND_DEVICE_FAIL;
+    }
+    if (vuvc_unplugged())
+    {
+        return IRUVC_FIND_DEVICE_FAIL;
+    }
+    pthread_mutex_lock(&vuvc_mutex);
+    if (vuvc_opened != same_dev_index)
+    {
+        vuvc_scene_init(same_dev_index);
+        vuvc_props_default(1, 1, 1);
+    }
+    vuvc_opened = same_dev_index;
+    vuvc_unplugged_until_us = 0;
+    pthread_mutex_unlock(&vuvc_mutex);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t uvc_camera_open(DevCfg_t dev_cfg)
+{
+    return uvc_camera_open_same(dev_cfg, 0);
+}
+
+void uvc_camera_close(void)
+{
+    if (vuvc_opened >= 0)
+    {
+        vuvc_stats_print();
+    }
+    memset(&vuvc_stats, 0, sizeof(vuvc_stats));
+}
+
+iruvc_error_t uvc_camera_set_bandwidth_factor(float factor)
+{
+    if (factor <= 0 || factor > 1)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    vuvc_bandwidth = factor;
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t uvc_camera_get_bandwidth_factor(float* factor)
+{
+    if (factor == NULL)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    *factor = vuvc_bandwidth;
+    return IRUVC_SUCCESS;
+}
+
+void* uvc_frame_buf_create(CameraParam_t camera_param)
+{
+    return calloc(1, camera_param.frame_size);
+}
+
+void uvc_frame_buf_release(void* frame_buf)
+{
+    free(frame_buf);
+}
+
+//the next frame: capture k at t0 + k * period plus its jitter, it arrives when the bus has moved it and the one
+//before. a frame the caller comes too late for is replaced by the next, like the vendor's single frame buffer
+iruvc_error_t uvc_frame_get(void* raw_data)
+{
+    VuvcStream_t* stream = &vuvc_stream;
+    if (raw_data == NULL || !stream->streaming)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    uint64_t now = vuvc_now_us();
+    if (vuvc_unplugged_until_us != 0)
+    {
+        vuvc_sleep_us((uint64_t)stream->timeout_ms * 1000);
+        vuvc_stats.timeouts++;
+        return IRUVC_GET_FRAME_OVER_TIME;
+    }
+    int closed = 0;
+    for (;;)
+    {
+        uint64_t k = stream->next;
+        uint64_t r = vuvc_hash(((uint64_t)(vuvc_cfg.seed + vuvc_opened) << 48) ^ k);
+        uint64_t capture = stream->t0_us + k * stream->period_us + \
+            ((vuvc_cfg.jitter_us > 0) ? (r >> 20) % (vuvc_cfg.jitter_us + 1) : 0);
+        uint64_t arrival = ((capture > stream->last_arrival_us) ? capture : stream->last_arrival_us) + \
+            stream->transfer_us;
+        if (arrival - capture > stream->period_us + stream->transfer_us)
+        {
+            vuvc_stats.bus_lost++;
+            stream->next++;
+            continue;
+        }
+        if (vuvc_cfg.drop_permille > 0 && r % 1000 < vuvc_cfg.drop_permille)
+        {
+            vuvc_stats.dropped++;
+            stream->next++;
+            continue;
+        }
+        if (arrival + stream->period_us < now)
+        {
+            vuvc_stats.stale++;
+            stream->last_arrival_us = arrival;
+            stream->next++;
+            continue;
+        }
+        if (arrival > now + (uint64_t)stream->timeout_ms * 1000)
+        {
+            vuvc_sleep_us((uint64_t)stream->timeout_ms * 1000);
+            vuvc_stats.timeouts++;
+            return IRUVC_GET_FRAME_OVER_TIME;
+        }
+        vuvc_sleep_until(arrival);
+        stream->last_arrival_us = arrival;
+        stream->next++;
+        pthread_mutex_lock(&vuvc_mutex);
+        closed = (vuvc_shutter_closed_us != 0 && capture >= vuvc_shutter_closed_us);
+        pthread_mutex_unlock(&vuvc_mutex);
+        break;
+    }
+    vuvc_frame_fill(stream->next - 1, (uint8_t*)raw_data, closed);
+    vuvc_stats.frames++;
+    stream->delivered++;
+    if (vuvc_cfg.unplug_after > 0 && stream->delivered >= vuvc_cfg.unplug_after)
+    {
+        vuvc_unplugged_until_us = vuvc_now_us() + (uint64_t)vuvc_cfg.unplug_ms * 1000;
+    }
+    return IRUVC_SUCCESS;
+}
+
+static void* vuvc_callback_thread(void* arg)
+{
+    VuvcStream_t* stream = (VuvcStream_t*)arg;
+    while (stream->callback_run)
+    {
+        if (uvc_frame_get(stream->callback_frame) == IRUVC_SUCCESS && stream->callback_run)
+        {
+            stream->callback(stream->callback_frame, stream->callback_param);
+        }
+    }
+    return NULL;
+}
+
+iruvc_error_t uvc_camera_stream_start(CameraParam_t camera_param, UserCallback_t* usr_callback)
+{
+    VuvcStream_t* stream = &vuvc_stream;
+    if (vuvc_opened < 0 || stream->streaming)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    if (camera_param.width != vuvc_cfg.width || (camera_param.height != vuvc_cfg.height && \
+        camera_param.height != vuvc_cfg.height * 2))
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    memset(stream, 0, sizeof(VuvcStream_t));
+    stream->width = camera_param.width;
+    stream->height = camera_param.height;
+    stream->frame_size = camera_param.width * camera_param.height * 2;
+    stream->timeout_ms = (camera_param.timeout_ms_delay > 0) ? camera_param.timeout_ms_delay : 1000;
+    stream->period_us = 1000000 / ((camera_param.fps > 0) ? camera_param.fps : vuvc_cfg.fps);
+    stream->transfer_us = (vuvc_cfg.usb_mbps > 0) ? \
+        (uint64_t)(stream->frame_size / (vuvc_cfg.usb_mbps * (double)vuvc_bandwidth)) : 0;
+    stream->t0_us = vuvc_now_us();
+    if (vuvc_cfg.replay != NULL)
+    {
+        stream->replay_fp = fopen(vuvc_cfg.replay, "rb");
+        if (stream->replay_fp == NULL)
+        {
+            printf("vuvc: can't open %s\n", vuvc_cfg.replay);
+            return IRUVC_ERROR_PARAM;
+        }
+    }
+    vuvc_command(0);
+    stream->streaming = 1;
+    if (usr_callback != NULL && usr_callback->usr_func != NULL)
+    {
+        stream->callback = (vuvc_callback_t)usr_callback->usr_func;
+        stream->callback_param = usr_callback->usr_param;
+        stream->callback_frame = malloc(stream->frame_size);
+        stream->callback_run = 1;
+        if (stream->callback_frame == NULL || \
+            pthread_create(&stream->callback_thread, NULL, vuvc_callback_thread, stream) != 0)
+        {
+            free(stream->callback_frame);
+            stream->callback_frame = NULL;
+            stream->callback_run = 0;
+            stream->streaming = 0;
+            return IRUVC_ERROR_PARAM;
+        }
+    }
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t uvc_camera_stream_close(cam_side_preview_ctl cam_preview)
+{
+    (void)cam_preview;
+    VuvcStream_t* stream = &vuvc_stream;
+    if (stream->callback_run)
+    {
+        stream->callback_run = 0;
+        pthread_join(stream->callback_thread, NULL);
+        free(stream->callback_frame);
+        stream->callback_frame = NULL;
+    }
+    if (stream->replay_fp != NULL)
+    {
+        fclose(stream->replay_fp);
+        stream->replay_fp = NULL;
+    }
+    stream->streaming = 0;
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t uvc_control_cmd(unsigned char request_type, unsigned char bRequest, unsigned short wValue, \
+    unsigned short wIndex, unsigned char* data, unsigned short wLength, unsigned int timeout)
+{
+    (void)request_type, (void)bRequest, (void)wValue, (void)wIndex, (void)timeout;
+    if (data != NULL && (request_type & 0x80))
+    {
+        memset(data, 0, wLength);
+    }
+    vuvc_command(0);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t register_i2c_device_node(const char* node_name)
+{
+    (void)node_name;
+    return IRUVC_SUCCESS;
+}
+
+int i2c_start_stream(uint8_t path, uint8_t src, uint16_t width, uint16_t height, uint8_t fps, uint8_t mode)
+{
+    (void)path, (void)src, (void)width, (void)height, (void)fps, (void)mode;
+    return IRUVC_SUCCESS;
+}
+
+int i2c_stop_stream(uint8_t path)
+{
+    (void)path;
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t vdcmd_init()
+{
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t vdcmd_init_by_type(enum vdcmd_driver_type type)
+{
+    (void)type;
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t vdcmd_set_polling_wait_time(uint32_t timeout_ms)
+{
+    vuvc_poll_ms = timeout_ms;
+    return IRUVC_SUCCESS;
+}
+
+//the pages of properties. a command to an unplugged module fails after the polling wait
+static iruvc_error_t vuvc_prop(uint16_t* page, int prop, uint16_t* get, uint16_t set)
+{
+    if (prop < 0 || prop >= VUVC_PROP_NUM)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    if (vuvc_unplugged())
+    {
+        vuvc_sleep_us((uint64_t)vuvc_poll_ms * 1000);
+        return IRUVC_GET_FRAME_OVER_TIME;
+    }
+    vuvc_command(0);
+    pthread_mutex_lock(&vuvc_mutex);
+    if (get != NULL)
+    {
+        *get = page[prop];
+    }
+    else
+    {
+        page[prop] = set;
+    }
+    pthread_mutex_unlock(&vuvc_mutex);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t set_prop_tpd_params(enum prop_tpd_params tpd_param, uint16_t value)
+{
+    return vuvc_prop(vuvc_tpd, (int)tpd_param, NULL, value);
+}
+
+iruvc_error_t get_prop_tpd_params(enum prop_tpd_params tpd_param, uint16_t* value)
+{
+    return (value == NULL) ? IRUVC_ERROR_PARAM : vuvc_prop(vuvc_tpd, (int)tpd_param, value, 0);
+}
+
+iruvc_error_t set_prop_image_params(enum prop_image_params image_param, uint16_t value)
+{
+    return vuvc_prop(vuvc_image, (int)image_param, NULL, value);
+}
+
+iruvc_error_t get_prop_image_params(enum prop_image_params image_param, uint16_t* value)
+{
+    return (value == NULL) ? IRUVC_ERROR_PARAM : vuvc_prop(vuvc_image, (int)image_param, value, 0);
+}
+
+iruvc_error_t set_prop_auto_shutter_params(enum prop_auto_shutter_params shutter_param, uint16_t value)
+{
+    return vuvc_prop(vuvc_shutter, (int)shutter_param, NULL, value);
+}
+
+iruvc_error_t get_prop_auto_shutter_params(enum prop_auto_shutter_params shutter_param, uint16_t* value)
+{
+    return (value == NULL) ? IRUVC_ERROR_PARAM : vuvc_prop(vuvc_shutter, (int)shutter_param, value, 0);
+}
+
+iruvc_error_t restore_default_cfg(enum prop_default_cfg default_cfg_type)
+{
+    vuvc_command(0);
+    pthread_mutex_lock(&vuvc_mutex);
+    int pages = (default_cfg_type == DEF_CFG_ALL || default_cfg_type == DEF_CFG_PROP_PAGE);
+    vuvc_props_default(pages || default_cfg_type == DEF_CFG_TPD, pages, pages);
+    pthread_mutex_unlock(&vuvc_mutex);
+    return IRUVC_SUCCESS;
+}
+
+static iruvc_error_t vuvc_array(void* dst, const void* src, uint32_t bytes)
+{
+    if (dst == NULL)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    vuvc_command(bytes);
+    pthread_mutex_lock(&vuvc_mutex);
+    memcpy(dst, src, bytes);
+    pthread_mutex_unlock(&vuvc_mutex);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t get_tpd_kt_array(uint8_t* data)
+{
+    return vuvc_array(data, vuvc_kt, sizeof(vuvc_kt));
+}
+
+iruvc_error_t set_tpd_kt_array(uint8_t* data)
+{
+    return (data == NULL) ? IRUVC_ERROR_PARAM : vuvc_array(vuvc_kt, data, sizeof(vuvc_kt));
+}
+
+iruvc_error_t get_tpd_bt_array(uint8_t* data)
+{
+    return vuvc_array(data, vuvc_bt, sizeof(vuvc_bt));
+}
+
+iruvc_error_t set_tpd_bt_array(uint8_t* data)
+{
+    return (data == NULL) ? IRUVC_ERROR_PARAM : vuvc_array(vuvc_bt, data, sizeof(vuvc_bt));
+}
+
+//the table of the selected gain, in the flash byte swapped and in host order here
+static iruvc_error_t vuvc_nuct(uint8_t* data, int write)
+{
+    if (data == NULL || vuvc_flash == NULL)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    vuvc_command(VUVC_NUCT_LEN * 2);
+    pthread_mutex_lock(&vuvc_mutex);
+    uint8_t* table = vuvc_flash + ((vuvc_tpd[TPD_PROP_GAIN_SEL] == VUVC_HIGH_GAIN) ? VUVC_NUCT_HIGH_ADDR : \
+        VUVC_NUCT_LOW_ADDR);
+    uint16_t* host = (uint16_t*)data;
+    for (int i = 0; i < VUVC_NUCT_LEN; i++)
+    {
+        if (write)
+        {
+            vuvc_put16_be(table + i * 2, host[i]);
+        }
+        else
+        {
+            host[i] = (uint16_t)(table[i * 2] << 8 | table[i * 2 + 1]);
+        }
+    }
+    pthread_mutex_unlock(&vuvc_mutex);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t get_tpd_nuc_t_array(uint8_t* data)
+{
+    return vuvc_nuct(data, 0);
+}
+
+iruvc_error_t set_tpd_nuc_t_array(uint8_t* data)
+{
+    return vuvc_nuct(data, 1);
+}
+
+iruvc_error_t set_tpd_nuc_t_array_to_ddr(uint8_t* data)
+{
+    return set_tpd_nuc_t_array(data);
+}
+
+iruvc_error_t get_tpd_calib_param(TempCalibParam_t* temp_calib_param)
+{
+    if (temp_calib_param == NULL)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    vuvc_command(0);
+    temp_calib_param->Ktemp = 10000;
+    temp_calib_param->Btemp = 0;
+    temp_calib_param->AddressCA = 0;
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t spi_read(uint32_t addr, uint16_t wlen, uint8_t* pbyData)
+{
+    if (pbyData == NULL || vuvc_flash == NULL || addr + wlen > VUVC_FLASH_SIZE)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    return vuvc_array(pbyData, vuvc_flash + addr, wlen);
+}
+
+iruvc_error_t spi_write(uint32_t addr, uint16_t wlen, uint8_t* pbyData)
+{
+    if (pbyData == NULL || vuvc_flash == NULL || addr + wlen > VUVC_FLASH_SIZE)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    return vuvc_array(vuvc_flash + addr, pbyData, wlen);
+}
+
+iruvc_error_t spi_erase_sector(uint32_t addr, uint16_t sector_cnt)
+{
+    uint32_t bytes = (uint32_t)sector_cnt * 0x1000;
+    if (vuvc_flash == NULL || (addr & 0xfff) != 0 || addr + bytes > VUVC_FLASH_SIZE)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    vuvc_command(0);
+    pthread_mutex_lock(&vuvc_mutex);
+    memset(vuvc_flash + addr, 0xff, bytes);
+    pthread_mutex_unlock(&vuvc_mutex);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t update_fw(uint8_t* data, int data_size)
+{
+    if (data == NULL || data_size <= 0)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    vuvc_command((uint32_t)data_size);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t get_device_info(enum device_id_types id_type, uint8_t* id_content)
+{
+    static const uint8_t lengths[] = { 8, 8, 8, 26, 4, 50, 48, 16, 10 };
+    if (id_content == NULL || (int)id_type < 0 || (int)id_type >= (int)sizeof(lengths))
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    vuvc_command(0);
+    memset(id_content, 0, lengths[id_type]);
+    if (id_type == DEV_INFO_GET_SN)
+    {
+        snprintf((char*)id_content, lengths[id_type], "VUVC%08u", (unsigned)(vuvc_cfg.seed + vuvc_opened));
+    }
+    else
+    {
+        snprintf((char*)id_content, lengths[id_type], "vuvc");
+    }
+    return IRUVC_SUCCESS;
+}
+
+//a serial number per module, calib.cpp's cache keeps one file per module
+iruvc_error_t get_sn(uint8_t* sn_content)
+{
+    return get_device_info(DEV_INFO_GET_SN, sn_content);
+}
+
+static iruvc_error_t vuvc_vtemp(uint16_t* vtemp, uint16_t value)
+{
+    if (vtemp == NULL)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    vuvc_command(0);
+    *vtemp = value;
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t cur_vtemp_get(uint16_t* cur_vtemp)
+{
+    return vuvc_vtemp(cur_vtemp, 5300);
+}
+
+iruvc_error_t shutter_vtemp_get(uint16_t* cur_vtemp)
+{
+    return vuvc_vtemp(cur_vtemp, 5280);
+}
+
+iruvc_error_t lens_vtemp_get(uint16_t* cur_vtemp)
+{
+    return vuvc_vtemp(cur_vtemp, 5260);
+}
+
+iruvc_error_t shutter_sta_get(uint8_t* shutter_en_sta, uint8_t* shutter_sta)
+{
+    if (shutter_en_sta == NULL || shutter_sta == NULL)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    vuvc_command(0);
+    *shutter_en_sta = (uint8_t)(vuvc_shutter[SHUTTER_PROP_SWITCH] != 0);
+    *shutter_sta = (uint8_t)(vuvc_shutter_closed_us == 0);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t shutter_sta_set(enum shutter_sta_types sta_type)
+{
+    (void)sta_type;
+    vuvc_command(0);
+    return IRUVC_SUCCESS;
+}
+
+//frames captured from the command's return on show the closed shutter
+iruvc_error_t shutter_manual_switch(enum shutter_manual_types manual_type)
+{
+    vuvc_command(0);
+    pthread_mutex_lock(&vuvc_mutex);
+    vuvc_shutter_closed_us = (manual_type == SHUTTER_CLOSE) ? vuvc_now_us() : 0;
+    pthread_mutex_unlock(&vuvc_mutex);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t ooc_b_update(enum ooc_b_update_types update_type)
+{
+    (void)update_type;
+    vuvc_command(0);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t dpc_auto_calibration(uint16_t wait_time)
+{
+    (void)wait_time;
+    vuvc_command(0);
+    return IRUVC_SUCCESS;
+}
+
+//the synthetic scene's image and temp planes are the same, the temperature preview changes nothing in the frames
+iruvc_error_t y16_preview_start(enum preview_path path, enum y16_isp_stream_src_types src_type)
+{
+    (void)path, (void)src_type;
+    vuvc_command(0);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t y16_preview_stop(enum preview_path path)
+{
+    (void)path;
+    vuvc_command(0);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t zoom_center_up(enum preview_path path, enum zoom_scale_step scale_step)
+{
+    (void)path, (void)scale_step;
+    vuvc_command(0);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t zoom_center_down(enum preview_path path, enum zoom_scale_step scale_step)
+{
+    (void)path, (void)scale_step;
+    vuvc_command(0);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t zoom_position_up(enum preview_path path, enum zoom_scale_step scale_step, IruvcPoint_t position)
+{
+    (void)path, (void)scale_step, (void)position;
+    vuvc_command(0);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t zoom_position_down(enum preview_path path, enum zoom_scale_step scale_step, IruvcPoint_t position)
+{
+    (void)path, (void)scale_step, (void)position;
+    vuvc_command(0);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t pseudo_color_set(enum preview_path path, enum pseudo_color_types color_type)
+{
+    (void)path, (void)color_type;
+    vuvc_command(0);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t switch_fps(uint8_t flag)
+{
+    (void)flag;
+    vuvc_command(0);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t set_vospi_y8_mode(uint8_t enable)
+{
+    (void)enable;
+    vuvc_command(0);
+    return IRUVC_SUCCESS;
+}
+
+//the firmware's point and area temperatures come from the last frame, in kelvin * 16. points start from 1
+static uint16_t vuvc_fw_temp(uint32_t x, uint32_t y)
+{
+    return (uint16_t)(vuvc_last[y * vuvc_cfg.width + x] >> (TEMP_RAW_SHIFT - TEMP_FW_SHIFT));
+}
+
+iruvc_error_t tpd_get_point_temp_info(IruvcPoint_t point_pos, uint16_t* point_temp_value)
+{
+    if (point_temp_value == NULL || vuvc_last == NULL || point_pos.x < 1 || point_pos.y < 1 || \
+        point_pos.x > vuvc_cfg.width || point_pos.y > vuvc_cfg.height)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    vuvc_command(0);
+    *point_temp_value = vuvc_fw_temp(point_pos.x - 1, point_pos.y - 1);
+    return IRUVC_SUCCESS;
+}
+
+iruvc_error_t tpd_get_rect_temp_info(IruvcRect_t rect_pos, TpdLineRectTempInfo_t* rect_temp_info)
+{
+    IruvcPoint_t start = rect_pos.start_point, end = rect_pos.end_point;
+    if (rect_temp_info == NULL || vuvc_last == NULL || start.x < 1 || start.y < 1 || start.x > end.x || \
+        start.y > end.y || end.x > vuvc_cfg.width || end.y > vuvc_cfg.height)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    vuvc_command(0);
+    uint64_t sum = 0;
+    uint16_t max_temp = 0, min_temp = 0xffff;
+    for (uint32_t y = start.y - 1; y < end.y; y++)
+    {
+        for (uint32_t x = start.x - 1; x < end.x; x++)
+        {
+            uint16_t temp = vuvc_fw_temp(x, y);
+            sum += temp;
+            if (temp > max_temp)
+            {
+                max_temp = temp;
+                rect_temp_info->max_temp_point.x = (uint16_t)(x + 1);
+                rect_temp_info->max_temp_point.y = (uint16_t)(y + 1);
+            }
+            if (temp < min_temp)
+            {
+                min_temp = temp;
+                rect_temp_info->min_temp_point.x = (uint16_t)(x + 1);
+                rect_temp_info->min_temp_point.y = (uint16_t)(y + 1);
+            }
+        }
+    }
+    uint32_t num = (uint32_t)(end.x - start.x + 1) * (end.y - start.y + 1);
+    rect_temp_info->temp_info_value.ave_temp = (uint16_t)(sum / num);
+    rect_temp_info->temp_info_value.max_temp = max_temp;
+    rect_temp_info->temp_info_value.min_temp = min_temp;
+    return IRUVC_SUCCESS;
+}
+
+static iruvc_error_t vuvc_frame_extreme(uint16_t* temp, int max)
+{
+    if (temp == NULL || vuvc_last == NULL)
+    {
+        return IRUVC_ERROR_PARAM;
+    }
+    IruvcRect_t whole = { { 1, 1 }, { (uint16_t)vuvc_cfg.width, (uint16_t)vuvc_cfg.height } };
+    TpdLineRectTempInfo_t info;
+    iruvc_error_t rst = tpd_get_rect_temp_info(whole, &info);
+    *temp = max ? info.temp_info_value.max_temp : info.temp_info_value.min_temp;
+    return rst;
+}
+
+iruvc_error_t tpd_get_max_temp(uint16_t* max_temp)
+{
+    return vuvc_frame_extreme(max_temp, 1);
+}
+
+iruvc_error_t tpd_get_min_temp(uint16_t* min_temp)
+{
+    return vuvc_frame_extreme(min_temp, 0);
+}
@@ -0,0 +1,169 @@
+#include "trace.h"
+#include "data.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_BUFFER_MASK (TRACE_BUFFER_EVENTS - 1)
+#define TRACE_CACHE_LINE 64
+
+//one thread's events, pos is written by the thread only and read by trace_dump
+typedef struct alignas(TRACE_CACHE_LINE) {
+    std::atomic<TraceEvent_t*> events;  //set once by the owning thread
+    std::atomic<uint64_t> pos;          //events written, the newest TRACE_BUFFER_EVENTS are kept
+    char name[TRACE_THREAD_NAME_LEN];
+}TraceBuffer_t;
+
+std::atomic<int> trace_active(0);
+
+static TraceBuffer_t trace_buffers[TRACE_MAX_THREADS];
+static std::atomic<int> trace_buffer_num(0);
+static std::atomic<uint64_t> trace_unbuffered(0);  //events of threads past TRACE_MAX_THREADS
+static thread_local TraceBuffer_t* trace_buffer = NULL;
+static thread_local uint8_t trace_buffer_failed = 0;
+
+static const char* trace_phase_names[] = { "B", "E", "i", "C" };
+
+static TraceBuffer_t* trace_buffer_get(void)
+{
+    if (trace_buffer != NULL || trace_buffer_failed)
+    {
+        return trace_buffer;
+    }
+    int index = trace_buffer_num.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent_t* events = (index < TRACE_MAX_THREADS) ? \
+        (TraceEvent_t*)malloc(TRACE_BUFFER_EVENTS * sizeof(TraceEvent_t)) : NULL;
+    if (events == NULL)
+    {
+        trace_buffer_failed = 1;
+        return NULL;
+    }
+    TraceBuffer_t* buffer = &trace_buffers[index];
+    if (buffer->name[0] == '\0')
+    {
+        snprintf(buffer->name, TRACE_THREAD_NAME_LEN, "thread %d", index + 1);
+    }
+    //trace_dump sees the buffer once events is set
+    buffer->events.store(events, std::memory_order_release);
+    trace_buffer = buffer;
+    return buffer;
+}
+
+void trace_record(const char* name, TracePhase_t phase, int64_t value)
+{
+    TraceBuffer_t* buffer = trace_buffer_get();
+    if (buffer == NULL)
+    {
+        trace_unbuffered.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    uint64_t pos = buffer->pos.load(std::memory_order_relaxed);
+    TraceEvent_t* event = &buffer->events.load(std::memory_order_relaxed)[pos & TRACE_BUFFER_MASK];
+    event->timestamp_us = get_monotonic_us();
+    event->name = name;
+    event->value = value;
+    event->phase = phase;
+    buffer->pos.store(pos + 1, std::memory_order_release);
+}
+
+void trace_thread_name(const char* name)
+{
+    if (name == NULL)
+    {
+        return;
+    }
+    TraceBuffer_t* buffer = trace_buffer_get();
+    if (buffer != NULL)
+    {
+        snprintf(buffer->name, TRACE_THREAD_NAME_LEN, "%s", name);
+    }
+}
+
+void trace_start(void)
+{
+    trace_active.store(1, std::memory_order_relaxed);
+}
+
+void trace_stop(void)
+{
+    trace_active.store(0, std::memory_order_relaxed);
+}
+
+int trace_dump(const char* path)
+{
+    if (path == NULL)
+    {
+        return TRACE_ERROR_PARAM;
+    }
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        return TRACE_ERROR_FILE;
+    }
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"ir camera\"}}");
+    int buffer_num = trace_buffer_num.load(std::memory_order_relaxed);
+    buffer_num = (buffer_num < TRACE_MAX_THREADS) ? buffer_num : TRACE_MAX_THREADS;
+    for (int i = 0; i < buffer_num; i++)
+    {
+        TraceBuffer_t* buffer = &trace_buffers[i];
+        TraceEvent_t* events = buffer->events.load(std::memory_order_acquire);
+        if (events == NULL)
+        {
+            continue;
+        }
+        int tid = i + 1;
+        fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", \
+            tid, buffer->name);
+        uint64_t pos = buffer->pos.load(std::memory_order_acquire);
+        uint64_t start = (pos > TRACE_BUFFER_EVENTS) ? pos - TRACE_BUFFER_EVENTS : 0;
+        for (uint64_t n = start; n < pos; n++)
+        {
+            const TraceEvent_t* event = &events[n & TRACE_BUFFER_MASK];
+            const char* phase = trace_phase_names[event->phase];
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%llu,\"pid\":1,\"tid\":%d", event->name, phase, \
+                (unsigned long long)event->timestamp_us, tid);
+            if (event->phase == TRACE_PHASE_INSTANT)
+            {
+                fprintf(fp, ",\"s\":\"t\"");
+            }
+            if (event->phase == TRACE_PHASE_COUNTER)
+            {
+                fprintf(fp, ",\"args\":{\"%s\":%lld}}", event->name, (long long)event->value);
+            }
+            else if (event->phase != TRACE_PHASE_END)
+            {
+                fprintf(fp, ",\"args\":{\"value\":%lld}}", (long long)event->value);
+            }
+            else
+            {
+                fprintf(fp, "}");
+            }
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    int failed = ferror(fp);
+    fclose(fp);
+    return failed ? TRACE_ERROR_FILE : TRACE_SUCCESS;
+}
+
+void trace_counts(uint64_t* events, uint64_t* lost)
+{
+    uint64_t written = 0, dropped = trace_unbuffered.load(std::memory_order_relaxed);
+    int buffer_num = trace_buffer_num.load(std::memory_order_relaxed);
+    buffer_num = (buffer_num < TRACE_MAX_THREADS) ? buffer_num : TRACE_MAX_THREADS;
+    for (int i = 0; i < buffer_num; i++)
+    {
+        uint64_t pos = trace_buffers[i].pos.load(std::memory_order_relaxed);
+        written += pos;
+        dropped += (pos > TRACE_BUFFER_EVENTS) ? pos - TRACE_BUFFER_EVENTS : 0;
+    }
+    if (events != NULL)
+    {
+        *events = written + trace_unbuffered.load(std::memory_order_relaxed);
+    }
+    if (lost != NULL)
+    {
+        *lost = dropped;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <atomic>
+
+#define TRACE_MAX_THREADS 64
+#define TRACE_BUFFER_EVENTS 65536       //per thread, a power of two: the newest ones are kept, 2 MiB
+#define TRACE_THREAD_NAME_LEN 32
+
+#define TRACE_SUCCESS 0
+#define TRACE_ERROR_PARAM -1
+#define TRACE_ERROR_FILE -2
+
+typedef enum
+{
+    TRACE_PHASE_BEGIN = 0,              //"B", ends at the thread's next TRACE_PHASE_END
+    TRACE_PHASE_END,                    //"E"
+    TRACE_PHASE_INSTANT,                //"i", thread scoped
+    TRACE_PHASE_COUNTER,                //"C", a track of its own per name
+}TracePhase_t;
+
+//32 bytes, name is a string literal and never copied
+typedef struct {
+    uint64_t timestamp_us;              //get_monotonic_us
+    const char* name;
+    int64_t value;                      //args.value of the event
+    uint32_t phase;                     //TracePhase_t
+    uint32_t reserved;
+}TraceEvent_t;
+
+//tested by every trace point before anything else
+extern std::atomic<int> trace_active;
+
+//build with TRACE_EVENTS (cmake -DTRACE_EVENTS=ON) to compile the trace points in. they cost one branch on
+//trace_active until trace_start, nothing at all without TRACE_EVENTS
+#if defined(TRACE_EVENTS)
+#define TRACE_EVENT(name, phase, value) do { \
+        if (trace_active.load(std::memory_order_relaxed)) trace_record(name, phase, value); \
+    } while (0)
+#define TRACE_THREAD_NAME(name) trace_thread_name(name)
+#else
+#define TRACE_EVENT(name, phase, value) do { } while (0)
+#define TRACE_THREAD_NAME(name) do { } while (0)
+#endif
+#define TRACE_BEGIN(name) TRACE_EVENT(name, TRACE_PHASE_BEGIN, 0)
+#define TRACE_BEGIN_VALUE(name, value) TRACE_EVENT(name, TRACE_PHASE_BEGIN, (int64_t)(value))
+#define TRACE_END(name) TRACE_EVENT(name, TRACE_PHASE_END, 0)
+#define TRACE_INSTANT(name, value) TRACE_EVENT(name, TRACE_PHASE_INSTANT, (int64_t)(value))
+#define TRACE_COUNTER(name, value) TRACE_EVENT(name, TRACE_PHASE_COUNTER, (int64_t)(value))
+
+//append to the calling thread's buffer, lock free: each thread writes only its own. the first event of a
+//thread allocates its buffer, threads past TRACE_MAX_THREADS are not traced
+void trace_record(const char* name, TracePhase_t phase, int64_t value);
+
+//name the calling thread's track, before its first event or later
+void trace_thread_name(const char* name);
+
+//start/stop recording, the buffers are kept across stops
+void trace_start(void);
+void trace_stop(void);
+
+//write every buffered event as chrome trace event json (chrome://tracing, ui.perfetto.dev).
+//stop first: while recording the oldest events of a wrapping buffer may be overwritten as they are read
+int trace_dump(const char* path);
+
+//events written and events lost to wrapping or to the thread limit since the process started
+void trace_counts(uint64_t* events, uint64_t* lost);
+
+#endif
@@ -0,0 +1,358 @@
+#include "tracker.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#define TRACKER_INIT_VELOCITY_VAR 100.0f        //p11 of a new track, its velocity is unknown
+#define TRACKER_SIZE_SHIFT 2                     //the box size follows 1/4 of each new blob
+
+int tracker_init(Tracker_t* tracker, const TrackerParam_t* param)
+{
+    if (tracker == NULL || param == NULL || param->min_iou < 0.0f || param->max_distance < 0.0f || \
+        param->measure_noise <= 0.0f || param->process_noise < 0.0f)
+    {
+        return TRACKER_ERROR_PARAM;
+    }
+    memset(tracker, 0, sizeof(Tracker_t));
+    tracker->param = *param;
+    if (tracker->param.confirm_hits == 0)
+    {
+        tracker->param.confirm_hits = 1;
+    }
+    return TRACKER_SUCCESS;
+}
+
+void tracker_reset(Tracker_t* tracker)
+{
+    if (tracker != NULL)
+    {
+        tracker->track_num = 0;
+    }
+}
+
+//constant velocity, one frame per step: x += v, P = F P F' + q [1/4 1/2; 1/2 1]
+static void tracker_predict(TrackerTrack_t* track, float q)
+{
+    track->x += track->vx;
+    track->y += track->vy;
+    track->p00 += 2.0f * track->p01 + track->p11 + 0.25f * q;
+    track->p01 += track->p11 + 0.5f * q;
+    track->p11 += q;
+}
+
+static void tracker_correct(TrackerTrack_t* track, const SegmentBlob_t* blob, float r)
+{
+    float s = track->p00 + r;
+    float k0 = track->p00 / s;
+    float k1 = track->p01 / s;
+    float ex = (float)blob->cx - track->x;
+    float ey = (float)blob->cy - track->y;
+    track->x += k0 * ex;
+    track->y += k0 * ey;
+    track->vx += k1 * ex;
+    track->vy += k1 * ey;
+    track->p11 -= k1 * track->p01;
+    track->p00 *= 1.0f - k0;
+    track->p01 *= 1.0f - k0;
+    track->w += ((float)(blob->x1 - blob->x0 + 1) - track->w) / (1 << TRACKER_SIZE_SHIFT);
+    track->h += ((float)(blob->y1 - blob->y0 + 1) - track->h) / (1 << TRACKER_SIZE_SHIFT);
+}
+
+//iou of the blob's box with the predicted box around (x, y), or minus the distance over max_distance when only
+//the centroid gate passes. returns 0 when neither gate passes
+static int tracker_score(const Tracker_t* tracker, const TrackerTrack_t* track, const SegmentBlob_t* blob, float* score)
+{
+    float px0 = track->x - 0.5f * track->w, px1 = track->x + 0.5f * track->w;
+    float py0 = track->y - 0.5f * track->h, py1 = track->y + 0.5f * track->h;
+    float bx0 = (float)blob->x0 - 0.5f, bx1 = (float)blob->x1 + 0.5f;
+    float by0 = (float)blob->y0 - 0.5f, by1 = (float)blob->y1 + 0.5f;
+    float iw = ((px1 < bx1) ? px1 : bx1) - ((px0 > bx0) ? px0 : bx0);
+    float ih = ((py1 < by1) ? py1 : by1) - ((py0 > by0) ? py0 : by0);
+    if (iw > 0.0f && ih > 0.0f)
+    {
+        float inter = iw * ih;
+        float iou = inter / (track->w * track->h + (bx1 - bx0) * (by1 - by0) - inter);
+        if (iou >= tracker->param.min_iou && iou > 0.0f)
+        {
+            *score = iou;
+            return 1;
+        }
+    }
+    float max_distance = tracker->param.max_distance;
+    float dx = (float)blob->cx - track->x, dy = (float)blob->cy - track->y;
+    float dist2 = dx * dx + dy * dy;
+    if (max_distance > 0.0f && dist2 <= max_distance * max_distance)
+    {
+        //below every overlap, nearer first. the sqrt is only taken for the gated pairs
+        *score = -sqrtf(dist2) / max_distance - 1e-6f;
+        return 1;
+    }
+    return 0;
+}
+
+static int tracker_pair_compare(const void* a, const void* b)
+{
+    float sa = ((const TrackerPair_t*)a)->score, sb = ((const TrackerPair_t*)b)->score;
+    return (sa < sb) ? 1 : ((sa > sb) ? -1 : 0);
+}
+
+//the best TRACKER_CANDIDATES gated blobs of every track, then the pairs in score order, each track and blob once.
+//greedy instead of hungarian: the gates keep the pairs few and local, where both pick the same matches
+static void tracker_match(Tracker_t* tracker, const SegmentBlob_t* blobs, int blob_num, int16_t* match)
+{
+    int pair_num = 0;
+    for (int t = 0; t < tracker->track_num; t++)
+    {
+        TrackerPair_t* best = &tracker->pairs[pair_num];
+        int best_num = 0;
+        for (int b = 0; b < blob_num; b++)
+        {
+            float score;
+            if (!tracker_score(tracker, &tracker->tracks[t], &blobs[b], &score))
+            {
+                continue;
+            }
+            if (best_num == TRACKER_CANDIDATES && score <= best[best_num - 1].score)
+            {
+                continue;
+            }
+            //insertion into the few kept, best first
+            int i = (best_num < TRACKER_CANDIDATES) ? best_num++ : best_num - 1;
+            while (i > 0 && best[i - 1].score < score)
+            {
+                best[i] = best[i - 1];
+                i--;
+            }
+            best[i].track = (uint16_t)t;
+            best[i].blob = (uint16_t)b;
+            best[i].score = score;
+        }
+        pair_num += best_num;
+        match[t] = -1;
+    }
+    qsort(tracker->pairs, pair_num, sizeof(TrackerPair_t), tracker_pair_compare);
+    for (int i = 0; i < pair_num; i++)
+    {
+        const TrackerPair_t* pair = &tracker->pairs[i];
+        if (match[pair->track] < 0 && !tracker->blob_used[pair->blob])
+        {
+            match[pair->track] = (int16_t)pair->blob;
+            tracker->blob_used[pair->blob] = 1;
+        }
+    }
+}
+
+static void tracker_birth(Tracker_t* tracker, const SegmentBlob_t* blob, uint64_t timestamp_us)
+{
+    if (tracker->track_num >= TRACKER_MAX_TRACKS)
+    {
+        tracker->stats.dropped_blobs++;
+        return;
+    }
+    TrackerTrack_t* track = &tracker->tracks[tracker->track_num++];
+    memset(track, 0, sizeof(TrackerTrack_t));
+    track->id = tracker->next_id++;
+    track->state = (tracker->param.confirm_hits <= 1) ? TRACKER_CONFIRMED : TRACKER_TENTATIVE;
+    track->matched = 1;
+    track->hits = 1;
+    track->first_us = track->last_us = timestamp_us;
+    track->x = (float)blob->cx;
+    track->y = (float)blob->cy;
+    track->p00 = tracker->param.measure_noise;
+    track->p11 = TRACKER_INIT_VELOCITY_VAR;
+    track->w = (float)(blob->x1 - blob->x0 + 1);
+    track->h = (float)(blob->y1 - blob->y0 + 1);
+    track->blob = *blob;
+    tracker->stats.tracks++;
+    tracker->stats.confirmed += (track->state == TRACKER_CONFIRMED);
+}
+
+int tracker_update(Tracker_t* tracker, const SegmentBlob_t* blobs, int blob_num, uint64_t timestamp_us)
+{
+    if (tracker == NULL || blob_num < 0 || (blob_num > 0 && blobs == NULL))
+    {
+        return TRACKER_ERROR_PARAM;
+    }
+    const TrackerParam_t* param = &tracker->param;
+    if (blob_num > TRACKER_MAX_BLOBS)
+    {
+        tracker->stats.dropped_blobs += blob_num - TRACKER_MAX_BLOBS;
+        blob_num = TRACKER_MAX_BLOBS;
+    }
+    for (int t = 0; t < tracker->track_num; t++)
+    {
+        tracker_predict(&tracker->tracks[t], param->process_noise);
+    }
+    memset(tracker->blob_used, 0, blob_num);
+    int16_t match[TRACKER_MAX_TRACKS];
+    tracker_match(tracker, blobs, blob_num, match);
+
+    //update or age every track, the ended ones are squeezed out in place
+    int live = 0;
+    for (int t = 0; t < tracker->track_num; t++)
+    {
+        TrackerTrack_t* track = &tracker->tracks[t];
+        track->dwell_alarm = 0;
+        if (match[t] >= 0)
+        {
+            const SegmentBlob_t* blob = &blobs[match[t]];
+            tracker_correct(track, blob, param->measure_noise);
+            track->blob = *blob;
+            track->matched = 1;
+            track->hits++;
+            track->misses = 0;
+            track->last_us = timestamp_us;
+            if (track->state == TRACKER_TENTATIVE && track->hits >= param->confirm_hits)
+            {
+                track->state = TRACKER_CONFIRMED;
+                tracker->stats.confirmed++;
+            }
+            if (track->state == TRACKER_CONFIRMED && param->dwell_us > 0 && !track->dwell_raised && \
+                track->last_us - track->first_us >= param->dwell_us)
+            {
+                track->dwell_raised = 1;
+                track->dwell_alarm = 1;
+                tracker->stats.dwell_alarms++;
+            }
+        }
+        else
+        {
+            track->matched = 0;
+            track->misses++;
+            if (track->state == TRACKER_TENTATIVE || track->misses > param->max_misses)
+            {
+                tracker->stats.ended++;
+                continue;
+            }
+        }
+        if (live != t)
+        {
+            tracker->tracks[live] = *track;
+        }
+        live++;
+    }
+    tracker->track_num = live;
+
+    for (int b = 0; b < blob_num; b++)
+    {
+        if (!tracker->blob_used[b])
+        {
+            tracker_birth(tracker, &blobs[b], timestamp_us);
+        }
+    }
+    tracker->stats.frames++;
+    return tracker->track_num;
+}
+
+static void tracker_engine_task(FrameSlot_t* slot, void* arg)
+{
+    TrackerEngine_t* engine = (TrackerEngine_t*)arg;
+    pthread_mutex_lock(&engine->mutex);
+    //a frame without good temperatures is skipped, the tracks coast on the next one
+    if (engine->running && slot->desc.temp.data != NULL && !(slot->desc.flags & FRAME_DESC_TEMP_INVALID))
+    {
+        int blob_num = segment_process(&engine->segment, (uint16_t*)slot->desc.temp.data, &engine->segment_param);
+        if (blob_num >= 0)
+        {
+            int track_num = tracker_update(&engine->tracker, engine->segment.blobs, blob_num, slot->desc.timestamp_us);
+            if (engine->func != NULL)
+            {
+                engine->func(engine->tracker.tracks, track_num, slot->seq, engine->arg);
+            }
+        }
+    }
+    pthread_mutex_unlock(&engine->mutex);
+}
+
+int tracker_engine_attach(TrackerEngine_t* engine, StreamFrameInfo_t* stream_frame_info)
+{
+    if (engine == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL || \
+        stream_frame_info->temp_byte_size == 0)
+    {
+        return TRACKER_ERROR_PARAM;
+    }
+    memset(engine, 0, sizeof(TrackerEngine_t));
+    engine->consumer_id = -1;
+    TempDataRes_t temp_res = { (uint16_t)stream_frame_info->temp_info.width, (uint16_t)stream_frame_info->temp_info.height };
+    int ret = segment_init(&engine->segment, temp_res);
+    if (ret != SEGMENT_SUCCESS)
+    {
+        return (ret == SEGMENT_ERROR_MEM) ? TRACKER_ERROR_MEM : TRACKER_ERROR_PARAM;
+    }
+    pthread_mutex_init(&engine->mutex, NULL);
+    engine->stream_frame_info = stream_frame_info;
+    //the prediction steps one frame per update, the engine takes every frame in order
+    engine->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, \
+        POOL_STAGE_TEMPERATURE, tracker_engine_task, engine);
+    if (engine->consumer_id < 0)
+    {
+        tracker_engine_release(engine);
+        return TRACKER_ERROR_PARAM;
+    }
+    return TRACKER_SUCCESS;
+}
+
+int tracker_engine_start(TrackerEngine_t* engine, const SegmentParam_t* segment_param, const TrackerParam_t* param, \
+    TrackerFunc_t func, void* arg)
+{
+    if (engine == NULL || engine->segment.mask == NULL || segment_param == NULL || \
+        segment_param->low_temp > segment_param->high_temp)
+    {
+        return TRACKER_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&engine->mutex);
+    int ret = tracker_init(&engine->tracker, param);
+    if (ret == TRACKER_SUCCESS)
+    {
+        engine->segment_param = *segment_param;
+        engine->func = func;
+        engine->arg = arg;
+        engine->running = 1;
+    }
+    pthread_mutex_unlock(&engine->mutex);
+    return ret;
+}
+
+int tracker_engine_stop(TrackerEngine_t* engine)
+{
+    if (engine == NULL)
+    {
+        return TRACKER_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&engine->mutex);
+    if (engine->running)
+    {
+        engine->running = 0;
+        const TrackerStats_t* stats = &engine->tracker.stats;
+        printf("tracker: %llu frames, %llu tracks, %llu confirmed, %llu ended, %llu dwell alarms, %llu dropped\n", \
+            (unsigned long long)stats->frames, (unsigned long long)stats->tracks, \
+            (unsigned long long)stats->confirmed, (unsigned long long)stats->ended, \
+            (unsigned long long)stats->dwell_alarms, (unsigned long long)stats->dropped_blobs);
+    }
+    pthread_mutex_unlock(&engine->mutex);
+    return TRACKER_SUCCESS;
+}
+
+void tracker_engine_release(TrackerEngine_t* engine)
+{
+    if (engine == NULL || engine->segment.mask == NULL)
+    {
+        return;
+    }
+    segment_release(&engine->segment);
+    pthread_mutex_destroy(&engine->mutex);
+    memset(engine, 0, sizeof(TrackerEngine_t));
+}
+
+int tracker_engine_stats(TrackerEngine_t* engine, TrackerStats_t* stats)
+{
+    if (engine == NULL || stats == NULL)
+    {
+        return TRACKER_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&engine->mutex);
+    *stats = engine->tracker.stats;
+    pthread_mutex_unlock(&engine->mutex);
+    return TRACKER_SUCCESS;
+}
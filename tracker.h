@@ -0,0 +1,120 @@
+#ifndef _TRACKER_H_
+#define _TRACKER_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+#include "segment.h"
+
+#define TRACKER_MAX_TRACKS 256
+#define TRACKER_MAX_BLOBS SEGMENT_MAX_BLOBS     //blobs per update, the rest are dropped
+#define TRACKER_CANDIDATES 4                    //best gated blobs kept per track for the matcher
+
+#define TRACKER_SUCCESS 0
+#define TRACKER_ERROR_PARAM -1
+#define TRACKER_ERROR_MEM -2
+
+typedef enum
+{
+    TRACKER_TENTATIVE = 0,              //fewer than confirm_hits hits, a single miss ends it
+    TRACKER_CONFIRMED,
+}TrackerState_t;
+
+typedef struct {
+    float min_iou;                      //gate on the overlap with the predicted box
+    float max_distance;                 //or on the centroid distance in pixels when the boxes do not overlap enough
+    uint16_t confirm_hits;              //hits before a track is confirmed and gets counted, 0 selects 1
+    uint16_t max_misses;                //frames a confirmed track is predicted without a blob before it ends
+    float process_noise;                //kalman q: acceleration variance, pixels^2 per frame^4
+    float measure_noise;                //kalman r: centroid variance, pixels^2
+    uint64_t dwell_us;                  //a confirmed track present that long raises dwell_alarm once, 0 never
+}TrackerParam_t;
+
+typedef struct {
+    uint16_t id;
+    uint8_t state;                      //TrackerState_t
+    uint8_t matched;                    //a blob was assigned on the last update, else the box is the prediction
+    uint8_t dwell_alarm;                //dwell_us was passed on the last update
+    uint8_t dwell_raised;
+    uint32_t hits;
+    uint32_t misses;                    //consecutive
+    uint64_t first_us;                  //timestamp of the first blob, dwell = last_us - first_us
+    uint64_t last_us;                   //timestamp of the last matched blob
+    float x;                            //kalman centroid and velocity (pixels per frame), one covariance for both axes
+    float y;
+    float vx;
+    float vy;
+    float p00;
+    float p01;
+    float p11;
+    float w;                            //smoothed box size
+    float h;
+    SegmentBlob_t blob;                 //the last matched blob
+}TrackerTrack_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t tracks;                    //started
+    uint64_t confirmed;                 //people/objects counted
+    uint64_t ended;
+    uint64_t dwell_alarms;
+    uint64_t dropped_blobs;             //over TRACKER_MAX_BLOBS, or no free track
+}TrackerStats_t;
+
+typedef struct {
+    uint16_t track;
+    uint16_t blob;
+    float score;                        //iou, or minus the centroid distance over max_distance
+}TrackerPair_t;
+
+//multi object tracker over blob lists: constant velocity kalman prediction of every track, gated iou/centroid
+//scores against the new blobs, a greedy matcher over the best pairs, then update, birth and death.
+//fixed capacity, an update allocates nothing
+typedef struct {
+    TrackerParam_t param;
+    TrackerTrack_t tracks[TRACKER_MAX_TRACKS];  //the live tracks, 0..track_num, in birth order
+    int track_num;
+    uint16_t next_id;
+    TrackerPair_t pairs[TRACKER_MAX_TRACKS * TRACKER_CANDIDATES];
+    uint8_t blob_used[TRACKER_MAX_BLOBS];
+    TrackerStats_t stats;
+}Tracker_t;
+
+int tracker_init(Tracker_t* tracker, const TrackerParam_t* param);
+
+//drop every track, the ids go on
+void tracker_reset(Tracker_t* tracker);
+
+//one frame of blobs, returns the number of live tracks in tracker->tracks
+int tracker_update(Tracker_t* tracker, const SegmentBlob_t* blobs, int blob_num, uint64_t timestamp_us);
+
+//called from the ring task with the live tracks after each frame
+typedef void (*TrackerFunc_t)(const TrackerTrack_t* tracks, int track_num, uint64_t seq, void* arg);
+
+//segment + tracker as a task consumer of the frame ring, in the temperature (analytics) stage
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    SegmentParam_t segment_param;
+    TrackerFunc_t func;
+    void* arg;
+    int consumer_id;
+    uint8_t running;
+    Segment_t segment;
+    Tracker_t tracker;
+    pthread_mutex_t mutex;
+}TrackerEngine_t;
+
+//register the engine as a task consumer of the camera's frame ring, before streaming
+int tracker_engine_attach(TrackerEngine_t* engine, StreamFrameInfo_t* stream_frame_info);
+
+//the blob ranges and the tracking rules, the tracks start empty
+int tracker_engine_start(TrackerEngine_t* engine, const SegmentParam_t* segment_param, const TrackerParam_t* param, \
+    TrackerFunc_t func, void* arg);
+
+int tracker_engine_stop(TrackerEngine_t* engine);
+
+void tracker_engine_release(TrackerEngine_t* engine);
+
+int tracker_engine_stats(TrackerEngine_t* engine, TrackerStats_t* stats);
+
+#endif
@@ -0,0 +1,185 @@
+#include "transform.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TRANSFORM_TILE 32           //tile edge for the 90 degree cases
+
+//source pixel of the output pixel (x,y): undo the rotation, then undo the mirror/flip
+static long transform_src_index(int x, int y, int width, int height, RotateSide_t rotate_side, \
+	MirrorFlipStatus_t mirror_flip_status)
+{
+	int xm = x, ym = y;
+	switch (rotate_side)
+	{
+	case LEFT_90D:
+		xm = width - 1 - y;
+		ym = x;
+		break;
+	case RIGHT_90D:
+		xm = y;
+		ym = height - 1 - x;
+		break;
+	case ROTATE_180D:
+		xm = width - 1 - x;
+		ym = height - 1 - y;
+		break;
+	case NO_ROTATE:
+	default:
+		break;
+	}
+	if (mirror_flip_status == STATUS_ONLY_MIRROR || mirror_flip_status == STATUS_MIRROR_FLIP)
+	{
+		xm = width - 1 - xm;
+	}
+	if (mirror_flip_status == STATUS_ONLY_FLIP || mirror_flip_status == STATUS_MIRROR_FLIP)
+	{
+		ym = height - 1 - ym;
+	}
+	return (long)ym * width + xm;
+}
+
+//every combination is affine in the output coordinates, so three samples give the whole mapping
+static void transform_map_get(int width, int height, RotateSide_t rotate_side, \
+	MirrorFlipStatus_t mirror_flip_status, TransformMap_t* map)
+{
+	if (rotate_side == LEFT_90D || rotate_side == RIGHT_90D)
+	{
+		map->out_width = height;
+		map->out_height = width;
+	}
+	else
+	{
+		map->out_width = width;
+		map->out_height = height;
+	}
+	map->base = transform_src_index(0, 0, width, height, rotate_side, mirror_flip_status);
+	map->step_x = transform_src_index(1, 0, width, height, rotate_side, mirror_flip_status) - map->base;
+	map->step_y = transform_src_index(0, 1, width, height, rotate_side, mirror_flip_status) - map->base;
+}
+
+template <int PIXEL_BYTES>
+struct TransformPixel_t {
+	uint8_t byte[PIXEL_BYTES];
+};
+
+template <int PIXEL_BYTES>
+static void transform_rows(const uint8_t* src, const TransformMap_t* map, int x0, int x1, int y0, int y1, uint8_t* dst)
+{
+	typedef TransformPixel_t<PIXEL_BYTES> Pixel_t;
+	const Pixel_t* src_pixel = (const Pixel_t*)src;
+	Pixel_t* dst_pixel = (Pixel_t*)dst;
+	for (int y = y0; y < y1; y++)
+	{
+		long index = map->base + (long)y * map->step_y + (long)x0 * map->step_x;
+		Pixel_t* d = dst_pixel + (long)y * map->out_width + x0;
+		for (int x = x0; x < x1; x++)
+		{
+			*d++ = src_pixel[index];
+			index += map->step_x;
+		}
+	}
+}
+
+template <int PIXEL_BYTES>
+static void transform_pixels(const uint8_t* src, const TransformMap_t* map, int y0, int y1, uint8_t* dst)
+{
+	if (map->step_x == 1 || map->step_x == -1)
+	{
+		//rows stay rows, both sides are read and written sequentially
+		transform_rows<PIXEL_BYTES>(src, map, 0, map->out_width, y0, y1, dst);
+		return;
+	}
+
+	//90 degree: output rows walk source columns, tiles keep both sides in cache
+	for (int ty = y0; ty < y1; ty += TRANSFORM_TILE)
+	{
+		int ty1 = (ty + TRANSFORM_TILE < y1) ? ty + TRANSFORM_TILE : y1;
+		for (int tx = 0; tx < map->out_width; tx += TRANSFORM_TILE)
+		{
+			int x1 = (tx + TRANSFORM_TILE < map->out_width) ? tx + TRANSFORM_TILE : map->out_width;
+			transform_rows<PIXEL_BYTES>(src, map, tx, x1, ty, ty1, dst);
+		}
+	}
+}
+
+//yuyv: Y per pixel, U/V per pixel pair. each output pair takes its two source pixels' Y and their chroma
+static void transform_yuv422(const uint8_t* src, const TransformMap_t* map, int y0, int y1, uint8_t* dst)
+{
+	for (int y = y0; y < y1; y++)
+	{
+		uint8_t* d = dst + (long)y * map->out_width * 2;
+		for (int x = 0; x + 1 < map->out_width; x += 2)
+		{
+			long p0 = map->base + (long)y * map->step_y + (long)x * map->step_x;
+			long p1 = p0 + map->step_x;
+			const uint8_t* pair0 = src + (p0 & ~1L) * 2;
+			const uint8_t* pair1 = src + (p1 & ~1L) * 2;
+			d[0] = src[p0 * 2];
+			d[2] = src[p1 * 2];
+			d[1] = (uint8_t)((pair0[1] + pair1[1] + 1) >> 1);
+			d[3] = (uint8_t)((pair0[3] + pair1[3] + 1) >> 1);
+			d += 4;
+		}
+	}
+}
+
+void frame_transform_map_get(int width, int height, RotateSide_t rotate_side, \
+	MirrorFlipStatus_t mirror_flip_status, TransformMap_t* map)
+{
+	transform_map_get(width, height, rotate_side, mirror_flip_status, map);
+}
+
+int frame_transform_rows(uint8_t* src, FrameInfo_t* frame_info, RotateSide_t rotate_side, \
+	MirrorFlipStatus_t mirror_flip_status, int y0, int y1, uint8_t* dst)
+{
+	if (src == NULL || frame_info == NULL || dst == NULL || src == dst)
+	{
+		return TRANSFORM_ERROR_PARAM;
+	}
+
+	TransformMap_t map;
+	transform_map_get(frame_info->width, frame_info->height, rotate_side, mirror_flip_status, &map);
+	if (y0 < 0) y0 = 0;
+	if (y1 > map.out_height) y1 = map.out_height;
+	if (y0 >= y1)
+	{
+		return TRANSFORM_SUCCESS;
+	}
+
+	switch (frame_info->output_format)
+	{
+	case OUTPUT_FMT_Y14:
+		transform_pixels<2>(src, &map, y0, y1, dst);
+		break;
+	case OUTPUT_FMT_YUV422:
+		if (map.out_width % 2 != 0)
+		{
+			return TRANSFORM_ERROR_FORMAT;
+		}
+		transform_yuv422(src, &map, y0, y1, dst);
+		break;
+	case OUTPUT_FMT_YUV444:
+	case OUTPUT_FMT_RGB888:
+	case OUTPUT_FMT_BGR888:
+		transform_pixels<3>(src, &map, y0, y1, dst);
+		break;
+	case OUTPUT_FMT_BGRA32:
+	case OUTPUT_FMT_RGBA32:
+		transform_pixels<4>(src, &map, y0, y1, dst);
+		break;
+	default:
+		return TRANSFORM_ERROR_FORMAT;
+	}
+	return TRANSFORM_SUCCESS;
+}
+
+int frame_transform(uint8_t* src, FrameInfo_t* frame_info, RotateSide_t rotate_side, \
+	MirrorFlipStatus_t mirror_flip_status, uint8_t* dst)
+{
+	if (frame_info == NULL)
+	{
+		return TRANSFORM_ERROR_PARAM;
+	}
+	int out_height = (rotate_side == LEFT_90D || rotate_side == RIGHT_90D) ? frame_info->width : frame_info->height;
+	return frame_transform_rows(src, frame_info, rotate_side, mirror_flip_status, 0, out_height, dst);
+}
@@ -0,0 +1,34 @@
+#ifndef _TRANSFORM_H_
+#define _TRANSFORM_H_
+
+#include <stdint.h>
+#include "data.h"
+
+#define TRANSFORM_SUCCESS 0
+#define TRANSFORM_ERROR_PARAM -1
+#define TRANSFORM_ERROR_FORMAT -2
+
+//output pixel (x,y) of a transform reads source pixel base + x * step_x + y * step_y
+typedef struct {
+    int out_width;
+    int out_height;
+    long base;                      //source pixel index of output (0,0)
+    long step_x;                    //source index step for output x+1
+    long step_y;                    //source index step for output y+1
+}TransformMap_t;
+
+//mirror/flip first, then rotate, in one pass. every output pixel is written once, src and dst must not overlap
+//frame_info gives the source width/height and output_format, 90 degree rotations swap the output width/height
+//yuv422 is handled per pixel pair: mirror/flip/180 keep the chroma, 90 degree rotations average the pair's chroma
+int frame_transform(uint8_t* src, FrameInfo_t* frame_info, RotateSide_t rotate_side, \
+    MirrorFlipStatus_t mirror_flip_status, uint8_t* dst);
+
+//the affine source mapping of frame_transform, for backends that gather the pixels themselves
+void frame_transform_map_get(int width, int height, RotateSide_t rotate_side, \
+    MirrorFlipStatus_t mirror_flip_status, TransformMap_t* map);
+
+//output rows [y0, y1) of frame_transform only, bands of one frame can run on different threads
+int frame_transform_rows(uint8_t* src, FrameInfo_t* frame_info, RotateSide_t rotate_side, \
+    MirrorFlipStatus_t mirror_flip_status, int y0, int y1, uint8_t* dst);
+
+#endif
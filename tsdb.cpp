@@ -0,0 +1,900 @@
+#include "tsdb.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flash.h"
+#include "stab.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if !defined(_WIN32)
+#include <dirent.h>
+#endif
+
+#define TSDB_TIMESTAMP_WORST_BITS 68    //'1111' + 64 bits
+#define TSDB_VALUE_WORST_BITS 44        //'11' + 5 + 5 + 32 bits
+#define TSDB_BLOCK_MAX_SIZE (sizeof(TsdbBlockHeader_t) + TSDB_COLUMNS * TSDB_COLUMN_BYTES)
+
+static const char* tsdb_tier_names[TSDB_TIERS] = { "raw", "1s", "1m", "1h" };
+static const uint64_t tsdb_bucket_us[TSDB_TIERS] = { 0, 1000000ull, 60000000ull, 3600000000ull };
+static const uint64_t tsdb_segment_s[TSDB_TIERS] = { 3600, 86400, 7 * 86400, 28 * 86400 };
+
+//x != 0
+static inline int tsdb_clz(uint32_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, x);
+    return 31 - (int)index;
+#else
+    return __builtin_clz(x);
+#endif
+}
+
+static inline int tsdb_ctz(uint32_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return (int)index;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+static inline uint32_t tsdb_float_bits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline float tsdb_bits_float(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void tsdb_segment_name(char* name, size_t size, const char* path, int tier, uint64_t segment)
+{
+    snprintf(name, size, "%s.%s.%llu", path, tsdb_tier_names[tier], \
+        (unsigned long long)(segment * tsdb_segment_s[tier]));
+}
+
+//msb first into a zeroed column
+static void tsdb_bits_put(uint8_t* column, uint32_t* pos, uint64_t value, int num)
+{
+    for (int i = num - 1; i >= 0; i--)
+    {
+        if ((value >> i) & 1)
+        {
+            column[*pos >> 3] |= (uint8_t)(0x80 >> (*pos & 7));
+        }
+        (*pos)++;
+    }
+}
+
+typedef struct {
+    const uint8_t* data;
+    uint32_t bits;
+    uint32_t pos;
+    int error;                          //read past the column
+}TsdbBitReader_t;
+
+static uint64_t tsdb_bits_get(TsdbBitReader_t* reader, int num)
+{
+    if (reader->pos + num > reader->bits)
+    {
+        reader->error = 1;
+        return 0;
+    }
+    uint64_t value = 0;
+    for (int i = 0; i < num; i++)
+    {
+        value = (value << 1) | ((reader->data[reader->pos >> 3] >> (7 - (reader->pos & 7))) & 1);
+        reader->pos++;
+    }
+    return value;
+}
+
+static void tsdb_series_reset(TsdbSeries_t* series)
+{
+    memset(series, 0, sizeof(TsdbSeries_t));
+    memset(series->leading, 0xff, sizeof(series->leading));
+}
+
+static void tsdb_timestamp_put(TsdbSeries_t* series, uint64_t timestamp_us)
+{
+    int64_t delta = (int64_t)(timestamp_us - series->last_us);
+    int64_t dod = delta - series->delta;
+    uint64_t zigzag = ((uint64_t)dod << 1) ^ (uint64_t)(dod >> 63);
+    uint8_t* column = series->columns[0];
+    uint32_t* pos = &series->bits[0];
+    if (zigzag == 0)
+    {
+        tsdb_bits_put(column, pos, 0, 1);
+    }
+    else if (zigzag < (1u << 10))
+    {
+        tsdb_bits_put(column, pos, 0x2, 2);
+        tsdb_bits_put(column, pos, zigzag, 10);
+    }
+    else if (zigzag < (1u << 14))
+    {
+        tsdb_bits_put(column, pos, 0x6, 3);
+        tsdb_bits_put(column, pos, zigzag, 14);
+    }
+    else if (zigzag < (1u << 20))
+    {
+        tsdb_bits_put(column, pos, 0xe, 4);
+        tsdb_bits_put(column, pos, zigzag, 20);
+    }
+    else
+    {
+        tsdb_bits_put(column, pos, 0xf, 4);
+        tsdb_bits_put(column, pos, zigzag, 64);
+    }
+    series->delta = delta;
+}
+
+//value v of min/max/avr into column v + 1
+static void tsdb_value_put(TsdbSeries_t* series, int v, float value)
+{
+    uint8_t* column = series->columns[v + 1];
+    uint32_t* pos = &series->bits[v + 1];
+    uint32_t bits = tsdb_float_bits(value);
+    uint32_t x = bits ^ series->value[v];
+    series->value[v] = bits;
+    if (series->point_num == 0)
+    {
+        tsdb_bits_put(column, pos, bits, 32);
+        return;
+    }
+    if (x == 0)
+    {
+        tsdb_bits_put(column, pos, 0, 1);
+        return;
+    }
+    int leading = tsdb_clz(x);
+    int trailing = tsdb_ctz(x);
+    if (series->leading[v] != 0xff && leading >= series->leading[v] && trailing >= series->trailing[v])
+    {
+        //inside the previous window
+        tsdb_bits_put(column, pos, 0x2, 2);
+        tsdb_bits_put(column, pos, x >> series->trailing[v], 32 - series->leading[v] - series->trailing[v]);
+        return;
+    }
+    int length = 32 - leading - trailing;
+    tsdb_bits_put(column, pos, 0x3, 2);
+    tsdb_bits_put(column, pos, (uint64_t)leading, 5);
+    tsdb_bits_put(column, pos, (uint64_t)(length - 1), 5);
+    tsdb_bits_put(column, pos, x >> trailing, length);
+    series->leading[v] = (uint8_t)leading;
+    series->trailing[v] = (uint8_t)trailing;
+}
+
+//the lock is held by the caller. the block goes behind the others waiting for the writer, the series starts over
+static void tsdb_series_seal(Tsdb_t* tsdb, int tier, int roi)
+{
+    TsdbSeries_t* series = &tsdb->series[roi * TSDB_TIERS + tier];
+    if (series->point_num == 0)
+    {
+        return;
+    }
+    uint32_t size = sizeof(TsdbBlockHeader_t);
+    for (int c = 0; c < TSDB_COLUMNS; c++)
+    {
+        size += (series->bits[c] + 7) >> 3;
+    }
+    if (tsdb->fill_used + size > TSDB_WRITE_BYTES)
+    {
+        tsdb->stats.dropped++;
+        tsdb_series_reset(series);
+        return;
+    }
+    TsdbBlockHeader_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = TSDB_BLOCK_MAGIC;
+    header.version = TSDB_VERSION;
+    header.tier = (uint8_t)tier;
+    header.roi = (uint8_t)roi;
+    header.point_num = series->point_num;
+    header.size = size;
+    header.first_us = series->first_us;
+    header.last_us = series->last_us;
+    uint8_t* block = tsdb->fill_buffer + tsdb->fill_used;
+    uint32_t offset = sizeof(TsdbBlockHeader_t);
+    for (int c = 0; c < TSDB_COLUMNS; c++)
+    {
+        header.column_bytes[c] = (uint16_t)((series->bits[c] + 7) >> 3);
+        memcpy(block + offset, series->columns[c], header.column_bytes[c]);
+        offset += header.column_bytes[c];
+    }
+    header.crc = flash_crc32(0, block + sizeof(TsdbBlockHeader_t), size - sizeof(TsdbBlockHeader_t));
+    memcpy(block, &header, sizeof(header));
+    tsdb->fill_used += size;
+    tsdb_series_reset(series);
+    pthread_cond_broadcast(&tsdb->cond);
+}
+
+//the lock is held by the caller
+static void tsdb_point_put(Tsdb_t* tsdb, int tier, int roi, const TsdbPoint_t* point)
+{
+    TsdbSeries_t* series = &tsdb->series[roi * TSDB_TIERS + tier];
+    if (series->point_num > 0 && \
+        (series->bits[0] + TSDB_TIMESTAMP_WORST_BITS > TSDB_COLUMN_BYTES * 8 || \
+        series->bits[1] + TSDB_VALUE_WORST_BITS > TSDB_COLUMN_BYTES * 8 || \
+        series->bits[2] + TSDB_VALUE_WORST_BITS > TSDB_COLUMN_BYTES * 8 || \
+        series->bits[3] + TSDB_VALUE_WORST_BITS > TSDB_COLUMN_BYTES * 8))
+    {
+        tsdb_series_seal(tsdb, tier, roi);
+    }
+    if (series->point_num == 0)
+    {
+        series->first_us = point->timestamp_us;
+        series->last_us = point->timestamp_us;
+    }
+    else
+    {
+        tsdb_timestamp_put(series, point->timestamp_us);
+    }
+    tsdb_value_put(series, 0, point->min_temp);
+    tsdb_value_put(series, 1, point->max_temp);
+    tsdb_value_put(series, 2, point->avr_temp);
+    series->last_us = point->timestamp_us;
+    series->point_num++;
+    tsdb->stats.points++;
+}
+
+//the lock is held by the caller. the bucket a rollup tier accumulated becomes its point
+static void tsdb_rollup_flush(Tsdb_t* tsdb, int tier, int roi)
+{
+    TsdbRollup_t* rollup = &tsdb->rollups[tier][roi];
+    if (rollup->count == 0)
+    {
+        return;
+    }
+    TsdbPoint_t point;
+    point.timestamp_us = rollup->bucket * tsdb_bucket_us[tier];
+    point.min_temp = rollup->min_temp;
+    point.max_temp = rollup->max_temp;
+    point.avr_temp = (float)(rollup->avr_sum / rollup->count);
+    tsdb_point_put(tsdb, tier, roi, &point);
+    rollup->count = 0;
+}
+
+//the lock is held by the caller
+static void tsdb_append(Tsdb_t* tsdb, int roi, const TsdbPoint_t* point)
+{
+    tsdb_point_put(tsdb, TSDB_TIER_RAW, roi, point);
+    for (int tier = TSDB_TIER_SECOND; tier < TSDB_TIERS; tier++)
+    {
+        TsdbRollup_t* rollup = &tsdb->rollups[tier][roi];
+        uint64_t bucket = point->timestamp_us / tsdb_bucket_us[tier];
+        if (rollup->count > 0 && bucket != rollup->bucket)
+        {
+            tsdb_rollup_flush(tsdb, tier, roi);
+        }
+        if (rollup->count == 0)
+        {
+            rollup->bucket = bucket;
+            rollup->min_temp = point->min_temp;
+            rollup->max_temp = point->max_temp;
+            rollup->avr_sum = 0.0;
+        }
+        rollup->min_temp = (point->min_temp < rollup->min_temp) ? point->min_temp : rollup->min_temp;
+        rollup->max_temp = (point->max_temp > rollup->max_temp) ? point->max_temp : rollup->max_temp;
+        rollup->avr_sum += point->avr_temp;
+        rollup->count++;
+    }
+}
+
+static void tsdb_task(FrameSlot_t* slot, void* arg)
+{
+    Tsdb_t* tsdb = (Tsdb_t*)arg;
+    pthread_mutex_lock(&tsdb->mutex);
+    if (!tsdb->running || slot->desc.temp.data == NULL || (tsdb->frame_cnt++ % tsdb->param.interval) != 0)
+    {
+        pthread_mutex_unlock(&tsdb->mutex);
+        return;
+    }
+    RoiEngine_t* engine = &tsdb->roi_engine;
+    uint64_t now_us = (uint64_t)((int64_t)slot->desc.timestamp_us + tsdb->wall_offset_us);
+    stab_roi_follow(engine, &slot->desc);
+    if (engine->roi_num > 0 && roi_engine_process_tiles(engine, (uint16_t*)slot->desc.temp.data, \
+        slot->desc.temp_tiles, tsdb->roi_info) == ROI_SUCCESS)
+    {
+        for (int i = 0; i < engine->roi_num; i++)
+        {
+            TsdbPoint_t point;
+            point.timestamp_us = now_us;
+            point.min_temp = tsdb->roi_info[i].min_temp;
+            point.max_temp = tsdb->roi_info[i].max_temp;
+            point.avr_temp = tsdb->roi_info[i].avr_temp;
+            tsdb_append(tsdb, i, &point);
+        }
+        tsdb->stats.frames++;
+    }
+    //seal by age, so the slow tiers reach the disk too
+    uint64_t seal_us = (uint64_t)tsdb->param.seal_s * 1000000ull;
+    for (int roi = 0; roi < engine->roi_num; roi++)
+    {
+        for (int tier = 0; tier < TSDB_TIERS; tier++)
+        {
+            TsdbSeries_t* series = &tsdb->series[roi * TSDB_TIERS + tier];
+            if (series->point_num > 0 && now_us >= series->first_us + seal_us)
+            {
+                tsdb_series_seal(tsdb, tier, roi);
+            }
+        }
+    }
+    pthread_mutex_unlock(&tsdb->mutex);
+}
+
+int tsdb_attach(Tsdb_t* tsdb, StreamFrameInfo_t* stream_frame_info)
+{
+    if (tsdb == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL || \
+        stream_frame_info->temp_byte_size == 0)
+    {
+        return TSDB_ERROR_PARAM;
+    }
+    memset(tsdb, 0, sizeof(Tsdb_t));
+    tsdb->stream_frame_info = stream_frame_info;
+    TempDataRes_t temp_res = { (uint16_t)stream_frame_info->temp_info.width, (uint16_t)stream_frame_info->temp_info.height };
+    if (roi_engine_init(&tsdb->roi_engine, temp_res) != ROI_SUCCESS)
+    {
+        return TSDB_ERROR_PARAM;
+    }
+    pthread_mutex_init(&tsdb->mutex, NULL);
+    pthread_cond_init(&tsdb->cond, NULL);
+    //history wants every interval-th frame, a frame the stage could not take is a gap in the raw tier
+    tsdb->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEXT, \
+        POOL_STAGE_TEMPERATURE, tsdb_task, tsdb);
+    if (tsdb->consumer_id < 0)
+    {
+        roi_engine_release(&tsdb->roi_engine);
+        pthread_cond_destroy(&tsdb->cond);
+        pthread_mutex_destroy(&tsdb->mutex);
+        return TSDB_ERROR_PARAM;
+    }
+    return TSDB_SUCCESS;
+}
+
+static int tsdb_roi_added(int roi_id)
+{
+    if (roi_id < 0)
+    {
+        return (roi_id == ROI_ERROR_FULL) ? TSDB_ERROR_FULL : TSDB_ERROR_PARAM;
+    }
+    return roi_id;
+}
+
+int tsdb_add_line(Tsdb_t* tsdb, Line_t line)
+{
+    if (tsdb == NULL || tsdb->stream_frame_info == NULL)
+    {
+        return TSDB_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&tsdb->mutex);
+    int rst = tsdb_roi_added(roi_engine_add_line(&tsdb->roi_engine, line));
+    pthread_mutex_unlock(&tsdb->mutex);
+    return rst;
+}
+
+int tsdb_add_rect(Tsdb_t* tsdb, Area_t rect)
+{
+    if (tsdb == NULL || tsdb->stream_frame_info == NULL)
+    {
+        return TSDB_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&tsdb->mutex);
+    int rst = tsdb_roi_added(roi_engine_add_rect(&tsdb->roi_engine, rect));
+    pthread_mutex_unlock(&tsdb->mutex);
+    return rst;
+}
+
+//writer: the tier's segment the block starts in, the expired ones removed when a new one is opened
+static FILE* tsdb_segment_file(Tsdb_t* tsdb, int tier, uint64_t first_us)
+{
+    uint64_t segment = first_us / 1000000ull / tsdb_segment_s[tier];
+    if (tsdb->files[tier] != NULL && tsdb->segments[tier] == segment)
+    {
+        return tsdb->files[tier];
+    }
+    if (tsdb->files[tier] != NULL)
+    {
+        fclose(tsdb->files[tier]);
+    }
+    char name[TSDB_PATH_LEN + 32];
+    tsdb_segment_name(name, sizeof(name), tsdb->param.path, tier, segment);
+    tsdb->files[tier] = fopen(name, "ab");
+    tsdb->segments[tier] = segment;
+    uint64_t retain_s = tsdb->param.retain_s[tier];
+    uint64_t segment_start_s = segment * tsdb_segment_s[tier];
+    if (retain_s > 0 && segment_start_s >= retain_s + tsdb_segment_s[tier])
+    {
+        //segment k ends at (k + 1) * span, expired once that is retain_s behind
+        uint64_t expired = (segment_start_s - retain_s) / tsdb_segment_s[tier] - 1;
+        for (uint64_t k = 0; k < TSDB_RETENTION_SCAN && k <= expired; k++)
+        {
+            tsdb_segment_name(name, sizeof(name), tsdb->param.path, tier, expired - k);
+            remove(name);
+        }
+    }
+    return tsdb->files[tier];
+}
+
+//writer thread: the filled buffer goes out block by block, each appended to its tier's segment
+static void* tsdb_writer(void* threadarg)
+{
+    Tsdb_t* tsdb = (Tsdb_t*)threadarg;
+    pthread_mutex_lock(&tsdb->mutex);
+    while (1)
+    {
+        while (tsdb->fill_used == 0 && tsdb->writer_running)
+        {
+            pthread_cond_wait(&tsdb->cond, &tsdb->mutex);
+        }
+        if (tsdb->fill_used == 0)
+        {
+            break;
+        }
+        uint8_t* buffer = tsdb->fill_buffer;
+        uint32_t used = tsdb->fill_used;
+        tsdb->fill_buffer = tsdb->write_buffer;
+        tsdb->write_buffer = buffer;
+        tsdb->fill_used = 0;
+        pthread_mutex_unlock(&tsdb->mutex);
+
+        uint64_t start_us = get_monotonic_us();
+        uint64_t blocks = 0, bytes = 0, errors = 0;
+        for (uint32_t offset = 0; offset < used;)
+        {
+            TsdbBlockHeader_t header;
+            memcpy(&header, buffer + offset, sizeof(header));
+            FILE* fp = tsdb_segment_file(tsdb, header.tier, header.first_us);
+            if (fp != NULL && fwrite(buffer + offset, 1, header.size, fp) == header.size)
+            {
+                blocks++;
+                bytes += header.size;
+            }
+            else
+            {
+                errors++;
+            }
+            offset += header.size;
+        }
+        for (int tier = 0; tier < TSDB_TIERS; tier++)
+        {
+            if (tsdb->files[tier] != NULL && fflush(tsdb->files[tier]) != 0)
+            {
+                errors++;
+            }
+        }
+        uint64_t write_us = get_monotonic_us() - start_us;
+
+        pthread_mutex_lock(&tsdb->mutex);
+        tsdb->stats.blocks += blocks;
+        tsdb->stats.bytes += bytes;
+        tsdb->stats.write_errors += errors;
+        tsdb->stats.write_max_us = (write_us > tsdb->stats.write_max_us) ? write_us : tsdb->stats.write_max_us;
+    }
+    pthread_mutex_unlock(&tsdb->mutex);
+    for (int tier = 0; tier < TSDB_TIERS; tier++)
+    {
+        if (tsdb->files[tier] != NULL)
+        {
+            fclose(tsdb->files[tier]);
+            tsdb->files[tier] = NULL;
+        }
+    }
+    return NULL;
+}
+
+static void tsdb_buffers_free(Tsdb_t* tsdb)
+{
+    free(tsdb->series);
+    free(tsdb->fill_buffer);
+    free(tsdb->write_buffer);
+    tsdb->series = NULL;
+    tsdb->fill_buffer = NULL;
+    tsdb->write_buffer = NULL;
+}
+
+int tsdb_start(Tsdb_t* tsdb, const TsdbParam_t* param)
+{
+    if (tsdb == NULL || param == NULL || tsdb->stream_frame_info == NULL || param->path[0] == 0)
+    {
+        return TSDB_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&tsdb->mutex);
+    if (tsdb->running || tsdb->writer_running)
+    {
+        pthread_mutex_unlock(&tsdb->mutex);
+        return TSDB_ERROR_PARAM;
+    }
+    tsdb->param = *param;
+    tsdb->param.path[TSDB_PATH_LEN - 1] = 0;
+    if (tsdb->param.interval == 0)
+    {
+        tsdb->param.interval = 1;
+    }
+    if (tsdb->param.seal_s == 0)
+    {
+        tsdb->param.seal_s = TSDB_DEFAULT_SEAL_S;
+    }
+    tsdb->series = (TsdbSeries_t*)malloc((size_t)ROI_MAX_NUM * TSDB_TIERS * sizeof(TsdbSeries_t));
+    tsdb->fill_buffer = (uint8_t*)malloc(TSDB_WRITE_BYTES);
+    tsdb->write_buffer = (uint8_t*)malloc(TSDB_WRITE_BYTES);
+    if (tsdb->series == NULL || tsdb->fill_buffer == NULL || tsdb->write_buffer == NULL)
+    {
+        tsdb_buffers_free(tsdb);
+        pthread_mutex_unlock(&tsdb->mutex);
+        return TSDB_ERROR_MEM;
+    }
+    for (int i = 0; i < ROI_MAX_NUM * TSDB_TIERS; i++)
+    {
+        tsdb_series_reset(&tsdb->series[i]);
+    }
+    memset(tsdb->rollups, 0, sizeof(tsdb->rollups));
+    memset(tsdb->files, 0, sizeof(tsdb->files));
+    memset(&tsdb->stats, 0, sizeof(TsdbStats_t));
+    tsdb->fill_used = 0;
+    tsdb->frame_cnt = 0;
+    //frames carry monotonic receive times, the history is kept in unix time
+    struct timespec wall;
+    timespec_get(&wall, TIME_UTC);
+    tsdb->wall_offset_us = (int64_t)wall.tv_sec * 1000000 + wall.tv_nsec / 1000 - (int64_t)get_monotonic_us();
+    tsdb->writer_running = 1;
+    if (pthread_create(&tsdb->writer, NULL, tsdb_writer, tsdb) != 0)
+    {
+        tsdb->writer_running = 0;
+        tsdb_buffers_free(tsdb);
+        pthread_mutex_unlock(&tsdb->mutex);
+        return TSDB_ERROR_MEM;
+    }
+    tsdb->running = 1;
+    pthread_mutex_unlock(&tsdb->mutex);
+    return TSDB_SUCCESS;
+}
+
+int tsdb_stop(Tsdb_t* tsdb)
+{
+    if (tsdb == NULL)
+    {
+        return TSDB_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&tsdb->mutex);
+    if (!tsdb->writer_running)
+    {
+        pthread_mutex_unlock(&tsdb->mutex);
+        return TSDB_SUCCESS;
+    }
+    tsdb->running = 0;
+    //the partial buckets are stored too, a restart within one gives that bucket 2 points
+    for (int roi = 0; roi < ROI_MAX_NUM; roi++)
+    {
+        for (int tier = TSDB_TIER_SECOND; tier < TSDB_TIERS; tier++)
+        {
+            tsdb_rollup_flush(tsdb, tier, roi);
+        }
+        for (int tier = 0; tier < TSDB_TIERS; tier++)
+        {
+            tsdb_series_seal(tsdb, tier, roi);
+        }
+    }
+    tsdb->writer_running = 0;
+    pthread_cond_broadcast(&tsdb->cond);
+    pthread_mutex_unlock(&tsdb->mutex);
+    pthread_join(tsdb->writer, NULL);
+
+    pthread_mutex_lock(&tsdb->mutex);
+    tsdb_buffers_free(tsdb);
+    printf("tsdb: %llu frames, %llu points, %llu blocks, %llu bytes, %llu dropped, %llu write errors\n", \
+        (unsigned long long)tsdb->stats.frames, (unsigned long long)tsdb->stats.points, \
+        (unsigned long long)tsdb->stats.blocks, (unsigned long long)tsdb->stats.bytes, \
+        (unsigned long long)tsdb->stats.dropped, (unsigned long long)tsdb->stats.write_errors);
+    pthread_mutex_unlock(&tsdb->mutex);
+    return TSDB_SUCCESS;
+}
+
+int tsdb_stats(Tsdb_t* tsdb, TsdbStats_t* stats)
+{
+    if (tsdb == NULL || stats == NULL)
+    {
+        return TSDB_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&tsdb->mutex);
+    *stats = tsdb->stats;
+    pthread_mutex_unlock(&tsdb->mutex);
+    return TSDB_SUCCESS;
+}
+
+//the points of one block inside [start_us, end_us] into points[num ..), returns the new num
+static int tsdb_block_decode(const TsdbBlockHeader_t* header, const uint8_t* data, uint64_t start_us, \
+    uint64_t end_us, TsdbPoint_t* points, int num, int max_points)
+{
+    TsdbBitReader_t readers[TSDB_COLUMNS];
+    uint32_t offset = 0;
+    for (int c = 0; c < TSDB_COLUMNS; c++)
+    {
+        readers[c].data = data + offset;
+        readers[c].bits = (uint32_t)header->column_bytes[c] * 8;
+        readers[c].pos = 0;
+        readers[c].error = 0;
+        offset += header->column_bytes[c];
+    }
+    uint64_t timestamp_us = header->first_us;
+    int64_t delta = 0;
+    uint32_t value[TSDB_COLUMNS - 1] = { 0 };
+    int leading[TSDB_COLUMNS - 1] = { 0 };
+    int trailing[TSDB_COLUMNS - 1] = { 0 };
+    for (uint32_t i = 0; i < header->point_num && num < max_points; i++)
+    {
+        if (i > 0)
+        {
+            TsdbBitReader_t* reader = &readers[0];
+            uint64_t zigzag = 0;
+            if (tsdb_bits_get(reader, 1) != 0)
+            {
+                if (tsdb_bits_get(reader, 1) == 0)
+                {
+                    zigzag = tsdb_bits_get(reader, 10);
+                }
+                else if (tsdb_bits_get(reader, 1) == 0)
+                {
+                    zigzag = tsdb_bits_get(reader, 14);
+                }
+                else if (tsdb_bits_get(reader, 1) == 0)
+                {
+                    zigzag = tsdb_bits_get(reader, 20);
+                }
+                else
+                {
+                    zigzag = tsdb_bits_get(reader, 64);
+                }
+            }
+            delta += (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+            timestamp_us += (uint64_t)delta;
+        }
+        for (int v = 0; v < TSDB_COLUMNS - 1; v++)
+        {
+            TsdbBitReader_t* reader = &readers[v + 1];
+            if (i == 0)
+            {
+                value[v] = (uint32_t)tsdb_bits_get(reader, 32);
+                continue;
+            }
+            if (tsdb_bits_get(reader, 1) == 0)
+            {
+                continue;
+            }
+            if (tsdb_bits_get(reader, 1) != 0)
+            {
+                leading[v] = (int)tsdb_bits_get(reader, 5);
+                int length = (int)tsdb_bits_get(reader, 5) + 1;
+                trailing[v] = 32 - leading[v] - length;
+                if (trailing[v] < 0)
+                {
+                    reader->error = 1;
+                    break;
+                }
+            }
+            value[v] ^= (uint32_t)tsdb_bits_get(reader, 32 - leading[v] - trailing[v]) << trailing[v];
+        }
+        if (readers[0].error || readers[1].error || readers[2].error || readers[3].error)
+        {
+            break;
+        }
+        if (timestamp_us > end_us)
+        {
+            break;
+        }
+        if (timestamp_us >= start_us)
+        {
+            points[num].timestamp_us = timestamp_us;
+            points[num].min_temp = tsdb_bits_float(value[0]);
+            points[num].max_temp = tsdb_bits_float(value[1]);
+            points[num].avr_temp = tsdb_bits_float(value[2]);
+            num++;
+        }
+    }
+    return num;
+}
+
+static int tsdb_header_valid(const TsdbBlockHeader_t* header)
+{
+    uint32_t column_size = 0;
+    for (int c = 0; c < TSDB_COLUMNS; c++)
+    {
+        column_size += header->column_bytes[c];
+    }
+    return header->magic == TSDB_BLOCK_MAGIC && header->version == TSDB_VERSION && header->tier < TSDB_TIERS && \
+        header->size <= TSDB_BLOCK_MAX_SIZE && header->size == sizeof(TsdbBlockHeader_t) + column_size && \
+        header->first_us <= header->last_us;
+}
+
+//a block torn by a crash is followed by the blocks of the next run, resume at the next magic
+static int tsdb_resync(FILE* fp, long from)
+{
+    if (fseek(fp, from, SEEK_SET) != 0)
+    {
+        return 0;
+    }
+    uint32_t window = 0;
+    long pos = from;
+    int c;
+    while ((c = fgetc(fp)) != EOF)
+    {
+        window = (window >> 8) | ((uint32_t)c << 24);
+        pos++;
+        if (pos - from >= 4 && window == TSDB_BLOCK_MAGIC)
+        {
+            return fseek(fp, pos - 4, SEEK_SET) == 0;
+        }
+    }
+    return 0;
+}
+
+static int tsdb_segment_cmp(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+//the tier's segments in [first, last] in time order into *segments (malloc'd), returns their number or an error
+//code. posix lists the directory, elsewhere every segment up to the current one is a candidate
+static int tsdb_segments_find(const char* path, int tier, uint64_t first, uint64_t last, uint64_t** segments)
+{
+    int num = 0, capacity = 0;
+    *segments = NULL;
+#if !defined(_WIN32)
+    char dir[TSDB_PATH_LEN];
+    const char* slash = strrchr(path, '/');
+    const char* base = (slash != NULL) ? slash + 1 : path;
+    if (slash == NULL)
+    {
+        strcpy(dir, ".");
+    }
+    else
+    {
+        snprintf(dir, sizeof(dir), "%.*s", (slash == path) ? 1 : (int)(slash - path), path);
+    }
+    char prefix[TSDB_PATH_LEN + 8];
+    int prefix_len = snprintf(prefix, sizeof(prefix), "%s.%s.", base, tsdb_tier_names[tier]);
+    DIR* handle = opendir(dir);
+    if (handle == NULL)
+    {
+        return 0;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL)
+    {
+        if (strncmp(entry->d_name, prefix, prefix_len) != 0)
+        {
+            continue;
+        }
+        char* end = NULL;
+        unsigned long long start_s = strtoull(entry->d_name + prefix_len, &end, 10);
+        uint64_t segment = start_s / tsdb_segment_s[tier];
+        if (end == entry->d_name + prefix_len || *end != 0 || start_s % tsdb_segment_s[tier] != 0 || \
+            segment < first || segment > last)
+        {
+            continue;
+        }
+        if (num == capacity)
+        {
+            capacity = (capacity > 0) ? capacity * 2 : 64;
+            uint64_t* grown = (uint64_t*)realloc(*segments, capacity * sizeof(uint64_t));
+            if (grown == NULL)
+            {
+                closedir(handle);
+                free(*segments);
+                *segments = NULL;
+                return TSDB_ERROR_MEM;
+            }
+            *segments = grown;
+        }
+        (*segments)[num++] = segment;
+    }
+    closedir(handle);
+    qsort(*segments, num, sizeof(uint64_t), tsdb_segment_cmp);
+#else
+    struct timespec wall;
+    timespec_get(&wall, TIME_UTC);
+    uint64_t current = (uint64_t)wall.tv_sec / tsdb_segment_s[tier] + 1;
+    last = (last < current) ? last : current;
+    capacity = (first <= last) ? (int)(last - first + 1) : 0;
+    *segments = (uint64_t*)malloc((capacity > 0 ? capacity : 1) * sizeof(uint64_t));
+    if (*segments == NULL)
+    {
+        return TSDB_ERROR_MEM;
+    }
+    for (uint64_t segment = first; segment <= last && capacity > 0; segment++)
+    {
+        (*segments)[num++] = segment;
+    }
+#endif
+    return num;
+}
+
+int tsdb_query(const char* path, TsdbTier_t tier, int roi, uint64_t start_us, uint64_t end_us, \
+    TsdbPoint_t* points, int max_points)
+{
+    if (path == NULL || (int)tier < 0 || tier >= TSDB_TIERS || roi < 0 || roi >= ROI_MAX_NUM || \
+        start_us > end_us || points == NULL || max_points <= 0)
+    {
+        return TSDB_ERROR_PARAM;
+    }
+    uint8_t* data = (uint8_t*)malloc(TSDB_BLOCK_MAX_SIZE);
+    if (data == NULL)
+    {
+        return TSDB_ERROR_MEM;
+    }
+    uint64_t span_us = tsdb_segment_s[tier] * 1000000ull;
+    //a block belongs to the segment it starts in, the one before the range may reach into it
+    uint64_t first = start_us / span_us;
+    first = (first > 0) ? first - 1 : 0;
+    uint64_t* segments = NULL;
+    int segment_num = tsdb_segments_find(path, tier, first, end_us / span_us, &segments);
+    if (segment_num < 0)
+    {
+        free(data);
+        return segment_num;
+    }
+    int num = 0;
+    char name[TSDB_PATH_LEN + 32];
+    for (int s = 0; s < segment_num && num < max_points; s++)
+    {
+        tsdb_segment_name(name, sizeof(name), path, tier, segments[s]);
+        FILE* fp = fopen(name, "rb");
+        if (fp == NULL)
+        {
+            continue;
+        }
+        while (num < max_points)
+        {
+            long pos = ftell(fp);
+            TsdbBlockHeader_t header;
+            if (fread(&header, sizeof(header), 1, fp) != 1)
+            {
+                break;
+            }
+            if (!tsdb_header_valid(&header))
+            {
+                if (!tsdb_resync(fp, pos + 1))
+                {
+                    break;
+                }
+                continue;
+            }
+            uint32_t payload = header.size - sizeof(TsdbBlockHeader_t);
+            if (header.roi != roi || header.last_us < start_us || header.first_us > end_us)
+            {
+                if (fseek(fp, payload, SEEK_CUR) != 0)
+                {
+                    break;
+                }
+                continue;
+            }
+            if (fread(data, 1, payload, fp) != payload)
+            {
+                break;
+            }
+            if (flash_crc32(0, data, payload) != header.crc)
+            {
+                if (!tsdb_resync(fp, pos + 1))
+                {
+                    break;
+                }
+                continue;
+            }
+            num = tsdb_block_decode(&header, data, start_us, end_us, points, num, max_points);
+        }
+        fclose(fp);
+    }
+    free(segments);
+    free(data);
+    return num;
+}
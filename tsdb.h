@@ -0,0 +1,151 @@
+#ifndef _TSDB_H_
+#define _TSDB_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "data.h"
+#include "libirtemp.h"
+#include "roi.h"
+
+#define TSDB_BLOCK_MAGIC 0x4B425354     //"TSBK"
+#define TSDB_VERSION 1
+#define TSDB_PATH_LEN 256
+#define TSDB_TIERS 4
+#define TSDB_COLUMNS 4                  //timestamps, min, max, avr
+#define TSDB_COLUMN_BYTES 1024          //one column of an open block, the block is sealed before one can overflow
+#define TSDB_WRITE_BYTES (256 * 1024)   //sealed blocks waiting for the writer, one buffer filling, one written
+#define TSDB_DEFAULT_SEAL_S 60
+#define TSDB_RETENTION_SCAN 64          //expired segments looked for below the newest expired one
+
+#define TSDB_SUCCESS 0
+#define TSDB_ERROR_PARAM -1
+#define TSDB_ERROR_FULL -2
+#define TSDB_ERROR_FILE -3
+#define TSDB_ERROR_MEM -4
+
+typedef enum
+{
+    TSDB_TIER_RAW = 0,                  //every evaluated frame
+    TSDB_TIER_SECOND,                   //rollups of 1 s, 1 min and 1 h buckets
+    TSDB_TIER_MINUTE,
+    TSDB_TIER_HOUR,
+}TsdbTier_t;
+
+//file layout, all little endian: a tier's points go into segment files path.<tier>.<segment start, unix seconds>
+//of 1 h (raw), 1 day (1 s), 7 days (1 min) and 28 days (1 h), appended block after block. a block is one
+//series (one roi, one tier): the header, then the columns back to back.
+//timestamps column: delta of delta, '0' for 0, '10', '110', '1110' + 10/14/20 bits or '1111' + 64 bits zigzag,
+//the first point is first_us and the delta before it 0.
+//value columns: float bits xor the previous value: '0' for equal, '10' + the bits inside the previous
+//window, '11' + 5 bits leading zeros + 5 bits length - 1 + the bits, the first value as 32 bits
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t tier;                       //TsdbTier_t
+    uint8_t roi;
+    uint32_t point_num;
+    uint32_t size;                      //bytes including the header, the next block follows
+    uint64_t first_us;                  //unix time of the first and the last point
+    uint64_t last_us;
+    uint16_t column_bytes[TSDB_COLUMNS];
+    uint32_t crc;                       //flash_crc32 of the columns, a block torn by a crash fails it
+    uint32_t reserved;
+}TsdbBlockHeader_t;
+
+//temperatures are raw temp values (kelvin * 64)
+typedef struct {
+    uint64_t timestamp_us;              //unix time of the frame, a rollup has the start of its bucket
+    float min_temp;                     //rollup: min of the frames' mins
+    float max_temp;                     //rollup: max of the frames' maxes
+    float avr_temp;                     //rollup: mean of the frames' averages
+}TsdbPoint_t;
+
+typedef struct {
+    char path[TSDB_PATH_LEN];           //prefix of the segment files
+    uint32_t interval;                  //frames between two raw points, 0 or 1 stores every frame
+    uint32_t seal_s;                    //an open block is written at most this long after its first point,
+                                        //0 selects TSDB_DEFAULT_SEAL_S
+    uint32_t retain_s[TSDB_TIERS];      //segments older than this are removed, 0 keeps them
+}TsdbParam_t;
+
+typedef struct {
+    uint64_t frames;                    //frames evaluated
+    uint64_t points;                    //raw and rollup points stored
+    uint64_t blocks;                    //blocks written
+    uint64_t bytes;                     //bytes written, 16 per point uncompressed
+    uint64_t dropped;                   //sealed blocks lost because the writer was behind
+    uint64_t write_errors;
+    uint64_t write_max_us;              //slowest write of one buffer
+}TsdbStats_t;
+
+//one open block
+typedef struct {
+    uint8_t columns[TSDB_COLUMNS][TSDB_COLUMN_BYTES];
+    uint32_t bits[TSDB_COLUMNS];
+    uint32_t point_num;
+    uint64_t first_us;
+    uint64_t last_us;
+    int64_t delta;                      //the last timestamp delta
+    uint32_t value[TSDB_COLUMNS - 1];   //float bits of the last min/max/avr
+    uint8_t leading[TSDB_COLUMNS - 1];  //the last xor window, 0xff before the first one
+    uint8_t trailing[TSDB_COLUMNS - 1];
+}TsdbSeries_t;
+
+//the bucket a rollup tier is accumulating
+typedef struct {
+    uint64_t bucket;
+    uint32_t count;
+    float min_temp;
+    float max_temp;
+    double avr_sum;
+}TsdbRollup_t;
+
+//a ring task consumer storing the registered lines' and rects' min/max/avr: raw points of the evaluated frames
+//and their 1 s/1 min/1 h rollups, compressed in memory (one open block per roi and tier) and appended to the
+//segment files by a writer thread. memory is fixed once started, nothing is allocated per frame
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    TsdbParam_t param;
+    int consumer_id;
+    uint8_t running;
+    uint8_t writer_running;
+    RoiEngine_t roi_engine;
+    TempInfo_t roi_info[ROI_MAX_NUM];
+    TsdbSeries_t* series;               //ROI_MAX_NUM * TSDB_TIERS, roi major
+    TsdbRollup_t rollups[TSDB_TIERS][ROI_MAX_NUM];  //TSDB_TIER_RAW unused
+    int64_t wall_offset_us;             //unix time - monotonic time, taken at start
+    uint8_t* fill_buffer;               //sealed blocks, TSDB_WRITE_BYTES
+    uint32_t fill_used;
+    uint8_t* write_buffer;              //owned by the writer while it writes
+    FILE* files[TSDB_TIERS];            //writer: the segment being appended per tier
+    uint64_t segments[TSDB_TIERS];
+    uint32_t frame_cnt;
+    TsdbStats_t stats;
+    pthread_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+}Tsdb_t;
+
+//register the store as a task consumer of the camera's frame ring, before streaming
+int tsdb_attach(Tsdb_t* tsdb, StreamFrameInfo_t* stream_frame_info);
+
+//returns the roi index the series are stored under or an error code
+int tsdb_add_line(Tsdb_t* tsdb, Line_t line);
+int tsdb_add_rect(Tsdb_t* tsdb, Area_t rect);
+
+//start storing, can be called while streaming
+int tsdb_start(Tsdb_t* tsdb, const TsdbParam_t* param);
+
+//close the partial rollup buckets, write every open block and close the segments
+int tsdb_stop(Tsdb_t* tsdb);
+
+int tsdb_stats(Tsdb_t* tsdb, TsdbStats_t* stats);
+
+//points of one roi and tier with start_us <= timestamp_us <= end_us in time order, read from the segment files
+//(blocks still open in a running store are not there yet). returns the number of points (at most max_points)
+//or an error code, does not need the store that wrote them
+int tsdb_query(const char* path, TsdbTier_t tier, int roi, uint64_t start_us, uint64_t end_us, \
+    TsdbPoint_t* points, int max_points);
+
+#endif
@@ -0,0 +1,146 @@
+#include "upscale.h"
+#include "simd.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static const char* upscale_mode_names[UPSCALE_MODE_NUM] = { "bilinear", "bicubic" };
+
+const char* upscale_mode_name(UpscaleMode_t mode)
+{
+	return (mode >= 0 && mode < UPSCALE_MODE_NUM) ? upscale_mode_names[mode] : "unknown";
+}
+
+//weights of the taps at first, first + 1, ... for a sample t past the source pixel first + (taps / 2 - 1)
+static void upscale_weights(UpscaleMode_t mode, float t, float* w)
+{
+	if (mode == UPSCALE_BILINEAR)
+	{
+		w[0] = 1.0f - t;
+		w[1] = t;
+		return;
+	}
+	const float a = -0.5f;
+	w[0] = a * t * t * t - 2.0f * a * t * t + a * t;
+	w[1] = (a + 2.0f) * t * t * t - (a + 3.0f) * t * t + 1.0f;
+	w[2] = -(a + 2.0f) * t * t * t + (2.0f * a + 3.0f) * t * t - a * t;
+	w[3] = -a * t * t * t + a * t * t;
+}
+
+int upscale_init(Upscale_t* upscale, int factor, UpscaleMode_t mode)
+{
+	if (upscale == NULL || factor < 1 || factor > UPSCALE_FACTOR_MAX || mode < 0 || mode >= UPSCALE_MODE_NUM)
+	{
+		return UPSCALE_ERROR_PARAM;
+	}
+	memset(upscale, 0, sizeof(Upscale_t));
+	upscale->factor = factor;
+	upscale->mode = mode;
+	upscale->taps = (mode == UPSCALE_BILINEAR) ? 2 : 4;
+
+	for (int p = 0; p < factor; p++)
+	{
+		//phase p samples x + (p + 0.5) / factor - 0.5, left of x for the first half of the phases
+		float pos = (p + 0.5f) / factor - 0.5f;
+		int base = (int)floorf(pos);
+		float w[UPSCALE_TAPS_MAX];
+		upscale_weights(mode, pos - base, w);
+		upscale->offset[p] = base - (upscale->taps / 2 - 1);
+
+		//Q14, the rounding error goes to the largest weight so a flat frame stays flat
+		int sum = 0, largest = 0;
+		for (int k = 0; k < upscale->taps; k++)
+		{
+			upscale->weight[p][k] = (int16_t)lrintf(w[k] * 16384.0f);
+			sum += upscale->weight[p][k];
+			largest = (upscale->weight[p][k] > upscale->weight[p][largest]) ? k : largest;
+		}
+		upscale->weight[p][largest] += (int16_t)(16384 - sum);
+	}
+	return UPSCALE_SUCCESS;
+}
+
+void upscale_release(Upscale_t* upscale)
+{
+	if (upscale != NULL)
+	{
+		free(upscale->row);
+		free(upscale->phase);
+		upscale->row = NULL;
+		upscale->phase = NULL;
+		upscale->width = 0;
+	}
+}
+
+int upscale_process(Upscale_t* upscale, const uint16_t* src, int width, int height, int shift, uint16_t* dst)
+{
+	if (upscale == NULL || upscale->factor < 1 || src == NULL || dst == NULL || width <= 0 || height <= 0 || \
+		shift < 0 || shift > 2)
+	{
+		return UPSCALE_ERROR_PARAM;
+	}
+	int factor = upscale->factor;
+	if (factor == 1)
+	{
+		const uint16_t* rows[2] = { src, src };
+		const int16_t copy[2] = { 16384, 0 };
+		simd_fir_u16(rows, copy, 2, shift, width * height, dst);
+		return UPSCALE_SUCCESS;
+	}
+	if (upscale->width != width)
+	{
+		free(upscale->row);
+		free(upscale->phase);
+		upscale->row = (uint16_t*)malloc((width + 2 * UPSCALE_PAD) * sizeof(uint16_t));
+		upscale->phase = (uint16_t*)malloc((size_t)factor * width * sizeof(uint16_t));
+		upscale->width = width;
+		if (upscale->row == NULL || upscale->phase == NULL)
+		{
+			upscale_release(upscale);
+			return UPSCALE_ERROR_MEM;
+		}
+	}
+
+	int taps = upscale->taps;
+	int out_width = width * factor;
+	uint16_t* row = upscale->row + UPSCALE_PAD;
+	for (int y = 0; y < height * factor; y++)
+	{
+		//vertical: the phase's source rows, clamped at the top and bottom, into the padded row
+		int p = y % factor;
+		int first = y / factor + upscale->offset[p];
+		const uint16_t* taps_src[UPSCALE_TAPS_MAX];
+		for (int k = 0; k < taps; k++)
+		{
+			int r = first + k;
+			r = (r < 0) ? 0 : ((r > height - 1) ? height - 1 : r);
+			taps_src[k] = src + (long)r * width;
+		}
+		simd_fir_u16(taps_src, upscale->weight[p], taps, shift, width, row);
+		for (int k = 1; k <= UPSCALE_PAD; k++)
+		{
+			row[-k] = row[0];
+			row[width - 1 + k] = row[width - 1];
+		}
+
+		//horizontal: one pass per phase over shifted views of the row, then interleaved into the output row
+		for (int q = 0; q < factor; q++)
+		{
+			for (int k = 0; k < taps; k++)
+			{
+				taps_src[k] = row + upscale->offset[q] + k;
+			}
+			simd_fir_u16(taps_src, upscale->weight[q], taps, 0, width, upscale->phase + q * width);
+		}
+		uint16_t* out = dst + (long)y * out_width;
+		for (int q = 0; q < factor; q++)
+		{
+			const uint16_t* phase = upscale->phase + q * width;
+			for (int x = 0; x < width; x++)
+			{
+				out[x * factor + q] = phase[x];
+			}
+		}
+	}
+	return UPSCALE_SUCCESS;
+}
@@ -0,0 +1,45 @@
+#ifndef _UPSCALE_H_
+#define _UPSCALE_H_
+
+#include <stdint.h>
+
+#define UPSCALE_SUCCESS 0
+#define UPSCALE_ERROR_PARAM -1
+#define UPSCALE_ERROR_MEM -2
+
+#define UPSCALE_FACTOR_MAX 4
+#define UPSCALE_TAPS_MAX 4
+#define UPSCALE_PAD 2                   //replicated border pixels each side of a row, the widest tap reach
+
+typedef enum {
+    UPSCALE_BILINEAR = 0,               //2 taps
+    UPSCALE_BICUBIC,                    //4 taps, catmull-rom (a = -0.5), sharper but overshoots at edges
+    UPSCALE_MODE_NUM
+}UpscaleMode_t;
+
+//integer factor upscale of Y14 with pixel centers aligned: output pixel o samples the source at (o + 0.5) / factor - 0.5.
+//every output row and column falls into one of factor phases, each with its own Q14 weights and first tap,
+//so the tables are built once per factor and mode
+typedef struct {
+    int factor;
+    UpscaleMode_t mode;
+    int taps;
+    int16_t weight[UPSCALE_FACTOR_MAX][UPSCALE_TAPS_MAX];
+    int offset[UPSCALE_FACTOR_MAX];     //first tap of a phase relative to the source pixel x = o / factor
+    int width;                          //source width of the row buffers
+    uint16_t* row;                      //vertical pass of one output row, UPSCALE_PAD pixels each side
+    uint16_t* phase;                    //horizontal pass, factor phase rows of width pixels
+}Upscale_t;
+
+//factor 1..UPSCALE_FACTOR_MAX, 1 copies the frame
+int upscale_init(Upscale_t* upscale, int factor, UpscaleMode_t mode);
+
+void upscale_release(Upscale_t* upscale);
+
+//vertical then horizontal pass per output row, both through simd_fir_u16. src is shifted right by shift
+//to get Y14, dst is Y14 of (width * factor) x (height * factor)
+int upscale_process(Upscale_t* upscale, const uint16_t* src, int width, int height, int shift, uint16_t* dst);
+
+const char* upscale_mode_name(UpscaleMode_t mode);
+
+#endif
@@ -0,0 +1,276 @@
+#include "usbplan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(linux) || defined(unix)
+#include <dirent.h>
+#endif
+
+#define USB_PLAN_SYSFS "/sys/bus/usb/devices"
+
+//periodic share and largest isochronous endpoint of each speed: 80% of the high speed microframes, 90% elsewhere
+typedef struct {
+    uint32_t speed_mbps;
+    uint64_t capacity_bps;
+    uint64_t endpoint_bps;
+}UsbPlanSpeed_t;
+
+static const UsbPlanSpeed_t usb_plan_speeds[] = {
+    { 10000, 900000000ull, 786432000ull },  //2 x (16 bursts x 3 x 1024 per 125us)
+    { 5000, 450000000ull, 393216000ull },   //8b/10b, 16 bursts x 3 x 1024 per 125us
+    { 480, 48000000ull, 24576000ull },      //3 x 1024 per 125us
+    { 12, 1350000ull, 1023000ull },         //1023 per 1ms
+};
+
+static const UsbPlanSpeed_t* usb_plan_speed(uint32_t speed_mbps)
+{
+    for (size_t i = 0; i < sizeof(usb_plan_speeds) / sizeof(usb_plan_speeds[0]); i++)
+    {
+        if (speed_mbps >= usb_plan_speeds[i].speed_mbps)
+        {
+            return &usb_plan_speeds[i];
+        }
+    }
+    //low speed has no isochronous transfers
+    return NULL;
+}
+
+#if defined(linux) || defined(unix)
+//one attribute of a sysfs usb device, 0 when it can not be read
+static int usb_plan_attr(const char* name, const char* attr, char* value, size_t len)
+{
+    char path[128];
+    snprintf(path, sizeof(path), USB_PLAN_SYSFS "/%s/%s", name, attr);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+    int ok = (fgets(value, (int)len, fp) != NULL);
+    fclose(fp);
+    return ok;
+}
+
+//bus first, then the port path number by number: 1-1.10 after 1-1.9
+static int usb_plan_compare(const void* a, const void* b)
+{
+    const UsbPlanDevice_t* da = (const UsbPlanDevice_t*)a;
+    const UsbPlanDevice_t* db = (const UsbPlanDevice_t*)b;
+    if (da->bus != db->bus)
+    {
+        return da->bus - db->bus;
+    }
+    const char* pa = strchr(da->name, '-');
+    const char* pb = strchr(db->name, '-');
+    while (pa != NULL && pb != NULL && *pa != '\0' && *pb != '\0')
+    {
+        char* ea;
+        char* eb;
+        long na = strtol(pa + 1, &ea, 10);
+        long nb = strtol(pb + 1, &eb, 10);
+        if (na != nb)
+        {
+            return (na < nb) ? -1 : 1;
+        }
+        pa = ea;
+        pb = eb;
+    }
+    return (pa != NULL && *pa != '\0') - (pb != NULL && *pb != '\0');
+}
+
+static int usb_plan_scan(UsbPlan_t* plan, uint32_t vid, uint32_t pid)
+{
+    DIR* dir = opendir(USB_PLAN_SYSFS);
+    if (dir == NULL)
+    {
+        return USB_PLAN_ERROR_TOPOLOGY;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL && plan->device_num < USB_PLAN_MAX_DEVICES)
+    {
+        //devices only, the interfaces are <device>:<config>.<interface> and the root hubs usb<bus>
+        const char* name = entry->d_name;
+        if (name[0] < '0' || name[0] > '9' || strchr(name, ':') != NULL || strlen(name) >= USB_PLAN_NAME_LEN)
+        {
+            continue;
+        }
+        char value[32];
+        if (!usb_plan_attr(name, "idVendor", value, sizeof(value)) || strtoul(value, NULL, 16) != vid || \
+            !usb_plan_attr(name, "idProduct", value, sizeof(value)) || strtoul(value, NULL, 16) != pid)
+        {
+            continue;
+        }
+        UsbPlanDevice_t* device = &plan->devices[plan->device_num];
+        memset(device, 0, sizeof(UsbPlanDevice_t));
+        strcpy(device->name, name);
+        device->bus = atoi(name);
+        for (const char* p = strchr(name, '.'); p != NULL; p = strchr(p + 1, '.'))
+        {
+            device->hub_depth++;
+        }
+        //1.5 for low speed reads as 1
+        device->speed_mbps = usb_plan_attr(name, "speed", value, sizeof(value)) ? (uint32_t)atof(value) : 0;
+        plan->device_num++;
+    }
+    closedir(dir);
+    qsort(plan->devices, plan->device_num, sizeof(UsbPlanDevice_t), usb_plan_compare);
+    return (plan->device_num > 0) ? USB_PLAN_SUCCESS : USB_PLAN_ERROR_TOPOLOGY;
+}
+#else
+static int usb_plan_scan(UsbPlan_t* plan, uint32_t vid, uint32_t pid)
+{
+    return USB_PLAN_ERROR_TOPOLOGY;
+}
+#endif
+
+//the modules of one bus: demand plus margin each while they fit, the spare share spread over them
+static void usb_plan_bus(UsbPlan_t* plan, UsbPlanBus_t* bus)
+{
+    const UsbPlanSpeed_t* speed = usb_plan_speed(bus->speed_mbps);
+    bus->capacity_bps = (speed != NULL) ? speed->capacity_bps : 0;
+    bus->endpoint_bps = (speed != NULL) ? speed->endpoint_bps : 0;
+    uint64_t need_bps = 0;
+    for (int i = 0; i < plan->device_num; i++)
+    {
+        if (plan->devices[i].bus == bus->bus)
+        {
+            need_bps = (uint64_t)(plan->devices[i].demand_bps * (1.0f + USB_PLAN_MARGIN));
+            bus->need_bps += need_bps;
+        }
+    }
+    bus->max_devices = (need_bps > 0) ? (int)(bus->capacity_bps / need_bps) : 0;
+    if (bus->endpoint_bps == 0)
+    {
+        return;
+    }
+    double scale = (bus->need_bps > 0) ? (double)bus->capacity_bps / bus->need_bps : 1.0;
+    uint64_t left_bps = bus->capacity_bps;
+    int left_num = bus->device_num;
+    for (int i = 0; i < plan->device_num; i++)
+    {
+        UsbPlanDevice_t* device = &plan->devices[i];
+        if (device->bus != bus->bus)
+        {
+            continue;
+        }
+        uint64_t want_bps = (uint64_t)(device->demand_bps * (1.0f + USB_PLAN_MARGIN));
+        uint64_t share_bps;
+        if (scale >= 1.0)
+        {
+            share_bps = (uint64_t)(want_bps * scale);
+        }
+        else if (bus->capacity_bps >= device->demand_bps * bus->device_num)
+        {
+            //short of the margin only, an equal share still covers every demand
+            share_bps = bus->capacity_bps / bus->device_num;
+        }
+        else
+        {
+            //the first ones take their margin, what is left goes to the rest and they drop frames
+            share_bps = (left_bps >= want_bps) ? want_bps : left_bps / left_num;
+        }
+        left_bps -= (share_bps < left_bps) ? share_bps : left_bps;
+        left_num--;
+        device->fits = (share_bps >= device->demand_bps);
+        bus->fit_num += device->fits;
+        device->factor = (float)share_bps / bus->endpoint_bps;
+        device->factor = (device->factor > 1.0f) ? 1.0f : device->factor;
+        device->factor_min = (float)device->demand_bps / bus->endpoint_bps;
+        device->factor_min = (device->factor_min > device->factor) ? device->factor : device->factor_min;
+    }
+}
+
+int usb_plan_build(UsbPlan_t* plan, uint32_t vid, uint32_t pid, uint32_t frame_size, uint32_t fps)
+{
+    if (plan == NULL || frame_size == 0 || fps == 0)
+    {
+        return USB_PLAN_ERROR_PARAM;
+    }
+    memset(plan, 0, sizeof(UsbPlan_t));
+    int rst = usb_plan_scan(plan, vid, pid);
+    if (rst != USB_PLAN_SUCCESS)
+    {
+        return rst;
+    }
+    for (int i = 0; i < plan->device_num; i++)
+    {
+        UsbPlanDevice_t* device = &plan->devices[i];
+        device->demand_bps = (uint64_t)frame_size * fps;
+        int b = 0;
+        while (b < plan->bus_num && plan->buses[b].bus != device->bus)
+        {
+            b++;
+        }
+        if (b == plan->bus_num)
+        {
+            if (plan->bus_num >= USB_PLAN_MAX_BUSES)
+            {
+                continue;
+            }
+            memset(&plan->buses[b], 0, sizeof(UsbPlanBus_t));
+            plan->buses[b].bus = device->bus;
+            plan->bus_num++;
+        }
+        //the modules of a bus run at its speed or below, the fastest one stands for the bus
+        if (device->speed_mbps > plan->buses[b].speed_mbps)
+        {
+            plan->buses[b].speed_mbps = device->speed_mbps;
+        }
+        plan->buses[b].device_num++;
+    }
+    for (int b = 0; b < plan->bus_num; b++)
+    {
+        usb_plan_bus(plan, &plan->buses[b]);
+    }
+    return USB_PLAN_SUCCESS;
+}
+
+float usb_plan_factor(const UsbPlan_t* plan, int same_dev_index)
+{
+    if (plan == NULL || same_dev_index < 0 || same_dev_index >= plan->device_num || \
+        plan->devices[same_dev_index].factor <= 0)
+    {
+        return -1;
+    }
+    return plan->devices[same_dev_index].factor;
+}
+
+float usb_plan_backoff(const UsbPlan_t* plan, int same_dev_index, float factor)
+{
+    if (usb_plan_factor(plan, same_dev_index) < 0)
+    {
+        return -1;
+    }
+    float factor_min = plan->devices[same_dev_index].factor_min;
+    if (factor <= factor_min)
+    {
+        return -1;
+    }
+    factor *= USB_PLAN_BACKOFF;
+    return (factor < factor_min) ? factor_min : factor;
+}
+
+void usb_plan_print(const UsbPlan_t* plan)
+{
+    if (plan == NULL)
+    {
+        return;
+    }
+    for (int b = 0; b < plan->bus_num; b++)
+    {
+        const UsbPlanBus_t* bus = &plan->buses[b];
+        printf("usb bus %d (%u Mbps): %d modules need %.1f of %.1f MB/s, carries %d of them\n", bus->bus, \
+            bus->speed_mbps, bus->device_num, bus->need_bps / 1e6, bus->capacity_bps / 1e6, bus->max_devices);
+        if (bus->fit_num < bus->device_num)
+        {
+            printf("usb bus %d: %d modules over its periodic share drop frames, move them to another controller\n", \
+                bus->bus, bus->device_num - bus->fit_num);
+        }
+    }
+    for (int i = 0; i < plan->device_num; i++)
+    {
+        const UsbPlanDevice_t* device = &plan->devices[i];
+        printf("usb module %d at %s, %d hubs deep: %.1f MB/s, bandwidth factor %.3f%s\n", i, device->name, \
+            device->hub_depth, device->demand_bps / 1e6, device->factor, device->fits ? "" : ", drops frames");
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef _USBPLAN_H_
+#define _USBPLAN_H_
+
+//usb bandwidth plan for several modules on a few controllers: the topology of every module with the vid/pid is read
+//from sysfs (bus = root hub of one controller, the port path through its hubs, the negotiated speed), each module
+//needs frame_size x fps plus USB_PLAN_MARGIN of its bus' periodic share, and the bandwidth factor of each one is
+//that need over what one stream reserves at factor 1, scaled up into the spare share of the bus. a bus that can not
+//carry them all is reported with how many of them it does carry. same_dev_index is taken as the bus/port order
+#include <stdint.h>
+
+#define USB_PLAN_MAX_DEVICES 16
+#define USB_PLAN_MAX_BUSES 8
+#define USB_PLAN_MARGIN 0.15f               //uvc payload headers and the uneven frame bursts over the microframes
+#define USB_PLAN_BACKOFF 0.8f               //factor of the next start after the controller refused one
+#define USB_PLAN_RETRIES 4
+#define USB_PLAN_RETRY_MS 50
+#define USB_PLAN_NAME_LEN 32
+
+#define USB_PLAN_SUCCESS 0
+#define USB_PLAN_ERROR_PARAM -1
+#define USB_PLAN_ERROR_TOPOLOGY -2          //no sysfs usb tree, or no module with the vid/pid in it
+
+typedef struct {
+    char name[USB_PLAN_NAME_LEN];       //sysfs name, <bus>-<port>.<port>...
+    int bus;
+    int hub_depth;                      //hubs between the root hub and the module
+    uint32_t speed_mbps;
+    uint64_t demand_bps;                //bytes/s, frame_size x fps
+    float factor;
+    float factor_min;                   //demand alone, the start retries back off no further
+    uint8_t fits;                       //0: its bus is over its periodic share, the module drops frames
+}UsbPlanDevice_t;
+
+typedef struct {
+    int bus;
+    uint32_t speed_mbps;
+    uint64_t capacity_bps;              //the periodic share of the bus
+    uint64_t endpoint_bps;              //one stream at factor 1
+    uint64_t need_bps;                  //the demands with their margin
+    int device_num;
+    int fit_num;
+    int max_devices;                    //modules of this frame_size x fps the bus carries
+}UsbPlanBus_t;
+
+typedef struct {
+    int device_num;
+    UsbPlanDevice_t devices[USB_PLAN_MAX_DEVICES];  //same_dev_index order
+    int bus_num;
+    UsbPlanBus_t buses[USB_PLAN_MAX_BUSES];
+}UsbPlan_t;
+
+//plan every module with vid/pid streaming frame_size x fps
+int usb_plan_build(UsbPlan_t* plan, uint32_t vid, uint32_t pid, uint32_t frame_size, uint32_t fps);
+
+//the planned factor of the same_dev_index-th module, -1 when it is not in the plan
+float usb_plan_factor(const UsbPlan_t* plan, int same_dev_index);
+
+//the factor after a refused start, -1 once it reached factor_min
+float usb_plan_backoff(const UsbPlan_t* plan, int same_dev_index, float factor);
+
+void usb_plan_print(const UsbPlan_t* plan);
+
+#endif
@@ -0,0 +1,451 @@
+#include "usbxfer.h"
+#include <string.h>
+#include "sync.h"
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+//libusb 1.0's struct libusb_transfer as far as it is read here, its layout is part of the libusb abi. the libusb
+//headers are not needed to build
+typedef struct {
+    uint32_t length;
+    uint32_t actual_length;
+    int status;
+}UsbXferIsoPacket_t;
+
+typedef void (*UsbXferCallback_t)(struct libusb_transfer* transfer);
+
+typedef struct {
+    void* dev_handle;
+    uint8_t flags;
+    uint8_t endpoint;
+    uint8_t type;
+    uint32_t timeout;
+    int status;
+    int length;
+    int actual_length;
+    UsbXferCallback_t callback;
+    void* user_data;
+    uint8_t* buffer;
+    int num_iso_packets;
+    UsbXferIsoPacket_t iso_packet_desc[1];  //num_iso_packets of them
+}UsbXferTransfer_t;
+
+#define USB_XFER_TYPE_ISO 1
+#define USB_XFER_TYPE_BULK 2
+#define USB_XFER_ENDPOINT_IN 0x80
+#define USB_XFER_STATUS_COMPLETED 0
+#define USB_XFER_STATUS_ERROR 1
+#define USB_XFER_STATUS_TIMED_OUT 2
+#define USB_XFER_STATUS_CANCELLED 3
+#define USB_XFER_STATUS_STALL 4
+#define USB_XFER_STATUS_OVERFLOW 6
+#define USB_XFER_LIBUSB_SUCCESS 0
+#define USB_XFER_LIBUSB_ERROR_NOT_FOUND -5
+#define USB_XFER_LIBUSB_ERROR_NO_MEM -11
+
+typedef struct {
+    UsbXferTransfer_t* transfer;            //NULL: a free entry
+    int camera;
+    UsbXferCallback_t callback;             //libiruvc's
+    int packets;                            //as libiruvc allocated the transfer
+    int length;
+    uint8_t returned;                       //came back at least once
+    uint8_t in_flight;
+    uint8_t held;
+    uint8_t cancelling;                     //a held transfer libiruvc cancelled, its completion is due
+    uint64_t held_seq;                      //order of the held submits
+}UsbXferEntry_t;
+
+typedef struct {
+    void* dev_handle;                       //bound by the last stream start, NULL before
+    UsbXferParam_t param;
+    UsbXferStats_t stats;
+}UsbXferCamera_t;
+
+static sync_mutex_t usb_xfer_mutex = SYNC_MUTEX_INITIALIZER;
+static UsbXferCamera_t usb_xfer_cameras[USB_XFER_MAX_CAMERAS];
+static UsbXferEntry_t usb_xfer_entries[USB_XFER_MAX_TRANSFERS];
+static uint64_t usb_xfer_held_seq = 0;
+static thread_local int usb_xfer_starting = -1;
+
+int usb_xfer_param_set(int camera, const UsbXferParam_t* param)
+{
+    if (camera < 0 || camera >= USB_XFER_MAX_CAMERAS || param == NULL)
+    {
+        return USB_XFER_ERROR_PARAM;
+    }
+    sync_mutex_lock(&usb_xfer_mutex);
+    usb_xfer_cameras[camera].param = *param;
+    sync_mutex_unlock(&usb_xfer_mutex);
+    return USB_XFER_SUCCESS;
+}
+
+void usb_xfer_stream_begin(int camera)
+{
+    if (camera < 0 || camera >= USB_XFER_MAX_CAMERAS)
+    {
+        return;
+    }
+    //a reopen comes with another handle, the first transfer of the start binds it
+    sync_mutex_lock(&usb_xfer_mutex);
+    usb_xfer_cameras[camera].dev_handle = NULL;
+    sync_mutex_unlock(&usb_xfer_mutex);
+    usb_xfer_starting = camera;
+}
+
+void usb_xfer_stream_end(void)
+{
+    usb_xfer_starting = -1;
+}
+
+int usb_xfer_stats(int camera, UsbXferStats_t* stats)
+{
+    if (camera < 0 || camera >= USB_XFER_MAX_CAMERAS || stats == NULL)
+    {
+        return USB_XFER_ERROR_PARAM;
+    }
+    sync_mutex_lock(&usb_xfer_mutex);
+    *stats = usb_xfer_cameras[camera].stats;
+    sync_mutex_unlock(&usb_xfer_mutex);
+    return USB_XFER_SUCCESS;
+}
+
+#if !defined(_WIN32)
+//libusb's own, usb_xfer_hook_install sets them before the first call comes through
+static UsbXferSubmitFunc_t usb_xfer_real_submit = NULL;
+static UsbXferSubmitFunc_t usb_xfer_real_cancel = NULL;
+static UsbXferFreeFunc_t usb_xfer_real_free = NULL;
+static uint8_t usb_xfer_delivering = 0;     //usb_xfer_cancel_deliver is running
+
+void usb_xfer_hook_install(UsbXferSubmitFunc_t submit, UsbXferSubmitFunc_t cancel, UsbXferFreeFunc_t free_func)
+{
+    usb_xfer_real_submit = submit;
+    usb_xfer_real_cancel = cancel;
+    usb_xfer_real_free = free_func;
+}
+
+//with the mutex held
+static UsbXferEntry_t* usb_xfer_entry_find(const UsbXferTransfer_t* transfer)
+{
+    for (int i = 0; i < USB_XFER_MAX_TRANSFERS; i++)
+    {
+        if (usb_xfer_entries[i].transfer == transfer)
+        {
+            return &usb_xfer_entries[i];
+        }
+    }
+    return NULL;
+}
+
+//with the mutex held: the camera of a stream transfer's device, bound on the thread starting the stream
+static int usb_xfer_camera_of(const UsbXferTransfer_t* transfer)
+{
+    for (int i = 0; i < USB_XFER_MAX_CAMERAS; i++)
+    {
+        if (usb_xfer_cameras[i].dev_handle == transfer->dev_handle)
+        {
+            return i;
+        }
+    }
+    if (usb_xfer_starting >= 0)
+    {
+        usb_xfer_cameras[usb_xfer_starting].dev_handle = transfer->dev_handle;
+        return usb_xfer_starting;
+    }
+    return -1;
+}
+
+//with the mutex held: the oldest held transfer of the camera when the depth has room for it, taken in flight
+static UsbXferEntry_t* usb_xfer_release_held(int camera)
+{
+    UsbXferCamera_t* cam = &usb_xfer_cameras[camera];
+    if (cam->param.depth > 0 && cam->stats.in_flight >= cam->param.depth)
+    {
+        return NULL;
+    }
+    UsbXferEntry_t* oldest = NULL;
+    for (int i = 0; i < USB_XFER_MAX_TRANSFERS; i++)
+    {
+        UsbXferEntry_t* entry = &usb_xfer_entries[i];
+        if (entry->transfer != NULL && entry->held && entry->camera == camera && \
+            (oldest == NULL || entry->held_seq < oldest->held_seq))
+        {
+            oldest = entry;
+        }
+    }
+    if (oldest != NULL)
+    {
+        oldest->held = 0;
+        oldest->in_flight = 1;
+        cam->stats.in_flight++;
+        cam->stats.submitted++;
+        cam->stats.in_flight_max = (cam->stats.in_flight > cam->stats.in_flight_max) ? cam->stats.in_flight : \
+            cam->stats.in_flight_max;
+    }
+    return oldest;
+}
+
+//a held transfer into libusb. libusb refusing it comes back to libiruvc as an error completion, it took the
+//submit for done
+static void usb_xfer_submit_held(UsbXferEntry_t* entry)
+{
+    UsbXferTransfer_t* transfer = entry->transfer;
+    if (usb_xfer_real_submit((struct libusb_transfer*)transfer) >= 0)
+    {
+        return;
+    }
+    sync_mutex_lock(&usb_xfer_mutex);
+    UsbXferCamera_t* cam = &usb_xfer_cameras[entry->camera];
+    UsbXferCallback_t callback = entry->callback;
+    entry->in_flight = 0;
+    entry->returned = 1;
+    cam->stats.in_flight--;
+    cam->stats.submit_errors++;
+    sync_mutex_unlock(&usb_xfer_mutex);
+    transfer->callback = callback;
+    transfer->status = USB_XFER_STATUS_ERROR;
+    transfer->actual_length = 0;
+    callback((struct libusb_transfer*)transfer);
+}
+
+//every tracked transfer comes back here first, on libiruvc's event thread
+static void usb_xfer_callback(struct libusb_transfer* libusb_transfer)
+{
+    UsbXferTransfer_t* transfer = (UsbXferTransfer_t*)libusb_transfer;
+    sync_mutex_lock(&usb_xfer_mutex);
+    UsbXferEntry_t* entry = usb_xfer_entry_find(transfer);
+    if (entry == NULL)
+    {
+        sync_mutex_unlock(&usb_xfer_mutex);
+        return;
+    }
+    UsbXferCallback_t callback = entry->callback;
+    UsbXferStats_t* stats = &usb_xfer_cameras[entry->camera].stats;
+    entry->in_flight = 0;
+    entry->returned = 1;
+    stats->in_flight--;
+    switch (transfer->status)
+    {
+    case USB_XFER_STATUS_COMPLETED:
+    {
+        stats->completed++;
+        uint64_t bytes = 0;
+        if (transfer->type == USB_XFER_TYPE_ISO)
+        {
+            for (int i = 0; i < transfer->num_iso_packets; i++)
+            {
+                bytes += transfer->iso_packet_desc[i].actual_length;
+                stats->iso_packet_errors += (transfer->iso_packet_desc[i].status != USB_XFER_STATUS_COMPLETED);
+            }
+            stats->short_transfers += (bytes == 0);
+        }
+        else
+        {
+            bytes = (uint64_t)transfer->actual_length;
+            stats->short_transfers += (transfer->actual_length < transfer->length);
+        }
+        stats->bytes += bytes;
+        break;
+    }
+    case USB_XFER_STATUS_CANCELLED:
+        stats->cancelled++;
+        break;
+    default:
+        stats->errors++;
+        stats->timeouts += (transfer->status == USB_XFER_STATUS_TIMED_OUT);
+        stats->stalls += (transfer->status == USB_XFER_STATUS_STALL);
+        stats->overflows += (transfer->status == USB_XFER_STATUS_OVERFLOW);
+        break;
+    }
+    //a stream being stopped gets nothing new into libusb
+    UsbXferEntry_t* next = (transfer->status == USB_XFER_STATUS_CANCELLED) ? NULL : \
+        usb_xfer_release_held(entry->camera);
+    sync_mutex_unlock(&usb_xfer_mutex);
+    if (next != NULL)
+    {
+        usb_xfer_submit_held(next);
+    }
+    //libiruvc sees its own callback, its resubmit comes through libusb_submit_transfer again
+    transfer->callback = callback;
+    callback(libusb_transfer);
+}
+
+//the size of the transfer as the camera's param shortens it, from what libiruvc allocated
+static void usb_xfer_shape(UsbXferTransfer_t* transfer, const UsbXferEntry_t* entry, const UsbXferParam_t* param)
+{
+    if (transfer->type == USB_XFER_TYPE_ISO)
+    {
+        int packets = (param->iso_packets > 0 && (int)param->iso_packets < entry->packets) ? \
+            (int)param->iso_packets : entry->packets;
+        transfer->num_iso_packets = packets;
+        transfer->length = (packets < entry->packets) ? packets * (int)transfer->iso_packet_desc[0].length : \
+            entry->length;
+        return;
+    }
+    int length = (int)(param->bulk_length / USB_XFER_BULK_UNIT * USB_XFER_BULK_UNIT);
+    length = (length < USB_XFER_BULK_UNIT) ? USB_XFER_BULK_UNIT : length;
+    transfer->length = (param->bulk_length > 0 && length < entry->length) ? length : entry->length;
+}
+
+int usb_xfer_hook_submit(struct libusb_transfer* libusb_transfer)
+{
+    UsbXferTransfer_t* transfer = (UsbXferTransfer_t*)libusb_transfer;
+    if ((transfer->type != USB_XFER_TYPE_ISO && transfer->type != USB_XFER_TYPE_BULK) || \
+        !(transfer->endpoint & USB_XFER_ENDPOINT_IN))
+    {
+        return usb_xfer_real_submit(libusb_transfer);
+    }
+    sync_mutex_lock(&usb_xfer_mutex);
+    int camera = usb_xfer_camera_of(transfer);
+    UsbXferEntry_t* entry = (camera >= 0) ? usb_xfer_entry_find(transfer) : NULL;
+    if (camera >= 0 && entry == NULL)
+    {
+        entry = usb_xfer_entry_find(NULL);
+        if (entry != NULL)
+        {
+            memset(entry, 0, sizeof(UsbXferEntry_t));
+            entry->transfer = transfer;
+            entry->packets = transfer->num_iso_packets;
+            entry->length = transfer->length;
+            usb_xfer_cameras[camera].stats.transfers++;
+        }
+    }
+    if (entry == NULL)
+    {
+        sync_mutex_unlock(&usb_xfer_mutex);
+        return usb_xfer_real_submit(libusb_transfer);
+    }
+    entry->camera = camera;
+    if (transfer->callback != usb_xfer_callback)
+    {
+        entry->callback = transfer->callback;
+    }
+    UsbXferCamera_t* cam = &usb_xfer_cameras[camera];
+    usb_xfer_shape(transfer, entry, &cam->param);
+    transfer->callback = usb_xfer_callback;
+    UsbXferStats_t* stats = &cam->stats;
+    stats->resubmitted += entry->returned;
+    stats->transfer_type = transfer->type;
+    stats->iso_packets = (transfer->type == USB_XFER_TYPE_ISO) ? (uint32_t)transfer->num_iso_packets : 0;
+    stats->transfer_length = (uint32_t)transfer->length;
+    if (cam->param.depth > 0 && stats->in_flight >= cam->param.depth)
+    {
+        //libiruvc takes it for submitted, it goes in when one in flight comes back
+        entry->held = 1;
+        entry->held_seq = usb_xfer_held_seq++;
+        stats->held++;
+        sync_mutex_unlock(&usb_xfer_mutex);
+        return 0;
+    }
+    entry->in_flight = 1;
+    stats->in_flight++;
+    stats->submitted++;
+    stats->in_flight_max = (stats->in_flight > stats->in_flight_max) ? stats->in_flight : stats->in_flight_max;
+    sync_mutex_unlock(&usb_xfer_mutex);
+    int rst = usb_xfer_real_submit(libusb_transfer);
+    if (rst < 0)
+    {
+        sync_mutex_lock(&usb_xfer_mutex);
+        entry->in_flight = 0;
+        stats->in_flight--;
+        stats->submit_errors++;
+        transfer->callback = entry->callback;
+        sync_mutex_unlock(&usb_xfer_mutex);
+    }
+    return rst;
+}
+
+//the cancelled completions of held transfers, on a thread of its own: uvc_stream_stop cancels with its callback
+//mutex held and then waits for them, a completion from inside libusb_cancel_transfer would deadlock on that mutex
+static void* usb_xfer_cancel_deliver(void* arg)
+{
+    (void)arg;
+    while (1)
+    {
+        sync_mutex_lock(&usb_xfer_mutex);
+        UsbXferEntry_t* entry = NULL;
+        for (int i = 0; entry == NULL && i < USB_XFER_MAX_TRANSFERS; i++)
+        {
+            entry = (usb_xfer_entries[i].transfer != NULL && usb_xfer_entries[i].cancelling) ? \
+                &usb_xfer_entries[i] : NULL;
+        }
+        if (entry == NULL)
+        {
+            usb_xfer_delivering = 0;
+            sync_mutex_unlock(&usb_xfer_mutex);
+            return NULL;
+        }
+        UsbXferTransfer_t* transfer = entry->transfer;
+        UsbXferCallback_t callback = entry->callback;
+        usb_xfer_cameras[entry->camera].stats.cancelled++;
+        usb_xfer_cameras[entry->camera].stats.transfers--;
+        entry->transfer = NULL;
+        sync_mutex_unlock(&usb_xfer_mutex);
+        //libiruvc frees it in the callback, the free passes untracked
+        transfer->callback = callback;
+        transfer->status = USB_XFER_STATUS_CANCELLED;
+        transfer->actual_length = 0;
+        callback((struct libusb_transfer*)transfer);
+    }
+}
+
+int usb_xfer_hook_cancel(struct libusb_transfer* libusb_transfer)
+{
+    UsbXferTransfer_t* transfer = (UsbXferTransfer_t*)libusb_transfer;
+    sync_mutex_lock(&usb_xfer_mutex);
+    UsbXferEntry_t* entry = usb_xfer_entry_find(transfer);
+    if (entry != NULL && entry->cancelling)
+    {
+        sync_mutex_unlock(&usb_xfer_mutex);
+        return USB_XFER_LIBUSB_ERROR_NOT_FOUND;
+    }
+    if (entry != NULL && entry->held)
+    {
+        //never reached libusb: it completes as cancelled the way libusb would, after the cancel returned
+        entry->held = 0;
+        entry->cancelling = 1;
+        int rst = USB_XFER_LIBUSB_SUCCESS;
+        if (!usb_xfer_delivering)
+        {
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, usb_xfer_cancel_deliver, NULL) == 0)
+            {
+                pthread_detach(thread);
+                usb_xfer_delivering = 1;
+            }
+            else
+            {
+                //no thread for the completion: a failed cancel, uvc_stream_stop frees it without waiting
+                transfer->callback = entry->callback;
+                usb_xfer_cameras[entry->camera].stats.cancelled++;
+                usb_xfer_cameras[entry->camera].stats.transfers--;
+                entry->transfer = NULL;
+                rst = USB_XFER_LIBUSB_ERROR_NO_MEM;
+            }
+        }
+        sync_mutex_unlock(&usb_xfer_mutex);
+        return rst;
+    }
+    sync_mutex_unlock(&usb_xfer_mutex);
+    return usb_xfer_real_cancel(libusb_transfer);
+}
+
+void usb_xfer_hook_free(struct libusb_transfer* libusb_transfer)
+{
+    if (libusb_transfer != NULL)
+    {
+        sync_mutex_lock(&usb_xfer_mutex);
+        UsbXferEntry_t* entry = usb_xfer_entry_find((UsbXferTransfer_t*)libusb_transfer);
+        if (entry != NULL)
+        {
+            UsbXferStats_t* stats = &usb_xfer_cameras[entry->camera].stats;
+            stats->transfers--;
+            stats->in_flight -= entry->in_flight;
+            entry->transfer = NULL;
+        }
+        sync_mutex_unlock(&usb_xfer_mutex);
+    }
+    usb_xfer_real_free(libusb_transfer);
+}
+#endif
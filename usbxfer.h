@@ -0,0 +1,71 @@
+#ifndef _USBXFER_H_
+#define _USBXFER_H_
+
+//usb transfer telemetry and queue control under libiruvc, which keeps its libusb transfers to itself: libiruvc
+//links libusb dynamically, so the process' own libusb_submit_transfer/libusb_cancel_transfer/libusb_free_transfer
+//come first and pass every call on to libusb (dlsym RTLD_NEXT). they are in usbxfer_hook.cpp, linked into the
+//sample program only (cmake USB_XFER_HOOK, make USB_XFER=0 leaves it out): a library built from these sources
+//does not take over libusb in the process that loads it, there the stats stay 0 and the param does nothing.
+//an isochronous or bulk IN transfer submitted by the thread between usb_xfer_stream_begin and usb_xfer_stream_end
+//binds its device handle to the camera, from then on each transfer of the handle wraps its callback once per
+//submit and counts how it came back. control and interrupt transfers pass untouched. the depth holds back submits over it until one in flight completes (the order stays the
+//submit order), iso_packets/bulk_length shorten the transfers; libiruvc allocates the transfers, so both can only
+//go below what it set up. windows: nothing is interposed, the stats stay 0
+#include <stdint.h>
+
+#define USB_XFER_MAX_CAMERAS 16
+#define USB_XFER_MAX_TRANSFERS 128          //tracked transfers over all cameras, more pass uncounted
+#define USB_XFER_BULK_UNIT 1024             //bulk_length is rounded down to whole super speed packets
+
+#define USB_XFER_SUCCESS 0
+#define USB_XFER_ERROR_PARAM -1
+
+typedef struct {
+    uint32_t depth;                         //transfers in flight at most, 0 all that libiruvc submits
+    uint32_t iso_packets;                   //iso packets per transfer at most, 0 libiruvc's
+    uint32_t bulk_length;                   //bytes per bulk transfer at most, 0 libiruvc's
+}UsbXferParam_t;
+
+typedef struct {
+    uint64_t submitted;                     //passed on to libusb
+    uint64_t resubmitted;                   //of them, transfers that had come back before
+    uint64_t submit_errors;                 //libusb refused the submit
+    uint64_t held;                          //submits held back by depth
+    uint64_t completed;
+    uint64_t short_transfers;               //completed short: bulk under its length, iso without a byte in any packet
+    uint64_t errors;                        //came back with an error status, the ones below included
+    uint64_t timeouts;
+    uint64_t stalls;
+    uint64_t overflows;
+    uint64_t cancelled;
+    uint64_t iso_packet_errors;             //packets of completed iso transfers with an error status
+    uint64_t bytes;                         //actual length of the completed transfers
+    uint32_t in_flight;
+    uint32_t in_flight_max;
+    uint32_t transfers;                     //tracked now
+    uint32_t transfer_type;                 //1 isochronous, 2 bulk, as libusb
+    uint32_t iso_packets;                   //per transfer as submitted, after iso_packets
+    uint32_t transfer_length;               //bytes per transfer as submitted
+}UsbXferStats_t;
+
+//the queue of the camera's next stream start, 0 fields keep libiruvc's
+int usb_xfer_param_set(int camera, const UsbXferParam_t* param);
+
+//around uvc_camera_stream_start of the camera on this thread: its transfers bind the device handle to the camera
+void usb_xfer_stream_begin(int camera);
+
+void usb_xfer_stream_end(void);
+
+//counters of the camera, from any thread
+int usb_xfer_stats(int camera, UsbXferStats_t* stats);
+
+//for usbxfer_hook.cpp: libusb's own calls, resolved, then every libusb call of the process through the hooks
+struct libusb_transfer;
+typedef int (*UsbXferSubmitFunc_t)(struct libusb_transfer* transfer);
+typedef void (*UsbXferFreeFunc_t)(struct libusb_transfer* transfer);
+void usb_xfer_hook_install(UsbXferSubmitFunc_t submit, UsbXferSubmitFunc_t cancel, UsbXferFreeFunc_t free_func);
+int usb_xfer_hook_submit(struct libusb_transfer* transfer);
+int usb_xfer_hook_cancel(struct libusb_transfer* transfer);
+void usb_xfer_hook_free(struct libusb_transfer* transfer);
+
+#endif
@@ -0,0 +1,55 @@
+//the libusb transfer calls of the process, in front of libusb: usbxfer.cpp counts and queues them, then hands them
+//on to the libusb behind them. linked into the sample program only, see usbxfer.h
+#include "usbxfer.h"
+#if !defined(_WIN32)
+#include <stdio.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#define USB_XFER_LIBUSB_ERROR_NOT_SUPPORTED -12
+
+static pthread_once_t usb_xfer_hook_once = PTHREAD_ONCE_INIT;
+static UsbXferFreeFunc_t usb_xfer_hook_real_free = NULL;
+static uint8_t usb_xfer_hook_ready = 0;
+
+//no libusb behind this one (libusb linked statically, or loaded after it): every call fails, nothing is called
+//through a NULL pointer
+static void usb_xfer_hook_resolve(void)
+{
+    UsbXferSubmitFunc_t submit = (UsbXferSubmitFunc_t)dlsym(RTLD_NEXT, "libusb_submit_transfer");
+    UsbXferSubmitFunc_t cancel = (UsbXferSubmitFunc_t)dlsym(RTLD_NEXT, "libusb_cancel_transfer");
+    usb_xfer_hook_real_free = (UsbXferFreeFunc_t)dlsym(RTLD_NEXT, "libusb_free_transfer");
+    if (submit == NULL || cancel == NULL || usb_xfer_hook_real_free == NULL)
+    {
+        printf("usbxfer: no libusb transfer calls behind the hooks, build with USB_XFER_HOOK off\n");
+        return;
+    }
+    usb_xfer_hook_install(submit, cancel, usb_xfer_hook_real_free);
+    usb_xfer_hook_ready = 1;
+}
+
+extern "C" __attribute__((visibility("default"))) int libusb_submit_transfer(struct libusb_transfer* transfer)
+{
+    pthread_once(&usb_xfer_hook_once, usb_xfer_hook_resolve);
+    return usb_xfer_hook_ready ? usb_xfer_hook_submit(transfer) : USB_XFER_LIBUSB_ERROR_NOT_SUPPORTED;
+}
+
+extern "C" __attribute__((visibility("default"))) int libusb_cancel_transfer(struct libusb_transfer* transfer)
+{
+    pthread_once(&usb_xfer_hook_once, usb_xfer_hook_resolve);
+    return usb_xfer_hook_ready ? usb_xfer_hook_cancel(transfer) : USB_XFER_LIBUSB_ERROR_NOT_SUPPORTED;
+}
+
+extern "C" __attribute__((visibility("default"))) void libusb_free_transfer(struct libusb_transfer* transfer)
+{
+    pthread_once(&usb_xfer_hook_once, usb_xfer_hook_resolve);
+    if (usb_xfer_hook_ready)
+    {
+        usb_xfer_hook_free(transfer);
+    }
+    else if (usb_xfer_hook_real_free != NULL)
+    {
+        usb_xfer_hook_real_free(transfer);
+    }
+}
+#endif
@@ -0,0 +1,1071 @@
+#include "web.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "palette.h"
+#include "snapshot.h"
+#include "tempunit.h"
+#include "latency.h"
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+
+#define WEB_POLL_MS 100
+#define WEB_WS_HEADER 10                //largest server frame header, the 64 bit length
+#define WEB_WS_OP_TEXT 0x1
+#define WEB_WS_OP_BINARY 0x2
+#define WEB_WS_OP_CLOSE 0x8
+#define WEB_WS_OP_PING 0x9
+#define WEB_WS_OP_PONG 0xA
+#define WEB_WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+//the dashboard: the jpegs as they come, the frame stats under them and the last alarm events. the wheel zooms
+//around the pointer, a click centers the view there and a double click goes back to the full frame
+static const char web_page[] =
+    "<!DOCTYPE html><html><head><meta charset=\"utf-8\"><title>ir camera</title><style>"
+    "body{background:#111;color:#ddd;font:14px monospace;margin:16px}img{width:768px;image-rendering:pixelated}"
+    "</style></head><body><img id=\"frame\"><pre id=\"stats\">connecting</pre><pre id=\"alarms\"></pre><script>"
+    "var frame=document.getElementById('frame'),stats=document.getElementById('stats'),"
+    "alarms=document.getElementById('alarms'),url=null,log=[],sock=null,z={f:1,x:.5,y:.5};"
+    "function zoom(f,x,y){f=Math.min(Math.max(f,1),8);var h=.5/f;z.f=f;z.x=Math.min(Math.max(x,h),1-h);"
+    "z.y=Math.min(Math.max(y,h),1-h);if(sock&&sock.readyState===1)sock.send('zoom '+z.f+' '+z.x+' '+z.y);}"
+    "function at(e){var r=frame.getBoundingClientRect(),h=.5/z.f;"
+    "return[z.x-h+(e.clientX-r.left)/r.width/z.f,z.y-h+(e.clientY-r.top)/r.height/z.f];}"
+    "frame.onwheel=function(e){e.preventDefault();var p=at(e);zoom(e.deltaY<0?z.f*2:z.f/2,p[0],p[1]);};"
+    "frame.onclick=function(e){var p=at(e);zoom(z.f,p[0],p[1]);};frame.ondblclick=function(){zoom(1,.5,.5);};"
+    "function connect(){var ws=new WebSocket('ws://'+location.host+'/ws');ws.binaryType='blob';sock=ws;"
+    "ws.onopen=function(){if(z.f>1)zoom(z.f,z.x,z.y);};"
+    "ws.onmessage=function(e){if(typeof e.data!=='string'){if(url)URL.revokeObjectURL(url);"
+    "url=URL.createObjectURL(e.data);frame.src=url;return;}var m=JSON.parse(e.data);"
+    "if(m.type==='frame'){stats.textContent='frame '+m.seq+(m.temp?'  max '+m.temp.max.toFixed(2)+' at ('+"
+    "m.temp.max_x+','+m.temp.max_y+')  min '+m.temp.min.toFixed(2)+'  mean '+m.temp.mean.toFixed(2)+"
+    "(m.temp_invalid?'  (shutter)':''):'');}else if(m.type==='alarm'){m.events.forEach(function(v){"
+    "log.unshift('frame '+v.seq+' '+v.event+' track '+v.track+' max '+v.max.toFixed(2)+' at ('+v.x+','+v.y+')');});"
+    "log=log.slice(0,20);alarms.textContent=log.join('\\n');}};"
+    "ws.onclose=function(){stats.textContent='reconnecting';setTimeout(connect,1000);};}connect();"
+    "</script></body></html>";
+
+//the lock is held by the caller for every function below that takes the server
+static WebPacket_t* web_packet_alloc(Web_t* web, uint32_t capacity)
+{
+    for (int i = 0; i < web->cache_num; i++)
+    {
+        if (web->cache[i]->capacity >= capacity)
+        {
+            WebPacket_t* packet = web->cache[i];
+            web->cache[i] = web->cache[--web->cache_num];
+            return packet;
+        }
+    }
+    WebPacket_t* packet = (WebPacket_t*)malloc(sizeof(WebPacket_t));
+    if (packet == NULL)
+    {
+        return NULL;
+    }
+    packet->data = (uint8_t*)malloc(capacity);
+    if (packet->data == NULL)
+    {
+        free(packet);
+        return NULL;
+    }
+    packet->capacity = capacity;
+    return packet;
+}
+
+static void web_packet_release(Web_t* web, WebPacket_t* packet)
+{
+    if (--packet->ref > 0)
+    {
+        return;
+    }
+    if (web->cache_num < WEB_PACKET_CACHE)
+    {
+        web->cache[web->cache_num++] = packet;
+        return;
+    }
+    //the cache keeps the larger buffers
+    int smallest = 0;
+    for (int i = 1; i < web->cache_num; i++)
+    {
+        if (web->cache[i]->capacity < web->cache[smallest]->capacity)
+        {
+            smallest = i;
+        }
+    }
+    if (web->cache[smallest]->capacity < packet->capacity)
+    {
+        WebPacket_t* tmp = web->cache[smallest];
+        web->cache[smallest] = packet;
+        packet = tmp;
+    }
+    free(packet->data);
+    free(packet);
+}
+
+//an unmasked server frame of one message, fin set. returns the header's size
+static uint32_t web_ws_header(uint8_t* p, int opcode, uint64_t len)
+{
+    p[0] = (uint8_t)(0x80 | opcode);
+    if (len < 126)
+    {
+        p[1] = (uint8_t)len;
+        return 2;
+    }
+    if (len <= 0xFFFF)
+    {
+        p[1] = 126;
+        p[2] = (uint8_t)(len >> 8);
+        p[3] = (uint8_t)len;
+        return 4;
+    }
+    p[1] = 127;
+    for (int i = 0; i < 8; i++)
+    {
+        p[2 + i] = (uint8_t)(len >> (56 - 8 * i));
+    }
+    return 10;
+}
+
+//append one message to a packet, its capacity counted WEB_WS_HEADER for the header
+static void web_ws_append(WebPacket_t* packet, int opcode, const void* payload, uint32_t len)
+{
+    packet->size += web_ws_header(packet->data + packet->size, opcode, len);
+    memcpy(packet->data + packet->size, payload, len);
+    packet->size += len;
+}
+
+static void web_client_reset(Web_t* web, WebClient_t* client)
+{
+    while (client->queue_num > 0)
+    {
+        web_packet_release(web, client->queue[client->queue_head]);
+        client->queue_head = (client->queue_head + 1) % WEB_CLIENT_QUEUE;
+        client->queue_num--;
+    }
+    client->queue_head = 0;
+    client->queue_sent = 0;
+}
+
+static void web_watched_update(Web_t* web)
+{
+    web->watched = 0;
+    web->mjpeg_watched = 0;
+    for (int i = 0; i < WEB_MAX_CLIENTS; i++)
+    {
+        const WebClient_t* client = &web->clients[i];
+        web->watched |= (client->fd >= 0 && client->websocket && !client->closing);
+        web->mjpeg_watched |= (client->fd >= 0 && client->mjpeg && !client->closing);
+    }
+}
+
+//a full queue makes room by dropping its oldest frame that is not being sent, the newest frame is dropped when
+//there is none. returns 0 when the packet is not to be queued
+static int web_client_room(Web_t* web, WebClient_t* client, const WebPacket_t* packet)
+{
+    if (client->queue_num < WEB_CLIENT_QUEUE)
+    {
+        return 1;
+    }
+    for (uint32_t i = (client->queue_sent > 0) ? 1 : 0; i < client->queue_num; i++)
+    {
+        uint32_t index = (client->queue_head + i) % WEB_CLIENT_QUEUE;
+        if (!client->queue[index]->frame)
+        {
+            continue;
+        }
+        web_packet_release(web, client->queue[index]);
+        for (; i + 1 < client->queue_num; i++)
+        {
+            client->queue[(client->queue_head + i) % WEB_CLIENT_QUEUE] = \
+                client->queue[(client->queue_head + i + 1) % WEB_CLIENT_QUEUE];
+        }
+        client->queue_num--;
+        web->stats.dropped++;
+        return 1;
+    }
+    web->stats.dropped += packet->frame;
+    return 0;
+}
+
+//the frame's view of the client: 0 the full frame, 1 + the index of its zoomed view in views
+static int web_client_view(const WebClient_t* client, const ZoomView_t* views, int view_num)
+{
+    if (!zoom_view_active(&client->zoom))
+    {
+        return 0;
+    }
+    for (int i = 0; i < view_num; i++)
+    {
+        if (zoom_view_equal(&client->zoom, &views[i]))
+        {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+//queue the packet to every websocket client, or every mjpeg client for a part, one reference each. view -1 is
+//every client, else only the ones web_client_view gives that view of views
+static void web_publish(Web_t* web, WebPacket_t* packet, const ZoomView_t* views, int view_num, int view)
+{
+    packet->ref = 1;
+    for (int i = 0; i < WEB_MAX_CLIENTS; i++)
+    {
+        WebClient_t* client = &web->clients[i];
+        if (client->fd < 0 || !(packet->mjpeg ? client->mjpeg : client->websocket) || client->closing || \
+            (view >= 0 && web_client_view(client, views, view_num) != view) || !web_client_room(web, client, packet))
+        {
+            continue;
+        }
+        client->queue[(client->queue_head + client->queue_num) % WEB_CLIENT_QUEUE] = packet;
+        client->queue_num++;
+        packet->ref++;
+    }
+    web_packet_release(web, packet);
+#if !defined(_WIN32)
+    uint8_t wake = 1;
+    if (write(web->wake_fd[1], &wake, 1) < 0)
+    {
+        //the pipe is full, the server thread is already woken
+    }
+#endif
+}
+
+//the text message of a frame, celsius of its temp stats
+static int web_frame_json(const FrameDesc_t* desc, uint32_t width, uint32_t height, char* dst, int size)
+{
+    int len = snprintf(dst, size, "{\"type\":\"frame\",\"seq\":%llu,\"timestamp_us\":%llu,\"width\":%u,\"height\":%u," \
+        "\"temp_invalid\":%s,\"temp\":", (unsigned long long)desc->seq, (unsigned long long)desc->timestamp_us, width, \
+        height, (desc->flags & FRAME_DESC_TEMP_INVALID) ? "true" : "false");
+    const FrameStats_t* stats = desc->temp_stats;
+    if (stats != NULL && stats->valid && (desc->flags & FRAME_DESC_TEMP_STATS))
+    {
+        len += snprintf(dst + len, size - len, "{\"min\":%.2f,\"max\":%.2f,\"mean\":%.2f,\"min_x\":%u,\"min_y\":%u," \
+            "\"max_x\":%u,\"max_y\":%u}}", temp_celsius_of_raw(stats->min_val), temp_celsius_of_raw(stats->max_val), \
+            temp_celsius_of_raw((TempRaw_t)(stats->mean + 0.5f)), stats->min_x, stats->min_y, stats->max_x, stats->max_y);
+    }
+    else
+    {
+        len += snprintf(dst + len, size - len, "null}");
+    }
+    return (len < size) ? len : size - 1;
+}
+
+//the full frame's jpeg as one multipart part, shared by every mjpeg client
+static void web_mjpeg_publish(Web_t* web, uint32_t file_size)
+{
+    WebPacket_t* packet = web_packet_alloc(web, WEB_MJPEG_PART_LEN + file_size + 2);
+    if (packet == NULL)
+    {
+        return;
+    }
+    packet->size = (uint32_t)snprintf((char*)packet->data, WEB_MJPEG_PART_LEN, "--" WEB_MJPEG_BOUNDARY "\r\n" \
+        "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n", file_size);
+    memcpy(packet->data + packet->size, web->file, file_size);
+    packet->size += file_size;
+    memcpy(packet->data + packet->size, "\r\n", 2);
+    packet->size += 2;
+    packet->frame = 1;
+    packet->mjpeg = 1;
+    web_publish(web, packet, NULL, 0, -1);
+}
+
+//color and encode one view of the frame, 0 the full frame, and queue it to the clients of that view, the full
+//frame to the mjpeg clients as well. returns 1 when it was queued
+static int web_frame_view(Web_t* web, FrameSlot_t* slot, const ZoomView_t* views, int view_num, int view)
+{
+    JpegYuv420_t yuv;
+    if (snapshot_color_frame_yuv420(palette_active(), &slot->desc, web->stream_frame_info->config->image_info.input_format, \
+        (view > 0) ? &views[view - 1] : NULL, (view > 0) ? &web->zoom_maps[view - 1] : NULL, web->yuv, web->rows, \
+        &yuv) < 0)
+    {
+        return 0;
+    }
+    int file_size = jpeg_encode_yuv420(&web->jpeg, &yuv, NULL, 0, web->file, web->file_capacity);
+    if (file_size < 0)
+    {
+        return 0;
+    }
+    char text[WEB_STATS_LEN];
+    int text_len = web_frame_json(&slot->desc, yuv.width, yuv.height, text, sizeof(text));
+
+    pthread_mutex_lock(&web->mutex);
+    int sent = 0;
+    if (web->running && web->watched)
+    {
+        WebPacket_t* packet = web_packet_alloc(web, 2 * WEB_WS_HEADER + text_len + file_size);
+        if (packet != NULL)
+        {
+            packet->size = 0;
+            packet->frame = 1;
+            packet->mjpeg = 0;
+            web_ws_append(packet, WEB_WS_OP_TEXT, text, (uint32_t)text_len);
+            web_ws_append(packet, WEB_WS_OP_BINARY, web->file, (uint32_t)file_size);
+            web_publish(web, packet, views, view_num, view);
+            sent = 1;
+        }
+    }
+    if (web->running && web->mjpeg_watched && view == 0)
+    {
+        web_mjpeg_publish(web, (uint32_t)file_size);
+        sent = 1;
+    }
+    web->stats.frames += sent;
+    pthread_mutex_unlock(&web->mutex);
+    return sent;
+}
+
+//ring task: color and encode the frame once per view of the connected websocket clients, queue each to the
+//clients of its view
+static void web_frame_task(FrameSlot_t* slot, void* arg)
+{
+    Web_t* web = (Web_t*)arg;
+    ZoomView_t views[WEB_ZOOM_VIEWS];
+    int view_num = 0;
+    int full = 0;
+    pthread_mutex_lock(&web->mutex);
+    uint32_t interval = (web->param.frame_interval > 0) ? web->param.frame_interval : 1;
+    int push = web->running && (web->watched || web->mjpeg_watched) && web->yuv != NULL && \
+        (web->frame_cnt++ % interval) == 0;
+    for (int i = 0; push && i < WEB_MAX_CLIENTS; i++)
+    {
+        const WebClient_t* client = &web->clients[i];
+        if (client->fd < 0 || !(client->websocket || client->mjpeg) || client->closing || \
+            web_client_view(client, views, view_num) != 0)
+        {
+            continue;
+        }
+        if (zoom_view_active(&client->zoom) && view_num < WEB_ZOOM_VIEWS)
+        {
+            views[view_num++] = client->zoom;
+        }
+        else
+        {
+            full = 1;
+        }
+    }
+    pthread_mutex_unlock(&web->mutex);
+    if (!push)
+    {
+        return;
+    }
+    //the task's strand runs one frame at a time, yuv, rows, file and the zoom maps are its own
+    int sent = 0;
+    for (int view = full ? 0 : 1; view <= view_num; view++)
+    {
+        sent |= web_frame_view(web, slot, views, view_num, view);
+    }
+    if (sent)
+    {
+        latency_probe_sink(web->stream_frame_info->latency_probe, LATENCY_SINK_NETWORK, slot->seq);
+    }
+}
+
+void web_alarm_events(const AlarmEvent_t* events, int event_num, void* arg)
+{
+    Web_t* web = (Web_t*)arg;
+    if (web == NULL || events == NULL || event_num <= 0)
+    {
+        return;
+    }
+    uint32_t capacity = 32 + event_num * WEB_EVENT_LEN;
+    char* text = (char*)malloc(capacity);
+    if (text == NULL)
+    {
+        return;
+    }
+    int len = snprintf(text, capacity, "{\"type\":\"alarm\",\"events\":[");
+    for (int i = 0; i < event_num; i++)
+    {
+        const AlarmEvent_t* event = &events[i];
+        len += snprintf(text + len, capacity - len, "%s{\"event\":\"%s\",\"seq\":%llu,\"track\":%u,\"max\":%.2f," \
+            "\"x\":%u,\"y\":%u,\"box\":[%u,%u,%u,%u],\"area\":%u,\"hot_area\":%u}", (i > 0) ? "," : "", \
+            alarm_event_name((AlarmEventType_t)event->type), (unsigned long long)event->seq, event->track_id, \
+            temp_celsius_of_raw(event->max_temp), event->max_x, event->max_y, event->x0, event->y0, event->x1, \
+            event->y1, event->area, event->hot_area);
+    }
+    len += snprintf(text + len, capacity - len, "]}");
+
+    pthread_mutex_lock(&web->mutex);
+    WebPacket_t* packet = (web->running && web->watched) ? web_packet_alloc(web, WEB_WS_HEADER + len) : NULL;
+    if (packet != NULL)
+    {
+        packet->size = 0;
+        packet->frame = 0;
+        packet->mjpeg = 0;
+        web_ws_append(packet, WEB_WS_OP_TEXT, text, (uint32_t)len);
+        web->stats.events += event_num;
+        web_publish(web, packet, NULL, 0, -1);
+    }
+    pthread_mutex_unlock(&web->mutex);
+    free(text);
+}
+
+int web_attach(Web_t* web, StreamFrameInfo_t* stream_frame_info)
+{
+    if (web == NULL || stream_frame_info == NULL || stream_frame_info->frame_ring == NULL)
+    {
+        return WEB_ERROR_PARAM;
+    }
+    memset(web, 0, sizeof(Web_t));
+    web->stream_frame_info = stream_frame_info;
+    web->listen_fd = -1;
+    web->wake_fd[0] = -1;
+    web->wake_fd[1] = -1;
+    for (int i = 0; i < WEB_MAX_CLIENTS; i++)
+    {
+        web->clients[i].fd = -1;
+    }
+    pthread_mutex_init(&web->mutex, NULL);
+    //a dashboard shows the newest frame, a slow encode skips the ones in between
+    web->consumer_id = ring_consumer_attach_task(stream_frame_info->frame_ring, RING_POLICY_NEWEST, \
+        POOL_STAGE_ENCODE, web_frame_task, web);
+    if (web->consumer_id < 0)
+    {
+        pthread_mutex_destroy(&web->mutex);
+        return WEB_ERROR_PARAM;
+    }
+    return WEB_SUCCESS;
+}
+
+#if !defined(_WIN32)
+//sha-1 of the handshake, rfc 3174
+static void web_sha1(const uint8_t* data, uint32_t len, uint8_t digest[20])
+{
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint64_t bits = (uint64_t)len * 8;
+    uint32_t total = ((len + 8) / 64 + 1) * 64;
+    for (uint32_t offset = 0; offset < total; offset += 64)
+    {
+        uint8_t block[64];
+        for (uint32_t i = 0; i < 64; i++)
+        {
+            uint32_t pos = offset + i;
+            block[i] = (pos < len) ? data[pos] : ((pos == len) ? 0x80 : 0);
+        }
+        if (offset + 64 == total)
+        {
+            for (int i = 0; i < 8; i++)
+            {
+                block[56 + i] = (uint8_t)(bits >> (56 - 8 * i));
+            }
+        }
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++)
+        {
+            w[i] = ((uint32_t)block[4 * i] << 24) | ((uint32_t)block[4 * i + 1] << 16) | \
+                ((uint32_t)block[4 * i + 2] << 8) | block[4 * i + 3];
+        }
+        for (int i = 16; i < 80; i++)
+        {
+            uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = (x << 1) | (x >> 31);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++)
+        {
+            uint32_t f, k;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t tmp = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = (b << 30) | (b >> 2);
+            b = a;
+            a = tmp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 20; i++)
+    {
+        digest[i] = (uint8_t)(h[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+static void web_base64(const uint8_t* src, uint32_t len, char* dst)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint32_t i = 0;
+    for (; i + 2 < len; i += 3)
+    {
+        uint32_t v = ((uint32_t)src[i] << 16) | ((uint32_t)src[i + 1] << 8) | src[i + 2];
+        *dst++ = table[v >> 18];
+        *dst++ = table[(v >> 12) & 63];
+        *dst++ = table[(v >> 6) & 63];
+        *dst++ = table[v & 63];
+    }
+    if (i < len)
+    {
+        uint32_t v = ((uint32_t)src[i] << 16) | ((i + 1 < len) ? (uint32_t)src[i + 1] << 8 : 0);
+        *dst++ = table[v >> 18];
+        *dst++ = table[(v >> 12) & 63];
+        *dst++ = (i + 1 < len) ? table[(v >> 6) & 63] : '=';
+        *dst++ = '=';
+    }
+    *dst = 0;
+}
+
+//value of a request header, empty when it is missing
+static void web_header_get(const char* request, const char* name, char* value, int value_len)
+{
+    size_t name_len = strlen(name);
+    value[0] = 0;
+    for (const char* line = strstr(request, "\r\n"); line != NULL; line = strstr(line, "\r\n"))
+    {
+        line += 2;
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':')
+        {
+            const char* p = line + name_len + 1;
+            while (*p == ' ')
+            {
+                p++;
+            }
+            int len = 0;
+            while (p[len] != 0 && p[len] != '\r' && len < value_len - 1)
+            {
+                len++;
+            }
+            memcpy(value, p, len);
+            value[len] = 0;
+            return;
+        }
+    }
+}
+
+static void web_reply(WebClient_t* client, const void* data, uint32_t len)
+{
+    if (client->reply_len + len > WEB_REPLY_LEN)
+    {
+        client->closing = 1;
+        return;
+    }
+    memcpy(client->reply + client->reply_len, data, len);
+    client->reply_len += len;
+}
+
+//GET / gives the page, GET /ws with a websocket upgrade and GET /stream.mjpg turn the connection into a push
+//client, one request of any other kind is answered and the connection closed
+static void web_client_request(Web_t* web, WebClient_t* client, char* request)
+{
+    char method[16] = { 0 }, path[256] = { 0 }, value[256], reply[512];
+    sscanf(request, "%15s %255s", method, path);
+    char* query = strchr(path, '?');
+    if (query != NULL)
+    {
+        *query = 0;
+    }
+    web->stats.requests++;
+    web_header_get(request, "Upgrade", value, sizeof(value));
+    if (strcmp(method, "GET") == 0 && strcmp(path, "/ws") == 0 && strcasecmp(value, "websocket") == 0)
+    {
+        char key[128];
+        web_header_get(request, "Sec-WebSocket-Key", value, sizeof(value));
+        int key_len = snprintf(key, sizeof(key), "%s%s", value, WEB_WS_GUID);
+        uint8_t digest[20];
+        char accept[32];
+        web_sha1((const uint8_t*)key, (uint32_t)key_len, digest);
+        web_base64(digest, sizeof(digest), accept);
+        int len = snprintf(reply, sizeof(reply), "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n" \
+            "Connection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", accept);
+        web_reply(client, reply, (uint32_t)len);
+        client->websocket = 1;
+        web->stats.clients++;
+        web_watched_update(web);
+        return;
+    }
+    if (strcmp(method, "GET") == 0 && strcmp(path, "/stream.mjpg") == 0)
+    {
+        int len = snprintf(reply, sizeof(reply), "HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace; " \
+            "boundary=" WEB_MJPEG_BOUNDARY "\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n");
+        web_reply(client, reply, (uint32_t)len);
+        client->mjpeg = 1;
+        web->stats.mjpeg_clients++;
+        web_watched_update(web);
+        return;
+    }
+    int found = (strcmp(method, "GET") == 0 && (strcmp(path, "/") == 0 || strcmp(path, "/index.html") == 0));
+    const char* body = found ? web_page : "not found\n";
+    uint32_t body_len = found ? sizeof(web_page) - 1 : 10;
+    int len = snprintf(reply, sizeof(reply), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %u\r\n" \
+        "Cache-Control: no-cache\r\nConnection: close\r\n\r\n", found ? "200 OK" : "404 Not Found", \
+        found ? "text/html; charset=utf-8" : "text/plain", body_len);
+    web_reply(client, reply, (uint32_t)len);
+    web_reply(client, body, body_len);
+    client->closing = 1;
+}
+
+//the client's websocket frames: close and ping are answered, a short text message may set the client's zoom and
+//other data frames are not used. returns the bytes taken from the request buffer, 0 while a frame is incomplete
+static uint32_t web_client_frame(WebClient_t* client)
+{
+    const uint8_t* p = (const uint8_t*)client->request;
+    if (client->request_len < 2)
+    {
+        return 0;
+    }
+    int opcode = p[0] & 0x0F;
+    int masked = (p[1] & 0x80) != 0;
+    uint64_t len = p[1] & 0x7F;
+    uint32_t header = 2;
+    if (len == 126)
+    {
+        if (client->request_len < 4)
+        {
+            return 0;
+        }
+        len = ((uint32_t)p[2] << 8) | p[3];
+        header = 4;
+    }
+    else if (len == 127)
+    {
+        if (client->request_len < 10)
+        {
+            return 0;
+        }
+        len = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            len = (len << 8) | p[2 + i];
+        }
+        header = 10;
+    }
+    header += masked ? 4 : 0;
+    if (opcode < WEB_WS_OP_CLOSE && (opcode != WEB_WS_OP_TEXT || len > 125))
+    {
+        //data is discarded as it comes, it does not have to fit the buffer
+        if (client->request_len < header)
+        {
+            return 0;
+        }
+        client->skip = (len > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)len;
+        return header;
+    }
+    if (len > 125)
+    {
+        client->closing = 1;
+        return client->request_len;
+    }
+    if (client->request_len < header + len)
+    {
+        return 0;
+    }
+    uint8_t payload[125 + 1];
+    for (uint32_t i = 0; i < len; i++)
+    {
+        payload[i] = p[header + i] ^ (masked ? p[header - 4 + (i & 3)] : 0);
+    }
+    payload[len] = 0;
+    float factor = 1, x = 0.5f, y = 0.5f;
+    if (opcode == WEB_WS_OP_TEXT && sscanf((const char*)payload, "zoom %f %f %f", &factor, &x, &y) >= 1)
+    {
+        zoom_view_set(&client->zoom, factor, x, y, ZOOM_SAMPLE_BILINEAR);
+    }
+    if (opcode == WEB_WS_OP_PING || opcode == WEB_WS_OP_CLOSE)
+    {
+        uint8_t frame[2 + 125];
+        uint32_t frame_len = web_ws_header(frame, (opcode == WEB_WS_OP_PING) ? WEB_WS_OP_PONG : WEB_WS_OP_CLOSE, len);
+        memcpy(frame + frame_len, payload, len);
+        web_reply(client, frame, frame_len + (uint32_t)len);
+    }
+    if (opcode == WEB_WS_OP_CLOSE)
+    {
+        client->closing = 1;
+    }
+    return header + (uint32_t)len;
+}
+
+static void web_client_close(Web_t* web, WebClient_t* client)
+{
+    web_client_reset(web, client);
+    close(client->fd);
+    memset(client, 0, sizeof(WebClient_t));
+    client->fd = -1;
+    web_watched_update(web);
+}
+
+//returns -1 when the connection is gone
+static int web_client_read(Web_t* web, WebClient_t* client)
+{
+    int len = (int)recv(client->fd, client->request + client->request_len, \
+        WEB_REQUEST_LEN - 1 - client->request_len, 0);
+    if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+        return -1;
+    }
+    if (len < 0)
+    {
+        return 0;
+    }
+    client->request_len += len;
+    while (client->request_len > 0 && !client->closing)
+    {
+        uint32_t used = 0;
+        if (client->skip > 0)
+        {
+            used = (client->skip < client->request_len) ? client->skip : client->request_len;
+            client->skip -= used;
+        }
+        else if (client->mjpeg)
+        {
+            //nothing more is read from a player
+            used = client->request_len;
+        }
+        else if (client->websocket)
+        {
+            used = web_client_frame(client);
+            if (used == 0)
+            {
+                return (client->request_len == WEB_REQUEST_LEN - 1) ? -1 : 0;
+            }
+        }
+        else
+        {
+            client->request[client->request_len] = 0;
+            char* end = strstr(client->request, "\r\n\r\n");
+            if (end == NULL)
+            {
+                return (client->request_len == WEB_REQUEST_LEN - 1) ? -1 : 0;
+            }
+            end[2] = 0;
+            web_client_request(web, client, client->request);
+            used = (uint32_t)(end + 4 - client->request);
+        }
+        memmove(client->request, client->request + used, client->request_len - used);
+        client->request_len -= used;
+    }
+    return 0;
+}
+
+static int web_send(Web_t* web, int fd, const uint8_t* data, uint32_t size, uint32_t* sent)
+{
+    while (*sent < size)
+    {
+        int len = (int)send(fd, data + *sent, size - *sent, MSG_NOSIGNAL);
+        if (len < 0)
+        {
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        }
+        *sent += len;
+        web->stats.bytes += len;
+    }
+    return 1;
+}
+
+//a started packet is finished before a reply goes out, then the queued messages follow
+//returns -1 when the connection is gone
+static int web_client_flush(Web_t* web, WebClient_t* client)
+{
+    int first = (client->queue_sent > 0);
+    for (;;)
+    {
+        if (!first && client->reply_sent < client->reply_len)
+        {
+            int rst = web_send(web, client->fd, (const uint8_t*)client->reply, client->reply_len, &client->reply_sent);
+            if (rst <= 0)
+            {
+                return rst;
+            }
+            client->reply_len = 0;
+            client->reply_sent = 0;
+        }
+        if (client->queue_num == 0 || client->closing)
+        {
+            return 0;
+        }
+        WebPacket_t* packet = client->queue[client->queue_head];
+        int rst = web_send(web, client->fd, packet->data, packet->size, &client->queue_sent);
+        if (rst <= 0)
+        {
+            return rst;
+        }
+        web_packet_release(web, packet);
+        client->queue_head = (client->queue_head + 1) % WEB_CLIENT_QUEUE;
+        client->queue_num--;
+        client->queue_sent = 0;
+        first = 0;
+    }
+}
+
+static void web_accept(Web_t* web)
+{
+    int fd = accept(web->listen_fd, NULL, NULL);
+    if (fd < 0)
+    {
+        return;
+    }
+    WebClient_t* client = NULL;
+    for (int i = 0; i < WEB_MAX_CLIENTS && client == NULL; i++)
+    {
+        if (web->clients[i].fd < 0)
+        {
+            client = &web->clients[i];
+        }
+    }
+    if (client == NULL)
+    {
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    memset(client, 0, sizeof(WebClient_t));
+    client->fd = fd;
+}
+
+//server thread: accepts, answers http requests and websocket control frames and sends the queued messages.
+//it never encodes, a frame reaches it as a finished packet
+static void* web_server_function(void* threadarg)
+{
+    Web_t* web = (Web_t*)threadarg;
+    struct pollfd pfds[WEB_MAX_CLIENTS + 2];
+    int pfd_client[WEB_MAX_CLIENTS + 2];
+    pthread_mutex_lock(&web->mutex);
+    while (web->running)
+    {
+        int pfd_num = 0;
+        pfds[pfd_num].fd = web->listen_fd;
+        pfds[pfd_num].events = POLLIN;
+        pfd_client[pfd_num++] = -1;
+        pfds[pfd_num].fd = web->wake_fd[0];
+        pfds[pfd_num].events = POLLIN;
+        pfd_client[pfd_num++] = -1;
+        for (int i = 0; i < WEB_MAX_CLIENTS; i++)
+        {
+            WebClient_t* client = &web->clients[i];
+            if (client->fd < 0)
+            {
+                continue;
+            }
+            pfds[pfd_num].fd = client->fd;
+            pfds[pfd_num].events = POLLIN;
+            if (client->reply_sent < client->reply_len || client->queue_num > 0)
+            {
+                pfds[pfd_num].events |= POLLOUT;
+            }
+            pfd_client[pfd_num++] = i;
+        }
+        pthread_mutex_unlock(&web->mutex);
+        poll(pfds, pfd_num, WEB_POLL_MS);
+        pthread_mutex_lock(&web->mutex);
+
+        if (pfds[1].revents & POLLIN)
+        {
+            uint8_t wake[64];
+            while (read(web->wake_fd[0], wake, sizeof(wake)) > 0)
+            {
+            }
+        }
+        if (pfds[0].revents & POLLIN)
+        {
+            web_accept(web);
+        }
+        for (int n = 2; n < pfd_num; n++)
+        {
+            WebClient_t* client = &web->clients[pfd_client[n]];
+            if (client->fd != pfds[n].fd)
+            {
+                continue;
+            }
+            if ((pfds[n].revents & (POLLERR | POLLHUP | POLLNVAL)) || \
+                ((pfds[n].revents & POLLIN) && web_client_read(web, client) < 0))
+            {
+                web_client_close(web, client);
+            }
+        }
+        //messages queued while polling are sent without waiting for POLLOUT
+        for (int i = 0; i < WEB_MAX_CLIENTS; i++)
+        {
+            WebClient_t* client = &web->clients[i];
+            if (client->fd < 0)
+            {
+                continue;
+            }
+            if (web_client_flush(web, client) < 0 || \
+                (client->closing && client->reply_sent == client->reply_len && client->queue_sent == 0))
+            {
+                web_client_close(web, client);
+            }
+        }
+    }
+    pthread_mutex_unlock(&web->mutex);
+    return NULL;
+}
+
+//bind the port, size the encoder's buffers for the larger plane and start the server thread
+int web_start(Web_t* web, const WebParam_t* param)
+{
+    if (web == NULL || param == NULL || web->stream_frame_info == NULL || web->running)
+    {
+        return WEB_ERROR_PARAM;
+    }
+    web->param = *param;
+    if (web->param.port == 0)
+    {
+        web->param.port = WEB_DEFAULT_PORT;
+    }
+    const StreamConfig_t* config = web->stream_frame_info->config;
+    uint32_t width = (config->image_info.width > config->temp_info.width) ? config->image_info.width : \
+        config->temp_info.width;
+    uint32_t height = (config->image_info.height > config->temp_info.height) ? config->image_info.height : \
+        config->temp_info.height;
+    web->file_capacity = jpeg_bound(width, height, 0);
+    web->yuv = (uint8_t*)malloc(jpeg_yuv420_size(width, height));
+    web->rows = (uint8_t*)malloc((size_t)(width + 15) * 6);
+    web->file = (uint8_t*)malloc(web->file_capacity);
+    if (width == 0 || height == 0 || web->yuv == NULL || web->rows == NULL || web->file == NULL || \
+        jpeg_init(&web->jpeg, (web->param.quality > 0) ? web->param.quality : WEB_DEFAULT_QUALITY) != JPEG_SUCCESS)
+    {
+        web_stop(web);
+        return WEB_ERROR_MEM;
+    }
+
+    web->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(web->param.port);
+    if (web->listen_fd < 0 || \
+        setsockopt(web->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 || \
+        bind(web->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(web->listen_fd, 4) < 0 || \
+        pipe(web->wake_fd) < 0)
+    {
+        printf("web: listen on port %u failed\n", web->param.port);
+        web_stop(web);
+        return WEB_ERROR_SOCKET;
+    }
+    fcntl(web->listen_fd, F_SETFL, fcntl(web->listen_fd, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(web->wake_fd[0], F_SETFL, fcntl(web->wake_fd[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(web->wake_fd[1], F_SETFL, fcntl(web->wake_fd[1], F_GETFL, 0) | O_NONBLOCK);
+
+    memset(&web->stats, 0, sizeof(WebStats_t));
+    web->frame_cnt = 0;
+    web->running = 1;
+    if (pthread_create(&web->thread, NULL, web_server_function, web) != 0)
+    {
+        web->running = 0;
+        web_stop(web);
+        return WEB_ERROR_SOCKET;
+    }
+    printf("web: http://<host>:%u/\n", web->param.port);
+    return WEB_SUCCESS;
+}
+
+int web_stop(Web_t* web)
+{
+    if (web == NULL)
+    {
+        return WEB_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&web->mutex);
+    int running = web->running;
+    web->running = 0;
+    pthread_mutex_unlock(&web->mutex);
+    if (running)
+    {
+        uint8_t wake = 1;
+        if (write(web->wake_fd[1], &wake, 1) < 0)
+        {
+        }
+        pthread_join(web->thread, NULL);
+    }
+
+    pthread_mutex_lock(&web->mutex);
+    for (int i = 0; i < WEB_MAX_CLIENTS; i++)
+    {
+        if (web->clients[i].fd >= 0)
+        {
+            web_client_close(web, &web->clients[i]);
+        }
+    }
+    if (web->listen_fd >= 0)
+    {
+        close(web->listen_fd);
+        web->listen_fd = -1;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (web->wake_fd[i] >= 0)
+        {
+            close(web->wake_fd[i]);
+            web->wake_fd[i] = -1;
+        }
+    }
+    for (int i = 0; i < web->cache_num; i++)
+    {
+        free(web->cache[i]->data);
+        free(web->cache[i]);
+    }
+    web->cache_num = 0;
+    pthread_mutex_unlock(&web->mutex);
+    //a ring task that saw the server running finishes its frame first, ring_close waits for it
+    if (running)
+    {
+        printf("web: %llu requests, %llu websocket clients, %llu mjpeg clients, %llu frames, %llu alarm events, " \
+            "%llu frames dropped for slow clients, %llu bytes sent\n", (unsigned long long)web->stats.requests, \
+            (unsigned long long)web->stats.clients, (unsigned long long)web->stats.mjpeg_clients, \
+            (unsigned long long)web->stats.frames, \
+            (unsigned long long)web->stats.events, (unsigned long long)web->stats.dropped, \
+            (unsigned long long)web->stats.bytes);
+    }
+    return WEB_SUCCESS;
+}
+#else
+int web_start(Web_t* web, const WebParam_t* param)
+{
+    //the server is written against posix sockets and poll
+    return WEB_ERROR_SOCKET;
+}
+
+int web_stop(Web_t* web)
+{
+    return WEB_SUCCESS;
+}
+#endif
+
+int web_stats(Web_t* web, WebStats_t* stats)
+{
+    if (web == NULL || stats == NULL)
+    {
+        return WEB_ERROR_PARAM;
+    }
+    pthread_mutex_lock(&web->mutex);
+    *stats = web->stats;
+    pthread_mutex_unlock(&web->mutex);
+    return WEB_SUCCESS;
+}
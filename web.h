@@ -0,0 +1,119 @@
+#ifndef _WEB_H_
+#define _WEB_H_
+
+//browser dashboard: an embedded http server gives a page on / that opens a websocket on /ws, and every pushed
+//frame goes to its clients as a text message of the frame's temp stats and a binary message of the palette
+//colored jpeg, alarm events as text messages of their own. GET /stream.mjpg streams the full frame's jpegs as a
+//multipart/x-mixed-replace response for players and <img> tags. a frame is colored (4:2:0, straight from the
+//palette's yuv lut) and encoded once for all clients of the same view (a client zooms its own with a
+//"zoom <factor> <x> <y>" text message) and once more wrapped for the mjpeg clients, a client that falls behind
+//loses its oldest frame instead of slowing the others, and the server thread only polls sockets, the encoding
+//runs on the task pool
+#include <stdint.h>
+#include <pthread.h>
+#include "data.h"
+#include "jpeg.h"
+#include "alarm.h"
+#include "zoom.h"
+
+#define WEB_DEFAULT_PORT 8080
+#define WEB_DEFAULT_QUALITY 75
+#define WEB_MAX_CLIENTS 16
+#define WEB_CLIENT_QUEUE 4              //messages waiting for one client, a full queue drops its oldest frame
+#define WEB_PACKET_CACHE 8              //released message buffers kept for reuse
+#define WEB_REQUEST_LEN 2048
+#define WEB_REPLY_LEN 4096
+#define WEB_STATS_LEN 512               //the text message of one frame
+#define WEB_EVENT_LEN 160               //json of one alarm event
+#define WEB_ZOOM_VIEWS 4                //zoomed views encoded per frame, the clients of any other get the full frame
+#define WEB_MJPEG_BOUNDARY "irframe"
+#define WEB_MJPEG_PART_LEN 96           //the part header in front of each jpeg
+
+#define WEB_SUCCESS 0
+#define WEB_ERROR_PARAM -1
+#define WEB_ERROR_MEM -2
+#define WEB_ERROR_SOCKET -3
+
+typedef struct {
+    uint16_t port;                      //0 selects WEB_DEFAULT_PORT
+    int quality;                        //jpeg 1..100, 0 selects WEB_DEFAULT_QUALITY
+    uint32_t frame_interval;            //ring frames per pushed frame, 0 selects 1
+}WebParam_t;
+
+typedef struct {
+    uint64_t requests;                  //http requests answered, the page and 404s
+    uint64_t clients;                   //websocket connections
+    uint64_t mjpeg_clients;             //GET /stream.mjpg connections
+    uint64_t frames;                    //frames encoded, once for every client
+    uint64_t events;                    //alarm events pushed
+    uint64_t dropped;                   //frames a full client queue dropped
+    uint64_t bytes;                     //bytes sent to all clients
+}WebStats_t;
+
+//one or more complete websocket messages, shared by every client it is queued to
+typedef struct {
+    int ref;                            //queues holding it, under the server mutex
+    uint32_t size;
+    uint32_t capacity;
+    uint8_t frame;                      //a frame's stats and jpeg, the kind a full queue may drop
+    uint8_t mjpeg;                      //a multipart part for the mjpeg clients, else websocket messages
+    uint8_t* data;
+}WebPacket_t;
+
+typedef struct {
+    int fd;                             //-1 for a free entry
+    uint8_t websocket;                  //upgraded on /ws, pushed messages are queued to it
+    uint8_t mjpeg;                      //GET /stream.mjpg, the full frame's parts are queued to it
+    uint8_t closing;                    //close once the reply is sent
+    char request[WEB_REQUEST_LEN];
+    uint32_t request_len;
+    uint32_t skip;                      //bytes of a client's data frame still to discard
+    char reply[WEB_REPLY_LEN];          //http answers and websocket control frames
+    uint32_t reply_len;
+    uint32_t reply_sent;
+    WebPacket_t* queue[WEB_CLIENT_QUEUE];
+    uint32_t queue_head;
+    uint32_t queue_num;
+    uint32_t queue_sent;                //bytes of the head packet already sent
+    ZoomView_t zoom;                    //the client's view, factor 0 (a new client) or 1 the full frame
+}WebClient_t;
+
+typedef struct {
+    StreamFrameInfo_t* stream_frame_info;
+    WebParam_t param;
+    int consumer_id;
+    uint8_t running;
+    uint8_t watched;                    //a websocket client is connected, the ring task has work
+    uint8_t mjpeg_watched;              //an mjpeg client is
+    int listen_fd;
+    int wake_fd[2];                     //a queued message wakes the server thread
+    WebClient_t clients[WEB_MAX_CLIENTS];
+    uint32_t frame_cnt;
+    JpegEncoder_t jpeg;                 //the ring task's, like yuv, rows and file
+    uint8_t* yuv;                       //the view's 4:2:0 planes
+    uint8_t* rows;
+    uint8_t* file;
+    uint32_t file_capacity;
+    ZoomMap_t zoom_maps[WEB_ZOOM_VIEWS];
+    WebPacket_t* cache[WEB_PACKET_CACHE];
+    int cache_num;
+    WebStats_t stats;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+}Web_t;
+
+//register the frame push as a task consumer of the camera's frame ring, before streaming
+int web_attach(Web_t* web, StreamFrameInfo_t* stream_frame_info);
+
+//listen on param->port and serve the page and the websocket clients from a server thread
+int web_start(Web_t* web, const WebParam_t* param);
+
+//close every client and the listening socket
+int web_stop(Web_t* web);
+
+//AlarmEventFunc_t pushing the events to the websocket clients, arg is the web server
+void web_alarm_events(const AlarmEvent_t* events, int event_num, void* arg);
+
+int web_stats(Web_t* web, WebStats_t* stats);
+
+#endif
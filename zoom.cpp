@@ -0,0 +1,136 @@
+#include "zoom.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "simd.h"
+
+static float zoom_clamp(float v, float lo, float hi)
+{
+    return (v < lo) ? lo : ((v > hi) ? hi : v);
+}
+
+void zoom_view_reset(ZoomView_t* view)
+{
+    view->factor = 1.0f;
+    view->center_x = 0.5f;
+    view->center_y = 0.5f;
+    view->sample = ZOOM_SAMPLE_BILINEAR;
+}
+
+void zoom_view_set(ZoomView_t* view, float factor, float center_x, float center_y, ZoomSample_t sample)
+{
+    //nan fails every comparison, it becomes the full frame
+    view->factor = (factor >= 1.0f) ? ((factor < ZOOM_FACTOR_MAX) ? factor : ZOOM_FACTOR_MAX) : 1.0f;
+    float half = 0.5f / view->factor;
+    view->center_x = (center_x == center_x) ? zoom_clamp(center_x, half, 1.0f - half) : 0.5f;
+    view->center_y = (center_y == center_y) ? zoom_clamp(center_y, half, 1.0f - half) : 0.5f;
+    view->sample = ((unsigned)sample < ZOOM_SAMPLE_NUM) ? sample : ZOOM_SAMPLE_BILINEAR;
+}
+
+void zoom_view_pan(ZoomView_t* view, int dx, int dy)
+{
+    float step = ZOOM_PAN_STEP / view->factor;
+    zoom_view_set(view, view->factor, view->center_x + dx * step, view->center_y + dy * step, view->sample);
+}
+
+void zoom_view_step(ZoomView_t* view)
+{
+    float factor = (view->factor * 2 > ZOOM_FACTOR_MAX + 0.01f) ? 1.0f : view->factor * 2;
+    zoom_view_set(view, factor, view->center_x, view->center_y, view->sample);
+}
+
+int zoom_view_active(const ZoomView_t* view)
+{
+    return view != NULL && view->factor > 1.0f;
+}
+
+int zoom_view_equal(const ZoomView_t* a, const ZoomView_t* b)
+{
+    return a->factor == b->factor && a->center_x == b->center_x && a->center_y == b->center_y && \
+        a->sample == b->sample;
+}
+
+void zoom_map_init(ZoomMap_t* map)
+{
+    memset(map, 0, sizeof(ZoomMap_t));
+}
+
+void zoom_map_release(ZoomMap_t* map)
+{
+    if (map == NULL)
+    {
+        return;
+    }
+    free(map->col);
+    free(map->col_frac);
+    free(map->row);
+    free(map->row_frac);
+    free(map->line);
+    zoom_map_init(map);
+}
+
+//source tap and Q6 weight of every output position along one axis, the 2 taps always inside [0, len)
+static void zoom_axis(int len, float factor, float center, ZoomSample_t sample, uint32_t* tap, uint8_t* frac, \
+    uint32_t scale)
+{
+    float first = center * len - 0.5f * len / factor;
+    for (int i = 0; i < len; i++)
+    {
+        float pos = first + (i + 0.5f) / factor - 0.5f;
+        long q = (sample == ZOOM_SAMPLE_NEAREST) ? lroundf(pos) * 64 : lroundf(pos * 64);
+        q = (q < 0) ? 0 : ((q > (long)(len - 1) * 64) ? (long)(len - 1) * 64 : q);
+        long t = q >> 6;
+        long f = q & 63;
+        if (t >= len - 1)
+        {
+            t = len - 2;
+            f = 64;
+        }
+        tap[i] = (uint32_t)t * scale;
+        frac[i] = (uint8_t)f;
+    }
+}
+
+int zoom_map_update(ZoomMap_t* map, const ZoomView_t* view, int width, int height, int stride)
+{
+    if (map == NULL || view == NULL || width < 2 || height < 2 || stride < width)
+    {
+        return ZOOM_ERROR_PARAM;
+    }
+    if (map->valid && map->width == width && map->height == height && map->stride == stride && \
+        zoom_view_equal(&map->view, view))
+    {
+        return ZOOM_SUCCESS;
+    }
+    if (map->width != width || map->height != height)
+    {
+        zoom_map_release(map);
+        map->col = (uint32_t*)malloc(width * sizeof(uint32_t));
+        map->col_frac = (uint8_t*)malloc(width);
+        map->row = (uint32_t*)malloc(height * sizeof(uint32_t));
+        map->row_frac = (uint8_t*)malloc(height);
+        map->line = (uint16_t*)malloc(width * sizeof(uint16_t));
+        if (map->col == NULL || map->col_frac == NULL || map->row == NULL || map->row_frac == NULL || map->line == NULL)
+        {
+            zoom_map_release(map);
+            return ZOOM_ERROR_MEM;
+        }
+    }
+    map->view = *view;
+    map->width = width;
+    map->height = height;
+    map->stride = stride;
+    zoom_axis(width, view->factor, view->center_x, view->sample, map->col, map->col_frac, 1);
+    zoom_axis(height, view->factor, view->center_y, view->sample, map->row, map->row_frac, (uint32_t)stride);
+    map->valid = 1;
+    return ZOOM_SUCCESS;
+}
+
+const uint16_t* zoom_map_line(ZoomMap_t* map, const uint16_t* src, int y)
+{
+    uint32_t offset = map->row[y];
+    uint32_t src_len = (uint32_t)(map->height - 1) * map->stride + map->width - offset;
+    simd_remap_row_u16(src + offset, src_len, map->stride, map->col, map->col_frac, map->row_frac[y], map->width, \
+        map->line);
+    return map->line;
+}
@@ -0,0 +1,72 @@
+#ifndef _ZOOM_H_
+#define _ZOOM_H_
+
+//host side digital zoom and pan: a consumer keeps its own view of the frame, factor times magnified around a
+//center given as a share of the frame, and the frame it sends stays the frame size. the device's zoom commands
+//change the stream for every consumer and the analytics, this only the consumer's copy. a view becomes a separable
+//remap table once per zoom state (the source column and Q6 weight of every output column, the same for the rows),
+//the rows are then resampled by simd_remap_row_u16 right before each consumer's colorize maps them
+#include <stdint.h>
+
+#define ZOOM_FACTOR_MAX 8.0f
+#define ZOOM_PAN_STEP 0.25f             //zoom_view_pan: a share of the zoomed window per step
+
+#define ZOOM_SUCCESS 0
+#define ZOOM_ERROR_PARAM -1
+#define ZOOM_ERROR_MEM -2
+
+typedef enum
+{
+    ZOOM_SAMPLE_NEAREST = 0,            //whole pixels magnified, the values stay raw values
+    ZOOM_SAMPLE_BILINEAR,
+    ZOOM_SAMPLE_NUM,
+}ZoomSample_t;
+
+typedef struct {
+    float factor;                       //1..ZOOM_FACTOR_MAX, 1 is the full frame
+    float center_x;                     //center of the window, share of the frame width in [0, 1]
+    float center_y;
+    ZoomSample_t sample;
+}ZoomView_t;
+
+typedef struct {
+    ZoomView_t view;                    //what the tables were computed for
+    int width;                          //frame and output size
+    int height;
+    int stride;                         //source row in values
+    uint32_t* col;                      //per output column, source column of the left tap
+    uint8_t* col_frac;                  //Q6 weight of the right tap
+    uint32_t* row;                      //per output row, source offset of the top row's values
+    uint8_t* row_frac;
+    uint16_t* line;                     //one resampled row, what the colorize reads
+    uint8_t valid;
+}ZoomMap_t;
+
+//the full frame, bilinear
+void zoom_view_reset(ZoomView_t* view);
+
+//factor is clamped to [1, ZOOM_FACTOR_MAX] and the center to where the window stays inside the frame
+void zoom_view_set(ZoomView_t* view, float factor, float center_x, float center_y, ZoomSample_t sample);
+
+//move the window by dx, dy steps of ZOOM_PAN_STEP of its own size
+void zoom_view_pan(ZoomView_t* view, int dx, int dy);
+
+//x1 -> x2 -> x4 -> x8 -> x1 around the same center
+void zoom_view_step(ZoomView_t* view);
+
+int zoom_view_active(const ZoomView_t* view);
+
+int zoom_view_equal(const ZoomView_t* a, const ZoomView_t* b);
+
+void zoom_map_init(ZoomMap_t* map);
+
+void zoom_map_release(ZoomMap_t* map);
+
+//the tables for view over a width x height frame with stride values per row, recomputed only when one of them
+//changed. width and height at least 2
+int zoom_map_update(ZoomMap_t* map, const ZoomView_t* view, int width, int height, int stride);
+
+//output row y resampled from the frame src (map->stride values per row) into map->line, returns map->line
+const uint16_t* zoom_map_line(ZoomMap_t* map, const uint16_t* src, int y);
+
+#endif